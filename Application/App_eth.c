@@ -8,12 +8,31 @@
 #include "lwip/pbuf.h"
 #include "lwip/ip_addr.h"
 
-void reset_phy(void)
+/* HAL_GetTick() + 1 when the reset pulse started, 0 before */
+static uint32_t PhyResetStart;
+
+void reset_phy_start(void)
 {
   HAL_GPIO_WritePin(ETH_RST_GPIO_Port, ETH_RST_Pin, GPIO_PIN_RESET);
-  osDelay(55);
-  HAL_GPIO_WritePin(ETH_RST_GPIO_Port, ETH_RST_Pin, GPIO_PIN_SET);
-  osDelay(55);
+  PhyResetStart = HAL_GetTick() + 1U;
 }
 
+/* Sleeps only for what is left of the pulse started by reset_phy_start() */
+void reset_phy(void)
+{
+  uint32_t held;
+
+  if (PhyResetStart == 0U)
+  {
+    reset_phy_start();
+  }
+  held = HAL_GetTick() + 1U - PhyResetStart;
+  if (held < ETH_PHY_RESET_MS)
+  {
+    osDelay(ETH_PHY_RESET_MS - held);
+  }
+  HAL_GPIO_WritePin(ETH_RST_GPIO_Port, ETH_RST_Pin, GPIO_PIN_SET);
+  osDelay(ETH_PHY_SETTLE_MS);
+  PhyResetStart = 0U;
+}
 
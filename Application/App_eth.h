@@ -9,6 +9,18 @@
 #include "cmsis_os.h"
 #include "lwip/ip_addr.h"
 
+/* Reset pulse of the LAN8742 and the wait before it answers on MDIO */
+#ifndef ETH_PHY_RESET_MS
+#define ETH_PHY_RESET_MS 55U
+#endif
+
+#ifndef ETH_PHY_SETTLE_MS
+#define ETH_PHY_SETTLE_MS 55U
+#endif
+
+/* Asserts the PHY reset, from main() before the scheduler starts */
+void reset_phy_start(void);
+/* Completes the reset, task context */
 void reset_phy(void);
 
 
@@ -1,31 +1,195 @@
 #include "board.h"
 #include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "timesync/timesync.h"
+#include "timesync/time_ns.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 
 extern RTC_HandleTypeDef hrtc;
-char* board_get_timestamp(char* buffer, size_t buffer_size)
+
+/* Timestamp cache: the RTC is read once, then time is advanced from
+ * HAL_GetTick(). Only the seconds digits are patched while the minute is
+ * unchanged; a minute rollover re-reads the RTC, which also bounds drift
+ * between the tick and the RTC to a few milliseconds. Once SNTP has set
+ * the clock, time comes from time_utc_ns() instead: slewed, so it
+ * never goes backwards, and the minute rollover renders the date from it
+ * without touching the RTC. */
+typedef struct {
+    uint32_t base_tick;     /* HAL tick when the RTC was read */
+    uint32_t base_ms;       /* RTC milliseconds of day at base_tick */
+    uint32_t rendered_sec;  /* second of day currently held in text */
+    char text[20];          /* "YYYY-MM-DD HH:MM:SS" */
+    bool valid;
+#if TIMESYNC
+    bool utc;               /* from timesync, not the RTC */
+    uint64_t day_ms;        /* timesync UTC milliseconds at 00:00 of the day */
+#endif
+} BoardTsCache_t;
+
+static BoardTsCache_t ts_cache;
+
+#if TIMESYNC
+/* board_ts_resync() from the disciplined UTC clock */
+static void board_ts_resync_utc(uint32_t now)
 {
-    /* Needs "YYYY-MM-DD HH:MM:SS" => 19 chars + null */
-    if (buffer_size < 20) {
-        if (buffer_size > 0) buffer[0] = '\0';
-        return buffer;
+    uint64_t ms = time_utc_ns() / 1000000U;
+    uint32_t ms_of_day = (uint32_t)(ms % 86400000U);
+    uint32_t sec = ms_of_day / 1000U;
+    int32_t year;
+    uint32_t month;
+    uint32_t day;
+
+    timesync_civil_from_days((int32_t)(ms / 86400000U), &year, &month, &day);
+    ts_cache.day_ms = ms - ms_of_day;
+    ts_cache.base_tick = now;
+    ts_cache.base_ms = ms_of_day;
+    ts_cache.rendered_sec = sec;
+    snprintf(ts_cache.text, sizeof(ts_cache.text), "%04lu-%02lu-%02lu %02lu:%02lu:%02lu",
+             (unsigned long)year,
+             (unsigned long)month,
+             (unsigned long)day,
+             (unsigned long)(sec / 3600U),
+             (unsigned long)((sec / 60U) % 60U),
+             (unsigned long)(sec % 60U));
+    ts_cache.utc = true;
+    ts_cache.valid = true;
+}
+#endif
+
+/* Milliseconds of day in the cache's day. From timesync the tick base
+ * moves along on every call, for board_get_timestamp_at(). */
+static uint32_t board_ts_ms(uint32_t now)
+{
+#if TIMESYNC
+    if (ts_cache.utc) {
+        ts_cache.base_ms = (uint32_t)(time_utc_ns() / 1000000U - ts_cache.day_ms);
+        ts_cache.base_tick = now;
+        return ts_cache.base_ms;
     }
+#endif
+    return ts_cache.base_ms + (now - ts_cache.base_tick);
+}
 
+/* Reads the RTC (or timesync, once synced) and fully re-renders the
+ * cache. Caller masks interrupts. */
+static bool board_ts_resync(uint32_t now)
+{
     RTC_TimeTypeDef sTime = {0};
     RTC_DateTypeDef sDate = {0};
 
+#if TIMESYNC
+    if (timesync_synced()) {
+        board_ts_resync_utc(now);
+        return true;
+    }
+    ts_cache.utc = false;
+#endif
     if (HAL_RTC_GetTime(&hrtc, &sTime, RTC_FORMAT_BIN) != HAL_OK ||
         HAL_RTC_GetDate(&hrtc, &sDate, RTC_FORMAT_BIN) != HAL_OK) {
-        buffer[0] = '\0';
-        return buffer;
+        ts_cache.valid = false;
+        return false;
     }
 
+    uint32_t sec = (uint32_t)sTime.Hours * 3600U + (uint32_t)sTime.Minutes * 60U + sTime.Seconds;
+    /* SSR counts down from SecondFraction within each second. */
+    uint32_t frac_ms = ((sTime.SecondFraction - sTime.SubSeconds) * 1000U) / (sTime.SecondFraction + 1U);
+
+    ts_cache.base_tick = now;
+    ts_cache.base_ms = sec * 1000U + frac_ms;
+    ts_cache.rendered_sec = sec;
+
     uint32_t year = 2000U + (uint32_t)sDate.Year;
-    snprintf(buffer, buffer_size, "%04lu-%02lu-%02lu %02lu:%02lu:%02lu",
+    snprintf(ts_cache.text, sizeof(ts_cache.text), "%04lu-%02lu-%02lu %02lu:%02lu:%02lu",
              (unsigned long)year,
              (unsigned long)sDate.Month,
              (unsigned long)sDate.Date,
              (unsigned long)sTime.Hours,
              (unsigned long)sTime.Minutes,
              (unsigned long)sTime.Seconds);
+    ts_cache.valid = true;
+    return true;
+}
+
+char* board_get_timestamp(char* buffer, size_t buffer_size)
+{
+    /* Needs "YYYY-MM-DD HH:MM:SS" => 19 chars + null */
+    if (buffer_size < 20) {
+        if (buffer_size > 0) buffer[0] = '\0';
+        return buffer;
+    }
+
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    uint32_t now = HAL_GetTick();
+    uint32_t ms = board_ts_ms(now);
+    uint32_t sec = ms / 1000U;
+    bool stale = !ts_cache.valid || sec / 60U != ts_cache.rendered_sec / 60U;
+
+#if TIMESYNC
+    stale = stale || ts_cache.utc != timesync_synced();
+#endif
+    if (stale) {
+        if (!board_ts_resync(now)) {
+            taskEXIT_CRITICAL_FROM_ISR(mask);
+            buffer[0] = '\0';
+            return buffer;
+        }
+        ms = ts_cache.base_ms;
+    } else if (sec != ts_cache.rendered_sec) {
+        uint32_t ss = sec % 60U;
+        ts_cache.text[17] = (char)('0' + ss / 10U);
+        ts_cache.text[18] = (char)('0' + ss % 10U);
+        ts_cache.rendered_sec = sec;
+    }
+    memcpy(buffer, ts_cache.text, sizeof(ts_cache.text));
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+
+#if BOARD_TIMESTAMP_MS
+    if (buffer_size >= BOARD_TIMESTAMP_LEN) {
+        uint32_t mmm = ms % 1000U;
+        buffer[19] = '.';
+        buffer[20] = (char)('0' + mmm / 100U);
+        buffer[21] = (char)('0' + (mmm / 10U) % 10U);
+        buffer[22] = (char)('0' + mmm % 10U);
+        buffer[23] = '\0';
+    }
+#else
+    (void)ms;
+#endif
+    return buffer;
+}
+
+char* board_get_timestamp_at(uint32_t tick, char* buffer, size_t buffer_size)
+{
+    /* Refresh the cache and take the date part from "now". */
+    board_get_timestamp(buffer, buffer_size);
+    if (buffer_size < 20 || buffer[0] == '\0') return buffer;
+
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    int32_t ms = (int32_t)ts_cache.base_ms + (int32_t)(tick - ts_cache.base_tick);
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+
+    /* Across midnight the date would be wrong: keep "now" instead. */
+    if (ms < 0 || ms >= 86400000) return buffer;
+
+    uint32_t sec = (uint32_t)ms / 1000U;
+    uint32_t hh = sec / 3600U, mm = (sec / 60U) % 60U, ss = sec % 60U;
+    buffer[11] = (char)('0' + hh / 10U);
+    buffer[12] = (char)('0' + hh % 10U);
+    buffer[14] = (char)('0' + mm / 10U);
+    buffer[15] = (char)('0' + mm % 10U);
+    buffer[17] = (char)('0' + ss / 10U);
+    buffer[18] = (char)('0' + ss % 10U);
+#if BOARD_TIMESTAMP_MS
+    if (buffer_size >= BOARD_TIMESTAMP_LEN) {
+        uint32_t mmm = (uint32_t)ms % 1000U;
+        buffer[20] = (char)('0' + mmm / 100U);
+        buffer[21] = (char)('0' + (mmm / 10U) % 10U);
+        buffer[22] = (char)('0' + mmm % 10U);
+    }
+#endif
     return buffer;
 }
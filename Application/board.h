@@ -5,6 +5,7 @@
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 
 #define SYSLOG_SERVER_IP "192.168.1.1"
 #define SYSLOG_SERVER_PORT 514
@@ -13,8 +14,28 @@
 #define NTP_SERVER_IP1 "ntp.towercrane.lan"
 #define NTP_SERVER_IP2 "pool.ntp.org"
 
+/* Append ".mmm" milliseconds to board_get_timestamp() output. */
+#ifndef BOARD_TIMESTAMP_MS
+#define BOARD_TIMESTAMP_MS 1
+#endif
+
+/* Buffer size needed for a full timestamp including the terminator. */
+#if BOARD_TIMESTAMP_MS
+#define BOARD_TIMESTAMP_LEN 24
+#else
+#define BOARD_TIMESTAMP_LEN 20
+#endif
+
+/* Cached RTC timestamp, cheap enough for every log line and ISR-safe.
+ * The RTC itself is read at most once per minute, and not at all once
+ * SNTP has set the clock: then the time is UTC from time_utc_ns(),
+ * which never goes backwards (component/timesync/time_ns.h). */
 char* board_get_timestamp(char* buffer, size_t buffer_size);
 
+/* Same format, for an earlier HAL_GetTick() value (e.g. a deferred log
+ * record). Falls back to the current time if the tick is not on today. */
+char* board_get_timestamp_at(uint32_t tick, char* buffer, size_t buffer_size);
+
 #ifdef __cplusplus
 }
 #endif
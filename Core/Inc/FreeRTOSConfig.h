@@ -68,8 +68,9 @@
 #define configTICK_RATE_HZ                       ((TickType_t)1000)
 #define configMAX_PRIORITIES                     ( 56 )
 #define configMINIMAL_STACK_SIZE                 ((uint16_t)128)
-#define configTOTAL_HEAP_SIZE                    ((size_t)15360)
+#define configTOTAL_HEAP_SIZE                    ((size_t)65536)
 #define configMAX_TASK_NAME_LEN                  ( 16 )
+#define configGENERATE_RUN_TIME_STATS            1
 #define configUSE_TRACE_FACILITY                 1
 #define configUSE_16_BIT_TICKS                   0
 #define configUSE_MUTEXES                        1
@@ -163,8 +164,111 @@ standard names. */
 
 #define USE_CUSTOM_SYSTICK_HANDLER_IMPLEMENTATION 0
 
+/* USER CODE BEGIN 2 */
+/* Definitions needed when configGENERATE_RUN_TIME_STATS is on */
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS configureTimerForRunTimeStats
+#define portGET_RUN_TIME_COUNTER_VALUE getRunTimeCounterValue
+/* USER CODE END 2 */
+
 /* USER CODE BEGIN Defines */
 /* Section where parameter definitions can be added (for instance, to override default ones in FreeRTOS.h) */
+/* Slot 0: per-task line assembly context of logger_printf_line() (SYSLOG_LINE_TLS_INDEX).
+ * Slot 1: per-task netconn semaphore of lwIP (LWIP_NETCONN_SEM_TLS_INDEX). */
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 2
+
+/* ETH_CODE: CLZ based task selection; it limits the scheduler to 32
+ * priorities. CubeMX fixes 56 for CMSIS-RTOS2, so both are overridden here.
+ * cmsis_os2.c halves osPriority_t values (osPriorityIdle 1 .. osPriorityISR
+ * 56 become 0 .. 28): the bands keep their order, neighbouring steps within
+ * a band (osPriorityNormal / osPriorityNormal1) share a level. Priorities
+ * given to xTaskCreate*() directly are FreeRTOS levels, 0 .. 31. */
+#undef configUSE_PORT_OPTIMISED_TASK_SELECTION
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION  1
+#undef configMAX_PRIORITIES
+#define configMAX_PRIORITIES                     ( 32 )
+
+#define configOS2_TO_RTOS_PRIO(p)                ((UBaseType_t)(p) >> 1)
+#define configRTOS_TO_OS2_PRIO(p)                (((p) == 0U) ? osPriorityIdle : (osPriority_t)((p) << 1))
+
+/* ETH_CODE: FPU. configENABLE_FPU above is only read by the ARMv8-M ports.
+ * The ARM_CM4F port used here (correct for the r1p1 Cortex-M7 of the
+ * STM32H743, see main()) enables CP10/CP11 in xPortStartScheduler() and
+ * sets FPCCR.ASPEN/LSPEN: FPU registers are stacked lazily, and only for
+ * tasks that have executed a floating point instruction. The build uses
+ * -mfpu=fpv5-d16 -mfloat-abi=hard. component/bench measures the cost. */
+
+/* ETH_CODE: the heap is split in two regions. configTOTAL_HEAP_SIZE lives in
+ * DTCM (zero wait state, not reachable by the ETH DMA) and is filled first;
+ * configHEAP_AXI_SIZE is in AXI SRAM. pvPortMallocRegion() prefers one
+ * region, e.g. heapREGION_AXI for large buffers, and falls back to the other. */
+#define configHEAP_AXI_SIZE                      ((size_t)65536)
+
+/* ETH_CODE: 1 puts the regions on TLSF (component/tlsf/heap_tlsf.c) instead
+ * of heap_4.c's first fit: pvPortMalloc() and vPortFree() take the same
+ * time however fragmented the heap is. Same API, same region preference. */
+#ifndef HEAP_TLSF
+#define HEAP_TLSF                                1
+#endif
+
+#define heapREGION_ANY                           0U
+#define heapREGION_DTCM                          1U
+#define heapREGION_AXI                           2U
+
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+#include <stddef.h>
+void *pvPortMallocRegion(size_t xWantedSize, uint32_t ulRegion);
+size_t xPortGetFreeHeapSizeRegion(uint32_t ulRegion);
+/* ETH_CODE: run-time stats time base, DWT CYCCNT (freertos.c) */
+void configureTimerForRunTimeStats(void);
+unsigned long getRunTimeCounterValue(void);
+#endif
+
+/* ETH_CODE: ulTaskGetIdleRunTimeCounter(), the CPU share of the driver's
+ * loopback benchmark (ethernetif_loopback_bench()) */
+#define INCLUDE_xTaskGetIdleTaskHandle 1
+
+/* ETH_CODE: tickless idle on LPTIM1, see component/tickless/tickless.h.
+ * The idle task sleeps in WFI until the next unblock time or an interrupt;
+ * the tcpip thread's mailbox timeout carries the next lwIP timer there. */
+#ifndef TICKLESS_IDLE
+#define TICKLESS_IDLE                            1
+#endif
+
+#if TICKLESS_IDLE
+#define configUSE_TICKLESS_IDLE                  2
+#if defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__)
+void tickless_sleep(uint32_t expected_ticks);
+#endif
+#define portSUPPRESS_TICKS_AND_SLEEP(xExpectedIdleTime) tickless_sleep(xExpectedIdleTime)
+#endif
+
+/* ETH_CODE: kernel event timeline into RAM, see component/trace/trace_rec.h.
+ * The hooks expand inside tasks.c and queue.c and read the TCB and queue
+ * numbers there (configUSE_TRACE_FACILITY). Queue hooks only record
+ * objects named with trace_rec_name_queue(). */
+#ifndef TRACE_REC
+#define TRACE_REC                                0
+#endif
+
+#if TRACE_REC && (defined(__ICCARM__) || defined(__CC_ARM) || defined(__GNUC__))
+#include "trace/trace_rec.h"
+#define traceTASK_SWITCHED_IN()                  trace_rec_task_in((uint8_t)pxCurrentTCB->uxTCBNumber)
+#define traceMOVED_TASK_TO_READY_STATE(pxTCB)    trace_rec_event(TRACE_EV_TASK_READY, (uint16_t)(pxTCB)->uxTCBNumber)
+#define traceQUEUE_SEND(pxQueue)                 trace_rec_queue(TRACE_EV_Q_SEND, (pxQueue)->uxQueueNumber)
+#define traceQUEUE_RECEIVE(pxQueue)              trace_rec_queue(TRACE_EV_Q_RECV, (pxQueue)->uxQueueNumber)
+#define traceBLOCKING_ON_QUEUE_SEND(pxQueue)     trace_rec_queue(TRACE_EV_Q_BLOCK_SEND, (pxQueue)->uxQueueNumber)
+#define traceBLOCKING_ON_QUEUE_RECEIVE(pxQueue)  trace_rec_queue(TRACE_EV_Q_BLOCK_RECV, (pxQueue)->uxQueueNumber)
+#define traceQUEUE_SEND_FROM_ISR(pxQueue)        trace_rec_queue(TRACE_EV_Q_SEND_ISR, (pxQueue)->uxQueueNumber)
+#define traceTASK_PRIORITY_INHERIT(pxTCB, uxPriority) \
+    trace_rec_event(TRACE_EV_PRIO_INHERIT, (uint16_t)(((pxTCB)->uxTCBNumber << 8) | (uxPriority)))
+#define traceTASK_PRIORITY_DISINHERIT(pxTCB, uxPriority) \
+    trace_rec_event(TRACE_EV_PRIO_DISINHERIT, (uint16_t)(((pxTCB)->uxTCBNumber << 8) | (uxPriority)))
+#define traceTASK_NOTIFY()                       trace_rec_event(TRACE_EV_NOTIFY, (uint16_t)pxTCB->uxTCBNumber)
+#define traceTASK_NOTIFY_FROM_ISR()              trace_rec_event(TRACE_EV_NOTIFY, (uint16_t)pxTCB->uxTCBNumber)
+#define traceTASK_NOTIFY_GIVE_FROM_ISR()         trace_rec_event(TRACE_EV_NOTIFY, (uint16_t)pxTCB->uxTCBNumber)
+#define traceTASK_NOTIFY_TAKE_BLOCK()            trace_rec_event(TRACE_EV_NOTIFY_BLOCK, 0U)
+#define traceTASK_NOTIFY_TAKE()                  trace_rec_event(TRACE_EV_NOTIFY_TAKE, 0U)
+#endif
 /* USER CODE END Defines */
 
 #endif /* FREERTOS_CONFIG_H */
@@ -32,6 +32,7 @@ extern "C" {
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include "board.h"
+#include "logger/syslog.h"
 /* USER CODE END Includes */
 
 /* Exported types ------------------------------------------------------------*/
@@ -46,6 +47,19 @@ extern "C" {
 
 /* Exported macro ------------------------------------------------------------*/
 /* USER CODE BEGIN EM */
+/* ETH_CODE: placement in the tightly coupled memories (zero wait states,
+ * not reachable by the ETH DMA). ITCM_FUNC code is copied from flash to
+ * ITCMRAM by the startup code, DTCM_DATA is initialised from flash and
+ * DTCM_BSS is zeroed. Calls between flash and ITCM go through linker
+ * veneers. Hot HAL, lwIP and FreeRTOS functions are placed by name in the
+ * linker script instead. */
+#define ITCM_FUNC __attribute__((section(".itcm_text")))
+#define DTCM_DATA __attribute__((section(".dtcm_data")))
+#define DTCM_BSS  __attribute__((section(".dtcm_bss")))
+/* ETH_CODE: AXI SRAM (RAM_D1) left out of the startup zero fill: buffers
+ * that are written before they are read, rings and scratch. Their contents
+ * are undefined after power-on and kept across a warm reset. */
+#define NOINIT    __attribute__((section(".noinit")))
 
 /* USER CODE END EM */
 
@@ -71,8 +85,15 @@ void Error_Handler(void);
 #define LOG_LEVEL_DEBUG   4
 #define LOG_LEVEL_VERBOSE 5
 #endif
-#define LOG_PRINTF(level,tag,...) logger_printf(level,tag,__VA_ARGS__)
-#define LOG_PRINTF_LINE(level,tag,...) logger_printf_line(level,tag,__VA_ARGS__)
+/* Levels above LOG_COMPILE_LEVEL are compiled out, arguments included.
+ * Below it, the runtime level (global or per tag) is checked before any
+ * formatting. */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_VERBOSE
+#endif
+#define LOG_ENABLED(level,tag) ((level) <= LOG_COMPILE_LEVEL && logger_level_enabled(level,tag))
+#define LOG_PRINTF(level,tag,...) do { if (LOG_ENABLED(level,tag)) logger_printf(level,tag,__VA_ARGS__); } while (0)
+#define LOG_PRINTF_LINE(level,tag,...) do { if (LOG_ENABLED(level,tag)) logger_printf_line(level,tag,__VA_ARGS__); } while (0)
 #define LOG_DEBUG(tag,...)    LOG_PRINTF(LOG_LEVEL_DEBUG,tag,__VA_ARGS__)
 #define LOG_INFO(tag,...)     LOG_PRINTF(LOG_LEVEL_INFO,tag,__VA_ARGS__)
 #define LOG_WARNING(tag,...)  LOG_PRINTF(LOG_LEVEL_WARNING,tag,__VA_ARGS__)
@@ -24,6 +24,8 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "logger/bkp_log.h"
+#include "boottime/boot_time.h"
 
 /* USER CODE END Includes */
 
@@ -34,6 +36,9 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+/* ETH_CODE: run-time stats count CPU cycles / 2^RUNTIME_STATS_SHIFT: at
+ * 400 MHz a 160 ns resolution, and the 32-bit counters wrap after 687 s. */
+#define RUNTIME_STATS_SHIFT 6U
 
 /* USER CODE END PD */
 
@@ -44,11 +49,15 @@
 
 /* Private variables ---------------------------------------------------------*/
 /* USER CODE BEGIN Variables */
+static uint32_t RunTimeLast;
+static uint32_t RunTimeWraps;
 
 /* USER CODE END Variables */
 
 /* Private function prototypes -----------------------------------------------*/
 /* USER CODE BEGIN FunctionPrototypes */
+void configureTimerForRunTimeStats(void);
+unsigned long getRunTimeCounterValue(void);
 
 /* USER CODE END FunctionPrototypes */
 
@@ -56,10 +65,53 @@
 /* USER CODE BEGIN Application */
 void vApplicationStackOverflowHook(xTaskHandle xTask, signed char *pcTaskName)
 {
+#if SYSLOG_BKP_LOG
+   /* ETH_CODE: leave the task in the backup SRAM for the next boot */
+   bkp_log_crash(BKP_LOG_CRASH_STACK_OVERFLOW, (uint32_t)(uintptr_t)__builtin_return_address(0),
+                 (const char*)pcTaskName);
+   bkp_log_reset();
+#endif
    /* ETH_CODE: add breakpoint when stack oveflow is detected by FreeRTOS.
     * Useful for debugging issues.
     */
    __BKPT(0);
 }
+
+/* Functions needed when configGENERATE_RUN_TIME_STATS is on */
+void configureTimerForRunTimeStats(void)
+{
+  /* ETH_CODE: called by vTaskStartScheduler(), the boot timeline continues
+   * from the reset counter */
+  BOOT_TIME_MARK(BOOT_TIME_RTOS);
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55U;
+  DWT->CYCCNT = 0U;
+#if BOOT_TIME
+  boot_time_rebase();
+#endif
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  RunTimeLast = 0U;
+  RunTimeWraps = 0U;
+}
+
+/* ETH_CODE: called at every context switch. CYCCNT wraps after 10.7 s at
+ * 400 MHz; a wrap is counted when the value went backwards, so this must
+ * run at least that often (any task waking up does, the 1 s loop of
+ * defaultTask guarantees it). Interrupts are masked around the update
+ * because uxTaskGetSystemState() calls it from task context too. */
+unsigned long getRunTimeCounterValue(void)
+{
+  UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+  uint32_t now = DWT->CYCCNT;
+
+  if (now < RunTimeLast)
+  {
+    RunTimeWraps++;
+  }
+  RunTimeLast = now;
+  now = (RunTimeWraps << (32U - RUNTIME_STATS_SHIFT)) | (now >> RUNTIME_STATS_SHIFT);
+  taskEXIT_CRITICAL_FROM_ISR(mask);
+  return now;
+}
 /* USER CODE END Application */
 
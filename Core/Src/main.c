@@ -24,8 +24,47 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include "udp.h"
+#include "App_eth.h"
 #include <string.h>
-#include "lwiperf.h"
+#include "iperf/iperf_service.h"
+#include "mdma/mdma_copy.h"
+#include "qspi/qspi_flash.h"
+#include "logger/bkp_log.h"
+#include "logger/console.h"
+#include "logger/log_ctl.h"
+#include "bench/ctxsw_bench.h"
+#include "bench/bench_suite.h"
+#include "rtstats/rtstats.h"
+#include "perf/perf_stats.h"
+#include "metrics/metrics.h"
+#include "httpd/diag_httpd.h"
+#include "memmon/memmon.h"
+#include "supervisor/supervisor.h"
+#include "pcap/pcap_ring.h"
+#include "trace/trace_rec.h"
+#include "prof/pc_prof.h"
+#include "irqstats/irq_stats.h"
+#include "periodic/periodic_exec.h"
+#include "mutexmon/mutex_mon.h"
+#include "heaptrace/heap_trace.h"
+#include "timesync/time_ns.h"
+#include "timesync/timesync.h"
+#include "timesync/sntp_client.h"
+#include "boottime/boot_time.h"
+#include "ctrlchan/ctrl_chan.h"
+#include "twamp/twamp_light.h"
+#include "workpool/work_pool.h"
+#include "modbus/modbus_tcp.h"
+#include "ota/ota.h"
+#include "telemetry/telemetry_agg.h"
+#include "telemetry/telemetry_mcast.h"
+#include "mqttstore/mqtt_store.h"
+#include "snmp/snmp_agent.h"
+#include "config/config_store.h"
+#include "clock/clock_profile.h"
+#include "clock/clock_dvfs.h"
+#include "tickless/tickless.h"
+#include "mpu/mpu_layout.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -35,7 +74,10 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
-
+/* Rounds of the context switch benchmark logged at startup, 0: off */
+#ifndef CTXSW_BENCH_ROUNDS
+#define CTXSW_BENCH_ROUNDS 0U
+#endif
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -85,11 +127,17 @@ int main(void)
 {
 
   /* USER CODE BEGIN 1 */
-
+#if BOOT_TIME
+  boot_time_start();
+#endif
+  /* ETH_CODE: the ARM_CM4F port is the FreeRTOS port for Cortex-M7 r1p0 and
+   * later; r0p1 cores need portable/GCC/ARM_CM7/r0p1 (erratum 837070). */
+  configASSERT((SCB->CPUID & SCB_CPUID_VARIANT_Msk) != 0U);
   /* USER CODE END 1 */
 
   /* MPU Configuration--------------------------------------------------------*/
   MPU_Config();
+  BOOT_TIME_MARK(BOOT_TIME_MPU); /* ETH_CODE */
 
   /* Enable the CPU Cache */
 
@@ -98,6 +146,7 @@ int main(void)
 
   /* Enable D-Cache---------------------------------------------------------*/
   SCB_EnableDCache();
+  BOOT_TIME_MARK(BOOT_TIME_CACHE); /* ETH_CODE */
 
   /* MCU Configuration--------------------------------------------------------*/
 
@@ -105,6 +154,7 @@ int main(void)
   HAL_Init();
 
   /* USER CODE BEGIN Init */
+  BOOT_TIME_MARK(BOOT_TIME_HAL);
 
   /* USER CODE END Init */
 
@@ -112,6 +162,7 @@ int main(void)
   SystemClock_Config();
 
   /* USER CODE BEGIN SysInit */
+  BOOT_TIME_MARK(BOOT_TIME_CLOCK);
 
   /* USER CODE END SysInit */
 
@@ -120,6 +171,19 @@ int main(void)
   MX_QUADSPI_Init();
   MX_RTC_Init();
   /* USER CODE BEGIN 2 */
+  /* ETH_CODE: the PHY reset pulse runs while the rest starts up, the link
+   * thread completes it (ETHIF_PHY_ASYNC) */
+  reset_phy_start();
+#if SYSLOG_BKP_LOG
+  (void)bkp_log_init();
+#endif
+  mdma_copy_init();
+#if QSPI_FLASH
+  (void)qspi_flash_init();
+#endif
+  /* ETH_CODE: read in place until config_store_release() below */
+  (void)config_store_init();
+  BOOT_TIME_MARK(BOOT_TIME_PERIPH);
 
   /* USER CODE END 2 */
 
@@ -181,6 +245,15 @@ void SystemClock_Config(void)
   RCC_OscInitTypeDef RCC_OscInitStruct = {0};
   RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
 
+#if CLOCK_PROFILE != CLOCK_PROFILE_HSI
+  /* ETH_CODE: HSE profiles (clock/clock_profile.h); the HSI configuration
+   * below is their fallback */
+  if (clock_profile_config())
+  {
+    return;
+  }
+#endif
+
   /** Supply configuration update enable
   */
   HAL_PWREx_ConfigSupply(PWR_LDO_SUPPLY);
@@ -302,7 +375,13 @@ static void MX_RTC_Init(void)
   }
 
   /* USER CODE BEGIN Check_RTC_BKUP */
-
+#if TIMESYNC && TIMESYNC_RTC
+  /* ETH_CODE: keep a time set by SNTP before the reset */
+  if (timesync_rtc_restore(&hrtc))
+  {
+    return;
+  }
+#endif
   /* USER CODE END Check_RTC_BKUP */
 
   /** Initialize RTC and set the Time and Date
@@ -392,14 +471,123 @@ void StartDefaultTask(void *argument)
   /* init code for LWIP */
   MX_LWIP_Init();
   /* USER CODE BEGIN 5 */
-  init_logger(SYSLOG_SERVER_IP, SYSLOG_SERVER_PORT);
-//  LOCK_TCPIP_CORE();
-//   lwiperf_start_tcp_server_default(NULL, NULL);
-//
-//   ip4_addr_t remote_addr;
-//   IP4_ADDR(&remote_addr, 192, 168, 1, 1);
-//   lwiperf_start_tcp_client_default(&remote_addr, NULL, NULL);
-//   UNLOCK_TCPIP_CORE();
+  BOOT_TIME_MARK(BOOT_TIME_LWIP);
+  /* ETH_CODE: CYCCNT was reset when the scheduler started */
+  time_ns_init();
+#if TRACE_REC
+  trace_rec_init();
+#endif
+#if PC_PROF
+  /* ETH_CODE: sampling starts when a client asks, see prof/pc_prof.h */
+  pc_prof_init();
+#endif
+  init_logger(config_store_get()->syslog_host, config_store_get()->syslog_port);
+  BOOT_TIME_MARK(BOOT_TIME_LOGGER);
+  clock_profile_report();
+  mpu_layout_report();
+#if SYSLOG_BKP_LOG
+  /* ETH_CODE: queued until the network is up */
+  bkp_log_replay();
+#endif
+#if SYSLOG_CTL
+  log_ctl_start();
+#endif
+#if PCAP_RING
+  pcap_ring_init();
+#endif
+#if TIMESYNC
+  sntp_client_start(config_store_get()->ntp[0], config_store_get()->ntp[1]);
+#endif
+  /* ETH_CODE: the blob's consumers are configured, the QSPI writers may go */
+  config_store_release();
+  rtstats_init();
+#if METRICS
+  metrics_init();
+#endif
+#if IRQ_STATS
+  /* ETH_CODE: the handlers in stm32h7xx_it.c call the hooks */
+  (void)irq_stats_register(ETH_IRQn, "eth");
+  (void)irq_stats_register(TIM6_DAC_IRQn, "tick");
+#endif
+#if PERIODIC_EXEC
+  /* ETH_CODE: releases nothing until the application adds its tasks */
+  periodic_exec_init();
+#endif
+#if MUTEX_MON
+  /* ETH_CODE: the core lock and the logger mutexes register themselves */
+  mutex_mon_init();
+#endif
+#if HEAP_TRACE
+  heap_trace_init();
+#endif
+#if METRICS && DIAG_HTTPD
+  diag_httpd_init();
+#endif
+#if CTRL_CHAN
+  /* ETH_CODE: echoes setpoints until the application passes its step */
+  ctrl_chan_start(CTRL_CHAN_PORT, NULL, NULL);
+#endif
+#if TWAMP_LIGHT
+  /* ETH_CODE: reflects only until the application adds its peers */
+  twamp_light_start();
+#endif
+#if CLOCK_DVFS
+  /* ETH_CODE: full speed only while the network stack needs it */
+  clock_dvfs_start();
+#endif
+#if TICKLESS_IDLE
+  tickless_start();
+#endif
+#if WORK_POOL
+  /* ETH_CODE: before the servers that hand work to it */
+  work_pool_start();
+#endif
+#if MODBUS_TCP
+  /* ETH_CODE: scratch registers until the application maps its own */
+  modbus_tcp_start(NULL);
+#endif
+#if OTA
+  ota_start();
+#endif
+#if TELEMETRY_AGG
+  /* ETH_CODE: sends nothing until the application adds its channels */
+  telemetry_agg_start();
+#endif
+#if TELEMETRY_AGG && TELEMETRY_MCAST
+  /* ETH_CODE: the datagrams to the group instead of TELEMETRY_AGG_IP */
+  telemetry_mcast_start();
+#endif
+#if MQTT_STORE
+  /* ETH_CODE: stores everything until the application hands over its client */
+  mqtt_store_start();
+#endif
+#if SNMP_AGENT
+  snmp_agent_start();
+#endif
+#if MEMMON
+  memmon_start();
+#endif
+#if SUPERVISOR
+  /* ETH_CODE: last, the IWDG runs from here on */
+  supervisor_start();
+#endif
+#if LWIP_PERF
+  perf_stats_init();
+#endif
+#if BENCH_SUITE
+  bench_suite_start();
+#endif
+#if CTXSW_BENCH_ROUNDS
+  CtxswBenchResult_t bench;
+  if (ctxsw_bench_run(CTXSW_BENCH_ROUNDS, &bench))
+  {
+    LOG_INFO("BENCH", "context switch %lu cycles, %lu with FPU context (%lu MHz, %lu rounds)",
+             bench.int_cycles, bench.fpu_cycles, bench.cpu_mhz, bench.rounds);
+  }
+#endif
+#if IPERF_SERVICE
+  iperf_service_start(IPERF_SERVICE_DEFAULT_MODES);
+#endif
   /* Infinite loop */
   for(;;)
   {
@@ -415,6 +603,11 @@ void MPU_Config(void)
 {
   MPU_Region_InitTypeDef MPU_InitStruct = {0};
 
+#if MPU_LAYOUT
+  /* ETH_CODE: regions and cache policies from mpu/mpu_layout.h */
+  mpu_layout_config();
+  return;
+#endif
   /* Disables the MPU */
   HAL_MPU_Disable();
 
@@ -490,7 +683,14 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
     HAL_IncTick();
   }
   /* USER CODE BEGIN Callback 1 */
-
+  /* ETH_CODE: anchor the nanosecond clock to every tick */
+  if (htim->Instance == TIM6)
+  {
+    time_ns_tick();
+#if SYSLOG_CONSOLE
+    console_drain();
+#endif
+  }
   /* USER CODE END Callback 1 */
 }
 
@@ -502,6 +702,11 @@ void Error_Handler(void)
 {
   /* USER CODE BEGIN Error_Handler_Debug */
   /* User can add his own implementation to report the HAL error return state */
+#if SYSLOG_BKP_LOG
+  /* ETH_CODE: leave the caller in the backup SRAM for the next boot */
+  bkp_log_crash(BKP_LOG_CRASH_ERROR, (uint32_t)(uintptr_t)__builtin_return_address(0), NULL);
+  bkp_log_reset();
+#endif
   __disable_irq();
   while (1)
   {
@@ -22,6 +22,10 @@
 #include "stm32h7xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "FreeRTOS.h"
+#include "trace/trace_rec.h"
+#include "logger/bkp_log.h"
+#include "irqstats/irq_stats.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -46,6 +50,11 @@
 
 /* Private function prototypes -----------------------------------------------*/
 /* USER CODE BEGIN PFP */
+#if SYSLOG_BKP_LOG
+/* ETH_CODE: no prologue, BKP_LOG_HARD_FAULT() finds the exception frame
+ * from the stack pointers as they were at the fault */
+void HardFault_Handler(void) __attribute__((naked));
+#endif
 
 /* USER CODE END PFP */
 
@@ -86,6 +95,9 @@ void NMI_Handler(void)
 void HardFault_Handler(void)
 {
   /* USER CODE BEGIN HardFault_IRQn 0 */
+#if SYSLOG_BKP_LOG
+  BKP_LOG_HARD_FAULT();
+#endif
 
   /* USER CODE END HardFault_IRQn 0 */
   while (1)
@@ -166,11 +178,15 @@ void DebugMon_Handler(void)
 void TIM6_DAC_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM6_DAC_IRQn 0 */
-
+#if IRQ_STATS
+  irq_stats_enter(TIM6_DAC_IRQn);
+#endif
   /* USER CODE END TIM6_DAC_IRQn 0 */
   HAL_TIM_IRQHandler(&htim6);
   /* USER CODE BEGIN TIM6_DAC_IRQn 1 */
-
+#if IRQ_STATS
+  irq_stats_exit(TIM6_DAC_IRQn);
+#endif
   /* USER CODE END TIM6_DAC_IRQn 1 */
 }
 
@@ -180,11 +196,21 @@ void TIM6_DAC_IRQHandler(void)
 void ETH_IRQHandler(void)
 {
   /* USER CODE BEGIN ETH_IRQn 0 */
-
+#if IRQ_STATS
+  irq_stats_enter(ETH_IRQn);
+#endif
+#if TRACE_REC
+  trace_rec_isr_enter(ETH_IRQn);
+#endif
   /* USER CODE END ETH_IRQn 0 */
   HAL_ETH_IRQHandler(&heth);
   /* USER CODE BEGIN ETH_IRQn 1 */
-
+#if TRACE_REC
+  trace_rec_isr_exit(ETH_IRQn);
+#endif
+#if IRQ_STATS
+  irq_stats_exit(ETH_IRQn);
+#endif
   /* USER CODE END ETH_IRQn 1 */
 }
 
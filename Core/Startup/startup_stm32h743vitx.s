@@ -65,35 +65,33 @@ Reset_Handler:
 /* Call the clock system initialization function.*/
   bl  SystemInit
 
-/* Copy the data segment initializers from flash to SRAM */
+/* ETH_CODE: copy the data segment initializers from flash to SRAM and zero
+ * fill the bss segment in 16-byte bursts (StartupCopy/StartupZero below).
+ * .noinit, after .bss, is left as the last reset found it. */
   ldr r0, =_sdata
   ldr r1, =_edata
   ldr r2, =_sidata
-  movs r3, #0
-  b LoopCopyDataInit
-
-CopyDataInit:
-  ldr r4, [r2, r3]
-  str r4, [r0, r3]
-  adds r3, r3, #4
-
-LoopCopyDataInit:
-  adds r4, r0, r3
-  cmp r4, r1
-  bcc CopyDataInit
-/* Zero fill the bss segment. */
-  ldr r2, =_sbss
-  ldr r4, =_ebss
-  movs r3, #0
-  b LoopFillZerobss
-
-FillZerobss:
-  str  r3, [r2]
-  adds r2, r2, #4
-
-LoopFillZerobss:
-  cmp r2, r4
-  bcc FillZerobss
+  bl StartupCopy
+  ldr r0, =_sbss
+  ldr r1, =_ebss
+  bl StartupZero
+
+/* ETH_CODE: copy the ITCM code and the DTCM data initializers from flash,
+ * zero fill the DTCM bss. */
+  ldr r0, =_sitcm_text
+  ldr r1, =_eitcm_text
+  ldr r2, =_siitcm_text
+  bl StartupCopy
+  ldr r0, =_sdtcm_data
+  ldr r1, =_edtcm_data
+  ldr r2, =_sidtcm_data
+  bl StartupCopy
+  ldr r0, =_sdtcm_bss
+  ldr r1, =_edtcm_bss
+  bl StartupZero
+/* Code written to ITCM is fetched only after these barriers */
+  dsb
+  isb
 
 /* Call static constructors */
     bl __libc_init_array
@@ -102,6 +100,57 @@ LoopFillZerobss:
   bx  lr
 .size  Reset_Handler, .-Reset_Handler
 
+/* ETH_CODE: Reset_Handler's copy and zero loops, before the caches are on:
+ * four words per LDM/STM, the rest one word at a time. Bounds are word
+ * aligned (ALIGN(4) in the linker script), r0 <= r1. Clobber r0, r2-r7. */
+/* Copies [r2, ...) to [r0, r1) */
+  .type  StartupCopy, %function
+StartupCopy:
+  subs r3, r1, r0
+  subs r3, r3, #16
+  blo 2f
+1:
+  ldmia r2!, {r4, r5, r6, r7}
+  stmia r0!, {r4, r5, r6, r7}
+  subs r3, r3, #16
+  bhs 1b
+2:
+  adds r3, r3, #16
+  beq 4f
+3:
+  ldr r4, [r2], #4
+  str r4, [r0], #4
+  subs r3, r3, #4
+  bne 3b
+4:
+  bx lr
+.size  StartupCopy, .-StartupCopy
+
+/* Zeroes [r0, r1) */
+  .type  StartupZero, %function
+StartupZero:
+  movs r4, #0
+  movs r5, #0
+  movs r6, #0
+  movs r7, #0
+  subs r3, r1, r0
+  subs r3, r3, #16
+  blo 2f
+1:
+  stmia r0!, {r4, r5, r6, r7}
+  subs r3, r3, #16
+  bhs 1b
+2:
+  adds r3, r3, #16
+  beq 4f
+3:
+  str r4, [r0], #4
+  subs r3, r3, #4
+  bne 3b
+4:
+  bx lr
+.size  StartupZero, .-StartupZero
+
 /**
  * @brief  This is the code that gets called when the processor receives an
  *         unexpected interrupt.  This simply enters an infinite loop, preserving
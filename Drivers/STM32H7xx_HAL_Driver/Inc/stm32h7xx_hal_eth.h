@@ -211,6 +211,9 @@ typedef struct
 
   uint32_t RxBuildDescCnt;            /*<! Number of Rx Descriptors awaiting building. */
 
+  uint32_t RxBuildDescMin;            /*<! ETH_CODE: HAL_ETH_ReadData() builds once this many are awaiting,
+                                             the rest is left to HAL_ETH_RxRebuild(). 0 or 1: every call. */
+
   uint32_t pRxLastRxDesc;             /*<! Last received descriptor. */
 
   ETH_TimeStampTypeDef TimeStamp;     /*<! Time Stamp Low value for receive. */
@@ -1762,6 +1765,11 @@ HAL_StatusTypeDef HAL_ETH_UnRegisterTxPtpCallback(ETH_HandleTypeDef *heth);
 
 HAL_StatusTypeDef HAL_ETH_Transmit(ETH_HandleTypeDef *heth, ETH_TxPacketConfigTypeDef *pTxConfig, uint32_t Timeout);
 HAL_StatusTypeDef HAL_ETH_Transmit_IT(ETH_HandleTypeDef *heth, ETH_TxPacketConfigTypeDef *pTxConfig);
+/* ETH_CODE: queue packets without starting the Tx DMA, then poll it once */
+HAL_StatusTypeDef HAL_ETH_TransmitNoPoll_IT(ETH_HandleTypeDef *heth, ETH_TxPacketConfigTypeDef *pTxConfig);
+void HAL_ETH_TransmitPoll(ETH_HandleTypeDef *heth);
+/* ETH_CODE: rebuild the Rx descriptors HAL_ETH_ReadData() left awaiting */
+void HAL_ETH_RxRebuild(ETH_HandleTypeDef *heth);
 
 HAL_StatusTypeDef HAL_ETH_WritePHYRegister(const ETH_HandleTypeDef *heth, uint32_t PHYAddr, uint32_t PHYReg,
                                            uint32_t RegValue);
@@ -1030,6 +1030,62 @@ HAL_StatusTypeDef HAL_ETH_Transmit_IT(ETH_HandleTypeDef *heth, ETH_TxPacketConfi
   }
 }
 
+/**
+  * @brief  ETH_CODE: Queues an Ethernet Packet in interrupt mode without
+  *         starting transmission. The Tx DMA stops at the tail pointer, so
+  *         the packet is sent once HAL_ETH_TransmitPoll() is called.
+  * @param  heth: pointer to a ETH_HandleTypeDef structure that contains
+  *         the configuration information for ETHERNET module
+  * @param  pTxConfig: Hold the configuration of packet to be transmitted
+  * @retval HAL status
+  */
+HAL_StatusTypeDef HAL_ETH_TransmitNoPoll_IT(ETH_HandleTypeDef *heth, ETH_TxPacketConfigTypeDef *pTxConfig)
+{
+  if (pTxConfig == NULL)
+  {
+    heth->ErrorCode |= HAL_ETH_ERROR_PARAM;
+    return HAL_ERROR;
+  }
+
+  if (heth->gState == HAL_ETH_STATE_STARTED)
+  {
+    /* Save the packet pointer to release.  */
+    heth->TxDescList.CurrentPacketAddress = (uint32_t *)pTxConfig->pData;
+
+    /* Config DMA Tx descriptor by Tx Packet info */
+    if (ETH_Prepare_Tx_Descriptors(heth, pTxConfig, 1) != HAL_ETH_ERROR_NONE)
+    {
+      heth->ErrorCode |= HAL_ETH_ERROR_BUSY;
+      return HAL_ERROR;
+    }
+
+    /* Incr current tx desc index */
+    INCR_TX_DESC_INDEX(heth->TxDescList.CurTxDesc, 1U);
+
+    return HAL_OK;
+  }
+  else
+  {
+    return HAL_ERROR;
+  }
+}
+
+/**
+  * @brief  ETH_CODE: Starts transmission of the packets queued with
+  *         HAL_ETH_TransmitNoPoll_IT().
+  * @param  heth: pointer to a ETH_HandleTypeDef structure that contains
+  *         the configuration information for ETHERNET module
+  * @retval None
+  */
+void HAL_ETH_TransmitPoll(ETH_HandleTypeDef *heth)
+{
+  /* Ensure completion of descriptor preparation before transmission start */
+  __DSB();
+
+  /* issue a poll command to Tx DMA by writing address of next immediate free descriptor */
+  WRITE_REG(heth->Instance->DMACTDTPR, (uint32_t)(heth->TxDescList.TxDesc[heth->TxDescList.CurTxDesc]));
+}
+
 /**
   * @brief  Read a received packet.
   * @param  heth: pointer to a ETH_HandleTypeDef structure that contains
@@ -1119,7 +1175,9 @@ HAL_StatusTypeDef HAL_ETH_ReadData(ETH_HandleTypeDef *heth, void **pAppBuff)
   }
 
   heth->RxDescList.RxBuildDescCnt += desccnt;
-  if ((heth->RxDescList.RxBuildDescCnt) != 0U)
+  /* ETH_CODE: below RxBuildDescMin the rebuild waits for HAL_ETH_RxRebuild() */
+  if (((heth->RxDescList.RxBuildDescCnt) != 0U) &&
+      (heth->RxDescList.RxBuildDescCnt >= heth->RxDescList.RxBuildDescMin))
   {
     /* Update Descriptors */
     ETH_UpdateDescriptor(heth);
@@ -1141,6 +1199,22 @@ HAL_StatusTypeDef HAL_ETH_ReadData(ETH_HandleTypeDef *heth, void **pAppBuff)
   return HAL_ERROR;
 }
 
+/**
+  * @brief  ETH_CODE: Gives back to the DMA the Rx descriptors that
+  *         HAL_ETH_ReadData() left awaiting a rebuild (RxBuildDescMin),
+  *         with a single tail pointer write.
+  * @param  heth: pointer to a ETH_HandleTypeDef structure that contains
+  *         the configuration information for ETHERNET module
+  * @retval None
+  */
+void HAL_ETH_RxRebuild(ETH_HandleTypeDef *heth)
+{
+  if ((heth->gState == HAL_ETH_STATE_STARTED) && (heth->RxDescList.RxBuildDescCnt != 0U))
+  {
+    ETH_UpdateDescriptor(heth);
+  }
+}
+
 /**
   * @brief  This function gives back Rx Desc of the last received Packet
   *         to the DMA, so ETH DMA will be able to use these descriptors
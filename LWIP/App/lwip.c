@@ -29,7 +29,10 @@
 #include <string.h>
 
 /* USER CODE BEGIN 0 */
-
+#include "board.h"
+#include "lwip/dns.h"
+#include "dhcpc/dhcp_client.h"
+#include "config/config_store.h"
 /* USER CODE END 0 */
 /* Private function prototypes -----------------------------------------------*/
 static void ethernet_link_status_updated(struct netif *netif);
@@ -51,6 +54,10 @@ uint8_t GATEWAY_ADDRESS[4];
 /* USER CODE BEGIN OS_THREAD_ATTR_CMSIS_RTOS_V2 */
 #define INTERFACE_THREAD_STACK_SIZE ( 1024 )
 osThreadAttr_t attributes;
+/* ETH_CODE: EthLink task memory. Link handling is not time critical, so it
+ * stays in AXI SRAM and leaves DTCM to the packet path. */
+static StaticTask_t EthLinkTcb;
+static uint32_t EthLinkStack[INTERFACE_THREAD_STACK_SIZE / 4] __ALIGNED(8);
 /* USER CODE END OS_THREAD_ATTR_CMSIS_RTOS_V2 */
 
 /* USER CODE BEGIN 2 */
@@ -83,6 +90,17 @@ void MX_LWIP_Init(void)
   GATEWAY_ADDRESS[3] = 1;
 
 /* USER CODE BEGIN IP_ADDRESSES */
+  /* ETH_CODE: the configuration blob, read in place, overrides the address
+   * above unless it leaves it at 0.0.0.0 */
+  {
+    const ConfigBlob_t *cfg = config_store_get();
+    if (cfg->ip[0] != 0U || cfg->ip[1] != 0U || cfg->ip[2] != 0U || cfg->ip[3] != 0U)
+    {
+      memcpy(IP_ADDRESS, cfg->ip, sizeof(IP_ADDRESS));
+      memcpy(NETMASK_ADDRESS, cfg->netmask, sizeof(NETMASK_ADDRESS));
+      memcpy(GATEWAY_ADDRESS, cfg->gateway, sizeof(GATEWAY_ADDRESS));
+    }
+  }
 /* USER CODE END IP_ADDRESSES */
 
   /* Initialize the LwIP stack with RTOS */
@@ -109,12 +127,33 @@ void MX_LWIP_Init(void)
 /* USER CODE BEGIN H7_OS_THREAD_NEW_CMSIS_RTOS_V2 */
   memset(&attributes, 0x0, sizeof(osThreadAttr_t));
   attributes.name = "EthLink";
-  attributes.stack_size = INTERFACE_THREAD_STACK_SIZE;
+  attributes.cb_mem = &EthLinkTcb;
+  attributes.cb_size = sizeof(EthLinkTcb);
+  attributes.stack_mem = EthLinkStack;
+  attributes.stack_size = sizeof(EthLinkStack);
   attributes.priority = osPriorityBelowNormal;
   osThreadNew(ethernet_link_thread, &gnetif, &attributes);
 /* USER CODE END H7_OS_THREAD_NEW_CMSIS_RTOS_V2 */
 
 /* USER CODE BEGIN 3 */
+#if LWIP_DNS
+  /* ETH_CODE: static DNS servers of the configuration blob, until a DHCP
+   * lease names others */
+  {
+    const ConfigBlob_t *cfg = config_store_get();
+    ip_addr_t dns;
+    if (ipaddr_aton(cfg->dns[0], &dns)) dns_setserver(0, &dns);
+    if (ipaddr_aton(cfg->dns[1], &dns)) dns_setserver(1, &dns);
+  }
+#endif
+#if DHCP_CLIENT
+  /* ETH_CODE: the address above is replaced by the stored lease, or none
+   * until DHCP binds one */
+  if (dhcp_client_start(&gnetif) != ERR_OK)
+  {
+    Error_Handler();
+  }
+#endif
  /* ETH_CODE: call UNLOCK_TCPIP_CORE after we are done */
   UNLOCK_TCPIP_CORE();
 /* USER CODE END 3 */
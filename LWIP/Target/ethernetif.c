@@ -33,7 +33,34 @@
 
 /* Within 'USER CODE' section, code will be kept by default at each generation */
 /* USER CODE BEGIN 0 */
+#include "lwip/prot/ip.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/ip6.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/prot/udp.h"
+#include "lwip/tcp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/udp.h"
+#include "lwip/inet_chksum.h"
 #include "App_eth.h"
+#include "ethernetif_opts.h"
+#include "boottime/boot_time.h"
+#include "pcap/pcap_ring.h"
+#include "supervisor/supervisor.h"
+#if ETHIF_RX_LATENCY
+#include "lathist/lat_hist.h"
+#endif
+#if ETHIF_TX_TT || LWIP_SO_TIMESTAMP
+#include "timesync/time_ns.h"
+#endif
+#include "tickless/tickless.h"
+#if ETHIF_MDIO_ASYNC
+#include "timers.h"
+#include "semphr.h"
+#endif
+#if ETHIF_LEAN_DMA
+#include "ethernetif_dma.h"
+#endif
 
 
 /* USER CODE END 0 */
@@ -45,7 +72,12 @@
 #define ETHIF_TX_TIMEOUT (2000U)
 /* USER CODE BEGIN OS_THREAD_STACK_SIZE_WITH_RTOS */
 /* Stack size of the interface thread */
+#if ETHIF_RX_INLINE
+/* ETH_CODE: ethernet_input() and the raw API callbacks run on it */
+#define INTERFACE_THREAD_STACK_SIZE ( TCPIP_THREAD_STACKSIZE )
+#else
 #define INTERFACE_THREAD_STACK_SIZE ( 350 )
+#endif
 /* USER CODE END OS_THREAD_STACK_SIZE_WITH_RTOS */
 /* Network interface name */
 #define IFNAME0 's'
@@ -93,26 +125,48 @@ typedef enum
 typedef struct
 {
   struct pbuf_custom pbuf_custom;
-  uint8_t buff[(ETH_RX_BUFFER_SIZE + 31) & ~31] __ALIGNED(32);
+#if ETHIF_PTP
+  /* ETH_CODE: receive timestamp of the frame starting in this buffer */
+  uint32_t ts_sec;
+  uint32_t ts_nsec;
+  uint8_t ts_valid;
+#endif
+  /* ETH_CODE: the DMA writes from ETHIF_RX_OFFSET on */
+  uint8_t buff[(ETH_RX_BUFFER_SIZE + ETHIF_RX_OFFSET + 31) & ~31] __ALIGNED(32);
 } RxBuff_t;
 
 /* Memory Pool Declaration */
-#define ETH_RX_BUFFER_CNT             12U
+/* ETH_CODE: ETH_RX_BUFFER_CNT is derived from ETH_RX_DESC_CNT in ethernetif_opts.h */
 LWIP_MEMPOOL_DECLARE(RX_POOL, ETH_RX_BUFFER_CNT, sizeof(RxBuff_t), "Zero-copy RX PBUF pool");
 
+#if ETHIF_RX_COPY_MAX
+/* ETH_CODE: small frames copied out of RX_POOL, see ETHIF_RX_COPY_MAX.
+ * Written by the CPU only, so no DMA placement or cache maintenance. */
+typedef struct
+{
+  struct pbuf_custom pbuf_custom;
+  uint8_t buff[ETHIF_RX_COPY_MAX] __ALIGNED(4);
+} RxSmall_t;
+
+LWIP_MEMPOOL_DECLARE(RX_SMALL, ETHIF_RX_SMALL_CNT, sizeof(RxSmall_t), "RX small frame copies");
+
+static void pbuf_free_small(struct pbuf *p);
+#endif
+
 /* Variable Definitions */
-static uint8_t RxAllocStatus;
+/* ETH_CODE: written by the EthIf task and read from pbuf_free_custom() */
+static volatile uint8_t RxAllocStatus;
 #if defined ( __ICCARM__ ) /*!< IAR Compiler */
 
-#pragma location=0x30000000
+#pragma location=ETHIF_RX_DESC_ADDR
 ETH_DMADescTypeDef  DMARxDscrTab[ETH_RX_DESC_CNT]; /* Ethernet Rx DMA Descriptors */
-#pragma location=0x30000080
+#pragma location=ETHIF_TX_DESC_ADDR
 ETH_DMADescTypeDef  DMATxDscrTab[ETH_TX_DESC_CNT]; /* Ethernet Tx DMA Descriptors */
 
 #elif defined ( __CC_ARM )  /* MDK ARM Compiler */
 
-__attribute__((at(0x30000000))) ETH_DMADescTypeDef  DMARxDscrTab[ETH_RX_DESC_CNT]; /* Ethernet Rx DMA Descriptors */
-__attribute__((at(0x30000080))) ETH_DMADescTypeDef  DMATxDscrTab[ETH_TX_DESC_CNT]; /* Ethernet Tx DMA Descriptors */
+__attribute__((at(ETHIF_RX_DESC_ADDR))) ETH_DMADescTypeDef  DMARxDscrTab[ETH_RX_DESC_CNT]; /* Ethernet Rx DMA Descriptors */
+__attribute__((at(ETHIF_TX_DESC_ADDR))) ETH_DMADescTypeDef  DMATxDscrTab[ETH_TX_DESC_CNT]; /* Ethernet Tx DMA Descriptors */
 
 #elif defined ( __GNUC__ ) /* GNU Compiler */
 
@@ -122,7 +176,7 @@ ETH_DMADescTypeDef DMATxDscrTab[ETH_TX_DESC_CNT] __attribute__((section(".TxDecr
 #endif
 
 #if defined ( __ICCARM__ ) /*!< IAR Compiler */
-#pragma location = 0x30000100
+#pragma location = ETHIF_RX_POOL_ADDR
 extern u8_t memp_memory_RX_POOL_base[];
 
 #elif defined ( __CC_ARM ) /* MDK ARM Compiler */
@@ -135,32 +189,97 @@ __attribute__((section(".Rx_PoolSection"))) extern u8_t memp_memory_RX_POOL_base
 /* USER CODE BEGIN 2 */
 /* ETH_CODE: placement of RX_POOL
  * Please note this was tested only for GCC compiler.
- * Additional code needed in linkerscript for GCC.
- *
- * Also this buffer can be placed in D1 SRAM
- * if there is not sufficient space in D2.
- * This can be case of STM32H72x/H73x devices.
- * However the 32-byte alignment should be forced.
- * Below is example of placement into BSS section
- *
- * . = ALIGN(32);
- * *(.Rx_PoolSection)
- * . = ALIGN(4);
- * _ebss = .;
- *  __bss_end__ = _ebss;
- * } >RAM_D1
+ * The linker script puts .Rx_PoolSection right after the descriptor
+ * region, in the 32 KB DMA area of the device's memory map
+ * (mpu/mpu_layout.h): D2 SRAM on the H743 and on the H72x/H73x alike,
+ * where the 32 KB of D2 SRAM are all DMA area and the lwIP heap moved to
+ * AXI SRAM instead. Elsewhere the buffers need 32-byte alignment and an
+ * MPU region of their own (MPU_DMA_POLICY).
  */
 #if defined ( __ICCARM__ ) /*!< IAR Compiler */
-#pragma location = 0x30040200
+#pragma location = ETHIF_RX_POOL_ADDR
 extern u8_t memp_memory_RX_POOL_base[];
 
 #elif defined ( __CC_ARM )  /* MDK ARM Compiler */
-__attribute__((at(0x30040200)) extern u8_t memp_memory_RX_POOL_base[];
+__attribute__((at(ETHIF_RX_POOL_ADDR)) extern u8_t memp_memory_RX_POOL_base[];
 
 #elif defined ( __GNUC__ ) /* GNU Compiler */
 __attribute__((section(".Rx_PoolSection"))) extern u8_t memp_memory_RX_POOL_base[];
 
 #endif
+
+/* ETH_CODE: layout checks, see ethernetif_opts.h */
+_Static_assert(sizeof(ETH_DMADescTypeDef) == ETHIF_DMA_DESC_SIZE, "ETHIF_DMA_DESC_SIZE out of date");
+_Static_assert((ETHIF_DESC_REGION_SIZE & (ETHIF_DESC_REGION_SIZE - 1U)) == 0U &&
+               (ETHIF_DESC_BASE & (ETHIF_DESC_REGION_SIZE - 1U)) == 0U,
+               "the descriptor MPU region must be a power of two aligned to its size");
+_Static_assert((1UL << (ETHIF_DESC_MPU_SIZE + 1U)) == ETHIF_DESC_REGION_SIZE,
+               "ETHIF_DESC_MPU_SIZE does not match ETHIF_DESC_REGION_SIZE");
+_Static_assert(ETHIF_RX_DESC_SPAN + ETHIF_TX_DESC_SPAN <= ETHIF_DESC_REGION_SIZE,
+               "ETH DMA descriptors do not fit in their MPU region");
+#if ETHIF_JUMBO
+_Static_assert(ETH_RX_DESC_CNT > (ETHIF_FRAME_MAX + 4U + ETH_RX_BUFFER_SIZE - 1U) / ETH_RX_BUFFER_SIZE,
+               "ETH_RX_DESC_CNT cannot hold a jumbo frame");
+#endif
+_Static_assert(MEM_SIZE <= MPU_LAYOUT_HEAP_SIZE &&
+               (LWIP_RAM_HEAP_POINTER + MEM_SIZE <= ETHIF_DESC_BASE ||
+                LWIP_RAM_HEAP_POINTER >= ETHIF_DESC_BASE + MPU_LAYOUT_DMA_SIZE),
+               "lwIP heap overlaps the ETH DMA area");
+_Static_assert(ETH_RX_BUFFER_CNT >= ETH_RX_DESC_CNT,
+               "RX_POOL must hold at least one buffer per RX descriptor");
+_Static_assert(ETHIF_RX_POOL_ADDR + ETH_RX_BUFFER_CNT * sizeof(RxBuff_t) + MEM_ALIGNMENT <= ETHIF_D2_END,
+               "RX_POOL does not fit in RAM_D2");
+#if TCP_PROFILE_BULK
+/* ETH_CODE: memory behind the bulk TCP profile of lwipopts.h */
+_Static_assert(TCP_WND <= (ETH_RX_BUFFER_CNT - ETH_RX_DESC_CNT) * TCP_MSS,
+               "TCP_WND exceeds the RX_POOL buffers outside the RX ring");
+#if MEM_USE_POOLS
+_Static_assert(TCP_SND_BUF / TCP_MSS + 8U <= LWIP_POOL_1600_NUM,
+               "TCP_SND_BUF leaves fewer than 8 buffers of the 1600-byte malloc pool");
+#if TCP_SND_AUTOTUNE
+_Static_assert((TCP_SND_BUF_MIN + TCP_SND_BUDGET) / TCP_MSS + 8U <= LWIP_POOL_1600_NUM,
+               "TCP_SND_BUDGET leaves fewer than 8 buffers of the 1600-byte malloc pool");
+#endif
+#endif
+#endif
+
+/* ETH_CODE: memory budget of the LWIP_PROFILE (lwipopts_profile.h) against
+ * the MPU layout (mpu/mpu_layout.h). Pool bytes as memp.c lays them out,
+ * without MEMP_OVERFLOW_CHECK. */
+#define ETHIF_POOL_BYTES(num, size)   ((uint32_t)(num) * LWIP_MEM_ALIGN_SIZE(size) + MEM_ALIGNMENT - 1U)
+#if MEM_USE_POOLS
+#define ETHIF_MALLOC_POOL_BYTES(num, size) \
+  ETHIF_POOL_BYTES(num, (size) + LWIP_MEM_ALIGN_SIZE(sizeof(struct memp_malloc_helper)))
+#define ETHIF_D2_HEAP_BYTES           (ETHIF_MALLOC_POOL_BYTES(LWIP_POOL_128_NUM, 128U) + \
+                                       ETHIF_MALLOC_POOL_BYTES(LWIP_POOL_640_NUM, 640U) + \
+                                       ETHIF_MALLOC_POOL_BYTES(LWIP_POOL_1600_NUM, 1600U))
+#else
+#define ETHIF_D2_HEAP_BYTES           ((uint32_t)MEM_SIZE)
+#endif
+#define ETHIF_D2_DMA_BYTES            (ETHIF_DESC_REGION_SIZE + ETHIF_POOL_BYTES(ETH_RX_BUFFER_CNT, sizeof(RxBuff_t)))
+#if ETHIF_RX_COPY_MAX
+#define ETHIF_AXI_RX_SMALL_BYTES      ETHIF_POOL_BYTES(ETHIF_RX_SMALL_CNT, sizeof(RxSmall_t))
+#else
+#define ETHIF_AXI_RX_SMALL_BYTES      0U
+#endif
+#define ETHIF_AXI_LWIP_BYTES          (ETHIF_POOL_BYTES(PBUF_POOL_SIZE, LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf)) + \
+                                                        LWIP_MEM_ALIGN_SIZE(PBUF_POOL_BUFSIZE)) + \
+                                       ETHIF_POOL_BYTES(MEMP_NUM_PBUF, sizeof(struct pbuf)) + \
+                                       ETHIF_POOL_BYTES(MEMP_NUM_TCP_SEG, sizeof(struct tcp_seg)) + \
+                                       ETHIF_POOL_BYTES(MEMP_NUM_TCP_PCB, sizeof(struct tcp_pcb)) + \
+                                       ETHIF_AXI_RX_SMALL_BYTES)
+_Static_assert(LWIP_RAM_HEAP_POINTER == MPU_LAYOUT_HEAP_BASE,
+               "the lwIP heap is not at MPU region 1");
+_Static_assert(ETHIF_D2_HEAP_BYTES <= MPU_LAYOUT_HEAP_SIZE,
+               "LWIP_PROFILE: the malloc pools exceed MPU region 1 (MPU_LAYOUT_HEAP_SIZE)");
+_Static_assert(ETHIF_D2_DMA_BYTES <= MPU_LAYOUT_DMA_SIZE &&
+               ETHIF_DESC_BASE + MPU_LAYOUT_DMA_SIZE <= ETHIF_D2_END,
+               "LWIP_PROFILE: descriptors and RX_POOL exceed MPU region 2 (D2, 32 KB)");
+_Static_assert(ETHIF_AXI_LWIP_BYTES <= LWIP_PROFILE_AXI_BUDGET &&
+               LWIP_PROFILE_AXI_BUDGET <= MPU_LAYOUT_AXI_SIZE,
+               "LWIP_PROFILE: the lwIP pools exceed LWIP_PROFILE_AXI_BUDGET of AXI SRAM");
+_Static_assert(IP_REASS_MAX_PBUFS < PBUF_POOL_SIZE,
+               "LWIP_PROFILE: reassembly would take all of PBUF_POOL");
 /* USER CODE END 2 */
 
 osSemaphoreId RxPktSemaphore = NULL;   /* Semaphore to signal incoming packets */
@@ -186,7 +305,672 @@ lan8742_IOCtx_t  LAN8742_IOCtx = {ETH_PHY_IO_Init,
                                   ETH_PHY_IO_GetTick};
 
 /* USER CODE BEGIN 3 */
+static EthIfRxStatsTypeDef RxStats;
+#if ETHIF_RX_CSUM_DROP || ETHIF_ARP_OFFLOAD
+/* ETH_CODE: set by HAL_ETH_RxLinkCallback() for the frame being completed */
+#define RX_FRAME_KEEP     0U
+#define RX_FRAME_BAD      1U
+#define RX_FRAME_ARP      2U
+static uint8_t RxFrameDrop;
+#endif
+#if ETHIF_ARP_OFFLOAD
+static void ethernetif_arp_offload_cb(struct netif *netif, netif_nsc_reason_t reason,
+                                      const netif_ext_callback_args_t *args);
+NETIF_DECLARE_EXT_CALLBACK(ArpOffloadCallback)
+static struct netif *ArpOffloadNetif;
+#endif
+
+#if ETHIF_RX_BATCH
+/* ETH_CODE: frames passed from the EthIf task (producer) to the tcpip
+ * thread (consumer), or to itself with ETHIF_RX_INLINE. Free-running
+ * indices, empty when equal. Each side publishes its index with a release
+ * store after its slot access and reads the other's with an acquire load:
+ * volatile alone lets the slot store move past the index store. */
+static struct pbuf *RxQueue[ETHIF_RX_QUEUE_LEN];
+static volatile uint32_t RxQueueHead;
+static volatile uint32_t RxQueueTail;
+#if !ETHIF_RX_INLINE
+static struct tcpip_callback_msg *RxDeliverMsg;
+static volatile uint8_t RxDeliverPending;
+
+static void ethernetif_rx_deliver(void *arg);
+#endif
+#endif
+
+#if ETHIF_RX_DIRECT
+/* ETH_CODE: posted by the RX interrupt, runs the receive poll on the
+ * tcpip thread. Pending while the message is in TCPIP_MBOX. */
+static struct tcpip_callback_msg *RxDirectMsg;
+static volatile uint8_t RxDirectPending;
+
+static void ethernetif_rx_direct(void *arg);
+#endif
+
+#if ETHIF_RX_LATENCY
+/* ETH_CODE: RxIrqCycles is written by the RX interrupt, RxLatT0 by the
+ * EthIf task for the frames of the current wakeup. */
+static volatile uint32_t RxIrqCycles;
+static volatile uint8_t RxIrqFresh;
+static uint32_t RxLatT0;
+static LatHist_t RxLatHist[ETHIF_RXLAT_CNT];
+
+static err_t ethernetif_rx_latency_input(struct pbuf *p, struct netif *netif);
+#define ETHIF_ETHERNET_INPUT ethernetif_rx_latency_input
+#else
+#define ETHIF_ETHERNET_INPUT ethernet_input
+#endif
+
+#if ETHIF_VLAN
+static void ethernetif_vlan_init(void);
+#endif
+
+#if ETHIF_EEE
+/* ETH_CODE: LPI state. EeeWakeStart is the DWT cycle count (made odd, 0
+ * when idle) at which a frame was submitted with TX in LPI. */
+static EthIfEeeStatsTypeDef EeeStats;
+static uint8_t EeeLinkOk;
+static volatile uint8_t EeeAllowed = 1U;
+static volatile uint32_t EeeWakeStart;
+
+static void ethernetif_eee_init(void);
+static void ethernetif_eee_link(uint8_t up);
+static void ethernetif_eee_tx_done(void);
+#endif
+
+#if ETHIF_WOL
+/* ETH_CODE: standby state. WolWakeCyc is the DWT cycle count of the wake;
+ * WolFirstRx/Tx hold it (made odd, 0 when done) until the first frame
+ * after the resume. */
+static EthIfWolStatsTypeDef WolStats;
+static osSemaphoreId_t WolSemaphore;
+static volatile uint8_t WolParked;
+static volatile EthIfWakeTypeDef WolWake;
+static volatile uint32_t WolWakeCyc;
+static volatile uint32_t WolFirstRx;
+static volatile uint32_t WolFirstTx;
+
+static void ethernetif_wol_init(void);
+static void ethernetif_wol_first(volatile uint32_t *start, uint32_t *us);
+#endif
+
+/* ETH_CODE: data path calls, the HAL's or the lean ones (ethernetif_dma.h) */
+#if ETHIF_LEAN_DMA
+#define ETHIF_DMA_READ(h, b)      ethernetif_dma_read((h), (b))
+#define ETHIF_DMA_TX(h, c)        ethernetif_dma_transmit((h), (c), 1U)
+#define ETHIF_DMA_TX_NOPOLL(h, c) ethernetif_dma_transmit((h), (c), 0U)
+#define ETHIF_DMA_RELEASE(h)      ethernetif_dma_release(h)
+#define HAL_ETH_TransmitPoll      ethernetif_dma_kick
+#define HAL_ETH_PTP_InsertTxTimestamp ethernetif_dma_tx_tstamp
+#define HAL_ETH_RxRebuild         ethernetif_dma_rebuild
+/* Descriptor HAL_ETH_RxLinkCallback() is called for */
+#define ETHIF_RX_LINK_IDX         ethernetif_dma_rx_idx
+#else
+#define ETHIF_DMA_READ(h, b)      HAL_ETH_ReadData((h), (b))
+#define ETHIF_DMA_TX(h, c)        HAL_ETH_Transmit_IT((h), (c))
+#define ETHIF_DMA_TX_NOPOLL(h, c) HAL_ETH_TransmitNoPoll_IT((h), (c))
+#define ETHIF_DMA_RELEASE(h)      HAL_ETH_ReleaseTxPacket(h)
+/* First descriptor HAL_ETH_RxLinkCallback() may be called for */
+#define ETHIF_RX_LINK_IDX         heth.RxDescList.RxDescIdx
+#endif
+
+#if ETHIF_DMA_PROF
+/* ETH_CODE: the calls timed with the DWT cycle counter */
+static EthIfDmaProfTypeDef DmaProf = { .lean = ETHIF_LEAN_DMA };
+
+static ITCM_FUNC HAL_StatusTypeDef ethernetif_prof_read(ETH_HandleTypeDef *h, void **pAppBuff)
+{
+  uint32_t t0 = DWT->CYCCNT;
+  HAL_StatusTypeDef status = ETHIF_DMA_READ(h, pAppBuff);
+
+  DmaProf.rx_cycles += DWT->CYCCNT - t0;
+  DmaProf.rx_frames += (status == HAL_OK) ? 1U : 0U;
+  return status;
+}
+
+static ITCM_FUNC HAL_StatusTypeDef ethernetif_prof_tx(ETH_HandleTypeDef *h, ETH_TxPacketConfigTypeDef *c,
+                                                      uint8_t poll)
+{
+  uint32_t t0 = DWT->CYCCNT;
+  HAL_StatusTypeDef status = (poll != 0U) ? ETHIF_DMA_TX(h, c) : ETHIF_DMA_TX_NOPOLL(h, c);
+
+  if (status == HAL_OK)
+  {
+    DmaProf.tx_cycles += DWT->CYCCNT - t0;
+    DmaProf.tx_frames++;
+  }
+  return status;
+}
+
+static ITCM_FUNC HAL_StatusTypeDef ethernetif_prof_release(ETH_HandleTypeDef *h)
+{
+  uint32_t t0 = DWT->CYCCNT;
+  HAL_StatusTypeDef status = ETHIF_DMA_RELEASE(h);
+
+  DmaProf.release_cycles += DWT->CYCCNT - t0;
+  return status;
+}
+
+#define HAL_ETH_ReadData(h, b)          ethernetif_prof_read((h), (b))
+#define HAL_ETH_Transmit_IT(h, c)       ethernetif_prof_tx((h), (c), 1U)
+#define HAL_ETH_TransmitNoPoll_IT(h, c) ethernetif_prof_tx((h), (c), 0U)
+#define HAL_ETH_ReleaseTxPacket(h)      ethernetif_prof_release(h)
+#elif ETHIF_LEAN_DMA
+#define HAL_ETH_ReadData(h, b)          ETHIF_DMA_READ(h, b)
+#define HAL_ETH_Transmit_IT(h, c)       ETHIF_DMA_TX(h, c)
+#define HAL_ETH_TransmitNoPoll_IT(h, c) ETHIF_DMA_TX_NOPOLL(h, c)
+#define HAL_ETH_ReleaseTxPacket(h)      ETHIF_DMA_RELEASE(h)
+#endif
+#if (ETHIF_VLAN || ETHIF_RX_CTRL_PRIO) && ETHIF_RX_BATCH
+/* ETH_CODE: frames tagged with PCP >= ETHIF_VLAN_PRIO_PCP and control
+ * frames, drained ahead of RxQueue, indices ordered as RxQueue's.
+ * RxPrioMsg goes to the front of the tcpip mailbox. RxFramePrio is set by HAL_ETH_RxLinkCallback() for the
+ * frame being completed. */
+#define ETHIF_RX_PRIO     1
+static struct pbuf *RxPrioQueue[ETHIF_RX_PRIO_QUEUE_LEN];
+static volatile uint32_t RxPrioHead;
+static volatile uint32_t RxPrioTail;
+#if ETHIF_VLAN
+static uint8_t RxFramePrio;
+#endif
+#if !ETHIF_RX_INLINE
+static struct tcpip_callback_msg *RxPrioMsg;
+static volatile uint8_t RxPrioPending;
+
+static void ethernetif_rx_deliver_prio(void *arg);
+#endif
+#else
+#define ETHIF_RX_PRIO     0
+#endif
+
+#if ETHIF_RX_ADMIT
+/* ETH_CODE: admission control (ETHIF_RX_ADMIT). RxAdmitLevel is written by
+ * whoever polls the ring (the EthIf task, the tcpip thread with
+ * ETHIF_RX_DIRECT); the port map by the tcpip thread, into the half not
+ * being read. */
+#define ETHIF_RX_ADMIT_HEADROOM   (ETH_RX_BUFFER_CNT - ETH_RX_DESC_CNT)
+#define ETHIF_RX_ADMIT_WORDS      (ETHIF_RX_ADMIT_PORT_BITS / 32U)
+
+#if (ETHIF_RX_ADMIT_PORT_BITS & (ETHIF_RX_ADMIT_PORT_BITS - 1U)) != 0U
+#error "ETHIF_RX_ADMIT_PORT_BITS must be a power of two"
+#endif
+
+static volatile uint8_t RxAdmitLevel;
+static uint32_t RxAdmitCalm;              /* sys_now() of the last step */
+static uint32_t RxAdmitCpu;               /* load in per mille */
+static uint32_t RxAdmitCpuT;
+static uint32_t RxAdmitIdle0;
+static uint32_t RxAdmitTotal0;
+static uint32_t RxAdmitPorts[2][ETHIF_RX_ADMIT_WORDS];
+static volatile uint8_t RxAdmitPortsCur;
+
+static uint32_t ethernetif_rx_pool_free(void);
+static void ethernetif_rx_admit_ports(void *arg);
+#endif
+
+#if ETHIF_UDP_FAST
+/* ETH_CODE: fast path ports, written with the core lock held, read by the
+ * EthIf task. port is published last and cleared first; 0 is a free slot. */
+typedef struct
+{
+  volatile uint16_t port;
+  EthIfUdpFastFn fn;
+  osMessageQueueId_t queue;
+  void *arg;
+} UdpFastPort_t;
+
+static UdpFastPort_t UdpFastPorts[ETHIF_UDP_FAST_PORTS];
+static volatile uint32_t UdpFastCnt;
+#endif
+
+#if ETHIF_RX_STEER
+/* ETH_CODE: steering rules, written with the core lock held, read by the
+ * EthIf task. type (network byte order) is published last and cleared
+ * first; 0 is a free slot. */
+typedef struct
+{
+  volatile uint16_t type;
+  uint16_t proto;
+  EthIfRxSteerFn fn;
+  osMessageQueueId_t queue;
+  void *arg;
+} RxSteerRule_t;
+
+static RxSteerRule_t RxSteerRules[ETHIF_RX_STEER_RULES];
+static volatile uint32_t RxSteerCnt;
+#endif
+
+#if ETHIF_TX_QUEUE
+#if ETHIF_TX_SCHED
+#define ETHIF_TX_QUEUES   ETHIF_TX_CLASS_CNT
+#else
+#define ETHIF_TX_QUEUES   1U
+#endif
+/* ETH_CODE: software TX queues, one per class with ETHIF_TX_SCHED, only
+ * touched with the lwIP core lock held. Free-running indices, empty when
+ * equal. */
+typedef struct
+{
+  struct pbuf *frame[ETHIF_TX_QUEUE_LEN];
+#if ETHIF_TX_SCHED
+  uint32_t stamp[ETHIF_TX_QUEUE_LEN];   /* DWT cycles when queued */
+  int32_t deficit;                      /* DRR, bytes */
+#endif
+  uint32_t head;
+  uint32_t tail;
+} TxQueueTypeDef;
+
+static TxQueueTypeDef TxQueue[ETHIF_TX_QUEUES];
+static uint32_t TxQueued;       /* frames in all queues */
+static struct tcpip_callback_msg *TxKickMsg;
+static volatile uint8_t TxKickPending;
+
+static void ethernetif_tx_kick(void *arg);
+#endif
+static void ethernetif_tx_reclaim(void);
+#if ETHIF_PKTGEN
+static void ethernetif_pktgen_fill(void);
+#endif
+#if ETHIF_TX_SCHED
+/* ETH_CODE: class of each frame in the DMA ring, in submission order;
+ * HAL_ETH_TxFreeCallback() releases them in the same order. Core lock. */
+static uint8_t TxRingClass[ETH_TX_DESC_CNT];
+static uint32_t TxRingHead;
+static uint32_t TxRingTail;
+static uint32_t TxRingLow;      /* non-control frames in the ring */
+static uint32_t TxDrrClass = ETHIF_TX_CLASS_TELEMETRY;
+static uint8_t TxDrrGranted;    /* quantum of this turn added */
+static EthIfTxClassStatsTypeDef TxClassStats[ETHIF_TX_CLASS_CNT];
+static uint32_t TxClassDelayMax[ETHIF_TX_CLASS_CNT];   /* cycles */
+
+static const int32_t TxDrrQuantum[ETHIF_TX_CLASS_CNT] =
+{
+  0, ETHIF_TX_SCHED_QUANTUM_TELEMETRY, ETHIF_TX_SCHED_QUANTUM_LOGGING, ETHIF_TX_SCHED_QUANTUM_BULK
+};
+#endif
+/* ETH_CODE: link losses, link thread under the core lock */
+static EthIfLinkStatsTypeDef LinkStats;
+#if ETHIF_LINK_FLAP_MS
+static uint32_t LinkFlapSince;  /* HAL_GetTick() | 1 of the loss, 0: none */
+static uint8_t LinkFlapHold;    /* TX held for the flap */
+#endif
+#if ETHIF_TX_SHAPE
+/* ETH_CODE: token buckets, in bytes scaled by 2^ETHIF_TX_SHAPE_Q. Tokens go
+ * negative when a time-triggered window sends past the rate. Core lock. */
+#define ETHIF_TX_SHAPE_Q  24U
+
+typedef struct
+{
+  int64_t tokens;
+  int64_t burst;
+  uint32_t rate;        /* per DWT cycle; 0: unshaped */
+  uint32_t stamp;       /* DWT cycles of the last fill */
+  uint32_t kbps;        /* rate is derived from, at the core clock */
+} TxShapeTypeDef;
+
+static TxShapeTypeDef TxShape[ETHIF_TX_CLASS_CNT];
+static uint8_t TxShapeTimer;    /* ethernetif_tx_shape_timer() pending */
+
+static void ethernetif_tx_shape_config(uint32_t c, uint32_t rate_kbps, uint32_t burst);
+#endif
+#if ETHIF_TX_TT
+/* ETH_CODE: time-triggered window. TxTtOpen is only touched with the core
+ * lock held; TxTtArmed is set by the window close and cleared by the
+ * compare interrupt, which then owns the stats. */
+static uint8_t TxTtOpen;
+static volatile uint8_t TxTtArmed;
+static uint32_t TxTtFrames;     /* in the open window */
+static uint64_t TxTtAt;         /* time_now_ns() of the window */
+static uint32_t TxTtMul;        /* timer ticks per ns, units of 2^-32 */
+static EthIfTxTtStatsTypeDef TxTtStats;
+
+static void ethernetif_tx_tt_init(void);
+#endif
+#if ETHIF_TX_BATCH
+/* ETH_CODE: set while frames are left in the ring for one tail pointer
+ * write; core lock held */
+static uint8_t TxBatch;
+static uint32_t TxTailPending;  /* frames queued since the last write */
+#endif
+static EthIfTxStatsTypeDef TxStats;
+static uint32_t DmaErrors;
+static uint32_t MacErrors;
+#if ETHIF_STATS_LOG_MS
+static void ethernetif_stats_timer(void *arg);
+#endif
+
+#if ETHIF_PTP
+/* ETH_CODE: PTP clock. PtpAddendBase is the addend for a nominal
+ * frequency of 1e9 / SSINC Hz, PtpTxHook is only called on the tcpip
+ * thread. */
+static uint32_t PtpAddendBase;
+static EthIfPtpTxHook PtpTxHook;
+
+static void ethernetif_ptp_init(void);
+
+static uint8_t ethernetif_ptp_tx_requested(const struct pbuf *p)
+{
+  for (; p != NULL; p = p->next)
+  {
+    if ((p->flags & ETHIF_PBUF_FLAG_TSTAMP) != 0U)
+    {
+      return 1U;
+    }
+  }
+  return 0U;
+}
+#endif
+
+#if ETHIF_PHY_IT
+/* ETH_CODE: released from the PHY nINT EXTI callback */
+static osSemaphoreId_t PhyItSemaphore;
+#endif
+
+#if LWIP_IGMP || (LWIP_IPV6 && LWIP_IPV6_MLD)
+/* ETH_CODE: multicast hash filter, 64 bins (MACHT0R/MACHT1R). Several
+ * groups can share a bin, hence a reference count per bin. Only touched
+ * with the core lock held. */
+static uint8_t McastHashRefs[64];
+static uint32_t McastHashTable[2];
+
+static void ethernetif_mcast_init(void);
+static void ethernetif_mcast_update(const uint8_t *mac, enum netif_mac_filter_action action);
+#endif
+#if LWIP_IGMP
+static err_t ethernetif_igmp_mac_filter(struct netif *netif, const ip4_addr_t *group,
+                                        enum netif_mac_filter_action action);
+#endif
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+static err_t ethernetif_mld_mac_filter(struct netif *netif, const ip6_addr_t *group,
+                                       enum netif_mac_filter_action action);
+#endif
+
+/* ETH_CODE: TX bounce buffers for pbuf chains longer than ETH_TX_BUFFER_MAX.
+ * Plain .bss in AXI SRAM (write-through, no clean needed before the DMA
+ * reads it). Allocated and freed with the core lock held only, so an in-use
+ * flag is all the bookkeeping needed. */
+typedef struct
+{
+  struct pbuf_custom pbuf_custom;
+  uint8_t in_use;
+  uint8_t buff[ETHIF_ALIGN32(ETHIF_FRAME_MAX)] __ALIGNED(32);
+} TxBounceBuff_t;
+
+static TxBounceBuff_t TxBounce[ETHIF_TX_BOUNCE_CNT] __ALIGNED(32);
+
+#if ETHIF_PKTGEN
+/* ETH_CODE: traffic generator frames, built once at the start; only the
+ * sequence number changes per send. AXI SRAM like the bounce buffers, and
+ * likewise only touched with the core lock held. */
+#define PKTGEN_MAGIC            0x504B5447UL    /* "PKTG" */
+#define PKTGEN_SEQ_OFS          (SIZEOF_ETH_HDR + 4U)
+#define PKTGEN_STAMP_OFS        (SIZEOF_ETH_HDR + 8U)   /* DWT at the submit, native order */
+#define PKTGEN_LEN_MIN          60U
+#define PKTGEN_LEN_MAX          (ETHIF_MTU + SIZEOF_ETH_HDR)
+
+typedef struct
+{
+  struct pbuf_custom pbuf_custom;
+  uint8_t state;                  /* 0 free, 1 built, 2 in the ring */
+  uint8_t buff[ETHIF_ALIGN32(ETHIF_FRAME_MAX)] __ALIGNED(32);
+} PktgenBuff_t;
+
+static PktgenBuff_t PktgenBuff[ETHIF_PKTGEN_BUFS] __ALIGNED(32);
+static EthIfPktgenConfigTypeDef PktgenCfg;
+static EthIfPktgenStatsTypeDef PktgenStats;
+static uint32_t PktgenStart;    /* HAL_GetTick() */
+static uint32_t PktgenEchoNext; /* sequence number expected back, EthIf task */
+static uint64_t PktgenLatSum;   /* submit to receive stamp of the echoes, cycles */
+static uint32_t PktgenLatMin;
+static uint32_t PktgenLatMax;
+static uint8_t PktgenTimer;
+#if ETHIF_RX_STEER
+/* ETH_CODE: the PHY loops frames back; the link thread leaves MAC and
+ * netif alone meanwhile */
+static volatile uint8_t LoopbackActive;
+#endif
+#endif
+
+/* ETH_CODE: EthIf task memory, zero wait state for the RX/TX path. */
+static StaticTask_t EthIfTcb DTCM_BSS;
+static uint32_t EthIfStack[(INTERFACE_THREAD_STACK_SIZE + 3U) / 4U] DTCM_BSS __ALIGNED(8);
+
+#if ETHIF_TASK_NOTIFY
+static TaskHandle_t EthIfTask;
+#else
+/* ETH_CODE: control blocks of the driver semaphores, none from the heap */
+static StaticSemaphore_t RxPktSemaphoreCb DTCM_BSS;
+static const osSemaphoreAttr_t RxPktSemaphoreAttr = {
+  .name = "EthRx", .cb_mem = &RxPktSemaphoreCb, .cb_size = sizeof(RxPktSemaphoreCb)
+};
+#endif
+/* ETH_CODE: the blocking transmitter waits on the semaphore even with
+ * ETHIF_TASK_NOTIFY: it runs on the tcpip thread or a core-locked socket
+ * caller, whose notification value carries the mailbox and socket event
+ * flags (sys_arch.c) and cannot be taken as a count */
+#if !ETHIF_TASK_NOTIFY || !ETHIF_TX_QUEUE
+static StaticSemaphore_t TxPktSemaphoreCb DTCM_BSS;
+static const osSemaphoreAttr_t TxPktSemaphoreAttr = {
+  .name = "EthTx", .cb_mem = &TxPktSemaphoreCb, .cb_size = sizeof(TxPktSemaphoreCb)
+};
+#endif
+#if ETHIF_WOL
+static StaticSemaphore_t WolSemaphoreCb;
+static const osSemaphoreAttr_t WolSemaphoreAttr = {
+  .name = "EthWol", .cb_mem = &WolSemaphoreCb, .cb_size = sizeof(WolSemaphoreCb)
+};
+#endif
+#if ETHIF_PHY_IT
+static StaticSemaphore_t PhyItSemaphoreCb;
+static const osSemaphoreAttr_t PhyItSemaphoreAttr = {
+  .name = "EthPhyIt", .cb_mem = &PhyItSemaphoreCb, .cb_size = sizeof(PhyItSemaphoreCb)
+};
+#endif
+
+#if ETHIF_RX_DIRECT
+/* ETH_CODE: post RxDirectMsg unless it is pending, from interrupts and
+ * tasks. Returns 0 if it could not be posted (TCPIP_MBOX full). */
+static ITCM_FUNC uint8_t ethernetif_rx_direct_post(void)
+{
+  err_t err;
+
+  if (RxDirectMsg == NULL)
+  {
+    return 0U;
+  }
+  if (RxDirectPending != 0U)
+  {
+    return 1U;
+  }
+  /* An interrupt between the test and the set posts a second message,
+   * which then finds the ring empty */
+  RxDirectPending = 1U;
+  err = (__get_IPSR() != 0U) ? tcpip_callbackmsg_trycallback_fromisr(RxDirectMsg)
+                             : tcpip_callbackmsg_trycallback(RxDirectMsg);
+  if (err != ERR_OK)
+  {
+    RxDirectPending = 0U;
+    RxStats.mbox_full++;
+    return 0U;
+  }
+  RxStats.batches++;
+  return 1U;
+}
+#endif
+
+/* ETH_CODE: wake the EthIf task, from interrupts and tasks. With
+ * ETHIF_RX_DIRECT the tcpip thread instead, the task only if that fails. */
+static ITCM_FUNC void ethernetif_rx_signal(void)
+{
+#if ETHIF_RX_DIRECT
+  if (ethernetif_rx_direct_post() != 0U)
+  {
+    return;
+  }
+#endif
+#if ETHIF_TASK_NOTIFY
+  if (EthIfTask == NULL)
+  {
+    return;
+  }
+  if (__get_IPSR() != 0U)
+  {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(EthIfTask, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+  else
+  {
+    xTaskNotifyGive(EthIfTask);
+  }
+#else
+  osSemaphoreRelease(RxPktSemaphore);
+#endif
+}
+
+#if SUPERVISOR
+/* ETH_CODE: supervisor probe: the time from this wakeup to the EthIf task
+ * running is its latency, whatever the ring holds. The task itself, also
+ * with ETHIF_RX_DIRECT, where it then posts one empty poll. */
+static bool ethernetif_supervisor_probe(SupervisorCheck_t *c)
+{
+  LWIP_UNUSED_ARG(c);
+#if ETHIF_TASK_NOTIFY
+  if (EthIfTask == NULL)
+  {
+    return false;
+  }
+  xTaskNotifyGive(EthIfTask);
+  return true;
+#else
+  return osSemaphoreRelease(RxPktSemaphore) == osOK;
+#endif
+}
+
+static SupervisorCheck_t EthIfSupervisor = {
+  .name = "ethif",
+  .budget_us = SUPERVISOR_ETHIF_BUDGET_US,
+  .timeout_ms = SUPERVISOR_PROBE_TIMEOUT_MS,
+  .probe = ethernetif_supervisor_probe,
+};
+#endif
+
+/* ETH_CODE: TX descriptors were freed, from the ETH interrupt. */
+static ITCM_FUNC void ethernetif_tx_signal(void)
+{
+#if !ETHIF_TASK_NOTIFY || !ETHIF_TX_QUEUE
+  osSemaphoreRelease(TxPktSemaphore);
+#endif
+}
+
+/* ETH_CODE: D-cache policy, from the MPU layout (mpu/mpu_layout.h). Only
+ * write-back memory the ETH DMA can reach needs a clean before transmit:
+ * AXI SRAM, the lwIP heap and RX_POOL when their policy says so, the rest
+ * of D2 SRAM and D3 SRAM (default map) always. Flash is never dirty. The
+ * heap is in D2 SRAM or above region 3 in AXI SRAM, depending on the
+ * device. */
+static ITCM_FUNC inline uint8_t ethernetif_cache_wb(uint32_t addr)
+{
+  if ((addr >= MPU_LAYOUT_HEAP_BASE) && (addr < MPU_LAYOUT_HEAP_BASE + MPU_LAYOUT_HEAP_SIZE))
+  {
+    return MPU_POLICY_WRITEBACK(MPU_HEAP_POLICY) ? 1U : 0U;
+  }
+  if ((addr >= MPU_LAYOUT_AXI_BASE) && (addr < MPU_LAYOUT_AXI_BASE + MPU_LAYOUT_AXI_SIZE))
+  {
+    return MPU_POLICY_WRITEBACK(MPU_AXI_POLICY) ? 1U : 0U;
+  }
+  if ((addr >= MPU_LAYOUT_D2_BASE) && (addr < ETHIF_D2_END))
+  {
+#if MPU_LAYOUT
+    if ((addr >= ETHIF_DESC_BASE) && (addr < ETHIF_DESC_BASE + MPU_LAYOUT_DMA_SIZE))
+    {
+      return MPU_POLICY_WRITEBACK(MPU_DMA_POLICY) ? 1U : 0U;
+    }
+#endif
+    return 1U;
+  }
+  return ((addr >= MPU_LAYOUT_D3_BASE) && (addr < MPU_LAYOUT_D3_END)) ? 1U : 0U;
+}
+
+/* Clean the dirty lines of a frame about to be read by the TX DMA, e.g. an
+ * RX_POOL buffer reused in place for an ICMP echo reply. */
+static ITCM_FUNC inline void ethernetif_cache_tx(struct pbuf *p)
+{
+  for (struct pbuf *q = p; q != NULL; q = q->next)
+  {
+    uint32_t addr = (uint32_t)q->payload;
+    if ((q->len != 0U) && ethernetif_cache_wb(addr))
+    {
+      uint32_t start = addr & ~31U;
+      SCB_CleanDCache_by_Addr((uint32_t *)start, (int32_t)ETHIF_ALIGN32(addr + q->len - start));
+    }
+  }
+}
+
+/* Discard stale lines over the bytes the RX DMA wrote, in whole lines. */
+static ITCM_FUNC inline void ethernetif_cache_rx(uint8_t *buff, uint16_t len)
+{
+#if ETHIF_RX_NONCACHEABLE
+  (void)buff;
+  (void)len;
+#else
+  SCB_InvalidateDCache_by_Addr((uint32_t *)buff, (int32_t)ETHIF_ALIGN32((uint32_t)len));
+#endif
+}
+
+/* Discard the lines of a free RX buffer before the DMA gets it back: lwIP
+ * and the application write into received frames in place (tcp_input()
+ * byte-swaps the headers), and a dirty line evicted once the DMA owns the
+ * buffer would overwrite part of the next frame. */
+static ITCM_FUNC inline void ethernetif_cache_rx_arm(RxBuff_t *b)
+{
+#if ETHIF_RX_NONCACHEABLE
+  (void)b;
+#else
+  SCB_InvalidateDCache_by_Addr((uint32_t *)b->buff, (int32_t)sizeof(b->buff));
+#endif
+}
+
+#if MPU_LAYOUT
+_Static_assert(ETHIF_RX_POOL_ADDR + ETH_RX_BUFFER_CNT * sizeof(RxBuff_t) + MEM_ALIGNMENT <=
+               ETHIF_DESC_BASE + MPU_LAYOUT_DMA_SIZE,
+               "RX_POOL exceeds the MPU_DMA_POLICY region");
+#endif
+
+/* ETH_CODE: every (re)start of the MAC/DMA goes through here, so that the
+ * RX interrupt mode survives HAL_ETH_Start_IT() resetting ItMode. */
+#if ETHIF_RX_COALESCE_US
+/* ETH_CODE: RX watchdog for ETHIF_RX_COALESCE_US at the current HCLK */
+static void ethernetif_rx_rwt_set(ETH_HandleTypeDef *handlerEth)
+{
+  /* RWT counts in units of 256 HCLK cycles */
+  uint32_t rwt = (ETHIF_RX_COALESCE_US * (HAL_RCC_GetHCLKFreq() / 1000000U)) / 256U;
+  if (rwt == 0U)
+  {
+    rwt = 1U;
+  }
+  else if (rwt > ETH_DMACRIWTR_RWT)
+  {
+    rwt = ETH_DMACRIWTR_RWT;
+  }
+  WRITE_REG(handlerEth->Instance->DMACRIWTR, rwt);
+}
+#endif
 
+static HAL_StatusTypeDef ethernetif_start(ETH_HandleTypeDef *handlerEth)
+{
+  HAL_StatusTypeDef status = HAL_ETH_Start_IT(handlerEth);
+
+#if ETHIF_RX_COALESCE_US
+  if (status == HAL_OK)
+  {
+    ethernetif_rx_rwt_set(handlerEth);
+    /* Descriptors rebuilt from now on are queued without IOC */
+    handlerEth->RxDescList.ItMode = 0U;
+  }
+#endif
+  return status;
+}
+#define HAL_ETH_Start_IT ethernetif_start
 /* USER CODE END 3 */
 
 /* Private functions ---------------------------------------------------------*/
@@ -197,18 +981,48 @@ void pbuf_free_custom(struct pbuf *p);
   * @param  handlerEth: ETH handler
   * @retval None
   */
-void HAL_ETH_RxCpltCallback(ETH_HandleTypeDef *handlerEth)
+ITCM_FUNC void HAL_ETH_RxCpltCallback(ETH_HandleTypeDef *handlerEth)
 {
-  osSemaphoreRelease(RxPktSemaphore);
+#if ETHIF_RX_POLL
+  /* ETH_CODE: the EthIf task polls the ring until it is empty */
+  __HAL_ETH_DMA_DISABLE_IT(handlerEth, ETH_DMA_RX_IT);
+#endif
+  RxStats.irq++;
+#if ETHIF_RX_LATENCY
+  RxIrqCycles = DWT->CYCCNT;
+  RxIrqFresh = 1U;
+#endif
+#if ETHIF_WOL
+  ethernetif_wol_first(&WolFirstRx, &WolStats.first_rx_us);
+#endif
+  ethernetif_rx_signal();
 }
 /**
   * @brief  Ethernet Tx Transfer completed callback
   * @param  handlerEth: ETH handler
   * @retval None
   */
-void HAL_ETH_TxCpltCallback(ETH_HandleTypeDef *handlerEth)
+ITCM_FUNC void HAL_ETH_TxCpltCallback(ETH_HandleTypeDef *handlerEth)
 {
-  osSemaphoreRelease(TxPktSemaphore);
+#if ETHIF_EEE
+  ethernetif_eee_tx_done();
+#endif
+#if ETHIF_WOL
+  ethernetif_wol_first(&WolFirstTx, &WolStats.first_tx_us);
+#endif
+#if ETHIF_TX_QUEUE
+  /* ETH_CODE: free completed frames and refill descriptors from the queue
+   * on the tcpip thread; one pending callback is enough. */
+  if ((TxKickMsg != NULL) && (TxKickPending == 0U))
+  {
+    TxKickPending = 1U;
+    if (tcpip_callbackmsg_trycallback_fromisr(TxKickMsg) != ERR_OK)
+    {
+      TxKickPending = 0U;
+    }
+  }
+#endif
+  ethernetif_tx_signal();
 }
 /**
   * @brief  Ethernet DMA transfer error callback
@@ -217,9 +1031,24 @@ void HAL_ETH_TxCpltCallback(ETH_HandleTypeDef *handlerEth)
   */
 void HAL_ETH_ErrorCallback(ETH_HandleTypeDef *handlerEth)
 {
+  /* ETH_CODE: MACErrorCode is only non-zero while a MAC error is reported */
+  if (handlerEth->MACErrorCode != 0U)
+  {
+    MacErrors++;
+  }
+  else if ((HAL_ETH_GetDMAError(handlerEth) & ~(ETH_DMACSR_RBU | ETH_DMACSR_AIS)) != 0U)
+  {
+    DmaErrors++;
+  }
   if((HAL_ETH_GetDMAError(handlerEth) & ETH_DMACSR_RBU) == ETH_DMACSR_RBU)
   {
-     osSemaphoreRelease(RxPktSemaphore);
+     /* ETH_CODE: trace RX buffer unavailable at the moment it happens */
+     LOG_ISR(LOG_LEVEL_WARNING, "ETH", "DMA error 0x%08lx (RBU)", (unsigned long)HAL_ETH_GetDMAError(handlerEth));
+     /* ETH_CODE: DMAErrorCode is sticky in the HAL; consume RBU so that
+      * each event is counted once. The EthIf task rebuilds the ring. */
+     handlerEth->DMAErrorCode &= ~ETH_DMACSR_RBU;
+     RxStats.rbu++;
+     ethernetif_rx_signal();
   }
 }
 
@@ -231,22 +1060,101 @@ void HAL_ETH_ErrorCallback(ETH_HandleTypeDef *handlerEth)
 //  HAL_GPIO_WritePin(ETH_RST_GPIO_Port, ETH_RST_Pin, GPIO_PIN_SET);
 //  osDelay(55);
 //}
-/* USER CODE END 4 */
 
-/*******************************************************************************
-                       LL Driver Interface ( LwIP stack --> ETH)
-*******************************************************************************/
-/**
- * @brief In this function, the hardware should be initialized.
- * Called from ethernetif_init().
- *
- * @param netif the already initialized lwip network interface structure
- *        for this ethernetif
- */
-static void low_level_init(struct netif *netif)
+/* ETH_CODE: DMA and MTL profiles, see EthIfDmaProfileTypeDef */
+static const EthIfDmaProfileTypeDef DmaProfiles[ETHIF_DMA_PROFILE_CNT] = {
+  [ETHIF_DMA_PROFILE_DEFAULT] = { .tx_pbl = 32U, .rx_pbl = 32U, .fixed_burst = 1U, .aligned_beats = 1U },
+  [ETHIF_DMA_PROFILE_LATENCY] = { .tx_pbl = 32U, .rx_pbl = 32U, .fixed_burst = 1U, .aligned_beats = 1U,
+                                  .osf = 1U, .tx_threshold = 64U, .rx_threshold = 32U },
+  [ETHIF_DMA_PROFILE_THROUGHPUT] = { .tx_pbl = 32U, .rx_pbl = 32U, .fixed_burst = 1U, .aligned_beats = 1U,
+                                     .osf = 1U },
+};
+
+/* FIFO thresholds in bytes and their register values */
+static const uint16_t DmaTxThreshold[] = { 32U, 64U, 96U, 128U, 192U, 256U, 384U, 512U };
+static const uint32_t DmaTxThresholdMode[] = {
+  ETH_TRANSMITTHRESHOLD_32, ETH_TRANSMITTHRESHOLD_64, ETH_TRANSMITTHRESHOLD_96, ETH_TRANSMITTHRESHOLD_128,
+  ETH_TRANSMITTHRESHOLD_192, ETH_TRANSMITTHRESHOLD_256, ETH_TRANSMITTHRESHOLD_384, ETH_TRANSMITTHRESHOLD_512
+};
+static const uint16_t DmaRxThreshold[] = { 32U, 64U, 96U, 128U };
+static const uint32_t DmaRxThresholdMode[] = {
+  ETH_RECEIVETHRESHOLD8_32, ETH_RECEIVETHRESHOLD8_64, ETH_RECEIVETHRESHOLD8_96, ETH_RECEIVETHRESHOLD8_128
+};
+
+/* Index of bytes in a threshold table, n if it is not there */
+static uint32_t ethernetif_dma_threshold(const uint16_t *tab, uint32_t n, uint16_t bytes)
 {
-  HAL_StatusTypeDef hal_eth_init_status = HAL_OK;
-/* USER CODE BEGIN OS_THREAD_ATTR_CMSIS_RTOS_V2 */
+  uint32_t i = 0U;
+
+  while ((i < n) && (tab[i] != bytes))
+  {
+    i++;
+  }
+  return i;
+}
+
+static uint8_t ethernetif_dma_pbl_valid(uint8_t pbl)
+{
+  return ((pbl != 0U) && (pbl <= 32U) && ((pbl & (pbl - 1U)) == 0U)) ? 1U : 0U;
+}
+
+static uint8_t ethernetif_dma_profile_valid(const EthIfDmaProfileTypeDef *prof)
+{
+  uint32_t ntx = sizeof(DmaTxThreshold) / sizeof(DmaTxThreshold[0]);
+  uint32_t nrx = sizeof(DmaRxThreshold) / sizeof(DmaRxThreshold[0]);
+
+  return ((prof != NULL) && ethernetif_dma_pbl_valid(prof->tx_pbl) && ethernetif_dma_pbl_valid(prof->rx_pbl) &&
+          ((prof->tx_threshold == 0U) || (ethernetif_dma_threshold(DmaTxThreshold, ntx, prof->tx_threshold) < ntx)) &&
+          ((prof->rx_threshold == 0U) || (ethernetif_dma_threshold(DmaRxThreshold, nrx, prof->rx_threshold) < nrx)))
+         ? 1U : 0U;
+}
+
+/* Writes a valid profile to the DMA and MTL; the MAC must be stopped */
+static void ethernetif_dma_profile_apply(const EthIfDmaProfileTypeDef *prof)
+{
+  ETH_DMAConfigTypeDef dma;
+  ETH_MACConfigTypeDef mac;
+  uint16_t tx = prof->tx_threshold;
+  uint16_t rx = prof->rx_threshold;
+
+#if ETHIF_JUMBO
+  /* A jumbo frame does not fit in a FIFO */
+  tx = (tx != 0U) ? tx : 64U;
+  rx = (rx != 0U) ? rx : 64U;
+#endif
+  HAL_ETH_GetDMAConfig(&heth, &dma);
+  /* TPBL and RPBL hold the beats as they are */
+  dma.TxDMABurstLength = (uint32_t)prof->tx_pbl << ETH_DMACTCR_TPBL_Pos;
+  dma.RxDMABurstLength = (uint32_t)prof->rx_pbl << ETH_DMACRCR_RPBL_Pos;
+  dma.PBLx8Mode = (prof->pbl_x8 != 0U) ? ENABLE : DISABLE;
+  dma.BurstMode = (prof->fixed_burst != 0U) ? ETH_BURSTLENGTH_FIXED : ETH_BURSTLENGTH_MIXED;
+  dma.AddressAlignedBeats = (prof->aligned_beats != 0U) ? ENABLE : DISABLE;
+  dma.SecondPacketOperate = (prof->osf != 0U) ? ENABLE : DISABLE;
+  HAL_ETH_SetDMAConfig(&heth, &dma);
+
+  HAL_ETH_GetMACConfig(&heth, &mac);
+  mac.TransmitQueueMode = (tx == 0U) ? ETH_TRANSMITSTOREFORWARD :
+    DmaTxThresholdMode[ethernetif_dma_threshold(DmaTxThreshold, sizeof(DmaTxThreshold) / sizeof(DmaTxThreshold[0]), tx)];
+  mac.ReceiveQueueMode = (rx == 0U) ? ETH_RECEIVESTOREFORWARD :
+    DmaRxThresholdMode[ethernetif_dma_threshold(DmaRxThreshold, sizeof(DmaRxThreshold) / sizeof(DmaRxThreshold[0]), rx)];
+  HAL_ETH_SetMACConfig(&heth, &mac);
+}
+/* USER CODE END 4 */
+
+/*******************************************************************************
+                       LL Driver Interface ( LwIP stack --> ETH)
+*******************************************************************************/
+/**
+ * @brief In this function, the hardware should be initialized.
+ * Called from ethernetif_init().
+ *
+ * @param netif the already initialized lwip network interface structure
+ *        for this ethernetif
+ */
+static void low_level_init(struct netif *netif)
+{
+  HAL_StatusTypeDef hal_eth_init_status = HAL_OK;
+/* USER CODE BEGIN OS_THREAD_ATTR_CMSIS_RTOS_V2 */
   osThreadAttr_t attributes;
 /* USER CODE END OS_THREAD_ATTR_CMSIS_RTOS_V2 */
   uint32_t duplex, speed = 0;
@@ -273,16 +1181,35 @@ static void low_level_init(struct netif *netif)
   /* USER CODE END MACADDRESS */
 
   hal_eth_init_status = HAL_ETH_Init(&heth);
+#if ETHIF_RX_REARM_BATCH
+  /* ETH_CODE: re-arm consumed RX descriptors in batches */
+  heth.RxDescList.RxBuildDescMin = ETHIF_RX_REARM_BATCH;
+#endif
 
   memset(&TxConfig, 0 , sizeof(ETH_TxPacketConfig));
   TxConfig.Attributes = ETH_TX_PACKETS_FEATURES_CSUM | ETH_TX_PACKETS_FEATURES_CRCPAD;
   TxConfig.ChecksumCtrl = ETH_CHECKSUM_IPHDR_PAYLOAD_INSERT_PHDR_CALC;
   TxConfig.CRCPadCtrl = ETH_CRC_PAD_INSERT;
 
+#if ETHIF_JUMBO
+  /* ETH_CODE: jumbo frames do not fit in the 2 KB MTL FIFOs, so neither
+   * queue can wait for a whole frame */
+  HAL_ETH_GetMACConfig(&heth, &MACConf);
+  MACConf.JumboPacket = ENABLE;
+  MACConf.TransmitQueueMode = ETH_TRANSMITTHRESHOLD_64;
+  MACConf.ReceiveQueueMode = ETH_RECEIVETHRESHOLD8_64;
+  HAL_ETH_SetMACConfig(&heth, &MACConf);
+#endif
+  /* ETH_CODE: DMA and MTL profile */
+  ethernetif_dma_profile_apply(&DmaProfiles[ETHIF_DMA_PROFILE]);
+
   /* End ETH HAL Init */
 
   /* Initialize the RX POOL */
   LWIP_MEMPOOL_INIT(RX_POOL);
+#if ETHIF_RX_COPY_MAX
+  LWIP_MEMPOOL_INIT(RX_SMALL);
+#endif
 
 #if LWIP_ARP || LWIP_ETHERNET
   /* set MAC hardware address length */
@@ -297,7 +1224,7 @@ static void low_level_init(struct netif *netif)
   netif->hwaddr[5] =  heth.Init.MACAddr[5];
 
   /* maximum transfer unit */
-  netif->mtu = ETH_MAX_PAYLOAD;
+  netif->mtu = ETHIF_MTU; /* ETH_CODE: see ETHIF_JUMBO */
 
   /* Accept broadcast address and ARP traffic */
   /* don't set NETIF_FLAG_ETHARP if this device is not an ethernet one */
@@ -308,23 +1235,52 @@ static void low_level_init(struct netif *netif)
   #endif /* LWIP_ARP */
 
   /* create a binary semaphore used for informing ethernetif of frame reception */
-  RxPktSemaphore = osSemaphoreNew(1, 0, NULL);
+#if !ETHIF_TASK_NOTIFY
+  RxPktSemaphore = osSemaphoreNew(1, 0, &RxPktSemaphoreAttr); /* ETH_CODE: static */
+#endif
 
   /* create a binary semaphore used for informing ethernetif of frame transmission */
-  TxPktSemaphore = osSemaphoreNew(1, 0, NULL);
+#if !ETHIF_TASK_NOTIFY || !ETHIF_TX_QUEUE
+  TxPktSemaphore = osSemaphoreNew(1, 0, &TxPktSemaphoreAttr); /* ETH_CODE: static */
+#endif
 
   /* create the task that handles the ETH_MAC */
 /* USER CODE BEGIN OS_THREAD_NEW_CMSIS_RTOS_V2 */
   memset(&attributes, 0x0, sizeof(osThreadAttr_t));
   attributes.name = "EthIf";
-  attributes.stack_size = INTERFACE_THREAD_STACK_SIZE;
+  /* ETH_CODE: stack and TCB in DTCM, see main.h */
+  attributes.cb_mem = &EthIfTcb;
+  attributes.cb_size = sizeof(EthIfTcb);
+  attributes.stack_mem = EthIfStack;
+  attributes.stack_size = sizeof(EthIfStack);
   attributes.priority = osPriorityRealtime;
+#if ETHIF_TASK_NOTIFY
+  EthIfTask = (TaskHandle_t)osThreadNew(ethernetif_input, netif, &attributes);
+#else
   osThreadNew(ethernetif_input, netif, &attributes);
+#endif
+#if SUPERVISOR
+  (void)supervisor_add(&EthIfSupervisor);
+#endif
 /* USER CODE END OS_THREAD_NEW_CMSIS_RTOS_V2 */
 
 /* USER CODE BEGIN PHY_PRE_CONFIG */
+#if !ETHIF_PHY_ASYNC
 reset_phy();
+#endif
 /* USER CODE END PHY_PRE_CONFIG */
+  /* ETH_CODE: with ETHIF_PHY_ASYNC the link thread resets and initialises
+   * the PHY; the link stays down until it reports one */
+#if ETHIF_PHY_ASYNC
+  if (hal_eth_init_status != HAL_OK)
+  {
+    Error_Handler();
+  }
+  (void)PHYLinkState;
+  (void)duplex;
+  (void)speed;
+  (void)MACConf;
+#else
   /* Set PHY IO functions */
   LAN8742_RegisterBusIO(&LAN8742, &LAN8742_IOCtx);
 
@@ -382,6 +1338,10 @@ reset_phy();
     netif_set_up(netif);
     netif_set_link_up(netif);
 /* USER CODE BEGIN PHY_POST_CONFIG */
+    BOOT_TIME_MARK(BOOT_TIME_LINK_UP);
+#if ETHIF_EEE
+    EeeLinkOk = ((speed == ETH_SPEED_100M) && (duplex == ETH_FULLDUPLEX_MODE)) ? 1U : 0U;
+#endif
 
 /* USER CODE END PHY_POST_CONFIG */
     }
@@ -391,10 +1351,80 @@ reset_phy();
   {
     Error_Handler();
   }
+#endif /* ETHIF_PHY_ASYNC */
 #endif /* LWIP_ARP || LWIP_ETHERNET */
 
 /* USER CODE BEGIN LOW_LEVEL_INIT */
-
+#if ETHIF_TX_QUEUE
+  TxKickMsg = tcpip_callbackmsg_new(ethernetif_tx_kick, NULL);
+  if (TxKickMsg == NULL)
+  {
+    Error_Handler();
+  }
+#endif
+#if ETHIF_TX_SHAPE
+  ethernetif_tx_shape_config(ETHIF_TX_CLASS_TELEMETRY, ETHIF_TX_SHAPE_RATE_TELEMETRY, ETHIF_TX_SHAPE_BURST_TELEMETRY);
+  ethernetif_tx_shape_config(ETHIF_TX_CLASS_LOGGING, ETHIF_TX_SHAPE_RATE_LOGGING, ETHIF_TX_SHAPE_BURST_LOGGING);
+  ethernetif_tx_shape_config(ETHIF_TX_CLASS_BULK, ETHIF_TX_SHAPE_RATE_BULK, ETHIF_TX_SHAPE_BURST_BULK);
+#endif
+#if ETHIF_TX_TT
+  ethernetif_tx_tt_init();
+#endif
+#if LWIP_IGMP || (LWIP_IPV6 && LWIP_IPV6_MLD)
+  ethernetif_mcast_init();
+#endif
+#if LWIP_IGMP
+  netif->flags |= NETIF_FLAG_IGMP;
+  netif_set_igmp_mac_filter(netif, ethernetif_igmp_mac_filter);
+#endif
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+  netif->flags |= NETIF_FLAG_MLD6;
+  netif_set_mld_mac_filter(netif, ethernetif_mld_mac_filter);
+#endif
+#if ETHIF_STATS_LOG_MS
+  sys_timeout(ETHIF_STATS_LOG_MS, ethernetif_stats_timer, NULL);
+#endif
+#if ETHIF_PTP
+  ethernetif_ptp_init();
+#endif
+#if ETHIF_ARP_OFFLOAD
+  ArpOffloadNetif = netif;
+  netif_add_ext_callback(&ArpOffloadCallback, ethernetif_arp_offload_cb);
+#endif
+#if ETHIF_VLAN
+  ethernetif_vlan_init();
+#endif
+#if ETHIF_EEE
+  ethernetif_eee_init();
+#endif
+#if ETHIF_WOL
+  ethernetif_wol_init();
+#endif
+#if ETHIF_RX_BATCH && !ETHIF_RX_INLINE
+  RxDeliverMsg = tcpip_callbackmsg_new(ethernetif_rx_deliver, netif);
+  if (RxDeliverMsg == NULL)
+  {
+    Error_Handler();
+  }
+#endif
+#if ETHIF_RX_PRIO && !ETHIF_RX_INLINE
+  RxPrioMsg = tcpip_callbackmsg_new(ethernetif_rx_deliver_prio, netif);
+  if (RxPrioMsg == NULL)
+  {
+    Error_Handler();
+  }
+#endif
+#if ETHIF_RX_DIRECT
+  RxDirectMsg = tcpip_callbackmsg_new(ethernetif_rx_direct, netif);
+  if (RxDirectMsg == NULL)
+  {
+    Error_Handler();
+  }
+#endif
+#if ETHIF_RX_ADMIT
+  /* ETH_CODE: the first port map, then one every ETHIF_RX_ADMIT_PORTS_MS */
+  ethernetif_rx_admit_ports(NULL);
+#endif
 /* USER CODE END LOW_LEVEL_INIT */
 }
 
@@ -414,19 +1444,223 @@ reset_phy();
  *       dropped because of memory failure (except for the TCP timers).
  */
 
-static err_t low_level_output(struct netif *netif, struct pbuf *p)
+static void ethernetif_tx_bounce_free(struct pbuf *p)
+{
+  ((TxBounceBuff_t *)p)->in_use = 0U;
+}
+
+/* ETH_CODE: copy a whole frame into a free bounce buffer, NULL if none.
+ * The caller has checked that the frame fits. */
+static struct pbuf *ethernetif_tx_bounce(struct pbuf *p)
+{
+  for (uint32_t n = 0; n < ETHIF_TX_BOUNCE_CNT; n++)
+  {
+    TxBounceBuff_t *b = &TxBounce[n];
+    if (b->in_use == 0U)
+    {
+      b->in_use = 1U;
+      b->pbuf_custom.custom_free_function = ethernetif_tx_bounce_free;
+      struct pbuf *c = pbuf_alloced_custom(PBUF_RAW, p->tot_len, PBUF_RAM, &b->pbuf_custom,
+                                           b->buff, sizeof(b->buff));
+      pbuf_copy_partial(p, c->payload, p->tot_len, 0);
+      LWIP_PBUF_CUSTOM_DATA_COPY(c, p);
+#if ETHIF_PTP
+      if (ethernetif_ptp_tx_requested(p))
+      {
+        c->flags |= ETHIF_PBUF_FLAG_TSTAMP;
+      }
+#endif
+      return c;
+    }
+  }
+  return NULL;
+}
+
+/* ETH_CODE: the ETH DMA cannot reach DTCM (DTCM_BSS task stacks, main.h);
+ * frames referencing it are sent from a bounce buffer. */
+static ITCM_FUNC uint8_t ethernetif_tx_in_dtcm(const struct pbuf *p)
+{
+  for (; p != NULL; p = p->next)
+  {
+    if (((uint32_t)p->payload - 0x20000000U) < 0x20000U)
+    {
+      return 1U;
+    }
+  }
+  return 0U;
+}
+
+#if ETHIF_JUMBO
+/* ETH_CODE: checksums of a frame too long for the TX FIFO, which the MAC
+ * cannot insert. lwIP builds the headers in the first pbuf; a frame where
+ * they are not, or that is not IP, goes out as it is. Fragments only get
+ * the IPv4 header checksum: the transport one covers the whole datagram. */
+static void ethernetif_tx_csum_sw(struct pbuf *p)
+{
+  const struct eth_hdr *eth = (const struct eth_hdr *)p->payload;
+  uint8_t *hdr = (uint8_t *)p->payload + SIZEOF_ETH_HDR;
+  uint16_t hlen;
+  uint16_t plen;
+  uint8_t proto;
+  uint16_t field;
+  uint16_t sum = 0U;
+#if LWIP_IPV4
+  ip4_addr_t src4;
+  ip4_addr_t dst4;
+#endif
+#if LWIP_IPV6
+  ip6_addr_t src6;
+  ip6_addr_t dst6;
+#endif
+
+  if (p->len < SIZEOF_ETH_HDR)
+  {
+    return;
+  }
+#if LWIP_IPV4
+  if ((eth->type == PP_HTONS(ETHTYPE_IP)) && (p->len >= SIZEOF_ETH_HDR + IP_HLEN))
+  {
+    struct ip_hdr *iph = (struct ip_hdr *)hdr;
+
+    hlen = IPH_HL_BYTES(iph);
+    if (p->len < SIZEOF_ETH_HDR + hlen)
+    {
+      return;
+    }
+    IPH_CHKSUM_SET(iph, 0);
+    IPH_CHKSUM_SET(iph, inet_chksum(iph, hlen));
+    if ((IPH_OFFSET(iph) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0U)
+    {
+      TxStats.csum_sw++;
+      return;
+    }
+    proto = IPH_PROTO(iph);
+    plen = (uint16_t)(lwip_ntohs(IPH_LEN(iph)) - hlen);
+    ip4_addr_copy(src4, iph->src);
+    ip4_addr_copy(dst4, iph->dest);
+  }
+  else
+#endif
+#if LWIP_IPV6
+  if ((eth->type == PP_HTONS(ETHTYPE_IPV6)) && (p->len >= SIZEOF_ETH_HDR + IP6_HLEN))
+  {
+    struct ip6_hdr *ip6h = (struct ip6_hdr *)hdr;
+
+    hlen = IP6_HLEN;
+    proto = IP6H_NEXTH(ip6h);
+    plen = IP6H_PLEN(ip6h);
+    ip6_addr_copy_from_packed(src6, ip6h->src);
+    ip6_addr_copy_from_packed(dst6, ip6h->dest);
+  }
+  else
+#endif
+  {
+    return;
+  }
+
+  switch (proto)
+  {
+  case IP_PROTO_TCP:
+    field = 16U;
+    break;
+  case IP_PROTO_UDP:
+    field = 6U;
+    break;
+#if LWIP_IPV4
+  case IP_PROTO_ICMP:
+#endif
+#if LWIP_IPV6
+  case IP6_NEXTH_ICMP6:
+#endif
+    field = 2U;
+    break;
+  default:
+    TxStats.csum_sw++;
+    return;
+  }
+  if (p->len < SIZEOF_ETH_HDR + hlen + field + 2U)
+  {
+    return;
+  }
+
+  hdr += hlen + field;
+  hdr[0] = 0U;
+  hdr[1] = 0U;
+  (void)pbuf_remove_header(p, SIZEOF_ETH_HDR + hlen);
+#if LWIP_IPV4
+  if (eth->type == PP_HTONS(ETHTYPE_IP))
+  {
+    sum = (proto == IP_PROTO_ICMP) ? inet_chksum_pbuf(p) : inet_chksum_pseudo(p, proto, plen, &src4, &dst4);
+  }
+  else
+#endif
+  {
+#if LWIP_IPV6
+    sum = ip6_chksum_pseudo(p, proto, plen, &src6, &dst6);
+#endif
+  }
+  (void)pbuf_header_force(p, (s16_t)(SIZEOF_ETH_HDR + hlen));
+  if ((proto == IP_PROTO_UDP) && (sum == 0U))
+  {
+    sum = 0xFFFFU;
+  }
+  memcpy(hdr, &sum, sizeof(sum));
+  TxStats.csum_sw++;
+}
+#endif
+
+/* ETH_CODE: hand one frame to the DMA. Returns ERR_BUF while the
+ * descriptors (or bounce buffers) are busy. The caller owns a reference,
+ * passed to the HAL on success. */
+static ITCM_FUNC err_t ethernetif_tx_frame(struct pbuf *p)
 {
   uint32_t i = 0U;
   struct pbuf *q = NULL;
-  err_t errval = ERR_OK;
-  ETH_BufferTypeDef Txbuffer[ETH_TX_DESC_CNT] = {0};
+  ETH_BufferTypeDef Txbuffer[ETH_TX_BUFFER_MAX] = {0};
+
+  /* The HAL takes two buffers per descriptor; coalesce longer chains. */
+  if ((pbuf_clen(p) > ETH_TX_BUFFER_MAX) || ethernetif_tx_in_dtcm(p))
+  {
+    if (p->tot_len > sizeof(TxBounce[0].buff))
+    {
+      TxStats.errors++;
+      return ERR_IF;
+    }
+    struct pbuf *c = ethernetif_tx_bounce(p);
+    if (c == NULL)
+    {
+      TxStats.busy++;
+      return ERR_BUF;
+    }
+    err_t err = ethernetif_tx_frame(c);
+    if (err == ERR_OK)
+    {
+      TxStats.coalesced++;
+      pbuf_free(p);
+    }
+    else
+    {
+      pbuf_free(c);
+    }
+    return err;
+  }
+
+#if ETHIF_JUMBO
+  if (p->tot_len > ETH_MAX_PACKET_SIZE)
+  {
+    ethernetif_tx_csum_sw(p);
+    TxConfig.Attributes &= ~ETH_TX_PACKETS_FEATURES_CSUM;
+  }
+  else
+  {
+    TxConfig.Attributes |= ETH_TX_PACKETS_FEATURES_CSUM;
+  }
+#endif
 
-  memset(Txbuffer, 0 , ETH_TX_DESC_CNT*sizeof(ETH_BufferTypeDef));
+  memset(Txbuffer, 0 , ETH_TX_BUFFER_MAX*sizeof(ETH_BufferTypeDef));
 
   for(q = p; q != NULL; q = q->next)
   {
-    if(i >= ETH_TX_DESC_CNT)
-      return ERR_IF;
 
     Txbuffer[i].buffer = q->payload;
     Txbuffer[i].len = q->len;
@@ -448,201 +1682,3880 @@ static err_t low_level_output(struct netif *netif, struct pbuf *p)
   TxConfig.TxBuffer = Txbuffer;
   TxConfig.pData = p;
 
-  pbuf_ref(p);
+  ethernetif_cache_tx(p);
 
-  do
+#if ETHIF_PTP
+  uint8_t tstamp = ethernetif_ptp_tx_requested(p);
+  if (tstamp)
   {
-    if(HAL_ETH_Transmit_IT(&heth, &TxConfig) == HAL_OK)
-    {
-      errval = ERR_OK;
-    }
-    else
-    {
+    /* ETH_CODE: TTSE on the first descriptor of this frame */
+    HAL_ETH_PTP_InsertTxTimestamp(&heth);
+  }
+#endif
 
-      if(HAL_ETH_GetError(&heth) & HAL_ETH_ERROR_BUSY)
-      {
-        /* Wait for descriptors to become available */
-        osSemaphoreAcquire(TxPktSemaphore, ETHIF_TX_TIMEOUT);
-        HAL_ETH_ReleaseTxPacket(&heth);
-        errval = ERR_BUF;
-      }
-      else
-      {
-        /* Other error */
-        pbuf_free(p);
-        errval =  ERR_IF;
-      }
-    }
-  }while(errval == ERR_BUF);
+#if ETHIF_EEE
+  /* ETH_CODE: time the wake if this frame has to bring TX out of LPI */
+  uint8_t wake = (EeeWakeStart == 0U) && (READ_BIT(heth.Instance->MACLCSR, ETH_MACLCSR_TLPIST) != 0U);
+  if (wake)
+  {
+    EeeWakeStart = DWT->CYCCNT | 1U;
+  }
+#endif
 
-  return errval;
+#if ETHIF_TX_TT
+  /* Frames of a window wait for the compare interrupt's tail pointer write */
+  uint8_t hold = TxTtOpen;
+#else
+  uint8_t hold = 0U;
+#endif
+#if ETHIF_TX_BATCH
+  HAL_StatusTypeDef status = ((TxBatch | hold) != 0U) ? HAL_ETH_TransmitNoPoll_IT(&heth, &TxConfig)
+                                                      : HAL_ETH_Transmit_IT(&heth, &TxConfig);
+#else
+  HAL_StatusTypeDef status = (hold != 0U) ? HAL_ETH_TransmitNoPoll_IT(&heth, &TxConfig)
+                                          : HAL_ETH_Transmit_IT(&heth, &TxConfig);
+#endif
+  if(status == HAL_OK)
+  {
+#if ETHIF_TX_BATCH
+    TxTailPending += (hold == 0U) ? TxBatch : 0U;
+#endif
+    TxStats.frames++;
+    TxStats.bytes += p->tot_len;
+#if PCAP_RING
+    pcap_ring_tap(p);
+#endif
+    return ERR_OK;
+  }
+#if ETHIF_EEE
+  if (wake)
+  {
+    EeeWakeStart = 0U;
+  }
+#endif
+#if ETHIF_PTP
+  if (tstamp)
+  {
+    /* Not queued: do not leave TTSE for whichever frame comes next */
+    ETH_DMADescTypeDef *desc = (ETH_DMADescTypeDef *)heth.TxDescList.TxDesc[heth.TxDescList.CurTxDesc];
+    CLEAR_BIT(desc->DESC2, ETH_DMATXNDESCRF_TTSE);
+  }
+#endif
+  if(HAL_ETH_GetError(&heth) & HAL_ETH_ERROR_BUSY)
+  {
+    TxStats.busy++;
+    return ERR_BUF;
+  }
+  TxStats.errors++;
+  return ERR_IF;
 }
 
-/**
- * @brief Should allocate a pbuf and transfer the bytes of the incoming
- * packet from the interface into the pbuf.
- *
- * @param netif the lwip network interface structure for this ethernetif
- * @return a pbuf filled with the received packet (including MAC header)
- *         NULL on memory error
-   */
-static struct pbuf * low_level_input(struct netif *netif)
+#if ETHIF_TX_BATCH
+/* ETH_CODE: start the DMA on the frames a batch left in the ring. Called
+ * at the end of the batch and whenever the ring fills up. */
+static ITCM_FUNC void ethernetif_tx_ring(void)
 {
-  struct pbuf *p = NULL;
-
-  if(RxAllocStatus == RX_ALLOC_OK)
+  if (TxTailPending != 0U)
   {
-    HAL_ETH_ReadData(&heth, (void **)&p);
+    HAL_ETH_TransmitPoll(&heth);
+    TxStats.batches++;
+    TxStats.batched += TxTailPending;
+    TxTailPending = 0U;
   }
+}
 
-  return p;
+/* ETH_CODE: netif->tx_flush, end of a tcp_output() batch */
+static ITCM_FUNC void ethernetif_tx_batch_end(struct netif *netif)
+{
+  LWIP_UNUSED_ARG(netif);
+  TxBatch = 0U;
+  ethernetif_tx_ring();
 }
+#endif
 
-/**
- * @brief This function should be called when a packet is ready to be read
- * from the interface. It uses the function low_level_input() that
- * should handle the actual reception of bytes from the network
- * interface. Then the type of the received packet is determined and
- * the appropriate input function is called.
- *
- * @param netif the lwip network interface structure for this ethernetif
- */
-void ethernetif_input(void* argument)
+#if ETHIF_TX_QUEUE
+#if ETHIF_TX_SCHED
+/* ETH_CODE: class of an outgoing frame from its IP precedence. Only the
+ * headers in the first pbuf are looked at; lwIP puts them there. */
+static ITCM_FUNC uint32_t ethernetif_tx_class(const struct pbuf *p)
 {
-  struct pbuf *p = NULL;
-  struct netif *netif = (struct netif *) argument;
+  const struct eth_hdr *eth = (const struct eth_hdr *)p->payload;
+  uint16_t type = eth->type;
+  uint16_t hlen = SIZEOF_ETH_HDR;
+  uint8_t prec;
 
-  for( ;; )
+  if (((p->meta_flags & ETHIF_META_CLASS) != 0U) && (p->meta_class < ETHIF_TX_CLASS_CNT))
+  {
+    return p->meta_class;
+  }
+  if (p->len < SIZEOF_ETH_HDR)
+  {
+    return ETHIF_TX_CLASS_BULK;
+  }
+  if ((type == PP_HTONS(ETHTYPE_VLAN)) && (p->len >= (SIZEOF_ETH_HDR + SIZEOF_VLAN_HDR)))
+  {
+    type = ((const struct eth_vlan_hdr *)((const uint8_t *)p->payload + SIZEOF_ETH_HDR))->tpid;
+    hlen += SIZEOF_VLAN_HDR;
+  }
+
+  if ((type == PP_HTONS(ETHTYPE_IP)) && (p->len >= (hlen + IP_HLEN)))
   {
-    if (osSemaphoreAcquire(RxPktSemaphore, TIME_WAITING_FOR_INPUT) == osOK)
+    const struct ip_hdr *iph = (const struct ip_hdr *)((const uint8_t *)p->payload + hlen);
+    if ((IPH_PROTO(iph) == IP_PROTO_ICMP) || (IPH_PROTO(iph) == IP_PROTO_IGMP))
     {
-      do
-      {
-        p = low_level_input( netif );
-        if (p != NULL)
-        {
-          if (netif->input( p, netif) != ERR_OK )
-          {
-            pbuf_free(p);
-          }
-        }
-      } while(p!=NULL);
+      return ETHIF_TX_CLASS_CONTROL;
     }
+    prec = IPH_TOS(iph) >> 5;
   }
-}
-
-#if !LWIP_ARP
-/**
- * This function has to be completed by user in case of ARP OFF.
- *
+#if LWIP_IPV6
+  else if ((type == PP_HTONS(ETHTYPE_IPV6)) && (p->len >= (hlen + IP6_HLEN)))
+  {
+    const struct ip6_hdr *ip6h = (const struct ip6_hdr *)((const uint8_t *)p->payload + hlen);
+    if (IP6H_NEXTH(ip6h) == IP6_NEXTH_ICMP6)
+    {
+      return ETHIF_TX_CLASS_CONTROL;
+    }
+    prec = (uint8_t)(IP6H_TC(ip6h) >> 5);
+  }
+#endif
+  else if ((type == PP_HTONS(ETHTYPE_IP)) || (type == PP_HTONS(ETHTYPE_IPV6)))
+  {
+    return ETHIF_TX_CLASS_BULK;
+  }
+  else
+  {
+    /* ARP and other link control */
+    return ETHIF_TX_CLASS_CONTROL;
+  }
+
+  if (prec >= 5U)
+  {
+    return ETHIF_TX_CLASS_CONTROL;
+  }
+  if (prec >= 3U)
+  {
+    return ETHIF_TX_CLASS_TELEMETRY;
+  }
+  return (prec == 2U) ? ETHIF_TX_CLASS_LOGGING : ETHIF_TX_CLASS_BULK;
+}
+
+#if ETHIF_TX_SHAPE
+/* ETH_CODE: whether class c has the tokens for len bytes, filling its
+ * bucket first */
+static ITCM_FUNC uint8_t ethernetif_tx_conform(uint32_t c, uint16_t len)
+{
+  TxShapeTypeDef *b = &TxShape[c];
+  uint32_t now;
+
+  if (b->rate == 0U)
+  {
+    return 1U;
+  }
+  now = DWT->CYCCNT;
+  b->tokens += (int64_t)((uint64_t)(now - b->stamp) * b->rate);
+  b->stamp = now;
+  if (b->tokens > b->burst)
+  {
+    b->tokens = b->burst;
+  }
+  return (b->tokens >= ((int64_t)len << ETHIF_TX_SHAPE_Q)) ? 1U : 0U;
+}
+
+/* ETH_CODE: lwIP timeout, the tokens a waiting class needed are there */
+static void ethernetif_tx_shape_timer(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+  TxShapeTimer = 0U;
+  ethernetif_tx_kick(NULL);
+}
+
+/* ETH_CODE: nothing conforms: come back when the first head frame does.
+ * No interrupt would, with the ring idle. */
+static void ethernetif_tx_shape_wait(void)
+{
+  uint64_t wait = UINT64_MAX;
+  uint32_t ms;
+
+  if (TxShapeTimer != 0U)
+  {
+    return;
+  }
+  for (uint32_t c = ETHIF_TX_CLASS_TELEMETRY; c < ETHIF_TX_CLASS_CNT; c++)
+  {
+    TxQueueTypeDef *q = &TxQueue[c];
+    TxShapeTypeDef *b = &TxShape[c];
+    if ((q->tail != q->head) && (b->rate != 0U))
+    {
+      int64_t need = ((int64_t)q->frame[q->tail % ETHIF_TX_QUEUE_LEN]->tot_len << ETHIF_TX_SHAPE_Q) - b->tokens;
+      uint64_t cycles = (need > 0) ? ((uint64_t)need / b->rate) : 0U;
+      if (cycles < wait)
+      {
+        wait = cycles;
+      }
+    }
+  }
+  if (wait == UINT64_MAX)
+  {
+    return;
+  }
+  ms = (uint32_t)(wait / (SystemCoreClock / 1000U)) + 1U;
+  TxShapeTimer = 1U;
+  sys_timeout(ms, ethernetif_tx_shape_timer, NULL);
+}
+
+/* ETH_CODE: rate of b from its kbit/s at the current core clock */
+static void ethernetif_tx_shape_rate(TxShapeTypeDef *b)
+{
+  /* 125 bytes per kbit */
+  b->rate = (uint32_t)((((uint64_t)b->kbps * 125U) << ETHIF_TX_SHAPE_Q) / SystemCoreClock);
+  if ((b->kbps != 0U) && (b->rate == 0U))
+  {
+    b->rate = 1U;
+  }
+}
+
+/* ETH_CODE: bucket of class c, rate_kbps 0 unshaped; starts full */
+static void ethernetif_tx_shape_config(uint32_t c, uint32_t rate_kbps, uint32_t burst)
+{
+  TxShapeTypeDef *b = &TxShape[c];
+
+  b->kbps = rate_kbps;
+  ethernetif_tx_shape_rate(b);
+  b->burst = (int64_t)burst << ETHIF_TX_SHAPE_Q;
+  b->tokens = b->burst;
+  b->stamp = DWT->CYCCNT;
+}
+#endif
+
+/* ETH_CODE: whether a frame of class c, len bytes, may go to the DMA now:
+ * control frames always, the others while fewer than
+ * ETHIF_TX_SCHED_RING_LIMIT of them are in the DMA ring and their bucket
+ * has the tokens */
+static ITCM_FUNC uint8_t ethernetif_tx_admit(uint32_t c, uint16_t len)
+{
+  if (c == ETHIF_TX_CLASS_CONTROL)
+  {
+    return 1U;
+  }
+  if (TxRingLow >= ETHIF_TX_SCHED_RING_LIMIT)
+  {
+    return 0U;
+  }
+#if ETHIF_TX_SHAPE
+  return ethernetif_tx_conform(c, len);
+#else
+  LWIP_UNUSED_ARG(len);
+  return 1U;
+#endif
+}
+
+/* ETH_CODE: the class to send from next, ETHIF_TX_QUEUES if none may.
+ * Deficit round robin among the non-control classes that may send: such
+ * a class gets its quantum once per turn and keeps the turn while its
+ * head frame fits. A class waiting for tokens sits its turns out. */
+static ITCM_FUNC uint32_t ethernetif_tx_next(void)
+{
+  uint32_t ready = 0U;
+
+  if (TxQueue[ETHIF_TX_CLASS_CONTROL].tail != TxQueue[ETHIF_TX_CLASS_CONTROL].head)
+  {
+    return ETHIF_TX_CLASS_CONTROL;
+  }
+  if ((TxQueued == 0U) || (TxRingLow >= ETHIF_TX_SCHED_RING_LIMIT))
+  {
+    return ETHIF_TX_QUEUES;
+  }
+  for (uint32_t c = ETHIF_TX_CLASS_TELEMETRY; c < ETHIF_TX_CLASS_CNT; c++)
+  {
+    TxQueueTypeDef *q = &TxQueue[c];
+    if ((q->tail != q->head) && ethernetif_tx_admit(c, q->frame[q->tail % ETHIF_TX_QUEUE_LEN]->tot_len))
+    {
+      ready |= 1UL << c;
+    }
+  }
+  if (ready == 0U)
+  {
+#if ETHIF_TX_SHAPE
+    ethernetif_tx_shape_wait();
+#endif
+    return ETHIF_TX_QUEUES;
+  }
+  for (;;)
+  {
+    TxQueueTypeDef *q = &TxQueue[TxDrrClass];
+    if ((ready & (1UL << TxDrrClass)) != 0U)
+    {
+      if (TxDrrGranted == 0U)
+      {
+        q->deficit += TxDrrQuantum[TxDrrClass];
+        TxDrrGranted = 1U;
+      }
+      if (q->deficit >= (int32_t)q->frame[q->tail % ETHIF_TX_QUEUE_LEN]->tot_len)
+      {
+        return TxDrrClass;
+      }
+    }
+    else if (q->tail == q->head)
+    {
+      q->deficit = 0;
+    }
+    TxDrrClass = (TxDrrClass % (ETHIF_TX_CLASS_CNT - 1U)) + 1U;
+    TxDrrGranted = 0U;
+  }
+}
+#else
+static ITCM_FUNC uint32_t ethernetif_tx_next(void)
+{
+  return (TxQueued != 0U) ? 0U : ETHIF_TX_QUEUES;
+}
+#endif
+
+/* ETH_CODE: nothing but the frames of a time-triggered window may enter
+ * the ring while one is open or armed */
+static ITCM_FUNC uint8_t ethernetif_tx_held(void)
+{
+#if ETHIF_LINK_FLAP_MS
+  if (LinkFlapHold != 0U)
+  {
+    return 1U;
+  }
+#endif
+#if ETHIF_TX_TT
+  return (uint8_t)(TxTtOpen | TxTtArmed);
+#else
+  return 0U;
+#endif
+}
+
+/* ETH_CODE: ethernetif_tx_frame() for a frame of class c, which the ring
+ * order records */
+static ITCM_FUNC err_t ethernetif_tx_submit(struct pbuf *p, uint32_t c)
+{
+#if ETHIF_TX_SCHED
+  uint16_t len = p->tot_len;
+  err_t err = ethernetif_tx_frame(p);
+
+  if (err == ERR_OK)
+  {
+    TxRingClass[TxRingHead % ETH_TX_DESC_CNT] = (uint8_t)c;
+    TxRingHead++;
+    if (c != ETHIF_TX_CLASS_CONTROL)
+    {
+      TxRingLow++;
+    }
+    TxClassStats[c].frames++;
+    TxClassStats[c].bytes += len;
+#if ETHIF_TX_SHAPE
+    TxShape[c].tokens -= (int64_t)len << ETHIF_TX_SHAPE_Q;
+#endif
+  }
+  return err;
+#else
+  LWIP_UNUSED_ARG(c);
+  return ethernetif_tx_frame(p);
+#endif
+}
+
+/* ETH_CODE: take the head frame of queue c, len bytes, off the queue */
+static ITCM_FUNC void ethernetif_tx_dequeue(uint32_t c, uint16_t len)
+{
+  TxQueueTypeDef *q = &TxQueue[c];
+
+#if ETHIF_TX_SCHED
+  uint32_t delay = DWT->CYCCNT - q->stamp[q->tail % ETHIF_TX_QUEUE_LEN];
+  if (delay > TxClassDelayMax[c])
+  {
+    TxClassDelayMax[c] = delay;
+  }
+#endif
+  q->tail++;
+  TxQueued--;
+#if ETHIF_TX_SCHED
+  if (c != ETHIF_TX_CLASS_CONTROL)
+  {
+    q->deficit -= (int32_t)len;
+    if (q->tail == q->head)
+    {
+      /* An emptied class keeps no credit */
+      q->deficit = 0;
+      TxDrrClass = (c % (ETHIF_TX_CLASS_CNT - 1U)) + 1U;
+      TxDrrGranted = 0U;
+    }
+  }
+#else
+  LWIP_UNUSED_ARG(len);
+#endif
+}
+
+/* ETH_CODE: move queued frames to free descriptors, in scheduler order */
+static ITCM_FUNC void ethernetif_tx_dispatch(void)
+{
+  uint32_t c;
+
+  while (!ethernetif_tx_held() && ((c = ethernetif_tx_next()) < ETHIF_TX_QUEUES))
+  {
+    TxQueueTypeDef *q = &TxQueue[c];
+    struct pbuf *p = q->frame[q->tail % ETHIF_TX_QUEUE_LEN];
+    uint16_t len = p->tot_len;
+    err_t err = ethernetif_tx_submit(p, c);
+    if (err == ERR_BUF)
+    {
+      break;
+    }
+    if (err != ERR_OK)
+    {
+      pbuf_free(p);
+    }
+    ethernetif_tx_dequeue(c, len);
+  }
+}
+
+/* ETH_CODE: free completed frames and refill the descriptors. Runs with
+ * the core lock held, either from low_level_output() or as a tcpip
+ * callback scheduled by the TX complete interrupt. */
+static void ethernetif_tx_kick(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+  TxKickPending = 0U;
+
+  HAL_ETH_ReleaseTxPacket(&heth);
+#if ETHIF_TX_SCHED
+  if (heth.TxDescList.BuffersInUse == 0U)
+  {
+    /* Nothing in flight: whatever the ring order says, e.g. after a stop */
+    TxRingTail = TxRingHead;
+    TxRingLow = 0U;
+  }
+#endif
+#if ETHIF_TX_BATCH
+  /* The refill is a batch of its own, unless it is part of one */
+  uint8_t batch = TxBatch;
+  TxBatch = 1U;
+#endif
+  ethernetif_tx_dispatch();
+#if ETHIF_PKTGEN
+  /* Descriptors the stack left free */
+  ethernetif_pktgen_fill();
+#endif
+#if ETHIF_TX_BATCH
+  TxBatch = batch;
+  if (batch == 0U)
+  {
+    ethernetif_tx_ring();
+  }
+#endif
+}
+
+/* ETH_CODE: drop queued frames, e.g. when the link goes down. */
+static void ethernetif_tx_flush(void)
+{
+  for (uint32_t c = 0U; c < ETHIF_TX_QUEUES; c++)
+  {
+    TxQueueTypeDef *q = &TxQueue[c];
+    while (q->tail != q->head)
+    {
+      pbuf_free(q->frame[q->tail % ETHIF_TX_QUEUE_LEN]);
+      q->tail++;
+    }
+#if ETHIF_TX_SCHED
+    q->deficit = 0;
+#endif
+  }
+  TxQueued = 0U;
+#if ETHIF_TX_SHAPE
+  if (TxShapeTimer != 0U)
+  {
+    sys_untimeout(ethernetif_tx_shape_timer, NULL);
+    TxShapeTimer = 0U;
+  }
+#endif
+#if ETHIF_TX_TT
+  ETHIF_TX_TT_TIM->DIER &= ~(uint32_t)TIM_DIER_CC1IE;
+  TxTtArmed = 0U;
+#endif
+}
+
+static ITCM_FUNC err_t low_level_output(struct netif *netif, struct pbuf *p)
+{
+  err_t errval;
+#if ETHIF_TX_SCHED
+  uint32_t c = ethernetif_tx_class(p);
+#else
+  uint32_t c = 0U;
+#endif
+  TxQueueTypeDef *q = &TxQueue[c];
+
+  PERF_START;
+  pbuf_ref(p);
+#if ETHIF_TX_BATCH
+  TxBatch = (netif->tx_batch != 0U);
+#endif
+
+  /* Keep frame order: go straight to the DMA only when nothing is queued. */
+  ethernetif_tx_kick(NULL);
+#if ETHIF_TX_TT
+  if (TxTtOpen != 0U)
+  {
+    /* Part of the window, ahead of whatever is queued */
+    errval = ethernetif_tx_submit(p, c);
+    if (errval == ERR_OK)
+    {
+      TxTtFrames++;
+      PERF_STOP("low_level_output");
+      return ERR_OK;
+    }
+    pbuf_free(p);
+    TxTtStats.drops++;
+    return (errval == ERR_BUF) ? ERR_MEM : ERR_IF;
+  }
+#endif
+#if ETHIF_TX_SCHED
+  uint8_t admit = ethernetif_tx_admit(c, p->tot_len);
+#if ETHIF_TX_SHAPE
+  if (!admit && (TxRingLow < ETHIF_TX_SCHED_RING_LIMIT))
+  {
+    TxClassStats[c].shaped++;
+  }
+#endif
+  if ((TxQueued == 0U) && !ethernetif_tx_held() && admit)
+#else
+  if ((TxQueued == 0U) && !ethernetif_tx_held())
+#endif
+  {
+    errval = ethernetif_tx_submit(p, c);
+    if (errval == ERR_OK)
+    {
+      PERF_STOP("low_level_output");
+      return ERR_OK;
+    }
+    if (errval != ERR_BUF)
+    {
+      pbuf_free(p);
+      return ERR_IF;
+    }
+  }
+#if ETHIF_TX_BATCH
+  /* Ring full: send what the batch has so far, its completion refills */
+  ethernetif_tx_ring();
+#endif
+
+  if ((q->head - q->tail) >= ETHIF_TX_QUEUE_LEN)
+  {
+    /* Backpressure: TCP retransmits, UDP senders see ERR_MEM. */
+    pbuf_free(p);
+    TxStats.queue_drops++;
+#if ETHIF_TX_SCHED
+    TxClassStats[c].queue_drops++;
+#endif
+#if ETHIF_TX_SHAPE
+    if (TxShape[c].rate != 0U)
+    {
+      /* Over its rate: the sender is to come back, not to count a loss */
+      return ERR_WOULDBLOCK;
+    }
+#endif
+    return ERR_MEM;
+  }
+  q->frame[q->head % ETHIF_TX_QUEUE_LEN] = p;
+#if ETHIF_TX_SCHED
+  q->stamp[q->head % ETHIF_TX_QUEUE_LEN] = DWT->CYCCNT;
+  TxClassStats[c].queued++;
+#endif
+  q->head++;
+  TxQueued++;
+  TxStats.queued++;
+#if ETHIF_TX_TT
+  if (TxTtArmed != 0U)
+  {
+    TxTtStats.held++;
+  }
+#endif
+#if ETHIF_TX_SCHED
+  if (c == ETHIF_TX_CLASS_CONTROL)
+  {
+    /* Ahead of the lower classes holding the queue, if a descriptor is free */
+    ethernetif_tx_dispatch();
+  }
+#endif
+  PERF_STOP("low_level_output");
+  return ERR_OK;
+}
+#if ETHIF_TX_TT
+/* ETH_CODE: ticks per ns of ETHIF_TX_TT_TIM, at the timer kernel clock */
+static void ethernetif_tx_tt_scale(void)
+{
+  RCC_ClkInitTypeDef clkconfig;
+  uint32_t latency;
+  uint32_t hz;
+
+  HAL_RCC_GetClockConfig(&clkconfig, &latency);
+  hz = HAL_RCC_GetPCLK1Freq();
+  if (clkconfig.APB1CLKDivider != RCC_HCLK_DIV1)
+  {
+    hz *= 2U;
+  }
+  TxTtMul = (uint32_t)(((uint64_t)hz << 32) / 1000000000U);
+}
+
+/* ETH_CODE: free-running ETHIF_TX_TT_TIM at the timer kernel clock, the
+ * compare channel 1 starts the windows */
+static void ethernetif_tx_tt_init(void)
+{
+  ETHIF_TX_TT_CLK_ENABLE();
+  ethernetif_tx_tt_scale();
+
+  ETHIF_TX_TT_TIM->CR1 = 0U;
+  ETHIF_TX_TT_TIM->PSC = 0U;
+  ETHIF_TX_TT_TIM->ARR = 0xFFFFFFFFU;
+  ETHIF_TX_TT_TIM->CCMR1 = 0U;    /* frozen: compare flag only, no output */
+  ETHIF_TX_TT_TIM->DIER = 0U;
+  ETHIF_TX_TT_TIM->EGR = TIM_EGR_UG;
+  ETHIF_TX_TT_TIM->SR = 0U;
+  ETHIF_TX_TT_TIM->CR1 = TIM_CR1_CEN;
+
+  HAL_NVIC_SetPriority(ETHIF_TX_TT_IRQn, ETHIF_TX_TT_IRQ_PRIO, 0);
+  HAL_NVIC_EnableIRQ(ETHIF_TX_TT_IRQn);
+}
+
+/* ETH_CODE: distance of the tail pointer write at now from the window */
+static ITCM_FUNC void ethernetif_tx_tt_account(uint64_t now)
+{
+  uint64_t d = (now >= TxTtAt) ? (now - TxTtAt) : (TxTtAt - now);
+  uint32_t err = (d > 0xFFFFFFFFU) ? 0xFFFFFFFFU : (uint32_t)d;
+
+  TxTtStats.err_last_ns = err;
+  if (err > TxTtStats.err_max_ns)
+  {
+    TxTtStats.err_max_ns = err;
+  }
+}
+
+ITCM_FUNC void ETHIF_TX_TT_IRQHandler(void)
+{
+  ETHIF_TX_TT_TIM->DIER &= ~(uint32_t)TIM_DIER_CC1IE;
+  ETHIF_TX_TT_TIM->SR = ~(uint32_t)TIM_SR_CC1IF;
+  if (TxTtArmed != 0U)
+  {
+    /* CurTxDesc stays put while armed: nothing else enters the ring */
+    HAL_ETH_TransmitPoll(&heth);
+    ethernetif_tx_tt_account(time_now_ns());
+    TxTtArmed = 0U;
+  }
+}
+#endif /* ETHIF_TX_TT */
+
+#else
+static ITCM_FUNC err_t low_level_output(struct netif *netif, struct pbuf *p)
+{
+  err_t errval = ERR_OK;
+
+  PERF_START;
+  pbuf_ref(p);
+#if ETHIF_TX_BATCH
+  TxBatch = (netif->tx_batch != 0U);
+#endif
+
+  do
+  {
+    errval = ethernetif_tx_frame(p);
+    if (errval == ERR_BUF)
+    {
+#if ETHIF_TX_BATCH
+      /* ETH_CODE: nothing completes in a ring the DMA was not told about */
+      ethernetif_tx_ring();
+#endif
+      /* Wait for descriptors to become available */
+      osSemaphoreAcquire(TxPktSemaphore, ETHIF_TX_TIMEOUT);
+      HAL_ETH_ReleaseTxPacket(&heth);
+    }
+    else if (errval != ERR_OK)
+    {
+      /* Other error */
+      pbuf_free(p);
+    }
+  }while(errval == ERR_BUF);
+
+  /* Includes the waits for free descriptors */
+  PERF_STOP("low_level_output");
+  return errval;
+}
+#endif /* ETHIF_TX_QUEUE */
+
+/**
+ * @brief Should allocate a pbuf and transfer the bytes of the incoming
+ * packet from the interface into the pbuf.
+ *
  * @param netif the lwip network interface structure for this ethernetif
- * @return ERR_OK if ...
- */
-static err_t low_level_output_arp_off(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
+ * @return a pbuf filled with the received packet (including MAC header)
+ *         NULL on memory error
+   */
+#if ETHIF_RX_COPY_MAX
+/* ETH_CODE: move a small frame into RX_SMALL and free its RX_POOL buffer,
+ * which the next HAL_ETH_ReadData() puts back into the ring. Returns the
+ * frame to pass up, p itself if it stays. */
+static ITCM_FUNC struct pbuf *ethernetif_rx_copy(struct pbuf *p)
+{
+  RxSmall_t *s;
+  struct pbuf *q;
+
+#if ETHIF_PTP
+  if (((const RxBuff_t *)p)->ts_valid != 0U)
+  {
+    return p;
+  }
+#endif
+  s = (RxSmall_t *)LWIP_MEMPOOL_ALLOC(RX_SMALL);
+  if (s == NULL)
+  {
+    RxStats.copy_fail++;
+    return p;
+  }
+  s->pbuf_custom.custom_free_function = pbuf_free_small;
+  q = pbuf_alloced_custom(PBUF_RAW, p->tot_len, PBUF_REF, &s->pbuf_custom, s->buff, sizeof(s->buff));
+  (void)pbuf_copy_partial(p, s->buff, p->tot_len, 0U);
+  pbuf_free(p);
+  RxStats.copied++;
+  return q;
+}
+#endif
+
+static ITCM_FUNC struct pbuf * low_level_input(struct netif *netif)
+{
+  struct pbuf *p = NULL;
+
+  /* ETH_CODE: read even after an allocation failure. HAL_ETH_ReadData() is
+   * also what rebuilds descriptors left without a buffer, and writing the
+   * tail pointer there resumes a DMA suspended on RBU. Frames already in
+   * the ring are delivered meanwhile instead of waiting for the pool. */
+  RxAllocStatus = RX_ALLOC_OK;
+#if ETHIF_RX_CSUM_DROP || ETHIF_ARP_OFFLOAD
+  while (HAL_ETH_ReadData(&heth, (void **)&p) == HAL_OK)
+  {
+    if (RxFrameDrop == RX_FRAME_KEEP)
+    {
+      break;
+    }
+    if (RxFrameDrop == RX_FRAME_ARP)
+    {
+      RxStats.arp_offloaded++;
+    }
+    else
+    {
+      RxStats.csum_drops++;
+    }
+    pbuf_free(p);
+    p = NULL;
+  }
+#else
+  HAL_ETH_ReadData(&heth, (void **)&p);
+#endif
+#if ETHIF_RX_REARM_BATCH
+  if (p == NULL)
+  {
+    /* ETH_CODE: ring drained, re-arm what the reads left behind */
+    HAL_ETH_RxRebuild(&heth);
+  }
+#endif
+#if ETHIF_RX_COPY_MAX
+  if ((p != NULL) && (p->tot_len <= ETHIF_RX_COPY_MAX))
+  {
+    p = ethernetif_rx_copy(p);
+  }
+#endif
+  if (p != NULL)
+  {
+    RxStats.frames++;
+    RxStats.bytes += p->tot_len;
+#if PCAP_RING
+    pcap_ring_tap(p);
+#endif
+  }
+
+  return p;
+}
+
+#if ETHIF_RX_BATCH
+static ITCM_FUNC uint8_t ethernetif_rx_queued(void)
+{
+#if ETHIF_RX_PRIO
+  if (RxPrioTail != RxPrioHead)
+  {
+    return 1U;
+  }
+#endif
+  return (RxQueueTail != RxQueueHead) ? 1U : 0U;
+}
+
+/* ETH_CODE: next frame to deliver, priority frames first; NULL if none */
+static ITCM_FUNC struct pbuf *ethernetif_rx_dequeue(void)
+{
+  struct pbuf *p = NULL;
+
+#if ETHIF_RX_PRIO
+  if (RxPrioTail != __atomic_load_n(&RxPrioHead, __ATOMIC_ACQUIRE))
+  {
+    p = RxPrioQueue[RxPrioTail % ETHIF_RX_PRIO_QUEUE_LEN];
+    __atomic_store_n(&RxPrioTail, RxPrioTail + 1U, __ATOMIC_RELEASE);
+    return p;
+  }
+#endif
+  if (RxQueueTail != __atomic_load_n(&RxQueueHead, __ATOMIC_ACQUIRE))
+  {
+    p = RxQueue[RxQueueTail % ETHIF_RX_QUEUE_LEN];
+    __atomic_store_n(&RxQueueTail, RxQueueTail + 1U, __ATOMIC_RELEASE);
+  }
+  return p;
+}
+
+static ITCM_FUNC void ethernetif_rx_drain(struct netif *netif)
+{
+  struct pbuf *p;
+
+#if TCP_ACK_BATCH
+  /* ETH_CODE: one ACK per connection for what this drain delivers */
+  tcp_ack_batch_begin();
+#endif
+  while ((p = ethernetif_rx_dequeue()) != NULL)
+  {
+    if (ETHIF_ETHERNET_INPUT(p, netif) != ERR_OK)
+    {
+      pbuf_free(p);
+    }
+  }
+#if TCP_ACK_BATCH
+  tcp_ack_batch_end();
+#endif
+}
+
+#if ETHIF_RX_INLINE
+/* ETH_CODE: deliver the queued frames on the EthIf task, one core lock per
+ * batch; ethernet_input() and everything it calls see the lock held as on
+ * the tcpip thread. Priority frames still go first. */
+static uint8_t ethernetif_rx_kick(struct netif *netif)
+{
+  if (ethernetif_rx_queued())
+  {
+    LOCK_TCPIP_CORE();
+    ethernetif_rx_drain(netif);
+    UNLOCK_TCPIP_CORE();
+    RxStats.batches++;
+  }
+  return 1U;
+}
+#else
+/* ETH_CODE: runs on the tcpip thread (core locked) and drains every frame
+ * queued so far. Pending is cleared first, so a frame queued after this
+ * point either is seen by the loop or posts the message again. Priority
+ * frames queued meanwhile overtake the bulk frames still waiting. */
+static ITCM_FUNC void ethernetif_rx_deliver(void *arg)
+{
+  RxDeliverPending = 0U;
+  ethernetif_rx_drain((struct netif *)arg);
+}
+
+#if ETHIF_RX_PRIO
+/* ETH_CODE: same for RxPrioMsg, which may overtake a pending RxDeliverMsg;
+ * that one then finds the queues drained. */
+static ITCM_FUNC void ethernetif_rx_deliver_prio(void *arg)
+{
+  RxPrioPending = 0U;
+  ethernetif_rx_drain((struct netif *)arg);
+}
+#endif
+
+/* ETH_CODE: post the batch unless a delivery is already pending, priority
+ * frames ahead of the messages waiting in TCPIP_MBOX. Returns 0 if frames
+ * are left queued without a message (TCPIP_MBOX full). */
+static uint8_t ethernetif_rx_kick(struct netif *netif)
+{
+  LWIP_UNUSED_ARG(netif);
+#if ETHIF_RX_PRIO
+  if ((RxPrioPending == 0U) && (RxPrioTail != RxPrioHead))
+  {
+    RxPrioPending = 1U;
+    if (tcpip_callbackmsg_trycallback_urgent(RxPrioMsg) != ERR_OK)
+    {
+      RxPrioPending = 0U;
+      RxStats.mbox_full++;
+      return 0U;
+    }
+    RxStats.batches++;
+  }
+  if (RxPrioPending != 0U)
+  {
+    /* drains RxQueue as well */
+    return 1U;
+  }
+#endif
+  if ((RxDeliverPending == 0U) && ethernetif_rx_queued())
+  {
+    RxDeliverPending = 1U;
+    if (tcpip_callbackmsg_trycallback(RxDeliverMsg) != ERR_OK)
+    {
+      RxDeliverPending = 0U;
+      RxStats.mbox_full++;
+      return 0U;
+    }
+    RxStats.batches++;
+  }
+  return 1U;
+}
+#endif /* ETHIF_RX_INLINE */
+#endif
+
+#if ETHIF_RX_PRIO && ETHIF_RX_CTRL_PRIO
+/* ETH_CODE: control traffic for the priority queue: ARP, ICMP, IGMP,
+ * ICMPv6 (neighbour discovery, MLD) and TCP segments with SYN, FIN or RST.
+ * Only the headers in the first pbuf are looked at. */
+static ITCM_FUNC uint8_t ethernetif_rx_is_ctrl(const struct pbuf *p)
+{
+  const struct eth_hdr *eth = (const struct eth_hdr *)p->payload;
+  const uint8_t *l3 = (const uint8_t *)p->payload + SIZEOF_ETH_HDR;
+  uint16_t len = p->len;
+
+  if (len < SIZEOF_ETH_HDR)
+  {
+    return 0U;
+  }
+  len -= SIZEOF_ETH_HDR;
+
+  if (eth->type == PP_HTONS(ETHTYPE_ARP))
+  {
+    return 1U;
+  }
+  if ((eth->type == PP_HTONS(ETHTYPE_IP)) && (len >= IP_HLEN))
+  {
+    const struct ip_hdr *iph = (const struct ip_hdr *)l3;
+    uint16_t hlen = IPH_HL_BYTES(iph);
+
+    switch (IPH_PROTO(iph))
+    {
+      case IP_PROTO_ICMP:
+      case IP_PROTO_IGMP:
+        return 1U;
+      case IP_PROTO_TCP:
+        /* first fragment only, it carries the TCP header */
+        if (((IPH_OFFSET(iph) & PP_HTONS(IP_OFFMASK)) == 0U) && (len >= (hlen + TCP_HLEN)))
+        {
+          const struct tcp_hdr *tcph = (const struct tcp_hdr *)(l3 + hlen);
+          return ((TCPH_FLAGS(tcph) & (TCP_SYN | TCP_FIN | TCP_RST)) != 0U) ? 1U : 0U;
+        }
+        return 0U;
+      default:
+        return 0U;
+    }
+  }
+#if LWIP_IPV6
+  if ((eth->type == PP_HTONS(ETHTYPE_IPV6)) && (len >= IP6_HLEN))
+  {
+    return (IP6H_NEXTH((const struct ip6_hdr *)l3) == IP6_NEXTH_ICMP6) ? 1U : 0U;
+  }
+#endif
+  return 0U;
+}
+#endif
+
+#if ETHIF_UDP_FAST
+/* ETH_CODE: early demux on the EthIf task. Returns 1 if p went to a fast
+ * path port (or was dropped there), 0 to pass it to lwIP. The checks are
+ * the ones ip4_input() and udp_input() would make for such a datagram;
+ * checksums are verified by the MAC (ETHIF_RX_CSUM_DROP). */
+static ITCM_FUNC uint8_t ethernetif_udp_fast(struct netif *netif, struct pbuf *p)
+{
+  const struct eth_hdr *eth = (const struct eth_hdr *)p->payload;
+  const struct ip_hdr *iph = (const struct ip_hdr *)((const uint8_t *)p->payload + SIZEOF_ETH_HDR);
+  const struct udp_hdr *udph;
+  const UdpFastPort_t *fp = NULL;
+  ip4_addr_t dest;
+  ip4_addr_t src;
+  uint16_t hlen;
+  uint16_t port;
+  uint16_t ulen;
+
+  if ((UdpFastCnt == 0U) || (p->len < (SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN)) ||
+      (eth->type != PP_HTONS(ETHTYPE_IP)) || (IPH_V(iph) != 4U) || (IPH_PROTO(iph) != IP_PROTO_UDP) ||
+      ((IPH_OFFSET(iph) & PP_HTONS(IP_OFFMASK | IP_MF)) != 0U))
+  {
+    return 0U;
+  }
+  hlen = IPH_HL_BYTES(iph);
+  if ((hlen < IP_HLEN) || (p->len < (SIZEOF_ETH_HDR + hlen + UDP_HLEN)))
+  {
+    return 0U;
+  }
+  udph = (const struct udp_hdr *)((const uint8_t *)iph + hlen);
+  port = lwip_ntohs(udph->dest);
+  for (uint32_t i = 0U; i < ETHIF_UDP_FAST_PORTS; i++)
+  {
+    if (UdpFastPorts[i].port == port)
+    {
+      fp = &UdpFastPorts[i];
+      break;
+    }
+  }
+  if (fp == NULL)
+  {
+    return 0U;
+  }
+
+  ip4_addr_copy(dest, iph->dest);
+  if (!ip4_addr_cmp(&dest, netif_ip4_addr(netif)) && !ip4_addr_ismulticast(&dest) &&
+      !ip4_addr_isbroadcast(&dest, netif))
+  {
+    return 0U;
+  }
+  ulen = lwip_ntohs(udph->len);
+  if ((ulen < UDP_HLEN) || ((hlen + ulen) > lwip_ntohs(IPH_LEN(iph))) ||
+      ((SIZEOF_ETH_HDR + hlen + ulen) > p->tot_len))
+  {
+    return 0U;
+  }
+
+  EthIfUdpFastFn fn = fp->fn;
+  osMessageQueueId_t queue = fp->queue;
+  void *arg = fp->arg;
+  uint16_t src_port = lwip_ntohs(udph->src);
+  ip4_addr_copy(src, iph->src);
+
+  /* Payload only; the minimum frame pads short datagrams */
+  pbuf_remove_header(p, SIZEOF_ETH_HDR + hlen + UDP_HLEN);
+  pbuf_realloc(p, ulen - UDP_HLEN);
+  RxStats.udp_fast++;
+  if (fn != NULL)
+  {
+    fn(p, &src, src_port, arg);
+  }
+  else
+  {
+    EthIfUdpFastMsgTypeDef msg = { p, src, src_port };
+    if (osMessageQueuePut(queue, &msg, 0U, 0U) != osOK)
+    {
+      RxStats.udp_fast_drops++;
+      pbuf_free(p);
+    }
+  }
+  return 1U;
+}
+#endif
+
+#if ETHIF_RX_STEER
+/* ETH_CODE: returns 1 if p went to a steering rule (or was dropped there),
+ * 0 to pass it on. A rule for the frame's own protocol goes before one for
+ * any. The EtherType is the outer one: a VLAN tag is stripped by the MAC
+ * (ETHIF_VLAN), or the frame is 0x8100. */
+static ITCM_FUNC uint8_t ethernetif_rx_steer(struct pbuf *p)
+{
+  const struct eth_hdr *eth = (const struct eth_hdr *)p->payload;
+  const uint8_t *l3 = (const uint8_t *)p->payload + SIZEOF_ETH_HDR;
+  const RxSteerRule_t *rule = NULL;
+  uint16_t proto = ETHIF_RX_STEER_ANY;
+
+  if ((RxSteerCnt == 0U) || (p->len < SIZEOF_ETH_HDR))
+  {
+    return 0U;
+  }
+  if ((eth->type == PP_HTONS(ETHTYPE_IP)) && (p->len >= (SIZEOF_ETH_HDR + IP_HLEN)))
+  {
+    proto = IPH_PROTO((const struct ip_hdr *)l3);
+  }
+#if LWIP_IPV6
+  else if ((eth->type == PP_HTONS(ETHTYPE_IPV6)) && (p->len >= (SIZEOF_ETH_HDR + IP6_HLEN)))
+  {
+    proto = IP6H_NEXTH((const struct ip6_hdr *)l3);
+  }
+#endif
+  for (uint32_t i = 0U; i < ETHIF_RX_STEER_RULES; i++)
+  {
+    if (RxSteerRules[i].type != eth->type)
+    {
+      continue;
+    }
+    if (RxSteerRules[i].proto == proto)
+    {
+      rule = &RxSteerRules[i];
+      break;
+    }
+    if (RxSteerRules[i].proto == ETHIF_RX_STEER_ANY)
+    {
+      rule = &RxSteerRules[i];
+    }
+  }
+  if (rule == NULL)
+  {
+    return 0U;
+  }
+
+  EthIfRxSteerFn fn = rule->fn;
+  osMessageQueueId_t queue = rule->queue;
+  void *arg = rule->arg;
+
+  RxStats.steered++;
+  if (fn != NULL)
+  {
+    fn(p, arg);
+  }
+  else if (osMessageQueuePut(queue, &p, 0U, 0U) != osOK)
+  {
+    RxStats.steer_drops++;
+    pbuf_free(p);
+  }
+  return 1U;
+}
+#endif
+
+#if ETHIF_RX_ADMIT
+/* ETH_CODE: tcpip thread: the local ports of the UDP and TCP PCBs */
+static void ethernetif_rx_admit_ports(void *arg)
+{
+  uint32_t next = RxAdmitPortsCur ^ 1U;
+  uint32_t *map = RxAdmitPorts[next];
+
+  memset(map, 0, sizeof(RxAdmitPorts[0]));
+#define ETHIF_RX_ADMIT_MARK(port) \
+  map[((port) & (ETHIF_RX_ADMIT_PORT_BITS - 1U)) / 32U] |= 1UL << ((port) % 32U)
+#if LWIP_UDP
+  for (const struct udp_pcb *u = udp_pcbs; u != NULL; u = u->next)
+  {
+    ETHIF_RX_ADMIT_MARK(u->local_port);
+  }
+#endif
+#if LWIP_TCP
+  for (const struct tcp_pcb_listen *l = tcp_listen_pcbs.listen_pcbs; l != NULL; l = l->next)
+  {
+    ETHIF_RX_ADMIT_MARK(l->local_port);
+  }
+  for (const struct tcp_pcb *t = tcp_active_pcbs; t != NULL; t = t->next)
+  {
+    ETHIF_RX_ADMIT_MARK(t->local_port);
+  }
+#endif
+#undef ETHIF_RX_ADMIT_MARK
+  RxAdmitPortsCur = (uint8_t)next;
+  sys_timeout(ETHIF_RX_ADMIT_PORTS_MS, ethernetif_rx_admit_ports, arg);
+}
+
+/* ETH_CODE: 1 if the frame is IP to a TCP or UDP port in use here, or a
+ * later fragment, which cannot tell */
+static ITCM_FUNC uint8_t ethernetif_rx_admit_port(const struct pbuf *p)
+{
+  const struct eth_hdr *eth = (const struct eth_hdr *)p->payload;
+  const uint8_t *l3 = (const uint8_t *)p->payload + SIZEOF_ETH_HDR;
+  uint16_t len = p->len - SIZEOF_ETH_HDR;
+  uint16_t hlen;
+  uint8_t proto;
+  uint16_t port;
+
+  if ((eth->type == PP_HTONS(ETHTYPE_IP)) && (len >= IP_HLEN))
+  {
+    const struct ip_hdr *iph = (const struct ip_hdr *)l3;
+
+    if ((IPH_OFFSET(iph) & PP_HTONS(IP_OFFMASK)) != 0U)
+    {
+      return 1U;
+    }
+    hlen = IPH_HL_BYTES(iph);
+    proto = IPH_PROTO(iph);
+  }
+#if LWIP_IPV6
+  else if ((eth->type == PP_HTONS(ETHTYPE_IPV6)) && (len >= IP6_HLEN))
+  {
+    hlen = IP6_HLEN;
+    proto = IP6H_NEXTH((const struct ip6_hdr *)l3);
+  }
+#endif
+  else
+  {
+    return 0U;
+  }
+  if (((proto != IP_PROTO_TCP) && (proto != IP_PROTO_UDP)) || (len < (hlen + 4U)))
+  {
+    return 0U;
+  }
+  /* The destination port sits at the same offset in both headers */
+  port = lwip_ntohs(((const struct udp_hdr *)(l3 + hlen))->dest);
+  port &= ETHIF_RX_ADMIT_PORT_BITS - 1U;
+  return ((RxAdmitPorts[RxAdmitPortsCur][port / 32U] & (1UL << (port % 32U))) != 0U) ? 1U : 0U;
+}
+
+/* ETH_CODE: 1 to queue a frame that is not on the control lane, 0 to shed
+ * it; only called with RxAdmitLevel above 0 */
+static ITCM_FUNC uint8_t ethernetif_rx_admit(const struct pbuf *p)
+{
+  const struct eth_hdr *eth = (const struct eth_hdr *)p->payload;
+  uint8_t level = RxAdmitLevel;
+
+  if ((eth->dest.addr[0] & 0x01U) != 0U)
+  {
+    RxStats.admit_bcast++;
+    return 0U;
+  }
+  if ((level >= 2U) && (ethernetif_rx_admit_port(p) == 0U))
+  {
+    RxStats.admit_port++;
+    return 0U;
+  }
+  if (level >= 3U)
+  {
+    RxStats.admit_bulk++;
+    return 0U;
+  }
+  return 1U;
+}
+
+/* ETH_CODE: the overload level from RX_POOL, RxQueue, TCPIP_MBOX (kicked 0:
+ * a batch was refused) and the CPU load; once per poll pass */
+static ITCM_FUNC void ethernetif_rx_admit_update(uint8_t kicked)
+{
+  uint32_t now = sys_now();
+  uint32_t free = ethernetif_rx_pool_free();
+  uint32_t fill = RxQueueHead - RxQueueTail;
+  uint8_t level = 0U;
+  uint8_t cur = RxAdmitLevel;
+
+  if ((now - RxAdmitCpuT) >= ETHIF_RX_ADMIT_CPU_MS)
+  {
+    uint32_t idle = ulTaskGetIdleRunTimeCounter();
+    uint32_t total = portGET_RUN_TIME_COUNTER_VALUE();
+    uint32_t d_idle = idle - RxAdmitIdle0;
+    uint32_t d_total = total - RxAdmitTotal0;
+
+    if ((d_total != 0U) && (d_idle <= d_total))
+    {
+      RxAdmitCpu = 1000U - (uint32_t)(((uint64_t)d_idle * 1000U) / d_total);
+    }
+    RxAdmitIdle0 = idle;
+    RxAdmitTotal0 = total;
+    RxAdmitCpuT = now;
+  }
+
+  if (free <= ETHIF_RX_POOL_LOW)
+  {
+    level = 3U;
+  }
+  else if (free < (ETHIF_RX_ADMIT_HEADROOM / 4U))
+  {
+    level = 2U;
+  }
+  else if (free < (ETHIF_RX_ADMIT_HEADROOM / 2U))
+  {
+    level = 1U;
+  }
+  if (kicked == 0U)
+  {
+    level = 3U;
+  }
+  else if ((fill >= ((ETHIF_RX_QUEUE_LEN * 3U) / 4U)) && (level < 2U))
+  {
+    level = 2U;
+  }
+  else if ((fill >= (ETHIF_RX_QUEUE_LEN / 2U)) && (level < 1U))
+  {
+    level = 1U;
+  }
+  if ((RxAdmitCpu >= ETHIF_RX_ADMIT_CPU_MAX) && (level < 2U))
+  {
+    level = 2U;
+  }
+  else if ((RxAdmitCpu >= ETHIF_RX_ADMIT_CPU_HIGH) && (level < 1U))
+  {
+    level = 1U;
+  }
+
+  if (level >= cur)
+  {
+    if ((level != 0U) && (cur == 0U))
+    {
+      RxStats.overloads++;
+    }
+    RxAdmitLevel = level;
+    RxAdmitCalm = now;
+  }
+  else if ((now - RxAdmitCalm) >= ETHIF_RX_ADMIT_HOLD_MS)
+  {
+    RxAdmitLevel = cur - 1U;
+    RxAdmitCalm = now;
+  }
+}
+#endif /* ETHIF_RX_ADMIT */
+
+/* ETH_CODE: hand one received frame to the stack */
+static ITCM_FUNC void ethernetif_rx_frame(struct netif *netif, struct pbuf *p)
+{
+  /* ETH_CODE: metadata first, the handlers below own the frame */
+#if ETHIF_RX_LATENCY
+  p->meta_stamp = RxLatT0;
+  lat_hist_add(&RxLatHist[ETHIF_RXLAT_POST], DWT->CYCCNT - RxLatT0);
+#else
+  p->meta_stamp = DWT->CYCCNT;
+#endif
+  p->meta_flags = ETHIF_META_STAMP;
+#if ETHIF_PTP
+  if ((((struct pbuf_custom *)p)->custom_free_function == pbuf_free_custom) && (((RxBuff_t *)p)->ts_valid != 0U))
+  {
+    p->meta_flags |= ETHIF_META_HWTS;
+  }
+#endif
+  p->meta_class = ETHIF_TX_CLASS_BULK;
+#if ETHIF_UDP_FAST
+  p->meta_queue = ETHIF_META_Q_FAST;
+  if (ethernetif_udp_fast(netif, p) != 0U)
+  {
+    return;
+  }
+#endif
+#if ETHIF_RX_STEER
+  p->meta_queue = ETHIF_META_Q_STEER;
+  if (ethernetif_rx_steer(p) != 0U)
+  {
+    return;
+  }
+#endif
+#if ETHIF_RX_BATCH
+  LWIP_UNUSED_ARG(netif);
+#if ETHIF_RX_PRIO
+  uint8_t prio = 0U;
+#if ETHIF_VLAN
+  prio = RxFramePrio;
+#endif
+#if ETHIF_RX_CTRL_PRIO
+  if (prio == 0U)
+  {
+    prio = ethernetif_rx_is_ctrl(p);
+  }
+#endif
+#if ETHIF_RX_ADMIT
+  /* ETH_CODE: under overload, shed before the frame costs anything more */
+  if ((prio == 0U) && (RxAdmitLevel != 0U) && (ethernetif_rx_admit(p) == 0U))
+  {
+    pbuf_free(p);
+    return;
+  }
+#endif
+  if (prio != 0U)
+  {
+    p->meta_class = ETHIF_TX_CLASS_CONTROL;
+    p->meta_queue = ETHIF_META_Q_PRIO;
+    if ((RxPrioHead - __atomic_load_n(&RxPrioTail, __ATOMIC_ACQUIRE)) >= ETHIF_RX_PRIO_QUEUE_LEN)
+    {
+      RxStats.queue_drops++;
+      pbuf_free(p);
+      return;
+    }
+    RxPrioQueue[RxPrioHead % ETHIF_RX_PRIO_QUEUE_LEN] = p;
+    __atomic_store_n(&RxPrioHead, RxPrioHead + 1U, __ATOMIC_RELEASE);
+    RxStats.prio++;
+    return;
+  }
+#endif
+  p->meta_queue = ETHIF_META_Q_BULK;
+  if ((RxQueueHead - __atomic_load_n(&RxQueueTail, __ATOMIC_ACQUIRE)) >= ETHIF_RX_QUEUE_LEN)
+  {
+    RxStats.queue_drops++;
+    pbuf_free(p);
+    return;
+  }
+  RxQueue[RxQueueHead % ETHIF_RX_QUEUE_LEN] = p;
+  __atomic_store_n(&RxQueueHead, RxQueueHead + 1U, __ATOMIC_RELEASE);
+#else
+  p->meta_queue = ETHIF_META_Q_MBOX;
+#if ETHIF_RX_LATENCY
+  if (tcpip_inpkt(p, netif, ethernetif_rx_latency_input) != ERR_OK)
+#else
+  if (netif->input( p, netif) != ERR_OK )
+#endif
+  {
+    /* TCPIP_MBOX or its message pool full */
+    RxStats.mbox_full++;
+    pbuf_free(p);
+  }
+#endif
+}
+
+#if ETHIF_RX_DIRECT
+/* ETH_CODE: RxDirectMsg on the tcpip thread (core locked): the poll of the
+ * EthIf task, then the frames go up at once. A pass that uses its whole
+ * budget posts the message again, behind the messages waiting; an empty
+ * ring unmasks RIE. */
+static ITCM_FUNC void ethernetif_rx_direct(void *arg)
+{
+  struct netif *netif = (struct netif *)arg;
+  uint32_t budget = ETHIF_RX_POLL_BUDGET;
+  struct pbuf *p;
+
+  RxDirectPending = 0U;
+  PERF_START;
+#if ETHIF_RX_LATENCY
+  RxLatT0 = DWT->CYCCNT;
+  if (RxIrqFresh != 0U)
+  {
+    RxIrqFresh = 0U;
+    lat_hist_add(&RxLatHist[ETHIF_RXLAT_WAKE], RxLatT0 - RxIrqCycles);
+    RxLatT0 = RxIrqCycles;
+  }
+#endif
+#if TICKLESS_IDLE
+  tickless_rx_mark();
+#endif
+#if ETHIF_RX_ADMIT
+  ethernetif_rx_admit_update(1U);
+#endif
+  do
+  {
+    p = low_level_input(netif);
+    if (p != NULL)
+    {
+      ethernetif_rx_frame(netif, p);
+    }
+  } while ((p != NULL) && (--budget != 0U));
+  ethernetif_rx_drain(netif);
+  if (p != NULL)
+  {
+    RxStats.budget_hits++;
+    ethernetif_rx_signal();
+  }
+  else
+  {
+    __HAL_ETH_DMA_ENABLE_IT(&heth, ETH_DMA_RX_IT);
+  }
+  PERF_STOP("ethernetif_rx_direct");
+}
+#endif
+
+/**
+ * @brief This function should be called when a packet is ready to be read
+ * from the interface. It uses the function low_level_input() that
+ * should handle the actual reception of bytes from the network
+ * interface. Then the type of the received packet is determined and
+ * the appropriate input function is called.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ */
+void ethernetif_input(void* argument)
+{
+  struct pbuf *p = NULL;
+  struct netif *netif = (struct netif *) argument;
+
+  uint32_t timeout = TIME_WAITING_FOR_INPUT;
+  uint8_t kicked = 1U;
+
+  for( ;; )
+  {
+    /* ETH_CODE: while RX_POOL is exhausted, also retry the refill on a timer */
+#if ETHIF_TASK_NOTIFY
+    osStatus_t status = (ulTaskNotifyTake(pdTRUE, timeout) != 0U) ? osOK : osErrorTimeout;
+#else
+    osStatus_t status = osSemaphoreAcquire(RxPktSemaphore, timeout);
+#endif
+#if SUPERVISOR
+    supervisor_beat(&EthIfSupervisor);
+#endif
+#if ETHIF_RX_DIRECT
+    /* ETH_CODE: the tcpip thread reads the ring; repost its message until
+     * TCPIP_MBOX takes it, and retry RX_POOL refills on the timer */
+    LWIP_UNUSED_ARG(p);
+    LWIP_UNUSED_ARG(netif);
+    if ((status == osOK) || (RxAllocStatus == RX_ALLOC_ERROR) || (kicked == 0U))
+    {
+      if (status != osOK)
+      {
+        RxStats.refill_retry++;
+      }
+      kicked = ethernetif_rx_direct_post();
+    }
+#else
+    if ((status == osOK) || (RxAllocStatus == RX_ALLOC_ERROR))
+    {
+      /* ETH_CODE: one wakeup, all frames read and handed to lwIP */
+      PERF_START;
+#if ETHIF_RX_LATENCY
+      RxLatT0 = DWT->CYCCNT;
+      if (RxIrqFresh != 0U)
+      {
+        RxIrqFresh = 0U;
+        lat_hist_add(&RxLatHist[ETHIF_RXLAT_WAKE], RxLatT0 - RxIrqCycles);
+        RxLatT0 = RxIrqCycles;
+      }
+#endif
+#if TICKLESS_IDLE
+      tickless_rx_mark();
+#endif
+      if (status != osOK)
+      {
+        RxStats.refill_retry++;
+      }
+#if ETHIF_RX_POLL
+      /* ETH_CODE: poll with RX interrupts masked. A pass that uses its
+       * whole budget yields and polls again; an empty ring unmasks RIE.
+       * RI set meanwhile is still pending, so a frame arriving just before
+       * the unmask raises the interrupt immediately. */
+      for (;;)
+      {
+        uint32_t budget = ETHIF_RX_POLL_BUDGET;
+#if ETHIF_RX_ADMIT
+        ethernetif_rx_admit_update(kicked);
+#endif
+        do
+        {
+          p = low_level_input( netif );
+          if (p != NULL)
+          {
+            ethernetif_rx_frame(netif, p);
+          }
+        } while((p != NULL) && (--budget != 0U));
+#if ETHIF_RX_BATCH
+        kicked = ethernetif_rx_kick(netif);
+#endif
+        if (p == NULL)
+        {
+          break;
+        }
+        RxStats.budget_hits++;
+        osThreadYield();
+      }
+      __HAL_ETH_DMA_ENABLE_IT(&heth, ETH_DMA_RX_IT);
+#else
+#if ETHIF_RX_ADMIT
+      ethernetif_rx_admit_update(kicked);
+#endif
+      do
+      {
+        p = low_level_input( netif );
+        if (p != NULL)
+        {
+          ethernetif_rx_frame(netif, p);
+        }
+      } while(p!=NULL);
+#if ETHIF_RX_BATCH
+      kicked = ethernetif_rx_kick(netif);
+#endif
+#endif
+      PERF_STOP("ethernetif_input");
+    }
+#if ETHIF_RX_BATCH
+    else if (kicked == 0U)
+    {
+      /* ETH_CODE: retry a batch that found TCPIP_MBOX full */
+      kicked = ethernetif_rx_kick(netif);
+    }
+#endif
+#endif /* ETHIF_RX_DIRECT */
+    timeout = ((RxAllocStatus == RX_ALLOC_ERROR) || (kicked == 0U)) ? pdMS_TO_TICKS(ETHIF_RX_REFILL_RETRY_MS)
+                                                                   : TIME_WAITING_FOR_INPUT;
+  }
+}
+
+#if !LWIP_ARP
+/**
+ * This function has to be completed by user in case of ARP OFF.
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @return ERR_OK if ...
+ */
+static err_t low_level_output_arp_off(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
+{
+  err_t errval;
+  errval = ERR_OK;
+
+/* USER CODE BEGIN 5 */
+
+/* USER CODE END 5 */
+
+  return errval;
+
+}
+#endif /* LWIP_ARP */
+
+/**
+ * @brief Should be called at the beginning of the program to set up the
+ * network interface. It calls the function low_level_init() to do the
+ * actual setup of the hardware.
+ *
+ * This function should be passed as a parameter to netif_add().
+ *
+ * @param netif the lwip network interface structure for this ethernetif
+ * @return ERR_OK if the loopif is initialized
+ *         ERR_MEM if private data couldn't be allocated
+ *         any other err_t on error
+ */
+err_t ethernetif_init(struct netif *netif)
+{
+  LWIP_ASSERT("netif != NULL", (netif != NULL));
+
+#if LWIP_NETIF_HOSTNAME
+  /* Initialize interface hostname */
+  netif->hostname = "lwip";
+#endif /* LWIP_NETIF_HOSTNAME */
+
+  /*
+   * Initialize the snmp variables and counters inside the struct netif.
+   * The last argument should be replaced with your link speed, in units
+   * of bits per second.
+   */
+  // MIB2_INIT_NETIF(netif, snmp_ifType_ethernet_csmacd, LINK_SPEED_OF_YOUR_NETIF_IN_BPS);
+  /* ETH_CODE: MIB2_STATS stays off; snmp/snmp_agent.h serves the IF-MIB
+   * from the driver counters and ethernetif_link_speed() */
+
+  netif->name[0] = IFNAME0;
+  netif->name[1] = IFNAME1;
+  /* We directly use etharp_output() here to save a function call.
+   * You can instead declare your own function an call etharp_output()
+   * from it if you have to do some checks before sending (e.g. if link
+   * is available...) */
+
+#if LWIP_IPV4
+#if LWIP_ARP || LWIP_ETHERNET
+#if LWIP_ARP
+  netif->output = etharp_output;
+#else
+  /* The user should write its own code in low_level_output_arp_off function */
+  netif->output = low_level_output_arp_off;
+#endif /* LWIP_ARP */
+#endif /* LWIP_ARP || LWIP_ETHERNET */
+#endif /* LWIP_IPV4 */
+
+#if LWIP_IPV6
+  netif->output_ip6 = ethip6_output;
+#endif /* LWIP_IPV6 */
+
+  netif->linkoutput = low_level_output;
+#if ETHIF_TX_BATCH
+  netif->tx_flush = ethernetif_tx_batch_end;
+#endif
+
+  /* initialize the hardware */
+  low_level_init(netif);
+
+  return ERR_OK;
+}
+
+#if ETHIF_OOSEQ_EVICT || ETHIF_RX_ADMIT
+/* ETH_CODE: RX_POOL buffers not allocated; the ring's count as allocated */
+static uint32_t ethernetif_rx_pool_free(void)
+{
+#if MEMP_STATS
+  return ETH_RX_BUFFER_CNT - (uint32_t)memp_RX_POOL.stats->used;
+#else
+  return (RxAllocStatus == RX_ALLOC_ERROR) ? 0U : (ETHIF_RX_POOL_LOW + 1U);
+#endif
+}
+#endif
+
+#if ETHIF_OOSEQ_EVICT
+
+/* ETH_CODE: TCP_OOSEQ_POOL_LOW() of lwipopts.h: no TCP out-of-order queue
+ * may grow while RX_POOL is at its watermark */
+int ethernetif_rx_pool_low(void)
+{
+  return (ethernetif_rx_pool_free() <= ETHIF_RX_POOL_LOW) ? 1 : 0;
+}
+
+static volatile uint8_t RxOoseqEvictPending;
+
+/* ETH_CODE: tcpip thread: free out-of-order queues, largest first, until
+ * RX_POOL is above its watermark again */
+static void ethernetif_ooseq_evict(void *arg)
+{
+  uint32_t avail = ethernetif_rx_pool_free();
+
+  LWIP_UNUSED_ARG(arg);
+  RxOoseqEvictPending = 0U;
+  if (avail <= ETHIF_RX_POOL_LOW)
+  {
+    (void)tcp_ooseq_evict(ETHIF_RX_POOL_LOW + 1U - avail);
+  }
+}
+
+/* ETH_CODE: from the RX_POOL allocation: at the watermark with TCP holding
+ * out-of-order data, queue one eviction on the tcpip thread */
+static ITCM_FUNC void ethernetif_ooseq_check(void)
+{
+  if ((RxOoseqEvictPending == 0U) && (tcp_ooseq_counters.pbufs != 0U) &&
+      (ethernetif_rx_pool_free() <= ETHIF_RX_POOL_LOW))
+  {
+    RxOoseqEvictPending = 1U;
+    if (tcpip_try_callback(ethernetif_ooseq_evict, NULL) != ERR_OK)
+    {
+      RxOoseqEvictPending = 0U;
+    }
+  }
+}
+#endif /* ETHIF_OOSEQ_EVICT */
+
+/**
+  * @brief  Custom Rx pbuf free callback
+  * @param  pbuf: pbuf to be freed
+  * @retval None
+  */
+ITCM_FUNC void pbuf_free_custom(struct pbuf *p)
+{
+  struct pbuf_custom* custom_pbuf = (struct pbuf_custom*)p;
+  LWIP_MEMPOOL_FREE(RX_POOL, custom_pbuf);
+
+  /* If the Rx Buffer Pool was exhausted, signal the ethernetif_input task to
+   * call HAL_ETH_GetRxDataBuffer to rebuild the Rx descriptors. */
+
+  if (RxAllocStatus == RX_ALLOC_ERROR)
+  {
+    RxAllocStatus = RX_ALLOC_OK;
+    ethernetif_rx_signal();
+  }
+}
+
+/* ETH_CODE: NETCONN_RX_PINNED() of lwipopts.h: q holds an RX_POOL buffer.
+ * A frame with a receive timestamp stays, the timestamp is read from its
+ * buffer (ethernetif_ptp_get_rx_timestamp()). */
+int ethernetif_rx_pinned(const struct pbuf *q)
+{
+  const RxBuff_t *b = (const RxBuff_t *)q;
+
+  if (((q->flags & PBUF_FLAG_IS_CUSTOM) == 0U) || (b->pbuf_custom.custom_free_function != pbuf_free_custom))
+  {
+    return 0;
+  }
+#if ETHIF_PTP
+  if (b->ts_valid != 0U)
+  {
+    return 0;
+  }
+#endif
+  return 1;
+}
+
+#if LWIP_SO_TIMESTAMP
+/* ETH_CODE: LWIP_PBUF_RX_TIME() of lwipopts.h: the receive stamp of the
+ * metadata on the time_ns clocks. The DWT count wraps, so it is good for
+ * about 5 s after the frame arrived; a PTP hardware timestamp is on the
+ * PTP clock instead and read with ethernetif_ptp_get_rx_timestamp(). */
+int ethernetif_rx_time(const struct pbuf *p, uint64_t *mono_ns, uint64_t *utc_ns)
+{
+  uint64_t mono;
+
+  if ((p->meta_flags & ETHIF_META_STAMP) == 0U)
+  {
+    return 0;
+  }
+  mono = time_ns_at_cycles(p->meta_stamp);
+  if (mono_ns != NULL)
+  {
+    *mono_ns = mono;
+  }
+  if (utc_ns != NULL)
+  {
+    *utc_ns = time_utc_ns_at(mono);
+  }
+  return 1;
+}
+#endif /* LWIP_SO_TIMESTAMP */
+
+#if ETHIF_RX_COPY_MAX
+/* ETH_CODE: free callback of the RX_SMALL copies */
+static void pbuf_free_small(struct pbuf *p)
+{
+  LWIP_MEMPOOL_FREE(RX_SMALL, p);
+}
+#endif
+
+/* USER CODE BEGIN 6 */
+
+/**
+  * @brief  Returns a snapshot of the receive path counters
+  * @param  stats: destination
+  * @retval None
+  */
+void ethernetif_get_rx_stats(EthIfRxStatsTypeDef *stats)
+{
+  if (stats != NULL)
+  {
+    *stats = RxStats;
+#if ETHIF_RX_ADMIT
+    stats->admit_level = RxAdmitLevel;
+#endif
+  }
+}
+
+/**
+  * @brief  Returns a snapshot of the transmit path counters
+  * @param  stats: destination
+  * @retval None
+  */
+void ethernetif_get_tx_stats(EthIfTxStatsTypeDef *stats)
+{
+  if (stats != NULL)
+  {
+    *stats = TxStats;
+  }
+}
+
+/**
+  * @brief  Returns a snapshot of the TX scheduler class counters
+  * @param  stats: destination, ETHIF_TX_CLASS_CNT entries
+  * @retval None
+  */
+void ethernetif_get_tx_class_stats(EthIfTxClassStatsTypeDef stats[ETHIF_TX_CLASS_CNT])
+{
+  if (stats == NULL)
+  {
+    return;
+  }
+#if ETHIF_TX_SCHED
+  uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+  for (uint32_t c = 0U; c < ETHIF_TX_CLASS_CNT; c++)
+  {
+    stats[c] = TxClassStats[c];
+    stats[c].delay_max_us = TxClassDelayMax[c] / cycles_per_us;
+  }
+#else
+  memset(stats, 0, ETHIF_TX_CLASS_CNT * sizeof(stats[0]));
+#endif
+}
+
+/**
+  * @brief  Sets the token bucket of a non-control class
+  * @param  c: class
+  * @param  rate_kbps: kbit/s, 0 unshaped
+  * @param  burst: bucket size in bytes, at least one full frame
+  * @retval ERR_OK, ERR_VAL (control class, short burst), ERR_ARG (no ETHIF_TX_SHAPE)
+  */
+err_t ethernetif_tx_shape_set(EthIfTxClassTypeDef c, uint32_t rate_kbps, uint32_t burst)
+{
+#if ETHIF_TX_SHAPE
+  LWIP_ASSERT_CORE_LOCKED();
+  if ((c == ETHIF_TX_CLASS_CONTROL) || (c >= ETHIF_TX_CLASS_CNT) || (burst < ETH_MAX_PACKET_SIZE))
+  {
+    return ERR_VAL;
+  }
+  ethernetif_tx_shape_config(c, rate_kbps, burst);
+  /* Frames waiting under the old rate may go now */
+  ethernetif_tx_kick(NULL);
+  return ERR_OK;
+#else
+  LWIP_UNUSED_ARG(c);
+  LWIP_UNUSED_ARG(rate_kbps);
+  LWIP_UNUSED_ARG(burst);
+  return ERR_ARG;
+#endif
+}
+
+/**
+  * @brief  Frames class c can queue before one is refused
+  * @param  c: class, ignored without ETHIF_TX_SCHED
+  * @retval free queue slots; 0 while a frame of c would be refused
+  */
+uint32_t ethernetif_tx_class_room(EthIfTxClassTypeDef c)
+{
+#if ETHIF_TX_QUEUE
+#if ETHIF_TX_SCHED
+  const TxQueueTypeDef *q = &TxQueue[(c < ETHIF_TX_CLASS_CNT) ? c : ETHIF_TX_CLASS_BULK];
+#else
+  const TxQueueTypeDef *q = &TxQueue[0];
+  LWIP_UNUSED_ARG(c);
+#endif
+  return ETHIF_TX_QUEUE_LEN - (q->head - q->tail);
+#else
+  LWIP_UNUSED_ARG(c);
+  return 1U;
+#endif
+}
+
+/**
+  * @brief  Opens a time-triggered window: the frames sent until
+  *         ethernetif_tx_window_close() start at at_ns. Core lock held.
+  * @param  at_ns: time_now_ns() of the first frame's tail pointer write
+  * @retval ERR_OK, ERR_INPROGRESS (a window is armed), ERR_VAL (too far ahead)
+  */
+err_t ethernetif_tx_window_open(uint64_t at_ns)
+{
+#if ETHIF_TX_TT
+  LWIP_ASSERT_CORE_LOCKED();
+  if ((TxTtOpen != 0U) || (TxTtArmed != 0U))
+  {
+    return ERR_INPROGRESS;
+  }
+  if ((int64_t)(at_ns - time_now_ns()) > ((int64_t)ETHIF_TX_TT_LEAD_MAX_US * 1000))
+  {
+    return ERR_VAL;
+  }
+#if ETHIF_TX_BATCH
+  /* What a batch left in the ring goes now, not with the window */
+  ethernetif_tx_ring();
+#endif
+  TxTtAt = at_ns;
+  TxTtFrames = 0U;
+  TxTtOpen = 1U;
+  return ERR_OK;
+#else
+  LWIP_UNUSED_ARG(at_ns);
+  return ERR_ARG;
+#endif
+}
+
+/**
+  * @brief  Closes the window and arms the compare, or sends the frames
+  *         at once when its time is less than ETHIF_TX_TT_LEAD_MIN_NS away.
+  *         Core lock held.
+  * @retval ERR_OK, ERR_VAL (no window open)
+  */
+err_t ethernetif_tx_window_close(void)
+{
+#if ETHIF_TX_TT
+  uint32_t primask;
+  uint32_t cnt;
+  uint32_t ccr;
+  uint64_t now;
+  int64_t lead;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  if (TxTtOpen == 0U)
+  {
+    return ERR_VAL;
+  }
+  TxTtOpen = 0U;
+  if (TxTtFrames == 0U)
+  {
+    return ERR_OK;
+  }
+  TxTtStats.windows++;
+  TxTtStats.frames += TxTtFrames;
+
+  /* Counter and clock read together: the pair maps at_ns to a count */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  cnt = ETHIF_TX_TT_TIM->CNT;
+  now = time_now_ns();
+  __set_PRIMASK(primask);
+
+  lead = (int64_t)(TxTtAt - now);
+  if (lead < (int64_t)ETHIF_TX_TT_LEAD_MIN_NS)
+  {
+    HAL_ETH_TransmitPoll(&heth);
+    TxTtStats.late++;
+    ethernetif_tx_tt_account(time_now_ns());
+    return ERR_OK;
+  }
+  ccr = cnt + (uint32_t)(((uint64_t)lead * TxTtMul) >> 32);
+  ETHIF_TX_TT_TIM->CCR1 = ccr;
+  ETHIF_TX_TT_TIM->SR = ~(uint32_t)TIM_SR_CC1IF;
+  TxTtArmed = 1U;
+  ETHIF_TX_TT_TIM->DIER |= TIM_DIER_CC1IE;
+  if ((int32_t)(ETHIF_TX_TT_TIM->CNT - ccr) >= 0)
+  {
+    /* Preempted past the compare: it will not match again for a wrap */
+    HAL_NVIC_SetPendingIRQ(ETHIF_TX_TT_IRQn);
+  }
+  return ERR_OK;
+#else
+  return ERR_ARG;
+#endif
+}
+
+/**
+  * @brief  Returns a snapshot of the time-triggered transmit counters
+  * @param  stats: destination
+  * @retval None
+  */
+void ethernetif_get_tx_tt_stats(EthIfTxTtStatsTypeDef *stats)
+{
+  if (stats == NULL)
+  {
+    return;
+  }
+#if ETHIF_TX_TT
+  *stats = TxTtStats;
+#else
+  memset(stats, 0, sizeof(*stats));
+#endif
+}
+
+/**
+  * @brief  Whether the core clock may change now; waits for an MDIO
+  *         transfer in progress to end, none starts before the change
+  *         since the caller masks interrupts
+  * @retval 0 while a time-triggered window is open or armed, or with the
+  *         PTP clock running from HCLK
+  */
+uint8_t ethernetif_clock_prepare(void)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+#if ETHIF_PTP
+  return 0U;
+#else
+#if ETHIF_TX_TT
+  if (ethernetif_tx_held() != 0U)
+  {
+    return 0U;
+  }
+#endif
+  while ((heth.Instance->MACMDIOAR & ETH_MACMDIOAR_MB) != 0U)
+  {
+  }
+  return 1U;
+#endif
+}
+
+/**
+  * @brief  Re-derives what follows the core and bus clocks after a change:
+  *         MDC divider, RX interrupt watchdog, shaper rates, time-triggered
+  *         timer scale. Interrupts still masked, core lock held.
+  * @retval None
+  */
+void ethernetif_clock_changed(void)
+{
+  HAL_ETH_SetMDIOClockRange(&heth);
+#if ETHIF_RX_COALESCE_US
+  ethernetif_rx_rwt_set(&heth);
+#endif
+#if ETHIF_TX_SHAPE
+  for (uint32_t c = ETHIF_TX_CLASS_TELEMETRY; c < ETHIF_TX_CLASS_CNT; c++)
+  {
+    /* Tokens stay; the cycles since the last fill count at the new rate */
+    ethernetif_tx_shape_rate(&TxShape[c]);
+  }
+#endif
+#if ETHIF_TX_TT
+  ethernetif_tx_tt_scale();
+#endif
+}
+
+/**
+  * @brief  Returns a snapshot of all driver counters
+  * @param  stats: destination
+  * @retval None
+  */
+void ethernetif_get_stats(EthIfStatsTypeDef *stats)
+{
+  if (stats != NULL)
+  {
+    stats->rx = RxStats;
+    stats->tx = TxStats;
+    stats->dma_errors = DmaErrors;
+    stats->mac_errors = MacErrors;
+  }
+}
+
+#if ETHIF_RX_LATENCY
+/* ETH_CODE: received frames and their copies only; anything else (TX
+ * frames, loopback) has no receive stamp */
+static uint8_t ethernetif_rx_latency_t0(const struct pbuf *p, uint32_t *t0)
+{
+  if ((p == NULL) || ((p->meta_flags & ETHIF_META_STAMP) == 0U))
+  {
+    return 0U;
+  }
+  *t0 = p->meta_stamp;
+  return 1U;
+}
+
+/* ETH_CODE: ethernet_input() on the tcpip thread, timed on both sides.
+ * The frame may be freed inside, so t0 is read before. */
+static ITCM_FUNC err_t ethernetif_rx_latency_input(struct pbuf *p, struct netif *netif)
+{
+  uint32_t t0 = 0U;
+  uint8_t traced = ethernetif_rx_latency_t0(p, &t0);
+  err_t err;
+
+  if (traced != 0U)
+  {
+    lat_hist_add(&RxLatHist[ETHIF_RXLAT_INPUT], DWT->CYCCNT - t0);
+  }
+  err = ethernet_input(p, netif);
+  if (traced != 0U)
+  {
+    lat_hist_add(&RxLatHist[ETHIF_RXLAT_DONE], DWT->CYCCNT - t0);
+  }
+  return err;
+}
+
+/**
+  * @brief  Records the application stage of a received frame
+  * @param  p: the pbuf as received from lwIP (raw API callback, netbuf)
+  * @retval None
+  * @note   Any context; ignored for pbufs not from the driver
+  */
+void ethernetif_rx_latency_mark(const struct pbuf *p)
+{
+  uint32_t t0;
+
+  if (ethernetif_rx_latency_t0(p, &t0) != 0U)
+  {
+    lat_hist_add(&RxLatHist[ETHIF_RXLAT_APP], DWT->CYCCNT - t0);
+  }
+}
+
+/**
+  * @brief  Returns the latency percentiles of one stage
+  * @param  stage: ETHIF_RXLAT_WAKE .. ETHIF_RXLAT_APP
+  * @param  lat: destination
+  * @retval None
+  */
+void ethernetif_rx_latency_get(EthIfRxLatStageTypeDef stage, EthIfRxLatTypeDef *lat)
+{
+  static LatHist_t h;
+  uint32_t mhz = SystemCoreClock / 1000000U;
+
+  if ((lat == NULL) || ((uint32_t)stage >= ETHIF_RXLAT_CNT))
+  {
+    return;
+  }
+  lat_hist_snapshot(&RxLatHist[stage], &h);
+  lat->count = h.count;
+  lat->p50_ns = (uint32_t)(((uint64_t)lat_hist_percentile(&h, 5000U) * 1000U) / mhz);
+  lat->p99_ns = (uint32_t)(((uint64_t)lat_hist_percentile(&h, 9900U) * 1000U) / mhz);
+  lat->p999_ns = (uint32_t)(((uint64_t)lat_hist_percentile(&h, 9990U) * 1000U) / mhz);
+  lat->max_ns = (uint32_t)(((uint64_t)h.max * 1000U) / mhz);
+}
+
+/**
+  * @brief  Clears the latency histograms
+  * @retval None
+  */
+void ethernetif_rx_latency_reset(void)
+{
+  for (uint32_t i = 0; i < ETHIF_RXLAT_CNT; i++)
+  {
+    lat_hist_reset(&RxLatHist[i]);
+  }
+}
+#endif
+
+/**
+  * @brief  Sends the driver counters to syslog, with frame and byte rates
+  *         since the previous call
+  * @retval None
+  */
+void ethernetif_log_stats(void)
+{
+  static EthIfStatsTypeDef last;
+  static uint32_t last_tick;
+  EthIfStatsTypeDef now;
+  uint32_t tick = HAL_GetTick();
+  uint32_t ms = tick - last_tick;
+
+  ethernetif_get_stats(&now);
+  if (ms == 0U)
+  {
+    ms = 1U;
+  }
+  LOG_INFO("ETH", "rx %lu fps %lu kB/s, tx %lu fps %lu kB/s",
+           (unsigned long)(((now.rx.frames - last.rx.frames) * 1000ULL) / ms),
+           (unsigned long)((now.rx.bytes - last.rx.bytes) / ms),
+           (unsigned long)(((now.tx.frames - last.tx.frames) * 1000ULL) / ms),
+           (unsigned long)((now.tx.bytes - last.tx.bytes) / ms));
+  LOG_INFO("ETH", "rx frames %lu rbu %lu alloc_fail %lu refill %lu csum %lu qdrop %lu mbox_full %lu prio %lu",
+           (unsigned long)now.rx.frames, (unsigned long)now.rx.rbu, (unsigned long)now.rx.alloc_fail,
+           (unsigned long)now.rx.refill_retry, (unsigned long)now.rx.csum_drops,
+           (unsigned long)now.rx.queue_drops, (unsigned long)now.rx.mbox_full, (unsigned long)now.rx.prio);
+#if ETHIF_UDP_FAST
+  LOG_INFO("ETH", "rx udp fast %lu drop %lu", (unsigned long)now.rx.udp_fast,
+           (unsigned long)now.rx.udp_fast_drops);
+#endif
+#if ETHIF_RX_STEER
+  LOG_INFO("ETH", "rx steered %lu drop %lu", (unsigned long)now.rx.steered,
+           (unsigned long)now.rx.steer_drops);
+#endif
+#if ETHIF_RX_COPY_MAX
+  LOG_INFO("ETH", "rx small copied %lu fail %lu", (unsigned long)now.rx.copied,
+           (unsigned long)now.rx.copy_fail);
+#endif
+#if ETHIF_RX_ADMIT
+  LOG_INFO("ETH", "rx admit level %lu overloads %lu shed bcast %lu port %lu bulk %lu",
+           (unsigned long)now.rx.admit_level, (unsigned long)now.rx.overloads,
+           (unsigned long)now.rx.admit_bcast, (unsigned long)now.rx.admit_port,
+           (unsigned long)now.rx.admit_bulk);
+#endif
+#if ETHIF_JUMBO
+  LOG_INFO("ETH", "tx jumbo checksummed %lu", (unsigned long)now.tx.csum_sw);
+#endif
+  LOG_INFO("ETH", "tx frames %lu busy %lu err %lu qdrop %lu coalesced %lu, dma err %lu mac err %lu",
+           (unsigned long)now.tx.frames, (unsigned long)now.tx.busy, (unsigned long)now.tx.errors,
+           (unsigned long)now.tx.queue_drops, (unsigned long)now.tx.coalesced,
+           (unsigned long)now.dma_errors, (unsigned long)now.mac_errors);
+  LOG_INFO("ETH", "link downs %lu flaps %lu restarts %lu expired %lu, flap last %lu max %lu ms, tx reclaimed %lu",
+           (unsigned long)LinkStats.downs, (unsigned long)LinkStats.flaps, (unsigned long)LinkStats.restarts,
+           (unsigned long)LinkStats.expired, (unsigned long)LinkStats.flap_last_ms,
+           (unsigned long)LinkStats.flap_max_ms, (unsigned long)LinkStats.tx_reclaimed);
+#if ETHIF_TX_TT
+  EthIfTxTtStatsTypeDef tt;
+  ethernetif_get_tx_tt_stats(&tt);
+  LOG_INFO("ETH", "tx tt windows %lu frames %lu drop %lu late %lu held %lu err last %lu max %lu ns",
+           (unsigned long)tt.windows, (unsigned long)tt.frames, (unsigned long)tt.drops,
+           (unsigned long)tt.late, (unsigned long)tt.held, (unsigned long)tt.err_last_ns,
+           (unsigned long)tt.err_max_ns);
+#endif
+#if ETHIF_TX_SCHED
+  static const char *const cls[ETHIF_TX_CLASS_CNT] = { "control", "telemetry", "logging", "bulk" };
+  EthIfTxClassStatsTypeDef tc[ETHIF_TX_CLASS_CNT];
+  ethernetif_get_tx_class_stats(tc);
+  for (uint32_t i = 0; i < ETHIF_TX_CLASS_CNT; i++)
+  {
+    LOG_INFO("ETH", "tx %-9s frames %lu queued %lu shaped %lu qdrop %lu delay max %lu us", cls[i],
+             (unsigned long)tc[i].frames, (unsigned long)tc[i].queued, (unsigned long)tc[i].shaped,
+             (unsigned long)tc[i].queue_drops, (unsigned long)tc[i].delay_max_us);
+  }
+#endif
+#if ETHIF_RX_LATENCY
+  static const char *const stage[ETHIF_RXLAT_CNT] = { "wake", "post", "input", "done", "app" };
+  for (uint32_t i = 0; i < ETHIF_RXLAT_CNT; i++)
+  {
+    EthIfRxLatTypeDef lat;
+    ethernetif_rx_latency_get((EthIfRxLatStageTypeDef)i, &lat);
+    LOG_INFO("ETH", "rx lat %-5s n %lu p50 %lu p99 %lu p99.9 %lu max %lu ns", stage[i],
+             (unsigned long)lat.count, (unsigned long)lat.p50_ns, (unsigned long)lat.p99_ns,
+             (unsigned long)lat.p999_ns, (unsigned long)lat.max_ns);
+  }
+#endif
+#if ETHIF_CORE_LOCK_PROF
+  static EthIfCoreLockStatsTypeDef lock[ETHIF_CORE_LOCK_PROF_THREADS];
+  uint32_t window_ms;
+  uint32_t threads = ethernetif_core_lock_get(lock, ETHIF_CORE_LOCK_PROF_THREADS, &window_ms);
+  uint32_t mhz = SystemCoreClock / 1000000U;
+  for (uint32_t i = 0; i < threads; i++)
+  {
+    const EthIfCoreLockStatsTypeDef *l = &lock[i];
+    uint32_t acq = (l->acquired != 0U) ? l->acquired : 1U;
+    LOG_INFO("ETH", "core lock %-12s acq %lu contended %lu, wait avg %lu max %lu us, hold avg %lu max %lu us, "
+             "held %lu.%lu%% of %lu ms", l->name, (unsigned long)l->acquired, (unsigned long)l->contended,
+             (unsigned long)(l->wait_cycles / acq / mhz), (unsigned long)(l->wait_max_cycles / mhz),
+             (unsigned long)(l->hold_cycles / acq / mhz), (unsigned long)(l->hold_max_cycles / mhz),
+             (unsigned long)((window_ms != 0U) ? (l->hold_cycles / mhz) / window_ms / 10U : 0U),
+             (unsigned long)((window_ms != 0U) ? ((l->hold_cycles / mhz) / window_ms) % 10U : 0U),
+             (unsigned long)window_ms);
+  }
+#endif
+#if ETHIF_EEE
+  EthIfEeeStatsTypeDef eee;
+  ethernetif_get_eee_stats(&eee);
+  LOG_INFO("ETH", "eee %s tx lpi %lu us rx lpi %lu us, wakes %lu last %lu max %lu us over %lu",
+           eee.active ? "on" : "off", (unsigned long)eee.tx_lpi_us, (unsigned long)eee.rx_lpi_us,
+           (unsigned long)eee.wakes, (unsigned long)eee.wake_last_us, (unsigned long)eee.wake_max_us,
+           (unsigned long)eee.over_budget);
+#endif
+#if ETHIF_WOL
+  EthIfWolStatsTypeDef wol;
+  ethernetif_get_wol_stats(&wol);
+  LOG_INFO("ETH", "wol standbys %lu magic %lu filter %lu timeout %lu, resume last %lu max %lu us, "
+           "first rx %lu tx %lu us", (unsigned long)wol.standbys, (unsigned long)wol.magic,
+           (unsigned long)wol.filter, (unsigned long)wol.timeout, (unsigned long)wol.resume_last_us,
+           (unsigned long)wol.resume_max_us, (unsigned long)wol.first_rx_us, (unsigned long)wol.first_tx_us);
+#endif
+#if ETHIF_DMA_PROF
+  EthIfDmaProfTypeDef prof;
+  ethernetif_dma_prof_get(&prof);
+  LOG_INFO("ETH", "dma %s rx %lu cyc/frame tx %lu cyc/frame release %lu cyc/frame (%lu/%lu/%lu frames)",
+           prof.lean ? "lean" : "hal",
+           (unsigned long)((prof.rx_frames != 0U) ? prof.rx_cycles / prof.rx_frames : 0U),
+           (unsigned long)((prof.tx_frames != 0U) ? prof.tx_cycles / prof.tx_frames : 0U),
+           (unsigned long)((prof.freed != 0U) ? prof.release_cycles / prof.freed : 0U),
+           (unsigned long)prof.rx_frames, (unsigned long)prof.tx_frames, (unsigned long)prof.freed);
+#endif
+  last = now;
+  last_tick = tick;
+}
+
+#if ETHIF_STATS_LOG_MS
+/* ETH_CODE: periodic summary, runs on the tcpip thread */
+static void ethernetif_stats_timer(void *arg)
+{
+  ethernetif_log_stats();
+  sys_timeout(ETHIF_STATS_LOG_MS, ethernetif_stats_timer, arg);
+}
+#endif
+
+/**
+* @brief  Returns the current time in milliseconds
+*         when LWIP_TIMERS == 1 and NO_SYS == 1
+* @param  None
+* @retval Current Time value
+*/
+u32_t sys_now(void)
+{
+  return HAL_GetTick();
+}
+
+
+/**
+  * @brief  Programs one hardware L3/L4 receive filter
+  * @param  index: 0 .. ETHIF_RX_FILTER_CNT - 1
+  * @param  filter: match fields, NULL clears the filter
+  * @retval ERR_OK, ERR_ARG on an invalid index or field
+  * @note   Call with the lwIP core lock held. Takes effect once enabled
+  *         with ethernetif_enable_rx_filter().
+  */
+err_t ethernetif_set_rx_filter(uint32_t index, const EthIfRxFilterTypeDef *filter)
+{
+  ETH_L3FilterConfigTypeDef l3 = {0};
+  ETH_L4FilterConfigTypeDef l4 = {0};
+  uint32_t filter_l3 = (index == 0U) ? ETH_L3_FILTER_0 : ETH_L3_FILTER_1;
+  uint32_t filter_l4 = (index == 0U) ? ETH_L4_FILTER_0 : ETH_L4_FILTER_1;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  if (index >= ETHIF_RX_FILTER_CNT)
+  {
+    return ERR_ARG;
+  }
+
+  l3.Protocol = ETH_L3_IPV4_MATCH;
+  l3.SrcAddrFilterMatch = ETH_L3_SRC_ADDR_MATCH_DISABLE;
+  l3.DestAddrFilterMatch = ETH_L3_DEST_ADDR_MATCH_DISABLE;
+  l4.Protocol = ETH_L4_TCP_MATCH;
+  l4.SrcPortFilterMatch = ETH_L4_SRC_PORT_MATCH_DISABLE;
+  l4.DestPortFilterMatch = ETH_L4_DEST_PORT_MATCH_DISABLE;
+
+  if (filter != NULL)
+  {
+    if ((filter->src_prefix > 32U) || (filter->dst_prefix > 32U) ||
+        (((filter->src_port != 0U) || (filter->dst_port != 0U)) &&
+         (filter->proto != IP_PROTO_TCP) && (filter->proto != IP_PROTO_UDP)))
+    {
+      return ERR_ARG;
+    }
+    /* The MAC compares addresses MSB first and masks the given number of
+     * low-order bits. */
+    if (filter->src_prefix != 0U)
+    {
+      l3.SrcAddrFilterMatch = ETH_L3_SRC_ADDR_PERFECT_MATCH_ENABLE;
+      l3.SrcAddrHigherBitsMatch = 32U - filter->src_prefix;
+      l3.Ip4SrcAddr = lwip_ntohl(ip4_addr_get_u32(&filter->src_addr));
+    }
+    if (filter->dst_prefix != 0U)
+    {
+      l3.DestAddrFilterMatch = ETH_L3_DEST_ADDR_PERFECT_MATCH_ENABLE;
+      l3.DestAddrHigherBitsMatch = 32U - filter->dst_prefix;
+      l3.Ip4DestAddr = lwip_ntohl(ip4_addr_get_u32(&filter->dst_addr));
+    }
+    if (filter->proto == IP_PROTO_UDP)
+    {
+      l4.Protocol = ETH_L4_UDP_MATCH;
+    }
+    if (filter->src_port != 0U)
+    {
+      l4.SrcPortFilterMatch = ETH_L4_SRC_PORT_PERFECT_MATCH_ENABLE;
+      l4.SourcePort = filter->src_port;
+    }
+    if (filter->dst_port != 0U)
+    {
+      l4.DestPortFilterMatch = ETH_L4_DEST_PORT_PERFECT_MATCH_ENABLE;
+      l4.DestinationPort = filter->dst_port;
+    }
+  }
+
+  /* Both setters also set MACPFR.IPFE; keep the caller's enable state. */
+  uint32_t ipfe = READ_BIT(heth.Instance->MACPFR, ETH_MACPFR_IPFE);
+  HAL_ETHEx_SetL3FilterConfig(&heth, filter_l3, &l3);
+  HAL_ETHEx_SetL4FilterConfig(&heth, filter_l4, &l4);
+  if (ipfe == 0U)
+  {
+    HAL_ETHEx_DisableL3L4Filtering(&heth);
+  }
+  return ERR_OK;
+}
+
+/**
+  * @brief  Enables or disables hardware L3/L4 receive filtering
+  * @param  enable: 0 passes every IP packet again
+  * @retval None
+  * @note   Call with the lwIP core lock held.
+  */
+void ethernetif_enable_rx_filter(uint8_t enable)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  if (enable != 0U)
+  {
+    HAL_ETHEx_EnableL3L4Filtering(&heth);
+  }
+  else
+  {
+    HAL_ETHEx_DisableL3L4Filtering(&heth);
+  }
+}
+
+#if ETHIF_UDP_FAST
+static err_t ethernetif_udp_fast_add(uint16_t port, EthIfUdpFastFn fn, osMessageQueueId_t queue, void *arg)
+{
+  UdpFastPort_t *slot = NULL;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  if (port == 0U)
+  {
+    return ERR_ARG;
+  }
+  for (uint32_t i = 0U; i < ETHIF_UDP_FAST_PORTS; i++)
+  {
+    if (UdpFastPorts[i].port == port)
+    {
+      return ERR_USE;
+    }
+    if ((slot == NULL) && (UdpFastPorts[i].port == 0U))
+    {
+      slot = &UdpFastPorts[i];
+    }
+  }
+  if (slot == NULL)
+  {
+    return ERR_MEM;
+  }
+  slot->fn = fn;
+  slot->queue = queue;
+  slot->arg = arg;
+  __DMB();
+  slot->port = port;
+  UdpFastCnt = UdpFastCnt + 1U;
+  return ERR_OK;
+}
+
+/**
+  * @brief  Delivers the datagrams for a local UDP port to a handler
+  * @param  port: local port, host byte order
+  * @param  fn: called on the EthIf task for each datagram, owns p
+  * @param  arg: passed to fn
+  * @retval ERR_OK, ERR_ARG for port 0 or no fn, ERR_USE if the port is
+  *         taken, ERR_MEM with ETHIF_UDP_FAST_PORTS ports registered
+  * @note   Call with the lwIP core lock held. A udp_bind() to the same
+  *         port no longer receives anything.
+  */
+err_t ethernetif_udp_fast_register(uint16_t port, EthIfUdpFastFn fn, void *arg)
+{
+  if (fn == NULL)
+  {
+    return ERR_ARG;
+  }
+  return ethernetif_udp_fast_add(port, fn, NULL, arg);
+}
+
+/**
+  * @brief  Posts the datagrams for a local UDP port to a message queue
+  * @param  port: local port, host byte order
+  * @param  queue: elements of sizeof(EthIfUdpFastMsgTypeDef); a datagram
+  *         finding it full is dropped and counted (udp_fast_drops)
+  * @retval as ethernetif_udp_fast_register()
+  * @note   Call with the lwIP core lock held.
+  */
+err_t ethernetif_udp_fast_queue(uint16_t port, osMessageQueueId_t queue)
+{
+  if (queue == NULL)
+  {
+    return ERR_ARG;
+  }
+  return ethernetif_udp_fast_add(port, NULL, queue, NULL);
+}
+
+/**
+  * @brief  Returns a fast path port to lwIP
+  * @param  port: local port, host byte order
+  * @retval None
+  * @note   Call with the lwIP core lock held. A datagram being handed over
+  *         at that moment may still reach the old handler or queue.
+  */
+void ethernetif_udp_fast_unregister(uint16_t port)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  for (uint32_t i = 0U; (port != 0U) && (i < ETHIF_UDP_FAST_PORTS); i++)
+  {
+    if (UdpFastPorts[i].port == port)
+    {
+      UdpFastPorts[i].port = 0U;
+      UdpFastCnt = UdpFastCnt - 1U;
+      break;
+    }
+  }
+}
+#endif
+
+#if ETHIF_RX_STEER
+static err_t ethernetif_rx_steer_add(uint16_t type, uint16_t proto, EthIfRxSteerFn fn, osMessageQueueId_t queue,
+                                     void *arg)
+{
+  RxSteerRule_t *slot = NULL;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  if ((type == 0U) || ((proto > 0xFFU) && (proto != ETHIF_RX_STEER_ANY)))
+  {
+    return ERR_ARG;
+  }
+  type = lwip_htons(type);
+  for (uint32_t i = 0U; i < ETHIF_RX_STEER_RULES; i++)
+  {
+    if ((RxSteerRules[i].type == type) && (RxSteerRules[i].proto == proto))
+    {
+      return ERR_USE;
+    }
+    if ((slot == NULL) && (RxSteerRules[i].type == 0U))
+    {
+      slot = &RxSteerRules[i];
+    }
+  }
+  if (slot == NULL)
+  {
+    return ERR_MEM;
+  }
+  slot->proto = proto;
+  slot->fn = fn;
+  slot->queue = queue;
+  slot->arg = arg;
+  __DMB();
+  slot->type = type;
+  RxSteerCnt = RxSteerCnt + 1U;
+  return ERR_OK;
+}
+
+/**
+  * @brief  Delivers the frames of an EtherType (and IP protocol) to a handler
+  * @param  type: EtherType, host byte order
+  * @param  proto: IP protocol or IPv6 next header, ETHIF_RX_STEER_ANY for all
+  * @param  fn: called on the EthIf task for each frame, owns p
+  * @param  arg: passed to fn
+  * @retval ERR_OK, ERR_ARG for type 0, a bad proto or no fn, ERR_USE if the
+  *         rule exists, ERR_MEM with ETHIF_RX_STEER_RULES rules registered
+  * @note   Call with the lwIP core lock held. A rule for one protocol
+  *         goes before a rule for ETHIF_RX_STEER_ANY of the same EtherType.
+  */
+err_t ethernetif_rx_steer_register(uint16_t type, uint16_t proto, EthIfRxSteerFn fn, void *arg)
+{
+  if (fn == NULL)
+  {
+    return ERR_ARG;
+  }
+  return ethernetif_rx_steer_add(type, proto, fn, NULL, arg);
+}
+
+/**
+  * @brief  Posts the frames of an EtherType (and IP protocol) to a queue
+  * @param  type: EtherType, host byte order
+  * @param  proto: IP protocol or IPv6 next header, ETHIF_RX_STEER_ANY for all
+  * @param  queue: elements of sizeof(struct pbuf *); a frame finding it
+  *         full is dropped and counted (steer_drops)
+  * @retval as ethernetif_rx_steer_register()
+  * @note   Call with the lwIP core lock held.
+  */
+err_t ethernetif_rx_steer_queue(uint16_t type, uint16_t proto, osMessageQueueId_t queue)
+{
+  if (queue == NULL)
+  {
+    return ERR_ARG;
+  }
+  return ethernetif_rx_steer_add(type, proto, NULL, queue, NULL);
+}
+
+/**
+  * @brief  Returns the frames of a steering rule to lwIP
+  * @param  type: EtherType, host byte order
+  * @param  proto: as registered
+  * @retval None
+  * @note   Call with the lwIP core lock held. A frame being handed over at
+  *         that moment may still reach the old handler or queue.
+  */
+void ethernetif_rx_steer_unregister(uint16_t type, uint16_t proto)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  type = lwip_htons(type);
+  for (uint32_t i = 0U; (type != 0U) && (i < ETHIF_RX_STEER_RULES); i++)
+  {
+    if ((RxSteerRules[i].type == type) && (RxSteerRules[i].proto == proto))
+    {
+      RxSteerRules[i].type = 0U;
+      RxSteerCnt = RxSteerCnt - 1U;
+      break;
+    }
+  }
+}
+#endif
+
+#if ETHIF_RAW
+/**
+  * @brief  Sends a whole Ethernet frame past lwIP
+  * @param  p: the frame from the Ethernet header, at most ETHIF_MTU + 14
+  *         bytes; still the caller's afterwards
+  * @param  cls: transmit class
+  * @retval ERR_OK, ERR_ARG for a bad frame or class, ERR_IF without a netif
+  *         or link, ERR_MEM with the class queue full, as low_level_output()
+  * @note   Any task, not holding the lwIP core lock.
+  */
+err_t ethernetif_raw_send(struct pbuf *p, EthIfTxClassTypeDef cls)
+{
+  err_t err;
+
+  if ((p == NULL) || (p->len < SIZEOF_ETH_HDR) || (p->tot_len > (ETHIF_MTU + SIZEOF_ETH_HDR)) ||
+      ((uint32_t)cls >= ETHIF_TX_CLASS_CNT))
+  {
+    return ERR_ARG;
+  }
+  p->meta_class = (u8_t)cls;
+  p->meta_flags |= ETHIF_META_CLASS;
+
+  LOCK_TCPIP_CORE();
+  struct netif *netif = netif_default;
+  if ((netif == NULL) || !netif_is_up(netif) || !netif_is_link_up(netif))
+  {
+    err = ERR_IF;
+  }
+  else
+  {
+    err = netif->linkoutput(netif, p);
+  }
+  UNLOCK_TCPIP_CORE();
+  return err;
+}
+
+/**
+  * @brief  Sends len bytes of data to dst as one frame of EtherType type
+  * @param  dst: destination MAC
+  * @param  type: EtherType, host byte order
+  * @param  data: payload, copied
+  * @param  len: payload bytes, at most ETHIF_MTU
+  * @param  cls: transmit class
+  * @retval as ethernetif_raw_send(), ERR_MEM without a PBUF_RAM buffer
+  * @note   Any task, not holding the lwIP core lock.
+  */
+err_t ethernetif_raw_sendto(const uint8_t dst[6], uint16_t type, const void *data, uint16_t len,
+                            EthIfTxClassTypeDef cls)
+{
+  struct netif *netif = netif_default;
+
+  if ((dst == NULL) || ((data == NULL) && (len != 0U)) || (len > ETHIF_MTU))
+  {
+    return ERR_ARG;
+  }
+  if (netif == NULL)
+  {
+    return ERR_IF;
+  }
+
+  struct pbuf *p = pbuf_alloc(PBUF_RAW, (u16_t)(SIZEOF_ETH_HDR + len), PBUF_RAM);
+  if (p == NULL)
+  {
+    return ERR_MEM;
+  }
+  struct eth_hdr *eth = (struct eth_hdr *)p->payload;
+  memcpy(&eth->dest, dst, ETH_HWADDR_LEN);
+  memcpy(&eth->src, netif->hwaddr, ETH_HWADDR_LEN);
+  eth->type = lwip_htons(type);
+  if (len != 0U)
+  {
+    memcpy((uint8_t *)p->payload + SIZEOF_ETH_HDR, data, len);
+  }
+
+  err_t err = ethernetif_raw_send(p, cls);
+  pbuf_free(p);
+  return err;
+}
+#endif /* ETHIF_RAW */
+
+/**
+  * @brief  Returns one of the predefined DMA and MTL profiles
+  * @param  id: which
+  * @param  prof: destination
+  * @retval ERR_OK, ERR_ARG for an unknown id
+  */
+err_t ethernetif_dma_profile_preset(EthIfDmaProfileIdTypeDef id, EthIfDmaProfileTypeDef *prof)
+{
+  if (((uint32_t)id >= ETHIF_DMA_PROFILE_CNT) || (prof == NULL))
+  {
+    return ERR_ARG;
+  }
+  *prof = DmaProfiles[id];
+  return ERR_OK;
+}
+
+/**
+  * @brief  Switches the DMA and the MTL FIFOs to a profile
+  * @param  prof: burst lengths, OSF and FIFO modes; copied
+  * @retval ERR_OK, ERR_ARG for a value the hardware does not have,
+  *         ERR_INPROGRESS during a generator or loopback run
+  * @note   Any task, not holding the lwIP core lock. A running MAC is
+  *         stopped for the change: queued frames are dropped as on a link
+  *         change, frames given to the DMA get ETHIF_DMA_PROFILE_DRAIN_MS.
+  */
+err_t ethernetif_dma_profile_set(const EthIfDmaProfileTypeDef *prof)
+{
+  if (!ethernetif_dma_profile_valid(prof))
+  {
+    return ERR_ARG;
+  }
+
+  LOCK_TCPIP_CORE();
+#if ETHIF_PKTGEN
+  if ((PktgenStats.running != 0U)
+#if ETHIF_RX_STEER
+      || (LoopbackActive != 0U)
+#endif
+     )
+  {
+    UNLOCK_TCPIP_CORE();
+    return ERR_INPROGRESS;
+  }
+#endif
+  uint8_t started = (heth.gState == HAL_ETH_STATE_STARTED) ? 1U : 0U;
+  if (started != 0U)
+  {
+#if ETHIF_TX_QUEUE
+    ethernetif_tx_flush();
+#endif
+    uint32_t t0 = HAL_GetTick();
+    while ((heth.TxDescList.BuffersInUse != 0U) && ((HAL_GetTick() - t0) < ETHIF_DMA_PROFILE_DRAIN_MS))
+    {
+      HAL_ETH_ReleaseTxPacket(&heth);
+    }
+    HAL_ETH_Stop_IT(&heth);
+    ethernetif_tx_reclaim();
+  }
+  ethernetif_dma_profile_apply(prof);
+  if (started != 0U)
+  {
+    HAL_ETH_Start_IT(&heth);
+  }
+  UNLOCK_TCPIP_CORE();
+  return ERR_OK;
+}
+
+/**
+  * @brief  Reads the DMA and MTL settings back as a profile
+  * @param  prof: destination
+  * @retval None
+  */
+void ethernetif_dma_profile_get(EthIfDmaProfileTypeDef *prof)
+{
+  ETH_DMAConfigTypeDef dma;
+  ETH_MACConfigTypeDef mac;
+
+  if (prof == NULL)
+  {
+    return;
+  }
+  HAL_ETH_GetDMAConfig(&heth, &dma);
+  HAL_ETH_GetMACConfig(&heth, &mac);
+  memset(prof, 0, sizeof(*prof));
+  prof->tx_pbl = (uint8_t)(dma.TxDMABurstLength >> ETH_DMACTCR_TPBL_Pos);
+  prof->rx_pbl = (uint8_t)(dma.RxDMABurstLength >> ETH_DMACRCR_RPBL_Pos);
+  prof->pbl_x8 = (dma.PBLx8Mode == ENABLE) ? 1U : 0U;
+  prof->fixed_burst = (dma.BurstMode == ETH_BURSTLENGTH_FIXED) ? 1U : 0U;
+  prof->aligned_beats = (dma.AddressAlignedBeats == ENABLE) ? 1U : 0U;
+  prof->osf = (dma.SecondPacketOperate == ENABLE) ? 1U : 0U;
+  for (uint32_t i = 0U; i < sizeof(DmaTxThresholdMode) / sizeof(DmaTxThresholdMode[0]); i++)
+  {
+    if ((mac.TransmitQueueMode != ETH_TRANSMITSTOREFORWARD) && (mac.TransmitQueueMode == DmaTxThresholdMode[i]))
+    {
+      prof->tx_threshold = DmaTxThreshold[i];
+    }
+  }
+  for (uint32_t i = 0U; i < sizeof(DmaRxThresholdMode) / sizeof(DmaRxThresholdMode[0]); i++)
+  {
+    if ((mac.ReceiveQueueMode != ETH_RECEIVESTOREFORWARD) && (mac.ReceiveQueueMode == DmaRxThresholdMode[i]))
+    {
+      prof->rx_threshold = DmaRxThreshold[i];
+    }
+  }
+}
+
+#if ETHIF_PKTGEN
+/* ETH_CODE: the DMA is done with a generator frame */
+static void ethernetif_pktgen_free(struct pbuf *p)
+{
+  PktgenBuff_t *b = (PktgenBuff_t *)p;
+
+  if (b->state == 2U)
+  {
+    PktgenStats.completed++;
+  }
+  b->state = 0U;
+}
+
+/* ETH_CODE: rate mode tick */
+static void ethernetif_pktgen_timer(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+  PktgenTimer = 0U;
+  ethernetif_pktgen_fill();
+}
+
+/* ETH_CODE: end of a run, by count, error or ethernetif_pktgen_stop().
+ * Frames still in the ring complete later. Core lock. */
+static void ethernetif_pktgen_end(const char *why)
+{
+  PktgenStats.running = 0U;
+  PktgenStats.elapsed_ms = HAL_GetTick() - PktgenStart;
+  if (PktgenTimer != 0U)
+  {
+    sys_untimeout(ethernetif_pktgen_timer, NULL);
+    PktgenTimer = 0U;
+  }
+
+  uint32_t ms = (PktgenStats.elapsed_ms != 0U) ? PktgenStats.elapsed_ms : 1U;
+  LOG_INFO("ETH", "pktgen %s: len %u sent %lu in %lu ms, %lu fps %lu Mbit/s, ring full %lu, echoed %lu lost %lu",
+           why, PktgenCfg.len, (unsigned long)PktgenStats.sent, (unsigned long)PktgenStats.elapsed_ms,
+           (unsigned long)((uint64_t)PktgenStats.sent * 1000U / ms),
+           (unsigned long)(PktgenStats.bytes * 8U / 1000U / ms), (unsigned long)PktgenStats.ring_full,
+           (unsigned long)PktgenStats.echoed, (unsigned long)PktgenStats.echo_lost);
+}
+
+/* ETH_CODE: hand generator frames to free descriptors, as many as the rate
+ * allows by now, the buffers hold and the ring takes. Called after each
+ * TX completion refill and, with a rate, every millisecond. Stack frames
+ * waiting in the TX queues go first. Core lock. */
+static void ethernetif_pktgen_fill(void)
+{
+  if (PktgenStats.running == 0U)
+  {
+    return;
+  }
+
+  uint32_t due = UINT32_MAX;
+  if (PktgenCfg.rate_pps != 0U)
+  {
+    due = (uint32_t)((uint64_t)PktgenCfg.rate_pps * (HAL_GetTick() - PktgenStart) / 1000U) + 1U;
+  }
+  if ((PktgenCfg.count != 0U) && (due > PktgenCfg.count))
+  {
+    due = PktgenCfg.count;
+  }
+
+#if ETHIF_TX_BATCH
+  uint8_t batch = TxBatch;
+  TxBatch = 1U;
+#endif
+  while ((PktgenStats.sent < due) && (TxQueued == 0U) && !ethernetif_tx_held())
+  {
+    /* Buffers complete in submission order: the next one is the oldest */
+    PktgenBuff_t *b = &PktgenBuff[PktgenStats.sent % ETHIF_PKTGEN_BUFS];
+    if (b->state != 0U)
+    {
+      break;
+    }
+    b->state = 1U;
+    b->pbuf_custom.custom_free_function = ethernetif_pktgen_free;
+    struct pbuf *p = pbuf_alloced_custom(PBUF_RAW, PktgenCfg.len, PBUF_RAM, &b->pbuf_custom,
+                                         b->buff, sizeof(b->buff));
+    uint32_t seq = lwip_htonl(PktgenStats.sent);
+    memcpy(&b->buff[PKTGEN_SEQ_OFS], &seq, sizeof(seq));
+    uint32_t stamp = DWT->CYCCNT;
+    memcpy(&b->buff[PKTGEN_STAMP_OFS], &stamp, sizeof(stamp));
+
+    err_t err = ethernetif_tx_submit(p, ETHIF_TX_CLASS_BULK);
+    if (err == ERR_OK)
+    {
+      b->state = 2U;
+      PktgenStats.sent++;
+      PktgenStats.bytes += PktgenCfg.len;
+      continue;
+    }
+    pbuf_free(p);
+    if (err == ERR_BUF)
+    {
+      PktgenStats.ring_full++;
+      break;
+    }
+    ethernetif_pktgen_end("tx error");
+    break;
+  }
+#if ETHIF_TX_BATCH
+  TxBatch = batch;
+  if (batch == 0U)
+  {
+    ethernetif_tx_ring();
+  }
+#endif
+
+  if ((PktgenStats.running != 0U) && (PktgenCfg.count != 0U) && (PktgenStats.sent >= PktgenCfg.count))
+  {
+    ethernetif_pktgen_end("done");
+  }
+  if ((PktgenStats.running != 0U) && (PktgenCfg.rate_pps != 0U) && (PktgenTimer == 0U))
+  {
+    sys_timeout(1U, ethernetif_pktgen_timer, NULL);
+    PktgenTimer = 1U;
+  }
+}
+
+#if ETHIF_RX_STEER
+/* ETH_CODE: a generator frame came back. EthIf task. */
+static void ethernetif_pktgen_echo(struct pbuf *p, void *arg)
+{
+  uint32_t hdr[3];
+
+  LWIP_UNUSED_ARG(arg);
+  if (pbuf_copy_partial(p, hdr, sizeof(hdr), SIZEOF_ETH_HDR) == sizeof(hdr) &&
+      (hdr[0] == PP_HTONL(PKTGEN_MAGIC)))
+  {
+    uint32_t seq = lwip_ntohl(hdr[1]);
+    if ((int32_t)(seq - PktgenEchoNext) >= 0)
+    {
+      PktgenStats.echo_lost += seq - PktgenEchoNext;
+      PktgenEchoNext = seq + 1U;
+      PktgenStats.echoed++;
+      /* The frame's way through both FIFOs, the wire or the PHY loop */
+      uint32_t lat = p->meta_stamp - hdr[2];
+      PktgenLatSum += lat;
+      PktgenLatMin = (lat < PktgenLatMin) ? lat : PktgenLatMin;
+      PktgenLatMax = (lat > PktgenLatMax) ? lat : PktgenLatMax;
+    }
+    else
+    {
+      PktgenStats.echo_late++;
+    }
+  }
+  pbuf_free(p);
+}
+#endif
+
+/**
+  * @brief  Starts the traffic generator
+  * @param  cfg: destination, frame length, rate and count; copied
+  * @retval ERR_OK, ERR_ARG for a bad length, ERR_INPROGRESS while a run
+  *         is going on or its frames are still in the ring, ERR_IF without
+  *         a netif or with the MAC stopped
+  * @note   Any task, not holding the lwIP core lock. The frames bypass
+  *         lwIP; only queued stack frames are served first.
+  */
+err_t ethernetif_pktgen_start(const EthIfPktgenConfigTypeDef *cfg)
+{
+  if ((cfg == NULL) || (cfg->len < PKTGEN_LEN_MIN) || (cfg->len > PKTGEN_LEN_MAX))
+  {
+    return ERR_ARG;
+  }
+
+  err_t err = ERR_OK;
+  LOCK_TCPIP_CORE();
+  struct netif *netif = netif_default;
+  if ((netif == NULL) || (heth.gState != HAL_ETH_STATE_STARTED))
+  {
+    err = ERR_IF;
+  }
+  for (uint32_t i = 0U; (err == ERR_OK) && (i < ETHIF_PKTGEN_BUFS); i++)
+  {
+    if ((PktgenStats.running != 0U) || (PktgenBuff[i].state != 0U))
+    {
+      err = ERR_INPROGRESS;
+    }
+  }
+  if (err == ERR_OK)
+  {
+#if ETHIF_RX_STEER
+    err_t reg = ethernetif_rx_steer_register(ETHIF_PKTGEN_TYPE, ETHIF_RX_STEER_ANY, ethernetif_pktgen_echo, NULL);
+    LWIP_UNUSED_ARG(reg);   /* ERR_USE from an earlier run */
+#endif
+    PktgenCfg = *cfg;
+    for (uint32_t i = 0U; i < ETHIF_PKTGEN_BUFS; i++)
+    {
+      uint8_t *f = PktgenBuff[i].buff;
+      uint32_t magic = PP_HTONL(PKTGEN_MAGIC);
+      uint16_t type = PP_HTONS(ETHIF_PKTGEN_TYPE);
+      memset(f, 0, PktgenCfg.len);
+      memcpy(&f[0], PktgenCfg.dst, ETH_HWADDR_LEN);
+      memcpy(&f[ETH_HWADDR_LEN], netif->hwaddr, ETH_HWADDR_LEN);
+      memcpy(&f[2U * ETH_HWADDR_LEN], &type, sizeof(type));
+      memcpy(&f[SIZEOF_ETH_HDR], &magic, sizeof(magic));
+    }
+    memset(&PktgenStats, 0, sizeof(PktgenStats));
+    PktgenEchoNext = 0U;
+    PktgenLatSum = 0U;
+    PktgenLatMin = UINT32_MAX;
+    PktgenLatMax = 0U;
+    PktgenStart = HAL_GetTick();
+    PktgenStats.running = 1U;
+    ethernetif_pktgen_fill();
+  }
+  UNLOCK_TCPIP_CORE();
+  return err;
+}
+
+/**
+  * @brief  Stops the traffic generator and logs the run
+  * @retval None
+  * @note   Any task, not holding the lwIP core lock.
+  */
+void ethernetif_pktgen_stop(void)
+{
+  LOCK_TCPIP_CORE();
+  if (PktgenStats.running != 0U)
+  {
+    ethernetif_pktgen_end("stopped");
+  }
+  UNLOCK_TCPIP_CORE();
+}
+
+/**
+  * @brief  Returns a snapshot of the traffic generator counters
+  * @param  stats: destination
+  * @retval None
+  */
+void ethernetif_pktgen_get_stats(EthIfPktgenStatsTypeDef *stats)
+{
+  if (stats != NULL)
+  {
+    *stats = PktgenStats;
+    if (stats->running != 0U)
+    {
+      stats->elapsed_ms = HAL_GetTick() - PktgenStart;
+    }
+    if (stats->echoed != 0U)
+    {
+      uint32_t mhz = SystemCoreClock / 1000000U;
+      stats->echo_lat_min_ns = (uint32_t)((uint64_t)PktgenLatMin * 1000U / mhz);
+      stats->echo_lat_avg_ns = (uint32_t)(PktgenLatSum * 1000U / stats->echoed / mhz);
+      stats->echo_lat_max_ns = (uint32_t)((uint64_t)PktgenLatMax * 1000U / mhz);
+    }
+  }
+}
+
+#if ETHIF_RX_STEER
+/**
+  * @brief  Measures the driver's frame rate with the PHY in loopback
+  * @param  len: frame length, as for ethernetif_pktgen_start()
+  * @param  ms: length of the run
+  * @param  rate_pps: frames per second, 0 as fast as the ring takes them
+  * @param  res: results
+  * @retval ERR_OK, or the error of ethernetif_pktgen_start(); ERR_INPROGRESS
+  *         while another run is going on
+  * @note   Blocks for the run, from a task not holding the lwIP core lock
+  *         (not the link thread). The link is cut for the run: the PHY
+  *         sends nothing to the wire, and frames of the stack loop back to
+  *         it too. A stopped MAC is started at 100 Mbit/s full duplex and
+  *         stopped again afterwards. The result is logged with the driver
+  *         options it depends on, one build per configuration.
+  */
+err_t ethernetif_loopback_bench(uint16_t len, uint32_t ms, uint32_t rate_pps, EthIfLoopbackResultTypeDef *res)
+{
+  EthIfPktgenConfigTypeDef cfg = {0};
+  EthIfPktgenStatsTypeDef st;
+  EthIfDmaProfileTypeDef prof;
+  uint8_t started;
+  err_t err = ERR_OK;
+
+  if ((res == NULL) || (ms == 0U))
+  {
+    return ERR_ARG;
+  }
+  memset(res, 0, sizeof(*res));
+
+  LOCK_TCPIP_CORE();
+  started = (heth.gState == HAL_ETH_STATE_STARTED) ? 1U : 0U;
+  if ((LoopbackActive != 0U) || (PktgenStats.running != 0U))
+  {
+    err = ERR_INPROGRESS;
+  }
+  else if (netif_default == NULL)
+  {
+    err = ERR_IF;
+  }
+  else
+  {
+    LoopbackActive = 1U;
+    memcpy(cfg.dst, netif_default->hwaddr, ETH_HWADDR_LEN);
+    if (started == 0U)
+    {
+      ETH_MACConfigTypeDef mac;
+      HAL_ETH_GetMACConfig(&heth, &mac);
+      mac.DuplexMode = ETH_FULLDUPLEX_MODE;
+      mac.Speed = ETH_SPEED_100M;
+      HAL_ETH_SetMACConfig(&heth, &mac);
+      HAL_ETH_Start_IT(&heth);
+    }
+  }
+  UNLOCK_TCPIP_CORE();
+  if (err != ERR_OK)
+  {
+    return err;
+  }
+
+  (void)LAN8742_EnableLoopbackMode(&LAN8742);
+  osDelay(ETHIF_LOOPBACK_SETTLE_MS);
+
+  cfg.len = len;
+  cfg.rate_pps = rate_pps;
+  uint32_t idle0 = ulTaskGetIdleRunTimeCounter();
+  uint32_t total0 = portGET_RUN_TIME_COUNTER_VALUE();
+  uint32_t cyc0 = DWT->CYCCNT;
+  err = ethernetif_pktgen_start(&cfg);
+  if (err == ERR_OK)
+  {
+    osDelay(ms);
+    ethernetif_pktgen_stop();
+    uint32_t cyc = DWT->CYCCNT - cyc0;
+    uint32_t total = portGET_RUN_TIME_COUNTER_VALUE() - total0;
+    uint32_t idle = ulTaskGetIdleRunTimeCounter() - idle0;
+    /* Frames still in flight come back */
+    osDelay(2U);
+    ethernetif_pktgen_get_stats(&st);
+
+    uint64_t busy = (total != 0U) ? (uint64_t)cyc * (total - ((idle < total) ? idle : total)) / total : cyc;
+    res->sent = st.sent;
+    res->received = st.echoed;
+    res->elapsed_ms = (st.elapsed_ms != 0U) ? st.elapsed_ms : 1U;
+    res->fps = (uint32_t)((uint64_t)st.echoed * 1000U / res->elapsed_ms);
+    res->cpu_permille = (total != 0U) ? (uint32_t)(busy * 1000U / ((cyc != 0U) ? cyc : 1U)) : 0U;
+    res->cycles_per_frame = (st.echoed != 0U) ? (uint32_t)(busy / st.echoed) : 0U;
+    res->lat_min_ns = st.echo_lat_min_ns;
+    res->lat_avg_ns = st.echo_lat_avg_ns;
+    res->lat_max_ns = st.echo_lat_max_ns;
+  }
+
+  (void)LAN8742_DisableLoopbackMode(&LAN8742);
+  LOCK_TCPIP_CORE();
+  if (started == 0U)
+  {
+    HAL_ETH_Stop_IT(&heth);
+    ethernetif_tx_reclaim();
+    ethernetif_tx_flush();
+  }
+  LoopbackActive = 0U;
+  UNLOCK_TCPIP_CORE();
+
+  if (err == ERR_OK)
+  {
+    LOG_INFO("ETH", "loopback len %u rate %lu sent %lu received %lu: %lu fps, cpu %lu.%lu%%, %lu cycles/frame, "
+             "latency %lu/%lu/%lu ns", len, (unsigned long)rate_pps, (unsigned long)res->sent,
+             (unsigned long)res->received, (unsigned long)res->fps,
+             (unsigned long)(res->cpu_permille / 10U), (unsigned long)(res->cpu_permille % 10U),
+             (unsigned long)res->cycles_per_frame, (unsigned long)res->lat_min_ns, (unsigned long)res->lat_avg_ns,
+             (unsigned long)res->lat_max_ns);
+    ethernetif_dma_profile_get(&prof);
+    LOG_INFO("ETH", "loopback dma pbl %u/%u x8 %u fixed %u aal %u osf %u fifo tx %u rx %u", prof.tx_pbl, prof.rx_pbl,
+             prof.pbl_x8, prof.fixed_burst, prof.aligned_beats, prof.osf, prof.tx_threshold, prof.rx_threshold);
+    LOG_INFO("ETH", "loopback config notify %d rx_poll %d rx_batch %d rx_inline %d rx_direct %d rx_copy %lu "
+             "tx_sched %d tx_batch %d lean_dma %d",
+             ETHIF_TASK_NOTIFY, ETHIF_RX_POLL, ETHIF_RX_BATCH, ETHIF_RX_INLINE, ETHIF_RX_DIRECT,
+             (unsigned long)ETHIF_RX_COPY_MAX, ETHIF_TX_SCHED, ETHIF_TX_BATCH, ETHIF_LEAN_DMA);
+  }
+  return err;
+}
+#endif /* ETHIF_RX_STEER */
+#endif /* ETHIF_PKTGEN */
+
+#if LWIP_IGMP || (LWIP_IPV6 && LWIP_IPV6_MLD)
+/* ETH_CODE: pass multicast frames through the hash filter only (unicast
+ * stays on perfect filtering), starting from an empty table. */
+static void ethernetif_mcast_init(void)
+{
+  ETH_MACFilterConfigTypeDef filter;
+
+  HAL_ETH_SetHashTable(&heth, McastHashTable);
+  HAL_ETH_GetMACFilterConfig(&heth, &filter);
+  filter.HashMulticast = ENABLE;
+  filter.PassAllMulticast = DISABLE;
+  HAL_ETH_SetMACFilterConfig(&heth, &filter);
+}
+
+/* Bin of a destination MAC: upper 6 bits of the bit-reversed, inverted
+ * CRC-32 (IEEE 802.3) of the address. */
+static uint32_t ethernetif_mcast_bin(const uint8_t *mac)
+{
+  uint32_t crc = 0xFFFFFFFFU;
+
+  for (uint32_t i = 0U; i < ETH_HWADDR_LEN; i++)
+  {
+    crc ^= mac[i];
+    for (uint32_t b = 0U; b < 8U; b++)
+    {
+      crc = (crc >> 1) ^ (((crc & 1U) != 0U) ? 0xEDB88320U : 0U);
+    }
+  }
+  return __RBIT(~crc) >> 26;
+}
+
+static void ethernetif_mcast_update(const uint8_t *mac, enum netif_mac_filter_action action)
+{
+  uint32_t bin = ethernetif_mcast_bin(mac);
+  uint32_t bit = 1UL << (bin & 31U);
+
+  if (action == NETIF_ADD_MAC_FILTER)
+  {
+    if (McastHashRefs[bin]++ == 0U)
+    {
+      McastHashTable[bin >> 5] |= bit;
+    }
+  }
+  else if (McastHashRefs[bin] != 0U)
+  {
+    if (--McastHashRefs[bin] == 0U)
+    {
+      McastHashTable[bin >> 5] &= ~bit;
+    }
+  }
+  HAL_ETH_SetHashTable(&heth, McastHashTable);
+}
+#endif
+
+#if LWIP_IGMP
+/* ETH_CODE: netif->igmp_mac_filter, 01:00:5e + low 23 bits of the group */
+static err_t ethernetif_igmp_mac_filter(struct netif *netif, const ip4_addr_t *group,
+                                        enum netif_mac_filter_action action)
+{
+  uint32_t addr = lwip_ntohl(ip4_addr_get_u32(group));
+  uint8_t mac[ETH_HWADDR_LEN] = {0x01U, 0x00U, 0x5EU,
+                                 (uint8_t)((addr >> 16) & 0x7FU), (uint8_t)(addr >> 8), (uint8_t)addr};
+
+  LWIP_UNUSED_ARG(netif);
+  ethernetif_mcast_update(mac, action);
+  return ERR_OK;
+}
+#endif
+
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+/* ETH_CODE: netif->mld_mac_filter, 33:33 + low 32 bits of the group */
+static err_t ethernetif_mld_mac_filter(struct netif *netif, const ip6_addr_t *group,
+                                       enum netif_mac_filter_action action)
+{
+  uint32_t addr = lwip_ntohl(group->addr[3]);
+  uint8_t mac[ETH_HWADDR_LEN] = {0x33U, 0x33U, (uint8_t)(addr >> 24), (uint8_t)(addr >> 16),
+                                 (uint8_t)(addr >> 8), (uint8_t)addr};
+
+  LWIP_UNUSED_ARG(netif);
+  ethernetif_mcast_update(mac, action);
+  return ERR_OK;
+}
+#endif
+
+#if ETHIF_PHY_IT
+/**
+  * @brief  EXTI line detection callback, PHY nINT
+  * @param  GPIO_Pin: pin that triggered
+  * @retval None
+  */
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+  if ((GPIO_Pin == ETHIF_PHY_IT_Pin) && (PhyItSemaphore != NULL))
+  {
+    osSemaphoreRelease(PhyItSemaphore);
+  }
+}
+#endif
+
+#if ETHIF_PTP
+/* ETH_CODE: fine update, digital rollover, V2 event messages over
+ * Ethernet and IPv4/UDP as a slave (Sync received, Delay_Req sent). The
+ * accumulator runs at twice the nominal increment rate so that the addend
+ * has headroom for +/- frequency corrections. */
+static void ethernetif_ptp_init(void)
+{
+  ETH_PTP_ConfigTypeDef ptp = {0};
+  uint32_t hclk = HAL_RCC_GetHCLKFreq();
+  uint32_t ssinc = (2000000000U + hclk - 1U) / hclk;
+
+  PtpAddendBase = (uint32_t)(((1000000000ULL / ssinc) << 32) / hclk);
+
+  ptp.Timestamp = ETH_MACTSCR_TSENA;
+  ptp.TimestampUpdateMode = ENABLE;
+  ptp.TimestampAddendUpdate = ENABLE;
+  ptp.TimestampRolloverMode = ENABLE;
+  ptp.TimestampV2 = ENABLE;
+  ptp.TimestampEthernet = ENABLE;
+  ptp.TimestampIPv4 = ENABLE;
+  ptp.TimestampEvent = ENABLE;
+  ptp.TimestampAddend = PtpAddendBase;
+  ptp.TimestampSubsecondInc = ssinc << ETH_MACMACSSIR_SSINC_Pos;
+  HAL_ETH_PTP_SetConfig(&heth, &ptp);
+}
+
+/* A previous step must have completed before the next one is requested. */
+static err_t ethernetif_ptp_wait(uint32_t bit)
+{
+  uint32_t tickstart = HAL_GetTick();
+
+  while (READ_BIT(heth.Instance->MACTSCR, bit) != 0U)
+  {
+    if ((HAL_GetTick() - tickstart) > 2U)
+    {
+      return ERR_TIMEOUT;
+    }
+  }
+  return ERR_OK;
+}
+
+/**
+  * @brief  Returns the receive timestamp of a frame from RX_POOL
+  * @param  p: first pbuf of the frame, as passed up by this driver
+  * @param  ts: destination
+  * @retval ERR_OK, ERR_VAL if p carries no timestamp
+  */
+err_t ethernetif_ptp_get_rx_timestamp(const struct pbuf *p, EthIfPtpTimeTypeDef *ts)
+{
+  const RxBuff_t *b = (const RxBuff_t *)p;
+
+  if ((p == NULL) || ((p->flags & PBUF_FLAG_IS_CUSTOM) == 0U) ||
+      (b->pbuf_custom.custom_free_function != pbuf_free_custom) || (b->ts_valid == 0U))
+  {
+    return ERR_VAL;
+  }
+  ts->sec = b->ts_sec;
+  ts->nsec = b->ts_nsec;
+  return ERR_OK;
+}
+
+/**
+  * @brief  Installs the transmit timestamp hook, NULL removes it
+  * @param  hook: see EthIfPtpTxHook
+  * @retval None
+  * @note   Call with the lwIP core lock held.
+  */
+void ethernetif_ptp_set_tx_hook(EthIfPtpTxHook hook)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  PtpTxHook = hook;
+}
+
+/**
+  * @brief  Tx PTP callback, from HAL_ETH_ReleaseTxPacket()
+  * @param  buff: pbuf passed as TxConfig.pData
+  * @param  timestamp: transmit time
+  * @retval None
+  */
+void HAL_ETH_TxPtpCallback(uint32_t *buff, ETH_TimeStampTypeDef *timestamp)
+{
+  struct pbuf *p = (struct pbuf *)buff;
+
+  if ((PtpTxHook != NULL) && ethernetif_ptp_tx_requested(p))
+  {
+    EthIfPtpTimeTypeDef ts = { timestamp->TimeStampHigh, timestamp->TimeStampLow };
+    PtpTxHook(p, &ts);
+  }
+}
+
+/**
+  * @brief  Reads the MAC system time
+  * @param  time: destination
+  * @retval ERR_OK, ERR_IF before PTP configuration
+  */
+err_t ethernetif_ptp_get_time(EthIfPtpTimeTypeDef *time)
+{
+  uint32_t sec;
+
+  do
+  {
+    sec = heth.Instance->MACSTSR;
+    time->nsec = heth.Instance->MACSTNR;
+    time->sec = heth.Instance->MACSTSR;
+  } while (time->sec != sec);
+  return (heth.IsPtpConfigured == HAL_ETH_PTP_CONFIGURED) ? ERR_OK : ERR_IF;
+}
+
+/**
+  * @brief  Steps the MAC system time to an absolute value
+  * @param  time: new time
+  * @retval ERR_OK, ERR_ARG, ERR_TIMEOUT or ERR_IF
+  */
+err_t ethernetif_ptp_set_time(const EthIfPtpTimeTypeDef *time)
+{
+  if (heth.IsPtpConfigured != HAL_ETH_PTP_CONFIGURED)
+  {
+    return ERR_IF;
+  }
+  if (time->nsec >= 1000000000U)
+  {
+    return ERR_ARG;
+  }
+  if (ethernetif_ptp_wait(ETH_MACTSCR_TSINIT | ETH_MACTSCR_TSUPDT) != ERR_OK)
+  {
+    return ERR_TIMEOUT;
+  }
+  /* TSINIT loads the update registers as the new time */
+  heth.Instance->MACSTSUR = time->sec;
+  heth.Instance->MACSTNUR = time->nsec;
+  SET_BIT(heth.Instance->MACTSCR, ETH_MACTSCR_TSINIT);
+  return ERR_OK;
+}
+
+/**
+  * @brief  Adds a signed offset to the MAC system time (servo step)
+  * @param  offset_ns: offset in nanoseconds
+  * @retval ERR_OK, ERR_TIMEOUT or ERR_IF
+  */
+err_t ethernetif_ptp_adjust_time(int64_t offset_ns)
+{
+  uint64_t mag = (offset_ns < 0) ? (uint64_t)(-offset_ns) : (uint64_t)offset_ns;
+  ETH_TimeTypeDef t = { (uint32_t)(mag / 1000000000ULL), (uint32_t)(mag % 1000000000ULL) };
+
+  if (ethernetif_ptp_wait(ETH_MACTSCR_TSINIT | ETH_MACTSCR_TSUPDT) != ERR_OK)
+  {
+    return ERR_TIMEOUT;
+  }
+  if (HAL_ETH_PTP_AddTimeOffset(&heth, (offset_ns < 0) ? HAL_ETH_PTP_NEGATIVE_UPDATE : HAL_ETH_PTP_POSITIVE_UPDATE,
+                                &t) != HAL_OK)
+  {
+    return ERR_IF;
+  }
+  return ERR_OK;
+}
+
+/**
+  * @brief  Sets the MAC clock rate relative to nominal (servo slew)
+  * @param  ppb: parts per billion, positive runs faster
+  * @retval ERR_OK, ERR_ARG, ERR_TIMEOUT or ERR_IF
+  */
+err_t ethernetif_ptp_adjust_freq(int32_t ppb)
+{
+  int64_t addend = (int64_t)PtpAddendBase + ((int64_t)PtpAddendBase * ppb) / 1000000000LL;
+
+  if (heth.IsPtpConfigured != HAL_ETH_PTP_CONFIGURED)
+  {
+    return ERR_IF;
+  }
+  if ((addend <= 0) || (addend > (int64_t)UINT32_MAX))
+  {
+    return ERR_ARG;
+  }
+  if (ethernetif_ptp_wait(ETH_MACTSCR_TSADDREG) != ERR_OK)
+  {
+    return ERR_TIMEOUT;
+  }
+  WRITE_REG(heth.Instance->MACTSAR, (uint32_t)addend);
+  SET_BIT(heth.Instance->MACTSCR, ETH_MACTSCR_TSADDREG);
+  return ERR_OK;
+}
+#endif
+
+#if ETHIF_ARP_OFFLOAD
+/* ETH_CODE: keep MACARPAR on the current IPv4 address; no address, no
+ * offload. Runs with the core lock held. */
+static void ethernetif_arp_offload_cb(struct netif *netif, netif_nsc_reason_t reason,
+                                      const netif_ext_callback_args_t *args)
+{
+  LWIP_UNUSED_ARG(args);
+  if ((netif != ArpOffloadNetif) ||
+      ((reason & (LWIP_NSC_NETIF_ADDED | LWIP_NSC_IPV4_ADDRESS_CHANGED | LWIP_NSC_IPV4_SETTINGS_CHANGED)) == 0U))
+  {
+    return;
+  }
+  if (ip4_addr_isany(netif_ip4_addr(netif)))
+  {
+    HAL_ETHEx_DisableARPOffload(&heth);
+    return;
+  }
+  HAL_ETHEx_SetARPAddressMatch(&heth, lwip_ntohl(ip4_addr_get_u32(netif_ip4_addr(netif))));
+  HAL_ETHEx_EnableARPOffload(&heth);
+}
+#endif
+
+#if ETHIF_VLAN
+_Static_assert((ETHIF_VLAN_VID >= 1U) && (ETHIF_VLAN_VID <= 4094U), "ETHIF_VLAN_VID out of range");
+_Static_assert(ETHIF_VLAN_PCP <= 7U, "ETHIF_VLAN_PCP out of range");
+
+/* ETH_CODE: one C-VLAN. The tag is inserted from MACVIR on transmit and
+ * always stripped on receive, with the stripped tag reported in RDES0. */
+static void ethernetif_vlan_init(void)
+{
+  ETH_RxVLANConfigTypeDef rxvlan = {0};
+  ETH_TxVLANConfigTypeDef txvlan = {0};
+
+  rxvlan.InnerVLANTagInStatus = DISABLE;
+  rxvlan.StripInnerVLANTag = ETH_INNERVLANTAGRXSTRIPPING_NONE;
+  rxvlan.InnerVLANTag = DISABLE;
+  rxvlan.DoubleVLANProcessing = DISABLE;
+  rxvlan.VLANTagHashTableMatch = DISABLE;
+  rxvlan.VLANTagInStatus = ENABLE;
+  rxvlan.StripVLANTag = ETH_VLANTAGRXSTRIPPING_ALWAYS;
+  rxvlan.VLANTypeCheck = ETH_VLANTYPECHECK_CVLAN;
+  rxvlan.VLANTagInverceMatch = DISABLE;
+  HAL_ETHEx_SetRxVLANConfig(&heth, &rxvlan);
+#if ETHIF_VLAN_FILTER
+  /* Perfect match on the 12-bit VID, any PCP/DEI. Untagged frames are not
+   * subject to the VLAN filter. */
+  MODIFY_REG(heth.Instance->MACVTR, ETH_MACVTR_ETV | ETH_MACVTR_VL, ETH_MACVTR_ETV | ETHIF_VLAN_VID);
+  HAL_ETHEx_EnableVLANProcessing(&heth);
+#endif
+
+  txvlan.SourceTxDesc = DISABLE;
+  txvlan.SVLANType = DISABLE;
+  txvlan.VLANTagControl = ETH_VLANTAGCONTROL_INSERT;
+  HAL_ETHEx_SetTxVLANConfig(&heth, ETH_OUTER_TX_VLANTAG, &txvlan);
+  HAL_ETHEx_SetTxVLANIdentifier(&heth, ETH_OUTER_TX_VLANTAG, (ETHIF_VLAN_PCP << 13) | ETHIF_VLAN_VID);
+}
+#endif
+
+#if ETHIF_EEE
+_Static_assert(((ETHIF_EEE_ENTRY_US % 8U) == 0U) && (ETHIF_EEE_ENTRY_US <= 0xFFFF8U),
+               "ETHIF_EEE_ENTRY_US must be a multiple of 8 up to 0xFFFF8");
+_Static_assert(ETHIF_EEE_LS_MS <= 1023U, "ETHIF_EEE_LS_MS exceeds MACLTCR.LST");
+_Static_assert(ETHIF_EEE_TW_US <= 0xFFFFU, "ETHIF_EEE_TW_US exceeds MACLTCR.TWT");
+
+/* ETH_CODE: LAN8742 EEE controls. The clause 45 registers are reached
+ * through MMDACR / MMDAADR. */
+#define ETHIF_PHY_ENCTR_EEE           ((uint16_t)0x0004U)  /* PHYEEEEN */
+#define ETHIF_MMD_AN                  7U
+#define ETHIF_MMD_EEE_ADV             60U
+#define ETHIF_MMD_EEE_LP_ADV          61U
+#define ETHIF_MMD_EEE_100TX           ((uint16_t)0x0002U)
+
+static int32_t ethernetif_mmd_select(uint32_t devad, uint32_t reg)
+{
+  if ((ETH_PHY_IO_WriteReg(LAN8742.DevAddr, LAN8742_MMDACR, LAN8742_MMDACR_MMD_FUNCTION_ADDR | devad) != 0) ||
+      (ETH_PHY_IO_WriteReg(LAN8742.DevAddr, LAN8742_MMDAADR, reg) != 0) ||
+      (ETH_PHY_IO_WriteReg(LAN8742.DevAddr, LAN8742_MMDACR, LAN8742_MMDACR_MMD_FUNCTION_DATA | devad) != 0))
+  {
+    return -1;
+  }
+  return 0;
+}
+
+static int32_t ethernetif_mmd_read(uint32_t devad, uint32_t reg, uint32_t *val)
+{
+  if (ethernetif_mmd_select(devad, reg) != 0)
+  {
+    return -1;
+  }
+  return ETH_PHY_IO_ReadReg(LAN8742.DevAddr, LAN8742_MMDAADR, val);
+}
+
+static int32_t ethernetif_mmd_write(uint32_t devad, uint32_t reg, uint32_t val)
+{
+  if (ethernetif_mmd_select(devad, reg) != 0)
+  {
+    return -1;
+  }
+  return ETH_PHY_IO_WriteReg(LAN8742.DevAddr, LAN8742_MMDAADR, val);
+}
+
+/* ETH_CODE: arm automatic LPI entry/exit when the link supports it and
+ * LPI is allowed, otherwise leave LPI. */
+static void ethernetif_eee_apply(void)
+{
+  if ((EeeLinkOk != 0U) && (EeeAllowed != 0U))
+  {
+    SET_BIT(heth.Instance->MACLCSR, ETH_MACLCSR_PLS);
+    HAL_ETHEx_EnterLPIMode(&heth, ENABLE, DISABLE);
+    SET_BIT(heth.Instance->MACLCSR, ETH_MACLCSR_LPITE);
+    EeeStats.active = 1U;
+  }
+  else
+  {
+    HAL_ETHEx_ExitLPIMode(&heth);
+    CLEAR_BIT(heth.Instance->MACLCSR, ETH_MACLCSR_LPITE);
+    EeeStats.active = 0U;
+    EeeWakeStart = 0U;
+  }
+}
+
+/* ETH_CODE: program the MAC LPI timers and advertise EEE. If the PHY was
+ * not advertising EEE yet, renegotiate; the link thread handles the new
+ * link. */
+static void ethernetif_eee_init(void)
 {
-  err_t errval;
-  errval = ERR_OK;
+  uint32_t enctr = 0U;
+  uint32_t adv = 0U;
 
-/* USER CODE BEGIN 5 */
+  /* Cycle counter for the wake timing */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55U;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
-/* USER CODE END 5 */
+  WRITE_REG(heth.Instance->MACLTCR, (ETHIF_EEE_LS_MS << ETH_MACLTCR_LST_Pos) | ETHIF_EEE_TW_US);
+  WRITE_REG(heth.Instance->MACLETR, ETHIF_EEE_ENTRY_US);
 
-  return errval;
+  if ((ETH_PHY_IO_ReadReg(LAN8742.DevAddr, LAN8742_ENCTR, &enctr) != 0) ||
+      (ethernetif_mmd_read(ETHIF_MMD_AN, ETHIF_MMD_EEE_ADV, &adv) != 0))
+  {
+    return;
+  }
+  if (((enctr & ETHIF_PHY_ENCTR_EEE) == 0U) || ((adv & ETHIF_MMD_EEE_100TX) == 0U))
+  {
+    ETH_PHY_IO_WriteReg(LAN8742.DevAddr, LAN8742_ENCTR, enctr | ETHIF_PHY_ENCTR_EEE);
+    ethernetif_mmd_write(ETHIF_MMD_AN, ETHIF_MMD_EEE_ADV, adv | ETHIF_MMD_EEE_100TX);
+    EeeLinkOk = 0U;
+    LAN8742_StartAutoNego(&LAN8742);
+    return;
+  }
+  ethernetif_eee_link(1U);
+}
+
+/* ETH_CODE: link transition, called with the core lock held. EeeLinkOk
+ * holds the speed/duplex check on entry and gains the link partner's EEE
+ * advertisement here. */
+static void ethernetif_eee_link(uint8_t up)
+{
+  uint32_t lp = 0U;
 
+  if ((up == 0U) || (ethernetif_mmd_read(ETHIF_MMD_AN, ETHIF_MMD_EEE_LP_ADV, &lp) != 0) ||
+      ((lp & ETHIF_MMD_EEE_100TX) == 0U))
+  {
+    EeeLinkOk = 0U;
+  }
+  ethernetif_eee_apply();
+}
+
+/* ETH_CODE: TX complete interrupt, ends a timed wake */
+static void ethernetif_eee_tx_done(void)
+{
+  uint32_t start = EeeWakeStart;
+
+  if (start == 0U)
+  {
+    return;
+  }
+  EeeWakeStart = 0U;
+
+  uint32_t us = (DWT->CYCCNT - start) / (SystemCoreClock / 1000000U);
+  EeeStats.wakes++;
+  EeeStats.wake_last_us = us;
+  if (us > EeeStats.wake_max_us)
+  {
+    EeeStats.wake_max_us = us;
+  }
+  if (us > ETHIF_EEE_WAKE_BUDGET_US)
+  {
+    /* Keep the latency bound: no more LPI until re-enabled */
+    EeeStats.over_budget++;
+    EeeAllowed = 0U;
+    HAL_ETHEx_ExitLPIMode(&heth);
+    CLEAR_BIT(heth.Instance->MACLCSR, ETH_MACLCSR_LPITE);
+    EeeStats.active = 0U;
+    LOG_ISR(LOG_LEVEL_WARNING, "ETH", "EEE wake took %lu us, LPI off", (unsigned long)us);
+  }
 }
-#endif /* LWIP_ARP */
 
 /**
- * @brief Should be called at the beginning of the program to set up the
- * network interface. It calls the function low_level_init() to do the
- * actual setup of the hardware.
- *
- * This function should be passed as a parameter to netif_add().
- *
- * @param netif the lwip network interface structure for this ethernetif
- * @return ERR_OK if the loopif is initialized
- *         ERR_MEM if private data couldn't be allocated
- *         any other err_t on error
- */
-err_t ethernetif_init(struct netif *netif)
+  * @brief  Counts the MAC LPI entry/exit events
+  * @param  handlerEth: ETH handle
+  * @retval None
+  */
+void HAL_ETH_EEECallback(ETH_HandleTypeDef *handlerEth)
 {
-  LWIP_ASSERT("netif != NULL", (netif != NULL));
+  uint32_t event = HAL_ETHEx_GetMACLPIEvent(handlerEth);
 
-#if LWIP_NETIF_HOSTNAME
-  /* Initialize interface hostname */
-  netif->hostname = "lwip";
-#endif /* LWIP_NETIF_HOSTNAME */
+  if ((event & ETH_TX_LPI_ENTRY) != 0U)
+  {
+    EeeStats.tx_entry++;
+  }
+  if ((event & ETH_TX_LPI_EXIT) != 0U)
+  {
+    EeeStats.tx_exit++;
+  }
+  if ((event & ETH_RX_LPI_ENTRY) != 0U)
+  {
+    EeeStats.rx_entry++;
+  }
+  if ((event & ETH_RX_LPI_EXIT) != 0U)
+  {
+    EeeStats.rx_exit++;
+  }
+}
 
-  /*
-   * Initialize the snmp variables and counters inside the struct netif.
-   * The last argument should be replaced with your link speed, in units
-   * of bits per second.
-   */
-  // MIB2_INIT_NETIF(netif, snmp_ifType_ethernet_csmacd, LINK_SPEED_OF_YOUR_NETIF_IN_BPS);
+/**
+  * @brief  Returns a snapshot of the EEE counters
+  * @param  stats: destination
+  * @retval None
+  */
+void ethernetif_get_eee_stats(EthIfEeeStatsTypeDef *stats)
+{
+  if (stats != NULL)
+  {
+    *stats = EeeStats;
+    stats->tx_lpi_us = READ_REG(heth.Instance->MMCTLPIMSTR);
+    stats->rx_lpi_us = READ_REG(heth.Instance->MMCRLPIMSTR);
+  }
+}
 
-  netif->name[0] = IFNAME0;
-  netif->name[1] = IFNAME1;
-  /* We directly use etharp_output() here to save a function call.
-   * You can instead declare your own function an call etharp_output()
-   * from it if you have to do some checks before sending (e.g. if link
-   * is available...) */
+/**
+  * @brief  Allows or forbids LPI, e.g. around latency critical phases or
+  *         after a wake exceeded ETHIF_EEE_WAKE_BUDGET_US
+  * @param  enable: 1 to allow LPI on an EEE capable link
+  * @retval None
+  * @note   Call with the lwIP core lock held.
+  */
+void ethernetif_eee_enable(uint8_t enable)
+{
+  EeeAllowed = (enable != 0U) ? 1U : 0U;
+  ethernetif_eee_apply();
+}
+#endif
 
-#if LWIP_IPV4
-#if LWIP_ARP || LWIP_ETHERNET
-#if LWIP_ARP
-  netif->output = etharp_output;
-#else
-  /* The user should write its own code in low_level_output_arp_off function */
-  netif->output = low_level_output_arp_off;
-#endif /* LWIP_ARP */
-#endif /* LWIP_ARP || LWIP_ETHERNET */
-#endif /* LWIP_IPV4 */
+#if ETHIF_WOL
+/* ETH_CODE: remote wake-up filters. Each matches, on frames to our unicast
+ * address, the bytes picked by its mask from its offset on: the IPv4
+ * EtherType (bytes 12-13) and the TCP/UDP destination port (36-37). The
+ * MAC compares their CRC-16 (0xA001 reflected, seed 0xFFFF). */
+static const uint16_t WolPorts[] = { ETHIF_WOL_PORTS };
+_Static_assert((sizeof(WolPorts) / sizeof(WolPorts[0])) <= 4U, "ETHIF_WOL_PORTS: at most 4 ports");
 
-#if LWIP_IPV6
-  netif->output_ip6 = ethip6_output;
-#endif /* LWIP_IPV6 */
+#define ETHIF_WOL_OFFSET              12U
+#define ETHIF_WOL_MASK                ((1UL << 0) | (1UL << 1) | (1UL << 24) | (1UL << 25))
 
-  netif->linkoutput = low_level_output;
+static uint32_t WolFilter[8];
 
-  /* initialize the hardware */
-  low_level_init(netif);
+static uint16_t ethernetif_wol_crc16(const uint8_t *data, uint32_t len)
+{
+  uint16_t crc = 0xFFFFU;
 
-  return ERR_OK;
+  for (uint32_t i = 0U; i < len; i++)
+  {
+    crc ^= data[i];
+    for (uint32_t b = 0U; b < 8U; b++)
+    {
+      crc = ((crc & 1U) != 0U) ? (uint16_t)((crc >> 1) ^ 0xA001U) : (uint16_t)(crc >> 1);
+    }
+  }
+  return crc;
+}
+
+/* ETH_CODE: MACRWKPFR words, in write order: four byte masks, the
+ * commands, the offsets, the CRC-16s of filters 0/1 and 2/3 */
+static void ethernetif_wol_init(void)
+{
+  WolSemaphore = osSemaphoreNew(1, 0, &WolSemaphoreAttr);
+  if (WolSemaphore == NULL)
+  {
+    Error_Handler();
+  }
+
+  for (uint32_t i = 0U; i < (sizeof(WolPorts) / sizeof(WolPorts[0])); i++)
+  {
+    const uint8_t pattern[4] = { 0x08U, 0x00U, (uint8_t)(WolPorts[i] >> 8), (uint8_t)WolPorts[i] };
+
+    WolFilter[i] = ETHIF_WOL_MASK;
+    WolFilter[4] |= 1UL << (8U * i);
+    WolFilter[5] |= ETHIF_WOL_OFFSET << (8U * i);
+    WolFilter[6U + (i / 2U)] |= (uint32_t)ethernetif_wol_crc16(pattern, sizeof(pattern)) << (16U * (i % 2U));
+  }
+}
+
+/* ETH_CODE: RX/TX complete interrupt, times the first one after a resume */
+static ITCM_FUNC void ethernetif_wol_first(volatile uint32_t *start, uint32_t *us)
+{
+  uint32_t t0 = *start;
+
+  if (t0 == 0U)
+  {
+    return;
+  }
+  *start = 0U;
+  *us = (DWT->CYCCNT - t0) / (SystemCoreClock / 1000000U);
 }
 
 /**
-  * @brief  Custom Rx pbuf free callback
-  * @param  pbuf: pbuf to be freed
+  * @brief  Wake-up event, from HAL_ETH_IRQHandler(); PWRDWN is already
+  *         cleared by the MAC
+  * @param  handlerEth: ETH handle
   * @retval None
   */
-void pbuf_free_custom(struct pbuf *p)
+void HAL_ETH_PMTCallback(ETH_HandleTypeDef *handlerEth)
 {
-  struct pbuf_custom* custom_pbuf = (struct pbuf_custom*)p;
-  LWIP_MEMPOOL_FREE(RX_POOL, custom_pbuf);
+  uint32_t source = HAL_ETH_GetMACWakeUpSource(handlerEth);
 
-  /* If the Rx Buffer Pool was exhausted, signal the ethernetif_input task to
-   * call HAL_ETH_GetRxDataBuffer to rebuild the Rx descriptors. */
+  if ((WolParked == 0U) || (WolWake != ETHIF_WAKE_NONE))
+  {
+    return;
+  }
+  WolWakeCyc = DWT->CYCCNT;
+  WolWake = ((source & ETH_MAGIC_PACKET_RECIEVED) != 0U) ? ETHIF_WAKE_MAGIC : ETHIF_WAKE_FILTER;
+  osSemaphoreRelease(WolSemaphore);
+}
 
-  if (RxAllocStatus == RX_ALLOC_ERROR)
+/**
+  * @brief  Parks the MAC in PMT power-down until a wake event
+  * @param  timeout_ms: local wake after this long, 0 for none
+  * @retval The cause of the wake, ETHIF_WAKE_NONE if the link was down
+  * @note   The descriptor rings and their buffers stay as they are; the
+  *         resume restarts the DMA on them, as at link up.
+  */
+EthIfWakeTypeDef ethernetif_standby(uint32_t timeout_ms)
+{
+  const ETH_PowerDownConfigTypeDef pdc = {
+    .WakeUpPacket = ENABLE,
+    .MagicPacket = ENABLE,
+    .GlobalUnicast = DISABLE,
+    .WakeUpForward = ENABLE,
+  };
+  EthIfWakeTypeDef wake;
+  uint32_t t0;
+  uint32_t us;
+
+  LOCK_TCPIP_CORE();
+  if (heth.gState != HAL_ETH_STATE_STARTED)
   {
-    RxAllocStatus = RX_ALLOC_OK;
-    osSemaphoreRelease(RxPktSemaphore);
+    UNLOCK_TCPIP_CORE();
+    return ETHIF_WAKE_NONE;
+  }
+#if ETHIF_TX_QUEUE
+  ethernetif_tx_flush();
+#endif
+  /* Frames already handed to the DMA go out first */
+  t0 = HAL_GetTick();
+  while ((heth.TxDescList.BuffersInUse != 0U) && ((HAL_GetTick() - t0) < ETHIF_WOL_TX_DRAIN_MS))
+  {
+    HAL_ETH_ReleaseTxPacket(&heth);
+  }
+
+  HAL_ETH_Stop_IT(&heth);
+  (void)osSemaphoreAcquire(WolSemaphore, 0U);
+  WolWake = ETHIF_WAKE_NONE;
+  WolParked = 1U;
+  (void)HAL_ETH_SetWakeUpFilter(&heth, WolFilter, 8U);
+  /* The receiver looks for the wake-up frames, the DMA stays off */
+  SET_BIT(heth.Instance->MACCR, ETH_MACCR_RE);
+  HAL_ETH_EnterPowerDownMode(&heth, &pdc);
+  WolStats.standbys++;
+  UNLOCK_TCPIP_CORE();
+
+  (void)osSemaphoreAcquire(WolSemaphore, (timeout_ms != 0U) ? pdMS_TO_TICKS(timeout_ms) : osWaitForever);
+
+  LOCK_TCPIP_CORE();
+  /* Also clears PWRDWN after a timeout */
+  HAL_ETH_ExitPowerDownMode(&heth);
+  wake = WolWake;
+  if (wake == ETHIF_WAKE_NONE)
+  {
+    wake = ETHIF_WAKE_TIMEOUT;
+    WolWakeCyc = DWT->CYCCNT;
+  }
+  WolFirstRx = WolWakeCyc | 1U;
+  WolFirstTx = WolWakeCyc | 1U;
+  HAL_ETH_Start_IT(&heth);
+  WolParked = 0U;
+  us = (DWT->CYCCNT - WolWakeCyc) / (SystemCoreClock / 1000000U);
+  WolStats.resume_last_us = us;
+  if (us > WolStats.resume_max_us)
+  {
+    WolStats.resume_max_us = us;
+  }
+  switch (wake)
+  {
+    case ETHIF_WAKE_MAGIC:
+      WolStats.magic++;
+      break;
+    case ETHIF_WAKE_FILTER:
+      WolStats.filter++;
+      break;
+    default:
+      WolStats.timeout++;
+      break;
   }
+  UNLOCK_TCPIP_CORE();
+  return wake;
 }
 
-/* USER CODE BEGIN 6 */
+/**
+  * @brief  Returns a snapshot of the standby counters
+  * @param  stats: destination
+  * @retval None
+  */
+void ethernetif_get_wol_stats(EthIfWolStatsTypeDef *stats)
+{
+  if (stats != NULL)
+  {
+    *stats = WolStats;
+  }
+}
+#endif
 
+#if ETHIF_DMA_PROF
 /**
-* @brief  Returns the current time in milliseconds
-*         when LWIP_TIMERS == 1 and NO_SYS == 1
-* @param  None
-* @retval Current Time value
-*/
-u32_t sys_now(void)
+  * @brief  Returns a snapshot of the data path profile
+  * @param  prof: destination
+  * @retval None
+  */
+void ethernetif_dma_prof_get(EthIfDmaProfTypeDef *prof)
 {
-  return HAL_GetTick();
+  if (prof != NULL)
+  {
+    *prof = DmaProf;
+  }
 }
 
+/**
+  * @brief  Clears the data path profile
+  * @retval None
+  */
+void ethernetif_dma_prof_reset(void)
+{
+  DmaProf = (EthIfDmaProfTypeDef){ .lean = ETHIF_LEAN_DMA };
+}
+#endif
 /* USER CODE END 6 */
 
 /**
@@ -740,10 +5653,219 @@ void HAL_ETH_MspDeInit(ETH_HandleTypeDef* ethHandle)
     /* Peripheral interrupt Deinit*/
     HAL_NVIC_DisableIRQ(ETH_IRQn);
 
-  /* USER CODE BEGIN ETH_MspDeInit 1 */
+  /* USER CODE BEGIN ETH_MspDeInit 1 */
+
+  /* USER CODE END ETH_MspDeInit 1 */
+  }
+}
+
+#if ETHIF_MDIO_ASYNC
+/* ETH_CODE: MDIO operation queue, see ETHIF_MDIO_ASYNC. The entry at
+ * MdioTail is on the bus while MdioBusy is set, which stays set through its
+ * completion callback, so nothing else starts meanwhile. State is touched in
+ * critical sections only; callbacks run outside them, on the timer task. */
+typedef struct
+{
+  uint8_t dev;
+  uint8_t reg;
+  uint8_t write;
+  uint16_t val;
+  EthIfMdioDoneTypeDef done;
+  void *arg;
+} EthIfMdioOpTypeDef;
+
+/* A synchronous caller sleeping on its operation */
+typedef struct
+{
+  StaticSemaphore_t cb;
+  SemaphoreHandle_t sem;
+  int32_t status;
+  uint32_t val;
+} EthIfMdioWaitTypeDef;
+
+_Static_assert((ETHIF_MDIO_QUEUE_LEN & (ETHIF_MDIO_QUEUE_LEN - 1U)) == 0U,
+               "ETHIF_MDIO_QUEUE_LEN must be a power of two");
+
+static EthIfMdioOpTypeDef MdioQueue[ETHIF_MDIO_QUEUE_LEN];
+static uint32_t MdioHead;        /* free-running, masked on access */
+static uint32_t MdioTail;
+static uint8_t MdioBusy;
+static uint8_t MdioTimerOn;      /* armed, or its callback running */
+static uint32_t MdioStart;       /* HAL tick the operation on the bus started */
+static TimerHandle_t MdioTimer;
+static StaticTimer_t MdioTimerCb;
+
+/* Critical section held, operation at MdioTail */
+static void ethernetif_mdio_start(void)
+{
+  const EthIfMdioOpTypeDef *op = &MdioQueue[MdioTail % ETHIF_MDIO_QUEUE_LEN];
+  uint32_t ar = READ_REG(heth.Instance->MACMDIOAR);
+
+  MODIFY_REG(ar, ETH_MACMDIOAR_PA, (uint32_t)op->dev << 21);
+  MODIFY_REG(ar, ETH_MACMDIOAR_RDA, (uint32_t)op->reg << 16);
+  if (op->write != 0U)
+  {
+    WRITE_REG(heth.Instance->MACMDIODR, op->val);
+    MODIFY_REG(ar, ETH_MACMDIOAR_MOC, ETH_MACMDIOAR_MOC_WR);
+  }
+  else
+  {
+    MODIFY_REG(ar, ETH_MACMDIOAR_MOC, ETH_MACMDIOAR_MOC_RD);
+  }
+  SET_BIT(ar, ETH_MACMDIOAR_MB);
+  WRITE_REG(heth.Instance->MACMDIOAR, ar);
+  MdioStart = HAL_GetTick();
+  MdioBusy = 1U;
+}
+
+/* Timer task: completes what the bus has finished, starts the next one and
+ * re-arms while anything is left */
+static void ethernetif_mdio_timer(TimerHandle_t timer)
+{
+  uint8_t rearm;
+
+  taskENTER_CRITICAL();
+  while (MdioBusy != 0U)
+  {
+    uint8_t busy = (READ_BIT(heth.Instance->MACMDIOAR, ETH_MACMDIOAR_MB) != 0U) ? 1U : 0U;
+    if ((busy != 0U) && ((HAL_GetTick() - MdioStart) <= ETH_MDIO_BUS_TIMEOUT))
+    {
+      break;
+    }
+    EthIfMdioOpTypeDef op = MdioQueue[MdioTail % ETHIF_MDIO_QUEUE_LEN];
+    uint32_t val = ((busy == 0U) && (op.write == 0U)) ? (READ_REG(heth.Instance->MACMDIODR) & 0xFFFFU) : 0U;
+    taskEXIT_CRITICAL();
+
+    if (op.done != NULL)
+    {
+      op.done(op.arg, (busy != 0U) ? -1 : 0, val);
+    }
+
+    taskENTER_CRITICAL();
+    MdioTail++;
+    MdioBusy = 0U;
+    if (MdioTail != MdioHead)
+    {
+      ethernetif_mdio_start();
+    }
+  }
+  rearm = MdioBusy;
+  if (rearm == 0U)
+  {
+    MdioTimerOn = 0U;
+  }
+  taskEXIT_CRITICAL();
+
+  if (rearm != 0U)
+  {
+    (void)xTimerReset(timer, 0);
+  }
+}
+
+static uint8_t ethernetif_mdio_submit(uint32_t dev, uint32_t reg, uint8_t write, uint32_t val,
+                                      EthIfMdioDoneTypeDef done, void *arg)
+{
+  uint8_t arm = 0U;
+
+  if (MdioTimer == NULL)
+  {
+    return 0U;
+  }
+  taskENTER_CRITICAL();
+  if ((MdioHead - MdioTail) >= ETHIF_MDIO_QUEUE_LEN)
+  {
+    taskEXIT_CRITICAL();
+    return 0U;
+  }
+  EthIfMdioOpTypeDef *op = &MdioQueue[MdioHead % ETHIF_MDIO_QUEUE_LEN];
+  op->dev = (uint8_t)dev;
+  op->reg = (uint8_t)reg;
+  op->write = write;
+  op->val = (uint16_t)val;
+  op->done = done;
+  op->arg = arg;
+  MdioHead++;
+  if (MdioBusy == 0U)
+  {
+    ethernetif_mdio_start();
+  }
+  /* Never the timer task itself: its callback keeps MdioTimerOn set */
+  if (MdioTimerOn == 0U)
+  {
+    MdioTimerOn = 1U;
+    arm = 1U;
+  }
+  taskEXIT_CRITICAL();
+
+  if (arm != 0U)
+  {
+    (void)xTimerStart(MdioTimer, portMAX_DELAY);
+  }
+  return 1U;
+}
+
+static void ethernetif_mdio_wake(void *arg, int32_t status, uint32_t val)
+{
+  EthIfMdioWaitTypeDef *w = (EthIfMdioWaitTypeDef *)arg;
+
+  w->status = status;
+  w->val = val;
+  (void)xSemaphoreGive(w->sem);
+}
+
+/* Queue and sleep until done. Tasks other than the timer task, once the
+ * scheduler runs; the rest busy-wait in the HAL, which is safe in a
+ * completion callback because the bus is idle and held for it. */
+static uint8_t ethernetif_mdio_can_wait(void)
+{
+  return ((MdioTimer != NULL) && (__get_IPSR() == 0U) &&
+          (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING) &&
+          (xTaskGetCurrentTaskHandle() != xTimerGetTimerDaemonTaskHandle())) ? 1U : 0U;
+}
+
+static int32_t ethernetif_mdio_wait(uint32_t dev, uint32_t reg, uint8_t write, uint32_t val, uint32_t *out)
+{
+  EthIfMdioWaitTypeDef w;
+
+  w.sem = xSemaphoreCreateBinaryStatic(&w.cb);
+  while (ethernetif_mdio_submit(dev, reg, write, val, ethernetif_mdio_wake, &w) == 0U)
+  {
+    osDelay(1);
+  }
+  (void)xSemaphoreTake(w.sem, portMAX_DELAY);
+  if (out != NULL)
+  {
+    *out = w.val;
+  }
+  return w.status;
+}
+#endif
+
+uint8_t ethernetif_mdio_read(uint32_t dev, uint32_t reg, EthIfMdioDoneTypeDef done, void *arg)
+{
+#if ETHIF_MDIO_ASYNC
+  return ethernetif_mdio_submit(dev, reg, 0U, 0U, done, arg);
+#else
+  (void)dev;
+  (void)reg;
+  (void)done;
+  (void)arg;
+  return 0U;
+#endif
+}
 
-  /* USER CODE END ETH_MspDeInit 1 */
-  }
+uint8_t ethernetif_mdio_write(uint32_t dev, uint32_t reg, uint32_t val, EthIfMdioDoneTypeDef done, void *arg)
+{
+#if ETHIF_MDIO_ASYNC
+  return ethernetif_mdio_submit(dev, reg, 1U, val, done, arg);
+#else
+  (void)dev;
+  (void)reg;
+  (void)val;
+  (void)done;
+  (void)arg;
+  return 0U;
+#endif
 }
 
 /*******************************************************************************
@@ -763,6 +5885,16 @@ int32_t ETH_PHY_IO_Init(void)
   /* Configure the MDIO Clock */
   HAL_ETH_SetMDIOClockRange(&heth);
 
+#if ETHIF_MDIO_ASYNC
+  /* ETH_CODE: LAN8742_Init() may be retried, the timer is made once */
+  if (MdioTimer == NULL)
+  {
+    MdioTimer = xTimerCreateStatic("EthMdio", (pdMS_TO_TICKS(ETHIF_MDIO_POLL_MS) > 0U) ?
+                                   pdMS_TO_TICKS(ETHIF_MDIO_POLL_MS) : 1U,
+                                   pdFALSE, NULL, ethernetif_mdio_timer, &MdioTimerCb);
+  }
+#endif
+
   return 0;
 }
 
@@ -785,6 +5917,12 @@ int32_t ETH_PHY_IO_DeInit (void)
   */
 int32_t ETH_PHY_IO_ReadReg(uint32_t DevAddr, uint32_t RegAddr, uint32_t *pRegVal)
 {
+#if ETHIF_MDIO_ASYNC
+  if (ethernetif_mdio_can_wait() != 0U)
+  {
+    return ethernetif_mdio_wait(DevAddr, RegAddr, 0U, 0U, pRegVal);
+  }
+#endif
   if(HAL_ETH_ReadPHYRegister(&heth, DevAddr, RegAddr, pRegVal) != HAL_OK)
   {
     return -1;
@@ -802,6 +5940,12 @@ int32_t ETH_PHY_IO_ReadReg(uint32_t DevAddr, uint32_t RegAddr, uint32_t *pRegVal
   */
 int32_t ETH_PHY_IO_WriteReg(uint32_t DevAddr, uint32_t RegAddr, uint32_t RegVal)
 {
+#if ETHIF_MDIO_ASYNC
+  if (ethernetif_mdio_can_wait() != 0U)
+  {
+    return ethernetif_mdio_wait(DevAddr, RegAddr, 1U, RegVal, NULL);
+  }
+#endif
   if(HAL_ETH_WritePHYRegister(&heth, DevAddr, RegAddr, RegVal) != HAL_OK)
   {
     return -1;
@@ -819,6 +5963,256 @@ int32_t ETH_PHY_IO_GetTick(void)
   return HAL_GetTick();
 }
 
+#if ETHIF_PHY_MODE != ETHIF_PHY_MODE_AUTO
+/* ETH_CODE: forced link mode, see ETHIF_PHY_MODE. Link thread only. */
+static int32_t PhyForcedState;   /* LAN8742_STATUS_xxx while forced, else 0 */
+static uint32_t PhyForcedSince;  /* HAL tick it was forced or the link lost */
+static uint8_t PhyLinkWasUp;
+
+#if ETHIF_PHY_MODE == ETHIF_PHY_MODE_CACHED
+extern RTC_HandleTypeDef hrtc;
+#endif
+
+/* The modes LAN8742_SetLinkState() can force */
+static uint8_t ethernetif_phy_forceable(int32_t state)
+{
+  return ((state == LAN8742_STATUS_100MBITS_FULLDUPLEX) || (state == LAN8742_STATUS_100MBITS_HALFDUPLEX) ||
+          (state == LAN8742_STATUS_10MBITS_FULLDUPLEX)) ? 1U : 0U;
+}
+
+/* Mode to force, 0 to negotiate */
+static int32_t ethernetif_phy_target(void)
+{
+#if ETHIF_PHY_MODE == ETHIF_PHY_MODE_CACHED
+  uint32_t v = (&RTC->BKP0R)[ETHIF_PHY_BKUP_REG];
+
+  if (((v & 0xFFFF0000UL) == ETHIF_PHY_BKUP_MAGIC) && (ethernetif_phy_forceable((int32_t)(v & 0xFFFFU)) != 0U))
+  {
+    return (int32_t)(v & 0xFFFFU);
+  }
+  return 0;
+#else
+  return ETHIF_PHY_FORCED_STATE;
+#endif
+}
+
+static void ethernetif_phy_force(void)
+{
+  int32_t state = ethernetif_phy_target();
+
+  PhyForcedState = 0;
+  PhyForcedSince = HAL_GetTick();
+  if ((state != 0) && (LAN8742_SetLinkState(&LAN8742, (uint32_t)state) == LAN8742_STATUS_OK))
+  {
+    PhyForcedState = state;
+  }
+}
+
+/* After each link state read: cache what was negotiated, force again on
+ * link loss or after a PHY reset, and negotiate once forcing timed out */
+static void ethernetif_phy_poll(int32_t state)
+{
+  uint32_t bcr = 0U;
+
+  if ((state >= LAN8742_STATUS_100MBITS_FULLDUPLEX) && (state <= LAN8742_STATUS_10MBITS_HALFDUPLEX))
+  {
+    PhyLinkWasUp = 1U;
+#if ETHIF_PHY_MODE == ETHIF_PHY_MODE_CACHED
+    if ((PhyForcedState == 0) && (ethernetif_phy_forceable(state) != 0U) &&
+        ((&RTC->BKP0R)[ETHIF_PHY_BKUP_REG] != (ETHIF_PHY_BKUP_MAGIC | (uint32_t)state)))
+    {
+      HAL_PWR_EnableBkUpAccess();
+      HAL_RTCEx_BKUPWrite(&hrtc, ETHIF_PHY_BKUP_REG, ETHIF_PHY_BKUP_MAGIC | (uint32_t)state);
+    }
+#endif
+    return;
+  }
+  if (PhyLinkWasUp != 0U)
+  {
+    PhyLinkWasUp = 0U;
+    ethernetif_phy_force();
+    return;
+  }
+  if (PhyForcedState == 0)
+  {
+    return;
+  }
+  if ((ETH_PHY_IO_ReadReg(LAN8742.DevAddr, LAN8742_BCR, &bcr) == 0) && ((bcr & LAN8742_BCR_AUTONEGO_EN) != 0U))
+  {
+    /* The PHY reset itself to its strapped mode */
+    ethernetif_phy_force();
+  }
+  else if ((HAL_GetTick() - PhyForcedSince) >= ETHIF_PHY_FORCED_TIMEOUT_MS)
+  {
+    LOG_WARNING("ETH", "no link in forced mode %ld, auto-negotiating", (long)PhyForcedState);
+    PhyForcedState = 0;
+    LAN8742_StartAutoNego(&LAN8742);
+  }
+}
+#endif
+
+/* ETH_CODE: after HAL_ETH_Stop_IT(): frees the frames the TX DMA still
+ * owns, which it would otherwise send stale after the restart, and points
+ * it back to the start of an empty ring; HAL_ETH_Start_IT() carries on
+ * from where the DMA stopped. */
+static void ethernetif_tx_reclaim(void)
+{
+  ETH_TxDescListTypeDef *list = &heth.TxDescList;
+
+  HAL_ETH_ReleaseTxPacket(&heth);
+  /* In submission order, as the free callback expects */
+  for (uint32_t i = 0U; i < ETH_TX_DESC_CNT; i++)
+  {
+    uint32_t idx = (list->releaseIndex + i) % ETH_TX_DESC_CNT;
+    if (list->PacketAddress[idx] != NULL)
+    {
+      HAL_ETH_TxFreeCallback(list->PacketAddress[idx]);
+      list->PacketAddress[idx] = NULL;
+      LinkStats.tx_reclaimed++;
+    }
+  }
+  for (uint32_t i = 0U; i < ETH_TX_DESC_CNT; i++)
+  {
+    ETH_DMADescTypeDef *d = (ETH_DMADescTypeDef *)list->TxDesc[i];
+    WRITE_REG(d->DESC0, 0U);
+    WRITE_REG(d->DESC1, 0U);
+    WRITE_REG(d->DESC2, 0U);
+    WRITE_REG(d->DESC3, 0U);
+  }
+  list->CurTxDesc = 0U;
+  list->releaseIndex = 0U;
+  list->BuffersInUse = 0U;
+#if ETHIF_TX_BATCH
+  TxTailPending = 0U;
+#endif
+  __DMB();
+  /* Written with the TX DMA stopped, this also resets its position */
+  WRITE_REG(heth.Instance->DMACTDLAR, (uint32_t)heth.Init.TxDesc);
+}
+
+/* ETH_CODE: the netif goes down with the link */
+static void ethernetif_link_down(struct netif *netif)
+{
+  HAL_ETH_Stop_IT(&heth);
+  ethernetif_tx_reclaim();
+#if ETHIF_TX_QUEUE
+  /* ETH_CODE: frames queued for a dead link would go out stale */
+  ethernetif_tx_flush();
+#endif
+  netif_set_down(netif);
+  netif_set_link_down(netif);
+}
+
+#if ETHIF_LINK_FLAP_MS
+/* ETH_CODE: MAC speed and duplex of a PHY link state, 0 for none */
+static uint8_t ethernetif_link_mode(int32_t state, uint32_t *speed, uint32_t *duplex)
+{
+  switch (state)
+  {
+    case LAN8742_STATUS_100MBITS_FULLDUPLEX:
+      *speed = ETH_SPEED_100M;
+      *duplex = ETH_FULLDUPLEX_MODE;
+      return 1U;
+    case LAN8742_STATUS_100MBITS_HALFDUPLEX:
+      *speed = ETH_SPEED_100M;
+      *duplex = ETH_HALFDUPLEX_MODE;
+      return 1U;
+    case LAN8742_STATUS_10MBITS_FULLDUPLEX:
+      *speed = ETH_SPEED_10M;
+      *duplex = ETH_FULLDUPLEX_MODE;
+      return 1U;
+    case LAN8742_STATUS_10MBITS_HALFDUPLEX:
+      *speed = ETH_SPEED_10M;
+      *duplex = ETH_HALFDUPLEX_MODE;
+      return 1U;
+    default:
+      return 0U;
+  }
+}
+
+/* ETH_CODE: the link is lost; MAC, DMA and netif stay as they are, TX
+ * holds */
+static void ethernetif_link_flap_start(void)
+{
+  LinkFlapSince = HAL_GetTick() | 1U;
+  LinkFlapHold = 1U;
+  LinkStats.downs++;
+}
+
+/* ETH_CODE: called while the link is lost, with the PHY state. Back: TX
+ * resumes, the MAC is restarted only for another speed or duplex. Still
+ * down after the window: the netif goes down. */
+static void ethernetif_link_flap_poll(struct netif *netif, int32_t state)
+{
+  ETH_MACConfigTypeDef mac;
+  uint32_t speed;
+  uint32_t duplex;
+  uint32_t ms = HAL_GetTick() - LinkFlapSince;
+
+  if ((state > LAN8742_STATUS_LINK_DOWN) && (ethernetif_link_mode(state, &speed, &duplex) != 0U))
+  {
+    HAL_ETH_GetMACConfig(&heth, &mac);
+    if ((mac.Speed != speed) || (mac.DuplexMode != duplex))
+    {
+      HAL_ETH_Stop_IT(&heth);
+      ethernetif_tx_reclaim();
+      mac.Speed = speed;
+      mac.DuplexMode = duplex;
+      HAL_ETH_SetMACConfig(&heth, &mac);
+      HAL_ETH_Start_IT(&heth);
+      LinkStats.restarts++;
+    }
+    else
+    {
+      LinkStats.flaps++;
+    }
+    LinkStats.flap_last_ms = ms;
+    if (ms > LinkStats.flap_max_ms)
+    {
+      LinkStats.flap_max_ms = ms;
+    }
+    LinkFlapSince = 0U;
+    LinkFlapHold = 0U;
+#if ETHIF_EEE
+    EeeLinkOk = ((speed == ETH_SPEED_100M) && (duplex == ETH_FULLDUPLEX_MODE)) ? 1U : 0U;
+    ethernetif_eee_link(1U);
+#endif
+    /* What queued up meanwhile */
+    ethernetif_tx_kick(NULL);
+  }
+  else if (ms >= ETHIF_LINK_FLAP_MS)
+  {
+    LinkFlapSince = 0U;
+    LinkFlapHold = 0U;
+    LinkStats.expired++;
+    ethernetif_link_down(netif);
+  }
+}
+#endif /* ETHIF_LINK_FLAP_MS */
+
+/**
+  * @brief  Returns a snapshot of the link loss counters
+  * @param  stats: destination
+  * @retval None
+  */
+void ethernetif_get_link_stats(EthIfLinkStatsTypeDef *stats)
+{
+  if (stats != NULL)
+  {
+    *stats = LinkStats;
+  }
+}
+
+/**
+  * @brief  ETH_CODE: Returns the speed the MAC runs at, from its
+  *         configuration register; lock-free
+  * @retval bits per second, 10 or 100 Mbit/s
+  */
+uint32_t ethernetif_link_speed(void)
+{
+  return (READ_BIT(heth.Instance->MACCR, ETH_MACCR_FES) != 0U) ? 100000000U : 10000000U;
+}
+
 /**
   * @brief  Check the ETH link state then update ETH driver and netif link accordingly.
   * @retval None
@@ -837,19 +6231,71 @@ void ethernet_link_thread(void* argument)
    * code re-generation by STM32CubeMX
    */
 #define HAL_ETH_Start HAL_ETH_Start_IT
-  /* ETH_CODE: workaround to call LOCK_TCPIP_CORE when accessing netif link functions*/
-  LOCK_TCPIP_CORE();
+#if ETHIF_PHY_ASYNC
+  /* ETH_CODE: the PHY bring-up taken out of low_level_init(), in parallel
+   * with the rest of the startup. MDIO needs no core lock. */
+  reset_phy();
+  LAN8742_RegisterBusIO(&LAN8742, &LAN8742_IOCtx);
+  while (LAN8742_Init(&LAN8742) != LAN8742_STATUS_OK)
+  {
+    osDelay(100);
+  }
+#endif
+#if ETHIF_PHY_MODE != ETHIF_PHY_MODE_AUTO
+  ethernetif_phy_force();
+#endif
+#if ETHIF_PHY_IT
+  /* ETH_CODE: report link changes on nINT; reading ISFR deasserts it */
+  PhyItSemaphore = osSemaphoreNew(1, 0, &PhyItSemaphoreAttr);
+  LAN8742_EnableIT(&LAN8742, LAN8742_LINK_DOWN_IT | LAN8742_AUTONEGO_COMPLETE_IT);
+  LAN8742_ClearIT(&LAN8742, LAN8742_LINK_DOWN_IT | LAN8742_AUTONEGO_COMPLETE_IT);
+#endif
 /* USER CODE END ETH link init */
 
   for(;;)
   {
   PHYLinkState = LAN8742_GetLinkState(&LAN8742);
+#if ETHIF_PHY_MODE != ETHIF_PHY_MODE_AUTO
+  ethernetif_phy_poll(PHYLinkState);
+#endif
+  /* ETH_CODE: MDIO above runs unlocked, only the MAC/netif transitions
+   * below are serialised with the stack. */
+  LOCK_TCPIP_CORE();
 
+#if ETHIF_WOL
+  /* ETH_CODE: the MAC is parked; the resume restarts it and the next poll
+   * catches up with the link */
+  if (WolParked != 0U)
+  {
+  }
+  else
+#endif
+#if ETHIF_PKTGEN && ETHIF_RX_STEER
+  /* ETH_CODE: PHY loopback benchmark, the link state means nothing */
+  if (LoopbackActive != 0U)
+  {
+  }
+  else
+#endif
+#if ETHIF_LINK_FLAP_MS
+  /* ETH_CODE: link lost, the netif still up */
+  if (LinkFlapSince != 0U)
+  {
+    ethernetif_link_flap_poll(netif, PHYLinkState);
+  }
+  else
+#endif
   if(netif_is_link_up(netif) && (PHYLinkState <= LAN8742_STATUS_LINK_DOWN))
   {
-    HAL_ETH_Stop_IT(&heth);
-    netif_set_down(netif);
-    netif_set_link_down(netif);
+#if ETHIF_EEE
+    ethernetif_eee_link(0U);
+#endif
+#if ETHIF_LINK_FLAP_MS
+    ethernetif_link_flap_start();
+#else
+    LinkStats.downs++;
+    ethernetif_link_down(netif);
+#endif
   }
   else if(!netif_is_link_up(netif) && (PHYLinkState > LAN8742_STATUS_LINK_DOWN))
   {
@@ -889,14 +6335,43 @@ void ethernet_link_thread(void* argument)
       HAL_ETH_Start_IT(&heth);
       netif_set_up(netif);
       netif_set_link_up(netif);
+      BOOT_TIME_MARK(BOOT_TIME_LINK_UP); /* ETH_CODE */
+#if ETHIF_EEE
+      /* ETH_CODE: EEE exists on 100BASE-TX full duplex only */
+      EeeLinkOk = ((speed == ETH_SPEED_100M) && (duplex == ETH_FULLDUPLEX_MODE)) ? 1U : 0U;
+      ethernetif_eee_link(1U);
+#endif
     }
   }
 
 /* USER CODE BEGIN ETH link Thread core code for User BSP */
  /* ETH_CODE: workaround to call LOCK_TCPIP_CORE when accessing netif link functions*/
   UNLOCK_TCPIP_CORE();
+  linkchanged = 0U;
+#if ETHIF_PHY_IT
+  /* ETH_CODE: sleep until the PHY signals a change, then acknowledge it.
+   * A forced link coming up raises no interrupt: poll while waiting, and
+   * for the end of a link flap window. */
+#if ETHIF_LINK_FLAP_MS
+  if (LinkFlapSince != 0U)
+  {
+    osSemaphoreAcquire(PhyItSemaphore, pdMS_TO_TICKS(100U));
+  }
+  else
+#endif
+#if ETHIF_PHY_MODE != ETHIF_PHY_MODE_AUTO
+  if ((PhyForcedState != 0) && (PhyLinkWasUp == 0U))
+  {
+    osSemaphoreAcquire(PhyItSemaphore, pdMS_TO_TICKS(100U));
+  }
+  else
+#endif
+  osSemaphoreAcquire(PhyItSemaphore, (ETHIF_PHY_IT_POLL_MS != 0U) ? pdMS_TO_TICKS(ETHIF_PHY_IT_POLL_MS)
+                                                                  : osWaitForever);
+  LAN8742_ClearIT(&LAN8742, LAN8742_LINK_DOWN_IT | LAN8742_AUTONEGO_COMPLETE_IT);
+#else
   osDelay(100);
-  LOCK_TCPIP_CORE();
+#endif
   continue; /* skip next osDelay */
 /* USER CODE END ETH link Thread core code for User BSP */
 
@@ -904,14 +6379,15 @@ void ethernet_link_thread(void* argument)
   }
 }
 
-void HAL_ETH_RxAllocateCallback(uint8_t **buff)
+ITCM_FUNC void HAL_ETH_RxAllocateCallback(uint8_t **buff)
 {
 /* USER CODE BEGIN HAL ETH RxAllocateCallback */
   struct pbuf_custom *p = LWIP_MEMPOOL_ALLOC(RX_POOL);
   if (p)
   {
     /* Get the buff from the struct pbuf address. */
-    *buff = (uint8_t *)p + offsetof(RxBuff_t, buff);
+    *buff = (uint8_t *)p + offsetof(RxBuff_t, buff) + ETHIF_RX_OFFSET;
+    ethernetif_cache_rx_arm((RxBuff_t *)p);
     p->custom_free_function = pbuf_free_custom;
     /* Initialize the struct pbuf.
     * This must be performed whenever a buffer's allocated because it may be
@@ -921,12 +6397,16 @@ void HAL_ETH_RxAllocateCallback(uint8_t **buff)
   else
   {
     RxAllocStatus = RX_ALLOC_ERROR;
+    RxStats.alloc_fail++;
     *buff = NULL;
   }
+#if ETHIF_OOSEQ_EVICT
+  ethernetif_ooseq_check();
+#endif
 /* USER CODE END HAL ETH RxAllocateCallback */
 }
 
-void HAL_ETH_RxLinkCallback(void **pStart, void **pEnd, uint8_t *buff, uint16_t Length)
+ITCM_FUNC void HAL_ETH_RxLinkCallback(void **pStart, void **pEnd, uint8_t *buff, uint16_t Length)
 {
 /* USER CODE BEGIN HAL ETH RxLinkCallback */
 
@@ -935,7 +6415,7 @@ void HAL_ETH_RxLinkCallback(void **pStart, void **pEnd, uint8_t *buff, uint16_t
   struct pbuf *p = NULL;
 
   /* Get the struct pbuf from the buff address. */
-  p = (struct pbuf *)(buff - offsetof(RxBuff_t, buff));
+  p = (struct pbuf *)(buff - offsetof(RxBuff_t, buff) - ETHIF_RX_OFFSET);
   p->next = NULL;
   p->tot_len = 0;
   p->len = Length;
@@ -961,16 +6441,86 @@ void HAL_ETH_RxLinkCallback(void **pStart, void **pEnd, uint8_t *buff, uint16_t
   }
 
   /* Invalidate data cache because Rx DMA's writing to physical memory makes it stale. */
-  SCB_InvalidateDCache_by_Addr((uint32_t *)buff, Length);
+  ethernetif_cache_rx(buff, Length);
+
+#if ETHIF_RX_CSUM_DROP || ETHIF_ARP_OFFLOAD || ETHIF_PTP || (ETHIF_RX_PRIO && ETHIF_VLAN)
+  /* ETH_CODE: still owned by the CPU here, so the write-back status of the
+   * descriptor holding buff is stable. Only the last one carries it. */
+  for (uint32_t i = 0U, idx = ETHIF_RX_LINK_IDX; i < ETH_RX_DESC_CNT; i++)
+  {
+    ETH_DMADescTypeDef *desc = (ETH_DMADescTypeDef *)heth.RxDescList.RxDesc[idx];
+    if (desc->BackupAddr0 == (uint32_t)buff)
+    {
+      uint32_t desc3 = desc->DESC3;
+      if ((desc3 & ETH_DMARXNDESCWBF_LD) != 0U)
+      {
+#if ETHIF_RX_CSUM_DROP || ETHIF_ARP_OFFLOAD
+        RxFrameDrop = RX_FRAME_KEEP;
+#endif
+#if ETHIF_RX_CSUM_DROP
+        if (((desc3 & ETH_DMARXNDESCWBF_ES) != 0U) ||
+            (((desc3 & ETH_DMARXNDESCWBF_RS1V) != 0U) &&
+             ((desc->DESC1 & (ETH_DMARXNDESCWBF_IPHE | ETH_DMARXNDESCWBF_IPCE)) != 0U)))
+        {
+          RxFrameDrop = RX_FRAME_BAD;
+        }
+#endif
+#if ETHIF_ARP_OFFLOAD
+        /* ARP request the MAC has already replied to */
+        if (((desc3 & ETH_DMARXNDESCWBF_LT) == ETH_DMARXNDESCWBF_LT_ARP) &&
+            ((desc3 & ETH_DMARXNDESCWBF_RS2V) != 0U) && ((desc->DESC2 & ETH_DMARXNDESCWBF_ARPNR) == 0U))
+        {
+          RxFrameDrop = RX_FRAME_ARP;
+        }
+#endif
+#if ETHIF_RX_PRIO && ETHIF_VLAN
+        /* PCP of the tag the MAC stripped, RDES0 outer VLAN tag */
+        RxFramePrio = (((desc3 & ETH_DMARXNDESCWBF_RS0V) != 0U) &&
+                       (((desc->DESC0 & ETH_DMARXNDESCWBF_OVT) >> 13) >= ETHIF_VLAN_PRIO_PCP)) ? 1U : 0U;
+#endif
+#if ETHIF_PTP
+        /* The timestamp follows in a context descriptor, which
+         * HAL_ETH_ReadData() only consumes on its next call. */
+        RxBuff_t *first = (RxBuff_t *)*ppStart;
+        ETH_DMADescTypeDef *ctx = (ETH_DMADescTypeDef *)heth.RxDescList.RxDesc[(idx + 1U) % ETH_RX_DESC_CNT];
+        first->ts_valid = 0U;
+        if (((desc3 & ETH_DMARXNDESCWBF_RS1V) != 0U) && ((desc->DESC1 & ETH_DMARXNDESCWBF_TSA) != 0U) &&
+            ((ctx->DESC3 & (ETH_DMARXCDESC_OWN | ETH_DMARXCDESC_CTXT)) == ETH_DMARXCDESC_CTXT))
+        {
+          first->ts_nsec = ctx->DESC0;
+          first->ts_sec = ctx->DESC1;
+          first->ts_valid = 1U;
+        }
+#endif
+      }
+      break;
+    }
+    idx = (idx + 1U) % ETH_RX_DESC_CNT;
+  }
+#endif
 
 /* USER CODE END HAL ETH RxLinkCallback */
 }
 
-void HAL_ETH_TxFreeCallback(uint32_t * buff)
+ITCM_FUNC void HAL_ETH_TxFreeCallback(uint32_t * buff)
 {
 /* USER CODE BEGIN HAL ETH TxFreeCallback */
 
   pbuf_free((struct pbuf *)buff);
+#if ETHIF_DMA_PROF
+  DmaProf.freed++;
+#endif
+#if ETHIF_TX_SCHED
+  /* Frames complete in submission order */
+  if (TxRingTail != TxRingHead)
+  {
+    if (TxRingClass[TxRingTail % ETH_TX_DESC_CNT] != ETHIF_TX_CLASS_CONTROL)
+    {
+      TxRingLow--;
+    }
+    TxRingTail++;
+  }
+#endif
 
 /* USER CODE END HAL ETH TxFreeCallback */
 }
@@ -981,16 +6531,178 @@ void HAL_ETH_TxFreeCallback(uint32_t * buff)
 static osThreadId_t lwip_core_lock_holder_thread_id;
 static osThreadId_t lwip_tcpip_thread_id;
 
+#if ETHIF_CORE_LOCK_PROF
+/* ETH_CODE: core lock profile. Only written with the lock held. */
+typedef struct
+{
+  osThreadId_t thread;
+  EthIfCoreLockStatsTypeDef stats;
+} CoreLockSlotTypeDef;
+
+static CoreLockSlotTypeDef CoreLockSlot[ETHIF_CORE_LOCK_PROF_THREADS];
+static uint32_t CoreLockSlotCount;
+static CoreLockSlotTypeDef *CoreLockHolder;
+static uint32_t CoreLockAcquired;
+static uint32_t CoreLockResetTick;
+
+static CoreLockSlotTypeDef *ethernetif_core_lock_slot(osThreadId_t thread)
+{
+  for (uint32_t i = 0; i < CoreLockSlotCount; i++)
+  {
+    if (CoreLockSlot[i].thread == thread)
+    {
+      return &CoreLockSlot[i];
+    }
+  }
+  if (CoreLockSlotCount == ETHIF_CORE_LOCK_PROF_THREADS)
+  {
+    CoreLockSlotTypeDef *last = &CoreLockSlot[ETHIF_CORE_LOCK_PROF_THREADS - 1U];
+    strcpy(last->stats.name, "other");
+    return last;
+  }
+
+  CoreLockSlotTypeDef *slot = &CoreLockSlot[CoreLockSlotCount++];
+  const char *name = osThreadGetName(thread);
+  uint32_t i = 0U;
+
+  slot->thread = thread;
+  /* Usable as a metric name */
+  for (; (name != NULL) && (name[i] != '\0') && (i < sizeof(slot->stats.name) - 1U); i++)
+  {
+    char c = name[i];
+    slot->stats.name[i] = (((c >= '0') && (c <= '9')) || ((c >= 'A') && (c <= 'Z')) ||
+                           ((c >= 'a') && (c <= 'z'))) ? c : '_';
+  }
+  slot->stats.name[i] = '\0';
+  return slot;
+}
+#endif
+
 void sys_lock_tcpip_core(void){
+#if ETHIF_CORE_LOCK_PROF
+	osThreadId_t self = osThreadGetId();
+	uint8_t taken = (osMutexGetOwner(lock_tcpip_core) != NULL) ? 1U : 0U;
+	uint32_t t0 = DWT->CYCCNT;
+	sys_mutex_lock(&lock_tcpip_core);
+	CoreLockAcquired = DWT->CYCCNT;
+
+	CoreLockSlotTypeDef *slot = ethernetif_core_lock_slot(self);
+	uint32_t wait = CoreLockAcquired - t0;
+	slot->stats.acquired++;
+	slot->stats.contended += taken;
+	slot->stats.wait_cycles += wait;
+	if (wait > slot->stats.wait_max_cycles)
+	{
+		slot->stats.wait_max_cycles = wait;
+	}
+	CoreLockHolder = slot;
+	lwip_core_lock_holder_thread_id = self;
+#else
 	sys_mutex_lock(&lock_tcpip_core);
 	lwip_core_lock_holder_thread_id = osThreadGetId();
+#endif
 }
 
 void sys_unlock_tcpip_core(void){
+#if ETHIF_CORE_LOCK_PROF
+	uint32_t hold = DWT->CYCCNT - CoreLockAcquired;
+	CoreLockHolder->stats.hold_cycles += hold;
+	if (hold > CoreLockHolder->stats.hold_max_cycles)
+	{
+		CoreLockHolder->stats.hold_max_cycles = hold;
+	}
+#endif
 	lwip_core_lock_holder_thread_id = 0;
 	sys_mutex_unlock(&lock_tcpip_core);
 }
 
+#if ETHIF_CORE_LOCK_PROF
+/* ETH_CODE: the raw mutex, so that reading the profile does not show in it */
+static uint8_t ethernetif_core_lock_enter(void)
+{
+  if (lwip_core_lock_holder_thread_id == osThreadGetId())
+  {
+    return 0U;
+  }
+  sys_mutex_lock(&lock_tcpip_core);
+  return 1U;
+}
+
+uint32_t ethernetif_core_lock_get(EthIfCoreLockStatsTypeDef *stats, uint32_t max, uint32_t *window_ms)
+{
+  uint8_t locked = ethernetif_core_lock_enter();
+  uint32_t n = LWIP_MIN(CoreLockSlotCount, max);
+
+  for (uint32_t i = 0; i < n; i++)
+  {
+    stats[i] = CoreLockSlot[i].stats;
+  }
+  if (window_ms != NULL)
+  {
+    *window_ms = HAL_GetTick() - CoreLockResetTick;
+  }
+  if (locked)
+  {
+    sys_mutex_unlock(&lock_tcpip_core);
+  }
+  return n;
+}
+
+void ethernetif_core_lock_reset(void)
+{
+  uint8_t locked = ethernetif_core_lock_enter();
+
+  /* Threads keep their entries, a holder its pointer */
+  for (uint32_t i = 0; i < CoreLockSlotCount; i++)
+  {
+    EthIfCoreLockStatsTypeDef *st = &CoreLockSlot[i].stats;
+    st->acquired = 0U;
+    st->contended = 0U;
+    st->wait_cycles = 0U;
+    st->wait_max_cycles = 0U;
+    st->hold_cycles = 0U;
+    st->hold_max_cycles = 0U;
+  }
+  CoreLockResetTick = HAL_GetTick();
+  if (locked)
+  {
+    sys_mutex_unlock(&lock_tcpip_core);
+  }
+}
+#endif
+
+#if ETHIF_CORE_LOCK_CHECK == 1
+/* ETH_CODE: release check, counted instead of halting */
+static volatile uint32_t CoreLockViolations;
+
+uint32_t ethernetif_core_lock_violations(void)
+{
+  return CoreLockViolations;
+}
+
+ITCM_FUNC void sys_check_core_locking(void){
+  /* xTaskGetCurrentTaskHandle() is a load, osThreadGetId() also checks
+   * for interrupt context; an ISR caller shows as a mismatch anyway */
+#if LWIP_TCPIP_CORE_LOCKING
+  void *expected = lwip_core_lock_holder_thread_id;
+#else
+  void *expected = lwip_tcpip_thread_id;
+#endif
+  if ((lwip_tcpip_thread_id != 0) && ((void *)xTaskGetCurrentTaskHandle() != expected))
+  {
+    if (CoreLockViolations++ == 0U)
+    {
+      LOG_ERROR("ETH", "lwIP API called without the core lock, by %s",
+                (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) ? "an ISR" : pcTaskGetName(NULL));
+    }
+  }
+}
+#elif ETHIF_CORE_LOCK_CHECK
+uint32_t ethernetif_core_lock_violations(void)
+{
+  return 0U;
+}
+
 void sys_check_core_locking(void){
   /* Embedded systems should check we are NOT in an interrupt context here */
 
@@ -1002,9 +6714,9 @@ void sys_check_core_locking(void){
 #if LWIP_TCPIP_CORE_LOCKING
 	LWIP_ASSERT("Function called without core lock", current_thread_id == lwip_core_lock_holder_thread_id);
 	/* ETH_CODE: to easily check that example has correct handling of core lock
-	 * This will trigger breakpoint (__BKPT)
+	 * This will trigger breakpoint (__BKPT). Debug check only, see
+	 * ETHIF_CORE_LOCK_CHECK.
 	 */
-#warning Below check should be removed in production code
 	if(current_thread_id != lwip_core_lock_holder_thread_id) __BKPT(0);
 #else /* LWIP_TCPIP_CORE_LOCKING */
 	LWIP_ASSERT("Function called from wrong thread", current_thread_id == lwip_tcpip_thread_id);
@@ -1012,6 +6724,12 @@ void sys_check_core_locking(void){
 	LWIP_UNUSED_ARG(current_thread_id); /* for LWIP_NOASSERT */
   }
 }
+#else
+uint32_t ethernetif_core_lock_violations(void)
+{
+  return 0U;
+}
+#endif /* ETHIF_CORE_LOCK_CHECK */
 void sys_mark_tcpip_thread(void){
 	lwip_tcpip_thread_id = osThreadGetId();
 }
@@ -41,5 +41,473 @@ u32_t sys_now(void);
 
 /* USER CODE BEGIN 1 */
 void reset_phy(void);
+
+/* Receive path counters (snapshot, never reset) */
+typedef struct
+{
+  uint32_t frames;         /* frames passed up */
+  uint32_t bytes;
+  uint32_t rbu;            /* DMA receive buffer unavailable events */
+  uint32_t alloc_fail;     /* RX_POOL exhausted while rebuilding descriptors */
+  uint32_t refill_retry;   /* descriptor rebuilds retried by timeout */
+  uint32_t irq;            /* RX interrupts taken */
+  uint32_t budget_hits;    /* poll passes that ended on ETHIF_RX_POLL_BUDGET */
+  uint32_t batches;        /* batches handed to the tcpip thread */
+  uint32_t queue_drops;    /* frames dropped, RX queue full */
+  uint32_t mbox_full;      /* TCPIP_MBOX full: frame dropped, or batch left queued */
+  uint32_t csum_drops;     /* frames dropped on a descriptor error/checksum status */
+  uint32_t arp_offloaded;  /* ARP requests answered by the MAC and dropped */
+  uint32_t prio;           /* frames queued ahead of bulk traffic (VLAN PCP, control) */
+  uint32_t udp_fast;       /* datagrams handed to a UDP fast path port */
+  uint32_t udp_fast_drops; /* of those, dropped on a full fast path queue */
+  uint32_t steered;        /* frames handed to an RX steering rule */
+  uint32_t steer_drops;    /* of those, dropped on a full steering queue */
+  uint32_t copied;         /* small frames moved to RX_SMALL (ETHIF_RX_COPY_MAX) */
+  uint32_t copy_fail;      /* small frames left in RX_POOL, RX_SMALL empty */
+  uint32_t admit_level;    /* overload level now, 0: all admitted (ETHIF_RX_ADMIT) */
+  uint32_t overloads;      /* times the level left 0 */
+  uint32_t admit_bcast;    /* frames shed: broadcast or multicast */
+  uint32_t admit_port;     /* frames shed: no local port, or not IP */
+  uint32_t admit_bulk;     /* frames shed: bulk */
+} EthIfRxStatsTypeDef;
+
+void ethernetif_get_rx_stats(EthIfRxStatsTypeDef *stats);
+
+/* Transmit path counters (snapshot, never reset) */
+typedef struct
+{
+  uint32_t frames;         /* frames handed to the DMA */
+  uint32_t bytes;
+  uint32_t busy;           /* attempts that found no free descriptor (ERR_BUF) */
+  uint32_t errors;         /* frames dropped with ERR_IF */
+  uint32_t queued;         /* frames deferred to the software TX queue */
+  uint32_t queue_drops;    /* frames refused with ERR_MEM, queue full */
+  uint32_t coalesced;      /* copied to a bounce buffer (long chain, DTCM) */
+  uint32_t batches;        /* tail pointer writes sending a batch */
+  uint32_t batched;        /* frames sent by those writes */
+  uint32_t csum_sw;        /* jumbo frames checksummed by the driver (ETHIF_JUMBO) */
+} EthIfTxStatsTypeDef;
+
+void ethernetif_get_tx_stats(EthIfTxStatsTypeDef *stats);
+
+/* TX scheduler classes (ETHIF_TX_SCHED), picked from the IP precedence.
+ * A PCB sets its class with pcb->tos = ETHIF_TOS_xxx, a single frame with
+ * ETHIF_META_CLASS. */
+typedef enum
+{
+  ETHIF_TX_CLASS_CONTROL = 0,
+  ETHIF_TX_CLASS_TELEMETRY,
+  ETHIF_TX_CLASS_LOGGING,
+  ETHIF_TX_CLASS_BULK,
+  ETHIF_TX_CLASS_CNT
+} EthIfTxClassTypeDef;
+
+#define ETHIF_TOS_CONTROL      0xB8U   /* DSCP EF */
+#define ETHIF_TOS_TELEMETRY    0x68U   /* DSCP AF31 */
+#define ETHIF_TOS_LOGGING      0x40U   /* DSCP CS2 */
+#define ETHIF_TOS_BULK         0x00U
+
+/* Per-packet metadata (LWIP_PBUF_CUSTOM_DATA, lwipopts.h), on the first
+ * pbuf of a frame:
+ *   p->meta_stamp  DWT cycle count: the RX interrupt with ETHIF_RX_LATENCY,
+ *                  the hand-over on the EthIf task otherwise
+ *   p->meta_class  EthIfTxClassTypeDef: received, CONTROL for the priority
+ *                  queue, BULK otherwise; to send, the class to use
+ *   p->meta_queue  ETHIF_META_Q_xxx, the way a received frame took
+ *   p->meta_flags  ETHIF_META_xxx
+ * Set for every received frame, copies (ETHIF_RX_COPY_MAX) included, and
+ * kept while lwIP strips headers, by pbuf_ref() and by pbuf_clone() (the
+ * NETCONN_RX_COPY copies); a header pbuf put in front starts empty. */
+#define ETHIF_META_STAMP       0x01U   /* meta_stamp valid */
+#define ETHIF_META_CLASS       0x02U   /* to send: meta_class overrides the IP precedence */
+#define ETHIF_META_HWTS        0x04U   /* PTP receive timestamp, ethernetif_ptp_get_rx_timestamp() */
+
+#define ETHIF_META_Q_NONE      0U
+#define ETHIF_META_Q_FAST      1U      /* UDP fast path handler */
+#define ETHIF_META_Q_STEER     2U      /* RX steering rule */
+#define ETHIF_META_Q_PRIO      3U      /* priority queue to the tcpip thread */
+#define ETHIF_META_Q_BULK      4U      /* bulk queue to the tcpip thread */
+#define ETHIF_META_Q_MBOX      5U      /* posted one by one (no ETHIF_RX_BATCH) */
+
+typedef struct
+{
+  uint32_t frames;         /* handed to the DMA */
+  uint32_t bytes;
+  uint32_t queued;         /* waited in the class queue */
+  uint32_t queue_drops;    /* refused with ERR_MEM, class queue full */
+  uint32_t delay_max_us;   /* longest wait in the class queue */
+  uint32_t shaped;         /* held back for want of tokens (ETHIF_TX_SHAPE) */
+} EthIfTxClassStatsTypeDef;
+
+/* One entry per class; zeros without ETHIF_TX_SCHED */
+void ethernetif_get_tx_class_stats(EthIfTxClassStatsTypeDef stats[ETHIF_TX_CLASS_CNT]);
+
+/* Token bucket of a non-control class (ETHIF_TX_SHAPE): rate_kbps 0 leaves
+ * it unshaped, burst in bytes, at least one full frame. Core lock held.
+ * ERR_VAL for the control class or a short burst, ERR_ARG without
+ * ETHIF_TX_SHAPE. */
+err_t ethernetif_tx_shape_set(EthIfTxClassTypeDef c, uint32_t rate_kbps, uint32_t burst);
+
+/* Frames class c can still queue before refusing one; core lock held */
+uint32_t ethernetif_tx_class_room(EthIfTxClassTypeDef c);
+
+/* Time-triggered transmit (ETHIF_TX_TT). Frames sent between
+ * ethernetif_tx_window_open() and ethernetif_tx_window_close(), with the
+ * core lock held throughout, start leaving the MAC when time_now_ns()
+ * reaches at_ns. Open returns ERR_INPROGRESS while the previous window is
+ * armed and ERR_VAL for an at_ns more than ETHIF_TX_TT_LEAD_MAX_US ahead;
+ * inside the window a frame finding no free descriptor is refused with
+ * ERR_MEM. ERR_ARG from both without ETHIF_TX_TT. */
+err_t ethernetif_tx_window_open(uint64_t at_ns);
+err_t ethernetif_tx_window_close(void);
+
+typedef struct
+{
+  uint32_t windows;        /* closed with at least one frame */
+  uint32_t frames;
+  uint32_t drops;          /* refused in a window, no free descriptor */
+  uint32_t late;           /* closed under ETHIF_TX_TT_LEAD_MIN_NS ahead, sent at once */
+  uint32_t held;           /* other frames queued while a window was armed */
+  uint32_t err_last_ns;    /* |tail pointer write - at_ns| */
+  uint32_t err_max_ns;
+} EthIfTxTtStatsTypeDef;
+
+void ethernetif_get_tx_tt_stats(EthIfTxTtStatsTypeDef *stats);
+
+/* Core clock changes at run time (clock/clock_dvfs.h), core lock held and
+ * interrupts masked around the switch: prepare() returns 0 when the clock
+ * must stay (time-triggered window pending, PTP), changed() re-derives the
+ * MDC divider, RX watchdog, shaper rates and window timer scale. */
+uint8_t ethernetif_clock_prepare(void);
+void ethernetif_clock_changed(void);
+
+/* All driver counters. Each counter has a single writer (EthIf task, ETH
+ * interrupt or core-locked context) and is read without locking. */
+typedef struct
+{
+  EthIfRxStatsTypeDef rx;
+  EthIfTxStatsTypeDef tx;
+  uint32_t dma_errors;     /* abnormal DMA interrupts other than RBU */
+  uint32_t mac_errors;     /* MAC RX/TX status errors */
+} EthIfStatsTypeDef;
+
+void ethernetif_get_stats(EthIfStatsTypeDef *stats);
+void ethernetif_log_stats(void);
+
+/* Link losses (ETHIF_LINK_FLAP_MS) */
+typedef struct
+{
+  uint32_t downs;          /* link lost */
+  uint32_t flaps;          /* back within the window, nothing restarted */
+  uint32_t restarts;       /* back within the window at another speed */
+  uint32_t expired;        /* window ran out, netif taken down */
+  uint32_t flap_last_ms;   /* link lost to back, last flap or restart */
+  uint32_t flap_max_ms;
+  uint32_t tx_reclaimed;   /* frames the DMA still held at a MAC stop */
+} EthIfLinkStatsTypeDef;
+
+void ethernetif_get_link_stats(EthIfLinkStatsTypeDef *stats);
+
+/* Speed the MAC is configured for, bits per second; the last link's while
+ * the link is down */
+uint32_t ethernetif_link_speed(void);
+
+/* Energy Efficient Ethernet (ETHIF_EEE) counters. Wake times are measured
+ * from the submission of a frame found TX in LPI to its TX complete. */
+typedef struct
+{
+  uint32_t tx_entry;       /* MAC LPI events (HAL_ETHEx_GetMACLPIEvent()) */
+  uint32_t tx_exit;
+  uint32_t rx_entry;
+  uint32_t rx_exit;
+  uint32_t tx_lpi_us;      /* time spent in LPI, MMC counters */
+  uint32_t rx_lpi_us;
+  uint32_t wakes;          /* frames that had to wake the transmitter */
+  uint32_t wake_last_us;
+  uint32_t wake_max_us;
+  uint32_t over_budget;    /* wakes longer than ETHIF_EEE_WAKE_BUDGET_US */
+  uint8_t active;          /* negotiated, enabled and LPI allowed */
+} EthIfEeeStatsTypeDef;
+
+void ethernetif_get_eee_stats(EthIfEeeStatsTypeDef *stats);
+void ethernetif_eee_enable(uint8_t enable);
+
+/* Wake-on-LAN standby (ETHIF_WOL). Times are measured from the PMT
+ * interrupt, or from the timeout for a local wake. */
+typedef enum
+{
+  ETHIF_WAKE_NONE = 0,     /* not parked: the link is down */
+  ETHIF_WAKE_MAGIC,        /* magic packet */
+  ETHIF_WAKE_FILTER,       /* frame to one of ETHIF_WOL_PORTS */
+  ETHIF_WAKE_TIMEOUT       /* timeout_ms passed */
+} EthIfWakeTypeDef;
+
+typedef struct
+{
+  uint32_t standbys;
+  uint32_t magic;          /* wakes by cause */
+  uint32_t filter;
+  uint32_t timeout;
+  uint32_t resume_last_us; /* wake to MAC and DMA running again */
+  uint32_t resume_max_us;
+  uint32_t first_rx_us;    /* wake to the first frame received, last standby */
+  uint32_t first_tx_us;    /* wake to the first TX complete, last standby */
+} EthIfWolStatsTypeDef;
+
+/* Parks the MAC and blocks the calling task until a wake event or
+ * timeout_ms (0: none). The core idles in the meantime (tickless.h). lwIP
+ * is left as it is: TCP connections and timers carry on, frames queued for
+ * TX are dropped. Call from a task, not holding the core lock. */
+EthIfWakeTypeDef ethernetif_standby(uint32_t timeout_ms);
+void ethernetif_get_wol_stats(EthIfWolStatsTypeDef *stats);
+
+/* Data path profile (ETHIF_DMA_PROF), CPU cycles since boot or
+ * ethernetif_dma_prof_reset(). rx covers every HAL_ETH_ReadData() call,
+ * empty ones included, tx the submit calls that queued a frame and release
+ * every HAL_ETH_ReleaseTxPacket() call. */
+typedef struct
+{
+  uint8_t lean;            /* ETHIF_LEAN_DMA path */
+  uint32_t rx_frames;
+  uint64_t rx_cycles;
+  uint32_t tx_frames;
+  uint64_t tx_cycles;
+  uint32_t freed;          /* frames released */
+  uint64_t release_cycles;
+} EthIfDmaProfTypeDef;
+
+void ethernetif_dma_prof_get(EthIfDmaProfTypeDef *prof);
+void ethernetif_dma_prof_reset(void);
+
+/* Asynchronous MDIO (ETHIF_MDIO_ASYNC). The operation is queued and done
+ * runs on the FreeRTOS timer task once it completed: status 0, or -1 on a
+ * bus timeout; val is the register read (0 for a write). done must not
+ * block, it may queue further operations. Returns 0 if the queue is full
+ * or without ETHIF_MDIO_ASYNC. From tasks only. */
+typedef void (*EthIfMdioDoneTypeDef)(void *arg, int32_t status, uint32_t val);
+
+uint8_t ethernetif_mdio_read(uint32_t dev, uint32_t reg, EthIfMdioDoneTypeDef done, void *arg);
+uint8_t ethernetif_mdio_write(uint32_t dev, uint32_t reg, uint32_t val, EthIfMdioDoneTypeDef done, void *arg);
+
+/* Hardware L3/L4 receive filters (MACL3L4CxR), two on the H7 MAC. While
+ * filtering is enabled the MAC discards IPv4 packets matching none of the
+ * programmed filters; non-IP frames (ARP) are not affected. */
+#define ETHIF_RX_FILTER_CNT 2U
+
+typedef struct
+{
+  ip4_addr_t src_addr;     /* compared on the upper src_prefix bits */
+  ip4_addr_t dst_addr;
+  uint8_t src_prefix;      /* 0: any source, 32: exact address */
+  uint8_t dst_prefix;      /* 0: any destination */
+  uint8_t proto;           /* IP_PROTO_TCP or IP_PROTO_UDP, used with ports */
+  uint16_t src_port;       /* 0: any, host byte order */
+  uint16_t dst_port;
+} EthIfRxFilterTypeDef;
+
+/* IEEE 1588 support (ETHIF_PTP). Times are MAC system time, digital
+ * rollover (nanoseconds 0 .. 999999999). */
+typedef struct
+{
+  uint32_t sec;
+  uint32_t nsec;
+} EthIfPtpTimeTypeDef;
+
+/* Set in pbuf->flags of any pbuf of an outgoing frame to have its transmit
+ * time reported to the TX hook. */
+#define ETHIF_PBUF_FLAG_TSTAMP 0x80U
+
+/* Called on the tcpip thread when a flagged frame has left the MAC; p is
+ * the whole frame, still valid for the duration of the call. */
+typedef void (*EthIfPtpTxHook)(struct pbuf *p, const EthIfPtpTimeTypeDef *ts);
+
+err_t ethernetif_ptp_get_rx_timestamp(const struct pbuf *p, EthIfPtpTimeTypeDef *ts);
+void ethernetif_ptp_set_tx_hook(EthIfPtpTxHook hook);
+err_t ethernetif_ptp_get_time(EthIfPtpTimeTypeDef *time);
+err_t ethernetif_ptp_set_time(const EthIfPtpTimeTypeDef *time);
+err_t ethernetif_ptp_adjust_time(int64_t offset_ns);
+err_t ethernetif_ptp_adjust_freq(int32_t ppb);
+
+/* Receive latency trace (ETHIF_RX_LATENCY). Every stage is measured from
+ * the RX DMA interrupt; frames read in a wakeup without one (refill retry)
+ * are measured from the wakeup. */
+typedef enum
+{
+  ETHIF_RXLAT_WAKE = 0,    /* EthIf task running, once per interrupt */
+  ETHIF_RXLAT_POST,        /* queued or posted to the tcpip thread */
+  ETHIF_RXLAT_INPUT,       /* ethernet_input() entered, tcpip thread or ETHIF_RX_INLINE */
+  ETHIF_RXLAT_DONE,        /* ethernet_input() returned, raw API callbacks run */
+  ETHIF_RXLAT_APP,         /* ethernetif_rx_latency_mark() by the application */
+  ETHIF_RXLAT_CNT
+} EthIfRxLatStageTypeDef;
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t p50_ns;         /* bin upper bounds, within 25 % */
+  uint32_t p99_ns;
+  uint32_t p999_ns;
+  uint32_t max_ns;
+} EthIfRxLatTypeDef;
+
+void ethernetif_rx_latency_mark(const struct pbuf *p);
+void ethernetif_rx_latency_get(EthIfRxLatStageTypeDef stage, EthIfRxLatTypeDef *lat);
+void ethernetif_rx_latency_reset(void);
+
+/* lwIP core lock profile (ETHIF_CORE_LOCK_PROF), per thread, in CPU
+ * cycles since boot or ethernetif_core_lock_reset() */
+typedef struct
+{
+  char name[16];           /* thread name at its first acquisition */
+  uint32_t acquired;
+  uint32_t contended;      /* found the lock held by another thread */
+  uint64_t wait_cycles;
+  uint32_t wait_max_cycles;
+  uint64_t hold_cycles;
+  uint32_t hold_max_cycles;
+} EthIfCoreLockStatsTypeDef;
+
+/* Copies up to max entries and returns their number; window_ms (may be
+ * NULL) receives the time covered. From any task, core lock held or not. */
+uint32_t ethernetif_core_lock_get(EthIfCoreLockStatsTypeDef *stats, uint32_t max, uint32_t *window_ms);
+void ethernetif_core_lock_reset(void);
+
+/* lwIP API calls made without the core lock, counted with
+ * ETHIF_CORE_LOCK_CHECK 1; 0 otherwise */
+uint32_t ethernetif_core_lock_violations(void);
+
+err_t ethernetif_set_rx_filter(uint32_t index, const EthIfRxFilterTypeDef *filter);
+void ethernetif_enable_rx_filter(uint8_t enable);
+
+/* UDP fast path (ETHIF_UDP_FAST). IPv4 datagrams for a registered local
+ * port (unicast to the netif address, broadcast or multicast, not
+ * fragmented) never reach lwIP. p starts at the UDP payload and holds
+ * exactly the datagram; the receiver owns it and frees it with pbuf_free()
+ * from any task. The handler runs on the EthIf task, ahead of all other
+ * receive processing: copy, post or signal, nothing longer. */
+typedef void (*EthIfUdpFastFn)(struct pbuf *p, const ip4_addr_t *src, uint16_t src_port, void *arg);
+
+/* Element of a queue given to ethernetif_udp_fast_queue() */
+typedef struct
+{
+  struct pbuf *p;
+  ip4_addr_t src;
+  uint16_t src_port;       /* host byte order */
+} EthIfUdpFastMsgTypeDef;
+
+err_t ethernetif_udp_fast_register(uint16_t port, EthIfUdpFastFn fn, void *arg);
+err_t ethernetif_udp_fast_queue(uint16_t port, osMessageQueueId_t queue);
+void ethernetif_udp_fast_unregister(uint16_t port);
+
+/* RX steering (ETHIF_RX_STEER). A rule matches an EtherType (host byte
+ * order) and, for IPv4 and IPv6, an IP protocol / next header, or any with
+ * ETHIF_RX_STEER_ANY. p is the whole frame from the Ethernet header, with
+ * its PTP timestamp if it has one; the receiver owns it and frees it with
+ * pbuf_free() from any task. No address or checksum check beyond the MAC's
+ * is made. The handler runs on the EthIf task: copy, post or signal. */
+#define ETHIF_RX_STEER_ANY       0xFFFFU
+
+typedef void (*EthIfRxSteerFn)(struct pbuf *p, void *arg);
+
+err_t ethernetif_rx_steer_register(uint16_t type, uint16_t proto, EthIfRxSteerFn fn, void *arg);
+/* queue elements are struct pbuf * */
+err_t ethernetif_rx_steer_queue(uint16_t type, uint16_t proto, osMessageQueueId_t queue);
+void ethernetif_rx_steer_unregister(uint16_t type, uint16_t proto);
+
+/* DMA and MTL profile. The DMA moves bursts of up to *_pbl beats (times
+ * eight with pbl_x8) of 64 bits over AXI; aligned_beats and fixed_burst
+ * shape them for the bus matrix. osf lets the TX DMA fetch the next frame
+ * before the status of the previous one is back. A FIFO threshold of 0 is
+ * store and forward: the whole frame is in the FIFO before the MAC sends
+ * it (TX) or the DMA moves it (RX); otherwise that many bytes, cut-through.
+ * RX cut-through hands a frame over about a frame time earlier; a frame
+ * with a bad FCS then gets as far as the descriptors, where it is
+ * dropped. */
+typedef struct
+{
+  uint8_t tx_pbl;          /* beats per TX burst: 1, 2, 4, 8, 16 or 32 */
+  uint8_t rx_pbl;          /* beats per RX burst, likewise */
+  uint8_t pbl_x8;
+  uint8_t fixed_burst;     /* fixed-length AHB/AXI bursts, else mixed */
+  uint8_t aligned_beats;
+  uint8_t osf;             /* operate on second frame */
+  uint16_t tx_threshold;   /* 0, 32, 64, 96, 128, 192, 256, 384 or 512 */
+  uint16_t rx_threshold;   /* 0, 32, 64, 96 or 128 */
+} EthIfDmaProfileTypeDef;
+
+typedef enum
+{
+  ETHIF_DMA_PROFILE_DEFAULT = 0,   /* the HAL's: 32 beats, store and forward */
+  ETHIF_DMA_PROFILE_LATENCY,       /* cut-through both ways, OSF */
+  ETHIF_DMA_PROFILE_THROUGHPUT,    /* store and forward, OSF */
+  ETHIF_DMA_PROFILE_CNT
+} EthIfDmaProfileIdTypeDef;
+
+err_t ethernetif_dma_profile_preset(EthIfDmaProfileIdTypeDef id, EthIfDmaProfileTypeDef *prof);
+err_t ethernetif_dma_profile_set(const EthIfDmaProfileTypeDef *prof);
+void ethernetif_dma_profile_get(EthIfDmaProfileTypeDef *prof);
+
+/* Raw Ethernet channel (ETHIF_RAW). p is a whole frame from the
+ * Ethernet header, no FCS; the MAC pads it to 60 bytes. It goes out in
+ * class cls, queued behind others of its class when the ring is full, like
+ * the stack's. The caller keeps p, as with netif->linkoutput(): PBUF_RAM
+ * can be freed at once, PBUF_REF / PBUF_ROM data must stay until the frame
+ * has been sent. Receive with an RX steering rule for the EtherType. */
+err_t ethernetif_raw_send(struct pbuf *p, EthIfTxClassTypeDef cls);
+/* Builds the frame to dst (the netif's MAC as source, type in host byte
+ * order) from a copy of len bytes of data and sends it */
+err_t ethernetif_raw_sendto(const uint8_t dst[6], uint16_t type, const void *data, uint16_t len,
+                            EthIfTxClassTypeDef cls);
+
+/* Traffic generator (ETHIF_PKTGEN). Frames are dst, the netif's MAC,
+ * ETHIF_PKTGEN_TYPE, "PKTG", a 32-bit sequence number (big endian), the
+ * sender's cycle count and zeros. A peer sending them back, sequence
+ * number and cycle count untouched, is counted as echo. */
+typedef struct
+{
+  uint8_t dst[6];
+  uint16_t len;            /* from the Ethernet header, no FCS: 60 to ETHIF_MTU + 14 */
+  uint32_t rate_pps;       /* 0: as fast as the descriptors free up */
+  uint32_t count;          /* 0: until ethernetif_pktgen_stop() */
+} EthIfPktgenConfigTypeDef;
+
+typedef struct
+{
+  uint32_t sent;           /* handed to the DMA */
+  uint32_t completed;      /* released by the DMA */
+  uint32_t ring_full;      /* a free buffer found no free descriptor */
+  uint32_t echoed;         /* generator frames received back */
+  uint32_t echo_lost;      /* gaps in their sequence numbers */
+  uint32_t echo_late;      /* behind the newest one received */
+  uint32_t echo_lat_min_ns; /* echoes in order, from the hand-over to */
+  uint32_t echo_lat_avg_ns; /* the DMA to their receive stamp */
+  uint32_t echo_lat_max_ns; /* (p->meta_stamp) */
+  uint64_t bytes;          /* sent, without FCS */
+  uint32_t elapsed_ms;     /* since the start, up to the stop */
+  uint8_t running;
+} EthIfPktgenStatsTypeDef;
+
+err_t ethernetif_pktgen_start(const EthIfPktgenConfigTypeDef *cfg);
+void ethernetif_pktgen_stop(void);
+void ethernetif_pktgen_get_stats(EthIfPktgenStatsTypeDef *stats);
+
+/* PHY loopback benchmark: the generator at full rate or a set one,
+ * addressed to the netif's own MAC, with the PHY looping every frame back,
+ * so each frame takes the whole TX and RX path of the driver. At full rate
+ * the latency is mostly the wait in the ring; paced, it is the path. */
+typedef struct
+{
+  uint32_t sent;
+  uint32_t received;       /* came back through the RX path */
+  uint32_t elapsed_ms;
+  uint32_t fps;            /* received per second */
+  uint32_t cpu_permille;   /* CPU not idle during the run, all tasks */
+  uint32_t cycles_per_frame; /* busy cycles / received */
+  uint32_t lat_min_ns;     /* hand-over to the DMA to the receive stamp */
+  uint32_t lat_avg_ns;
+  uint32_t lat_max_ns;
+} EthIfLoopbackResultTypeDef;
+
+err_t ethernetif_loopback_bench(uint16_t len, uint32_t ms, uint32_t rate_pps, EthIfLoopbackResultTypeDef *res);
 /* USER CODE END 1 */
 #endif
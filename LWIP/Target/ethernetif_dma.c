@@ -0,0 +1,344 @@
+/**
+ * @file ethernetif_dma.c
+ * @brief Lean ETH DMA data path, see ethernetif_dma.h.
+ */
+
+#include "main.h"
+#include "ethernetif_opts.h"
+
+#if ETHIF_LEAN_DMA
+
+#include "ethernetif_dma.h"
+
+uint32_t ethernetif_dma_rx_idx;
+
+#ifdef HAL_ETH_USE_PTP
+/* Set by ethernetif_dma_tx_tstamp(), taken by the next transmit */
+static uint8_t EthDmaTxTstamp;
+#endif
+
+/* Re-arms the RxBuildDescCnt descriptors from RxBuildDescIdx on, with a
+ * new buffer where the last one was handed up, and moves the tail pointer
+ * once. DESC0 is rewritten every time: the write-back of a context
+ * descriptor, which keeps its buffer, overwrote it. */
+static ITCM_FUNC void ethernetif_dma_refill(ETH_HandleTypeDef *heth)
+{
+  ETH_RxDescListTypeDef *list = &heth->RxDescList;
+  uint32_t idx = list->RxBuildDescIdx;
+  uint32_t cnt = list->RxBuildDescCnt;
+  const uint32_t desc3 = ETH_DMARXNDESCRF_OWN | ETH_DMARXNDESCRF_BUF1V |
+                         ((list->ItMode != 0U) ? ETH_DMARXNDESCRF_IOC : 0U);
+
+  while (cnt > 0U)
+  {
+    ETH_DMADescTypeDef *d = &heth->Init.RxDesc[idx];
+    uint32_t buff = d->BackupAddr0;
+
+    if (buff == 0U)
+    {
+      uint8_t *p = NULL;
+
+      HAL_ETH_RxAllocateCallback(&p);
+      if (p == NULL)
+      {
+        break;
+      }
+      buff = (uint32_t)p;
+      d->BackupAddr0 = buff;
+    }
+    d->DESC0 = buff;
+    d->DESC3 = desc3;
+    idx = (idx + 1U < ETH_RX_DESC_CNT) ? idx + 1U : 0U;
+    cnt--;
+  }
+
+  if (cnt != list->RxBuildDescCnt)
+  {
+    __DMB();
+    WRITE_REG(heth->Instance->DMACRDTPR,
+              (uint32_t)&heth->Init.RxDesc[(idx != 0U) ? idx - 1U : ETH_RX_DESC_CNT - 1U]);
+    list->RxBuildDescIdx = idx;
+    list->RxBuildDescCnt = cnt;
+  }
+}
+
+/**
+  * @brief  HAL_ETH_ReadData() on the rings directly: links the buffers of
+  *         the next complete frame and re-arms what it went through
+  * @param  heth: ETH handle
+  * @param  pAppBuff: the frame, from HAL_ETH_RxLinkCallback()'s pStart
+  * @retval HAL_OK with a frame, HAL_ERROR without one or stopped
+  */
+ITCM_FUNC HAL_StatusTypeDef ethernetif_dma_read(ETH_HandleTypeDef *heth, void **pAppBuff)
+{
+  ETH_RxDescListTypeDef *list = &heth->RxDescList;
+  uint32_t idx = list->RxDescIdx;
+  uint32_t left = ETH_RX_DESC_CNT - list->RxBuildDescCnt;
+  uint32_t done = 0U;
+  uint32_t len = list->RxDataLength;
+  uint8_t ready = 0U;
+
+  if (heth->gState != HAL_ETH_STATE_STARTED)
+  {
+    return HAL_ERROR;
+  }
+
+  while ((done < left) && (ready == 0U))
+  {
+    ETH_DMADescTypeDef *d = &heth->Init.RxDesc[idx];
+    uint32_t desc3 = d->DESC3;
+
+    if ((desc3 & ETH_DMARXNDESCWBF_OWN) != 0U)
+    {
+      break;
+    }
+    if ((desc3 & ETH_DMARXNDESCWBF_CTXT) != 0U)
+    {
+      /* Timestamp of the frame before; its buffer stays */
+      list->TimeStamp.TimeStampHigh = d->DESC1;
+      list->TimeStamp.TimeStampLow = d->DESC0;
+    }
+    else if (((desc3 & ETH_DMARXNDESCWBF_FD) != 0U) || (list->pRxStart != NULL))
+    {
+      if ((desc3 & ETH_DMARXNDESCWBF_FD) != 0U)
+      {
+        len = 0U;
+      }
+      uint32_t blen = (desc3 & ETH_DMARXNDESCWBF_PL) - len;
+      if ((desc3 & ETH_DMARXNDESCWBF_LD) != 0U)
+      {
+        list->pRxLastRxDesc = desc3;
+        ready = 1U;
+      }
+      ethernetif_dma_rx_idx = idx;
+      HAL_ETH_RxLinkCallback(&list->pRxStart, &list->pRxEnd, (uint8_t *)d->BackupAddr0, (uint16_t)blen);
+      len += blen;
+      d->BackupAddr0 = 0U;
+    }
+    idx = (idx + 1U < ETH_RX_DESC_CNT) ? idx + 1U : 0U;
+    done++;
+  }
+
+  list->RxDescIdx = idx;
+  list->RxDataLength = len;
+  list->RxBuildDescCnt += done;
+  if ((list->RxBuildDescCnt != 0U) && (list->RxBuildDescCnt >= list->RxBuildDescMin))
+  {
+    ethernetif_dma_refill(heth);
+  }
+
+  if (ready != 0U)
+  {
+    *pAppBuff = list->pRxStart;
+    list->pRxStart = NULL;
+    return HAL_OK;
+  }
+  return HAL_ERROR;
+}
+
+/**
+  * @brief  HAL_ETH_RxRebuild(): re-arms what ethernetif_dma_read() left
+  *         below RxBuildDescMin
+  * @param  heth: ETH handle
+  * @retval None
+  */
+ITCM_FUNC void ethernetif_dma_rebuild(ETH_HandleTypeDef *heth)
+{
+  if ((heth->gState == HAL_ETH_STATE_STARTED) && (heth->RxDescList.RxBuildDescCnt != 0U))
+  {
+    ethernetif_dma_refill(heth);
+  }
+}
+
+/**
+  * @brief  HAL_ETH_Transmit_IT() / HAL_ETH_TransmitNoPoll_IT(): two
+  *         buffers per descriptor, interrupt on the last one
+  * @param  heth: ETH handle
+  * @param  pTxConfig: Length, TxBuffer, pData, and the CSUM / CRCPAD
+  *         attributes with their controls
+  * @param  kick: 1 to move the tail pointer, 0 to leave it to
+  *         ethernetif_dma_kick()
+  * @retval HAL_OK, HAL_ERROR stopped or with HAL_ETH_ERROR_BUSY set when
+  *         the ring lacks descriptors
+  * @note   Core lock held, as for ethernetif_dma_release().
+  */
+ITCM_FUNC HAL_StatusTypeDef ethernetif_dma_transmit(ETH_HandleTypeDef *heth, ETH_TxPacketConfigTypeDef *pTxConfig,
+                                                    uint8_t kick)
+{
+  ETH_TxDescListTypeDef *list = &heth->TxDescList;
+  const ETH_BufferTypeDef *b = pTxConfig->TxBuffer;
+  uint32_t first = list->CurTxDesc;
+  uint32_t idx = first;
+  uint32_t need = 0U;
+  uint32_t desc2_first = 0U;
+  uint32_t desc3_first = 0U;
+  uint32_t desc3 = pTxConfig->Length & ETH_DMATXNDESCRF_FL;
+
+#ifdef HAL_ETH_USE_PTP
+  if (EthDmaTxTstamp != 0U)
+  {
+    EthDmaTxTstamp = 0U;
+    desc2_first = ETH_DMATXNDESCRF_TTSE;
+  }
+#endif
+  if (heth->gState != HAL_ETH_STATE_STARTED)
+  {
+    return HAL_ERROR;
+  }
+  for (const ETH_BufferTypeDef *q = b; q != NULL; q = (q->next != NULL) ? q->next->next : NULL)
+  {
+    need++;
+  }
+  if ((need > (ETH_TX_DESC_CNT - list->BuffersInUse)) || (list->PacketAddress[first] != NULL))
+  {
+    heth->ErrorCode |= HAL_ETH_ERROR_BUSY;
+    return HAL_ERROR;
+  }
+
+  if ((pTxConfig->Attributes & ETH_TX_PACKETS_FEATURES_CSUM) != 0U)
+  {
+    desc3 |= pTxConfig->ChecksumCtrl & ETH_DMATXNDESCRF_CIC;
+  }
+  if ((pTxConfig->Attributes & ETH_TX_PACKETS_FEATURES_CRCPAD) != 0U)
+  {
+    desc3_first = pTxConfig->CRCPadCtrl & ETH_DMATXNDESCRF_CPC;
+  }
+
+  for (uint32_t n = 0U; n < need; n++)
+  {
+    ETH_DMADescTypeDef *d = &heth->Init.TxDesc[idx];
+    const ETH_BufferTypeDef *b2 = b->next;
+    uint32_t desc2 = b->len & ETH_DMATXNDESCRF_B1L;
+    uint32_t d3 = desc3;
+
+    d->DESC0 = (uint32_t)b->buffer;
+    if (b2 != NULL)
+    {
+      d->DESC1 = (uint32_t)b2->buffer;
+      desc2 |= (b2->len << 16) & ETH_DMATXNDESCRF_B2L;
+      b = b2->next;
+    }
+    else
+    {
+      d->DESC1 = 0U;
+      b = NULL;
+    }
+    if (n == 0U)
+    {
+      desc2 |= desc2_first;
+      d3 |= ETH_DMATXNDESCRF_FD | desc3_first;
+    }
+    if (n == (need - 1U))
+    {
+      desc2 |= ETH_DMATXNDESCRF_IOC;
+      d3 |= ETH_DMATXNDESCRF_LD;
+    }
+    d->DESC2 = desc2;
+    if (n == 0U)
+    {
+      /* Owned last, once the whole chain is written */
+      desc3_first = d3;
+    }
+    else
+    {
+      __DMB();
+      d->DESC3 = d3 | ETH_DMATXNDESCRF_OWN;
+    }
+    if (n == (need - 1U))
+    {
+      list->PacketAddress[idx] = pTxConfig->pData;
+    }
+    idx = (idx + 1U < ETH_TX_DESC_CNT) ? idx + 1U : 0U;
+  }
+  __DMB();
+  heth->Init.TxDesc[first].DESC3 = desc3_first | ETH_DMATXNDESCRF_OWN;
+
+  list->CurTxDesc = idx;
+  list->BuffersInUse += need;
+  if (kick != 0U)
+  {
+    ethernetif_dma_kick(heth);
+  }
+  return HAL_OK;
+}
+
+/**
+  * @brief  HAL_ETH_TransmitPoll(): the DMA runs up to the next free descriptor
+  * @param  heth: ETH handle
+  * @retval None
+  */
+ITCM_FUNC void ethernetif_dma_kick(ETH_HandleTypeDef *heth)
+{
+  __DSB();
+  WRITE_REG(heth->Instance->DMACTDTPR, (uint32_t)&heth->Init.TxDesc[heth->TxDescList.CurTxDesc]);
+}
+
+/**
+  * @brief  HAL_ETH_ReleaseTxPacket(): frees the frames the DMA is done with,
+  *         in ring order, up to the first one still owned by it
+  * @param  heth: ETH handle
+  * @retval HAL_OK
+  */
+ITCM_FUNC HAL_StatusTypeDef ethernetif_dma_release(ETH_HandleTypeDef *heth)
+{
+  ETH_TxDescListTypeDef *list = &heth->TxDescList;
+  uint32_t n = list->BuffersInUse;
+  uint32_t idx = list->releaseIndex;
+
+  while (n != 0U)
+  {
+    void *pkt = list->PacketAddress[idx];
+
+    n--;
+    if (pkt != NULL)
+    {
+      const ETH_DMADescTypeDef *d = &heth->Init.TxDesc[idx];
+      uint32_t desc3 = d->DESC3;
+
+      if ((desc3 & ETH_DMATXNDESCWBF_OWN) != 0U)
+      {
+        break;
+      }
+#ifdef HAL_ETH_USE_PTP
+      if ((desc3 & (ETH_DMATXNDESCWBF_LD | ETH_DMATXNDESCWBF_TTSS)) ==
+          (ETH_DMATXNDESCWBF_LD | ETH_DMATXNDESCWBF_TTSS))
+      {
+        ETH_TimeStampTypeDef ts = { .TimeStampLow = d->DESC0, .TimeStampHigh = d->DESC1 };
+        HAL_ETH_TxPtpCallback(pkt, &ts);
+      }
+#endif
+      HAL_ETH_TxFreeCallback(pkt);
+      list->PacketAddress[idx] = NULL;
+      idx = (idx + 1U < ETH_TX_DESC_CNT) ? idx + 1U : 0U;
+      list->BuffersInUse = n;
+      list->releaseIndex = idx;
+    }
+    else
+    {
+      idx = (idx + 1U < ETH_TX_DESC_CNT) ? idx + 1U : 0U;
+    }
+  }
+  return HAL_OK;
+}
+
+/**
+  * @brief  HAL_ETH_PTP_InsertTxTimestamp(): the next frame transmitted gets
+  *         a TX timestamp
+  * @param  heth: ETH handle
+  * @retval HAL_ERROR if PTP is not configured
+  */
+HAL_StatusTypeDef ethernetif_dma_tx_tstamp(ETH_HandleTypeDef *heth)
+{
+#ifdef HAL_ETH_USE_PTP
+  if (heth->IsPtpConfigured == HAL_ETH_PTP_CONFIGURED)
+  {
+    EthDmaTxTstamp = 1U;
+    return HAL_OK;
+  }
+#else
+  (void)heth;
+#endif
+  return HAL_ERROR;
+}
+
+#endif /* ETHIF_LEAN_DMA */
@@ -0,0 +1,47 @@
+/**
+ * @file ethernetif_dma.h
+ * @brief Lean ETH DMA data path (ETHIF_LEAN_DMA): the descriptor rings
+ *        driven directly, the HAL kept for init, start/stop and MAC setup.
+ *
+ * Drop-in replacements for HAL_ETH_ReadData(), HAL_ETH_RxRebuild(),
+ * HAL_ETH_Transmit_IT(), HAL_ETH_TransmitNoPoll_IT(), HAL_ETH_TransmitPoll(),
+ * HAL_ETH_ReleaseTxPacket() and HAL_ETH_PTP_InsertTxTimestamp(), mapped
+ * onto them in ethernetif.c. They keep the HAL's ring bookkeeping in
+ * heth.RxDescList / heth.TxDescList, so HAL_ETH_Start_IT() / Stop_IT() and
+ * the driver code peeking at the rings work either way, and they call the
+ * same HAL_ETH_RxAllocateCallback(), HAL_ETH_RxLinkCallback(),
+ * HAL_ETH_TxFreeCallback() and HAL_ETH_TxPtpCallback().
+ *
+ * What goes: the state and parameter checks per call, the MODIFY_REG
+ * read-modify-writes of device memory descriptors (a TX descriptor is
+ * composed in registers and written once per word, DESC3 last), repeated
+ * DESC3 reads (one per descriptor per pass), the TX critical section
+ * (transmit and release both run with the core lock held) and the
+ * RxLinkCallback() descriptor search (ethernetif_dma_rx_idx names it).
+ * Descriptors are walked in ring order, the DMA's own order.
+ *
+ * Supported per packet: checksum insertion, CRC/pad control, TX timestamp.
+ * Per-packet VLAN tags, TSO and source address insertion are not (the
+ * driver tags VLANs in the MAC and uses none of the others).
+ *
+ * ETHIF_DMA_PROF in ethernetif_opts.h counts the cycles per frame of
+ * either path for comparison.
+ */
+
+#ifndef ETHERNETIF_DMA_H
+#define ETHERNETIF_DMA_H
+
+#include "stm32h7xx_hal.h"
+
+/* RX descriptor being passed to HAL_ETH_RxLinkCallback() */
+extern uint32_t ethernetif_dma_rx_idx;
+
+HAL_StatusTypeDef ethernetif_dma_read(ETH_HandleTypeDef *heth, void **pAppBuff);
+void ethernetif_dma_rebuild(ETH_HandleTypeDef *heth);
+HAL_StatusTypeDef ethernetif_dma_transmit(ETH_HandleTypeDef *heth, ETH_TxPacketConfigTypeDef *pTxConfig,
+                                          uint8_t kick);
+void ethernetif_dma_kick(ETH_HandleTypeDef *heth);
+HAL_StatusTypeDef ethernetif_dma_release(ETH_HandleTypeDef *heth);
+HAL_StatusTypeDef ethernetif_dma_tx_tstamp(ETH_HandleTypeDef *heth);
+
+#endif /* ETHERNETIF_DMA_H */
@@ -0,0 +1,842 @@
+/**
+ * @file ethernetif_opts.h
+ * @brief Sizing and placement of the ETH DMA rings and the zero-copy RX pool.
+ *
+ * The ring lengths themselves are ETH_RX_DESC_CNT / ETH_TX_DESC_CNT from
+ * stm32h7xx_hal_conf.h (CubeMX: ETH > Parameter Settings > Rx/Tx Descriptor
+ * Length). Everything else is derived here and checked at compile time in
+ * ethernetif.c:
+ *
+ *   ETHIF_DESC_BASE                      RX descriptors   (.RxDecripSection)
+ *   ETHIF_DESC_BASE + ETHIF_RX_DESC_SPAN TX descriptors   (.TxDecripSection)
+ *   ETHIF_DESC_BASE + region size        RX_POOL          (.Rx_PoolSection)
+ *
+ * The descriptor area is an MPU region of its own (MPU_DESC_POLICY, device
+ * by default) on top of the one RX_POOL is in (MPU_DMA_POLICY), see
+ * mpu/mpu_layout.h. The linker script mirrors ETHIF_DESC_BASE and
+ * ETHIF_DESC_REGION_SIZE as ETH_DESC_BASE / ETH_DESC_REGION_SIZE and asserts
+ * the same limits; change all three together. The base is the DMA area of
+ * the device's memory map (MPU_LAYOUT_DMA_BASE): 0x30040000 on the H743,
+ * the start of D2 SRAM on the H72x/H73x.
+ */
+
+#ifndef ETHERNETIF_OPTS_H
+#define ETHERNETIF_OPTS_H
+
+#include "stm32h7xx_hal.h"
+#include "mpu/mpu_layout.h"
+
+/* Bytes per ETH_DMADescTypeDef (DESC0..3 plus two backup words). */
+#define ETHIF_DMA_DESC_SIZE           24U
+
+#define ETHIF_ALIGN32(x)              (((x) + 31U) & ~31U)
+
+/* Base of the descriptor region and of the DMA area (MPU region 2). */
+#ifndef ETHIF_DESC_BASE
+#define ETHIF_DESC_BASE               MPU_LAYOUT_DMA_BASE
+#endif
+
+/* Size of the descriptor region in bytes and its MPU_REGION_SIZE_xxx encoding. */
+#ifndef ETHIF_DESC_REGION_SIZE
+#define ETHIF_DESC_REGION_SIZE        512U
+#define ETHIF_DESC_MPU_SIZE           MPU_REGION_SIZE_512B
+#endif
+
+#define ETHIF_RX_DESC_SPAN            ETHIF_ALIGN32(ETH_RX_DESC_CNT * ETHIF_DMA_DESC_SIZE)
+#define ETHIF_TX_DESC_SPAN            ETHIF_ALIGN32(ETH_TX_DESC_CNT * ETHIF_DMA_DESC_SIZE)
+
+#define ETHIF_RX_DESC_ADDR            ETHIF_DESC_BASE
+#define ETHIF_TX_DESC_ADDR            (ETHIF_DESC_BASE + ETHIF_RX_DESC_SPAN)
+#define ETHIF_RX_POOL_ADDR            (ETHIF_DESC_BASE + ETHIF_DESC_REGION_SIZE)
+
+/* End of RAM_D2 (0x30000000 + 288K on the H743, + 32K on the H72x). */
+#define ETHIF_D2_END                  MPU_LAYOUT_D2_END
+
+/* Spare RX buffers beyond two per descriptor, covering frames held by the
+ * stack (TCP out-of-order/recv queues) while the ring is being refilled. */
+#ifndef ETHIF_RX_BUFFER_SPARE
+#define ETHIF_RX_BUFFER_SPARE         4U
+#endif
+
+#ifndef ETH_RX_BUFFER_CNT
+#define ETH_RX_BUFFER_CNT             (2U * ETH_RX_DESC_CNT + ETHIF_RX_BUFFER_SPARE)
+#endif
+
+/* Small frames (ARP, TCP ACKs, short control datagrams) up to this many
+ * bytes are copied from their RX_POOL buffer into an RX_SMALL buffer in
+ * ordinary RAM, and the RX_POOL buffer is handed back at once for the
+ * next descriptor rebuild. Small frames the stack holds on to then do not
+ * keep full-size D2 buffers out of the ring. Frames carrying a PTP receive
+ * timestamp are not copied. 0 passes every frame up in place. */
+#ifndef ETHIF_RX_COPY_MAX
+#define ETHIF_RX_COPY_MAX             128U
+#endif
+
+/* RX_SMALL buffers; with the pool empty small frames stay in place */
+#ifndef ETHIF_RX_SMALL_CNT
+#define ETHIF_RX_SMALL_CNT            32U
+#endif
+
+/* Aligned receive payloads. The H7 MAC has no split-header mode
+ * (MACHWF1R.SPHEN reads 0), so instead every RX_POOL buffer is handed to
+ * the DMA ETHIF_RX_OFFSET bytes in, chosen so that a frame whose headers
+ * are ETHIF_RX_HDR_LEN bytes long has its payload on an
+ * ETHIF_RX_PAYLOAD_ALIGN boundary; the DMA accepts byte-aligned receive
+ * buffer addresses. The default 42 is Ethernet, IPv4 without options and
+ * UDP; 54 suits TCP without options, 66 TCP with timestamps. Frames with
+ * other header lengths are received as before, only shifted, and frames
+ * copied to RX_SMALL (ETHIF_RX_COPY_MAX) are only 4-byte aligned. 0 off,
+ * else a power of two up to the 32-byte cache line. */
+#ifndef ETHIF_RX_PAYLOAD_ALIGN
+#define ETHIF_RX_PAYLOAD_ALIGN        0U
+#endif
+
+#ifndef ETHIF_RX_HDR_LEN
+#define ETHIF_RX_HDR_LEN              42U
+#endif
+
+#if ETHIF_RX_PAYLOAD_ALIGN
+#if ((ETHIF_RX_PAYLOAD_ALIGN & (ETHIF_RX_PAYLOAD_ALIGN - 1U)) != 0U) || (ETHIF_RX_PAYLOAD_ALIGN > 32U)
+#error "ETHIF_RX_PAYLOAD_ALIGN must be a power of two no larger than 32"
+#endif
+#define ETHIF_RX_OFFSET               ((ETHIF_RX_PAYLOAD_ALIGN - (ETHIF_RX_HDR_LEN % ETHIF_RX_PAYLOAD_ALIGN)) % \
+                                       ETHIF_RX_PAYLOAD_ALIGN)
+#else
+#define ETHIF_RX_OFFSET               0U
+#endif
+
+/* Jumbo frames, for a segment where every station is configured for them:
+ * the MAC takes frames up to 9018 bytes (MACCR.JE), received into a chain
+ * of ETH_RX_BUFFER_SIZE buffers, and the interface MTU is ETHIF_JUMBO_MTU.
+ * The MTL FIFOs hold 2 KB each way, so both queues run in threshold mode
+ * instead of store and forward. Hardware checksum insertion needs the whole
+ * frame in the TX FIFO, so frames longer than a standard one get their IP
+ * header and TCP/UDP/ICMP checksums from the driver instead. TCP keeps
+ * TCP_MSS; raise it together with the malloc pools (lwippools.h) to send
+ * jumbo segments. */
+#ifndef ETHIF_JUMBO
+#define ETHIF_JUMBO                   0
+#endif
+
+#ifndef ETHIF_JUMBO_MTU
+#define ETHIF_JUMBO_MTU               ETH_JUMBO_FRAME_PAYLOAD
+#endif
+
+#if ETHIF_JUMBO
+#if (ETHIF_JUMBO_MTU < ETH_MAX_PAYLOAD) || (ETHIF_JUMBO_MTU > ETH_JUMBO_FRAME_PAYLOAD)
+#error "ETHIF_JUMBO_MTU must be between 1500 and 9000"
+#endif
+#define ETHIF_MTU                     ETHIF_JUMBO_MTU
+#else
+#define ETHIF_MTU                     ETH_MAX_PAYLOAD
+#endif
+
+/* Longest frame sent, Ethernet and VLAN headers included, no FCS */
+#define ETHIF_FRAME_MAX               (ETHIF_MTU + 18U)
+
+/* While RX_POOL is exhausted the descriptor rebuild is retried at least
+ * this often, independent of pbuf_free_custom() signalling, so receive
+ * recovers even if no further RX interrupt arrives (DMA suspended on RBU). */
+#ifndef ETHIF_RX_REFILL_RETRY_MS
+#define ETHIF_RX_REFILL_RETRY_MS      2U
+#endif
+
+/* RX_POOL watermark for the TCP out-of-order queues (TCP_OOSEQ_GOVERN in
+ * lwipopts.h): with this many buffers or fewer left unallocated (the
+ * ring's count as allocated), no ooseq queue may grow, and whole queues
+ * are freed on the tcpip thread, largest first, until more are left.
+ * Peers retransmit the data. 0 leaves RX_POOL out of it. */
+#ifndef ETHIF_RX_POOL_LOW
+#define ETHIF_RX_POOL_LOW             2U
+#endif
+
+#define ETHIF_OOSEQ_EVICT             (LWIP_TCP && TCP_OOSEQ_GOVERN && (ETHIF_RX_POOL_LOW != 0U))
+
+/* Non-blocking transmit: frames that find every TX descriptor busy wait in
+ * a software queue of ETHIF_TX_QUEUE_LEN frames instead of blocking the
+ * caller (and the lwIP core lock) on TxPktSemaphore. A full queue returns
+ * ERR_MEM to lwIP. Set to 0 for the blocking CubeMX behaviour. */
+#ifndef ETHIF_TX_QUEUE
+#define ETHIF_TX_QUEUE                1
+#endif
+
+#ifndef ETHIF_TX_QUEUE_LEN
+#define ETHIF_TX_QUEUE_LEN            16U
+#endif
+
+/* TX scheduling (needs ETHIF_TX_QUEUE): one software queue of
+ * ETHIF_TX_QUEUE_LEN frames per class instead of the single FIFO. The
+ * class comes from the IP precedence (top three DSCP bits) the sending PCB
+ * set in its tos:
+ *
+ *   control    5..7 (EF, CS5..CS7), and ARP, ICMP, IGMP, ICMPv6
+ *   telemetry  3..4 (AF3x, AF4x; metrics)
+ *   logging    2    (CS2, OAM; syslog)
+ *   bulk       0..1 (everything else)
+ *
+ * Control is served first. The other classes share what is left by
+ * deficit round robin, ETHIF_TX_SCHED_QUANTUM_* bytes per round. Frames
+ * already in the DMA ring go out in order whatever their class, so no more
+ * than ETHIF_TX_SCHED_RING_LIMIT non-control frames are given to it at a
+ * time. A control frame then waits for at most that many frames, plus the
+ * control frames ahead of it: 4 x 1538 bytes is 0.5 ms at 100 Mbit/s. A
+ * lower limit tightens the bound, but the TX complete interrupt has to
+ * refill the ring sooner to keep the line busy. */
+#ifndef ETHIF_TX_SCHED
+#define ETHIF_TX_SCHED                1
+#endif
+
+#if ETHIF_TX_SCHED && !ETHIF_TX_QUEUE
+#error "ETHIF_TX_SCHED needs ETHIF_TX_QUEUE"
+#endif
+
+#ifndef ETHIF_TX_SCHED_RING_LIMIT
+#define ETHIF_TX_SCHED_RING_LIMIT     4U
+#endif
+
+#ifndef ETHIF_TX_SCHED_QUANTUM_TELEMETRY
+#define ETHIF_TX_SCHED_QUANTUM_TELEMETRY  3036U
+#endif
+
+#ifndef ETHIF_TX_SCHED_QUANTUM_LOGGING
+#define ETHIF_TX_SCHED_QUANTUM_LOGGING    1518U
+#endif
+
+#ifndef ETHIF_TX_SCHED_QUANTUM_BULK
+#define ETHIF_TX_SCHED_QUANTUM_BULK       6072U
+#endif
+
+/* Token bucket shaping of the non-control classes (needs ETHIF_TX_SCHED):
+ * a class sends while its bucket holds the length of its head frame,
+ * filled at ETHIF_TX_SHAPE_RATE_* kbit/s up to ETHIF_TX_SHAPE_BURST_*
+ * bytes; ethernetif_tx_shape_set() changes both at run time. Frames over
+ * the rate wait in their class queue, and a full queue refuses the next
+ * with ERR_WOULDBLOCK. TCP keeps a refused segment unsent and the waiting
+ * ones unacknowledged, so tcp_sndbuf() shrinks and the sender slows down;
+ * UDP senders ask ethernetif_tx_class_room() first (syslog does). A rate
+ * of 0 leaves a class unshaped. */
+#ifndef ETHIF_TX_SHAPE
+#define ETHIF_TX_SHAPE                1
+#endif
+
+#if ETHIF_TX_SHAPE && !ETHIF_TX_SCHED
+#error "ETHIF_TX_SHAPE needs ETHIF_TX_SCHED"
+#endif
+
+#ifndef ETHIF_TX_SHAPE_RATE_TELEMETRY
+#define ETHIF_TX_SHAPE_RATE_TELEMETRY     0U
+#endif
+
+#ifndef ETHIF_TX_SHAPE_BURST_TELEMETRY
+#define ETHIF_TX_SHAPE_BURST_TELEMETRY    16384U
+#endif
+
+#ifndef ETHIF_TX_SHAPE_RATE_LOGGING
+#define ETHIF_TX_SHAPE_RATE_LOGGING       10000U
+#endif
+
+#ifndef ETHIF_TX_SHAPE_BURST_LOGGING
+#define ETHIF_TX_SHAPE_BURST_LOGGING      16384U
+#endif
+
+/* Unshaped: bulk transfers get the link unless a rate is set here or with
+ * ethernetif_tx_shape_set() */
+#ifndef ETHIF_TX_SHAPE_RATE_BULK
+#define ETHIF_TX_SHAPE_RATE_BULK          0U
+#endif
+
+#ifndef ETHIF_TX_SHAPE_BURST_BULK
+#define ETHIF_TX_SHAPE_BURST_BULK         32768U
+#endif
+
+/* Batched transmit: the frames of one tcp_output() call (and of one TX
+ * queue refill) are put in the descriptor ring without starting the DMA,
+ * which a single tail pointer write then sends at the end of the batch or
+ * as soon as the ring is full. Set to 0 for one write per frame. */
+#ifndef ETHIF_TX_BATCH
+#define ETHIF_TX_BATCH                1
+#endif
+
+/* Time-triggered transmit: frames sent inside ethernetif_tx_window_open()
+ * / _close() are put in the descriptor ring at once, and a compare
+ * interrupt of ETHIF_TX_TT_TIM writes the DMA tail pointer when
+ * time_now_ns() reaches the window time. The timer runs from the same PLL
+ * as the DWT cycle counter behind time_now_ns(), so the compare value
+ * taken from a (counter, time) pair read together does not drift over the
+ * lead. The start jitter is the interrupt entry and the DMA descriptor
+ * fetch, not the task scheduling. While a window is armed every other
+ * frame waits in the software TX queue; frames already in the ring go out
+ * first, so they have to be done by the window time: a window opened with
+ * an empty ring and a lead above the ring drain time is never late. */
+#ifndef ETHIF_TX_TT
+#define ETHIF_TX_TT                   1
+#endif
+
+#if ETHIF_TX_TT && !ETHIF_TX_QUEUE
+#error "ETHIF_TX_TT needs ETHIF_TX_QUEUE"
+#endif
+
+/* A free-running 32-bit timer on APB1 */
+#ifndef ETHIF_TX_TT_TIM
+#define ETHIF_TX_TT_TIM               TIM2
+#define ETHIF_TX_TT_IRQn              TIM2_IRQn
+#define ETHIF_TX_TT_IRQHandler        TIM2_IRQHandler
+#define ETHIF_TX_TT_CLK_ENABLE()      __HAL_RCC_TIM2_CLK_ENABLE()
+#endif
+
+/* Above configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY: the handler makes no
+ * RTOS call, and no critical section delays it */
+#ifndef ETHIF_TX_TT_IRQ_PRIO
+#define ETHIF_TX_TT_IRQ_PRIO          2U
+#endif
+
+/* Longest a window may be armed ahead, holding back all other traffic */
+#ifndef ETHIF_TX_TT_LEAD_MAX_US
+#define ETHIF_TX_TT_LEAD_MAX_US       500U
+#endif
+
+/* A window closed closer to its time than this is sent at once, late */
+#ifndef ETHIF_TX_TT_LEAD_MIN_NS
+#define ETHIF_TX_TT_LEAD_MIN_NS       2000U
+#endif
+
+/* Frames chained from more pbufs than the DMA can take at once (two buffers
+ * per TX descriptor) are copied into one of these cache-aligned bounce
+ * buffers instead of being dropped. */
+#ifndef ETHIF_TX_BOUNCE_CNT
+#define ETHIF_TX_BOUNCE_CNT           4U
+#endif
+
+/* RX buffers in non-cacheable memory (MPU_DMA_POLICY): no RX invalidation
+ * or TX clean is then needed for pool buffers, at the price of uncached
+ * protocol parsing. */
+#define ETHIF_RX_NONCACHEABLE         (MPU_DMA_POLICY == MPU_POLICY_NC)
+
+/* Direct-to-task notifications instead of the CubeMX RxPktSemaphore: RX
+ * interrupts and RX_POOL refills notify the EthIf task. With ETHIF_TX_QUEUE
+ * nothing waits for TX completion, so nothing is signalled; without it the
+ * task blocked in low_level_output() still waits on TxPktSemaphore, as it
+ * is the tcpip thread or a socket caller whose notification value holds
+ * the mailbox and socket wakeup flags. Set to 0 for both semaphores. */
+#ifndef ETHIF_TASK_NOTIFY
+#define ETHIF_TASK_NOTIFY             1
+#endif
+
+/* Polled receive: the first RX interrupt masks RIE and wakes the EthIf
+ * task, which then reads up to ETHIF_RX_POLL_BUDGET frames per pass and
+ * unmasks RIE only once the ring is empty. Set to 0 for one interrupt and
+ * semaphore release per frame. */
+#ifndef ETHIF_RX_POLL
+#define ETHIF_RX_POLL                 1
+#endif
+
+#ifndef ETHIF_RX_POLL_BUDGET
+#define ETHIF_RX_POLL_BUDGET          16U
+#endif
+
+/* RX interrupt coalescing: descriptors are handed to the DMA without IOC and
+ * the receive interrupt watchdog (DMACRIWTR) raises RI this many
+ * microseconds after the first unsignalled frame. 0 keeps IOC on every
+ * descriptor. */
+#ifndef ETHIF_RX_COALESCE_US
+#define ETHIF_RX_COALESCE_US          20U
+#endif
+
+/* Batched RX re-arm: HAL_ETH_ReadData() leaves consumed descriptors to the
+ * CPU until this many are waiting, then re-arms them with one tail pointer
+ * write; the rest is re-armed once the ring has been drained. Fewer device
+ * writes per frame, at the cost of up to this many minus one descriptors
+ * missing from the ring during a burst. 0 re-arms on every read. */
+#ifndef ETHIF_RX_REARM_BATCH
+#define ETHIF_RX_REARM_BATCH          (ETH_RX_DESC_CNT / 2U)
+#endif
+
+#if ETHIF_RX_REARM_BATCH > ETH_RX_DESC_CNT
+#error "ETHIF_RX_REARM_BATCH exceeds ETH_RX_DESC_CNT"
+#endif
+
+/* Drop frames whose last RX descriptor reports an error summary or an
+ * IP header / payload checksum error from the MAC checksum offload engine
+ * (CHECKSUM_CHECK_* are 0 in lwipopts.h, so nothing else checks them).
+ * Frames the engine bypassed (IPCB) are passed up unchecked. */
+#ifndef ETHIF_RX_CSUM_DROP
+#define ETHIF_RX_CSUM_DROP            1
+#endif
+
+/* Event-driven link monitoring: the LAN8742 nINT output (link down,
+ * auto-negotiation complete) on an EXTI line wakes the link thread instead
+ * of a 100 ms MDIO poll. Needs the pin set up in CubeMX as GPIO_EXTI
+ * falling edge with its EXTI interrupt enabled; HAL_GPIO_EXTI_Callback()
+ * is then provided by ethernetif.c. ETHIF_PHY_IT_POLL_MS bounds the wait
+ * as a safety net against a lost edge (0: wait for the interrupt only). */
+#ifndef ETHIF_PHY_IT
+#define ETHIF_PHY_IT                  0
+#endif
+
+#if ETHIF_PHY_IT
+#ifndef ETHIF_PHY_IT_Pin
+#define ETHIF_PHY_IT_Pin              ETH_INT_Pin
+#endif
+
+#ifndef ETHIF_PHY_IT_POLL_MS
+#define ETHIF_PHY_IT_POLL_MS          1000U
+#endif
+#endif
+
+/* Asynchronous PHY bring-up: reset_phy() and LAN8742_Init() run at the
+ * start of the link thread instead of in low_level_init(), so
+ * MX_LWIP_Init() neither sleeps through the reset nor holds the core lock
+ * meanwhile. The reset pulse starts in main() (reset_phy_start()). The
+ * netif starts with its link down; the link thread raises it once
+ * auto-negotiation completed. 0: the CubeMX sequence. */
+#ifndef ETHIF_PHY_ASYNC
+#define ETHIF_PHY_ASYNC               1
+#endif
+
+/* Link bring-up without waiting for auto-negotiation, for fixed links:
+ *
+ *   ETHIF_PHY_MODE_AUTO    the PHY negotiates, as strapped
+ *   ETHIF_PHY_MODE_FORCED  forced to ETHIF_PHY_FORCED_STATE (LAN8742_STATUS_xxx)
+ *   ETHIF_PHY_MODE_CACHED  forced to the mode last negotiated, kept in RTC
+ *                          backup register ETHIF_PHY_BKUP_REG; negotiates
+ *                          while nothing is cached
+ *
+ * A forced link that is not up within ETHIF_PHY_FORCED_TIMEOUT_MS falls
+ * back to auto-negotiation, which reaches a forced partner by parallel
+ * detection (half duplex). The partner has to be forced to the same mode:
+ * against one that negotiates, a forced full duplex end gets a duplex
+ * mismatch. A PHY that reset itself (BCR back to auto-negotiation) is
+ * forced again on the next link poll. Forcing excludes ETHIF_EEE, which
+ * is negotiated. */
+#define ETHIF_PHY_MODE_AUTO           0
+#define ETHIF_PHY_MODE_FORCED         1
+#define ETHIF_PHY_MODE_CACHED         2
+
+#ifndef ETHIF_PHY_MODE
+#define ETHIF_PHY_MODE                ETHIF_PHY_MODE_AUTO
+#endif
+
+#ifndef ETHIF_PHY_FORCED_STATE
+#define ETHIF_PHY_FORCED_STATE        LAN8742_STATUS_100MBITS_FULLDUPLEX
+#endif
+
+#ifndef ETHIF_PHY_FORCED_TIMEOUT_MS
+#define ETHIF_PHY_FORCED_TIMEOUT_MS   3000U
+#endif
+
+/* 0 and 1 are timesync's, 2 the clock profile's */
+#ifndef ETHIF_PHY_BKUP_REG
+#define ETHIF_PHY_BKUP_REG            3U
+#endif
+#define ETHIF_PHY_BKUP_MAGIC          0x50480000UL /* "PH" */
+
+/* Asynchronous MDIO: register accesses are queued (ETHIF_MDIO_QUEUE_LEN)
+ * and started one at a time; a FreeRTOS timer, armed only while the queue
+ * is not empty, polls the MII busy bit every ETHIF_MDIO_POLL_MS and calls
+ * each operation's completion callback (ethernetif_mdio_read/write() in
+ * ethernetif.h). ETH_PHY_IO_ReadReg()/WriteReg(), and so the LAN8742
+ * driver, queue too and sleep until their operation completes instead of
+ * spinning on the busy bit; before the scheduler runs they fall back to
+ * the HAL. 0: the HAL busy-wait throughout. */
+#ifndef ETHIF_MDIO_ASYNC
+#define ETHIF_MDIO_ASYNC              1
+#endif
+
+#ifndef ETHIF_MDIO_QUEUE_LEN
+#define ETHIF_MDIO_QUEUE_LEN          8U
+#endif
+
+#ifndef ETHIF_MDIO_POLL_MS
+#define ETHIF_MDIO_POLL_MS            1U
+#endif
+
+/* Period of the driver counter summary sent to syslog (tag "ETH") with
+ * frame and byte rates, from an lwIP timeout. 0: only on request through
+ * ethernetif_log_stats(). */
+#ifndef ETHIF_STATS_LOG_MS
+#define ETHIF_STATS_LOG_MS            0U
+#endif
+
+/* IEEE 1588 hardware timestamping: received PTP event messages carry the
+ * MAC system time in their RX_POOL buffer, flagged TX frames report theirs
+ * through a hook, and the system time can be stepped and slewed by a PTP
+ * servo (ethernetif.h). Requires HAL_ETH_USE_PTP in stm32h7xx_hal_conf.h. */
+#ifndef ETHIF_PTP
+#define ETHIF_PTP                     0
+#endif
+
+#if ETHIF_PTP && !defined(HAL_ETH_USE_PTP)
+#error "ETHIF_PTP requires HAL_ETH_USE_PTP in stm32h7xx_hal_conf.h"
+#endif
+
+/* ARP offload: the MAC answers ARP requests for the netif IPv4 address
+ * itself (MACARPAR, kept current from a netif extended status callback)
+ * and requests it answered are dropped in the driver. lwIP then no longer
+ * learns peers from their requests; it resolves them when it needs to. */
+#ifndef ETHIF_ARP_OFFLOAD
+#define ETHIF_ARP_OFFLOAD             1
+#endif
+
+/* 802.1Q VLAN in hardware: the MAC inserts the tag ETHIF_VLAN_VID /
+ * ETHIF_VLAN_PCP on every transmitted frame (MACVIR), and strips the tag on
+ * receive (MACVTR). When ETHIF_VLAN_FILTER is set, it also drops tagged
+ * frames for other VIDs. lwIP only ever sees untagged frames. With
+ * ETHIF_RX_BATCH, received frames with a stripped PCP of ETHIF_VLAN_PRIO_PCP
+ * or above go to the priority queue (ETHIF_RX_PRIO_QUEUE_LEN), which the
+ * tcpip thread drains ahead of bulk traffic. */
+#ifndef ETHIF_VLAN
+#define ETHIF_VLAN                    0
+#endif
+
+#if ETHIF_VLAN
+#ifndef ETHIF_VLAN_VID
+#define ETHIF_VLAN_VID                1U
+#endif
+
+#ifndef ETHIF_VLAN_PCP
+#define ETHIF_VLAN_PCP                0U
+#endif
+
+#ifndef ETHIF_VLAN_FILTER
+#define ETHIF_VLAN_FILTER             1
+#endif
+
+#ifndef ETHIF_VLAN_PRIO_PCP
+#define ETHIF_VLAN_PRIO_PCP           4U
+#endif
+#endif
+
+/* Energy Efficient Ethernet (802.3az, 100BASE-TX only): the PHY advertises
+ * EEE. If the link partner agrees, the MAC enters TX LPI once nothing has
+ * been sent for ETHIF_EEE_ENTRY_US (a multiple of 8). A queued frame wakes
+ * it automatically and goes out ETHIF_EEE_TW_US later. LPI is only allowed
+ * ETHIF_EEE_LS_MS after link up. Every wake is timed from submission to TX
+ * complete. A wake that takes longer than ETHIF_EEE_WAKE_BUDGET_US turns
+ * LPI off until ethernetif_eee_enable() is called again. */
+#ifndef ETHIF_EEE
+#define ETHIF_EEE                     0
+#endif
+
+#if ETHIF_EEE && (ETHIF_PHY_MODE != ETHIF_PHY_MODE_AUTO)
+#error "ETHIF_EEE needs ETHIF_PHY_MODE_AUTO"
+#endif
+
+#if ETHIF_EEE
+#ifndef ETHIF_EEE_ENTRY_US
+#define ETHIF_EEE_ENTRY_US            1000U
+#endif
+
+/* IEEE 802.3 Tw_sys_tx for 100BASE-TX */
+#ifndef ETHIF_EEE_TW_US
+#define ETHIF_EEE_TW_US               30U
+#endif
+
+#ifndef ETHIF_EEE_LS_MS
+#define ETHIF_EEE_LS_MS               1000U
+#endif
+
+#ifndef ETHIF_EEE_WAKE_BUDGET_US
+#define ETHIF_EEE_WAKE_BUDGET_US      200U
+#endif
+#endif
+
+/* Wake-on-LAN standby: ethernetif_standby() parks the MAC (DMA stopped,
+ * rings kept, PMT power-down) until a magic packet, or an IPv4 frame to one
+ * of ETHIF_WOL_PORTS (TCP or UDP destination port, no IP options) sent to
+ * our MAC address, wakes it. Up to four ports, one remote wake-up filter
+ * each; the defaults are the control channel and Modbus/TCP. The frame
+ * that matched a port filter is kept and delivered after the resume. */
+#ifndef ETHIF_WOL
+#define ETHIF_WOL                     0
+#endif
+
+#if ETHIF_WOL
+#ifndef ETHIF_WOL_PORTS
+#define ETHIF_WOL_PORTS               5300U, 502U
+#endif
+
+/* Longest wait for the TX ring to drain before the MAC is parked */
+#ifndef ETHIF_WOL_TX_DRAIN_MS
+#define ETHIF_WOL_TX_DRAIN_MS         2U
+#endif
+#endif
+
+/* Lean data path (ethernetif_dma.c): HAL_ETH_ReadData(), the transmit,
+ * poll and release calls and HAL_ETH_PTP_InsertTxTimestamp() replaced by
+ * register-level versions working on the same rings; init, start/stop,
+ * MAC and PTP setup stay with the HAL. Per-packet VLAN tags, TSO and
+ * source address insertion are not supported. */
+#ifndef ETHIF_LEAN_DMA
+#define ETHIF_LEAN_DMA                0
+#endif
+
+/* Data path profile: DWT cycles per received frame (ReadData), per
+ * transmitted frame (submit) and per freed frame (release), for whichever
+ * path is built. ethernetif_dma_prof_get(), logged with the driver
+ * counters. Needs the DWT cycle counter (run-time stats). */
+#ifndef ETHIF_DMA_PROF
+#define ETHIF_DMA_PROF                0
+#endif
+
+/* Batched delivery: received frames are queued for the tcpip thread and
+ * handed over with one preallocated callback message per batch instead of
+ * one TCPIP_MBOX message per frame (tcpip_input()). A full queue drops the
+ * frame. Set to 0 to call netif->input per frame. */
+#ifndef ETHIF_RX_BATCH
+#define ETHIF_RX_BATCH                1
+#endif
+
+#ifndef ETHIF_RX_QUEUE_LEN
+#define ETHIF_RX_QUEUE_LEN            16U
+#endif
+
+/* Control lane: with ETHIF_RX_BATCH, ARP, ICMP, IGMP, ICMPv6 and TCP
+ * segments with SYN, FIN or RST go to the priority queue as well. Its
+ * message is posted to the front of the tcpip thread mailbox, ahead of the
+ * API calls waiting there, and a burst of bulk frames filling RxQueue
+ * cannot crowd them out. */
+#ifndef ETHIF_RX_CTRL_PRIO
+#define ETHIF_RX_CTRL_PRIO            1
+#endif
+
+#ifndef ETHIF_RX_PRIO_QUEUE_LEN
+#define ETHIF_RX_PRIO_QUEUE_LEN       8U
+#endif
+
+/* Admission control under receive overload: rather than losing frames
+ * wherever RX_POOL, RxQueue or TCPIP_MBOX runs out first, each after work
+ * spent on them, the EthIf task sheds the least important ones before
+ * they are queued. An overload level follows the free RX_POOL buffers
+ * beyond the ring, the fill of RxQueue, a batch refused by TCPIP_MBOX and
+ * the CPU load (idle task run time, sampled every ETHIF_RX_ADMIT_CPU_MS):
+ *   1  broadcast and multicast frames are dropped
+ *   2  also frames to a TCP or UDP port no local PCB uses, and other
+ *      EtherTypes than IP and ARP
+ *   3  also bulk: everything but the control lane
+ * The control lane (ETHIF_RX_CTRL_PRIO, VLAN priority), the UDP fast path
+ * and RX steering are never shed. The level rises at once and falls one
+ * step per ETHIF_RX_ADMIT_HOLD_MS of less pressure. The local ports are a
+ * hashed bitmap rebuilt by the tcpip thread every ETHIF_RX_ADMIT_PORTS_MS;
+ * a collision admits a frame. Drops are counted per reason (rx admit_*).
+ * Level 0 costs a load per frame. */
+#ifndef ETHIF_RX_ADMIT
+#define ETHIF_RX_ADMIT                1
+#endif
+
+#if ETHIF_RX_ADMIT && !(ETHIF_RX_BATCH && ETHIF_RX_CTRL_PRIO)
+#error "ETHIF_RX_ADMIT needs ETHIF_RX_BATCH and ETHIF_RX_CTRL_PRIO"
+#endif
+
+/* CPU load in per mille for levels 1 and 2; the load alone never sheds
+ * bulk */
+#ifndef ETHIF_RX_ADMIT_CPU_HIGH
+#define ETHIF_RX_ADMIT_CPU_HIGH       900U
+#endif
+
+#ifndef ETHIF_RX_ADMIT_CPU_MAX
+#define ETHIF_RX_ADMIT_CPU_MAX        980U
+#endif
+
+#ifndef ETHIF_RX_ADMIT_CPU_MS
+#define ETHIF_RX_ADMIT_CPU_MS         10U
+#endif
+
+#ifndef ETHIF_RX_ADMIT_HOLD_MS
+#define ETHIF_RX_ADMIT_HOLD_MS        100U
+#endif
+
+#ifndef ETHIF_RX_ADMIT_PORTS_MS
+#define ETHIF_RX_ADMIT_PORTS_MS       250U
+#endif
+
+/* Bits of the local port map, a power of two */
+#ifndef ETHIF_RX_ADMIT_PORT_BITS
+#define ETHIF_RX_ADMIT_PORT_BITS      1024U
+#endif
+
+/* Low-latency receive without the EthIf task: the RX interrupt posts a
+ * callback message straight to the tcpip thread mailbox
+ * (sys_mbox_trypost_fromisr()), and the tcpip thread polls the ring and
+ * delivers the frames itself, saving a task switch per wakeup. Priority
+ * frames still go first, but nothing overtakes the API calls already
+ * waiting in the mailbox. The EthIf task only reposts the message when the
+ * mailbox was full or RX_POOL ran out. */
+#ifndef ETHIF_RX_DIRECT
+#define ETHIF_RX_DIRECT               0
+#endif
+
+#if ETHIF_RX_DIRECT && !(ETHIF_RX_POLL && ETHIF_RX_BATCH)
+#error "ETHIF_RX_DIRECT needs ETHIF_RX_POLL and ETHIF_RX_BATCH"
+#endif
+
+/* Receive on the EthIf task with the core lock instead of the tcpip thread
+ * (LWIP_TCPIP_CORE_LOCKING_INPUT in lwipopts.h): the task takes
+ * LOCK_TCPIP_CORE once per drained batch and runs ethernet_input() itself,
+ * without a mailbox message and the switch to the tcpip thread. Raw API
+ * receive callbacks then run on the EthIf task, whose stack grows to
+ * TCPIP_THREAD_STACKSIZE, at its priority. Without ETHIF_RX_BATCH lwIP's
+ * tcpip_input() locks per frame. ETHIF_RX_LATENCY and ETHIF_CORE_LOCK_PROF
+ * compare the two paths: the INPUT stage holds the wait for the core lock
+ * instead of the mailbox hop, and the EthIf entry shows what it costs the
+ * other holders. */
+#ifndef ETHIF_RX_INLINE
+#define ETHIF_RX_INLINE               0
+#endif
+
+#if ETHIF_RX_INLINE && ETHIF_RX_DIRECT
+#error "ETHIF_RX_INLINE and ETHIF_RX_DIRECT are alternatives"
+#endif
+
+/* Depth of the tcpip thread mailbox, TCPIP_MBOX_SIZE in lwipopts.h.
+ * Without ETHIF_RX_BATCH every RX buffer can be waiting in it as one
+ * tcpip_input() message, so it follows ETH_RX_BUFFER_CNT, plus
+ * ETHIF_TCPIP_MBOX_API slots for the API calls and callbacks of the other
+ * threads. A full mailbox counts rx mbox_full: the frame is dropped, or
+ * with ETHIF_RX_BATCH the batch stays queued and is posted again. */
+#ifndef ETHIF_TCPIP_MBOX_API
+#define ETHIF_TCPIP_MBOX_API          8U
+#endif
+
+#define ETHIF_TCPIP_MBOX_SIZE         (ETH_RX_BUFFER_CNT + ETHIF_TCPIP_MBOX_API)
+
+/* UDP fast path: IPv4 datagrams to a local port registered with
+ * ethernetif_udp_fast_register() or ethernetif_udp_fast_queue() are taken
+ * out of the EthIf task and handed over there, skipping the tcpip mailbox,
+ * the tcpip thread and the netconn mailbox. Up to ETHIF_UDP_FAST_PORTS
+ * ports; with none registered it costs one load per frame. */
+#ifndef ETHIF_UDP_FAST
+#define ETHIF_UDP_FAST                1
+#endif
+
+#ifndef ETHIF_UDP_FAST_PORTS
+#define ETHIF_UDP_FAST_PORTS          4U
+#endif
+
+/* RX steering: whole frames of a registered EtherType, optionally of one
+ * IP protocol, are handed over on the EthIf task like the UDP fast path
+ * (ethernetif_rx_steer_register(), ethernetif_rx_steer_queue()), e.g. PTP
+ * over Ethernet to the timing task or a raw control protocol to a real-time
+ * task. UDP fast path ports are looked up first. Up to ETHIF_RX_STEER_RULES
+ * rules; with none registered it costs one load per frame. */
+#ifndef ETHIF_RX_STEER
+#define ETHIF_RX_STEER                1
+#endif
+
+#ifndef ETHIF_RX_STEER_RULES
+#define ETHIF_RX_STEER_RULES          4U
+#endif
+
+/* Link flaps: a link lost for less than ETHIF_LINK_FLAP_MS goes unnoticed
+ * by the stack. The MAC and both DMA rings keep running, TX holds: frames
+ * wait in the class queues (ETHIF_TX_QUEUE_LEN each, then ERR_MEM) and go
+ * out when the link is back, at the same speed and duplex; the netif, ARP,
+ * DHCP and TCP see a delay only. Back at another speed and duplex the MAC
+ * is restarted with the netif up. Once the window has run out the netif is
+ * taken down. 0: every loss of link takes the netif down at once. */
+#ifndef ETHIF_LINK_FLAP_MS
+#define ETHIF_LINK_FLAP_MS            3000U
+#endif
+
+#if ETHIF_LINK_FLAP_MS && !ETHIF_TX_QUEUE
+#error "ETHIF_LINK_FLAP_MS needs ETHIF_TX_QUEUE"
+#endif
+
+/* DMA and MTL profile at start, an EthIfDmaProfileIdTypeDef (ethernetif.h);
+ * ethernetif_dma_profile_set() changes it at run time. ETHIF_JUMBO needs
+ * the FIFOs in threshold mode and turns store and forward into 64 bytes. */
+#ifndef ETHIF_DMA_PROFILE
+#define ETHIF_DMA_PROFILE             0
+#endif
+
+/* Longest wait for frames already given to the DMA before a profile change
+ * stops it */
+#ifndef ETHIF_DMA_PROFILE_DRAIN_MS
+#define ETHIF_DMA_PROFILE_DRAIN_MS    10U
+#endif
+
+/* Raw Ethernet channel: ethernetif_raw_send() gives whole frames of any
+ * EtherType to the TX path under the core lock, past ARP and IP; with an
+ * RX steering rule for the same EtherType (ethernetif_rx_steer_queue())
+ * the answers come back the same way, past lwIP, for controller to
+ * controller messages that need no IP. */
+#ifndef ETHIF_RAW
+#define ETHIF_RAW                     1
+#endif
+
+/* Traffic generator (ethernetif_pktgen_start()): pre-built frames of one
+ * size and ETHIF_PKTGEN_TYPE go straight to the TX descriptors, past lwIP,
+ * at a set rate or as fast as the ring takes them, for the packet rate
+ * limit of the MAC, the driver and the peer to compare the stack against.
+ * Frames the peer sends back (ETHIF_RX_STEER) are counted as echoes.
+ * Queued stack frames always go first. A test tool, off by default. */
+#ifndef ETHIF_PKTGEN
+#define ETHIF_PKTGEN                  0
+#endif
+
+#if ETHIF_PKTGEN && !ETHIF_TX_QUEUE
+#error "ETHIF_PKTGEN needs ETHIF_TX_QUEUE"
+#endif
+
+/* Generator frames in flight, each an ETHIF_FRAME_MAX buffer in AXI SRAM;
+ * fewer than ETH_TX_DESC_CNT leave descriptors to the stack */
+#ifndef ETHIF_PKTGEN_BUFS
+#define ETHIF_PKTGEN_BUFS             ETH_TX_DESC_CNT
+#endif
+
+/* EtherType of the generated frames, IEEE 802 local experimental 1 */
+#ifndef ETHIF_PKTGEN_TYPE
+#define ETHIF_PKTGEN_TYPE             0x88B5U
+#endif
+
+/* PHY loopback benchmark (ethernetif_loopback_bench(), ETHIF_PKTGEN and
+ * ETHIF_RX_STEER): the generator's frames turn around in the LAN8742 and
+ * come back through the whole receive path, no cable or peer needed. The
+ * PHY is given this long to switch before the run. */
+#ifndef ETHIF_LOOPBACK_SETTLE_MS
+#define ETHIF_LOOPBACK_SETTLE_MS      10U
+#endif
+
+/* Receive latency trace: each frame carries the cycle count of the RX
+ * interrupt that announced it, and log-scale histograms collect the delay
+ * to the EthIf wakeup, the hand-over to the tcpip thread, ethernet_input()
+ * and its return, and to ethernetif_rx_latency_mark() called by the
+ * application. Queried with ethernetif_rx_latency_get(), logged with the
+ * driver counters. Needs the DWT cycle counter (run-time stats). */
+#ifndef ETHIF_RX_LATENCY
+#define ETHIF_RX_LATENCY              0
+#endif
+
+/* lwIP core lock profile: sys_lock_tcpip_core() measures, per thread, the
+ * wait for the core lock and the time it is then held, and counts
+ * acquisitions that found it taken (ethernetif_core_lock_get(), logged with
+ * the driver counters and exported by the metrics). The counters are
+ * updated while the lock is held and need no lock of their own. 0 leaves
+ * the plain mutex; release builds (no DEBUG) default to 0. */
+#ifndef ETHIF_CORE_LOCK_PROF
+#ifdef DEBUG
+#define ETHIF_CORE_LOCK_PROF          1
+#else
+#define ETHIF_CORE_LOCK_PROF          0
+#endif
+#endif
+
+/* Threads told apart; later ones share the last entry */
+#ifndef ETHIF_CORE_LOCK_PROF_THREADS
+#define ETHIF_CORE_LOCK_PROF_THREADS  12U
+#endif
+
+/* Check of lwIP API calls for the core lock (LWIP_ASSERT_CORE_LOCKED):
+ *  2: assert and halt at a breakpoint on a call without the lock
+ *  1: count such calls (ethernetif_core_lock_violations(), metric
+ *     lwip.core_lock.violations) and log the first; one load per call
+ *  0: no check, the macro compiles to nothing
+ * DEBUG builds default to 2, release builds to 1. */
+#ifndef ETHIF_CORE_LOCK_CHECK
+#ifdef DEBUG
+#define ETHIF_CORE_LOCK_CHECK         2
+#else
+#define ETHIF_CORE_LOCK_CHECK         1
+#endif
+#endif
+
+#endif /* ETHERNETIF_OPTS_H */
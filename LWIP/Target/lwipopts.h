@@ -52,9 +52,12 @@
 /*----- Value in opt.h for MEM_ALIGNMENT: 1 -----*/
 #define MEM_ALIGNMENT 4
 /*----- Default Value for MEM_SIZE: 1600 ---*/
-#define MEM_SIZE 131048
+/* ETH_CODE: the heap is MPU region 1 of the device's memory map
+ * (mpu/mpu_layout.h): 131048 and 0x30020000 on the H743 */
+#include "mpu/mpu_layout.h"
+#define MEM_SIZE (MPU_LAYOUT_HEAP_SIZE - 24U)
 /*----- Default Value for H7 devices: 0x30004000 -----*/
-#define LWIP_RAM_HEAP_POINTER 0x30020000
+#define LWIP_RAM_HEAP_POINTER MPU_LAYOUT_HEAP_BASE
 /*----- Value supported for H7 devices: 1 -----*/
 #define LWIP_SUPPORT_CUSTOM_PBUF 1
 /*----- Value in opt.h for LWIP_ETHERNET: LWIP_ARP || PPPOE_SUPPORT -*/
@@ -113,9 +116,9 @@
 #define CHECKSUM_CHECK_ICMP6 0
 /*-----------------------------------------------------------------------------*/
 /* USER CODE BEGIN 1 */
-#define SNTP_SET_SYSTEM_TIME(sec) sntp_get_time(sec)
 /* ETH_CODE: first 2 macros solve errno issue with GCC 10 and ST LwIP
- * LWIPERF_CHECK_RX_DATA enables data check for iperf. Removing it might improve performance.
+ * LWIPERF_CHECK_RX_DATA compiles in the data check for iperf. It is off at startup
+ * and switched at runtime (iperf_service_set_rx_check()), as it costs throughput.
  */
 
 #undef LWIP_PROVIDE_ERRNO
@@ -123,20 +126,419 @@
 
 #define LWIPERF_CHECK_RX_DATA 1
 
+/* ETH_CODE: windows, mailboxes, pools, RX buffers and the TCP timer as one
+ * performance profile (LWIP_PROFILE), checked against the memory map in
+ * ethernetif.c. Ahead of ethernetif_opts.h, which takes its RX counts. */
+#include "lwipopts_profile.h"
+
+/* ETH_CODE: IGMP group membership; ethernetif.c keeps the MAC multicast
+ * hash filter in sync with the joined groups. */
+#define LWIP_IGMP 1
+
+/* ETH_CODE: ethernetif.c follows address changes (ARP offload) */
+#define LWIP_NETIF_EXT_STATUS_CALLBACK 1
+
 /* ETH_CODE: macro and prototypes for proper (hopefuly?)
  * multithreading support
  */
 #define LOCK_TCPIP_CORE sys_lock_tcpip_core
 #define UNLOCK_TCPIP_CORE sys_unlock_tcpip_core
 
+/* ETH_CODE: ETHIF_CORE_LOCK_CHECK 0 drops the check from every API call */
+#include "ethernetif_opts.h"
+#if ETHIF_CORE_LOCK_CHECK
 #define LWIP_ASSERT_CORE_LOCKED sys_check_core_locking
+#else
+#define LWIP_ASSERT_CORE_LOCKED()
+#endif
 #define LWIP_MARK_TCPIP_THREAD sys_mark_tcpip_thread
 
+/* ETH_CODE: ETHIF_RX_INLINE delivers frames under the core lock, see
+ * ethernetif_opts.h */
+#define LWIP_TCPIP_CORE_LOCKING_INPUT ETHIF_RX_INLINE
+
+/* ETH_CODE: the tcpip thread mailbox and its input messages follow the RX
+ * buffer count, see ETHIF_TCPIP_MBOX_SIZE in ethernetif_opts.h */
+#undef TCPIP_MBOX_SIZE
+#define TCPIP_MBOX_SIZE ETHIF_TCPIP_MBOX_SIZE
+#define MEMP_NUM_TCPIP_MSG_INPKT ETH_RX_BUFFER_CNT
+
 void sys_lock_tcpip_core(void);
 void sys_unlock_tcpip_core(void);
 
 void sys_check_core_locking(void);
 void sys_mark_tcpip_thread(void);
+
+/* ETH_CODE: large pbuf and socket copies go to the MDMA, see
+ * component/mdma/mdma_copy_opts.h; the others and header copies
+ * (SMEMCPY) to the word copy of component/memops/memops.h */
+#include "mdma/mdma_copy.h"
+#include "memops/memops.h"
+#if MDMA_COPY_LWIP
+#define MEMCPY(dst, src, len) mdma_copy(dst, src, len)
+#elif MEMOPS_LWIP
+#define MEMCPY(dst, src, len) MEMOPS_COPY(dst, src, len)
+#endif
+#if MEMOPS_LWIP
+#define SMEMCPY(dst, src, len) MEMOPS_COPY(dst, src, len)
+#endif
+
+/* ETH_CODE: software checksums (ICMP, IGMP, offload off) use the carry
+ * chain kernel, see component/chksum/chksum_m7.h */
+#include "chksum/chksum_m7.h"
+#if CHKSUM_M7
+#define LWIP_CHKSUM chksum_m7
+#define LWIP_CHKSUM_COPY(dst, src, len) chksum_m7_copy(dst, src, len)
+#endif
+
+/* ETH_CODE: SYS_ARCH_PROTECT (memp pools, pbuf free, stats) raises BASEPRI
+ * to configMAX_SYSCALL_INTERRUPT_PRIORITY for its few instructions instead
+ * of taking the generated port's CMSIS mutex, a kernel call per pool
+ * operation that may switch tasks and cannot be used from the ETH
+ * interrupt. 0 restores the mutex. "bench=sys_protect" of the Bench
+ * configuration compares the two. */
+#ifndef SYS_ARCH_PROTECT_BASEPRI
+#define SYS_ARCH_PROTECT_BASEPRI 1
+#endif
+
+/* ETH_CODE: pool free lists as lock-free stacks (opt.h): RX_POOL buffers
+ * are taken by the RX path and given back by whichever task frees the
+ * pbuf, PBUF and TCP_SEG by the tcpip thread, the driver and the
+ * applications, none of them waiting on the others. */
+#define MEMP_LOCKFREE 1
+
+/* ETH_CODE: per-packet metadata in every struct pbuf, 8 bytes more each:
+ * a DWT timestamp, traffic class, receive queue and flags, filled by the
+ * driver and read by the applications (ETHIF_META_* in ethernetif.h).
+ * Zeroed on allocation, taken over by pbuf_clone(). */
+#define LWIP_PBUF_CUSTOM_DATA \
+  u32_t meta_stamp;           \
+  u8_t meta_class;            \
+  u8_t meta_queue;            \
+  u8_t meta_flags;
+#define LWIP_PBUF_CUSTOM_DATA_INIT(p) \
+  do { (p)->meta_stamp = 0U; (p)->meta_class = 0U; (p)->meta_queue = 0U; (p)->meta_flags = 0U; } while (0)
+#define LWIP_PBUF_CUSTOM_DATA_COPY(q, p) \
+  do { (q)->meta_stamp = (p)->meta_stamp; (q)->meta_class = (p)->meta_class; \
+       (q)->meta_queue = (p)->meta_queue; (q)->meta_flags = (p)->meta_flags; } while (0)
+
+/* ETH_CODE: sys_mbox_* as lock-free rings of pointers with a thread flag
+ * for the sleeping fetcher instead of CMSIS message queues, which copy
+ * the message under a critical section on both ends. The tcpip thread
+ * mailbox takes every tcpip_callback(), netconn call and RX batch; see
+ * sys_arch.c. 0 restores the message queues. */
+#ifndef SYS_MBOX_LOCKFREE
+#define SYS_MBOX_LOCKFREE 1
+#endif
+
+/* ETH_CODE: PERF_START/PERF_STOP cycle statistics, see arch/perf.h.
+ * Costs a critical section per timed call; 0 compiles them out. */
+#define LWIP_PERF 1
+/* ETH_CODE: the default pool only fits lwIP's own timers. Periodic
+ * sys_timeout() users: ethernetif stats, rtstats, perf_stats, metrics,
+ * per MQTT client its cyclic and publish batch timers, and the timesync
+ * tick with the SNTP poll and reply timeout, the resolv poll, the
+ * telemetry flush and snapshot sampling, the TWAMP-light probes, the
+ * traffic generator's rate timer (ETHIF_PKTGEN). With TCP_RTO_MS one
+ * retransmission timer per TCP pcb; a coroutine connection
+ * (coro/coro_tcp.h) in CORO_TCP_SLEEP() holds one too. */
+#define MEMP_NUM_SYS_TIMEOUT (LWIP_NUM_SYS_TIMEOUT_INTERNAL + 15 + ETHIF_PKTGEN + \
+                              (TCP_RTO_MS ? MEMP_NUM_TCP_PCB : 0))
+
+/* ETH_CODE: the service names of board.h (NTP, syslog) are kept resolved
+ * by component/resolv/resolv.h. The servers are DNS_SERVER_IP1/2.
+ * DNS_TABLE_SIZE holds those names with room for a few more lookups.
+ * DNS_PREFETCH_S (a patch in dns.c): a name looked up since its last
+ * answer is asked again an eighth of its TTL plus DNS_PREFETCH_S before
+ * it expires, the old answer serving meanwhile, so a lookup never waits
+ * on the server after the first one. DNS_MAX_SOURCE_PORTS bounds the
+ * random source port PCBs of queries in flight. */
+#define LWIP_DNS 1
+#define DNS_TABLE_SIZE 8
+#define DNS_PREFETCH_S 16
+#define DNS_MAX_SOURCE_PORTS 2
+
+/* ETH_CODE: the address comes from DHCP, see component/dhcpc/dhcp_client.h:
+ * the last lease is kept across resets and asked for again in INIT-REBOOT
+ * (a patch in dhcp.c), used right away while it lasts; without one,
+ * DISCOVER asks for Rapid Commit (a patch in dhcp.c too). The DNS
+ * servers of the lease replace DNS_SERVER_IP1/2. */
+#define LWIP_DHCP 1
+#define LWIP_DHCP_INIT_REBOOT 1
+#define LWIP_DHCP_RAPID_COMMIT 1
+#define LWIP_HOOK_DHCP_LEASE(netif, dhcp) dhcp_client_lease(netif, dhcp)
+struct netif;
+struct dhcp;
+void dhcp_client_lease(struct netif *netif, const struct dhcp *dhcp);
+
+/* ETH_CODE: UDP users: syslog, DNS (DNS_MAX_SOURCE_PORTS), SNTP, metrics
+ * (StatsD), the pcap tftp listener and its transfer, iperf UDP, the trace
+ * stream, DHCP and the telemetry blocks */
+#define MEMP_NUM_UDP_PCB 11
+
+/* ETH_CODE: sys_timeout() and the cyclic stack timers run on a timer
+ * wheel, see component/twheel/twheel.h. MEMP_NUM_SYS_TIMEOUT sizes its
+ * node pool. */
+#include "twheel/twheel.h"
+#if TWHEEL_LWIP
+#define LWIP_TIMERS_CUSTOM 1
+#endif
+
+/* ETH_CODE: mem_malloc() (PBUF_RAM) from size-class pools instead of the
+ * first-fit MEM_SIZE heap, see lwippools.h. MEM_SIZE and
+ * LWIP_RAM_HEAP_POINTER then only describe the D2 window they occupy.
+ * LWIP_MEM_TLSF 1 makes that window one TLSF heap instead (tlsf_lwip.c in
+ * component/tlsf): also O(1), and no bytes are set aside per size class,
+ * at the price of fragmentation ("lwip.heap.*" metrics). */
+#ifndef LWIP_MEM_TLSF
+#define LWIP_MEM_TLSF 0
+#endif
+#if LWIP_MEM_TLSF
+#include "tlsf/tlsf.h"
+#define MEM_LIBC_MALLOC 1
+#define mem_clib_malloc tlsf_lwip_malloc
+#define mem_clib_calloc tlsf_lwip_calloc
+#define mem_clib_free tlsf_lwip_free
+#else
+#define MEM_USE_POOLS 1
+#define MEMP_USE_CUSTOM_POOLS 1
+#define MEM_USE_POOLS_TRY_BIGGER_POOL 1
+#endif
+
+/* ETH_CODE: bulk TCP profile (firmware upload, log archive). The send
+ * buffer covers the bandwidth-delay product TCP_PROFILE_KBPS x
+ * TCP_PROFILE_RTT_US; queue lengths and thresholds derive from it (opt.h
+ * formulas). The receive window is TCP_PROFILE_RX_SEGS full segments:
+ * unread data stays in the zero-copy RX_POOL, so a window larger than the
+ * buffers outside the RX ring only turns into drops. Window scaling lets
+ * peer windows above 64 KB be used. ethernetif.c checks the window against
+ * RX_POOL and the send buffer against the 1600-byte malloc pool at compile
+ * time. The three TCP_PROFILE_* figures come from the LWIP_PROFILE in
+ * lwipopts_profile.h. 0 keeps the CubeMX values above. */
+#ifndef TCP_PROFILE_BULK
+#define TCP_PROFILE_BULK 1
+#endif
+#if TCP_PROFILE_BULK
+#define TCP_MSS 1460
+#define LWIP_WND_SCALE 1
+#define TCP_RCV_SCALE 0
+#define TCP_WND (TCP_PROFILE_RX_SEGS * TCP_MSS)
+/* BDP rounded up to whole segments: 51100 bytes with the default profile */
+#define TCP_SND_BUF \
+  (((TCP_PROFILE_KBPS / 8 * TCP_PROFILE_RTT_US / 1000) + TCP_MSS - 1) / TCP_MSS * TCP_MSS)
+#undef TCP_SND_QUEUELEN
+#define TCP_SND_QUEUELEN (2 * TCP_SND_BUF / TCP_MSS)
+#undef TCP_SNDLOWAT
+#undef TCP_SNDQUEUELOWAT
+#undef TCP_WND_UPDATE_THRESHOLD
+#define MEMP_NUM_TCP_SEG (TCP_SND_QUEUELEN + TCP_PROFILE_RX_SEGS)
+#undef DEFAULT_TCP_RECVMBOX_SIZE
+#define DEFAULT_TCP_RECVMBOX_SIZE TCP_PROFILE_RX_SEGS
+#endif
+
+/* ETH_CODE: ARP cache sized for a plant subnet (PLCs, controllers, HMIs).
+ * ETHARP_HASH chains the entries in ETHARP_HASH_SIZE buckets (power of 2)
+ * keyed on the IPv4 address, so lookups don't sweep the table; only
+ * creating an entry still looks for an empty or the oldest one.
+ * LWIP_NETIF_HWADDRHINT keeps the last entry used by each PCB instead of
+ * a single global one, which thrashes as soon as two peers alternate. */
+#define ARP_TABLE_SIZE 64
+#define ETHARP_HASH 1
+#define ETHARP_HASH_SIZE 64
+#define LWIP_NETIF_HWADDRHINT 1
+
+/* ETH_CODE: no resolution on the send path for control peers. Entries in
+ * use are re-requested a minute before they expire (ETHARP_REFRESH),
+ * etharp_pin() keeps the control peers' entries for good (the control
+ * channel pins its peer) and etharp_add_static_entry() takes fixed ones. */
+#define ETHARP_REFRESH 60
+#define ETHARP_PIN_MAX 4
+#define ETHARP_SUPPORT_STATIC_ENTRIES 1
+
+/* ETH_CODE: pcb demultiplexing through hash chains. tcp_input() looks up
+ * active and TIME-WAIT connections by ports and peer address, listeners
+ * by local port; udp_input() looks only at the pcbs on the destination
+ * port. The cost no longer grows with the number of Modbus/TCP and
+ * telemetry sessions. The pcb lists stay, so timers and wildcard matches
+ * behave as before. */
+#define TCP_PCB_HASH 1
+#define TCP_PCB_HASH_SIZE 32
+#define UDP_PCB_HASH 1
+#define UDP_PCB_HASH_SIZE 16
+
+/* ETH_CODE: udp_tpl_send() for fixed-peer streams (syslog): Ethernet, IP
+ * and UDP headers built once per peer instead of a route lookup, an ARP
+ * lookup and three headers per datagram. */
+#define UDP_TPL 1
+
+/* ETH_CODE: RTT and RTO in milliseconds, retransmissions timed by the
+ * timer wheel. On the LAN a lost segment is resent after 50 ms instead of
+ * the 1 s or more the 500 ms tick allows; the floor stays above the 40 ms
+ * delayed ACK of Linux and Windows peers. */
+#define TCP_RTO_MS 1
+#define TCP_RTO_MIN_MS 50
+
+/* ETH_CODE: per-connection retransmission and stall counts, for the
+ * lwip.tcp.conn.* metrics and the connection table of the diagnostics
+ * page (/tcp.json) */
+#define TCP_CONN_STATS 1
+
+/* ETH_CODE: send buffers sized per connection (opt.h). A Modbus/TCP or
+ * telemetry session idles at two segments; a bulk transfer grows to
+ * TCP_SND_BUF as its window opens and gives it back once it goes quiet.
+ * What lies above the two segments is shared: one full TCP_SND_BUF, split
+ * between concurrent transfers, instead of one per connection. The queued
+ * data lives in the 1600-byte malloc pool, which ethernetif.c checks the
+ * budget against. */
+#if TCP_PROFILE_BULK
+#define TCP_SND_AUTOTUNE 1
+#define TCP_SND_BUF_MIN (2 * TCP_MSS)
+#define TCP_SND_BUF_MAX TCP_SND_BUF
+#define TCP_SND_BUDGET (TCP_SND_BUF - TCP_SND_BUF_MIN)
+#endif
+
+/* ETH_CODE: out-of-order segments sit in their zero-copy RX_POOL buffer,
+ * so one lossy connection could keep the ring from being refilled for
+ * every other. A connection queues at most two thirds of the buffers
+ * outside the ring, all of them together leave ETHIF_RX_POOL_LOW free,
+ * and at that watermark ethernetif.c stops the queues growing and evicts
+ * the largest (ethernetif_opts.h). */
+#define TCP_OOSEQ_GOVERN 1
+#define TCP_OOSEQ_MAX_PBUFS ((ETH_RX_BUFFER_CNT - ETH_RX_DESC_CNT) * 2U / 3U)
+#define TCP_OOSEQ_TOTAL_MAX_PBUFS (ETH_RX_BUFFER_CNT - ETH_RX_DESC_CNT - ETHIF_RX_POOL_LOW)
+#define TCP_OOSEQ_POOL_LOW() ethernetif_rx_pool_low()
+int ethernetif_rx_pool_low(void);
+
+/* ETH_CODE: socket event queues (lwip_evq_*() in sockets.h) for a task
+ * serving many connections (Modbus/TCP, telemetry): waiting costs the
+ * ready sockets, not all of them. Room for that many connections. */
+#define LWIP_SOCKET_EVQ 1
+#define MEMP_NUM_NETCONN 16
+#define MEMP_NUM_TCP_PCB 16
+
+/* ETH_CODE: datagrams in batches for high-rate UDP (telemetry ingest):
+ * lwip_sendmmsg() takes the core lock once per LWIP_NETCONN_BATCH_MAX
+ * datagrams, lwip_recvmmsg() looks the socket up once per call. Each
+ * queued datagram holds a netbuf, so a full UDP mailbox needs that many
+ * (the default of 2 dropped the rest of a burst before it was queued). */
+#define LWIP_NETCONN_BATCH 1
+#define MEMP_NUM_NETBUF DEFAULT_UDP_RECVMBOX_SIZE
+
+/* ETH_CODE: a blocking netconn call (connect, close, a write the send
+ * buffer cannot take at once) waits on a semaphore of the calling task,
+ * created on its first call and kept in FreeRTOS thread local storage,
+ * instead of one created with every netconn (sys_arch.c). A reader task
+ * and a writer task can then share a socket: each waits on its own, and
+ * a close from either wakes the other (LWIP_NETCONN_FULLDUPLEX). One
+ * reader per socket: the lock-free mailboxes have a single fetcher. */
+#define LWIP_NETCONN_SEM_PER_THREAD 1
+#define LWIP_NETCONN_FULLDUPLEX 1
+/* Thread local storage slot, see FreeRTOSConfig.h */
+#define LWIP_NETCONN_SEM_TLS_INDEX 1
+/* Tasks making netconn or socket calls at once */
+#define LWIP_NETCONN_THREAD_SEMS 16
+
+/* ETH_CODE: a netconn reader falling behind (deep mailbox, or no receive
+ * for 20 ms) gets copies in PBUF_RAM instead of the RX_POOL buffers, which
+ * go straight back to the ring. Frames with a PTP receive timestamp and
+ * RX_SMALL copies stay as they are. */
+#define NETCONN_RX_COPY 1
+#define NETCONN_RX_COPY_DEPTH 4
+#define NETCONN_RX_COPY_AGE 20
+#define NETCONN_RX_PINNED(q) ethernetif_rx_pinned(q)
+struct pbuf;
+int ethernetif_rx_pinned(const struct pbuf *q);
+/* ETH_CODE: a netconn holds at most 4 of the ETH_RX_BUFFER_CNT ring
+ * buffers, whatever the data in them; beyond, received data is copied or,
+ * a datagram without memory for a copy, dropped */
+#define NETCONN_RX_PINNED_SIZE(q) ETH_RX_BUFFER_SIZE
+#define NETCONN_RX_PINNED_MAX (4 * ETH_RX_BUFFER_SIZE)
+
+/* ETH_CODE: UDP and RAW sockets queue at most recv_bufsize bytes (CubeMX
+ * leaves it unlimited). It starts at 8 KB and follows the reader: twice
+ * what it takes per 100 ms, more when bursts overflow a reader that keeps
+ * up, between two full datagrams and 32 KB. SO_RCVBUF fixes it. */
+#define LWIP_SO_RCVBUF 1
+#undef RECV_BUFSIZE_DEFAULT
+#define RECV_BUFSIZE_DEFAULT 8192
+#define RECV_BUFSIZE_AUTOTUNE 1
+#define RECV_BUFSIZE_MIN (2 * 1472)
+#define RECV_BUFSIZE_MAX 32768
+#define RECV_BUFSIZE_TUNE_MS 100
+
+/* ETH_CODE: IP fragments waiting for the rest of their datagram are copied
+ * out of RX_POOL into PBUF_POOL, which receive does not use otherwise: a
+ * few incomplete datagrams would drain the receive buffers. Up to three
+ * quarters of the pool pbufs for reassembly (PBUF_POOL_SIZE is set by the
+ * profile), datagrams up to 8 KiB, given up after 3 s instead of 15. */
+#define IP_REASS_COPY 1
+#define IP_REASS_COPY_NEEDED(p) ethernetif_rx_pinned(p)
+#define IP_REASS_MAX_PBUFS (PBUF_POOL_SIZE * 3 / 4)
+#define IP_REASS_DGRAM_MAX 8192
+#define IP_REASS_MAXAGE 3
+
+/* ETH_CODE: SO_TIMESTAMP and netbuf_rxtime(), from the receive stamp of
+ * the packet metadata (ethernetif.h) */
+#define LWIP_SO_TIMESTAMP 1
+#define LWIP_PBUF_RX_TIME(p, mono_ns, utc_ns) ethernetif_rx_time(p, mono_ns, utc_ns)
+int ethernetif_rx_time(const struct pbuf *p, uint64_t *mono_ns, uint64_t *utc_ns);
+
+/* ETH_CODE: zero-copy netconn_write_ref() / tcp_write_ref(): the data is
+ * referenced, not copied, and a callback says when it can be reused. */
+#define LWIP_TCP_TXREF 1
+
+/* ETH_CODE: MQTT telemetry publishing. A 4 KiB output ring and 16 requests
+ * in flight instead of 256 bytes and 4; mqtt_publish_ref() sends payloads
+ * by reference (tcp_write_ref()), only their headers go through the ring.
+ * mqtt_client_t no longer fits the largest heap pool (lwippools.h):
+ * allocate it statically, not with mqtt_client_new(). See
+ * component/bench/mqtt_bench.h. */
+#define MQTT_OUTPUT_RINGBUF_SIZE 4096
+#define MQTT_REQ_MAX_IN_FLIGHT 16
+#define MQTT_PUBLISH_REF 1
+/* ETH_CODE: no MQTT over TLS in this tree. It would take LWIP_ALTCP and
+ * LWIP_ALTCP_TLS with lwIP's apps/altcp_tls/altcp_tls_mbedtls.c, and
+ * mbedTLS itself; neither source is part of the project. LWIP_ALTCP also
+ * rules out MQTT_PUBLISH_REF (mqtt.c): payloads sent by reference would
+ * bypass the TLS layer, so a TLS build goes back to copying them through
+ * the output ring. */
+/* ETH_CODE: telemetry publishes many topics with long names. Publishes
+ * can share TCP segments (publish_batch_ms in the client info, 0 = off),
+ * and MQTT 5 topic aliases replace the first 32 topics (up to 64 chars)
+ * by two bytes after their first publish. MQTT_V5 needs an MQTT 5 broker
+ * (Mosquitto 1.6+, EMQX, HiveMQ); a 3.1.1-only one refuses the connect. */
+#define MQTT_PUBLISH_BATCH 1
+#define MQTT_V5 1
+#define MQTT_TOPIC_ALIAS_NUM 32
+
+/* ETH_CODE: fewer pure ACKs for inbound bulk TCP, which share the TX
+ * path with outbound telemetry: one ACK per connection for all the frames
+ * an RX drain delivers (ethernetif_rx_drain()), and with the bulk profile
+ * an immediate ACK every LWIP_PROFILE_TCP_ACK_EVERY segments, 4 or a third
+ * of the TCP_PROFILE_RX_SEGS window by default (the delayed ACK timer
+ * covers the tail of a burst). */
+#define TCP_ACK_BATCH 1
+#if TCP_PROFILE_BULK
+#define TCP_ACK_EVERY LWIP_PROFILE_TCP_ACK_EVERY
+#endif
+
+/* ETH_CODE: tcp_output() sends its segments as one batch, so the driver
+ * starts the TX DMA once per batch, see ETHIF_TX_BATCH in ethernetif_opts.h */
+#define LWIP_NETIF_TX_BATCH ETHIF_TX_BATCH
+
+/* ETH_CODE: protocol, heap and pool statistics for the metrics exporter
+ * (component/metrics/metrics_sources.c). Counters are plain increments:
+ * the core stats are only written under the core lock, memp and mem stats
+ * under the allocator's own protection (atomic updates with MEMP_LOCKFREE),
+ * so no extra SYS_ARCH_PROTECT.
+ * 32-bit counters are read tear-free by a single load and don't wrap at
+ * 65535. Each group starts on its own 32-byte D-cache line.
+ * SYS_STATS stays off: sys_arch.c updates them from any task unlocked. */
+#undef LWIP_STATS
+#define LWIP_STATS 1
+#define LWIP_STATS_LARGE 1
+#define SYS_STATS 0
+#define LWIP_STATS_ALIGN __attribute__((aligned(32)))
 /* USER CODE END 1 */
 
 #ifdef __cplusplus
@@ -0,0 +1,184 @@
+/**
+ * @file lwipopts_profile.h
+ * @brief Performance profiles of the lwIP configuration: coherent sets of
+ *        windows, mailboxes, pools, RX buffers and timer granularity.
+ *
+ * lwipopts.h is CubeMX's flat list of options, tuned one by one. A
+ * profile sets the options that have to move together. Pick one with
+ * -DLWIP_PROFILE=<n>:
+ *
+ *                               DEFAULT  LOW_LATENCY  THROUGHPUT  LOW_MEMORY
+ *   TCP send buffer, kbit/s x   100M x   100M x       100M x      20M x
+ *     RTT (TCP_SND_BUF)         4 ms     1 ms         5 ms        4 ms
+ *   receive window, segments    12       8            12          4
+ *   immediate ACK every         4        2            4           2
+ *   UDP / accept mailbox        6 / 6    4 / 6        12 / 6      4 / 4
+ *   malloc pools 128/640/1600   64/64/48 64/64/48     64/24/64    32/24/16
+ *   PBUF_POOL (reassembly)      16       16           16          8
+ *   RX buffers beyond 2/desc    4        4            4           0
+ *   RX_SMALL copies             32       32           32          16
+ *   TCP_TMR_INTERVAL, ms        250      100          250         250
+ *
+ * DEFAULT is the configuration this tree was tuned with. LOW_LATENCY
+ * keeps queues short and runs the delayed ACK and fast retransmit timer
+ * every 100 ms. THROUGHPUT moves the malloc pools toward full-size
+ * segments for a 5 ms bandwidth-delay product. LOW_MEMORY leaves about
+ * 80 KB of the D2 heap region and 20 KB of AXI SRAM unused on the H743 and
+ * is the default on the H72x/H73x, whose heap region is 64 KB. The TCP
+ * receive window and mailbox follow from the segment count
+ * (TCP_PROFILE_BULK in lwipopts.h). Apart from the mailboxes, which
+ * CubeMX defines, a single option can still be set on the command line:
+ * the profile only sets what is not defined yet.
+ *
+ * ethernetif.c checks the result against the memory map at compile time:
+ * the malloc pools against MPU region 1 (the heap: 128 KB of D2 SRAM on
+ * the H743, 64 KB of AXI SRAM on the H72x), descriptors and RX_POOL
+ * against region 2 (D2, 32 KB), and the lwIP pools in .bss against
+ * LWIP_PROFILE_AXI_BUDGET of AXI SRAM (region 3). The linker script
+ * asserts the placement once more.
+ *
+ * Included by lwipopts.h after mpu/mpu_layout.h and before
+ * ethernetif_opts.h; no lwIP types here.
+ */
+
+#ifndef LWIPOPTS_PROFILE_H
+#define LWIPOPTS_PROFILE_H
+
+#define LWIP_PROFILE_DEFAULT      0
+#define LWIP_PROFILE_LOW_LATENCY  1
+#define LWIP_PROFILE_THROUGHPUT   2
+#define LWIP_PROFILE_LOW_MEMORY   3
+
+/* The H72x/H73x heap (64 KB, mpu/mpu_layout.h) holds the LOW_MEMORY pools */
+#ifndef LWIP_PROFILE
+#if defined(MPU_LAYOUT_MAP) && MPU_LAYOUT_MAP == MPU_MAP_H72X
+#define LWIP_PROFILE LWIP_PROFILE_LOW_MEMORY
+#else
+#define LWIP_PROFILE LWIP_PROFILE_DEFAULT
+#endif
+#endif
+
+#if LWIP_PROFILE == LWIP_PROFILE_DEFAULT
+#define LWIP_PROFILE_NAME             "default"
+#define LWIP_PROFILE_TCP_KBPS         100000
+#define LWIP_PROFILE_TCP_RTT_US       4000
+#define LWIP_PROFILE_TCP_RX_SEGS      12
+#define LWIP_PROFILE_TCP_ACK_EVERY    4
+#define LWIP_PROFILE_UDP_MBOX         6
+#define LWIP_PROFILE_ACCEPT_MBOX      6
+#define LWIP_PROFILE_POOL_128         64
+#define LWIP_PROFILE_POOL_640         64
+#define LWIP_PROFILE_POOL_1600        48
+#define LWIP_PROFILE_PBUF_POOL        16
+#define LWIP_PROFILE_RX_SPARE         4U
+#define LWIP_PROFILE_RX_SMALL         32U
+#define LWIP_PROFILE_TCP_TMR_MS       250
+
+#elif LWIP_PROFILE == LWIP_PROFILE_LOW_LATENCY
+#define LWIP_PROFILE_NAME             "low-latency"
+#define LWIP_PROFILE_TCP_KBPS         100000
+#define LWIP_PROFILE_TCP_RTT_US       1000
+#define LWIP_PROFILE_TCP_RX_SEGS      8
+#define LWIP_PROFILE_TCP_ACK_EVERY    2
+#define LWIP_PROFILE_UDP_MBOX         4
+#define LWIP_PROFILE_ACCEPT_MBOX      6
+#define LWIP_PROFILE_POOL_128         64
+#define LWIP_PROFILE_POOL_640         64
+#define LWIP_PROFILE_POOL_1600        48
+#define LWIP_PROFILE_PBUF_POOL        16
+#define LWIP_PROFILE_RX_SPARE         4U
+#define LWIP_PROFILE_RX_SMALL         32U
+#define LWIP_PROFILE_TCP_TMR_MS       100
+
+#elif LWIP_PROFILE == LWIP_PROFILE_THROUGHPUT
+#define LWIP_PROFILE_NAME             "throughput"
+#define LWIP_PROFILE_TCP_KBPS         100000
+#define LWIP_PROFILE_TCP_RTT_US       5000
+#define LWIP_PROFILE_TCP_RX_SEGS      12
+#define LWIP_PROFILE_TCP_ACK_EVERY    4
+#define LWIP_PROFILE_UDP_MBOX         12
+#define LWIP_PROFILE_ACCEPT_MBOX      6
+#define LWIP_PROFILE_POOL_128         64
+#define LWIP_PROFILE_POOL_640         24
+#define LWIP_PROFILE_POOL_1600        64
+#define LWIP_PROFILE_PBUF_POOL        16
+#define LWIP_PROFILE_RX_SPARE         4U
+#define LWIP_PROFILE_RX_SMALL         32U
+#define LWIP_PROFILE_TCP_TMR_MS       250
+
+#elif LWIP_PROFILE == LWIP_PROFILE_LOW_MEMORY
+#define LWIP_PROFILE_NAME             "low-memory"
+#define LWIP_PROFILE_TCP_KBPS         20000
+#define LWIP_PROFILE_TCP_RTT_US       4000
+#define LWIP_PROFILE_TCP_RX_SEGS      4
+#define LWIP_PROFILE_TCP_ACK_EVERY    2
+#define LWIP_PROFILE_UDP_MBOX         4
+#define LWIP_PROFILE_ACCEPT_MBOX      4
+#define LWIP_PROFILE_POOL_128         32
+#define LWIP_PROFILE_POOL_640         24
+#define LWIP_PROFILE_POOL_1600        16
+#define LWIP_PROFILE_PBUF_POOL        8
+#define LWIP_PROFILE_RX_SPARE         0U
+#define LWIP_PROFILE_RX_SMALL         16U
+#define LWIP_PROFILE_TCP_TMR_MS       250
+
+#else
+#error "LWIP_PROFILE: unknown profile"
+#endif
+
+/* AXI SRAM the lwIP pools in .bss may take (PBUF_POOL, pbufs, TCP
+ * segments and pcbs, RX_SMALL); the rest of region 3 holds the task
+ * stacks, the FreeRTOS heap and the application */
+#ifndef LWIP_PROFILE_AXI_BUDGET
+#define LWIP_PROFILE_AXI_BUDGET       (64U * 1024U)
+#endif
+
+/* Bulk TCP profile of lwipopts.h */
+#ifndef TCP_PROFILE_KBPS
+#define TCP_PROFILE_KBPS LWIP_PROFILE_TCP_KBPS
+#endif
+#ifndef TCP_PROFILE_RTT_US
+#define TCP_PROFILE_RTT_US LWIP_PROFILE_TCP_RTT_US
+#endif
+#ifndef TCP_PROFILE_RX_SEGS
+#define TCP_PROFILE_RX_SEGS LWIP_PROFILE_TCP_RX_SEGS
+#endif
+
+/* Mailboxes: CubeMX defines them unconditionally, the profile replaces
+ * its values */
+#undef DEFAULT_UDP_RECVMBOX_SIZE
+#define DEFAULT_UDP_RECVMBOX_SIZE LWIP_PROFILE_UDP_MBOX
+#undef DEFAULT_ACCEPTMBOX_SIZE
+#define DEFAULT_ACCEPTMBOX_SIZE LWIP_PROFILE_ACCEPT_MBOX
+
+/* Malloc pools (lwippools.h) */
+#ifndef LWIP_POOL_128_NUM
+#define LWIP_POOL_128_NUM LWIP_PROFILE_POOL_128
+#endif
+#ifndef LWIP_POOL_640_NUM
+#define LWIP_POOL_640_NUM LWIP_PROFILE_POOL_640
+#endif
+#ifndef LWIP_POOL_1600_NUM
+#define LWIP_POOL_1600_NUM LWIP_PROFILE_POOL_1600
+#endif
+
+/* PBUF_POOL: the reassembly arena (IP_REASS_COPY) */
+#ifndef PBUF_POOL_SIZE
+#define PBUF_POOL_SIZE LWIP_PROFILE_PBUF_POOL
+#endif
+
+/* RX_POOL and RX_SMALL (ethernetif_opts.h) */
+#ifndef ETHIF_RX_BUFFER_SPARE
+#define ETHIF_RX_BUFFER_SPARE LWIP_PROFILE_RX_SPARE
+#endif
+#ifndef ETHIF_RX_SMALL_CNT
+#define ETHIF_RX_SMALL_CNT LWIP_PROFILE_RX_SMALL
+#endif
+
+/* TCP fast timer: delayed ACKs and fast retransmit; the slow timer runs at
+ * twice the interval */
+#ifndef TCP_TMR_INTERVAL
+#define TCP_TMR_INTERVAL LWIP_PROFILE_TCP_TMR_MS
+#endif
+
+#endif /* LWIPOPTS_PROFILE_H */
@@ -0,0 +1,42 @@
+/**
+ * @file lwippools.h
+ * @brief Size classes of mem_malloc() (MEM_USE_POOLS), i.e. PBUF_RAM.
+ *
+ * mem_malloc() takes the smallest class that fits and, with
+ * MEM_USE_POOLS_TRY_BIGGER_POOL, the next one up when that is empty: O(1),
+ * and a long uptime cannot fragment it. Each class is a memp pool with its
+ * own stats (metric lwip.memp.POOL_<size>.*; "max" is the high water mark).
+ *
+ * A PBUF_RAM allocation is the payload plus the headers below its layer
+ * plus the 16-byte struct pbuf:
+ *   128   TCP ACKs and control segments, ARP / ICMP / IGMP, short syslog
+ *   640   partial TCP segments, DHCP / DNS, TFTP data blocks
+ *   1600  anything up to a full frame: full TCP segments (TCP_MSS 1460, the
+ *         send buffer of lwipopts.h), and a 1472-byte UDP payload allocated
+ *         at PBUF_TRANSPORT (room for a TCP header) takes 1542
+ *
+ * The pools are linked into the non-cacheable window of MPU region 1
+ * (LWIP_RAM_HEAP_POINTER, where the MEM_SIZE heap was; D2 SRAM, or AXI SRAM
+ * on the H72x, mpu/mpu_layout.h), see .lwip_pool_sec in
+ * STM32H743VITX_FLASH.ld, which asserts that they fit.
+ *
+ * Included several times by lwip/priv/memp_std.h: no include guard.
+ */
+
+#ifndef LWIP_POOL_128_NUM
+#define LWIP_POOL_128_NUM             64
+#endif
+
+#ifndef LWIP_POOL_640_NUM
+#define LWIP_POOL_640_NUM             64
+#endif
+
+#ifndef LWIP_POOL_1600_NUM
+#define LWIP_POOL_1600_NUM            48
+#endif
+
+LWIP_MALLOC_MEMPOOL_START
+LWIP_MALLOC_MEMPOOL(LWIP_POOL_128_NUM, 128)
+LWIP_MALLOC_MEMPOOL(LWIP_POOL_640_NUM, 640)
+LWIP_MALLOC_MEMPOOL(LWIP_POOL_1600_NUM, 1600)
+LWIP_MALLOC_MEMPOOL_END
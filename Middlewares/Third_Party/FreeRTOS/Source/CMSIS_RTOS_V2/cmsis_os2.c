@@ -489,6 +489,9 @@ osThreadId_t osThreadNew (osThreadFunc_t func, void *argument, const osThreadAtt
       mem = 0;
     }
 
+    /* ETH_CODE: osPriority_t to FreeRTOS level, see FreeRTOSConfig.h */
+    prio = configOS2_TO_RTOS_PRIO(prio);
+
     if (mem == 1) {
       #if (configSUPPORT_STATIC_ALLOCATION == 1)
         hTask = xTaskCreateStatic ((TaskFunction_t)func, name, stack, argument, prio, (StackType_t  *)attr->stack_mem,
@@ -577,7 +580,7 @@ osStatus_t osThreadSetPriority (osThreadId_t thread_id, osPriority_t priority) {
   }
   else {
     stat = osOK;
-    vTaskPrioritySet (hTask, (UBaseType_t)priority);
+    vTaskPrioritySet (hTask, configOS2_TO_RTOS_PRIO(priority));
   }
 
   return (stat);
@@ -590,7 +593,7 @@ osPriority_t osThreadGetPriority (osThreadId_t thread_id) {
   if (IS_IRQ() || (hTask == NULL)) {
     prio = osPriorityError;
   } else {
-    prio = (osPriority_t)((int32_t)uxTaskPriorityGet (hTask));
+    prio = configRTOS_TO_OS2_PRIO(uxTaskPriorityGet (hTask));
   }
 
   return (prio);
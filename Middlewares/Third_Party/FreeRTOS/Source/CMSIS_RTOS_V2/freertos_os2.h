@@ -290,7 +290,10 @@
   #error "Definition configUSE_16_BIT_TICKS must be zero to implement CMSIS-RTOS2 API."
 #endif
 
-#if (configMAX_PRIORITIES != 56)
+/* ETH_CODE: configOS2_TO_RTOS_PRIO() (FreeRTOSConfig.h) maps the 56 CMSIS
+   priorities onto fewer FreeRTOS levels, which also allows optimised task
+   selection. */
+#if (configMAX_PRIORITIES != 56) && !defined(configOS2_TO_RTOS_PRIO)
   /*
     CMSIS-RTOS2 defines 56 different priorities (see osPriority_t) and portable CMSIS-RTOS2
     implementation should implement the same number of priorities.
@@ -298,7 +301,7 @@
   */
   #error "Definition configMAX_PRIORITIES must equal 56 to implement Thread Management API."
 #endif
-#if (configUSE_PORT_OPTIMISED_TASK_SELECTION != 0)
+#if (configUSE_PORT_OPTIMISED_TASK_SELECTION != 0) && !defined(configOS2_TO_RTOS_PRIO)
   /*
     CMSIS-RTOS2 requires handling of 56 different priorities (see osPriority_t) while FreeRTOS port
     optimised selection for Cortex core only handles 32 different priorities.
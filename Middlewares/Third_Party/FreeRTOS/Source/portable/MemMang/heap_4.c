@@ -32,6 +32,11 @@
  *
  * See heap_1.c, heap_2.c and heap_3.c for alternative implementations, and the
  * memory management pages of http://www.FreeRTOS.org for more information.
+ *
+ * ETH_CODE: two regions as in heap_5.c, one free list in address order:
+ * configTOTAL_HEAP_SIZE bytes in DTCM (first fit, so task control blocks,
+ * stacks and queues land there) and configHEAP_AXI_SIZE bytes in AXI SRAM,
+ * used once DTCM is full or when asked for with pvPortMallocRegion().
  */
 #include <stdlib.h>
 
@@ -45,6 +50,12 @@ task.h is included from an application file. */
 
 #undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
 
+/* ETH_CODE: HEAP_TLSF replaces this file with component/tlsf/heap_tlsf.c. */
+#if( HEAP_TLSF == 0 )
+
+/* ETH_CODE: call sites of the allocations, component/heaptrace/heap_trace.h */
+#include "heaptrace/heap_trace.h"
+
 #if( configSUPPORT_DYNAMIC_ALLOCATION == 0 )
 	#error This file must not be used if configSUPPORT_DYNAMIC_ALLOCATION is 0
 #endif
@@ -61,9 +72,19 @@ task.h is included from an application file. */
 	heap - probably so it can be placed in a special segment or address. */
 	extern uint8_t ucHeap[ configTOTAL_HEAP_SIZE ];
 #else
-	static uint8_t ucHeap[ configTOTAL_HEAP_SIZE ];
+	/* ETH_CODE: .dtcm_bss, see STM32H743VITX_FLASH.ld */
+	static uint8_t ucHeap[ configTOTAL_HEAP_SIZE ] __attribute__( ( section( ".dtcm_bss" ) ) );
 #endif /* configAPPLICATION_ALLOCATED_HEAP */
 
+/* ETH_CODE: second region, plain .bss in AXI SRAM. */
+static uint8_t ucHeapAxi[ configHEAP_AXI_SIZE ];
+
+/* Indexed by heapREGION_DTCM - 1 and heapREGION_AXI - 1, in address order. */
+#define heapNUM_REGIONS			( 2U )
+
+static uint8_t * const pucRegionStart[ heapNUM_REGIONS ] = { ucHeap, ucHeapAxi };
+static const size_t xRegionSize[ heapNUM_REGIONS ] = { configTOTAL_HEAP_SIZE, configHEAP_AXI_SIZE };
+
 /* Define the linked list structure.  This is used to link free blocks in order
 of their memory address. */
 typedef struct A_BLOCK_LINK
@@ -88,6 +109,13 @@ static void prvInsertBlockIntoFreeList( BlockLink_t *pxBlockToInsert );
  */
 static void prvHeapInit( void );
 
+/* ETH_CODE: pvPortMalloc() restricted to one region (heapREGION_ANY: all). */
+static void *prvMalloc( size_t xWantedSize, uint32_t ulRegion );
+
+/* ETH_CODE: pvPortMallocRegion() for both API functions; pvSite is the
+caller of the API function, for HEAP_TRACE. */
+static void *prvMallocPreferred( size_t xWantedSize, uint32_t ulRegion, const void *pvSite );
+
 /*-----------------------------------------------------------*/
 
 /* The size of the structure placed at the beginning of each allocated memory
@@ -97,6 +125,11 @@ static const size_t xHeapStructSize	= ( sizeof( BlockLink_t ) + ( ( size_t ) ( p
 /* Create a couple of list links to mark the start and end of the list. */
 static BlockLink_t xStart, *pxEnd = NULL;
 
+/* ETH_CODE: usable bounds (first block to end marker) and free bytes of
+each region. */
+static size_t xRegionLow[ heapNUM_REGIONS ], xRegionHigh[ heapNUM_REGIONS ];
+static size_t xRegionFreeBytes[ heapNUM_REGIONS ];
+
 /* Keeps track of the number of calls to allocate and free memory as well as the
 number of free bytes remaining, but says nothing about fragmentation. */
 static size_t xFreeBytesRemaining = 0U;
@@ -112,7 +145,75 @@ static size_t xBlockAllocatedBit = 0;
 
 /*-----------------------------------------------------------*/
 
+/* ETH_CODE: index of the region holding pv, heapNUM_REGIONS if none. */
+static size_t prvRegionOf( const void *pv )
+{
+size_t x;
+
+	for( x = 0; x < heapNUM_REGIONS; x++ )
+	{
+		if( ( ( size_t ) pv >= xRegionLow[ x ] ) && ( ( size_t ) pv < xRegionHigh[ x ] ) )
+		{
+			break;
+		}
+	}
+	return x;
+}
+/*-----------------------------------------------------------*/
+
 void *pvPortMalloc( size_t xWantedSize )
+{
+	return prvMallocPreferred( xWantedSize, heapREGION_ANY, HEAP_TRACE_CALLER() );
+}
+/*-----------------------------------------------------------*/
+
+void *pvPortMallocRegion( size_t xWantedSize, uint32_t ulRegion )
+{
+	return prvMallocPreferred( xWantedSize, ulRegion, HEAP_TRACE_CALLER() );
+}
+/*-----------------------------------------------------------*/
+
+static void *prvMallocPreferred( size_t xWantedSize, uint32_t ulRegion, const void *pvSite )
+{
+void *pvReturn;
+
+	/* ETH_CODE: the region is a preference; fall back to any region. */
+	pvReturn = prvMalloc( xWantedSize, ( ulRegion > heapNUM_REGIONS ) ? heapREGION_ANY : ulRegion );
+	if( ( pvReturn == NULL ) && ( ulRegion != heapREGION_ANY ) )
+	{
+		pvReturn = prvMalloc( xWantedSize, heapREGION_ANY );
+	}
+
+	#if( HEAP_TRACE == 1 )
+	{
+		heap_trace_alloc( HEAP_TRACE_RTOS, pvReturn, xWantedSize, pvSite );
+	}
+	#else
+	{
+		( void ) pvSite;
+	}
+	#endif
+
+	#if( configUSE_MALLOC_FAILED_HOOK == 1 )
+	{
+		if( pvReturn == NULL )
+		{
+			extern void vApplicationMallocFailedHook( void );
+			vApplicationMallocFailedHook();
+		}
+		else
+		{
+			mtCOVERAGE_TEST_MARKER();
+		}
+	}
+	#endif
+
+	configASSERT( ( ( ( size_t ) pvReturn ) & ( size_t ) portBYTE_ALIGNMENT_MASK ) == 0 );
+	return pvReturn;
+}
+/*-----------------------------------------------------------*/
+
+static void *prvMalloc( size_t xWantedSize, uint32_t ulRegion )
 {
 BlockLink_t *pxBlock, *pxPreviousBlock, *pxNewBlockLink;
 void *pvReturn = NULL;
@@ -160,13 +261,16 @@ void *pvReturn = NULL;
 				mtCOVERAGE_TEST_MARKER();
 			}
 
-			if( ( xWantedSize > 0 ) && ( xWantedSize <= xFreeBytesRemaining ) )
+			if( ( xWantedSize > 0 ) &&
+				( xWantedSize <= ( ( ulRegion == heapREGION_ANY ) ? xFreeBytesRemaining : xPortGetFreeHeapSizeRegion( ulRegion ) ) ) )
 			{
 				/* Traverse the list from the start	(lowest address) block until
-				one	of adequate size is found. */
+				one	of adequate size is found, in the requested region if any. */
 				pxPreviousBlock = &xStart;
 				pxBlock = xStart.pxNextFreeBlock;
-				while( ( pxBlock->xBlockSize < xWantedSize ) && ( pxBlock->pxNextFreeBlock != NULL ) )
+				while( ( ( pxBlock->xBlockSize < xWantedSize ) ||
+						 ( ( ulRegion != heapREGION_ANY ) && ( prvRegionOf( pxBlock ) != ulRegion - 1U ) ) ) &&
+					   ( pxBlock->pxNextFreeBlock != NULL ) )
 				{
 					pxPreviousBlock = pxBlock;
 					pxBlock = pxBlock->pxNextFreeBlock;
@@ -209,6 +313,7 @@ void *pvReturn = NULL;
 					}
 
 					xFreeBytesRemaining -= pxBlock->xBlockSize;
+					xRegionFreeBytes[ prvRegionOf( pxBlock ) ] -= pxBlock->xBlockSize;
 
 					if( xFreeBytesRemaining < xMinimumEverFreeBytesRemaining )
 					{
@@ -244,21 +349,6 @@ void *pvReturn = NULL;
 	}
 	( void ) xTaskResumeAll();
 
-	#if( configUSE_MALLOC_FAILED_HOOK == 1 )
-	{
-		if( pvReturn == NULL )
-		{
-			extern void vApplicationMallocFailedHook( void );
-			vApplicationMallocFailedHook();
-		}
-		else
-		{
-			mtCOVERAGE_TEST_MARKER();
-		}
-	}
-	#endif
-
-	configASSERT( ( ( ( size_t ) pvReturn ) & ( size_t ) portBYTE_ALIGNMENT_MASK ) == 0 );
 	return pvReturn;
 }
 /*-----------------------------------------------------------*/
@@ -270,6 +360,12 @@ BlockLink_t *pxLink;
 
 	if( pv != NULL )
 	{
+		#if( HEAP_TRACE == 1 )
+		{
+			heap_trace_free( HEAP_TRACE_RTOS, pv );
+		}
+		#endif
+
 		/* The memory being freed will have an BlockLink_t structure immediately
 		before it. */
 		puc -= xHeapStructSize;
@@ -293,6 +389,7 @@ BlockLink_t *pxLink;
 				{
 					/* Add this block to the list of free blocks. */
 					xFreeBytesRemaining += pxLink->xBlockSize;
+					xRegionFreeBytes[ prvRegionOf( pxLink ) ] += pxLink->xBlockSize;
 					traceFREE( pv, pxLink->xBlockSize );
 					prvInsertBlockIntoFreeList( ( ( BlockLink_t * ) pxLink ) );
 					xNumberOfSuccessfulFrees++;
@@ -318,6 +415,16 @@ size_t xPortGetFreeHeapSize( void )
 }
 /*-----------------------------------------------------------*/
 
+size_t xPortGetFreeHeapSizeRegion( uint32_t ulRegion )
+{
+	if( ( ulRegion == heapREGION_ANY ) || ( ulRegion > heapNUM_REGIONS ) )
+	{
+		return xFreeBytesRemaining;
+	}
+	return xRegionFreeBytes[ ulRegion - 1U ];
+}
+/*-----------------------------------------------------------*/
+
 size_t xPortGetMinimumEverFreeHeapSize( void )
 {
 	return xMinimumEverFreeBytesRemaining;
@@ -332,46 +439,53 @@ void vPortInitialiseBlocks( void )
 
 static void prvHeapInit( void )
 {
-BlockLink_t *pxFirstFreeBlock;
-uint8_t *pucAlignedHeap;
-size_t uxAddress;
-size_t xTotalHeapSize = configTOTAL_HEAP_SIZE;
+BlockLink_t *pxFirstFreeBlock, *pxPreviousFreeBlock = NULL;
+size_t uxAddress, uxAlignedHeap, xTotalHeapSize = 0, x;
 
-	/* Ensure the heap starts on a correctly aligned boundary. */
-	uxAddress = ( size_t ) ucHeap;
-
-	if( ( uxAddress & portBYTE_ALIGNMENT_MASK ) != 0 )
+	/* ETH_CODE: one block per region as in heap_5.c. Each region ends in an
+	end marker; all but the last link on to the next region, so free blocks
+	are never merged across regions. */
+	for( x = 0; x < heapNUM_REGIONS; x++ )
 	{
-		uxAddress += ( portBYTE_ALIGNMENT - 1 );
-		uxAddress &= ~( ( size_t ) portBYTE_ALIGNMENT_MASK );
-		xTotalHeapSize -= uxAddress - ( size_t ) ucHeap;
-	}
+		/* Ensure the region starts on a correctly aligned boundary. */
+		uxAddress = ( size_t ) pucRegionStart[ x ];
+		uxAlignedHeap = ( uxAddress + portBYTE_ALIGNMENT_MASK ) & ~( ( size_t ) portBYTE_ALIGNMENT_MASK );
 
-	pucAlignedHeap = ( uint8_t * ) uxAddress;
+		/* pxEnd marks the end of the region. */
+		uxAddress += xRegionSize[ x ];
+		uxAddress -= xHeapStructSize;
+		uxAddress &= ~( ( size_t ) portBYTE_ALIGNMENT_MASK );
+		pxEnd = ( void * ) uxAddress;
+		pxEnd->xBlockSize = 0;
+		pxEnd->pxNextFreeBlock = NULL;
 
-	/* xStart is used to hold a pointer to the first item in the list of free
-	blocks.  The void cast is used to prevent compiler warnings. */
-	xStart.pxNextFreeBlock = ( void * ) pucAlignedHeap;
-	xStart.xBlockSize = ( size_t ) 0;
+		/* A single free block covers the region, minus the space taken by
+		pxEnd. */
+		pxFirstFreeBlock = ( void * ) uxAlignedHeap;
+		pxFirstFreeBlock->xBlockSize = uxAddress - uxAlignedHeap;
+		pxFirstFreeBlock->pxNextFreeBlock = pxEnd;
 
-	/* pxEnd is used to mark the end of the list of free blocks and is inserted
-	at the end of the heap space. */
-	uxAddress = ( ( size_t ) pucAlignedHeap ) + xTotalHeapSize;
-	uxAddress -= xHeapStructSize;
-	uxAddress &= ~( ( size_t ) portBYTE_ALIGNMENT_MASK );
-	pxEnd = ( void * ) uxAddress;
-	pxEnd->xBlockSize = 0;
-	pxEnd->pxNextFreeBlock = NULL;
+		if( pxPreviousFreeBlock == NULL )
+		{
+			/* xStart holds a pointer to the first item in the list of free
+			blocks. */
+			xStart.pxNextFreeBlock = pxFirstFreeBlock;
+			xStart.xBlockSize = ( size_t ) 0;
+		}
+		else
+		{
+			pxPreviousFreeBlock->pxNextFreeBlock = pxFirstFreeBlock;
+		}
+		pxPreviousFreeBlock = pxEnd;
 
-	/* To start with there is a single free block that is sized to take up the
-	entire heap space, minus the space taken by pxEnd. */
-	pxFirstFreeBlock = ( void * ) pucAlignedHeap;
-	pxFirstFreeBlock->xBlockSize = uxAddress - ( size_t ) pxFirstFreeBlock;
-	pxFirstFreeBlock->pxNextFreeBlock = pxEnd;
+		xRegionLow[ x ] = uxAlignedHeap;
+		xRegionHigh[ x ] = uxAddress;
+		xRegionFreeBytes[ x ] = pxFirstFreeBlock->xBlockSize;
+		xTotalHeapSize += pxFirstFreeBlock->xBlockSize;
+	}
 
-	/* Only one block exists - and it covers the entire usable heap space. */
-	xMinimumEverFreeBytesRemaining = pxFirstFreeBlock->xBlockSize;
-	xFreeBytesRemaining = pxFirstFreeBlock->xBlockSize;
+	xMinimumEverFreeBytesRemaining = xTotalHeapSize;
+	xFreeBytesRemaining = xTotalHeapSize;
 
 	/* Work out the position of the top bit in a size_t variable. */
 	xBlockAllocatedBit = ( ( size_t ) 1 ) << ( ( sizeof( size_t ) * heapBITS_PER_BYTE ) - 1 );
@@ -455,17 +569,20 @@ size_t xBlocks = 0, xMaxSize = 0, xMinSize = portMAX_DELAY; /* portMAX_DELAY use
 			do
 			{
 				/* Increment the number of blocks and record the largest block seen
-				so far. */
-				xBlocks++;
-
-				if( pxBlock->xBlockSize > xMaxSize )
+				so far. ETH_CODE: skip the end markers between regions. */
+				if( pxBlock->xBlockSize != 0 )
 				{
-					xMaxSize = pxBlock->xBlockSize;
-				}
+					xBlocks++;
 
-				if( pxBlock->xBlockSize < xMinSize )
-				{
-					xMinSize = pxBlock->xBlockSize;
+					if( pxBlock->xBlockSize > xMaxSize )
+					{
+						xMaxSize = pxBlock->xBlockSize;
+					}
+
+					if( pxBlock->xBlockSize < xMinSize )
+					{
+						xMinSize = pxBlock->xBlockSize;
+					}
 				}
 
 				/* Move to the next block in the chain until the last block is
@@ -490,3 +607,4 @@ size_t xBlocks = 0, xMaxSize = 0, xMinSize = portMAX_DELAY; /* portMAX_DELAY use
 	taskEXIT_CRITICAL();
 }
 
+#endif /* HEAP_TLSF == 0 */
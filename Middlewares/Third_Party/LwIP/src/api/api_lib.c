@@ -580,6 +580,9 @@ netconn_recv_data(struct netconn *conn, void **new_buf, u8_t apiflags)
 {
   void *buf = NULL;
   u16_t len;
+#if NETCONN_RX_COPY
+  const struct pbuf *data;
+#endif /* NETCONN_RX_COPY */
 
   LWIP_ERROR("netconn_recv: invalid pointer", (new_buf != NULL), return ERR_ARG;);
   *new_buf = NULL;
@@ -647,6 +650,9 @@ netconn_recv_data(struct netconn *conn, void **new_buf, u8_t apiflags)
       return err;
     }
     len = ((struct pbuf *)buf)->tot_len;
+#if NETCONN_RX_COPY
+    data = (const struct pbuf *)buf;
+#endif /* NETCONN_RX_COPY */
   }
 #endif /* LWIP_TCP */
 #if LWIP_TCP && (LWIP_UDP || LWIP_RAW)
@@ -656,12 +662,23 @@ netconn_recv_data(struct netconn *conn, void **new_buf, u8_t apiflags)
   {
     LWIP_ASSERT("buf != NULL", buf != NULL);
     len = netbuf_len((struct netbuf *)buf);
+#if NETCONN_RX_COPY
+    data = ((struct netbuf *)buf)->p;
+#endif /* NETCONN_RX_COPY */
   }
 #endif /* (LWIP_UDP || LWIP_RAW) */
 
 #if LWIP_SO_RCVBUF
   SYS_ARCH_DEC(conn->recv_avail, len);
+#if RECV_BUFSIZE_AUTOTUNE
+  SYS_ARCH_INC(conn->recv_read, len);
+#endif /* RECV_BUFSIZE_AUTOTUNE */
 #endif /* LWIP_SO_RCVBUF */
+#if NETCONN_RX_COPY
+  SYS_ARCH_DEC(conn->rx_queued, 1);
+  conn->rx_since = sys_now();
+  SYS_ARCH_DEC(conn->rx_pinned, netconn_rx_pinned_size(data));
+#endif /* NETCONN_RX_COPY */
   /* Register event with callback */
   API_EVENT(conn, NETCONN_EVT_RCVMINUS, len);
 
@@ -956,6 +973,80 @@ netconn_send(struct netconn *conn, struct netbuf *buf)
   return err;
 }
 
+#if LWIP_NETCONN_BATCH
+/**
+ * @ingroup netconn_udp
+ * ETH_CODE: Receive a batch of netbufs from a UDP or RAW netconn. Waits
+ * (unless NETCONN_DONTBLOCK) for the first one only, then takes those
+ * already queued, up to cnt.
+ *
+ * @param conn the UDP or RAW netconn from which to receive
+ * @param bufs array of cnt pointers where the netbufs are stored
+ * @param cnt size of bufs
+ * @param received output of the number of netbufs stored
+ * @param apiflags NETCONN_DONTBLOCK: don't wait for the first one either
+ * @return ERR_OK if at least one netbuf has been received, else the
+ *         error of netconn_recv_udp_raw_netbuf_flags()
+ */
+err_t
+netconn_recv_batch(struct netconn *conn, struct netbuf **bufs, u16_t cnt, u16_t *received, u8_t apiflags)
+{
+  err_t err;
+  u16_t n;
+
+  LWIP_ERROR("netconn_recv_batch: invalid arguments", (bufs != NULL) && (cnt > 0) && (received != NULL),
+             return ERR_ARG;);
+  *received = 0;
+  err = netconn_recv_udp_raw_netbuf_flags(conn, &bufs[0], apiflags);
+  if (err != ERR_OK) {
+    return err;
+  }
+  for (n = 1; n < cnt; n++) {
+    if (netconn_recv_udp_raw_netbuf_flags(conn, &bufs[n], NETCONN_DONTBLOCK) != ERR_OK) {
+      break;
+    }
+  }
+  *received = n;
+  return ERR_OK;
+}
+
+/**
+ * @ingroup netconn_udp
+ * ETH_CODE: Send a batch of netbufs over a UDP or RAW netconn, as
+ * netconn_send() each but in one call to the tcpip thread. Stops at the
+ * first that fails.
+ *
+ * @param conn the UDP or RAW netconn over which to send
+ * @param bufs array of cnt netbufs, addressed as for netconn_send()
+ * @param cnt number of netbufs to send
+ * @param sent output of the number of netbufs sent
+ * @return ERR_OK if at least one netbuf was sent, else the error of the first
+ */
+err_t
+netconn_send_batch(struct netconn *conn, struct netbuf *const *bufs, u16_t cnt, u16_t *sent)
+{
+  API_MSG_VAR_DECLARE(msg);
+  err_t err;
+
+  LWIP_ERROR("netconn_send_batch: invalid conn", (conn != NULL), return ERR_ARG;);
+  LWIP_ERROR("netconn_send_batch: invalid arguments", (bufs != NULL) && (cnt > 0) && (sent != NULL),
+             return ERR_ARG;);
+
+  LWIP_DEBUGF(API_LIB_DEBUG, ("netconn_send_batch: sending %"U16_F" netbufs\n", cnt));
+
+  API_MSG_VAR_ALLOC(msg);
+  API_MSG_VAR_REF(msg).conn = conn;
+  API_MSG_VAR_REF(msg).msg.bb.bufs = bufs;
+  API_MSG_VAR_REF(msg).msg.bb.cnt = cnt;
+  API_MSG_VAR_REF(msg).msg.bb.sent = 0;
+  err = netconn_apimsg(lwip_netconn_do_send_batch, &API_MSG_VAR_REF(msg));
+  *sent = API_MSG_VAR_REF(msg).msg.bb.sent;
+  API_MSG_VAR_FREE(msg);
+
+  return err;
+}
+#endif /* LWIP_NETCONN_BATCH */
+
 /**
  * @ingroup netconn_tcp
  * Send data over a TCP netconn.
@@ -993,9 +1084,54 @@ netconn_write_partly(struct netconn *conn, const void *dataptr, size_t size,
  * @param bytes_written pointer to a location that receives the number of written bytes
  * @return ERR_OK if data was sent, any other err_t on error
  */
+#if LWIP_TCP_TXREF
+static err_t netconn_write_vectors_ref(struct netconn *conn, struct netvector *vectors, u16_t vectorcnt,
+                                       u8_t apiflags, size_t *bytes_written, struct tcp_txref *txref);
+
+err_t
+netconn_write_vectors_partly(struct netconn *conn, struct netvector *vectors, u16_t vectorcnt,
+                             u8_t apiflags, size_t *bytes_written)
+{
+  return netconn_write_vectors_ref(conn, vectors, vectorcnt, apiflags, bytes_written, NULL);
+}
+
+/**
+ * @ingroup netconn_tcp
+ * ETH_CODE: Send data over a TCP netconn without copying it.
+ * The pbufs built by tcp_write_ref() reference dataptr and hold a
+ * reference of ref each: ref->done is called once all are freed and the
+ * caller has dropped its own with tcp_txref_release(). Until then the
+ * data must not change. Several writes (buffers) can share one ref.
+ * Buffers in DTCM are sent through the driver's bounce buffers.
+ *
+ * @param conn the TCP netconn over which to send data
+ * @param dataptr pointer to the application buffer that contains the data to send
+ * @param size size of the application data to send
+ * @param apiflags NETCONN_MORE and/or NETCONN_DONTBLOCK, see netconn_write_partly()
+ * @param bytes_written receives the number of bytes queued (required to not block)
+ * @param ref from tcp_txref_init()
+ * @return ERR_OK if data was queued, any other err_t on error
+ */
+err_t
+netconn_write_ref(struct netconn *conn, const void *dataptr, size_t size,
+                  u8_t apiflags, size_t *bytes_written, struct tcp_txref *ref)
+{
+  struct netvector vector;
+  LWIP_ERROR("netconn_write_ref: invalid ref", (ref != NULL), return ERR_ARG;);
+  vector.ptr = dataptr;
+  vector.len = size;
+  return netconn_write_vectors_ref(conn, &vector, 1, (u8_t)(apiflags & ~NETCONN_COPY),
+                                   bytes_written, ref);
+}
+
+static err_t
+netconn_write_vectors_ref(struct netconn *conn, struct netvector *vectors, u16_t vectorcnt,
+                          u8_t apiflags, size_t *bytes_written, struct tcp_txref *txref)
+#else /* LWIP_TCP_TXREF */
 err_t
 netconn_write_vectors_partly(struct netconn *conn, struct netvector *vectors, u16_t vectorcnt,
                              u8_t apiflags, size_t *bytes_written)
+#endif /* LWIP_TCP_TXREF */
 {
   API_MSG_VAR_DECLARE(msg);
   err_t err;
@@ -1048,6 +1184,9 @@ netconn_write_vectors_partly(struct netconn *conn, struct netvector *vectors, u1
   API_MSG_VAR_REF(msg).msg.w.apiflags = apiflags;
   API_MSG_VAR_REF(msg).msg.w.len = size;
   API_MSG_VAR_REF(msg).msg.w.offset = 0;
+#if LWIP_TCP_TXREF
+  API_MSG_VAR_REF(msg).msg.w.txref = txref;
+#endif /* LWIP_TCP_TXREF */
 #if LWIP_SO_SNDTIMEO
   if (conn->send_timeout != 0) {
     /* get the time we started, which is later compared to
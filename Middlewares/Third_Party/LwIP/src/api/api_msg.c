@@ -147,6 +147,185 @@ lwip_netconn_is_err_msg(void *msg, err_t *err)
 #endif /* LWIP_TCP */
 
 
+#if NETCONN_RX_COPY
+/* ETH_CODE: see NETCONN_RX_COPY; written by the tcpip thread only */
+static struct netconn_rx_copy_stats netconn_rx_copy_st;
+
+/** ETH_CODE: Bytes of pinned buffers in p (NETCONN_RX_PINNED_SIZE) */
+int
+netconn_rx_pinned_size(const struct pbuf *p)
+{
+  int size = 0;
+
+  for (; p != NULL; p = p->next) {
+    if (NETCONN_RX_PINNED(p)) {
+      size += (int)NETCONN_RX_PINNED_SIZE(p);
+    }
+  }
+  return size;
+}
+
+/** ETH_CODE: Nonzero if pinned more bytes would take conn over
+ * NETCONN_RX_PINNED_MAX */
+static int
+netconn_rx_pinned_over(struct netconn *conn, int pinned)
+{
+  int held;
+
+  SYS_ARCH_GET(conn->rx_pinned, held);
+  return pinned > (NETCONN_RX_PINNED_MAX - held);
+}
+
+/** ETH_CODE: Copy of the data p for conn if it holds pinned buffers
+ * (pinned bytes of them) and would queue behind data its application is
+ * slow to take, or take conn over NETCONN_RX_PINNED_MAX; else NULL.
+ * p itself stays untouched. */
+static struct pbuf *
+netconn_rx_unpin(struct netconn *conn, struct pbuf *p, int pinned)
+{
+  struct pbuf *q;
+  struct pbuf *head = NULL;
+  struct pbuf *tail = NULL;
+  int queued;
+  int over;
+
+  if (pinned == 0) {
+    return NULL;
+  }
+  over = netconn_rx_pinned_over(conn, pinned);
+  SYS_ARCH_GET(conn->rx_queued, queued);
+  if (!over && ((queued == 0) ||
+      ((queued < NETCONN_RX_COPY_DEPTH) && ((u32_t)(sys_now() - conn->rx_since) < NETCONN_RX_COPY_AGE)))) {
+    return NULL;
+  }
+  /* pbuf by pbuf, so each fits a PBUF_RAM allocation */
+  for (q = p; q != NULL; q = q->next) {
+    struct pbuf *c = pbuf_alloc(PBUF_RAW, q->len, PBUF_RAM);
+    if (c == NULL) {
+      if (head != NULL) {
+        pbuf_free(head);
+      }
+      netconn_rx_copy_st.failed++;
+      return NULL;
+    }
+    MEMCPY(c->payload, q->payload, q->len);
+    c->tot_len = q->tot_len;
+    c->flags |= (u8_t)(q->flags & PBUF_FLAG_PUSH);
+    if (head == NULL) {
+      head = c;
+    } else {
+      tail->next = c;
+    }
+    tail = c;
+  }
+  netconn_rx_copy_st.copied++;
+  netconn_rx_copy_st.bytes += p->tot_len;
+  if (over) {
+    netconn_rx_copy_st.forced++;
+  }
+  return head;
+}
+
+/** ETH_CODE: Count data posted to the recvmbox of conn */
+static void
+netconn_rx_queued(struct netconn *conn)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+  SYS_ARCH_PROTECT(lev);
+  if (conn->rx_queued++ == 0) {
+    conn->rx_since = sys_now();
+  }
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+/**
+ * @ingroup netconn_common
+ * ETH_CODE: Copy of the NETCONN_RX_COPY counters
+ */
+void
+netconn_rx_copy_get_stats(struct netconn_rx_copy_stats *stats)
+{
+  *stats = netconn_rx_copy_st;
+}
+#endif /* NETCONN_RX_COPY */
+
+#if LWIP_SO_RCVBUF
+/* ETH_CODE: see netconn_recvbuf_get_stats(); written by the tcpip thread only */
+static struct netconn_recvbuf_stats netconn_recvbuf_st;
+
+#if RECV_BUFSIZE_AUTOTUNE
+/** ETH_CODE: Move the recv_bufsize of conn toward twice what its
+ * application reads per RECV_BUFSIZE_TUNE_MS, see RECV_BUFSIZE_AUTOTUNE */
+static void
+netconn_recv_bufsize_tune(struct netconn *conn)
+{
+  u32_t now = sys_now();
+  u32_t elapsed = now - conn->recv_tune_since;
+  int size = conn->recv_bufsize;
+  int target;
+  int read;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  if (!conn->recv_autotune || (elapsed < RECV_BUFSIZE_TUNE_MS)) {
+    return;
+  }
+  SYS_ARCH_PROTECT(lev);
+  read = conn->recv_read;
+  conn->recv_read = 0;
+  SYS_ARCH_UNPROTECT(lev);
+  conn->recv_tune_since = now;
+
+  /* per interval: a quiet stretch counts as intervals without reads */
+  target = (int)LWIP_MIN(((u64_t)(u32_t)read * RECV_BUFSIZE_TUNE_MS * 2U) / elapsed, (u64_t)RECV_BUFSIZE_MAX);
+  if (conn->recv_dropped && (read > 0)) {
+    /* the application keeps up, bursts overran the limit */
+    target = LWIP_MAX(target, LWIP_MIN(size, RECV_BUFSIZE_MAX / 2) * 2);
+  }
+  conn->recv_dropped = 0;
+  target = LWIP_MIN(LWIP_MAX(target, RECV_BUFSIZE_MIN), RECV_BUFSIZE_MAX);
+  if (target > size) {
+    size = target;
+    netconn_recvbuf_st.grown++;
+  } else if (target < size) {
+    size -= (size - target + 1) / 2;
+    netconn_recvbuf_st.shrunk++;
+  }
+  conn->recv_bufsize = size;
+}
+#endif /* RECV_BUFSIZE_AUTOTUNE */
+
+/** ETH_CODE: Nonzero (and counted) if len more bytes would take conn over
+ * its recv_bufsize */
+static int
+netconn_recv_bufsize_over(struct netconn *conn, int len)
+{
+  int recv_avail;
+
+#if RECV_BUFSIZE_AUTOTUNE
+  netconn_recv_bufsize_tune(conn);
+#endif /* RECV_BUFSIZE_AUTOTUNE */
+  SYS_ARCH_GET(conn->recv_avail, recv_avail);
+  if ((recv_avail + len) > conn->recv_bufsize) {
+    netconn_recvbuf_st.dropped++;
+#if RECV_BUFSIZE_AUTOTUNE
+    conn->recv_dropped = 1;
+#endif /* RECV_BUFSIZE_AUTOTUNE */
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * @ingroup netconn_common
+ * ETH_CODE: Copy of the receive buffer counters
+ */
+void
+netconn_recvbuf_get_stats(struct netconn_recvbuf_stats *stats)
+{
+  *stats = netconn_recvbuf_st;
+}
+#endif /* LWIP_SO_RCVBUF */
+
 #if LWIP_RAW
 /**
  * Receive callback function for RAW netconns.
@@ -168,9 +347,7 @@ recv_raw(void *arg, struct raw_pcb *pcb, struct pbuf *p,
 
   if ((conn != NULL) && NETCONN_MBOX_VALID(conn, &conn->recvmbox)) {
 #if LWIP_SO_RCVBUF
-    int recv_avail;
-    SYS_ARCH_GET(conn->recv_avail, recv_avail);
-    if ((recv_avail + (int)(p->tot_len)) > conn->recv_bufsize) {
+    if (netconn_recv_bufsize_over(conn, (int)p->tot_len)) {
       return 0;
     }
 #endif /* LWIP_SO_RCVBUF */
@@ -197,6 +374,9 @@ recv_raw(void *arg, struct raw_pcb *pcb, struct pbuf *p,
 #if LWIP_SO_RCVBUF
         SYS_ARCH_INC(conn->recv_avail, len);
 #endif /* LWIP_SO_RCVBUF */
+#if NETCONN_RX_COPY
+        netconn_rx_queued(conn);
+#endif /* NETCONN_RX_COPY */
         /* Register event with callback */
         API_EVENT(conn, NETCONN_EVT_RCVPLUS, len);
       }
@@ -221,9 +401,9 @@ recv_udp(void *arg, struct udp_pcb *pcb, struct pbuf *p,
   struct netbuf *buf;
   struct netconn *conn;
   u16_t len;
-#if LWIP_SO_RCVBUF
-  int recv_avail;
-#endif /* LWIP_SO_RCVBUF */
+#if NETCONN_RX_COPY
+  int pinned;
+#endif /* NETCONN_RX_COPY */
 
   LWIP_UNUSED_ARG(pcb); /* only used for asserts... */
   LWIP_ASSERT("recv_udp must have a pcb argument", pcb != NULL);
@@ -238,9 +418,8 @@ recv_udp(void *arg, struct udp_pcb *pcb, struct pbuf *p,
   LWIP_ASSERT("recv_udp: recv for wrong pcb!", conn->pcb.udp == pcb);
 
 #if LWIP_SO_RCVBUF
-  SYS_ARCH_GET(conn->recv_avail, recv_avail);
   if (!NETCONN_MBOX_VALID(conn, &conn->recvmbox) ||
-      ((recv_avail + (int)(p->tot_len)) > conn->recv_bufsize)) {
+      netconn_recv_bufsize_over(conn, (int)p->tot_len)) {
 #else  /* LWIP_SO_RCVBUF */
   if (!NETCONN_MBOX_VALID(conn, &conn->recvmbox)) {
 #endif /* LWIP_SO_RCVBUF */
@@ -248,6 +427,23 @@ recv_udp(void *arg, struct udp_pcb *pcb, struct pbuf *p,
     return;
   }
 
+#if NETCONN_RX_COPY
+  pinned = netconn_rx_pinned_size(p);
+  {
+    struct pbuf *c = netconn_rx_unpin(conn, p, pinned);
+    if (c != NULL) {
+      pbuf_free(p);
+      p = c;
+      pinned = 0;
+    } else if ((pinned != 0) && netconn_rx_pinned_over(conn, pinned)) {
+      /* ETH_CODE: no copy, and no more of the netif's buffers either */
+      netconn_rx_copy_st.dropped++;
+      pbuf_free(p);
+      return;
+    }
+  }
+#endif /* NETCONN_RX_COPY */
+
   buf = (struct netbuf *)memp_malloc(MEMP_NETBUF);
   if (buf == NULL) {
     pbuf_free(p);
@@ -276,6 +472,10 @@ recv_udp(void *arg, struct udp_pcb *pcb, struct pbuf *p,
 #if LWIP_SO_RCVBUF
     SYS_ARCH_INC(conn->recv_avail, len);
 #endif /* LWIP_SO_RCVBUF */
+#if NETCONN_RX_COPY
+    SYS_ARCH_INC(conn->rx_pinned, pinned);
+    netconn_rx_queued(conn);
+#endif /* NETCONN_RX_COPY */
     /* Register event with callback */
     API_EVENT(conn, NETCONN_EVT_RCVPLUS, len);
   }
@@ -295,6 +495,10 @@ recv_tcp(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
   struct netconn *conn;
   u16_t len;
   void *msg;
+#if NETCONN_RX_COPY
+  struct pbuf *copy = NULL;
+  int pinned = 0;
+#endif /* NETCONN_RX_COPY */
 
   LWIP_UNUSED_ARG(pcb);
   LWIP_ASSERT("recv_tcp must have a pcb argument", pcb != NULL);
@@ -323,18 +527,41 @@ recv_tcp(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
   if (p != NULL) {
     msg = p;
     len = p->tot_len;
+#if NETCONN_RX_COPY
+    pinned = netconn_rx_pinned_size(p);
+    copy = netconn_rx_unpin(conn, p, pinned);
+    if (copy != NULL) {
+      msg = copy;
+      pinned = 0;
+    }
+#endif /* NETCONN_RX_COPY */
   } else {
     msg = LWIP_CONST_CAST(void *, &netconn_closed);
     len = 0;
   }
 
   if (sys_mbox_trypost(&conn->recvmbox, msg) != ERR_OK) {
+#if NETCONN_RX_COPY
+    /* ETH_CODE: p goes back to TCP as refused data, not the copy */
+    if (copy != NULL) {
+      pbuf_free(copy);
+    }
+#endif /* NETCONN_RX_COPY */
     /* don't deallocate p: it is presented to us later again from tcp_fasttmr! */
     return ERR_MEM;
   } else {
 #if LWIP_SO_RCVBUF
     SYS_ARCH_INC(conn->recv_avail, len);
 #endif /* LWIP_SO_RCVBUF */
+#if NETCONN_RX_COPY
+    if (copy != NULL) {
+      pbuf_free(p);
+    }
+    if (p != NULL) {
+      SYS_ARCH_INC(conn->rx_pinned, pinned);
+      netconn_rx_queued(conn);
+    }
+#endif /* NETCONN_RX_COPY */
     /* Register event with callback */
     API_EVENT(conn, NETCONN_EVT_RCVPLUS, len);
   }
@@ -376,9 +603,10 @@ poll_tcp(void *arg, struct tcp_pcb *pcb)
   /* Did a nonblocking write fail before? Then check available write-space. */
   if (conn->flags & NETCONN_FLAG_CHECK_WRITESPACE) {
     /* If the queued byte- or pbuf-count drops below the configured low-water limit,
-       let select mark this pcb as writable again. */
-    if ((conn->pcb.tcp != NULL) && (tcp_sndbuf(conn->pcb.tcp) > TCP_SNDLOWAT) &&
-        (tcp_sndqueuelen(conn->pcb.tcp) < TCP_SNDQUEUELOWAT)) {
+       let select mark this pcb as writable again. (ETH_CODE: the pcb's limits,
+       see TCP_SND_AUTOTUNE) */
+    if ((conn->pcb.tcp != NULL) && (tcp_sndbuf(conn->pcb.tcp) > tcp_sndlowat(conn->pcb.tcp)) &&
+        (tcp_sndqueuelen(conn->pcb.tcp) < tcp_sndqueuelowat(conn->pcb.tcp))) {
       netconn_clear_flags(conn, NETCONN_FLAG_CHECK_WRITESPACE);
       API_EVENT(conn, NETCONN_EVT_SENDPLUS, 0);
     }
@@ -410,9 +638,10 @@ sent_tcp(void *arg, struct tcp_pcb *pcb, u16_t len)
     }
 
     /* If the queued byte- or pbuf-count drops below the configured low-water limit,
-       let select mark this pcb as writable again. */
-    if ((conn->pcb.tcp != NULL) && (tcp_sndbuf(conn->pcb.tcp) > TCP_SNDLOWAT) &&
-        (tcp_sndqueuelen(conn->pcb.tcp) < TCP_SNDQUEUELOWAT)) {
+       let select mark this pcb as writable again. (ETH_CODE: the pcb's limits,
+       see TCP_SND_AUTOTUNE) */
+    if ((conn->pcb.tcp != NULL) && (tcp_sndbuf(conn->pcb.tcp) > tcp_sndlowat(conn->pcb.tcp)) &&
+        (tcp_sndqueuelen(conn->pcb.tcp) < tcp_sndqueuelowat(conn->pcb.tcp))) {
       netconn_clear_flags(conn, NETCONN_FLAG_CHECK_WRITESPACE);
       API_EVENT(conn, NETCONN_EVT_SENDPLUS, len);
     }
@@ -773,7 +1002,18 @@ netconn_alloc(enum netconn_type t, netconn_callback callback)
 #if LWIP_SO_RCVBUF
   conn->recv_bufsize = RECV_BUFSIZE_DEFAULT;
   conn->recv_avail   = 0;
+#if RECV_BUFSIZE_AUTOTUNE
+  conn->recv_read = 0;
+  conn->recv_tune_since = sys_now();
+  conn->recv_autotune = 1;
+  conn->recv_dropped = 0;
+#endif /* RECV_BUFSIZE_AUTOTUNE */
 #endif /* LWIP_SO_RCVBUF */
+#if NETCONN_RX_COPY
+  conn->rx_queued = 0;
+  conn->rx_since = 0;
+  conn->rx_pinned = 0;
+#endif /* NETCONN_RX_COPY */
 #if LWIP_SO_LINGER
   conn->linger = -1;
 #endif /* LWIP_SO_LINGER */
@@ -1522,46 +1762,40 @@ lwip_netconn_do_listen(void *m)
 }
 #endif /* LWIP_TCP */
 
-/**
- * Send some data on a RAW or UDP pcb contained in a netconn
- * Called from netconn_send
- *
- * @param m the api_msg pointing to the connection
- */
-void
-lwip_netconn_do_send(void *m)
+/* Send one netbuf on a UDP or RAW netconn
+ * (ETH_CODE: factored out of lwip_netconn_do_send() for batches) */
+static err_t
+lwip_netconn_send_netbuf(struct netconn *conn, struct netbuf *b)
 {
-  struct api_msg *msg = (struct api_msg *)m;
-
-  err_t err = netconn_err(msg->conn);
+  err_t err = netconn_err(conn);
   if (err == ERR_OK) {
-    if (msg->conn->pcb.tcp != NULL) {
-      switch (NETCONNTYPE_GROUP(msg->conn->type)) {
+    if (conn->pcb.tcp != NULL) {
+      switch (NETCONNTYPE_GROUP(conn->type)) {
 #if LWIP_RAW
         case NETCONN_RAW:
-          if (ip_addr_isany(&msg->msg.b->addr) || IP_IS_ANY_TYPE_VAL(msg->msg.b->addr)) {
-            err = raw_send(msg->conn->pcb.raw, msg->msg.b->p);
+          if (ip_addr_isany(&b->addr) || IP_IS_ANY_TYPE_VAL(b->addr)) {
+            err = raw_send(conn->pcb.raw, b->p);
           } else {
-            err = raw_sendto(msg->conn->pcb.raw, msg->msg.b->p, &msg->msg.b->addr);
+            err = raw_sendto(conn->pcb.raw, b->p, &b->addr);
           }
           break;
 #endif
 #if LWIP_UDP
         case NETCONN_UDP:
 #if LWIP_CHECKSUM_ON_COPY
-          if (ip_addr_isany(&msg->msg.b->addr) || IP_IS_ANY_TYPE_VAL(msg->msg.b->addr)) {
-            err = udp_send_chksum(msg->conn->pcb.udp, msg->msg.b->p,
-                                  msg->msg.b->flags & NETBUF_FLAG_CHKSUM, msg->msg.b->toport_chksum);
+          if (ip_addr_isany(&b->addr) || IP_IS_ANY_TYPE_VAL(b->addr)) {
+            err = udp_send_chksum(conn->pcb.udp, b->p,
+                                  b->flags & NETBUF_FLAG_CHKSUM, b->toport_chksum);
           } else {
-            err = udp_sendto_chksum(msg->conn->pcb.udp, msg->msg.b->p,
-                                    &msg->msg.b->addr, msg->msg.b->port,
-                                    msg->msg.b->flags & NETBUF_FLAG_CHKSUM, msg->msg.b->toport_chksum);
+            err = udp_sendto_chksum(conn->pcb.udp, b->p,
+                                    &b->addr, b->port,
+                                    b->flags & NETBUF_FLAG_CHKSUM, b->toport_chksum);
           }
 #else /* LWIP_CHECKSUM_ON_COPY */
-          if (ip_addr_isany_val(msg->msg.b->addr) || IP_IS_ANY_TYPE_VAL(msg->msg.b->addr)) {
-            err = udp_send(msg->conn->pcb.udp, msg->msg.b->p);
+          if (ip_addr_isany_val(b->addr) || IP_IS_ANY_TYPE_VAL(b->addr)) {
+            err = udp_send(conn->pcb.udp, b->p);
           } else {
-            err = udp_sendto(msg->conn->pcb.udp, msg->msg.b->p, &msg->msg.b->addr, msg->msg.b->port);
+            err = udp_sendto(conn->pcb.udp, b->p, &b->addr, b->port);
           }
 #endif /* LWIP_CHECKSUM_ON_COPY */
           break;
@@ -1574,10 +1808,51 @@ lwip_netconn_do_send(void *m)
       err = ERR_CONN;
     }
   }
-  msg->err = err;
+  return err;
+}
+
+/**
+ * Send some data on a RAW or UDP pcb contained in a netconn
+ * Called from netconn_send
+ *
+ * @param m the api_msg pointing to the connection
+ */
+void
+lwip_netconn_do_send(void *m)
+{
+  struct api_msg *msg = (struct api_msg *)m;
+
+  msg->err = lwip_netconn_send_netbuf(msg->conn, msg->msg.b);
   TCPIP_APIMSG_ACK(msg);
 }
 
+#if LWIP_NETCONN_BATCH
+/**
+ * ETH_CODE: Send netbufs on a RAW or UDP pcb contained in a netconn, up
+ * to the first that fails. Called from netconn_send_batch
+ *
+ * @param m the api_msg pointing to the connection
+ */
+void
+lwip_netconn_do_send_batch(void *m)
+{
+  struct api_msg *msg = (struct api_msg *)m;
+  err_t err = ERR_OK;
+  u16_t i;
+
+  for (i = 0; i < msg->msg.bb.cnt; i++) {
+    err = lwip_netconn_send_netbuf(msg->conn, msg->msg.bb.bufs[i]);
+    if (err != ERR_OK) {
+      break;
+    }
+  }
+  msg->msg.bb.sent = i;
+  /* a partial batch is a success, as with sendmmsg() */
+  msg->err = (i != 0) ? ERR_OK : err;
+  TCPIP_APIMSG_ACK(msg);
+}
+#endif /* LWIP_NETCONN_BATCH */
+
 #if LWIP_TCP
 /**
  * Indicate data has been received from a TCP pcb contained in a netconn
@@ -1709,7 +1984,14 @@ lwip_netconn_do_writemore(struct netconn *conn  WRITE_DELAYED_PARAM)
       } else {
         write_more = 0;
       }
-      err = tcp_write(conn->pcb.tcp, dataptr, len, apiflags);
+#if LWIP_TCP_TXREF
+      if (conn->current_msg->msg.w.txref != NULL) {
+        err = tcp_write_ref(conn->pcb.tcp, dataptr, len, apiflags, conn->current_msg->msg.w.txref);
+      } else
+#endif /* LWIP_TCP_TXREF */
+      {
+        err = tcp_write(conn->pcb.tcp, dataptr, len, apiflags);
+      }
       if (err == ERR_OK) {
         conn->current_msg->msg.w.offset += len;
         conn->current_msg->msg.w.vector_off += len;
@@ -1732,8 +2014,8 @@ err_mem:
            and let poll_tcp check writable space to mark the pcb writable again */
         API_EVENT(conn, NETCONN_EVT_SENDMINUS, 0);
         conn->flags |= NETCONN_FLAG_CHECK_WRITESPACE;
-      } else if ((tcp_sndbuf(conn->pcb.tcp) <= TCP_SNDLOWAT) ||
-                 (tcp_sndqueuelen(conn->pcb.tcp) >= TCP_SNDQUEUELOWAT)) {
+      } else if ((tcp_sndbuf(conn->pcb.tcp) <= tcp_sndlowat(conn->pcb.tcp)) || /* ETH_CODE */
+                 (tcp_sndqueuelen(conn->pcb.tcp) >= tcp_sndqueuelowat(conn->pcb.tcp))) {
         /* The queued byte- or pbuf-count exceeds the configured low-water limit,
            let select mark this pcb as non-writable. */
         API_EVENT(conn, NETCONN_EVT_SENDMINUS, 0);
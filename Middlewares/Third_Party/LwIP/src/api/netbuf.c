@@ -247,4 +247,22 @@ netbuf_first(struct netbuf *buf)
   buf->ptr = buf->p;
 }
 
+#if LWIP_SO_TIMESTAMP
+/**
+ * @ingroup netbuf
+ * ETH_CODE: arrival time of a received packet, see LWIP_SO_TIMESTAMP.
+ *
+ * @param buf the netbuf as received
+ * @param mono_ns monotonic nanoseconds, or NULL
+ * @param utc_ns UTC nanoseconds, or NULL
+ * @return ERR_OK, ERR_VAL if the packet carries no arrival time
+ */
+err_t
+netbuf_rxtime(struct netbuf *buf, u64_t *mono_ns, u64_t *utc_ns)
+{
+  LWIP_ERROR("netbuf_rxtime: invalid buf", ((buf != NULL) && (buf->p != NULL)), return ERR_ARG;);
+  return LWIP_PBUF_RX_TIME(buf->p, mono_ns, utc_ns) ? ERR_OK : ERR_VAL;
+}
+#endif /* LWIP_SO_TIMESTAMP */
+
 #endif /* LWIP_NETCONN */
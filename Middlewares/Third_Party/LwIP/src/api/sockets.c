@@ -278,6 +278,129 @@ static volatile int select_cb_ctr;
 static struct lwip_select_cb *select_cb_list;
 #endif /* LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL */
 
+#if LWIP_SOCKET_EVQ
+#if !LWIP_SOCKET_SELECT && !LWIP_SOCKET_POLL
+#error "LWIP_SOCKET_EVQ needs the socket event counters of LWIP_SOCKET_SELECT or LWIP_SOCKET_POLL"
+#endif
+/** ETH_CODE: a socket event queue, see lwip_evq_create(). The queues and
+    the evq_* members of the sockets are protected by SYS_ARCH_PROTECT,
+    like the event counters event_callback() updates. */
+struct lwip_evq {
+  u8_t used;
+  /** 1 while waiter sleeps in lwip_evq_wait() */
+  u8_t waiting;
+  sys_thread_t waiter;
+  /** ready list of socket indexes (-1 when empty) and its length */
+  s16_t head;
+  s16_t tail;
+  s16_t count;
+};
+
+static struct lwip_evq evqs[LWIP_SOCKET_EVQ_NUM];
+
+/* ETH_CODE: events of a socket that its queue reports; call protected */
+static u8_t
+lwip_evq_pending(const struct lwip_sock *sock)
+{
+  u8_t events = 0;
+  if ((sock->lastdata.pbuf != NULL) || (sock->rcvevent > 0)) {
+    events |= LWIP_EVQ_IN;
+  }
+  if (sock->sendevent != 0) {
+    events |= LWIP_EVQ_OUT;
+  }
+  if (sock->errevent != 0) {
+    events |= LWIP_EVQ_ERR;
+  }
+  return events & (sock->evq_events | LWIP_EVQ_ERR);
+}
+
+/* ETH_CODE: append socket index i to the ready list; call protected */
+static void
+lwip_evq_push(struct lwip_evq *evq, s16_t i)
+{
+  sockets[i].evq_next = -1;
+  sockets[i].evq_queued = 1;
+  if (evq->tail < 0) {
+    evq->head = i;
+  } else {
+    sockets[evq->tail].evq_next = i;
+  }
+  evq->tail = i;
+  evq->count++;
+}
+
+/* ETH_CODE: take the first socket index off the ready list; call protected */
+static s16_t
+lwip_evq_pop(struct lwip_evq *evq)
+{
+  s16_t i = evq->head;
+  LWIP_ASSERT("evq->head >= 0", i >= 0);
+  evq->head = sockets[i].evq_next;
+  if (evq->head < 0) {
+    evq->tail = -1;
+  }
+  sockets[i].evq_queued = 0;
+  evq->count--;
+  return i;
+}
+
+/* ETH_CODE: take socket index i off the ready list, O(ready); call protected */
+static void
+lwip_evq_unlink(struct lwip_evq *evq, s16_t i)
+{
+  s16_t prev = -1;
+  s16_t n;
+  for (n = evq->head; n >= 0; prev = n, n = sockets[n].evq_next) {
+    if (n == i) {
+      if (prev < 0) {
+        evq->head = sockets[n].evq_next;
+      } else {
+        sockets[prev].evq_next = sockets[n].evq_next;
+      }
+      if (evq->tail == n) {
+        evq->tail = prev;
+      }
+      evq->count--;
+      break;
+    }
+  }
+  sockets[i].evq_queued = 0;
+}
+
+/* ETH_CODE: queue a socket that turned ready. Call protected; returns 1
+   with *waiter set if the waiting task is to be woken: the caller does
+   sys_notify(*waiter) after SYS_ARCH_UNPROTECT, as a kernel call inside
+   the section would end it early (SYS_ARCH_PROTECT_BASEPRI: the kernel's
+   critical section exit clears BASEPRI). lwip_evq_wait() tolerates the
+   late wakeup: it looks at the ready list again. */
+static u8_t
+lwip_evq_check(struct lwip_sock *sock, sys_thread_t *waiter)
+{
+  struct lwip_evq *evq = &evqs[sock->evq - 1];
+  if (!sock->evq_queued && (lwip_evq_pending(sock) != 0)) {
+    lwip_evq_push(evq, (s16_t)(sock - sockets));
+    if (evq->waiting) {
+      evq->waiting = 0;
+      *waiter = evq->waiter;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* ETH_CODE: remove a socket from its queue; call protected */
+static void
+lwip_evq_detach(struct lwip_sock *sock)
+{
+  if (sock->evq_queued) {
+    lwip_evq_unlink(&evqs[sock->evq - 1], (s16_t)(sock - sockets));
+  }
+  sock->evq = 0;
+  sock->evq_arg = NULL;
+}
+#endif /* LWIP_SOCKET_EVQ */
+
 #define sock_set_errno(sk, e) do { \
   const int sockerr = (e); \
   set_errno(sockerr); \
@@ -522,6 +645,9 @@ alloc_socket(struct netconn *newconn, int accepted)
          after having marked it as used. */
       SYS_ARCH_UNPROTECT(lev);
       sockets[i].lastdata.pbuf = NULL;
+#if LWIP_SO_TIMESTAMP
+      sockets[i].rx_timestamp = 0;
+#endif /* LWIP_SO_TIMESTAMP */
 #if LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL
       LWIP_ASSERT("sockets[i].select_waiting == 0", sockets[i].select_waiting == 0);
       sockets[i].rcvevent   = 0;
@@ -563,6 +689,12 @@ free_socket_locked(struct lwip_sock *sock, int is_tcp, struct netconn **conn,
   sock->lastdata.pbuf = NULL;
   *conn = sock->conn;
   sock->conn = NULL;
+#if LWIP_SOCKET_EVQ
+  /* ETH_CODE: a closed socket leaves its event queue */
+  if (sock->evq != 0) {
+    lwip_evq_detach(sock);
+  }
+#endif /* LWIP_SOCKET_EVQ */
   return 1;
 }
 
@@ -1155,7 +1287,8 @@ lwip_recvfrom_udp_raw(struct lwip_sock *sock, int flags, struct msghdr *msg, u16
   msg->msg_flags = 0;
 
   if (msg->msg_control) {
-    u8_t wrote_msg = 0;
+    /* ETH_CODE: bytes of control messages written */
+    socklen_t used = 0;
 #if LWIP_NETBUF_RECVINFO
     /* Check if packet info was recorded */
     if (buf->flags & NETBUF_FLAG_DESTADDR) {
@@ -1169,8 +1302,7 @@ lwip_recvfrom_udp_raw(struct lwip_sock *sock, int flags, struct msghdr *msg, u16
           chdr->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
           pkti->ipi_ifindex = buf->p->if_idx;
           inet_addr_from_ip4addr(&pkti->ipi_addr, ip_2_ip4(netbuf_destaddr(buf)));
-          msg->msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
-          wrote_msg = 1;
+          used = CMSG_SPACE(sizeof(struct in_pktinfo));
         } else {
           msg->msg_flags |= MSG_CTRUNC;
         }
@@ -1178,10 +1310,25 @@ lwip_recvfrom_udp_raw(struct lwip_sock *sock, int flags, struct msghdr *msg, u16
       }
     }
 #endif /* LWIP_NETBUF_RECVINFO */
-
-    if (!wrote_msg) {
-      msg->msg_controllen = 0;
+#if LWIP_SO_TIMESTAMP
+    /* ETH_CODE: SCM_TIMESTAMP after IP_PKTINFO */
+    if (sock->rx_timestamp) {
+      u64_t utc_ns;
+      if (msg->msg_controllen < used + CMSG_SPACE(sizeof(struct timeval))) {
+        msg->msg_flags |= MSG_CTRUNC;
+      } else if (LWIP_PBUF_RX_TIME(buf->p, NULL, &utc_ns)) {
+        struct cmsghdr *chdr = (struct cmsghdr *)(void *)((u8_t *)msg->msg_control + used);
+        struct timeval *tv = (struct timeval *)CMSG_DATA(chdr);
+        chdr->cmsg_level = SOL_SOCKET;
+        chdr->cmsg_type = SCM_TIMESTAMP;
+        chdr->cmsg_len = CMSG_LEN(sizeof(struct timeval));
+        tv->tv_sec = (long)(utc_ns / 1000000000U);
+        tv->tv_usec = (long)((utc_ns % 1000000000U) / 1000U);
+        used += CMSG_SPACE(sizeof(struct timeval));
+      }
     }
+#endif /* LWIP_SO_TIMESTAMP */
+    msg->msg_controllen = used;
   }
 
   /* If we don't peek the incoming message: zero lastdata pointer and free the netbuf */
@@ -1378,6 +1525,88 @@ lwip_recvmsg(int s, struct msghdr *message, int flags)
 #endif /* LWIP_UDP || LWIP_RAW */
 }
 
+#if LWIP_NETCONN_BATCH
+/**
+ * ETH_CODE: Receive up to vlen datagrams, as lwip_recvmsg() each, in one
+ * call: only the first waits (unless MSG_DONTWAIT), the rest are taken if
+ * already queued. msg_len of each mmsghdr is set to its datagram length.
+ * UDP and RAW sockets only.
+ *
+ * @return the number of datagrams received, -1 (errno set) if none
+ */
+int
+lwip_recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+  struct lwip_sock *sock;
+  unsigned int n;
+  err_t err = ERR_OK;
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvmmsg(%d, msgvec=%p, vlen=%u, flags=0x%x)\n", s, (void *)msgvec, vlen, flags));
+  LWIP_ERROR("lwip_recvmmsg: invalid msgvec", (msgvec != NULL) || (vlen == 0),
+             set_errno(EFAULT); return -1;);
+  LWIP_ERROR("lwip_recvmmsg: unsupported flags", (flags & ~MSG_DONTWAIT) == 0,
+             set_errno(EOPNOTSUPP); return -1;);
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    sock_set_errno(sock, EOPNOTSUPP);
+    done_socket(sock);
+    return -1;
+  }
+
+#if LWIP_UDP || LWIP_RAW
+  for (n = 0; n < vlen; n++) {
+    struct msghdr *message = &msgvec[n].msg_hdr;
+    ssize_t buflen = 0;
+    u16_t datagram_len = 0;
+    int i;
+
+    if ((message->msg_iovlen <= 0) || (message->msg_iovlen > IOV_MAX)) {
+      err = ERR_VAL;
+      break;
+    }
+    /* check for valid vectors, as lwip_recvmsg() */
+    for (i = 0; i < message->msg_iovlen; i++) {
+      if ((message->msg_iov[i].iov_base == NULL) || ((ssize_t)message->msg_iov[i].iov_len <= 0) ||
+          ((size_t)(ssize_t)message->msg_iov[i].iov_len != message->msg_iov[i].iov_len) ||
+          ((ssize_t)(buflen + (ssize_t)message->msg_iov[i].iov_len) <= 0)) {
+        err = ERR_VAL;
+        break;
+      }
+      buflen = (ssize_t)(buflen + (ssize_t)message->msg_iov[i].iov_len);
+    }
+    if (err != ERR_OK) {
+      break;
+    }
+    err = lwip_recvfrom_udp_raw(sock, (n == 0) ? flags : (flags | MSG_DONTWAIT), message, &datagram_len, s);
+    if (err != ERR_OK) {
+      break;
+    }
+    if (datagram_len > buflen) {
+      message->msg_flags |= MSG_TRUNC;
+    }
+    msgvec[n].msg_len = datagram_len;
+  }
+#else /* LWIP_UDP || LWIP_RAW */
+  n = 0;
+  err = ERR_ARG;
+#endif /* LWIP_UDP || LWIP_RAW */
+
+  if ((n == 0) && (vlen != 0)) {
+    LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_recvmmsg(%d): error is \"%s\"!\n", s, lwip_strerr(err)));
+    sock_set_errno(sock, err_to_errno(err));
+    done_socket(sock);
+    return -1;
+  }
+  sock_set_errno(sock, 0);
+  done_socket(sock);
+  return (int)n;
+}
+#endif /* LWIP_NETCONN_BATCH */
+
 ssize_t
 lwip_send(int s, const void *data, size_t size, int flags)
 {
@@ -1418,6 +1647,104 @@ lwip_send(int s, const void *data, size_t size, int flags)
   return (err == ERR_OK ? (ssize_t)written : -1);
 }
 
+#if LWIP_UDP || LWIP_RAW
+/* Build the netbuf of a datagram from a msghdr, with its destination
+ * (ETH_CODE: factored out of lwip_sendmsg() for lwip_sendmmsg()).
+ * ERR_VAL if it does not fit a datagram; netbuf_free() it in any case. */
+static err_t
+lwip_sendmsg_netbuf(const struct msghdr *msg, struct netbuf *chain_buf, ssize_t *size_out)
+{
+  err_t err = ERR_OK;
+  ssize_t size = 0;
+  int i;
+
+  /* initialize chain buffer with destination */
+  memset(chain_buf, 0, sizeof(struct netbuf));
+  if (msg->msg_name) {
+    u16_t remote_port;
+    SOCKADDR_TO_IPADDR_PORT((const struct sockaddr *)msg->msg_name, &chain_buf->addr, remote_port);
+    netbuf_fromport(chain_buf) = remote_port;
+  }
+#if LWIP_NETIF_TX_SINGLE_PBUF
+  for (i = 0; i < msg->msg_iovlen; i++) {
+    size += msg->msg_iov[i].iov_len;
+    if ((msg->msg_iov[i].iov_len > INT_MAX) || (size < (int)msg->msg_iov[i].iov_len)) {
+      /* overflow */
+      return ERR_VAL;
+    }
+  }
+  if (size > 0xFFFF) {
+    /* overflow */
+    return ERR_VAL;
+  }
+  /* Allocate a new netbuf and copy the data into it. */
+  if (netbuf_alloc(chain_buf, (u16_t)size) == NULL) {
+    err = ERR_MEM;
+  } else {
+    /* flatten the IO vectors */
+    size_t offset = 0;
+    for (i = 0; i < msg->msg_iovlen; i++) {
+      MEMCPY(&((u8_t *)chain_buf->p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+      offset += msg->msg_iov[i].iov_len;
+    }
+#if LWIP_CHECKSUM_ON_COPY
+    {
+      /* This can be improved by using LWIP_CHKSUM_COPY() and aggregating the checksum for each IO vector */
+      u16_t chksum = ~inet_chksum_pbuf(chain_buf->p);
+      netbuf_set_chksum(chain_buf, chksum);
+    }
+#endif /* LWIP_CHECKSUM_ON_COPY */
+    err = ERR_OK;
+  }
+#else /* LWIP_NETIF_TX_SINGLE_PBUF */
+  /* create a chained netbuf from the IO vectors. NOTE: we assemble a pbuf chain
+     manually to avoid having to allocate, chain, and delete a netbuf for each iov */
+  for (i = 0; i < msg->msg_iovlen; i++) {
+    struct pbuf *p;
+    if (msg->msg_iov[i].iov_len > 0xFFFF) {
+      /* overflow */
+      return ERR_VAL;
+    }
+    p = pbuf_alloc(PBUF_TRANSPORT, 0, PBUF_REF);
+    if (p == NULL) {
+      err = ERR_MEM; /* let netbuf_delete() cleanup chain_buf */
+      break;
+    }
+    p->payload = msg->msg_iov[i].iov_base;
+    p->len = p->tot_len = (u16_t)msg->msg_iov[i].iov_len;
+    /* netbuf empty, add new pbuf */
+    if (chain_buf->p == NULL) {
+      chain_buf->p = chain_buf->ptr = p;
+      /* add pbuf to existing pbuf chain */
+    } else {
+      if (chain_buf->p->tot_len + p->len > 0xffff) {
+        /* overflow */
+        pbuf_free(p);
+        return ERR_VAL;
+      }
+      pbuf_cat(chain_buf->p, p);
+    }
+  }
+  /* save size of total chain */
+  if (err == ERR_OK) {
+    size = netbuf_len(chain_buf);
+  }
+#endif /* LWIP_NETIF_TX_SINGLE_PBUF */
+
+  if (err == ERR_OK) {
+    *size_out = size;
+#if LWIP_IPV4 && LWIP_IPV6
+    /* Dual-stack: Unmap IPv4 mapped IPv6 addresses */
+    if (IP_IS_V6_VAL(chain_buf->addr) && ip6_addr_isipv4mappedipv6(ip_2_ip6(&chain_buf->addr))) {
+      unmap_ipv4_mapped_ipv6(ip_2_ip4(&chain_buf->addr), ip_2_ip6(&chain_buf->addr));
+      IP_SET_TYPE_VAL(chain_buf->addr, IPADDR_TYPE_V4);
+    }
+#endif /* LWIP_IPV4 && LWIP_IPV6 */
+  }
+  return err;
+}
+#endif /* LWIP_UDP || LWIP_RAW */
+
 ssize_t
 lwip_sendmsg(int s, const struct msghdr *msg, int flags)
 {
@@ -1468,7 +1795,6 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
 #if LWIP_UDP || LWIP_RAW
   {
     struct netbuf chain_buf;
-    int i;
     ssize_t size = 0;
 
     LWIP_UNUSED_ARG(flags);
@@ -1476,88 +1802,11 @@ lwip_sendmsg(int s, const struct msghdr *msg, int flags)
                IS_SOCK_ADDR_LEN_VALID(msg->msg_namelen)),
                sock_set_errno(sock, err_to_errno(ERR_ARG)); done_socket(sock); return -1;);
 
-    /* initialize chain buffer with destination */
-    memset(&chain_buf, 0, sizeof(struct netbuf));
-    if (msg->msg_name) {
-      u16_t remote_port;
-      SOCKADDR_TO_IPADDR_PORT((const struct sockaddr *)msg->msg_name, &chain_buf.addr, remote_port);
-      netbuf_fromport(&chain_buf) = remote_port;
-    }
-#if LWIP_NETIF_TX_SINGLE_PBUF
-    for (i = 0; i < msg->msg_iovlen; i++) {
-      size += msg->msg_iov[i].iov_len;
-      if ((msg->msg_iov[i].iov_len > INT_MAX) || (size < (int)msg->msg_iov[i].iov_len)) {
-        /* overflow */
-        goto sendmsg_emsgsize;
-      }
-    }
-    if (size > 0xFFFF) {
-      /* overflow */
+    err = lwip_sendmsg_netbuf(msg, &chain_buf, &size);
+    if (err == ERR_VAL) {
       goto sendmsg_emsgsize;
     }
-    /* Allocate a new netbuf and copy the data into it. */
-    if (netbuf_alloc(&chain_buf, (u16_t)size) == NULL) {
-      err = ERR_MEM;
-    } else {
-      /* flatten the IO vectors */
-      size_t offset = 0;
-      for (i = 0; i < msg->msg_iovlen; i++) {
-        MEMCPY(&((u8_t *)chain_buf.p->payload)[offset], msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
-        offset += msg->msg_iov[i].iov_len;
-      }
-#if LWIP_CHECKSUM_ON_COPY
-      {
-        /* This can be improved by using LWIP_CHKSUM_COPY() and aggregating the checksum for each IO vector */
-        u16_t chksum = ~inet_chksum_pbuf(chain_buf.p);
-        netbuf_set_chksum(&chain_buf, chksum);
-      }
-#endif /* LWIP_CHECKSUM_ON_COPY */
-      err = ERR_OK;
-    }
-#else /* LWIP_NETIF_TX_SINGLE_PBUF */
-    /* create a chained netbuf from the IO vectors. NOTE: we assemble a pbuf chain
-       manually to avoid having to allocate, chain, and delete a netbuf for each iov */
-    for (i = 0; i < msg->msg_iovlen; i++) {
-      struct pbuf *p;
-      if (msg->msg_iov[i].iov_len > 0xFFFF) {
-        /* overflow */
-        goto sendmsg_emsgsize;
-      }
-      p = pbuf_alloc(PBUF_TRANSPORT, 0, PBUF_REF);
-      if (p == NULL) {
-        err = ERR_MEM; /* let netbuf_delete() cleanup chain_buf */
-        break;
-      }
-      p->payload = msg->msg_iov[i].iov_base;
-      p->len = p->tot_len = (u16_t)msg->msg_iov[i].iov_len;
-      /* netbuf empty, add new pbuf */
-      if (chain_buf.p == NULL) {
-        chain_buf.p = chain_buf.ptr = p;
-        /* add pbuf to existing pbuf chain */
-      } else {
-        if (chain_buf.p->tot_len + p->len > 0xffff) {
-          /* overflow */
-          pbuf_free(p);
-          goto sendmsg_emsgsize;
-        }
-        pbuf_cat(chain_buf.p, p);
-      }
-    }
-    /* save size of total chain */
     if (err == ERR_OK) {
-      size = netbuf_len(&chain_buf);
-    }
-#endif /* LWIP_NETIF_TX_SINGLE_PBUF */
-
-    if (err == ERR_OK) {
-#if LWIP_IPV4 && LWIP_IPV6
-      /* Dual-stack: Unmap IPv4 mapped IPv6 addresses */
-      if (IP_IS_V6_VAL(chain_buf.addr) && ip6_addr_isipv4mappedipv6(ip_2_ip6(&chain_buf.addr))) {
-        unmap_ipv4_mapped_ipv6(ip_2_ip4(&chain_buf.addr), ip_2_ip6(&chain_buf.addr));
-        IP_SET_TYPE_VAL(chain_buf.addr, IPADDR_TYPE_V4);
-      }
-#endif /* LWIP_IPV4 && LWIP_IPV6 */
-
       /* send the data */
       err = netconn_send(sock->conn, &chain_buf);
     }
@@ -1581,6 +1830,99 @@ sendmsg_emsgsize:
 #endif /* LWIP_UDP || LWIP_RAW */
 }
 
+#if LWIP_NETCONN_BATCH
+/**
+ * ETH_CODE: Send up to vlen datagrams, as lwip_sendmsg() each, handing
+ * LWIP_NETCONN_BATCH_MAX at a time to netconn_send_batch(): one core lock
+ * (or tcpip message) per batch instead of per datagram. Stops at the
+ * first datagram that fails. msg_len of each mmsghdr sent is set to its
+ * length. A TCP socket gets its messages written one by one.
+ *
+ * @return the number of datagrams sent, -1 (errno set) if none
+ */
+int
+lwip_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+  struct lwip_sock *sock;
+  unsigned int done = 0;
+  err_t err = ERR_OK;
+
+  LWIP_ERROR("lwip_sendmmsg: invalid msgvec", (msgvec != NULL) || (vlen == 0),
+             set_errno(EFAULT); return -1;);
+  LWIP_ERROR("lwip_sendmmsg: unsupported flags", (flags & ~(MSG_DONTWAIT | MSG_MORE)) == 0,
+             set_errno(EOPNOTSUPP); return -1;);
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+    done_socket(sock);
+    for (; done < vlen; done++) {
+      ssize_t len = lwip_sendmsg(s, &msgvec[done].msg_hdr, flags);
+      if (len < 0) {
+        /* errno set by lwip_sendmsg() */
+        return (done != 0) ? (int)done : -1;
+      }
+      msgvec[done].msg_len = (unsigned int)len;
+    }
+    return (int)done;
+  }
+
+#if LWIP_UDP || LWIP_RAW
+  while ((done < vlen) && (err == ERR_OK)) {
+    struct netbuf bufs[LWIP_NETCONN_BATCH_MAX];
+    struct netbuf *batch[LWIP_NETCONN_BATCH_MAX];
+    u16_t n, i, sent;
+
+    for (n = 0; (n < LWIP_NETCONN_BATCH_MAX) && (done + n < vlen); n++) {
+      const struct msghdr *msg = &msgvec[done + n].msg_hdr;
+      ssize_t size = 0;
+
+      if ((msg->msg_iov == NULL) || (msg->msg_iovlen <= 0) || (msg->msg_iovlen > IOV_MAX)) {
+        err = ERR_VAL;
+        break;
+      }
+      if (!(((msg->msg_name == NULL) && (msg->msg_namelen == 0)) || IS_SOCK_ADDR_LEN_VALID(msg->msg_namelen))) {
+        err = ERR_ARG;
+        break;
+      }
+      err = lwip_sendmsg_netbuf(msg, &bufs[n], &size);
+      if (err != ERR_OK) {
+        netbuf_free(&bufs[n]);
+        break;
+      }
+      msgvec[done + n].msg_len = (unsigned int)size;
+      batch[n] = &bufs[n];
+    }
+    if (n != 0) {
+      err_t send_err = netconn_send_batch(sock->conn, batch, n, &sent);
+      for (i = 0; i < n; i++) {
+        netbuf_free(&bufs[i]);
+      }
+      done += sent;
+      if (sent != n) {
+        err = (send_err != ERR_OK) ? send_err : ERR_MEM;
+      }
+    }
+  }
+#else /* LWIP_UDP || LWIP_RAW */
+  err = ERR_ARG;
+#endif /* LWIP_UDP || LWIP_RAW */
+
+  if ((done == 0) && (vlen != 0)) {
+    /* ERR_VAL: a message too large or with a bad vector count */
+    sock_set_errno(sock, (err == ERR_VAL) ? EMSGSIZE : err_to_errno(err));
+    done_socket(sock);
+    return -1;
+  }
+  sock_set_errno(sock, 0);
+  done_socket(sock);
+  return (int)done;
+}
+#endif /* LWIP_NETCONN_BATCH */
+
 ssize_t
 lwip_sendto(int s, const void *data, size_t size, int flags,
             const struct sockaddr *to, socklen_t tolen)
@@ -2478,6 +2820,10 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
 {
   int s, check_waiters;
   struct lwip_sock *sock;
+#if LWIP_SOCKET_EVQ
+  u8_t wake;
+  sys_thread_t waiter;
+#endif /* LWIP_SOCKET_EVQ */
   SYS_ARCH_DECL_PROTECT(lev);
 
   LWIP_UNUSED_ARG(len);
@@ -2514,6 +2860,9 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
   }
 
   check_waiters = 1;
+#if LWIP_SOCKET_EVQ
+  wake = 0;
+#endif /* LWIP_SOCKET_EVQ */
   SYS_ARCH_PROTECT(lev);
   /* Set event as required */
   switch (evt) {
@@ -2545,6 +2894,13 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
       break;
   }
 
+#if LWIP_SOCKET_EVQ
+  /* ETH_CODE: onto the ready list of its event queue once it turns ready */
+  if (sock->evq != 0) {
+    wake = lwip_evq_check(sock, &waiter);
+  }
+#endif /* LWIP_SOCKET_EVQ */
+
   if (sock->select_waiting && check_waiters) {
     /* Save which events are active */
     int has_recvevent, has_sendevent, has_errevent;
@@ -2557,6 +2913,11 @@ event_callback(struct netconn *conn, enum netconn_evt evt, u16_t len)
   } else {
     SYS_ARCH_UNPROTECT(lev);
   }
+#if LWIP_SOCKET_EVQ
+  if (wake) {
+    sys_notify(waiter);
+  }
+#endif /* LWIP_SOCKET_EVQ */
   done_socket(sock);
 }
 
@@ -2648,6 +3009,231 @@ again:
 }
 #endif /* LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL */
 
+#if LWIP_SOCKET_EVQ
+/* ETH_CODE: event queue of id q, NULL (errno EBADF) if there is none */
+static struct lwip_evq *
+lwip_evq_get(int q)
+{
+  if ((q < 0) || (q >= LWIP_SOCKET_EVQ_NUM) || !evqs[q].used) {
+    set_errno(EBADF);
+    return NULL;
+  }
+  return &evqs[q];
+}
+
+/**
+ * ETH_CODE: Create a socket event queue.
+ *
+ * Sockets are added with lwip_evq_ctl(); lwip_evq_wait() returns those
+ * that are ready. Unlike select() and poll(), which walk every socket
+ * they are given on each call and each event, a socket is put on the
+ * ready list by event_callback() when it turns ready, and the waiting
+ * task is woken by sys_notify(). One task at a time waits on a queue.
+ *
+ * @return the queue id, -1 (errno ENFILE) if all LWIP_SOCKET_EVQ_NUM are used
+ */
+int
+lwip_evq_create(void)
+{
+  int q;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  for (q = 0; q < LWIP_SOCKET_EVQ_NUM; q++) {
+    if (!evqs[q].used) {
+      evqs[q].used = 1;
+      evqs[q].waiting = 0;
+      evqs[q].head = -1;
+      evqs[q].tail = -1;
+      evqs[q].count = 0;
+      SYS_ARCH_UNPROTECT(lev);
+      return q;
+    }
+  }
+  SYS_ARCH_UNPROTECT(lev);
+  set_errno(ENFILE);
+  return -1;
+}
+
+/**
+ * ETH_CODE: Close a socket event queue, removing its sockets (which stay
+ * open). A task waiting on it returns -1 with errno EBADF.
+ */
+int
+lwip_evq_close(int q)
+{
+  struct lwip_evq *evq;
+  int i;
+  u8_t wake;
+  sys_thread_t waiter;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  evq = lwip_evq_get(q);
+  if (evq == NULL) {
+    SYS_ARCH_UNPROTECT(lev);
+    return -1;
+  }
+  for (i = 0; i < NUM_SOCKETS; i++) {
+    if (sockets[i].evq == q + 1) {
+      lwip_evq_detach(&sockets[i]);
+    }
+  }
+  evq->used = 0;
+  wake = evq->waiting;
+  evq->waiting = 0;
+  waiter = evq->waiter;
+  SYS_ARCH_UNPROTECT(lev);
+  if (wake) {
+    sys_notify(waiter);
+  }
+  return 0;
+}
+
+/**
+ * ETH_CODE: Add a socket to, change it on or remove it from an event queue.
+ *
+ * @param q queue id from lwip_evq_create()
+ * @param op LWIP_EVQ_CTL_ADD, LWIP_EVQ_CTL_MOD or LWIP_EVQ_CTL_DEL
+ * @param s the socket; a socket is on one queue at most
+ * @param events LWIP_EVQ_IN and/or LWIP_EVQ_OUT (LWIP_EVQ_ERR is always
+ *        reported); ignored for LWIP_EVQ_CTL_DEL
+ * @param arg returned with the events of s; ignored for LWIP_EVQ_CTL_DEL
+ * @return 0, or -1 with errno EBADF, EINVAL, EEXIST (ADD: s is on a queue)
+ *         or ENOENT (MOD, DEL: s is not on q)
+ */
+int
+lwip_evq_ctl(int q, int op, int s, u8_t events, void *arg)
+{
+  struct lwip_evq *evq;
+  struct lwip_sock *sock;
+  int err = 0;
+  u8_t wake = 0;
+  sys_thread_t waiter;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_evq_ctl(%d, %d, %d, 0x%x)\n", q, op, s, (unsigned int)events));
+  LWIP_ERROR("lwip_evq_ctl: invalid events",
+             (events & ~(LWIP_EVQ_IN | LWIP_EVQ_OUT | LWIP_EVQ_ERR)) == 0,
+             set_errno(EINVAL); return -1;);
+
+  sock = get_socket(s);
+  if (!sock) {
+    return -1;
+  }
+
+  SYS_ARCH_PROTECT(lev);
+  evq = lwip_evq_get(q);
+  if (evq == NULL) {
+    err = EBADF;
+  } else if (op == LWIP_EVQ_CTL_ADD) {
+    if (sock->evq != 0) {
+      err = EEXIST;
+    } else {
+      sock->evq = (u8_t)(q + 1);
+      sock->evq_events = events;
+      sock->evq_arg = arg;
+      sock->evq_queued = 0;
+      wake = lwip_evq_check(sock, &waiter);
+    }
+  } else if (sock->evq != q + 1) {
+    err = ((op == LWIP_EVQ_CTL_MOD) || (op == LWIP_EVQ_CTL_DEL)) ? ENOENT : EINVAL;
+  } else if (op == LWIP_EVQ_CTL_MOD) {
+    sock->evq_events = events;
+    sock->evq_arg = arg;
+    wake = lwip_evq_check(sock, &waiter);
+  } else if (op == LWIP_EVQ_CTL_DEL) {
+    lwip_evq_detach(sock);
+  } else {
+    err = EINVAL;
+  }
+  SYS_ARCH_UNPROTECT(lev);
+  if (wake) {
+    sys_notify(waiter);
+  }
+
+  done_socket(sock);
+  if (err != 0) {
+    set_errno(err);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * ETH_CODE: Wait for sockets of an event queue to become ready.
+ *
+ * Level triggered: a socket that still has events after being returned
+ * goes back to the end of the ready list, so it is returned again by the
+ * next call (after the other ready sockets) until it is read, written
+ * or its events are changed with LWIP_EVQ_CTL_MOD. A call costs the
+ * number of ready sockets, not the number of sockets on the queue.
+ *
+ * @param q queue id from lwip_evq_create()
+ * @param ev filled in with up to maxevents ready sockets
+ * @param maxevents size of ev, > 0
+ * @param timeout in ms, 0 to return at once, < 0 to wait for ever
+ * @return the number of entries filled in, 0 on timeout, or -1 with errno
+ *         EBADF (q not open or closed while waiting) or EINVAL
+ */
+int
+lwip_evq_wait(int q, struct lwip_evq_event *ev, int maxevents, int timeout)
+{
+  struct lwip_evq *evq;
+  u32_t start = sys_now();
+  int n;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  LWIP_ERROR("lwip_evq_wait: invalid events", (ev != NULL) && (maxevents > 0),
+             set_errno(EINVAL); return -1;);
+
+  SYS_ARCH_PROTECT(lev);
+  for (;;) {
+    s16_t k;
+    u32_t wait_ms = 0;
+
+    evq = lwip_evq_get(q);
+    if (evq == NULL) {
+      SYS_ARCH_UNPROTECT(lev);
+      return -1;
+    }
+    /* visit each socket ready now once: report or drop it */
+    n = 0;
+    for (k = evq->count; (k > 0) && (n < maxevents); k--) {
+      s16_t i = lwip_evq_pop(evq);
+      u8_t events = lwip_evq_pending(&sockets[i]);
+      if (events != 0) {
+        ev[n].fd = i + LWIP_SOCKET_OFFSET;
+        ev[n].events = events;
+        ev[n].arg = sockets[i].evq_arg;
+        n++;
+        lwip_evq_push(evq, i);
+      }
+    }
+    if ((n > 0) || (timeout == 0)) {
+      break;
+    }
+    if (timeout > 0) {
+      u32_t elapsed = sys_now() - start;
+      if (elapsed >= (u32_t)timeout) {
+        break;
+      }
+      wait_ms = (u32_t)timeout - elapsed;
+    }
+    evq->waiter = sys_notify_self();
+    evq->waiting = 1;
+    SYS_ARCH_UNPROTECT(lev);
+
+    sys_notify_wait(wait_ms);
+
+    SYS_ARCH_PROTECT(lev);
+    evq->waiting = 0;
+  }
+  SYS_ARCH_UNPROTECT(lev);
+  return n;
+}
+#endif /* LWIP_SOCKET_EVQ */
+
 /**
  * Close one end of a full-duplex connection.
  */
@@ -3010,6 +3596,12 @@ lwip_getsockopt_impl(int s, int level, int optname, void *optval, socklen_t *opt
           *(int *)optval = udp_is_flag_set(sock->conn->pcb.udp, UDP_FLAGS_NOCHKSUM) ? 1 : 0;
           break;
 #endif /* LWIP_UDP*/
+#if LWIP_SO_TIMESTAMP
+        case SO_TIMESTAMP:
+          LWIP_SOCKOPT_CHECK_OPTLEN_CONN(sock, *optlen, int);
+          *(int *)optval = sock->rx_timestamp;
+          break;
+#endif /* LWIP_SO_TIMESTAMP */
         default:
           LWIP_DEBUGF(SOCKETS_DEBUG, ("lwip_getsockopt(%d, SOL_SOCKET, UNIMPL: optname=0x%x, ..)\n",
                                       s, optname));
@@ -3418,6 +4010,17 @@ lwip_setsockopt_impl(int s, int level, int optname, const void *optval, socklen_
           }
           break;
 #endif /* LWIP_UDP */
+#if LWIP_SO_TIMESTAMP
+        case SO_TIMESTAMP:
+          LWIP_SOCKOPT_CHECK_OPTLEN_CONN(sock, optlen, int);
+          if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+            /* a stream has no datagram to stamp */
+            done_socket(sock);
+            return ENOPROTOOPT;
+          }
+          sock->rx_timestamp = (*(const int *)optval != 0) ? 1 : 0;
+          break;
+#endif /* LWIP_SO_TIMESTAMP */
         case SO_BINDTODEVICE: {
           const struct ifreq *iface;
           struct netif *n = NULL;
@@ -589,6 +589,23 @@ tcpip_callbackmsg_trycallback_fromisr(struct tcpip_callback_msg *msg)
   return sys_mbox_trypost_fromisr(&tcpip_mbox, msg);
 }
 
+/**
+ * @ingroup lwip_os
+ * ETH_CODE: Try to post a callback-message to the front of the tcpip_thread
+ * mbox, so that it runs before the messages already waiting. Task level only.
+ *
+ * @param msg pointer to the message to post
+ * @return sys_mbox_trypost_front() return code
+ *
+ * @see tcpip_callbackmsg_trycallback()
+ */
+err_t
+tcpip_callbackmsg_trycallback_urgent(struct tcpip_callback_msg *msg)
+{
+  LWIP_ASSERT("Invalid mbox", sys_mbox_valid_val(tcpip_mbox));
+  return sys_mbox_trypost_front(&tcpip_mbox, msg);
+}
+
 /**
  * @ingroup lwip_os
  * Initialize this module:
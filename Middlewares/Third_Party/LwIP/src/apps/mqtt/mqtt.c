@@ -57,10 +57,21 @@
 #include "lwip/altcp.h"
 #include "lwip/altcp_tcp.h"
 #include "lwip/altcp_tls.h"
+#if MQTT_PUBLISH_REF
+#include "lwip/tcp.h"
+#endif
 #include <string.h>
 
 #if LWIP_TCP && LWIP_CALLBACK_API
 
+#if MQTT_PUBLISH_REF && (LWIP_ALTCP || !LWIP_TCP_TXREF)
+#error "MQTT_PUBLISH_REF needs LWIP_TCP_TXREF and LWIP_ALTCP==0"
+#endif
+
+#if MQTT_V5 && (MQTT_TOPIC_ALIAS_LEN > 255)
+#error "MQTT_TOPIC_ALIAS_LEN must fit in u8_t"
+#endif
+
 /**
  * MQTT_DEBUG: Default is off.
  */
@@ -106,6 +117,14 @@ enum mqtt_message_type {
   MQTT_MSG_TYPE_DISCONNECT = 14
 };
 
+#if MQTT_V5
+/** ETH_CODE: MQTT 5 property identifiers used here */
+#define MQTT_PROP_TOPIC_ALIAS_MAX 0x22
+#define MQTT_PROP_TOPIC_ALIAS     0x23
+/** ETH_CODE: MQTT 5 reason codes from 0x80 on are failures */
+#define MQTT_REASON_FAILURE       0x80
+#endif /* MQTT_V5 */
+
 /** Helpers to extract control packet type and qos from first byte in fixed header */
 #define MQTT_CTL_PACKET_TYPE(fixed_hdr_byte0) ((fixed_hdr_byte0 & 0xf0) >> 4)
 #define MQTT_CTL_PACKET_QOS(fixed_hdr_byte0) ((fixed_hdr_byte0 & 0x6) >> 1)
@@ -123,6 +142,9 @@ enum mqtt_connect_flag {
 
 
 static void mqtt_cyclic_timer(void *arg);
+#if MQTT_PUBLISH_BATCH
+static void mqtt_batch_timer(void *arg);
+#endif
 
 #if defined(LWIP_DEBUG)
 static const char *const mqtt_message_type_str[15] = {
@@ -188,6 +210,28 @@ mqtt_ringbuf_put(struct mqtt_ringbuf_t *rb, u8_t item)
   if (rb->put >= MQTT_OUTPUT_RINGBUF_SIZE) {
     rb->put = 0;
   }
+#if MQTT_PUBLISH_REF
+  rb->put_total++;
+#endif
+}
+
+/** ETH_CODE: Add len bytes to ring buffer, one copy per linear part */
+static void
+mqtt_ringbuf_put_buf(struct mqtt_ringbuf_t *rb, const void *data, u16_t len)
+{
+  u16_t lin = LWIP_MIN(len, MQTT_OUTPUT_RINGBUF_SIZE - rb->put);
+
+  MEMCPY(&rb->buf[rb->put], data, lin);
+  if (len > lin) {
+    MEMCPY(rb->buf, (const u8_t *)data + lin, len - lin);
+  }
+  rb->put += len;
+  if (rb->put >= MQTT_OUTPUT_RINGBUF_SIZE) {
+    rb->put -= MQTT_OUTPUT_RINGBUF_SIZE;
+  }
+#if MQTT_PUBLISH_REF
+  rb->put_total += len;
+#endif
 }
 
 /** Return pointer to ring buffer get position */
@@ -206,6 +250,9 @@ mqtt_ringbuf_advance_get_idx(struct mqtt_ringbuf_t *rb, u16_t len)
   if (rb->get >= MQTT_OUTPUT_RINGBUF_SIZE) {
     rb->get = rb->get - MQTT_OUTPUT_RINGBUF_SIZE;
   }
+#if MQTT_PUBLISH_REF
+  rb->get_total += len;
+#endif
 }
 
 /** Return number of bytes in ring buffer */
@@ -219,28 +266,32 @@ mqtt_ringbuf_len(struct mqtt_ringbuf_t *rb)
   return (u16_t)len;
 }
 
-/** Return number of bytes free in ring buffer */
-#define mqtt_ringbuf_free(rb) (MQTT_OUTPUT_RINGBUF_SIZE - mqtt_ringbuf_len(rb))
+/** Return number of bytes free in ring buffer
+ * ETH_CODE: one byte less than unused, a full ring would read as empty */
+#define mqtt_ringbuf_free(rb) (MQTT_OUTPUT_RINGBUF_SIZE - 1 - mqtt_ringbuf_len(rb))
 
 /** Return number of bytes possible to read without wrapping around */
 #define mqtt_ringbuf_linear_read_length(rb) LWIP_MIN(mqtt_ringbuf_len(rb), (MQTT_OUTPUT_RINGBUF_SIZE - (rb)->get))
 
 /**
- * Try send as many bytes as possible from output ring buffer
+ * Write as many bytes as possible from output ring buffer, without flushing
+ * ETH_CODE: at most limit bytes, the ones before the next queued payload
  * @param rb Output ring buffer
  * @param tpcb TCP connection handle
+ * @param limit Maximum number of bytes to write
+ * @return 1 if anything was written
  */
-static void
-mqtt_output_send(struct mqtt_ringbuf_t *rb, struct altcp_pcb *tpcb)
+static u8_t
+mqtt_output_write_ring(struct mqtt_ringbuf_t *rb, struct altcp_pcb *tpcb, u16_t limit)
 {
   err_t err;
   u8_t wrap = 0;
-  u16_t ringbuf_lin_len = mqtt_ringbuf_linear_read_length(rb);
+  u16_t ringbuf_len = LWIP_MIN(mqtt_ringbuf_len(rb), limit);
+  u16_t ringbuf_lin_len = LWIP_MIN(mqtt_ringbuf_linear_read_length(rb), ringbuf_len);
   u16_t send_len = altcp_sndbuf(tpcb);
-  LWIP_ASSERT("mqtt_output_send: tpcb != NULL", tpcb != NULL);
 
   if (send_len == 0 || ringbuf_lin_len == 0) {
-    return;
+    return 0;
   }
 
   LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_output_send: tcp_sndbuf: %d bytes, ringbuf_linear_available: %d, get %d, put %d\n",
@@ -250,25 +301,124 @@ mqtt_output_send(struct mqtt_ringbuf_t *rb, struct altcp_pcb *tpcb)
     /* Space in TCP output buffer is larger than available in ring buffer linear portion */
     send_len = ringbuf_lin_len;
     /* Wrap around if more data in ring buffer after linear portion */
-    wrap = (mqtt_ringbuf_len(rb) > ringbuf_lin_len);
+    wrap = (ringbuf_len > ringbuf_lin_len);
   }
   err = altcp_write(tpcb, mqtt_ringbuf_get_ptr(rb), send_len, TCP_WRITE_FLAG_COPY | (wrap ? TCP_WRITE_FLAG_MORE : 0));
   if ((err == ERR_OK) && wrap) {
     mqtt_ringbuf_advance_get_idx(rb, send_len);
-    /* Use the lesser one of ring buffer linear length and TCP send buffer size */
-    send_len = LWIP_MIN(altcp_sndbuf(tpcb), mqtt_ringbuf_linear_read_length(rb));
+    /* Use the lesser one of what is left to write and TCP send buffer size */
+    send_len = LWIP_MIN(altcp_sndbuf(tpcb), ringbuf_len - send_len);
     err = altcp_write(tpcb, mqtt_ringbuf_get_ptr(rb), send_len, TCP_WRITE_FLAG_COPY);
   }
 
   if (err == ERR_OK) {
     mqtt_ringbuf_advance_get_idx(rb, send_len);
+    return 1;
+  }
+  LWIP_DEBUGF(MQTT_DEBUG_WARN, ("mqtt_output_send: Send failed with err %d (\"%s\")\n", err, lwip_strerr(err)));
+  return 0;
+}
+
+#if MQTT_PUBLISH_REF
+/**
+ * ETH_CODE: Write queued payloads by reference, each after the ring buffer
+ * bytes in front of it
+ * @param rb Output ring buffer
+ * @param tpcb TCP connection handle
+ * @return 1 if anything was written
+ */
+static u8_t
+mqtt_output_write_refs(struct mqtt_ringbuf_t *rb, struct altcp_pcb *tpcb)
+{
+  u8_t written = 0;
+
+  while (rb->ref_num > 0) {
+    struct mqtt_out_ref_t *r = &rb->refs[rb->ref_first];
+    u16_t len;
+
+    if (rb->get_total != r->at) {
+      written |= mqtt_output_write_ring(rb, tpcb, (u16_t)(r->at - rb->get_total));
+      if (rb->get_total != r->at) {
+        break;
+      }
+    }
+    len = LWIP_MIN(r->len, altcp_sndbuf(tpcb));
+    if ((len == 0) || (tcp_write_ref(tpcb, r->data, len, 0, r->ref) != ERR_OK)) {
+      break;
+    }
+    written = 1;
+    r->data += len;
+    r->len -= len;
+    if (r->len > 0) {
+      break;
+    }
+    /* TCP holds its own references now */
+    tcp_txref_release(r->ref);
+    rb->ref_first = (u8_t)((rb->ref_first + 1) % MQTT_PUBLISH_REF_MAX);
+    rb->ref_num--;
+  }
+  return written;
+}
+
+/**
+ * ETH_CODE: Drop the payloads not yet handed to TCP
+ * @param rb Output ring buffer
+ */
+static void
+mqtt_output_clear_refs(struct mqtt_ringbuf_t *rb)
+{
+  while (rb->ref_num > 0) {
+    tcp_txref_release(rb->refs[rb->ref_first].ref);
+    rb->ref_first = (u8_t)((rb->ref_first + 1) % MQTT_PUBLISH_REF_MAX);
+    rb->ref_num--;
+  }
+}
+#endif /* MQTT_PUBLISH_REF */
+
+/**
+ * Try send as many bytes as possible from output ring buffer
+ * @param rb Output ring buffer
+ * @param tpcb TCP connection handle
+ */
+static void
+mqtt_output_send(struct mqtt_ringbuf_t *rb, struct altcp_pcb *tpcb)
+{
+  u8_t written = 0;
+  LWIP_ASSERT("mqtt_output_send: tpcb != NULL", tpcb != NULL);
+
+#if MQTT_PUBLISH_REF
+  written = mqtt_output_write_refs(rb, tpcb);
+  if (rb->ref_num == 0)
+#endif /* MQTT_PUBLISH_REF */
+  {
+    written |= mqtt_output_write_ring(rb, tpcb, 0xFFFF);
+  }
+  if (written) {
     /* Flush */
     altcp_output(tpcb);
-  } else {
-    LWIP_DEBUGF(MQTT_DEBUG_WARN, ("mqtt_output_send: Send failed with err %d (\"%s\")\n", err, lwip_strerr(err)));
   }
 }
 
+#if MQTT_PUBLISH_BATCH
+/**
+ * ETH_CODE: Bytes waiting to be written, payloads by reference included
+ * @param rb Output ring buffer
+ * @return Number of bytes
+ */
+static u32_t
+mqtt_output_pending(struct mqtt_ringbuf_t *rb)
+{
+  u32_t len = mqtt_ringbuf_len(rb);
+#if MQTT_PUBLISH_REF
+  u8_t n;
+  for (n = 0; n < rb->ref_num; n++) {
+    len += rb->refs[(rb->ref_first + n) % MQTT_PUBLISH_REF_MAX].len;
+  }
+#endif /* MQTT_PUBLISH_REF */
+  return len;
+}
+#endif /* MQTT_PUBLISH_BATCH */
+
 
 
 /*--------------------------------------------------------------------------------------------------------------------- */
@@ -463,20 +613,53 @@ void mqtt_output_append_u16(struct mqtt_ringbuf_t *rb, u16_t value)
 static void
 mqtt_output_append_buf(struct mqtt_ringbuf_t *rb, const void *data, u16_t length)
 {
-  u16_t n;
-  for (n = 0; n < length; n++) {
-    mqtt_ringbuf_put(rb, ((const u8_t *)data)[n]);
-  }
+  mqtt_ringbuf_put_buf(rb, data, length);
 }
 
 static void
 mqtt_output_append_string(struct mqtt_ringbuf_t *rb, const char *str, u16_t length)
 {
-  u16_t n;
   mqtt_ringbuf_put(rb, length >> 8);
   mqtt_ringbuf_put(rb, length & 0xff);
-  for (n = 0; n < length; n++) {
-    mqtt_ringbuf_put(rb, str[n]);
+  mqtt_ringbuf_put_buf(rb, str, length);
+}
+
+/**
+ * @ingroup mqtt
+ * ETH_CODE: Append payload bytes from an mqtt_payload_gen_t. Bytes past the
+ * payload length given to mqtt_publish_gen() are dropped.
+ * @param out Payload writer passed to the generator
+ * @param data Bytes to append
+ * @param len Number of bytes
+ */
+void
+mqtt_payload_write(struct mqtt_payload_out *out, const void *data, u16_t len)
+{
+  LWIP_ASSERT("mqtt_payload_write: payload longer than declared", len <= out->left);
+  len = LWIP_MIN(len, out->left);
+  mqtt_ringbuf_put_buf(out->rb, data, len);
+  out->left -= len;
+}
+
+/**
+ * ETH_CODE: Append a payload written by a generator, padded with zeros to
+ * length if it writes less
+ * @param rb Output ring buffer
+ * @param length Payload length
+ * @param gen Generator
+ * @param gen_arg Argument to gen
+ */
+static void
+mqtt_output_append_gen(struct mqtt_ringbuf_t *rb, u16_t length, mqtt_payload_gen_t gen, void *gen_arg)
+{
+  struct mqtt_payload_out out;
+  out.rb = rb;
+  out.left = length;
+  gen(gen_arg, &out);
+  LWIP_ASSERT("mqtt_output_append_gen: payload shorter than declared", out.left == 0);
+  while (out.left > 0) {
+    mqtt_ringbuf_put(rb, 0);
+    out.left--;
   }
 }
 
@@ -503,18 +686,188 @@ mqtt_output_append_fixed_header(struct mqtt_ringbuf_t *rb, u8_t msg_type, u8_t f
   } while (r_length > 0);
 }
 
+#if MQTT_V5
+/**
+ * ETH_CODE: Decode a Variable Byte Integer
+ * @param buf Input
+ * @param len Bytes available in buf
+ * @param value Decoded value
+ * @return Bytes used, 0 if malformed or not all in buf
+ */
+static u16_t
+mqtt_read_varint(const u8_t *buf, u16_t len, u32_t *value)
+{
+  u16_t n;
+  *value = 0;
+  for (n = 0; (n < len) && (n < 4); n++) {
+    *value |= (u32_t)(buf[n] & 0x7f) << (7 * n);
+    if ((buf[n] & 0x80) == 0) {
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * ETH_CODE: Skip a property length and the properties after it
+ * @param buf Input, at the property length
+ * @param len Bytes available in buf
+ * @return Bytes to skip, 0 if malformed or not all in buf
+ */
+static u16_t
+mqtt_skip_props(const u8_t *buf, u16_t len)
+{
+  u32_t props_len;
+  u16_t n = mqtt_read_varint(buf, len, &props_len);
+  if ((n == 0) || (props_len > (u32_t)(len - n))) {
+    return 0;
+  }
+  return (u16_t)(n + props_len);
+}
+
+/**
+ * ETH_CODE: Read the CONNACK properties this client uses
+ * @param client MQTT client
+ * @param buf Input, at the property length
+ * @param len Bytes available in buf
+ */
+static void
+mqtt_parse_connack_props(mqtt_client_t *client, const u8_t *buf, u16_t len)
+{
+  u32_t props_len;
+  u16_t i = mqtt_read_varint(buf, len, &props_len);
+  u16_t end;
+
+  if ((i == 0) || (props_len > (u32_t)(len - i))) {
+    return;
+  }
+  end = (u16_t)(i + props_len);
+  while (i < end) {
+    u8_t id = buf[i++];
+    u32_t skip;
+    switch (id) {
+      case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+        skip = 1;
+        break;
+      case 0x13: case 0x21: case MQTT_PROP_TOPIC_ALIAS: case MQTT_PROP_TOPIC_ALIAS_MAX:
+        skip = 2;
+        break;
+      case 0x02: case 0x11: case 0x18: case 0x27:
+        skip = 4;
+        break;
+      case 0x0B:
+        skip = mqtt_read_varint(&buf[i], (u16_t)(end - i), &skip);
+        break;
+      case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+        /* UTF-8 string or binary data */
+        skip = (end - i >= 2) ? 2 + (((u32_t)buf[i] << 8) | buf[i + 1]) : 0;
+        break;
+      case 0x26:
+        /* String pair */
+        skip = 0;
+        if (end - i >= 2) {
+          skip = 2 + (((u32_t)buf[i] << 8) | buf[i + 1]);
+          if ((end - i >= skip + 2)) {
+            skip += 2 + (((u32_t)buf[i + skip] << 8) | buf[i + skip + 1]);
+          }
+        }
+        break;
+      default:
+        LWIP_DEBUGF(MQTT_DEBUG_WARN, ("mqtt_parse_connack_props: Unknown property 0x%02x\n", id));
+        return;
+    }
+    if ((skip == 0) || (skip > (u32_t)(end - i))) {
+      return;
+    }
+    if ((id == MQTT_PROP_TOPIC_ALIAS_MAX) && (skip == 2)) {
+      client->alias_max = (u16_t)(((u16_t)buf[i] << 8) | buf[i + 1]);
+    }
+    i = (u16_t)(i + skip);
+  }
+}
+
+/**
+ * ETH_CODE: Map a failed MQTT 5 CONNACK reason code to the 3.1.1 return codes
+ * @param reason CONNACK reason code
+ * @return Connection status
+ */
+static mqtt_connection_status_t
+mqtt_connack_reason_to_status(u8_t reason)
+{
+  switch (reason) {
+    case 0x00:
+      return MQTT_CONNECT_ACCEPTED;
+    case 0x84:
+      return MQTT_CONNECT_REFUSED_PROTOCOL_VERSION;
+    case 0x85:
+      return MQTT_CONNECT_REFUSED_IDENTIFIER;
+    case 0x86:
+      return MQTT_CONNECT_REFUSED_USERNAME_PASS;
+    case 0x87:
+      return MQTT_CONNECT_REFUSED_NOT_AUTHORIZED_;
+    default:
+      return MQTT_CONNECT_REFUSED_SERVER;
+  }
+}
+
+/**
+ * ETH_CODE: Find the alias of a topic, or the next free one; a new alias is
+ * kept with mqtt_topic_alias_add() once its publish is queued
+ * @param client MQTT client
+ * @param topic Topic string
+ * @param topic_len Topic length
+ * @param known Set to 1 if the server already knows the alias
+ * @return Alias, 0 for none
+ */
+static u16_t
+mqtt_topic_alias(mqtt_client_t *client, const char *topic, u16_t topic_len, u8_t *known)
+{
+  u16_t n;
+
+  *known = 0;
+  if ((topic_len == 0) || (topic_len > MQTT_TOPIC_ALIAS_LEN)) {
+    return 0;
+  }
+  for (n = 0; n < client->alias_num; n++) {
+    struct mqtt_topic_alias_t *a = &client->aliases[n];
+    if ((a->len == topic_len) && (memcmp(a->topic, topic, topic_len) == 0)) {
+      *known = 1;
+      return n + 1;
+    }
+  }
+  if (n >= LWIP_MIN(client->alias_max, MQTT_TOPIC_ALIAS_NUM)) {
+    return 0;
+  }
+  return n + 1;
+}
+
+/**
+ * ETH_CODE: Keep the topic of a new alias from mqtt_topic_alias()
+ * @param client MQTT client
+ * @param topic Topic string
+ * @param topic_len Topic length
+ */
+static void
+mqtt_topic_alias_add(mqtt_client_t *client, const char *topic, u16_t topic_len)
+{
+  struct mqtt_topic_alias_t *a = &client->aliases[client->alias_num++];
+  a->len = (u8_t)topic_len;
+  MEMCPY(a->topic, topic, topic_len);
+}
+#endif /* MQTT_V5 */
 
 /**
  * Check output buffer space
  * @param rb Output ring buffer
  * @param r_length Remaining length after fixed header
+ * @param ref_length ETH_CODE: bytes of r_length sent by reference, not from the ring
  * @return 1 if message will fit, 0 if not enough buffer space
  */
 static u8_t
-mqtt_output_check_space(struct mqtt_ringbuf_t *rb, u16_t r_length)
+mqtt_output_check_space(struct mqtt_ringbuf_t *rb, u16_t r_length, u16_t ref_length)
 {
   /* Start with length of type byte + remaining length */
-  u16_t total_len = 1 + r_length;
+  u32_t total_len = 1 + (u32_t)r_length - ref_length;
 
   LWIP_ASSERT("mqtt_output_check_space: rb != NULL", rb != NULL);
 
@@ -554,8 +907,15 @@ mqtt_close(mqtt_client_t *client, mqtt_connection_status_t reason)
 
   /* Remove all pending requests */
   mqtt_clear_requests(&client->pend_req_queue);
+#if MQTT_PUBLISH_REF
+  mqtt_output_clear_refs(&client->output);
+#endif
   /* Stop cyclic timer */
   sys_untimeout(mqtt_cyclic_timer, client);
+#if MQTT_PUBLISH_BATCH
+  sys_untimeout(mqtt_batch_timer, client);
+  client->batch_pending = 0;
+#endif
 
   /* Notify upper layer of disconnection if changed state */
   if (client->conn_state != TCP_DISCONNECTED) {
@@ -605,7 +965,7 @@ mqtt_cyclic_timer(void *arg)
       /* If time for a keep alive message to be sent, transmission has been idle for keep_alive time */
       if ((client->cyclic_tick * MQTT_CYCLIC_TIMER_INTERVAL) >= client->keep_alive) {
         LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_cyclic_timer: Sending keep-alive message to server\n"));
-        if (mqtt_output_check_space(&client->output, 0) != 0) {
+        if (mqtt_output_check_space(&client->output, 0, 0) != 0) {
           mqtt_output_append_fixed_header(&client->output, MQTT_MSG_TYPE_PINGREQ, 0, 0, 0, 0);
           client->cyclic_tick = 0;
         }
@@ -622,6 +982,55 @@ mqtt_cyclic_timer(void *arg)
   }
 }
 
+#if MQTT_PUBLISH_BATCH
+/**
+ * ETH_CODE: Publish flush timer, started by the first publish of a batch
+ * @param arg MQTT client
+ */
+static void
+mqtt_batch_timer(void *arg)
+{
+  mqtt_client_t *client = (mqtt_client_t *)arg;
+  client->batch_pending = 0;
+  if (client->conn != NULL) {
+    mqtt_output_send(&client->output, client->conn);
+  }
+}
+
+/**
+ * ETH_CODE: Send a new publish now, or start or join a batch
+ * @param client MQTT client
+ */
+static void
+mqtt_output_send_batched(mqtt_client_t *client)
+{
+  if ((client->batch_ms == 0) || (mqtt_output_pending(&client->output) >= altcp_mss(client->conn))) {
+    /* Not batching, or a segment is full */
+    mqtt_output_send(&client->output, client->conn);
+  } else if (!client->batch_pending) {
+    client->batch_pending = 1;
+    sys_timeout(client->batch_ms, mqtt_batch_timer, client);
+  }
+}
+
+/**
+ * @ingroup mqtt
+ * ETH_CODE: Send the publishes of the current batch now, e.g. after the
+ * last of a burst
+ * @param client MQTT client
+ */
+void
+mqtt_flush(mqtt_client_t *client)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ASSERT("mqtt_flush: client != NULL", client != NULL);
+  if (client->batch_pending) {
+    sys_untimeout(mqtt_batch_timer, client);
+    mqtt_batch_timer(client);
+  }
+}
+#endif /* MQTT_PUBLISH_BATCH */
+
 
 /**
  * Send PUBACK, PUBREC or PUBREL response message
@@ -635,7 +1044,7 @@ static err_t
 pub_ack_rec_rel_response(mqtt_client_t *client, u8_t msg, u16_t pkt_id, u8_t qos)
 {
   err_t err = ERR_OK;
-  if (mqtt_output_check_space(&client->output, 2)) {
+  if (mqtt_output_check_space(&client->output, 2, 0)) {
     mqtt_output_append_fixed_header(&client->output, msg, 0, qos, 0, 2);
     mqtt_output_append_u16(&client->output, pkt_id);
     mqtt_output_send(&client->output, client->conn);
@@ -692,7 +1101,14 @@ mqtt_message_received(mqtt_client_t *client, u8_t fixed_hdr_idx, u16_t length, u
         goto out_disconnect;
       }
       /* Get result code from CONNACK */
+#if MQTT_V5
+      res = mqtt_connack_reason_to_status(var_hdr_payload[1]);
+      if (res == MQTT_CONNECT_ACCEPTED) {
+        mqtt_parse_connack_props(client, &var_hdr_payload[2], length - 2);
+      }
+#else
       res = (mqtt_connection_status_t)var_hdr_payload[1];
+#endif /* MQTT_V5 */
       LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_message_received: Connect response code %d\n", res));
       if (res == MQTT_CONNECT_ACCEPTED) {
         /* Reset cyclic_tick when changing to connected state */
@@ -752,6 +1168,17 @@ mqtt_message_received(mqtt_client_t *client, u8_t fixed_hdr_idx, u16_t length, u
       } else {
         client->inpub_pkt_id = 0;
       }
+#if MQTT_V5
+      {
+        /* ETH_CODE: properties, none used (no topic aliases from the server) */
+        u16_t props_len = mqtt_skip_props(var_hdr_payload + after_topic, length - after_topic);
+        if (props_len == 0) {
+          LWIP_DEBUGF(MQTT_DEBUG_WARN, ("mqtt_message_received: PUBLISH properties do not fit receive buffer\n"));
+          goto out_disconnect;
+        }
+        after_topic += props_len;
+      }
+#endif /* MQTT_V5 */
       /* Take backup of byte after topic */
       bkp = topic[topic_len];
       /* Zero terminate string */
@@ -791,6 +1218,19 @@ mqtt_message_received(mqtt_client_t *client, u8_t fixed_hdr_idx, u16_t length, u
       LWIP_DEBUGF(MQTT_DEBUG_WARN, ("mqtt_message_received: Got message with illegal packet identifier: 0\n"));
       goto out_disconnect;
     }
+#if MQTT_V5
+    /* ETH_CODE: a failed QoS 2 publish ends at PUBREC */
+    if ((pkt_type == MQTT_MSG_TYPE_PUBREC) && (length > 2) && (var_hdr_payload[2] >= MQTT_REASON_FAILURE)) {
+      struct mqtt_request_t *r = mqtt_take_request(&client->pend_req_queue, pkt_id);
+      LWIP_DEBUGF(MQTT_DEBUG_WARN, ("mqtt_message_received: PUBREC reason 0x%02x\n", var_hdr_payload[2]));
+      if (r != NULL) {
+        if (r->cb != NULL) {
+          r->cb(r->arg, ERR_ABRT);
+        }
+        mqtt_delete_request(r);
+      }
+    } else
+#endif /* MQTT_V5 */
     if (pkt_type == MQTT_MSG_TYPE_PUBREC) {
       LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_message_received: PUBREC, sending PUBREL with pkt_id: %d\n", pkt_id));
       pub_ack_rec_rel_response(client, MQTT_MSG_TYPE_PUBREL, pkt_id, 1);
@@ -805,13 +1245,26 @@ mqtt_message_received(mqtt_client_t *client, u8_t fixed_hdr_idx, u16_t length, u
       if (r != NULL) {
         LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_message_received: %s response with id %d\n", mqtt_msg_type_to_str(pkt_type), pkt_id));
         if (pkt_type == MQTT_MSG_TYPE_SUBACK) {
+#if MQTT_V5
+          /* ETH_CODE: the return code follows the properties */
+          u16_t rc_idx = 2 + mqtt_skip_props(var_hdr_payload + 2, length - 2);
+          if ((rc_idx == 2) || (length <= rc_idx)) {
+#else
+          u16_t rc_idx = 2;
           if (length < 3) {
+#endif /* MQTT_V5 */
             LWIP_DEBUGF(MQTT_DEBUG_WARN, ("mqtt_message_received: To small SUBACK packet\n"));
             goto out_disconnect;
           } else {
-            mqtt_incomming_suback(r, var_hdr_payload[2]);
+            mqtt_incomming_suback(r, var_hdr_payload[rc_idx]);
           }
         } else if (r->cb != NULL) {
+#if MQTT_V5
+          /* ETH_CODE: PUBACK and PUBCOMP may carry a failure reason code */
+          if ((pkt_type != MQTT_MSG_TYPE_UNSUBACK) && (length > 2) && (var_hdr_payload[2] >= MQTT_REASON_FAILURE)) {
+            r->cb(r->arg, ERR_ABRT);
+          } else
+#endif /* MQTT_V5 */
           r->cb(r->arg, ERR_OK);
         }
         mqtt_delete_request(r);
@@ -995,7 +1448,13 @@ mqtt_tcp_sent_cb(void *arg, struct altcp_pcb *tpcb, u16_t len)
       mqtt_delete_request(r);
     }
     /* Try send any remaining buffers from output queue */
-    mqtt_output_send(&client->output, client->conn);
+#if MQTT_PUBLISH_BATCH
+    /* ETH_CODE: a pending batch waits for its timer */
+    if (!client->batch_pending)
+#endif /* MQTT_PUBLISH_BATCH */
+    {
+      mqtt_output_send(&client->output, client->conn);
+    }
   }
   return ERR_OK;
 }
@@ -1079,23 +1538,26 @@ mqtt_tcp_connect_cb(void *arg, struct altcp_pcb *tpcb, err_t err)
 
 
 /**
- * @ingroup mqtt
- * MQTT publish function.
+ * Queue a publish message
  * @param client MQTT client
  * @param topic Publish topic string
  * @param payload Data to publish (NULL is allowed)
  * @param payload_length Length of payload (0 is allowed)
  * @param qos Quality of service, 0 1 or 2
  * @param retain MQTT retain flag
+ * @param ref ETH_CODE: send the payload by reference under ref, NULL to copy it
+ * @param gen ETH_CODE: write the payload with gen instead, NULL to use payload
+ * @param gen_arg ETH_CODE: argument to gen
  * @param cb Callback to call when publish is complete or has timed out
  * @param arg User supplied argument to publish callback
  * @return ERR_OK if successful
  *         ERR_CONN if client is disconnected
  *         ERR_MEM if short on memory
  */
-err_t
-mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_t payload_length, u8_t qos, u8_t retain,
-             mqtt_request_cb_t cb, void *arg)
+static err_t
+mqtt_publish_msg(mqtt_client_t *client, const char *topic, const void *payload, u16_t payload_length, u8_t qos,
+                 u8_t retain, struct tcp_txref *ref, mqtt_payload_gen_t gen, void *gen_arg,
+                 mqtt_request_cb_t cb, void *arg)
 {
   struct mqtt_request_t *r;
   u16_t pkt_id;
@@ -1103,6 +1565,11 @@ mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_
   size_t total_len;
   u16_t topic_len;
   u16_t remaining_length;
+  u16_t ref_length = 0;
+#if MQTT_V5
+  u16_t alias;
+  u8_t alias_known;
+#endif /* MQTT_V5 */
 
   LWIP_ASSERT_CORE_LOCKED();
   LWIP_ASSERT("mqtt_publish: client != NULL", client);
@@ -1112,7 +1579,13 @@ mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_
   topic_strlen = strlen(topic);
   LWIP_ERROR("mqtt_publish: topic length overflow", (topic_strlen <= (0xFFFF - 2)), return ERR_ARG);
   topic_len = (u16_t)topic_strlen;
+#if MQTT_V5
+  /* ETH_CODE: once the server knows the alias, the topic is sent empty */
+  alias = mqtt_topic_alias(client, topic, topic_len, &alias_known);
+  total_len = 2 + (alias_known ? 0 : topic_len) + 1 + (alias ? 3 : 0) + (size_t)payload_length;
+#else
   total_len = 2 + topic_len + payload_length;
+#endif /* MQTT_V5 */
 
   if (qos > 0) {
     total_len += 2;
@@ -1127,12 +1600,41 @@ mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_
 
   LWIP_DEBUGF(MQTT_DEBUG_TRACE, ("mqtt_publish: Publish with payload length %d to topic \"%s\"\n", payload_length, topic));
 
+#if MQTT_PUBLISH_REF
+  if ((ref != NULL) && (payload != NULL) && (payload_length > 0)) {
+    ref_length = payload_length;
+  }
+#else
+  LWIP_UNUSED_ARG(ref);
+#endif /* MQTT_PUBLISH_REF */
+
+#if MQTT_PUBLISH_BATCH
+  /* ETH_CODE: make room by sending the batch early */
+  if (client->batch_pending && ((mqtt_output_check_space(&client->output, remaining_length, ref_length) == 0)
+#if MQTT_PUBLISH_REF
+                                || ((ref_length > 0) && (client->output.ref_num >= MQTT_PUBLISH_REF_MAX))
+#endif /* MQTT_PUBLISH_REF */
+                               )) {
+    mqtt_flush(client);
+  }
+#endif /* MQTT_PUBLISH_BATCH */
+
+#if MQTT_PUBLISH_REF
+  if ((ref_length > 0) && (client->output.ref_num >= MQTT_PUBLISH_REF_MAX)) {
+    return ERR_MEM;
+  }
+#endif /* MQTT_PUBLISH_REF */
+
   r = mqtt_create_request(client->req_list, LWIP_ARRAYSIZE(client->req_list), pkt_id, cb, arg);
   if (r == NULL) {
+#if MQTT_PUBLISH_BATCH
+    /* ETH_CODE: QoS 0 requests end when sent, don't hold them for the timer */
+    mqtt_flush(client);
+#endif /* MQTT_PUBLISH_BATCH */
     return ERR_MEM;
   }
 
-  if (mqtt_output_check_space(&client->output, remaining_length) == 0) {
+  if (mqtt_output_check_space(&client->output, remaining_length, ref_length) == 0) {
     mqtt_delete_request(r);
     return ERR_MEM;
   }
@@ -1140,6 +1642,11 @@ mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_
   mqtt_output_append_fixed_header(&client->output, MQTT_MSG_TYPE_PUBLISH, 0, qos, retain, remaining_length);
 
   /* Append Topic */
+#if MQTT_V5
+  if (alias_known) {
+    mqtt_output_append_u16(&client->output, 0);
+  } else
+#endif /* MQTT_V5 */
   mqtt_output_append_string(&client->output, topic, topic_len);
 
   /* Append packet if for QoS 1 and 2*/
@@ -1147,16 +1654,133 @@ mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_
     mqtt_output_append_u16(&client->output, pkt_id);
   }
 
+#if MQTT_V5
+  /* ETH_CODE: properties, only the topic alias */
+  if (alias != 0) {
+    mqtt_output_append_u8(&client->output, 3);
+    mqtt_output_append_u8(&client->output, MQTT_PROP_TOPIC_ALIAS);
+    mqtt_output_append_u16(&client->output, alias);
+    if (!alias_known) {
+      mqtt_topic_alias_add(client, topic, topic_len);
+    }
+  } else {
+    mqtt_output_append_u8(&client->output, 0);
+  }
+#endif /* MQTT_V5 */
+
+#if MQTT_PUBLISH_REF
+  if (ref_length > 0) {
+    /* ETH_CODE: the payload follows the header from the caller's buffer */
+    struct mqtt_out_ref_t *out = &client->output.refs[(client->output.ref_first + client->output.ref_num) %
+                                                      MQTT_PUBLISH_REF_MAX];
+    out->at = client->output.put_total;
+    out->data = (const u8_t *)payload;
+    out->len = payload_length;
+    out->ref = ref;
+    client->output.ref_num++;
+  } else if (ref != NULL) {
+    /* Nothing to reference */
+    tcp_txref_release(ref);
+  } else
+#endif /* MQTT_PUBLISH_REF */
+  if (gen != NULL) {
+    mqtt_output_append_gen(&client->output, payload_length, gen, gen_arg);
+  } else
   /* Append optional publish payload */
   if ((payload != NULL) && (payload_length > 0)) {
     mqtt_output_append_buf(&client->output, payload, payload_length);
   }
 
   mqtt_append_request(&client->pend_req_queue, r);
+#if MQTT_PUBLISH_BATCH
+  mqtt_output_send_batched(client);
+#else
   mqtt_output_send(&client->output, client->conn);
+#endif /* MQTT_PUBLISH_BATCH */
   return ERR_OK;
 }
 
+/**
+ * @ingroup mqtt
+ * MQTT publish function.
+ * @param client MQTT client
+ * @param topic Publish topic string
+ * @param payload Data to publish (NULL is allowed)
+ * @param payload_length Length of payload (0 is allowed)
+ * @param qos Quality of service, 0 1 or 2
+ * @param retain MQTT retain flag
+ * @param cb Callback to call when publish is complete or has timed out
+ * @param arg User supplied argument to publish callback
+ * @return ERR_OK if successful
+ *         ERR_CONN if client is disconnected
+ *         ERR_MEM if short on memory
+ */
+err_t
+mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_t payload_length, u8_t qos, u8_t retain,
+             mqtt_request_cb_t cb, void *arg)
+{
+  return mqtt_publish_msg(client, topic, payload, payload_length, qos, retain, NULL, NULL, NULL, cb, arg);
+}
+
+/**
+ * @ingroup mqtt
+ * ETH_CODE: MQTT publish with the payload written by gen straight into the
+ * output ring-buffer, e.g. an encoder of a fixed telemetry struct (see
+ * component/telemetry/telemetry_cbor.h). gen is called once, before this
+ * returns, and must write payload_length bytes with mqtt_payload_write().
+ * @param client MQTT client
+ * @param topic Publish topic string
+ * @param payload_length Length of payload gen writes
+ * @param gen Payload generator
+ * @param gen_arg Argument to gen
+ * @param qos Quality of service, 0 1 or 2
+ * @param retain MQTT retain flag
+ * @param cb Callback to call when publish is complete or has timed out
+ * @param arg User supplied argument to publish callback
+ * @return ERR_OK if successful
+ *         ERR_CONN if client is disconnected
+ *         ERR_MEM if short on memory, gen is not called then
+ */
+err_t
+mqtt_publish_gen(mqtt_client_t *client, const char *topic, u16_t payload_length, mqtt_payload_gen_t gen,
+                 void *gen_arg, u8_t qos, u8_t retain, mqtt_request_cb_t cb, void *arg)
+{
+  LWIP_ASSERT("mqtt_publish_gen: gen != NULL", gen != NULL);
+  return mqtt_publish_msg(client, topic, NULL, payload_length, qos, retain, NULL, gen, gen_arg, cb, arg);
+}
+
+#if MQTT_PUBLISH_REF
+/**
+ * @ingroup mqtt
+ * ETH_CODE: MQTT publish without copying the payload. Only the header goes
+ * to the output ring-buffer; the payload is sent from its buffer with
+ * tcp_write_ref(), so many large messages can be in flight.
+ * On ERR_OK the initial reference of ref passes to MQTT: do not call
+ * tcp_txref_release() for it. ref->done is called once neither MQTT nor
+ * TCP references the payload any more (acked, or connection closed);
+ * until then it must not change. One ref per call. On error ref is unused.
+ * @param client MQTT client
+ * @param topic Publish topic string
+ * @param payload Data to publish (NULL is allowed)
+ * @param payload_length Length of payload (0 is allowed)
+ * @param qos Quality of service, 0 1 or 2
+ * @param retain MQTT retain flag
+ * @param ref Reference prepared with tcp_txref_init()
+ * @param cb Callback to call when publish is complete or has timed out
+ * @param arg User supplied argument to publish callback
+ * @return ERR_OK if successful
+ *         ERR_CONN if client is disconnected
+ *         ERR_MEM if short on memory, or MQTT_PUBLISH_REF_MAX payloads queued
+ */
+err_t
+mqtt_publish_ref(mqtt_client_t *client, const char *topic, const void *payload, u16_t payload_length, u8_t qos,
+                 u8_t retain, struct tcp_txref *ref, mqtt_request_cb_t cb, void *arg)
+{
+  LWIP_ASSERT("mqtt_publish_ref: ref != NULL", ref != NULL);
+  return mqtt_publish_msg(client, topic, payload, payload_length, qos, retain, ref, NULL, NULL, cb, arg);
+}
+#endif /* MQTT_PUBLISH_REF */
+
 
 /**
  * @ingroup mqtt
@@ -1188,6 +1812,10 @@ mqtt_sub_unsub(mqtt_client_t *client, const char *topic, u8_t qos, mqtt_request_
   topic_len = (u16_t)topic_strlen;
   /* Topic string, pkt_id, qos for subscribe */
   total_len =  topic_len + 2 + 2 + (sub != 0);
+#if MQTT_V5
+  /* ETH_CODE: empty properties */
+  total_len += 1;
+#endif /* MQTT_V5 */
   LWIP_ERROR("mqtt_sub_unsub: total length overflow", (total_len <= 0xFFFF), return ERR_ARG);
   remaining_length = (u16_t)total_len;
 
@@ -1203,7 +1831,7 @@ mqtt_sub_unsub(mqtt_client_t *client, const char *topic, u8_t qos, mqtt_request_
     return ERR_MEM;
   }
 
-  if (mqtt_output_check_space(&client->output, remaining_length) == 0) {
+  if (mqtt_output_check_space(&client->output, remaining_length, 0) == 0) {
     mqtt_delete_request(r);
     return ERR_MEM;
   }
@@ -1213,6 +1841,9 @@ mqtt_sub_unsub(mqtt_client_t *client, const char *topic, u8_t qos, mqtt_request_
   mqtt_output_append_fixed_header(&client->output, sub ? MQTT_MSG_TYPE_SUBSCRIBE : MQTT_MSG_TYPE_UNSUBSCRIBE, 0, 1, 0, remaining_length);
   /* Packet id */
   mqtt_output_append_u16(&client->output, pkt_id);
+#if MQTT_V5
+  mqtt_output_append_u8(&client->output, 0);
+#endif /* MQTT_V5 */
   /* Topic */
   mqtt_output_append_string(&client->output, topic, topic_len);
   /* QoS */
@@ -1288,6 +1919,10 @@ mqtt_client_connect(mqtt_client_t *client, const ip_addr_t *ip_addr, u16_t port,
   u16_t client_id_length;
   /* Length is the sum of 2+"MQTT", protocol level, flags and keep alive */
   u16_t remaining_length = 2 + 4 + 1 + 1 + 2;
+#if MQTT_V5
+  /* ETH_CODE: and empty properties */
+  remaining_length += 1;
+#endif /* MQTT_V5 */
   u8_t flags = 0, will_topic_len = 0, will_msg_len = 0;
   u16_t client_user_len = 0, client_pass_len = 0;
 
@@ -1307,6 +1942,9 @@ mqtt_client_connect(mqtt_client_t *client, const ip_addr_t *ip_addr, u16_t port,
   client->connect_arg = arg;
   client->connect_cb = cb;
   client->keep_alive = client_info->keep_alive;
+#if MQTT_PUBLISH_BATCH
+  client->batch_ms = client_info->publish_batch_ms;
+#endif /* MQTT_PUBLISH_BATCH */
   mqtt_init_requests(client->req_list, LWIP_ARRAYSIZE(client->req_list));
 
   /* Build connect message */
@@ -1324,6 +1962,10 @@ mqtt_client_connect(mqtt_client_t *client, const ip_addr_t *ip_addr, u16_t port,
     LWIP_ERROR("mqtt_client_connect: client_info->will_msg length overflow", len <= 0xFF, return ERR_VAL);
     will_msg_len = (u8_t)len;
     len = remaining_length + 2 + will_topic_len + 2 + will_msg_len;
+#if MQTT_V5
+    /* ETH_CODE: empty will properties */
+    len += 1;
+#endif /* MQTT_V5 */
     LWIP_ERROR("mqtt_client_connect: remaining_length overflow", len <= 0xFFFF, return ERR_VAL);
     remaining_length = (u16_t)len;
   }
@@ -1358,7 +2000,7 @@ mqtt_client_connect(mqtt_client_t *client, const ip_addr_t *ip_addr, u16_t port,
   LWIP_ERROR("mqtt_client_connect: remaining_length overflow", len <= 0xFFFF, return ERR_VAL);
   remaining_length = (u16_t)len;
 
-  if (mqtt_output_check_space(&client->output, remaining_length) == 0) {
+  if (mqtt_output_check_space(&client->output, remaining_length, 0) == 0) {
     return ERR_MEM;
   }
 
@@ -1399,15 +2041,26 @@ mqtt_client_connect(mqtt_client_t *client, const ip_addr_t *ip_addr, u16_t port,
   /* Append Protocol string */
   mqtt_output_append_string(&client->output, "MQTT", 4);
   /* Append Protocol level */
+#if MQTT_V5
+  mqtt_output_append_u8(&client->output, 5);
+#else
   mqtt_output_append_u8(&client->output, 4);
+#endif /* MQTT_V5 */
   /* Append connect flags */
   mqtt_output_append_u8(&client->output, flags);
   /* Append keep-alive */
   mqtt_output_append_u16(&client->output, client_info->keep_alive);
+#if MQTT_V5
+  /* ETH_CODE: no properties, so no topic aliases from the server */
+  mqtt_output_append_u8(&client->output, 0);
+#endif /* MQTT_V5 */
   /* Append client id */
   mqtt_output_append_string(&client->output, client_info->client_id, client_id_length);
   /* Append will message if used */
   if ((flags & MQTT_CONNECT_FLAG_WILL) != 0) {
+#if MQTT_V5
+    mqtt_output_append_u8(&client->output, 0);
+#endif /* MQTT_V5 */
     mqtt_output_append_string(&client->output, client_info->will_topic, will_topic_len);
     mqtt_output_append_string(&client->output, client_info->will_msg, will_msg_len);
   }
@@ -112,6 +112,11 @@ static u16_t dns_txid;
 #define DNS_PORT_ALLOWED(port) ((port) >= 1024)
 #endif
 
+/* ETH_CODE: prefetch, see lwipopts.h; 0 leaves the table as upstream */
+#ifndef DNS_PREFETCH_S
+#define DNS_PREFETCH_S            0
+#endif
+
 /** DNS resource record max. TTL (one week as default) */
 #ifndef DNS_MAX_TTL
 #define DNS_MAX_TTL               604800
@@ -236,6 +241,13 @@ struct dns_table_entry {
 #if LWIP_DNS_SUPPORT_MDNS_QUERIES
   u8_t is_mdns;
 #endif
+#if DNS_PREFETCH_S
+  /** ETH_CODE: TTL of the last answer; looked up since; asked again while
+   * the last answer still serves */
+  u32_t ttl_full;
+  u8_t used;
+  u8_t refresh;
+#endif
 };
 
 /** DNS request table entry: used when dns_gehostbyname cannot answer the
@@ -615,7 +627,12 @@ dns_lookup(const char *name, ip_addr_t *addr LWIP_DNS_ADDRTYPE_ARG(u8_t dns_addr
 
   /* Walk through name list, return entry if found. If not, return NULL. */
   for (i = 0; i < DNS_TABLE_SIZE; ++i) {
-    if ((dns_table[i].state == DNS_STATE_DONE) &&
+    if (((dns_table[i].state == DNS_STATE_DONE)
+#if DNS_PREFETCH_S
+         /* ETH_CODE: the previous answer serves until its TTL runs out */
+         || ((dns_table[i].state == DNS_STATE_ASKING) && dns_table[i].refresh && (dns_table[i].ttl > 0))
+#endif
+        ) &&
         (lwip_strnicmp(name, dns_table[i].name, sizeof(dns_table[i].name)) == 0) &&
         LWIP_DNS_ADDRTYPE_MATCH_IP(dns_addrtype, dns_table[i].ipaddr)) {
       LWIP_DEBUGF(DNS_DEBUG, ("dns_lookup: \"%s\": found = ", name));
@@ -624,6 +641,9 @@ dns_lookup(const char *name, ip_addr_t *addr LWIP_DNS_ADDRTYPE_ARG(u8_t dns_addr
       if (addr) {
         ip_addr_copy(*addr, dns_table[i].ipaddr);
       }
+#if DNS_PREFETCH_S
+      dns_table[i].used = 1;
+#endif
       return ERR_OK;
     }
   }
@@ -1034,6 +1054,37 @@ dns_backupserver_available(struct dns_table_entry *pentry)
   return ret;
 }
 
+#if DNS_PREFETCH_S
+/* ETH_CODE: asks again for an answer that was looked up since it came in,
+ * while it still serves; the entry goes back to DONE if no answer comes
+ * before its TTL runs out. */
+static void
+dns_refresh_entry(u8_t i)
+{
+  struct dns_table_entry *entry = &dns_table[i];
+
+#if ((LWIP_DNS_SECURE & LWIP_DNS_SECURE_RAND_SRC_PORT) != 0)
+  entry->pcb_idx = dns_alloc_pcb();
+  if (entry->pcb_idx >= DNS_MAX_SOURCE_PORTS) {
+    /* tried again on the next timer */
+    return;
+  }
+#endif
+  LWIP_DEBUGF(DNS_DEBUG, ("dns_refresh_entry: \"%s\": %"U32_F" s left\n", entry->name, entry->ttl));
+  entry->used = 0;
+  entry->refresh = 1;
+  entry->seqno = dns_seqno++;
+  entry->txid = dns_create_txid();
+  entry->state = DNS_STATE_ASKING;
+  entry->server_idx = 0;
+  entry->tmr = 1;
+  entry->retries = 0;
+  if (dns_send(i) != ERR_OK) {
+    LWIP_DEBUGF(DNS_DEBUG | LWIP_DBG_LEVEL_WARNING, ("dns_refresh_entry: send failed\n"));
+  }
+}
+#endif /* DNS_PREFETCH_S */
+
 /**
  * dns_check_entry() - see if entry has not yet been queried and, if so, sends out a query.
  * Check an entry in the dns_table:
@@ -1068,6 +1119,11 @@ dns_check_entry(u8_t i)
       }
       break;
     case DNS_STATE_ASKING:
+#if DNS_PREFETCH_S
+      if (entry->refresh && (entry->ttl > 0)) {
+        entry->ttl--;
+      }
+#endif
       if (--entry->tmr == 0) {
         if (++entry->retries == DNS_MAX_RETRIES) {
           if (dns_backupserver_available(entry)
@@ -1085,6 +1141,13 @@ dns_check_entry(u8_t i)
             dns_call_found(i, NULL);
             /* flush this entry */
             entry->state = DNS_STATE_UNUSED;
+#if DNS_PREFETCH_S
+            /* ETH_CODE: a failed refresh keeps the answer until its TTL */
+            if (entry->refresh && (entry->ttl > 0)) {
+              entry->state = DNS_STATE_DONE;
+            }
+            entry->refresh = 0;
+#endif
             break;
           }
         } else {
@@ -1107,6 +1170,14 @@ dns_check_entry(u8_t i)
         /* flush this entry, there cannot be any related pending entries in this state */
         entry->state = DNS_STATE_UNUSED;
       }
+#if DNS_PREFETCH_S
+      /* ETH_CODE: ask again ahead of the expiry, by an eighth of the TTL
+       * plus DNS_PREFETCH_S (a query with its retries), at most half */
+      else if (entry->used &&
+               (entry->ttl <= LWIP_MIN(entry->ttl_full / 2, entry->ttl_full / 8 + DNS_PREFETCH_S))) {
+        dns_refresh_entry(i);
+      }
+#endif
       break;
     case DNS_STATE_UNUSED:
       /* nothing to do */
@@ -1149,6 +1220,10 @@ dns_correct_response(u8_t idx, u32_t ttl)
   if (entry->ttl > DNS_MAX_TTL) {
     entry->ttl = DNS_MAX_TTL;
   }
+#if DNS_PREFETCH_S
+  entry->ttl_full = entry->ttl;
+  entry->refresh = 0;
+#endif
   dns_call_found(idx, &entry->ipaddr);
 
   if (entry->ttl == 0) {
@@ -1469,6 +1544,10 @@ dns_enqueue(const char *name, size_t hostnamelen, dns_found_callback found,
   /* fill the entry */
   entry->state = DNS_STATE_NEW;
   entry->seqno = dns_seqno;
+#if DNS_PREFETCH_S
+  entry->used = 0;
+  entry->refresh = 0;
+#endif
   LWIP_DNS_SET_ADDRTYPE(entry->reqaddrtype, dns_addrtype);
   LWIP_DNS_SET_ADDRTYPE(req->reqaddrtype, dns_addrtype);
   req->found = found;
@@ -237,6 +237,13 @@ PACK_STRUCT_END
 #error "NETCONN_MORE != TCP_WRITE_FLAG_MORE"
 #endif
 #endif /* LWIP_NETCONN && LWIP_TCP */
+/* ETH_CODE: the receive buffer range of RECV_BUFSIZE_AUTOTUNE */
+#if RECV_BUFSIZE_AUTOTUNE && !LWIP_SO_RCVBUF
+#error "RECV_BUFSIZE_AUTOTUNE needs LWIP_SO_RCVBUF"
+#endif
+#if RECV_BUFSIZE_AUTOTUNE && ((RECV_BUFSIZE_MIN <= 0) || (RECV_BUFSIZE_MAX < RECV_BUFSIZE_MIN) || (RECV_BUFSIZE_MAX > INT_MAX / 2))
+#error "RECV_BUFSIZE_AUTOTUNE needs 0 < RECV_BUFSIZE_MIN <= RECV_BUFSIZE_MAX <= INT_MAX / 2"
+#endif
 #if LWIP_SOCKET
 #endif /* LWIP_SOCKET */
 
@@ -308,6 +315,10 @@ PACK_STRUCT_END
 #if TCP_SNDLOWAT >= (0xFFFF - (4 * TCP_MSS))
 #error "lwip_sanity_check: WARNING: TCP_SNDLOWAT must at least be 4*MSS below u16_t overflow!"
 #endif
+/* ETH_CODE: the per-pcb send buffer limits of TCP_SND_AUTOTUNE */
+#if TCP_SND_AUTOTUNE && ((TCP_SND_BUF_MIN < (2 * TCP_MSS)) || (TCP_SND_BUF_MAX < TCP_SND_BUF_MIN))
+#error "lwip_sanity_check: WARNING: TCP_SND_AUTOTUNE needs 2 * TCP_MSS <= TCP_SND_BUF_MIN <= TCP_SND_BUF_MAX. If you know what you are doing, define LWIP_DISABLE_TCP_SANITY_CHECKS to 1 to disable this error."
+#endif
 #if TCP_SNDQUEUELOWAT >= TCP_SND_QUEUELEN
 #error "lwip_sanity_check: WARNING: TCP_SNDQUEUELOWAT must be less than TCP_SND_QUEUELEN. If you know what you are doing, define LWIP_DISABLE_TCP_SANITY_CHECKS to 1 to disable this error."
 #endif
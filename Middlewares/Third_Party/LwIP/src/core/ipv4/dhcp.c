@@ -91,6 +91,10 @@
 #ifndef LWIP_HOOK_DHCP_PARSE_OPTION
 #define LWIP_HOOK_DHCP_PARSE_OPTION(netif, dhcp, state, msg, msg_type, option, len, pbuf, offset) do { LWIP_UNUSED_ARG(msg); } while(0)
 #endif
+/* ETH_CODE: see opt.h */
+#ifndef LWIP_HOOK_DHCP_LEASE
+#define LWIP_HOOK_DHCP_LEASE(netif, dhcp)
+#endif
 
 /** DHCP_CREATE_RAND_XID: if this is set to 1, the xid is created using
  * LWIP_RAND() (this overrides DHCP_GLOBAL_XID)
@@ -149,6 +153,10 @@ enum dhcp_option_idx {
   DHCP_OPTION_IDX_NTP_SERVER,
   DHCP_OPTION_IDX_NTP_SERVER_LAST = DHCP_OPTION_IDX_NTP_SERVER + LWIP_DHCP_MAX_NTP_SERVERS - 1,
 #endif /* LWIP_DHCP_GET_NTP_SRV */
+#if LWIP_DHCP_RAPID_COMMIT
+  /* ETH_CODE: given, no value */
+  DHCP_OPTION_IDX_RAPID_COMMIT,
+#endif /* LWIP_DHCP_RAPID_COMMIT */
   DHCP_OPTION_IDX_MAX
 };
 
@@ -285,6 +293,8 @@ dhcp_handle_nak(struct netif *netif)
   dhcp_set_state(dhcp, DHCP_STATE_BACKING_OFF);
   /* remove IP address from interface (must no longer be used, as per RFC2131) */
   netif_set_addr(netif, IP4_ADDR_ANY4, IP4_ADDR_ANY4, IP4_ADDR_ANY4);
+  /* ETH_CODE: a kept copy of the lease is stale */
+  LWIP_HOOK_DHCP_LEASE(netif, dhcp);
   /* We can immediately restart discovery */
   dhcp_discover(netif);
 }
@@ -733,8 +743,14 @@ void dhcp_cleanup(struct netif *netif)
  * - ERR_OK - No error
  * - ERR_MEM - Out of memory
  */
+#if LWIP_DHCP_INIT_REBOOT
+/* ETH_CODE: dhcp_start() and dhcp_start_reboot(); addr NULL to discover */
+static err_t
+dhcp_start_addr(struct netif *netif, const ip4_addr_t *addr, u32_t lease_left)
+#else /* LWIP_DHCP_INIT_REBOOT */
 err_t
 dhcp_start(struct netif *netif)
+#endif /* LWIP_DHCP_INIT_REBOOT */
 {
   struct dhcp *dhcp;
   err_t result;
@@ -784,6 +800,25 @@ dhcp_start(struct netif *netif)
   }
   dhcp->pcb_allocated = 1;
 
+#if LWIP_DHCP_INIT_REBOOT
+  if (addr != NULL) {
+    u32_t timeout;
+    ip4_addr_copy(dhcp->offered_ip_addr, *addr);
+    /* what is left of the lease runs out like a bound one, see dhcp_coarse_tmr() */
+    if (lease_left != 0) {
+      timeout = (lease_left + DHCP_COARSE_TIMER_SECS / 2) / DHCP_COARSE_TIMER_SECS;
+      dhcp->t0_timeout = (u16_t)LWIP_MAX(1, LWIP_MIN(timeout, 0xffff));
+    }
+    if (!netif_is_link_up(netif)) {
+      /* dhcp_network_changed() calls dhcp_reboot() */
+      dhcp_set_state(dhcp, DHCP_STATE_REBOOTING);
+      return ERR_OK;
+    }
+    dhcp_reboot(netif);
+    return ERR_OK;
+  }
+#endif /* LWIP_DHCP_INIT_REBOOT */
+
   if (!netif_is_link_up(netif)) {
     /* set state INIT and wait for dhcp_network_changed() to call dhcp_discover() */
     dhcp_set_state(dhcp, DHCP_STATE_INIT);
@@ -800,6 +835,38 @@ dhcp_start(struct netif *netif)
   return result;
 }
 
+#if LWIP_DHCP_INIT_REBOOT
+err_t
+dhcp_start(struct netif *netif)
+{
+  return dhcp_start_addr(netif, NULL, 0);
+}
+
+/**
+ * @ingroup dhcp4
+ * ETH_CODE: Start DHCP in INIT-REBOOT: ask for an address remembered from
+ * an earlier lease (RFC 2131 3.2) instead of discovering.
+ *
+ * The server confirms it with an ACK and the lease is bound after a single
+ * exchange; a NAK restarts discovery; without an answer discovery starts
+ * after REBOOT_TRIES requests. The netif may already hold the address
+ * while the lease lasts (RFC 2131 3.7); it is then removed after
+ * lease_left seconds unless a server renewed it. 0 leaves that to the
+ * caller.
+ *
+ * @param netif The lwIP network interface
+ * @param addr the address of the earlier lease
+ * @param lease_left seconds left of that lease, 0 if not known
+ * @return lwIP error code
+ */
+err_t
+dhcp_start_reboot(struct netif *netif, const ip4_addr_t *addr, u32_t lease_left)
+{
+  LWIP_ERROR("addr != NULL", (addr != NULL), return ERR_ARG;);
+  return dhcp_start_addr(netif, addr, lease_left);
+}
+#endif /* LWIP_DHCP_INIT_REBOOT */
+
 /**
  * @ingroup dhcp4
  * Inform a DHCP server of our manual configuration.
@@ -1004,6 +1071,10 @@ dhcp_discover(struct netif *netif)
     for (i = 0; i < LWIP_ARRAYSIZE(dhcp_discover_request_options); i++) {
       options_out_len = dhcp_option_byte(options_out_len, msg_out->options, dhcp_discover_request_options[i]);
     }
+#if LWIP_DHCP_RAPID_COMMIT
+    /* ETH_CODE: an ACK right away is welcome */
+    options_out_len = dhcp_option(options_out_len, msg_out->options, DHCP_OPTION_RAPID_COMMIT, 0);
+#endif /* LWIP_DHCP_RAPID_COMMIT */
     LWIP_HOOK_DHCP_APPEND_OPTIONS(netif, dhcp, DHCP_STATE_SELECTING, msg_out, DHCP_DISCOVER, &options_out_len);
     dhcp_option_trailer(options_out_len, msg_out->options, p_out);
 
@@ -1138,6 +1209,8 @@ dhcp_bind(struct netif *netif)
 
   netif_set_addr(netif, &dhcp->offered_ip_addr, &sn_mask, &gw_addr);
   /* interface is used by routing now that an address is set */
+  /* ETH_CODE: see opt.h */
+  LWIP_HOOK_DHCP_LEASE(netif, dhcp);
 }
 
 /**
@@ -1633,6 +1706,13 @@ again:
         LWIP_ERROR("len == 4", len == 4, return ERR_VAL;);
         decode_idx = DHCP_OPTION_IDX_T2;
         break;
+#if LWIP_DHCP_RAPID_COMMIT
+      case (DHCP_OPTION_RAPID_COMMIT):
+        /* ETH_CODE: nothing to decode, only noted */
+        LWIP_ERROR("len == 0", len == 0, return ERR_VAL;);
+        dhcp_got_option(dhcp, DHCP_OPTION_IDX_RAPID_COMMIT);
+        break;
+#endif /* LWIP_DHCP_RAPID_COMMIT */
       default:
         decode_len = 0;
         LWIP_DEBUGF(DHCP_DEBUG, ("skipping option %"U16_F" in options\n", (u16_t)op));
@@ -1822,8 +1902,22 @@ dhcp_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr,
   /* message type is DHCP ACK? */
   if (msg_type == DHCP_ACK) {
     LWIP_DEBUGF(DHCP_DEBUG | LWIP_DBG_TRACE, ("DHCP_ACK received\n"));
+#if LWIP_DHCP_RAPID_COMMIT || LWIP_DHCP_INIT_REBOOT
+    /* ETH_CODE: without an OFFER before it (rapid commit, INIT-REBOOT) the
+     * ACK is the only message naming the server, which renewals go to */
+    if (dhcp_option_given(dhcp, DHCP_OPTION_IDX_SERVER_ID) &&
+        ((dhcp->state == DHCP_STATE_SELECTING) || (dhcp->state == DHCP_STATE_REBOOTING))) {
+      ip_addr_set_ip4_u32(&dhcp->server_ip_addr, lwip_htonl(dhcp_get_option_value(dhcp, DHCP_OPTION_IDX_SERVER_ID)));
+    }
+#endif /* LWIP_DHCP_RAPID_COMMIT || LWIP_DHCP_INIT_REBOOT */
     /* in requesting state? */
+#if LWIP_DHCP_RAPID_COMMIT
+    /* ETH_CODE: or the rapid commit ACK to our DISCOVER */
+    if ((dhcp->state == DHCP_STATE_REQUESTING) ||
+        ((dhcp->state == DHCP_STATE_SELECTING) && dhcp_option_given(dhcp, DHCP_OPTION_IDX_RAPID_COMMIT))) {
+#else /* LWIP_DHCP_RAPID_COMMIT */
     if (dhcp->state == DHCP_STATE_REQUESTING) {
+#endif /* LWIP_DHCP_RAPID_COMMIT */
       dhcp_handle_ack(netif, msg_in);
 #if DHCP_DOES_ARP_CHECK
       if ((netif->flags & NETIF_FLAG_ETHARP) != 0) {
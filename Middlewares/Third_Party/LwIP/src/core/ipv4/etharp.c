@@ -54,6 +54,9 @@
 #include "lwip/autoip.h"
 #include "lwip/prot/iana.h"
 #include "netif/ethernet.h"
+#if UDP_TPL
+#include "lwip/udp.h"
+#endif /* UDP_TPL */
 
 #include <string.h>
 
@@ -87,6 +90,11 @@ enum etharp_state {
 #endif /* ETHARP_SUPPORT_STATIC_ENTRIES */
 };
 
+/* ETH_CODE: 1 finds entries through hash chains, see lwipopts.h */
+#ifndef ETHARP_HASH
+#define ETHARP_HASH 0
+#endif
+
 struct etharp_entry {
 #if ARP_QUEUEING
   /** Pointer to queue of pending outgoing packets on this ARP entry. */
@@ -100,10 +108,50 @@ struct etharp_entry {
   struct eth_addr ethaddr;
   u16_t ctime;
   u8_t state;
+#if ETHARP_HASH
+  /** ETH_CODE: next entry + 1 in the same hash bucket, 0 ends the chain */
+  netif_addr_idx_t hnext;
+#endif /* ETHARP_HASH */
+#if ETHARP_REFRESH || ETHARP_PIN_MAX
+  /** ETH_CODE: ETHARP_ENTRY_USED, ETHARP_ENTRY_PINNED */
+  u8_t eflags;
+#endif /* ETHARP_REFRESH || ETHARP_PIN_MAX */
 };
 
 static struct etharp_entry arp_table[ARP_TABLE_SIZE];
 
+#if ETHARP_REFRESH || ETHARP_PIN_MAX
+/* ETH_CODE: etharp_entry.eflags; cleared with the entry */
+#define ETHARP_ENTRY_USED     0x01U   /* traffic since last confirmed */
+#define ETHARP_ENTRY_PINNED   0x02U   /* etharp_pin() */
+#define ETHARP_SET_USED(i)    (arp_table[i].eflags |= ETHARP_ENTRY_USED)
+#define ETHARP_IS_PINNED(i)   ((arp_table[i].eflags & ETHARP_ENTRY_PINNED) != 0)
+#else
+#define ETHARP_SET_USED(i)
+#define ETHARP_IS_PINNED(i)   0
+#endif /* ETHARP_REFRESH || ETHARP_PIN_MAX */
+
+#if ETHARP_PIN_MAX
+/* ETH_CODE: pinned addresses, ipaddr any for a free slot. The netif is
+ * kept by index: it may go away while the pin stays. */
+static struct {
+  ip4_addr_t ipaddr;
+  u8_t netif_idx;
+} etharp_pins[ETHARP_PIN_MAX];
+#endif /* ETHARP_PIN_MAX */
+
+#if ETHARP_HASH
+/* ETH_CODE: hash chains over arp_table, see ETHARP_HASH in lwipopts.h */
+#ifndef ETHARP_HASH_SIZE
+#define ETHARP_HASH_SIZE 64
+#endif
+#if (ETHARP_HASH_SIZE & (ETHARP_HASH_SIZE - 1)) != 0
+#error "ETHARP_HASH_SIZE must be a power of 2"
+#endif
+/** first entry + 1 of each bucket, 0 for an empty bucket */
+static netif_addr_idx_t etharp_hash_head[ETHARP_HASH_SIZE];
+#endif /* ETHARP_HASH */
+
 #if !LWIP_NETIF_HWADDRHINT
 static netif_addr_idx_t etharp_cached_entry;
 #endif /* !LWIP_NETIF_HWADDRHINT */
@@ -129,8 +177,67 @@ static netif_addr_idx_t etharp_cached_entry;
 #error "ARP_TABLE_SIZE must fit in an s16_t, you have to reduce it in your lwipopts.h"
 #endif
 
+#if ETHARP_HASH
+/* ETH_CODE: Fibonacci hash; the host part of the address sits in the
+ * last bytes, which the multiply spreads into the top bits taken. */
+static u32_t
+etharp_hash_bucket(const ip4_addr_t *ipaddr)
+{
+  u32_t h = lwip_ntohl(ip4_addr_get_u32(ipaddr)) * 2654435761UL;
+  return h >> 16 & (ETHARP_HASH_SIZE - 1);
+}
+
+/* ETH_CODE: chain entry i into the bucket of its (just set) address */
+static void
+etharp_hash_insert(s16_t i)
+{
+  u32_t b = etharp_hash_bucket(&arp_table[i].ipaddr);
+  arp_table[i].hnext = etharp_hash_head[b];
+  etharp_hash_head[b] = (netif_addr_idx_t)(i + 1);
+}
+
+/* ETH_CODE: unchain entry i, if it is chained, before its address changes */
+static void
+etharp_hash_remove(s16_t i)
+{
+  netif_addr_idx_t *link = &etharp_hash_head[etharp_hash_bucket(&arp_table[i].ipaddr)];
+  while (*link != 0) {
+    if (*link == (netif_addr_idx_t)(i + 1)) {
+      *link = arp_table[i].hnext;
+      arp_table[i].hnext = 0;
+      return;
+    }
+    link = &arp_table[*link - 1].hnext;
+  }
+}
+
+/* ETH_CODE: pending or stable entry for ipaddr (on netif, NULL matching
+ * any, with ETHARP_TABLE_MATCH_NETIF), -1 if there is none */
+static s16_t
+etharp_hash_find(const ip4_addr_t *ipaddr, struct netif *netif)
+{
+  netif_addr_idx_t n = etharp_hash_head[etharp_hash_bucket(ipaddr)];
+  LWIP_UNUSED_ARG(netif);
+  while (n != 0) {
+    struct etharp_entry *e = &arp_table[n - 1];
+    if ((e->state != ETHARP_STATE_EMPTY) && ip4_addr_cmp(ipaddr, &e->ipaddr)
+#if ETHARP_TABLE_MATCH_NETIF
+        && ((netif == NULL) || (netif == e->netif))
+#endif /* ETHARP_TABLE_MATCH_NETIF */
+       ) {
+      return (s16_t)(n - 1);
+    }
+    n = e->hnext;
+  }
+  return -1;
+}
+#endif /* ETHARP_HASH */
+
 
 static err_t etharp_request_dst(struct netif *netif, const ip4_addr_t *ipaddr, const struct eth_addr *hw_dst_addr);
+#if ETHARP_PIN_MAX
+static void etharp_pin_apply(int k);
+#endif /* ETHARP_PIN_MAX */
 static err_t etharp_raw(struct netif *netif,
                         const struct eth_addr *ethsrc_addr, const struct eth_addr *ethdst_addr,
                         const struct eth_addr *hwsrc_addr, const ip4_addr_t *ipsrc_addr,
@@ -169,6 +276,16 @@ etharp_free_entry(int i)
 {
   /* remove from SNMP ARP index tree */
   mib2_remove_arp_entry(arp_table[i].netif, &arp_table[i].ipaddr);
+#if ETHARP_HASH
+  /* ETH_CODE: no longer found by address */
+  etharp_hash_remove((s16_t)i);
+#endif /* ETHARP_HASH */
+#if UDP_TPL
+  /* ETH_CODE: a template may hold its address */
+  if (arp_table[i].state >= ETHARP_STATE_STABLE) {
+    UDP_TPL_INVALIDATE();
+  }
+#endif /* UDP_TPL */
   /* and empty packet queue */
   if (arp_table[i].q != NULL) {
     /* remove all queued packets */
@@ -178,6 +295,9 @@ etharp_free_entry(int i)
   }
   /* recycle entry for re-use */
   arp_table[i].state = ETHARP_STATE_EMPTY;
+#if ETHARP_REFRESH || ETHARP_PIN_MAX
+  arp_table[i].eflags = 0;
+#endif /* ETHARP_REFRESH || ETHARP_PIN_MAX */
 #ifdef LWIP_DEBUG
   /* for debugging, clean out the complete entry */
   arp_table[i].ctime = 0;
@@ -208,9 +328,16 @@ etharp_tmr(void)
 #endif /* ETHARP_SUPPORT_STATIC_ENTRIES */
        ) {
       arp_table[i].ctime++;
-      if ((arp_table[i].ctime >= ARP_MAXAGE) ||
-          ((arp_table[i].state == ETHARP_STATE_PENDING)  &&
-           (arp_table[i].ctime >= ARP_MAXPENDING))) {
+#if ETHARP_PIN_MAX
+      /* ETH_CODE: pinned entries do not expire, they stay due for refresh */
+      if (ETHARP_IS_PINNED(i) && (arp_table[i].ctime > ARP_MAXAGE)) {
+        arp_table[i].ctime = ARP_MAXAGE;
+      }
+#endif /* ETHARP_PIN_MAX */
+      if (!ETHARP_IS_PINNED(i) &&
+          ((arp_table[i].ctime >= ARP_MAXAGE) ||
+           ((arp_table[i].state == ETHARP_STATE_PENDING)  &&
+            (arp_table[i].ctime >= ARP_MAXPENDING)))) {
         /* pending or stable entry has become old! */
         LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_timer: expired %s entry %d.\n",
                                    arp_table[i].state >= ETHARP_STATE_STABLE ? "stable" : "pending", i));
@@ -227,8 +354,33 @@ etharp_tmr(void)
         /* still pending, resend an ARP query */
         etharp_request(arp_table[i].netif, &arp_table[i].ipaddr);
       }
+#if ETHARP_REFRESH
+      /* ETH_CODE: renew an entry in use before it expires, see
+       * ETHARP_REFRESH; at most one request every 2 seconds as above */
+      else if ((arp_table[i].state == ETHARP_STATE_STABLE) &&
+               ((arp_table[i].eflags & (ETHARP_ENTRY_USED | ETHARP_ENTRY_PINNED)) != 0) &&
+               (arp_table[i].ctime >= (ARP_MAXAGE - ETHARP_REFRESH))) {
+        err_t err;
+        if (arp_table[i].ctime >= (ARP_MAXAGE - ETHARP_REFRESH / 2)) {
+          err = etharp_request(arp_table[i].netif, &arp_table[i].ipaddr);
+        } else {
+          err = etharp_request_dst(arp_table[i].netif, &arp_table[i].ipaddr, &arp_table[i].ethaddr);
+        }
+        if (err == ERR_OK) {
+          arp_table[i].state = ETHARP_STATE_STABLE_REREQUESTING_1;
+        }
+      }
+#endif /* ETHARP_REFRESH */
+    }
+  }
+#if ETHARP_PIN_MAX
+  /* ETH_CODE: pinned entries lost with their netif come back with it */
+  for (i = 0; i < ETHARP_PIN_MAX; ++i) {
+    if (!ip4_addr_isany_val(etharp_pins[i].ipaddr)) {
+      etharp_pin_apply(i);
     }
   }
+#endif /* ETHARP_PIN_MAX */
 }
 
 /**
@@ -265,6 +417,21 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
 
   LWIP_UNUSED_ARG(netif);
 
+#if ETHARP_HASH
+  /* ETH_CODE: a match is found through the hash chains; the sweep below
+   * only picks the entry to create (it cannot match any more) */
+  if (ipaddr != NULL) {
+    i = etharp_hash_find(ipaddr, netif);
+    if (i >= 0) {
+      LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_find_entry: found matching entry %d\n", (int)i));
+      return i;
+    }
+    if ((flags & ETHARP_FLAG_FIND_ONLY) != 0) {
+      return (s16_t)ERR_MEM;
+    }
+  }
+#endif /* ETHARP_HASH */
+
   /**
    * a) do a search through the cache, remember candidates
    * b) select candidate entry
@@ -300,6 +467,12 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
         /* found exact IP address match, simply bail out */
         return i;
       }
+#if ETHARP_PIN_MAX
+      /* ETH_CODE: pinned entries are never recycled */
+      if (ETHARP_IS_PINNED(i)) {
+        continue;
+      }
+#endif /* ETHARP_PIN_MAX */
       /* pending entry? */
       if (state == ETHARP_STATE_PENDING) {
         /* pending with queued packets? */
@@ -390,8 +563,15 @@ etharp_find_entry(const ip4_addr_t *ipaddr, u8_t flags, struct netif *netif)
 
   /* IP address given? */
   if (ipaddr != NULL) {
+#if ETHARP_HASH
+    /* ETH_CODE: an empty entry is normally unchained already */
+    etharp_hash_remove(i);
+#endif /* ETHARP_HASH */
     /* set IP address */
     ip4_addr_copy(arp_table[i].ipaddr, *ipaddr);
+#if ETHARP_HASH
+    etharp_hash_insert(i);
+#endif /* ETHARP_HASH */
   }
   arp_table[i].ctime = 0;
 #if ETHARP_TABLE_MATCH_NETIF
@@ -461,10 +641,20 @@ etharp_update_arp_entry(struct netif *netif, const ip4_addr_t *ipaddr, struct et
   mib2_add_arp_entry(netif, &arp_table[i].ipaddr);
 
   LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_update_arp_entry: updating stable entry %"S16_F"\n", i));
+#if UDP_TPL
+  /* ETH_CODE: a template may hold the old address */
+  if (!eth_addr_cmp(&arp_table[i].ethaddr, ethaddr)) {
+    UDP_TPL_INVALIDATE();
+  }
+#endif /* UDP_TPL */
   /* update address */
   SMEMCPY(&arp_table[i].ethaddr, ethaddr, ETH_HWADDR_LEN);
   /* reset time stamp */
   arp_table[i].ctime = 0;
+#if ETHARP_REFRESH
+  /* ETH_CODE: confirmed; refreshed again only if used again */
+  arp_table[i].eflags &= (u8_t)~ETHARP_ENTRY_USED;
+#endif /* ETHARP_REFRESH */
   /* this is where we will send out queued packets! */
 #if ARP_QUEUEING
   while (arp_table[i].q != NULL) {
@@ -550,6 +740,100 @@ etharp_remove_static_entry(const ip4_addr_t *ipaddr)
 }
 #endif /* ETHARP_SUPPORT_STATIC_ENTRIES */
 
+#if ETHARP_PIN_MAX
+/* ETH_CODE: the entry of pin k, requested if there is none, marked
+ * pinned; nothing while its netif is missing, down or without link */
+static void
+etharp_pin_apply(int k)
+{
+  struct netif *netif = netif_get_by_index(etharp_pins[k].netif_idx);
+  s16_t i;
+
+  if ((netif == NULL) || !netif_is_up(netif) || !netif_is_link_up(netif)) {
+    return;
+  }
+  i = etharp_find_entry(&etharp_pins[k].ipaddr, ETHARP_FLAG_FIND_ONLY, netif);
+  if (i < 0) {
+    /* a pending entry and a request */
+    (void)etharp_query(netif, &etharp_pins[k].ipaddr, NULL);
+    i = etharp_find_entry(&etharp_pins[k].ipaddr, ETHARP_FLAG_FIND_ONLY, netif);
+  }
+  if (i >= 0) {
+    arp_table[i].eflags |= ETHARP_ENTRY_PINNED;
+  }
+}
+
+/**
+ * ETH_CODE: Keep an address resolved, see ETHARP_PIN_MAX. A peer off the
+ * link is reached through its gateway: pin that.
+ *
+ * @param netif the netif the address is on
+ * @param ipaddr IP address on the netif's link
+ * @return ERR_OK: pinned (or already pinned)
+ *         ERR_MEM: ETHARP_PIN_MAX addresses pinned already
+ *         ERR_ARG: not a unicast address
+ */
+err_t
+etharp_pin(struct netif *netif, const ip4_addr_t *ipaddr)
+{
+  int k;
+  int free_k = -1;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ERROR("etharp_pin: invalid netif", netif != NULL, return ERR_ARG);
+  LWIP_ERROR("etharp_pin: invalid ipaddr", ipaddr != NULL, return ERR_ARG);
+
+  if (ip4_addr_isany(ipaddr) || ip4_addr_isbroadcast(ipaddr, netif) || ip4_addr_ismulticast(ipaddr)) {
+    return ERR_ARG;
+  }
+  for (k = 0; k < ETHARP_PIN_MAX; ++k) {
+    if (ip4_addr_cmp(&etharp_pins[k].ipaddr, ipaddr) &&
+        (etharp_pins[k].netif_idx == netif_get_index(netif))) {
+      return ERR_OK;
+    }
+    if ((free_k < 0) && ip4_addr_isany_val(etharp_pins[k].ipaddr)) {
+      free_k = k;
+    }
+  }
+  if (free_k < 0) {
+    return ERR_MEM;
+  }
+  ip4_addr_copy(etharp_pins[free_k].ipaddr, *ipaddr);
+  etharp_pins[free_k].netif_idx = netif_get_index(netif);
+  etharp_pin_apply(free_k);
+  return ERR_OK;
+}
+
+/**
+ * ETH_CODE: Let a pinned address expire again like any other entry.
+ *
+ * @param ipaddr the address given to etharp_pin()
+ * @return ERR_OK: unpinned
+ *         ERR_VAL: not pinned
+ */
+err_t
+etharp_unpin(const ip4_addr_t *ipaddr)
+{
+  int k;
+  s16_t i;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ERROR("etharp_unpin: invalid ipaddr", ipaddr != NULL, return ERR_ARG);
+
+  for (k = 0; k < ETHARP_PIN_MAX; ++k) {
+    if (!ip4_addr_isany_val(etharp_pins[k].ipaddr) && ip4_addr_cmp(&etharp_pins[k].ipaddr, ipaddr)) {
+      i = etharp_find_entry(ipaddr, ETHARP_FLAG_FIND_ONLY, netif_get_by_index(etharp_pins[k].netif_idx));
+      if (i >= 0) {
+        arp_table[i].eflags &= (u8_t)~ETHARP_ENTRY_PINNED;
+      }
+      ip4_addr_set_any(&etharp_pins[k].ipaddr);
+      return ERR_OK;
+    }
+  }
+  return ERR_VAL;
+}
+#endif /* ETHARP_PIN_MAX */
+
 /**
  * Remove all ARP table entries of the specified netif.
  *
@@ -749,6 +1033,7 @@ etharp_output_to_arp_index(struct netif *netif, struct pbuf *q, netif_addr_idx_t
 {
   LWIP_ASSERT("arp_table[arp_idx].state >= ETHARP_STATE_STABLE",
               arp_table[arp_idx].state >= ETHARP_STATE_STABLE);
+  ETHARP_SET_USED(arp_idx);
   /* if arp table entry is about to expire: re-request it,
      but only if its state is ETHARP_STATE_STABLE to prevent flooding the
      network with ARP requests if this address is used frequently. */
@@ -872,6 +1157,17 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
     }
 #endif /* LWIP_NETIF_HWADDRHINT */
 
+#if ETHARP_HASH
+    /* ETH_CODE: find stable entry through the hash chains */
+    {
+      s16_t h = etharp_hash_find(dst_addr, netif);
+      if ((h >= 0) && (arp_table[h].state >= ETHARP_STATE_STABLE)) {
+        i = (netif_addr_idx_t)h;
+        ETHARP_SET_ADDRHINT(netif, i);
+        return etharp_output_to_arp_index(netif, q, i);
+      }
+    }
+#else /* ETHARP_HASH */
     /* find stable entry: do this here since this is a critical path for
        throughput and etharp_find_entry() is kind of slow */
     for (i = 0; i < ARP_TABLE_SIZE; i++) {
@@ -885,6 +1181,7 @@ etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
         return etharp_output_to_arp_index(netif, q, i);
       }
     }
+#endif /* ETHARP_HASH */
     /* no stable entry found, use the (slower) query function:
        queue on destination Ethernet address belonging to ipaddr */
     return etharp_query(netif, dst_addr, q);
@@ -995,6 +1292,7 @@ etharp_query(struct netif *netif, const ip4_addr_t *ipaddr, struct pbuf *q)
   if (arp_table[i].state >= ETHARP_STATE_STABLE) {
     /* we have a valid IP->Ethernet address mapping */
     ETHARP_SET_ADDRHINT(netif, i);
+    ETHARP_SET_USED(i);
     /* send the packet */
     result = ethernet_output(netif, q, srcaddr, &(arp_table[i].ethaddr), ETHTYPE_IP);
     /* pending entry? (either just created or already pending */
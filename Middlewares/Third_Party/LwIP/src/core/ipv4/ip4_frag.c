@@ -117,6 +117,7 @@ static u16_t ip_reass_pbufcount;
 /* function prototypes */
 static void ip_reass_dequeue_datagram(struct ip_reassdata *ipr, struct ip_reassdata *prev);
 static int ip_reass_free_complete_datagram(struct ip_reassdata *ipr, struct ip_reassdata *prev);
+static void ip_reass_discard_datagram(struct ip_hdr *fraghdr);
 
 /**
  * Reassembly timer base function
@@ -213,6 +214,43 @@ ip_reass_free_complete_datagram(struct ip_reassdata *ipr, struct ip_reassdata *p
   return pbufs_freed;
 }
 
+/**
+ * ETH_CODE: Free the datagram 'fraghdr' belongs to, if any, and all its
+ * pbufs, like ip_reass_free_complete_datagram() but without the ICMP time
+ * exceeded: it is given up, not timed out.
+ *
+ * @param fraghdr IP header of the current fragment
+ */
+static void
+ip_reass_discard_datagram(struct ip_hdr *fraghdr)
+{
+  struct ip_reassdata *ipr, *prev = NULL;
+  struct pbuf *p;
+  u16_t pbufs_freed = 0;
+
+  for (ipr = reassdatagrams; ipr != NULL; ipr = ipr->next) {
+    if (IP_ADDRESSES_AND_ID_MATCH(&ipr->iphdr, fraghdr)) {
+      break;
+    }
+    prev = ipr;
+  }
+  if (ipr == NULL) {
+    return;
+  }
+
+  MIB2_STATS_INC(mib2.ipreasmfails);
+  p = ipr->p;
+  while (p != NULL) {
+    struct pbuf *pcur = p;
+    p = ((struct ip_reass_helper *)p->payload)->next_pbuf;
+    pbufs_freed = (u16_t)(pbufs_freed + pbuf_clen(pcur));
+    pbuf_free(pcur);
+  }
+  ip_reass_dequeue_datagram(ipr, prev);
+  LWIP_ASSERT("ip_reass_pbufcount >= pbufs_freed", ip_reass_pbufcount >= pbufs_freed);
+  ip_reass_pbufcount = (u16_t)(ip_reass_pbufcount - pbufs_freed);
+}
+
 #if IP_REASS_FREE_OLDEST
 /**
  * Free the oldest datagram to make room for enqueueing new fragments.
@@ -510,6 +548,9 @@ ip4_reass(struct pbuf *p)
   u8_t hlen;
   int valid;
   int is_last;
+#if IP_REASS_COPY
+  int copy;
+#endif
 
   IPFRAG_STATS_INC(ip_frag.recv);
   MIB2_STATS_INC(mib2.ipreasmreqds);
@@ -531,8 +572,27 @@ ip4_reass(struct pbuf *p)
   }
   len = (u16_t)(len - hlen);
 
+  /* ETH_CODE: see opt.h */
+  if ((u32_t)offset + len > (u32_t)IP_REASS_DGRAM_MAX) {
+    LWIP_DEBUGF(IP_REASS_DEBUG, ("ip4_reass: datagram longer than %"U32_F", dropped\n",
+                                 (u32_t)IP_REASS_DGRAM_MAX));
+    ip_reass_discard_datagram(fraghdr);
+    IPFRAG_STATS_INC(ip_frag.lenerr);
+    goto nullreturn;
+  }
+
   /* Check if we are allowed to enqueue more datagrams. */
-  clen = pbuf_clen(p);
+#if IP_REASS_COPY
+  /* ETH_CODE: count the arena pbufs the copy takes, not the received ones */
+  copy = IP_REASS_COPY_NEEDED(p);
+  if (copy) {
+    clen = (u16_t)((p->tot_len + LWIP_MEM_ALIGN_SIZE(PBUF_POOL_BUFSIZE) - 1) /
+                   LWIP_MEM_ALIGN_SIZE(PBUF_POOL_BUFSIZE));
+  } else
+#endif /* IP_REASS_COPY */
+  {
+    clen = pbuf_clen(p);
+  }
   if ((ip_reass_pbufcount + clen) > IP_REASS_MAX_PBUFS) {
 #if IP_REASS_FREE_OLDEST
     if (!ip_reass_remove_oldest_datagram(fraghdr, clen) ||
@@ -549,6 +609,27 @@ ip4_reass(struct pbuf *p)
     }
   }
 
+#if IP_REASS_COPY
+  /* ETH_CODE: see opt.h */
+  if (copy) {
+    struct pbuf *q = pbuf_clone(PBUF_RAW, PBUF_POOL, p);
+#if IP_REASS_FREE_OLDEST
+    if ((q == NULL) && ip_reass_remove_oldest_datagram(fraghdr, clen)) {
+      q = pbuf_clone(PBUF_RAW, PBUF_POOL, p);
+    }
+#endif /* IP_REASS_FREE_OLDEST */
+    if (q == NULL) {
+      LWIP_DEBUGF(IP_REASS_DEBUG, ("ip4_reass: no arena pbufs for %"U16_F" bytes\n", p->tot_len));
+      IPFRAG_STATS_INC(ip_frag.memerr);
+      goto nullreturn;
+    }
+    pbuf_free(p);
+    p = q;
+    fraghdr = (struct ip_hdr *)p->payload;
+    clen = pbuf_clen(p);
+  }
+#endif /* IP_REASS_COPY */
+
   /* Look for the datagram the fragment belongs to in the current datagram queue,
    * remembering the previous in the queue for later dequeueing. */
   for (ipr = reassdatagrams; ipr != NULL; ipr = ipr->next) {
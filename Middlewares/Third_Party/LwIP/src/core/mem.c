@@ -66,6 +66,21 @@
 #include <stdlib.h> /* for malloc()/free() */
 #endif
 
+/* ETH_CODE: call sites of the heap, component/heaptrace/heap_trace.h. The
+ * implementations below become the _untraced functions, the public ones
+ * at the end of the file record around them. */
+#include "heaptrace/heap_trace.h"
+#if HEAP_TRACE
+static void *mem_malloc_untraced(mem_size_t size);
+static void *mem_calloc_untraced(mem_size_t count, mem_size_t size);
+static void *mem_trim_untraced(void *mem, mem_size_t size);
+static void mem_free_untraced(void *rmem);
+#define mem_malloc mem_malloc_untraced
+#define mem_calloc mem_calloc_untraced
+#define mem_trim mem_trim_untraced
+#define mem_free mem_free_untraced
+#endif
+
 /* This is overridable for tests only... */
 #ifndef LWIP_MEM_ILLEGAL_FREE
 #define LWIP_MEM_ILLEGAL_FREE(msg)         LWIP_ASSERT(msg, 0)
@@ -1015,3 +1030,47 @@ mem_calloc(mem_size_t count, mem_size_t size)
   return p;
 }
 #endif /* MEM_LIBC_MALLOC && (!LWIP_STATS || !MEM_STATS) */
+
+/* ETH_CODE: see the top of the file */
+#if HEAP_TRACE
+#undef mem_malloc
+#undef mem_calloc
+#undef mem_trim
+#undef mem_free
+
+void *
+mem_malloc(mem_size_t size)
+{
+  void *p = mem_malloc_untraced(size);
+
+  heap_trace_alloc(HEAP_TRACE_LWIP, p, size, HEAP_TRACE_CALLER());
+  return p;
+}
+
+void *
+mem_calloc(mem_size_t count, mem_size_t size)
+{
+  void *p = mem_calloc_untraced(count, size);
+
+  heap_trace_alloc(HEAP_TRACE_LWIP, p, (size_t)count * size, HEAP_TRACE_CALLER());
+  return p;
+}
+
+void *
+mem_trim(void *mem, mem_size_t size)
+{
+  void *p = mem_trim_untraced(mem, size);
+
+  if (p != NULL) {
+    heap_trace_resize(HEAP_TRACE_LWIP, p, size);
+  }
+  return p;
+}
+
+void
+mem_free(void *rmem)
+{
+  heap_trace_free(HEAP_TRACE_LWIP, rmem);
+  mem_free_untraced(rmem);
+}
+#endif /* HEAP_TRACE */
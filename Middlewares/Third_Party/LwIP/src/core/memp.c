@@ -93,6 +93,74 @@ const struct memp_desc *const memp_pools[MEMP_MAX] = {
 #define MEMP_OVERFLOW_CHECK 1
 #endif
 
+/* ETH_CODE: MEMP_LOCKFREE, see opt.h. The free list is a Treiber stack
+ * whose head is read with LDREX and written with STREX. Any other write
+ * to the head in between, and any exception entry or return (both clear
+ * the exclusive monitor), fails the STREX and the operation starts over.
+ * So a pop that loaded head->next cannot succeed after the element was
+ * taken and given back meanwhile (ABA): no tag is needed next to the
+ * pointer. head->next may be read from an element another context just
+ * took; the value is then discarded with the failed STREX. Only loads sit
+ * between LDREX and STREX: whether an explicit store in between clears
+ * the monitor is IMPLEMENTATION DEFINED (Armv7-M ARM), so a push writes
+ * the element's next first and retries if the head has moved by the
+ * LDREX. */
+#if MEMP_LOCKFREE
+#if MEMP_MEM_MALLOC || MEMP_OVERFLOW_CHECK || MEMP_SANITY_CHECK || defined(LWIP_HOOK_MEMP_AVAILABLE)
+#error "MEMP_LOCKFREE needs plain fixed-size pools"
+#endif
+#include "cmsis_compiler.h"
+
+static struct memp *
+memp_lf_pop(struct memp **tab)
+{
+  struct memp *memp;
+
+  do {
+    memp = (struct memp *)__LDREXW((volatile uint32_t *)tab);
+    if (memp == NULL) {
+      __CLREX();
+      return NULL;
+    }
+  } while (__STREXW((uint32_t)memp->next, (volatile uint32_t *)tab) != 0U);
+  __COMPILER_BARRIER();
+  return memp;
+}
+
+static void
+memp_lf_push(struct memp **tab, struct memp *memp)
+{
+  for (;;) {
+    struct memp *head = *(struct memp *volatile *)tab;
+
+    memp->next = head;
+    /* The element's next and content are written before it is published */
+    __COMPILER_BARRIER();
+    if ((struct memp *)__LDREXW((volatile uint32_t *)tab) != head) {
+      __CLREX();
+      continue;
+    }
+    if (__STREXW((uint32_t)memp, (volatile uint32_t *)tab) == 0U) {
+      return;
+    }
+  }
+}
+
+#if MEMP_STATS
+/* Counters by atomic updates; max may miss a racing allocation's peak
+ * until the next one */
+static void
+memp_lf_stats_alloc(const struct memp_desc *desc)
+{
+  mem_size_t used = __atomic_add_fetch(&desc->stats->used, 1, __ATOMIC_RELAXED);
+
+  if (used > desc->stats->max) {
+    desc->stats->max = used;
+  }
+}
+#endif /* MEMP_STATS */
+#endif /* MEMP_LOCKFREE */
+
 #if MEMP_SANITY_CHECK && !MEMP_MEM_MALLOC
 /**
  * Check that memp-lists don't form a circle, using "Floyd's cycle-finding algorithm".
@@ -250,6 +318,23 @@ do_memp_malloc_pool_fn(const struct memp_desc *desc, const char *file, const int
   struct memp *memp;
   SYS_ARCH_DECL_PROTECT(old_level);
 
+#if MEMP_LOCKFREE
+  /* ETH_CODE: no SYS_ARCH_PROTECT, see memp_lf_pop() */
+  LWIP_UNUSED_ARG(old_level);
+  memp = memp_lf_pop(desc->tab);
+  if (memp == NULL) {
+#if MEMP_STATS
+    __atomic_add_fetch(&desc->stats->err, 1, __ATOMIC_RELAXED);
+#endif
+    LWIP_DEBUGF(MEMP_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("memp_malloc: out of memory in pool %s\n", desc->desc));
+    return NULL;
+  }
+#if MEMP_STATS
+  memp_lf_stats_alloc(desc);
+#endif
+  return ((u8_t *)memp + MEMP_SIZE);
+#else /* MEMP_LOCKFREE */
+
 #if MEMP_MEM_MALLOC
   memp = (struct memp *)mem_malloc(MEMP_SIZE + MEMP_ALIGN_SIZE(desc->size));
   SYS_ARCH_PROTECT(old_level);
@@ -297,6 +382,7 @@ do_memp_malloc_pool_fn(const struct memp_desc *desc, const char *file, const int
   }
 
   return NULL;
+#endif /* MEMP_LOCKFREE */
 }
 
 /**
@@ -367,6 +453,14 @@ do_memp_free_pool(const struct memp_desc *desc, void *mem)
   /* cast through void* to get rid of alignment warnings */
   memp = (struct memp *)(void *)((u8_t *)mem - MEMP_SIZE);
 
+#if MEMP_LOCKFREE
+  /* ETH_CODE: no SYS_ARCH_PROTECT, see memp_lf_pop() */
+  LWIP_UNUSED_ARG(old_level);
+#if MEMP_STATS
+  __atomic_sub_fetch(&desc->stats->used, 1, __ATOMIC_RELAXED);
+#endif
+  memp_lf_push(desc->tab, memp);
+#else /* MEMP_LOCKFREE */
   SYS_ARCH_PROTECT(old_level);
 
 #if MEMP_OVERFLOW_CHECK == 1
@@ -391,6 +485,7 @@ do_memp_free_pool(const struct memp_desc *desc, void *mem)
 
   SYS_ARCH_UNPROTECT(old_level);
 #endif /* !MEMP_MEM_MALLOC */
+#endif /* MEMP_LOCKFREE */
 }
 
 /**
@@ -90,6 +90,14 @@
 #include "lwip/nd6.h"
 #endif
 
+#if UDP_TPL
+/* ETH_CODE: what ip_route() finds may have changed; udp_tpl headers are
+ * rebuilt */
+#define NETIF_ROUTE_CHANGED() UDP_TPL_INVALIDATE()
+#else
+#define NETIF_ROUTE_CHANGED()
+#endif /* UDP_TPL */
+
 #if LWIP_NETIF_STATUS_CALLBACK
 #define NETIF_STATUS_CALLBACK(n) do{ if (n->status_callback) { (n->status_callback)(n); }}while(0)
 #else
@@ -352,6 +360,11 @@ netif_add(struct netif *netif,
   netif->loop_first = NULL;
   netif->loop_last = NULL;
 #endif /* ENABLE_LOOPBACK */
+#if LWIP_NETIF_TX_BATCH
+  /* ETH_CODE: set by the driver's init function if it batches frames */
+  netif->tx_flush = NULL;
+  netif->tx_batch = 0;
+#endif /* LWIP_NETIF_TX_BATCH */
 
   /* remember netif specific state information data */
   netif->state = state;
@@ -433,6 +446,7 @@ netif_add(struct netif *netif,
 #endif /* LWIP_IPV4 */
   LWIP_DEBUGF(NETIF_DEBUG, ("\n"));
 
+  NETIF_ROUTE_CHANGED();
   netif_invoke_ext_callback(netif, LWIP_NSC_NETIF_ADDED, NULL);
 
   return netif;
@@ -481,6 +495,7 @@ netif_do_set_ipaddr(struct netif *netif, const ip4_addr_t *ipaddr, ip_addr_t *ol
     netif_issue_reports(netif, NETIF_REPORT_TYPE_IPV4);
 
     NETIF_STATUS_CALLBACK(netif);
+    NETIF_ROUTE_CHANGED();
     return 1; /* address changed */
   }
   return 0; /* address unchanged */
@@ -541,6 +556,7 @@ netif_do_set_netmask(struct netif *netif, const ip4_addr_t *netmask, ip_addr_t *
                 ip4_addr2_16(netif_ip4_netmask(netif)),
                 ip4_addr3_16(netif_ip4_netmask(netif)),
                 ip4_addr4_16(netif_ip4_netmask(netif))));
+    NETIF_ROUTE_CHANGED();
     return 1; /* netmask changed */
   }
   return 0; /* netmask unchanged */
@@ -603,6 +619,7 @@ netif_do_set_gw(struct netif *netif, const ip4_addr_t *gw, ip_addr_t *old_gw)
                 ip4_addr2_16(netif_ip4_gw(netif)),
                 ip4_addr3_16(netif_ip4_gw(netif)),
                 ip4_addr4_16(netif_ip4_gw(netif))));
+    NETIF_ROUTE_CHANGED();
     return 1; /* gateway changed */
   }
   return 0; /* gateway unchanged */
@@ -746,6 +763,7 @@ netif_remove(struct netif *netif)
     return;
   }
 
+  NETIF_ROUTE_CHANGED();
   netif_invoke_ext_callback(netif, LWIP_NSC_NETIF_REMOVED, NULL);
 
 #if LWIP_IPV4
@@ -831,6 +849,7 @@ netif_set_default(struct netif *netif)
     mib2_add_route_ip4(1, netif);
   }
   netif_default = netif;
+  NETIF_ROUTE_CHANGED();
   LWIP_DEBUGF(NETIF_DEBUG, ("netif: setting default interface %c%c\n",
                             netif ? netif->name[0] : '\'', netif ? netif->name[1] : '\''));
 }
@@ -849,6 +868,7 @@ netif_set_up(struct netif *netif)
 
   if (!(netif->flags & NETIF_FLAG_UP)) {
     netif_set_flags(netif, NETIF_FLAG_UP);
+    NETIF_ROUTE_CHANGED();
 
     MIB2_COPY_SYSUPTIME_TO(&netif->ts);
 
@@ -932,6 +952,7 @@ netif_set_down(struct netif *netif)
 #endif
 
     netif_clear_flags(netif, NETIF_FLAG_UP);
+    NETIF_ROUTE_CHANGED();
     MIB2_COPY_SYSUPTIME_TO(&netif->ts);
 
 #if LWIP_IPV4 && LWIP_ARP
@@ -993,6 +1014,7 @@ netif_set_link_up(struct netif *netif)
 
   if (!(netif->flags & NETIF_FLAG_LINK_UP)) {
     netif_set_flags(netif, NETIF_FLAG_LINK_UP);
+    NETIF_ROUTE_CHANGED();
 
 #if LWIP_DHCP
     dhcp_network_changed(netif);
@@ -1031,6 +1053,7 @@ netif_set_link_down(struct netif *netif)
 
   if (netif->flags & NETIF_FLAG_LINK_UP) {
     netif_clear_flags(netif, NETIF_FLAG_LINK_UP);
+    NETIF_ROUTE_CHANGED();
     NETIF_LINK_CALLBACK(netif);
 #if LWIP_NETIF_EXT_STATUS_CALLBACK
     {
@@ -85,6 +85,8 @@
 #endif
 
 #include <string.h>
+/* ETH_CODE: PBUF_RAM charged to the caller of pbuf_alloc() */
+#include "heaptrace/heap_trace.h"
 
 #define SIZEOF_STRUCT_PBUF        LWIP_MEM_ALIGN_SIZE(sizeof(struct pbuf))
 /* Since the pool is created in memp, PBUF_POOL_BUFSIZE will be automatically
@@ -186,6 +188,10 @@ pbuf_init_alloced_pbuf(struct pbuf *p, void *payload, u16_t tot_len, u16_t len,
   p->flags = flags;
   p->ref = 1;
   p->if_idx = NETIF_NO_INDEX;
+#ifdef LWIP_PBUF_CUSTOM_DATA_INIT
+  /* ETH_CODE: see LWIP_PBUF_CUSTOM_DATA */
+  LWIP_PBUF_CUSTOM_DATA_INIT(p);
+#endif
 }
 
 /**
@@ -285,6 +291,10 @@ pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
       if (p == NULL) {
         return NULL;
       }
+#if HEAP_TRACE
+      /* ETH_CODE: see heap_trace.h */
+      heap_trace_retag(HEAP_TRACE_LWIP, p, HEAP_TRACE_CALLER());
+#endif
       pbuf_init_alloced_pbuf(p, LWIP_MEM_ALIGN((void *)((u8_t *)p + SIZEOF_STRUCT_PBUF + offset)),
                              length, length, type, 0);
       LWIP_ASSERT("pbuf_alloc: pbuf->payload properly aligned",
@@ -1314,6 +1324,10 @@ pbuf_clone(pbuf_layer layer, pbuf_type type, struct pbuf *p)
   err = pbuf_copy(q, p);
   LWIP_UNUSED_ARG(err); /* in case of LWIP_NOASSERT */
   LWIP_ASSERT("pbuf_copy failed", err == ERR_OK);
+#ifdef LWIP_PBUF_CUSTOM_DATA_COPY
+  /* ETH_CODE: the copy of a packet is the same packet */
+  LWIP_PBUF_CUSTOM_DATA_COPY(q, p);
+#endif
   return q;
 }
 
@@ -111,6 +111,7 @@
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
 #include "lwip/nd6.h"
+#include "lwip/timeouts.h"
 
 #include <string.h>
 
@@ -184,12 +185,95 @@ struct tcp_pcb **const tcp_pcb_lists[] = {&tcp_listen_pcbs.pcbs, &tcp_bound_pcbs
 
 u8_t tcp_active_pcbs_changed;
 
+#if TCP_PCB_HASH
+#if (TCP_PCB_HASH_SIZE & (TCP_PCB_HASH_SIZE - 1)) != 0
+#error "TCP_PCB_HASH_SIZE must be a power of 2"
+#endif
+/** ETH_CODE: hash chains over the lists tcp_input() searches, see opt.h */
+struct tcp_pcb *tcp_pcb_hash_active[TCP_PCB_HASH_SIZE];
+struct tcp_pcb *tcp_pcb_hash_tw[TCP_PCB_HASH_SIZE];
+struct tcp_pcb *tcp_pcb_hash_listen[TCP_PCB_HASH_SIZE];
+
+/**
+ * ETH_CODE: Bucket of a connection, or of a listener with remote_port 0
+ * and remote_ip NULL. The local address is left out: it can change under
+ * a listening pcb (tcp_netif_ip_addr_changed()).
+ */
+u32_t
+tcp_pcb_hash_bucket(u16_t local_port, u16_t remote_port, const ip_addr_t *remote_ip)
+{
+  u32_t h = ((u32_t)local_port << 16) | remote_port;
+  if (remote_ip != NULL) {
+#if LWIP_IPV6
+    if (IP_IS_V6(remote_ip)) {
+      h ^= ip_2_ip6(remote_ip)->addr[3];
+    } else
+#endif /* LWIP_IPV6 */
+    {
+#if LWIP_IPV4
+      h ^= ip4_addr_get_u32(ip_2_ip4(remote_ip));
+#endif /* LWIP_IPV4 */
+    }
+  }
+  h *= 2654435761UL;
+  return (h >> 16) & (TCP_PCB_HASH_SIZE - 1);
+}
+
+/* ETH_CODE: the chain a pcb of list pcbs belongs in, NULL for
+ * tcp_bound_pcbs (never searched by tcp_input()) */
+static struct tcp_pcb **
+tcp_pcb_hash_head(struct tcp_pcb **pcbs, const struct tcp_pcb *pcb)
+{
+  if (pcbs == &tcp_active_pcbs) {
+    return &tcp_pcb_hash_active[tcp_pcb_hash_bucket(pcb->local_port, pcb->remote_port, &pcb->remote_ip)];
+  }
+  if (pcbs == &tcp_tw_pcbs) {
+    return &tcp_pcb_hash_tw[tcp_pcb_hash_bucket(pcb->local_port, pcb->remote_port, &pcb->remote_ip)];
+  }
+  if (pcbs == &tcp_listen_pcbs.pcbs) {
+    return &tcp_pcb_hash_listen[tcp_pcb_hash_bucket(pcb->local_port, 0, NULL)];
+  }
+  return NULL;
+}
+
+/** ETH_CODE: chain a pcb just put on list pcbs, see TCP_REG */
+void
+tcp_pcb_hash_add(struct tcp_pcb **pcbs, struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **head = tcp_pcb_hash_head(pcbs, pcb);
+  if (head != NULL) {
+    pcb->hnext = *head;
+    *head = pcb;
+  }
+}
+
+/** ETH_CODE: unchain a pcb taken off list pcbs, if it is chained, see TCP_RMV */
+void
+tcp_pcb_hash_rmv(struct tcp_pcb **pcbs, struct tcp_pcb *pcb)
+{
+  struct tcp_pcb **link = tcp_pcb_hash_head(pcbs, pcb);
+  if (link == NULL) {
+    return;
+  }
+  for (; *link != NULL; link = &(*link)->hnext) {
+    if (*link == pcb) {
+      *link = pcb->hnext;
+      pcb->hnext = NULL;
+      return;
+    }
+  }
+}
+#endif /* TCP_PCB_HASH */
+
 /** Timer counter to handle calling slow-timer from tcp_tmr() */
 static u8_t tcp_timer;
 static u8_t tcp_timer_ctr;
 static u16_t tcp_new_port(void);
 
 static err_t tcp_close_shutdown_fin(struct tcp_pcb *pcb);
+#if TCP_SND_AUTOTUNE
+static void tcp_snd_tune_tmr(void); /* ETH_CODE */
+#endif /* TCP_SND_AUTOTUNE */
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
 static void tcp_ext_arg_invoke_callbacks_destroyed(struct tcp_pcb_ext_args *ext_args);
 #endif
@@ -203,6 +287,9 @@ tcp_init(void)
 #ifdef LWIP_RAND
   tcp_port = TCP_ENSURE_LOCAL_PORT_RANGE(LWIP_RAND());
 #endif /* LWIP_RAND */
+#if LWIP_TCP_TXREF
+  tcp_txref_pool_init();
+#endif /* LWIP_TCP_TXREF */
 }
 
 /** Free a tcp pcb */
@@ -210,6 +297,9 @@ void
 tcp_free(struct tcp_pcb *pcb)
 {
   LWIP_ASSERT("tcp_free: LISTEN", pcb->state != LISTEN);
+#if TCP_RTO_MS
+  tcp_rto_stop(pcb);
+#endif /* TCP_RTO_MS */
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
   tcp_ext_arg_invoke_callbacks_destroyed(pcb->ext_args);
 #endif
@@ -608,9 +698,14 @@ tcp_abandon(struct tcp_pcb *pcb, int reset)
       tcp_segs_free(pcb->unsent);
     }
 #if TCP_QUEUE_OOSEQ
+#if TCP_OOSEQ_GOVERN
+    /* ETH_CODE: take the queue off the totals too */
+    tcp_free_ooseq(pcb);
+#else
     if (pcb->ooseq != NULL) {
       tcp_segs_free(pcb->ooseq);
     }
+#endif /* TCP_OOSEQ_GOVERN */
 #endif /* TCP_QUEUE_OOSEQ */
     tcp_backlog_accepted(pcb);
     if (send_rst) {
@@ -930,8 +1025,15 @@ u32_t
 tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
 {
   u32_t new_right_edge;
+#if TCP_CONN_STATS
+  /* ETH_CODE: a zero window announced where there was room */
+  tcpwnd_size_t old_ann_wnd;
+#endif /* TCP_CONN_STATS */
 
   LWIP_ASSERT("tcp_update_rcv_ann_wnd: invalid pcb", pcb != NULL);
+#if TCP_CONN_STATS
+  old_ann_wnd = pcb->rcv_ann_wnd;
+#endif /* TCP_CONN_STATS */
   new_right_edge = pcb->rcv_nxt + pcb->rcv_wnd;
 
   if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((TCP_WND / 2), pcb->mss))) {
@@ -951,6 +1053,11 @@ tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
 #endif
       pcb->rcv_ann_wnd = (tcpwnd_size_t)new_rcv_ann_wnd;
     }
+#if TCP_CONN_STATS
+    if ((pcb->rcv_ann_wnd == 0) && (old_ann_wnd != 0)) {
+      pcb->rcv_wnd_stalls++;
+    }
+#endif /* TCP_CONN_STATS */
     return 0;
   }
 }
@@ -1181,6 +1288,108 @@ tcp_connect(struct tcp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port,
   return ret;
 }
 
+/**
+ * Retransmission timeout: retransmit, back the RTO off and shrink the
+ * congestion window (ETH_CODE: factored out of tcp_slowtmr() for
+ * tcp_rto_timer()).
+ */
+static void
+tcp_rto_expired(struct tcp_pcb *pcb)
+{
+  tcpwnd_size_t eff_wnd;
+
+  LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_slowtmr: rtime %"TCPRTO_F
+                              " pcb->rto %"TCPRTO_F"\n",
+                              pcb->rtime, pcb->rto));
+  /* If prepare phase fails but we have unsent data but no unacked data,
+     still execute the backoff calculations below, as this means we somehow
+     failed to send segment. */
+  if ((tcp_rexmit_rto_prepare(pcb) == ERR_OK) || ((pcb->unacked == NULL) && (pcb->unsent != NULL))) {
+    /* Double retransmission time-out unless we are trying to
+     * connect to somebody (i.e., we are in SYN_SENT). */
+    if (pcb->state != SYN_SENT) {
+      u8_t backoff_idx = LWIP_MIN(pcb->nrtx, sizeof(tcp_backoff) - 1);
+      int calc_rto = ((pcb->sa >> 3) + pcb->sv) << tcp_backoff[backoff_idx];
+      pcb->rto = (tcp_rto_t)TCP_RTO_BOUND(calc_rto);
+    }
+
+    /* Reset the retransmission timer. */
+    TCP_RTO_START(pcb);
+
+    /* Reduce congestion window and ssthresh. */
+    eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
+    pcb->ssthresh = eff_wnd >> 1;
+    if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
+      pcb->ssthresh = (tcpwnd_size_t)(pcb->mss << 1);
+    }
+    pcb->cwnd = pcb->mss;
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
+                                 " ssthresh %"TCPWNDSIZE_F"\n",
+                                 pcb->cwnd, pcb->ssthresh));
+    pcb->bytes_acked = 0;
+
+    /* The following needs to be called AFTER cwnd is set to one
+       mss - STJ */
+    tcp_rexmit_rto_commit(pcb);
+  }
+}
+
+#if TCP_RTO_MS
+/**
+ * ETH_CODE: Retransmission timer of a pcb with TCP_RTO_MS. The checks
+ * tcp_slowtmr() makes before its own RTO handling are repeated: a pcb out
+ * of retransmissions is left for tcp_slowtmr() to abort, and in persist
+ * state the timer only waits.
+ */
+static void
+tcp_rto_timer(void *arg)
+{
+  struct tcp_pcb *pcb = (struct tcp_pcb *)arg;
+
+  if (pcb->rtime < 0) {
+    return;
+  }
+  if ((pcb->state == SYN_SENT) ? (pcb->nrtx >= TCP_SYNMAXRTX) : (pcb->nrtx >= TCP_MAXRTX)) {
+    return;
+  }
+  if (pcb->persist_backoff == 0) {
+    tcp_rto_expired(pcb);
+  }
+  /* not restarted (nothing to send yet) or waiting in persist state:
+     look again after another RTO, as tcp_slowtmr() would every tick */
+  if (pcb->rtime >= 0) {
+    tcp_rto_start(pcb);
+  }
+}
+
+/** ETH_CODE: (Re)start the retransmission timer for one RTO from now */
+void
+tcp_rto_start(struct tcp_pcb *pcb)
+{
+  pcb->rtime = 0;
+  sys_untimeout(tcp_rto_timer, pcb);
+  sys_timeout((u32_t)pcb->rto, tcp_rto_timer, pcb);
+}
+
+/** ETH_CODE: Stop the retransmission timer */
+void
+tcp_rto_stop(struct tcp_pcb *pcb)
+{
+  if (pcb->rtime >= 0) {
+    pcb->rtime = -1;
+    sys_untimeout(tcp_rto_timer, pcb);
+  }
+}
+
+/** ETH_CODE: RTT measurement start time, never 0 (rttest == 0 is idle) */
+u32_t
+tcp_rtt_stamp(void)
+{
+  u32_t now = sys_now();
+  return (now != 0) ? now : 1;
+}
+#endif /* TCP_RTO_MS */
+
 /**
  * Called every 500 ms and implements the retransmission timer and the timer that
  * removes PCBs that have been in TIME-WAIT for enough time. It also increments
@@ -1192,7 +1401,6 @@ void
 tcp_slowtmr(void)
 {
   struct tcp_pcb *pcb, *prev;
-  tcpwnd_size_t eff_wnd;
   u8_t pcb_remove;      /* flag if a PCB should be removed */
   u8_t pcb_reset;       /* flag if a RST should be sent when removing */
   err_t err;
@@ -1201,6 +1409,9 @@ tcp_slowtmr(void)
 
   ++tcp_ticks;
   ++tcp_timer_ctr;
+#if TCP_SND_AUTOTUNE
+  tcp_snd_tune_tmr(); /* ETH_CODE */
+#endif /* TCP_SND_AUTOTUNE */
 
 tcp_slowtmr_start:
   /* Steps through all of the active PCBs. */
@@ -1267,6 +1478,7 @@ tcp_slowtmr_start:
           }
         }
       } else {
+#if !TCP_RTO_MS /* ETH_CODE: else tcp_rto_timer() */
         /* Increase the retransmission timer if it is running */
         if ((pcb->rtime >= 0) && (pcb->rtime < 0x7FFF)) {
           ++pcb->rtime;
@@ -1274,41 +1486,9 @@ tcp_slowtmr_start:
 
         if (pcb->rtime >= pcb->rto) {
           /* Time for a retransmission. */
-          LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_slowtmr: rtime %"S16_F
-                                      " pcb->rto %"S16_F"\n",
-                                      pcb->rtime, pcb->rto));
-          /* If prepare phase fails but we have unsent data but no unacked data,
-             still execute the backoff calculations below, as this means we somehow
-             failed to send segment. */
-          if ((tcp_rexmit_rto_prepare(pcb) == ERR_OK) || ((pcb->unacked == NULL) && (pcb->unsent != NULL))) {
-            /* Double retransmission time-out unless we are trying to
-             * connect to somebody (i.e., we are in SYN_SENT). */
-            if (pcb->state != SYN_SENT) {
-              u8_t backoff_idx = LWIP_MIN(pcb->nrtx, sizeof(tcp_backoff) - 1);
-              int calc_rto = ((pcb->sa >> 3) + pcb->sv) << tcp_backoff[backoff_idx];
-              pcb->rto = (s16_t)LWIP_MIN(calc_rto, 0x7FFF);
-            }
-
-            /* Reset the retransmission timer. */
-            pcb->rtime = 0;
-
-            /* Reduce congestion window and ssthresh. */
-            eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
-            pcb->ssthresh = eff_wnd >> 1;
-            if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
-              pcb->ssthresh = (tcpwnd_size_t)(pcb->mss << 1);
-            }
-            pcb->cwnd = pcb->mss;
-            LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
-                                         " ssthresh %"TCPWNDSIZE_F"\n",
-                                         pcb->cwnd, pcb->ssthresh));
-            pcb->bytes_acked = 0;
-
-            /* The following needs to be called AFTER cwnd is set to one
-               mss - STJ */
-            tcp_rexmit_rto_commit(pcb);
-          }
+          tcp_rto_expired(pcb);
         }
+#endif /* !TCP_RTO_MS */
       }
     }
     /* Check if this PCB has stayed too long in FIN-WAIT-2 */
@@ -1352,7 +1532,7 @@ tcp_slowtmr_start:
        be retransmitted). */
 #if TCP_QUEUE_OOSEQ
     if (pcb->ooseq != NULL &&
-        (tcp_ticks - pcb->tmr >= (u32_t)pcb->rto * TCP_OOSEQ_TIMEOUT)) {
+        (tcp_ticks - pcb->tmr >= TCP_RTO_TICKS(pcb) * TCP_OOSEQ_TIMEOUT)) {
       LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: dropping OOSEQ queued data\n"));
       tcp_free_ooseq(pcb);
     }
@@ -1393,6 +1573,8 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_active_pcbs", tcp_active_pcbs == pcb);
         tcp_active_pcbs = pcb->next;
       }
+      /* ETH_CODE: and from its hash chain */
+      TCP_PCB_HASH_RMV(&tcp_active_pcbs, pcb);
 
       if (pcb_reset) {
         tcp_rst(pcb, pcb->snd_nxt, pcb->rcv_nxt, &pcb->local_ip, &pcb->remote_ip,
@@ -1459,6 +1641,8 @@ tcp_slowtmr_start:
         LWIP_ASSERT("tcp_slowtmr: first pcb == tcp_tw_pcbs", tcp_tw_pcbs == pcb);
         tcp_tw_pcbs = pcb->next;
       }
+      /* ETH_CODE: and from its hash chain */
+      TCP_PCB_HASH_RMV(&tcp_tw_pcbs, pcb);
       pcb2 = pcb;
       pcb = pcb->next;
       tcp_free(pcb2);
@@ -1889,7 +2073,11 @@ tcp_alloc(u8_t prio)
     /* zero out the whole pcb, so there is no need to initialize members to zero */
     memset(pcb, 0, sizeof(struct tcp_pcb));
     pcb->prio = prio;
+#if TCP_SND_AUTOTUNE
+    tcp_snd_tune_init(pcb); /* ETH_CODE */
+#else /* TCP_SND_AUTOTUNE */
     pcb->snd_buf = TCP_SND_BUF;
+#endif /* TCP_SND_AUTOTUNE */
     /* Start with a window that does not need scaling. When window scaling is
        enabled and used, the window is enlarged when both sides agree on scaling. */
     pcb->rcv_wnd = pcb->rcv_ann_wnd = TCPWND_MIN16(TCP_WND);
@@ -1897,8 +2085,8 @@ tcp_alloc(u8_t prio)
     /* As initial send MSS, we use TCP_MSS but limit it to 536.
        The send MSS is updated when an MSS option is received. */
     pcb->mss = INITIAL_MSS;
-    pcb->rto = 3000 / TCP_SLOW_INTERVAL;
-    pcb->sv = 3000 / TCP_SLOW_INTERVAL;
+    pcb->rto = TCP_RTO_INITIAL;
+    pcb->sv = TCP_RTO_INITIAL;
     pcb->rtime = -1;
     pcb->cwnd = 1;
     pcb->tmr = tcp_ticks;
@@ -2156,7 +2344,7 @@ tcp_pcb_purge(struct tcp_pcb *pcb)
 
     /* Stop the retransmission timer as it will expect data on unacked
        queue if it fires */
-    pcb->rtime = -1;
+    TCP_RTO_STOP(pcb);
 
     tcp_segs_free(pcb->unsent);
     tcp_segs_free(pcb->unacked);
@@ -2391,9 +2579,290 @@ tcp_free_ooseq(struct tcp_pcb *pcb)
 #if LWIP_TCP_SACK_OUT
     memset(pcb->rcv_sacks, 0, sizeof(pcb->rcv_sacks));
 #endif /* LWIP_TCP_SACK_OUT */
+#if TCP_OOSEQ_GOVERN
+    tcp_ooseq_account(pcb);
+#endif /* TCP_OOSEQ_GOVERN */
+  }
+}
+#endif /* TCP_QUEUE_OOSEQ */
+
+#if TCP_OOSEQ_GOVERN
+/* ETH_CODE: ooseq data of all pcbs, see TCP_OOSEQ_GOVERN */
+struct tcp_ooseq_stats tcp_ooseq_counters;
+
+/** ETH_CODE: Recount the ooseq queue of a pcb into the totals, after it
+ * may have changed. The queue is bounded by its limits, so walking it is
+ * cheap; pcbs without one are not called. */
+void
+tcp_ooseq_account(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg;
+  u16_t pbufs = 0;
+  u32_t bytes = 0;
+
+  for (seg = pcb->ooseq; seg != NULL; seg = seg->next) {
+    pbufs = (u16_t)(pbufs + pbuf_clen(seg->p));
+    bytes += seg->p->tot_len;
+  }
+  tcp_ooseq_counters.pbufs = tcp_ooseq_counters.pbufs - pcb->ooseq_pbufs + pbufs;
+  tcp_ooseq_counters.bytes = tcp_ooseq_counters.bytes - pcb->ooseq_bytes + bytes;
+  pcb->ooseq_pbufs = pbufs;
+  pcb->ooseq_bytes = bytes;
+  if (tcp_ooseq_counters.pbufs > tcp_ooseq_counters.pbufs_max) {
+    tcp_ooseq_counters.pbufs_max = tcp_ooseq_counters.pbufs;
+  }
+}
+
+/** ETH_CODE: TCP_OOSEQ_BYTES_LIMIT(pcb): the per-pcb limit, less what the
+ * other pcbs hold of the total; no growth while the pool is low. */
+u32_t
+tcp_ooseq_bytes_limit(const struct tcp_pcb *pcb)
+{
+  u32_t limit = (TCP_OOSEQ_MAX_BYTES != 0) ? (u32_t)TCP_OOSEQ_MAX_BYTES : 0xFFFFFFFFUL;
+#if TCP_OOSEQ_TOTAL_MAX_BYTES
+  u32_t others = tcp_ooseq_counters.bytes - pcb->ooseq_bytes;
+
+  limit = LWIP_MIN(limit, (others < TCP_OOSEQ_TOTAL_MAX_BYTES) ? TCP_OOSEQ_TOTAL_MAX_BYTES - others : 0U);
+#endif /* TCP_OOSEQ_TOTAL_MAX_BYTES */
+  if (TCP_OOSEQ_POOL_LOW()) {
+    limit = LWIP_MIN(limit, pcb->ooseq_bytes);
+  }
+  return limit;
+}
+
+/** ETH_CODE: TCP_OOSEQ_PBUFS_LIMIT(pcb), as tcp_ooseq_bytes_limit() */
+u16_t
+tcp_ooseq_pbufs_limit(const struct tcp_pcb *pcb)
+{
+  u32_t limit = (TCP_OOSEQ_MAX_PBUFS != 0) ? (u32_t)TCP_OOSEQ_MAX_PBUFS : 0xFFFFUL;
+#if TCP_OOSEQ_TOTAL_MAX_PBUFS
+  u32_t others = tcp_ooseq_counters.pbufs - pcb->ooseq_pbufs;
+
+  limit = LWIP_MIN(limit, (others < TCP_OOSEQ_TOTAL_MAX_PBUFS) ? TCP_OOSEQ_TOTAL_MAX_PBUFS - others : 0U);
+#endif /* TCP_OOSEQ_TOTAL_MAX_PBUFS */
+  if (TCP_OOSEQ_POOL_LOW()) {
+    tcp_ooseq_counters.pool_low++;
+    limit = LWIP_MIN(limit, pcb->ooseq_pbufs);
+  }
+  return (u16_t)limit;
+}
+
+/**
+ * ETH_CODE: Free whole ooseq queues, the one holding most pbufs first,
+ * until at least pbufs pbufs are released or no queue is left. The peers
+ * retransmit the data; SACK state goes with the queue.
+ *
+ * @param pbufs pbufs wanted back
+ * @return pbufs released
+ */
+u32_t
+tcp_ooseq_evict(u32_t pbufs)
+{
+  u32_t freed = 0;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  while (freed < pbufs) {
+    struct tcp_pcb *pcb;
+    struct tcp_pcb *victim = NULL;
+
+    for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+      if ((pcb->ooseq != NULL) && ((victim == NULL) || (pcb->ooseq_pbufs > victim->ooseq_pbufs))) {
+        victim = pcb;
+      }
+    }
+    if (victim == NULL) {
+      break;
+    }
+    freed += victim->ooseq_pbufs;
+    tcp_free_ooseq(victim);
+    tcp_ooseq_counters.evicted++;
+  }
+  tcp_ooseq_counters.evicted_pbufs += freed;
+  return freed;
+}
+
+/** ETH_CODE: Copy of the ooseq counters; core lock held */
+void
+tcp_ooseq_get_stats(struct tcp_ooseq_stats *stats)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  *stats = tcp_ooseq_counters;
+}
+#endif /* TCP_OOSEQ_GOVERN */
+
+#if TCP_SND_AUTOTUNE
+/* ETH_CODE: send buffers of all pcbs, see TCP_SND_AUTOTUNE */
+static struct tcp_snd_tune_stats tcp_snd_tune_counters;
+
+/** ETH_CODE: Change the send buffer of pcb by delta bytes. Queued data
+ * keeps its room: a shrink takes only what is free. The queue length
+ * limit keeps the ratio of TCP_SND_QUEUELEN to TCP_SND_BUF.
+ *
+ * @return the bytes the buffer changed by
+ */
+static s32_t
+tcp_snd_tune_resize(struct tcp_pcb *pcb, s32_t delta)
+{
+  u32_t queuelen;
+
+  if ((delta < 0) && ((u32_t)-delta > pcb->snd_buf)) {
+    delta = -(s32_t)pcb->snd_buf;
+  }
+  pcb->snd_buf = (tcpwnd_size_t)(pcb->snd_buf + delta);
+  pcb->snd_buf_max = (tcpwnd_size_t)(pcb->snd_buf_max + delta);
+  queuelen = ((u32_t)pcb->snd_buf_max * TCP_SND_QUEUELEN + TCP_SND_BUF - 1U) / TCP_SND_BUF;
+  pcb->snd_queuelen_max = (u16_t)LWIP_MIN(LWIP_MAX(queuelen, 2U), TCP_SNDQUEUELEN_OVERFLOW);
+  return delta;
+}
+
+/** ETH_CODE: A new pcb starts at TCP_SND_BUF_MIN */
+void
+tcp_snd_tune_init(struct tcp_pcb *pcb)
+{
+  (void)tcp_snd_tune_resize(pcb, TCP_SND_BUF_MIN);
+}
+
+/**
+ * ETH_CODE: Called by tcp_write() on a send buffer filled past half: the
+ * buffer grows to twice what the congestion and peer windows let out in
+ * a round trip, plus a segment, as far as TCP_SND_BUF_MAX and the budget
+ * allow.
+ */
+void
+tcp_snd_tune_demand(struct tcp_pcb *pcb)
+{
+  u32_t want;
+  u32_t room;
+
+  if (pcb->snd_buf >= pcb->snd_buf_max / 2U) {
+    return;
+  }
+  pcb->snd_tune_demand = 1;
+  want = 2U * (u32_t)LWIP_MIN(pcb->cwnd, pcb->snd_wnd) + TCP_MSS;
+  want = LWIP_MIN((want + TCP_MSS - 1U) / TCP_MSS * TCP_MSS, (u32_t)TCP_SND_BUF_MAX);
+  if (want <= pcb->snd_buf_max) {
+    return;
+  }
+  room = (tcp_snd_tune_counters.granted < TCP_SND_BUDGET) ? TCP_SND_BUDGET - tcp_snd_tune_counters.granted : 0U;
+  if (room == 0U) {
+    tcp_snd_tune_counters.denied++;
+    return;
+  }
+  tcp_snd_tune_counters.granted += (u32_t)tcp_snd_tune_resize(pcb, (s32_t)LWIP_MIN(want - pcb->snd_buf_max, room));
+  tcp_snd_tune_counters.grown++;
+  if (tcp_snd_tune_counters.granted > tcp_snd_tune_counters.granted_max) {
+    tcp_snd_tune_counters.granted_max = tcp_snd_tune_counters.granted;
+  }
+}
+
+/**
+ * ETH_CODE: Slow timer part of TCP_SND_AUTOTUNE: pcbs that did not ask for
+ * more since the last tick shrink toward twice their bandwidth-delay
+ * product, and the total given out is recounted over the active pcbs
+ * (the buffers of pcbs gone since are released here).
+ */
+static void
+tcp_snd_tune_tmr(void)
+{
+  struct tcp_pcb *pcb;
+  u32_t granted = 0;
+
+  for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+    pcb->snd_tune_rate = LWIP_MAX(pcb->snd_tune_acked, pcb->snd_tune_rate - pcb->snd_tune_rate / 4U);
+    pcb->snd_tune_acked = 0;
+    if (!pcb->snd_tune_demand && (pcb->snd_buf_max > TCP_SND_BUF_MIN)) {
+      /* bytes per tick x smoothed RTT (sa is 8 times it), 0 before a sample */
+      u64_t bdp = (u64_t)pcb->snd_tune_rate * TCP_RTT_MS((u32_t)LWIP_MAX(pcb->sa, 0) >> 3) / TCP_SLOW_INTERVAL;
+      u64_t target = (2U * bdp + 2U * TCP_MSS - 1U) / TCP_MSS * TCP_MSS;
+
+      target = LWIP_MAX(target, (u64_t)TCP_SND_BUF_MIN);
+      if ((target < pcb->snd_buf_max) &&
+          (tcp_snd_tune_resize(pcb, -(s32_t)(pcb->snd_buf_max - (u32_t)target)) != 0)) {
+        tcp_snd_tune_counters.shrunk++;
+      }
+    }
+    pcb->snd_tune_demand = 0;
+    granted += pcb->snd_buf_max - TCP_SND_BUF_MIN;
   }
+  tcp_snd_tune_counters.granted = granted;
 }
+
+/** ETH_CODE: Copy of the TCP_SND_AUTOTUNE counters; core lock held */
+void
+tcp_snd_tune_get_stats(struct tcp_snd_tune_stats *stats)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  *stats = tcp_snd_tune_counters;
+}
+#endif /* TCP_SND_AUTOTUNE */
+
+#if TCP_CONN_STATS
+/* ETH_CODE: sa and sv in ms */
+#if TCP_RTO_MS
+#define TCP_CONN_MS(t) ((t) > 0 ? (u32_t)(t) : 0U)
+#else
+#define TCP_CONN_MS(t) ((t) > 0 ? (u32_t)(t) * TCP_SLOW_INTERVAL : 0U)
+#endif
+
+/**
+ * ETH_CODE: Copy the congestion and window state and the TCP_CONN_STATS
+ * counters of up to max active pcbs, in list order (most recent first).
+ * The ooseq queues are walked; they are bounded by their limits.
+ *
+ * @param info max entries
+ * @param max size of info
+ * @return entries filled
+ */
+u16_t
+tcp_conn_snapshot(struct tcp_conn_info *info, u16_t max)
+{
+  struct tcp_pcb *pcb;
+  u16_t n = 0;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  for (pcb = tcp_active_pcbs; (pcb != NULL) && (n < max); pcb = pcb->next, n++) {
+    struct tcp_conn_info *c = &info[n];
+
+    ip_addr_copy(c->local_ip, pcb->local_ip);
+    ip_addr_copy(c->remote_ip, pcb->remote_ip);
+    c->local_port = pcb->local_port;
+    c->remote_port = pcb->remote_port;
+    c->state = (u8_t)pcb->state;
+    c->nrtx = pcb->nrtx;
+    c->mss = pcb->mss;
+    /* sa is 8 times the smoothed RTT, sv 4 times its mean deviation */
+    c->srtt_ms = TCP_CONN_MS(pcb->sa >> 3);
+    c->rttvar_ms = TCP_CONN_MS(pcb->sv >> 2);
+    c->rto_ms = TCP_CONN_MS(pcb->rto);
+    c->cwnd = pcb->cwnd;
+    c->ssthresh = pcb->ssthresh;
+    c->snd_wnd = pcb->snd_wnd;
+    c->rcv_ann_wnd = pcb->rcv_ann_wnd;
+    c->snd_buf = pcb->snd_buf;
+    c->snd_buf_max = tcp_sndbuf_max(pcb);
+    c->in_flight = pcb->snd_nxt - pcb->lastack;
+    c->snd_queuelen = pcb->snd_queuelen;
+    c->ooseq_pbufs = 0;
+    c->ooseq_bytes = 0;
+#if TCP_QUEUE_OOSEQ
+    {
+      struct tcp_seg *seg;
+
+      for (seg = pcb->ooseq; seg != NULL; seg = seg->next) {
+        c->ooseq_pbufs = (u16_t)(c->ooseq_pbufs + pbuf_clen(seg->p));
+        c->ooseq_bytes += seg->p->tot_len;
+      }
+    }
 #endif /* TCP_QUEUE_OOSEQ */
+    c->rexmit_rto = pcb->rexmit_rto;
+    c->rexmit_fast = pcb->rexmit_fast;
+    c->snd_wnd_stalls = pcb->snd_wnd_stalls;
+    c->snd_buf_stalls = pcb->snd_buf_stalls;
+    c->rcv_wnd_stalls = pcb->rcv_wnd_stalls;
+  }
+  return n;
+}
+#endif /* TCP_CONN_STATS */
 
 #if TCP_DEBUG || TCP_INPUT_DEBUG || TCP_OUTPUT_DEBUG
 /**
@@ -87,6 +87,11 @@ static struct pbuf *recv_data;
 
 struct tcp_pcb *tcp_input_pcb;
 
+#if TCP_ACK_BATCH
+/* ETH_CODE: set between tcp_ack_batch_begin() and tcp_ack_batch_end() */
+static u8_t tcp_ack_batch;
+#endif /* TCP_ACK_BATCH */
+
 /* Forward declarations. */
 static err_t tcp_process(struct tcp_pcb *pcb);
 static void tcp_receive(struct tcp_pcb *pcb);
@@ -105,6 +110,47 @@ static void tcp_remove_sacks_gt(struct tcp_pcb *pcb, u32_t seq);
 #endif /* TCP_OOSEQ_BYTES_LIMIT || TCP_OOSEQ_PBUFS_LIMIT */
 #endif /* LWIP_TCP_SACK_OUT */
 
+#if TCP_ACK_BATCH
+/**
+ * ETH_CODE: Start a batch of received frames. Until tcp_ack_batch_end(),
+ * tcp_input() does not call tcp_output() for the connections it delivers
+ * to, so ACKs and replies wait for the end of the batch.
+ * Called with the core lock held.
+ */
+void
+tcp_ack_batch_begin(void)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  tcp_ack_batch = 1;
+}
+
+/**
+ * ETH_CODE: End a batch started by tcp_ack_batch_begin(): call the output
+ * skipped by tcp_input(), once per connection. A connection just moved to
+ * TIME_WAIT still has to acknowledge the FIN.
+ */
+void
+tcp_ack_batch_end(void)
+{
+  struct tcp_pcb *pcb;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  tcp_ack_batch = 0;
+  for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+    if (pcb->ack_batched) {
+      pcb->ack_batched = 0;
+      tcp_output(pcb);
+    }
+  }
+  for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
+    if (pcb->ack_batched) {
+      pcb->ack_batched = 0;
+      tcp_output(pcb);
+    }
+  }
+}
+#endif /* TCP_ACK_BATCH */
+
 /**
  * The initial input processing of TCP. It verifies the TCP header, demultiplexes
  * the segment between the PCBs and passes it on to tcp_process(), which implements
@@ -123,6 +169,9 @@ tcp_input(struct pbuf *p, struct netif *inp)
   struct tcp_pcb *lpcb_prev = NULL;
   struct tcp_pcb_listen *lpcb_any = NULL;
 #endif /* SO_REUSE */
+#if TCP_PCB_HASH
+  u32_t bucket;
+#endif /* TCP_PCB_HASH */
   u8_t hdrlen_bytes;
   err_t err;
 
@@ -247,7 +296,13 @@ tcp_input(struct pbuf *p, struct netif *inp)
      for an active connection. */
   prev = NULL;
 
+#if TCP_PCB_HASH
+  /* ETH_CODE: only the pcbs in the bucket of the ports and source address */
+  bucket = tcp_pcb_hash_bucket(tcphdr->dest, tcphdr->src, ip_current_src_addr());
+  for (pcb = tcp_pcb_hash_active[bucket]; pcb != NULL; pcb = pcb->hnext) {
+#else /* TCP_PCB_HASH */
   for (pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+#endif /* TCP_PCB_HASH */
     LWIP_ASSERT("tcp_input: active pcb->state != CLOSED", pcb->state != CLOSED);
     LWIP_ASSERT("tcp_input: active pcb->state != TIME-WAIT", pcb->state != TIME_WAIT);
     LWIP_ASSERT("tcp_input: active pcb->state != LISTEN", pcb->state != LISTEN);
@@ -268,9 +323,16 @@ tcp_input(struct pbuf *p, struct netif *inp)
          arrivals). */
       LWIP_ASSERT("tcp_input: pcb->next != pcb (before cache)", pcb->next != pcb);
       if (prev != NULL) {
+#if TCP_PCB_HASH
+        /* ETH_CODE: to the front of its bucket */
+        prev->hnext = pcb->hnext;
+        pcb->hnext = tcp_pcb_hash_active[bucket];
+        tcp_pcb_hash_active[bucket] = pcb;
+#else /* TCP_PCB_HASH */
         prev->next = pcb->next;
         pcb->next = tcp_active_pcbs;
         tcp_active_pcbs = pcb;
+#endif /* TCP_PCB_HASH */
       } else {
         TCP_STATS_INC(tcp.cachehit);
       }
@@ -283,7 +345,11 @@ tcp_input(struct pbuf *p, struct netif *inp)
   if (pcb == NULL) {
     /* If it did not go to an active connection, we check the connections
        in the TIME-WAIT state. */
+#if TCP_PCB_HASH
+    for (pcb = tcp_pcb_hash_tw[bucket]; pcb != NULL; pcb = pcb->hnext) {
+#else /* TCP_PCB_HASH */
     for (pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
+#endif /* TCP_PCB_HASH */
       LWIP_ASSERT("tcp_input: TIME-WAIT pcb->state == TIME-WAIT", pcb->state == TIME_WAIT);
 
       /* check if PCB is bound to specific netif */
@@ -315,7 +381,13 @@ tcp_input(struct pbuf *p, struct netif *inp)
     /* Finally, if we still did not get a match, we check all PCBs that
        are LISTENing for incoming connections. */
     prev = NULL;
+#if TCP_PCB_HASH
+    /* ETH_CODE: the listeners on the destination port */
+    bucket = tcp_pcb_hash_bucket(tcphdr->dest, 0, NULL);
+    for (lpcb = (struct tcp_pcb_listen *)tcp_pcb_hash_listen[bucket]; lpcb != NULL; lpcb = lpcb->hnext) {
+#else /* TCP_PCB_HASH */
     for (lpcb = tcp_listen_pcbs.listen_pcbs; lpcb != NULL; lpcb = lpcb->next) {
+#endif /* TCP_PCB_HASH */
       /* check if PCB is bound to specific netif */
       if ((lpcb->netif_idx != NETIF_NO_INDEX) &&
           (lpcb->netif_idx != netif_get_index(ip_data.current_input_netif))) {
@@ -362,11 +434,18 @@ tcp_input(struct pbuf *p, struct netif *inp)
          lookups will be faster (we exploit locality in TCP segment
          arrivals). */
       if (prev != NULL) {
+#if TCP_PCB_HASH
+        /* ETH_CODE: to the front of its bucket */
+        ((struct tcp_pcb_listen *)prev)->hnext = lpcb->hnext;
+        lpcb->hnext = (struct tcp_pcb_listen *)tcp_pcb_hash_listen[bucket];
+        tcp_pcb_hash_listen[bucket] = (struct tcp_pcb *)lpcb;
+#else /* TCP_PCB_HASH */
         ((struct tcp_pcb_listen *)prev)->next = lpcb->next;
         /* our successor is the remainder of the listening list */
         lpcb->next = tcp_listen_pcbs.listen_pcbs;
         /* put this listening pcb at the head of the listening list */
         tcp_listen_pcbs.listen_pcbs = lpcb;
+#endif /* TCP_PCB_HASH */
       } else {
         TCP_STATS_INC(tcp.cachehit);
       }
@@ -550,7 +629,15 @@ tcp_input(struct pbuf *p, struct netif *inp)
           goto aborted;
         }
         /* Try to send something out. */
-        tcp_output(pcb);
+#if TCP_ACK_BATCH
+        if (tcp_ack_batch) {
+          /* ETH_CODE: tcp_ack_batch_end() sends for the whole batch */
+          pcb->ack_batched = 1;
+        } else
+#endif /* TCP_ACK_BATCH */
+        {
+          tcp_output(pcb);
+        }
 #if TCP_INPUT_DEBUG
 #if TCP_DEBUG
         tcp_debug_print_state(pcb->state);
@@ -891,9 +978,9 @@ tcp_process(struct tcp_pcb *pcb)
         /* If there's nothing left to acknowledge, stop the retransmit
            timer, otherwise reset it to start again */
         if (pcb->unacked == NULL) {
-          pcb->rtime = -1;
+          TCP_RTO_STOP(pcb);
         } else {
-          pcb->rtime = 0;
+          TCP_RTO_START(pcb);
           pcb->nrtx = 0;
         }
 
@@ -914,7 +1001,7 @@ tcp_process(struct tcp_pcb *pcb)
           connection faster, but do not send more SYNs than we otherwise would
           have, or we might get caught in a loop on loopback interfaces. */
         if (pcb->nrtx < TCP_SYNMAXRTX) {
-          pcb->rtime = 0;
+          TCP_RTO_START(pcb);
           tcp_rexmit_rto(pcb);
         }
       }
@@ -1140,7 +1227,7 @@ tcp_free_acked_segments(struct tcp_pcb *pcb, struct tcp_seg *seg_list, const cha
 static void
 tcp_receive(struct tcp_pcb *pcb)
 {
-  s16_t m;
+  tcp_rto_t m;
   u32_t right_wnd_edge;
   int found_dupack = 0;
 
@@ -1242,7 +1329,7 @@ tcp_receive(struct tcp_pcb *pcb)
       pcb->nrtx = 0;
 
       /* Reset the retransmission time-out. */
-      pcb->rto = (s16_t)((pcb->sa >> 3) + pcb->sv);
+      pcb->rto = TCP_RTO_CALC(pcb);
 
       /* Record how much data this ACK acks */
       acked = (tcpwnd_size_t)(ackno - pcb->lastack);
@@ -1293,9 +1380,9 @@ tcp_receive(struct tcp_pcb *pcb)
       /* If there's nothing left to acknowledge, stop the retransmit
          timer, otherwise reset it to start again */
       if (pcb->unacked == NULL) {
-        pcb->rtime = -1;
+        TCP_RTO_STOP(pcb);
       } else {
-        pcb->rtime = 0;
+        TCP_RTO_START(pcb);
       }
 
       pcb->polltmr = 0;
@@ -1314,6 +1401,9 @@ tcp_receive(struct tcp_pcb *pcb)
 #endif /* LWIP_IPV6 && LWIP_ND6_TCP_REACHABILITY_HINTS*/
 
       pcb->snd_buf = (tcpwnd_size_t)(pcb->snd_buf + recv_acked);
+#if TCP_SND_AUTOTUNE
+      pcb->snd_tune_acked += recv_acked; /* ETH_CODE */
+#endif /* TCP_SND_AUTOTUNE */
       /* check if this ACK ends our retransmission of in-flight data */
       if (pcb->flags & TF_RTO) {
         /* RTO is done if
@@ -1344,23 +1434,23 @@ tcp_receive(struct tcp_pcb *pcb)
     if (pcb->rttest && TCP_SEQ_LT(pcb->rtseq, ackno)) {
       /* diff between this shouldn't exceed 32K since this are tcp timer ticks
          and a round-trip shouldn't be that long... */
-      m = (s16_t)(tcp_ticks - pcb->rttest);
+      m = (tcp_rto_t)(TCP_RTT_STAMP() - pcb->rttest);
 
-      LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: experienced rtt %"U16_F" ticks (%"U16_F" msec).\n",
-                                  m, (u16_t)(m * TCP_SLOW_INTERVAL)));
+      LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: experienced rtt %"TCPRTO_F" (%"U32_F" msec).\n",
+                                  m, (u32_t)TCP_RTT_MS(m)));
 
       /* This is taken directly from VJs original code in his paper */
-      m = (s16_t)(m - (pcb->sa >> 3));
-      pcb->sa = (s16_t)(pcb->sa + m);
+      m = (tcp_rto_t)(m - (pcb->sa >> 3));
+      pcb->sa = (tcp_rto_t)(pcb->sa + m);
       if (m < 0) {
-        m = (s16_t) - m;
+        m = (tcp_rto_t) - m;
       }
-      m = (s16_t)(m - (pcb->sv >> 2));
-      pcb->sv = (s16_t)(pcb->sv + m);
-      pcb->rto = (s16_t)((pcb->sa >> 3) + pcb->sv);
+      m = (tcp_rto_t)(m - (pcb->sv >> 2));
+      pcb->sv = (tcp_rto_t)(pcb->sv + m);
+      pcb->rto = TCP_RTO_CALC(pcb);
 
-      LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: RTO %"U16_F" (%"U16_F" milliseconds)\n",
-                                  pcb->rto, (u16_t)(pcb->rto * TCP_SLOW_INTERVAL)));
+      LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_receive: RTO %"TCPRTO_F" (%"U32_F" milliseconds)\n",
+                                  pcb->rto, (u32_t)TCP_RTT_MS(pcb->rto)));
 
       pcb->rttest = 0;
     }
@@ -1845,6 +1935,9 @@ tcp_receive(struct tcp_pcb *pcb)
             }
 #endif
             if (stop_here) {
+#if TCP_OOSEQ_GOVERN
+              tcp_ooseq_counters.trimmed++;
+#endif /* TCP_OOSEQ_GOVERN */
 #if LWIP_TCP_SACK_OUT
               if (pcb->flags & TF_SACK) {
                 /* Let's remove all SACKs from next's seqno up. */
@@ -1882,6 +1975,12 @@ tcp_receive(struct tcp_pcb *pcb)
       tcp_ack_now(pcb);
     }
   }
+#if TCP_OOSEQ_GOVERN
+  /* ETH_CODE: the queue may have grown, been cut back or drained above */
+  if ((pcb->ooseq != NULL) || (pcb->ooseq_pbufs != 0)) {
+    tcp_ooseq_account(pcb);
+  }
+#endif /* TCP_OOSEQ_GOVERN */
 }
 
 static u8_t
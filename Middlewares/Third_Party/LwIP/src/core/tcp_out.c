@@ -74,7 +74,7 @@
 #include "lwip/stats.h"
 #include "lwip/ip6.h"
 #include "lwip/ip6_addr.h"
-#if LWIP_TCP_TIMESTAMPS
+#if LWIP_TCP_TIMESTAMPS || LWIP_TCP_TXREF
 #include "lwip/sys.h"
 #endif
 
@@ -322,6 +322,12 @@ tcp_write_checks(struct tcp_pcb *pcb, u16_t len)
     LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SEVERE, ("tcp_write: too much data (len=%"U16_F" > snd_buf=%"TCPWNDSIZE_F")\n",
                 len, pcb->snd_buf));
     tcp_set_flags(pcb, TF_NAGLEMEMERR);
+#if TCP_CONN_STATS
+    pcb->snd_buf_stalls++; /* ETH_CODE */
+#endif /* TCP_CONN_STATS */
+#if TCP_SND_AUTOTUNE
+    tcp_snd_tune_demand(pcb); /* ETH_CODE: room for the next call */
+#endif /* TCP_SND_AUTOTUNE */
     return ERR_MEM;
   }
 
@@ -330,11 +336,15 @@ tcp_write_checks(struct tcp_pcb *pcb, u16_t len)
   /* If total number of pbufs on the unsent/unacked queues exceeds the
    * configured maximum, return an error */
   /* check for configured max queuelen and possible overflow */
-  if (pcb->snd_queuelen >= LWIP_MIN(TCP_SND_QUEUELEN, (TCP_SNDQUEUELEN_OVERFLOW + 1))) {
+  /* ETH_CODE: the pcb's limit, see TCP_SND_AUTOTUNE */
+  if (pcb->snd_queuelen >= LWIP_MIN(tcp_sndqueuelen_max(pcb), (TCP_SNDQUEUELEN_OVERFLOW + 1))) {
     LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SEVERE, ("tcp_write: too long queue %"U16_F" (max %"U16_F")\n",
-                pcb->snd_queuelen, (u16_t)TCP_SND_QUEUELEN));
+                pcb->snd_queuelen, (u16_t)tcp_sndqueuelen_max(pcb)));
     TCP_STATS_INC(tcp.memerr);
     tcp_set_flags(pcb, TF_NAGLEMEMERR);
+#if TCP_CONN_STATS
+    pcb->snd_buf_stalls++; /* ETH_CODE */
+#endif /* TCP_CONN_STATS */
     return ERR_MEM;
   }
   if (pcb->snd_queuelen != 0) {
@@ -347,6 +357,100 @@ tcp_write_checks(struct tcp_pcb *pcb, u16_t len)
   return ERR_OK;
 }
 
+#if LWIP_TCP_TXREF
+#if !LWIP_SUPPORT_CUSTOM_PBUF
+#error "LWIP_TCP_TXREF needs LWIP_SUPPORT_CUSTOM_PBUF"
+#endif
+/* ETH_CODE: a ROM pbuf whose free drops a reference of a tcp_txref */
+struct tcp_txref_pbuf {
+  struct pbuf_custom pc;
+  struct tcp_txref *ref;
+};
+
+LWIP_MEMPOOL_DECLARE(TCP_TXREF, MEMP_NUM_TCP_TXREF, sizeof(struct tcp_txref_pbuf), "TCP_TXREF")
+
+/** ETH_CODE: the reference of the tcp_write_ref() call in progress */
+static struct tcp_txref *tcp_txref_cur;
+
+void
+tcp_txref_pool_init(void)
+{
+  LWIP_MEMPOOL_INIT(TCP_TXREF);
+}
+
+static void
+tcp_txref_pbuf_free(struct pbuf *p)
+{
+  struct tcp_txref_pbuf *r = (struct tcp_txref_pbuf *)p;
+  struct tcp_txref *ref = r->ref;
+  LWIP_MEMPOOL_FREE(TCP_TXREF, r);
+  tcp_txref_release(ref);
+}
+
+/**
+ * @ingroup tcp_raw
+ * ETH_CODE: Prepare a reference for tcp_write_ref(). It starts with the
+ * caller's own reference, which tcp_txref_release() drops after the last
+ * write: done is not called before that, even if the writes are acked.
+ *
+ * @param ref the reference, owned by the caller until done is called
+ * @param done called once, see tcp_txref_fn
+ * @param arg stored in ref->arg for done
+ */
+void
+tcp_txref_init(struct tcp_txref *ref, tcp_txref_fn done, void *arg)
+{
+  LWIP_ASSERT("tcp_txref_init: invalid ref", (ref != NULL) && (done != NULL));
+  ref->refs = 1;
+  ref->done = done;
+  ref->arg = arg;
+}
+
+/**
+ * @ingroup tcp_raw
+ * ETH_CODE: Drop a reference; done is called when it was the last one.
+ * Pbufs are freed by the tcpip thread and (TX complete) the driver,
+ * hence the protection.
+ */
+void
+tcp_txref_release(struct tcp_txref *ref)
+{
+  u16_t refs;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  LWIP_ASSERT("tcp_txref_release: not referenced", ref->refs > 0);
+  refs = --ref->refs;
+  SYS_ARCH_UNPROTECT(lev);
+  if (refs == 0) {
+    ref->done(ref);
+  }
+}
+#endif /* LWIP_TCP_TXREF */
+
+/* ETH_CODE: a pbuf referencing len bytes of tcp_write() data (not copied) */
+static struct pbuf *
+tcp_write_rom_alloc(pbuf_layer layer, u16_t len)
+{
+#if LWIP_TCP_TXREF
+  if (tcp_txref_cur != NULL) {
+    struct tcp_txref_pbuf *r = (struct tcp_txref_pbuf *)LWIP_MEMPOOL_ALLOC(TCP_TXREF);
+    SYS_ARCH_DECL_PROTECT(lev);
+    if (r == NULL) {
+      return NULL;
+    }
+    r->pc.custom_free_function = tcp_txref_pbuf_free;
+    r->ref = tcp_txref_cur;
+    SYS_ARCH_PROTECT(lev);
+    tcp_txref_cur->refs++;
+    SYS_ARCH_UNPROTECT(lev);
+    /* no header room needed: the headers go in a separate pbuf */
+    return pbuf_alloced_custom(PBUF_RAW, len, PBUF_ROM, &r->pc, NULL, len);
+  }
+#endif /* LWIP_TCP_TXREF */
+  return pbuf_alloc(layer, len, PBUF_ROM);
+}
+
 /**
  * @ingroup tcp_raw
  * Write data for sending (but does not send it immediately).
@@ -557,11 +661,15 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
         struct pbuf *p;
         for (p = last_unsent->p; p->next != NULL; p = p->next);
         if (((p->type_internal & (PBUF_TYPE_FLAG_STRUCT_DATA_CONTIGUOUS | PBUF_TYPE_FLAG_DATA_VOLATILE)) == 0) &&
+#if LWIP_TCP_TXREF
+            /* ETH_CODE: each pbuf counts for the reference of its own data */
+            (tcp_txref_cur == NULL) && ((p->flags & PBUF_FLAG_IS_CUSTOM) == 0) &&
+#endif /* LWIP_TCP_TXREF */
             (const u8_t *)p->payload + p->len == (const u8_t *)arg) {
           LWIP_ASSERT("tcp_write: ROM pbufs cannot be oversized", pos == 0);
           extendlen = seglen;
         } else {
-          if ((concat_p = pbuf_alloc(PBUF_RAW, seglen, PBUF_ROM)) == NULL) {
+          if ((concat_p = tcp_write_rom_alloc(PBUF_RAW, seglen)) == NULL) {
             LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS,
                         ("tcp_write: could not allocate memory for zero-copy pbuf\n"));
             goto memerr;
@@ -624,7 +732,7 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
 #if TCP_OVERSIZE
       LWIP_ASSERT("oversize == 0", oversize == 0);
 #endif /* TCP_OVERSIZE */
-      if ((p2 = pbuf_alloc(PBUF_TRANSPORT, seglen, PBUF_ROM)) == NULL) {
+      if ((p2 = tcp_write_rom_alloc(PBUF_TRANSPORT, seglen)) == NULL) {
         LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_write: could not allocate memory for zero-copy pbuf\n"));
         goto memerr;
       }
@@ -656,9 +764,9 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
     /* Now that there are more segments queued, we check again if the
      * length of the queue exceeds the configured maximum or
      * overflows. */
-    if (queuelen > LWIP_MIN(TCP_SND_QUEUELEN, TCP_SNDQUEUELEN_OVERFLOW)) {
+    if (queuelen > LWIP_MIN(tcp_sndqueuelen_max(pcb), TCP_SNDQUEUELEN_OVERFLOW)) { /* ETH_CODE: the pcb's limit */
       LWIP_DEBUGF(TCP_OUTPUT_DEBUG | LWIP_DBG_LEVEL_SERIOUS, ("tcp_write: queue too long %"U16_F" (%d)\n",
-                  queuelen, (int)TCP_SND_QUEUELEN));
+                  queuelen, (int)tcp_sndqueuelen_max(pcb)));
       pbuf_free(p);
       goto memerr;
     }
@@ -779,6 +887,9 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
   pcb->snd_lbb += len;
   pcb->snd_buf -= len;
   pcb->snd_queuelen = queuelen;
+#if TCP_SND_AUTOTUNE
+  tcp_snd_tune_demand(pcb); /* ETH_CODE */
+#endif /* TCP_SND_AUTOTUNE */
 
   LWIP_DEBUGF(TCP_QLEN_DEBUG, ("tcp_write: %"S16_F" (after enqueued)\n",
                                pcb->snd_queuelen));
@@ -811,6 +922,34 @@ memerr:
   return ERR_MEM;
 }
 
+#if LWIP_TCP_TXREF
+/**
+ * @ingroup tcp_raw
+ * ETH_CODE: tcp_write() without TCP_WRITE_FLAG_COPY that takes a reference
+ * of ref for every pbuf holding the data, so ref->done tells when the
+ * memory can be reused: once the data is acked and the driver is done
+ * with it, or dropped with the pcb. Several writes can share one ref.
+ * Such pbufs are never extended by a later write; the data must stay
+ * unchanged until done. Failing with ERR_MEM (send buffer or the
+ * MEMP_NUM_TCP_TXREF pool) leaves no reference behind.
+ *
+ * @param pcb, dataptr, len, apiflags see tcp_write()
+ * @param ref from tcp_txref_init()
+ */
+err_t
+tcp_write_ref(struct tcp_pcb *pcb, const void *dataptr, u16_t len, u8_t apiflags,
+              struct tcp_txref *ref)
+{
+  err_t err;
+
+  LWIP_ERROR("tcp_write_ref: invalid ref", (ref != NULL) && (ref->refs > 0), return ERR_ARG);
+  tcp_txref_cur = ref;
+  err = tcp_write(pcb, dataptr, len, (u8_t)(apiflags & ~TCP_WRITE_FLAG_COPY));
+  tcp_txref_cur = NULL;
+  return err;
+}
+#endif /* LWIP_TCP_TXREF */
+
 /**
  * Split segment on the head of the unsent queue.  If return is not
  * ERR_OK, existing head remains intact
@@ -1313,6 +1452,9 @@ tcp_output(struct tcp_pcb *pcb)
       pcb->persist_cnt = 0;
       pcb->persist_backoff = 1;
       pcb->persist_probe = 0;
+#if TCP_CONN_STATS
+      pcb->snd_wnd_stalls++; /* ETH_CODE */
+#endif /* TCP_CONN_STATS */
     }
     /* We need an ACK, but can't send data now, so send an empty ACK */
     if (pcb->flags & TF_ACK_NOW) {
@@ -1328,6 +1470,8 @@ tcp_output(struct tcp_pcb *pcb)
   if (useg != NULL) {
     for (; useg->next != NULL; useg = useg->next);
   }
+  /* ETH_CODE: let the driver start the DMA once for all segments below */
+  netif_tx_batch_begin(netif);
   /* data available and window allows it to be sent? */
   while (seg != NULL &&
          lwip_ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len <= wnd) {
@@ -1361,6 +1505,7 @@ tcp_output(struct tcp_pcb *pcb)
     if (err != ERR_OK) {
       /* segment could not be sent, for whatever reason */
       tcp_set_flags(pcb, TF_NAGLEMEMERR);
+      netif_tx_batch_end(netif);
       return err;
     }
 #if TCP_OVERSIZE_DBGCHECK
@@ -1407,6 +1552,7 @@ tcp_output(struct tcp_pcb *pcb)
     }
     seg = pcb->unsent;
   }
+  netif_tx_batch_end(netif);
 #if TCP_OVERSIZE
   if (pcb->unsent == NULL) {
     /* last unsent has been removed, reset unsent_oversize */
@@ -1489,6 +1635,9 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
   }
 
   pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
+#if TCP_ACK_EVERY != 2
+  pcb->ack_segs = 0;
+#endif
 
   /* Add any requested options.  NB MSS option is only set on SYN
      packets, so ignore it here */
@@ -1532,11 +1681,11 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb, struct netif *netif
   /* Set retransmission timer running if it is not currently enabled
      This must be set before checking the route. */
   if (pcb->rtime < 0) {
-    pcb->rtime = 0;
+    TCP_RTO_START(pcb);
   }
 
   if (pcb->rttest == 0) {
-    pcb->rttest = tcp_ticks;
+    pcb->rttest = TCP_RTT_STAMP();
     pcb->rtseq = lwip_ntohl(seg->tcphdr->seqno);
 
     LWIP_DEBUGF(TCP_RTO_DEBUG, ("tcp_output_segment: rtseq %"U32_F"\n", pcb->rtseq));
@@ -1691,6 +1840,9 @@ tcp_rexmit_rto_commit(struct tcp_pcb *pcb)
   if (pcb->nrtx < 0xFF) {
     ++pcb->nrtx;
   }
+#if TCP_CONN_STATS
+  pcb->rexmit_rto++; /* ETH_CODE */
+#endif /* TCP_CONN_STATS */
   /* Do the actual retransmission */
   tcp_output(pcb);
 }
@@ -1807,9 +1959,12 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
 
       pcb->cwnd = pcb->ssthresh + 3 * pcb->mss;
       tcp_set_flags(pcb, TF_INFR);
+#if TCP_CONN_STATS
+      pcb->rexmit_fast++; /* ETH_CODE */
+#endif /* TCP_CONN_STATS */
 
       /* Reset the retransmission timer to prevent immediate rto retransmissions */
-      pcb->rtime = 0;
+      TCP_RTO_START(pcb);
     }
   }
 }
@@ -1863,6 +2018,9 @@ tcp_output_alloc_header(struct tcp_pcb *pcb, u16_t optlen, u16_t datalen,
   if (p != NULL) {
     /* If we're sending a packet, update the announced right window edge */
     pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
+#if TCP_ACK_EVERY != 2
+    pcb->ack_segs = 0;
+#endif
   }
   return p;
 }
@@ -442,7 +442,8 @@ sys_timeouts_sleeptime(void)
   }
 }
 
-#else /* LWIP_TIMERS && !LWIP_TIMERS_CUSTOM */
+#elif !TWHEEL_LWIP /* LWIP_TIMERS && !LWIP_TIMERS_CUSTOM */
+/* ETH_CODE: component/twheel starts and stops the TCP timer itself */
 /* Satisfy the TCP code which calls this function */
 void
 tcp_timer_needed(void)
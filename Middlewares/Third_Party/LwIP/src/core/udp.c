@@ -62,6 +62,10 @@
 #include "lwip/stats.h"
 #include "lwip/snmp.h"
 #include "lwip/dhcp.h"
+#if UDP_TPL
+#include "lwip/etharp.h"
+#include "lwip/sys.h"
+#endif /* UDP_TPL */
 
 #include <string.h>
 
@@ -80,6 +84,40 @@ static u16_t udp_port = UDP_LOCAL_PORT_RANGE_START;
 /* exported in udp.h (was static) */
 struct udp_pcb *udp_pcbs;
 
+#if UDP_PCB_HASH
+#if (UDP_PCB_HASH_SIZE & (UDP_PCB_HASH_SIZE - 1)) != 0
+#error "UDP_PCB_HASH_SIZE must be a power of 2"
+#endif
+/* ETH_CODE: udp_pcbs chained by local port, see UDP_PCB_HASH in opt.h */
+static struct udp_pcb *udp_pcb_hash[UDP_PCB_HASH_SIZE];
+
+#define UDP_PCB_HASH_HEAD(port) (&udp_pcb_hash[((u32_t)(port) * 2654435761UL >> 16) & (UDP_PCB_HASH_SIZE - 1)])
+
+/* ETH_CODE: chain a pcb on udp_pcbs under its local port */
+static void
+udp_pcb_hash_add(struct udp_pcb *pcb)
+{
+  struct udp_pcb **head = UDP_PCB_HASH_HEAD(pcb->local_port);
+  pcb->hnext = *head;
+  *head = pcb;
+}
+
+/* ETH_CODE: unchain a pcb, before its local port changes; a pcb not
+ * chained is left alone */
+static void
+udp_pcb_hash_rmv(struct udp_pcb *pcb)
+{
+  struct udp_pcb **link;
+  for (link = UDP_PCB_HASH_HEAD(pcb->local_port); *link != NULL; link = &(*link)->hnext) {
+    if (*link == pcb) {
+      *link = pcb->hnext;
+      pcb->hnext = NULL;
+      return;
+    }
+  }
+}
+#endif /* UDP_PCB_HASH */
+
 /**
  * Initialize this module.
  */
@@ -250,7 +288,12 @@ udp_input(struct pbuf *p, struct netif *inp)
    * 'Perfect match' pcbs (connected to the remote port & ip address) are
    * preferred. If no perfect match is found, the first unconnected pcb that
    * matches the local port and ip address gets the datagram. */
+#if UDP_PCB_HASH
+  /* ETH_CODE: only the pcbs bound to the destination port */
+  for (pcb = *UDP_PCB_HASH_HEAD(dest); pcb != NULL; pcb = pcb->hnext) {
+#else /* UDP_PCB_HASH */
   for (pcb = udp_pcbs; pcb != NULL; pcb = pcb->next) {
+#endif /* UDP_PCB_HASH */
     /* print the PCB local and remote address */
     LWIP_DEBUGF(UDP_DEBUG, ("pcb ("));
     ip_addr_debug_print_val(UDP_DEBUG, pcb->local_ip);
@@ -291,11 +334,18 @@ udp_input(struct pbuf *p, struct netif *inp)
            ip_addr_cmp(&pcb->remote_ip, ip_current_src_addr()))) {
         /* the first fully matching PCB */
         if (prev != NULL) {
+#if UDP_PCB_HASH
+          /* ETH_CODE: to the front of its bucket */
+          prev->hnext = pcb->hnext;
+          pcb->hnext = *UDP_PCB_HASH_HEAD(dest);
+          *UDP_PCB_HASH_HEAD(dest) = pcb;
+#else /* UDP_PCB_HASH */
           /* move the pcb to the front of udp_pcbs so that is
              found faster next time */
           prev->next = pcb->next;
           pcb->next = udp_pcbs;
           udp_pcbs = pcb;
+#endif /* UDP_PCB_HASH */
         } else {
           UDP_STATS_INC(udp.cachehit);
         }
@@ -908,6 +958,185 @@ udp_sendto_if_src_chksum(struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *d
   return err;
 }
 
+#if UDP_TPL
+/* ETH_CODE: see UDP_TPL_INVALIDATE() */
+u32_t udp_tpl_gen = 1;
+
+/**
+ * @ingroup udp_raw
+ * ETH_CODE: Set up a header template for pcb, built by the first
+ * udp_tpl_send(). Call it again after udp_connect(), udp_bind() or a
+ * ttl/tos change on the pcb.
+ *
+ * @param tpl the template
+ * @param pcb a connected UDP PCB
+ */
+void
+udp_tpl_init(struct udp_tpl *tpl, struct udp_pcb *pcb)
+{
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ERROR("udp_tpl_init: invalid tpl", tpl != NULL, return);
+
+  memset(tpl, 0, sizeof(*tpl));
+  tpl->pcb = pcb;
+}
+
+/* ETH_CODE: the headers udp_send() and etharp_output() would write for
+ * tpl->pcb. Only a unicast IPv4 peer over Ethernet with a stable ARP
+ * entry (for it or the gateway) gets a template. */
+static err_t
+udp_tpl_build(struct udp_tpl *tpl)
+{
+  struct udp_pcb *pcb = tpl->pcb;
+  struct netif *netif;
+  const ip4_addr_t *dst;
+  const ip4_addr_t *src;
+  const ip4_addr_t *nexthop;
+  const ip4_addr_t *unused;
+  struct eth_addr *ethaddr;
+  struct eth_hdr *ethhdr;
+  struct ip_hdr *iphdr;
+  struct udp_hdr *udphdr;
+
+  tpl->gen = 0;
+  if (!udp_is_flag_set(pcb, UDP_FLAGS_CONNECTED) || udp_is_flag_set(pcb, UDP_FLAGS_UDPLITE) ||
+      !IP_IS_V4(&pcb->remote_ip) || (pcb->local_port == 0)) {
+    return ERR_VAL;
+  }
+  dst = ip_2_ip4(&pcb->remote_ip);
+  if (pcb->netif_idx != NETIF_NO_INDEX) {
+    netif = netif_get_by_index(pcb->netif_idx);
+  } else {
+    netif = ip_route(&pcb->local_ip, &pcb->remote_ip);
+  }
+  if ((netif == NULL) || !netif_is_up(netif) || !netif_is_link_up(netif) ||
+      ((netif->flags & NETIF_FLAG_ETHARP) == 0) || ip4_addr_ismulticast(dst) ||
+      ip4_addr_isbroadcast(dst, netif) || ip4_addr_cmp(dst, netif_ip4_addr(netif))) {
+    return ERR_RTE;
+  }
+  if (ip_addr_isany(&pcb->local_ip)) {
+    src = netif_ip4_addr(netif);
+  } else if (ip4_addr_cmp(ip_2_ip4(&pcb->local_ip), netif_ip4_addr(netif))) {
+    src = ip_2_ip4(&pcb->local_ip);
+  } else {
+    return ERR_RTE;
+  }
+  nexthop = dst;
+  if (!ip4_addr_netcmp(dst, netif_ip4_addr(netif), netif_ip4_netmask(netif)) &&
+      !ip4_addr_islinklocal(dst)) {
+    if (ip4_addr_isany_val(*netif_ip4_gw(netif))) {
+      return ERR_RTE;
+    }
+    nexthop = netif_ip4_gw(netif);
+  }
+  if (etharp_find_addr(netif, nexthop, &ethaddr, &unused) < 0) {
+    return ERR_RTE;
+  }
+
+  memset(tpl->hdr, 0, sizeof(tpl->hdr));
+  ethhdr = (struct eth_hdr *)tpl->hdr;
+  SMEMCPY(&ethhdr->dest, ethaddr, ETH_HWADDR_LEN);
+  SMEMCPY(&ethhdr->src, netif->hwaddr, ETH_HWADDR_LEN);
+  ethhdr->type = PP_HTONS(ETHTYPE_IP);
+  iphdr = (struct ip_hdr *)&tpl->hdr[SIZEOF_ETH_HDR];
+  IPH_VHL_SET(iphdr, 4, IP_HLEN / 4);
+  IPH_TOS_SET(iphdr, pcb->tos);
+  IPH_TTL_SET(iphdr, pcb->ttl);
+  IPH_PROTO_SET(iphdr, IP_PROTO_UDP);
+  ip4_addr_copy(iphdr->src, *src);
+  ip4_addr_copy(iphdr->dest, *dst);
+  tpl->ip_sum = (u16_t)~inet_chksum(iphdr, IP_HLEN);
+  udphdr = (struct udp_hdr *)&tpl->hdr[SIZEOF_ETH_HDR + IP_HLEN];
+  udphdr->src = lwip_htons(pcb->local_port);
+  udphdr->dest = lwip_htons(pcb->remote_port);
+
+  tpl->netif = netif;
+  tpl->built = sys_now();
+  tpl->gen = udp_tpl_gen;
+  return ERR_OK;
+}
+
+/**
+ * @ingroup udp_raw
+ * ETH_CODE: udp_send() with the headers from tpl, straight to
+ * netif->linkoutput. Datagrams the template does not cover (no template
+ * yet, too big for the MTU, no room for the headers in p) and one per
+ * UDP_TPL_MAXAGE ms go through udp_send(), which also (re)builds it.
+ * Like udp_send(), p keeps the headers and stays the caller's.
+ *
+ * @param tpl the template, see udp_tpl_init()
+ * @param p chain of pbuf's to be sent, allocated with PBUF_TRANSPORT
+ * @return see udp_send()
+ */
+err_t
+udp_tpl_send(struct udp_tpl *tpl, struct pbuf *p)
+{
+  struct netif *netif;
+  struct ip_hdr *iphdr;
+  struct udp_hdr *udphdr;
+  u16_t len;
+  err_t err;
+
+  LWIP_ASSERT_CORE_LOCKED();
+  LWIP_ERROR("udp_tpl_send: invalid tpl", (tpl != NULL) && (tpl->pcb != NULL), return ERR_ARG);
+  LWIP_ERROR("udp_tpl_send: invalid pbuf", p != NULL, return ERR_ARG);
+
+  if ((tpl->gen != udp_tpl_gen) || ((u32_t)(sys_now() - tpl->built) >= UDP_TPL_MAXAGE)) {
+    /* resolves or refreshes the ARP entry the template is built from */
+    err = udp_send(tpl->pcb, p);
+    (void)udp_tpl_build(tpl);
+    return err;
+  }
+  netif = tpl->netif;
+  if (((netif->mtu != 0) && ((u32_t)p->tot_len + IP_HLEN + UDP_HLEN > netif->mtu)) ||
+      pbuf_add_header(p, UDP_TPL_HLEN)) {
+    return udp_send(tpl->pcb, p);
+  }
+
+  MEMCPY(p->payload, tpl->hdr, UDP_TPL_HLEN);
+  len = (u16_t)(p->tot_len - SIZEOF_ETH_HDR);
+  iphdr = (struct ip_hdr *)((u8_t *)p->payload + SIZEOF_ETH_HDR);
+  IPH_LEN_SET(iphdr, lwip_htons(len));
+  IPH_ID_SET(iphdr, lwip_htons(tpl->id));
+  tpl->id++;
+#if CHECKSUM_GEN_IP
+  IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_IP) {
+    u32_t acc = (u32_t)tpl->ip_sum + IPH_LEN(iphdr) + IPH_ID(iphdr);
+    acc = FOLD_U32T(acc);
+    acc = FOLD_U32T(acc);
+    IPH_CHKSUM_SET(iphdr, (u16_t)~acc);
+  }
+#endif /* CHECKSUM_GEN_IP */
+  udphdr = (struct udp_hdr *)((u8_t *)iphdr + IP_HLEN);
+  udphdr->len = lwip_htons((u16_t)(len - IP_HLEN));
+#if CHECKSUM_GEN_UDP
+  IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_UDP) {
+    if ((tpl->pcb->flags & UDP_FLAGS_NOCHKSUM) == 0) {
+      ip4_addr_t src;
+      ip4_addr_t dst;
+      u16_t udpchksum;
+
+      ip4_addr_copy(src, iphdr->src);
+      ip4_addr_copy(dst, iphdr->dest);
+      pbuf_remove_header(p, SIZEOF_ETH_HDR + IP_HLEN);
+      udpchksum = inet_chksum_pseudo(p, IP_PROTO_UDP, p->tot_len, &src, &dst);
+      pbuf_add_header(p, SIZEOF_ETH_HDR + IP_HLEN);
+      /* chksum zero must become 0xffff, as zero means 'no checksum' */
+      if (udpchksum == 0x0000) {
+        udpchksum = 0xffff;
+      }
+      udphdr->chksum = udpchksum;
+    }
+  }
+#endif /* CHECKSUM_GEN_UDP */
+
+  IP_STATS_INC(ip.xmit);
+  MIB2_STATS_INC(mib2.udpoutdatagrams);
+  UDP_STATS_INC(udp.xmit);
+  return netif->linkoutput(netif, p);
+}
+#endif /* UDP_TPL */
+
 /**
  * @ingroup udp_raw
  * Bind an UDP PCB.
@@ -1012,6 +1241,12 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
 
   ip_addr_set_ipaddr(&pcb->local_ip, ipaddr);
 
+#if UDP_PCB_HASH
+  /* ETH_CODE: rechained under the new port */
+  if (rebind != 0) {
+    udp_pcb_hash_rmv(pcb);
+  }
+#endif /* UDP_PCB_HASH */
   pcb->local_port = port;
   mib2_udp_bind(pcb);
   /* pcb not active yet? */
@@ -1020,6 +1255,9 @@ udp_bind(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
     pcb->next = udp_pcbs;
     udp_pcbs = pcb;
   }
+#if UDP_PCB_HASH
+  udp_pcb_hash_add(pcb);
+#endif /* UDP_PCB_HASH */
   LWIP_DEBUGF(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, ("udp_bind: bound to "));
   ip_addr_debug_print_val(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, pcb->local_ip);
   LWIP_DEBUGF(UDP_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_STATE, (", port %"U16_F")\n", pcb->local_port));
@@ -1112,6 +1350,9 @@ udp_connect(struct udp_pcb *pcb, const ip_addr_t *ipaddr, u16_t port)
   /* PCB not yet on the list, add PCB now */
   pcb->next = udp_pcbs;
   udp_pcbs = pcb;
+#if UDP_PCB_HASH
+  udp_pcb_hash_add(pcb);
+#endif /* UDP_PCB_HASH */
   return ERR_OK;
 }
 
@@ -1200,6 +1441,9 @@ udp_remove(struct udp_pcb *pcb)
       }
     }
   }
+#if UDP_PCB_HASH
+  udp_pcb_hash_rmv(pcb);
+#endif /* UDP_PCB_HASH */
   memp_free(MEMP_UDP_PCB, pcb);
 }
 
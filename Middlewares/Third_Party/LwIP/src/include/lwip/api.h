@@ -268,7 +268,24 @@ struct netconn {
       tested against recv_bufsize to limit bytes on recvmbox
       for UDP and RAW, used for FIONREAD */
   int recv_avail;
+#if RECV_BUFSIZE_AUTOTUNE
+  /** ETH_CODE: bytes received by the application since recv_tune_since,
+      whether recv_bufsize is tuned and whether data was dropped at it in
+      the interval, see RECV_BUFSIZE_AUTOTUNE */
+  int recv_read;
+  u32_t recv_tune_since;
+  u8_t recv_autotune;
+  u8_t recv_dropped;
+#endif /* RECV_BUFSIZE_AUTOTUNE */
 #endif /* LWIP_SO_RCVBUF */
+#if NETCONN_RX_COPY
+  /** ETH_CODE: data in recvmbox, and sys_now() when it last started to
+      queue or was received from, see NETCONN_RX_COPY */
+  int rx_queued;
+  u32_t rx_since;
+  /** ETH_CODE: bytes of pinned buffers in recvmbox, see NETCONN_RX_PINNED_MAX */
+  int rx_pinned;
+#endif /* NETCONN_RX_COPY */
 #if LWIP_SO_LINGER
    /** values <0 mean linger is disabled, values > 0 are seconds to linger */
   s16_t linger;
@@ -340,10 +357,46 @@ err_t   netconn_tcp_recvd(struct netconn *conn, size_t len);
 err_t   netconn_sendto(struct netconn *conn, struct netbuf *buf,
                              const ip_addr_t *addr, u16_t port);
 err_t   netconn_send(struct netconn *conn, struct netbuf *buf);
+#if LWIP_NETCONN_BATCH
+/* ETH_CODE: datagrams in batches, see LWIP_NETCONN_BATCH */
+err_t   netconn_recv_batch(struct netconn *conn, struct netbuf **bufs, u16_t cnt,
+                           u16_t *received, u8_t apiflags);
+err_t   netconn_send_batch(struct netconn *conn, struct netbuf *const *bufs, u16_t cnt,
+                           u16_t *sent);
+#endif /* LWIP_NETCONN_BATCH */
+#if NETCONN_RX_COPY
+/* ETH_CODE: copies of held zero-copy data, see NETCONN_RX_COPY */
+struct netconn_rx_copy_stats {
+  u32_t copied;   /* pbuf chains or datagrams copied */
+  u32_t bytes;
+  u32_t failed;   /* no memory for a copy */
+  u32_t forced;   /* copied for NETCONN_RX_PINNED_MAX */
+  u32_t dropped;  /* datagrams over NETCONN_RX_PINNED_MAX, not copied */
+};
+void    netconn_rx_copy_get_stats(struct netconn_rx_copy_stats *stats);
+#endif /* NETCONN_RX_COPY */
+#if LWIP_SO_RCVBUF
+/* ETH_CODE: receive buffer limits of UDP and RAW netconns */
+struct netconn_recvbuf_stats {
+  u32_t dropped;  /* datagrams over recv_bufsize */
+  u32_t grown;    /* RECV_BUFSIZE_AUTOTUNE steps */
+  u32_t shrunk;
+};
+void    netconn_recvbuf_get_stats(struct netconn_recvbuf_stats *stats);
+#endif /* LWIP_SO_RCVBUF */
 err_t   netconn_write_partly(struct netconn *conn, const void *dataptr, size_t size,
                              u8_t apiflags, size_t *bytes_written);
 err_t   netconn_write_vectors_partly(struct netconn *conn, struct netvector *vectors, u16_t vectorcnt,
                                      u8_t apiflags, size_t *bytes_written);
+#if LWIP_TCP_TXREF
+/* ETH_CODE: zero-copy send with a completion, see netconn_write_ref().
+ * Zero-copy receive: netconn_recv_tcp_pbuf_flags() with NETCONN_NOAUTORCVD
+ * lends the pbuf chain (RX DMA buffers: free it soon), netconn_tcp_recvd()
+ * opens the window once consumed. */
+struct tcp_txref;
+err_t   netconn_write_ref(struct netconn *conn, const void *dataptr, size_t size,
+                          u8_t apiflags, size_t *bytes_written, struct tcp_txref *ref);
+#endif /* LWIP_TCP_TXREF */
 /** @ingroup netconn_tcp */
 #define netconn_write(conn, dataptr, size, apiflags) \
           netconn_write_partly(conn, dataptr, size, apiflags, NULL)
@@ -409,7 +462,13 @@ err_t   netconn_err(struct netconn *conn);
 #endif /* LWIP_SO_RCVTIMEO */
 #if LWIP_SO_RCVBUF
 /** Set the receive buffer in bytes */
+#if RECV_BUFSIZE_AUTOTUNE
+/* ETH_CODE: a size set by the application is no longer tuned */
+#define netconn_set_recvbufsize(conn, recvbufsize)  do { (conn)->recv_bufsize = (recvbufsize); \
+                                                         (conn)->recv_autotune = 0; } while (0)
+#else /* RECV_BUFSIZE_AUTOTUNE */
 #define netconn_set_recvbufsize(conn, recvbufsize)  ((conn)->recv_bufsize = (recvbufsize))
+#endif /* RECV_BUFSIZE_AUTOTUNE */
 /** Get the receive buffer in bytes */
 #define netconn_get_recvbufsize(conn)               ((conn)->recv_bufsize)
 #endif /* LWIP_SO_RCVBUF*/
@@ -91,6 +91,8 @@ void* lwiperf_start_tcp_client_default(const ip_addr_t* remote_addr,
                                lwiperf_report_fn report_fn, void* report_arg);
 
 void  lwiperf_abort(void* lwiperf_session);
+/* ETH_CODE: runtime switch of the LWIPERF_CHECK_RX_DATA check */
+void  lwiperf_set_check_rx_data(u8_t enable);
 
 
 #ifdef __cplusplus
@@ -87,6 +87,11 @@ struct mqtt_connect_client_info_t {
   /** TLS configuration for secure connections */
   struct altcp_tls_config *tls_config;
 #endif
+#if MQTT_PUBLISH_BATCH
+  /** ETH_CODE: milliseconds publishes may wait to share a TCP segment,
+      0 to send each at once */
+  u16_t publish_batch_ms;
+#endif
 };
 
 /**
@@ -198,6 +203,25 @@ err_t mqtt_sub_unsub(mqtt_client_t *client, const char *topic, u8_t qos, mqtt_re
 err_t mqtt_publish(mqtt_client_t *client, const char *topic, const void *payload, u16_t payload_length, u8_t qos, u8_t retain,
                                     mqtt_request_cb_t cb, void *arg);
 
+/* ETH_CODE: payload written into the output ring, see mqtt_publish_gen() */
+struct mqtt_payload_out;
+typedef void (*mqtt_payload_gen_t)(void *gen_arg, struct mqtt_payload_out *out);
+void mqtt_payload_write(struct mqtt_payload_out *out, const void *data, u16_t len);
+err_t mqtt_publish_gen(mqtt_client_t *client, const char *topic, u16_t payload_length, mqtt_payload_gen_t gen,
+                       void *gen_arg, u8_t qos, u8_t retain, mqtt_request_cb_t cb, void *arg);
+
+#if MQTT_PUBLISH_BATCH
+/* ETH_CODE: send batched publishes now */
+void mqtt_flush(mqtt_client_t *client);
+#endif /* MQTT_PUBLISH_BATCH */
+
+/* ETH_CODE: zero-copy publish, see mqtt_publish_ref() */
+struct tcp_txref;
+#if MQTT_PUBLISH_REF
+err_t mqtt_publish_ref(mqtt_client_t *client, const char *topic, const void *payload, u16_t payload_length, u8_t qos,
+                       u8_t retain, struct tcp_txref *ref, mqtt_request_cb_t cb, void *arg);
+#endif /* MQTT_PUBLISH_REF */
+
 #ifdef __cplusplus
 }
 #endif
@@ -56,6 +56,60 @@ extern "C" {
 #define MQTT_OUTPUT_RINGBUF_SIZE 256
 #endif
 
+/**
+ * ETH_CODE: MQTT_PUBLISH_REF==1: enable mqtt_publish_ref(), which leaves the
+ * payload in the caller's buffer and hands it to tcp_write_ref(); only the
+ * header goes through the output ring-buffer.
+ * Requires LWIP_TCP_TXREF and LWIP_ALTCP==0.
+ */
+#ifndef MQTT_PUBLISH_REF
+#define MQTT_PUBLISH_REF 0
+#endif
+
+/**
+ * ETH_CODE: Number of mqtt_publish_ref() payloads waiting for TCP send
+ * buffer space at a time.
+ */
+#ifndef MQTT_PUBLISH_REF_MAX
+#define MQTT_PUBLISH_REF_MAX MQTT_REQ_MAX_IN_FLIGHT
+#endif
+
+/**
+ * ETH_CODE: MQTT_PUBLISH_BATCH==1: publishes are held in the output
+ * ring-buffer for up to mqtt_connect_client_info_t.publish_batch_ms and
+ * go out together, several PUBLISH packets per TCP segment. A full
+ * segment's worth or mqtt_flush() sends them earlier.
+ */
+#ifndef MQTT_PUBLISH_BATCH
+#define MQTT_PUBLISH_BATCH 0
+#endif
+
+/**
+ * ETH_CODE: MQTT_V5==1: connect with protocol level 5 (MQTT 5.0) instead
+ * of 4 (3.1.1). Properties from the server are skipped, except the Topic
+ * Alias Maximum of CONNACK; none are sent but Topic Alias. The broker must
+ * support MQTT 5.
+ */
+#ifndef MQTT_V5
+#define MQTT_V5 0
+#endif
+
+/**
+ * ETH_CODE: Topic aliases per connection (MQTT_V5), further limited by the
+ * server's Topic Alias Maximum. The first topics published get them and
+ * keep them for the connection; later ones are always sent in full.
+ */
+#ifndef MQTT_TOPIC_ALIAS_NUM
+#define MQTT_TOPIC_ALIAS_NUM 16
+#endif
+
+/**
+ * ETH_CODE: Longest topic given an alias; each alias keeps a copy of it.
+ */
+#ifndef MQTT_TOPIC_ALIAS_LEN
+#define MQTT_TOPIC_ALIAS_LEN 64
+#endif
+
 /**
  * Number of bytes in receive buffer, must be at least the size of the longest incoming topic + 8
  * If one wants to avoid fragmented incoming publish, set length to max incoming topic length + max payload length + 8
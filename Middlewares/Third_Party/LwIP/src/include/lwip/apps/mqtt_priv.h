@@ -59,13 +59,47 @@ struct mqtt_request_t
   u16_t timeout_diff;
 };
 
+#if MQTT_PUBLISH_REF
+/** ETH_CODE: mqtt_publish_ref() payload, sent once the ring-buffer bytes
+    put before it are */
+struct mqtt_out_ref_t {
+  /** Value of put_total when the payload was queued */
+  u32_t at;
+  const u8_t *data;
+  u16_t len;
+  struct tcp_txref *ref;
+};
+#endif /* MQTT_PUBLISH_REF */
+
 /** Ring buffer */
 struct mqtt_ringbuf_t {
   u16_t put;
   u16_t get;
+#if MQTT_PUBLISH_REF
+  /** ETH_CODE: bytes ever put / got, positions of the queued payloads */
+  u32_t put_total;
+  u32_t get_total;
+  struct mqtt_out_ref_t refs[MQTT_PUBLISH_REF_MAX];
+  u8_t ref_first;
+  u8_t ref_num;
+#endif /* MQTT_PUBLISH_REF */
   u8_t buf[MQTT_OUTPUT_RINGBUF_SIZE];
 };
 
+/** ETH_CODE: mqtt_payload_gen_t output, bytes still to write */
+struct mqtt_payload_out {
+  struct mqtt_ringbuf_t *rb;
+  u16_t left;
+};
+
+#if MQTT_V5
+/** ETH_CODE: topic of alias index + 1, len 0 while unused */
+struct mqtt_topic_alias_t {
+  u8_t len;
+  char topic[MQTT_TOPIC_ALIAS_LEN];
+};
+#endif /* MQTT_V5 */
+
 /** MQTT client */
 struct mqtt_client_s
 {
@@ -95,6 +129,18 @@ struct mqtt_client_s
   u8_t rx_buffer[MQTT_VAR_HEADER_BUFFER_LEN];
   /** Output ring-buffer */
   struct mqtt_ringbuf_t output;
+#if MQTT_PUBLISH_BATCH
+  /** ETH_CODE: publish flush interval, 0 to send at once */
+  u16_t batch_ms;
+  /** ETH_CODE: flush timer running */
+  u8_t batch_pending;
+#endif /* MQTT_PUBLISH_BATCH */
+#if MQTT_V5
+  /** ETH_CODE: aliases the server accepts (CONNACK), and assigned so far */
+  u16_t alias_max;
+  u16_t alias_num;
+  struct mqtt_topic_alias_t aliases[MQTT_TOPIC_ALIAS_NUM];
+#endif /* MQTT_V5 */
 };
 
 #ifdef __cplusplus
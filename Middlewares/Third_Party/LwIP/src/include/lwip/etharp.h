@@ -93,6 +93,11 @@ err_t etharp_add_static_entry(const ip4_addr_t *ipaddr, struct eth_addr *ethaddr
 err_t etharp_remove_static_entry(const ip4_addr_t *ipaddr);
 #endif /* ETHARP_SUPPORT_STATIC_ENTRIES */
 
+#if ETHARP_PIN_MAX
+err_t etharp_pin(struct netif *netif, const ip4_addr_t *ipaddr);
+err_t etharp_unpin(const ip4_addr_t *ipaddr);
+#endif /* ETHARP_PIN_MAX */
+
 void etharp_input(struct pbuf *p, struct netif *netif);
 
 #ifdef __cplusplus
@@ -83,6 +83,10 @@ err_t             netbuf_data     (struct netbuf *buf,
                                    void **dataptr, u16_t *len);
 s8_t              netbuf_next     (struct netbuf *buf);
 void              netbuf_first    (struct netbuf *buf);
+#if LWIP_SO_TIMESTAMP
+/* ETH_CODE: see LWIP_SO_TIMESTAMP */
+err_t             netbuf_rxtime   (struct netbuf *buf, u64_t *mono_ns, u64_t *utc_ns);
+#endif /* LWIP_SO_TIMESTAMP */
 
 
 #define netbuf_copy_partial(buf, dataptr, len, offset) \
@@ -212,6 +212,14 @@ typedef err_t (*netif_output_ip6_fn)(struct netif *netif, struct pbuf *p,
 typedef err_t (*netif_linkoutput_fn)(struct netif *netif, struct pbuf *p);
 /** Function prototype for netif status- or link-callback functions. */
 typedef void (*netif_status_callback_fn)(struct netif *netif);
+#if LWIP_NETIF_TX_BATCH
+/** ETH_CODE: Function prototype for netif->tx_flush functions. Called at the
+ * end of a batch of linkoutput calls to hand the frames to the hardware.
+ *
+ * @param netif The netif which sent the batch
+ */
+typedef void (*netif_tx_flush_fn)(struct netif *netif);
+#endif /* LWIP_NETIF_TX_BATCH */
 #if LWIP_IPV4 && LWIP_IGMP
 /** Function prototype for netif igmp_mac_filter functions */
 typedef err_t (*netif_igmp_mac_filter_fn)(struct netif *netif,
@@ -297,6 +305,12 @@ struct netif {
    *  to send a packet on the interface. This function outputs
    *  the pbuf as-is on the link medium. */
   netif_linkoutput_fn linkoutput;
+#if LWIP_NETIF_TX_BATCH
+  /** ETH_CODE: called when the outermost batch ends (may be NULL). While
+   *  tx_batch is non-zero, more linkoutput calls follow before it. */
+  netif_tx_flush_fn tx_flush;
+  u8_t tx_batch;
+#endif /* LWIP_NETIF_TX_BATCH */
 #if LWIP_IPV6
   /** This function is called by the IPv6 module when it wants
    *  to send a packet on the interface. This function typically
@@ -389,6 +403,18 @@ struct netif {
 #endif /* ENABLE_LOOPBACK */
 };
 
+#if LWIP_NETIF_TX_BATCH
+/** ETH_CODE: open a batch of frames on netif (batches nest) */
+#define netif_tx_batch_begin(netif) do { (netif)->tx_batch++; } while(0)
+/** ETH_CODE: close a batch; the outermost one calls netif->tx_flush */
+#define netif_tx_batch_end(netif) do { \
+  if ((--(netif)->tx_batch == 0) && ((netif)->tx_flush != NULL)) { \
+    (netif)->tx_flush(netif); } } while(0)
+#else /* LWIP_NETIF_TX_BATCH */
+#define netif_tx_batch_begin(netif)
+#define netif_tx_batch_end(netif)
+#endif /* LWIP_NETIF_TX_BATCH */
+
 #if LWIP_CHECKSUM_CTRL_PER_NETIF
 #define NETIF_SET_CHECKSUM_CTRL(netif, chksumflags) do { \
   (netif)->chksum_flags = chksumflags; } while(0)
@@ -318,6 +318,17 @@
 #define MEMP_SANITY_CHECK               0
 #endif
 
+/**
+ * ETH_CODE: MEMP_LOCKFREE==1: the free list of every fixed-size pool is a
+ * lock-free stack, popped and pushed with LDREX/STREX (ARMv7-M) instead
+ * of under SYS_ARCH_PROTECT. memp_malloc() and memp_free() then never wait
+ * on each other, from any task or interrupt. Not with MEMP_MEM_MALLOC,
+ * MEMP_OVERFLOW_CHECK, MEMP_SANITY_CHECK or LWIP_HOOK_MEMP_AVAILABLE.
+ */
+#if !defined MEMP_LOCKFREE || defined __DOXYGEN__
+#define MEMP_LOCKFREE                   0
+#endif
+
 /**
  * MEM_OVERFLOW_CHECK: mem overflow protection reserves a configurable
  * amount of bytes before and after each heap allocation chunk and fills
@@ -706,6 +717,31 @@
 #if !defined ETHARP_TABLE_MATCH_NETIF || defined __DOXYGEN__
 #define ETHARP_TABLE_MATCH_NETIF        !LWIP_SINGLE_NETIF
 #endif
+
+/**
+ * ETH_CODE: ETHARP_REFRESH > 0: etharp_tmr() re-requests a stable entry
+ * that carried traffic since it was last confirmed (or is pinned)
+ * ETHARP_REFRESH seconds before it would expire: unicast, broadcast for
+ * the last half of that time. The entry is renewed before it expires and
+ * the next packet waits on resolution. With 0 only the output path
+ * re-requests, and only if a packet goes out in the last 30 seconds.
+ * Below ARP_MAXAGE.
+ */
+#if !defined ETHARP_REFRESH || defined __DOXYGEN__
+#define ETHARP_REFRESH                  0
+#endif
+
+/**
+ * ETH_CODE: ETHARP_PIN_MAX > 0: etharp_pin() keeps up to that many
+ * addresses resolved. Their entries are requested right away, made again
+ * when the netif comes back up, never expire and are never recycled; a
+ * pinned entry whose refresh goes unanswered keeps its address. For a
+ * peer whose MAC address is fixed, ETHARP_SUPPORT_STATIC_ENTRIES does
+ * without ARP at all.
+ */
+#if !defined ETHARP_PIN_MAX || defined __DOXYGEN__
+#define ETHARP_PIN_MAX                  0
+#endif
 /**
  * @}
  */
@@ -794,6 +830,32 @@
 #define IP_REASS_MAX_PBUFS              10
 #endif
 
+/**
+ * ETH_CODE: IP_REASS_COPY==1: ip4_reass() copies every fragment for which
+ * IP_REASS_COPY_NEEDED(p) is true into PBUF_POOL pbufs, the reassembly
+ * arena, and frees the received pbuf at once. Fragments waiting for the
+ * rest of their datagram then hold no receive buffers of the driver.
+ * IP_REASS_MAX_PBUFS counts the arena pbufs: keep it below PBUF_POOL_SIZE.
+ * A fragment the arena has no room for evicts the oldest other datagram
+ * (IP_REASS_FREE_OLDEST) or is dropped.
+ */
+#if !defined IP_REASS_COPY || defined __DOXYGEN__
+#define IP_REASS_COPY                   0
+#endif
+#if !defined IP_REASS_COPY_NEEDED || defined __DOXYGEN__
+#define IP_REASS_COPY_NEEDED(p)         1
+#endif
+
+/**
+ * ETH_CODE: IP_REASS_DGRAM_MAX: longest datagram reassembled, in bytes
+ * after the IP header. A fragment reaching past it is dropped together with
+ * the fragments held for its datagram, right away instead of after
+ * IP_REASS_MAXAGE. The default is the most an IPv4 datagram can carry.
+ */
+#if !defined IP_REASS_DGRAM_MAX || defined __DOXYGEN__
+#define IP_REASS_DGRAM_MAX              (0xFFFF - IP_HLEN)
+#endif
+
 /**
  * IP_DEFAULT_TTL: Default value for Time-To-Live used by transport layers.
  */
@@ -961,6 +1023,25 @@
 #if !defined LWIP_DHCP_MAX_DNS_SERVERS || defined __DOXYGEN__
 #define LWIP_DHCP_MAX_DNS_SERVERS       DNS_MAX_SERVERS
 #endif
+
+/**
+ * ETH_CODE: LWIP_DHCP_RAPID_COMMIT==1: DISCOVER carries the Rapid Commit
+ * option (RFC 4039); a server that supports it answers with an ACK, taken
+ * in SELECTING like the ACK to a REQUEST, and the lease is bound after one
+ * exchange instead of two. Servers without it answer with an OFFER.
+ */
+#if !defined LWIP_DHCP_RAPID_COMMIT || defined __DOXYGEN__
+#define LWIP_DHCP_RAPID_COMMIT          0
+#endif
+
+/**
+ * ETH_CODE: LWIP_DHCP_INIT_REBOOT==1: dhcp_start_reboot() starts in
+ * INIT-REBOOT with an address remembered from an earlier lease: a single
+ * REQUEST for it, as on a link change, then DISCOVER if no server answers.
+ */
+#if !defined LWIP_DHCP_INIT_REBOOT || defined __DOXYGEN__
+#define LWIP_DHCP_INIT_REBOOT           0
+#endif
 /**
  * @}
  */
@@ -1200,6 +1281,37 @@
 #if !defined LWIP_NETBUF_RECVINFO || defined __DOXYGEN__
 #define LWIP_NETBUF_RECVINFO            0
 #endif
+
+/**
+ * ETH_CODE: UDP_PCB_HASH==1: udp_input() only looks at the pcbs bound to
+ * the destination port, chained in UDP_PCB_HASH_SIZE buckets (a power of
+ * 2) keyed on the local port. Matching among them is unchanged; broadcast
+ * and multicast copies to several pcbs still walk udp_pcbs.
+ */
+#if !defined UDP_PCB_HASH || defined __DOXYGEN__
+#define UDP_PCB_HASH                    0
+#endif
+
+#if !defined UDP_PCB_HASH_SIZE || defined __DOXYGEN__
+#define UDP_PCB_HASH_SIZE               16
+#endif
+
+/**
+ * ETH_CODE: UDP_TPL==1: udp_tpl_send() sends over a connected pcb with
+ * Ethernet, IPv4 and UDP headers built once (struct udp_tpl), skipping the
+ * route and ARP lookups and header construction of udp_send(). Templates
+ * are rebuilt after a netif or ARP entry change, and every UDP_TPL_MAXAGE
+ * ms, when one datagram takes the udp_send() path to keep the ARP entry
+ * in use; ARP_MAXAGE - 30 s before expiry it is then refreshed. Needs no
+ * LWIP_HOOK_VLAN_SET (ethernet_output() is not called).
+ */
+#if !defined UDP_TPL || defined __DOXYGEN__
+#define UDP_TPL                         0
+#endif
+
+#if !defined UDP_TPL_MAXAGE || defined __DOXYGEN__
+#define UDP_TPL_MAXAGE                  10000
+#endif
 /**
  * @}
  */
@@ -1340,6 +1452,92 @@
 #define TCP_SNDQUEUELOWAT               LWIP_MAX(((TCP_SND_QUEUELEN)/2), 5)
 #endif
 
+/**
+ * ETH_CODE: TCP_SND_AUTOTUNE==1: each pcb's send buffer is sized at run
+ * time, between TCP_SND_BUF_MIN and TCP_SND_BUF_MAX, instead of
+ * TCP_SND_BUF for all. A pcb starts at the minimum. When its application
+ * has filled more than half of it, the pcb is given up to twice what the
+ * congestion and peer windows let out per round trip, out of what
+ * TCP_SND_BUDGET has left. On each slow timer tick, a pcb that did not
+ * ask for more since the last tick gives back what is above twice its
+ * bandwidth-delay product: acknowledged bytes per tick (a peak decaying
+ * by a quarter per tick) times the smoothed RTT. An idle pcb goes back to
+ * the minimum. The queue length limit (TCP_SND_QUEUELEN) and the netconn
+ * writable thresholds (TCP_SNDLOWAT, TCP_SNDQUEUELOWAT) scale with the
+ * buffer. tcp_sndbuf_max() and tcp_sndqueuelen_max() return a pcb's sizes;
+ * tcp_snd_tune_get_stats() returns the totals.
+ */
+#if !defined TCP_SND_AUTOTUNE || defined __DOXYGEN__
+#define TCP_SND_AUTOTUNE                0
+#endif
+
+/**
+ * ETH_CODE: TCP_SND_BUF_MIN: send buffer every pcb has (TCP_SND_AUTOTUNE)
+ */
+#if !defined TCP_SND_BUF_MIN || defined __DOXYGEN__
+#define TCP_SND_BUF_MIN                 LWIP_MIN(2 * TCP_MSS, TCP_SND_BUF)
+#endif
+
+/**
+ * ETH_CODE: TCP_SND_BUF_MAX: largest send buffer of a pcb (TCP_SND_AUTOTUNE)
+ */
+#if !defined TCP_SND_BUF_MAX || defined __DOXYGEN__
+#define TCP_SND_BUF_MAX                 TCP_SND_BUF
+#endif
+
+/**
+ * ETH_CODE: TCP_SND_BUDGET: send buffer above TCP_SND_BUF_MIN all pcbs
+ * together may be given (TCP_SND_AUTOTUNE)
+ */
+#if !defined TCP_SND_BUDGET || defined __DOXYGEN__
+#define TCP_SND_BUDGET                  TCP_SND_BUF
+#endif
+
+/**
+ * ETH_CODE: TCP_OOSEQ_GOVERN==1: the out-of-sequence queues of all pcbs are
+ * accounted together. A pcb's queue is cut back (highest sequence numbers
+ * first) to the lowest of TCP_OOSEQ_MAX_BYTES / TCP_OOSEQ_MAX_PBUFS (per
+ * pcb, 0: no limit), what TCP_OOSEQ_TOTAL_MAX_BYTES /
+ * TCP_OOSEQ_TOTAL_MAX_PBUFS leave after the other pcbs, and, while
+ * TCP_OOSEQ_POOL_LOW() is true, what it already holds. tcp_ooseq_evict()
+ * frees whole queues, largest first, for a netif whose receive buffers
+ * run short; tcp_ooseq_get_stats() reads the counters.
+ * Takes over TCP_OOSEQ_BYTES_LIMIT(pcb) and TCP_OOSEQ_PBUFS_LIMIT(pcb).
+ */
+#if !defined TCP_OOSEQ_GOVERN || defined __DOXYGEN__
+#define TCP_OOSEQ_GOVERN                0
+#endif
+
+/**
+ * ETH_CODE: TCP_OOSEQ_TOTAL_MAX_BYTES: bytes on the ooseq queues of all
+ * pcbs together (TCP_OOSEQ_GOVERN), 0: no limit
+ */
+#if !defined TCP_OOSEQ_TOTAL_MAX_BYTES || defined __DOXYGEN__
+#define TCP_OOSEQ_TOTAL_MAX_BYTES       0
+#endif
+
+/**
+ * ETH_CODE: TCP_OOSEQ_TOTAL_MAX_PBUFS: pbufs on the ooseq queues of all
+ * pcbs together (TCP_OOSEQ_GOVERN), 0: no limit
+ */
+#if !defined TCP_OOSEQ_TOTAL_MAX_PBUFS || defined __DOXYGEN__
+#define TCP_OOSEQ_TOTAL_MAX_PBUFS       0
+#endif
+
+/**
+ * ETH_CODE: TCP_OOSEQ_POOL_LOW(): nonzero while the buffers received
+ * segments live in are short, so no queue may grow (TCP_OOSEQ_GOVERN).
+ * Called with the core lock held.
+ */
+#if !defined TCP_OOSEQ_POOL_LOW || defined __DOXYGEN__
+#define TCP_OOSEQ_POOL_LOW()            0
+#endif
+
+#if TCP_OOSEQ_GOVERN && !defined __DOXYGEN__
+#define TCP_OOSEQ_BYTES_LIMIT(pcb)      tcp_ooseq_bytes_limit(pcb)
+#define TCP_OOSEQ_PBUFS_LIMIT(pcb)      tcp_ooseq_pbufs_limit(pcb)
+#endif
+
 /**
  * TCP_OOSEQ_MAX_BYTES: The default maximum number of bytes queued on ooseq per
  * pcb if TCP_OOSEQ_BYTES_LIMIT is not defined. Default is 0 (no limit).
@@ -1479,6 +1677,104 @@
 #define LWIP_TCP_PCB_NUM_EXT_ARGS       0
 #endif
 
+/**
+ * ETH_CODE: LWIP_TCP_TXREF==1: enable tcp_write_ref() and
+ * netconn_write_ref(), zero-copy writes that call back once lwIP (TCP
+ * queues, ARP queue, driver) holds no more reference to the data.
+ * Requires LWIP_SUPPORT_CUSTOM_PBUF.
+ */
+#if !defined LWIP_TCP_TXREF || defined __DOXYGEN__
+#define LWIP_TCP_TXREF                  0
+#endif
+
+/**
+ * ETH_CODE: MEMP_NUM_TCP_TXREF: the number of pbufs referencing
+ * tcp_write_ref() data at a time (a segment takes one or two).
+ */
+#if !defined MEMP_NUM_TCP_TXREF || defined __DOXYGEN__
+#define MEMP_NUM_TCP_TXREF              MEMP_NUM_TCP_SEG
+#endif
+
+/**
+ * ETH_CODE: TCP_ACK_EVERY: the number of in-order segments received before
+ * an ACK is sent right away; the delayed ACK timer (TCP_TMR_INTERVAL)
+ * acknowledges fewer. 2 is lwIP's fixed behaviour and RFC 5681's advice;
+ * more sends stretch ACKs, keep it well below TCP_WND / TCP_MSS.
+ */
+#if !defined TCP_ACK_EVERY || defined __DOXYGEN__
+#define TCP_ACK_EVERY                   2
+#endif
+
+/**
+ * ETH_CODE: TCP_ACK_BATCH==1: enable tcp_ack_batch_begin() and
+ * tcp_ack_batch_end(). A driver brackets the frames it delivers in one go
+ * with them; tcp_input() then leaves output to the end of the batch, so a
+ * connection sends one ACK for all the segments the batch brought.
+ * Duplicate ACKs for out-of-order segments still go out at once.
+ */
+#if !defined TCP_ACK_BATCH || defined __DOXYGEN__
+#define TCP_ACK_BATCH                   0
+#endif
+
+/**
+ * ETH_CODE: TCP_PCB_HASH==1: tcp_input() finds the pcb of a segment in
+ * hash chains instead of walking tcp_active_pcbs, tcp_tw_pcbs and the
+ * listen list: active and TIME-WAIT pcbs keyed on both ports and the
+ * remote address, listening ones on the local port. The lists stay as
+ * they are for everything else, and a chain is matched like the list was,
+ * so listeners on any address work unchanged.
+ */
+#if !defined TCP_PCB_HASH || defined __DOXYGEN__
+#define TCP_PCB_HASH                    0
+#endif
+
+/**
+ * ETH_CODE: TCP_PCB_HASH_SIZE: buckets of each of the three tables, a
+ * power of 2
+ */
+#if !defined TCP_PCB_HASH_SIZE || defined __DOXYGEN__
+#define TCP_PCB_HASH_SIZE               32
+#endif
+
+/**
+ * ETH_CODE: TCP_RTO_MS==1: RTT measured and RTO kept in milliseconds
+ * instead of TCP_SLOW_INTERVAL ticks, and the retransmission timer of a
+ * connection is a sys_timeout() of its own instead of a count in
+ * tcp_slowtmr(). The RTO is at least TCP_RTO_MIN_MS and, backed off, at
+ * most TCP_RTO_MAX_MS. Takes one more timeout per TCP pcb
+ * (MEMP_NUM_SYS_TIMEOUT); the rest of tcp_slowtmr() stays as it is.
+ */
+#if !defined TCP_RTO_MS || defined __DOXYGEN__
+#define TCP_RTO_MS                      0
+#endif
+
+/**
+ * ETH_CODE: TCP_RTO_MIN_MS: RTO floor with TCP_RTO_MS. Keep it above the
+ * delayed ACK time of the peers, or a reply they hold back is sent twice.
+ */
+#if !defined TCP_RTO_MIN_MS || defined __DOXYGEN__
+#define TCP_RTO_MIN_MS                  200
+#endif
+
+/**
+ * ETH_CODE: TCP_RTO_MAX_MS: RTO ceiling with TCP_RTO_MS
+ */
+#if !defined TCP_RTO_MAX_MS || defined __DOXYGEN__
+#define TCP_RTO_MAX_MS                  60000
+#endif
+
+/**
+ * ETH_CODE: TCP_CONN_STATS==1: each pcb counts its retransmissions (by
+ * the RTO and fast), the times its sender stalled on the peer's window
+ * (persist timer started) or on snd_buf / snd_queuelen (tcp_write()
+ * refused), and the times it announced a zero window. tcp_conn_snapshot()
+ * copies them, with RTT estimate, RTO, cwnd, windows and queues, for the
+ * active pcbs. 20 bytes per pcb.
+ */
+#if !defined TCP_CONN_STATS || defined __DOXYGEN__
+#define TCP_CONN_STATS                  0
+#endif
+
 /** LWIP_ALTCP==1: enable the altcp API.
  * altcp is an abstraction layer that prevents applications linking against the
  * tcp.h functions but provides the same functionality. It is used to e.g. add
@@ -1658,6 +1954,17 @@
 #define LWIP_NETIF_TX_SINGLE_PBUF       0
 #endif /* LWIP_NETIF_TX_SINGLE_PBUF */
 
+/**
+ * ETH_CODE: LWIP_NETIF_TX_BATCH==1: tcp_output() brackets the segments it
+ * sends with netif_tx_batch_begin() / netif_tx_batch_end(). A driver that
+ * sets netif->tx_flush may then leave the frames passed to linkoutput in
+ * its descriptor ring without starting the DMA, and start it once in
+ * tx_flush at the end of the batch.
+ */
+#if !defined LWIP_NETIF_TX_BATCH || defined __DOXYGEN__
+#define LWIP_NETIF_TX_BATCH             0
+#endif
+
 /**
  * LWIP_NUM_NETIF_CLIENT_DATA: Number of clients that may store
  * data in client_data member array of struct netif (max. 256).
@@ -1921,6 +2228,82 @@
 #if !defined LWIP_NETCONN_FULLDUPLEX || defined __DOXYGEN__
 #define LWIP_NETCONN_FULLDUPLEX         0
 #endif
+
+/**
+ * ETH_CODE: LWIP_NETCONN_BATCH==1: datagrams in batches on UDP and RAW
+ * netconns: netconn_recv_batch() and netconn_send_batch() and, with
+ * LWIP_SOCKET, lwip_recvmmsg() and lwip_sendmmsg(). A send batch costs one
+ * core lock (or tcpip message); a receive batch waits for its first
+ * datagram only and takes what is queued behind it.
+ */
+#if !defined LWIP_NETCONN_BATCH || defined __DOXYGEN__
+#define LWIP_NETCONN_BATCH              0
+#endif
+
+/**
+ * ETH_CODE: LWIP_NETCONN_BATCH_MAX: the datagrams lwip_sendmmsg() passes to
+ * one netconn_send_batch(), a struct netbuf each on the caller's stack.
+ */
+#if !defined LWIP_NETCONN_BATCH_MAX || defined __DOXYGEN__
+#define LWIP_NETCONN_BATCH_MAX          8
+#endif
+
+/**
+ * ETH_CODE: NETCONN_RX_COPY==1: received data that would queue on a
+ * netconn behind NETCONN_RX_COPY_DEPTH others, or behind data its
+ * application has not made progress on for NETCONN_RX_COPY_AGE ms, is
+ * copied into PBUF_RAM first if NETCONN_RX_PINNED() is true for any pbuf
+ * of it. A netif receiving into a few zero-copy buffers then gets them
+ * back while a slow reader holds copies. The original is released only
+ * once the copy is queued: without memory for a copy it is queued as is.
+ * Counters by netconn_rx_copy_get_stats().
+ */
+#if !defined NETCONN_RX_COPY || defined __DOXYGEN__
+#define NETCONN_RX_COPY                 0
+#endif
+
+/**
+ * ETH_CODE: NETCONN_RX_COPY_DEPTH: received pbufs or datagrams already
+ * queued on a netconn from which the next is copied (NETCONN_RX_COPY)
+ */
+#if !defined NETCONN_RX_COPY_DEPTH || defined __DOXYGEN__
+#define NETCONN_RX_COPY_DEPTH           4
+#endif
+
+/**
+ * ETH_CODE: NETCONN_RX_COPY_AGE: ms without a receive call while data is
+ * queued on a netconn after which new data is copied (NETCONN_RX_COPY)
+ */
+#if !defined NETCONN_RX_COPY_AGE || defined __DOXYGEN__
+#define NETCONN_RX_COPY_AGE             20
+#endif
+
+/**
+ * ETH_CODE: NETCONN_RX_PINNED(q): nonzero if the pbuf q holds a buffer the
+ * netif needs back (NETCONN_RX_COPY). The default takes every custom pbuf.
+ */
+#if !defined NETCONN_RX_PINNED || defined __DOXYGEN__
+#define NETCONN_RX_PINNED(q)            (((q)->flags & PBUF_FLAG_IS_CUSTOM) != 0)
+#endif
+
+/**
+ * ETH_CODE: NETCONN_RX_PINNED_SIZE(q): bytes of the netif's buffers a
+ * pinned pbuf q holds, charged against NETCONN_RX_PINNED_MAX. The default
+ * is the data it carries.
+ */
+#if !defined NETCONN_RX_PINNED_SIZE || defined __DOXYGEN__
+#define NETCONN_RX_PINNED_SIZE(q)       ((q)->len)
+#endif
+
+/**
+ * ETH_CODE: NETCONN_RX_PINNED_MAX: bytes of pinned buffers one netconn
+ * may hold in its recvmbox (NETCONN_RX_PINNED_SIZE). Data beyond is
+ * copied however short the queue; a datagram that cannot be copied is
+ * dropped, TCP data (already acknowledged) is queued as is.
+ */
+#if !defined NETCONN_RX_PINNED_MAX || defined __DOXYGEN__
+#define NETCONN_RX_PINNED_MAX           INT_MAX
+#endif
 /**
  * @}
  */
@@ -2026,6 +2409,39 @@
 #define RECV_BUFSIZE_DEFAULT            INT_MAX
 #endif
 
+/**
+ * ETH_CODE: RECV_BUFSIZE_AUTOTUNE==1: the recv_bufsize of UDP and RAW
+ * netconns follows how fast the application reads. Every
+ * RECV_BUFSIZE_TUNE_MS (checked as data arrives) the target is twice what
+ * was read per interval, or twice the current size when data was dropped
+ * at the limit while the application kept reading, within
+ * RECV_BUFSIZE_MIN..RECV_BUFSIZE_MAX. The size grows to the target at
+ * once and shrinks by half the difference per interval. Setting SO_RCVBUF
+ * (netconn_set_recvbufsize()) ends it for that netconn. Needs
+ * LWIP_SO_RCVBUF; counters by netconn_recvbuf_get_stats().
+ */
+#if !defined RECV_BUFSIZE_AUTOTUNE || defined __DOXYGEN__
+#define RECV_BUFSIZE_AUTOTUNE           0
+#endif
+
+/**
+ * ETH_CODE: RECV_BUFSIZE_MIN, RECV_BUFSIZE_MAX: the range of
+ * RECV_BUFSIZE_AUTOTUNE
+ */
+#if !defined RECV_BUFSIZE_MIN || defined __DOXYGEN__
+#define RECV_BUFSIZE_MIN                2048
+#endif
+#if !defined RECV_BUFSIZE_MAX || defined __DOXYGEN__
+#define RECV_BUFSIZE_MAX                (1024 * 1024)
+#endif
+
+/**
+ * ETH_CODE: RECV_BUFSIZE_TUNE_MS: the interval of RECV_BUFSIZE_AUTOTUNE
+ */
+#if !defined RECV_BUFSIZE_TUNE_MS || defined __DOXYGEN__
+#define RECV_BUFSIZE_TUNE_MS            100
+#endif
+
 /**
  * By default, TCP socket/netconn close waits 20 seconds max to send the FIN
  */
@@ -2078,6 +2494,36 @@
 #if !defined LWIP_SOCKET_POLL || defined __DOXYGEN__
 #define LWIP_SOCKET_POLL                1
 #endif
+
+/**
+ * ETH_CODE: LWIP_SO_TIMESTAMP==1: arrival times of received datagrams:
+ * SO_TIMESTAMP on UDP and RAW sockets adds an SCM_TIMESTAMP control
+ * message (struct timeval, UTC) to lwip_recvmsg(), netbuf_rxtime() gives
+ * netconn users the monotonic and UTC time in nanoseconds. The port
+ * defines LWIP_PBUF_RX_TIME(p, mono_ns, utc_ns): the time the packet in p
+ * arrived (u64_t pointers, either may be NULL), non-zero if it is known.
+ */
+#if !defined LWIP_SO_TIMESTAMP || defined __DOXYGEN__
+#define LWIP_SO_TIMESTAMP               0
+#endif
+
+/**
+ * ETH_CODE: LWIP_SOCKET_EVQ==1: enable the socket event queues
+ * (lwip_evq_create() etc.): event_callback() appends a socket that turns
+ * ready to the ready list of its queue and wakes the waiting task through
+ * sys_notify(), so waiting costs O(ready sockets), not O(sockets).
+ * Needs sys_notify_self(), sys_notify() and sys_notify_wait() from the port.
+ */
+#if !defined LWIP_SOCKET_EVQ || defined __DOXYGEN__
+#define LWIP_SOCKET_EVQ                 0
+#endif
+
+/**
+ * ETH_CODE: LWIP_SOCKET_EVQ_NUM: the number of socket event queues.
+ */
+#if !defined LWIP_SOCKET_EVQ_NUM || defined __DOXYGEN__
+#define LWIP_SOCKET_EVQ_NUM             2
+#endif
 /**
  * @}
  */
@@ -3124,6 +3570,20 @@
 #define LWIP_HOOK_DHCP_PARSE_OPTION(netif, dhcp, state, msg, msg_type, option, len, pbuf, offset)
 #endif
 
+/**
+ * ETH_CODE: LWIP_HOOK_DHCP_LEASE(netif, dhcp):
+ * Called from dhcp_bind() once the netif holds the leased address (state
+ * DHCP_STATE_BOUND, offered_* and server_ip_addr describe the lease; also
+ * after every renewal), and from the NAK handling once the address was
+ * taken away (any other state). Meant for keeping a copy of the lease.
+ * Signature:\code{.c}
+ *   void my_hook(struct netif *netif, const struct dhcp *dhcp);
+ * \endcode
+ */
+#ifdef __DOXYGEN__
+#define LWIP_HOOK_DHCP_LEASE(netif, dhcp)
+#endif
+
 /**
  * LWIP_HOOK_DHCP6_APPEND_OPTIONS(netif, dhcp6, state, msg, msg_type, options_len_ptr, max_len):
  * Called from various dhcp6 functions when sending a DHCP6 message.
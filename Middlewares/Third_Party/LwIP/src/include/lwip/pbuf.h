@@ -219,6 +219,12 @@ struct pbuf {
 
   /** For incoming packets, this contains the input netif's index */
   u8_t if_idx;
+
+  /* ETH_CODE: per-packet data of the port (from lwIP 2.2), members
+   * declared by LWIP_PBUF_CUSTOM_DATA in lwipopts.h */
+#ifdef LWIP_PBUF_CUSTOM_DATA
+  LWIP_PBUF_CUSTOM_DATA
+#endif
 };
 
 
@@ -86,6 +86,15 @@ struct api_msg {
   union {
     /** used for lwip_netconn_do_send */
     struct netbuf *b;
+#if LWIP_NETCONN_BATCH
+    /** ETH_CODE: used for lwip_netconn_do_send_batch */
+    struct {
+      struct netbuf *const *bufs;
+      u16_t cnt;
+      /** output of datagrams sent */
+      u16_t sent;
+    } bb;
+#endif /* LWIP_NETCONN_BATCH */
     /** used for lwip_netconn_do_newconn */
     struct {
       u8_t proto;
@@ -118,6 +127,10 @@ struct api_msg {
 #if LWIP_SO_SNDTIMEO
       u32_t time_started;
 #endif /* LWIP_SO_SNDTIMEO */
+#if LWIP_TCP_TXREF
+      /** ETH_CODE: tcp_write_ref() instead of tcp_write() if not NULL */
+      struct tcp_txref *txref;
+#endif /* LWIP_TCP_TXREF */
     } w;
     /** used for lwip_netconn_do_recv */
     struct {
@@ -199,6 +212,9 @@ void lwip_netconn_do_connect         (void *m);
 void lwip_netconn_do_disconnect      (void *m);
 void lwip_netconn_do_listen          (void *m);
 void lwip_netconn_do_send            (void *m);
+#if LWIP_NETCONN_BATCH
+void lwip_netconn_do_send_batch      (void *m);
+#endif /* LWIP_NETCONN_BATCH */
 void lwip_netconn_do_recv            (void *m);
 #if TCP_LISTEN_BACKLOG
 void lwip_netconn_do_accepted        (void *m);
@@ -218,6 +234,10 @@ void lwip_netconn_do_gethostbyname(void *arg);
 
 struct netconn* netconn_alloc(enum netconn_type t, netconn_callback callback);
 void netconn_free(struct netconn *conn);
+#if NETCONN_RX_COPY
+/* ETH_CODE: bytes of pinned buffers in p, see NETCONN_RX_PINNED_MAX */
+int netconn_rx_pinned_size(const struct pbuf *p);
+#endif /* NETCONN_RX_COPY */
 
 #endif /* LWIP_NETCONN || LWIP_SOCKET */
 
@@ -137,7 +137,8 @@ struct memp_desc {
 #endif
 
 #if MEMP_STATS
-#define LWIP_MEMPOOL_DECLARE_STATS_INSTANCE(name) static struct stats_mem name;
+/* ETH_CODE: LWIP_STATS_ALIGN, see stats.h */
+#define LWIP_MEMPOOL_DECLARE_STATS_INSTANCE(name) static struct stats_mem name LWIP_STATS_ALIGN;
 #define LWIP_MEMPOOL_DECLARE_STATS_REFERENCE(name) &name,
 #else
 #define LWIP_MEMPOOL_DECLARE_STATS_INSTANCE(name)
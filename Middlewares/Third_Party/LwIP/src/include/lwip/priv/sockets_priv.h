@@ -81,6 +81,22 @@ struct lwip_sock {
   /** counter of how many threads are waiting for this socket using select */
   SELWAIT_T select_waiting;
 #endif /* LWIP_SOCKET_SELECT || LWIP_SOCKET_POLL */
+#if LWIP_SOCKET_EVQ
+  /** ETH_CODE: event queue + 1 the socket is added to, 0 for none */
+  u8_t evq;
+  /** ETH_CODE: LWIP_EVQ_IN / LWIP_EVQ_OUT to report (LWIP_EVQ_ERR always) */
+  u8_t evq_events;
+  /** ETH_CODE: 1 while on the ready list of its event queue */
+  u8_t evq_queued;
+  /** ETH_CODE: next socket index on the ready list, -1 ends it */
+  s16_t evq_next;
+  /** ETH_CODE: returned with the events, see lwip_evq_ctl() */
+  void *evq_arg;
+#endif /* LWIP_SOCKET_EVQ */
+#if LWIP_SO_TIMESTAMP
+  /** ETH_CODE: SO_TIMESTAMP set */
+  u8_t rx_timestamp;
+#endif /* LWIP_SO_TIMESTAMP */
 #if LWIP_NETCONN_FULLDUPLEX
   /* counter of how many threads are using a struct lwip_sock (not the 'int') */
   u8_t fd_used;
@@ -78,6 +78,10 @@ void             tcp_input   (struct pbuf *p, struct netif *inp);
 /* Used within the TCP code only: */
 struct tcp_pcb * tcp_alloc   (u8_t prio);
 void             tcp_free    (struct tcp_pcb *pcb);
+#if LWIP_TCP_TXREF
+/* ETH_CODE: pool of the pbufs referencing tcp_write_ref() data */
+void             tcp_txref_pool_init(void);
+#endif /* LWIP_TCP_TXREF */
 void             tcp_abandon (struct tcp_pcb *pcb, int reset);
 err_t            tcp_send_empty_ack(struct tcp_pcb *pcb);
 err_t            tcp_rexmit  (struct tcp_pcb *pcb);
@@ -101,7 +105,7 @@ err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
                             ((tpcb)->flags & (TF_NODELAY | TF_INFR)) || \
                             (((tpcb)->unsent != NULL) && (((tpcb)->unsent->next != NULL) || \
                               ((tpcb)->unsent->len >= (tpcb)->mss))) || \
-                            ((tcp_sndbuf(tpcb) == 0) || (tcp_sndqueuelen(tpcb) >= TCP_SND_QUEUELEN)) \
+                            ((tcp_sndbuf(tpcb) == 0) || (tcp_sndqueuelen(tpcb) >= tcp_sndqueuelen_max(tpcb))) \
                             ) ? 1 : 0)
 #define tcp_output_nagle(tpcb) (tcp_do_output_nagle(tpcb) ? tcp_output(tpcb) : ERR_OK)
 
@@ -133,6 +137,28 @@ err_t            tcp_process_refused_data(struct tcp_pcb *pcb);
 
 #define TCP_OOSEQ_TIMEOUT        6U /* x RTO */
 
+#if TCP_RTO_MS
+/* ETH_CODE: RTO in milliseconds, the retransmission timer a sys_timeout()
+ * per pcb (rtime only tells whether it runs) */
+#define TCP_RTO_INITIAL          3000
+#define TCP_RTO_BOUND(rto)       LWIP_MIN(LWIP_MAX((rto), TCP_RTO_MIN_MS), TCP_RTO_MAX_MS)
+#define TCP_RTO_TICKS(pcb)       (((u32_t)(pcb)->rto + TCP_SLOW_INTERVAL - 1) / TCP_SLOW_INTERVAL)
+#define TCP_RTO_START(pcb)       tcp_rto_start(pcb)
+#define TCP_RTO_STOP(pcb)        tcp_rto_stop(pcb)
+#define TCP_RTT_STAMP()          tcp_rtt_stamp()
+#define TCP_RTT_MS(m)            (m)
+#else /* TCP_RTO_MS */
+#define TCP_RTO_INITIAL          (3000 / TCP_SLOW_INTERVAL)
+#define TCP_RTO_BOUND(rto)       LWIP_MIN((rto), 0x7FFF)
+#define TCP_RTO_TICKS(pcb)       ((u32_t)(pcb)->rto)
+#define TCP_RTO_START(pcb)       do { (pcb)->rtime = 0; } while (0)
+#define TCP_RTO_STOP(pcb)        do { (pcb)->rtime = -1; } while (0)
+#define TCP_RTT_STAMP()          tcp_ticks
+#define TCP_RTT_MS(m)            ((m) * TCP_SLOW_INTERVAL)
+#endif /* TCP_RTO_MS */
+/* RTO from the smoothed RTT and its variance */
+#define TCP_RTO_CALC(pcb)        ((tcp_rto_t)TCP_RTO_BOUND(((pcb)->sa >> 3) + (pcb)->sv))
+
 #ifndef TCP_MSL
 #define TCP_MSL 60000UL /* The maximum segment lifetime in milliseconds */
 #endif
@@ -343,6 +369,24 @@ extern struct tcp_pcb *tcp_tw_pcbs;      /* List of all TCP PCBs in TIME-WAIT. *
 #define NUM_TCP_PCB_LISTS               4
 extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
 
+#if TCP_PCB_HASH
+/* ETH_CODE: hash chains over tcp_active_pcbs, tcp_tw_pcbs and
+   tcp_listen_pcbs (the latter of struct tcp_pcb_listen), kept in step by
+   TCP_REG and TCP_RMV. Bucket of a listening pcb: remote port 0 and
+   remote_ip NULL. */
+extern struct tcp_pcb *tcp_pcb_hash_active[TCP_PCB_HASH_SIZE];
+extern struct tcp_pcb *tcp_pcb_hash_tw[TCP_PCB_HASH_SIZE];
+extern struct tcp_pcb *tcp_pcb_hash_listen[TCP_PCB_HASH_SIZE];
+u32_t tcp_pcb_hash_bucket(u16_t local_port, u16_t remote_port, const ip_addr_t *remote_ip);
+void tcp_pcb_hash_add(struct tcp_pcb **pcbs, struct tcp_pcb *pcb);
+void tcp_pcb_hash_rmv(struct tcp_pcb **pcbs, struct tcp_pcb *pcb);
+#define TCP_PCB_HASH_ADD(pcbs, npcb) tcp_pcb_hash_add(pcbs, npcb)
+#define TCP_PCB_HASH_RMV(pcbs, npcb) tcp_pcb_hash_rmv(pcbs, npcb)
+#else /* TCP_PCB_HASH */
+#define TCP_PCB_HASH_ADD(pcbs, npcb)
+#define TCP_PCB_HASH_RMV(pcbs, npcb)
+#endif /* TCP_PCB_HASH */
+
 /* Axioms about the above lists:
    1) Every TCP PCB that is not CLOSED is in one of the lists.
    2) A PCB is only in one of the lists.
@@ -367,6 +411,7 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                             (npcb)->next = *(pcbs); \
                             LWIP_ASSERT("TCP_REG: npcb->next != npcb", (npcb)->next != (npcb)); \
                             *(pcbs) = (npcb); \
+                            TCP_PCB_HASH_ADD(pcbs, npcb); \
                             LWIP_ASSERT("TCP_REG: tcp_pcbs sane", tcp_pcbs_sane()); \
               tcp_timer_needed(); \
                             } while(0)
@@ -383,6 +428,7 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
                                } \
                             } \
                             (npcb)->next = NULL; \
+                            TCP_PCB_HASH_RMV(pcbs, npcb); \
                             LWIP_ASSERT("TCP_RMV: tcp_pcbs sane", tcp_pcbs_sane()); \
                             LWIP_DEBUGF(TCP_DEBUG, ("TCP_RMV: removed %p from %p\n", (void *)(npcb), (void *)(*(pcbs)))); \
                             } while(0)
@@ -393,6 +439,7 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
   do {                                             \
     (npcb)->next = *pcbs;                          \
     *(pcbs) = (npcb);                              \
+    TCP_PCB_HASH_ADD(pcbs, npcb);                  \
     tcp_timer_needed();                            \
   } while (0)
 
@@ -413,6 +460,7 @@ extern struct tcp_pcb ** const tcp_pcb_lists[NUM_TCP_PCB_LISTS];
       }                                            \
     }                                              \
     (npcb)->next = NULL;                           \
+    TCP_PCB_HASH_RMV(pcbs, npcb);                  \
   } while(0)
 
 #endif /* LWIP_DEBUG */
@@ -445,6 +493,7 @@ void tcp_segs_free(struct tcp_seg *seg);
 void tcp_seg_free(struct tcp_seg *seg);
 struct tcp_seg *tcp_seg_copy(struct tcp_seg *seg);
 
+#if TCP_ACK_EVERY == 2
 #define tcp_ack(pcb)                               \
   do {                                             \
     if((pcb)->flags & TF_ACK_DELAY) {              \
@@ -455,6 +504,23 @@ struct tcp_seg *tcp_seg_copy(struct tcp_seg *seg);
       tcp_set_flags(pcb, TF_ACK_DELAY);            \
     }                                              \
   } while (0)
+#else /* TCP_ACK_EVERY == 2 */
+#if (TCP_ACK_EVERY < 1) || (TCP_ACK_EVERY > 255)
+#error "TCP_ACK_EVERY must be 1..255"
+#endif
+/* ETH_CODE: ACK right away every TCP_ACK_EVERY segments; ack_segs is reset
+ * wherever a segment carrying the current ackno is built */
+#define tcp_ack(pcb)                               \
+  do {                                             \
+    if(++(pcb)->ack_segs >= TCP_ACK_EVERY) {       \
+      tcp_clear_flags(pcb, TF_ACK_DELAY);          \
+      tcp_ack_now(pcb);                            \
+    }                                              \
+    else {                                         \
+      tcp_set_flags(pcb, TF_ACK_DELAY);            \
+    }                                              \
+  } while (0)
+#endif /* TCP_ACK_EVERY == 2 */
 
 #define tcp_ack_now(pcb)                           \
   tcp_set_flags(pcb, TF_ACK_NOW)
@@ -504,12 +570,32 @@ s16_t tcp_pcbs_sane(void);
  * that a timer is needed (i.e. active- or time-wait-pcb found). */
 void tcp_timer_needed(void);
 
+#if TCP_RTO_MS
+/* ETH_CODE: (re)start and stop the retransmission timer, see TCP_RTO_MS */
+void tcp_rto_start(struct tcp_pcb *pcb);
+void tcp_rto_stop(struct tcp_pcb *pcb);
+u32_t tcp_rtt_stamp(void);
+#endif /* TCP_RTO_MS */
+
 void tcp_netif_ip_addr_changed(const ip_addr_t* old_addr, const ip_addr_t* new_addr);
 
 #if TCP_QUEUE_OOSEQ
 void tcp_free_ooseq(struct tcp_pcb *pcb);
 #endif
 
+#if TCP_OOSEQ_GOVERN
+/* ETH_CODE: ooseq accounting and limits, see TCP_OOSEQ_GOVERN */
+void tcp_ooseq_account(struct tcp_pcb *pcb);
+u32_t tcp_ooseq_bytes_limit(const struct tcp_pcb *pcb);
+u16_t tcp_ooseq_pbufs_limit(const struct tcp_pcb *pcb);
+#endif /* TCP_OOSEQ_GOVERN */
+
+#if TCP_SND_AUTOTUNE
+/* ETH_CODE: send buffer sizing, see TCP_SND_AUTOTUNE */
+void tcp_snd_tune_init(struct tcp_pcb *pcb);
+void tcp_snd_tune_demand(struct tcp_pcb *pcb);
+#endif /* TCP_SND_AUTOTUNE */
+
 #if LWIP_TCP_PCB_NUM_EXT_ARGS
 err_t tcp_ext_arg_invoke_callbacks_passive_open(struct tcp_pcb_listen *lpcb, struct tcp_pcb *cpcb);
 #endif
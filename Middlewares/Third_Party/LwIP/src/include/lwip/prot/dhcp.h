@@ -163,6 +163,8 @@ typedef enum {
 #define DHCP_OPTION_CLIENT_ID       61
 #define DHCP_OPTION_TFTP_SERVERNAME 66
 #define DHCP_OPTION_BOOTFILE        67
+/* ETH_CODE: RFC 4039, no data */
+#define DHCP_OPTION_RAPID_COMMIT    80
 
 /* possible combinations of overloading the file and sname fields with options */
 #define DHCP_OVERLOAD_NONE          0
@@ -134,6 +134,14 @@ struct msghdr {
   int           msg_flags;
 };
 
+#if LWIP_NETCONN_BATCH
+/* ETH_CODE: one message of lwip_recvmmsg() / lwip_sendmmsg() */
+struct mmsghdr {
+  struct msghdr msg_hdr;
+  unsigned int  msg_len;
+};
+#endif /* LWIP_NETCONN_BATCH */
+
 /* struct msghdr->msg_flags bit field values */
 #define MSG_TRUNC   0x04
 #define MSG_CTRUNC  0x08
@@ -219,6 +227,11 @@ struct ifreq {
 #define SO_CONTIMEO     0x1009 /* Unimplemented: connect timeout */
 #define SO_NO_CHECK     0x100a /* don't create UDP checksum */
 #define SO_BINDTODEVICE 0x100b /* bind to device */
+#if LWIP_SO_TIMESTAMP
+/* ETH_CODE: arrival time of each datagram, see LWIP_SO_TIMESTAMP */
+#define SO_TIMESTAMP    0x0400
+#define SCM_TIMESTAMP   SO_TIMESTAMP
+#endif /* LWIP_SO_TIMESTAMP */
 
 /*
  * Structure used for manipulating linger option.
@@ -591,6 +604,13 @@ ssize_t lwip_recvfrom(int s, void *mem, size_t len, int flags,
 ssize_t lwip_recvmsg(int s, struct msghdr *message, int flags);
 ssize_t lwip_send(int s, const void *dataptr, size_t size, int flags);
 ssize_t lwip_sendmsg(int s, const struct msghdr *message, int flags);
+#if LWIP_NETCONN_BATCH
+/* ETH_CODE: datagrams in batches, see LWIP_NETCONN_BATCH. Unlike Linux
+ * recvmmsg(), only the first datagram is waited for and there is no
+ * timeout argument (SO_RCVTIMEO applies). */
+int lwip_recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+int lwip_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags);
+#endif /* LWIP_NETCONN_BATCH */
 ssize_t lwip_sendto(int s, const void *dataptr, size_t size, int flags,
     const struct sockaddr *to, socklen_t tolen);
 int lwip_socket(int domain, int type, int protocol);
@@ -603,6 +623,30 @@ int lwip_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptse
 #if LWIP_SOCKET_POLL
 int lwip_poll(struct pollfd *fds, nfds_t nfds, int timeout);
 #endif
+#if LWIP_SOCKET_EVQ
+/* ETH_CODE: socket event queues, an epoll() for one task serving many
+ * sockets. Level triggered: a socket stays on the ready list, and is
+ * returned by every lwip_evq_wait(), until its events are consumed. */
+#define LWIP_EVQ_IN       0x01 /* readable: data, a connection to accept, or EOF */
+#define LWIP_EVQ_OUT      0x02 /* writable */
+#define LWIP_EVQ_ERR      0x04 /* error pending; always reported */
+
+#define LWIP_EVQ_CTL_ADD  1
+#define LWIP_EVQ_CTL_MOD  2
+#define LWIP_EVQ_CTL_DEL  3
+
+struct lwip_evq_event {
+  int fd;
+  u8_t events;
+  /** arg of lwip_evq_ctl(), e.g. the connection state of fd */
+  void *arg;
+};
+
+int lwip_evq_create(void);
+int lwip_evq_close(int q);
+int lwip_evq_ctl(int q, int op, int s, u8_t events, void *arg);
+int lwip_evq_wait(int q, struct lwip_evq_event *ev, int maxevents, int timeout);
+#endif /* LWIP_SOCKET_EVQ */
 int lwip_ioctl(int s, long cmd, void *argp);
 int lwip_fcntl(int s, int cmd, int val);
 const char *lwip_inet_ntop(int af, const void *src, char *dst, socklen_t size);
@@ -229,42 +229,48 @@ struct stats_mib2_netif_ctrs {
 };
 
 /** lwIP stats container */
+/* ETH_CODE: lets lwipopts.h put each group (and each pool's stats_mem)
+ * on its own cache line */
+#ifndef LWIP_STATS_ALIGN
+#define LWIP_STATS_ALIGN
+#endif
+
 struct stats_ {
 #if LINK_STATS
   /** Link level */
-  struct stats_proto link;
+  struct stats_proto link LWIP_STATS_ALIGN;
 #endif
 #if ETHARP_STATS
   /** ARP */
-  struct stats_proto etharp;
+  struct stats_proto etharp LWIP_STATS_ALIGN;
 #endif
 #if IPFRAG_STATS
   /** Fragmentation */
-  struct stats_proto ip_frag;
+  struct stats_proto ip_frag LWIP_STATS_ALIGN;
 #endif
 #if IP_STATS
   /** IP */
-  struct stats_proto ip;
+  struct stats_proto ip LWIP_STATS_ALIGN;
 #endif
 #if ICMP_STATS
   /** ICMP */
-  struct stats_proto icmp;
+  struct stats_proto icmp LWIP_STATS_ALIGN;
 #endif
 #if IGMP_STATS
   /** IGMP */
-  struct stats_igmp igmp;
+  struct stats_igmp igmp LWIP_STATS_ALIGN;
 #endif
 #if UDP_STATS
   /** UDP */
-  struct stats_proto udp;
+  struct stats_proto udp LWIP_STATS_ALIGN;
 #endif
 #if TCP_STATS
   /** TCP */
-  struct stats_proto tcp;
+  struct stats_proto tcp LWIP_STATS_ALIGN;
 #endif
 #if MEM_STATS
   /** Heap */
-  struct stats_mem mem;
+  struct stats_mem mem LWIP_STATS_ALIGN;
 #endif
 #if MEMP_STATS
   /** Internal memory pools */
@@ -272,31 +278,31 @@ struct stats_ {
 #endif
 #if SYS_STATS
   /** System */
-  struct stats_sys sys;
+  struct stats_sys sys LWIP_STATS_ALIGN;
 #endif
 #if IP6_STATS
   /** IPv6 */
-  struct stats_proto ip6;
+  struct stats_proto ip6 LWIP_STATS_ALIGN;
 #endif
 #if ICMP6_STATS
   /** ICMP6 */
-  struct stats_proto icmp6;
+  struct stats_proto icmp6 LWIP_STATS_ALIGN;
 #endif
 #if IP6_FRAG_STATS
   /** IPv6 fragmentation */
-  struct stats_proto ip6_frag;
+  struct stats_proto ip6_frag LWIP_STATS_ALIGN;
 #endif
 #if MLD6_STATS
   /** Multicast listener discovery */
-  struct stats_igmp mld6;
+  struct stats_igmp mld6 LWIP_STATS_ALIGN;
 #endif
 #if ND6_STATS
   /** Neighbor discovery */
-  struct stats_proto nd6;
+  struct stats_proto nd6 LWIP_STATS_ALIGN;
 #endif
 #if MIB2_STATS
   /** SNMP MIB2 */
-  struct stats_mib2 mib2;
+  struct stats_mib2 mib2 LWIP_STATS_ALIGN;
 #endif
 };
 
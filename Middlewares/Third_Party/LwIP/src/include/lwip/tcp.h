@@ -206,11 +206,28 @@ struct tcp_pcb_ext_args {
 typedef u16_t tcpflags_t;
 #define TCP_ALLFLAGS 0xffffU
 
+#if TCP_RTO_MS
+/* ETH_CODE: RTT, RTO and retransmission timer in milliseconds */
+typedef s32_t tcp_rto_t;
+#define TCPRTO_F S32_F
+#else /* TCP_RTO_MS */
+typedef s16_t tcp_rto_t;
+#define TCPRTO_F S16_F
+#endif /* TCP_RTO_MS */
+
 /**
  * members common to struct tcp_pcb and struct tcp_listen_pcb
  */
+#if TCP_PCB_HASH
+/* ETH_CODE: chain of the hash bucket, see TCP_PCB_HASH */
+#define TCP_PCB_HASH_NEXT(type) type *hnext;
+#else
+#define TCP_PCB_HASH_NEXT(type)
+#endif
+
 #define TCP_PCB_COMMON(type) \
   type *next; /* for the linked list */ \
+  TCP_PCB_HASH_NEXT(type) \
   void *callback_arg; \
   TCP_PCB_EXTARGS \
   enum tcp_state state; /* TCP state */ \
@@ -284,6 +301,12 @@ struct tcp_pcb {
   tcpwnd_size_t rcv_wnd;   /* receiver window available */
   tcpwnd_size_t rcv_ann_wnd; /* receiver window to announce */
   u32_t rcv_ann_right_edge; /* announced right edge of window */
+#if TCP_ACK_EVERY != 2
+  u8_t ack_segs;   /* ETH_CODE: segments tcp_ack()ed since the last ACK sent */
+#endif
+#if TCP_ACK_BATCH
+  u8_t ack_batched; /* ETH_CODE: tcp_output() left to tcp_ack_batch_end() */
+#endif
 
 #if LWIP_TCP_SACK_OUT
   /* SACK ranges to include in ACK packets (entry is invalid if left==right) */
@@ -292,16 +315,16 @@ struct tcp_pcb {
 #endif /* LWIP_TCP_SACK_OUT */
 
   /* Retransmission timer. */
-  s16_t rtime;
+  tcp_rto_t rtime;
 
   u16_t mss;   /* maximum segment size */
 
   /* RTT (round trip time) estimation variables */
-  u32_t rttest; /* RTT estimate in 500ms ticks */
+  u32_t rttest; /* RTT estimate in 500ms ticks (ETH_CODE: sys_now() with TCP_RTO_MS) */
   u32_t rtseq;  /* sequence number being timed */
-  s16_t sa, sv; /* @see "Congestion Avoidance and Control" by Van Jacobson and Karels */
+  tcp_rto_t sa, sv; /* @see "Congestion Avoidance and Control" by Van Jacobson and Karels */
 
-  s16_t rto;    /* retransmission time-out (in ticks of TCP_SLOW_INTERVAL) */
+  tcp_rto_t rto;    /* retransmission time-out (in ticks of TCP_SLOW_INTERVAL, ETH_CODE: ms with TCP_RTO_MS) */
   u8_t nrtx;    /* number of retransmissions */
 
   /* fast retransmit/recovery */
@@ -340,6 +363,28 @@ struct tcp_pcb {
 #if TCP_QUEUE_OOSEQ
   struct tcp_seg *ooseq;    /* Received out of sequence segments. */
 #endif /* TCP_QUEUE_OOSEQ */
+#if TCP_OOSEQ_GOVERN
+  /* ETH_CODE: ooseq as last accounted, see tcp_ooseq_account() */
+  u16_t ooseq_pbufs;
+  u32_t ooseq_bytes;
+#endif /* TCP_OOSEQ_GOVERN */
+#if TCP_SND_AUTOTUNE
+  /* ETH_CODE: send buffer size (snd_buf is what is free of it) and queue
+   * length limit, see TCP_SND_AUTOTUNE */
+  tcpwnd_size_t snd_buf_max;
+  u16_t snd_queuelen_max;
+  u8_t snd_tune_demand;   /* filled past half since the last tick */
+  u32_t snd_tune_acked;   /* bytes acknowledged since the last tick */
+  u32_t snd_tune_rate;    /* acknowledged bytes per tick, decaying peak */
+#endif /* TCP_SND_AUTOTUNE */
+#if TCP_CONN_STATS
+  /* ETH_CODE: since the pcb was allocated, see tcp_conn_snapshot() */
+  u32_t rexmit_rto;
+  u32_t rexmit_fast;
+  u32_t snd_wnd_stalls;
+  u32_t snd_buf_stalls;
+  u32_t rcv_wnd_stalls;
+#endif /* TCP_CONN_STATS */
 
   struct pbuf *refused_data; /* Data previously received but not yet taken by upper layer */
 
@@ -434,6 +479,20 @@ void             tcp_poll    (struct tcp_pcb *pcb, tcp_poll_fn poll, u8_t interv
 #define          tcp_sndbuf(pcb)          (TCPWND16((pcb)->snd_buf))
 /** @ingroup tcp_raw */
 #define          tcp_sndqueuelen(pcb)     ((pcb)->snd_queuelen)
+/* ETH_CODE: a pcb's send buffer size and queue length limit, and the
+ * netconn writable thresholds in proportion, see TCP_SND_AUTOTUNE */
+#if TCP_SND_AUTOTUNE
+#define          tcp_sndbuf_max(pcb)      ((pcb)->snd_buf_max)
+#define          tcp_sndqueuelen_max(pcb) ((pcb)->snd_queuelen_max)
+#define          tcp_sndlowat(pcb)        LWIP_MIN(LWIP_MIN(LWIP_MAX((u32_t)(pcb)->snd_buf_max / 2U, 2U * TCP_MSS + 1U), \
+                                                            (u32_t)(pcb)->snd_buf_max - 1U), 0xFFFFU - 4U * TCP_MSS)
+#define          tcp_sndqueuelowat(pcb)   LWIP_MIN(LWIP_MAX((pcb)->snd_queuelen_max / 2U, 5U), (pcb)->snd_queuelen_max)
+#else /* TCP_SND_AUTOTUNE */
+#define          tcp_sndbuf_max(pcb)      ((tcpwnd_size_t)TCP_SND_BUF)
+#define          tcp_sndqueuelen_max(pcb) ((u16_t)TCP_SND_QUEUELEN)
+#define          tcp_sndlowat(pcb)        TCP_SNDLOWAT
+#define          tcp_sndqueuelowat(pcb)   TCP_SNDQUEUELOWAT
+#endif /* TCP_SND_AUTOTUNE */
 /** @ingroup tcp_raw */
 #define          tcp_nagle_disable(pcb)   tcp_set_flags(pcb, TF_NODELAY)
 /** @ingroup tcp_raw */
@@ -473,10 +532,100 @@ err_t            tcp_shutdown(struct tcp_pcb *pcb, int shut_rx, int shut_tx);
 err_t            tcp_write   (struct tcp_pcb *pcb, const void *dataptr, u16_t len,
                               u8_t apiflags);
 
+#if LWIP_TCP_TXREF
+/* ETH_CODE: zero-copy writes with a completion, see tcp_write_ref() */
+struct tcp_txref;
+/** Called once the data of all writes under ref is no longer referenced:
+ *  acked, or dropped with the pcb. Runs in the thread freeing the last
+ *  pbuf (tcpip thread, or the caller of tcp_txref_release()): keep short. */
+typedef void (*tcp_txref_fn)(struct tcp_txref *ref);
+struct tcp_txref {
+  /** internal: the caller's reference plus one per pbuf holding the data */
+  u16_t refs;
+  tcp_txref_fn done;
+  void *arg;
+};
+void             tcp_txref_init   (struct tcp_txref *ref, tcp_txref_fn done, void *arg);
+void             tcp_txref_release(struct tcp_txref *ref);
+err_t            tcp_write_ref    (struct tcp_pcb *pcb, const void *dataptr, u16_t len,
+                                   u8_t apiflags, struct tcp_txref *ref);
+#endif /* LWIP_TCP_TXREF */
+
 void             tcp_setprio (struct tcp_pcb *pcb, u8_t prio);
 
 err_t            tcp_output  (struct tcp_pcb *pcb);
 
+#if TCP_ACK_BATCH
+/* ETH_CODE: one ACK per connection for the segments of a received batch */
+void             tcp_ack_batch_begin(void);
+void             tcp_ack_batch_end  (void);
+#endif /* TCP_ACK_BATCH */
+
+#if TCP_OOSEQ_GOVERN
+/* ETH_CODE: out-of-sequence data of all pcbs, see TCP_OOSEQ_GOVERN */
+struct tcp_ooseq_stats {
+  u32_t pbufs;          /* queued now */
+  u32_t bytes;
+  u32_t pbufs_max;      /* most pbufs queued at once */
+  u32_t trimmed;        /* queues cut back to their limit */
+  u32_t pool_low;       /* segments arriving with TCP_OOSEQ_POOL_LOW() true */
+  u32_t evicted;        /* queues freed by tcp_ooseq_evict() */
+  u32_t evicted_pbufs;
+};
+/** Written with the core lock held; a netif may read pbufs without it as
+ *  a hint whether tcp_ooseq_evict() has anything to free. */
+extern struct tcp_ooseq_stats tcp_ooseq_counters;
+/** Free whole ooseq queues, largest first, until at least pbufs pbufs are
+ *  released or none are left; returns the pbufs released. Core lock held. */
+u32_t            tcp_ooseq_evict    (u32_t pbufs);
+void             tcp_ooseq_get_stats(struct tcp_ooseq_stats *stats);
+#endif /* TCP_OOSEQ_GOVERN */
+
+#if TCP_SND_AUTOTUNE
+/* ETH_CODE: send buffers of all pcbs, see TCP_SND_AUTOTUNE */
+struct tcp_snd_tune_stats {
+  u32_t granted;        /* bytes above TCP_SND_BUF_MIN given out */
+  u32_t granted_max;
+  u32_t grown;          /* buffers enlarged */
+  u32_t shrunk;         /* buffers given back, in part or whole */
+  u32_t denied;         /* buffers that could not grow, budget spent */
+};
+void             tcp_snd_tune_get_stats(struct tcp_snd_tune_stats *stats);
+#endif /* TCP_SND_AUTOTUNE */
+
+#if TCP_CONN_STATS
+/* ETH_CODE: one active pcb, see tcp_conn_snapshot() */
+struct tcp_conn_info {
+  ip_addr_t local_ip;
+  ip_addr_t remote_ip;
+  u16_t local_port;
+  u16_t remote_port;
+  u8_t state;           /* enum tcp_state */
+  u8_t nrtx;            /* retransmissions of the oldest unacked segment */
+  u16_t mss;
+  u32_t srtt_ms;        /* smoothed RTT, 0 before the first sample */
+  u32_t rttvar_ms;
+  u32_t rto_ms;
+  u32_t cwnd;
+  u32_t ssthresh;
+  u32_t snd_wnd;        /* the peer's window */
+  u32_t rcv_ann_wnd;    /* the window last announced */
+  u32_t snd_buf;        /* free send buffer */
+  u32_t snd_buf_max;    /* send buffer size */
+  u32_t in_flight;      /* sent, not acknowledged */
+  u16_t snd_queuelen;
+  u16_t ooseq_pbufs;
+  u32_t ooseq_bytes;
+  u32_t rexmit_rto;     /* the counters of struct tcp_pcb */
+  u32_t rexmit_fast;
+  u32_t snd_wnd_stalls;
+  u32_t snd_buf_stalls;
+  u32_t rcv_wnd_stalls;
+};
+/** Copies up to max active pcbs into info; returns how many. Core lock held. */
+u16_t            tcp_conn_snapshot  (struct tcp_conn_info *info, u16_t max);
+#endif /* TCP_CONN_STATS */
+
 err_t            tcp_tcp_get_tcp_addrinfo(struct tcp_pcb *pcb, int local, ip_addr_t *addr, u16_t *port);
 
 #define tcp_dbg_get_tcp_state(pcb) ((pcb)->state)
@@ -90,6 +90,8 @@ struct tcpip_callback_msg* tcpip_callbackmsg_new(tcpip_callback_fn function, voi
 void   tcpip_callbackmsg_delete(struct tcpip_callback_msg* msg);
 err_t  tcpip_callbackmsg_trycallback(struct tcpip_callback_msg* msg);
 err_t  tcpip_callbackmsg_trycallback_fromisr(struct tcpip_callback_msg* msg);
+/* ETH_CODE: ahead of the messages already queued, see sys_mbox_trypost_front() */
+err_t  tcpip_callbackmsg_trycallback_urgent(struct tcpip_callback_msg* msg);
 
 /* free pbufs or heap memory from another context without blocking */
 err_t  pbuf_free_callback(struct pbuf *p);
@@ -48,6 +48,10 @@
 #include "lwip/ip.h"
 #include "lwip/ip6_addr.h"
 #include "lwip/prot/udp.h"
+#if UDP_TPL
+#include "lwip/prot/ethernet.h"
+#include "lwip/prot/ip4.h"
+#endif /* UDP_TPL */
 
 #ifdef __cplusplus
 extern "C" {
@@ -85,6 +89,10 @@ struct udp_pcb {
 /* Protocol specific PCB members */
 
   struct udp_pcb *next;
+#if UDP_PCB_HASH
+  /** ETH_CODE: chain of the local port's hash bucket, see UDP_PCB_HASH */
+  struct udp_pcb *hnext;
+#endif /* UDP_PCB_HASH */
 
   u8_t flags;
   /** ports are in host byte order */
@@ -114,6 +122,33 @@ struct udp_pcb {
 /* udp_pcbs export for external reference (e.g. SNMP agent) */
 extern struct udp_pcb *udp_pcbs;
 
+#if UDP_TPL
+/** ETH_CODE: bytes of the Ethernet, IPv4 and UDP headers in a template */
+#define UDP_TPL_HLEN (SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN)
+
+/** ETH_CODE: the headers udp_send() would write for a connected pcb, see
+ * UDP_TPL. Filled by udp_tpl_send(); the pcb must outlive it. */
+struct udp_tpl {
+  struct udp_pcb *pcb;
+  /** output netif, valid while gen is current */
+  struct netif *netif;
+  /** udp_tpl_gen when built, 0 when not built */
+  u32_t gen;
+  /** sys_now() when built */
+  u32_t built;
+  /** one's complement sum of the IP header with length and ID 0 */
+  u16_t ip_sum;
+  /** next IP ID */
+  u16_t id;
+  u8_t hdr[UDP_TPL_HLEN];
+};
+
+/** ETH_CODE: templates built at an older generation are rebuilt */
+extern u32_t udp_tpl_gen;
+/** ETH_CODE: a route or ARP entry changed (0 is never a generation) */
+#define UDP_TPL_INVALIDATE() do { if (++udp_tpl_gen == 0) { udp_tpl_gen = 1; } } while (0)
+#endif /* UDP_TPL */
+
 /* The following functions is the application layer interface to the
    UDP code. */
 struct udp_pcb * udp_new        (void);
@@ -137,6 +172,10 @@ err_t            udp_sendto     (struct udp_pcb *pcb, struct pbuf *p,
                                  const ip_addr_t *dst_ip, u16_t dst_port);
 err_t            udp_send       (struct udp_pcb *pcb, struct pbuf *p);
 
+#if UDP_TPL
+void             udp_tpl_init   (struct udp_tpl *tpl, struct udp_pcb *pcb);
+err_t            udp_tpl_send   (struct udp_tpl *tpl, struct pbuf *p);
+#endif /* UDP_TPL */
 #if LWIP_CHECKSUM_ON_COPY && CHECKSUM_GEN_UDP
 err_t            udp_sendto_if_chksum(struct udp_pcb *pcb, struct pbuf *p,
                                  const ip_addr_t *dst_ip, u16_t dst_port,
@@ -40,11 +40,360 @@
 #if !NO_SYS
 
 #include "cmsis_os.h"
+/* ETH_CODE: DTCM placement of the tcpip thread and the core lock */
+#include "lwip/tcpip.h"
+#include "main.h"
+/* ETH_CODE: xQueueSendToFront() for sys_mbox_trypost_front(), the FromISR
+ * calls for sys_mbox_trypost_fromisr() */
+#include "queue.h"
+#include "task.h"
+/* ETH_CODE: blocking time and priority inversions of the core lock */
+#include "mutexmon/mutex_mon.h"
+#include <string.h>
 
 #if defined(LWIP_PROVIDE_ERRNO)
 int errno;
 #endif
 
+#if SYS_MBOX_LOCKFREE
+/* ETH_CODE: SYS_MBOX_LOCKFREE, see lwipopts.h. A mailbox is a bounded ring
+ * of message pointers in which every slot carries a sequence number saying
+ * whose turn it is (D. Vyukov's bounded queue). A poster claims a slot by
+ * advancing tail with LDREX/STREX, stores the message, then the slot's
+ * sequence; the fetcher claims it the same way on head and hands the slot
+ * back with the next lap's sequence. Posters from tasks and interrupts
+ * never wait for each other or for the fetcher, and nothing masks
+ * interrupts or enters the kernel unless a thread sleeps.
+ *
+ * The fetcher, one thread at a time as lwIP uses its mailboxes, sleeps on
+ * SYS_MBOX_FLAG: it publishes itself in waiter, looks at the ring once
+ * more and waits. A poster that finds waiter set takes it and sets the
+ * flag, so a message posted in between is not missed; a flag left over
+ * costs the fetcher one more look at the ring.
+ *
+ * sys_mbox_trypost_front() posts to a second ring of SYS_MBOX_FRONT_SLOTS
+ * that is fetched first. Sizes round up to a power of two. */
+
+/* Next to SYS_NOTIFY_FLAG, which the socket event queues wait on. Both
+ * are bits of the FreeRTOS task notification value (CMSIS thread flags),
+ * which the components' tasks also use as a counter (ulTaskNotifyTake() /
+ * xTaskNotifyGive()). A task must not do both: a flag left over from a
+ * wakeup reads as a count of 2^29 to ulTaskNotifyTake(), and
+ * ulTaskNotifyTake(pdFALSE) decrements it into garbage. So a task that
+ * counts notifications must not block in a mailbox fetch (netconn and
+ * socket receive, accept, tcpip_thread) or in lwip_select() / poll(),
+ * and no such thread may count: the driver's blocking low_level_output()
+ * runs on them and so waits on a semaphore. With notification arrays
+ * (FreeRTOS 10.4 or later, configTASK_NOTIFICATION_ARRAY_ENTRIES > 1) the
+ * fetcher sleeps on its own index instead, and mailboxes drop out of the
+ * rule. */
+#define SYS_MBOX_FLAG 0x20000000U
+#if defined(configTASK_NOTIFICATION_ARRAY_ENTRIES) && (configTASK_NOTIFICATION_ARRAY_ENTRIES > 1)
+#define SYS_MBOX_NOTIFY_INDEX 1U
+#endif
+
+#define SYS_MBOX_FRONT_SLOTS 4U
+
+/* The size sys_mbox_new() rounds to, for the static tcpip mailbox */
+#define SYS_MBOX_POW2(n) ((n) <= 4 ? 4 : (n) <= 8 ? 8 : (n) <= 16 ? 16 : (n) <= 32 ? 32 : \
+                          (n) <= 64 ? 64 : (n) <= 128 ? 128 : 256)
+
+struct sys_mbox_slot {
+  u32_t seq;
+  void *msg;
+};
+
+struct sys_mbox_ring {
+  u32_t mask;
+  u32_t head;                   /* next to fetch, free-running */
+  u32_t tail;                   /* next to post */
+  struct sys_mbox_slot *slot;
+};
+
+struct sys_mbox_lf {
+  struct sys_mbox_ring ring;
+  struct sys_mbox_ring front;
+  osThreadId_t waiter;          /* fetcher about to sleep, or NULL */
+  struct sys_mbox_slot front_slot[SYS_MBOX_FRONT_SLOTS];
+};
+
+_Static_assert(TCPIP_MBOX_SIZE <= 256, "SYS_MBOX_POW2 stops at 256");
+
+/* The tcpip thread mailbox (the first one, created by tcpip_init()) is
+ * static and in DTCM: every tcpip_callback() and netconn API message goes
+ * through it. */
+static struct sys_mbox_lf tcpip_mbox_lf DTCM_BSS;
+static struct sys_mbox_slot tcpip_mbox_slot[SYS_MBOX_POW2(TCPIP_MBOX_SIZE)] DTCM_BSS;
+static uint8_t tcpip_mbox_created;
+
+static void sys_mbox_ring_init(struct sys_mbox_ring *r, struct sys_mbox_slot *slot, u32_t size)
+{
+  r->mask = size - 1U;
+  r->head = 0U;
+  r->tail = 0U;
+  r->slot = slot;
+  for (u32_t i = 0U; i < size; i++) {
+    slot[i].seq = i;
+  }
+}
+
+/* 0 if full. Any context. */
+static int sys_mbox_ring_put(struct sys_mbox_ring *r, void *msg)
+{
+  u32_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+
+  for (;;) {
+    struct sys_mbox_slot *s = &r->slot[pos & r->mask];
+    s32_t dif = (s32_t)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) - pos);
+
+    if (dif == 0) {
+      /* A failed claim reloads pos */
+      if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1U, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        s->msg = msg;
+        __atomic_store_n(&s->seq, pos + 1U, __ATOMIC_RELEASE);
+        return 1;
+      }
+    } else if (dif < 0) {
+      /* The slot of the previous lap is not fetched yet */
+      return 0;
+    } else {
+      pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/* 0 if empty, or the next message is claimed but not stored yet: its
+ * poster wakes the fetcher when it is. */
+static int sys_mbox_ring_get(struct sys_mbox_ring *r, void **msg)
+{
+  u32_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+
+  for (;;) {
+    struct sys_mbox_slot *s = &r->slot[pos & r->mask];
+    s32_t dif = (s32_t)(__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) - (pos + 1U));
+
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1U, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        if (msg != NULL) {
+          *msg = s->msg;
+        }
+        __atomic_store_n(&s->seq, pos + r->mask + 1U, __ATOMIC_RELEASE);
+        return 1;
+      }
+    } else if (dif < 0) {
+      return 0;
+    } else {
+      pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static u32_t sys_mbox_ring_count(const struct sys_mbox_ring *r)
+{
+  return __atomic_load_n(&r->tail, __ATOMIC_RELAXED) - __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+}
+
+static int sys_mbox_get(struct sys_mbox_lf *m, void **msg)
+{
+  return sys_mbox_ring_get(&m->front, msg) || sys_mbox_ring_get(&m->ring, msg);
+}
+
+/* After a post: the fetcher that went to sleep, taken out of waiter */
+static osThreadId_t sys_mbox_take_waiter(struct sys_mbox_lf *m)
+{
+  /* The slot's sequence is stored before waiter is read */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&m->waiter, __ATOMIC_RELAXED) == NULL) {
+    return NULL;
+  }
+  return __atomic_exchange_n(&m->waiter, NULL, __ATOMIC_ACQUIRE);
+}
+
+static void sys_mbox_wake(struct sys_mbox_lf *m)
+{
+  osThreadId_t thread = sys_mbox_take_waiter(m);
+
+  if (thread != NULL) {
+#ifdef SYS_MBOX_NOTIFY_INDEX
+    (void)xTaskNotifyGiveIndexed((TaskHandle_t)thread, SYS_MBOX_NOTIFY_INDEX);
+#else
+    osThreadFlagsSet(thread, SYS_MBOX_FLAG);
+#endif
+  }
+}
+
+/* The fetcher until sys_mbox_wake() or ticks (osWaitForever) */
+static void sys_mbox_sleep(uint32_t ticks)
+{
+#ifdef SYS_MBOX_NOTIFY_INDEX
+  (void)ulTaskNotifyTakeIndexed(SYS_MBOX_NOTIFY_INDEX, pdTRUE, (TickType_t)ticks);
+#else
+  (void)osThreadFlagsWait(SYS_MBOX_FLAG, osFlagsWaitAny, ticks);
+#endif
+}
+
+/*-----------------------------------------------------------------------------------*/
+//  Creates an empty mailbox.
+err_t sys_mbox_new(sys_mbox_t *mbox, int size)
+{
+  struct sys_mbox_lf *m;
+  struct sys_mbox_slot *slot;
+  u32_t n = SYS_MBOX_FRONT_SLOTS;
+
+  while (n < (u32_t)size) {
+    n <<= 1;
+  }
+  if (!tcpip_mbox_created && (size == TCPIP_MBOX_SIZE)) {
+    tcpip_mbox_created = 1;
+    m = &tcpip_mbox_lf;
+    slot = tcpip_mbox_slot;
+  } else {
+    m = (struct sys_mbox_lf *)pvPortMalloc(sizeof(*m) + (n * sizeof(*slot)));
+    slot = (m != NULL) ? (struct sys_mbox_slot *)(m + 1) : NULL;
+  }
+  *mbox = m;
+#if SYS_STATS
+  ++lwip_stats.sys.mbox.used;
+  if(lwip_stats.sys.mbox.max < lwip_stats.sys.mbox.used)
+  {
+    lwip_stats.sys.mbox.max = lwip_stats.sys.mbox.used;
+  }
+#endif /* SYS_STATS */
+  if(m == NULL)
+    return ERR_MEM;
+
+  sys_mbox_ring_init(&m->ring, slot, n);
+  sys_mbox_ring_init(&m->front, m->front_slot, SYS_MBOX_FRONT_SLOTS);
+  m->waiter = NULL;
+  return ERR_OK;
+}
+
+/*-----------------------------------------------------------------------------------*/
+/*
+  Deallocates a mailbox. If there are messages still present in the
+  mailbox when the mailbox is deallocated, it is an indication of a
+  programming error in lwIP and the developer should be notified.
+*/
+void sys_mbox_free(sys_mbox_t *mbox)
+{
+  struct sys_mbox_lf *m = *mbox;
+
+  if((sys_mbox_ring_count(&m->ring) != 0U) || (sys_mbox_ring_count(&m->front) != 0U))
+  {
+    /* Line for breakpoint.  Should never break here! */
+    portNOP();
+#if SYS_STATS
+    lwip_stats.sys.mbox.err++;
+#endif /* SYS_STATS */
+
+  }
+  if (m != &tcpip_mbox_lf)
+  {
+    vPortFree(m);
+  }
+#if SYS_STATS
+  --lwip_stats.sys.mbox.used;
+#endif /* SYS_STATS */
+}
+
+/*-----------------------------------------------------------------------------------*/
+//   Posts the "msg" to the mailbox; polls each tick while it is full.
+void sys_mbox_post(sys_mbox_t *mbox, void *data)
+{
+  while(!sys_mbox_ring_put(&(*mbox)->ring, data))
+  {
+    osDelay(1U);
+  }
+  sys_mbox_wake(*mbox);
+}
+
+/*-----------------------------------------------------------------------------------*/
+//   Try to post the "msg" to the mailbox.
+err_t sys_mbox_trypost(sys_mbox_t *mbox, void *msg)
+{
+  if(sys_mbox_ring_put(&(*mbox)->ring, msg))
+  {
+    sys_mbox_wake(*mbox);
+    return ERR_OK;
+  }
+#if SYS_STATS
+  lwip_stats.sys.mbox.err++;
+#endif /* SYS_STATS */
+  return ERR_MEM;
+}
+
+/*-----------------------------------------------------------------------------------*/
+/* ETH_CODE: like sys_mbox_trypost(), but the message is fetched ahead of
+ * those already in the mailbox. */
+err_t sys_mbox_trypost_front(sys_mbox_t *mbox, void *msg)
+{
+  if(sys_mbox_ring_put(&(*mbox)->front, msg))
+  {
+    sys_mbox_wake(*mbox);
+    return ERR_OK;
+  }
+#if SYS_STATS
+  lwip_stats.sys.mbox.err++;
+#endif /* SYS_STATS */
+  return ERR_MEM;
+}
+
+/*-----------------------------------------------------------------------------------*/
+/*
+  Blocks the thread until a message arrives in the mailbox, but not longer
+  than "timeout" milliseconds (0: no timeout). Returns the milliseconds
+  spent waiting or SYS_ARCH_TIMEOUT, see below for the generic version.
+*/
+u32_t sys_arch_mbox_fetch(sys_mbox_t *mbox, void **msg, u32_t timeout)
+{
+  struct sys_mbox_lf *m = *mbox;
+  uint32_t starttime = osKernelGetTickCount();
+  uint32_t waited;
+
+  for (;;)
+  {
+    if (sys_mbox_get(m, msg))
+    {
+      return (osKernelGetTickCount() - starttime);
+    }
+    waited = osKernelGetTickCount() - starttime;
+    if ((timeout != 0) && (waited >= timeout))
+    {
+      return SYS_ARCH_TIMEOUT;
+    }
+    __atomic_store_n(&m->waiter, osThreadGetId(), __ATOMIC_RELAXED);
+    /* waiter is stored before the ring is read again */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!sys_mbox_get(m, msg))
+    {
+      sys_mbox_sleep((timeout != 0) ? (timeout - waited) : osWaitForever);
+      (void)__atomic_exchange_n(&m->waiter, NULL, __ATOMIC_RELAXED);
+      continue;
+    }
+    (void)__atomic_exchange_n(&m->waiter, NULL, __ATOMIC_RELAXED);
+    return (osKernelGetTickCount() - starttime);
+  }
+}
+
+/*-----------------------------------------------------------------------------------*/
+/*
+  Similar to sys_arch_mbox_fetch, but if message is not ready immediately, we'll
+  return with SYS_MBOX_EMPTY.  On success, 0 is returned.
+*/
+u32_t sys_arch_mbox_tryfetch(sys_mbox_t *mbox, void **msg)
+{
+  return sys_mbox_get(*mbox, msg) ? ERR_OK : SYS_MBOX_EMPTY;
+}
+#else
+#if (osCMSIS >= 0x20000U)
+/* ETH_CODE: the tcpip thread mailbox (the first one, created by
+ * tcpip_init()) is static and in DTCM: every tcpip_callback() and
+ * netconn API message goes through it. */
+static StaticQueue_t tcpip_mbox_cb DTCM_BSS;
+static void *tcpip_mbox_mem[TCPIP_MBOX_SIZE] DTCM_BSS;
+static uint8_t tcpip_mbox_created;
+#endif
+
 /*-----------------------------------------------------------------------------------*/
 //  Creates an empty mailbox.
 err_t sys_mbox_new(sys_mbox_t *mbox, int size)
@@ -53,7 +402,15 @@ err_t sys_mbox_new(sys_mbox_t *mbox, int size)
   osMessageQDef(QUEUE, size, void *);
   *mbox = osMessageCreate(osMessageQ(QUEUE), NULL);
 #else
-  *mbox = osMessageQueueNew(size, sizeof(void *), NULL);
+  osMessageQueueAttr_t attributes = {0};
+  if (!tcpip_mbox_created && (size == TCPIP_MBOX_SIZE)) {
+    tcpip_mbox_created = 1;
+    attributes.cb_mem = &tcpip_mbox_cb;
+    attributes.cb_size = sizeof(tcpip_mbox_cb);
+    attributes.mq_mem = tcpip_mbox_mem;
+    attributes.mq_size = sizeof(tcpip_mbox_mem);
+  }
+  *mbox = osMessageQueueNew(size, sizeof(void *), &attributes);
 #endif
 #if SYS_STATS
   ++lwip_stats.sys.mbox.used;
@@ -137,14 +494,104 @@ err_t sys_mbox_trypost(sys_mbox_t *mbox, void *msg)
   return result;
 }
 
+/*-----------------------------------------------------------------------------------*/
+/* ETH_CODE: like sys_mbox_trypost(), but the message goes to the head of
+ * the queue and is fetched next. Task level only. */
+err_t sys_mbox_trypost_front(sys_mbox_t *mbox, void *msg)
+{
+#if (osCMSIS < 0x20000U)
+  return sys_mbox_trypost(mbox, msg);
+#else
+  /* On FreeRTOS a CMSIS-RTOS v2 message queue id is the queue handle */
+  if(xQueueSendToFront((QueueHandle_t)*mbox, &msg, 0) == pdPASS)
+  {
+    return ERR_OK;
+  }
+#if SYS_STATS
+  lwip_stats.sys.mbox.err++;
+#endif /* SYS_STATS */
+  return ERR_MEM;
+#endif
+}
+
+#endif /* SYS_MBOX_LOCKFREE */
+
+
+#if SYS_ARCH_PROTECT_BASEPRI
+/* ETH_CODE: depth of SYS_ARCH_PROTECT, see sys_arch_protect() */
+static uint32_t sys_arch_prot_nesting DTCM_BSS;
+#endif
 
 /*-----------------------------------------------------------------------------------*/
-//   Try to post the "msg" to the mailbox.
+/* ETH_CODE: socket event queue wake-ups on a thread flag (task notification) */
+sys_thread_t sys_notify_self(void)
+{
+  return osThreadGetId();
+}
+
+void sys_notify(sys_thread_t thread)
+{
+#if SYS_ARCH_PROTECT_BASEPRI
+  /* The kernel's critical section exit would clear the mask */
+  LWIP_ASSERT("sys_notify: under SYS_ARCH_PROTECT", sys_arch_prot_nesting == 0U);
+#endif
+#if (osCMSIS < 0x20000U)
+  osSignalSet(thread, SYS_NOTIFY_FLAG);
+#else
+  osThreadFlagsSet(thread, SYS_NOTIFY_FLAG);
+#endif
+}
+
+u32_t sys_notify_wait(u32_t timeout)
+{
+#if (osCMSIS < 0x20000U)
+  osEvent event = osSignalWait(SYS_NOTIFY_FLAG, timeout != 0 ? timeout : osWaitForever);
+  return event.status == osEventSignal ? 0 : SYS_ARCH_TIMEOUT;
+#else
+  uint32_t flags = osThreadFlagsWait(SYS_NOTIFY_FLAG, osFlagsWaitAny,
+                                     timeout != 0 ? timeout : osWaitForever);
+  return (flags & osFlagsError) ? SYS_ARCH_TIMEOUT : 0;
+#endif
+}
+
+
+/*-----------------------------------------------------------------------------------*/
+/* ETH_CODE: sys_mbox_trypost() for interrupts at or below
+ * configMAX_SYSCALL_INTERRUPT_PRIORITY, with the FreeRTOS FromISR calls
+ * directly: a fetcher it wakes runs as the interrupt returns, without a
+ * task in between. */
 err_t sys_mbox_trypost_fromisr(sys_mbox_t *mbox, void *msg)
 {
-  return sys_mbox_trypost(mbox, msg);
+  BaseType_t woken = pdFALSE;
+#if SYS_MBOX_LOCKFREE
+  osThreadId_t thread;
+
+  if(!sys_mbox_ring_put(&(*mbox)->ring, msg))
+#else
+  if(xQueueSendToBackFromISR((QueueHandle_t)*mbox, &msg, &woken) != pdPASS)
+#endif
+  {
+#if SYS_STATS
+    lwip_stats.sys.mbox.err++;
+#endif /* SYS_STATS */
+    return ERR_MEM;
+  }
+#if SYS_MBOX_LOCKFREE
+  thread = sys_mbox_take_waiter(*mbox);
+  if(thread != NULL)
+  {
+#ifdef SYS_MBOX_NOTIFY_INDEX
+    vTaskNotifyGiveIndexedFromISR((TaskHandle_t)thread, SYS_MBOX_NOTIFY_INDEX, &woken);
+#else
+    (void)xTaskNotifyFromISR((TaskHandle_t)thread, SYS_MBOX_FLAG, eSetBits, &woken);
+#endif
+  }
+#endif
+  portYIELD_FROM_ISR(woken);
+  return ERR_OK;
 }
 
+#if !SYS_MBOX_LOCKFREE
 /*-----------------------------------------------------------------------------------*/
 /*
   Blocks the thread until a message arrives in the mailbox, but does
@@ -231,6 +678,7 @@ u32_t sys_arch_mbox_tryfetch(sys_mbox_t *mbox, void **msg)
     return SYS_MBOX_EMPTY;
   }
 }
+#endif /* !SYS_MBOX_LOCKFREE */
 /*----------------------------------------------------------------------------------*/
 int sys_mbox_valid(sys_mbox_t *mbox)
 {
@@ -368,6 +816,72 @@ void sys_sem_set_invalid(sys_sem_t *sem)
   *sem = SYS_SEM_NULL;
 }
 
+#if LWIP_NETCONN_SEM_PER_THREAD && (osCMSIS >= 0x20000U)
+/* ETH_CODE: LWIP_NETCONN_SEM_PER_THREAD, see lwipopts.h. A task's
+ * semaphore is a slot of a static table, its address in the task's
+ * thread local storage; creating it allocates nothing. A task deleted
+ * without netconn_thread_cleanup() keeps its slot. */
+#if configNUM_THREAD_LOCAL_STORAGE_POINTERS <= LWIP_NETCONN_SEM_TLS_INDEX
+#error "LWIP_NETCONN_SEM_PER_THREAD needs configNUM_THREAD_LOCAL_STORAGE_POINTERS > LWIP_NETCONN_SEM_TLS_INDEX"
+#endif
+
+struct sys_netconn_sem {
+  sys_sem_t sem;
+  StaticSemaphore_t cb;
+  u8_t used;
+};
+
+static struct sys_netconn_sem sys_netconn_sems[LWIP_NETCONN_THREAD_SEMS];
+
+sys_sem_t *sys_arch_netconn_sem_get(void)
+{
+  struct sys_netconn_sem *s = pvTaskGetThreadLocalStoragePointer(NULL, LWIP_NETCONN_SEM_TLS_INDEX);
+
+  if (s == NULL)
+  {
+    sys_arch_netconn_sem_alloc();
+    s = pvTaskGetThreadLocalStoragePointer(NULL, LWIP_NETCONN_SEM_TLS_INDEX);
+    LWIP_ASSERT("sys_arch_netconn_sem_get: no semaphore left, see LWIP_NETCONN_THREAD_SEMS", s != NULL);
+  }
+  return (s != NULL) ? &s->sem : NULL;
+}
+
+void sys_arch_netconn_sem_alloc(void)
+{
+  for (u32_t i = 0; i < LWIP_NETCONN_THREAD_SEMS; i++)
+  {
+    struct sys_netconn_sem *s = &sys_netconn_sems[i];
+    osSemaphoreAttr_t attr = { .name = "netconn", .cb_mem = &s->cb, .cb_size = sizeof(s->cb) };
+
+    if (__atomic_exchange_n(&s->used, 1U, __ATOMIC_ACQUIRE) != 0U)
+    {
+      continue;
+    }
+    s->sem = osSemaphoreNew(UINT16_MAX, 0, &attr);
+    if (s->sem == NULL)
+    {
+      __atomic_store_n(&s->used, 0U, __ATOMIC_RELEASE);
+      return;
+    }
+    vTaskSetThreadLocalStoragePointer(NULL, LWIP_NETCONN_SEM_TLS_INDEX, s);
+    return;
+  }
+}
+
+void sys_arch_netconn_sem_free(void)
+{
+  struct sys_netconn_sem *s = pvTaskGetThreadLocalStoragePointer(NULL, LWIP_NETCONN_SEM_TLS_INDEX);
+
+  if (s != NULL)
+  {
+    vTaskSetThreadLocalStoragePointer(NULL, LWIP_NETCONN_SEM_TLS_INDEX, NULL);
+    osSemaphoreDelete(s->sem);
+    s->sem = SYS_SEM_NULL;
+    __atomic_store_n(&s->used, 0U, __ATOMIC_RELEASE);
+  }
+}
+#endif /* LWIP_NETCONN_SEM_PER_THREAD */
+
 /*-----------------------------------------------------------------------------------*/
 #if (osCMSIS < 0x20000U)
 osMutexId lwip_sys_mutex;
@@ -378,17 +892,28 @@ osMutexId_t lwip_sys_mutex;
 // Initialize sys arch
 void sys_init(void)
 {
+/* ETH_CODE: no mutex with SYS_ARCH_PROTECT_BASEPRI */
+#if !SYS_ARCH_PROTECT_BASEPRI
 #if (osCMSIS < 0x20000U)
   lwip_sys_mutex = osMutexCreate(osMutex(lwip_sys_mutex));
 #else
   lwip_sys_mutex = osMutexNew(NULL);
 #endif
+#if MUTEX_MON
+  (void)mutex_mon_register((SemaphoreHandle_t)lwip_sys_mutex, "lwip_sys");
+#endif
+#endif
 }
 /*-----------------------------------------------------------------------------------*/
                                       /* Mutexes*/
 /*-----------------------------------------------------------------------------------*/
 /*-----------------------------------------------------------------------------------*/
 #if LWIP_COMPAT_MUTEX == 0
+#if LWIP_TCPIP_CORE_LOCKING && (osCMSIS >= 0x20000U)
+/* ETH_CODE: the core lock is taken for every packet and API call */
+static StaticSemaphore_t lock_tcpip_core_cb DTCM_BSS;
+#endif
+
 /* Create a new mutex*/
 err_t sys_mutex_new(sys_mutex_t *mutex) {
 
@@ -396,7 +921,14 @@ err_t sys_mutex_new(sys_mutex_t *mutex) {
   osMutexDef(MUTEX);
   *mutex = osMutexCreate(osMutex(MUTEX));
 #else
-  *mutex = osMutexNew(NULL);
+  osMutexAttr_t attributes = {0};
+#if LWIP_TCPIP_CORE_LOCKING
+  if (mutex == &lock_tcpip_core) {
+    attributes.cb_mem = &lock_tcpip_core_cb;
+    attributes.cb_size = sizeof(lock_tcpip_core_cb);
+  }
+#endif
+  *mutex = osMutexNew(&attributes);
 #endif
 
   if(*mutex == NULL)
@@ -406,6 +938,12 @@ err_t sys_mutex_new(sys_mutex_t *mutex) {
 #endif /* SYS_STATS */
     return ERR_MEM;
   }
+#if LWIP_TCPIP_CORE_LOCKING && MUTEX_MON && (osCMSIS >= 0x20000U)
+  /* ETH_CODE: sys_mutex_lock() measures it */
+  if (mutex == &lock_tcpip_core) {
+    (void)mutex_mon_register((SemaphoreHandle_t)*mutex, "core");
+  }
+#endif
 
 #if SYS_STATS
   ++lwip_stats.sys.mutex.used;
@@ -431,6 +969,9 @@ void sys_mutex_lock(sys_mutex_t *mutex)
 {
 #if (osCMSIS < 0x20000U)
   osMutexWait(*mutex, osWaitForever);
+#elif MUTEX_MON
+  /* ETH_CODE: osMutexAcquire() of a non-recursive mutex, measured */
+  (void)mutex_mon_take((SemaphoreHandle_t)*mutex, portMAX_DELAY);
 #else
   osMutexAcquire(*mutex, osWaitForever);
 #endif
@@ -452,17 +993,32 @@ void sys_mutex_unlock(sys_mutex_t *mutex)
   thread() function. The id of the new thread is returned. Both the id and
   the priority are system dependent.
 */
+#if (osCMSIS >= 0x20000U)
+/* ETH_CODE: tcpip thread memory in DTCM, zero wait state for the stack */
+static StaticTask_t tcpip_thread_cb DTCM_BSS;
+static uint32_t tcpip_thread_stack[(TCPIP_THREAD_STACKSIZE + 3) / 4] DTCM_BSS __ALIGNED(8);
+static uint8_t tcpip_thread_created;
+#endif
+
 sys_thread_t sys_thread_new(const char *name, lwip_thread_fn thread , void *arg, int stacksize, int prio)
 {
 #if (osCMSIS < 0x20000U)
   const osThreadDef_t os_thread_def = { (char *)name, (os_pthread)thread, (osPriority)prio, 0, stacksize};
   return osThreadCreate(&os_thread_def, arg);
 #else
-  const osThreadAttr_t attributes = {
+  osThreadAttr_t attributes = {
                         .name = name,
                         .stack_size = stacksize,
                         .priority = (osPriority_t)prio,
                       };
+  if (!tcpip_thread_created && (stacksize <= (int)sizeof(tcpip_thread_stack)) &&
+      (strcmp(name, TCPIP_THREAD_NAME) == 0)) {
+    tcpip_thread_created = 1;
+    attributes.cb_mem = &tcpip_thread_cb;
+    attributes.cb_size = sizeof(tcpip_thread_cb);
+    attributes.stack_mem = tcpip_thread_stack;
+    attributes.stack_size = sizeof(tcpip_thread_stack);
+  }
   return osThreadNew(thread, arg, &attributes);
 #endif
 }
@@ -483,10 +1039,37 @@ sys_thread_t sys_thread_new(const char *name, lwip_thread_fn thread , void *arg,
   Note: This function is based on FreeRTOS API, because no equivalent CMSIS-RTOS
         API is available
 */
+/* ETH_CODE: SYS_ARCH_PROTECT_BASEPRI, see lwipopts.h. The ETH interrupt
+ * and every other one calling FreeRTOS or lwIP sit at or below
+ * configMAX_SYSCALL_INTERRUPT_PRIORITY, so they are held off while a pool
+ * list is changed, tasks cannot be switched in, and higher interrupts keep
+ * running. The returned value is the previous BASEPRI: an inner pair
+ * restores the mask of the outer one, which restores the caller's. While
+ * the mask is up no other protected section can run, so one counter holds
+ * the nesting depth for all contexts; it catches unbalanced pairs. */
+#if SYS_ARCH_PROTECT_BASEPRI
+sys_prot_t sys_arch_protect(void)
+{
+  sys_prot_t pval = (sys_prot_t)portSET_INTERRUPT_MASK_FROM_ISR();
+
+  sys_arch_prot_nesting++;
+  return pval;
+}
+
+void sys_arch_unprotect(sys_prot_t pval)
+{
+  LWIP_ASSERT("sys_arch_unprotect: not protected", sys_arch_prot_nesting > 0U);
+  sys_arch_prot_nesting--;
+  portCLEAR_INTERRUPT_MASK_FROM_ISR((uint32_t)pval);
+}
+#else
 sys_prot_t sys_arch_protect(void)
 {
 #if (osCMSIS < 0x20000U)
   osMutexWait(lwip_sys_mutex, osWaitForever);
+#elif MUTEX_MON
+  /* ETH_CODE: measured like sys_mutex_lock() */
+  (void)mutex_mon_take((SemaphoreHandle_t)lwip_sys_mutex, portMAX_DELAY);
 #else
   osMutexAcquire(lwip_sys_mutex, osWaitForever);
 #endif
@@ -508,5 +1091,6 @@ void sys_arch_unprotect(sys_prot_t pval)
   ( void ) pval;
   osMutexRelease(lwip_sys_mutex);
 }
+#endif /* SYS_ARCH_PROTECT_BASEPRI */
 
 #endif /* !NO_SYS */
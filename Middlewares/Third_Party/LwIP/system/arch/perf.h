@@ -32,7 +32,11 @@
 #ifndef __PERF_H__
 #define __PERF_H__
 
-#define PERF_START    /* null definition */
-#define PERF_STOP(x)  /* null definition */
+/* ETH_CODE: sections timed on the DWT cycle counter, see
+ * component/perf/perf_stats.h. Only included when LWIP_PERF is set. */
+#include "perf/perf_stats.h"
+
+#define PERF_START    PerfStatsStart_t perf_start_ = perf_stats_start()
+#define PERF_STOP(x)  do { static uint8_t perf_slot_; perf_stats_record(&perf_slot_, (x), &perf_start_); } while (0)
 
 #endif /* __PERF_H__ */
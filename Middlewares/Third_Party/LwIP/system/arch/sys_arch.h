@@ -39,6 +39,8 @@
 #endif
 
 #include "cmsis_os.h"
+/* ETH_CODE: err_t of sys_mbox_trypost_front() */
+#include "lwip/err.h"
 
 #ifdef  __cplusplus
 extern "C" {
@@ -46,6 +48,10 @@ extern "C" {
 
 #if (osCMSIS < 0x20000U)
 
+#if SYS_MBOX_LOCKFREE
+#error "SYS_MBOX_LOCKFREE needs CMSIS-RTOS v2 thread flags"
+#endif
+
 #define SYS_MBOX_NULL (osMessageQId)0
 #define SYS_SEM_NULL  (osSemaphoreId)0
 
@@ -55,14 +61,48 @@ typedef osMessageQId  sys_mbox_t;
 typedef osThreadId    sys_thread_t;
 #else
 
-#define SYS_MBOX_NULL (osMessageQueueId_t)0
 #define SYS_SEM_NULL  (osSemaphoreId_t)0
 
 typedef osSemaphoreId_t     sys_sem_t;
 typedef osSemaphoreId_t     sys_mutex_t;
-typedef osMessageQueueId_t  sys_mbox_t;
 typedef osThreadId_t        sys_thread_t;
+
+/* ETH_CODE: SYS_MBOX_LOCKFREE, see lwipopts.h and sys_arch.c */
+#if SYS_MBOX_LOCKFREE
+#define SYS_MBOX_NULL (struct sys_mbox_lf *)0
+
+typedef struct sys_mbox_lf *sys_mbox_t;
+#else
+#define SYS_MBOX_NULL (osMessageQueueId_t)0
+
+typedef osMessageQueueId_t  sys_mbox_t;
 #endif
+#endif
+
+/* ETH_CODE: sys_mbox_trypost() to the head of the queue (the message is
+ * fetched next), for tcpip_callbackmsg_trycallback_urgent() */
+err_t sys_mbox_trypost_front(sys_mbox_t *mbox, void *msg);
+
+/* ETH_CODE: LWIP_NETCONN_SEM_PER_THREAD, the calling task's semaphore;
+ * created on first use, so netconn_thread_init() is optional. A task that
+ * ends calls netconn_thread_cleanup() to hand its slot back. */
+#if LWIP_NETCONN_SEM_PER_THREAD
+sys_sem_t *sys_arch_netconn_sem_get(void);
+void sys_arch_netconn_sem_alloc(void);
+void sys_arch_netconn_sem_free(void);
+#define LWIP_NETCONN_THREAD_SEM_GET()   sys_arch_netconn_sem_get()
+#define LWIP_NETCONN_THREAD_SEM_ALLOC() sys_arch_netconn_sem_alloc()
+#define LWIP_NETCONN_THREAD_SEM_FREE()  sys_arch_netconn_sem_free()
+#endif
+
+/* ETH_CODE: wake-ups of the socket event queues (LWIP_SOCKET_EVQ). A
+ * thread flag, i.e. a FreeRTOS task notification bit: a task waiting in
+ * lwip_evq_wait() must not use SYS_NOTIFY_FLAG for anything else. */
+#define SYS_NOTIFY_FLAG 0x40000000U
+sys_thread_t sys_notify_self(void);
+void sys_notify(sys_thread_t thread);
+/* timeout in ms, 0 for ever; returns SYS_ARCH_TIMEOUT or 0 */
+u32_t sys_notify_wait(u32_t timeout);
 
 #ifdef  __cplusplus
 }
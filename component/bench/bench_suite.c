@@ -0,0 +1,573 @@
+/**
+ * @file bench_suite.c
+ * @brief Benchmark runner task; results as key=value lines on syslog.
+ */
+
+#include "bench_suite.h"
+
+#if BENCH_SUITE
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "lwip/tcpip.h"
+#include "lwip/mem.h"
+#include "lwip/pbuf.h"
+#include "lwip/inet_chksum.h"
+#include "chksum/chksum_m7.h"
+#include "memops/memops.h"
+#include "compress/lz4_block.h"
+#include "mpu/mpu_layout.h"
+#include "ctxsw_bench.h"
+#include "log_bench.h"
+#include "mqtt_bench.h"
+#include "lwip/apps/mqtt.h"
+#include "ethernetif.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_TAG           "BENCH"
+#define BENCH_LOGGER_CALLS  32U     /* below SYSLOG_RING_SLOTS, nothing dropped */
+
+/* Keeps repeated identical operations from being merged */
+#define BENCH_BARRIER()     __asm volatile("" ::: "memory")
+
+typedef struct {
+    const char* name;
+    uint8_t* src;
+    uint8_t* dst;
+} BenchRegion_t;
+
+typedef struct {
+    uint32_t n;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} BenchStat_t;
+
+/* ITCM has no data section: these ride in .itcm_text and are copied from
+ * flash at startup like the code. */
+static uint8_t bench_itcm[2][BENCH_SUITE_BUF_LEN] __attribute__((section(".itcm_text.bench"))) __ALIGNED(32);
+static uint8_t bench_dtcm[2][BENCH_SUITE_BUF_LEN] DTCM_BSS __ALIGNED(32);
+static uint8_t bench_axi[2][BENCH_SUITE_BUF_LEN] __ALIGNED(32);
+
+/* MPU policy sweep: one region over src and dst. D2 SRAM below the lwIP
+ * pools is not used by anything else; the H72x map has none to spare. */
+#define BENCH_MPU_LEN       (2U * BENCH_SUITE_BUF_LEN)
+#define BENCH_MPU_D2        MPU_LAYOUT_D2_BASE
+static uint8_t bench_mpu_axi[BENCH_MPU_LEN] __ALIGNED(BENCH_MPU_LEN);
+
+static StaticTask_t bench_tcb;
+static StackType_t bench_stack[BENCH_SUITE_STACK_WORDS];
+static TaskHandle_t bench_runner;
+
+static StaticTask_t bench_irq_tcb;
+static StackType_t bench_irq_stack[configMINIMAL_STACK_SIZE];
+static TaskHandle_t bench_irq_task;
+static volatile uint32_t bench_irq_t0;      /* pended */
+static volatile uint32_t bench_irq_t1;      /* handler entered */
+static volatile uint32_t bench_irq_t2;      /* task running */
+
+static volatile uint16_t bench_sink;
+
+static inline uint32_t bench_now(void)
+{
+    return DWT->CYCCNT;
+}
+
+static void bench_stat_add(BenchStat_t* s, uint32_t cycles)
+{
+    if (s->n == 0U || cycles < s->min) {
+        s->min = cycles;
+    }
+    if (cycles > s->max) {
+        s->max = cycles;
+    }
+    s->sum += cycles;
+    s->n++;
+}
+
+static uint32_t bench_stat_avg(const BenchStat_t* s)
+{
+    return (s->n != 0U) ? (uint32_t)(s->sum / s->n) : 0U;
+}
+
+/* Bytes per microsecond is MB/s */
+static uint32_t bench_mbps(uint32_t bytes, uint32_t cycles)
+{
+    return (cycles != 0U) ? (uint32_t)(((uint64_t)bytes * (SystemCoreClock / 1000000U)) / cycles) : 0U;
+}
+
+static void bench_region(const BenchRegion_t* r)
+{
+    uint32_t t0;
+    uint32_t copy;
+    uint32_t copy_ops;
+    uint32_t csum;
+    uint32_t csum_ref;
+    uint32_t csum_copy;
+
+    memset(r->src, 0xA5, BENCH_SUITE_BUF_LEN);
+    memcpy(r->dst, r->src, BENCH_SUITE_BUF_LEN);   /* warm the caches */
+
+    t0 = bench_now();
+    for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+        memcpy(r->dst, r->src, BENCH_SUITE_BUF_LEN);
+        BENCH_BARRIER();
+    }
+    copy = (bench_now() - t0) / BENCH_SUITE_ITERATIONS;
+
+    t0 = bench_now();
+    for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+        memops_copy(r->dst, r->src, BENCH_SUITE_BUF_LEN);
+        BENCH_BARRIER();
+    }
+    copy_ops = (bench_now() - t0) / BENCH_SUITE_ITERATIONS;
+
+    t0 = bench_now();
+    for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+        bench_sink = inet_chksum(r->src, BENCH_SUITE_BUF_LEN);
+    }
+    csum = (bench_now() - t0) / BENCH_SUITE_ITERATIONS;
+
+    /* lwIP's generic C loop, what inet_chksum() was before chksum_m7 */
+    t0 = bench_now();
+    for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+        bench_sink = chksum_m7_ref(r->src, BENCH_SUITE_BUF_LEN);
+    }
+    csum_ref = (bench_now() - t0) / BENCH_SUITE_ITERATIONS;
+
+    t0 = bench_now();
+    for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+        bench_sink = chksum_m7_copy(r->dst, r->src, BENCH_SUITE_BUF_LEN);
+    }
+    csum_copy = (bench_now() - t0) / BENCH_SUITE_ITERATIONS;
+
+    LOG_INFO(BENCH_TAG, "bench=memcpy region=%s bytes=%lu cycles=%lu mbps=%lu",
+             r->name, (uint32_t)BENCH_SUITE_BUF_LEN, copy, bench_mbps(BENCH_SUITE_BUF_LEN, copy));
+    LOG_INFO(BENCH_TAG, "bench=memops_copy region=%s bytes=%lu cycles=%lu mbps=%lu",
+             r->name, (uint32_t)BENCH_SUITE_BUF_LEN, copy_ops, bench_mbps(BENCH_SUITE_BUF_LEN, copy_ops));
+    LOG_INFO(BENCH_TAG, "bench=chksum region=%s bytes=%lu cycles=%lu mbps=%lu",
+             r->name, (uint32_t)BENCH_SUITE_BUF_LEN, csum, bench_mbps(BENCH_SUITE_BUF_LEN, csum));
+    LOG_INFO(BENCH_TAG, "bench=chksum_ref region=%s bytes=%lu cycles=%lu mbps=%lu",
+             r->name, (uint32_t)BENCH_SUITE_BUF_LEN, csum_ref, bench_mbps(BENCH_SUITE_BUF_LEN, csum_ref));
+    LOG_INFO(BENCH_TAG, "bench=chksum_copy region=%s bytes=%lu cycles=%lu mbps=%lu",
+             r->name, (uint32_t)BENCH_SUITE_BUF_LEN, csum_copy, bench_mbps(BENCH_SUITE_BUF_LEN, csum_copy));
+}
+
+/* CPU read, write and copy throughput of one memory under every policy */
+static void bench_mpu(const char* name, uint8_t* base)
+{
+    uint8_t* src = base;
+    uint8_t* dst = base + BENCH_SUITE_BUF_LEN;
+    const uint32_t* words = (const uint32_t*)src;
+    uint32_t t0;
+    uint32_t rd;
+    uint32_t wr;
+    uint32_t cp;
+    uint32_t sum;
+
+    for (uint32_t p = 0; p < MPU_POLICY_COUNT; p++) {
+        /* Nothing of the previous policy may stay in the cache */
+        SCB_CleanInvalidateDCache_by_Addr((uint32_t*)base, (int32_t)BENCH_MPU_LEN);
+        mpu_layout_region(MPU_LAYOUT_REGION_BENCH, (uint32_t)base, BENCH_MPU_LEN, p);
+        memset(src, 0xA5, BENCH_SUITE_BUF_LEN);
+
+        sum = 0U;
+        t0 = bench_now();
+        for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+            for (uint32_t w = 0; w < BENCH_SUITE_BUF_LEN / 4U; w++) {
+                sum += words[w];
+            }
+            BENCH_BARRIER();
+        }
+        rd = (bench_now() - t0) / BENCH_SUITE_ITERATIONS;
+        bench_sink = (uint16_t)sum;
+
+        t0 = bench_now();
+        for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+            memset(dst, (int)i, BENCH_SUITE_BUF_LEN);
+            BENCH_BARRIER();
+        }
+        wr = (bench_now() - t0) / BENCH_SUITE_ITERATIONS;
+
+        t0 = bench_now();
+        for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+            memcpy(dst, src, BENCH_SUITE_BUF_LEN);
+            BENCH_BARRIER();
+        }
+        cp = (bench_now() - t0) / BENCH_SUITE_ITERATIONS;
+
+        LOG_INFO(BENCH_TAG, "bench=mpu region=%s policy=%s read_mbps=%lu write_mbps=%lu copy_mbps=%lu", name,
+                 mpu_policy_name(p), bench_mbps(BENCH_SUITE_BUF_LEN, rd), bench_mbps(BENCH_SUITE_BUF_LEN, wr),
+                 bench_mbps(BENCH_SUITE_BUF_LEN, cp));
+    }
+    SCB_CleanInvalidateDCache_by_Addr((uint32_t*)base, (int32_t)BENCH_MPU_LEN);
+    mpu_layout_region_off(MPU_LAYOUT_REGION_BENCH);
+}
+
+static void bench_mpu_layout(void)
+{
+    LOG_INFO(BENCH_TAG, "bench=mpu_layout axi=%s heap=%s rx_pool=%s desc=%s", mpu_policy_name(MPU_AXI_POLICY),
+             mpu_policy_name(MPU_HEAP_POLICY), mpu_policy_name(MPU_DMA_POLICY), mpu_policy_name(MPU_DESC_POLICY));
+    bench_mpu("axi", bench_mpu_axi);
+#if MPU_LAYOUT_D2_FREE_SIZE >= BENCH_MPU_LEN
+    bench_mpu("d2", (uint8_t*)BENCH_MPU_D2);
+#endif
+}
+
+static void bench_regions(void)
+{
+    BenchRegion_t regions[] = {
+        { "itcm", bench_itcm[0], bench_itcm[1] },
+        { "dtcm", bench_dtcm[0], bench_dtcm[1] },
+        { "axi", bench_axi[0], bench_axi[1] },
+        { MPU_LAYOUT_HEAP_IN_D2 ? "d2" : "heap", NULL, NULL },
+    };
+    BenchRegion_t* d2 = &regions[3];
+
+    /* The lwIP heap is the memory the stack works in (non-cacheable): D2
+     * SRAM, AXI SRAM above region 3 on the H72x */
+    LOCK_TCPIP_CORE();
+    d2->src = (uint8_t*)mem_malloc(BENCH_SUITE_BUF_LEN);
+    d2->dst = (uint8_t*)mem_malloc(BENCH_SUITE_BUF_LEN);
+    UNLOCK_TCPIP_CORE();
+
+    for (uint32_t i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+        if (regions[i].src != NULL && regions[i].dst != NULL) {
+            bench_region(&regions[i]);
+        }
+    }
+
+    LOCK_TCPIP_CORE();
+    if (d2->src != NULL) {
+        mem_free(d2->src);
+    }
+    if (d2->dst != NULL) {
+        mem_free(d2->dst);
+    }
+    UNLOCK_TCPIP_CORE();
+}
+
+static void bench_pbuf(const char* name, pbuf_type type, u16_t len)
+{
+    uint32_t failed = 0U;
+    uint32_t t0;
+    uint32_t cycles;
+
+    LOCK_TCPIP_CORE();
+    t0 = bench_now();
+    for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+        struct pbuf* p = pbuf_alloc(PBUF_RAW, len, type);
+        if (p == NULL) {
+            failed++;
+        } else {
+            pbuf_free(p);
+        }
+    }
+    cycles = (bench_now() - t0) / BENCH_SUITE_ITERATIONS;
+    UNLOCK_TCPIP_CORE();
+
+    LOG_INFO(BENCH_TAG, "bench=pbuf type=%s bytes=%u cycles=%lu per_s=%lu failed=%lu protect=%s", name, len,
+             cycles, (cycles != 0U) ? SystemCoreClock / cycles : 0U, failed,
+             SYS_ARCH_PROTECT_BASEPRI ? "basepri" : "mutex");
+}
+
+/* One SYS_ARCH_PROTECT pair as built, against the mutex pair of the
+ * generated port and the BASEPRI pair, whichever mode is in use */
+static void bench_sys_protect(void)
+{
+    static StaticSemaphore_t mutex_cb;
+    SemaphoreHandle_t mutex = xSemaphoreCreateMutexStatic(&mutex_cb);
+    uint32_t t0;
+    uint32_t sys;
+    uint32_t mtx;
+    uint32_t bpri;
+
+    t0 = bench_now();
+    for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+        SYS_ARCH_DECL_PROTECT(lev);
+        SYS_ARCH_PROTECT(lev);
+        BENCH_BARRIER();
+        SYS_ARCH_UNPROTECT(lev);
+    }
+    sys = (bench_now() - t0) / BENCH_SUITE_ITERATIONS;
+
+    t0 = bench_now();
+    for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+        (void)xSemaphoreTake(mutex, portMAX_DELAY);
+        BENCH_BARRIER();
+        (void)xSemaphoreGive(mutex);
+    }
+    mtx = (bench_now() - t0) / BENCH_SUITE_ITERATIONS;
+
+    t0 = bench_now();
+    for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+        UBaseType_t saved = portSET_INTERRUPT_MASK_FROM_ISR();
+        BENCH_BARRIER();
+        portCLEAR_INTERRUPT_MASK_FROM_ISR(saved);
+    }
+    bpri = (bench_now() - t0) / BENCH_SUITE_ITERATIONS;
+
+    LOG_INFO(BENCH_TAG, "bench=sys_protect mode=%s cycles=%lu mutex_cycles=%lu basepri_cycles=%lu",
+             SYS_ARCH_PROTECT_BASEPRI ? "basepri" : "mutex", sys, mtx, bpri);
+}
+
+/* LZ4 on a TCP stage worth of framed syslog lines (SYSLOG_LZ4) and on
+ * random bytes: cycles per byte in hundredths, both directions */
+static void bench_lz4(void)
+{
+    static Lz4Block_t st;
+    static uint8_t text[1460];
+    static uint8_t packed[LZ4_BLOCK_BOUND(sizeof(text))];
+    static uint8_t plain[sizeof(text)];
+    uint32_t len = 0U;
+    uint32_t seed = 1U;
+
+    for (uint32_t i = 0U;; i++) {
+        char line[160];
+        char hdr[8];
+        int n = snprintf(line, sizeof(line), "<14>1 2026-01-01T00:%02lu:%02lu.%06luZ stm32-eth STM32_eth - BENCH "
+                         "[meta sequenceId=\"%lu\"] bench=lz4_probe seq=%lu", i / 60U % 60U, i % 60U,
+                         (i * 7919U) % 1000000U, i + 1U, i);
+        int h = snprintf(hdr, sizeof(hdr), "%d ", n);
+        if (len + (uint32_t)(h + n) > sizeof(text)) {
+            break;
+        }
+        memcpy(&text[len], hdr, (uint32_t)h);
+        memcpy(&text[len + (uint32_t)h], line, (uint32_t)n);
+        len += (uint32_t)(h + n);
+    }
+    for (uint32_t pass = 0U; pass < 2U; pass++) {
+        uint32_t out = 0U;
+        int32_t back = 0;
+        uint32_t t0;
+        uint32_t enc;
+        uint32_t dec;
+
+        if (pass == 1U) {
+            for (uint32_t i = 0U; i < len; i++) {
+                seed = seed * 1664525U + 1013904223U;
+                text[i] = (uint8_t)(seed >> 24);
+            }
+        }
+        t0 = bench_now();
+        for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS / 10U; i++) {
+            out = lz4_block_compress(&st, text, len, packed, sizeof(packed));
+            BENCH_BARRIER();
+        }
+        enc = (bench_now() - t0) / (BENCH_SUITE_ITERATIONS / 10U);
+        t0 = bench_now();
+        for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS / 10U; i++) {
+            back = lz4_block_decompress(packed, out, plain, sizeof(plain));
+            BENCH_BARRIER();
+        }
+        dec = (bench_now() - t0) / (BENCH_SUITE_ITERATIONS / 10U);
+        LOG_INFO(BENCH_TAG, "bench=lz4 data=%s bytes=%lu out=%lu cycles=%lu cpb_x100=%lu mbps=%lu "
+                 "dec_cycles=%lu dec_cpb_x100=%lu dec_mbps=%lu ok=%u", (pass == 0U) ? "syslog" : "random", len, out,
+                 enc, enc * 100U / len, bench_mbps(len, enc), dec, dec * 100U / len, bench_mbps(len, dec),
+                 (back == (int32_t)len && memcmp(plain, text, len) == 0) ? 1U : 0U);
+    }
+}
+
+static void bench_logger(void)
+{
+    BenchStat_t s = { 0 };
+
+    for (uint32_t i = 0; i < BENCH_LOGGER_CALLS; i++) {
+        uint32_t t0 = bench_now();
+        logger_printf(LOG_LEVEL_INFO, BENCH_TAG, "bench=logger_probe seq=%lu", i);
+        bench_stat_add(&s, bench_now() - t0);
+    }
+    /* Let the sender drain before timing anything else */
+    vTaskDelay(pdMS_TO_TICKS(100));
+    LOG_INFO(BENCH_TAG, "bench=logger_printf calls=%lu min=%lu avg=%lu max=%lu", s.n, s.min,
+             bench_stat_avg(&s), s.max);
+}
+
+/* Producers from below the application to just under the runner, from a
+ * warning trickle to a debug flood well past the ring */
+static const LogBenchProducer_t bench_log_producers[] = {
+    { .priority = BENCH_SUITE_PRIORITY - 1U, .rate_hz = 20U, .len = 32U, .level = LOG_LEVEL_WARNING },
+    { .priority = BENCH_SUITE_PRIORITY - 8U, .rate_hz = 500U, .len = 64U, .level = LOG_LEVEL_INFO },
+    { .priority = tskIDLE_PRIORITY + 2U, .rate_hz = 2000U, .len = 128U, .level = LOG_LEVEL_DEBUG },
+    { .priority = tskIDLE_PRIORITY + 1U, .rate_hz = 5000U, .len = 200U, .level = LOG_LEVEL_VERBOSE },
+};
+
+static void bench_log_stress(void)
+{
+    static LogBenchResult_t r;
+    const uint32_t n = sizeof(bench_log_producers) / sizeof(bench_log_producers[0]);
+
+    if (!log_bench_run(bench_log_producers, n, BENCH_SUITE_LOG_MS, BENCH_SUITE_LOG_DRAIN_MS, &r)) {
+        LOG_INFO(BENCH_TAG, "bench=log_stress failed");
+        return;
+    }
+    LOG_INFO(BENCH_TAG, "bench=log_stress async=%u producers=%lu ms=%lu calls=%lu per_s=%lu sent=%lu failed=%lu "
+             "dropped=%lu suppressed=%lu cpu_permille=%lu", (unsigned)SYSLOG_ASYNC, n, r.ms, r.calls, r.per_s, r.sent,
+             r.failed, r.dropped, r.suppressed, r.cpu_permille);
+    for (uint32_t i = 0U; i < n; i++) {
+        const LogBenchProducer_t* p = &bench_log_producers[i];
+        const LogBenchProducerResult_t* q = &r.producer[i];
+
+        LOG_INFO(BENCH_TAG, "bench=log_producer id=%lu prio=%lu level=%d rate=%lu len=%u calls=%lu refused=%lu "
+                 "p50=%lu p99=%lu p999=%lu max=%lu", i, p->priority, p->level, p->rate_hz, p->len, q->calls,
+                 q->refused, q->p50, q->p99, q->p999, q->max);
+    }
+}
+
+static void bench_ctxsw(void)
+{
+    CtxswBenchResult_t r;
+
+    if (ctxsw_bench_run(BENCH_SUITE_ITERATIONS, &r)) {
+        LOG_INFO(BENCH_TAG, "bench=ctxsw rounds=%lu int_cycles=%lu fpu_cycles=%lu", r.rounds, r.int_cycles,
+                 r.fpu_cycles);
+    }
+}
+
+#ifdef BENCH_SUITE_MQTT_BROKER
+static void bench_mqtt(bool by_ref)
+{
+    MqttBenchResult_t r;
+    ip_addr_t broker;
+
+    if (!ipaddr_aton(BENCH_SUITE_MQTT_BROKER, &broker) ||
+        !mqtt_bench_run(&broker, MQTT_PORT, BENCH_SUITE_MQTT_COUNT, BENCH_SUITE_MQTT_LEN, by_ref, &r)) {
+        LOG_INFO(BENCH_TAG, "bench=%s failed", by_ref ? "mqtt_ref" : "mqtt_copy");
+        return;
+    }
+    LOG_INFO(BENCH_TAG, "bench=%s msgs=%lu len=%lu ms=%lu per_s=%lu kbps=%lu retries=%lu",
+             by_ref ? "mqtt_ref" : "mqtt_copy", r.msgs, (uint32_t)BENCH_SUITE_MQTT_LEN, r.ms, r.per_s, r.kbps,
+             r.retries);
+}
+#endif /* BENCH_SUITE_MQTT_BROKER */
+
+#if BENCH_SUITE_LOOPBACK_MS
+static void bench_loopback(void)
+{
+    static const uint16_t lens[] = {60U, 512U, 1514U};
+    static const uint32_t rates[] = {0U, BENCH_SUITE_LOOPBACK_PPS};
+    static const char* const profiles[ETHIF_DMA_PROFILE_CNT] = {"default", "latency", "throughput"};
+    EthIfDmaProfileTypeDef boot;
+    EthIfDmaProfileTypeDef prof;
+    EthIfLoopbackResultTypeDef r;
+
+    ethernetif_dma_profile_get(&boot);
+    for (uint32_t p = 0; p < ETHIF_DMA_PROFILE_CNT; p++) {
+        (void)ethernetif_dma_profile_preset((EthIfDmaProfileIdTypeDef)p, &prof);
+        if (ethernetif_dma_profile_set(&prof) != ERR_OK) {
+            LOG_INFO(BENCH_TAG, "bench=phy_loopback failed");
+            break;
+        }
+        for (uint32_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+            for (uint32_t k = 0; k < sizeof(rates) / sizeof(rates[0]); k++) {
+                if (ethernetif_loopback_bench(lens[i], BENCH_SUITE_LOOPBACK_MS, rates[k], &r) != ERR_OK) {
+                    LOG_INFO(BENCH_TAG, "bench=phy_loopback failed");
+                    (void)ethernetif_dma_profile_set(&boot);
+                    return;
+                }
+                LOG_INFO(BENCH_TAG, "bench=phy_loopback profile=%s len=%u rate=%lu ms=%lu sent=%lu received=%lu "
+                         "fps=%lu cpu_permille=%lu cycles_per_frame=%lu lat_min_ns=%lu lat_avg_ns=%lu "
+                         "lat_max_ns=%lu", profiles[p], lens[i], rates[k], r.elapsed_ms, r.sent, r.received, r.fps,
+                         r.cpu_permille, r.cycles_per_frame, r.lat_min_ns, r.lat_avg_ns, r.lat_max_ns);
+            }
+        }
+    }
+    (void)ethernetif_dma_profile_set(&boot);
+}
+#endif /* BENCH_SUITE_LOOPBACK_MS */
+
+void BENCH_SUITE_IRQHandler(void)
+{
+    BaseType_t woken = pdFALSE;
+
+    bench_irq_t1 = bench_now();
+    vTaskNotifyGiveFromISR(bench_irq_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void bench_irq_waiter(void* arg)
+{
+    (void)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        bench_irq_t2 = bench_now();
+        xTaskNotifyGive(bench_runner);
+    }
+}
+
+static void bench_irq(void)
+{
+    BenchStat_t entry = { 0 };
+    BenchStat_t task = { 0 };
+
+    /* Runs at once and blocks: it is above the runner */
+    bench_irq_task = xTaskCreateStatic(bench_irq_waiter, "BenchIrq", configMINIMAL_STACK_SIZE, NULL,
+                                       BENCH_SUITE_PRIORITY + 1U, bench_irq_stack, &bench_irq_tcb);
+    if (bench_irq_task == NULL) {
+        return;
+    }
+    HAL_NVIC_SetPriority(BENCH_SUITE_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(BENCH_SUITE_IRQn);
+
+    for (uint32_t i = 0; i < BENCH_SUITE_ITERATIONS; i++) {
+        bench_irq_t0 = bench_now();
+        NVIC_SetPendingIRQ(BENCH_SUITE_IRQn);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        bench_stat_add(&entry, bench_irq_t1 - bench_irq_t0);
+        bench_stat_add(&task, bench_irq_t2 - bench_irq_t0);
+    }
+
+    HAL_NVIC_DisableIRQ(BENCH_SUITE_IRQn);
+    vTaskDelete(bench_irq_task);
+    LOG_INFO(BENCH_TAG, "bench=irq_entry rounds=%lu min=%lu avg=%lu max=%lu", entry.n, entry.min,
+             bench_stat_avg(&entry), entry.max);
+    LOG_INFO(BENCH_TAG, "bench=irq_to_task rounds=%lu min=%lu avg=%lu max=%lu", task.n, task.min,
+             bench_stat_avg(&task), task.max);
+}
+
+static void bench_suite_task(void* arg)
+{
+    (void)arg;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55U;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    LOG_INFO(BENCH_TAG, "bench=info cpu_mhz=%lu iterations=%lu", SystemCoreClock / 1000000U,
+             (uint32_t)BENCH_SUITE_ITERATIONS);
+    bench_regions();
+    bench_mpu_layout();
+    bench_pbuf("ram", PBUF_RAM, 1514U);
+    bench_pbuf("pool", PBUF_POOL, 1514U);
+    bench_pbuf("ref", PBUF_REF, 0U);
+    bench_sys_protect();
+    bench_lz4();
+    bench_logger();
+    bench_log_stress();
+    bench_ctxsw();
+    bench_irq();
+#ifdef BENCH_SUITE_MQTT_BROKER
+    bench_mqtt(false);
+#if MQTT_PUBLISH_REF
+    bench_mqtt(true);
+#endif
+#endif
+#if BENCH_SUITE_LOOPBACK_MS
+    bench_loopback();
+#endif
+    LOG_INFO(BENCH_TAG, "bench=done");
+    vTaskDelete(NULL);
+}
+
+bool bench_suite_start(void)
+{
+    bench_runner = xTaskCreateStatic(bench_suite_task, "Bench", BENCH_SUITE_STACK_WORDS, NULL,
+                                     BENCH_SUITE_PRIORITY, bench_stack, &bench_tcb);
+    return bench_runner != NULL;
+}
+
+#endif /* BENCH_SUITE */
@@ -0,0 +1,107 @@
+/**
+ * @file bench_suite.h
+ * @brief On-target benchmark runner of the Bench build configuration.
+ *
+ * The Bench configuration (CubeIDE, -O2, BENCH_SUITE=1) starts a runner
+ * task once the network and the logger are up. It measures checksum and
+ * memcpy throughput per memory region, CPU read/write/copy throughput of
+ * AXI and D2 SRAM under each MPU policy (mpu/mpu_layout.h), pbuf
+ * allocation rates, the cost of SYS_ARCH_PROTECT (lwipopts.h), LZ4 compression (compress/lz4_block.h) in
+ * cycles per byte, the cost of a logger_printf() call, the logger under
+ * concurrent producers (log_bench.h), context switch
+ * time and interrupt-to-task latency (and with BENCH_SUITE_MQTT_BROKER the MQTT publish rate,
+ * with BENCH_SUITE_LOOPBACK_MS the driver's frame rate and latency in PHY
+ * loopback per DMA profile), then
+ * sends one syslog line per result, tag "BENCH":
+ *
+ *   bench=<name> key=value key=value ...
+ *
+ * Values are decimal integers; cycles are CPU cycles at cpu_mhz (first
+ * line). The last line is "bench=done". Interrupts stay enabled, so run
+ * without traffic for comparable figures.
+ */
+
+#pragma once
+
+#ifndef BENCH_SUITE_H
+#define BENCH_SUITE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef BENCH_SUITE
+#define BENCH_SUITE 0
+#endif
+
+#if BENCH_SUITE
+/* Below the context switch benchmark tasks, above the application */
+#ifndef BENCH_SUITE_PRIORITY
+#define BENCH_SUITE_PRIORITY (configMAX_PRIORITIES - 4)
+#endif
+
+#ifndef BENCH_SUITE_STACK_WORDS
+#define BENCH_SUITE_STACK_WORDS 1024U
+#endif
+
+/* Bytes per copy / checksum; the ITCM buffers take twice that of flash */
+#ifndef BENCH_SUITE_BUF_LEN
+#define BENCH_SUITE_BUF_LEN 1024U
+#endif
+
+#ifndef BENCH_SUITE_ITERATIONS
+#define BENCH_SUITE_ITERATIONS 1000U
+#endif
+
+/* Spare vector for the interrupt latency test (SWPMI is not used) */
+#ifndef BENCH_SUITE_IRQn
+#define BENCH_SUITE_IRQn SWPMI1_IRQn
+#define BENCH_SUITE_IRQHandler SWPMI1_IRQHandler
+#endif
+
+/* MQTT publish rate (mqtt_bench.h) when BENCH_SUITE_MQTT_BROKER is defined
+ * as a dotted IPv4 broker address string: messages and payload bytes */
+#ifndef BENCH_SUITE_MQTT_COUNT
+#define BENCH_SUITE_MQTT_COUNT 10000U
+#endif
+
+#ifndef BENCH_SUITE_MQTT_LEN
+#define BENCH_SUITE_MQTT_LEN 64U
+#endif
+
+/* Logger stress (log_bench.h): run and drain time. The producers are the
+ * table in bench_suite.c. */
+#ifndef BENCH_SUITE_LOG_MS
+#define BENCH_SUITE_LOG_MS 5000U
+#endif
+
+#ifndef BENCH_SUITE_LOG_DRAIN_MS
+#define BENCH_SUITE_LOG_DRAIN_MS 1000U
+#endif
+
+/* Driver TX->RX frame rate, cycles per frame and latency with the PHY in
+ * loopback (ethernetif_loopback_bench(), needs ETHIF_PKTGEN), under each
+ * DMA and MTL profile (ethernetif_dma_profile_set()): run time per frame
+ * length and rate. The link is cut meanwhile; 0 leaves it out. */
+#ifndef BENCH_SUITE_LOOPBACK_MS
+#define BENCH_SUITE_LOOPBACK_MS 0U
+#endif
+
+/* Rate of the paced runs, for the latency of the path without queueing;
+ * the others go at full rate */
+#ifndef BENCH_SUITE_LOOPBACK_PPS
+#define BENCH_SUITE_LOOPBACK_PPS 1000U
+#endif
+
+/* Creates the runner task. Call once from a task, after init_logger(). */
+bool bench_suite_start(void);
+#endif /* BENCH_SUITE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCH_SUITE_H */
@@ -0,0 +1,104 @@
+/**
+ * @file ctxsw_bench.c
+ * @brief Task-to-task wakeup timing over a notification ping-pong.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "stm32h7xx_hal.h"
+
+#include "ctxsw_bench.h"
+
+typedef struct {
+    StaticTask_t tcb[2];
+    StackType_t stack[2][CTXSW_BENCH_STACK_WORDS];
+    TaskHandle_t task[2];
+    StaticSemaphore_t done_cb;
+    SemaphoreHandle_t done;
+    uint32_t rounds;
+    bool fpu;
+    uint32_t cycles;
+} CtxswBench_t;
+
+static CtxswBench_t bench;
+
+/* Keeps the FPU in use across the switch without being optimised out. */
+static volatile float bench_fp[2];
+
+static void ctxsw_bench_dwt_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55U;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static void ctxsw_bench_pong(void* arg)
+{
+    (void)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (bench.fpu) {
+            bench_fp[1] = bench_fp[1] * 1.0001f + 0.5f;
+        }
+        xTaskNotifyGive(bench.task[0]);
+    }
+}
+
+static void ctxsw_bench_ping(void* arg)
+{
+    (void)arg;
+    for (;;) {
+        /* Started by the caller, then parked until deleted */
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        uint32_t start = DWT->CYCCNT;
+        for (uint32_t i = 0; i < bench.rounds; i++) {
+            if (bench.fpu) {
+                bench_fp[0] = bench_fp[0] * 1.0001f + 0.5f;
+            }
+            xTaskNotifyGive(bench.task[1]);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        bench.cycles = DWT->CYCCNT - start;
+        xSemaphoreGive(bench.done);
+    }
+}
+
+static bool ctxsw_bench_pass(bool fpu, uint32_t* cycles_per_switch)
+{
+    bench.fpu = fpu;
+    bench.task[1] = xTaskCreateStatic(ctxsw_bench_pong, "BenchPong", CTXSW_BENCH_STACK_WORDS, NULL,
+                                      CTXSW_BENCH_PRIORITY, bench.stack[1], &bench.tcb[1]);
+    bench.task[0] = xTaskCreateStatic(ctxsw_bench_ping, "BenchPing", CTXSW_BENCH_STACK_WORDS, NULL,
+                                      CTXSW_BENCH_PRIORITY, bench.stack[0], &bench.tcb[0]);
+    if (bench.task[0] == NULL || bench.task[1] == NULL) {
+        return false;
+    }
+
+    xTaskNotifyGive(bench.task[0]);
+    xSemaphoreTake(bench.done, portMAX_DELAY);
+
+    /* Both are blocked again: deleting them frees the static memory now */
+    vTaskDelete(bench.task[0]);
+    vTaskDelete(bench.task[1]);
+    *cycles_per_switch = bench.cycles / (2U * bench.rounds);
+    return true;
+}
+
+bool ctxsw_bench_run(uint32_t rounds, CtxswBenchResult_t* result)
+{
+    if (rounds == 0U || result == NULL) {
+        return false;
+    }
+    if (bench.done == NULL) {
+        bench.done = xSemaphoreCreateBinaryStatic(&bench.done_cb);
+    }
+    ctxsw_bench_dwt_init();
+
+    bench.rounds = rounds;
+    result->rounds = rounds;
+    result->cpu_mhz = SystemCoreClock / 1000000U;
+    return ctxsw_bench_pass(false, &result->int_cycles) &&
+           ctxsw_bench_pass(true, &result->fpu_cycles);
+}
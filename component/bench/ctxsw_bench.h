@@ -0,0 +1,55 @@
+/**
+ * @file ctxsw_bench.h
+ * @brief FreeRTOS context switch cost, with and without FPU context.
+ *
+ * Two tasks at priority CTXSW_BENCH_PRIORITY hand a task notification back
+ * and forth; the DWT cycle counter times the whole exchange. This is run
+ * twice: once with both tasks using integer code only and once with both
+ * doing a floating point operation per round. With lazy stacking
+ * (FPCCR.ASPEN/LSPEN, set by the ARM_CM4F port) integer tasks switch
+ * without any FPU register traffic; the difference between the two figures
+ * is what a task pays for touching the FPU.
+ *
+ * Figures include the notify/take calls, i.e. they are the cost of one
+ * task-to-task wakeup, not of PendSV alone. Interrupts stay enabled, so
+ * run on an idle system and take the minimum of a few runs.
+ */
+
+#pragma once
+
+#ifndef CTXSW_BENCH_H
+#define CTXSW_BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Above every application task; the tasks block between rounds, so the
+ * timer task and lower priorities only run once the benchmark is done. */
+#ifndef CTXSW_BENCH_PRIORITY
+#define CTXSW_BENCH_PRIORITY (configMAX_PRIORITIES - 1)
+#endif
+
+#ifndef CTXSW_BENCH_STACK_WORDS
+#define CTXSW_BENCH_STACK_WORDS 256U
+#endif
+
+typedef struct {
+    uint32_t rounds;        /* round trips, two switches each */
+    uint32_t int_cycles;    /* cycles per switch, integer tasks */
+    uint32_t fpu_cycles;    /* cycles per switch, tasks with FPU context */
+    uint32_t cpu_mhz;       /* SystemCoreClock / 1e6, to convert */
+} CtxswBenchResult_t;
+
+/* Blocks the calling task for the duration of both runs. Not reentrant.
+ * Returns false if the tasks could not be created. */
+bool ctxsw_bench_run(uint32_t rounds, CtxswBenchResult_t* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CTXSW_BENCH_H */
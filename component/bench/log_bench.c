@@ -0,0 +1,164 @@
+/**
+ * @file log_bench.c
+ * @brief Concurrent logger producers with per-call latency histograms.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "stm32h7xx_hal.h"
+
+#include "log_bench.h"
+#include "lathist/lat_hist.h"
+
+#include <string.h>
+
+typedef struct {
+    StaticTask_t tcb[LOG_BENCH_MAX_PRODUCERS];
+    StackType_t stack[LOG_BENCH_MAX_PRODUCERS][LOG_BENCH_STACK_WORDS];
+    LatHist_t hist[LOG_BENCH_MAX_PRODUCERS];
+    LogBenchProducer_t producer[LOG_BENCH_MAX_PRODUCERS];
+    uint32_t calls[LOG_BENCH_MAX_PRODUCERS];
+    uint32_t refused[LOG_BENCH_MAX_PRODUCERS];
+    TaskHandle_t runner;
+    TickType_t start;
+    TickType_t ticks;
+} LogBench_t;
+
+static LogBench_t bench;
+
+/* Message filler, cut to the producer's length by the precision */
+static const char log_bench_text[LOG_BENCH_LEN_MAX + 1U] = {
+    [0 ... LOG_BENCH_LEN_MAX - 1U] = 'x'
+};
+
+/* Per-tag state (levels, limiter) is kept apart for each producer */
+static const char* const log_bench_tags[] = { "LOGB0", "LOGB1", "LOGB2", "LOGB3", "LOGB4", "LOGB5", "LOGB6", "LOGB7" };
+
+_Static_assert(LOG_BENCH_MAX_PRODUCERS <= sizeof(log_bench_tags) / sizeof(log_bench_tags[0]),
+               "LOG_BENCH_MAX_PRODUCERS: add tags");
+
+static void log_bench_producer(void* arg)
+{
+    uint32_t i = (uint32_t)(uintptr_t)arg;
+    const LogBenchProducer_t* p = &bench.producer[i];
+    uint32_t seq = 0U;
+
+    /* Released together by the runner */
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    for (;;) {
+        TickType_t elapsed = xTaskGetTickCount() - bench.start;
+        if (elapsed >= bench.ticks) {
+            break;
+        }
+        /* Records due by now, issued back to back */
+        uint32_t due = (uint32_t)(((uint64_t)elapsed * portTICK_PERIOD_MS * p->rate_hz) / 1000U) + 1U;
+        while (seq < due) {
+            uint32_t t0 = LOG_BENCH_CYCLES();
+            bool ok = logger_printf(p->level, log_bench_tags[i], "seq=%lu %.*s", (unsigned long)seq, (int)p->len,
+                                    log_bench_text);
+            lat_hist_add(&bench.hist[i], LOG_BENCH_CYCLES() - t0);
+            if (!ok) {
+                bench.refused[i]++;
+            }
+            seq++;
+        }
+        vTaskDelay(1);
+    }
+    bench.calls[i] = seq;
+    xTaskNotifyGive(bench.runner);
+    vTaskDelete(NULL);
+}
+
+#if LOG_BENCH_CPU
+/* tasks.c's default */
+#ifndef configIDLE_TASK_NAME
+#define configIDLE_TASK_NAME "IDLE"
+#endif
+
+/* Idle and total run time, configUSE_TRACE_FACILITY */
+static void log_bench_run_time(uint32_t* idle, uint32_t* total)
+{
+    static TaskStatus_t status[16];
+    UBaseType_t n = uxTaskGetSystemState(status, sizeof(status) / sizeof(status[0]), total);
+
+    *idle = 0U;
+    for (UBaseType_t k = 0U; k < n; k++) {
+        if (strcmp(status[k].pcTaskName, configIDLE_TASK_NAME) == 0) {
+            *idle += status[k].ulRunTimeCounter;
+        }
+    }
+}
+#endif
+
+bool log_bench_run(const LogBenchProducer_t* p, uint32_t n, uint32_t duration_ms, uint32_t drain_ms,
+                   LogBenchResult_t* result)
+{
+    TaskHandle_t task[LOG_BENCH_MAX_PRODUCERS];
+    uint32_t sent0, failed0, sent1, failed1;
+    uint32_t dropped0, suppressed0;
+#if LOG_BENCH_CPU
+    uint32_t idle0, total0, idle1, total1;
+#endif
+
+    if (n == 0U || n > LOG_BENCH_MAX_PRODUCERS) {
+        return false;
+    }
+    memset(&bench, 0, sizeof(bench));
+    memset(result, 0, sizeof(*result));
+    bench.runner = xTaskGetCurrentTaskHandle();
+    bench.ticks = pdMS_TO_TICKS(duration_ms);
+    for (uint32_t i = 0U; i < n; i++) {
+        bench.producer[i] = p[i];
+        if (bench.producer[i].len > LOG_BENCH_LEN_MAX) {
+            bench.producer[i].len = LOG_BENCH_LEN_MAX;
+        }
+        task[i] = xTaskCreateStatic(log_bench_producer, log_bench_tags[i], LOG_BENCH_STACK_WORDS,
+                                    (void*)(uintptr_t)i, p[i].priority, bench.stack[i], &bench.tcb[i]);
+        if (task[i] == NULL) {
+            /* The ones created wait for a start that does not come */
+            return false;
+        }
+    }
+
+    logger_get_stats(&sent0, &failed0);
+    dropped0 = logger_get_dropped_count();
+    suppressed0 = logger_get_suppressed_count();
+#if LOG_BENCH_CPU
+    log_bench_run_time(&idle0, &total0);
+#endif
+    bench.start = xTaskGetTickCount();
+    for (uint32_t i = 0U; i < n; i++) {
+        xTaskNotifyGive(task[i]);
+    }
+    for (uint32_t done = 0U; done < n;) {
+        done += ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    result->ms = (uint32_t)(xTaskGetTickCount() - bench.start) * portTICK_PERIOD_MS;
+#if LOG_BENCH_CPU
+    log_bench_run_time(&idle1, &total1);
+    if (total1 != total0) {
+        result->cpu_permille = 1000U - (uint32_t)(((uint64_t)(idle1 - idle0) * 1000U) / (total1 - total0));
+    }
+#endif
+    vTaskDelay(pdMS_TO_TICKS(drain_ms));
+
+    logger_get_stats(&sent1, &failed1);
+    result->sent = sent1 - sent0;
+    result->failed = failed1 - failed0;
+    result->dropped = logger_get_dropped_count() - dropped0;
+    result->suppressed = logger_get_suppressed_count() - suppressed0;
+    result->cycles_hz = LOG_BENCH_CYCLES_HZ;
+    for (uint32_t i = 0U; i < n; i++) {
+        LogBenchProducerResult_t* r = &result->producer[i];
+
+        r->calls = bench.calls[i];
+        r->refused = bench.refused[i];
+        r->p50 = lat_hist_percentile(&bench.hist[i], 5000U);
+        r->p99 = lat_hist_percentile(&bench.hist[i], 9900U);
+        r->p999 = lat_hist_percentile(&bench.hist[i], 9990U);
+        r->max = bench.hist[i].max;
+        result->calls += r->calls;
+    }
+    result->per_s = (result->ms != 0U) ? (uint32_t)((uint64_t)result->calls * 1000U / result->ms) : 0U;
+    return true;
+}
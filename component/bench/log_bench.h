@@ -0,0 +1,103 @@
+/**
+ * @file log_bench.h
+ * @brief Logger stress benchmark: concurrent producers at set rates.
+ *
+ * log_bench_run() starts one task per LogBenchProducer_t, each at its own
+ * priority, logging records of a given level and message length at a given
+ * rate through logger_printf() for the duration of the run. Records due are
+ * issued at every tick, so rates above the tick rate come in bursts, as
+ * they do from a real burst of events. Every call is timed with the cycle
+ * counter into a latency histogram per producer (lathist/lat_hist.h).
+ *
+ * The result adds what the logger made of the load: records sent and
+ * failed (logger_get_stats()), dropped with the ring full and suppressed by
+ * the rate limiter, all as deltas over the run, and the CPU load from the
+ * FreeRTOS run-time counters (idle task share). Build with SYSLOG_ASYNC 0
+ * and 1 to compare the mutex logger with the lock-free ring; run an iperf
+ * client against the board meanwhile for the saturated network case.
+ */
+
+#pragma once
+
+#ifndef LOG_BENCH_H
+#define LOG_BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "logger/syslog.h"
+
+#ifndef LOG_BENCH_MAX_PRODUCERS
+#define LOG_BENCH_MAX_PRODUCERS 4U
+#endif
+
+/* Longest message; the line adds a sequence number and the syslog header */
+#ifndef LOG_BENCH_LEN_MAX
+#define LOG_BENCH_LEN_MAX 200U
+#endif
+
+#ifndef LOG_BENCH_STACK_WORDS
+#define LOG_BENCH_STACK_WORDS 384U
+#endif
+
+/* Timestamp of a call and its rate; the host has a microsecond stand-in */
+#ifndef LOG_BENCH_CYCLES
+#define LOG_BENCH_CYCLES()  (DWT->CYCCNT)
+#define LOG_BENCH_CYCLES_HZ SystemCoreClock
+#endif
+
+/* CPU load from the run-time counters, where the RTOS keeps them */
+#ifndef LOG_BENCH_CPU
+#if defined(configGENERATE_RUN_TIME_STATS) && configGENERATE_RUN_TIME_STATS
+#define LOG_BENCH_CPU 1
+#else
+#define LOG_BENCH_CPU 0
+#endif
+#endif
+
+typedef struct {
+    uint32_t priority;      /* FreeRTOS priority of the task */
+    uint32_t rate_hz;       /* records per second */
+    uint16_t len;           /* message bytes, up to LOG_BENCH_LEN_MAX */
+    log_level_t level;
+} LogBenchProducer_t;
+
+typedef struct {
+    uint32_t calls;
+    uint32_t refused;       /* logger_printf() returned false */
+    uint32_t p50;           /* per-call latency, cycles */
+    uint32_t p99;
+    uint32_t p999;
+    uint32_t max;
+} LogBenchProducerResult_t;
+
+typedef struct {
+    uint32_t ms;            /* measured duration */
+    uint32_t calls;         /* all producers */
+    uint32_t per_s;
+    uint32_t sent;          /* logger counters over the run */
+    uint32_t failed;
+    uint32_t dropped;
+    uint32_t suppressed;
+    uint32_t cpu_permille;  /* busy share of the CPU, 0 without LOG_BENCH_CPU */
+    uint32_t cycles_hz;     /* unit of the latencies */
+    LogBenchProducerResult_t producer[LOG_BENCH_MAX_PRODUCERS];
+} LogBenchResult_t;
+
+/* Runs n producers for duration_ms and blocks the caller meanwhile; then
+ * waits drain_ms for the sender so that the counters cover the run. Call
+ * from a task after init_logger(). Not reentrant. False when n is out of
+ * range or a task could not be created. */
+bool log_bench_run(const LogBenchProducer_t* p, uint32_t n, uint32_t duration_ms, uint32_t drain_ms,
+                   LogBenchResult_t* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOG_BENCH_H */
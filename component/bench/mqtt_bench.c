@@ -0,0 +1,239 @@
+/**
+ * @file mqtt_bench.c
+ * @brief MQTT publish rate over the lwIP MQTT client.
+ */
+
+#include "lwip/opt.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#include "lwip/apps/mqtt.h"
+#include "lwip/apps/mqtt_priv.h"
+#if MQTT_PUBLISH_REF
+#include "lwip/tcp.h"
+#endif
+
+#include "mqtt_bench.h"
+
+#include <string.h>
+
+typedef struct {
+    mqtt_client_t client;           /* over the largest heap pool, see lwipopts.h */
+    sys_sem_t wake;                 /* any progress: connect, sent, ref done, barrier */
+    bool connected;
+    bool closed;
+    bool barrier_done;
+    err_t barrier_err;
+#if MQTT_PUBLISH_REF
+    struct tcp_txref refs[MQTT_BENCH_REFS];
+    struct tcp_txref* free_refs[MQTT_BENCH_REFS];
+    uint32_t free_num;
+#endif
+} MqttBench_t;
+
+/* Core lock for everything but wake */
+static MqttBench_t bench;
+
+static uint8_t bench_payload[MQTT_BENCH_PAYLOAD_MAX];
+
+static void mqtt_bench_conn_cb(mqtt_client_t* client, void* arg, mqtt_connection_status_t status)
+{
+    (void)client;
+    (void)arg;
+    if (status == MQTT_CONNECT_ACCEPTED) {
+        bench.connected = true;
+    } else {
+        bench.closed = true;
+    }
+    sys_sem_signal(&bench.wake);
+}
+
+static void mqtt_bench_sent_cb(void* arg, err_t err)
+{
+    (void)arg;
+    (void)err;
+    sys_sem_signal(&bench.wake);
+}
+
+static void mqtt_bench_barrier_cb(void* arg, err_t err)
+{
+    (void)arg;
+    bench.barrier_err = err;
+    bench.barrier_done = true;
+    sys_sem_signal(&bench.wake);
+}
+
+#if MQTT_PUBLISH_REF
+/* tcpip thread, core lock held */
+static void mqtt_bench_ref_done(struct tcp_txref* ref)
+{
+    bench.free_refs[bench.free_num++] = ref;
+    sys_sem_signal(&bench.wake);
+}
+#endif
+
+/* Core lock held. ERR_MEM: wait for bench.wake and retry. */
+static err_t mqtt_bench_publish(uint16_t len, bool by_ref)
+{
+#if MQTT_PUBLISH_REF
+    if (by_ref) {
+        struct tcp_txref* ref;
+        err_t err;
+
+        if (bench.free_num == 0U) {
+            return ERR_MEM;
+        }
+        ref = bench.free_refs[--bench.free_num];
+        tcp_txref_init(ref, mqtt_bench_ref_done, NULL);
+        err = mqtt_publish_ref(&bench.client, MQTT_BENCH_TOPIC, bench_payload, len, 0, 0, ref, mqtt_bench_sent_cb,
+                               NULL);
+        if (err != ERR_OK) {
+            bench.free_refs[bench.free_num++] = ref;
+        }
+        return err;
+    }
+#else
+    (void)by_ref;
+#endif
+    return mqtt_publish(&bench.client, MQTT_BENCH_TOPIC, bench_payload, len, 0, 0, mqtt_bench_sent_cb, NULL);
+}
+
+static bool mqtt_bench_connect_done(void)
+{
+    return bench.connected || bench.closed;
+}
+
+static bool mqtt_bench_barrier_done(void)
+{
+    return bench.barrier_done || bench.closed;
+}
+
+#if MQTT_PUBLISH_REF
+static bool mqtt_bench_refs_idle(void)
+{
+    return bench.free_num == MQTT_BENCH_REFS;
+}
+#endif
+
+/* Blocks until cond() holds, checked under the core lock */
+static bool mqtt_bench_wait(bool (*cond)(void))
+{
+    uint32_t t0 = sys_now();
+    bool ok;
+
+    for (;;) {
+        LOCK_TCPIP_CORE();
+        ok = cond();
+        UNLOCK_TCPIP_CORE();
+        if (ok || (sys_now() - t0) >= MQTT_BENCH_TIMEOUT_MS) {
+            return ok;
+        }
+        sys_arch_sem_wait(&bench.wake, MQTT_BENCH_TIMEOUT_MS);
+    }
+}
+
+/* Publish until it is not refused for lack of room */
+static err_t mqtt_bench_retry(uint16_t len, bool by_ref, u8_t qos, MqttBenchResult_t* result)
+{
+    err_t err;
+
+    for (;;) {
+        LOCK_TCPIP_CORE();
+        if (qos == 0U) {
+            err = mqtt_bench_publish(len, by_ref);
+        } else {
+            err = mqtt_publish(&bench.client, MQTT_BENCH_TOPIC, bench_payload, len, qos, 0, mqtt_bench_barrier_cb,
+                               NULL);
+        }
+        UNLOCK_TCPIP_CORE();
+        if (err != ERR_MEM) {
+            return err;
+        }
+        result->retries++;
+        if (sys_arch_sem_wait(&bench.wake, MQTT_BENCH_TIMEOUT_MS) == SYS_ARCH_TIMEOUT) {
+            return ERR_TIMEOUT;
+        }
+    }
+}
+
+static bool mqtt_bench_send(uint32_t count, uint16_t len, bool by_ref, MqttBenchResult_t* result)
+{
+    uint32_t t0 = sys_now();
+
+    for (uint32_t i = 0; i + 1U < count; i++) {
+        if (mqtt_bench_retry(len, by_ref, 0, result) != ERR_OK) {
+            return false;
+        }
+    }
+    /* Barrier: its PUBACK follows every message before it */
+    if (mqtt_bench_retry(len, false, 1, result) != ERR_OK || !mqtt_bench_wait(mqtt_bench_barrier_done) ||
+        !bench.barrier_done || bench.barrier_err != ERR_OK) {
+        return false;
+    }
+
+    result->ms = sys_now() - t0;
+    result->msgs = count;
+    result->bytes = count * len;
+    if (result->ms != 0U) {
+        result->per_s = (uint32_t)((uint64_t)count * 1000U / result->ms);
+        result->kbps = (uint32_t)((uint64_t)result->bytes * 8U / result->ms);
+    }
+    return true;
+}
+
+bool mqtt_bench_run(const ip_addr_t* broker, uint16_t port, uint32_t count, uint16_t len, bool by_ref,
+                    MqttBenchResult_t* result)
+{
+    static bool init;
+    struct mqtt_connect_client_info_t ci = { "mqtt_bench", NULL, NULL, 60, NULL, NULL, 0, 0 };
+    bool ok = false;
+    err_t err;
+
+#if !MQTT_PUBLISH_REF
+    if (by_ref) {
+        return false;
+    }
+#endif
+    if (count == 0U || len > MQTT_BENCH_PAYLOAD_MAX) {
+        return false;
+    }
+    /* Kept across runs: refs of a failed run may come back late */
+    if (!init) {
+        if (sys_sem_new(&bench.wake, 0) != ERR_OK) {
+            return false;
+        }
+#if MQTT_PUBLISH_REF
+        for (uint32_t i = 0; i < MQTT_BENCH_REFS; i++) {
+            bench.free_refs[bench.free_num++] = &bench.refs[i];
+        }
+#endif
+        init = true;
+    }
+#if MQTT_PUBLISH_BATCH
+    ci.publish_batch_ms = MQTT_BENCH_BATCH_MS;
+#endif
+    memset(result, 0, sizeof(*result));
+
+    LOCK_TCPIP_CORE();
+    for (uint16_t i = 0; i < len; i++) {
+        bench_payload[i] = (uint8_t)('a' + i % 26U);
+    }
+    bench.connected = false;
+    bench.closed = false;
+    bench.barrier_done = false;
+    memset(&bench.client, 0, sizeof(bench.client));
+    err = mqtt_client_connect(&bench.client, broker, port, mqtt_bench_conn_cb, NULL, &ci);
+    UNLOCK_TCPIP_CORE();
+
+    if (err == ERR_OK && mqtt_bench_wait(mqtt_bench_connect_done) && bench.connected) {
+        ok = mqtt_bench_send(count, len, by_ref, result);
+#if MQTT_PUBLISH_REF
+        /* The barrier's PUBACK acks every payload; wait for TCP to let go */
+        ok = ok && mqtt_bench_wait(mqtt_bench_refs_idle);
+#endif
+    }
+
+    LOCK_TCPIP_CORE();
+    mqtt_disconnect(&bench.client);
+    UNLOCK_TCPIP_CORE();
+    return ok;
+}
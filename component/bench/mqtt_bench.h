@@ -0,0 +1,77 @@
+/**
+ * @file mqtt_bench.h
+ * @brief MQTT publish rate, payloads copied or sent by reference.
+ *
+ * Connects to a broker and publishes QoS 0 messages to one topic as fast
+ * as the client takes them: a publish that finds the request slots, the
+ * output ring or the reference queue full waits for the next acked
+ * segment and is retried. A final QoS 1 publish is the barrier: the
+ * measurement runs from the first publish to its PUBACK, so it covers
+ * the broker accepting every message, not only lwIP queueing them.
+ *
+ * by_ref uses mqtt_publish_ref() (MQTT_PUBLISH_REF) with one shared
+ * payload buffer and a tcp_txref per message in flight; otherwise
+ * mqtt_publish() copies each payload into the output ring.
+ *
+ * Uses the lwIP sys API only (core lock, semaphores, sys_now()), so the
+ * host build runs it too. Not reentrant; blocks the caller.
+ */
+
+#pragma once
+
+#ifndef MQTT_BENCH_H
+#define MQTT_BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "lwip/ip_addr.h"
+
+#ifndef MQTT_BENCH_TOPIC
+#define MQTT_BENCH_TOPIC "bench/publish"
+#endif
+
+/* Longest payload; the by_ref buffer is static */
+#ifndef MQTT_BENCH_PAYLOAD_MAX
+#define MQTT_BENCH_PAYLOAD_MAX 1024U
+#endif
+
+/* by_ref payloads TCP may hold until acked, one tcp_txref each */
+#ifndef MQTT_BENCH_REFS
+#define MQTT_BENCH_REFS 64U
+#endif
+
+/* publish_batch_ms of the client (MQTT_PUBLISH_BATCH), 0 = off */
+#ifndef MQTT_BENCH_BATCH_MS
+#define MQTT_BENCH_BATCH_MS 0U
+#endif
+
+/* Connect and barrier timeout */
+#ifndef MQTT_BENCH_TIMEOUT_MS
+#define MQTT_BENCH_TIMEOUT_MS 5000U
+#endif
+
+typedef struct {
+    uint32_t msgs;       /* messages published, barrier included */
+    uint32_t bytes;      /* payload bytes published */
+    uint32_t ms;         /* first publish to the barrier's PUBACK */
+    uint32_t per_s;      /* messages per second */
+    uint32_t kbps;       /* payload kbit/s */
+    uint32_t retries;    /* publish calls refused with ERR_MEM */
+} MqttBenchResult_t;
+
+/* Publishes count messages of len payload bytes (at most
+ * MQTT_BENCH_PAYLOAD_MAX) to broker:port. Call from a task, not with the
+ * core lock held. Returns false if the broker could not be reached or
+ * the barrier was not acknowledged in time. */
+bool mqtt_bench_run(const ip_addr_t* broker, uint16_t port, uint32_t count, uint16_t len, bool by_ref,
+                    MqttBenchResult_t* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MQTT_BENCH_H */
@@ -0,0 +1,103 @@
+/**
+ * @file boot_time.c
+ * @brief Boot timeline, see boot_time.h.
+ */
+
+#include "boot_time.h"
+
+#if BOOT_TIME
+
+#include "main.h"
+
+#include <stdio.h>
+
+#define BOOT_TIME_TAG "BOOT"
+
+typedef struct {
+    uint32_t last_cycles;   /* CYCCNT at the previous mark */
+    uint32_t last_hz;       /* core clock since the previous mark */
+    uint64_t now_ns;        /* time of the previous mark */
+    uint32_t reached;       /* bit per stage */
+    bool reported;
+    uint64_t ns[BOOT_TIME_STAGES];
+} BootTime_t;
+
+static BootTime_t bt;
+
+static const char* const boot_time_names[BOOT_TIME_STAGES] = {
+    "main", "mpu", "cache", "hal", "clock", "periph", "rtos", "lwip", "logger", "link", "syslog"
+};
+
+void boot_time_start(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55U;
+    DWT->CYCCNT = 0U;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    bt.last_cycles = 0U;
+    bt.last_hz = SystemCoreClock;
+    bt.now_ns = 0U;
+    bt.ns[BOOT_TIME_MAIN] = 0U;
+    bt.reached = 1U << BOOT_TIME_MAIN;
+}
+
+void boot_time_mark(BootTimeStage_t stage)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t cycles;
+
+    if ((unsigned)stage >= BOOT_TIME_STAGES || (bt.reached & (1U << stage)) != 0U) {
+        return;
+    }
+    __disable_irq();
+    cycles = DWT->CYCCNT;
+    if ((bt.reached & (1U << stage)) == 0U) {
+        bt.now_ns += (uint64_t)(cycles - bt.last_cycles) * 1000000000U / bt.last_hz;
+        bt.last_cycles = cycles;
+        bt.last_hz = SystemCoreClock;
+        bt.ns[stage] = bt.now_ns;
+        bt.reached |= 1U << stage;
+    }
+    if (primask == 0U) {
+        __enable_irq();
+    }
+}
+
+void boot_time_rebase(void)
+{
+    bt.last_cycles = 0U;
+}
+
+bool boot_time_get(BootTimeStage_t stage, uint64_t* ns)
+{
+    if ((unsigned)stage >= BOOT_TIME_STAGES || (bt.reached & (1U << stage)) == 0U) {
+        return false;
+    }
+    *ns = bt.ns[stage];
+    return true;
+}
+
+void boot_time_report(void)
+{
+    char line[320] = "";
+    uint64_t prev = 0U;
+    int n = 0;
+
+    if (bt.reported || (bt.reached & (1U << BOOT_TIME_SYSLOG)) == 0U) {
+        return;
+    }
+    bt.reported = true;
+    for (uint32_t i = BOOT_TIME_MAIN + 1U; i < BOOT_TIME_STAGES && n >= 0 && (size_t)n < sizeof(line); i++) {
+        if ((bt.reached & (1U << i)) == 0U) {
+            n += snprintf(&line[n], sizeof(line) - (size_t)n, " %s -", boot_time_names[i]);
+            continue;
+        }
+        n += snprintf(&line[n], sizeof(line) - (size_t)n, " %s +%lu", boot_time_names[i],
+                      (unsigned long)((bt.ns[i] - prev) / 1000U));
+        prev = bt.ns[i];
+    }
+    LOG_INFO(BOOT_TIME_TAG, "boot timeline (us):%s, total %lu us", line,
+             (unsigned long)(bt.ns[BOOT_TIME_SYSLOG] / 1000U));
+}
+
+#endif /* BOOT_TIME */
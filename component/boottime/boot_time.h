@@ -0,0 +1,74 @@
+/**
+ * @file boot_time.h
+ * @brief Boot timeline: DWT cycle stamps of the startup stages.
+ *
+ * boot_time_start() runs the DWT cycle counter from the top of main();
+ * every BOOT_TIME_MARK() turns the cycles since the previous mark into
+ * nanoseconds at the core clock of that interval (SystemClock_Config()
+ * switches from HSI to the PLL) and keeps the running total in a static
+ * table. The scheduler start resets CYCCNT (configureTimerForRunTimeStats()
+ * in freertos.c), which calls boot_time_rebase() right after. Marks more
+ * than one counter wrap apart (10.7 s at 400 MHz) come out short.
+ *
+ * Only the first mark of a stage counts. Once the first syslog datagram
+ * left, the syslog sender calls boot_time_report(), which logs the stages
+ * once (tag "BOOT"): the time of each since the previous one and since
+ * main().
+ */
+
+#pragma once
+
+#ifndef BOOT_TIME_H
+#define BOOT_TIME_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef BOOT_TIME
+#define BOOT_TIME 1
+#endif
+
+typedef enum {
+    BOOT_TIME_MAIN = 0,     /* main() entry, time 0 */
+    BOOT_TIME_MPU,          /* MPU_Config() */
+    BOOT_TIME_CACHE,        /* I- and D-cache enabled */
+    BOOT_TIME_HAL,          /* HAL_Init() */
+    BOOT_TIME_CLOCK,        /* SystemClock_Config() */
+    BOOT_TIME_PERIPH,       /* MX_*_Init() and the drivers of main() */
+    BOOT_TIME_RTOS,         /* scheduler started */
+    BOOT_TIME_LWIP,         /* MX_LWIP_Init() */
+    BOOT_TIME_LOGGER,       /* init_logger() */
+    BOOT_TIME_LINK_UP,      /* first PHY link up */
+    BOOT_TIME_SYSLOG,       /* first syslog datagram sent */
+    BOOT_TIME_STAGES
+} BootTimeStage_t;
+
+#if BOOT_TIME
+#define BOOT_TIME_MARK(stage) boot_time_mark(stage)
+#else
+#define BOOT_TIME_MARK(stage) do {} while (0)
+#endif
+
+/* Starts the cycle counter; first statement of main() */
+void boot_time_start(void);
+/* Any context, interrupts included */
+void boot_time_mark(BootTimeStage_t stage);
+/* After CYCCNT was set to 0 */
+void boot_time_rebase(void);
+
+/* Nanoseconds from main() to the stage, false when not reached yet */
+bool boot_time_get(BootTimeStage_t stage, uint64_t* ns);
+
+/* Logs the timeline once BOOT_TIME_SYSLOG is marked; cheap otherwise.
+ * Task context. */
+void boot_time_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BOOT_TIME_H */
@@ -0,0 +1,224 @@
+/**
+ * @file chksum_m7.c
+ * @brief Carry-chain Internet checksum, plain and fused with a copy.
+ */
+
+#include "chksum_m7.h"
+
+#include "main.h"
+#include "lwip/def.h"
+
+#include <string.h>
+
+/* Bytes per unrolled block, one cache line */
+#define CHKSUM_BLOCK    32U
+
+#if defined(__thumb2__) && defined(__ARM_ARCH_7EM__)
+#define CHKSUM_ASM      1
+#else
+#define CHKSUM_ASM      0
+#endif
+
+typedef uint16_t chksum_u16_t __attribute__((may_alias));
+typedef uint32_t chksum_u32_t __attribute__((may_alias));
+
+#if CHKSUM_ASM
+/* Sums blocks 32-byte blocks at *src (word aligned) into *sum, the carries
+ * out of each block into *carries; copies them to *dst unless dst is NULL */
+static inline void chksum_blocks(uint8_t** dst, const uint8_t** src, uint32_t blocks, uint32_t* sum,
+                                 uint32_t* carries)
+{
+    const uint8_t* p = *src;
+    uint32_t s = *sum;
+    uint32_t k = *carries;
+    uint32_t a, b, c, d;
+
+    if (*dst == NULL) {
+        __asm volatile(
+            "1:                             \n"
+            "ldrd   %[a], %[b], [%[p]], #8  \n"
+            "ldrd   %[c], %[d], [%[p]], #8  \n"
+            "adds   %[s], %[s], %[a]        \n"
+            "adcs   %[s], %[s], %[b]        \n"
+            "adcs   %[s], %[s], %[c]        \n"
+            "adcs   %[s], %[s], %[d]        \n"
+            "ldrd   %[a], %[b], [%[p]], #8  \n"
+            "ldrd   %[c], %[d], [%[p]], #8  \n"
+            "adcs   %[s], %[s], %[a]        \n"
+            "adcs   %[s], %[s], %[b]        \n"
+            "adcs   %[s], %[s], %[c]        \n"
+            "adcs   %[s], %[s], %[d]        \n"
+            "adc    %[k], %[k], #0          \n"
+            "subs   %[n], %[n], #1          \n"
+            "bne    1b                      \n"
+            : [p] "+r"(p), [s] "+r"(s), [k] "+r"(k), [n] "+r"(blocks),
+              [a] "=&r"(a), [b] "=&r"(b), [c] "=&r"(c), [d] "=&r"(d)
+            :
+            : "cc", "memory");
+    } else {
+        uint8_t* q = *dst;
+
+        __asm volatile(
+            "1:                             \n"
+            "ldrd   %[a], %[b], [%[p]], #8  \n"
+            "ldrd   %[c], %[d], [%[p]], #8  \n"
+            "strd   %[a], %[b], [%[q]], #8  \n"
+            "strd   %[c], %[d], [%[q]], #8  \n"
+            "adds   %[s], %[s], %[a]        \n"
+            "adcs   %[s], %[s], %[b]        \n"
+            "adcs   %[s], %[s], %[c]        \n"
+            "adcs   %[s], %[s], %[d]        \n"
+            "ldrd   %[a], %[b], [%[p]], #8  \n"
+            "ldrd   %[c], %[d], [%[p]], #8  \n"
+            "strd   %[a], %[b], [%[q]], #8  \n"
+            "strd   %[c], %[d], [%[q]], #8  \n"
+            "adcs   %[s], %[s], %[a]        \n"
+            "adcs   %[s], %[s], %[b]        \n"
+            "adcs   %[s], %[s], %[c]        \n"
+            "adcs   %[s], %[s], %[d]        \n"
+            "adc    %[k], %[k], #0          \n"
+            "subs   %[n], %[n], #1          \n"
+            "bne    1b                      \n"
+            : [p] "+r"(p), [q] "+r"(q), [s] "+r"(s), [k] "+r"(k), [n] "+r"(blocks),
+              [a] "=&r"(a), [b] "=&r"(b), [c] "=&r"(c), [d] "=&r"(d)
+            :
+            : "cc", "memory");
+        *dst = q;
+    }
+    *src = p;
+    *sum = s;
+    *carries = k;
+}
+#endif
+
+/* Sum of len bytes at src, copied to dst first unless dst is NULL. With a
+ * dst, src and dst have the same alignment in a word. */
+static inline uint16_t chksum_run(uint8_t* dst, const uint8_t* src, int len)
+{
+    uint64_t sum = 0U;
+    uint16_t t = 0U;
+    int odd = (int)((uintptr_t)src & 1U);
+
+    /* Word align, keeping a leading odd byte in the high half as lwIP does */
+    if (odd && len > 0) {
+        if (dst != NULL) {
+            *dst++ = *src;
+        }
+        ((uint8_t*)&t)[1] = *src++;
+        len--;
+    }
+    if (((uintptr_t)src & 2U) != 0U && len >= 2) {
+        uint16_t h = *(const chksum_u16_t*)src;
+        if (dst != NULL) {
+            *(chksum_u16_t*)dst = h;
+            dst += 2;
+        }
+        sum += h;
+        src += 2;
+        len -= 2;
+    }
+
+#if CHKSUM_ASM
+    if ((uint32_t)len >= CHKSUM_BLOCK) {
+        uint32_t s = 0U;
+        uint32_t k = 0U;
+        uint32_t blocks = (uint32_t)len / CHKSUM_BLOCK;
+
+        chksum_blocks(&dst, &src, blocks, &s, &k);
+        sum += s + ((uint64_t)k << 32);
+        len -= (int)(blocks * CHKSUM_BLOCK);
+    }
+#endif
+
+    while (len >= 4) {
+        uint32_t w = *(const chksum_u32_t*)src;
+        if (dst != NULL) {
+            *(chksum_u32_t*)dst = w;
+            dst += 4;
+        }
+        sum += w;
+        src += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        uint16_t h = *(const chksum_u16_t*)src;
+        if (dst != NULL) {
+            *(chksum_u16_t*)dst = h;
+            dst += 2;
+        }
+        sum += h;
+        src += 2;
+        len -= 2;
+    }
+    if (len > 0) {
+        if (dst != NULL) {
+            *dst = *src;
+        }
+        ((uint8_t*)&t)[0] = *src;
+    }
+    sum += t;
+
+    /* 64 -> 32 -> 16 bits, end-around carries included */
+    sum = (sum & 0xFFFFFFFFU) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFFU) + (sum >> 32);
+    sum = (sum & 0xFFFFU) + (sum >> 16);
+    sum = (sum & 0xFFFFU) + (sum >> 16);
+    sum = (sum & 0xFFFFU) + (sum >> 16);
+
+    if (odd) {
+        sum = ((sum & 0xFFU) << 8) | (sum >> 8);
+    }
+    return (uint16_t)sum;
+}
+
+ITCM_FUNC uint16_t chksum_m7(const void* data, int len)
+{
+    PERF_START;
+    uint16_t sum = chksum_run(NULL, (const uint8_t*)data, len);
+    PERF_STOP("chksum");
+    return sum;
+}
+
+ITCM_FUNC uint16_t chksum_m7_copy(void* dst, const void* src, uint16_t len)
+{
+    uint16_t sum;
+
+    PERF_START;
+    if ((((uintptr_t)dst ^ (uintptr_t)src) & 3U) != 0U) {
+        memcpy(dst, src, len);
+        sum = chksum_run(NULL, (const uint8_t*)dst, len);
+    } else {
+        sum = chksum_run((uint8_t*)dst, (const uint8_t*)src, len);
+    }
+    PERF_STOP("chksum_copy");
+    return sum;
+}
+
+uint16_t chksum_m7_ref(const void* data, int len)
+{
+    const uint8_t* pb = (const uint8_t*)data;
+    const chksum_u16_t* ps;
+    uint16_t t = 0U;
+    uint32_t sum = 0U;
+    int odd = (int)((uintptr_t)pb & 1U);
+
+    if (odd && len > 0) {
+        ((uint8_t*)&t)[1] = *pb++;
+        len--;
+    }
+    ps = (const chksum_u16_t*)(const void*)pb;
+    while (len > 1) {
+        sum += *ps++;
+        len -= 2;
+    }
+    if (len > 0) {
+        ((uint8_t*)&t)[0] = *(const uint8_t*)ps;
+    }
+    sum += t;
+    sum = (sum >> 16) + (sum & 0xFFFFU);
+    sum = (sum >> 16) + (sum & 0xFFFFU);
+    if (odd) {
+        sum = ((sum & 0xFFU) << 8) | ((sum & 0xFF00U) >> 8);
+    }
+    return (uint16_t)sum;
+}
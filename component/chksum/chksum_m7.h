@@ -0,0 +1,50 @@
+/**
+ * @file chksum_m7.h
+ * @brief Internet checksum kernels for the Cortex-M7, used as LWIP_CHKSUM.
+ *
+ * The MAC computes the TCP/UDP/IP checksums, but lwIP still sums in
+ * software for ICMP, IGMP and IPv6 headers and for everything once the
+ * offload is switched off. chksum_m7() keeps a carry chain (ADDS/ADCS) over
+ * 32-byte blocks loaded with LDRD, one instruction per word, with the
+ * carries out of each block counted apart and folded once at the end.
+ * chksum_m7_copy() stores the words it sums, for LWIP_CHKSUM_COPY.
+ *
+ * Both return what lwIP's LWIP_CHKSUM_ALGORITHM 2 returns: the 16-bit one's
+ * complement sum of the data in memory order, not inverted, whatever the
+ * alignment. chksum_m7_ref() is that algorithm, kept as the baseline for
+ * the Bench configuration and the host build. Other targets (host) get a
+ * portable 32-bit word loop.
+ */
+
+#pragma once
+
+#ifndef CHKSUM_M7_H
+#define CHKSUM_M7_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* 1: lwipopts.h routes LWIP_CHKSUM and LWIP_CHKSUM_COPY here */
+#ifndef CHKSUM_M7
+#define CHKSUM_M7 1
+#endif
+
+/* Sum of len bytes at data; LWIP_CHKSUM */
+uint16_t chksum_m7(const void* data, int len);
+
+/* memcpy(dst, src, len), returns the sum of the bytes; LWIP_CHKSUM_COPY.
+ * Fused when src and dst share their alignment in a word, copy then sum
+ * otherwise. */
+uint16_t chksum_m7_copy(void* dst, const void* src, uint16_t len);
+
+/* lwIP's generic LWIP_CHKSUM_ALGORITHM 2, for comparison */
+uint16_t chksum_m7_ref(const void* data, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CHKSUM_M7_H */
@@ -0,0 +1,29 @@
+/**
+ * @file crc32.h
+ * @brief CRC-32 of IEEE 802.3 (reflected, polynomial 0xEDB88320), four bits
+ *        at a time from a 64-byte table.
+ *
+ * Checks the configuration blob (config/config_store.c) and the image of a
+ * firmware update (ota/ota.c); "123456789" gives 0xCBF43926.
+ */
+
+#pragma once
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* CRC of len more bytes at data after those that gave crc; 0 to start, so
+ * crc32_ieee(crc32_ieee(0, a, n), b, m) is the CRC of a followed by b */
+uint32_t crc32_ieee(uint32_t crc, const void* data, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CRC32_H */
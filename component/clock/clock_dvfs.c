@@ -0,0 +1,194 @@
+/**
+ * @file clock_dvfs.c
+ * @brief Core clock governor, see clock_dvfs.h.
+ */
+
+#include "clock_dvfs.h"
+
+#if CLOCK_DVFS
+
+#include "metrics/metrics.h"
+#include "rtstats/rtstats.h"
+#include "timesync/time_ns.h"
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+
+#include <string.h>
+
+#define DVFS_TAG "CLOCK"
+
+/* Tasks counted as network load, and the idle task */
+static const char* const dvfs_net_tasks[] = { TCPIP_THREAD_NAME, "EthIf" };
+#define DVFS_IDLE_TASK "IDLE"
+
+typedef struct {
+    ClockProfile_t full;
+    uint32_t quiet;             /* periods below the down threshold */
+    bool pinned;
+    uint32_t prev_total;
+    uint32_t prev_net;
+    uint32_t prev_idle;
+    ClockDvfsStats_t stats;
+    TaskStatus_t status[RTSTATS_MAX_TASKS];
+} ClockDvfs_t;
+
+/* tcpip thread */
+static ClockDvfs_t dvfs;
+
+static Metric_t dvfs_up = METRIC_COUNTER_INIT("clock.dvfs.up");
+static Metric_t dvfs_down = METRIC_COUNTER_INIT("clock.dvfs.down");
+static Metric_t dvfs_vetoed = METRIC_COUNTER_INIT("clock.dvfs.vetoed");
+static Metric_t dvfs_mhz = METRIC_GAUGE_INIT("clock.mhz");
+static Metric_t dvfs_switch_ns = METRIC_GAUGE_INIT("clock.dvfs.switch_ns");
+
+static bool dvfs_is_net(const char* name)
+{
+    for (uint32_t i = 0U; i < sizeof(dvfs_net_tasks) / sizeof(dvfs_net_tasks[0]); i++) {
+        if (strcmp(name, dvfs_net_tasks[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Loads since the previous call, false before the first window */
+static bool dvfs_sample(uint32_t* net_load, uint32_t* cpu_load)
+{
+    uint32_t total = 0U;
+    uint32_t net = 0U;
+    uint32_t idle = 0U;
+    UBaseType_t count = uxTaskGetSystemState(dvfs.status, RTSTATS_MAX_TASKS, &total);
+    uint32_t window = total - dvfs.prev_total;
+    uint32_t d_net;
+    uint32_t d_idle;
+
+    if (count == 0U) {
+        return false;
+    }
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t* s = &dvfs.status[i];
+        if (dvfs_is_net(s->pcTaskName)) {
+            net += s->ulRunTimeCounter;
+        } else if (strcmp(s->pcTaskName, DVFS_IDLE_TASK) == 0) {
+            idle = s->ulRunTimeCounter;
+        }
+    }
+    /* Counters wrap; unsigned differences stay right within one wrap */
+    d_net = net - dvfs.prev_net;
+    d_idle = idle - dvfs.prev_idle;
+    dvfs.prev_total = total;
+    dvfs.prev_net = net;
+    dvfs.prev_idle = idle;
+    if (window == 0U || d_net > window || d_idle > window) {
+        return false;
+    }
+    *net_load = (uint32_t)(((uint64_t)d_net * 1000U) / window);
+    *cpu_load = 1000U - (uint32_t)(((uint64_t)d_idle * 1000U) / window);
+    return true;
+}
+
+static void dvfs_switch(ClockProfile_t p)
+{
+    ClockProfileStatus_t st;
+    uint64_t t0 = time_now_ns();
+    uint32_t ns;
+
+    clock_profile_get_status(&st);
+    if (st.active == p) {
+        return;
+    }
+    if (!clock_profile_switch(p)) {
+        dvfs.stats.vetoed++;
+        metric_inc(&dvfs_vetoed);
+        return;
+    }
+    ns = (uint32_t)(time_now_ns() - t0);
+    dvfs.stats.switch_ns_last = ns;
+    if (ns > dvfs.stats.switch_ns_max) {
+        dvfs.stats.switch_ns_max = ns;
+    }
+    metric_set(&dvfs_switch_ns, ns);
+    metric_set(&dvfs_mhz, SystemCoreClock / 1000000U);
+    if (p == dvfs.full) {
+        dvfs.stats.up++;
+        metric_inc(&dvfs_up);
+    } else {
+        dvfs.stats.down++;
+        metric_inc(&dvfs_down);
+    }
+    LOG_DEBUG(DVFS_TAG, "%s, %lu MHz, net %lu cpu %lu permille, switch %lu ns", clock_profile_name(p),
+              (unsigned long)(SystemCoreClock / 1000000U), (unsigned long)dvfs.stats.net_load,
+              (unsigned long)dvfs.stats.cpu_load, (unsigned long)ns);
+}
+
+/* Runs on the tcpip thread */
+static void dvfs_timer(void* arg)
+{
+    uint32_t net;
+    uint32_t cpu;
+
+    if (dvfs_sample(&net, &cpu)) {
+        dvfs.stats.net_load = net;
+        dvfs.stats.cpu_load = cpu;
+        if (dvfs.pinned || net > CLOCK_DVFS_UP_PERMILLE || cpu > CLOCK_DVFS_CPU_PERMILLE) {
+            dvfs.quiet = 0U;
+            dvfs_switch(dvfs.full);
+        } else if (net < CLOCK_DVFS_DOWN_PERMILLE) {
+            if (++dvfs.quiet >= CLOCK_DVFS_HOLD) {
+                dvfs.quiet = CLOCK_DVFS_HOLD;
+                dvfs_switch(CLOCK_DVFS_IDLE_PROFILE);
+            }
+        } else {
+            dvfs.quiet = 0U;
+        }
+    }
+    sys_timeout(CLOCK_DVFS_PERIOD_MS, dvfs_timer, arg);
+}
+
+void clock_dvfs_start(void)
+{
+    ClockProfileStatus_t st;
+
+    clock_profile_get_status(&st);
+    if (st.active == CLOCK_PROFILE_HSI || st.active == CLOCK_DVFS_IDLE_PROFILE) {
+        LOG_INFO(DVFS_TAG, "governor off, running %s", clock_profile_name(st.active));
+        return;
+    }
+    dvfs.full = st.active;
+
+    (void)metrics_register(&dvfs_up);
+    (void)metrics_register(&dvfs_down);
+    (void)metrics_register(&dvfs_vetoed);
+    (void)metrics_register(&dvfs_mhz);
+    (void)metrics_register(&dvfs_switch_ns);
+    metric_set(&dvfs_mhz, SystemCoreClock / 1000000U);
+
+    LOCK_TCPIP_CORE();
+    /* Starts the first window */
+    (void)dvfs_sample(&dvfs.stats.net_load, &dvfs.stats.cpu_load);
+    sys_timeout(CLOCK_DVFS_PERIOD_MS, dvfs_timer, NULL);
+    UNLOCK_TCPIP_CORE();
+    LOG_INFO(DVFS_TAG, "governor %s/%s every %u ms", clock_profile_name(dvfs.full),
+             clock_profile_name(CLOCK_DVFS_IDLE_PROFILE), (unsigned)CLOCK_DVFS_PERIOD_MS);
+}
+
+void clock_dvfs_pin(bool full)
+{
+    LWIP_ASSERT_CORE_LOCKED();
+    dvfs.pinned = full;
+    if (full && dvfs.full != CLOCK_PROFILE_HSI) {
+        dvfs.quiet = 0U;
+        dvfs_switch(dvfs.full);
+    }
+}
+
+void clock_dvfs_get_stats(ClockDvfsStats_t* stats)
+{
+    *stats = dvfs.stats;
+}
+
+#endif /* CLOCK_DVFS */
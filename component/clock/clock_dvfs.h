@@ -0,0 +1,105 @@
+/**
+ * @file clock_dvfs.h
+ * @brief Core clock governor: full speed while the network stack is busy.
+ *
+ * Every CLOCK_DVFS_PERIOD_MS the governor (a lwIP timeout on the tcpip
+ * thread) takes the run-time counters of the tcpip thread and the EthIf
+ * task and of the idle task, and works out the share of the period the
+ * network stack and the CPU as a whole were busy. Above
+ * CLOCK_DVFS_UP_PERMILLE network load, or CLOCK_DVFS_CPU_PERMILLE CPU load,
+ * it switches to the boot profile at once; after CLOCK_DVFS_HOLD periods
+ * below CLOCK_DVFS_DOWN_PERMILLE and under the CPU limit it drops to
+ * CLOCK_DVFS_IDLE_PROFILE. Loads are shares of the period at the clock
+ * that ran it, so the same work reads about 2.4 times higher at 200 MHz
+ * than at 480 MHz; the thresholds leave that as hysteresis.
+ *
+ * A switch (clock_profile_switch()) runs the system clock from the 25 MHz
+ * HSE for the PLL1 lock time, with interrupts masked up to
+ * configMAX_SYSCALL_INTERRUPT_PRIORITY. The MAC and its DMA keep running,
+ * so frames land in the free RX descriptors meanwhile; the HAL tick
+ * (TIM6), the SysTick, time_ns, the MDC divider, the RX interrupt watchdog,
+ * the shaper rates and the time-triggered timer are re-derived before
+ * interrupts come back. No UART in this tree needs its baud rate redone.
+ * The driver vetoes a switch while a time-triggered window is pending and
+ * always with ETHIF_PTP, whose clock runs from HCLK.
+ *
+ * Exported through metrics as "clock.*".
+ */
+
+#pragma once
+
+#ifndef CLOCK_DVFS_H
+#define CLOCK_DVFS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "clock_profile.h"
+
+/* Needs the HSE profiles */
+#ifndef CLOCK_DVFS
+#if CLOCK_PROFILE != CLOCK_PROFILE_HSI
+#define CLOCK_DVFS 1
+#else
+#define CLOCK_DVFS 0
+#endif
+#endif
+
+#ifndef CLOCK_DVFS_PERIOD_MS
+#define CLOCK_DVFS_PERIOD_MS 200U
+#endif
+
+/* tcpip thread plus EthIf, 0.1 % of the period, that calls for full speed */
+#ifndef CLOCK_DVFS_UP_PERMILLE
+#define CLOCK_DVFS_UP_PERMILLE 400U
+#endif
+
+/* Network load under which the clock may drop */
+#ifndef CLOCK_DVFS_DOWN_PERMILLE
+#define CLOCK_DVFS_DOWN_PERMILLE 100U
+#endif
+
+/* Whole-CPU load (everything but idle) that holds full speed too */
+#ifndef CLOCK_DVFS_CPU_PERMILLE
+#define CLOCK_DVFS_CPU_PERMILLE 700U
+#endif
+
+/* Quiet periods before the clock drops */
+#ifndef CLOCK_DVFS_HOLD
+#define CLOCK_DVFS_HOLD 10U
+#endif
+
+#ifndef CLOCK_DVFS_IDLE_PROFILE
+#define CLOCK_DVFS_IDLE_PROFILE CLOCK_PROFILE_LOW
+#endif
+
+typedef struct {
+    uint32_t up;            /* switches to full speed */
+    uint32_t down;
+    uint32_t vetoed;        /* switches the driver refused */
+    uint32_t switch_ns_last;    /* time_now_ns() across the switch */
+    uint32_t switch_ns_max;
+    uint32_t net_load;      /* last period, 0.1 % */
+    uint32_t cpu_load;
+} ClockDvfsStats_t;
+
+/* Arms the governor. Call once from a task after metrics_init(), not
+ * holding the core lock; nothing happens when the boot profile is the
+ * idle one or the HSI fallback. */
+void clock_dvfs_start(void);
+
+/* true keeps full speed (benchmarks, measurements) until released with
+ * false; core lock held */
+void clock_dvfs_pin(bool full);
+
+void clock_dvfs_get_stats(ClockDvfsStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLOCK_DVFS_H */
@@ -0,0 +1,232 @@
+/**
+ * @file clock_profile.c
+ * @brief System clock profiles, see clock_profile.h.
+ */
+
+#include "clock_profile.h"
+#include "clock_dvfs.h"
+
+#include "main.h"
+#if CLOCK_DVFS
+#include "FreeRTOS.h"
+#include "task.h"
+#include "lwip/tcpip.h"
+#include "ethernetif.h"
+#include "timesync/time_ns.h"
+#include "periodic/periodic_exec.h"
+#include "sensor/sensor_acq.h"
+#endif
+
+#define CLOCK_TAG "CLOCK"
+
+extern RTC_HandleTypeDef hrtc;
+
+typedef struct {
+    uint32_t vos;
+    uint32_t plln;          /* VCO = 5 MHz * plln, SYSCLK = VCO / 2 */
+    uint32_t latency;
+    uint32_t prog_delay;
+} ClockProfileCfg_t;
+
+/* Indexed by ClockProfile_t; PLLM 5 takes the 25 MHz HSE to 5 MHz */
+static const ClockProfileCfg_t clock_profile_cfg[CLOCK_PROFILE_COUNT] = {
+    [CLOCK_PROFILE_PERF] = {
+        PWR_REGULATOR_VOLTAGE_SCALE0, 192U, FLASH_LATENCY_4, FLASH_PROGRAMMING_DELAY_2
+    },
+    [CLOCK_PROFILE_BALANCED] = {
+        PWR_REGULATOR_VOLTAGE_SCALE1, 160U, FLASH_LATENCY_2, FLASH_PROGRAMMING_DELAY_2
+    },
+    [CLOCK_PROFILE_LOW] = {
+        PWR_REGULATOR_VOLTAGE_SCALE3, 80U, FLASH_LATENCY_2, FLASH_PROGRAMMING_DELAY_1
+    },
+};
+
+/* Set before the scheduler starts; active changes under the core lock
+ * with CLOCK_DVFS */
+static ClockProfileStatus_t clock_status;
+
+static const char* const clock_profile_names[CLOCK_PROFILE_COUNT] = {
+    "hsi", "perf", "balanced", "low"
+};
+
+const char* clock_profile_name(ClockProfile_t p)
+{
+    return (p < CLOCK_PROFILE_COUNT) ? clock_profile_names[p] : "?";
+}
+
+#if CLOCK_PROFILE != CLOCK_PROFILE_HSI
+static ClockProfile_t clock_profile_boot(void)
+{
+    uint32_t v;
+
+    /* Reading the backup registers needs the RTC bus clock only */
+    __HAL_RCC_RTC_CLK_ENABLE();
+    v = (&RTC->BKP0R)[CLOCK_PROFILE_BKUP_REG];
+    if ((v & 0xFFFF0000UL) == CLOCK_PROFILE_BKUP_MAGIC && (v & 0xFFFFU) < CLOCK_PROFILE_COUNT) {
+        return (ClockProfile_t)(v & 0xFFFFU);
+    }
+    return CLOCK_PROFILE;
+}
+
+bool clock_profile_config(void)
+{
+    RCC_OscInitTypeDef osc = {0};
+    RCC_ClkInitTypeDef clk = {0};
+    const ClockProfileCfg_t* cfg;
+    ClockProfile_t p = clock_profile_boot();
+
+    clock_status.requested = p;
+    clock_status.rev_y = HAL_GetREVID() == REV_ID_Y;
+    if (p == CLOCK_PROFILE_PERF && clock_status.rev_y) {
+        p = CLOCK_PROFILE_BALANCED;
+    }
+    if (p == CLOCK_PROFILE_HSI) {
+        return false;
+    }
+    cfg = &clock_profile_cfg[p];
+
+    HAL_PWREx_ConfigSupply(PWR_LDO_SUPPLY);
+    /* The overdrive of VOS0 is a SYSCFG bit */
+    __HAL_RCC_SYSCFG_CLK_ENABLE();
+    __HAL_PWR_VOLTAGESCALING_CONFIG(cfg->vos);
+    while (!__HAL_PWR_GET_FLAG(PWR_FLAG_VOSRDY)) {}
+
+    /* HSE is started before the PLL is touched: on a timeout the HSI
+     * configuration still applies */
+    osc.OscillatorType = RCC_OSCILLATORTYPE_HSE | RCC_OSCILLATORTYPE_LSI;
+    osc.HSEState = CLOCK_PROFILE_HSE_BYPASS ? RCC_HSE_BYPASS : RCC_HSE_ON;
+    osc.LSIState = RCC_LSI_ON;
+    osc.PLL.PLLState = RCC_PLL_ON;
+    osc.PLL.PLLSource = RCC_PLLSOURCE_HSE;
+    osc.PLL.PLLM = HSE_VALUE / 5000000UL;
+    osc.PLL.PLLN = cfg->plln;
+    osc.PLL.PLLP = 2;
+    osc.PLL.PLLQ = 4;
+    osc.PLL.PLLR = 2;
+    osc.PLL.PLLRGE = RCC_PLL1VCIRANGE_2;
+    osc.PLL.PLLVCOSEL = RCC_PLL1VCOWIDE;
+    osc.PLL.PLLFRACN = 0;
+    if (HAL_RCC_OscConfig(&osc) != HAL_OK) {
+        clock_status.hse_failed = true;
+        clock_status.active = CLOCK_PROFILE_HSI;
+        return false;
+    }
+
+    clk.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK
+                  | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2
+                  | RCC_CLOCKTYPE_D3PCLK1 | RCC_CLOCKTYPE_D1PCLK1;
+    clk.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+    clk.SYSCLKDivider = RCC_SYSCLK_DIV1;
+    clk.AHBCLKDivider = RCC_HCLK_DIV2;
+    clk.APB3CLKDivider = RCC_APB3_DIV2;
+    clk.APB1CLKDivider = RCC_APB1_DIV2;
+    clk.APB2CLKDivider = RCC_APB2_DIV2;
+    clk.APB4CLKDivider = RCC_APB4_DIV2;
+    if (HAL_RCC_ClockConfig(&clk, cfg->latency) != HAL_OK) {
+        Error_Handler();
+    }
+    __HAL_FLASH_SET_PROGRAM_DELAY(cfg->prog_delay);
+    clock_status.active = p;
+    return true;
+}
+#endif /* CLOCK_PROFILE != CLOCK_PROFILE_HSI */
+
+#if CLOCK_DVFS
+bool clock_profile_switch(ClockProfile_t p)
+{
+    const ClockProfileCfg_t* from;
+    const ClockProfileCfg_t* to;
+    bool up;
+
+    LWIP_ASSERT_CORE_LOCKED();
+    if (p == clock_status.active) {
+        return true;
+    }
+    if (p == CLOCK_PROFILE_HSI || p >= CLOCK_PROFILE_COUNT || clock_status.active == CLOCK_PROFILE_HSI ||
+        (p == CLOCK_PROFILE_PERF && clock_status.rev_y)) {
+        return false;
+    }
+    from = &clock_profile_cfg[clock_status.active];
+    to = &clock_profile_cfg[p];
+    up = to->plln > from->plln;
+    if (up) {
+        /* Voltage before frequency on the way up, after it on the way down */
+        __HAL_PWR_VOLTAGESCALING_CONFIG(to->vos);
+        while (!__HAL_PWR_GET_FLAG(PWR_FLAG_VOSRDY)) {}
+    }
+
+    taskENTER_CRITICAL();
+    if (ethernetif_clock_prepare() == 0U) {
+        taskEXIT_CRITICAL();
+        if (up) {
+            __HAL_PWR_VOLTAGESCALING_CONFIG(from->vos);
+        }
+        return false;
+    }
+    /* The HSE carries the system clock while PLL1 relocks, AHB undivided
+     * so that the ETH DMA keeps its 25 MHz */
+    MODIFY_REG(RCC->CFGR, RCC_CFGR_SW, RCC_CFGR_SW_HSE);
+    while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_HSE) {}
+    MODIFY_REG(RCC->D1CFGR, RCC_D1CFGR_HPRE, RCC_HCLK_DIV1);
+    time_ns_set_hz(HSE_VALUE);
+
+    __HAL_RCC_PLL_DISABLE();
+    while (__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY)) {}
+    MODIFY_REG(RCC->PLL1DIVR, RCC_PLL1DIVR_N1, (to->plln - 1U) << RCC_PLL1DIVR_N1_Pos);
+    __HAL_RCC_PLL_ENABLE();
+    while (!__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY)) {}
+
+    /* At 25 MHz any wait state count is safe */
+    __HAL_FLASH_SET_LATENCY(to->latency);
+    while (__HAL_FLASH_GET_LATENCY() != to->latency) {}
+    __HAL_FLASH_SET_PROGRAM_DELAY(to->prog_delay);
+    MODIFY_REG(RCC->D1CFGR, RCC_D1CFGR_HPRE, RCC_HCLK_DIV2);
+    MODIFY_REG(RCC->CFGR, RCC_CFGR_SW, RCC_CFGR_SW_PLL1);
+    while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL1) {}
+
+    SystemCoreClockUpdate();
+    time_ns_set_hz(SystemCoreClock);
+    /* RTOS tick and HAL tick (TIM6) */
+    SysTick->LOAD = (SystemCoreClock / configTICK_RATE_HZ) - 1U;
+    SysTick->VAL = 0U;
+    (void)HAL_InitTick(uwTickPrio);
+    ethernetif_clock_changed();
+#if PERIODIC_EXEC
+    periodic_exec_clock_changed();
+#endif
+#if SENSOR_ACQ
+    sensor_acq_clock_changed();
+#endif
+    taskEXIT_CRITICAL();
+
+    if (!up) {
+        __HAL_PWR_VOLTAGESCALING_CONFIG(to->vos);
+        while (!__HAL_PWR_GET_FLAG(PWR_FLAG_VOSRDY)) {}
+    }
+    clock_status.active = p;
+    return true;
+}
+#endif /* CLOCK_DVFS */
+
+void clock_profile_set_next(ClockProfile_t p)
+{
+    HAL_PWR_EnableBkUpAccess();
+    HAL_RTCEx_BKUPWrite(&hrtc, CLOCK_PROFILE_BKUP_REG,
+                        (p < CLOCK_PROFILE_COUNT) ? (CLOCK_PROFILE_BKUP_MAGIC | (uint32_t)p) : 0U);
+}
+
+void clock_profile_get_status(ClockProfileStatus_t* st)
+{
+    *st = clock_status;
+}
+
+void clock_profile_report(void)
+{
+    ClockProfileStatus_t st = clock_status;
+
+    LOG_INFO(CLOCK_TAG, "profile %s (asked %s%s%s): SYSCLK %lu HCLK %lu PCLK1 %lu Hz",
+             clock_profile_name(st.active), clock_profile_name(st.requested),
+             st.hse_failed ? ", HSE failed" : "", st.rev_y ? ", rev Y" : "",
+             (unsigned long)HAL_RCC_GetSysClockFreq(), (unsigned long)HAL_RCC_GetHCLKFreq(),
+             (unsigned long)HAL_RCC_GetPCLK1Freq());
+}
@@ -0,0 +1,98 @@
+/**
+ * @file clock_profile.h
+ * @brief System clock profiles: 480 MHz at VOS0 from HSE, and slower ones.
+ *
+ * SystemClock_Config() asks clock_profile_config() first; the CubeMX
+ * configuration after it (PLL from HSI, 400 MHz at VOS1) only runs when
+ * profiles are disabled, the profile is CLOCK_PROFILE_HSI, or the HSE does
+ * not start within HSE_STARTUP_TIMEOUT. The HSE profiles run PLL1 from the
+ * 25 MHz external clock (HSE_VALUE; bypass mode, as the .ioc has it), which
+ * takes the HSI jitter out of the clock tree the RMII timing and the
+ * cycle-counter clocks (time_ns.h) depend on.
+ *
+ *   profile    SYSCLK  AXI/AHB  APB   VOS  flash WS
+ *   PERF       480     240      120   0    4
+ *   BALANCED   400     200      100   1    2
+ *   LOW        200     100      50    3    2
+ *
+ * AXI and AHB run at the highest frequency the scale allows (SYSCLK / 2),
+ * the ETH DMA masters AHB1 at that clock. PERF needs revision V silicon;
+ * on revision Y (400 MHz parts) BALANCED runs instead.
+ *
+ * The profile is picked at boot: the one stored by clock_profile_set_next()
+ * in an RTC backup register if there is one, CLOCK_PROFILE otherwise. The
+ * backup domain keeps it across resets, not across power loss.
+ */
+
+#pragma once
+
+#ifndef CLOCK_PROFILE_H
+#define CLOCK_PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    CLOCK_PROFILE_HSI = 0,      /* the CubeMX configuration */
+    CLOCK_PROFILE_PERF,
+    CLOCK_PROFILE_BALANCED,
+    CLOCK_PROFILE_LOW,
+    CLOCK_PROFILE_COUNT
+} ClockProfile_t;
+
+/* Build default; CLOCK_PROFILE_HSI leaves SystemClock_Config() as
+ * generated and ignores the backup register */
+#ifndef CLOCK_PROFILE
+#define CLOCK_PROFILE CLOCK_PROFILE_PERF
+#endif
+
+/* 1: HSE is an external clock on OSC_IN (bypass), 0: a crystal */
+#ifndef CLOCK_PROFILE_HSE_BYPASS
+#define CLOCK_PROFILE_HSE_BYPASS 1
+#endif
+
+/* RTC backup register holding the next profile; 0 and 1 are timesync's */
+#define CLOCK_PROFILE_BKUP_REG 2U
+#define CLOCK_PROFILE_BKUP_MAGIC 0x434C0000UL /* "CL" */
+
+typedef struct {
+    ClockProfile_t requested;   /* stored or built-in */
+    ClockProfile_t active;      /* after the fallbacks */
+    bool hse_failed;            /* HSE did not start, HSI profile instead */
+    bool rev_y;                 /* 480 MHz not supported */
+} ClockProfileStatus_t;
+
+#if CLOCK_PROFILE != CLOCK_PROFILE_HSI
+/* Sets up supply, voltage scale, PLL1 and bus clocks for the boot profile;
+ * false when SystemClock_Config() has to go on with the HSI configuration.
+ * Only from SystemClock_Config(), the system clock still on HSI. */
+bool clock_profile_config(void);
+#endif
+
+/* Changes the running HSE profile (clock_dvfs.h): PLL1 relocks while the
+ * system clock runs from the HSE, interrupts up to
+ * configMAX_SYSCALL_INTERRUPT_PRIORITY masked. False, clock unchanged,
+ * for an HSI boot, a profile the part cannot run, or when the driver vetoes
+ * (ethernetif_clock_prepare()). Core lock held. */
+bool clock_profile_switch(ClockProfile_t p);
+
+/* Profile for the next boot, after the RTC is initialised;
+ * CLOCK_PROFILE_COUNT returns to the build default. */
+void clock_profile_set_next(ClockProfile_t p);
+
+void clock_profile_get_status(ClockProfileStatus_t* st);
+const char* clock_profile_name(ClockProfile_t p);
+
+/* Logs the profile and the resulting clocks (tag "CLOCK"), once the
+ * logger runs */
+void clock_profile_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLOCK_PROFILE_H */
@@ -0,0 +1,183 @@
+/**
+ * @file lz4_block.c
+ * @brief LZ4 block compression, see lz4_block.h.
+ */
+
+#include "lz4_block.h"
+
+#include <string.h>
+
+#define LZ4_MIN_MATCH   4U
+/* The format's end conditions: the last match starts at least 12 bytes
+ * before the end of the input and the last 5 bytes are literals */
+#define LZ4_MF_LIMIT    12U
+#define LZ4_LAST_LIT    5U
+#define LZ4_MAX_OFFSET  65535U
+/* Misses before the step grows by one byte, log2 */
+#define LZ4_SKIP_LOG    6U
+
+static inline uint32_t lz4_read32(const uint8_t* p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t lz4_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32U - LZ4_BLOCK_HASH_LOG);
+}
+
+/* 255-byte extensions of a length field above 15 */
+static inline uint8_t* lz4_put_len(uint8_t* op, uint32_t n)
+{
+    while (n >= 255U) {
+        *op++ = 255U;
+        n -= 255U;
+    }
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+/* One sequence: the literals from anchor, then a match unless mlen is 0.
+ * Returns NULL when it does not fit before end. */
+static uint8_t* lz4_sequence(uint8_t* op, const uint8_t* end, const uint8_t* lit, uint32_t nlit,
+                             uint32_t offset, uint32_t mlen)
+{
+    uint32_t ml = (mlen != 0U) ? mlen - LZ4_MIN_MATCH : 0U;
+    uint8_t* token = op;
+
+    if ((uint32_t)(end - op) < 1U + nlit / 255U + 1U + nlit + 2U + ml / 255U + 1U) {
+        return NULL;
+    }
+    op++;
+    *token = (uint8_t)(((nlit < 15U) ? nlit : 15U) << 4);
+    if (nlit >= 15U) {
+        op = lz4_put_len(op, nlit - 15U);
+    }
+    memcpy(op, lit, nlit);
+    op += nlit;
+    if (mlen == 0U) {
+        return op;
+    }
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    *token |= (uint8_t)((ml < 15U) ? ml : 15U);
+    if (ml >= 15U) {
+        op = lz4_put_len(op, ml - 15U);
+    }
+    return op;
+}
+
+uint32_t lz4_block_compress(Lz4Block_t* st, const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap)
+{
+    const uint8_t* end = &dst[cap];
+    uint8_t* op = dst;
+    uint32_t anchor = 0U;
+    uint32_t ip = 0U;
+
+    if (len > LZ4_BLOCK_MAX_INPUT) {
+        return 0U;
+    }
+    if (len > LZ4_MF_LIMIT) {
+        const uint32_t limit = len - LZ4_MF_LIMIT;
+        const uint32_t match_end = len - LZ4_LAST_LIT;
+
+        while (ip < limit) {
+            uint32_t seq = lz4_read32(&src[ip]);
+            uint32_t h = lz4_hash(seq);
+            uint32_t ref = st->table[h];
+
+            st->table[h] = (uint16_t)ip;
+            /* Stale entries of an earlier block fail one of these */
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || lz4_read32(&src[ref]) != seq) {
+                ip += 1U + ((ip - anchor) >> LZ4_SKIP_LOG);
+                continue;
+            }
+            /* Back over equal literals, then forward */
+            while (ip > anchor && ref > 0U && src[ip - 1U] == src[ref - 1U]) {
+                ip--;
+                ref--;
+            }
+            uint32_t mlen = LZ4_MIN_MATCH;
+            while (ip + mlen < match_end && src[ip + mlen] == src[ref + mlen]) {
+                mlen++;
+            }
+            op = lz4_sequence(op, end, &src[anchor], ip - anchor, ip - ref, mlen);
+            if (op == NULL) {
+                return 0U;
+            }
+            ip += mlen;
+            anchor = ip;
+            /* Seeds the table inside the match for the next one */
+            if (ip < limit) {
+                st->table[lz4_hash(lz4_read32(&src[ip - 2U]))] = (uint16_t)(ip - 2U);
+            }
+        }
+    }
+    op = lz4_sequence(op, end, &src[anchor], len - anchor, 0U, 0U);
+    return (op != NULL) ? (uint32_t)(op - dst) : 0U;
+}
+
+int32_t lz4_block_decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap)
+{
+    const uint8_t* ip = src;
+    const uint8_t* iend = &src[len];
+    uint8_t* op = dst;
+    uint8_t* oend = &dst[cap];
+
+    while (ip < iend) {
+        uint32_t token = *ip++;
+        uint32_t n = token >> 4;
+
+        if (n == 15U) {
+            uint8_t b;
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                b = *ip++;
+                n += b;
+            } while (b == 255U);
+        }
+        if ((uint32_t)(iend - ip) < n || (uint32_t)(oend - op) < n) {
+            return -1;
+        }
+        memcpy(op, ip, n);
+        op += n;
+        ip += n;
+        if (ip == iend) {
+            break;              /* the last sequence, literals only */
+        }
+        if (iend - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = (uint32_t)ip[0] | ((uint32_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0U || offset > (uint32_t)(op - dst)) {
+            return -1;
+        }
+        n = token & 15U;
+        if (n == 15U) {
+            uint8_t b;
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                b = *ip++;
+                n += b;
+            } while (b == 255U);
+        }
+        n += LZ4_MIN_MATCH;
+        if ((uint32_t)(oend - op) < n) {
+            return -1;
+        }
+        /* Byte by byte: the match may overlap its own output */
+        const uint8_t* m = op - offset;
+        while (n-- > 0U) {
+            *op++ = *m++;
+        }
+    }
+    return (int32_t)(op - dst);
+}
@@ -0,0 +1,65 @@
+/**
+ * @file lz4_block.h
+ * @brief LZ4 block compression with a fixed, caller-owned work area.
+ *
+ * The standard LZ4 block format (lz4.org, "LZ4 Block Format"): sequences
+ * of a token, literals, a 16-bit little-endian offset and the match
+ * length, the last sequence literals only. Any LZ4 decoder takes the
+ * output, e.g. Python's lz4.block.decompress(data, uncompressed_size=n),
+ * and lz4_block_decompress() here, which tools/lz4_relay.py mirrors.
+ *
+ * The compressor is greedy with one hash table of 4-byte positions and
+ * skips ahead faster through data that does not match, like the reference
+ * "fast" mode. Its whole state is an Lz4Block_t, 2 << LZ4_BLOCK_HASH_LOG
+ * bytes, static in the caller; nothing is allocated. The table is not
+ * cleared between blocks: every candidate is checked against the input,
+ * so a stale entry costs a missed match at most. Blocks are at most 64 KB
+ * and independent of each other, so a lost datagram loses only its own.
+ *
+ * No lock: one Lz4Block_t per context that compresses. Short, repetitive
+ * text (syslog lines with the same host, app and timestamp prefix) shrinks
+ * to a third or so; already packed data such as the telemetry blocks
+ * gains little, which is why every user has its own switch.
+ */
+
+#pragma once
+
+#ifndef LZ4_BLOCK_H
+#define LZ4_BLOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Hash table entries, log2: 10 is 2 KB of state. More finds more matches
+ * in longer blocks at the cost of RAM and cache. */
+#ifndef LZ4_BLOCK_HASH_LOG
+#define LZ4_BLOCK_HASH_LOG 10U
+#endif
+
+/* Largest input of one block: the table holds 16-bit positions */
+#define LZ4_BLOCK_MAX_INPUT 65535U
+
+/* Output room that holds any input of n bytes, incompressible included */
+#define LZ4_BLOCK_BOUND(n) ((n) + (n) / 255U + 16U)
+
+typedef struct {
+    uint16_t table[1U << LZ4_BLOCK_HASH_LOG];
+} Lz4Block_t;
+
+/* Compresses len bytes of src into dst. Returns the block length, or 0
+ * when the block does not fit in cap bytes (cap = len - 1 keeps only
+ * blocks that save something) or len exceeds LZ4_BLOCK_MAX_INPUT. */
+uint32_t lz4_block_compress(Lz4Block_t* st, const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap);
+
+/* Decompresses a whole block of len bytes into dst. Returns the output
+ * length, or -1 for a malformed block or one that does not fit cap. */
+int32_t lz4_block_decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LZ4_BLOCK_H */
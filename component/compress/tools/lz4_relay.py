@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""Receiver for the logger's syslog TCP stream with LZ4 blocks.
+
+With LZ4 on the syslog sink (SYSLOG_LZ4, log_ctl "sink syslog lz4 on")
+the board sends its RFC 6587 stream ("LEN SP MSG" records) partly as
+blocks: "Z", u16 raw length, u16 block length (network byte order) and an
+LZ4 block (component/compress/lz4_block.h) of records. This listens for the
+board's connection, expands the blocks and prints the records, or passes
+the plain stream on to a real syslog server with --forward.
+
+    lz4_relay.py [--bind 0.0.0.0] [--port 514] [--forward host:port]
+
+decompress(block, size) can be imported by other tools.
+"""
+
+import argparse
+import socket
+import struct
+import sys
+
+
+def decompress(block, size=65536):
+    """One LZ4 block to at most size bytes; ValueError when malformed."""
+    out = bytearray()
+    i = 0
+    n = len(block)
+    while i < n:
+        token = block[i]
+        i += 1
+        lit = token >> 4
+        if lit == 15:
+            while True:
+                b = block[i]
+                i += 1
+                lit += b
+                if b != 255:
+                    break
+        if i + lit > n:
+            raise ValueError("literals past the end")
+        out += block[i:i + lit]
+        i += lit
+        if i == n:
+            break
+        off = block[i] | (block[i + 1] << 8)
+        i += 2
+        if off == 0 or off > len(out):
+            raise ValueError("bad offset")
+        mlen = token & 15
+        if mlen == 15:
+            while True:
+                b = block[i]
+                i += 1
+                mlen += b
+                if b != 255:
+                    break
+        mlen += 4
+        for _ in range(mlen):
+            out.append(out[-off])
+        if len(out) > size:
+            raise ValueError("block too large")
+    return bytes(out)
+
+
+def records(buf):
+    """Splits octet-counted records off buf up to a block; returns them and
+    the rest."""
+    out = []
+    while buf and buf[:1] != b"Z":
+        sp = buf.find(b" ")
+        if sp < 0 and buf.isdigit():
+            break
+        if sp <= 0 or not buf[:sp].isdigit():
+            raise ValueError("bad frame")
+        n = int(buf[:sp])
+        if len(buf) < sp + 1 + n:
+            break
+        out.append(buf[sp + 1:sp + 1 + n])
+        buf = buf[sp + 1 + n:]
+    return out, buf
+
+
+class Stream:
+    """Board stream to plain records, blocks expanded."""
+
+    def __init__(self):
+        self.buf = b""
+        self.raw = 0
+        self.wire = 0
+
+    def feed(self, data):
+        self.buf += data
+        self.wire += len(data)
+        out = []
+        while self.buf:
+            if self.buf[:1] == b"Z":
+                if len(self.buf) < 5:
+                    break
+                raw, blen = struct.unpack_from("!HH", self.buf, 1)
+                if len(self.buf) < 5 + blen:
+                    break
+                plain = decompress(self.buf[5:5 + blen], raw)
+                if len(plain) != raw:
+                    raise ValueError("block of %d bytes, %d announced" % (len(plain), raw))
+                self.buf = self.buf[5 + blen:]
+                recs, rest = records(plain)
+                if rest:
+                    raise ValueError("record cut at a block end")
+            else:
+                recs, self.buf = records(self.buf)
+                if not recs:
+                    break
+            out += recs
+        self.raw += sum(len(r) + len(b"%d " % len(r)) for r in out)
+        return out
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--bind", default="0.0.0.0")
+    ap.add_argument("--port", type=int, default=514)
+    ap.add_argument("--forward", help="host:port of a syslog server taking RFC 6587 over TCP")
+    args = ap.parse_args()
+
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind((args.bind, args.port))
+    srv.listen(1)
+    while True:
+        conn, peer = srv.accept()
+        fwd = None
+        if args.forward:
+            host, port = args.forward.rsplit(":", 1)
+            fwd = socket.create_connection((host, int(port)))
+        st = Stream()
+        print("%s: connected" % peer[0], file=sys.stderr)
+        try:
+            while True:
+                data = conn.recv(4096)
+                if not data:
+                    break
+                for rec in st.feed(data):
+                    if fwd:
+                        fwd.sendall(b"%d %s" % (len(rec), rec))
+                    else:
+                        print(rec.decode(errors="replace"))
+                sys.stdout.flush()
+        except (ValueError, IndexError, struct.error) as e:
+            print("%s: bad stream: %s" % (peer[0], e), file=sys.stderr)
+        print("%s: closed, %d bytes received for %d bytes of records" % (peer[0], st.wire, st.raw),
+              file=sys.stderr)
+        conn.close()
+        if fwd:
+            fwd.close()
+
+
+if __name__ == "__main__":
+    sys.exit(main())
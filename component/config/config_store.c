@@ -0,0 +1,155 @@
+/**
+ * @file config_store.c
+ * @brief Memory-mapped configuration blob, see config_store.h.
+ */
+
+#include "config_store.h"
+
+#include "chksum/crc32.h"
+#include "board.h"
+#include "main.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define CONFIG_TAG              "CFG"
+#define CONFIG_CRC_OFFSET       (offsetof(ConfigBlob_t, crc) + sizeof(uint32_t))
+
+#if CONFIG_STORE && (CONFIG_STORE_OFFSET % QSPI_FLASH_SECTOR_SIZE) != 0U
+#error "CONFIG_STORE_OFFSET must start a QSPI sector"
+#endif
+
+static const ConfigBlob_t config_defaults = {
+    .magic = CONFIG_STORE_MAGIC,
+    .version = CONFIG_STORE_VERSION,
+    .size = sizeof(ConfigBlob_t),
+    .syslog_port = SYSLOG_SERVER_PORT,
+    .dns = { DNS_SERVER_IP1, DNS_SERVER_IP2 },
+    .syslog_host = SYSLOG_SERVER_IP,
+    .ntp = { NTP_SERVER_IP1, NTP_SERVER_IP2 },
+};
+
+static const ConfigBlob_t* volatile config_active = &config_defaults;
+/* Slot of config_active and its sequence number; -1 for the defaults */
+static int32_t config_slot = -1;
+static uint32_t config_seq;
+/* The startup window's reader reference is held */
+static bool config_mapped;
+
+#if CONFIG_STORE
+static uint32_t config_blob_crc(const ConfigBlob_t* b)
+{
+    return crc32_ieee(0U, (const uint8_t*)b + CONFIG_CRC_OFFSET, sizeof(*b) - CONFIG_CRC_OFFSET);
+}
+
+static uint32_t config_slot_addr(uint32_t slot)
+{
+    return CONFIG_STORE_OFFSET + slot * QSPI_FLASH_SECTOR_SIZE;
+}
+
+static bool config_terminated(const char* s)
+{
+    return memchr(s, '\0', CONFIG_STORE_HOST_MAX) != NULL;
+}
+
+/* Read in place: header first, so an erased or foreign slot costs a word */
+static bool config_valid(const ConfigBlob_t* b)
+{
+    return b->magic == CONFIG_STORE_MAGIC && b->version == CONFIG_STORE_VERSION && b->size == sizeof(*b) &&
+           b->crc == config_blob_crc(b) && config_terminated(b->dns[0]) && config_terminated(b->dns[1]) &&
+           config_terminated(b->syslog_host) && config_terminated(b->ntp[0]) && config_terminated(b->ntp[1]);
+}
+#endif /* CONFIG_STORE */
+
+bool config_store_init(void)
+{
+#if CONFIG_STORE
+    if (qspi_flash_size() < config_slot_addr(2U) || !qspi_flash_map_get()) {
+        return false;
+    }
+    for (uint32_t slot = 0U; slot < 2U; slot++) {
+        const ConfigBlob_t* b = qspi_flash_ptr(config_slot_addr(slot));
+
+        if (config_valid(b) && (config_slot < 0 || (int32_t)(b->seq - config_seq) > 0)) {
+            config_active = b;
+            config_slot = (int32_t)slot;
+            config_seq = b->seq;
+        }
+    }
+    /* The defaults need no window */
+    if (config_slot < 0) {
+        qspi_flash_map_put();
+        return false;
+    }
+    config_mapped = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+const ConfigBlob_t* config_store_get(void)
+{
+    return config_active;
+}
+
+void config_store_release(void)
+{
+    if (config_slot < 0) {
+        LOG_INFO(CONFIG_TAG, "built-in configuration");
+    } else {
+        LOG_INFO(CONFIG_TAG, "configuration from slot %ld, sequence %lu", (long)config_slot,
+                 (unsigned long)config_seq);
+    }
+#if CONFIG_STORE
+    if (config_mapped) {
+        config_mapped = false;
+        qspi_flash_map_put();
+    }
+#endif
+}
+
+bool config_store_write(const ConfigBlob_t* cfg)
+{
+#if CONFIG_STORE
+    ConfigBlob_t b = *cfg;
+    uint32_t slot = (config_slot == 0) ? 1U : 0U;
+    uint32_t addr = config_slot_addr(slot);
+    bool ok;
+
+    if (config_mapped || qspi_flash_size() < config_slot_addr(2U)) {
+        return false;
+    }
+    b.magic = CONFIG_STORE_MAGIC;
+    b.version = CONFIG_STORE_VERSION;
+    b.size = sizeof(b);
+    b.seq = config_seq + 1U;
+    b.crc = config_blob_crc(&b);
+
+    if (!qspi_flash_begin(CONFIG_STORE_BUS_WAIT_MS)) {
+        return false;
+    }
+    ok = qspi_flash_erase_sector(addr) && qspi_flash_program(addr, &b, sizeof(b));
+    qspi_flash_end();
+    if (!ok || !qspi_flash_map_get()) {
+        LOG_ERROR(CONFIG_TAG, "slot %lu not written", (unsigned long)slot);
+        return false;
+    }
+    ok = memcmp(qspi_flash_ptr(addr), &b, sizeof(b)) == 0;
+    qspi_flash_map_put();
+    if (!ok) {
+        LOG_ERROR(CONFIG_TAG, "slot %lu does not read back", (unsigned long)slot);
+        return false;
+    }
+
+    config_active = qspi_flash_ptr(addr);
+    config_slot = (int32_t)slot;
+    config_seq = b.seq;
+    LOG_INFO(CONFIG_TAG, "configuration written to slot %lu, sequence %lu", (unsigned long)slot,
+             (unsigned long)b.seq);
+    return true;
+#else
+    (void)cfg;
+    return false;
+#endif
+}
@@ -0,0 +1,107 @@
+/**
+ * @file config_store.h
+ * @brief Network configuration as a binary blob in the QSPI flash, read in
+ *        place through the memory map at boot.
+ *
+ * The blob (ConfigBlob_t) is the C struct itself: fixed-size fields,
+ * strings terminated within them, a header with magic, layout version,
+ * size, a sequence number and a CRC-32 of the rest. There is nothing to
+ * parse and nothing is copied: config_store_init() checks the two slots
+ * (CONFIG_STORE_OFFSET, one sector each) where the flash maps them and
+ * points config_store_get() at the valid one with the higher sequence
+ * number, or at the built-in defaults (board.h, the CubeMX address in
+ * lwip.c) when neither is valid. A blob of another layout version is not
+ * valid; a new layout bumps CONFIG_STORE_VERSION.
+ *
+ * config_store_write() fills in the header, erases the slot not in use,
+ * programs it and reads it back; the slot in use is untouched until the
+ * next write, so a write cut short by a reset leaves the previous blob
+ * active. The new blob is what config_store_get() returns from then on;
+ * what was configured from the old one stays until the next boot.
+ * tools/mkconfig.py builds a blob to program into either slot with a
+ * flash programmer.
+ *
+ * A blob in the flash is only readable while it is mapped. From
+ * config_store_init() to config_store_release(), the startup window, the
+ * store holds a qspi_flash_map_get() reference and the blob may be read
+ * freely (the QSPI writers wait); afterwards a reader brackets its access
+ * with qspi_flash_map_get()/_put() itself. Consumers that keep a string
+ * beyond the call copy it (resolv_add()).
+ */
+
+#pragma once
+
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "qspi/qspi_flash.h"
+
+/* 0: the built-in defaults only, nothing read from the flash */
+#ifndef CONFIG_STORE
+#define CONFIG_STORE QSPI_FLASH
+#endif
+
+/* Device offset of the two slots, one sector each; below the MQTT store,
+ * see the QSPI region of the linker script */
+#ifndef CONFIG_STORE_OFFSET
+#define CONFIG_STORE_OFFSET 0x00DFE000U
+#endif
+
+/* Longest wait for readers of the mapped flash before a write */
+#ifndef CONFIG_STORE_BUS_WAIT_MS
+#define CONFIG_STORE_BUS_WAIT_MS 500U
+#endif
+
+#define CONFIG_STORE_MAGIC      0x43464731U     /* "CFG1" */
+#define CONFIG_STORE_VERSION    1U
+/* A host name or dotted address, terminator included */
+#define CONFIG_STORE_HOST_MAX   48U
+
+/* Little-endian, as the device reads it; tools/mkconfig.py packs the same
+ * layout */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;              /* sizeof(ConfigBlob_t) */
+    uint32_t seq;               /* the higher of two valid slots wins */
+    uint32_t crc;               /* CRC-32 (IEEE 802.3) of what follows */
+    uint8_t ip[4];              /* 0.0.0.0: the address in lwip.c */
+    uint8_t netmask[4];
+    uint8_t gateway[4];
+    uint16_t syslog_port;
+    uint16_t reserved;
+    char dns[2][CONFIG_STORE_HOST_MAX];
+    char syslog_host[CONFIG_STORE_HOST_MAX];
+    char ntp[2][CONFIG_STORE_HOST_MAX];
+} ConfigBlob_t;
+
+_Static_assert(sizeof(ConfigBlob_t) == 272U, "ConfigBlob_t layout changed: bump CONFIG_STORE_VERSION");
+
+/* Picks the blob and opens the startup window; once, after
+ * qspi_flash_init(), before the scheduler. True when the blob came from
+ * the flash. */
+bool config_store_init(void);
+
+/* The active blob, never NULL; see the startup window above */
+const ConfigBlob_t* config_store_get(void);
+
+/* Ends the startup window, once the consumers are configured */
+void config_store_release(void);
+
+/* Stores cfg (header fields ignored) in the slot not in use and makes it
+ * the active blob. From a task, after the startup window; false when the
+ * flash could not be taken, written or verified. */
+bool config_store_write(const ConfigBlob_t* cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CONFIG_STORE_H */
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Builds a configuration blob of component/config/config_store.h.
+
+The output is one ConfigBlob_t, header and CRC-32 included, to program into
+either slot of the QSPI flash (CONFIG_STORE_OFFSET or the sector after it,
+0x90DFE000 / 0x90DFF000 mapped) with a flash programmer and its external
+QSPI loader. The board takes the valid slot with the higher sequence
+number; leave --seq above the one the board logs at boot ("CFG:
+configuration from slot ...") to replace it.
+
+    mkconfig.py -o config.bin --ip 192.168.1.20/24 --gw 192.168.1.1 \\
+        --dns 192.168.1.1 8.8.8.8 --syslog 192.168.1.5:514 \\
+        --ntp ntp.towercrane.lan pool.ntp.org --seq 2
+    mkconfig.py --dump config.bin
+
+Without --ip the board keeps the address compiled into lwip.c.
+"""
+
+import argparse
+import ipaddress
+import struct
+import sys
+import zlib
+
+CONFIG_STORE_MAGIC = 0x43464731
+CONFIG_STORE_VERSION = 1
+HOST_MAX = 48
+# magic, version, size, seq, crc, ip, netmask, gateway, syslog_port,
+# reserved, dns[2], syslog_host, ntp[2]
+LAYOUT = "<IHHII4s4s4sHH%ds%ds%ds%ds%ds" % ((HOST_MAX,) * 5)
+SIZE = struct.calcsize(LAYOUT)
+CRC_OFFSET = 16
+
+assert SIZE == 272
+
+
+def host(s):
+    b = s.encode("ascii")
+    if len(b) >= HOST_MAX:
+        sys.exit("name too long (%d characters at most): %s" % (HOST_MAX - 1, s))
+    return b
+
+
+def build(args):
+    ip = netmask = gateway = b"\0\0\0\0"
+    if args.ip:
+        iface = ipaddress.IPv4Interface(args.ip)
+        ip = iface.ip.packed
+        netmask = iface.netmask.packed
+        gateway = ipaddress.IPv4Address(args.gw).packed if args.gw else b"\0\0\0\0"
+    syslog_host, _, port = args.syslog.partition(":")
+    dns = (args.dns + ["", ""])[:2]
+    ntp = (args.ntp + ["", ""])[:2]
+    body = struct.pack(LAYOUT, CONFIG_STORE_MAGIC, CONFIG_STORE_VERSION, SIZE, args.seq, 0,
+                       ip, netmask, gateway, int(port or 514), 0,
+                       host(dns[0]), host(dns[1]), host(syslog_host), host(ntp[0]), host(ntp[1]))
+    crc = zlib.crc32(body[CRC_OFFSET:]) & 0xFFFFFFFF
+    return body[:12] + struct.pack("<I", crc) + body[CRC_OFFSET:]
+
+
+def dump(path):
+    with open(path, "rb") as f:
+        data = f.read(SIZE)
+    if len(data) < SIZE:
+        sys.exit("short blob")
+    f = struct.unpack(LAYOUT, data)
+    crc_ok = (zlib.crc32(data[CRC_OFFSET:]) & 0xFFFFFFFF) == f[4]
+    s = lambda b: b.split(b"\0", 1)[0].decode("ascii", "replace")
+    print("magic %08x%s version %u size %u seq %u crc %08x %s" %
+          (f[0], "" if f[0] == CONFIG_STORE_MAGIC else " (bad)", f[1], f[2], f[3], f[4],
+           "ok" if crc_ok else "BAD"))
+    print("ip %s netmask %s gateway %s" % tuple(str(ipaddress.IPv4Address(x)) for x in f[5:8]))
+    print("dns %s %s" % (s(f[10]), s(f[11])))
+    print("syslog %s:%u" % (s(f[12]), f[8]))
+    print("ntp %s %s" % (s(f[13]), s(f[14])))
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("-o", "--output")
+    ap.add_argument("--dump")
+    ap.add_argument("--ip", help="address/prefix")
+    ap.add_argument("--gw")
+    ap.add_argument("--dns", nargs="*", default=["192.168.1.1", "8.8.8.8"])
+    ap.add_argument("--syslog", default="192.168.1.1:514")
+    ap.add_argument("--ntp", nargs="*", default=["ntp.towercrane.lan", "pool.ntp.org"])
+    ap.add_argument("--seq", type=int, default=1)
+    args = ap.parse_args()
+
+    if args.dump:
+        dump(args.dump)
+        return
+    if not args.output:
+        ap.error("-o or --dump")
+    with open(args.output, "wb") as f:
+        f.write(build(args))
+
+
+if __name__ == "__main__":
+    main()
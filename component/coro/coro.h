@@ -0,0 +1,100 @@
+/**
+ * @file coro.h
+ * @brief Stackless coroutines: sequential handlers as resumable functions.
+ *
+ * Protothread style. A coroutine is a function between CORO_BEGIN() and
+ * CORO_END() that returns CORO_WAITING wherever it has to wait and is
+ * called again when something may have changed; the Coro_t records the
+ * line to resume at, and the switch in CORO_BEGIN() jumps there. Two bytes
+ * of state instead of a stack: one task (for protocol handlers the tcpip
+ * thread, see coro_tcp.h) runs any number of them.
+ *
+ * The price is C's: local variables do not survive a wait, so whatever a
+ * coroutine needs across one lives in its context struct, and a switch
+ * statement of its own must not contain a wait. A condition is evaluated
+ * again on every call until it holds.
+ *
+ *   static CoroState_t blink(Blink_t* b)
+ *   {
+ *       CORO_BEGIN(&b->co);
+ *       for (;;) {
+ *           CORO_WAIT_UNTIL(&b->co, b->tick);
+ *           ...
+ *       }
+ *       CORO_END(&b->co);
+ *   }
+ */
+
+#pragma once
+
+#ifndef CORO_H
+#define CORO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+typedef struct {
+    uint16_t lc;            /* line to resume at, 0 at the start */
+} Coro_t;
+
+typedef enum {
+    CORO_WAITING = 0,       /* call again */
+    CORO_DONE,              /* ended; starts over if called again */
+} CoroState_t;
+
+#define CORO_INIT(co)       ((co)->lc = 0U)
+
+#define CORO_BEGIN(co)                                                          \
+    {                                                                           \
+        uint8_t coro_resumed_ = 1U;                                             \
+        (void)coro_resumed_;                                                    \
+        switch ((co)->lc) {                                                     \
+        case 0U:
+
+#define CORO_END(co)                                                            \
+        }                                                                       \
+        (co)->lc = 0U;                                                          \
+        return CORO_DONE;                                                       \
+    }
+
+/* Returns until cond holds; at once when it does already */
+#define CORO_WAIT_UNTIL(co, cond)                                               \
+    do {                                                                        \
+        (co)->lc = __LINE__;                                                    \
+        case __LINE__:                                                          \
+        if (!(cond)) {                                                          \
+            return CORO_WAITING;                                                \
+        }                                                                       \
+    } while (0)
+
+#define CORO_WAIT_WHILE(co, cond) CORO_WAIT_UNTIL((co), !(cond))
+
+/* Runs a child coroutine to its end */
+#define CORO_WAIT_CHILD(co, call) CORO_WAIT_UNTIL((co), (call) != CORO_WAITING)
+
+/* Returns once, resumes at the next call */
+#define CORO_YIELD(co)                                                          \
+    do {                                                                        \
+        coro_resumed_ = 0U;                                                     \
+        (co)->lc = __LINE__;                                                    \
+        case __LINE__:                                                          \
+        if (coro_resumed_ == 0U) {                                              \
+            return CORO_WAITING;                                                \
+        }                                                                       \
+    } while (0)
+
+/* Ends the coroutine from anywhere in it */
+#define CORO_EXIT(co)                                                           \
+    do {                                                                        \
+        (co)->lc = 0U;                                                          \
+        return CORO_DONE;                                                       \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CORO_H */
@@ -0,0 +1,259 @@
+/**
+ * @file coro_tcp.c
+ * @brief TCP connections as coroutines, see coro_tcp.h.
+ */
+
+#include "coro_tcp.h"
+
+#include "main.h"
+#include "lwip/tcpip.h"
+#include "lwip/tcp.h"
+#include "lwip/pbuf.h"
+#include "lwip/timeouts.h"
+
+#include <string.h>
+
+#define CORO_TCP_TAG            "CORO"
+/* tcp_poll() every 500 ms */
+#define CORO_TCP_POLL_INTERVAL  1U
+
+static CoroTcpConn_t* coro_tcp_conn(const CoroTcpServer_t* srv, uint32_t i)
+{
+    return (CoroTcpConn_t*)(void*)((uint8_t*)srv->conns + i * srv->conn_size);
+}
+
+static void coro_tcp_wake(void* arg);
+
+/* Everything the connection holds back, the entry free again */
+static void coro_tcp_release(CoroTcpConn_t* c)
+{
+    if (c->srv->release != NULL) {
+        c->srv->release(c);
+    }
+    if (c->sleeping) {
+        sys_untimeout(coro_tcp_wake, c);
+        c->sleeping = false;
+    }
+    if (c->rx != NULL) {
+        pbuf_free(c->rx);
+        c->rx = NULL;
+    }
+    c->pcb = NULL;
+}
+
+/* The handler is done: FIN after the queued data */
+static err_t coro_tcp_finish(CoroTcpConn_t* c)
+{
+    struct tcp_pcb* pcb = c->pcb;
+
+    coro_tcp_release(c);
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+    tcp_err(pcb, NULL);
+    if (tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    return ERR_OK;
+}
+
+/* Resumes the handler; ERR_ABRT when the pcb was aborted */
+static err_t coro_tcp_run(CoroTcpConn_t* c)
+{
+    if (c->srv->fn(c) == CORO_WAITING) {
+        return ERR_OK;
+    }
+    return coro_tcp_finish(c);
+}
+
+static void coro_tcp_wake(void* arg)
+{
+    CoroTcpConn_t* c = arg;
+
+    c->sleeping = false;
+    (void)coro_tcp_run(c);
+}
+
+static err_t coro_tcp_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    CoroTcpConn_t* c = arg;
+
+    LWIP_UNUSED_ARG(pcb);
+    if (p == NULL || err != ERR_OK) {
+        if (p != NULL) {
+            pbuf_free(p);
+        }
+        c->eof = true;
+    } else if (c->rx == NULL) {
+        c->rx = p;
+    } else {
+        pbuf_cat(c->rx, p);
+    }
+    c->polls = 0U;
+    return coro_tcp_run(c);
+}
+
+static err_t coro_tcp_sent(void* arg, struct tcp_pcb* pcb, u16_t len)
+{
+    CoroTcpConn_t* c = arg;
+
+    LWIP_UNUSED_ARG(pcb);
+    LWIP_UNUSED_ARG(len);
+    c->polls = 0U;
+    return coro_tcp_run(c);
+}
+
+static err_t coro_tcp_poll(void* arg, struct tcp_pcb* pcb)
+{
+    CoroTcpConn_t* c = arg;
+
+    if (++c->polls >= c->srv->idle_polls) {
+        coro_tcp_release(c);
+        tcp_err(pcb, NULL);
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    /* A send waiting for room that a lost callback never brought */
+    return coro_tcp_run(c);
+}
+
+static void coro_tcp_err(void* arg, err_t err)
+{
+    CoroTcpConn_t* c = arg;
+
+    LWIP_UNUSED_ARG(err);
+    /* The pcb is gone, and with it whatever was queued */
+    coro_tcp_release(c);
+}
+
+static err_t coro_tcp_accept(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+    CoroTcpServer_t* srv = arg;
+    CoroTcpConn_t* c = NULL;
+
+    if (err != ERR_OK || pcb == NULL) {
+        return ERR_VAL;
+    }
+    for (uint32_t i = 0U; i < srv->count; i++) {
+        if (coro_tcp_conn(srv, i)->pcb == NULL) {
+            c = coro_tcp_conn(srv, i);
+            break;
+        }
+    }
+    if (c == NULL) {
+        return ERR_MEM;
+    }
+    memset(c, 0, srv->conn_size);
+    CORO_INIT(&c->co);
+    c->pcb = pcb;
+    c->srv = srv;
+    pcb->tos = srv->tos;
+    tcp_arg(pcb, c);
+    tcp_recv(pcb, coro_tcp_recv);
+    tcp_sent(pcb, coro_tcp_sent);
+    tcp_poll(pcb, coro_tcp_poll, CORO_TCP_POLL_INTERVAL);
+    tcp_err(pcb, coro_tcp_err);
+    /* Up to its first wait: a server that speaks first does so now */
+    return coro_tcp_run(c);
+}
+
+uint32_t coro_tcp_rx_len(const CoroTcpConn_t* c)
+{
+    return (c->rx != NULL) ? c->rx->tot_len : 0U;
+}
+
+int32_t coro_tcp_rx_find(const CoroTcpConn_t* c, uint8_t b)
+{
+    u16_t i;
+
+    if (c->rx == NULL) {
+        return -1;
+    }
+    i = pbuf_memfind(c->rx, &b, 1U, 0U);
+    return (i == 0xFFFFU) ? -1 : (int32_t)i;
+}
+
+uint32_t coro_tcp_read(CoroTcpConn_t* c, void* dst, uint32_t n)
+{
+    uint32_t len = coro_tcp_rx_len(c);
+
+    if (n > len) {
+        n = len;
+    }
+    if (n == 0U) {
+        return 0U;
+    }
+    if (dst != NULL) {
+        (void)pbuf_copy_partial(c->rx, dst, (u16_t)n, 0U);
+    }
+    c->rx = pbuf_free_header(c->rx, (u16_t)n);
+    /* The window reopens as the handler consumes */
+    tcp_recved(c->pcb, (u16_t)n);
+    return n;
+}
+
+bool coro_tcp_send_step(CoroTcpConn_t* c, const void* data, uint32_t len, uint8_t flags)
+{
+    const uint8_t* p = data;
+
+    while (c->tx_off < len) {
+        uint32_t n = len - c->tx_off;
+        u16_t room = tcp_sndbuf(c->pcb);
+        u8_t f = flags;
+
+        if (n > room) {
+            n = room;
+        }
+        if (c->tx_off + n < len) {
+            f |= TCP_WRITE_FLAG_MORE;
+        }
+        if (n == 0U || tcp_write(c->pcb, &p[c->tx_off], (u16_t)n, f) != ERR_OK) {
+            break;
+        }
+        c->tx_off += n;
+    }
+    tcp_output(c->pcb);
+    return c->tx_off == len;
+}
+
+bool coro_tcp_acked(const CoroTcpConn_t* c)
+{
+    return tcp_sndqueuelen(c->pcb) == 0U;
+}
+
+void coro_tcp_sleep(CoroTcpConn_t* c, uint32_t ms)
+{
+    c->sleeping = true;
+    sys_timeout(ms, coro_tcp_wake, c);
+}
+
+bool coro_tcp_start(CoroTcpServer_t* srv)
+{
+    struct tcp_pcb* pcb;
+    struct tcp_pcb* lpcb = NULL;
+
+    if (srv->fn == NULL || srv->count == 0U || srv->conn_size < sizeof(CoroTcpConn_t) || srv->idle_polls == 0U) {
+        return false;
+    }
+    LOCK_TCPIP_CORE();
+    pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (pcb != NULL) {
+        if (tcp_bind(pcb, IP_ANY_TYPE, srv->port) == ERR_OK) {
+            lpcb = tcp_listen_with_backlog(pcb, (u8_t)((srv->count < 255U) ? srv->count : 255U));
+        }
+        if (lpcb == NULL) {
+            tcp_close(pcb);
+        } else {
+            tcp_arg(lpcb, srv);
+            tcp_accept(lpcb, coro_tcp_accept);
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+    if (lpcb == NULL) {
+        LOG_ERROR(CORO_TCP_TAG, "no listener on port %u", (unsigned)srv->port);
+        return false;
+    }
+    return true;
+}
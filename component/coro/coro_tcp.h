@@ -0,0 +1,130 @@
+/**
+ * @file coro_tcp.h
+ * @brief TCP servers whose connections are coroutines on the tcpip thread.
+ *
+ * A handler written as a blocking-socket loop (read the request, send the
+ * answer, wait until it is acknowledged) without a task per connection:
+ * every connection is a CoroTcpConn_t and a coroutine (coro.h) that the
+ * server resumes from the raw API callbacks, on data received, data
+ * acknowledged, the 500 ms poll and its own sleep timer. A connection costs
+ * its context struct, nothing on the FreeRTOS heap, so the number served
+ * at once is a matter of the static array and of lwIP's PCBs.
+ *
+ * Received data is kept as a pbuf chain until the handler consumes it,
+ * and the receive window follows the consumption: a handler that reads
+ * slowly slows the peer down. coro_tcp_send_step() queues by reference
+ * unless told to copy; CORO_TCP_WAIT_ACKED() then waits until the peer
+ * has everything, after which the memory is free again. The handler's
+ * return ends the connection with a FIN; a peer silent for idle_polls
+ * polls, or an error, ends it at once. Either way the release callback
+ * gets the connection first, to give back whatever it holds.
+ *
+ * Handler conventions: data and length arguments of the macros are
+ * evaluated again on every resumption, so they must be fields of the
+ * context, not locals.
+ */
+
+#pragma once
+
+#ifndef CORO_TCP_H
+#define CORO_TCP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "coro.h"
+
+struct tcp_pcb;
+struct pbuf;
+
+typedef struct CoroTcpConn_s CoroTcpConn_t;
+typedef struct CoroTcpServer_s CoroTcpServer_t;
+
+/* The connection's coroutine; CORO_DONE closes it */
+typedef CoroState_t (*CoroTcpFn)(CoroTcpConn_t* c);
+/* The connection ends, its pcb is no longer usable */
+typedef void (*CoroTcpReleaseFn)(CoroTcpConn_t* c);
+
+/* First member of the handler's context struct */
+struct CoroTcpConn_s {
+    Coro_t co;
+    struct tcp_pcb* pcb;        /* NULL: the entry is free */
+    CoroTcpServer_t* srv;
+    struct pbuf* rx;            /* received, not consumed */
+    uint32_t tx_off;            /* of the send in progress */
+    uint8_t polls;              /* without progress */
+    bool eof;                   /* the peer closed its side */
+    bool sleeping;
+};
+
+struct CoroTcpServer_s {
+    uint16_t port;
+    uint8_t tos;
+    uint8_t idle_polls;         /* 500 ms each */
+    CoroTcpFn fn;
+    CoroTcpReleaseFn release;   /* may be NULL */
+    void* conns;                /* count context structs of conn_size */
+    size_t conn_size;
+    uint32_t count;
+};
+
+/* A server with n connections of the context type, which starts with a
+ * CoroTcpConn_t */
+#define CORO_TCP_SERVER_DEFINE(var, type, n, port_, fn_, release_, idle_polls_)  \
+    static type var##_conns[(n)];                                               \
+    static CoroTcpServer_t var = { .port = (port_), .tos = 0U,                  \
+                                   .idle_polls = (idle_polls_), .fn = (fn_),    \
+                                   .release = (release_), .conns = var##_conns, \
+                                   .conn_size = sizeof(type), .count = (n) }
+
+/* Opens the listener. From a task, core lock not held. */
+bool coro_tcp_start(CoroTcpServer_t* srv);
+
+/* Bytes received and not consumed */
+uint32_t coro_tcp_rx_len(const CoroTcpConn_t* c);
+/* Offset of the first byte b in them, or -1 */
+int32_t coro_tcp_rx_find(const CoroTcpConn_t* c, uint8_t b);
+/* Copies up to n of them to dst (NULL: drops them); returns the count */
+uint32_t coro_tcp_read(CoroTcpConn_t* c, void* dst, uint32_t n);
+
+/* Queues what the send buffer takes of data[tx_off..len); true once all
+ * is queued. flags: TCP_WRITE_FLAG_COPY to copy, TCP_WRITE_FLAG_MORE when
+ * more follows. */
+bool coro_tcp_send_step(CoroTcpConn_t* c, const void* data, uint32_t len, uint8_t flags);
+
+/* Nothing sent is waiting for an acknowledgement */
+bool coro_tcp_acked(const CoroTcpConn_t* c);
+
+/* Wakes the coroutine after ms */
+void coro_tcp_sleep(CoroTcpConn_t* c, uint32_t ms);
+
+/* At least n bytes received, or the peer closed */
+#define CORO_TCP_WAIT_RX(c, n) \
+    CORO_WAIT_UNTIL(&(c)->co, coro_tcp_rx_len(c) >= (n) || (c)->eof)
+
+/* All of data queued; data must stay until acknowledged unless copied */
+#define CORO_TCP_SEND(c, data, len, flags)                                      \
+    do {                                                                        \
+        (c)->tx_off = 0U;                                                       \
+        CORO_WAIT_UNTIL(&(c)->co, coro_tcp_send_step((c), (data), (len), (flags))); \
+    } while (0)
+
+/* Everything sent is acknowledged */
+#define CORO_TCP_WAIT_ACKED(c) CORO_WAIT_UNTIL(&(c)->co, coro_tcp_acked(c))
+
+#define CORO_TCP_SLEEP(c, ms)                                                   \
+    do {                                                                        \
+        coro_tcp_sleep((c), (ms));                                              \
+        CORO_WAIT_WHILE(&(c)->co, (c)->sleeping);                               \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CORO_TCP_H */
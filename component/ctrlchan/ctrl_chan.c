@@ -0,0 +1,425 @@
+/**
+ * @file ctrl_chan.c
+ * @brief UDP control channel: fast path receive, control task, static
+ *        feedback pbufs.
+ */
+
+#include "ctrl_chan.h"
+
+#include "lwip/opt.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#include "lwip/pbuf.h"
+#include "lwip/def.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "logger/syslog.h"
+#include "metrics/metrics.h"
+#include "objpool/obj_pool.h"
+#include "timesync/time_ns.h"
+#if CTRL_CHAN_FAST
+#include "ethernetif.h"
+#endif
+#if CTRL_CHAN_ARP_PIN && LWIP_IPV4 && LWIP_ARP && ETHARP_PIN_MAX
+#include "lwip/etharp.h"
+#define CTRL_CHAN_PIN 1
+#else
+#define CTRL_CHAN_PIN 0
+#endif
+
+#include <string.h>
+
+#define CTRL_TAG "CTRL"
+
+#define CTRL_CHAN_NS_PER_US     1000U
+
+/* Room for the headers lwIP adds in front of the payload */
+#define CTRL_CHAN_TX_MEM \
+    ((LWIP_MEM_ALIGN_SIZE((uint32_t)PBUF_TRANSPORT) + CTRL_CHAN_MSG_MAX + 31U) & ~31U)
+
+_Static_assert((CTRL_CHAN_RX_SLOTS & (CTRL_CHAN_RX_SLOTS - 1U)) == 0U, "CTRL_CHAN_RX_SLOTS not a power of two");
+_Static_assert(CTRL_CHAN_MSG_MAX > sizeof(CtrlChanHdr_t), "CTRL_CHAN_MSG_MAX below the header");
+
+typedef struct {
+    struct pbuf* p;
+    ip_addr_t src;
+    uint16_t src_port;
+    uint64_t t_rx;          /* time_now_ns() at the hand-over */
+} CtrlChanRx_t;
+
+/* pc first: the free function is given its pbuf */
+typedef struct {
+    struct pbuf_custom pc;
+    uint8_t mem[CTRL_CHAN_TX_MEM] __attribute__((aligned(32)));
+} CtrlChanTxBuf_t;
+
+/* Allocated by the control task, freed by whoever releases the pbuf last,
+ * usually the driver's TX completion */
+OBJ_POOL_DEFINE(ctrl_tx_pool, CtrlChanTxBuf_t, CTRL_CHAN_TX_BUFS);
+
+typedef struct {
+    struct udp_pcb* pcb;
+    TaskHandle_t task;
+    CtrlChanFn fn;
+    void* arg;
+    /* Single producer (EthIf task or tcpip thread), single consumer */
+    CtrlChanRx_t rx[CTRL_CHAN_RX_SLOTS];
+    volatile uint32_t rx_head;
+    volatile uint32_t rx_tail;
+    /* Control task from here on, but stats.overruns: producer */
+    bool active;
+    uint32_t peer_seq;
+    uint64_t last_rx;
+    uint32_t seq;
+#if CTRL_CHAN_PIN
+    ip_addr_t pin_peer;     /* peer the pin is for */
+    ip4_addr_t pin_hop;     /* pinned address, any for none */
+#endif
+    CtrlChanStats_t stats;
+    LatHist_t hist[CTRL_CHAN_HIST_CNT];
+} CtrlChan_t;
+
+static CtrlChan_t chan;
+
+/* Setpoint payload, and the feedback when no buffer is free */
+static uint8_t ctrl_setpoint[CTRL_CHAN_PAYLOAD_MAX];
+static uint8_t ctrl_scratch[CTRL_CHAN_PAYLOAD_MAX];
+
+static StackType_t ctrl_stack[CTRL_CHAN_STACK_WORDS];
+static StaticTask_t ctrl_tcb;
+
+/* Any context: the driver releases a sent frame from its TX completion */
+static void ctrl_chan_tx_free(struct pbuf* p)
+{
+    (void)ctrl_tx_pool_free((CtrlChanTxBuf_t*)(void*)p);
+}
+
+/* Producer side, EthIf task or tcpip thread; takes p */
+static void ctrl_chan_post(struct pbuf* p, const ip_addr_t* src, uint16_t src_port)
+{
+    uint32_t head = chan.rx_head;
+    CtrlChanRx_t* r;
+
+    if ((head - __atomic_load_n(&chan.rx_tail, __ATOMIC_ACQUIRE)) >= CTRL_CHAN_RX_SLOTS) {
+        chan.stats.overruns++;
+        pbuf_free(p);
+        return;
+    }
+    r = &chan.rx[head % CTRL_CHAN_RX_SLOTS];
+    r->t_rx = time_now_ns();
+    r->p = p;
+    ip_addr_copy(r->src, *src);
+    r->src_port = src_port;
+    __atomic_store_n(&chan.rx_head, head + 1U, __ATOMIC_RELEASE);
+    xTaskNotifyGive(chan.task);
+}
+
+#if CTRL_CHAN_FAST
+static void ctrl_chan_fast_rx(struct pbuf* p, const ip4_addr_t* src, uint16_t src_port, void* arg)
+{
+    ip_addr_t addr;
+
+    (void)arg;
+    ip_addr_copy_from_ip4(addr, *src);
+    ctrl_chan_post(p, &addr, src_port);
+}
+#endif
+
+static void ctrl_chan_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    (void)arg;
+    (void)pcb;
+    ctrl_chan_post(p, addr, port);
+}
+
+/* Header and sequence checks of one received datagram. Accepted ones
+ * become the stream's latest. */
+static bool ctrl_chan_accept(const CtrlChanRx_t* r, CtrlChanHdr_t* hdr)
+{
+    uint32_t seq;
+    int32_t d;
+
+    if ((r->p->tot_len < CTRL_CHAN_HDR_LEN) || (r->p->tot_len > CTRL_CHAN_MSG_MAX) ||
+        (pbuf_copy_partial(r->p, hdr, CTRL_CHAN_HDR_LEN, 0) != CTRL_CHAN_HDR_LEN) ||
+        (hdr->magic != PP_HTONS(CTRL_CHAN_MAGIC)) || (hdr->version != CTRL_CHAN_VERSION) ||
+        (hdr->type != CTRL_CHAN_SETPOINT)) {
+        chan.stats.bad++;
+        return false;
+    }
+
+    seq = lwip_ntohl(hdr->seq);
+    d = (int32_t)(seq - chan.peer_seq);
+    if (chan.active) {
+        if ((d > -(int32_t)CTRL_CHAN_SEQ_WINDOW) && (d <= 0)) {
+            chan.stats.stale++;
+            return false;
+        }
+        if ((d >= (int32_t)CTRL_CHAN_SEQ_WINDOW) || (d <= -(int32_t)CTRL_CHAN_SEQ_WINDOW)) {
+            chan.stats.restarts++;
+        } else {
+            chan.stats.lost += (uint32_t)d - 1U;
+        }
+        if (d == 1) {
+            int64_t dt = (int64_t)(r->t_rx - chan.last_rx) - (int64_t)CTRL_CHAN_PERIOD_US * CTRL_CHAN_NS_PER_US;
+            uint64_t jitter = (uint64_t)((dt < 0) ? -dt : dt);
+            lat_hist_add(&chan.hist[CTRL_CHAN_HIST_JITTER], (jitter > UINT32_MAX) ? UINT32_MAX : (uint32_t)jitter);
+        }
+    }
+    chan.active = true;
+    chan.peer_seq = seq;
+    chan.last_rx = r->t_rx;
+    chan.stats.rx++;
+    return true;
+}
+
+#if CTRL_CHAN_PIN
+/* The next hop to a new peer pinned in place of the previous one; the
+ * control task with the core lock held */
+static void ctrl_chan_pin(const ip_addr_t* peer)
+{
+    const ip4_addr_t* dst;
+    const ip4_addr_t* hop;
+    struct netif* netif;
+
+    if (ip_addr_cmp(&chan.pin_peer, peer) || !IP_IS_V4(peer)) {
+        return;
+    }
+    dst = ip_2_ip4(peer);
+    netif = ip4_route(dst);
+    if (netif == NULL) {
+        return;
+    }
+    hop = ip4_addr_netcmp(dst, netif_ip4_addr(netif), netif_ip4_netmask(netif)) ? dst : netif_ip4_gw(netif);
+    ip_addr_copy(chan.pin_peer, *peer);
+    if (ip4_addr_cmp(hop, &chan.pin_hop)) {
+        return;
+    }
+    if (!ip4_addr_isany_val(chan.pin_hop)) {
+        (void)etharp_unpin(&chan.pin_hop);
+    }
+    /* With all ETHARP_PIN_MAX slots taken, the entry just ages as before */
+    if (etharp_pin(netif, hop) == ERR_OK) {
+        ip4_addr_copy(chan.pin_hop, *hop);
+    } else {
+        ip4_addr_set_any(&chan.pin_hop);
+    }
+}
+#endif
+
+/* Runs the control step on the newest setpoint and sends its feedback */
+static void ctrl_chan_answer(const CtrlChanRx_t* r, const CtrlChanHdr_t* in, uint64_t t_wake)
+{
+    uint16_t len = (uint16_t)(r->p->tot_len - CTRL_CHAN_HDR_LEN);
+    CtrlChanTxBuf_t* b = ctrl_tx_pool_alloc();
+    struct pbuf* p = NULL;
+    uint8_t* out = ctrl_scratch;
+    uint16_t n;
+
+    lat_hist_add(&chan.hist[CTRL_CHAN_HIST_WAKE], (uint32_t)(t_wake - r->t_rx));
+    (void)pbuf_copy_partial(r->p, ctrl_setpoint, len, CTRL_CHAN_HDR_LEN);
+    pbuf_free(r->p);
+
+    if (b != NULL) {
+        b->pc.custom_free_function = ctrl_chan_tx_free;
+        p = pbuf_alloced_custom(PBUF_TRANSPORT, CTRL_CHAN_MSG_MAX, PBUF_RAM, &b->pc, b->mem, sizeof(b->mem));
+        if (p != NULL) {
+            out = (uint8_t*)p->payload + CTRL_CHAN_HDR_LEN;
+        } else {
+            (void)ctrl_tx_pool_free(b);
+        }
+    }
+
+    if (chan.fn != NULL) {
+        n = chan.fn(ctrl_setpoint, len, out, CTRL_CHAN_PAYLOAD_MAX, chan.arg);
+    } else {
+        memcpy(out, ctrl_setpoint, len);
+        n = len;
+    }
+    if (n == 0U) {
+        if (p != NULL) {
+            pbuf_free(p);
+        }
+        return;
+    }
+    if (p == NULL) {
+        chan.stats.tx_busy++;
+        chan.stats.deadline_miss++;
+        return;
+    }
+
+    CtrlChanHdr_t* h = (CtrlChanHdr_t*)p->payload;
+    uint64_t t_send = time_now_ns();
+    uint64_t residence = t_send - r->t_rx;
+    err_t err;
+
+    pbuf_realloc(p, (uint16_t)(CTRL_CHAN_HDR_LEN + ((n < CTRL_CHAN_PAYLOAD_MAX) ? n : CTRL_CHAN_PAYLOAD_MAX)));
+    h->magic = PP_HTONS(CTRL_CHAN_MAGIC);
+    h->version = CTRL_CHAN_VERSION;
+    h->type = CTRL_CHAN_FEEDBACK;
+    h->seq = lwip_htonl(chan.seq);
+    h->ack = in->seq;
+    h->residence_ns = lwip_htonl((residence > UINT32_MAX) ? UINT32_MAX : (uint32_t)residence);
+    h->ts = in->ts;
+
+    LOCK_TCPIP_CORE();
+#if CTRL_CHAN_PIN
+    ctrl_chan_pin(&r->src);
+#endif
+    err = udp_sendto(chan.pcb, p, &r->src, r->src_port);
+    UNLOCK_TCPIP_CORE();
+    /* The driver keeps its own reference until the frame is out */
+    pbuf_free(p);
+
+    uint64_t latency = time_now_ns() - r->t_rx;
+    if (err != ERR_OK) {
+        chan.stats.tx_errors++;
+        chan.stats.deadline_miss++;
+        return;
+    }
+    chan.seq++;
+    chan.stats.tx++;
+    lat_hist_add(&chan.hist[CTRL_CHAN_HIST_LATENCY], (latency > UINT32_MAX) ? UINT32_MAX : (uint32_t)latency);
+    if (latency > (uint64_t)CTRL_CHAN_DEADLINE_US * CTRL_CHAN_NS_PER_US) {
+        chan.stats.deadline_miss++;
+    }
+}
+
+/* Everything queued since the last wakeup; only the newest accepted
+ * setpoint gets an answer */
+static void ctrl_chan_step(void)
+{
+    uint32_t head = __atomic_load_n(&chan.rx_head, __ATOMIC_ACQUIRE);
+    uint64_t t_wake = time_now_ns();
+    CtrlChanRx_t cur = { 0 };
+    CtrlChanHdr_t cur_hdr = { 0 };
+    CtrlChanHdr_t hdr;
+
+    while (chan.rx_tail != head) {
+        CtrlChanRx_t r = chan.rx[chan.rx_tail % CTRL_CHAN_RX_SLOTS];
+
+        /* Slot free again for the producer */
+        __atomic_store_n(&chan.rx_tail, chan.rx_tail + 1U, __ATOMIC_RELEASE);
+        if (!ctrl_chan_accept(&r, &hdr)) {
+            pbuf_free(r.p);
+            continue;
+        }
+        if (cur.p != NULL) {
+            chan.stats.superseded++;
+            chan.stats.deadline_miss++;
+            pbuf_free(cur.p);
+        }
+        cur = r;
+        cur_hdr = hdr;
+    }
+    if (cur.p != NULL) {
+        ctrl_chan_answer(&cur, &cur_hdr, t_wake);
+    }
+}
+
+static void ctrl_chan_timeout(void)
+{
+    chan.active = false;
+    chan.stats.timeouts++;
+    if (chan.fn != NULL) {
+        (void)chan.fn(NULL, 0U, ctrl_scratch, CTRL_CHAN_PAYLOAD_MAX, chan.arg);
+    }
+    LOG_WARNING(CTRL_TAG, "no setpoint for %u ms, stream ended (%lu lost, %lu deadline misses)",
+             (unsigned)CTRL_CHAN_TIMEOUT_MS, (unsigned long)chan.stats.lost,
+             (unsigned long)chan.stats.deadline_miss);
+}
+
+static void ctrl_chan_task(void* arg)
+{
+    (void)arg;
+    for (;;) {
+        /* A tick more than the timeout: the first one may be partly gone */
+        if (ulTaskNotifyTake(pdTRUE, chan.active ? (pdMS_TO_TICKS(CTRL_CHAN_TIMEOUT_MS) + 1U) : portMAX_DELAY) != 0U) {
+            ctrl_chan_step();
+        }
+        if (chan.active && ((time_now_ns() - chan.last_rx) >= (uint64_t)CTRL_CHAN_TIMEOUT_MS * 1000000U)) {
+            ctrl_chan_timeout();
+        }
+    }
+}
+
+#if METRICS
+static void ctrl_chan_metrics(MetricsWriter_t* w)
+{
+    CtrlChanStats_t s;
+
+    ctrl_chan_get_stats(&s);
+    metrics_emit(w, "ctrl.rx", METRIC_COUNTER, s.rx);
+    metrics_emit(w, "ctrl.tx", METRIC_COUNTER, s.tx);
+    metrics_emit(w, "ctrl.bad", METRIC_COUNTER, s.bad);
+    metrics_emit(w, "ctrl.stale", METRIC_COUNTER, s.stale);
+    metrics_emit(w, "ctrl.lost", METRIC_COUNTER, s.lost);
+    metrics_emit(w, "ctrl.restarts", METRIC_COUNTER, s.restarts);
+    metrics_emit(w, "ctrl.superseded", METRIC_COUNTER, s.superseded);
+    metrics_emit(w, "ctrl.overruns", METRIC_COUNTER, s.overruns);
+    metrics_emit(w, "ctrl.timeouts", METRIC_COUNTER, s.timeouts);
+    metrics_emit(w, "ctrl.deadline_miss", METRIC_COUNTER, s.deadline_miss);
+    metrics_emit(w, "ctrl.tx_busy", METRIC_COUNTER, s.tx_busy);
+    metrics_emit(w, "ctrl.tx_errors", METRIC_COUNTER, s.tx_errors);
+}
+#endif
+
+bool ctrl_chan_start(uint16_t port, CtrlChanFn fn, void* arg)
+{
+    bool ok = false;
+    bool fast = false;
+
+    if (chan.task != NULL) {
+        return false;
+    }
+    chan.fn = fn;
+    chan.arg = arg;
+#if METRICS
+    (void)metrics_register_collector(ctrl_chan_metrics);
+    (void)obj_pool_register(&ctrl_tx_pool);
+    (void)metrics_register_hist("ctrl.wake_ns", &chan.hist[CTRL_CHAN_HIST_WAKE]);
+    (void)metrics_register_hist("ctrl.latency_ns", &chan.hist[CTRL_CHAN_HIST_LATENCY]);
+    (void)metrics_register_hist("ctrl.jitter_ns", &chan.hist[CTRL_CHAN_HIST_JITTER]);
+#endif
+    /* Before any datagram can be posted to it */
+    chan.task = xTaskCreateStatic(ctrl_chan_task, "Ctrl", CTRL_CHAN_STACK_WORDS, NULL, CTRL_CHAN_PRIORITY,
+                                  ctrl_stack, &ctrl_tcb);
+    if (chan.task == NULL) {
+        LOG_ERROR(CTRL_TAG, "no task");
+        return false;
+    }
+
+    LOCK_TCPIP_CORE();
+    chan.pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if ((chan.pcb != NULL) && (udp_bind(chan.pcb, IP_ANY_TYPE, port) == ERR_OK)) {
+        chan.pcb->tos = CTRL_CHAN_TOS;
+        udp_recv(chan.pcb, ctrl_chan_recv, NULL);
+#if CTRL_CHAN_FAST
+        fast = (ethernetif_udp_fast_register(port, ctrl_chan_fast_rx, NULL) == ERR_OK);
+#endif
+        ok = true;
+    } else if (chan.pcb != NULL) {
+        udp_remove(chan.pcb);
+        chan.pcb = NULL;
+    }
+    UNLOCK_TCPIP_CORE();
+
+    if (!ok) {
+        LOG_ERROR(CTRL_TAG, "port %u not bound", (unsigned)port);
+        return false;
+    }
+    LOG_INFO(CTRL_TAG, "port %u, %s receive, deadline %u us", (unsigned)port, fast ? "fast path" : "udp",
+             (unsigned)CTRL_CHAN_DEADLINE_US);
+    return true;
+}
+
+void ctrl_chan_get_stats(CtrlChanStats_t* stats)
+{
+    *stats = chan.stats;
+}
+
+void ctrl_chan_get_hist(CtrlChanHist_t which, LatHist_t* out)
+{
+    if ((uint32_t)which < CTRL_CHAN_HIST_CNT) {
+        lat_hist_snapshot(&chan.hist[which], out);
+    }
+}
@@ -0,0 +1,191 @@
+/**
+ * @file ctrl_chan.h
+ * @brief Periodic setpoint / feedback exchange over UDP with deadline
+ *        accounting.
+ *
+ * A peer sends a setpoint datagram every CTRL_CHAN_PERIOD_US to
+ * CTRL_CHAN_PORT; each one is answered with one feedback datagram to its
+ * source. Datagrams are taken off the EthIf task by the UDP fast path
+ * (ETHIF_UDP_FAST, ethernetif.h), ahead of the tcpip mailbox that the
+ * logging, metrics and iperf traffic queue in; without it (CTRL_CHAN_FAST
+ * 0, the host build) a raw udp_recv() callback on the tcpip thread takes
+ * them. Either way they are stamped with time_now_ns() and posted to a
+ * small lock-free ring, and the control task, above the tcpip thread, is
+ * woken with a task notification. Of the setpoints queued by then only the
+ * newest is handed to the CtrlChanFn: a late cycle catches up instead of
+ * working through stale setpoints. The feedback goes out from one of
+ * CTRL_CHAN_TX_BUFS pbufs of a static pool (objpool/obj_pool.h), no heap
+ * allocation on the path; the core lock is taken only around udp_sendto(),
+ * and priority inheritance bounds the wait to the longest section another
+ * thread holds it for.
+ *
+ * Every datagram starts with CtrlChanHdr_t, in network byte order. Peer
+ * sequence numbers are checked in serial arithmetic: a gap counts as lost,
+ * an older or repeated one is dropped, a jump beyond CTRL_CHAN_SEQ_WINDOW
+ * either way starts over. The feedback echoes the setpoint's sequence
+ * number and timestamp and carries the time the setpoint spent in the
+ * controller, so the peer measures the network round trip alone.
+ * tools/ctrl_ping.py is such a peer.
+ *
+ * Measured here, in nanoseconds, as LatHist_t:
+ *   wake      hand-over to the control task running
+ *   latency   hand-over to the feedback given to the driver
+ *   jitter    |arrival interval - CTRL_CHAN_PERIOD_US| of consecutive setpoints
+ * Latency above CTRL_CHAN_DEADLINE_US, and a setpoint left without feedback,
+ * count as a deadline miss. No setpoint for CTRL_CHAN_TIMEOUT_MS calls the
+ * CtrlChanFn once without one, for the safe state, and the next setpoint
+ * starts a new stream. Exported through metrics as "ctrl.*".
+ *
+ * One peer at a time: sequence tracking assumes a single stream.
+ */
+
+#pragma once
+
+#ifndef CTRL_CHAN_H
+#define CTRL_CHAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lathist/lat_hist.h"
+
+/* 0 leaves the control channel out of the startup code */
+#ifndef CTRL_CHAN
+#define CTRL_CHAN 1
+#endif
+
+/* Receive on the EthIf task through ethernetif_udp_fast_register();
+ * 0: udp_recv() on the tcpip thread */
+#ifndef CTRL_CHAN_FAST
+#define CTRL_CHAN_FAST 1
+#endif
+
+#ifndef CTRL_CHAN_PORT
+#define CTRL_CHAN_PORT 5300U
+#endif
+
+/* Nominal setpoint period, reference of the jitter histogram */
+#ifndef CTRL_CHAN_PERIOD_US
+#define CTRL_CHAN_PERIOD_US 1000U
+#endif
+
+/* Hand-over to feedback sent */
+#ifndef CTRL_CHAN_DEADLINE_US
+#define CTRL_CHAN_DEADLINE_US 250U
+#endif
+
+/* Silence that ends a stream; one tick of resolution */
+#ifndef CTRL_CHAN_TIMEOUT_MS
+#define CTRL_CHAN_TIMEOUT_MS 5U
+#endif
+
+/* Largest datagram, header included; longer ones are dropped as bad */
+#ifndef CTRL_CHAN_MSG_MAX
+#define CTRL_CHAN_MSG_MAX 256U
+#endif
+
+/* A sequence number this far from the last one is a restarted peer: a
+ * new stream, not a loss or a stale datagram */
+#ifndef CTRL_CHAN_SEQ_WINDOW
+#define CTRL_CHAN_SEQ_WINDOW 1024U
+#endif
+
+/* Received datagrams waiting for the task, a power of two */
+#ifndef CTRL_CHAN_RX_SLOTS
+#define CTRL_CHAN_RX_SLOTS 4U
+#endif
+
+/* Feedback buffers: one held by the driver until sent, one being filled */
+#ifndef CTRL_CHAN_TX_BUFS
+#define CTRL_CHAN_TX_BUFS 2U
+#endif
+
+/* Pin the ARP entry of the peer (or of the gateway to it) with
+ * etharp_pin(), so feedback never waits on ARP resolution; the previous
+ * peer's entry expires again. Needs ETHARP_PIN_MAX. */
+#ifndef CTRL_CHAN_ARP_PIN
+#define CTRL_CHAN_ARP_PIN 1
+#endif
+
+/* DSCP EF (46), for the switches on the way */
+#ifndef CTRL_CHAN_TOS
+#define CTRL_CHAN_TOS 0xB8U
+#endif
+
+/* osPriorityHigh, see configOS2_TO_RTOS_PRIO(): above the tcpip thread,
+ * below the EthIf task */
+#ifndef CTRL_CHAN_PRIORITY
+#define CTRL_CHAN_PRIORITY 20
+#endif
+
+/* The CtrlChanFn runs on this stack */
+#ifndef CTRL_CHAN_STACK_WORDS
+#define CTRL_CHAN_STACK_WORDS 512U
+#endif
+
+#define CTRL_CHAN_MAGIC         0x4343U     /* "CC" */
+#define CTRL_CHAN_VERSION       1U
+#define CTRL_CHAN_SETPOINT      1U
+#define CTRL_CHAN_FEEDBACK      2U
+
+/* Header of every datagram, network byte order, payload follows */
+typedef struct __attribute__((packed)) {
+    uint16_t magic;         /* CTRL_CHAN_MAGIC */
+    uint8_t version;        /* CTRL_CHAN_VERSION */
+    uint8_t type;           /* CTRL_CHAN_SETPOINT or CTRL_CHAN_FEEDBACK */
+    uint32_t seq;           /* sender's, +1 per datagram */
+    uint32_t ack;           /* feedback: seq of the setpoint answered */
+    uint32_t residence_ns;  /* feedback: hand-over to send in the controller */
+    uint64_t ts;            /* setpoint: peer's send time, echoed in the feedback */
+} CtrlChanHdr_t;
+
+#define CTRL_CHAN_HDR_LEN       ((uint16_t)sizeof(CtrlChanHdr_t))
+#define CTRL_CHAN_PAYLOAD_MAX   (CTRL_CHAN_MSG_MAX - CTRL_CHAN_HDR_LEN)
+
+/* Control step on the control task: the setpoint payload in, the feedback
+ * payload (up to size bytes) out, its length returned; 0 sends nothing.
+ * setpoint is NULL (len 0) once when the stream times out. */
+typedef uint16_t (*CtrlChanFn)(const uint8_t* setpoint, uint16_t len, uint8_t* feedback, uint16_t size,
+                               void* arg);
+
+typedef struct {
+    uint32_t rx;            /* setpoints accepted */
+    uint32_t tx;            /* feedback sent */
+    uint32_t bad;           /* short, oversized, wrong magic, version or type */
+    uint32_t stale;         /* sequence number not newer: repeated or reordered */
+    uint32_t lost;          /* sequence numbers skipped */
+    uint32_t restarts;      /* sequence number jumped by CTRL_CHAN_SEQ_WINDOW or more */
+    uint32_t superseded;    /* accepted, but a newer one was queued before the step */
+    uint32_t overruns;      /* dropped on a full receive ring */
+    uint32_t timeouts;      /* streams ended by CTRL_CHAN_TIMEOUT_MS of silence */
+    uint32_t deadline_miss; /* feedback later than CTRL_CHAN_DEADLINE_US, or none */
+    uint32_t tx_busy;       /* no free feedback buffer */
+    uint32_t tx_errors;     /* udp_sendto() failed */
+} CtrlChanStats_t;
+
+typedef enum {
+    CTRL_CHAN_HIST_WAKE = 0,
+    CTRL_CHAN_HIST_LATENCY,
+    CTRL_CHAN_HIST_JITTER,
+    CTRL_CHAN_HIST_CNT
+} CtrlChanHist_t;
+
+/* Binds port and starts the control task; fn NULL echoes the setpoint
+ * payload, for latency measurements. Call once from a task, not holding
+ * the core lock, after time_ns_init() and metrics_init(). */
+bool ctrl_chan_start(uint16_t port, CtrlChanFn fn, void* arg);
+
+void ctrl_chan_get_stats(CtrlChanStats_t* stats);
+
+/* Consistent copy of one histogram, nanoseconds */
+void ctrl_chan_get_hist(CtrlChanHist_t which, LatHist_t* out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CTRL_CHAN_H */
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Control channel peer: periodic setpoints, round trip statistics.
+
+Sends CTRL_CHAN_SETPOINT datagrams to the board's control channel
+(component/ctrlchan/ctrl_chan.h) at a fixed period and matches the feedback
+by its ack field. Each datagram starts with, in network byte order,
+
+    magic:u16 'CC'  version:u8  type:u8  seq:u32  ack:u32  residence_ns:u32  ts:u64
+
+The setpoint carries the send time in ts; the feedback echoes it and adds
+the time the setpoint spent in the controller, so the report splits the
+round trip into controller residence and network (both directions, this
+host's stack included).
+
+    ctrl_ping.py 192.168.7.2 [--port 5300] [--period-us 1000] [--count 10000]
+                 [--len 32] [--deadline-us 2000]
+
+Feedback later than the deadline, or never received, is reported as missed.
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+MAGIC = 0x4343
+VERSION = 1
+SETPOINT = 1
+FEEDBACK = 2
+HEADER = struct.Struct("!HBBIIIQ")
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+def report(name, values):
+    print("%-10s p50 %8.1f  p99 %8.1f  p99.9 %8.1f  max %8.1f us" %
+          (name, percentile(values, 50) / 1e3, percentile(values, 99) / 1e3,
+           percentile(values, 99.9) / 1e3, (max(values) if values else 0) / 1e3))
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("host")
+    ap.add_argument("--port", type=int, default=5300)
+    ap.add_argument("--period-us", type=int, default=1000)
+    ap.add_argument("--count", type=int, default=10000)
+    ap.add_argument("--len", type=int, default=32, help="setpoint payload bytes")
+    ap.add_argument("--deadline-us", type=int, default=2000, help="round trip deadline")
+    args = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_TOS, 0xB8)
+    sock.connect((args.host, args.port))
+    sock.setblocking(False)
+
+    payload = bytes(range(256)) * (args.len // 256 + 1)
+    payload = payload[:args.len]
+    period = args.period_us * 1000
+    rtt, residence, network = [], [], []
+    late = bad = 0
+    seen = set()
+    start = time.monotonic_ns()
+    next_send = start
+    seq = 0
+    last_feedback_seq = None
+    fb_gaps = 0
+
+    def receive():
+        nonlocal bad, late, last_feedback_seq, fb_gaps
+        while True:
+            try:
+                data, now = sock.recv(2048), time.monotonic_ns()
+            except BlockingIOError:
+                return
+            if len(data) < HEADER.size:
+                bad += 1
+                continue
+            magic, ver, typ, fseq, ack, res, ts = HEADER.unpack_from(data)
+            if magic != MAGIC or ver != VERSION or typ != FEEDBACK or ack in seen or \
+                    data[HEADER.size:] != payload:
+                bad += 1
+                continue
+            seen.add(ack)
+            if last_feedback_seq is not None and fseq != (last_feedback_seq + 1) & 0xFFFFFFFF:
+                fb_gaps += 1
+            last_feedback_seq = fseq
+            r = now - ts
+            rtt.append(r)
+            residence.append(res)
+            network.append(r - res)
+            if r > args.deadline_us * 1000:
+                late += 1
+
+    while seq < args.count:
+        now = time.monotonic_ns()
+        if now >= next_send:
+            sock.send(HEADER.pack(MAGIC, VERSION, SETPOINT, seq, 0, 0, now) + payload)
+            seq += 1
+            next_send += period
+        receive()
+    # Stragglers
+    end = time.monotonic_ns() + 100 * 1000000
+    while time.monotonic_ns() < end:
+        receive()
+
+    answered = len(seen)
+    missed = args.count - answered + late
+    print("%d setpoints every %d us, %d answered, %d late (> %d us), %d bad, %d feedback seq gaps" %
+          (args.count, args.period_us, answered, late, args.deadline_us, bad, fb_gaps))
+    report("rtt", rtt)
+    report("residence", residence)
+    report("network", network)
+    print("missed %d (%.3f %%)" % (missed, 100.0 * missed / max(1, args.count)))
+    return 0 if missed == 0 else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,148 @@
+/**
+ * @file dhcp_client.c
+ * @brief DHCP address with the last lease kept across resets, see
+ * dhcp_client.h.
+ */
+
+#include "dhcp_client.h"
+
+#if DHCP_CLIENT
+
+#include "main.h"
+#include "lwip/dhcp.h"
+#include "lwip/prot/dhcp.h"
+#include "lwip/dns.h"
+#include "lwip/netif.h"
+#include "lwip/sys.h"
+#include "logger/syslog.h"
+
+#include <string.h>
+
+#define DHCP_CLIENT_TAG "DHCP"
+
+/* tcpip thread */
+typedef struct {
+    uint32_t start_ms;
+    bool stored;            /* the store holds a lease */
+    DhcpClientStats_t stats;
+} DhcpClient_t;
+
+static DhcpClient_t dc;
+
+static void dhcp_client_addressed(void)
+{
+    if (!dc.stats.addressed) {
+        dc.stats.addr_ms = sys_now() - dc.start_ms;
+        dc.stats.addressed = true;
+    }
+}
+
+/* Seconds left of a stored lease, 0 when it cannot be used yet */
+static uint32_t dhcp_client_left(const DhcpLease_t* l)
+{
+    uint32_t now;
+    uint32_t age;
+
+    if (l->lease_s == DHCP_CLIENT_LEASE_INFINITE) {
+        return DHCP_CLIENT_LEASE_INFINITE;
+    }
+    if (l->bound_s == 0U || !dhcp_lease_clock(&now) || now < l->bound_s) {
+        return 0U;
+    }
+    age = now - l->bound_s;
+    if (age >= l->lease_s || l->lease_s - age < DHCP_CLIENT_REUSE_MIN_S) {
+        return 0U;
+    }
+    return l->lease_s - age;
+}
+
+err_t dhcp_client_start(struct netif* netif)
+{
+    DhcpLease_t l;
+    uint32_t left;
+
+    dc.start_ms = sys_now();
+    if (!dhcp_lease_load(&l)) {
+        netif_set_addr(netif, IP4_ADDR_ANY4, IP4_ADDR_ANY4, IP4_ADDR_ANY4);
+        return dhcp_start(netif);
+    }
+    dc.stored = true;
+    dc.stats.reboots++;
+    left = dhcp_client_left(&l);
+    if (left == 0U) {
+        netif_set_addr(netif, IP4_ADDR_ANY4, IP4_ADDR_ANY4, IP4_ADDR_ANY4);
+        return dhcp_start_reboot(netif, &l.addr, 0U);
+    }
+
+    /* In use before the server confirmed it, as a static address would be */
+    netif_set_addr(netif, &l.addr, &l.mask, &l.gw);
+#if LWIP_DNS
+    if (!ip4_addr_isany_val(l.dns)) {
+        ip_addr_t dns;
+
+        ip_addr_copy_from_ip4(dns, l.dns);
+        dns_setserver(0, &dns);
+    }
+#endif
+    dc.stats.reused++;
+    dhcp_client_addressed();
+    return dhcp_start_reboot(netif, &l.addr, (left == DHCP_CLIENT_LEASE_INFINITE) ? 0U : left);
+}
+
+void dhcp_client_lease(struct netif* netif, const struct dhcp* dhcp)
+{
+    DhcpLease_t l;
+    bool first = dc.stats.binds == 0U;
+
+    if (dhcp->state != DHCP_STATE_BOUND) {
+        dc.stats.naks++;
+        dc.stats.bound = false;
+        if (dc.stored) {
+            dhcp_lease_save(NULL);
+            dc.stored = false;
+        }
+        LOG_WARNING(DHCP_CLIENT_TAG, "lease refused, discovering");
+        return;
+    }
+
+    memset(&l, 0, sizeof(l));
+    ip4_addr_copy(l.addr, *netif_ip4_addr(netif));
+    ip4_addr_copy(l.mask, *netif_ip4_netmask(netif));
+    ip4_addr_copy(l.gw, *netif_ip4_gw(netif));
+#if LWIP_DNS
+    {
+        const ip_addr_t* dns = dns_getserver(0);
+
+        if (IP_IS_V4(dns)) {
+            ip4_addr_copy(l.dns, *ip_2_ip4(dns));
+        }
+    }
+#endif
+    l.lease_s = dhcp->offered_t0_lease;
+    if (!dhcp_lease_clock(&l.bound_s)) {
+        l.bound_s = 0U;
+    }
+    dhcp_lease_save(&l);
+    dc.stored = true;
+
+    dc.stats.binds++;
+    dc.stats.bound = true;
+    dhcp_client_addressed();
+    if (first) {
+        char addr[IP4ADDR_STRLEN_MAX];
+        char server[IP4ADDR_STRLEN_MAX];
+
+        dc.stats.bind_ms = sys_now() - dc.start_ms;
+        LOG_INFO(DHCP_CLIENT_TAG, "%s lease %lu s from %s, bound after %lu ms, address after %lu ms",
+                 ip4addr_ntoa_r(&l.addr, addr, sizeof(addr)), (unsigned long)l.lease_s,
+                 ip4addr_ntoa_r(ip_2_ip4(&dhcp->server_ip_addr), server, sizeof(server)),
+                 (unsigned long)dc.stats.bind_ms, (unsigned long)dc.stats.addr_ms);
+    }
+}
+
+void dhcp_client_get_stats(DhcpClientStats_t* stats)
+{
+    *stats = dc.stats;
+}
+
+#endif /* DHCP_CLIENT */
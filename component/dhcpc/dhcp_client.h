@@ -0,0 +1,109 @@
+/**
+ * @file dhcp_client.h
+ * @brief DHCP address with the last lease kept across resets.
+ *
+ * dhcp_client_start() takes over from the static address of
+ * MX_LWIP_Init(). What it does depends on the lease stored by the previous
+ * boot (dhcp_lease_load()):
+ *  - a lease with at least DHCP_CLIENT_REUSE_MIN_S left by the stored
+ *    clock: the netif takes its address, mask, gateway and DNS server right
+ *    away, as with a static configuration, and DHCP confirms them in
+ *    INIT-REBOOT, one REQUEST/ACK once the link is up. A NAK takes the
+ *    address away and starts discovery; with no server answering, the
+ *    address stays until the lease runs out (RFC 2131 3.7).
+ *  - a lease of unknown age (no clock) or run out: INIT-REBOOT as well,
+ *    the address in use only once acknowledged.
+ *  - no lease: DISCOVER with Rapid Commit (LWIP_DHCP_RAPID_COMMIT), a
+ *    single exchange with servers that support it.
+ * Every bind and renewal stores the lease (LWIP_HOOK_DHCP_LEASE in
+ * lwipopts.h); a NAK clears it.
+ *
+ * The store: dhcp_lease_bkp.c keeps the lease in RTC backup registers,
+ * dated by the RTC (timesync_rtc_seconds()), which the backup domain keeps
+ * across resets; the host build keeps it in a file.
+ */
+
+#pragma once
+
+#ifndef DHCP_CLIENT_H
+#define DHCP_CLIENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lwip/opt.h"
+#include "lwip/ip4_addr.h"
+#include "lwip/err.h"
+
+/* 0 keeps the static address of MX_LWIP_Init() */
+#ifndef DHCP_CLIENT
+#define DHCP_CLIENT (LWIP_DHCP && LWIP_DHCP_INIT_REBOOT)
+#endif
+
+/* A stored lease with less left is only used once acknowledged */
+#ifndef DHCP_CLIENT_REUSE_MIN_S
+#define DHCP_CLIENT_REUSE_MIN_S 60U
+#endif
+
+/* RTC backup registers: DHCP_CLIENT_BKUP_REG and the next
+ * DHCP_CLIENT_BKUP_WORDS - 1; 0 to 3 are timesync's, the clock profile's
+ * and the PHY mode's */
+#ifndef DHCP_CLIENT_BKUP_REG
+#define DHCP_CLIENT_BKUP_REG 4U
+#endif
+#define DHCP_CLIENT_BKUP_WORDS 7U
+#define DHCP_CLIENT_BKUP_MAGIC 0x44480000UL /* "DH" */
+
+/* lease_s of a lease that does not run out */
+#define DHCP_CLIENT_LEASE_INFINITE 0xFFFFFFFFUL
+
+typedef struct {
+    ip4_addr_t addr;
+    ip4_addr_t mask;
+    ip4_addr_t gw;
+    ip4_addr_t dns;         /* first DNS server, any if none */
+    uint32_t lease_s;       /* from the last ACK */
+    uint32_t bound_s;       /* dhcp_lease_clock() at that ACK, 0 if none */
+} DhcpLease_t;
+
+typedef struct {
+    uint32_t binds;         /* ACKs taken, renewals included */
+    uint32_t naks;          /* leases taken away */
+    uint32_t reused;        /* boots on the stored address */
+    uint32_t reboots;       /* boots in INIT-REBOOT, reused ones included */
+    uint32_t addr_ms;       /* start to the first usable address */
+    uint32_t bind_ms;       /* start to the first ACK, once binds != 0 */
+    bool addressed;         /* addr_ms valid */
+    bool bound;             /* lease held now */
+} DhcpClientStats_t;
+
+#if DHCP_CLIENT
+struct netif;
+struct dhcp;
+
+/* Instead of the static address; netif added and up, core lock held */
+err_t dhcp_client_start(struct netif* netif);
+
+/* LWIP_HOOK_DHCP_LEASE, tcpip thread */
+void dhcp_client_lease(struct netif* netif, const struct dhcp* dhcp);
+
+void dhcp_client_get_stats(DhcpClientStats_t* stats);
+
+/* The store, one implementation per platform. False when there is no
+ * valid lease; NULL clears it. */
+bool dhcp_lease_load(DhcpLease_t* lease);
+void dhcp_lease_save(const DhcpLease_t* lease);
+/* Seconds on a clock that keeps running across resets; false if there
+ * is none (yet) */
+bool dhcp_lease_clock(uint32_t* sec);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DHCP_CLIENT_H */
@@ -0,0 +1,82 @@
+/**
+ * @file dhcp_lease_bkp.c
+ * @brief DHCP lease store in RTC backup registers, see dhcp_client.h.
+ *
+ * DHCP_CLIENT_BKUP_WORDS registers from DHCP_CLIENT_BKUP_REG: the lease
+ * words, then DHCP_CLIENT_BKUP_MAGIC with a 16-bit check of them. The
+ * check is written last and cleared first, so a reset halfway through a
+ * save leaves no lease rather than a mixed one.
+ */
+
+#include "dhcp_client.h"
+
+#if DHCP_CLIENT
+
+#include "main.h"
+#include "timesync/timesync.h"
+
+#define DHCP_LEASE_WORDS (DHCP_CLIENT_BKUP_WORDS - 1U)
+
+extern RTC_HandleTypeDef hrtc;
+
+static uint32_t dhcp_lease_check(const uint32_t* w)
+{
+    uint32_t h = 0x811C9DC5UL;
+
+    for (uint32_t i = 0U; i < DHCP_LEASE_WORDS; i++) {
+        h = (h ^ w[i]) * 16777619UL;
+    }
+    return DHCP_CLIENT_BKUP_MAGIC | ((h ^ (h >> 16)) & 0xFFFFU);
+}
+
+bool dhcp_lease_load(DhcpLease_t* lease)
+{
+    uint32_t w[DHCP_LEASE_WORDS];
+
+    for (uint32_t i = 0U; i < DHCP_LEASE_WORDS; i++) {
+        w[i] = (&RTC->BKP0R)[DHCP_CLIENT_BKUP_REG + i];
+    }
+    if ((&RTC->BKP0R)[DHCP_CLIENT_BKUP_REG + DHCP_LEASE_WORDS] != dhcp_lease_check(w)) {
+        return false;
+    }
+    ip4_addr_set_u32(&lease->addr, w[0]);
+    ip4_addr_set_u32(&lease->mask, w[1]);
+    ip4_addr_set_u32(&lease->gw, w[2]);
+    ip4_addr_set_u32(&lease->dns, w[3]);
+    lease->lease_s = w[4];
+    lease->bound_s = w[5];
+    return !ip4_addr_isany_val(lease->addr);
+}
+
+void dhcp_lease_save(const DhcpLease_t* lease)
+{
+    uint32_t w[DHCP_LEASE_WORDS];
+
+    HAL_PWR_EnableBkUpAccess();
+    HAL_RTCEx_BKUPWrite(&hrtc, DHCP_CLIENT_BKUP_REG + DHCP_LEASE_WORDS, 0U);
+    if (lease == NULL) {
+        return;
+    }
+    w[0] = ip4_addr_get_u32(&lease->addr);
+    w[1] = ip4_addr_get_u32(&lease->mask);
+    w[2] = ip4_addr_get_u32(&lease->gw);
+    w[3] = ip4_addr_get_u32(&lease->dns);
+    w[4] = lease->lease_s;
+    w[5] = lease->bound_s;
+    for (uint32_t i = 0U; i < DHCP_LEASE_WORDS; i++) {
+        HAL_RTCEx_BKUPWrite(&hrtc, DHCP_CLIENT_BKUP_REG + i, w[i]);
+    }
+    HAL_RTCEx_BKUPWrite(&hrtc, DHCP_CLIENT_BKUP_REG + DHCP_LEASE_WORDS, dhcp_lease_check(w));
+}
+
+bool dhcp_lease_clock(uint32_t* sec)
+{
+#if TIMESYNC_RTC
+    return timesync_rtc_seconds(sec);
+#else
+    (void)sec;
+    return false;
+#endif
+}
+
+#endif /* DHCP_CLIENT */
@@ -0,0 +1,366 @@
+/**
+ * @file heap_trace.c
+ * @brief Allocation call-site tables and their UDP dump, see heap_trace.h.
+ */
+
+#include "heap_trace.h"
+
+#if HEAP_TRACE
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "lwip/udp.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcpip.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define TRACE_TAG           "HEAPTRACE"
+#define TRACE_HEAPS         2U
+#define TRACE_MAGIC_INFO    0x49525448U     /* "HTRI" */
+#define TRACE_MAGIC_SITES   0x53525448U     /* "HTRS" */
+#define TRACE_SITE_LEN      24U
+/* Sites per "HTRS" datagram, within one Ethernet frame */
+#define TRACE_DGRAM_SITES   56U
+
+#if (HEAP_TRACE_LIVE & (HEAP_TRACE_LIVE - 1U)) != 0U || (HEAP_TRACE_SITES & (HEAP_TRACE_SITES - 1U)) != 0U
+#error "HEAP_TRACE_LIVE and HEAP_TRACE_SITES must be powers of two"
+#endif
+
+#if HEAP_TRACE_SITES > 65536U
+#error "HEAP_TRACE_SITES above the 16-bit site index"
+#endif
+
+typedef struct {
+    const void* ptr;        /* NULL: free slot */
+    uint32_t size;
+    uint16_t site;
+    uint8_t heap;
+} TraceLive_t;
+
+typedef struct {
+    const void* site;       /* NULL with used set: the sites beyond the table */
+    uint32_t heap;
+    uint32_t live_bytes;
+    uint32_t live_count;
+    uint32_t peak_bytes;    /* live bytes at the peak of its heap */
+    uint32_t allocs;
+    bool used;
+} TraceSite_t;
+
+typedef struct {
+    uint32_t live_bytes;
+    uint32_t peak_bytes;
+    uint32_t live_count;
+    uint32_t untracked;
+} TraceHeap_t;
+
+/* All changed with interrupts masked */
+static TraceLive_t trace_live[HEAP_TRACE_LIVE];
+static TraceSite_t trace_sites[HEAP_TRACE_SITES];
+static uint32_t trace_site_count;
+static TraceHeap_t trace_heaps[TRACE_HEAPS];
+static uint32_t trace_unknown_frees;
+
+/* Dump copy, tcpip thread */
+static TraceSite_t trace_snap[HEAP_TRACE_SITES];
+static TraceHeap_t trace_snap_heaps[TRACE_HEAPS];
+static struct udp_pcb* trace_pcb;
+
+static inline uint32_t trace_hash(const void* p)
+{
+    return (((uint32_t)(uintptr_t)p >> 2) * 0x9E3779B1U) >> 16;
+}
+
+/* Entry of p, or the free slot where it would go */
+static uint32_t trace_live_slot(const void* p)
+{
+    uint32_t i = trace_hash(p) & (HEAP_TRACE_LIVE - 1U);
+
+    while (trace_live[i].ptr != NULL && trace_live[i].ptr != p) {
+        i = (i + 1U) & (HEAP_TRACE_LIVE - 1U);
+    }
+    return i;
+}
+
+/* Linear probing without tombstones: the entries after the hole that
+ * probed past it move back into it */
+static void trace_live_remove(uint32_t i)
+{
+    uint32_t j = i;
+
+    for (;;) {
+        uint32_t k;
+
+        j = (j + 1U) & (HEAP_TRACE_LIVE - 1U);
+        if (trace_live[j].ptr == NULL) {
+            break;
+        }
+        k = trace_hash(trace_live[j].ptr) & (HEAP_TRACE_LIVE - 1U);
+        /* Stays when its home k lies cyclically in (i, j] */
+        if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) {
+            continue;
+        }
+        trace_live[i] = trace_live[j];
+        i = j;
+    }
+    trace_live[i].ptr = NULL;
+}
+
+/* Index of (site, heap), created on first use; the last two free entries
+ * are kept for the overflow sites of the two heaps */
+static uint32_t trace_site_index(const void* site, uint32_t heap)
+{
+    uint32_t i;
+
+    if (trace_site_count >= HEAP_TRACE_SITES - TRACE_HEAPS) {
+        site = NULL;
+    }
+    i = trace_hash(site) & (HEAP_TRACE_SITES - 1U);
+    while (trace_sites[i].used && (trace_sites[i].site != site || trace_sites[i].heap != heap)) {
+        i = (i + 1U) & (HEAP_TRACE_SITES - 1U);
+    }
+    if (!trace_sites[i].used) {
+        trace_sites[i].used = true;
+        trace_sites[i].site = site;
+        trace_sites[i].heap = heap;
+        trace_site_count++;
+    }
+    return i;
+}
+
+/* A new peak: every site's live bytes are its share of it */
+static void trace_peak_check(uint32_t heap)
+{
+    TraceHeap_t* h = &trace_heaps[heap];
+
+    if (h->live_bytes <= h->peak_bytes) {
+        return;
+    }
+    h->peak_bytes = h->live_bytes;
+    for (uint32_t i = 0U; i < HEAP_TRACE_SITES; i++) {
+        if (trace_sites[i].used && trace_sites[i].heap == heap) {
+            trace_sites[i].peak_bytes = trace_sites[i].live_bytes;
+        }
+    }
+}
+
+void heap_trace_alloc(uint32_t heap, const void* p, size_t size, const void* site)
+{
+    uint32_t mask;
+    uint32_t i;
+    uint32_t s;
+
+    if (p == NULL || heap >= TRACE_HEAPS) {
+        return;
+    }
+    mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    i = trace_live_slot(p);
+    /* Freed where it was not seen: the old entry is stale */
+    if (trace_live[i].ptr != NULL) {
+        TraceSite_t* old = &trace_sites[trace_live[i].site];
+
+        old->live_bytes -= trace_live[i].size;
+        old->live_count--;
+        trace_heaps[trace_live[i].heap].live_bytes -= trace_live[i].size;
+        trace_heaps[trace_live[i].heap].live_count--;
+        trace_unknown_frees++;
+    }
+    /* Keep one slot free so that probes end */
+    if (trace_live[i].ptr == NULL && trace_heaps[0].live_count + trace_heaps[1].live_count >= HEAP_TRACE_LIVE - 1U) {
+        trace_heaps[heap].untracked++;
+        portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+        return;
+    }
+    s = trace_site_index(site, heap);
+    trace_live[i].ptr = p;
+    trace_live[i].size = (uint32_t)size;
+    trace_live[i].site = (uint16_t)s;
+    trace_live[i].heap = (uint8_t)heap;
+    trace_sites[s].live_bytes += (uint32_t)size;
+    trace_sites[s].live_count++;
+    trace_sites[s].allocs++;
+    trace_heaps[heap].live_bytes += (uint32_t)size;
+    trace_heaps[heap].live_count++;
+    trace_peak_check(heap);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+void heap_trace_free(uint32_t heap, const void* p)
+{
+    uint32_t mask;
+    uint32_t i;
+
+    if (p == NULL) {
+        return;
+    }
+    mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    i = trace_live_slot(p);
+    if (trace_live[i].ptr == NULL || trace_live[i].heap != heap) {
+        trace_unknown_frees++;
+    } else {
+        TraceSite_t* s = &trace_sites[trace_live[i].site];
+
+        s->live_bytes -= trace_live[i].size;
+        s->live_count--;
+        trace_heaps[heap].live_bytes -= trace_live[i].size;
+        trace_heaps[heap].live_count--;
+        trace_live_remove(i);
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+void heap_trace_resize(uint32_t heap, const void* p, size_t size)
+{
+    uint32_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint32_t i = trace_live_slot(p);
+
+    if (p != NULL && trace_live[i].ptr != NULL && trace_live[i].heap == heap) {
+        TraceSite_t* s = &trace_sites[trace_live[i].site];
+
+        s->live_bytes = s->live_bytes - trace_live[i].size + (uint32_t)size;
+        trace_heaps[heap].live_bytes = trace_heaps[heap].live_bytes - trace_live[i].size + (uint32_t)size;
+        trace_live[i].size = (uint32_t)size;
+        trace_peak_check(heap);
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+void heap_trace_retag(uint32_t heap, const void* p, const void* site)
+{
+    uint32_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint32_t i = trace_live_slot(p);
+
+    if (p != NULL && trace_live[i].ptr != NULL && trace_live[i].heap == heap) {
+        TraceSite_t* from = &trace_sites[trace_live[i].site];
+        uint32_t s = trace_site_index(site, heap);
+        TraceSite_t* to = &trace_sites[s];
+
+        from->live_bytes -= trace_live[i].size;
+        from->live_count--;
+        from->allocs--;
+        to->live_bytes += trace_live[i].size;
+        to->live_count++;
+        to->allocs++;
+        trace_live[i].site = (uint16_t)s;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+static void trace_put32(uint8_t* dst, uint32_t v)
+{
+    memcpy(dst, &v, sizeof(v));
+}
+
+/* Copies the used sites; the tables stay masked for a few microseconds */
+static uint32_t trace_snapshot(bool restart_peak, uint32_t* unknown_frees)
+{
+    uint32_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    uint32_t n = 0U;
+
+    for (uint32_t h = 0U; h < TRACE_HEAPS && restart_peak; h++) {
+        trace_heaps[h].peak_bytes = trace_heaps[h].live_bytes;
+    }
+    for (uint32_t i = 0U; i < HEAP_TRACE_SITES; i++) {
+        if (!trace_sites[i].used) {
+            continue;
+        }
+        if (restart_peak) {
+            trace_sites[i].peak_bytes = trace_sites[i].live_bytes;
+        }
+        trace_snap[n++] = trace_sites[i];
+    }
+    memcpy(trace_snap_heaps, trace_heaps, sizeof(trace_snap_heaps));
+    *unknown_frees = trace_unknown_frees;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+    return n;
+}
+
+static void trace_send_dump(const ip_addr_t* addr, u16_t port)
+{
+    uint32_t unknown_frees;
+    uint32_t n = trace_snapshot(false, &unknown_frees);
+    struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)(12U + TRACE_HEAPS * 16U), PBUF_RAM);
+    uint8_t* b;
+
+    if (p == NULL) {
+        return;
+    }
+    b = p->payload;
+    trace_put32(&b[0], TRACE_MAGIC_INFO);
+    trace_put32(&b[4], n);
+    trace_put32(&b[8], unknown_frees);
+    b += 12;
+    for (uint32_t h = 0U; h < TRACE_HEAPS; h++) {
+        trace_put32(&b[0], trace_snap_heaps[h].live_bytes);
+        trace_put32(&b[4], trace_snap_heaps[h].peak_bytes);
+        trace_put32(&b[8], trace_snap_heaps[h].live_count);
+        trace_put32(&b[12], trace_snap_heaps[h].untracked);
+        b += 16;
+    }
+    (void)udp_sendto(trace_pcb, p, addr, port);
+    pbuf_free(p);
+
+    for (uint32_t first = 0U; first < n; first += TRACE_DGRAM_SITES) {
+        uint32_t count = LWIP_MIN(n - first, TRACE_DGRAM_SITES);
+
+        p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)(8U + count * TRACE_SITE_LEN), PBUF_RAM);
+        if (p == NULL) {
+            return;
+        }
+        b = p->payload;
+        trace_put32(&b[0], TRACE_MAGIC_SITES);
+        trace_put32(&b[4], first);
+        b += 8;
+        for (uint32_t i = first; i < first + count; i++) {
+            const TraceSite_t* s = &trace_snap[i];
+
+            trace_put32(&b[0], (uint32_t)(uintptr_t)s->site);
+            trace_put32(&b[4], s->heap);
+            trace_put32(&b[8], s->live_bytes);
+            trace_put32(&b[12], s->live_count);
+            trace_put32(&b[16], s->peak_bytes);
+            trace_put32(&b[20], s->allocs);
+            b += TRACE_SITE_LEN;
+        }
+        (void)udp_sendto(trace_pcb, p, addr, port);
+        pbuf_free(p);
+    }
+}
+
+static void trace_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    char cmd[8] = { 0 };
+
+    (void)arg;
+    (void)pcb;
+    (void)pbuf_copy_partial(p, cmd, sizeof(cmd) - 1U, 0);
+    pbuf_free(p);
+    if (strncmp(cmd, "dump", 4) == 0) {
+        trace_send_dump(addr, port);
+    } else if (strncmp(cmd, "peak", 4) == 0) {
+        uint32_t unknown_frees;
+
+        (void)trace_snapshot(true, &unknown_frees);
+        LOG_INFO(TRACE_TAG, "peaks restarted by %s", ipaddr_ntoa(addr));
+    }
+}
+
+void heap_trace_init(void)
+{
+    LOCK_TCPIP_CORE();
+    trace_pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if (trace_pcb != NULL && udp_bind(trace_pcb, IP_ANY_TYPE, HEAP_TRACE_UDP_PORT) == ERR_OK) {
+        udp_recv(trace_pcb, trace_recv, NULL);
+    } else {
+        if (trace_pcb != NULL) {
+            udp_remove(trace_pcb);
+            trace_pcb = NULL;
+        }
+        LOG_ERROR(TRACE_TAG, "no dump port %u", (unsigned)HEAP_TRACE_UDP_PORT);
+    }
+    UNLOCK_TCPIP_CORE();
+}
+
+#endif /* HEAP_TRACE */
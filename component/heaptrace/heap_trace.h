@@ -0,0 +1,97 @@
+/**
+ * @file heap_trace.h
+ * @brief Live bytes per allocation call site of the lwIP and FreeRTOS heaps.
+ *
+ * With HEAP_TRACE set, mem_malloc(), mem_calloc() and mem_trim() (mem.c)
+ * and pvPortMalloc() / pvPortMallocRegion() (heap_tlsf.c or heap_4.c)
+ * record every allocation in a live table keyed by the pointer: its size
+ * as requested and its call site, the return address of the allocating
+ * call. The frees look it up and take it off again. Per call site and
+ * heap there are the live bytes and allocations, the allocations since
+ * boot, and the live bytes at the peak of its heap: whenever a heap
+ * reaches a new peak of live bytes, every site's figure is copied, so the
+ * peak column adds up to the peak and shows who held the heap when it was
+ * fullest. pbuf_alloc(PBUF_RAM) moves its allocation on to its own
+ * caller, otherwise all of PBUF_RAM would be one site. FreeRTOS objects
+ * show the kernel function that created them (xTaskCreate,
+ * xQueueGenericCreate, ...).
+ *
+ * Readout over UDP: a datagram "dump" to HEAP_TRACE_UDP_PORT is answered
+ * with
+ *     "HTRI" u32 sites, u32 unknown frees, then per heap (lwIP, FreeRTOS)
+ *            u32 live bytes, u32 peak bytes, u32 live allocations,
+ *            u32 untracked allocations (live table full)
+ *     "HTRS" u32 index of the first site, then sites of
+ *            u32 call site, u32 heap, u32 live bytes, u32 live count,
+ *            u32 bytes at the peak, u32 allocations
+ * little endian, as many "HTRS" datagrams as needed. "peak" restarts the
+ * peaks from the current live bytes. tools/heap_sites.py asks for the
+ * dump and names the call sites from the ELF.
+ *
+ * The tables are updated with interrupts masked up to the syscall
+ * priority, a hash probe each; sized by HEAP_TRACE_LIVE and
+ * HEAP_TRACE_SITES (about 12 and 24 bytes per entry). Off by default: a
+ * tool for sizing MEM_SIZE and configTOTAL_HEAP_SIZE, not for production.
+ */
+
+#pragma once
+
+#ifndef HEAP_TRACE_H
+#define HEAP_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef HEAP_TRACE
+#define HEAP_TRACE 0
+#endif
+
+/* Live allocations tracked at once, a power of two; further ones are
+ * counted as untracked */
+#ifndef HEAP_TRACE_LIVE
+#define HEAP_TRACE_LIVE 1024U
+#endif
+
+/* Call sites, a power of two; further sites share one entry (site 0) */
+#ifndef HEAP_TRACE_SITES
+#define HEAP_TRACE_SITES 128U
+#endif
+
+#ifndef HEAP_TRACE_UDP_PORT
+#define HEAP_TRACE_UDP_PORT 5005U
+#endif
+
+#define HEAP_TRACE_LWIP 0U
+#define HEAP_TRACE_RTOS 1U
+
+/* Return address of the function it is used in */
+#define HEAP_TRACE_CALLER() __builtin_return_address(0)
+
+#if HEAP_TRACE
+
+/* Allocation of size bytes at p (NULL: failed, not recorded) by site */
+void heap_trace_alloc(uint32_t heap, const void* p, size_t size, const void* site);
+
+/* Before p goes back to the heap */
+void heap_trace_free(uint32_t heap, const void* p);
+
+/* p now holds size bytes */
+void heap_trace_resize(uint32_t heap, const void* p, size_t size);
+
+/* Moves p to another call site */
+void heap_trace_retag(uint32_t heap, const void* p, const void* site);
+
+/* Binds the dump port. Call once from a task after lwIP is up. */
+void heap_trace_init(void);
+
+#endif /* HEAP_TRACE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEAP_TRACE_H */
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""Live and peak heap bytes per allocation call site, named from the ELF.
+
+Asks the heap tracer (component/heaptrace/heap_trace.h, HEAP_TRACE 1) on
+HEAP_TRACE_UDP_PORT for its tables and prints one line per call site and
+heap, largest share of the peak first:
+
+    heap  peak  live  count  allocs  site
+
+The site is the function that called mem_malloc() / pvPortMalloc() (or
+pbuf_alloc() for PBUF_RAM) and the offset of the return address in it.
+The answer is
+
+    "HTRI" sites:u32 unknown_frees:u32, then per heap (lwIP, FreeRTOS)
+           live:u32 peak:u32 count:u32 untracked:u32
+    "HTRS" first:u32, then sites of
+           site:u32 heap:u32 live:u32 count:u32 peak:u32 allocs:u32
+
+all little endian.
+
+    heap_sites.py Debug/STM32_eth.elf 192.168.7.2 [--port 5005] [--heap lwip|rtos]
+                  [--top 30] [--restart-peak]
+
+--restart-peak sends "peak" afterwards, so the next dump shows the peak of
+the workload run in between. Requires pyelftools.
+"""
+
+import argparse
+import bisect
+import socket
+import struct
+import sys
+import time
+
+from elftools.elf.elffile import ELFFile
+
+INFO_MAGIC = b"HTRI"
+SITES_MAGIC = b"HTRS"
+INFO_HEADER = struct.Struct("<4sII")
+HEAP_INFO = struct.Struct("<IIII")
+SITES_HEADER = struct.Struct("<4sI")
+SITE = struct.Struct("<IIIIII")
+HEAPS = ("lwip", "rtos")
+TIMEOUT_S = 2.0
+
+
+class Symbols:
+    """Function symbols of the ELF, looked up by address."""
+
+    def __init__(self, path):
+        funcs = []
+        with open(path, "rb") as f:
+            elf = ELFFile(f)
+            symtab = elf.get_section_by_name(".symtab")
+            if symtab is None:
+                sys.exit("%s: no symbol table" % path)
+            for sym in symtab.iter_symbols():
+                if sym["st_info"]["type"] == "STT_FUNC" and sym["st_value"] != 0:
+                    # Thumb functions have bit 0 set
+                    funcs.append((sym["st_value"] & ~1, sym["st_size"], sym.name))
+        funcs.sort()
+        self.starts = [f[0] for f in funcs]
+        self.funcs = funcs
+
+    def site(self, addr):
+        if addr == 0:
+            return "(other sites)"
+        addr &= ~1
+        i = bisect.bisect_right(self.starts, addr) - 1
+        if i >= 0:
+            start, size, name = self.funcs[i]
+            if addr < start + max(size, 2):
+                return "%s+0x%x" % (name, addr - start)
+        return "0x%08x" % addr
+
+
+def dump(host, port):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(TIMEOUT_S)
+    sock.sendto(b"dump", (host, port))
+    info = None
+    sites = {}
+    deadline = time.monotonic() + TIMEOUT_S
+    while info is None or len(sites) < info[0]:
+        if time.monotonic() > deadline:
+            break
+        try:
+            data, _ = sock.recvfrom(2048)
+        except socket.timeout:
+            break
+        if data[:4] == INFO_MAGIC:
+            _, n, unknown = INFO_HEADER.unpack_from(data)
+            heaps = [HEAP_INFO.unpack_from(data, INFO_HEADER.size + i * HEAP_INFO.size) for i in range(len(HEAPS))]
+            info = (n, unknown, heaps)
+        elif data[:4] == SITES_MAGIC:
+            _, first = SITES_HEADER.unpack_from(data)
+            count = (len(data) - SITES_HEADER.size) // SITE.size
+            for i in range(count):
+                sites[first + i] = SITE.unpack_from(data, SITES_HEADER.size + i * SITE.size)
+    sock.close()
+    if info is None:
+        sys.exit("no answer from %s:%d (HEAP_TRACE off?)" % (host, port))
+    if len(sites) < info[0]:
+        print("warning: %d of %d sites received" % (len(sites), info[0]), file=sys.stderr)
+    return info, list(sites.values())
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    ap.add_argument("elf")
+    ap.add_argument("host")
+    ap.add_argument("--port", type=int, default=5005)
+    ap.add_argument("--heap", choices=HEAPS)
+    ap.add_argument("--top", type=int, default=30)
+    ap.add_argument("--restart-peak", action="store_true")
+    args = ap.parse_args()
+
+    symbols = Symbols(args.elf)
+    (n, unknown, heaps), sites = dump(args.host, args.port)
+
+    for name, (live, peak, count, untracked) in zip(HEAPS, heaps):
+        if args.heap in (None, name):
+            print("%-4s live %7d B in %5d  peak %7d B  untracked %d" % (name, live, count, peak, untracked))
+    if unknown:
+        print("frees of untracked allocations: %d" % unknown)
+    print()
+    print("%-4s %8s %8s %6s %8s  %s" % ("heap", "peak", "live", "count", "allocs", "site"))
+    rows = [s for s in sites if args.heap in (None, HEAPS[s[1]])]
+    rows.sort(key=lambda s: (s[4], s[2]), reverse=True)
+    for site, heap, live, count, peak, allocs in rows[:args.top]:
+        print("%-4s %8d %8d %6d %8d  %s" % (HEAPS[heap], peak, live, count, allocs, symbols.site(site)))
+
+    if args.restart_peak:
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.sendto(b"peak", (args.host, args.port))
+        sock.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,102 @@
+/**
+ * @file diag_assets.c
+ * @brief Generated by tools/mkassets.py from www/, do not edit.
+ */
+
+#include "diag_httpd.h"
+
+#if DIAG_HTTPD
+
+/* /index.html: 3045 bytes, 1267 gzipped */
+static const char diag_asset_index_html_header[] DIAG_HTTPD_ASSET_SECTION =
+    "HTTP/1.0 200 OK\r\nContent-Type: text/html; charset=utf-8\r\nContent-Encoding: gzip\r\nContent-Length: 1267\r\nCache-Control: max-age=300\r\nConnection: close\r\n\r\n";
+static const uint8_t diag_asset_index_html_body[] DIAG_HTTPD_ASSET_SECTION = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xa5, 0x56, 0x6d, 0x6f, 0xdb, 0x36,
+    0x10, 0xfe, 0xae, 0x5f, 0x71, 0x65, 0xbe, 0xc8, 0x98, 0x25, 0xc7, 0x69, 0x91, 0x0d, 0x96, 0x9d,
+    0x01, 0x73, 0x03, 0xac, 0x40, 0xbb, 0x14, 0x6d, 0xbe, 0x0c, 0x41, 0x60, 0xc8, 0x12, 0x25, 0xb1,
+    0xa1, 0x48, 0x8d, 0xa4, 0xe2, 0x78, 0xad, 0xff, 0xfb, 0x8e, 0x14, 0x25, 0xe7, 0xcd, 0x49, 0x81,
+    0x25, 0x80, 0x7c, 0x3a, 0xdd, 0xcb, 0x73, 0xc7, 0xe7, 0x48, 0xce, 0xdf, 0xbc, 0xbf, 0x58, 0x5e,
+    0xfe, 0xfd, 0xf9, 0x1c, 0x2a, 0x53, 0xf3, 0xb3, 0x60, 0x6e, 0x7f, 0x80, 0xa7, 0xa2, 0x5c, 0x10,
+    0x2a, 0x88, 0x55, 0xd0, 0x34, 0xc7, 0x9f, 0x9a, 0x9a, 0x14, 0xb2, 0x2a, 0x55, 0x9a, 0x9a, 0x05,
+    0x69, 0x4d, 0x11, 0xfd, 0x46, 0x7a, 0xb5, 0x48, 0x6b, 0xba, 0x20, 0xb7, 0x8c, 0x6e, 0x1a, 0xa9,
+    0x0c, 0x81, 0x4c, 0x0a, 0x43, 0x05, 0x9a, 0x6d, 0x58, 0x6e, 0xaa, 0x45, 0x4e, 0x6f, 0x59, 0x46,
+    0x23, 0xf7, 0x32, 0x06, 0x26, 0x98, 0x61, 0x29, 0x8f, 0x74, 0x96, 0x72, 0xba, 0x98, 0xda, 0x20,
+    0x86, 0x19, 0x4e, 0xcf, 0xfe, 0xfc, 0xf5, 0xdd, 0x5b, 0xc8, 0x59, 0x5a, 0x0a, 0xa9, 0x0d, 0xcb,
+    0xf4, 0x7c, 0xd2, 0xe9, 0x83, 0xb9, 0x36, 0x5b, 0xfb, 0xbb, 0x96, 0xf9, 0x16, 0xbe, 0x43, 0x81,
+    0xd1, 0x67, 0x30, 0x7d, 0xd7, 0xdc, 0x4d, 0xa6, 0xf1, 0x3b, 0xd0, 0x5b, 0x6d, 0x68, 0x1d, 0xb5,
+    0x6c, 0x0c, 0x3a, 0x15, 0x3a, 0xd2, 0x54, 0xb1, 0x22, 0x81, 0x3a, 0x55, 0x25, 0x13, 0x68, 0x47,
+    0xeb, 0x04, 0x01, 0x71, 0xa9, 0x66, 0x70, 0x74, 0x72, 0x72, 0x92, 0xc0, 0x2e, 0xa8, 0xa6, 0x3e,
+    0x4c, 0xa4, 0xd9, 0xbf, 0x14, 0x6d, 0xe2, 0xb7, 0xd6, 0xaa, 0x77, 0x39, 0xc6, 0xff, 0x4e, 0xb3,
+    0x0b, 0x8e, 0xb4, 0x49, 0x0d, 0x45, 0xf3, 0x3e, 0xc4, 0xe9, 0xe9, 0x69, 0x6f, 0x19, 0xad, 0xa5,
+    0x31, 0xb2, 0xf6, 0x39, 0x76, 0x41, 0x5c, 0x2a, 0xd9, 0x36, 0x1a, 0x8d, 0x73, 0xa6, 0x1b, 0x9e,
+    0x6e, 0x67, 0x50, 0x70, 0x7a, 0x97, 0xb8, 0x67, 0xb4, 0x51, 0x69, 0x33, 0x03, 0xfb, 0x4c, 0xa0,
+    0xb4, 0xa2, 0xf3, 0x4a, 0x39, 0x2b, 0x45, 0xc4, 0xb0, 0x02, 0xdd, 0x59, 0x47, 0x98, 0x50, 0x19,
+    0x1b, 0xce, 0xa4, 0x6b, 0x6e, 0x33, 0xaf, 0xa5, 0xca, 0xa9, 0x8a, 0x10, 0x00, 0x4f, 0x1b, 0x8d,
+    0x70, 0x7b, 0x09, 0x71, 0x20, 0x08, 0xd7, 0x56, 0x8c, 0x76, 0xda, 0x81, 0xc8, 0xd2, 0xc6, 0x30,
+    0x29, 0xd0, 0xcf, 0xd0, 0x3b, 0x13, 0xb9, 0xf8, 0x33, 0xe0, 0xb4, 0xc0, 0x98, 0xae, 0xe4, 0x0d,
+    0x65, 0x65, 0x85, 0x0d, 0x5c, 0x4b, 0x9e, 0x27, 0xd0, 0xa4, 0x79, 0xce, 0x44, 0x39, 0x83, 0xf8,
+    0x84, 0xd6, 0x70, 0xec, 0xf2, 0xe6, 0xe8, 0xbc, 0xd7, 0x23, 0x4c, 0x88, 0x4f, 0xed, 0x63, 0xda,
+    0x59, 0x78, 0x3c, 0x43, 0xf1, 0xcd, 0x1d, 0x68, 0xc9, 0x59, 0x0e, 0x47, 0x94, 0xd2, 0x2e, 0xc0,
+    0x8c, 0xa7, 0xda, 0x44, 0x59, 0xc5, 0x78, 0xfe, 0x08, 0x88, 0xb2, 0xc9, 0x3d, 0x92, 0x22, 0xad,
+    0x19, 0xc7, 0x26, 0xb5, 0x2c, 0xaa, 0x25, 0x2e, 0x7a, 0x93, 0x66, 0x74, 0x0c, 0x83, 0xe8, 0x5a,
+    0x8a, 0xdd, 0xe0, 0xf7, 0xdb, 0xbf, 0x3e, 0x76, 0x18, 0x8f, 0x4c, 0xd6, 0x80, 0xf9, 0x9f, 0xc1,
+    0x7d, 0x90, 0x59, 0xc1, 0x54, 0x8f, 0x76, 0x0c, 0xbd, 0x52, 0x98, 0xaa, 0x53, 0x85, 0x27, 0xa3,
+    0x67, 0x9b, 0xb9, 0x0b, 0xe6, 0x13, 0x4f, 0xcc, 0xf9, 0xc4, 0x0f, 0x89, 0x65, 0xa8, 0x1d, 0x99,
+    0xe9, 0x33, 0x64, 0x46, 0x65, 0x30, 0xcf, 0xd9, 0x2d, 0xb0, 0x7c, 0x41, 0x1c, 0xab, 0xc8, 0x19,
+    0x97, 0xa9, 0xed, 0xf2, 0x7c, 0x82, 0x7a, 0xff, 0x35, 0xc3, 0xd6, 0xe9, 0x05, 0xe9, 0xa8, 0x44,
+    0x9c, 0xb1, 0x97, 0xcf, 0x7a, 0xb3, 0x8e, 0x18, 0xf6, 0x0b, 0x62, 0xb5, 0x6a, 0xa7, 0xb0, 0x73,
+    0x92, 0x29, 0xd6, 0x98, 0xb3, 0x80, 0xb4, 0x9a, 0x82, 0x36, 0x8a, 0x65, 0x86, 0x24, 0xc1, 0x6d,
+    0xaa, 0xe0, 0xf3, 0xf9, 0x97, 0x0f, 0x17, 0xef, 0x57, 0x9f, 0xbe, 0xc2, 0x02, 0x4e, 0x8e, 0xb1,
+    0x87, 0x41, 0x50, 0xb4, 0x22, 0x73, 0x4c, 0x51, 0x54, 0xe0, 0x7a, 0x86, 0x35, 0x96, 0x19, 0x00,
+    0x58, 0x6b, 0xcf, 0xe3, 0x05, 0x7c, 0xdf, 0x25, 0xa8, 0xba, 0x58, 0x7f, 0xa3, 0x99, 0x89, 0x6f,
+    0xe8, 0x56, 0xa3, 0x55, 0xac, 0x71, 0xc6, 0xc3, 0x51, 0x5c, 0x48, 0x75, 0x9e, 0x66, 0x55, 0x38,
+    0xc4, 0x09, 0x6f, 0xba, 0x08, 0x3e, 0x06, 0xba, 0xdf, 0xc4, 0x38, 0x06, 0xcc, 0x84, 0x24, 0x26,
+    0xa3, 0xab, 0xe3, 0xeb, 0xc4, 0x7d, 0x0c, 0xbb, 0xe8, 0x57, 0xe5, 0x35, 0x5a, 0xec, 0xe5, 0x1f,
+    0x3f, 0xe0, 0xea, 0x7a, 0x14, 0x37, 0xad, 0xae, 0x30, 0x90, 0x35, 0xdd, 0xb9, 0xa7, 0x8d, 0x25,
+    0x5b, 0x83, 0xb6, 0xb9, 0xcc, 0xda, 0x1a, 0xb7, 0x95, 0xb8, 0xa4, 0xe6, 0x9c, 0x53, 0x2b, 0xfe,
+    0xb1, 0xfd, 0x90, 0x87, 0x7d, 0x7f, 0x9c, 0x39, 0x9a, 0xc6, 0x76, 0xad, 0x96, 0xdd, 0x16, 0x84,
+    0x6e, 0x84, 0x3c, 0xae, 0xa1, 0xb3, 0x7f, 0xae, 0x82, 0xf2, 0x7e, 0x05, 0x0f, 0x72, 0x66, 0x8a,
+    0xe2, 0x8a, 0xf9, 0xb4, 0x21, 0x71, 0x1d, 0xef, 0x32, 0x02, 0xf4, 0x5f, 0x97, 0xdd, 0xe8, 0x61,
+    0x6f, 0x1e, 0x22, 0x28, 0x3b, 0xb3, 0xa1, 0xd6, 0x97, 0x5a, 0xd7, 0xa5, 0x56, 0xe8, 0x65, 0x62,
+    0x26, 0x70, 0x2f, 0x33, 0x5f, 0xe4, 0x26, 0xf4, 0x89, 0x00, 0x94, 0x57, 0x2e, 0x29, 0xe7, 0x4f,
+    0xf2, 0x60, 0xbb, 0x39, 0x6e, 0xb4, 0x61, 0x19, 0x73, 0x2a, 0x4a, 0x53, 0xc1, 0x2f, 0x30, 0xfd,
+    0x39, 0xcf, 0xfa, 0xea, 0xc6, 0xaf, 0xce, 0xce, 0x3b, 0xd8, 0x3e, 0xa6, 0x4d, 0x83, 0xd4, 0x58,
+    0xba, 0x21, 0x30, 0xc3, 0x92, 0xec, 0x02, 0xc7, 0xa8, 0xcb, 0xe5, 0xe7, 0xd5, 0xf2, 0xe2, 0xa3,
+    0x25, 0xd4, 0x15, 0x51, 0xb4, 0x96, 0xc8, 0xe7, 0x31, 0x78, 0x62, 0x5b, 0x41, 0x19, 0xb3, 0xaa,
+    0xb5, 0x15, 0x51, 0x42, 0x8f, 0xe1, 0x45, 0x7a, 0x29, 0xdb, 0x88, 0xdc, 0x59, 0x6a, 0x53, 0x29,
+    0xaa, 0x2b, 0x27, 0x8b, 0x7c, 0xe5, 0xd5, 0x2a, 0xbb, 0xed, 0x44, 0x5f, 0xc0, 0xfe, 0x8f, 0x30,
+    0xb1, 0x2a, 0xb8, 0x9d, 0x75, 0x6b, 0x27, 0xa5, 0xa6, 0xff, 0xac, 0xd6, 0x5b, 0x43, 0xbb, 0xf8,
+    0xf4, 0xae, 0x66, 0x66, 0x85, 0x69, 0xee, 0xbd, 0x15, 0xb8, 0x1d, 0xdd, 0x0b, 0xbf, 0xb2, 0xbb,
+    0x0a, 0xd7, 0xbd, 0x66, 0xdd, 0x16, 0x83, 0xe6, 0x69, 0x32, 0x8f, 0xa3, 0xb7, 0xb8, 0x7e, 0x3a,
+    0x3a, 0x97, 0x59, 0x13, 0xe2, 0x91, 0x27, 0xf4, 0x7e, 0x82, 0x5e, 0xe4, 0xab, 0x9d, 0x5a, 0xd7,
+    0xce, 0xe7, 0xa9, 0xfa, 0x1a, 0x9d, 0xac, 0xbf, 0x3d, 0x62, 0x05, 0x75, 0x20, 0x34, 0xe9, 0xc7,
+    0xa4, 0x7a, 0x8e, 0x35, 0x57, 0x84, 0x4b, 0x3c, 0x69, 0xc9, 0x75, 0x8c, 0x2e, 0x59, 0x6a, 0xc2,
+    0x7e, 0xe1, 0x9e, 0xe3, 0x7f, 0x66, 0xb7, 0xba, 0xea, 0x25, 0xa6, 0x64, 0x89, 0xa7, 0x88, 0x2b,
+    0xf8, 0x40, 0x88, 0xe0, 0x15, 0x1e, 0xbf, 0xc8, 0xc5, 0x2c, 0x76, 0x80, 0x3b, 0xcb, 0x1e, 0xec,
+    0x81, 0x91, 0x79, 0x25, 0x92, 0x65, 0xb5, 0x87, 0xeb, 0x99, 0x3b, 0xb8, 0x37, 0xd2, 0x3a, 0x0c,
+    0xeb, 0xa5, 0x5f, 0x5a, 0xaf, 0x8e, 0xd3, 0x2e, 0x4c, 0x41, 0x0d, 0x82, 0x20, 0x13, 0xbc, 0xf6,
+    0xe0, 0xee, 0xaa, 0xe3, 0x6f, 0x5a, 0x0a, 0xa4, 0x11, 0x9e, 0x4f, 0x08, 0x0e, 0x8f, 0x66, 0x22,
+    0x24, 0x1e, 0xe0, 0x52, 0x51, 0x82, 0x19, 0x5d, 0x05, 0xb1, 0xa9, 0xa8, 0xb8, 0x07, 0x5b, 0x59,
+    0xd8, 0xac, 0x80, 0xf0, 0x8d, 0x8a, 0x25, 0xd6, 0x80, 0xdc, 0x97, 0x1b, 0x10, 0x74, 0x03, 0xe7,
+    0x4a, 0x49, 0x15, 0x2a, 0x7b, 0xe4, 0x99, 0x56, 0x8f, 0x12, 0x64, 0x97, 0x69, 0x15, 0x92, 0xcc,
+    0x65, 0xc1, 0xde, 0x1d, 0x0a, 0x59, 0xef, 0x37, 0x8f, 0x61, 0x2f, 0x1f, 0xc6, 0xbe, 0x8b, 0xd1,
+    0xe3, 0x46, 0xea, 0xfc, 0x04, 0xe6, 0x83, 0xb8, 0x07, 0x44, 0xf2, 0x06, 0x7e, 0x1f, 0x80, 0xc1,
+    0x0c, 0x44, 0xcb, 0x79, 0xf2, 0x92, 0x7b, 0xd6, 0x97, 0x8d, 0xc2, 0xbd, 0xa9, 0x19, 0x25, 0xc3,
+    0x8e, 0x73, 0xa0, 0xb8, 0x7d, 0x6d, 0x3a, 0x76, 0x67, 0xe3, 0x5f, 0x78, 0xd9, 0x1c, 0x66, 0xa5,
+    0xd3, 0x3f, 0x9a, 0x8f, 0xb6, 0xc9, 0x71, 0xc1, 0x72, 0x20, 0xb8, 0x01, 0xda, 0xc6, 0xbe, 0xc7,
+    0x37, 0x4b, 0x0e, 0xf9, 0xd1, 0x12, 0x8b, 0x5e, 0xb2, 0x9a, 0x7e, 0xc5, 0xe5, 0x13, 0x65, 0xf8,
+    0x28, 0x35, 0x8e, 0xc7, 0x03, 0x8a, 0xd1, 0x83, 0xc9, 0xdd, 0xb5, 0xe4, 0x30, 0x02, 0x21, 0x01,
+    0xaf, 0xa2, 0x1b, 0xaa, 0x20, 0xb4, 0x20, 0x68, 0x5c, 0x53, 0xad, 0xd3, 0x92, 0xa2, 0x4c, 0x46,
+    0x63, 0xdb, 0x46, 0xb5, 0xc5, 0xfc, 0xe4, 0xb5, 0xca, 0x01, 0x2f, 0xdb, 0x16, 0x2e, 0xee, 0xc6,
+    0xa1, 0x65, 0xec, 0x78, 0x7f, 0x90, 0xfb, 0xce, 0x21, 0xa7, 0x3b, 0x2a, 0x27, 0xf6, 0x3a, 0xe2,
+    0xcf, 0xff, 0xf9, 0xc4, 0x5f, 0x44, 0x26, 0xdd, 0xa5, 0xfe, 0x3f, 0xb1, 0xb8, 0x5c, 0x39, 0xe5,
+    0x0b, 0x00, 0x00,
+};
+
+const DiagHttpdAsset_t diag_httpd_assets[] = {
+    { "/index.html", diag_asset_index_html_header, sizeof(diag_asset_index_html_header) - 1U, diag_asset_index_html_body, sizeof(diag_asset_index_html_body) },
+};
+
+const uint32_t diag_httpd_asset_count = sizeof(diag_httpd_assets) / sizeof(diag_httpd_assets[0]);
+
+#endif /* DIAG_HTTPD */
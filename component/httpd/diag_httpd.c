@@ -0,0 +1,411 @@
+/**
+ * @file diag_httpd.c
+ * @brief Diagnostics HTTP server on the raw TCP API, see diag_httpd.h.
+ */
+
+#include "diag_httpd.h"
+
+#if DIAG_HTTPD
+
+#include "metrics/metrics.h"
+#include "qspi/qspi_flash.h"
+#include "coro/coro_tcp.h"
+#include "json/json_out.h"
+#include "diag_ws.h"
+
+#include "main.h"
+#include "lwip/tcp.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#if DIAG_HTTPD_CHUNK_SIZE < JSON_OUT_TOKEN_MAX
+#error "DIAG_HTTPD_CHUNK_SIZE must hold a JSON token"
+#endif
+
+/* Request line and headers kept; only the request line is looked at */
+#define DIAG_REQ_MAX            128U
+/* tcp_poll() runs every 500 ms */
+#define DIAG_POLLS              10U
+#define DIAG_JSON_PATH          "/metrics.json"
+#define DIAG_TCP_PATH           "/tcp.json"
+
+typedef struct {
+    CoroTcpConn_t tcp;          /* first */
+    const uint8_t* part[2];     /* header, body */
+    uint32_t part_len[2];
+    uint16_t req_len;
+    uint16_t json_rows;         /* of /tcp.json, fixed by the first chunk */
+    JsonOutFn_t json_fn;        /* JSON body to stream, or NULL */
+    JsonOut_t json;
+    bool mapped;                /* holds a QSPI flash reader reference */
+#if DIAG_WS
+    bool ws_req;                /* GET of DIAG_WS_PATH, headers to read */
+    bool upgrade;               /* "Upgrade: websocket" among them */
+    uint8_t key_len;
+    char key[DIAG_WS_ACCEPT_LEN + 4U];  /* Sec-WebSocket-Key, then the accept
+                                           value and the blank line */
+    DiagWs_t* ws;
+#endif
+    char req[DIAG_REQ_MAX];     /* the request line, then a header line */
+} DiagConn_t;
+
+static CoroState_t diag_conn(CoroTcpConn_t* t);
+static void diag_release(CoroTcpConn_t* t);
+
+/* tcpip thread */
+CORO_TCP_SERVER_DEFINE(diag_server, DiagConn_t, DIAG_HTTPD_CONNS, DIAG_HTTPD_PORT, diag_conn, diag_release,
+                       DIAG_POLLS);
+/* One JSON chunk at a time, copied into the send buffer */
+static char diag_chunk[DIAG_HTTPD_CHUNK_SIZE];
+
+static Metric_t diag_requests = METRIC_COUNTER_INIT("http.requests");
+static Metric_t diag_not_found = METRIC_COUNTER_INIT("http.not_found");
+static Metric_t diag_busy = METRIC_COUNTER_INIT("http.busy");
+
+static const char diag_json_header[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "Cache-Control: no-store\r\n"
+    "Connection: close\r\n\r\n";
+
+static const char diag_not_found_response[] =
+    "HTTP/1.0 404 Not Found\r\n"
+    "Content-Type: text/plain\r\n"
+    "Connection: close\r\n\r\n"
+    "not found\n";
+
+static const char diag_bad_request_response[] =
+    "HTTP/1.0 400 Bad Request\r\n"
+    "Content-Type: text/plain\r\n"
+    "Connection: close\r\n\r\n"
+    "GET only\n";
+
+#if DIAG_WS
+static const char diag_ws_response[] =
+    "HTTP/1.1 101 Switching Protocols\r\n"
+    "Upgrade: websocket\r\n"
+    "Connection: Upgrade\r\n"
+    "Sec-WebSocket-Accept: ";
+
+static const char diag_ws_bad_response[] =
+    "HTTP/1.0 400 Bad Request\r\n"
+    "Content-Type: text/plain\r\n"
+    "Connection: close\r\n\r\n"
+    "WebSocket only\n";
+#endif
+
+static const char diag_busy_response[] =
+    "HTTP/1.0 503 Service Unavailable\r\n"
+    "Retry-After: 1\r\n"
+    "Connection: close\r\n\r\n";
+
+/* Whatever the response held, once it is acknowledged or the connection
+ * is gone */
+static void diag_release(CoroTcpConn_t* t)
+{
+    DiagConn_t* c = (DiagConn_t*)t;
+
+#if DIAG_WS
+    if (c->ws != NULL) {
+        diag_ws_close(c->ws);
+        c->ws = NULL;
+    }
+#endif
+#if QSPI_FLASH
+    if (c->mapped) {
+        c->mapped = false;
+        qspi_flash_map_put();
+    }
+#endif
+}
+
+static void diag_respond(DiagConn_t* c, const void* header, uint32_t header_len, const void* body, uint32_t body_len)
+{
+    c->part[0] = (const uint8_t*)header;
+    c->part_len[0] = header_len;
+    c->part[1] = (const uint8_t*)body;
+    c->part_len[1] = body_len;
+}
+
+#define DIAG_RESPOND_CONST(c, s) diag_respond((c), (s), sizeof(s) - 1U, NULL, 0U)
+
+#if TCP_CONN_STATS
+/* The active connections as an array of objects. Each chunk takes a new
+ * snapshot; the row count is the one of the first chunk, so the document
+ * keeps its shape: a connection gone meanwhile shows as CLOSED. */
+static void diag_render_tcp(JsonOut_t* j, void* arg)
+{
+    static struct tcp_conn_info conns[MEMP_NUM_TCP_PCB];
+    static const struct tcp_conn_info gone;
+    DiagConn_t* dc = (DiagConn_t*)arg;
+    uint16_t n = tcp_conn_snapshot(conns, MEMP_NUM_TCP_PCB);
+
+    /* Nothing is sent yet */
+    if (j->cursor == 0U) {
+        dc->json_rows = n;
+    }
+    json_out_arr(j, NULL);
+    for (uint16_t i = 0U; i < dc->json_rows && !json_out_full(j); i++) {
+        const struct tcp_conn_info* c = (i < n) ? &conns[i] : &gone;
+        char local[IP4ADDR_STRLEN_MAX + 6];
+        char remote[IP4ADDR_STRLEN_MAX + 6];
+
+        (void)ipaddr_ntoa_r(&c->local_ip, local, IP4ADDR_STRLEN_MAX);
+        (void)ipaddr_ntoa_r(&c->remote_ip, remote, IP4ADDR_STRLEN_MAX);
+        (void)snprintf(&local[strlen(local)], 7U, ":%u", (unsigned)c->local_port);
+        (void)snprintf(&remote[strlen(remote)], 7U, ":%u", (unsigned)c->remote_port);
+        json_out_obj(j, NULL);
+        json_out_str(j, "local", local);
+        json_out_str(j, "remote", remote);
+        json_out_str(j, "state", tcp_debug_state_str((enum tcp_state)c->state));
+        json_out_u32(j, "mss", c->mss);
+        json_out_u32(j, "srtt_ms", c->srtt_ms);
+        json_out_u32(j, "rttvar_ms", c->rttvar_ms);
+        json_out_u32(j, "rto_ms", c->rto_ms);
+        json_out_u32(j, "nrtx", c->nrtx);
+        json_out_u32(j, "cwnd", c->cwnd);
+        json_out_u32(j, "ssthresh", c->ssthresh);
+        json_out_u32(j, "snd_wnd", c->snd_wnd);
+        json_out_u32(j, "rcv_wnd", c->rcv_ann_wnd);
+        json_out_u32(j, "snd_buf", c->snd_buf);
+        json_out_u32(j, "snd_buf_max", c->snd_buf_max);
+        json_out_u32(j, "in_flight", c->in_flight);
+        json_out_u32(j, "snd_queuelen", c->snd_queuelen);
+        json_out_u32(j, "ooseq_pbufs", c->ooseq_pbufs);
+        json_out_u32(j, "ooseq_bytes", c->ooseq_bytes);
+        json_out_u32(j, "rexmit_rto", c->rexmit_rto);
+        json_out_u32(j, "rexmit_fast", c->rexmit_fast);
+        json_out_u32(j, "snd_wnd_stalls", c->snd_wnd_stalls);
+        json_out_u32(j, "snd_buf_stalls", c->snd_buf_stalls);
+        json_out_u32(j, "rcv_wnd_stalls", c->rcv_wnd_stalls);
+        json_out_end(j);
+    }
+    json_out_end(j);
+}
+#endif /* TCP_CONN_STATS */
+
+/* A JSON response: the header now, the body streamed by diag_json_send() */
+static void diag_respond_json(DiagConn_t* c, JsonOutFn_t fn)
+{
+    c->json_fn = fn;
+    json_out_init(&c->json);
+    DIAG_RESPOND_CONST(c, diag_json_header);
+}
+
+/* Renders chunks into what the send buffer takes, copied there; true once
+ * the whole body is queued. A chunk the send buffer refuses is rendered
+ * again on the next wakeup. */
+static bool diag_json_send(DiagConn_t* c)
+{
+    while (!json_out_done(&c->json)) {
+        uint32_t room = tcp_sndbuf(c->tcp.pcb);
+
+        if (room > sizeof(diag_chunk)) {
+            room = sizeof(diag_chunk);
+        }
+        if (!json_out_chunk(&c->json, c->json_fn, c, diag_chunk, room)) {
+            break;
+        }
+        if (c->json.len != 0U &&
+            tcp_write(c->tcp.pcb, diag_chunk, (u16_t)c->json.len, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+            break;
+        }
+        json_out_commit(&c->json);
+    }
+    tcp_output(c->tcp.pcb);
+    return json_out_done(&c->json);
+}
+
+/* "GET /path HTTP/1.x": the path, cut at the query, or NULL */
+static const char* diag_path(char* req)
+{
+    char* end;
+
+    if (strncmp(req, "GET /", 5) != 0) {
+        return NULL;
+    }
+    end = strpbrk(&req[4], " ?\r\n");
+    if (end == NULL) {
+        return NULL;
+    }
+    *end = '\0';
+    return &req[4];
+}
+
+static void diag_route(DiagConn_t* c)
+{
+    const char* path = diag_path(c->req);
+
+    metric_inc(&diag_requests);
+    if (path == NULL) {
+        DIAG_RESPOND_CONST(c, diag_bad_request_response);
+        return;
+    }
+    if (strcmp(path, "/") == 0) {
+        path = "/index.html";
+    }
+    if (strcmp(path, DIAG_JSON_PATH) == 0) {
+        diag_respond_json(c, metrics_json);
+        return;
+    }
+#if TCP_CONN_STATS
+    if (strcmp(path, DIAG_TCP_PATH) == 0) {
+        diag_respond_json(c, diag_render_tcp);
+        return;
+    }
+#endif
+#if DIAG_WS
+    if (strcmp(path, DIAG_WS_PATH) == 0) {
+        /* Answered once the headers are in */
+        c->ws_req = true;
+        return;
+    }
+#endif
+    for (uint32_t i = 0U; i < diag_httpd_asset_count; i++) {
+        const DiagHttpdAsset_t* a = &diag_httpd_assets[i];
+        if (strcmp(path, a->path) == 0) {
+#if QSPI_FLASH
+            /* Unreadable while the flash is written */
+            if (qspi_flash_contains(a->body)) {
+                if (!qspi_flash_map_get()) {
+                    metric_inc(&diag_busy);
+                    DIAG_RESPOND_CONST(c, diag_busy_response);
+                    return;
+                }
+                c->mapped = true;
+            }
+#endif
+            diag_respond(c, a->header, a->header_len, a->body, a->body_len);
+            return;
+        }
+    }
+    metric_inc(&diag_not_found);
+    DIAG_RESPOND_CONST(c, diag_not_found_response);
+}
+
+/* Takes what arrived of the request line; true once it is in, the
+ * buffer is full or the peer is gone. The headers stay for
+ * diag_headers(). */
+static bool diag_take(DiagConn_t* c)
+{
+    int32_t nl = coro_tcp_rx_find(&c->tcp, '\n');
+    uint32_t room = sizeof(c->req) - 1U - c->req_len;
+    uint32_t n = (nl < 0) ? coro_tcp_rx_len(&c->tcp) : (uint32_t)nl + 1U;
+
+    n = coro_tcp_read(&c->tcp, &c->req[c->req_len], (n < room) ? n : room);
+    c->req_len = (uint16_t)(c->req_len + n);
+    c->req[c->req_len] = '\0';
+    return strchr(c->req, '\n') != NULL || c->req_len == sizeof(c->req) - 1U || c->tcp.eof;
+}
+
+#if DIAG_WS
+/* Reads header lines into req, keeping what the upgrade needs; true at
+ * the blank line or once the peer is gone. Lines longer than req, which
+ * none of those is, are dropped. */
+static bool diag_headers(DiagConn_t* c)
+{
+    for (;;) {
+        int32_t nl = coro_tcp_rx_find(&c->tcp, '\n');
+        char* v;
+
+        if (nl < 0) {
+            return c->tcp.eof;
+        }
+        if ((uint32_t)nl >= sizeof(c->req) - 1U) {
+            (void)coro_tcp_read(&c->tcp, NULL, (uint32_t)nl + 1U);
+            continue;
+        }
+        c->req_len = (uint16_t)coro_tcp_read(&c->tcp, c->req, (uint32_t)nl + 1U);
+        c->req[c->req_len] = '\0';
+        if (c->req[0] == '\r' || c->req[0] == '\n') {
+            return true;
+        }
+        v = strchr(c->req, ':');
+        if (v == NULL) {
+            continue;
+        }
+        *v++ = '\0';
+        v += strspn(v, " \t");
+        v[strcspn(v, " \t\r\n")] = '\0';
+        if (strcasecmp(c->req, "Upgrade") == 0 && strcasecmp(v, "websocket") == 0) {
+            c->upgrade = true;
+        } else if (strcasecmp(c->req, "Sec-WebSocket-Key") == 0 && strlen(v) == DIAG_WS_KEY_LEN) {
+            memcpy(c->key, v, DIAG_WS_KEY_LEN);
+            c->key_len = DIAG_WS_KEY_LEN;
+        }
+    }
+}
+
+/* The upgrade, or a 400 / 503 to send instead */
+static void diag_ws_route(DiagConn_t* c)
+{
+    if (!c->upgrade || c->key_len != DIAG_WS_KEY_LEN) {
+        DIAG_RESPOND_CONST(c, diag_ws_bad_response);
+        return;
+    }
+    c->ws = diag_ws_open(&c->tcp);
+    if (c->ws == NULL) {
+        metric_inc(&diag_busy);
+        DIAG_RESPOND_CONST(c, diag_busy_response);
+        return;
+    }
+    diag_ws_accept(c->key, c->key);
+    memcpy(&c->key[DIAG_WS_ACCEPT_LEN], "\r\n\r\n", 4U);
+    diag_respond(c, diag_ws_response, sizeof(diag_ws_response) - 1U, c->key, sizeof(c->key));
+}
+#endif /* DIAG_WS */
+
+/* One connection: request line, response by reference or streamed, close
+ * once the peer has all of it */
+static CoroState_t diag_conn(CoroTcpConn_t* t)
+{
+    DiagConn_t* c = (DiagConn_t*)t;
+
+    CORO_BEGIN(&t->co);
+    CORO_WAIT_UNTIL(&t->co, diag_take(c));
+    /* The request line is all that matters; a full buffer without it is
+     * a bad request, a peer leaving before it none */
+    if (strchr(c->req, '\n') == NULL && c->req_len < sizeof(c->req) - 1U) {
+        CORO_EXIT(&t->co);
+    }
+    diag_route(c);
+#if DIAG_WS
+    if (c->ws_req) {
+        CORO_WAIT_UNTIL(&t->co, diag_headers(c));
+        diag_ws_route(c);
+        if (c->ws != NULL) {
+            CORO_TCP_SEND(t, c->part[0], c->part_len[0], TCP_WRITE_FLAG_MORE);
+            CORO_TCP_SEND(t, c->part[1], c->part_len[1], TCP_WRITE_FLAG_COPY);
+            diag_ws_start(c->ws);
+            CORO_WAIT_UNTIL(&t->co, diag_ws_serve(c->ws));
+            CORO_EXIT(&t->co);
+        }
+    }
+#endif
+    /* Whatever else the request holds is not looked at */
+    (void)coro_tcp_read(&c->tcp, NULL, coro_tcp_rx_len(&c->tcp));
+    CORO_TCP_SEND(t, c->part[0], c->part_len[0],
+                  (c->part_len[1] != 0U || c->json_fn != NULL) ? TCP_WRITE_FLAG_MORE : 0U);
+    CORO_TCP_SEND(t, c->part[1], c->part_len[1], 0U);
+    if (c->json_fn != NULL) {
+        CORO_WAIT_UNTIL(&t->co, diag_json_send(c));
+    }
+    CORO_TCP_WAIT_ACKED(t);
+    CORO_END(&t->co);
+}
+
+bool diag_httpd_init(void)
+{
+    (void)metrics_register(&diag_requests);
+    (void)metrics_register(&diag_not_found);
+    (void)metrics_register(&diag_busy);
+#if DIAG_WS
+    diag_ws_init();
+#endif
+
+    return coro_tcp_start(&diag_server);
+}
+
+#endif /* DIAG_HTTPD */
@@ -0,0 +1,87 @@
+/**
+ * @file diag_httpd.h
+ * @brief Diagnostics web page: static assets and the metrics as JSON.
+ *
+ *   http://<board>/              the page (www/index.html), which polls
+ *   http://<board>/metrics.json  metrics_json()
+ *   http://<board>/tcp.json      the TCP connections, tcp_conn_snapshot()
+ *                                (TCP_CONN_STATS): RTT, RTO, cwnd,
+ *                                windows, queues, retransmissions, stalls
+ *   ws://<board>/telemetry.ws    telemetry datagrams pushed as WebSocket
+ *                                messages (diag_ws.h)
+ *
+ * lwIP's httpd is not part of this tree; this is a GET-only HTTP/1.0
+ * server with DIAG_HTTPD_CONNS connections, each a coroutine on the
+ * tcpip thread (coro/coro_tcp.h) of a few hundred bytes. Assets
+ * are gzip-compressed at build time by tools/mkassets.py into const
+ * arrays (diag_assets.c), header included, and go out with tcp_write()
+ * without TCP_WRITE_FLAG_COPY: the segments reference flash, the ETH DMA
+ * reads it directly. Either JSON is streamed (json/json_out.h): rendered
+ * chunk by chunk into one shared DIAG_HTTPD_CHUNK_SIZE buffer, each chunk
+ * sized to the send buffer and copied into it, so any number of requests
+ * may be served at once and no series or connection is left out.
+ * Every response closes the connection once it is acknowledged, but for
+ * the WebSocket, which stays open.
+ */
+
+#pragma once
+
+#ifndef DIAG_HTTPD_H
+#define DIAG_HTTPD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 0 leaves the server out of the startup code */
+#ifndef DIAG_HTTPD
+#define DIAG_HTTPD 1
+#endif
+
+#ifndef DIAG_HTTPD_PORT
+#define DIAG_HTTPD_PORT 80U
+#endif
+
+/* Connections served at once; more are refused. About 200 bytes each,
+ * lwIP's MEMP_NUM_TCP_PCB is the other limit. */
+#ifndef DIAG_HTTPD_CONNS
+#define DIAG_HTTPD_CONNS 6U
+#endif
+
+/* JSON rendered per chunk at most; at least JSON_OUT_TOKEN_MAX */
+#ifndef DIAG_HTTPD_CHUNK_SIZE
+#define DIAG_HTTPD_CHUNK_SIZE 1024U
+#endif
+
+/* Placement of the asset arrays; internal flash (.rodata) by default.
+ * QSPI_FLASH_RODATA puts them in the memory-mapped QSPI flash; a response
+ * then holds a qspi_flash_map_get() reference until it is acknowledged,
+ * and gets a 503 while the flash is being written. */
+#ifndef DIAG_HTTPD_ASSET_SECTION
+#define DIAG_HTTPD_ASSET_SECTION
+#endif
+
+typedef struct {
+    const char* path;
+    const char* header;         /* complete HTTP response header */
+    uint32_t header_len;
+    const uint8_t* body;        /* gzip */
+    uint32_t body_len;
+} DiagHttpdAsset_t;
+
+/* diag_assets.c */
+extern const DiagHttpdAsset_t diag_httpd_assets[];
+extern const uint32_t diag_httpd_asset_count;
+
+/* Opens the listener and registers the http.* metrics. Call once from a
+ * task after metrics_init(), not holding the core lock. */
+bool diag_httpd_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DIAG_HTTPD_H */
@@ -0,0 +1,367 @@
+/**
+ * @file diag_ws.c
+ * @brief WebSocket telemetry stream, see diag_ws.h.
+ */
+
+#include "diag_ws.h"
+
+#if DIAG_HTTPD && DIAG_WS
+
+#include "metrics/metrics.h"
+#include "telemetry/telemetry_agg.h"
+
+#include "lwip/tcpip.h"
+#include "lwip/tcp.h"
+#include "lwip/pbuf.h"
+#include "lwip/sys.h"
+
+#include <string.h>
+
+#if !LWIP_TCP_TXREF
+#error "DIAG_WS needs LWIP_TCP_TXREF"
+#endif
+
+#if DIAG_WS_CLIENTS >= DIAG_HTTPD_CONNS
+#error "DIAG_WS_CLIENTS must leave connections for the page"
+#endif
+
+#define DIAG_WS_GUID            "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define DIAG_WS_FIN_BINARY      0x82U
+#define DIAG_WS_OP_CLOSE        0x8U
+#define DIAG_WS_NONE            0xFFU
+
+enum {
+    DIAG_WS_FREE = 0,
+    DIAG_WS_FILL,           /* frames being added */
+    DIAG_WS_SENT,           /* referenced by lwIP until acknowledged */
+};
+
+typedef struct {
+    struct tcp_txref ref;   /* first: the done callback gets it */
+    uint16_t len;
+    uint8_t state;
+    uint8_t buf[DIAG_WS_BUF_SIZE];
+} DiagWsBuf_t;
+
+struct DiagWs_s {
+    CoroTcpConn_t* conn;    /* NULL: closed, free once no buffer is SENT */
+    bool active;            /* handshake queued */
+    uint8_t fill;           /* the FILL buffer, DIAG_WS_NONE if none */
+    uint16_t skip;          /* payload of a client frame still to drop */
+    uint32_t ping_ms;
+    DiagWsBuf_t bufs[DIAG_WS_BUFS];
+};
+
+/* tcpip thread */
+static DiagWs_t diag_ws[DIAG_WS_CLIENTS];
+
+static const uint8_t diag_ws_ping[] = { 0x89U, 0x00U };
+static const uint8_t diag_ws_close_frame[] = { 0x88U, 0x00U };
+
+static Metric_t diag_ws_upgrades = METRIC_COUNTER_INIT("http.ws.upgrades");
+static Metric_t diag_ws_frames = METRIC_COUNTER_INIT("http.ws.frames");
+static Metric_t diag_ws_writes = METRIC_COUNTER_INIT("http.ws.writes");
+static Metric_t diag_ws_bytes = METRIC_COUNTER_INIT("http.ws.bytes");
+static Metric_t diag_ws_dropped = METRIC_COUNTER_INIT("http.ws.dropped");
+
+/*---------------------------------------------------------------------------*/
+/* Handshake */
+
+static uint32_t diag_ws_rol(uint32_t v, uint32_t n)
+{
+    return (v << n) | (v >> (32U - n));
+}
+
+static void diag_ws_sha1_block(uint32_t h[5], const uint8_t* p)
+{
+    uint32_t w[80];
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+    for (uint32_t i = 0U; i < 16U; i++) {
+        w[i] = ((uint32_t)p[4U * i] << 24) | ((uint32_t)p[4U * i + 1U] << 16) | ((uint32_t)p[4U * i + 2U] << 8) |
+               p[4U * i + 3U];
+    }
+    for (uint32_t i = 16U; i < 80U; i++) {
+        w[i] = diag_ws_rol(w[i - 3U] ^ w[i - 8U] ^ w[i - 14U] ^ w[i - 16U], 1U);
+    }
+    for (uint32_t i = 0U; i < 80U; i++) {
+        uint32_t f;
+        uint32_t k;
+
+        if (i < 20U) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999U;
+        } else if (i < 40U) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1U;
+        } else if (i < 60U) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDCU;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6U;
+        }
+        uint32_t t = diag_ws_rol(a, 5U) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = diag_ws_rol(b, 30U);
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+/* SHA-1 of key and the GUID, 60 bytes: two blocks with the padding */
+static void diag_ws_sha1(const char* key, uint8_t out[20])
+{
+    uint8_t m[128];
+    uint32_t h[5] = { 0x67452301U, 0xEFCDAB89U, 0x98BADCFEU, 0x10325476U, 0xC3D2E1F0U };
+    const uint32_t len = DIAG_WS_KEY_LEN + sizeof(DIAG_WS_GUID) - 1U;
+
+    memset(m, 0, sizeof(m));
+    memcpy(m, key, DIAG_WS_KEY_LEN);
+    memcpy(&m[DIAG_WS_KEY_LEN], DIAG_WS_GUID, sizeof(DIAG_WS_GUID) - 1U);
+    m[len] = 0x80U;
+    m[sizeof(m) - 2U] = (uint8_t)((len * 8U) >> 8);
+    m[sizeof(m) - 1U] = (uint8_t)(len * 8U);
+    diag_ws_sha1_block(h, m);
+    diag_ws_sha1_block(h, &m[64]);
+    for (uint32_t i = 0U; i < 20U; i++) {
+        out[i] = (uint8_t)(h[i / 4U] >> (24U - 8U * (i % 4U)));
+    }
+}
+
+void diag_ws_accept(const char* key, char out[DIAG_WS_ACCEPT_LEN])
+{
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint8_t d[21];
+    uint32_t o = 0U;
+
+    diag_ws_sha1(key, d);
+    d[20] = 0U;
+    /* 20 bytes: six full groups and one of two bytes */
+    for (uint32_t i = 0U; i < 21U; i += 3U) {
+        uint32_t v = ((uint32_t)d[i] << 16) | ((uint32_t)d[i + 1U] << 8) | d[i + 2U];
+        out[o++] = b64[(v >> 18) & 0x3FU];
+        out[o++] = b64[(v >> 12) & 0x3FU];
+        out[o++] = b64[(v >> 6) & 0x3FU];
+        out[o++] = b64[v & 0x3FU];
+    }
+    out[DIAG_WS_ACCEPT_LEN - 1U] = '=';
+}
+
+/*---------------------------------------------------------------------------*/
+/* Sending */
+
+/* tcp_txref_fn: the peer has the buffer, or the pcb is gone */
+static void diag_ws_done(struct tcp_txref* ref)
+{
+    ((DiagWsBuf_t*)ref)->state = DIAG_WS_FREE;
+}
+
+/* Hands the FILL buffer to TCP; false while the send buffer has no room
+ * for all of it, which the next resumption retries */
+static bool diag_ws_send(DiagWs_t* ws)
+{
+    DiagWsBuf_t* b;
+
+    if (ws->fill == DIAG_WS_NONE) {
+        return true;
+    }
+    b = &ws->bufs[ws->fill];
+    if (b->len == 0U) {
+        return true;
+    }
+    tcp_txref_init(&b->ref, diag_ws_done, NULL);
+    if (tcp_write_ref(ws->conn->pcb, b->buf, b->len, 0U, &b->ref) != ERR_OK) {
+        return false;
+    }
+    b->state = DIAG_WS_SENT;
+    ws->fill = DIAG_WS_NONE;
+    metric_inc(&diag_ws_writes);
+    metric_add(&diag_ws_bytes, b->len);
+    /* The pbufs hold the buffer from here */
+    tcp_txref_release(&b->ref);
+    tcp_output(ws->conn->pcb);
+    return true;
+}
+
+/* A buffer with room for n more bytes, NULL when the client is behind */
+static DiagWsBuf_t* diag_ws_room(DiagWs_t* ws, uint32_t n)
+{
+    if (ws->fill != DIAG_WS_NONE && ws->bufs[ws->fill].len + n > DIAG_WS_BUF_SIZE && !diag_ws_send(ws)) {
+        return NULL;
+    }
+    if (ws->fill == DIAG_WS_NONE) {
+        for (uint32_t i = 0U; i < DIAG_WS_BUFS; i++) {
+            if (ws->bufs[i].state == DIAG_WS_FREE) {
+                ws->bufs[i].state = DIAG_WS_FILL;
+                ws->bufs[i].len = 0U;
+                ws->fill = (uint8_t)i;
+                break;
+            }
+        }
+    }
+    return (ws->fill != DIAG_WS_NONE) ? &ws->bufs[ws->fill] : NULL;
+}
+
+/* TelemetrySink_t: a datagram framed for every client, or the end of the
+ * flush */
+static void diag_ws_push(const uint8_t* data, uint32_t len)
+{
+    uint32_t hdr = (len < 126U) ? 2U : 4U;
+
+    for (uint32_t i = 0U; i < DIAG_WS_CLIENTS; i++) {
+        DiagWs_t* ws = &diag_ws[i];
+        DiagWsBuf_t* b;
+
+        if (ws->conn == NULL || !ws->active) {
+            continue;
+        }
+        if (data == NULL) {
+            (void)diag_ws_send(ws);
+            continue;
+        }
+        b = (hdr + len <= DIAG_WS_BUF_SIZE) ? diag_ws_room(ws, hdr + len) : NULL;
+        if (b == NULL) {
+            metric_inc(&diag_ws_dropped);
+            continue;
+        }
+        b->buf[b->len] = DIAG_WS_FIN_BINARY;
+        if (hdr == 2U) {
+            b->buf[b->len + 1U] = (uint8_t)len;
+        } else {
+            b->buf[b->len + 1U] = 126U;
+            b->buf[b->len + 2U] = (uint8_t)(len >> 8);
+            b->buf[b->len + 3U] = (uint8_t)len;
+        }
+        memcpy(&b->buf[b->len + hdr], data, len);
+        b->len = (uint16_t)(b->len + hdr + len);
+        metric_inc(&diag_ws_frames);
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Connection */
+
+DiagWs_t* diag_ws_open(CoroTcpConn_t* c)
+{
+    for (uint32_t i = 0U; i < DIAG_WS_CLIENTS; i++) {
+        DiagWs_t* ws = &diag_ws[i];
+        bool free = (ws->conn == NULL);
+
+        for (uint32_t j = 0U; j < DIAG_WS_BUFS && free; j++) {
+            free = (ws->bufs[j].state == DIAG_WS_FREE);
+        }
+        if (free) {
+            ws->conn = c;
+            ws->active = false;
+            ws->fill = DIAG_WS_NONE;
+            ws->skip = 0U;
+            ws->ping_ms = sys_now();
+            return ws;
+        }
+    }
+    return NULL;
+}
+
+void diag_ws_start(DiagWs_t* ws)
+{
+    ws->active = true;
+    metric_inc(&diag_ws_upgrades);
+}
+
+/* Drops the client's frames; false on a close frame or one too long to
+ * be ours */
+static bool diag_ws_read(DiagWs_t* ws)
+{
+    CoroTcpConn_t* c = ws->conn;
+
+    for (;;) {
+        uint8_t h[4];
+        uint32_t avail;
+        uint32_t need;
+        uint32_t len;
+
+        if (ws->skip != 0U) {
+            ws->skip = (uint16_t)(ws->skip - coro_tcp_read(c, NULL, ws->skip));
+            if (ws->skip != 0U) {
+                return true;
+            }
+        }
+        avail = coro_tcp_rx_len(c);
+        if (avail < 2U) {
+            return true;
+        }
+        (void)pbuf_copy_partial(c->rx, h, (u16_t)((avail < sizeof(h)) ? avail : sizeof(h)), 0U);
+        len = h[1] & 0x7FU;
+        if (len == 127U) {
+            return false;
+        }
+        /* Client frames are masked */
+        need = 2U + ((len == 126U) ? 2U : 0U) + (((h[1] & 0x80U) != 0U) ? 4U : 0U);
+        if (avail < need) {
+            return true;
+        }
+        if (len == 126U) {
+            len = ((uint32_t)h[2] << 8) | h[3];
+        }
+        (void)coro_tcp_read(c, NULL, need);
+        if ((h[0] & 0x0FU) == DIAG_WS_OP_CLOSE) {
+            return false;
+        }
+        ws->skip = (uint16_t)len;
+    }
+}
+
+bool diag_ws_serve(DiagWs_t* ws)
+{
+    struct tcp_pcb* pcb = ws->conn->pcb;
+
+    if (!diag_ws_read(ws)) {
+        /* Best effort: the connection closes either way */
+        (void)tcp_write(pcb, diag_ws_close_frame, sizeof(diag_ws_close_frame), 0U);
+        return true;
+    }
+    if (ws->conn->eof) {
+        return true;
+    }
+    (void)diag_ws_send(ws);
+    /* tcp_write() queues all or nothing: never inside a buffer's frames */
+    if (sys_now() - ws->ping_ms >= DIAG_WS_PING_MS &&
+        tcp_write(pcb, diag_ws_ping, sizeof(diag_ws_ping), 0U) == ERR_OK) {
+        ws->ping_ms = sys_now();
+        tcp_output(pcb);
+    }
+    return false;
+}
+
+void diag_ws_close(DiagWs_t* ws)
+{
+    if (ws->fill != DIAG_WS_NONE) {
+        ws->bufs[ws->fill].state = DIAG_WS_FREE;
+        ws->fill = DIAG_WS_NONE;
+    }
+    ws->active = false;
+    ws->conn = NULL;
+}
+
+void diag_ws_init(void)
+{
+    (void)metrics_register(&diag_ws_upgrades);
+    (void)metrics_register(&diag_ws_frames);
+    (void)metrics_register(&diag_ws_writes);
+    (void)metrics_register(&diag_ws_bytes);
+    (void)metrics_register(&diag_ws_dropped);
+#if TELEMETRY_AGG
+    telemetry_agg_set_sink(diag_ws_push);
+#else
+    LWIP_UNUSED_ARG(diag_ws_push);
+#endif
+}
+
+#endif /* DIAG_HTTPD && DIAG_WS */
@@ -0,0 +1,96 @@
+/**
+ * @file diag_ws.h
+ * @brief WebSocket telemetry stream of the diagnostics server.
+ *
+ * A GET of DIAG_WS_PATH with "Upgrade: websocket" becomes a WebSocket
+ * (RFC 6455) that carries every telemetry datagram (telemetry_agg.h) as
+ * one binary message, the same bytes the UDP datagram carries, so
+ * tools/telemetry_decode.py applies to either.
+ *
+ * Each client has DIAG_WS_BUFS buffers of DIAG_WS_BUF_SIZE bytes. The
+ * datagrams of one flush are framed into the buffer being filled, and at
+ * the end of the flush that buffer goes out with tcp_write_ref(): one
+ * write for the lot, the segments referencing the buffer, which is free
+ * again once the peer has acknowledged it. A client still holding all its
+ * buffers misses datagrams (http.ws.dropped) rather than holding up the
+ * flush or the other clients.
+ *
+ * The server pings every DIAG_WS_PING_MS; a client that acknowledges
+ * nothing for the idle time of the server is dropped. What the client
+ * sends is read and dropped, a close frame answered and the connection
+ * closed. Everything runs on the tcpip thread.
+ */
+
+#pragma once
+
+#ifndef DIAG_WS_H
+#define DIAG_WS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "diag_httpd.h"
+#include "coro/coro_tcp.h"
+
+/* 0 leaves the WebSocket out of the server */
+#ifndef DIAG_WS
+#define DIAG_WS 1
+#endif
+
+#ifndef DIAG_WS_PATH
+#define DIAG_WS_PATH "/telemetry.ws"
+#endif
+
+/* Clients streaming at once, below DIAG_HTTPD_CONNS */
+#ifndef DIAG_WS_CLIENTS
+#define DIAG_WS_CLIENTS 2U
+#endif
+
+/* Buffers of a client: one being filled, the others in flight */
+#ifndef DIAG_WS_BUFS
+#define DIAG_WS_BUFS 2U
+#endif
+
+/* A telemetry datagram (TELEMETRY_AGG_MTU) and its 4-byte frame header
+ * at least */
+#ifndef DIAG_WS_BUF_SIZE
+#define DIAG_WS_BUF_SIZE 2048U
+#endif
+
+#ifndef DIAG_WS_PING_MS
+#define DIAG_WS_PING_MS 2000U
+#endif
+
+/* Sec-WebSocket-Key: 16 bytes in base64 */
+#define DIAG_WS_KEY_LEN         24U
+/* Sec-WebSocket-Accept: a SHA-1 in base64 */
+#define DIAG_WS_ACCEPT_LEN      28U
+
+typedef struct DiagWs_s DiagWs_t;
+
+/* Registers the http.ws.* metrics and becomes the telemetry sink. From a
+ * task, core lock not held. */
+void diag_ws_init(void);
+
+/* Sec-WebSocket-Accept of key into out, not terminated */
+void diag_ws_accept(const char* key, char out[DIAG_WS_ACCEPT_LEN]);
+
+/* A client for connection c, NULL when all are taken */
+DiagWs_t* diag_ws_open(CoroTcpConn_t* c);
+/* The handshake is queued: frames may follow */
+void diag_ws_start(DiagWs_t* ws);
+/* Reads the client's frames, pings, sends a buffer the send buffer had no
+ * room for; true once the connection is to be closed */
+bool diag_ws_serve(DiagWs_t* ws);
+/* The connection ends; buffers in flight stay taken until released */
+void diag_ws_close(DiagWs_t* ws);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DIAG_WS_H */
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""Builds diag_assets.c from the files under component/httpd/www.
+
+Every file is gzip-compressed (level 9, no timestamp, so the output only
+changes with the input) and stored with its complete HTTP response header
+as const arrays, which the linker places in flash. The firmware sends both
+with tcp_write() without copying.
+
+    mkassets.py [--www component/httpd/www] [--out component/httpd/diag_assets.c]
+
+Run it after editing the pages and commit the result with them.
+"""
+
+import argparse
+import gzip
+import os
+import re
+import sys
+
+TYPES = {
+    ".html": "text/html; charset=utf-8",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+    ".png": "image/png",
+}
+
+# The pages are small and change with the firmware only
+CACHE = "max-age=300"
+
+
+def c_name(path):
+    return "diag_asset_" + re.sub(r"[^0-9A-Za-z]", "_", path.strip("/")).lower()
+
+
+def c_bytes(data):
+    lines = []
+    for i in range(0, len(data), 16):
+        lines.append("    " + " ".join("0x%02x," % b for b in data[i:i + 16]))
+    return "\n".join(lines)
+
+
+def c_string(s):
+    return '"' + s.replace("\\", "\\\\").replace('"', '\\"').replace("\r", "\\r").replace("\n", "\\n") + '"'
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--www", default=os.path.join(here, "..", "www"))
+    ap.add_argument("--out", default=os.path.join(here, "..", "diag_assets.c"))
+    args = ap.parse_args()
+
+    assets = []
+    for root, _, files in os.walk(args.www):
+        for f in sorted(files):
+            full = os.path.join(root, f)
+            path = "/" + os.path.relpath(full, args.www).replace(os.sep, "/")
+            ext = os.path.splitext(f)[1].lower()
+            if ext not in TYPES:
+                sys.exit("%s: no content type for %s" % (full, ext))
+            with open(full, "rb") as fh:
+                raw = fh.read()
+            body = gzip.compress(raw, 9, mtime=0)
+            header = ("HTTP/1.0 200 OK\r\n"
+                      "Content-Type: %s\r\n"
+                      "Content-Encoding: gzip\r\n"
+                      "Content-Length: %d\r\n"
+                      "Cache-Control: %s\r\n"
+                      "Connection: close\r\n\r\n") % (TYPES[ext], len(body), CACHE)
+            assets.append((path, header, body, len(raw)))
+    assets.sort()
+
+    out = []
+    out.append("/**")
+    out.append(" * @file diag_assets.c")
+    out.append(" * @brief Generated by tools/mkassets.py from www/, do not edit.")
+    out.append(" */")
+    out.append("")
+    out.append('#include "diag_httpd.h"')
+    out.append("")
+    out.append("#if DIAG_HTTPD")
+    out.append("")
+    for path, header, body, raw_len in assets:
+        name = c_name(path)
+        out.append("/* %s: %d bytes, %d gzipped */" % (path, raw_len, len(body)))
+        out.append("static const char %s_header[] DIAG_HTTPD_ASSET_SECTION =" % name)
+        out.append("    " + c_string(header) + ";")
+        out.append("static const uint8_t %s_body[] DIAG_HTTPD_ASSET_SECTION = {" % name)
+        out.append(c_bytes(body))
+        out.append("};")
+        out.append("")
+    out.append("const DiagHttpdAsset_t diag_httpd_assets[] = {")
+    for path, header, body, _ in assets:
+        name = c_name(path)
+        out.append("    { %s, %s_header, sizeof(%s_header) - 1U, %s_body, sizeof(%s_body) }," %
+                   (c_string(path), name, name, name, name))
+    out.append("};")
+    out.append("")
+    out.append("const uint32_t diag_httpd_asset_count = sizeof(diag_httpd_assets) / sizeof(diag_httpd_assets[0]);")
+    out.append("")
+    out.append("#endif /* DIAG_HTTPD */")
+    out.append("")
+
+    with open(args.out, "w", newline="\n") as fh:
+        fh.write("\n".join(out))
+    for path, _, body, raw_len in assets:
+        print("%s %d -> %d" % (path, raw_len, len(body)))
+
+
+if __name__ == "__main__":
+    main()
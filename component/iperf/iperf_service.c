@@ -0,0 +1,285 @@
+/**
+ * @file iperf_service.c
+ * @brief lwiperf TCP server and iperf2 UDP server, results on syslog.
+ */
+
+#include "iperf_service.h"
+
+#include "main.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#include "lwip/pbuf.h"
+#include "lwip/sys.h"
+#include "lwip/def.h"
+#include "lwip/apps/lwiperf.h"
+
+#include <string.h>
+
+#define IPERF_TAG           "IPERF"
+/* Above this gap the cycle counter may have wrapped, sys_now() is used */
+#define IPERF_CYC_MAX_GAP_MS 4000U
+
+/* iperf 2.0.5 layout, all fields big endian */
+typedef struct {
+    int32_t id;             /* negative on the final datagram */
+    uint32_t tv_sec;
+    uint32_t tv_usec;
+} IperfUdpHdr_t;
+
+typedef struct {
+    int32_t flags;
+    int32_t total_len1;
+    int32_t total_len2;
+    int32_t stop_sec;
+    int32_t stop_usec;
+    int32_t error_cnt;
+    int32_t outorder_cnt;
+    int32_t datagrams;
+    int32_t jitter1;
+    int32_t jitter2;
+} IperfUdpReport_t;
+
+#define IPERF_REPORT_FLAG_HEADER_VERSION1 0x80000000UL
+
+typedef struct {
+    bool active;
+    bool done;              /* final datagram seen, only acks are sent */
+    ip_addr_t remote;
+    u16_t port;
+    uint64_t start_us;
+    uint64_t stop_us;
+    uint64_t bytes;
+    int32_t last_id;
+    uint32_t lost;
+    uint32_t outorder;
+    int64_t last_transit;
+    uint32_t jitter_x16;    /* RFC 1889 estimator, 1/16 us */
+} IperfUdpSession_t;
+
+static void* iperf_tcp;
+static struct udp_pcb* iperf_udp;
+static IperfUdpSession_t iperf_session;
+
+/* Microseconds on the tcpip thread: cycle counter deltas (the DWT is
+ * running for the run-time stats), sys_now() after long gaps. */
+static uint64_t iperf_now_us(void)
+{
+    static uint64_t us;
+    static uint32_t last_cyc;
+    static uint32_t last_ms;
+    static uint32_t rem_cyc;
+    uint32_t cyc = DWT->CYCCNT;
+    uint32_t ms = sys_now();
+    uint32_t mhz = SystemCoreClock / 1000000U;
+
+    if (ms - last_ms > IPERF_CYC_MAX_GAP_MS) {
+        us += (uint64_t)(ms - last_ms) * 1000U;
+        rem_cyc = 0U;
+    } else {
+        uint32_t delta = cyc - last_cyc + rem_cyc;
+        us += delta / mhz;
+        rem_cyc = delta % mhz;
+    }
+    last_cyc = cyc;
+    last_ms = ms;
+    return us;
+}
+
+static const char* iperf_tcp_result(enum lwiperf_report_type type)
+{
+    switch (type) {
+    case LWIPERF_TCP_DONE_SERVER: return "done_server";
+    case LWIPERF_TCP_DONE_CLIENT: return "done_client";
+    case LWIPERF_TCP_ABORTED_LOCAL: return "aborted_local";
+    case LWIPERF_TCP_ABORTED_LOCAL_DATAERROR: return "data_error";
+    case LWIPERF_TCP_ABORTED_LOCAL_TXERROR: return "tx_error";
+    case LWIPERF_TCP_ABORTED_REMOTE: return "aborted_remote";
+    default: return "unknown";
+    }
+}
+
+/* Runs on the tcpip thread */
+static void iperf_tcp_report(void* arg, enum lwiperf_report_type report_type, const ip_addr_t* local_addr,
+                             u16_t local_port, const ip_addr_t* remote_addr, u16_t remote_port,
+                             u32_t bytes_transferred, u32_t ms_duration, u32_t bandwidth_kbitpsec)
+{
+    (void)arg;
+    (void)local_addr;
+    (void)local_port;
+
+    LOG_INFO(IPERF_TAG, "tcp %s remote=%s:%u bytes=%lu ms=%lu kbps=%lu", iperf_tcp_result(report_type),
+             ipaddr_ntoa(remote_addr), remote_port, bytes_transferred, ms_duration, bandwidth_kbitpsec);
+}
+
+static void iperf_udp_begin(IperfUdpSession_t* s, const ip_addr_t* addr, u16_t port, uint64_t now)
+{
+    memset(s, 0, sizeof(*s));
+    s->active = true;
+    ip_addr_copy(s->remote, *addr);
+    s->port = port;
+    s->start_us = now;
+    s->last_id = -1;
+}
+
+static void iperf_udp_count(IperfUdpSession_t* s, int32_t id, const IperfUdpHdr_t* hdr, uint64_t now)
+{
+    int64_t sent = (int64_t)lwip_ntohl(hdr->tv_sec) * 1000000 + (int64_t)lwip_ntohl(hdr->tv_usec);
+    int64_t transit = (int64_t)now - sent;
+
+    /* The clocks are not synchronised: only the differences count */
+    if (s->last_id >= 0) {
+        int64_t d = transit - s->last_transit;
+        uint32_t ad = (uint32_t)((d < 0) ? -d : d);
+        s->jitter_x16 += ad - ((s->jitter_x16 + 8U) >> 4);
+    }
+    s->last_transit = transit;
+
+    if (id > s->last_id + 1) {
+        s->lost += (uint32_t)(id - s->last_id - 1);
+    } else if (id <= s->last_id) {
+        s->outorder++;
+        if (s->lost > 0U) {
+            s->lost--;
+        }
+    }
+    if (id > s->last_id) {
+        s->last_id = id;
+    }
+}
+
+static void iperf_udp_ack(struct udp_pcb* pcb, const IperfUdpSession_t* s, const IperfUdpHdr_t* hdr)
+{
+    struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, sizeof(IperfUdpHdr_t) + sizeof(IperfUdpReport_t), PBUF_RAM);
+    uint64_t duration = s->stop_us - s->start_us;
+    uint32_t jitter = s->jitter_x16 >> 4;
+    IperfUdpReport_t r;
+
+    if (p == NULL) {
+        /* The client repeats the final datagram */
+        return;
+    }
+    r.flags = (int32_t)lwip_htonl(IPERF_REPORT_FLAG_HEADER_VERSION1);
+    r.total_len1 = (int32_t)lwip_htonl((uint32_t)(s->bytes >> 32));
+    r.total_len2 = (int32_t)lwip_htonl((uint32_t)s->bytes);
+    r.stop_sec = (int32_t)lwip_htonl((uint32_t)(duration / 1000000U));
+    r.stop_usec = (int32_t)lwip_htonl((uint32_t)(duration % 1000000U));
+    r.error_cnt = (int32_t)lwip_htonl(s->lost);
+    r.outorder_cnt = (int32_t)lwip_htonl(s->outorder);
+    r.datagrams = (int32_t)lwip_htonl((uint32_t)s->last_id);
+    r.jitter1 = (int32_t)lwip_htonl(jitter / 1000000U);
+    r.jitter2 = (int32_t)lwip_htonl(jitter % 1000000U);
+    pbuf_take(p, hdr, sizeof(IperfUdpHdr_t));
+    pbuf_take_at(p, &r, sizeof(r), sizeof(IperfUdpHdr_t));
+    udp_sendto(pcb, p, &s->remote, s->port);
+    pbuf_free(p);
+}
+
+static void iperf_udp_log(const IperfUdpSession_t* s)
+{
+    uint64_t duration = s->stop_us - s->start_us;
+    uint32_t ms = (uint32_t)(duration / 1000U);
+    uint32_t kbps = (duration != 0U) ? (uint32_t)((s->bytes * 8000U) / duration) : 0U;
+    uint32_t jitter = s->jitter_x16 >> 4;
+
+    LOG_INFO(IPERF_TAG, "udp done remote=%s:%u bytes=%lu ms=%lu kbps=%lu datagrams=%lu lost=%lu outorder=%lu jitter_us=%lu",
+             ipaddr_ntoa(&s->remote), s->port, (uint32_t)s->bytes, ms, kbps, (uint32_t)(s->last_id + 1),
+             s->lost, s->outorder, jitter);
+}
+
+/* Runs on the tcpip thread */
+static void iperf_udp_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    IperfUdpSession_t* s = &iperf_session;
+    uint64_t now = iperf_now_us();
+    IperfUdpHdr_t hdr;
+    int32_t id;
+    bool same;
+
+    (void)arg;
+    if (pbuf_copy_partial(p, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+        pbuf_free(p);
+        return;
+    }
+    id = (int32_t)lwip_ntohl((uint32_t)hdr.id);
+    same = s->active && (s->port == port) && ip_addr_cmp(&s->remote, addr);
+
+    if (id >= 0) {
+        /* A new client, or the same one starting over */
+        if (!same || (s->done && id == 0)) {
+            iperf_udp_begin(s, addr, port, now);
+        }
+        if (!s->done) {
+            s->bytes += p->tot_len;
+            iperf_udp_count(s, id, &hdr, now);
+        }
+    } else if (same) {
+        if (!s->done) {
+            s->bytes += p->tot_len;
+            iperf_udp_count(s, -id, &hdr, now);
+            s->stop_us = now;
+            s->done = true;
+            iperf_udp_log(s);
+        }
+        /* Repeated finals get the report again, the first ack may be lost */
+        iperf_udp_ack(pcb, s, &hdr);
+    }
+    pbuf_free(p);
+}
+
+static bool iperf_udp_open(void)
+{
+    struct udp_pcb* pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+
+    if (pcb == NULL) {
+        return false;
+    }
+    if (udp_bind(pcb, IP_ANY_TYPE, LWIPERF_TCP_PORT_DEFAULT) != ERR_OK) {
+        udp_remove(pcb);
+        return false;
+    }
+    memset(&iperf_session, 0, sizeof(iperf_session));
+    udp_recv(pcb, iperf_udp_recv, NULL);
+    iperf_udp = pcb;
+    return true;
+}
+
+bool iperf_service_start(uint32_t modes)
+{
+    bool ok = true;
+
+    LOCK_TCPIP_CORE();
+    if ((modes & IPERF_SERVICE_TCP) != 0U) {
+        if (iperf_tcp == NULL) {
+            iperf_tcp = lwiperf_start_tcp_server_default(iperf_tcp_report, NULL);
+            ok = ok && (iperf_tcp != NULL);
+        }
+    } else if (iperf_tcp != NULL) {
+        lwiperf_abort(iperf_tcp);
+        iperf_tcp = NULL;
+    }
+    if ((modes & IPERF_SERVICE_UDP) != 0U) {
+        if (iperf_udp == NULL) {
+            ok = iperf_udp_open() && ok;
+        }
+    } else if (iperf_udp != NULL) {
+        udp_remove(iperf_udp);
+        iperf_udp = NULL;
+    }
+    UNLOCK_TCPIP_CORE();
+
+    LOG_INFO(IPERF_TAG, "server port %u tcp=%u udp=%u", LWIPERF_TCP_PORT_DEFAULT, iperf_tcp != NULL,
+             iperf_udp != NULL);
+    return ok;
+}
+
+void iperf_service_stop(void)
+{
+    (void)iperf_service_start(0U);
+}
+
+void iperf_service_set_rx_check(bool enable)
+{
+    LOCK_TCPIP_CORE();
+    lwiperf_set_check_rx_data(enable ? 1U : 0U);
+    UNLOCK_TCPIP_CORE();
+}
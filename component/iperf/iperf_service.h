@@ -0,0 +1,54 @@
+/**
+ * @file iperf_service.h
+ * @brief iperf2 throughput server (TCP through lwiperf, UDP) with syslog results.
+ *
+ * TCP is the lwiperf server on LWIPERF_TCP_PORT_DEFAULT (5001), "iperf -c
+ * <board>". UDP is a minimal iperf2 server on the same port number, "iperf
+ * -c <board> -u -b 90M": it counts bytes, lost and out-of-order datagrams
+ * and the RFC 1889 jitter, and answers the final datagram with the server
+ * report so the client prints the same figures. Every finished session
+ * sends one syslog line, tag "IPERF".
+ */
+
+#pragma once
+
+#ifndef IPERF_SERVICE_H
+#define IPERF_SERVICE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 0 leaves the service out of the startup code */
+#ifndef IPERF_SERVICE
+#define IPERF_SERVICE 1
+#endif
+
+#define IPERF_SERVICE_TCP   0x01U
+#define IPERF_SERVICE_UDP   0x02U
+
+/* Servers started at boot */
+#ifndef IPERF_SERVICE_DEFAULT_MODES
+#define IPERF_SERVICE_DEFAULT_MODES (IPERF_SERVICE_TCP | IPERF_SERVICE_UDP)
+#endif
+
+/* Starts the servers in modes (IPERF_SERVICE_TCP / _UDP) that are not
+ * running yet and stops the others. Call from a task, not holding the core
+ * lock. False if a server could not be started. */
+bool iperf_service_start(uint32_t modes);
+
+/* Stops all servers, running sessions are aborted without a report. */
+void iperf_service_stop(void);
+
+/* Checks the digit pattern of received TCP data (needs
+ * LWIPERF_CHECK_RX_DATA). Off at startup: it costs throughput. */
+void iperf_service_set_rx_check(bool enable);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IPERF_SERVICE_H */
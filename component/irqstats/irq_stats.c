@@ -0,0 +1,215 @@
+/**
+ * @file irq_stats.c
+ * @brief Interrupt handler timing on the DWT cycle counter, see irq_stats.h.
+ */
+
+#include "irq_stats.h"
+
+#if IRQ_STATS
+
+#include "main.h"
+#include "lathist/lat_hist.h"
+#include "metrics/metrics.h"
+
+#include <stdio.h>
+
+/* Device interrupts of the H743 */
+#define IRQ_STATS_IRQS          150U
+#define IRQ_STATS_HIST_NAME     32U
+
+typedef struct {
+    const char* name;
+    uint16_t irqn;
+    uint32_t count;
+    uint32_t nested;            /* entered over another wrapped handler */
+    uint32_t preempted;         /* left a nested handler run meanwhile */
+    uint32_t depth_max;         /* most wrapped handlers it preempted */
+    uint32_t total_max_ns;      /* entry to exit, nested handlers included */
+    uint32_t pending_at;        /* cycle stamp seen pending, 0: not seen */
+    LatHist_t self;
+    LatHist_t preempt;
+    LatHist_t delay;
+#if METRICS
+    char hist_name[3][IRQ_STATS_HIST_NAME];
+#endif
+} IrqStatsVector_t;
+
+typedef struct {
+    IrqStatsVector_t* v;
+    uint32_t start;
+    uint32_t nested_cycles;     /* in handlers that preempted this one */
+} IrqStatsFrame_t;
+
+static IrqStatsVector_t irq_vectors[IRQ_STATS_MAX_VECTORS];
+static uint32_t irq_vector_count;
+/* Index + 1 into irq_vectors, 0: not measured */
+static uint8_t irq_slot[IRQ_STATS_IRQS];
+
+/* Wrapped handlers being run, changed with interrupts masked */
+static IrqStatsFrame_t irq_frames[IRQ_STATS_MAX_NEST];
+static uint32_t irq_depth;
+
+static inline IrqStatsVector_t* irq_stats_vector(uint16_t irqn)
+{
+    uint32_t slot = (irqn < IRQ_STATS_IRQS) ? irq_slot[irqn] : 0U;
+
+    return (slot != 0U) ? &irq_vectors[slot - 1U] : NULL;
+}
+
+/* DVFS changes the clock, so each value is converted when recorded */
+static inline uint32_t irq_stats_ns(uint32_t cycles)
+{
+    return (uint32_t)(((uint64_t)cycles * 1000U) / (SystemCoreClock / 1000000U));
+}
+
+/* Stamps the other vectors found pending; interrupts masked */
+static void irq_stats_scan(const IrqStatsVector_t* self, uint32_t now)
+{
+    uint32_t n = irq_vector_count;
+
+    for (uint32_t i = 0; i < n; i++) {
+        IrqStatsVector_t* v = &irq_vectors[i];
+
+        if (v != self && v->pending_at == 0U && NVIC_GetPendingIRQ((IRQn_Type)v->irqn) != 0U) {
+            v->pending_at = now | 1U;
+        }
+    }
+}
+
+ITCM_FUNC void irq_stats_enter(uint16_t irqn)
+{
+    uint32_t now = DWT->CYCCNT;
+    IrqStatsVector_t* v = irq_stats_vector(irqn);
+    uint32_t primask;
+    uint32_t depth;
+    uint32_t pending_at;
+
+    if (v == NULL) {
+        return;
+    }
+    primask = __get_PRIMASK();
+    __disable_irq();
+    depth = irq_depth++;
+    if (depth < IRQ_STATS_MAX_NEST) {
+        irq_frames[depth].v = v;
+        irq_frames[depth].start = now;
+        irq_frames[depth].nested_cycles = 0U;
+    }
+    pending_at = v->pending_at;
+    v->pending_at = 0U;
+    irq_stats_scan(v, now);
+    __set_PRIMASK(primask);
+
+    /* A vector does not nest with itself: the rest is only written here */
+    v->count++;
+    if (depth != 0U) {
+        v->nested++;
+        if (depth > v->depth_max) {
+            v->depth_max = depth;
+        }
+    }
+    if (pending_at != 0U) {
+        lat_hist_add(&v->delay, irq_stats_ns(now - pending_at));
+    }
+}
+
+ITCM_FUNC void irq_stats_exit(uint16_t irqn)
+{
+    uint32_t now = DWT->CYCCNT;
+    IrqStatsVector_t* v = irq_stats_vector(irqn);
+    IrqStatsFrame_t f;
+    uint32_t primask;
+    uint32_t depth;
+    uint32_t total;
+
+    if (v == NULL) {
+        return;
+    }
+    primask = __get_PRIMASK();
+    __disable_irq();
+    /* Registered while this run was in progress: nothing was pushed */
+    if (irq_depth == 0U || (irq_depth <= IRQ_STATS_MAX_NEST && irq_frames[irq_depth - 1U].v != v)) {
+        __set_PRIMASK(primask);
+        return;
+    }
+    depth = --irq_depth;
+    f.v = NULL;
+    if (depth < IRQ_STATS_MAX_NEST) {
+        f = irq_frames[depth];
+        if (depth != 0U) {
+            irq_frames[depth - 1U].nested_cycles += now - f.start;
+        }
+    }
+    irq_stats_scan(v, now);
+    __set_PRIMASK(primask);
+
+    if (f.v == NULL) {
+        return;
+    }
+    total = now - f.start;
+    lat_hist_add(&v->self, irq_stats_ns(total - f.nested_cycles));
+    if (f.nested_cycles != 0U) {
+        v->preempted++;
+        lat_hist_add(&v->preempt, irq_stats_ns(f.nested_cycles));
+    }
+    total = irq_stats_ns(total);
+    if (total > v->total_max_ns) {
+        v->total_max_ns = total;
+    }
+}
+
+#if METRICS
+/* Runs on the tcpip thread; the histograms are registered on their own */
+static void irq_stats_metrics(MetricsWriter_t* w)
+{
+    char name[METRICS_NAME_MAX];
+    uint32_t n = __atomic_load_n(&irq_vector_count, __ATOMIC_ACQUIRE);
+
+    for (uint32_t i = 0; i < n; i++) {
+        const IrqStatsVector_t* v = &irq_vectors[i];
+
+        snprintf(name, sizeof(name), "irq.%s.count", v->name);
+        metrics_emit(w, name, METRIC_COUNTER, v->count);
+        snprintf(name, sizeof(name), "irq.%s.nested", v->name);
+        metrics_emit(w, name, METRIC_COUNTER, v->nested);
+        snprintf(name, sizeof(name), "irq.%s.preempted", v->name);
+        metrics_emit(w, name, METRIC_COUNTER, v->preempted);
+        snprintf(name, sizeof(name), "irq.%s.total_max_ns", v->name);
+        metrics_emit(w, name, METRIC_GAUGE, v->total_max_ns);
+        snprintf(name, sizeof(name), "irq.%s.depth_max", v->name);
+        metrics_emit(w, name, METRIC_GAUGE, v->depth_max);
+    }
+}
+#endif
+
+bool irq_stats_register(uint16_t irqn, const char* name)
+{
+    IrqStatsVector_t* v;
+
+    if (irqn >= IRQ_STATS_IRQS || irq_vector_count >= IRQ_STATS_MAX_VECTORS) {
+        return false;
+    }
+    if (irq_slot[irqn] != 0U) {
+        return true;
+    }
+    v = &irq_vectors[irq_vector_count];
+    v->name = name;
+    v->irqn = irqn;
+#if METRICS
+    if (irq_vector_count == 0U && !metrics_register_collector(irq_stats_metrics)) {
+        return false;
+    }
+    snprintf(v->hist_name[0], IRQ_STATS_HIST_NAME, "irq.%s.self_ns", name);
+    snprintf(v->hist_name[1], IRQ_STATS_HIST_NAME, "irq.%s.preempt_ns", name);
+    snprintf(v->hist_name[2], IRQ_STATS_HIST_NAME, "irq.%s.delay_ns", name);
+    (void)metrics_register_hist(v->hist_name[0], &v->self);
+    (void)metrics_register_hist(v->hist_name[1], &v->preempt);
+    (void)metrics_register_hist(v->hist_name[2], &v->delay);
+#endif
+    /* Scanned by the hooks from here on, measured once the slot is set */
+    __atomic_store_n(&irq_vector_count, irq_vector_count + 1U, __ATOMIC_RELEASE);
+    __atomic_store_n(&irq_slot[irqn], (uint8_t)irq_vector_count, __ATOMIC_RELEASE);
+    return true;
+}
+
+#endif /* IRQ_STATS */
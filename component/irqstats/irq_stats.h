@@ -0,0 +1,74 @@
+/**
+ * @file irq_stats.h
+ * @brief Per-vector interrupt duration, preemption and delay histograms.
+ *
+ * irq_stats_enter(irqn) and irq_stats_exit(irqn) at the top and bottom of
+ * an interrupt handler timestamp it with the DWT cycle counter; vectors
+ * registered with irq_stats_register() are measured, the calls are a table
+ * lookup for the others. A stack of the wrapped handlers being run tracks
+ * nesting, so that for every vector there is
+ *  - self_ns:    its own time, entry to exit less the nested handlers
+ *  - preempt_ns: time spent in nested handlers, for the runs preempted
+ *  - delay_ns:   time it was seen pending by another wrapped handler
+ *                (at that handler's entry or exit) until its own entry
+ * as latency histograms (lathist/lat_hist.h) in nanoseconds, plus the
+ * worst entry-to-exit time, how often it ran nested and the deepest
+ * nesting. None is ever reset: the maxima are worst cases since boot.
+ *
+ * delay_ns is a lower bound of the pending time and only counts what the
+ * other wrapped handlers caused; the hardware entry and a handler's code
+ * before irq_stats_enter() are not in any figure. Unwrapped handlers count
+ * as part of the handler they preempt. Sizing priorities against a latency
+ * budget: a vector's entry can be held off by the self time of every
+ * vector at its priority or above, and by critical sections; delay_ns
+ * shows what it saw in practice.
+ *
+ * Each wrapped run costs about a hundred cycles. Exported through metrics
+ * as "irq.<name>.count", ".nested", ".preempted", ".total_max_ns",
+ * ".depth_max" and the three histograms.
+ */
+
+#pragma once
+
+#ifndef IRQ_STATS_H
+#define IRQ_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef IRQ_STATS
+#define IRQ_STATS 1
+#endif
+
+/* Vectors irq_stats_register() accepts */
+#ifndef IRQ_STATS_MAX_VECTORS
+#define IRQ_STATS_MAX_VECTORS 6U
+#endif
+
+/* Deepest nesting tracked; deeper runs are counted, not timed */
+#ifndef IRQ_STATS_MAX_NEST
+#define IRQ_STATS_MAX_NEST 8U
+#endif
+
+#if IRQ_STATS
+
+/* Starts measuring a device interrupt (IRQn >= 0) under name, which must
+ * outlive the registry. Call from a task after metrics_init(); the
+ * handler must call the two hooks below. False when the table is full. */
+bool irq_stats_register(uint16_t irqn, const char* name);
+
+/* First and last statement of the handler of irqn */
+void irq_stats_enter(uint16_t irqn);
+void irq_stats_exit(uint16_t irqn);
+
+#endif /* IRQ_STATS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IRQ_STATS_H */
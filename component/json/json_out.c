@@ -0,0 +1,227 @@
+/**
+ * @file json_out.c
+ * @brief Streaming JSON writer, see json_out.h.
+ */
+
+#include "json_out.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#if JSON_OUT_DEPTH > 32U
+#error "JSON_OUT_DEPTH is limited to 32"
+#endif
+
+void json_out_init(JsonOut_t* j)
+{
+    memset(j, 0, sizeof(*j));
+}
+
+bool json_out_chunk(JsonOut_t* j, JsonOutFn_t fn, void* arg, char* buf, uint32_t size)
+{
+    if (size < JSON_OUT_TOKEN_MAX) {
+        return false;
+    }
+    j->buf = buf;
+    j->size = size;
+    j->len = 0U;
+    j->token = 0U;
+    j->first = 1U;
+    j->arr = 0U;
+    j->depth = 0U;
+    j->full = false;
+    fn(j, arg);
+    j->last = !j->full;
+    if (j->last) {
+        j->next = j->token;
+    }
+    return true;
+}
+
+void json_out_commit(JsonOut_t* j)
+{
+    j->cursor = j->next;
+    j->done = j->last;
+}
+
+bool json_out_done(const JsonOut_t* j)
+{
+    return j->done;
+}
+
+bool json_out_full(const JsonOut_t* j)
+{
+    return j->full;
+}
+
+static bool json_out_put(JsonOut_t* j, const char* s, uint32_t n)
+{
+    if (j->len + n > j->size) {
+        return false;
+    }
+    memcpy(&j->buf[j->len], s, n);
+    j->len += n;
+    return true;
+}
+
+/* Quoted and escaped, cut at max characters */
+static bool json_out_quoted(JsonOut_t* j, const char* s, uint32_t max)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    if (!json_out_put(j, "\"", 1U)) {
+        return false;
+    }
+    for (uint32_t i = 0U; i < max && s[i] != '\0'; i++) {
+        uint8_t ch = (uint8_t)s[i];
+        char e[6] = { '\\', (char)ch, 0, 0, 0, 0 };
+        uint32_t n = 2U;
+
+        if (ch == '\n') {
+            e[1] = 'n';
+        } else if (ch == '\r') {
+            e[1] = 'r';
+        } else if (ch == '\t') {
+            e[1] = 't';
+        } else if (ch < 0x20U) {
+            e[1] = 'u';
+            e[2] = '0';
+            e[3] = '0';
+            e[4] = hex[ch >> 4];
+            e[5] = hex[ch & 0x0FU];
+            n = 6U;
+        } else if (ch != '"' && ch != '\\') {
+            e[0] = (char)ch;
+            n = 1U;
+        }
+        if (!json_out_put(j, e, n)) {
+            return false;
+        }
+    }
+    return json_out_put(j, "\"", 1U);
+}
+
+/* Counts a token; true when it belongs to this chunk, its comma and key
+ * then written unless *ok comes back false. A token that does not fit
+ * ends the chunk: json_out_done_token() rolls it back. */
+static bool json_out_begin(JsonOut_t* j, const char* key, uint32_t* start, bool* ok)
+{
+    uint32_t bit = 1UL << j->depth;
+    bool write = !j->full && j->token >= j->cursor;
+    bool comma = (j->first & bit) == 0U;
+
+    j->token++;
+    j->first &= ~bit;
+    if (!write) {
+        return false;
+    }
+    *start = j->len;
+    *ok = !comma || json_out_put(j, ",", 1U);
+    /* Array elements have no key, whatever the caller passed */
+    if (*ok && key != NULL && (j->arr & bit) == 0U) {
+        *ok = json_out_quoted(j, key, JSON_OUT_KEY_MAX) && json_out_put(j, ":", 1U);
+    }
+    return true;
+}
+
+static void json_out_done_token(JsonOut_t* j, uint32_t start, bool ok)
+{
+    if (!ok) {
+        j->len = start;
+        j->full = true;
+        j->next = j->token - 1U;
+    }
+}
+
+static void json_out_open(JsonOut_t* j, const char* key, bool arr)
+{
+    uint32_t start;
+    bool ok;
+
+    if (json_out_begin(j, key, &start, &ok)) {
+        json_out_done_token(j, start, ok && json_out_put(j, arr ? "[" : "{", 1U));
+    }
+    if (j->depth + 1U < JSON_OUT_DEPTH) {
+        j->depth++;
+        j->first |= 1UL << j->depth;
+        j->arr = arr ? (j->arr | (1UL << j->depth)) : (j->arr & ~(1UL << j->depth));
+    }
+}
+
+void json_out_obj(JsonOut_t* j, const char* key)
+{
+    json_out_open(j, key, false);
+}
+
+void json_out_arr(JsonOut_t* j, const char* key)
+{
+    json_out_open(j, key, true);
+}
+
+void json_out_end(JsonOut_t* j)
+{
+    bool arr = (j->arr & (1UL << j->depth)) != 0U;
+    bool write = !j->full && j->token >= j->cursor;
+
+    if (j->depth > 0U) {
+        j->depth--;
+    }
+    j->token++;
+    if (write && !json_out_put(j, arr ? "]" : "}", 1U)) {
+        j->full = true;
+        j->next = j->token - 1U;
+    }
+}
+
+/* A number, true or false, or null */
+static void json_out_raw(JsonOut_t* j, const char* key, const char* v, uint32_t n)
+{
+    uint32_t start;
+    bool ok;
+
+    if (json_out_begin(j, key, &start, &ok)) {
+        json_out_done_token(j, start, ok && json_out_put(j, v, n));
+    }
+}
+
+static void json_out_num(JsonOut_t* j, const char* key, uint32_t v, bool neg)
+{
+    char d[11];
+    uint32_t i = sizeof(d);
+
+    do {
+        d[--i] = (char)('0' + v % 10U);
+        v /= 10U;
+    } while (v != 0U);
+    if (neg) {
+        d[--i] = '-';
+    }
+    json_out_raw(j, key, &d[i], sizeof(d) - i);
+}
+
+void json_out_u32(JsonOut_t* j, const char* key, uint32_t v)
+{
+    json_out_num(j, key, v, false);
+}
+
+void json_out_i32(JsonOut_t* j, const char* key, int32_t v)
+{
+    json_out_num(j, key, (v < 0) ? 0U - (uint32_t)v : (uint32_t)v, v < 0);
+}
+
+void json_out_bool(JsonOut_t* j, const char* key, bool v)
+{
+    json_out_raw(j, key, v ? "true" : "false", v ? 4U : 5U);
+}
+
+void json_out_str(JsonOut_t* j, const char* key, const char* s)
+{
+    uint32_t start;
+    bool ok;
+
+    if (s == NULL) {
+        json_out_raw(j, key, "null", 4U);
+    } else if (json_out_begin(j, key, &start, &ok)) {
+        json_out_done_token(j, start, ok && json_out_quoted(j, s, JSON_OUT_STR_MAX));
+    }
+}
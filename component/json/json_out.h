@@ -0,0 +1,107 @@
+/**
+ * @file json_out.h
+ * @brief Streaming JSON writer: a document rendered chunk by chunk into a
+ *        small buffer, without keeping it whole anywhere.
+ *
+ * The document is a function (JsonOutFn_t) that writes it token by token:
+ * json_out_obj()/_arr() open a level, json_out_end() closes it, and the
+ * value calls write one member or element each; commas are the writer's
+ * business. json_out_chunk() runs the function once and keeps the tokens
+ * from the cursor on that fit the buffer; the caller sends the chunk
+ * (tcp_write() with TCP_WRITE_FLAG_COPY, pbuf_take()) and
+ * json_out_commit() moves the cursor past it. The next chunk runs the
+ * function again and skips what was sent. A chunk that could not be sent,
+ * because the send buffer filled meanwhile, is simply not committed and
+ * rendered again.
+ *
+ * So the state between chunks is a token count; nothing is allocated and
+ * a table of any length costs one chunk of RAM. The price is that the
+ * function runs once per chunk and must write the same tokens each time:
+ * a table read again per chunk may show a row changed between chunks,
+ * but the document stays well-formed as long as the token count up to
+ * the cursor does not change. A function may stop early once
+ * json_out_full() says the chunk is done.
+ *
+ * Keys are cut at JSON_OUT_KEY_MAX characters and string values at
+ * JSON_OUT_STR_MAX, so any token fits JSON_OUT_TOKEN_MAX bytes; a chunk
+ * must have room for one.
+ */
+
+#pragma once
+
+#ifndef JSON_OUT_H
+#define JSON_OUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Nesting levels, up to 32 */
+#ifndef JSON_OUT_DEPTH
+#define JSON_OUT_DEPTH 16U
+#endif
+
+#ifndef JSON_OUT_KEY_MAX
+#define JSON_OUT_KEY_MAX 64U
+#endif
+
+#ifndef JSON_OUT_STR_MAX
+#define JSON_OUT_STR_MAX 48U
+#endif
+
+/* Comma, quoted key, colon, and a string value of control characters
+ * (\u00XX each) or a number */
+#define JSON_OUT_TOKEN_MAX (1U + 2U + JSON_OUT_KEY_MAX * 6U + 1U + 2U + JSON_OUT_STR_MAX * 6U)
+
+typedef struct {
+    /* Between chunks */
+    uint32_t cursor;        /* tokens sent */
+    uint32_t next;          /* tokens in the chunk rendered last, cursor
+                               included */
+    bool done;              /* the whole document is sent */
+    bool last;              /* the chunk rendered last ends the document */
+    /* One pass */
+    char* buf;
+    uint32_t size;
+    uint32_t len;
+    uint32_t token;         /* tokens offered */
+    uint32_t first;         /* bit d: level d has no member yet */
+    uint32_t arr;           /* bit d: level d is an array */
+    uint8_t depth;
+    bool full;
+} JsonOut_t;
+
+/* Writes the whole document; the same tokens on every call */
+typedef void (*JsonOutFn_t)(JsonOut_t* j, void* arg);
+
+/* A new document, cursor at its start */
+void json_out_init(JsonOut_t* j);
+
+/* Renders the next chunk of fn's document into buf, j->len bytes; false,
+ * nothing rendered, when size is below JSON_OUT_TOKEN_MAX */
+bool json_out_chunk(JsonOut_t* j, JsonOutFn_t fn, void* arg, char* buf, uint32_t size);
+/* The chunk is sent */
+void json_out_commit(JsonOut_t* j);
+bool json_out_done(const JsonOut_t* j);
+/* The chunk is done: tokens from here on are not written */
+bool json_out_full(const JsonOut_t* j);
+
+/* key NULL inside arrays and for the document itself */
+void json_out_obj(JsonOut_t* j, const char* key);
+void json_out_arr(JsonOut_t* j, const char* key);
+void json_out_end(JsonOut_t* j);
+
+void json_out_u32(JsonOut_t* j, const char* key, uint32_t v);
+void json_out_i32(JsonOut_t* j, const char* key, int32_t v);
+void json_out_bool(JsonOut_t* j, const char* key, bool v);
+/* Escaped; NULL writes null */
+void json_out_str(JsonOut_t* j, const char* key, const char* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSON_OUT_H */
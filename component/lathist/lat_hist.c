@@ -0,0 +1,82 @@
+/**
+ * @file lat_hist.c
+ * @brief Log-scale latency histogram.
+ */
+
+#include "lat_hist.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <string.h>
+
+static uint32_t lat_hist_bin(uint32_t value)
+{
+    if (value < LAT_HIST_SUB_BINS) {
+        return value;
+    }
+    uint32_t msb = 31U - (uint32_t)__builtin_clz(value);
+    uint32_t sub = (value >> (msb - LAT_HIST_SUB_BITS)) & (LAT_HIST_SUB_BINS - 1U);
+    return (msb - LAT_HIST_SUB_BITS + 1U) * LAT_HIST_SUB_BINS + sub;
+}
+
+/* Largest value that lands in bin */
+static uint32_t lat_hist_bin_max(uint32_t bin)
+{
+    if (bin < LAT_HIST_SUB_BINS) {
+        return bin;
+    }
+    uint32_t shift = bin / LAT_HIST_SUB_BINS - 1U;
+    uint32_t sub = bin % LAT_HIST_SUB_BINS;
+    uint64_t lo = (uint64_t)(LAT_HIST_SUB_BINS + sub) << shift;
+    return (uint32_t)(lo + ((uint64_t)1U << shift) - 1U);
+}
+
+void lat_hist_add(LatHist_t* h, uint32_t value)
+{
+    uint32_t bin = lat_hist_bin(value);
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    h->bins[bin]++;
+    h->count++;
+    if (value > h->max) {
+        h->max = value;
+    }
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+void lat_hist_reset(LatHist_t* h)
+{
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    memset(h, 0, sizeof(*h));
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+void lat_hist_snapshot(const LatHist_t* h, LatHist_t* out)
+{
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    *out = *h;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+uint32_t lat_hist_percentile(const LatHist_t* h, uint32_t per10k)
+{
+    if (h->count == 0U) {
+        return 0U;
+    }
+    /* Rank of the sample, rounded up, at least the first one */
+    uint64_t rank = ((uint64_t)h->count * per10k + 9999U) / 10000U;
+    uint64_t seen = 0U;
+
+    if (rank == 0U) {
+        rank = 1U;
+    }
+    for (uint32_t bin = 0; bin < LAT_HIST_BINS; bin++) {
+        seen += h->bins[bin];
+        if (seen >= rank) {
+            uint32_t v = lat_hist_bin_max(bin);
+            return (v < h->max) ? v : h->max;
+        }
+    }
+    return h->max;
+}
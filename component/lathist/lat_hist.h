@@ -0,0 +1,49 @@
+/**
+ * @file lat_hist.h
+ * @brief Log-scale latency histogram with percentile queries.
+ *
+ * Each power of two is split into LAT_HIST_SUB_BINS linear bins, so a
+ * value is placed within 1 / LAT_HIST_SUB_BINS (25 %) of its magnitude
+ * over the whole 32-bit range, in a fixed 124-bin table. Percentiles are
+ * reported as the upper bound of the bin they fall in, capped by the
+ * largest value seen. Units are whatever the caller adds, usually cycles.
+ */
+
+#pragma once
+
+#ifndef LAT_HIST_H
+#define LAT_HIST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define LAT_HIST_SUB_BITS   2U
+#define LAT_HIST_SUB_BINS   (1U << LAT_HIST_SUB_BITS)
+/* values below LAT_HIST_SUB_BINS get a bin each, then octaves 2 .. 31 */
+#define LAT_HIST_BINS       ((32U - LAT_HIST_SUB_BITS + 1U) * LAT_HIST_SUB_BINS)
+
+typedef struct {
+    uint32_t bins[LAT_HIST_BINS];
+    uint32_t count;
+    uint32_t max;
+} LatHist_t;
+
+/* Usable from tasks and interrupts */
+void lat_hist_add(LatHist_t* h, uint32_t value);
+void lat_hist_reset(LatHist_t* h);
+
+/* Consistent copy while other contexts keep adding */
+void lat_hist_snapshot(const LatHist_t* h, LatHist_t* out);
+
+/* Value below which per10k / 10000 of the samples fall, e.g. 9990 for
+ * p99.9. 0 for an empty histogram. Best used on a snapshot. */
+uint32_t lat_hist_percentile(const LatHist_t* h, uint32_t per10k);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAT_HIST_H */
@@ -0,0 +1,345 @@
+/**
+ * @file bkp_log.c
+ * @brief Log ring and crash record in the backup SRAM, see bkp_log.h.
+ */
+
+#include "bkp_log.h"
+
+#if SYSLOG_BKP_LOG
+
+#include "syslog.h"
+#include "log_ring.h"
+
+#include "stm32h7xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BKP_LOG_TAG         "BKPLOG"
+#define BKP_LOG_MAGIC       0x424B4C31U     /* "BKL1" */
+#define BKP_LOG_HEAD_SIZE   128U
+#define BKP_LOG_TEXT_MAX    44U
+
+typedef struct {
+    volatile uint32_t seq;  /* claim index + 1 once complete, 0 otherwise */
+    uint32_t tick;
+    uint32_t tag;
+    uint32_t fmt;           /* LOG_RING_KIND_BINARY only */
+    uint8_t level;
+    uint8_t kind;           /* LOG_RING_KIND_* */
+    uint8_t len;            /* arguments, or text bytes */
+    uint8_t reserved;
+    union {
+        uint32_t args[SYSLOG_BIN_MAX_ARGS];
+        char text[BKP_LOG_TEXT_MAX];
+    };
+} BkpLogEntry_t;
+
+#define BKP_LOG_ENTRIES ((BKP_LOG_SIZE - BKP_LOG_HEAD_SIZE) / sizeof(BkpLogEntry_t))
+
+typedef struct {
+    uint32_t magic;
+    uint32_t stamp;         /* bkp_log_stamp() of the writing image */
+    uint32_t boots;
+    volatile uint32_t claim;
+    BkpLogCrash_t crash;
+    uint8_t reserved[BKP_LOG_HEAD_SIZE - 16U - sizeof(BkpLogCrash_t)];
+    BkpLogEntry_t entries[BKP_LOG_ENTRIES];
+} BkpLogArea_t;
+
+_Static_assert(sizeof(BkpLogArea_t) <= BKP_LOG_SIZE, "backup log does not fit the backup SRAM");
+_Static_assert(SYSLOG_BIN_MAX_ARGS * sizeof(uint32_t) <= BKP_LOG_TEXT_MAX, "deferred arguments do not fit an entry");
+
+#define bkp_area ((BkpLogArea_t*)BKP_LOG_BASE)
+
+/* Tells this image from others: the tag and format addresses of the
+ * previous boot are only followed when it wrote them */
+static const char bkp_log_build[] = __DATE__ " " __TIME__;
+extern const uint8_t _sidata[];
+
+static volatile bool bkp_ready;
+/* Set while the previous boot is replayed, so it is not recorded again */
+static volatile bool bkp_replaying;
+static bool bkp_prev_valid;
+static uint32_t bkp_reset_flags;
+static BkpLogArea_t bkp_prev;
+
+static uint32_t bkp_log_stamp(void)
+{
+    uint32_t h = 2166136261U;
+
+    for (const char* p = bkp_log_build; *p != '\0'; p++) {
+        h = (h ^ (uint8_t)*p) * 16777619U;
+    }
+    return h ^ (uint32_t)(uintptr_t)_sidata;
+}
+
+static void bkp_log_mpu(void)
+{
+    MPU_Region_InitTypeDef r = { 0 };
+    uint32_t primask = __get_PRIMASK();
+
+    r.Enable = MPU_REGION_ENABLE;
+    r.Number = SYSLOG_BKP_LOG_MPU_REGION;
+    r.BaseAddress = BKP_LOG_BASE;
+    r.Size = MPU_REGION_SIZE_4KB;
+    r.SubRegionDisable = 0x0;
+    r.TypeExtField = MPU_TEX_LEVEL1;
+    r.AccessPermission = MPU_REGION_FULL_ACCESS;
+    r.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+    r.IsShareable = MPU_ACCESS_NOT_SHAREABLE;
+    r.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+    r.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+
+    __disable_irq();
+    HAL_MPU_Disable();
+    HAL_MPU_ConfigRegion(&r);
+    HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+    if (primask == 0U) {
+        __enable_irq();
+    }
+}
+
+bool bkp_log_init(void)
+{
+    BkpLogArea_t* a = bkp_area;
+
+    if (bkp_ready) {
+        return true;
+    }
+    __HAL_RCC_BKPRAM_CLK_ENABLE();
+    HAL_PWR_EnableBkUpAccess();
+    bkp_log_mpu();
+
+    bkp_reset_flags = RCC->RSR;
+    __HAL_RCC_CLEAR_RESET_FLAGS();
+
+    /* Anything but a power-on leaves the previous boot's log */
+    bkp_prev_valid = a->magic == BKP_LOG_MAGIC && (bkp_reset_flags & RCC_RSR_PORRSTF) == 0U;
+    if (bkp_prev_valid) {
+        memcpy(&bkp_prev, a, sizeof(bkp_prev));
+    }
+    memset(a, 0, sizeof(*a));
+    a->stamp = bkp_log_stamp();
+    a->boots = bkp_prev_valid ? bkp_prev.boots + 1U : 1U;
+    a->magic = BKP_LOG_MAGIC;
+    bkp_ready = true;
+    return true;
+}
+
+static BkpLogEntry_t* bkp_log_claim(uint32_t* idx)
+{
+    *idx = __atomic_fetch_add(&bkp_area->claim, 1U, __ATOMIC_RELAXED);
+    BkpLogEntry_t* e = &bkp_area->entries[*idx % BKP_LOG_ENTRIES];
+    e->seq = 0U;
+    return e;
+}
+
+static void bkp_log_publish(BkpLogEntry_t* e, uint32_t idx)
+{
+    __DMB();
+    e->seq = idx + 1U;
+}
+
+void bkp_log_bin(int level, const char* tag, const char* fmt, uint32_t nargs, const uint32_t* args)
+{
+    BkpLogEntry_t* e;
+    uint32_t idx;
+
+    if (!bkp_ready || bkp_replaying) {
+        return;
+    }
+    if (nargs > SYSLOG_BIN_MAX_ARGS) {
+        nargs = SYSLOG_BIN_MAX_ARGS;
+    }
+    e = bkp_log_claim(&idx);
+    e->tick = HAL_GetTick();
+    e->tag = (uint32_t)(uintptr_t)tag;
+    e->fmt = (uint32_t)(uintptr_t)fmt;
+    e->level = (uint8_t)level;
+    e->kind = LOG_RING_KIND_BINARY;
+    e->len = (uint8_t)nargs;
+    for (uint32_t i = 0U; i < nargs; i++) {
+        e->args[i] = args[i];
+    }
+    bkp_log_publish(e, idx);
+}
+
+void bkp_log_text(int level, const char* tag, const char* msg)
+{
+    BkpLogEntry_t* e;
+    uint32_t idx;
+    uint32_t len;
+
+    if (!bkp_ready || bkp_replaying) {
+        return;
+    }
+    len = (uint32_t)strnlen(msg, BKP_LOG_TEXT_MAX);
+    e = bkp_log_claim(&idx);
+    e->tick = HAL_GetTick();
+    e->tag = (uint32_t)(uintptr_t)tag;
+    e->fmt = 0U;
+    e->level = (uint8_t)level;
+    e->kind = LOG_RING_KIND_TEXT;
+    e->len = (uint8_t)len;
+    memcpy(e->text, msg, len);
+    bkp_log_publish(e, idx);
+}
+
+static void bkp_log_task_name(char* out, size_t size)
+{
+    if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) {
+        strncpy(out, "-", size);
+        return;
+    }
+    strncpy(out, pcTaskGetName(xTaskGetCurrentTaskHandle()), size - 1U);
+    out[size - 1U] = '\0';
+}
+
+void bkp_log_crash(uint32_t cause, uint32_t pc, const char* task)
+{
+    BkpLogCrash_t* c = &bkp_area->crash;
+
+    if (!bkp_ready || c->cause != 0U) {
+        return;
+    }
+    c->tick = HAL_GetTick();
+    c->pc = pc;
+    c->lr = 0U;
+    c->psr = __get_xPSR();
+    c->cfsr = SCB->CFSR;
+    c->hfsr = SCB->HFSR;
+    c->addr = 0U;
+    if (task != NULL) {
+        strncpy(c->task, task, sizeof(c->task) - 1U);
+    } else {
+        bkp_log_task_name(c->task, sizeof(c->task));
+    }
+    __DMB();
+    c->cause = cause;
+}
+
+void bkp_log_reset(void)
+{
+#if SYSLOG_BKP_LOG_RESET
+    if ((CoreDebug->DHCSR & CoreDebug_DHCSR_C_DEBUGEN_Msk) == 0U) {
+        NVIC_SystemReset();
+    }
+#endif
+}
+
+void bkp_log_hard_fault(const uint32_t* frame, uint32_t exc_return)
+{
+    BkpLogCrash_t* c = &bkp_area->crash;
+
+    if (bkp_ready && c->cause == 0U) {
+        uint32_t cfsr = SCB->CFSR;
+
+        c->tick = HAL_GetTick();
+        c->lr = frame[5];
+        c->pc = frame[6];
+        c->psr = frame[7];
+        c->cfsr = cfsr;
+        c->hfsr = SCB->HFSR;
+        c->addr = ((cfsr & SCB_CFSR_MMARVALID_Msk) != 0U) ? SCB->MMFAR :
+                  ((cfsr & SCB_CFSR_BFARVALID_Msk) != 0U) ? SCB->BFAR : 0U;
+        /* The process stack is a task's; the main stack an interrupt's */
+        if ((exc_return & 0x4U) != 0U) {
+            bkp_log_task_name(c->task, sizeof(c->task));
+        } else {
+            strncpy(c->task, "ISR", sizeof(c->task));
+        }
+        __DMB();
+        c->cause = BKP_LOG_CRASH_HARD_FAULT;
+    }
+    bkp_log_reset();
+    for (;;) {
+    }
+}
+
+/* Tags and formats of this image live in its flash */
+static const char* bkp_log_string(uint32_t addr, bool same)
+{
+    if (!same || addr < FLASH_BANK1_BASE || addr > FLASH_END) {
+        return NULL;
+    }
+    return (const char*)(uintptr_t)addr;
+}
+
+static void bkp_log_replay_entry(const BkpLogEntry_t* e, bool same)
+{
+    const char* tag = bkp_log_string(e->tag, same);
+    const char* fmt = bkp_log_string(e->fmt, same);
+    char msg[SYSLOG_RECORD_SIZE];
+
+    if (tag == NULL) {
+        tag = BKP_LOG_TAG;
+    }
+    if (e->kind == LOG_RING_KIND_TEXT) {
+        logger_printf(e->level, tag, "[prev %lu ms] %.*s", (unsigned long)e->tick, (int)e->len, e->text);
+        return;
+    }
+    if (fmt != NULL) {
+        logger_bin_format(msg, sizeof(msg), fmt, e->len, e->args);
+    } else {
+        int n = snprintf(msg, sizeof(msg), "fmt 0x%08lx tag 0x%08lx args", (unsigned long)e->fmt,
+                         (unsigned long)e->tag);
+        for (uint32_t i = 0U; i < e->len && n > 0 && (size_t)n < sizeof(msg); i++) {
+            n += snprintf(&msg[n], sizeof(msg) - (size_t)n, " %08lx", (unsigned long)e->args[i]);
+        }
+    }
+    logger_printf(e->level, tag, "[prev %lu ms] %s", (unsigned long)e->tick, msg);
+}
+
+static const char* bkp_log_crash_name(uint32_t cause)
+{
+    switch (cause) {
+    case BKP_LOG_CRASH_ERROR:
+        return "Error_Handler";
+    case BKP_LOG_CRASH_STACK_OVERFLOW:
+        return "stack overflow";
+    case BKP_LOG_CRASH_HARD_FAULT:
+        return "hard fault";
+    case BKP_LOG_CRASH_DEADLINE:
+        return "latency budget";
+    default:
+        return "crash";
+    }
+}
+
+void bkp_log_replay(void)
+{
+    const BkpLogCrash_t* c = &bkp_prev.crash;
+    bool same = bkp_prev.stamp == bkp_log_stamp();
+    uint32_t end = bkp_prev.claim;
+    uint32_t first = (end > BKP_LOG_ENTRIES) ? end - BKP_LOG_ENTRIES : 0U;
+
+    if (!bkp_prev_valid) {
+        return;
+    }
+    bkp_prev_valid = false;
+    bkp_replaying = true;
+    logger_printf(LOG_LEVEL_INFO, BKP_LOG_TAG, "boot %lu, reset flags 0x%08lx, %lu records kept%s",
+                  (unsigned long)bkp_area->boots, (unsigned long)bkp_reset_flags, (unsigned long)(end - first),
+                  same ? "" : " by another image");
+    for (uint32_t i = first; i != end; i++) {
+        const BkpLogEntry_t* e = &bkp_prev.entries[i % BKP_LOG_ENTRIES];
+        /* Torn by the reset, or reclaimed by a later record */
+        if (e->seq == i + 1U) {
+            bkp_log_replay_entry(e, same);
+        }
+    }
+    if (c->cause != 0U) {
+        logger_printf(LOG_LEVEL_ERROR, BKP_LOG_TAG,
+                      "previous boot: %s at %lu ms in %.16s, pc 0x%08lx lr 0x%08lx psr 0x%08lx "
+                      "cfsr 0x%08lx hfsr 0x%08lx addr 0x%08lx",
+                      bkp_log_crash_name(c->cause), (unsigned long)c->tick, c->task, (unsigned long)c->pc,
+                      (unsigned long)c->lr, (unsigned long)c->psr, (unsigned long)c->cfsr, (unsigned long)c->hfsr,
+                      (unsigned long)c->addr);
+    }
+    bkp_replaying = false;
+}
+
+#endif /* SYSLOG_BKP_LOG */
@@ -0,0 +1,103 @@
+/**
+ * @file bkp_log.h
+ * @brief Log ring and crash record in the backup SRAM, kept across resets.
+ *
+ * The 4 KB backup SRAM (D3 domain, BKP_LOG_BASE) keeps its content through
+ * every reset but a power loss. Records up to the level of the "bkp" sink
+ * (log_sink.h, SYSLOG_BKP_LOG_LEVEL at boot) are copied there as they are
+ * logged, in the deferred format of LOG_BIN(): a tick, the tag and format
+ * addresses and the raw arguments; text lines keep the head of the message.
+ * A producer claims an entry with one atomic increment and publishes it by
+ * writing its sequence number last, so tasks and interrupts write without a
+ * lock and an entry cut by a reset is recognised. MPU region
+ * SYSLOG_BKP_LOG_MPU_REGION makes the area non-cacheable: nothing waits in
+ * the D-cache when the reset comes.
+ *
+ * Error_Handler(), vApplicationStackOverflowHook() and HardFault_Handler()
+ * fill a separate crash record, the first crash of a boot only: the
+ * others tend to be its consequences. The supervisor records the first
+ * blown latency budget there too (supervisor/supervisor.h), the likely
+ * cause of an IWDG reset.
+ *
+ * bkp_log_init() takes the previous boot's content aside and starts over;
+ * bkp_log_replay() sends it to syslog once init_logger() ran, so it waits
+ * in the syslog ring until the network is up. Tags and formats are printed
+ * when the image is the one that wrote them, addresses otherwise.
+ */
+
+#pragma once
+
+#ifndef LOGGER_BKP_LOG_H
+#define LOGGER_BKP_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "syslog_opts.h"
+
+#define BKP_LOG_BASE            0x38800000U
+#define BKP_LOG_SIZE            4096U
+
+/* Above region 4 (QSPI flash) */
+#ifndef SYSLOG_BKP_LOG_MPU_REGION
+#define SYSLOG_BKP_LOG_MPU_REGION MPU_REGION_NUMBER5
+#endif
+
+/* BkpLogCrash_t.cause */
+#define BKP_LOG_CRASH_ERROR             1U  /* Error_Handler() */
+#define BKP_LOG_CRASH_STACK_OVERFLOW    2U  /* vApplicationStackOverflowHook() */
+#define BKP_LOG_CRASH_HARD_FAULT        3U
+#define BKP_LOG_CRASH_DEADLINE          4U  /* supervisor: latency budget blown, task is the check */
+
+typedef struct {
+    uint32_t cause;         /* BKP_LOG_CRASH_*, 0: none */
+    uint32_t tick;
+    uint32_t pc;            /* caller, or the faulting instruction */
+    uint32_t lr;
+    uint32_t psr;
+    uint32_t cfsr;          /* hard fault: SCB->CFSR, ->HFSR, ->MMFAR or ->BFAR */
+    uint32_t hfsr;
+    uint32_t addr;
+    char task[16];
+} BkpLogCrash_t;
+
+/* Enables the backup SRAM and maps it non-cacheable, saves what the
+ * previous boot left and starts this boot's log. Call once from main(),
+ * after SystemClock_Config(). */
+bool bkp_log_init(void);
+
+/* Logger hooks, any context. Not filtered by level here. */
+void bkp_log_bin(int level, const char* tag, const char* fmt, uint32_t nargs, const uint32_t* args);
+void bkp_log_text(int level, const char* tag, const char* msg);
+
+/* Queues the previous boot's records and crash to syslog, oldest first.
+ * Task context, after init_logger(). */
+void bkp_log_replay(void);
+
+/* Records a crash at pc in task, the running one when NULL */
+void bkp_log_crash(uint32_t cause, uint32_t pc, const char* task);
+/* With SYSLOG_BKP_LOG_RESET, resets unless a debugger is attached; returns
+ * otherwise. */
+void bkp_log_reset(void);
+
+/* Records the hard fault of the exception frame, then bkp_log_reset() */
+void bkp_log_hard_fault(const uint32_t* frame, uint32_t exc_return) __attribute__((noreturn));
+
+/* First statement of a naked HardFault_Handler(): hands the stacked frame
+ * of the faulting context to bkp_log_hard_fault() */
+#define BKP_LOG_HARD_FAULT() \
+    __asm volatile("tst lr, #4\n"           \
+                   "ite eq\n"               \
+                   "mrseq r0, msp\n"        \
+                   "mrsne r0, psp\n"        \
+                   "mov r1, lr\n"           \
+                   "b bkp_log_hard_fault\n")
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGGER_BKP_LOG_H */
@@ -0,0 +1,119 @@
+/**
+ * @file console.c
+ * @brief Non-blocking console, see console.h.
+ */
+
+#include "console.h"
+
+#if SYSLOG_CONSOLE
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <errno.h>
+
+#define CONSOLE_MASK (SYSLOG_CONSOLE_RING_SIZE - 1U)
+
+_Static_assert((SYSLOG_CONSOLE_RING_SIZE & CONSOLE_MASK) == 0U, "SYSLOG_CONSOLE_RING_SIZE must be a power of two");
+_Static_assert(SYSLOG_CONSOLE_ITM_PORT < 32, "ITM has 32 stimulus ports");
+
+typedef struct {
+    uint32_t head;          /* free-running, masked on access */
+    uint32_t tail;
+    ConsoleStats_t stats;
+    char buf[SYSLOG_CONSOLE_RING_SIZE];
+} Console_t;
+
+static Console_t con;
+
+/* Set by the debugger: ITM on, trace enabled and the port unmasked */
+static bool console_itm_on(void)
+{
+    return ((CoreDebug->DEMCR & CoreDebug_DEMCR_TRCENA_Msk) != 0U) && ((ITM->TCR & ITM_TCR_ITMENA_Msk) != 0U) &&
+           ((ITM->TER & (1UL << SYSLOG_CONSOLE_ITM_PORT)) != 0U);
+}
+
+/* Interrupts masked; stops at the first byte the ITM FIFO cannot take */
+static void console_drain_locked(void)
+{
+    uint32_t n = 0U;
+
+    while ((con.tail != con.head) && (n < SYSLOG_CONSOLE_DRAIN_MAX)) {
+        if (ITM->PORT[SYSLOG_CONSOLE_ITM_PORT].u32 == 0U) {
+            break;
+        }
+        ITM->PORT[SYSLOG_CONSOLE_ITM_PORT].u8 = (uint8_t)con.buf[con.tail & CONSOLE_MASK];
+        con.tail++;
+        n++;
+    }
+    con.stats.written += n;
+}
+
+void console_drain(void)
+{
+    UBaseType_t saved;
+
+    if (con.tail == con.head) {
+        return;
+    }
+    saved = taskENTER_CRITICAL_FROM_ISR();
+    if (console_itm_on()) {
+        console_drain_locked();
+    } else {
+        /* The debugger went away */
+        con.stats.discarded += con.head - con.tail;
+        con.tail = con.head;
+    }
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+bool console_pending(void)
+{
+    return con.tail != con.head;
+}
+
+void console_get_stats(ConsoleStats_t* stats)
+{
+    UBaseType_t saved = taskENTER_CRITICAL_FROM_ISR();
+
+    *stats = con.stats;
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+}
+
+/* Overrides the weak _write() of syscalls.c: stdout and stderr */
+int _write(int file, char* ptr, int len)
+{
+    UBaseType_t saved;
+    uint32_t room;
+    uint32_t n;
+
+    if ((file != 1) && (file != 2)) {
+        errno = EBADF;
+        return -1;
+    }
+    if (len <= 0) {
+        return 0;
+    }
+
+    saved = taskENTER_CRITICAL_FROM_ISR();
+    if (!console_itm_on()) {
+        con.stats.discarded += (uint32_t)len;
+        taskEXIT_CRITICAL_FROM_ISR(saved);
+        return len;
+    }
+    room = SYSLOG_CONSOLE_RING_SIZE - (con.head - con.tail);
+    n = ((uint32_t)len < room) ? (uint32_t)len : room;
+    for (uint32_t i = 0U; i < n; i++) {
+        con.buf[(con.head + i) & CONSOLE_MASK] = ptr[i];
+    }
+    con.head += n;
+    con.stats.dropped += (uint32_t)len - n;
+    console_drain_locked();
+    taskEXIT_CRITICAL_FROM_ISR(saved);
+
+    /* All of it, dropped bytes included: newlib must not retry */
+    return len;
+}
+
+#endif /* SYSLOG_CONSOLE */
@@ -0,0 +1,51 @@
+/**
+ * @file console.h
+ * @brief Non-blocking console: printf() output through a RAM ring to ITM/SWO.
+ *
+ * console.c provides _write(), which overrides the weak one of syscalls.c
+ * that looped over __io_putchar() a byte at a time. A write copies into a
+ * SYSLOG_CONSOLE_RING_SIZE ring and returns; what does not fit is dropped
+ * and counted, so the early boot messages and the logger's printf fallback
+ * cost a memcpy instead of the line time of a serial port.
+ *
+ * The ring drains to ITM stimulus port SYSLOG_CONSOLE_ITM_PORT, as far as
+ * the ITM FIFO takes bytes without waiting: from _write() itself and from
+ * the 1 ms HAL tick. The board has no UART wired for a console, the SWO pin
+ * goes to the ST-LINK (SWV console in the IDE, or openocd "itm port 0 on").
+ * Without a debugger enabling the ITM, writes are discarded and counted.
+ */
+
+#pragma once
+
+#ifndef LOGGER_CONSOLE_H
+#define LOGGER_CONSOLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "syslog_opts.h"
+
+typedef struct {
+    uint32_t written;       /* bytes sent to the ITM */
+    uint32_t dropped;       /* bytes that found the ring full */
+    uint32_t discarded;     /* bytes written with the ITM port disabled */
+} ConsoleStats_t;
+
+#if SYSLOG_CONSOLE
+/* Moves up to SYSLOG_CONSOLE_DRAIN_MAX bytes to the ITM, any context */
+void console_drain(void);
+
+/* Bytes waiting in the ring */
+bool console_pending(void);
+
+void console_get_stats(ConsoleStats_t* stats);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGGER_CONSOLE_H */
@@ -0,0 +1,335 @@
+/**
+ * @file log_ctl.c
+ * @brief Logger configuration over UDP, see log_ctl.h.
+ */
+
+#include "log_ctl.h"
+
+#if SYSLOG_CTL
+
+#include "syslog.h"
+#include "log_limit.h"
+#include "log_sink.h"
+
+#include "lwip/opt.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define LOG_CTL_TAG "LOGCTL"
+
+/* Longest command datagram and reply */
+#define LOG_CTL_MSG_MAX   256U
+#define LOG_CTL_REPLY_MAX 768U
+
+typedef struct {
+    struct udp_pcb* pcb;
+    TaskHandle_t task;
+    ip_addr_t peer;
+    bool any_peer;
+    /* Set by the callback with a command in cmd, cleared by the task */
+    volatile uint32_t busy;
+    ip_addr_t src;
+    uint16_t src_port;
+    char cmd[LOG_CTL_MSG_MAX + 1U];
+    char reply[LOG_CTL_REPLY_MAX];
+    uint32_t reply_len;
+    LogCtlStats_t stats;
+} LogCtl_t;
+
+static LogCtl_t ctl;
+static StaticTask_t log_ctl_tcb;
+static StackType_t log_ctl_stack[SYSLOG_CTL_STACK_WORDS];
+
+static const char* const log_ctl_levels[] = { "none", "error", "warning", "info", "debug", "verbose" };
+
+#define LOG_CTL_COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+static void log_ctl_printf(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void log_ctl_printf(const char* fmt, ...)
+{
+    uint32_t room = sizeof(ctl.reply) - ctl.reply_len;
+    va_list ap;
+    int n;
+
+    if (room <= 1U) {
+        return;
+    }
+    va_start(ap, fmt);
+    n = vsnprintf(&ctl.reply[ctl.reply_len], room, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        ctl.reply_len += ((uint32_t)n < room) ? (uint32_t)n : room - 1U;
+    }
+}
+
+static const char* log_ctl_level_name(log_level_t level)
+{
+    return ((level >= LOG_LEVEL_NONE) && (level <= LOG_LEVEL_VERBOSE)) ? log_ctl_levels[level] : "?";
+}
+
+static bool log_ctl_parse_level(const char* s, log_level_t* level)
+{
+    for (uint32_t i = 0; i < LOG_CTL_COUNT(log_ctl_levels); i++) {
+        if ((strcasecmp(s, log_ctl_levels[i]) == 0) || ((s[0] == (char)('0' + i)) && (s[1] == '\0'))) {
+            *level = (log_level_t)i;
+            return true;
+        }
+    }
+    /* As the LOG_* macros spell it */
+    if (strcasecmp(s, "warn") == 0) {
+        *level = LOG_LEVEL_WARNING;
+        return true;
+    }
+    return false;
+}
+
+static bool log_ctl_parse_u32(const char* s, uint32_t* v)
+{
+    char* end;
+    unsigned long n;
+
+    if ((s == NULL) || (*s == '\0')) {
+        return false;
+    }
+    n = strtoul(s, &end, 10);
+    if ((*end != '\0') || (n > UINT32_MAX)) {
+        return false;
+    }
+    *v = (uint32_t)n;
+    return true;
+}
+
+/* The configuration, in command syntax */
+static void log_ctl_show(void)
+{
+    char tag[SYSLOG_TAG_NAME_MAX];
+    log_level_t level;
+    uint32_t rate;
+    uint32_t burst;
+
+    log_ctl_printf("level %s\n", log_ctl_level_name(logger_get_min_level()));
+    for (uint32_t i = 0; logger_get_tag_level(i, tag, sizeof(tag), &level); i++) {
+        log_ctl_printf("tag %s %s\n", tag, log_ctl_level_name(level));
+    }
+    log_limit_get(&rate, &burst);
+    log_ctl_printf("limit %lu %lu\n", (unsigned long)rate, (unsigned long)burst);
+    for (const LogSink_t* k = log_sink_first(); k != NULL; k = k->next) {
+        log_ctl_printf("sink %s %s\n", k->name, log_ctl_level_name(k->level));
+        if (log_sink_has_lz4(k)) {
+            log_ctl_printf("sink %s lz4 %s\n", k->name, k->lz4 ? "on" : "off");
+        }
+    }
+}
+
+/* Runs one command of argc words; NULL on success, else the error */
+static const char* log_ctl_exec(uint32_t argc, char** argv)
+{
+    log_level_t level;
+    uint32_t a;
+    uint32_t b;
+
+    if (strcmp(argv[0], "show") == 0) {
+        return NULL;
+    }
+    if (strcmp(argv[0], "level") == 0) {
+        if ((argc != 2U) || !log_ctl_parse_level(argv[1], &level)) {
+            return "usage: level <none|error|warning|info|debug|verbose>";
+        }
+        logger_set_min_level(level);
+        return (logger_get_min_level() == level) ? NULL : "logger busy";
+    }
+    if (strcmp(argv[0], "tag") == 0) {
+        if (argc != 3U) {
+            return "usage: tag <tag> <level|default>";
+        }
+        if (strlen(argv[1]) >= SYSLOG_TAG_NAME_MAX) {
+            return "tag too long";
+        }
+        if (strcmp(argv[2], "default") == 0) {
+            logger_clear_tag_level(argv[1]);
+            return NULL;
+        }
+        if (!log_ctl_parse_level(argv[2], &level)) {
+            return "bad level";
+        }
+        return logger_set_tag_level(argv[1], level) ? NULL : "tag table full";
+    }
+    if (strcmp(argv[0], "limit") == 0) {
+        if ((argc != 3U) || !log_ctl_parse_u32(argv[1], &a) || !log_ctl_parse_u32(argv[2], &b)) {
+            return "usage: limit <rate> <burst>";
+        }
+        return log_limit_set(a, b) ? NULL : "rate 0..1000, burst 1..1000";
+    }
+    if (strcmp(argv[0], "sink") == 0) {
+        LogSink_t* sink;
+
+        if ((argc != 3U) && ((argc != 4U) || (strcmp(argv[2], "lz4") != 0))) {
+            return "usage: sink <name> <on|off|level>, sink <name> lz4 <on|off>";
+        }
+        sink = log_sink_find(argv[1]);
+        if (sink == NULL) {
+            return "unknown sink";
+        }
+        if (argc == 4U) {
+            if ((strcmp(argv[3], "on") != 0) && (strcmp(argv[3], "off") != 0)) {
+                return "usage: sink <name> lz4 <on|off>";
+            }
+            return log_sink_set_lz4(sink, strcmp(argv[3], "on") == 0) ? NULL : "no lz4 on this sink";
+        }
+        if (strcmp(argv[2], "on") == 0) {
+            level = LOG_LEVEL_VERBOSE;
+        } else if (strcmp(argv[2], "off") == 0) {
+            level = LOG_LEVEL_NONE;
+        } else if (!log_ctl_parse_level(argv[2], &level)) {
+            return "bad level";
+        }
+        log_sink_set_level(sink, level);
+        return NULL;
+    }
+    return "unknown command";
+}
+
+static void log_ctl_run(void)
+{
+    char src[IPADDR_STRLEN_MAX];
+    char* save_line;
+    char* save_word;
+    char* argv[4];
+
+    ctl.reply_len = 0U;
+    ipaddr_ntoa_r(&ctl.src, src, sizeof(src));
+    for (char* line = strtok_r(ctl.cmd, "\n;", &save_line); line != NULL; line = strtok_r(NULL, "\n;", &save_line)) {
+        uint32_t argc = 0U;
+        const char* err;
+
+        for (char* w = strtok_r(line, " \t\r", &save_word); w != NULL; w = strtok_r(NULL, " \t\r", &save_word)) {
+            if (argc < LOG_CTL_COUNT(argv)) {
+                argv[argc] = w;
+            }
+            argc++;
+        }
+        if (argc == 0U) {
+            continue;
+        }
+        err = (argc <= LOG_CTL_COUNT(argv)) ? log_ctl_exec(argc, argv) : "too many words";
+        if (err != NULL) {
+            ctl.stats.errors++;
+            log_ctl_printf("error: %s\n", err);
+        } else {
+            log_ctl_printf("ok\n");
+            if (strcmp(argv[0], "show") != 0) {
+                LOG_WARNING(LOG_CTL_TAG, "%s: %s%s%s%s%s", src, argv[0], (argc > 1U) ? " " : "",
+                         (argc > 1U) ? argv[1] : "", (argc > 2U) ? " " : "", (argc > 2U) ? argv[2] : "");
+            }
+        }
+    }
+    log_ctl_show();
+}
+
+static void log_ctl_reply(void)
+{
+    struct pbuf* p;
+
+    LOCK_TCPIP_CORE();
+    p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)ctl.reply_len, PBUF_RAM);
+    if (p != NULL) {
+        (void)pbuf_take(p, ctl.reply, (u16_t)ctl.reply_len);
+        (void)udp_sendto(ctl.pcb, p, &ctl.src, ctl.src_port);
+        pbuf_free(p);
+    }
+    UNLOCK_TCPIP_CORE();
+}
+
+static void log_ctl_task(void* argument)
+{
+    (void)argument;
+
+    for (;;) {
+        (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (ctl.busy == 0U) {
+            continue;
+        }
+        log_ctl_run();
+        log_ctl_reply();
+        ctl.stats.datagrams++;
+        ctl.busy = 0U;
+    }
+}
+
+/* tcpip thread: hands the datagram over, the task does the rest */
+static void log_ctl_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    (void)arg;
+    (void)pcb;
+
+    if (ctl.busy != 0U) {
+        ctl.stats.busy++;
+    } else if ((p->tot_len > LOG_CTL_MSG_MAX) || (!ctl.any_peer && !ip_addr_cmp(addr, &ctl.peer))) {
+        ctl.stats.refused++;
+    } else {
+        (void)pbuf_copy_partial(p, ctl.cmd, p->tot_len, 0U);
+        ctl.cmd[p->tot_len] = '\0';
+        ip_addr_copy(ctl.src, *addr);
+        ctl.src_port = port;
+        ctl.busy = 1U;
+        xTaskNotifyGive(ctl.task);
+    }
+    pbuf_free(p);
+}
+
+bool log_ctl_start(void)
+{
+    bool ok = false;
+
+    if (ctl.task != NULL) {
+        return false;
+    }
+    ctl.any_peer = (SYSLOG_CTL_PEER[0] == '\0');
+    if (!ctl.any_peer && !ipaddr_aton(SYSLOG_CTL_PEER, &ctl.peer)) {
+        LOG_ERROR(LOG_CTL_TAG, "bad SYSLOG_CTL_PEER %s", SYSLOG_CTL_PEER);
+        return false;
+    }
+    ctl.task = xTaskCreateStatic(log_ctl_task, "LogCtl", SYSLOG_CTL_STACK_WORDS, NULL, SYSLOG_CTL_PRIORITY,
+                                 log_ctl_stack, &log_ctl_tcb);
+    if (ctl.task == NULL) {
+        LOG_ERROR(LOG_CTL_TAG, "no task");
+        return false;
+    }
+
+    LOCK_TCPIP_CORE();
+    ctl.pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if ((ctl.pcb != NULL) && (udp_bind(ctl.pcb, IP_ANY_TYPE, SYSLOG_CTL_PORT) == ERR_OK)) {
+        udp_recv(ctl.pcb, log_ctl_recv, NULL);
+        ok = true;
+    } else if (ctl.pcb != NULL) {
+        udp_remove(ctl.pcb);
+        ctl.pcb = NULL;
+    }
+    UNLOCK_TCPIP_CORE();
+
+    if (!ok) {
+        LOG_ERROR(LOG_CTL_TAG, "cannot bind UDP port %u", (unsigned)SYSLOG_CTL_PORT);
+        return false;
+    }
+    LOG_INFO(LOG_CTL_TAG, "logger configuration on UDP port %u%s%s", (unsigned)SYSLOG_CTL_PORT,
+             ctl.any_peer ? "" : " from ", SYSLOG_CTL_PEER);
+    return true;
+}
+
+void log_ctl_get_stats(LogCtlStats_t* stats)
+{
+    *stats = ctl.stats;
+}
+
+#endif /* SYSLOG_CTL */
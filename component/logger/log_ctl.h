@@ -0,0 +1,62 @@
+/**
+ * @file log_ctl.h
+ * @brief Logger configuration over UDP: levels, rate limit and sinks at run time.
+ *
+ * A datagram to SYSLOG_CTL_PORT holds one or more commands, separated by
+ * newlines or ';':
+ *
+ *   show
+ *   level <level>              global minimum, logger_set_min_level()
+ *   tag <tag> <level>          per-tag override, logger_set_tag_level()
+ *   tag <tag> default          back to the global level
+ *   limit <rate> <burst>       records per second per tag and level, 0 off
+ *   sink <name> <level>        a sink's level (log_sink.h), on is verbose
+ *   sink <name> <on|off>
+ *   sink <name> lz4 <on|off>   LZ4 blocks on syslog (TCP) and flash, SYSLOG_LZ4
+ *
+ * Levels are none, error, warning, info, debug, verbose or 0 to 5. The
+ * reply goes to the source: "ok" or "error: ..." per command, then the
+ * whole configuration in the same syntax, which can be sent back as is.
+ * Changes are logged as warnings (tag "LOGCTL") with the sender's address;
+ * they last until the next reset.
+ *
+ * The udp_recv() callback only copies the datagram; the commands run on a
+ * task of their own, because the logger setters take the syslog mutex and
+ * the sender task takes that before the core lock. One command datagram
+ * is handled at a time, others arriving meanwhile are dropped and counted.
+ * tools/log_ctl.py is a client.
+ */
+
+#pragma once
+
+#ifndef LOGGER_LOG_CTL_H
+#define LOGGER_LOG_CTL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "syslog_opts.h"
+
+typedef struct {
+    uint32_t datagrams;     /* handled */
+    uint32_t errors;        /* commands answered with an error */
+    uint32_t busy;          /* dropped: the previous datagram still running */
+    uint32_t refused;       /* not from SYSLOG_CTL_PEER, or oversized */
+} LogCtlStats_t;
+
+#if SYSLOG_CTL
+/* Binds SYSLOG_CTL_PORT and starts the task. Once from a task, not
+ * holding the core lock, after init_logger(). */
+bool log_ctl_start(void);
+
+void log_ctl_get_stats(LogCtlStats_t* stats);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGGER_LOG_CTL_H */
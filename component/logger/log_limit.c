@@ -0,0 +1,180 @@
+/**
+ * @file log_limit.c
+ * @brief Token-bucket rate limiter and duplicate coalescing for the logger.
+ */
+
+#include "log_limit.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <string.h>
+
+#if (SYSLOG_LIMIT_BUCKETS & (SYSLOG_LIMIT_BUCKETS - 1)) != 0
+#error "SYSLOG_LIMIT_BUCKETS must be a power of two"
+#endif
+
+/* Tokens are kept in thousandths so that refill is exact per millisecond. */
+#define LOG_LIMIT_TOKEN   1000U
+/* Keeps the refill product within 32 bits */
+#define LOG_LIMIT_MAX     1000U
+
+typedef struct {
+    uint32_t tokens;
+    uint32_t last_tick;
+    uint32_t limited;
+    bool used;
+} LogBucket_t;
+
+typedef struct {
+    uint32_t hash;          /* message + tag + level of the last record */
+    uint32_t repeats;
+    uint32_t first_tick;    /* tick of the first suppressed duplicate */
+    log_level_t level;
+    char tag[SYSLOG_TAG_NAME_MAX];
+    bool valid;
+} LogDedup_t;
+
+static LogBucket_t buckets[SYSLOG_LIMIT_BUCKETS];
+static LogDedup_t last;
+#if SYSLOG_LIMIT
+/* Set at run time by log_limit_set(); rate 0 lets everything through */
+static uint32_t limit_rate = SYSLOG_LIMIT_RATE;
+static uint32_t limit_burst = SYSLOG_LIMIT_BURST;
+static uint32_t limit_cap = (uint32_t)SYSLOG_LIMIT_BURST * LOG_LIMIT_TOKEN;
+#endif
+
+uint32_t log_limit_hash(const void* data, size_t len, uint32_t seed)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint32_t h = seed;
+    while (len--) {
+        h ^= *p++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static uint32_t log_limit_key(log_level_t level, const char* tag)
+{
+    uint32_t h = log_limit_hash(tag, strnlen(tag, SYSLOG_TAG_NAME_MAX), LOG_LIMIT_HASH_SEED);
+    return log_limit_hash(&level, sizeof(level), h);
+}
+
+/* Moves pending duplicates into rep. Called in the critical section. */
+static void log_limit_take_repeats(LogLimitReport_t* rep)
+{
+    rep->repeats = last.repeats;
+    rep->repeat_level = last.level;
+    memcpy(rep->repeat_tag, last.tag, sizeof(rep->repeat_tag));
+    last.repeats = 0;
+}
+
+#if SYSLOG_LIMIT
+static bool log_limit_bucket_take(LogBucket_t* b, uint32_t now, uint32_t* limited)
+{
+    if (!b->used) {
+        b->used = true;
+        b->tokens = limit_cap;
+    } else {
+        uint32_t elapsed = now - b->last_tick;
+        /* Clamp first so the refill product cannot overflow. */
+        if (elapsed > limit_cap) elapsed = limit_cap;
+        b->tokens += elapsed * limit_rate;
+        if (b->tokens > limit_cap) b->tokens = limit_cap;
+    }
+    b->last_tick = now;
+
+    if (limit_rate != 0U && b->tokens < LOG_LIMIT_TOKEN) {
+        b->limited++;
+        return false;
+    }
+    if (b->tokens >= LOG_LIMIT_TOKEN) b->tokens -= LOG_LIMIT_TOKEN;
+    *limited = b->limited;
+    b->limited = 0;
+    return true;
+}
+#endif /* SYSLOG_LIMIT */
+
+bool log_limit_check(log_level_t level, const char* tag, uint32_t msg_hash,
+                     uint32_t now, LogLimitReport_t* rep)
+{
+    if (!tag) tag = "";
+    uint32_t key = log_limit_key(level, tag);
+    bool pass = true;
+
+    rep->repeats = 0;
+    rep->limited = 0;
+
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+#if SYSLOG_DEDUP
+    uint32_t full = log_limit_hash(&key, sizeof(key), msg_hash);
+    if (last.valid && last.hash == full) {
+        if (last.repeats++ == 0) last.first_tick = now;
+        /* Keep reporting during a long storm. */
+        if (now - last.first_tick >= SYSLOG_DEDUP_FLUSH_MS) log_limit_take_repeats(rep);
+        taskEXIT_CRITICAL_FROM_ISR(mask);
+        return false;
+    }
+    if (last.valid && last.repeats) log_limit_take_repeats(rep);
+    last.hash = full;
+    last.level = level;
+    strncpy(last.tag, tag, sizeof(last.tag) - 1);
+    last.tag[sizeof(last.tag) - 1] = '\0';
+    last.valid = true;
+#else
+    (void)msg_hash;
+#endif
+#if SYSLOG_LIMIT
+    pass = log_limit_bucket_take(&buckets[key & (SYSLOG_LIMIT_BUCKETS - 1U)], now, &rep->limited);
+#else
+    (void)key; (void)now;
+#endif
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+    return pass;
+}
+
+bool log_limit_expire(uint32_t now, LogLimitReport_t* rep)
+{
+    rep->repeats = 0;
+    rep->limited = 0;
+#if SYSLOG_DEDUP
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    if (last.valid && last.repeats && now - last.first_tick >= SYSLOG_DEDUP_FLUSH_MS) {
+        log_limit_take_repeats(rep);
+    }
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+#else
+    (void)now;
+#endif
+    return rep->repeats != 0;
+}
+
+bool log_limit_set(uint32_t rate, uint32_t burst)
+{
+#if SYSLOG_LIMIT
+    if (rate > LOG_LIMIT_MAX || burst == 0U || burst > LOG_LIMIT_MAX) return false;
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    limit_rate = rate;
+    limit_burst = burst;
+    limit_cap = burst * LOG_LIMIT_TOKEN;
+    /* Start every bucket full at the new burst */
+    for (uint32_t i = 0; i < SYSLOG_LIMIT_BUCKETS; i++) buckets[i].used = false;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+    return true;
+#else
+    (void)rate; (void)burst;
+    return false;
+#endif
+}
+
+void log_limit_get(uint32_t* rate, uint32_t* burst)
+{
+#if SYSLOG_LIMIT
+    *rate = limit_rate;
+    *burst = limit_burst;
+#else
+    *rate = 0;
+    *burst = 0;
+#endif
+}
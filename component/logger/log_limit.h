@@ -0,0 +1,64 @@
+/**
+ * @file log_limit.h
+ * @brief Rate limiting and duplicate suppression for log records.
+ *
+ * Two independent filters, both applied before a record reaches the ring:
+ *  - a token bucket per (tag, level), SYSLOG_LIMIT_RATE records per second
+ *    with bursts of SYSLOG_LIMIT_BURST; excess records are counted and the
+ *    count is reported once the bucket lets a record through again;
+ *  - coalescing of identical consecutive records into a single
+ *    "last message repeated N times" line, as syslogd does.
+ *
+ * Buckets are direct-mapped by a hash of tag and level, so two keys may
+ * share a bucket; that only makes limiting slightly stricter. State is
+ * updated inside a short critical section.
+ */
+
+#pragma once
+
+#ifndef LOGGER_LOG_LIMIT_H
+#define LOGGER_LOG_LIMIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "syslog.h"
+#include "syslog_opts.h"
+
+/* What the caller must emit before (or instead of) the record itself. */
+typedef struct {
+    uint32_t repeats;                   /* duplicates of the previous record */
+    log_level_t repeat_level;
+    char repeat_tag[SYSLOG_TAG_NAME_MAX];
+    uint32_t limited;                   /* records of this key dropped by the bucket */
+} LogLimitReport_t;
+
+/* FNV-1a, chainable through seed (start with LOG_LIMIT_HASH_SEED). */
+#define LOG_LIMIT_HASH_SEED 2166136261U
+uint32_t log_limit_hash(const void* data, size_t len, uint32_t seed);
+
+/* Returns true if the record with content hash msg_hash should be emitted.
+ * rep is always filled in and may ask for summary lines either way. */
+bool log_limit_check(log_level_t level, const char* tag, uint32_t msg_hash,
+                     uint32_t now, LogLimitReport_t* rep);
+
+/* Reports pending duplicates older than SYSLOG_DEDUP_FLUSH_MS so that the
+ * summary line is not held back indefinitely. Returns true if rep has
+ * something to emit. */
+bool log_limit_expire(uint32_t now, LogLimitReport_t* rep);
+
+/* Replaces SYSLOG_LIMIT_RATE and SYSLOG_LIMIT_BURST, both up to 1000; rate
+ * 0 turns the limiter off. False when out of range or without
+ * SYSLOG_LIMIT. */
+bool log_limit_set(uint32_t rate, uint32_t burst);
+void log_limit_get(uint32_t* rate, uint32_t* burst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGGER_LOG_LIMIT_H */
@@ -0,0 +1,88 @@
+/**
+ * @file log_ring.c
+ * @brief Lock-free MPSC log record ring (bounded, sequence-numbered slots).
+ *
+ * Each slot carries a sequence number:
+ *   seq == pos          slot is free for the producer claiming position pos
+ *   seq == pos + 1      slot holds a committed record for position pos
+ *   seq == pos + count  slot was released and is free for the next lap
+ *
+ * The GCC __atomic builtins compile to LDREX/STREX with DMB on the M7, so
+ * no interrupt masking or RTOS call is needed on the producer path.
+ */
+
+#include "log_ring.h"
+
+#include <stddef.h>
+
+void log_ring_init(LogRing_t* r, LogRingSlot_t* slots, uint32_t count)
+{
+    r->slots = slots;
+    r->mask = count - 1U;
+    r->head = 0;
+    r->tail = 0;
+    r->dropped = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        slots[i].seq = i;
+    }
+}
+
+LogRingSlot_t* log_ring_reserve(LogRing_t* r)
+{
+    LogRingSlot_t* slot = log_ring_try_reserve(r, 0U);
+    if (!slot) log_ring_count_drop(r);
+    return slot;
+}
+
+LogRingSlot_t* log_ring_try_reserve(LogRing_t* r, uint32_t keep)
+{
+    uint32_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    for (;;) {
+        /* The tail only moves on, so a stale one errs on the full side */
+        if (keep && pos - __atomic_load_n(&r->tail, __ATOMIC_RELAXED) + keep > r->mask) {
+            return NULL;
+        }
+        LogRingSlot_t* slot = &r->slots[pos & r->mask];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int32_t dif = (int32_t)(seq - pos);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1U, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                slot->pos = pos;
+                return slot;
+            }
+            /* pos reloaded by the failed CAS, retry */
+        } else if (dif < 0) {
+            /* Consumer has not released this slot yet: full. */
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void log_ring_commit(LogRing_t* r, LogRingSlot_t* slot)
+{
+    (void)r;
+    __atomic_store_n(&slot->seq, slot->pos + 1U, __ATOMIC_RELEASE);
+}
+
+LogRingSlot_t* log_ring_peek(LogRing_t* r)
+{
+    return log_ring_peek_at(r, r->tail);
+}
+
+LogRingSlot_t* log_ring_peek_at(LogRing_t* r, uint32_t pos)
+{
+    LogRingSlot_t* slot = &r->slots[pos & r->mask];
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (seq != pos + 1U) return NULL;
+    return slot;
+}
+
+void log_ring_release(LogRing_t* r, LogRingSlot_t* slot)
+{
+    uint32_t pos = r->tail;
+    __atomic_store_n(&slot->seq, pos + r->mask + 1U, __ATOMIC_RELEASE);
+    r->tail = pos + 1U;
+}
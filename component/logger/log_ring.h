@@ -0,0 +1,91 @@
+/**
+ * @file log_ring.h
+ * @brief Lock-free multi-producer / single-consumer ring of fixed-size log records.
+ *
+ * Producers reserve a slot with a single compare-and-swap on the head index
+ * (LDREX/STREX on Cortex-M7), fill it in place and commit it. No mutex is
+ * taken, so any task, and interrupt handlers, can produce without priority
+ * inversion. When the ring is full the record is dropped and counted.
+ * log_ring_try_reserve() can also keep some slots back, so that records of
+ * low importance are refused while there is still room for others.
+ *
+ * The consumer (the syslog sender task) peeks committed slots in order and
+ * releases them once transmitted. Committed slots are the consumer's until
+ * released, it may rewrite them.
+ */
+
+#pragma once
+
+#ifndef LOGGER_LOG_RING_H
+#define LOGGER_LOG_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "syslog_opts.h"
+
+#define LOG_RING_CACHE_LINE 32U
+
+/* LogRingSlot_t.kind */
+#define LOG_RING_KIND_TEXT   0U  /* data holds a formatted syslog line */
+#define LOG_RING_KIND_BINARY 1U  /* data holds a deferred record, see syslog.c */
+
+typedef struct {
+    volatile uint32_t seq;  /* slot state, see log_ring.c */
+    uint32_t pos;           /* ring position owned by the current writer */
+    uint16_t len;           /* payload bytes used */
+    uint8_t  level;
+    uint8_t  kind;
+    char     data[SYSLOG_RECORD_SIZE - 12];
+} __attribute__((aligned(LOG_RING_CACHE_LINE))) LogRingSlot_t;
+
+typedef struct {
+    volatile uint32_t head __attribute__((aligned(LOG_RING_CACHE_LINE)));
+    volatile uint32_t tail __attribute__((aligned(LOG_RING_CACHE_LINE)));
+    volatile uint32_t dropped;
+    LogRingSlot_t* slots;
+    uint32_t mask;
+} LogRing_t;
+
+/* count must be a power of two. */
+void log_ring_init(LogRing_t* r, LogRingSlot_t* slots, uint32_t count);
+
+/* Producer side, callable from tasks and ISRs. Returns NULL when full. */
+LogRingSlot_t* log_ring_reserve(LogRing_t* r);
+/* As log_ring_reserve(), but NULL when fewer than keep + 1 slots are free,
+ * and nothing counted: the caller may try another ring first. */
+LogRingSlot_t* log_ring_try_reserve(LogRing_t* r, uint32_t keep);
+void log_ring_commit(LogRing_t* r, LogRingSlot_t* slot);
+
+/* Consumer side, single task only. */
+LogRingSlot_t* log_ring_peek(LogRing_t* r);
+/* The committed record at pos, which lies between the tail and the head;
+ * for a consumer looking ahead of what it releases */
+LogRingSlot_t* log_ring_peek_at(LogRing_t* r, uint32_t pos);
+void log_ring_release(LogRing_t* r, LogRingSlot_t* slot);
+
+/* Reserved and committed slots, a snapshot */
+static inline uint32_t log_ring_used(const LogRing_t* r)
+{
+    return r->head - r->tail;
+}
+
+static inline uint32_t log_ring_dropped(const LogRing_t* r)
+{
+    return r->dropped;
+}
+
+/* Counts a record refused by log_ring_try_reserve() and not placed elsewhere */
+static inline void log_ring_count_drop(LogRing_t* r)
+{
+    __atomic_fetch_add(&r->dropped, 1U, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGGER_LOG_RING_H */
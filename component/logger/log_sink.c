@@ -0,0 +1,148 @@
+/**
+ * @file log_sink.c
+ * @brief Logger sink registry and fan-out, see log_sink.h.
+ */
+
+#include "log_sink.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static bool log_sink_console_write(LogSink_t* sink, const char* line, uint16_t len, log_level_t level);
+
+LogSink_t log_sink_console = {
+    .name = "console",
+    .level = SYSLOG_SINK_CONSOLE_LEVEL,
+    .write = log_sink_console_write,
+};
+
+#if SYSLOG_BKP_LOG
+LogSink_t log_sink_bkp = {
+    .name = "bkp",
+    .level = SYSLOG_BKP_LOG_LEVEL,
+    .next = &log_sink_console,
+};
+#define LOG_SINK_AFTER_FLASH (&log_sink_bkp)
+#else
+#define LOG_SINK_AFTER_FLASH (&log_sink_console)
+#endif
+
+#if SYSLOG_ARCHIVE
+LogSink_t log_sink_flash = {
+    .name = "flash",
+    .level = SYSLOG_SINK_FLASH_LEVEL,
+    .lz4 = SYSLOG_LZ4 && SYSLOG_SINK_FLASH_LZ4,
+    .next = LOG_SINK_AFTER_FLASH,
+};
+#define LOG_SINK_AFTER_SYSLOG (&log_sink_flash)
+#else
+#define LOG_SINK_AFTER_SYSLOG LOG_SINK_AFTER_FLASH
+#endif
+
+LogSink_t log_sink_syslog = {
+    .name = "syslog",
+    .level = SYSLOG_SINK_SYSLOG_LEVEL,
+    .lz4 = SYSLOG_LZ4 && SYSLOG_TCP && SYSLOG_SINK_SYSLOG_LZ4,
+    .next = LOG_SINK_AFTER_SYSLOG,
+};
+
+/* Registered sinks go behind the console */
+static LogSink_t* log_sink_last = &log_sink_console;
+
+volatile log_level_t log_sink_write_level = SYSLOG_SINK_CONSOLE_LEVEL;
+volatile log_level_t log_sink_ring_level = (SYSLOG_SINK_CONSOLE_LEVEL > SYSLOG_SINK_SYSLOG_LEVEL) ?
+                                           SYSLOG_SINK_CONSOLE_LEVEL : SYSLOG_SINK_SYSLOG_LEVEL;
+
+/* The console is stdout: console.c's ring on the target, so no wait */
+static bool log_sink_console_write(LogSink_t* sink, const char* line, uint16_t len, log_level_t level)
+{
+    (void)sink;
+    (void)level;
+    return printf("%.*s\n", (int)len, line) >= 0;
+}
+
+static void log_sink_update_levels(void)
+{
+    log_level_t ring = log_sink_syslog.level;
+    log_level_t write = LOG_LEVEL_NONE;
+
+    for (const LogSink_t* k = log_sink_first(); k != NULL; k = k->next) {
+        if ((k->write != NULL) && (k->level > write)) {
+            write = k->level;
+        }
+    }
+    log_sink_write_level = write;
+    log_sink_ring_level = (write > ring) ? write : ring;
+}
+
+void log_sink_register(LogSink_t* sink)
+{
+    sink->next = NULL;
+    taskENTER_CRITICAL();
+    /* Published last: the sender may be walking the list */
+    __atomic_store_n(&log_sink_last->next, sink, __ATOMIC_RELEASE);
+    log_sink_last = sink;
+    taskEXIT_CRITICAL();
+    log_sink_update_levels();
+}
+
+void log_sink_set_level(LogSink_t* sink, log_level_t level)
+{
+    sink->level = level;
+    log_sink_update_levels();
+}
+
+bool log_sink_has_lz4(const LogSink_t* sink)
+{
+#if SYSLOG_LZ4 && SYSLOG_TCP
+    if (sink == &log_sink_syslog) {
+        return true;
+    }
+#endif
+#if SYSLOG_LZ4 && SYSLOG_ARCHIVE
+    if (sink == &log_sink_flash) {
+        return true;
+    }
+#endif
+    (void)sink;
+    return false;
+}
+
+bool log_sink_set_lz4(LogSink_t* sink, bool on)
+{
+    if (!log_sink_has_lz4(sink)) {
+        return false;
+    }
+    sink->lz4 = on;
+    return true;
+}
+
+LogSink_t* log_sink_find(const char* name)
+{
+    for (LogSink_t* k = log_sink_first(); k != NULL; k = k->next) {
+        if (strcmp(k->name, name) == 0) {
+            return k;
+        }
+    }
+    return NULL;
+}
+
+LogSink_t* log_sink_first(void)
+{
+    return &log_sink_syslog;
+}
+
+void log_sink_dispatch(const char* line, uint16_t len, log_level_t level)
+{
+    if (level > log_sink_write_level) {
+        return;
+    }
+    for (LogSink_t* k = log_sink_first(); k != NULL; k = __atomic_load_n(&k->next, __ATOMIC_ACQUIRE)) {
+        if ((k->write != NULL) && log_sink_wants(k, level)) {
+            log_sink_count(k, k->write(k, line, len, level));
+        }
+    }
+}
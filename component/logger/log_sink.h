@@ -0,0 +1,110 @@
+/**
+ * @file log_sink.h
+ * @brief Logger outputs: one formatted record fanned out to sinks, each with its own level and queue.
+ *
+ * A record is formatted once by its producer, into a slot of the record
+ * ring (LOG_BIN() and LOG_ISR() records are expanded once, by the sender
+ * task). The sinks then take it from there:
+ *
+ *   sink     queue                                fed by
+ *   syslog   the record ring                      sender task, UDP or TCP (SYSLOG_TCP)
+ *   flash    the archive stage, log_store.c       sender task, records syslog cannot send
+ *   bkp      the backup SRAM ring, bkp_log.c      producer, so a crash cannot lose it
+ *   console  the console ring, console.c          sender task, the lines syslog sends
+ *
+ * The sender hands each record to the sinks with a write function as soon
+ * as it is committed, ahead of the syslog sink, which may hold it while the
+ * server is unreachable. Nothing waits on a sink: a write copies into the
+ * sink's own queue or drops and counts. The syslog sink keeps at most
+ * SYSLOG_SINK_BACKLOG records in the ring and drops its oldest beyond that,
+ * so a dead server does not leave the producers without slots.
+ *
+ * The global and per-tag levels of syslog.h decide what is produced, a
+ * sink's level only narrows that for the sink; LOG_LEVEL_NONE turns it off.
+ * Records no ring sink wants do not take a slot. Application sinks are
+ * added with log_sink_register(); their write runs on the sender task.
+ */
+
+#pragma once
+
+#ifndef LOGGER_LOG_SINK_H
+#define LOGGER_LOG_SINK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "syslog.h"
+#include "syslog_opts.h"
+
+typedef struct LogSink LogSink_t;
+
+/* Takes a copy of the line (len bytes, not terminated) or drops it;
+ * false counts a drop. Must not block. */
+typedef bool (*LogSinkWrite_t)(LogSink_t* sink, const char* line, uint16_t len, log_level_t level);
+
+struct LogSink {
+    const char* name;
+    volatile log_level_t level;     /* most verbose level taken */
+    LogSinkWrite_t write;           /* NULL: fed by the logger itself */
+    uint32_t written;
+    uint32_t dropped;               /* queue full or send failed */
+    volatile bool lz4;              /* LZ4 blocks, see SYSLOG_LZ4 */
+    uint32_t lz4_in;                /* bytes compressed ... */
+    uint32_t lz4_out;               /* ... and what they became */
+    LogSink_t* next;
+};
+
+/* The built-in sinks */
+extern LogSink_t log_sink_syslog;
+#if SYSLOG_ARCHIVE
+extern LogSink_t log_sink_flash;
+#endif
+#if SYSLOG_BKP_LOG
+extern LogSink_t log_sink_bkp;
+#endif
+extern LogSink_t log_sink_console;
+
+/* Most verbose level of the sinks fed from the ring, and of those with a
+ * write function; maintained by the functions below */
+extern volatile log_level_t log_sink_ring_level;
+extern volatile log_level_t log_sink_write_level;
+
+static inline bool log_sink_wants(const LogSink_t* sink, log_level_t level)
+{
+    return level <= sink->level;
+}
+
+static inline void log_sink_count(LogSink_t* sink, bool ok)
+{
+    __atomic_fetch_add(ok ? &sink->written : &sink->dropped, 1U, __ATOMIC_RELAXED);
+}
+
+/* Appends a sink with a write function, from a task. The sink object must
+ * stay valid, there is no removal: set its level to LOG_LEVEL_NONE. */
+void log_sink_register(LogSink_t* sink);
+
+void log_sink_set_level(LogSink_t* sink, log_level_t level);
+
+/* Whether the sink has LZ4 blocks (SYSLOG_LZ4): syslog over TCP and
+ * flash. Setting fails for the others. */
+bool log_sink_has_lz4(const LogSink_t* sink);
+bool log_sink_set_lz4(LogSink_t* sink, bool on);
+
+/* NULL if no sink has that name */
+LogSink_t* log_sink_find(const char* name);
+
+/* The first sink, the others follow through next */
+LogSink_t* log_sink_first(void);
+
+/* Hands a formatted line to every sink with a write function whose level
+ * takes it. Sender task, or the producer in synchronous mode. */
+void log_sink_dispatch(const char* line, uint16_t len, log_level_t level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGGER_LOG_SINK_H */
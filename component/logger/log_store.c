@@ -0,0 +1,60 @@
+/**
+ * @file log_store.c
+ * @brief The syslog archive, a qspi_log.h log, see log_store.h.
+ */
+
+#include "log_store.h"
+
+#if SYSLOG_ARCHIVE
+
+#include "qspi/qspi_flash.h"
+#include "qspi/qspi_log.h"
+
+#if (SYSLOG_ARCHIVE_OFFSET % QSPI_FLASH_SECTOR_SIZE) != 0 || (SYSLOG_ARCHIVE_SIZE % QSPI_FLASH_SECTOR_SIZE) != 0
+#error "the syslog archive must be made of whole QSPI sectors"
+#endif
+
+#if SYSLOG_ARCHIVE_SIZE / QSPI_FLASH_SECTOR_SIZE < 2
+#error "the syslog archive needs at least two sectors"
+#endif
+
+/* Sender task only, but for the statistics */
+QSPI_LOG_DEFINE(store, SYSLOG_ARCHIVE_OFFSET, SYSLOG_ARCHIVE_SIZE, SYSLOG_ARCHIVE_STAGE_SIZE,
+                SYSLOG_ARCHIVE_REPLAY_MAX, SYSLOG_ARCHIVE_BUS_WAIT_MS);
+
+bool log_store_init(void)
+{
+    return qspi_log_init(&store);
+}
+
+bool log_store_ready(void)
+{
+    return qspi_log_ready(&store);
+}
+
+bool log_store_append(uint8_t kind, const void* data, uint16_t len)
+{
+    return qspi_log_append(&store, kind, data, len);
+}
+
+bool log_store_pending(void)
+{
+    return qspi_log_pending(&store);
+}
+
+uint32_t log_store_replay(LogStoreReplay_t fn, void* arg, uint32_t max)
+{
+    return qspi_log_replay(&store, fn, arg, max);
+}
+
+void log_store_flush(void)
+{
+    qspi_log_flush(&store);
+}
+
+void log_store_get_stats(LogStoreStats_t* stats)
+{
+    qspi_log_get_stats(&store, stats);
+}
+
+#endif /* SYSLOG_ARCHIVE */
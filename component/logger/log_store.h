@@ -0,0 +1,55 @@
+/**
+ * @file log_store.h
+ * @brief Append-only record log in the QSPI flash, the syslog archive.
+ *
+ * The area SYSLOG_ARCHIVE_OFFSET/_SIZE as a qspi_log.h log: a ring of
+ * 4 KB sectors written strictly in order, records pending until
+ * log_store_replay() has handed them out, a restart resuming with the
+ * oldest record not yet replayed.
+ *
+ * Flash writes are done by log_store_flush() alone: log_store_append()
+ * only stages in RAM and log_store_replay() only reads the mapped flash,
+ * so both are fine under the core lock. All calls come from one task.
+ */
+
+#pragma once
+
+#ifndef LOGGER_LOG_STORE_H
+#define LOGGER_LOG_STORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "syslog_opts.h"
+#include "qspi/qspi_log.h"
+
+/* Returns false to stop the replay; the record stays pending. */
+typedef QspiLogReplay_t LogStoreReplay_t;
+
+typedef QspiLogStats_t LogStoreStats_t;
+
+/* Finds the newest record and the oldest pending one. Needs
+ * qspi_flash_init(); false leaves the store unusable. */
+bool log_store_init(void);
+bool log_store_ready(void);
+
+bool log_store_append(uint8_t kind, const void* data, uint16_t len);
+/* Archived records not yet replayed */
+bool log_store_pending(void);
+/* Hands up to max pending records, oldest first, to fn. Returns the number
+ * fn accepted. */
+uint32_t log_store_replay(LogStoreReplay_t fn, void* arg, uint32_t max);
+/* Writes the staged records and the replay marks. Task context, no lock
+ * held: it may wait for a sector erase. */
+void log_store_flush(void);
+
+void log_store_get_stats(LogStoreStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGGER_LOG_STORE_H */
@@ -0,0 +1,112 @@
+/**
+ * @file log_tag.c
+ * @brief Interned log tags, an open-addressed table filled once per name.
+ */
+
+#include "log_tag.h"
+#include "log_limit.h"
+
+#include <string.h>
+
+#if (SYSLOG_TAG_INTERN & (SYSLOG_TAG_INTERN - 1)) != 0
+#error "SYSLOG_TAG_INTERN must be a power of two"
+#endif
+#if SYSLOG_TAG_INTERN > 256 || SYSLOG_TAG_INTERN_LEN > 256
+#error "SYSLOG_TAG_INTERN and SYSLOG_TAG_INTERN_LEN are limited to 256"
+#endif
+
+#define LOG_TAG_MASK (SYSLOG_TAG_INTERN - 1U)
+
+/* Entries are never removed: a reader probing from the name's home slot
+ * stops at the first entry not ready, which an insert fills in before
+ * setting ready with release order. */
+static LogTag_t tags[SYSLOG_TAG_INTERN];
+static uint8_t tag_order[SYSLOG_TAG_INTERN];    /* slots in insert order */
+static volatile uint32_t tag_count;
+static volatile uint32_t tag_overflow;
+static volatile uint8_t tag_lock;
+
+static const LogTag_t* log_tag_find(const char* tag, uint32_t len, uint32_t hash, uint32_t* free_slot)
+{
+    for (uint32_t i = 0; i < SYSLOG_TAG_INTERN; i++) {
+        uint32_t slot = (hash + i) & LOG_TAG_MASK;
+        const LogTag_t* t = &tags[slot];
+        if (!__atomic_load_n(&t->ready, __ATOMIC_ACQUIRE)) {
+            *free_slot = slot;
+            return NULL;
+        }
+        if (t->hash == hash && t->len == len && memcmp(t->name, tag, len) == 0) return t;
+    }
+    *free_slot = SYSLOG_TAG_INTERN;
+    return NULL;
+}
+
+/* An id no entry has, from the folded hash on. Under tag_lock. */
+static uint16_t log_tag_new_id(uint32_t hash)
+{
+    uint16_t id = (uint16_t)(hash ^ (hash >> 16));
+    for (;;) {
+        bool used = (id == 0U);
+        for (uint32_t i = 0; i < tag_count && !used; i++) used = (tags[tag_order[i]].id == id);
+        if (!used) return id;
+        id++;
+    }
+}
+
+const LogTag_t* log_tag_intern(const char* tag)
+{
+    if (!tag || !tag[0]) return NULL;
+    uint32_t len = (uint32_t)strnlen(tag, SYSLOG_TAG_INTERN_LEN);
+    if (len == SYSLOG_TAG_INTERN_LEN) return NULL;
+    uint32_t hash = log_limit_hash(tag, len, LOG_LIMIT_HASH_SEED);
+    uint32_t slot;
+
+    const LogTag_t* t = log_tag_find(tag, len, hash, &slot);
+    if (t) return t;
+
+    /* First use. Never waits: an interrupt may have preempted the insert. */
+    if (__atomic_test_and_set(&tag_lock, __ATOMIC_ACQUIRE)) return NULL;
+    t = log_tag_find(tag, len, hash, &slot);
+    if (!t && slot < SYSLOG_TAG_INTERN) {
+        LogTag_t* n = &tags[slot];
+        n->len = (uint8_t)len;
+        n->hash = hash;
+        memcpy(n->name, tag, len);
+        n->name[len] = '\0';
+        n->id = log_tag_new_id(hash);
+        tag_order[tag_count] = (uint8_t)slot;
+        __atomic_store_n(&n->ready, 1U, __ATOMIC_RELEASE);
+        __atomic_store_n(&tag_count, tag_count + 1U, __ATOMIC_RELEASE);
+        t = n;
+    } else if (!t) {
+        tag_overflow++;
+    }
+    __atomic_clear(&tag_lock, __ATOMIC_RELEASE);
+    return t;
+}
+
+const LogTag_t* log_tag_by_id(uint16_t id)
+{
+    uint32_t n = log_tag_count();
+    if (id == 0U) return NULL;
+    for (uint32_t i = 0; i < n; i++) {
+        const LogTag_t* t = &tags[tag_order[i]];
+        if (t->id == id) return t;
+    }
+    return NULL;
+}
+
+uint32_t log_tag_count(void)
+{
+    return __atomic_load_n(&tag_count, __ATOMIC_ACQUIRE);
+}
+
+const LogTag_t* log_tag_get(uint32_t i)
+{
+    return (i < log_tag_count()) ? &tags[tag_order[i]] : NULL;
+}
+
+uint32_t log_tag_overflow(void)
+{
+    return tag_overflow;
+}
@@ -0,0 +1,60 @@
+/**
+ * @file log_tag.h
+ * @brief Interned log tags: a small id and the length of every tag name.
+ *
+ * A tag is interned by its content on first use: log_tag_intern() returns
+ * its entry, the name copied with its length and a 16-bit id. The text
+ * path copies the name into the header without measuring it again; the
+ * deferred (binary) records carry the id instead of the tag's address,
+ * and the sender announces the id table to the decoder (syslog.c).
+ *
+ * The id is the FNV-1a hash of the name folded to 16 bits, the next free
+ * one on a collision, so it stays the same from boot to boot and archived
+ * records keep their tags. 0 means no tag.
+ *
+ * Lookups take no lock and work from interrupts. An insert takes a
+ * try-lock; a caller that finds it taken, or the table full, gets NULL and
+ * formats the tag as before.
+ */
+
+#pragma once
+
+#ifndef LOGGER_LOG_TAG_H
+#define LOGGER_LOG_TAG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "syslog_opts.h"
+
+typedef struct {
+    volatile uint8_t ready;     /* filled in, see log_tag.c */
+    uint8_t len;
+    uint16_t id;
+    uint32_t hash;
+    char name[SYSLOG_TAG_INTERN_LEN];
+} LogTag_t;
+
+/* The entry of tag, interning it on first use; NULL for NULL or "", a
+ * name of SYSLOG_TAG_INTERN_LEN characters or more, a full table or a
+ * concurrent insert. Any context. */
+const LogTag_t* log_tag_intern(const char* tag);
+
+/* The entry with id, NULL if none */
+const LogTag_t* log_tag_by_id(uint16_t id);
+
+/* Entries interned so far; log_tag_get(i) for i below it, in order */
+uint32_t log_tag_count(void);
+const LogTag_t* log_tag_get(uint32_t i);
+
+/* Tags not interned because the table was full */
+uint32_t log_tag_overflow(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGGER_LOG_TAG_H */
@@ -4,6 +4,11 @@
  */
 
 #include "syslog.h"
+#include "syslog_opts.h"
+#include "log_ring.h"
+#include "log_limit.h"
+#include "log_sink.h"
+#include "log_tag.h"
 
 #include "main.h"
 #include "stm32h7xx_hal.h"
@@ -12,12 +17,44 @@
 #include "task.h"
 #include "semphr.h"
 #include "lwip.h"
+#include "lwip/udp.h"
+#if SYSLOG_TCP
+#include "lwip/tcp.h"
+#endif
+#include "resolv/resolv.h"
+#include "boottime/boot_time.h"
+#include "mutexmon/mutex_mon.h"
+#if SYSLOG_TX_ROOM
+#include "ethernetif.h"
+#endif
 
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
 #include <time.h>
 #include "board.h"
+#if TRACE_REC
+#include "trace/trace_rec.h"
+#include "memops/memops.h"
+#endif
+#include "lwip/ip.h"
+#if SYSLOG_ARCHIVE
+#include "log_store.h"
+#endif
+#if SYSLOG_BKP_LOG
+#include "bkp_log.h"
+#endif
+#if SYSLOG_RFC5424
+#include "timesync/time_ns.h"
+#include "timesync/timesync.h"
+#endif
+#if SYSLOG_LZ4 && (SYSLOG_TCP || SYSLOG_ARCHIVE)
+#include "compress/lz4_block.h"
+#endif
+
+#if SYSLOG_TCP && !SYSLOG_ASYNC
+#error "SYSLOG_TCP needs SYSLOG_ASYNC"
+#endif
 #if defined(LOCK_TCPIP_CORE) && defined(UNLOCK_TCPIP_CORE)
 #define SYSLOG_LWIP_LOCK()   LOCK_TCPIP_CORE()
 #define SYSLOG_LWIP_UNLOCK() UNLOCK_TCPIP_CORE()
@@ -32,6 +69,7 @@ static const TickType_t MUTEX_TIMEOUT_MS = 100;
 
 typedef struct {
     ip_addr_t server;
+    int server_id;      /* resolv.h id when the server is a name, else -1 */
     uint16_t port;
     int facility;
     log_level_t min_level;
@@ -39,14 +77,92 @@ typedef struct {
     char app_name[48];
     bool initialized;
     struct udp_pcb* udp;
+#if UDP_TPL
+    struct udp_tpl tpl; /* headers to the server, udp connected to it */
+#endif
     SemaphoreHandle_t mutex;
     uint32_t send_count;
     uint32_t failed_count;
+    uint32_t dropped_count;
+    uint32_t suppressed_count;
+#if SYSLOG_ASYNC
+    LogRing_t* ring;            /* main lane */
+    LogRing_t* urgent;          /* urgent lane, drained first */
+    TaskHandle_t task;
+    uint32_t dispatch;  /* ring position of the next record for the sinks */
+    uint32_t urgent_dispatch;
+#endif
+#if SYSLOG_TCP
+    /* Core lock: the sender task and the tcpip thread callbacks */
+    struct tcp_pcb* tcp;
+    bool tcp_up;                /* connected, records go over TCP */
+    uint32_t tcp_down_tick;     /* HAL_GetTick() when it went down */
+    uint32_t tcp_delay_ms;      /* from then to the next connect */
+    uint32_t tcp_backoff_ms;    /* delay after the next failure */
+    uint32_t tcp_connects;
+    uint32_t tcp_failures;      /* connects failed and connections lost */
+    uint32_t udp_fallback;      /* records sent over UDP meanwhile */
+#endif
 } Syslog_t;
 
+#if SYSLOG_ASYNC
+#if (SYSLOG_RING_SLOTS & (SYSLOG_RING_SLOTS - 1)) != 0
+#error "SYSLOG_RING_SLOTS must be a power of two"
+#endif
+#if SYSLOG_RING_URGENT_SLOTS < 2 || (SYSLOG_RING_URGENT_SLOTS & (SYSLOG_RING_URGENT_SLOTS - 1)) != 0
+#error "SYSLOG_RING_URGENT_SLOTS must be a power of two"
+#endif
+#if SYSLOG_RING_SHED_KEEP >= SYSLOG_RING_SLOTS
+#error "SYSLOG_RING_SHED_KEEP leaves no room for shed levels"
+#endif
+
+/* Ring storage and sender task are statically allocated: the FreeRTOS heap is
+ * far too small to hold the records. Plain .bss lands in AXI SRAM (RAM_D1);
+ * the slots are NOINIT there, log_ring_init() sets their state. */
+static LogRing_t syslog_ring;
+static LogRingSlot_t syslog_ring_slots[SYSLOG_RING_SLOTS] NOINIT;
+static LogRing_t syslog_ring_urgent;
+static LogRingSlot_t syslog_ring_urgent_slots[SYSLOG_RING_URGENT_SLOTS] NOINIT;
+static StaticTask_t syslog_task_cb;
+static StackType_t syslog_task_stack[SYSLOG_TASK_STACK_WORDS];
+#endif
+
+#if SYSLOG_BIN_MAX_ARGS > 8
+#error "SYSLOG_BIN_MAX_ARGS is limited to 8"
+#endif
+
+/* Deferred record written by logger_bin_write(). It lives in a ring slot of
+ * kind LOG_RING_KIND_BINARY and, with SYSLOG_BIN_REMOTE, the first
+ * LOG_BIN_RECORD_LEN(nargs) bytes go on the wire unchanged (little endian)
+ * behind a LogBinHeader_t. tools/log_decode.py mirrors this layout. */
+typedef struct {
+    uint32_t tick;      /* HAL_GetTick() at the call */
+    uint32_t fmt;       /* format string address in the image */
+    uint8_t  level;
+    uint8_t  nargs;     /* words in args, see LOG_BIN() */
+    uint16_t tag;       /* interned tag id (log_tag.h), 0: none */
+    uint32_t args[SYSLOG_BIN_MAX_ARGS];
+} LogBinRecord_t;
+
+#define LOG_BIN_RECORD_LEN(nargs) (offsetof(LogBinRecord_t, args) + (nargs) * sizeof(uint32_t))
+
+typedef struct {
+    uint8_t magic[2];   /* 'L', 'B' */
+    uint8_t version;    /* LOG_BIN_VERSION */
+    uint8_t count;      /* records that follow */
+} LogBinHeader_t;
+
+/* 2: nargs counts words, 64-bit values take two; 3: the tag as an
+ * interned id, announced in "LT" datagrams (syslog_tags_announce()) */
+#define LOG_BIN_VERSION 3U
+
+_Static_assert(sizeof(LogBinRecord_t) <= sizeof(((LogRingSlot_t*)0)->data),
+               "deferred log record does not fit a ring slot");
+
 /* Global syslog instance (simpler than placement-storage singleton) */
 static Syslog_t logger_syslog = {
     .server = {0},
+    .server_id = -1,
     .port = 514,
     .facility = SYSLOG_FACILITY_USER,
     .min_level = LOG_LEVEL_VERBOSE,
@@ -56,136 +172,1444 @@ static Syslog_t logger_syslog = {
     .udp = NULL,
     .mutex = NULL,
     .send_count = 0,
-    .failed_count = 0
+    .failed_count = 0,
+    .dropped_count = 0,
+    .suppressed_count = 0
 };
 
-static inline Syslog_t* get_logger_obj(void)
+static inline Syslog_t* get_logger_obj(void)
+{
+    return &logger_syslog;
+}
+
+/* Per-tag level overrides. Written under s->mutex; read lock-free by the
+ * LOG_* fast path, an entry is published by bumping tag_level_count last. */
+typedef struct {
+    char tag[SYSLOG_TAG_NAME_MAX];
+    log_level_t level;
+} SyslogTagLevel_t;
+
+static SyslogTagLevel_t tag_levels[SYSLOG_TAG_LEVELS_MAX];
+static volatile uint32_t tag_level_count = 0;
+
+volatile log_level_t logger_level_ceiling = LOG_LEVEL_VERBOSE;
+
+/* Caller holds s->mutex. */
+static void syslog_update_ceiling(const Syslog_t* s)
+{
+    log_level_t ceiling = s->min_level;
+    for (uint32_t i = 0; i < tag_level_count; i++) {
+        if (tag_levels[i].level > ceiling) ceiling = tag_levels[i].level;
+    }
+    logger_level_ceiling = ceiling;
+}
+
+static SyslogTagLevel_t* syslog_find_tag(const char* tag)
+{
+    for (uint32_t i = 0; i < tag_level_count; i++) {
+        if (strncmp(tag_levels[i].tag, tag, sizeof(tag_levels[i].tag)) == 0) return &tag_levels[i];
+    }
+    return NULL;
+}
+
+bool logger_tag_level_enabled(log_level_t level, const char* tag)
+{
+    const Syslog_t* s = get_logger_obj();
+    if (tag && tag_level_count) {
+        const SyslogTagLevel_t* t = syslog_find_tag(tag);
+        if (t) return level <= t->level;
+    }
+    return level <= s->min_level;
+}
+
+/* Zero-copy TX buffers: each element is a custom pbuf followed by its payload
+ * area, so a line is formatted straight into the memory that the ETH DMA
+ * reads and lwIP prepends the UDP/IP/Ethernet headers in place. This mirrors
+ * RX_POOL in ethernetif.c and keeps log traffic out of the MEM_SIZE heap.
+ * The pool lives in AXI SRAM, which MPU_Config() maps write-through, so no
+ * cache clean is needed before the DMA reads it. */
+typedef struct {
+    struct pbuf_custom pbuf_custom;
+    uint8_t buff[SYSLOG_TX_POOL_BUF_SIZE] __ALIGNED(32);
+} SyslogTxBuff_t;
+
+LWIP_MEMPOOL_DECLARE(SYSLOG_TX_POOL, SYSLOG_TX_POOL_COUNT, sizeof(SyslogTxBuff_t), "Syslog TX pbuf pool");
+
+/* Largest payload a pool pbuf can carry behind the transport-layer headroom. */
+#define SYSLOG_TX_PAYLOAD_MAX ((u16_t)(SYSLOG_TX_POOL_BUF_SIZE - LWIP_MEM_ALIGN_SIZE(PBUF_TRANSPORT)))
+
+static void syslog_pbuf_free(struct pbuf* p)
+{
+    LWIP_MEMPOOL_FREE(SYSLOG_TX_POOL, p);
+}
+
+/* Returns a pool pbuf with a len-byte writable payload, or NULL when the pool
+ * is empty. Safe without the core lock (memp is lock-free or protected). */
+static struct pbuf* syslog_pbuf_alloc(u16_t len)
+{
+    if (len > SYSLOG_TX_PAYLOAD_MAX) return NULL;
+    SyslogTxBuff_t* b = (SyslogTxBuff_t*)LWIP_MEMPOOL_ALLOC(SYSLOG_TX_POOL);
+    if (!b) return NULL;
+    b->pbuf_custom.custom_free_function = syslog_pbuf_free;
+    return pbuf_alloced_custom(PBUF_TRANSPORT, len, PBUF_RAM, &b->pbuf_custom,
+                               b->buff, sizeof(b->buff));
+}
+
+/* Sends a pbuf from syslog_pbuf_alloc() and frees our reference.
+ * Caller holds s->mutex and the core lock. */
+static bool syslog_send_pbuf_locked(Syslog_t* s, struct pbuf* p, uint16_t port, uint32_t records)
+{
+    /* A server name follows its DNS answer; until the first one records fail */
+    if (s->server_id >= 0 && !resolv_get(s->server_id, &s->server)) {
+        pbuf_free(p);
+        s->failed_count += records;
+        return false;
+    }
+#if UDP_TPL
+    /* Reconnected when the address (a name's DNS answer) or port changes */
+    if (!ip_addr_cmp(&s->udp->remote_ip, &s->server) || s->udp->remote_port != port) {
+        udp_connect(s->udp, &s->server, port);
+        udp_tpl_init(&s->tpl, s->udp);
+    }
+    err_t err = udp_tpl_send(&s->tpl, p);
+#else
+    err_t err = udp_sendto(s->udp, p, &s->server, port);
+#endif
+    pbuf_free(p);
+
+    if (err == ERR_OK) {
+        s->send_count += records;
+        BOOT_TIME_MARK(BOOT_TIME_SYSLOG);
+        return true;
+    }
+    s->failed_count += records;
+    return false;
+}
+
+#if SYSLOG_ASYNC
+/* Whether a datagram can leave for the server: its name has an address and
+ * the route goes out over an interface with link. A server that is down
+ * behind a working link cannot be told apart over UDP. Caller holds
+ * s->mutex and the core lock. */
+static bool syslog_reachable_locked(Syslog_t* s)
+{
+    if (s->server_id >= 0 && !resolv_get(s->server_id, &s->server)) return false;
+    struct netif* netif = ip_route(NULL, &s->server);
+    return netif && netif_is_up(netif) && netif_is_link_up(netif);
+}
+
+/* Whether the driver takes the next datagrams without refusing them, see
+ * SYSLOG_TX_ROOM. Caller holds the core lock. */
+static bool syslog_tx_room_locked(void)
+{
+#if SYSLOG_TX_ROOM
+    return ethernetif_tx_class_room(ETHIF_TX_CLASS_LOGGING) >= SYSLOG_TX_ROOM;
+#else
+    return true;
+#endif
+}
+#endif
+
+#if SYSLOG_LZ4 && (SYSLOG_TCP || SYSLOG_ARCHIVE)
+/* "Z", u16 raw length, u16 block length ahead of a block on TCP */
+#define SYSLOG_LZ4_HDR_LEN 5U
+
+/* Compressor of the sender task, s->mutex held. A block is kept only when
+ * it is shorter than its input, so the output needs no more room. */
+static Lz4Block_t syslog_lz4;
+static uint8_t syslog_lz4_out[LWIP_MAX(SYSLOG_TCP_STAGE_SIZE, SYSLOG_ARCHIVE_LZ4_BATCH)];
+
+/* Compresses len bytes of framed records into syslog_lz4_out behind hdr
+ * bytes for the caller's header. Returns the block length, 0 when the
+ * block with its header would not be shorter than the records. */
+static uint32_t syslog_lz4_pack(LogSink_t* sink, const uint8_t* src, uint32_t len, uint32_t hdr)
+{
+    uint32_t n = (len > hdr + 1U) ? lz4_block_compress(&syslog_lz4, src, len, &syslog_lz4_out[hdr], len - hdr - 1U) : 0U;
+
+    sink->lz4_in += len;
+    sink->lz4_out += (n != 0U) ? hdr + n : len;
+    return n;
+}
+#endif
+
+#if (SYSLOG_LZ4 && SYSLOG_ARCHIVE) || SYSLOG_TCP
+/* Writes the "LEN SP" of a record of len bytes (RFC 6587 octet counting)
+ * to hdr; returns its length */
+static uint32_t syslog_frame_hdr(char hdr[8], u16_t len)
+{
+    return (uint32_t)snprintf(hdr, 8, "%u ", (unsigned)len);
+}
+#endif
+
+#if SYSLOG_TCP
+/* Framed records on their way to tcp_write(); sender task, core lock held */
+static uint8_t syslog_tcp_stage[SYSLOG_TCP_STAGE_SIZE];
+static uint32_t syslog_tcp_used;
+static uint32_t syslog_tcp_records;
+
+static uint16_t syslog_tcp_port(const Syslog_t* s)
+{
+    return (SYSLOG_TCP_PORT != 0) ? (uint16_t)SYSLOG_TCP_PORT : s->port;
+}
+
+/* The pcb is gone (freed by lwIP or closed by the caller): UDP until the
+ * next attempt, one backoff later. Core lock held. */
+static void syslog_tcp_down(Syslog_t* s)
+{
+    s->tcp = NULL;
+    s->tcp_up = false;
+    s->tcp_failures++;
+    s->tcp_down_tick = HAL_GetTick();
+    s->tcp_delay_ms = s->tcp_backoff_ms;
+    s->tcp_backoff_ms = LWIP_MIN(s->tcp_backoff_ms * 2U, SYSLOG_TCP_BACKOFF_MAX_MS);
+}
+
+/* Drops the connection without a callback, for init_logger(). Core lock held. */
+static void syslog_tcp_reset(Syslog_t* s)
+{
+    if (s->tcp) {
+        tcp_arg(s->tcp, NULL);
+        tcp_err(s->tcp, NULL);
+        tcp_recv(s->tcp, NULL);
+        tcp_sent(s->tcp, NULL);
+        tcp_abort(s->tcp);
+    }
+    s->tcp = NULL;
+    s->tcp_up = false;
+    s->tcp_delay_ms = 0;
+    s->tcp_backoff_ms = SYSLOG_TCP_BACKOFF_MIN_MS;
+    syslog_tcp_used = 0;
+    syslog_tcp_records = 0;
+}
+
+/* tcpip thread callbacks */
+static void syslog_tcp_err(void* arg, err_t err)
+{
+    (void)err;
+    if (arg) syslog_tcp_down((Syslog_t*)arg);
+}
+
+static err_t syslog_tcp_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    Syslog_t* s = (Syslog_t*)arg;
+    (void)err;
+
+    if (p) {
+        /* Nothing expected from the server */
+        tcp_recved(pcb, p->tot_len);
+        pbuf_free(p);
+        return ERR_OK;
+    }
+    /* Closed by the server */
+    tcp_arg(pcb, NULL);
+    tcp_err(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    syslog_tcp_down(s);
+    if (tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    return ERR_OK;
+}
+
+static err_t syslog_tcp_sent(void* arg, struct tcp_pcb* pcb, u16_t len)
+{
+    Syslog_t* s = (Syslog_t*)arg;
+    (void)pcb;
+    (void)len;
+
+    /* Send buffer space: records may be waiting for it */
+    if (s->task) xTaskNotifyGive(s->task);
+    return ERR_OK;
+}
+
+static err_t syslog_tcp_connected(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+    Syslog_t* s = (Syslog_t*)arg;
+    (void)pcb;
+    (void)err;
+
+    s->tcp_up = true;
+    s->tcp_connects++;
+    s->tcp_backoff_ms = SYSLOG_TCP_BACKOFF_MIN_MS;
+    if (s->task) xTaskNotifyGive(s->task);
+    return ERR_OK;
+}
+
+/* Starts a connection when none is up or under way and the backoff has
+ * passed. Caller holds s->mutex and the core lock. */
+static void syslog_tcp_connect_locked(Syslog_t* s)
+{
+    if (s->tcp || HAL_GetTick() - s->tcp_down_tick < s->tcp_delay_ms) return;
+    if (s->server_id >= 0 && !resolv_get(s->server_id, &s->server)) return;
+
+    struct tcp_pcb* pcb = tcp_new_ip_type(IP_GET_TYPE(&s->server));
+    if (!pcb) {
+        syslog_tcp_down(s);
+        return;
+    }
+    pcb->tos = SYSLOG_TOS;
+    tcp_arg(pcb, s);
+    if (tcp_connect(pcb, &s->server, syslog_tcp_port(s), syslog_tcp_connected) != ERR_OK) {
+        /* Not registered yet: closing frees it without a callback */
+        tcp_close(pcb);
+        syslog_tcp_down(s);
+        return;
+    }
+    tcp_err(pcb, syslog_tcp_err);
+    tcp_recv(pcb, syslog_tcp_recv);
+    tcp_sent(pcb, syslog_tcp_sent);
+    s->tcp = pcb;
+}
+
+/* Hands the staged records to the connection in one copy, as one LZ4
+ * block when the sink asks for it and they shrink. Core lock held. */
+static void syslog_tcp_flush(Syslog_t* s)
+{
+    const uint8_t* data = syslog_tcp_stage;
+    uint32_t len = syslog_tcp_used;
+
+    if (!syslog_tcp_used) return;
+#if SYSLOG_LZ4
+    uint32_t n = log_sink_syslog.lz4 ? syslog_lz4_pack(&log_sink_syslog, syslog_tcp_stage, len, SYSLOG_LZ4_HDR_LEN) : 0U;
+    if (n) {
+        syslog_lz4_out[0] = 'Z';
+        syslog_lz4_out[1] = (uint8_t)(len >> 8);
+        syslog_lz4_out[2] = (uint8_t)len;
+        syslog_lz4_out[3] = (uint8_t)(n >> 8);
+        syslog_lz4_out[4] = (uint8_t)n;
+        data = syslog_lz4_out;
+        len = SYSLOG_LZ4_HDR_LEN + n;
+    }
+#endif
+    if (s->tcp_up && tcp_write(s->tcp, data, (u16_t)len, TCP_WRITE_FLAG_COPY) == ERR_OK) {
+        tcp_output(s->tcp);
+        s->send_count += syslog_tcp_records;
+        BOOT_TIME_MARK(BOOT_TIME_SYSLOG);
+    } else {
+        s->failed_count += syslog_tcp_records;
+    }
+    syslog_tcp_used = 0;
+    syslog_tcp_records = 0;
+}
+
+/* Stages one record as "LEN SP MSG" (RFC 6587 octet counting). Returns
+ * false, leaving the record to the caller, when the connection cannot
+ * take it now. Core lock held. */
+static bool syslog_tcp_add(Syslog_t* s, const char* data, u16_t len)
+{
+    char hdr[8];
+
+    if (len > SYSLOG_TCP_STAGE_SIZE - sizeof(hdr)) len = (u16_t)(SYSLOG_TCP_STAGE_SIZE - sizeof(hdr));
+    uint32_t hlen = syslog_frame_hdr(hdr, len);
+    uint32_t frame = hlen + len;
+
+    if (syslog_tcp_used + frame > SYSLOG_TCP_STAGE_SIZE) syslog_tcp_flush(s);
+    if (!s->tcp_up || syslog_tcp_used + frame > tcp_sndbuf(s->tcp) ||
+        tcp_sndqueuelen(s->tcp) + 2U > tcp_sndqueuelen_max(s->tcp)) {
+        return false;
+    }
+    memops_copy(&syslog_tcp_stage[syslog_tcp_used], hdr, hlen);
+    memops_copy(&syslog_tcp_stage[syslog_tcp_used + hlen], data, len);
+    syslog_tcp_used += frame;
+    syslog_tcp_records++;
+    return true;
+}
+#endif /* SYSLOG_TCP */
+
+static int syslog_get_severity(const Syslog_t* s, log_level_t level)
+{
+    (void)s;
+    switch (level) {
+        case LOG_LEVEL_NONE:    return 0;
+        case LOG_LEVEL_ERROR:   return 3;
+        case LOG_LEVEL_WARNING: return 4;
+        case LOG_LEVEL_INFO:    return 6;
+        case LOG_LEVEL_DEBUG:   return 7;
+        case LOG_LEVEL_VERBOSE: return 7;
+        default: return 6;
+    }
+}
+
+static int syslog_get_priority(const Syslog_t* s, log_level_t level)
+{
+    return (s->facility * 8) + syslog_get_severity(s, level);
+}
+
+#if SYSLOG_RFC5424
+/* "YYYY-MM-DDTHH:MM:SS.uuuuuuZ" */
+#define SYSLOG_TIMESTAMP_LEN 28
+
+static uint32_t syslog_sequence;
+
+/* Zero-padded decimal of a fixed width, returns the end */
+static char* syslog_put_dec(char* p, uint32_t v, uint32_t width, char sep)
+{
+    for (uint32_t i = width; i > 0; i--) {
+        p[i - 1] = (char)('0' + v % 10U);
+        v /= 10U;
+    }
+    p[width] = sep;
+    return p + width + 1;
+}
+
+/* RFC 3339 UTC time of HAL tick `tick`: from the synced clock with
+ * microseconds, else from the RTC (kept in UTC by timesync) with
+ * milliseconds, or the NILVALUE without either. */
+static void syslog_timestamp(char* out, size_t size, uint32_t tick)
+{
+#if TIMESYNC
+    if (timesync_synced()) {
+        uint64_t us = time_utc_ns() / 1000U - (uint64_t)(HAL_GetTick() - tick) * 1000U;
+        uint64_t day_us = 86400ULL * 1000000U;
+        uint32_t tod_s = (uint32_t)((us % day_us) / 1000000U);
+        int32_t y;
+        uint32_t m;
+        uint32_t d;
+
+        timesync_civil_from_days((int32_t)(us / day_us), &y, &m, &d);
+        char* p = out;
+
+        if (size < SYSLOG_TIMESTAMP_LEN) {
+            out[0] = '\0';
+            return;
+        }
+        p = syslog_put_dec(p, (uint32_t)y, 4, '-');
+        p = syslog_put_dec(p, m, 2, '-');
+        p = syslog_put_dec(p, d, 2, 'T');
+        p = syslog_put_dec(p, tod_s / 3600U, 2, ':');
+        p = syslog_put_dec(p, (tod_s / 60U) % 60U, 2, ':');
+        p = syslog_put_dec(p, tod_s % 60U, 2, '.');
+        p = syslog_put_dec(p, (uint32_t)(us % 1000000U), 6, 'Z');
+        *p = '\0';
+        return;
+    }
+#endif
+    char rtc[BOARD_TIMESTAMP_LEN];
+    board_get_timestamp_at(tick, rtc, sizeof(rtc));
+    if (rtc[0] == '\0') {
+        snprintf(out, size, "-");
+        return;
+    }
+    rtc[10] = 'T';
+    snprintf(out, size, "%sZ", rtc);
+}
+#else
+#define SYSLOG_TIMESTAMP_LEN BOARD_TIMESTAMP_LEN
+
+static void syslog_timestamp(char* out, size_t size, uint32_t tick)
+{
+    board_get_timestamp_at(tick, out, size);
+}
+#endif /* SYSLOG_RFC5424 */
+
+/* Header parts that change only with the level or not at all, rendered
+ * once: the PRI field per level and the host and app names around the
+ * tag. With the tag's interned name and length (log_tag.h) a header is
+ * put together by copies; the timestamp between PRI and host keeps a
+ * whole header per (tag, level) from being one string. */
+typedef struct {
+    char pri[LOG_LEVEL_VERBOSE + 1][8];         /* "<PRI>1 " or "<PRI>" */
+    uint8_t pri_len[LOG_LEVEL_VERBOSE + 1];
+    char host[sizeof(((Syslog_t*)0)->hostname) + sizeof(((Syslog_t*)0)->app_name) + 8];
+    uint16_t host_len;                          /* " HOST APP - " or " HOST APP[" */
+    volatile bool ready;
+} SyslogHeader_t;
+
+static SyslogHeader_t syslog_header;
+
+/* Idempotent: two tasks rendering at once write the same bytes */
+static void syslog_header_render(const Syslog_t* s)
+{
+    for (int level = LOG_LEVEL_NONE; level <= LOG_LEVEL_VERBOSE; level++) {
+#if SYSLOG_RFC5424
+        int n = snprintf(syslog_header.pri[level], sizeof(syslog_header.pri[level]), "<%d>1 ",
+                         syslog_get_priority(s, level));
+#else
+        int n = snprintf(syslog_header.pri[level], sizeof(syslog_header.pri[level]), "<%d>",
+                         syslog_get_priority(s, level));
+#endif
+        syslog_header.pri_len[level] = (uint8_t)n;
+    }
+#if SYSLOG_RFC5424
+    int n = snprintf(syslog_header.host, sizeof(syslog_header.host), " %s %s - ", s->hostname, s->app_name);
+#else
+    int n = snprintf(syslog_header.host, sizeof(syslog_header.host), " %s %s[", s->hostname, s->app_name);
+#endif
+    syslog_header.host_len = (uint16_t)n;
+    __atomic_store_n(&syslog_header.ready, true, __ATOMIC_RELEASE);
+}
+
+/* A line being put together; cut once something did not fit */
+typedef struct {
+    char* p;
+    char* end;      /* the terminating NUL goes here at the latest */
+    bool cut;
+} SyslogOut_t;
+
+static void syslog_put(SyslogOut_t* o, const void* src, size_t len)
+{
+    size_t room = (size_t)(o->end - o->p);
+    if (len > room) {
+        len = room;
+        o->cut = true;
+    }
+    memops_copy(o->p, src, len);
+    o->p += len;
+}
+
+#define SYSLOG_PUT_LITERAL(o, str) syslog_put((o), (str), sizeof(str) - 1U)
+
+#if SYSLOG_RFC5424
+static void syslog_put_u32(SyslogOut_t* o, uint32_t v)
+{
+    char digits[10];
+    size_t n = sizeof(digits);
+    do {
+        digits[--n] = (char)('0' + v % 10U);
+        v /= 10U;
+    } while (v != 0U);
+    syslog_put(o, &digits[n], sizeof(digits) - n);
+}
+#endif
+
+/* One record, stamped with the time of HAL tick `tick`. Returns 0 when the
+ * line did not fit; buffer then holds it truncated. */
+static size_t syslog_format_line(Syslog_t* s, char* buffer, size_t bufferSize,
+                                 log_level_t level, const char* tag, const char* message,
+                                 uint32_t tick)
+{
+    if (!buffer || bufferSize < 64) return 0;
+    if (!__atomic_load_n(&syslog_header.ready, __ATOMIC_ACQUIRE)) syslog_header_render(s);
+    char timestamp[SYSLOG_TIMESTAMP_LEN];
+    syslog_timestamp(timestamp, sizeof(timestamp), tick);
+    /* Unknown levels have INFO's severity, see syslog_get_severity() */
+    int lvl = (level >= LOG_LEVEL_NONE && level <= LOG_LEVEL_VERBOSE) ? level : LOG_LEVEL_INFO;
+
+    const LogTag_t* t = log_tag_intern(tag);
+    const char* name;
+    size_t name_len;
+    if (t) {
+        name = t->name;
+        name_len = t->len;
+    } else {
+#if SYSLOG_RFC5424
+        name = (tag && tag[0]) ? tag : "-";
+#else
+        name = tag ? tag : "unknown";
+#endif
+        name_len = strlen(name);
+    }
+
+    SyslogOut_t o = { .p = buffer, .end = buffer + bufferSize - 1U, .cut = false };
+    syslog_put(&o, syslog_header.pri[lvl], syslog_header.pri_len[lvl]);
+    syslog_put(&o, timestamp, strlen(timestamp));
+    syslog_put(&o, syslog_header.host, syslog_header.host_len);
+    syslog_put(&o, name, name_len);
+#if SYSLOG_RFC5424
+    /* meta: RFC 5424 7.3, sequenceId 1..2147483647, sysUpTime in 10 ms */
+    uint32_t seq = __atomic_add_fetch(&syslog_sequence, 1U, __ATOMIC_RELAXED) & 0x7FFFFFFFU;
+    SYSLOG_PUT_LITERAL(&o, " [meta sequenceId=\"");
+    syslog_put_u32(&o, seq ? seq : 1U);
+    SYSLOG_PUT_LITERAL(&o, "\" sysUpTime=\"");
+    syslog_put_u32(&o, tick / 10U);
+    SYSLOG_PUT_LITERAL(&o, "\"] ");
+#else
+    SYSLOG_PUT_LITERAL(&o, "]: ");
+#endif
+    if (message) syslog_put(&o, message, strlen(message));
+    *o.p = '\0';
+    return o.cut ? 0U : (size_t)(o.p - buffer);
+}
+
+static size_t syslog_format_msg(Syslog_t* s, char* buffer, size_t bufferSize,
+                            log_level_t level, const char* tag, const char* message)
+{
+    return syslog_format_line(s, buffer, bufferSize, level, tag, message, HAL_GetTick());
+}
+
+/* Next nwords of a deferred record, zero past its end */
+static uint64_t syslog_bin_take(const uint32_t* args, uint32_t nargs, uint32_t* i, uint32_t nwords)
+{
+    uint64_t v = 0U;
+    for (uint32_t k = 0U; k < nwords; k++, (*i)++) {
+        if (*i < nargs) v |= (uint64_t)args[*i] << (32U * k);
+    }
+    return v;
+}
+
+/* Expands a deferred record's message. LOG_BIN() packed each argument into
+ * one or two words by its type and the compiler checked that type against
+ * the conversion, so walking fmt tells how many words every conversion
+ * takes: two for ll, j, 64-bit l, z and t, and floating point. Each
+ * conversion is then printed on its own with its real type. */
+void logger_bin_format(char* out, size_t size, const char* fmt,
+                       uint32_t nargs, const uint32_t* args)
+{
+    size_t n = 0;
+    uint32_t i = 0;
+    if (size == 0) return;
+    if (nargs > SYSLOG_BIN_MAX_ARGS) nargs = SYSLOG_BIN_MAX_ARGS;
+
+    while (*fmt && n + 1 < size) {
+        if (*fmt != '%') {
+            out[n++] = *fmt++;
+            continue;
+        }
+        /* One conversion: %[flags][width][.prec][length]spec */
+        char spec[24];
+        size_t k = 0;
+        const char* p = fmt + 1;
+        int star[2] = {0, 0};
+        uint32_t nstar = 0;
+        uint32_t length = 0;     /* size of an integer argument, 0: int */
+        uint32_t nl = 0;         /* 'l' modifiers */
+        spec[k++] = '%';
+        while (*p && strchr("-+ #0", *p) && k < sizeof(spec) - 8) spec[k++] = *p++;
+        for (int part = 0; part < 2; part++) {
+            if (part == 1) {
+                if (*p != '.') break;
+                spec[k++] = *p++;
+            }
+            if (*p == '*') {
+                star[nstar++] = (int)(uint32_t)syslog_bin_take(args, nargs, &i, 1U);
+                spec[k++] = *p++;
+            }
+            while (*p >= '0' && *p <= '9' && k < sizeof(spec) - 6) spec[k++] = *p++;
+        }
+        while (*p && strchr("hlLjzt", *p) && k < sizeof(spec) - 2) {
+            switch (*p) {
+            case 'l': length = ++nl == 1U ? sizeof(long) : sizeof(long long); break;
+            case 'j': length = sizeof(intmax_t); break;
+            case 'z': length = sizeof(size_t); break;
+            case 't': length = sizeof(ptrdiff_t); break;
+            default: break;
+            }
+            spec[k++] = *p++;
+        }
+        char c = *p;
+        if (c == '\0') break;
+        spec[k++] = c;
+        spec[k] = '\0';
+        fmt = p + 1;
+
+        size_t room = size - n;
+        int w;
+#define SYSLOG_BIN_PRINT(v) (nstar == 2 ? snprintf(&out[n], room, spec, star[0], star[1], (v)) \
+                           : nstar == 1 ? snprintf(&out[n], room, spec, star[0], (v)) \
+                           : snprintf(&out[n], room, spec, (v)))
+        if (c == '%') {
+            w = snprintf(&out[n], room, "%%");
+        } else if (strchr("fFeEgGaA", c)) {
+            uint64_t u = syslog_bin_take(args, nargs, &i, 2U);
+            double d;
+            memops_copy(&d, &u, sizeof(d));
+            w = SYSLOG_BIN_PRINT(d);
+        } else if (strchr("diouxXc", c) && length > 4U) {
+            unsigned long long v = syslog_bin_take(args, nargs, &i, 2U);
+            /* spec keeps its length modifier, so pass the type it names */
+            w = nl == 1U ? SYSLOG_BIN_PRINT((unsigned long)v) : SYSLOG_BIN_PRINT(v);
+        } else if (c == 's' || c == 'p') {
+            const void* v = (const void*)(uintptr_t)syslog_bin_take(args, nargs, &i, 1U);
+            if (c == 's' && v == NULL) v = "(null)";
+            w = SYSLOG_BIN_PRINT(v);
+        } else if (strchr("diouxXc", c)) {
+            uint32_t v = (uint32_t)syslog_bin_take(args, nargs, &i, 1U);
+            w = SYSLOG_BIN_PRINT(v);
+        } else {
+            /* %n or unknown: printed, not interpreted */
+            w = snprintf(&out[n], room, "%s", spec);
+        }
+#undef SYSLOG_BIN_PRINT
+        if (w < 0) break;
+        n += (size_t)w < room ? (size_t)w : room - 1;
+    }
+    out[n] = '\0';
+}
+
+#if SYSLOG_ASYNC
+static bool syslog_start_sender(Syslog_t* s);
+#endif
+static bool syslog_output(Syslog_t* s, log_level_t level, const char* tag, const char* message);
+
+#if SYSLOG_LIMIT || SYSLOG_DEDUP
+#define SYSLOG_LIMITING 1
+
+/* Emits the summary lines requested by log_limit_check()/log_limit_expire(). */
+static void syslog_emit_report(Syslog_t* s, const LogLimitReport_t* rep,
+                               log_level_t level, const char* tag)
+{
+    char msg[64];
+    if (rep->repeats) {
+        snprintf(msg, sizeof(msg), "last message repeated %lu times", (unsigned long)rep->repeats);
+        syslog_output(s, rep->repeat_level, rep->repeat_tag, msg);
+    }
+    if (rep->limited) {
+        snprintf(msg, sizeof(msg), "%lu messages suppressed by rate limit", (unsigned long)rep->limited);
+        syslog_output(s, level, tag, msg);
+    }
+}
+
+/* Returns true if the record may be emitted. */
+static bool syslog_limit(Syslog_t* s, log_level_t level, const char* tag, uint32_t msg_hash)
+{
+    LogLimitReport_t rep;
+    bool pass = log_limit_check(level, tag, msg_hash, HAL_GetTick(), &rep);
+    syslog_emit_report(s, &rep, level, tag);
+    if (!pass) s->suppressed_count++;
+    return pass;
+}
+#else
+#define SYSLOG_LIMITING 0
+#endif
+
+bool init_logger(const char* ipstr, int port)
+{
+    if (!ipstr) {
+        printf("ERROR: init_logger_params: NULL ipstr\n");
+        return false;
+    }
+    if (port <= 0 || port > 65535) {
+        printf("ERROR: init_logger_params: invalid port %d\n", port);
+        return false;
+    }
+
+    ip_addr_t server;
+    int server_id = -1;
+    if (!ipaddr_aton(ipstr, &server)) {
+        /* Not an address: a name, kept resolved by resolv.h */
+        server_id = resolv_add(ipstr);
+        if (server_id < 0) {
+            printf("ERROR: init_logger_params: no room for server name '%s'\n", ipstr);
+            return false;
+        }
+        ip_addr_set_zero(&server);
+    }
+
+    Syslog_t* s = get_logger_obj();
+    if (!s) {
+        printf("ERROR: Failed to initialize syslog!\n");
+        return false;
+    }
+
+    /* begin (configure server/port/facility) */
+    if (!s->mutex) {
+        LWIP_MEMPOOL_INIT(SYSLOG_TX_POOL);
+        s->mutex = xSemaphoreCreateMutex();
+        if (!s->mutex) {
+            printf("ERROR: Failed to create syslog mutex\n");
+            return false;
+        }
+#if SYSLOG_ARCHIVE
+        if (!log_store_init()) {
+            printf("WARNING: no syslog archive in the QSPI flash\n");
+        }
+#endif
+#if TRACE_REC
+        (void)trace_rec_name_queue(s->mutex, "syslog");
+#endif
+#if MUTEX_MON
+        (void)mutex_mon_register(s->mutex, "syslog");
+#endif
+    }
+
+    if (mutex_mon_take(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) {
+        printf("ERROR: Failed to take syslog mutex\n");
+        return false;
+    }
+
+    /* cleanup existing */
+    if (s->initialized) {
+        if (s->udp) {
+            SYSLOG_LWIP_LOCK();
+            udp_remove(s->udp);
+            SYSLOG_LWIP_UNLOCK();
+            s->udp = NULL;
+        }
+        s->initialized = false;
+    }
+#if SYSLOG_TCP
+    SYSLOG_LWIP_LOCK();
+    syslog_tcp_reset(s);
+    SYSLOG_LWIP_UNLOCK();
+#endif
+
+    s->server = server;
+    s->server_id = server_id;
+    s->port = (uint16_t)port;
+    syslog_header_render(s);
+
+    SYSLOG_LWIP_LOCK();
+    s->udp = udp_new();
+    if (s->udp) {
+        err_t bindErr = udp_bind(s->udp, IP_ADDR_ANY, 0);
+        if (bindErr != ERR_OK) {
+            udp_remove(s->udp);
+            s->udp = NULL;
+        } else {
+            s->udp->tos = SYSLOG_TOS;
+        }
+    }
+    SYSLOG_LWIP_UNLOCK();
+
+    if (!s->udp) {
+        xSemaphoreGive(s->mutex);
+        printf("ERROR: Failed to create UDP PCB for syslog\n");
+        return false;
+    }
+
+#if SYSLOG_ASYNC
+    if (!syslog_start_sender(s)) {
+        xSemaphoreGive(s->mutex);
+        printf("ERROR: Failed to start syslog sender task\n");
+        return false;
+    }
+#endif
+
+    s->initialized = true;
+    xSemaphoreGive(s->mutex);
+    char ipbuf[48];
+    printf("Syslog initialized: %s:%u\n", (server_id >= 0) ? ipstr : ipaddr_ntoa_r(&s->server, ipbuf, sizeof(ipbuf)),
+           (unsigned)s->port);
+    return true;
+}
+
+#if SYSLOG_ASYNC
+#if SYSLOG_BATCH_PACK || SYSLOG_BIN_REMOTE
+/* Datagram being packed by the sender task. */
+typedef struct {
+    struct pbuf* p;
+    u16_t used;
+    uint16_t records;
+    uint16_t port;
+    bool binary;        /* prefix a LogBinHeader_t when flushed */
+} SyslogBatch_t;
+
+#if SYSLOG_BIN_REMOTE
+static uint32_t syslog_tags_sent;   /* interned tags the decoder was told */
+static uint32_t syslog_tags_tick;   /* HAL_GetTick() of the last table */
+
+/* Tells the decoder the interned tag ids ahead of the binary records that
+ * use them: "LT" datagrams, a LogBinHeader_t and count entries of id:u16
+ * len:u8 name. Sent when tags were added, and every SYSLOG_BIN_TAGS_MS for
+ * a decoder started later. Caller holds s->mutex and the core lock. */
+static void syslog_tags_announce(Syslog_t* s, uint16_t port)
+{
+    uint32_t n = log_tag_count();
+    uint32_t now = HAL_GetTick();
+    uint32_t i = 0;
+    bool ok = true;
+
+    if (n == syslog_tags_sent && now - syslog_tags_tick < SYSLOG_BIN_TAGS_MS) return;
+    while (i < n) {
+        struct pbuf* p = syslog_pbuf_alloc(SYSLOG_BATCH_DATAGRAM_MAX);
+        if (!p) return;
+        uint8_t* d = (uint8_t*)p->payload;
+        u16_t used = (u16_t)sizeof(LogBinHeader_t);
+        uint8_t count = 0;
+        while (i < n && count < UINT8_MAX) {
+            const LogTag_t* t = log_tag_get(i);
+            if (used + 3U + t->len > SYSLOG_BATCH_DATAGRAM_MAX) break;
+            d[used] = (uint8_t)t->id;
+            d[used + 1U] = (uint8_t)(t->id >> 8);
+            d[used + 2U] = t->len;
+            memops_copy(&d[used + 3U], t->name, t->len);
+            used = (u16_t)(used + 3U + t->len);
+            count++;
+            i++;
+        }
+        LogBinHeader_t* h = (LogBinHeader_t*)d;
+        h->magic[0] = 'L';
+        h->magic[1] = 'T';
+        h->version = LOG_BIN_VERSION;
+        h->count = count;
+        pbuf_realloc(p, used);
+        ok = syslog_send_pbuf_locked(s, p, port, 0U) && ok;
+    }
+    if (ok) {
+        syslog_tags_sent = n;
+        syslog_tags_tick = now;
+    }
+}
+#endif /* SYSLOG_BIN_REMOTE */
+
+static void syslog_batch_flush(Syslog_t* s, SyslogBatch_t* b)
+{
+    if (!b->p) return;
+    if (b->binary) {
+        LogBinHeader_t* h = (LogBinHeader_t*)b->p->payload;
+        h->magic[0] = 'L';
+        h->magic[1] = 'B';
+        h->version = LOG_BIN_VERSION;
+        h->count = (uint8_t)b->records;
+    }
+    pbuf_realloc(b->p, b->used);
+    syslog_send_pbuf_locked(s, b->p, b->port, b->records);
+    b->p = NULL;
+    b->used = 0;
+    b->records = 0;
+}
+
+/* Returns room for len more bytes, flushing first if they would overflow the
+ * datagram, or NULL when no TX buffer is free. Caller holds the core lock and
+ * advances b->used. */
+static uint8_t* syslog_batch_reserve(Syslog_t* s, SyslogBatch_t* b, u16_t len)
+{
+    if (b->p && ((u32_t)b->used + len > SYSLOG_BATCH_DATAGRAM_MAX || b->records == UINT8_MAX)) {
+        syslog_batch_flush(s, b);
+    }
+    if (!b->p) {
+#if SYSLOG_BIN_REMOTE
+        if (b->binary) syslog_tags_announce(s, b->port);
+#endif
+        b->p = syslog_pbuf_alloc(SYSLOG_BATCH_DATAGRAM_MAX);
+        if (!b->p) return NULL;
+        b->used = b->binary ? (u16_t)sizeof(LogBinHeader_t) : 0U;
+    }
+    return (uint8_t*)b->p->payload + b->used;
+}
+#endif /* SYSLOG_BATCH_PACK || SYSLOG_BIN_REMOTE */
+
+#if SYSLOG_BATCH_PACK
+/* Appends one record plus a '\n' separator. Returns false, leaving the
+ * record unconsumed, when no TX buffer is free. */
+static bool syslog_batch_add(Syslog_t* s, SyslogBatch_t* b, const char* data, u16_t len)
+{
+    if (len > SYSLOG_BATCH_DATAGRAM_MAX - 1U) len = SYSLOG_BATCH_DATAGRAM_MAX - 1U;
+    uint8_t* dst = syslog_batch_reserve(s, b, len + 1U);
+    if (!dst) return false;
+    memops_copy(dst, data, len);
+    dst[len] = '\n';
+    b->used += len + 1U;
+    b->records++;
+    return true;
+}
+#endif /* SYSLOG_BATCH_PACK */
+
+#if SYSLOG_BIN_REMOTE
+static bool syslog_bin_add(Syslog_t* s, SyslogBatch_t* b, const LogBinRecord_t* r)
+{
+    u16_t len = (u16_t)LOG_BIN_RECORD_LEN(r->nargs);
+    uint8_t* dst = syslog_batch_reserve(s, b, len);
+    if (!dst) return false;
+    memops_copy(dst, r, len);
+    b->used += len;
+    b->records++;
+    return true;
+}
+#endif /* SYSLOG_BIN_REMOTE */
+
+/* Sender-side expansion buffers; only the sender task touches them. */
+static char syslog_bin_msg[SYSLOG_RECORD_SIZE];
+static char syslog_bin_line[SYSLOG_RECORD_SIZE];
+
+/* Renders a deferred record as a syslog line stamped with its capture time. */
+static u16_t syslog_bin_expand(Syslog_t* s, const LogBinRecord_t* r)
+{
+    logger_bin_format(syslog_bin_msg, sizeof(syslog_bin_msg), (const char*)(uintptr_t)r->fmt,
+                      r->nargs, r->args);
+    const LogTag_t* t = log_tag_by_id(r->tag);
+    size_t len = syslog_format_line(s, syslog_bin_line, sizeof(syslog_bin_line), r->level,
+                                    t ? t->name : NULL, syslog_bin_msg, r->tick);
+    if (len == 0) len = strnlen(syslog_bin_line, sizeof(syslog_bin_line) - 1);
+    return (u16_t)len;
+}
+
+#if SYSLOG_ARCHIVE
+#if SYSLOG_LZ4
+/* Archive record kind next to LOG_RING_KIND_*: an LZ4 block of text
+ * records framed as on TCP, "LEN SP MSG" */
+#define SYSLOG_KIND_LZ4 0x80U
+
+/* Text records of the current sender pass for one compressed record */
+static uint8_t syslog_archive_batch[SYSLOG_ARCHIVE_LZ4_BATCH];
+static uint32_t syslog_archive_used;
+static uint32_t syslog_archive_records;
+
+/* A compressed record being replayed, and its records already sent */
+static uint8_t syslog_replay_buf[SYSLOG_ARCHIVE_LZ4_BATCH];
+static const void* syslog_replay_at;
+static uint32_t syslog_replay_done;
+
+/* The record at *pos of a framed batch of size bytes; false at the end */
+static bool syslog_frame_next(const uint8_t* buf, uint32_t size, uint32_t* pos, const char** msg, u16_t* len)
+{
+    uint32_t p = *pos;
+    uint32_t n = 0;
+
+    while (p < size && buf[p] >= '0' && buf[p] <= '9' && n <= UINT16_MAX) n = n * 10U + (buf[p++] - '0');
+    if (p == *pos || p >= size || buf[p] != ' ' || n > size - p - 1U) return false;
+    *msg = (const char*)&buf[p + 1U];
+    *len = (u16_t)n;
+    *pos = p + 1U + n;
+    return true;
+}
+
+/* Archives the batched records as one compressed record, or one by one
+ * when they do not shrink. */
+static void syslog_archive_flush(Syslog_t* s)
+{
+    uint32_t pos = 0;
+    const char* msg;
+    u16_t len;
+
+    if (!syslog_archive_records) return;
+    uint32_t n = syslog_lz4_pack(&log_sink_flash, syslog_archive_batch, syslog_archive_used, 0);
+    if (n) {
+        bool ok = log_store_append(SYSLOG_KIND_LZ4, syslog_lz4_out, (uint16_t)n);
+        if (!ok) s->failed_count += syslog_archive_records;
+        for (uint32_t i = 0; i < syslog_archive_records; i++) log_sink_count(&log_sink_flash, ok);
+    } else {
+        while (syslog_frame_next(syslog_archive_batch, syslog_archive_used, &pos, &msg, &len)) {
+            bool ok = log_store_append(LOG_RING_KIND_TEXT, msg, len);
+            if (!ok) s->failed_count++;
+            log_sink_count(&log_sink_flash, ok);
+        }
+    }
+    syslog_archive_used = 0;
+    syslog_archive_records = 0;
+}
+#endif
+
+/* Stages a ring record for the flash archive as it is: text, or a
+ * deferred record when it goes to the host undecoded anyway (without
+ * SYSLOG_BIN_REMOTE syslog_dispatch() expanded it). With LZ4 on the sink
+ * text records are batched for syslog_archive_flush(). */
+static void syslog_archive(Syslog_t* s, const LogRingSlot_t* slot)
+{
+    if (slot->len == 0) return;
+#if SYSLOG_LZ4
+    if (log_sink_flash.lz4 && slot->kind == LOG_RING_KIND_TEXT) {
+        char hdr[8];
+        uint32_t hlen = syslog_frame_hdr(hdr, slot->len);
+
+        if (syslog_archive_used + hlen + slot->len > sizeof(syslog_archive_batch)) syslog_archive_flush(s);
+        if (hlen + slot->len <= sizeof(syslog_archive_batch)) {
+            memops_copy(&syslog_archive_batch[syslog_archive_used], hdr, hlen);
+            memops_copy(&syslog_archive_batch[syslog_archive_used + hlen], slot->data, slot->len);
+            syslog_archive_used += hlen + slot->len;
+            syslog_archive_records++;
+            return;
+        }
+    }
+    /* Behind the batched records, in order */
+    syslog_archive_flush(s);
+#endif
+    bool ok = log_store_append(slot->kind, slot->data, slot->len);
+    if (!ok) s->failed_count++;
+    log_sink_count(&log_sink_flash, ok);
+}
+
+typedef struct {
+    Syslog_t* s;
+#if SYSLOG_BIN_REMOTE
+    SyslogBatch_t bin;
+#endif
+} SyslogReplay_t;
+
+/* Sends one archived text record. */
+static bool syslog_replay_text(Syslog_t* s, const void* data, uint16_t len)
+{
+#if SYSLOG_TCP
+    if (s->tcp_up) return syslog_tcp_add(s, data, len);
+#endif
+    struct pbuf* p = syslog_pbuf_alloc(len);
+    if (!p) return false;
+    memops_copy(p->payload, data, len);
+    syslog_send_pbuf_locked(s, p, s->port, 1);
+    return true;
+}
+
+#if SYSLOG_LZ4
+/* Sends the records of a compressed archive record. When the connection
+ * or the TX pool does not take them all, the next attempt on the same
+ * record resumes behind the ones sent; a corrupt block is dropped. */
+static bool syslog_replay_lz4(Syslog_t* s, const void* data, uint16_t len)
+{
+    int32_t size = lz4_block_decompress(data, len, syslog_replay_buf, sizeof(syslog_replay_buf));
+    uint32_t pos = 0;
+    uint32_t i = 0;
+    const char* msg;
+    u16_t mlen;
+
+    if (size < 0) {
+        s->failed_count++;
+        return true;
+    }
+    if (data != syslog_replay_at) {
+        syslog_replay_at = data;
+        syslog_replay_done = 0;
+    }
+    while (syslog_frame_next(syslog_replay_buf, (uint32_t)size, &pos, &msg, &mlen)) {
+        if (i++ < syslog_replay_done) continue;
+        if (!syslog_replay_text(s, msg, mlen)) return false;
+        syslog_replay_done++;
+    }
+    syslog_replay_at = NULL;
+    return true;
+}
+#endif
+
+/* Sends one archived record, read from the mapped flash. */
+static bool syslog_replay_one(void* arg, uint8_t kind, const void* data, uint16_t len)
 {
-    return &logger_syslog;
+    SyslogReplay_t* r = (SyslogReplay_t*)arg;
+#if SYSLOG_BIN_REMOTE
+    if (kind == LOG_RING_KIND_BINARY) return syslog_bin_add(r->s, &r->bin, (const LogBinRecord_t*)data);
+#endif
+#if SYSLOG_LZ4
+    if (kind == SYSLOG_KIND_LZ4) return syslog_replay_lz4(r->s, data, len);
+#endif
+    (void)kind;
+    return syslog_replay_text(r->s, data, len);
 }
 
-static int syslog_get_severity(const Syslog_t* s, log_level_t level)
+/* Sends a few archived records once the server is reachable again and
+ * nothing newer is queued. */
+static void syslog_replay(Syslog_t* s)
 {
-    (void)s;
-    switch (level) {
-        case LOG_LEVEL_NONE:    return 0;
-        case LOG_LEVEL_ERROR:   return 3;
-        case LOG_LEVEL_WARNING: return 4;
-        case LOG_LEVEL_INFO:    return 6;
-        case LOG_LEVEL_DEBUG:   return 7;
-        case LOG_LEVEL_VERBOSE: return 7;
-        default: return 6;
+    SyslogReplay_t r = { .s = s };
+
+    if (!log_store_pending() || log_ring_peek(s->ring) || log_ring_peek(s->urgent)) return;
+    if (mutex_mon_take(s->mutex, portMAX_DELAY) != pdTRUE) return;
+    if (s->initialized && s->udp) {
+#if SYSLOG_BIN_REMOTE
+        r.bin.port = SYSLOG_BIN_PORT;
+        r.bin.binary = true;
+#endif
+        SYSLOG_LWIP_LOCK();
+        if (syslog_reachable_locked(s)) {
+            (void)log_store_replay(syslog_replay_one, &r, SYSLOG_ARCHIVE_REPLAY_MAX);
+#if SYSLOG_TCP
+            syslog_tcp_flush(s);
+#endif
+#if SYSLOG_BIN_REMOTE
+            syslog_batch_flush(s, &r.bin);
+#endif
+        }
+        SYSLOG_LWIP_UNLOCK();
     }
+    xSemaphoreGive(s->mutex);
 }
+#endif /* SYSLOG_ARCHIVE */
 
-static int syslog_get_priority(const Syslog_t* s, log_level_t level)
+/* Hands the records committed since the last pass to the sinks with a
+ * write function, ahead of the syslog sink that may hold them. A deferred
+ * record is expanded here, once and into its own slot, unless it goes to
+ * the host undecoded; then it is expanded for these sinks alone. */
+static void syslog_dispatch_lane(Syslog_t* s, LogRing_t* ring, uint32_t* pos)
 {
-    return (s->facility * 8) + syslog_get_severity(s, level);
+    LogRingSlot_t* slot;
+
+    while ((slot = log_ring_peek_at(ring, *pos)) != NULL) {
+        const char* line = slot->data;
+        u16_t len = slot->len;
+
+        if (slot->kind == LOG_RING_KIND_BINARY) {
+#if SYSLOG_BIN_REMOTE
+            line = syslog_bin_line;
+            len = (slot->level <= log_sink_write_level) ? syslog_bin_expand(s, (const LogBinRecord_t*)slot->data) : 0;
+#else
+            len = syslog_bin_expand(s, (const LogBinRecord_t*)slot->data);
+            if (len > sizeof(slot->data)) len = sizeof(slot->data);
+            memops_copy(slot->data, syslog_bin_line, len);
+            slot->len = len;
+            slot->kind = LOG_RING_KIND_TEXT;
+#endif
+        }
+        if (len > 0) log_sink_dispatch(line, len, (log_level_t)slot->level);
+        (*pos)++;
+    }
 }
 
-static size_t syslog_format_msg(Syslog_t* s, char* buffer, size_t bufferSize,
-                            log_level_t level, const char* tag, const char* message)
+static void syslog_dispatch(Syslog_t* s)
 {
-    if (!buffer || bufferSize < 64) return 0;
-    char timestamp[20];
-    board_get_timestamp(timestamp, sizeof(timestamp));
-    int priority = syslog_get_priority(s, level);
-    int written = snprintf(buffer, bufferSize,
-                          "<%d>%s %s %s[%s]: %s",
-                          priority,
-                          timestamp,
-                          s->hostname,
-                          s->app_name,
-                          tag ? tag : "unknown",
-                          message ? message : "");
-    if (written < 0 || written >= (int)bufferSize) return 0;
-    return (size_t)written;
+    syslog_dispatch_lane(s, s->urgent, &s->urgent_dispatch);
+    syslog_dispatch_lane(s, s->ring, &s->dispatch);
 }
 
-bool init_logger(const char* ipstr, int port)
+/* The oldest record of the urgent lane, else of the main one, once the
+ * other sinks have seen it; *ring is where to release it */
+static LogRingSlot_t* syslog_next(Syslog_t* s, LogRing_t** ring)
 {
-    if (!ipstr) {
-        printf("ERROR: init_logger_params: NULL ipstr\n");
-        return false;
-    }
-    if (port <= 0 || port > 65535) {
-        printf("ERROR: init_logger_params: invalid port %d\n", port);
-        return false;
+    if (s->urgent->tail != s->urgent_dispatch) {
+        *ring = s->urgent;
+        return log_ring_peek(s->urgent);
     }
+    *ring = s->ring;
+    return (s->ring->tail != s->dispatch) ? log_ring_peek(s->ring) : NULL;
+}
 
-    ip_addr_t server;
-    if (!ipaddr_aton(ipstr, &server)) {
-        printf("ERROR: init_logger_params: invalid ip string '%s'\n", ipstr);
-        return false;
-    }
+/* Drains up to SYSLOG_BATCH_MAX committed records under a single core-lock
+ * acquisition. Returns the number of records consumed. */
+static uint32_t syslog_drain_batch(Syslog_t* s)
+{
+    uint32_t n = 0;
+    LogRing_t* ring;
+    syslog_dispatch(s);
+    LogRingSlot_t* slot = syslog_next(s, &ring);
+    if (!slot) return 0;
 
-    Syslog_t* s = get_logger_obj();
-    if (!s) {
-        printf("ERROR: Failed to initialize syslog!\n");
-        return false;
+    if (mutex_mon_take(s->mutex, portMAX_DELAY) != pdTRUE) return 0;
+    bool online = s->initialized && s->udp;
+#if SYSLOG_BATCH_PACK
+    SyslogBatch_t batch = { .port = s->port };
+#endif
+#if SYSLOG_BIN_REMOTE
+    SyslogBatch_t bin = { .port = SYSLOG_BIN_PORT, .binary = true };
+#endif
+
+    if (online) SYSLOG_LWIP_LOCK();
+    /* Records wait in the ring while the server cannot be reached, before
+     * the link came up for instance */
+    bool reachable = online && syslog_reachable_locked(s);
+    bool tcp = false;
+#if SYSLOG_TCP
+    if (reachable) {
+        syslog_tcp_connect_locked(s);
+        tcp = s->tcp_up;
     }
+#endif
+#if SYSLOG_ARCHIVE
+    /* ... and go to the flash archive once the ring fills up */
+    bool archive = online && !reachable && log_sink_flash.level != LOG_LEVEL_NONE && log_store_ready() &&
+                   log_ring_used(s->ring) >= SYSLOG_ARCHIVE_RING_FILL;
+#endif
+    while (slot && n < SYSLOG_BATCH_MAX) {
+        const char* data = slot->data;
+        u16_t len = slot->len;
 
-    /* begin (configure server/port/facility) */
-    if (!s->mutex) {
-        s->mutex = xSemaphoreCreateMutex();
-        if (!s->mutex) {
-            printf("ERROR: Failed to create syslog mutex\n");
-            return false;
+        if (!log_sink_wants(&log_sink_syslog, slot->level)) {
+            /* Produced for the other sinks */
+            len = 0;
+        } else if (!online) {
+            s->failed_count++;
+            log_sink_count(&log_sink_syslog, false);
+            len = 0;
+#if SYSLOG_ARCHIVE
+        } else if (archive) {
+            if (log_sink_wants(&log_sink_flash, slot->level)) syslog_archive(s, slot);
+            len = 0;
+#endif
+        } else if (!reachable || !syslog_tx_room_locked()) {
+            break;
+#if SYSLOG_BIN_REMOTE
+        } else if (slot->kind == LOG_RING_KIND_BINARY) {
+            if (!syslog_bin_add(s, &bin, (const LogBinRecord_t*)slot->data)) break;
+            log_sink_count(&log_sink_syslog, true);
+            len = 0;
+#endif
+        }
+
+        if (len > 0 && tcp) {
+#if SYSLOG_TCP
+            /* Send buffer full: the record waits for the server's ACKs */
+            if (!syslog_tcp_add(s, data, len)) break;
+#endif
+            log_sink_count(&log_sink_syslog, true);
+        } else if (len > 0) {
+#if SYSLOG_BATCH_PACK
+            if (!syslog_batch_add(s, &batch, data, len)) break;
+#else
+            struct pbuf* p = syslog_pbuf_alloc(len);
+            /* TX pool exhausted: leave the record queued until the driver
+             * returns buffers, the ring absorbs the backlog. */
+            if (!p) break;
+            memops_copy(p->payload, data, len);
+            syslog_send_pbuf_locked(s, p, s->port, 1);
+#endif
+#if SYSLOG_TCP
+            s->udp_fallback++;
+#endif
+            log_sink_count(&log_sink_syslog, true);
         }
+        log_ring_release(ring, slot);
+        n++;
+        slot = syslog_next(s, &ring);
     }
+#if SYSLOG_ARCHIVE && SYSLOG_LZ4
+    if (archive) syslog_archive_flush(s);
+#endif
+#if SYSLOG_TCP
+    if (tcp) syslog_tcp_flush(s);
+#endif
+#if SYSLOG_BATCH_PACK
+    if (online) syslog_batch_flush(s, &batch);
+#endif
+#if SYSLOG_BIN_REMOTE
+    if (online) syslog_batch_flush(s, &bin);
+#endif
+    if (online) SYSLOG_LWIP_UNLOCK();
 
-    if (xSemaphoreTake(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) {
-        printf("ERROR: Failed to take syslog mutex\n");
-        return false;
+    /* The syslog sink's share of the main ring is bounded: past it its
+     * oldest records go, the producers keep finding slots for the other
+     * sinks. The urgent lane is not trimmed, it overflows into the main. */
+    while (log_ring_used(s->ring) > SYSLOG_SINK_BACKLOG && s->ring->tail != s->dispatch &&
+           (slot = log_ring_peek(s->ring)) != NULL) {
+        log_ring_release(s->ring, slot);
+        s->dropped_count++;
+        log_sink_count(&log_sink_syslog, false);
     }
+    xSemaphoreGive(s->mutex);
+    return n;
+}
 
-    /* cleanup existing */
-    if (s->initialized) {
-        if (s->udp) {
-            SYSLOG_LWIP_LOCK();
-            udp_remove(s->udp);
-            SYSLOG_LWIP_UNLOCK();
-            s->udp = NULL;
-        }
-        s->initialized = false;
+#if SYSLOG_TCP
+/* Connects ahead of the next record: the first ones after a quiet spell
+ * would go over UDP otherwise. */
+static void syslog_tcp_poll(Syslog_t* s)
+{
+    if (s->tcp || HAL_GetTick() - s->tcp_down_tick < s->tcp_delay_ms) return;
+    if (mutex_mon_take(s->mutex, portMAX_DELAY) != pdTRUE) return;
+    if (s->initialized && s->udp) {
+        SYSLOG_LWIP_LOCK();
+        if (syslog_reachable_locked(s)) syslog_tcp_connect_locked(s);
+        SYSLOG_LWIP_UNLOCK();
     }
+    xSemaphoreGive(s->mutex);
+}
+#endif
 
-    s->server = server;
-    s->port = (uint16_t)port;
+static void syslog_sender_task(void* argument)
+{
+    Syslog_t* s = (Syslog_t*)argument;
 
-    SYSLOG_LWIP_LOCK();
-    s->udp = udp_new();
-    if (s->udp) {
-        err_t bindErr = udp_bind(s->udp, IP_ADDR_ANY, 0);
-        if (bindErr != ERR_OK) {
-            udp_remove(s->udp);
-            s->udp = NULL;
+    for (;;) {
+        /* Producers notify on every commit; the timeout also picks up a slot
+         * whose producer was preempted between reserve and commit. */
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SYSLOG_SENDER_POLL_MS));
+
+#if SYSLOG_LIMITING
+        LogLimitReport_t rep;
+        if (log_limit_expire(HAL_GetTick(), &rep)) syslog_emit_report(s, &rep, LOG_LEVEL_INFO, NULL);
+#endif
+
+#if SYSLOG_TCP
+        syslog_tcp_poll(s);
+#endif
+        /* Drop the core lock between batches so the stack makes progress
+         * during a long burst. */
+        while (syslog_drain_batch(s) == SYSLOG_BATCH_MAX) {
+#if SYSLOG_ARCHIVE
+            log_store_flush();
+#endif
+            taskYIELD();
         }
+#if SYSLOG_ARCHIVE
+        syslog_replay(s);
+        /* Flash writes, out of the core lock and s->mutex */
+        log_store_flush();
+#endif
+#if BOOT_TIME
+        boot_time_report();
+#endif
     }
-    SYSLOG_LWIP_UNLOCK();
+}
 
-    if (!s->udp) {
-        xSemaphoreGive(s->mutex);
-        printf("ERROR: Failed to create UDP PCB for syslog\n");
-        return false;
+/* Creates the record ring and the sender task once. Caller holds s->mutex. */
+static bool syslog_start_sender(Syslog_t* s)
+{
+    if (!s->ring) {
+        log_ring_init(&syslog_ring_urgent, syslog_ring_urgent_slots, SYSLOG_RING_URGENT_SLOTS);
+        log_ring_init(&syslog_ring, syslog_ring_slots, SYSLOG_RING_SLOTS);
+        s->dispatch = 0;
+        s->urgent_dispatch = 0;
+        s->urgent = &syslog_ring_urgent;
+        s->ring = &syslog_ring;
+    }
+    if (!s->task) {
+        s->task = xTaskCreateStatic(syslog_sender_task, "SyslogTx",
+                                    SYSLOG_TASK_STACK_WORDS, s,
+                                    SYSLOG_TASK_PRIORITY,
+                                    syslog_task_stack, &syslog_task_cb);
+        if (!s->task) return false;
     }
-
-    s->initialized = true;
-    xSemaphoreGive(s->mutex);
-    char ipbuf[48];
-    printf("Syslog initialized: %s:%u\n", ipaddr_ntoa_r(&s->server, ipbuf, sizeof(ipbuf)), (unsigned)s->port);
     return true;
 }
 
+/* A slot for a record of level, never blocking: ERROR and WARNING take
+ * the urgent lane and overflow into the main ring, DEBUG and VERBOSE leave
+ * SYSLOG_RING_SHED_KEEP slots of it to the rest. *ring gets the commit. */
+static LogRingSlot_t* syslog_reserve(Syslog_t* s, log_level_t level, LogRing_t** ring)
+{
+    LogRingSlot_t* slot;
+    if (level <= SYSLOG_URGENT_LEVEL) {
+        *ring = s->urgent;
+        slot = log_ring_try_reserve(s->urgent, 0U);
+        if (slot) return slot;
+    }
+    *ring = s->ring;
+    slot = log_ring_try_reserve(s->ring, level > SYSLOG_SHED_LEVEL ? SYSLOG_RING_SHED_KEEP : 0U);
+    if (!slot) log_ring_count_drop(s->ring);
+    return slot;
+}
+
+/* Formats straight into a reserved ring slot; never blocks. */
+static bool syslog_enqueue(Syslog_t* s, log_level_t level, const char* tag, const char* message)
+{
+    LogRing_t* ring;
+    LogRingSlot_t* slot = syslog_reserve(s, level, &ring);
+    if (!slot) return false;
+
+    size_t msgLen = syslog_format_msg(s, slot->data, sizeof(slot->data), level, tag, message);
+    if (msgLen == 0) {
+        /* Too long for one slot: keep the truncated line rather than
+         * losing it entirely. */
+        msgLen = strnlen(slot->data, sizeof(slot->data) - 1);
+    }
+    slot->len = (uint16_t)msgLen;
+    slot->level = (uint8_t)level;
+    slot->kind = LOG_RING_KIND_TEXT;
+    /* An empty slot is still committed so the consumer can move past it. */
+    log_ring_commit(ring, slot);
+    xTaskNotifyGive(s->task);
+    return msgLen != 0;
+}
+#endif /* SYSLOG_ASYNC */
+
 bool logger_output(log_level_t level, const char* tag, const char* message)
 {
     Syslog_t* s = get_logger_obj();
+    if (!message) message = "";
+
+    /* Filtered and rate-limited lines return early and are not timed */
+    PERF_START;
+#if SYSLOG_LIMITING
+    /* Only remote output is limited; the printf fallback before init is not. */
+    if (s && s->initialized) {
+        if (!logger_level_enabled(level, tag)) return true;
+        uint32_t h = log_limit_hash(message, strlen(message), LOG_LIMIT_HASH_SEED);
+        if (!syslog_limit(s, level, tag, h)) return true;
+    }
+#endif
+#if SYSLOG_BKP_LOG
+    if (log_sink_wants(&log_sink_bkp, level)) {
+        bkp_log_text(level, tag, message);
+        log_sink_count(&log_sink_bkp, true);
+    }
+#endif
+    bool ok = syslog_output(s, level, tag, message);
+    PERF_STOP("logger_output");
+    return ok;
+}
+
+static bool syslog_output(Syslog_t* s, log_level_t level, const char* tag, const char* message)
+{
 
+#if SYSLOG_ASYNC
+    if (s && s->initialized && s->ring) {
+        if (!logger_level_enabled(level, tag)) return true;
+        /* No sink fed from the ring takes it */
+        if (level > log_sink_ring_level) return true;
+        return syslog_enqueue(s, level, tag, message);
+    }
+#else
     /* If syslog is initialized, send via UDP. Otherwise fallback to printf. */
     if (s && s->initialized && s->udp && s->mutex) {
-        if (level > s->min_level) return true;
+        if (!logger_level_enabled(level, tag)) return true;
 
-        if (xSemaphoreTake(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) {
+        if (mutex_mon_take(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) {
             s->failed_count++;
             return false;
         }
@@ -196,37 +1620,31 @@ bool logger_output(log_level_t level, const char* tag, const char* message)
             xSemaphoreGive(s->mutex);
             /* fallthrough to printf fallback below */
         } else {
-            char buffer[SYSLOG_MAX_MESSAGE_SIZE];
-            size_t msgLen = syslog_format_msg(s, buffer, sizeof(buffer), level, tag, message);
+            /* Format straight into the TX pbuf payload. */
+            struct pbuf* p = syslog_pbuf_alloc(SYSLOG_TX_PAYLOAD_MAX);
+            size_t msgLen = p ? syslog_format_msg(s, (char*)p->payload, p->len, level, tag, message) : 0;
             if (msgLen == 0) {
+                if (p) pbuf_free(p);
                 s->failed_count++;
                 xSemaphoreGive(s->mutex);
                 return false;
             }
-
-            bool ok = false;
-            SYSLOG_LWIP_LOCK();
-            struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)msgLen, PBUF_RAM);
-            if (p) {
-                if (pbuf_take(p, buffer, msgLen) == ERR_OK) {
-                    err_t err = udp_sendto(s->udp, p, &s->server, s->port);
-                    ok = (err == ERR_OK);
-                }
+            pbuf_realloc(p, (u16_t)msgLen);
+            log_sink_dispatch((const char*)p->payload, (uint16_t)msgLen, level);
+            if (!log_sink_wants(&log_sink_syslog, level)) {
                 pbuf_free(p);
-            }
-            SYSLOG_LWIP_UNLOCK();
-
-            if (!ok) {
-                s->failed_count++;
                 xSemaphoreGive(s->mutex);
-                return false;
+                return true;
             }
 
-            s->send_count++;
+            SYSLOG_LWIP_LOCK();
+            bool ok = syslog_send_pbuf_locked(s, p, s->port, 1);
+            SYSLOG_LWIP_UNLOCK();
             xSemaphoreGive(s->mutex);
-            return true;
+            return ok;
         }
     }
+#endif
 
     printf("%s\n",message);
     return true;
@@ -237,9 +1655,11 @@ bool logger_printf(log_level_t level, const char* tag, const char* format, ...)
     if (!format) return false;
     char msg[512];
     va_list args;
+    PERF_START;
     va_start(args, format);
     int n = vsnprintf(msg, sizeof(msg), format, args);
     va_end(args);
+    PERF_STOP("logger_format");
 
     if (n < 0) return false;
     if (n >= (int)sizeof(msg)) msg[sizeof(msg)-1] = '\0';
@@ -247,81 +1667,196 @@ bool logger_printf(log_level_t level, const char* tag, const char* format, ...)
     return logger_output(level, tag ? tag : "printf", msg);
 }
 
-bool logger_printf_line(log_level_t level, const char* tag, const char* format, ...)
+#if SYSLOG_ASYNC
+/* Writes a deferred record into the ring. Lock-free and non-blocking, so
+ * also used from interrupt context; the caller wakes the sender. */
+static bool syslog_bin_enqueue(Syslog_t* s, log_level_t level, const char* tag,
+                               const char* fmt, uint32_t nargs, const uint32_t* args)
 {
-    static char line_buf[SYSLOG_MAX_MESSAGE_SIZE];
-    static size_t line_len = 0;
-    static log_level_t cur_level = LOG_LEVEL_DEBUG;
-    static char cur_tag[48] = {0};
-    static SemaphoreHandle_t line_mutex = NULL;
+    LogRing_t* ring;
+    LogRingSlot_t* slot = syslog_reserve(s, level, &ring);
+    if (!slot) return false;
 
-    if (!format) return false;
+    LogBinRecord_t* r = (LogBinRecord_t*)slot->data;
+    r->tick = HAL_GetTick();
+    r->fmt = (uint32_t)(uintptr_t)fmt;
+    const LogTag_t* t = log_tag_intern(tag);
+    r->tag = t ? t->id : 0U;
+    r->level = (uint8_t)level;
+    r->nargs = (uint8_t)nargs;
+    if (nargs) memops_copy(r->args, args, nargs * sizeof(uint32_t));
 
-    if (!line_mutex) {
-        line_mutex = xSemaphoreCreateMutex();
+    slot->len = (uint16_t)LOG_BIN_RECORD_LEN(nargs);
+    slot->level = (uint8_t)level;
+    slot->kind = LOG_RING_KIND_BINARY;
+    log_ring_commit(ring, slot);
+    return true;
+}
+#endif /* SYSLOG_ASYNC */
+
+bool logger_bin_write(log_level_t level, const char* tag, const char* fmt,
+                      uint32_t nargs, const uint32_t* args)
+{
+    if (!fmt) return false;
+    if (!tag) tag = "bin";
+    if (nargs > SYSLOG_BIN_MAX_ARGS) nargs = SYSLOG_BIN_MAX_ARGS;
+    Syslog_t* s = get_logger_obj();
+
+#if SYSLOG_ASYNC
+    if (s && s->initialized && s->ring) {
+        if (!logger_level_enabled(level, tag)) return true;
+#if SYSLOG_LIMITING
+        uint32_t h = log_limit_hash(&fmt, sizeof(fmt), LOG_LIMIT_HASH_SEED);
+        h = log_limit_hash(args, nargs * sizeof(uint32_t), h);
+        if (!syslog_limit(s, level, tag, h)) return true;
+#endif
+#if SYSLOG_BKP_LOG
+        if (log_sink_wants(&log_sink_bkp, level)) {
+            bkp_log_bin(level, tag, fmt, nargs, args);
+            log_sink_count(&log_sink_bkp, true);
+        }
+#endif
+        if (level > log_sink_ring_level) return true;
+        if (!syslog_bin_enqueue(s, level, tag, fmt, nargs, args)) return false;
+        xTaskNotifyGive(s->task);
+        return true;
     }
+#endif
 
-    char tmp[256];
-    va_list args;
-    va_start(args, format);
-    int n = vsnprintf(tmp, sizeof(tmp), format, args);
-    va_end(args);
+    /* Synchronous mode, or before init_logger(): expand in the caller. */
+    (void)s;
+    char msg[SYSLOG_RECORD_SIZE];
+    logger_bin_format(msg, sizeof(msg), fmt, nargs, args);
+    return logger_output(level, tag, msg);
+}
 
-    if (n < 0) return false;
-    if (n >= (int)sizeof(tmp)) tmp[sizeof(tmp)-1] = '\0';
+bool logger_isr_write(log_level_t level, const char* tag, const char* fmt,
+                      uint32_t nargs, const uint32_t* args)
+{
+#if SYSLOG_ASYNC
+    Syslog_t* s = get_logger_obj();
+    if (!fmt) return false;
+    if (!tag) tag = "isr";
+    if (nargs > SYSLOG_BIN_MAX_ARGS) nargs = SYSLOG_BIN_MAX_ARGS;
+    /* The ring and task never go away once created, so no lock is needed
+     * to test them. Nothing is printed before init: there is no safe
+     * output from here. */
+    if (!s->ring || !s->task) return false;
+    if (!logger_level_enabled(level, tag)) return true;
+#if SYSLOG_BKP_LOG
+    if (log_sink_wants(&log_sink_bkp, level)) {
+        bkp_log_bin(level, tag, fmt, nargs, args);
+        log_sink_count(&log_sink_bkp, true);
+    }
+#endif
+    if (level > log_sink_ring_level) return true;
+    if (!syslog_bin_enqueue(s, level, tag, fmt, nargs, args)) return false;
 
-    if (line_mutex && xSemaphoreTake(line_mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) {
-        return false;
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(s->task, &woken);
+    portYIELD_FROM_ISR(woken);
+    return true;
+#else
+    (void)level; (void)tag; (void)fmt; (void)nargs; (void)args;
+    return false;
+#endif
+}
+
+/* Line assembly state of logger_printf_line(). */
+typedef struct {
+    TaskHandle_t owner;     /* NULL when free (pooled contexts only) */
+    size_t len;
+    log_level_t level;
+    char tag[48];
+    char buf[SYSLOG_MAX_MESSAGE_SIZE];
+} SyslogLineCtx_t;
+
+#if configNUM_THREAD_LOCAL_STORAGE_POINTERS <= SYSLOG_LINE_TLS_INDEX
+#error "logger_printf_line() needs configNUM_THREAD_LOCAL_STORAGE_POINTERS > SYSLOG_LINE_TLS_INDEX"
+#endif
+
+static SyslogLineCtx_t line_ctx_pool[SYSLOG_LINE_CTX_COUNT];
+static SyslogLineCtx_t line_ctx_shared;
+static SemaphoreHandle_t line_mutex = NULL;
+
+/* Returns the calling task's context, claiming a free one if needed, or NULL
+ * if the pool is exhausted. */
+static SyslogLineCtx_t* syslog_line_ctx_get(void)
+{
+    SyslogLineCtx_t* c = pvTaskGetThreadLocalStoragePointer(NULL, SYSLOG_LINE_TLS_INDEX);
+    if (c) return c;
+
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (uint32_t i = 0; i < SYSLOG_LINE_CTX_COUNT; i++) {
+        TaskHandle_t expected = NULL;
+        if (__atomic_compare_exchange_n(&line_ctx_pool[i].owner, &expected, self, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            c = &line_ctx_pool[i];
+            c->len = 0;
+            vTaskSetThreadLocalStoragePointer(NULL, SYSLOG_LINE_TLS_INDEX, c);
+            return c;
+        }
     }
+    return NULL;
+}
+
+static void syslog_line_ctx_put(SyslogLineCtx_t* c)
+{
+    vTaskSetThreadLocalStoragePointer(NULL, SYSLOG_LINE_TLS_INDEX, NULL);
+    __atomic_store_n(&c->owner, NULL, __ATOMIC_RELEASE);
+}
 
+/* Appends text to c, emitting every completed line. */
+static bool syslog_line_feed(SyslogLineCtx_t* c, log_level_t level, const char* tag, const char* text)
+{
     bool all_ok = true;
-    const char* p = tmp;
+    const char* p = text;
     while (*p) {
         const char* nl = strpbrk(p, "\r\n");
         size_t chunk_len = nl ? (size_t)(nl - p) : strlen(p);
 
-        if (line_len > 0) {
-            if ((tag && cur_tag[0] && strncmp(cur_tag, tag, sizeof(cur_tag)) != 0) || level != cur_level) {
-                line_buf[line_len] = '\0';
-                all_ok = all_ok && logger_output(cur_level, cur_tag[0] ? cur_tag : (tag ? tag : "printf"), line_buf);
-                line_len = 0;
-                cur_tag[0] = '\0';
+        if (c->len > 0) {
+            if ((tag && c->tag[0] && strncmp(c->tag, tag, sizeof(c->tag)) != 0) || level != c->level) {
+                c->buf[c->len] = '\0';
+                all_ok = all_ok && logger_output(c->level, c->tag[0] ? c->tag : (tag ? tag : "printf"), c->buf);
+                c->len = 0;
+                c->tag[0] = '\0';
             }
         }
 
-        if (line_len == 0) {
-            cur_level = level;
+        if (c->len == 0) {
+            c->level = level;
             const char* use_tag = tag ? tag : "printf";
-            strncpy(cur_tag, use_tag, sizeof(cur_tag)-1);
-            cur_tag[sizeof(cur_tag)-1] = '\0';
+            strncpy(c->tag, use_tag, sizeof(c->tag)-1);
+            c->tag[sizeof(c->tag)-1] = '\0';
         }
 
-        size_t space = sizeof(line_buf) - 1 - line_len;
+        size_t space = sizeof(c->buf) - 1 - c->len;
         if (chunk_len > space) {
-            if (line_len > 0) {
-                line_buf[line_len] = '\0';
-                all_ok = all_ok && logger_output(cur_level, cur_tag, line_buf);
-                line_len = 0;
+            if (c->len > 0) {
+                c->buf[c->len] = '\0';
+                all_ok = all_ok && logger_output(c->level, c->tag, c->buf);
+                c->len = 0;
             }
-            while (chunk_len > sizeof(line_buf) - 1) {
-                size_t seg = sizeof(line_buf) - 1;
-                memcpy(line_buf, p, seg);
-                line_buf[seg] = '\0';
-                all_ok = all_ok && logger_output(level, tag ? tag : "printf", line_buf);
+            while (chunk_len > sizeof(c->buf) - 1) {
+                size_t seg = sizeof(c->buf) - 1;
+                memops_copy(c->buf, p, seg);
+                c->buf[seg] = '\0';
+                all_ok = all_ok && logger_output(level, tag ? tag : "printf", c->buf);
                 p += seg;
                 chunk_len -= seg;
             }
         }
 
-        memcpy(line_buf + line_len, p, chunk_len);
-        line_len += chunk_len;
+        memops_copy(c->buf + c->len, p, chunk_len);
+        c->len += chunk_len;
         p += chunk_len;
 
         if (nl) {
-            line_buf[line_len] = '\0';
-            all_ok = all_ok && logger_output(cur_level, cur_tag, line_buf);
-            line_len = 0;
-            cur_tag[0] = '\0';
+            c->buf[c->len] = '\0';
+            all_ok = all_ok && logger_output(c->level, c->tag, c->buf);
+            c->len = 0;
+            c->tag[0] = '\0';
 
             if (nl[0] == '\r' && nl[1] == '\n') {
                 p = nl + 2;
@@ -332,7 +1867,44 @@ bool logger_printf_line(log_level_t level, const char* tag, const char* format,
             }
         }
     }
+    return all_ok;
+}
+
+bool logger_printf_line(log_level_t level, const char* tag, const char* format, ...)
+{
+    if (!format) return false;
+
+    char tmp[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(tmp, sizeof(tmp), format, args);
+    va_end(args);
+
+    if (n < 0) return false;
+    if (n >= (int)sizeof(tmp)) tmp[sizeof(tmp)-1] = '\0';
+
+    /* Each task assembles into its own context, so concurrent partial lines
+     * neither contend nor flush each other. */
+    if (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) {
+        SyslogLineCtx_t* c = syslog_line_ctx_get();
+        if (c) {
+            bool ok = syslog_line_feed(c, level, tag, tmp);
+            if (c->len == 0) syslog_line_ctx_put(c);
+            return ok;
+        }
+    }
 
+    /* Pool exhausted (or no scheduler yet): fall back to the shared context. */
+    if (!line_mutex) {
+        line_mutex = xSemaphoreCreateMutex();
+#if MUTEX_MON
+        (void)mutex_mon_register(line_mutex, "log_line");
+#endif
+    }
+    if (line_mutex && mutex_mon_take(line_mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) {
+        return false;
+    }
+    bool all_ok = syslog_line_feed(&line_ctx_shared, level, tag, tmp);
     if (line_mutex) {
         xSemaphoreGive(line_mutex);
     }
@@ -344,9 +1916,80 @@ void logger_set_min_level(log_level_t min_level)
     Syslog_t* s = get_logger_obj();
     if (!s) return;
     if (!s->mutex) return;
-    if (xSemaphoreTake(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) return;
+    if (mutex_mon_take(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) return;
     s->min_level = min_level;
+    syslog_update_ceiling(s);
+    xSemaphoreGive(s->mutex);
+}
+
+bool logger_set_tag_level(const char* tag, log_level_t level)
+{
+    Syslog_t* s = get_logger_obj();
+    if (!tag || !s->mutex) return false;
+    if (mutex_mon_take(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) return false;
+
+    bool ok = true;
+    SyslogTagLevel_t* t = syslog_find_tag(tag);
+    if (t) {
+        t->level = level;
+    } else if (tag_level_count < SYSLOG_TAG_LEVELS_MAX) {
+        t = &tag_levels[tag_level_count];
+        strncpy(t->tag, tag, sizeof(t->tag) - 1);
+        t->tag[sizeof(t->tag) - 1] = '\0';
+        t->level = level;
+        tag_level_count++;
+    } else {
+        ok = false;
+    }
+    syslog_update_ceiling(s);
+    xSemaphoreGive(s->mutex);
+    return ok;
+}
+
+void logger_clear_tag_level(const char* tag)
+{
+    Syslog_t* s = get_logger_obj();
+    if (!tag || !s->mutex) return;
+    if (mutex_mon_take(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) return;
+
+    SyslogTagLevel_t* t = syslog_find_tag(tag);
+    if (t) {
+        /* A reader racing with this may filter one message against the old
+         * entry, which is harmless. */
+        *t = tag_levels[tag_level_count - 1];
+        tag_level_count--;
+    }
+    syslog_update_ceiling(s);
+    xSemaphoreGive(s->mutex);
+}
+
+bool logger_get_tag_level(uint32_t i, char* tag, size_t size, log_level_t* level)
+{
+    Syslog_t* s = get_logger_obj();
+    bool ok = false;
+    if (!tag || !size || !level || !s->mutex) return false;
+    if (mutex_mon_take(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) return false;
+    if (i < tag_level_count) {
+        strncpy(tag, tag_levels[i].tag, size - 1);
+        tag[size - 1] = '\0';
+        *level = tag_levels[i].level;
+        ok = true;
+    }
     xSemaphoreGive(s->mutex);
+    return ok;
+}
+
+void logger_get_tcp_stats(LoggerTcpStats_t* stats)
+{
+#if SYSLOG_TCP
+    const Syslog_t* s = get_logger_obj();
+    stats->up = s->tcp_up;
+    stats->connects = s->tcp_connects;
+    stats->failures = s->tcp_failures;
+    stats->udp_fallback = s->udp_fallback;
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif
 }
 
 log_level_t logger_get_min_level(void)
@@ -362,20 +2005,39 @@ void logger_get_stats(uint32_t* sent, uint32_t* failed)
     Syslog_t* s = get_logger_obj();
     if (!s) return;
     if (!s->mutex) return;
-    if (xSemaphoreTake(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) return;
+    if (mutex_mon_take(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) return;
     *sent = s->send_count;
     *failed = s->failed_count;
     xSemaphoreGive(s->mutex);
 }
 
+uint32_t logger_get_dropped_count(void)
+{
+    Syslog_t* s = get_logger_obj();
+    if (!s) return 0;
+#if SYSLOG_ASYNC
+    if (s->ring) return s->dropped_count + log_ring_dropped(s->ring) + log_ring_dropped(s->urgent);
+#endif
+    return s->dropped_count;
+}
+
+uint32_t logger_get_suppressed_count(void)
+{
+    Syslog_t* s = get_logger_obj();
+    if (!s) return 0;
+    return s->suppressed_count;
+}
+
 void logger_reset_stats(void)
 {
     Syslog_t* s = get_logger_obj();
     if (!s) return;
     if (!s->mutex) return;
-    if (xSemaphoreTake(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) return;
+    if (mutex_mon_take(s->mutex, pdMS_TO_TICKS(MUTEX_TIMEOUT_MS)) != pdTRUE) return;
     s->send_count = 0;
     s->failed_count = 0;
+    s->dropped_count = 0;
+    s->suppressed_count = 0;
     xSemaphoreGive(s->mutex);
 }
 
@@ -8,10 +8,20 @@
  * over UDP. Integrates with ESP32-Logger via callback mechanism.
  *
  * Features:
- * - RFC 3164 (BSD syslog) compliant message format
- * - UDP transport (fire-and-forget, low overhead)
+ * - RFC 5424 message format with microsecond UTC timestamps (SYSLOG_RFC5424),
+ *   or RFC 3164 (BSD syslog)
+ * - UDP transport (fire-and-forget, low overhead), or RFC 6587 octet-counted
+ *   records pipelined over one persistent TCP connection (SYSLOG_TCP),
+ *   with UDP while it is down and reconnects under exponential backoff
  * - Thread-safe with FreeRTOS mutex protection
- * - Configurable log level filtering
+ * - Optional asynchronous mode (SYSLOG_ASYNC): callers enqueue, a sender task transmits
+ * - Deferred formatting (LOG_BIN): only the format address and raw arguments are recorded,
+ *   the format checked against the argument types at compile time
+ * - Interrupt-safe logging (LOG_ISR) through the same lock-free ring
+ * - Priority lanes: ERROR/WARNING in a ring of their own, sent first; DEBUG/VERBOSE
+ *   refused first when the main ring fills
+ * - Configurable log level filtering, globally and per tag, checked before formatting
+ * - Rate limiting and duplicate coalescing ("last message repeated N times")
  * - Statistics tracking (sent/failed counts)
  * - Supports both WiFi and Ethernet (define SYSLOG_USE_ETHERNET)
  */
@@ -27,6 +37,9 @@ extern "C" {
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "syslog_opts.h"
 
 typedef int log_level_t;
 
@@ -61,13 +74,177 @@ typedef int log_level_t;
 #define SYSLOG_FACILITY_LOCAL6   22
 #define SYSLOG_FACILITY_LOCAL7   23
 
-// Safe to call multiple times. Returns true on success.
+// Safe to call multiple times. Returns true on success. ipstr is an address
+// or a host name (component/resolv/resolv.h), which must then stay valid.
 bool init_logger(const char* ipstr, int port);
 int logger_is_initialized(void);
 bool logger_printf(log_level_t level, const char* tag, const char* format, ...);
 bool logger_printf_line(log_level_t level, const char* tag, const char* format, ...);
 void logger_set_min_level(log_level_t minLevel);
 log_level_t logger_get_min_level(void);
+void logger_get_stats(uint32_t* sent, uint32_t* failed);
+void logger_reset_stats(void);
+
+// Per-tag threshold replacing the global minimum level for that tag (more or
+// less verbose). Returns false when the table is full.
+bool logger_set_tag_level(const char* tag, log_level_t level);
+void logger_clear_tag_level(const char* tag);
+
+// Most verbose level enabled for any tag; maintained by the setters above.
+extern volatile log_level_t logger_level_ceiling;
+bool logger_tag_level_enabled(log_level_t level, const char* tag);
+
+// Cheap pre-format check used by the LOG_* macros: a single compare when the
+// level is above every threshold, a table lookup only otherwise.
+static inline bool logger_level_enabled(log_level_t level, const char* tag)
+{
+    if (level > logger_level_ceiling) return false;
+    return logger_tag_level_enabled(level, tag);
+}
+
+// Copies the i-th per-tag override; false past the last one.
+bool logger_get_tag_level(uint32_t i, char* tag, size_t size, log_level_t* level);
+
+// Outputs once init_logger() ran, see log_sink.h; before it records are
+// printed.
+
+// TCP transport (SYSLOG_TCP); zeros without it.
+typedef struct {
+    bool up;                // records go over TCP
+    uint32_t connects;
+    uint32_t failures;      // connects failed and connections lost
+    uint32_t udp_fallback;  // records sent over UDP while it was down
+} LoggerTcpStats_t;
+void logger_get_tcp_stats(LoggerTcpStats_t* stats);
+
+// Records dropped because the asynchronous queue was full.
+uint32_t logger_get_dropped_count(void);
+// Records withheld by the rate limiter or duplicate coalescing.
+uint32_t logger_get_suppressed_count(void);
+
+// Deferred logging: stores the fmt address, the interned tag id (log_tag.h),
+// a tick and nargs raw 32-bit arguments; formatting happens in the sender task or on the host
+// (SYSLOG_BIN_REMOTE). Use through LOG_BIN().
+bool logger_bin_write(log_level_t level, const char* tag, const char* fmt,
+                      uint32_t nargs, const uint32_t* args);
+
+// Interrupt-context variant of logger_bin_write(): never blocks and takes no
+// lock or lwIP call, wakes the sender with vTaskNotifyGiveFromISR(). Only
+// for ISRs at or below configMAX_SYSCALL_INTERRUPT_PRIORITY. Needs
+// SYSLOG_ASYNC and init_logger(); returns false otherwise or when the ring is
+// full. Use through LOG_ISR().
+bool logger_isr_write(log_level_t level, const char* tag, const char* fmt,
+                      uint32_t nargs, const uint32_t* args);
+
+// Expands a deferred record: fmt applied to the nargs words args that
+// LOG_BIN() packed. Used by the sender task and by bkp_log replay.
+void logger_bin_format(char* out, size_t size, const char* fmt,
+                       uint32_t nargs, const uint32_t* args);
+
+/*
+ * LOG_BIN(level, tag, fmt, ...) - deferred printf-style logging.
+ *
+ * fmt and tag must be string literals (or otherwise live in flash for the
+ * lifetime of the firmware); %s arguments must also point at constant
+ * strings. Each argument is packed by its type into 32-bit words: one for
+ * integers of up to 32 bits, chars and pointers, two for long long and
+ * double (float is promoted, as printf does). At most SYSLOG_BIN_MAX_ARGS
+ * words, at most 8 arguments.
+ *
+ * The format is checked against the arguments at compile time as for
+ * printf, and a mismatch is an error, not a warning: the record is decoded
+ * later by walking fmt (logger_bin_format(), tools/log_decode.py), so a
+ * wrong conversion would misread every word after it. Too many words fail
+ * a static assertion. The check costs no code; a call is the level test,
+ * one store per word and logger_bin_write().
+ */
+static inline __attribute__((format(printf, 1, 2))) void log_bin_check(const char* fmt, ...)
+{
+    (void)fmt;
+}
+
+static inline uint32_t* log_bin_put32(uint32_t* p, uint32_t v)
+{
+    p[0] = v;
+    return p + 1;
+}
+
+static inline uint32_t* log_bin_put64(uint32_t* p, uint64_t v)
+{
+    p[0] = (uint32_t)v;
+    p[1] = (uint32_t)(v >> 32);
+    return p + 2;
+}
+
+static inline uint32_t* log_bin_put_double(uint32_t* p, double v)
+{
+    uint64_t u;
+    __builtin_memcpy(&u, &v, sizeof(u));
+    return log_bin_put64(p, u);
+}
+
+#if __SIZEOF_LONG__ == 8
+#define log_bin_put_long log_bin_put64
+#define LOG_BIN_LONG_WORDS 2U
+#else
+#define log_bin_put_long log_bin_put32
+#define LOG_BIN_LONG_WORDS 1U
+#endif
+
+/* Words an argument takes; an integer constant expression */
+#define LOG_BIN_WORDS1(a) _Generic((a), \
+    float: 2U, double: 2U, long long: 2U, unsigned long long: 2U, \
+    long: LOG_BIN_LONG_WORDS, unsigned long: LOG_BIN_LONG_WORDS, default: 1U)
+
+/* Packs a at p and advances p. Only the default branch converts, which is
+ * valid for any scalar, so the branches not taken compile for every type. */
+#define LOG_BIN_PUT1(p, a) ((p) = _Generic((a), \
+    float: log_bin_put_double, double: log_bin_put_double, \
+    long long: log_bin_put64, unsigned long long: log_bin_put64, \
+    long: log_bin_put_long, unsigned long: log_bin_put_long, \
+    default: log_bin_put32)((p), _Generic((a), \
+    float: (a), double: (a), long long: (a), unsigned long long: (a), \
+    long: (a), unsigned long: (a), default: (uint32_t)(uintptr_t)(a))))
+
+#define LOG_BIN_W0(m, s)
+#define LOG_BIN_W1(m, s, a)      s m(a)
+#define LOG_BIN_W2(m, s, a, ...) s m(a) LOG_BIN_W1(m, s, __VA_ARGS__)
+#define LOG_BIN_W3(m, s, a, ...) s m(a) LOG_BIN_W2(m, s, __VA_ARGS__)
+#define LOG_BIN_W4(m, s, a, ...) s m(a) LOG_BIN_W3(m, s, __VA_ARGS__)
+#define LOG_BIN_W5(m, s, a, ...) s m(a) LOG_BIN_W4(m, s, __VA_ARGS__)
+#define LOG_BIN_W6(m, s, a, ...) s m(a) LOG_BIN_W5(m, s, __VA_ARGS__)
+#define LOG_BIN_W7(m, s, a, ...) s m(a) LOG_BIN_W6(m, s, __VA_ARGS__)
+#define LOG_BIN_W8(m, s, a, ...) s m(a) LOG_BIN_W7(m, s, __VA_ARGS__)
+#define LOG_BIN_SEL(_0, _1, _2, _3, _4, _5, _6, _7, _8, name, ...) name
+/* s m(a) for every argument */
+#define LOG_BIN_EACH(m, s, ...) \
+    LOG_BIN_SEL(_0, ##__VA_ARGS__, LOG_BIN_W8, LOG_BIN_W7, LOG_BIN_W6, LOG_BIN_W5, \
+                LOG_BIN_W4, LOG_BIN_W3, LOG_BIN_W2, LOG_BIN_W1, LOG_BIN_W0)(m, s, ##__VA_ARGS__)
+
+#define LOG_BIN_PUT_ARG(a) LOG_BIN_PUT1(_log_bin_p, a)
+
+#define LOG_BIN_EMIT(write, level, tag, fmt, ...) do { \
+    _Pragma("GCC diagnostic push") \
+    _Pragma("GCC diagnostic error \"-Wformat\"") \
+    _Pragma("GCC diagnostic error \"-Wformat-extra-args\"") \
+    if (0) log_bin_check(fmt, ##__VA_ARGS__); \
+    _Pragma("GCC diagnostic pop") \
+    enum { _log_bin_n = 0U LOG_BIN_EACH(LOG_BIN_WORDS1, +, ##__VA_ARGS__) }; \
+    _Static_assert(_log_bin_n <= SYSLOG_BIN_MAX_ARGS, "LOG_BIN: arguments exceed SYSLOG_BIN_MAX_ARGS words"); \
+    if (logger_level_enabled((level), (tag))) { \
+        uint32_t _log_bin_w[_log_bin_n + 1U]; \
+        uint32_t* _log_bin_p = _log_bin_w; \
+        LOG_BIN_EACH(LOG_BIN_PUT_ARG, ;, ##__VA_ARGS__); \
+        write((level), (tag), (fmt), (uint32_t)(_log_bin_p - _log_bin_w), _log_bin_w); \
+    } \
+} while (0)
+
+#define LOG_BIN(level, tag, fmt, ...) LOG_BIN_EMIT(logger_bin_write, level, tag, fmt, ##__VA_ARGS__)
+
+/* LOG_ISR(level, tag, fmt, ...) - LOG_BIN() for interrupt handlers, same
+ * argument rules. */
+#define LOG_ISR(level, tag, fmt, ...) LOG_BIN_EMIT(logger_isr_write, level, tag, fmt, ##__VA_ARGS__)
+
 #ifdef __cplusplus
 }
 #endif
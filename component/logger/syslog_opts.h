@@ -0,0 +1,384 @@
+/**
+ * @file syslog_opts.h
+ * @brief Build-time options for the syslog client.
+ *
+ * Every option can be overridden from the compiler command line or by
+ * defining it before this header is included.
+ */
+
+#pragma once
+
+#ifndef LOGGER_SYSLOG_OPTS_H
+#define LOGGER_SYSLOG_OPTS_H
+
+/* Asynchronous mode: callers only enqueue a formatted record, a dedicated
+ * low-priority task drains the queue to UDP. Set to 0 for the legacy
+ * behaviour where every caller sends on its own thread. */
+#ifndef SYSLOG_ASYNC
+#define SYSLOG_ASYNC 1
+#endif
+
+/* Number of slots in the lock-free record ring (power of two). */
+#ifndef SYSLOG_RING_SLOTS
+#define SYSLOG_RING_SLOTS 64
+#endif
+
+/* Urgent lane: a second ring for records up to SYSLOG_URGENT_LEVEL (2:
+ * ERROR and WARNING). The sender drains it before the main ring, and a
+ * flood of lower records cannot fill it; when it is full its records go
+ * to the main ring. Power of two. */
+#ifndef SYSLOG_RING_URGENT_SLOTS
+#define SYSLOG_RING_URGENT_SLOTS 16
+#endif
+
+#ifndef SYSLOG_URGENT_LEVEL
+#define SYSLOG_URGENT_LEVEL 2
+#endif
+
+/* Main ring slots that records above SYSLOG_SHED_LEVEL (3: DEBUG and
+ * VERBOSE) cannot take: under pressure they are refused first, leaving
+ * room for INFO and overflowing urgent records. */
+#ifndef SYSLOG_RING_SHED_KEEP
+#define SYSLOG_RING_SHED_KEEP (SYSLOG_RING_SLOTS / 4)
+#endif
+
+#ifndef SYSLOG_SHED_LEVEL
+#define SYSLOG_SHED_LEVEL 3
+#endif
+
+/* Size of one ring slot including its header, multiple of the 32-byte cache
+ * line. Longer lines are truncated. */
+#ifndef SYSLOG_RECORD_SIZE
+#define SYSLOG_RECORD_SIZE 256
+#endif
+
+/* Upper bound on how long the sender sleeps without a notification. */
+#ifndef SYSLOG_SENDER_POLL_MS
+#define SYSLOG_SENDER_POLL_MS 10
+#endif
+
+/* Maximum records the sender drains per LOCK_TCPIP_CORE() acquisition. */
+#ifndef SYSLOG_BATCH_MAX
+#define SYSLOG_BATCH_MAX 16
+#endif
+
+/* Pack several newline-separated records into one UDP datagram. Only enable
+ * this if the receiver splits datagrams on '\n' (rsyslog imudp does not by
+ * default), otherwise records arrive merged. */
+#ifndef SYSLOG_BATCH_PACK
+#define SYSLOG_BATCH_PACK 0
+#endif
+
+/* Payload limit of a packed datagram: Ethernet MTU minus IPv4 and UDP headers. */
+#ifndef SYSLOG_BATCH_DATAGRAM_MAX
+#define SYSLOG_BATCH_DATAGRAM_MAX (1500 - 20 - 8)
+#endif
+
+/* Dedicated pool of zero-copy TX pbufs. Each buffer must hold the
+ * transport-layer headroom plus the largest datagram (a packed batch or, in
+ * synchronous mode, a SYSLOG_MAX_MESSAGE_SIZE line). */
+#ifndef SYSLOG_TX_POOL_COUNT
+#define SYSLOG_TX_POOL_COUNT 4
+#endif
+
+#ifndef SYSLOG_TX_POOL_BUF_SIZE
+#define SYSLOG_TX_POOL_BUF_SIZE 1536
+#endif
+
+/* Sender task parameters (FreeRTOS priority values, stack in words). */
+#ifndef SYSLOG_TASK_PRIORITY
+#define SYSLOG_TASK_PRIORITY 4 /* osPriorityLow, see configOS2_TO_RTOS_PRIO() */
+#endif
+
+#ifndef SYSLOG_TASK_STACK_WORDS
+#define SYSLOG_TASK_STACK_WORDS 384
+#endif
+
+/* Runtime per-tag level overrides (logger_set_tag_level()). */
+#ifndef SYSLOG_TAG_LEVELS_MAX
+#define SYSLOG_TAG_LEVELS_MAX 8
+#endif
+
+/* Tag names are compared up to this many characters. */
+#ifndef SYSLOG_TAG_NAME_MAX
+#define SYSLOG_TAG_NAME_MAX 16
+#endif
+
+/* Interned tags (log_tag.h): entries, a power of two up to 256, and the
+ * longest name plus one; other tags are formatted as they come. */
+#ifndef SYSLOG_TAG_INTERN
+#define SYSLOG_TAG_INTERN 64
+#endif
+
+#ifndef SYSLOG_TAG_INTERN_LEN
+#define SYSLOG_TAG_INTERN_LEN 24
+#endif
+
+/* Storm protection (log_limit.c): token bucket per tag/level, in records
+ * per second with a burst allowance. Not applied to LOG_ISR(). */
+#ifndef SYSLOG_LIMIT
+#define SYSLOG_LIMIT 1
+#endif
+
+#ifndef SYSLOG_LIMIT_RATE
+#define SYSLOG_LIMIT_RATE 20
+#endif
+
+#ifndef SYSLOG_LIMIT_BURST
+#define SYSLOG_LIMIT_BURST 40
+#endif
+
+/* Number of buckets (power of two). */
+#ifndef SYSLOG_LIMIT_BUCKETS
+#define SYSLOG_LIMIT_BUCKETS 16
+#endif
+
+/* Coalesce identical consecutive records into "last message repeated N
+ * times", reported at the latest after SYSLOG_DEDUP_FLUSH_MS. */
+#ifndef SYSLOG_DEDUP
+#define SYSLOG_DEDUP 1
+#endif
+
+#ifndef SYSLOG_DEDUP_FLUSH_MS
+#define SYSLOG_DEDUP_FLUSH_MS 5000
+#endif
+
+/* logger_printf_line() assembly contexts. A task holds one only while it
+ * has an unterminated line; when all are taken, callers share a single
+ * mutex-protected context. The TLS index must be below
+ * configNUM_THREAD_LOCAL_STORAGE_POINTERS. */
+#ifndef SYSLOG_LINE_CTX_COUNT
+#define SYSLOG_LINE_CTX_COUNT 4
+#endif
+
+#ifndef SYSLOG_LINE_TLS_INDEX
+#define SYSLOG_LINE_TLS_INDEX 0
+#endif
+
+/* Deferred (binary) logging, see LOG_BIN() in syslog.h. Maximum number of
+ * 32-bit argument words stored per record (64-bit values take two). */
+#ifndef SYSLOG_BIN_MAX_ARGS
+#define SYSLOG_BIN_MAX_ARGS 8
+#endif
+
+/* 0: the sender task expands deferred records into normal syslog lines.
+ * 1: records are shipped unexpanded to SYSLOG_BIN_PORT on the syslog server
+ *    and expanded off-box by tools/log_decode.py against the firmware ELF. */
+#ifndef SYSLOG_BIN_REMOTE
+#define SYSLOG_BIN_REMOTE 0
+#endif
+
+#ifndef SYSLOG_BIN_PORT
+#define SYSLOG_BIN_PORT 5140
+#endif
+
+/* The tag id table goes to SYSLOG_BIN_PORT whenever tags were added and
+ * at least this often while deferred records are sent */
+#ifndef SYSLOG_BIN_TAGS_MS
+#define SYSLOG_BIN_TAGS_MS 30000U
+#endif
+
+/* Archive (log_store.c): while the server is unreachable the sender task
+ * appends records to a log in the QSPI flash instead of failing them, and
+ * replays them once it is reachable again. Needs QSPI_FLASH. */
+#ifndef SYSLOG_ARCHIVE
+#define SYSLOG_ARCHIVE 1
+#endif
+
+/* Device range of the archive in whole 4 KB sectors: the top megabyte of a
+ * 16 MB part, above the QSPI region of the linker script. */
+#ifndef SYSLOG_ARCHIVE_OFFSET
+#define SYSLOG_ARCHIVE_OFFSET 0x00F00000U
+#endif
+
+#ifndef SYSLOG_ARCHIVE_SIZE
+#define SYSLOG_ARCHIVE_SIZE 0x00100000U
+#endif
+
+/* Records waiting in the ring for an unreachable server before the sender
+ * moves them to the archive; fewer are just held, a boot's wait for the
+ * link costs no flash write. */
+#ifndef SYSLOG_ARCHIVE_RING_FILL
+#define SYSLOG_ARCHIVE_RING_FILL (SYSLOG_RING_SLOTS / 2)
+#endif
+
+/* RAM the sender stages archived records in while it holds the core lock;
+ * they are written to the flash after the batch. */
+#ifndef SYSLOG_ARCHIVE_STAGE_SIZE
+#define SYSLOG_ARCHIVE_STAGE_SIZE 4096
+#endif
+
+/* Archived records sent per sender pass once the server is back. */
+#ifndef SYSLOG_ARCHIVE_REPLAY_MAX
+#define SYSLOG_ARCHIVE_REPLAY_MAX 8
+#endif
+
+/* Longest wait for readers of the mapped QSPI flash before the archive
+ * gives up writing until the next pass. */
+#ifndef SYSLOG_ARCHIVE_BUS_WAIT_MS
+#define SYSLOG_ARCHIVE_BUS_WAIT_MS 50
+#endif
+
+/* Backup SRAM log (bkp_log.c): the latest records and a crash record kept
+ * in the 4 KB backup SRAM across resets, replayed to syslog at the next
+ * boot. */
+#ifndef SYSLOG_BKP_LOG
+#define SYSLOG_BKP_LOG 1
+#endif
+
+/* Records up to this level (LOG_LEVEL_INFO) go to the backup SRAM too */
+#ifndef SYSLOG_BKP_LOG_LEVEL
+#define SYSLOG_BKP_LOG_LEVEL 3
+#endif
+
+/* 1: a crash resets the MCU once recorded, unless a debugger is attached;
+ * 0: it hangs as before. */
+#ifndef SYSLOG_BKP_LOG_RESET
+#define SYSLOG_BKP_LOG_RESET 1
+#endif
+
+/* Console (console.c): printf() and the logger's fallback before syslog
+ * runs go to a RAM ring drained to the ITM stimulus port, never blocking;
+ * 0 leaves the weak _write() of syscalls.c. */
+#ifndef SYSLOG_CONSOLE
+#define SYSLOG_CONSOLE 1
+#endif
+
+/* Console ring in bytes (power of two); output beyond it is dropped */
+#ifndef SYSLOG_CONSOLE_RING_SIZE
+#define SYSLOG_CONSOLE_RING_SIZE 2048
+#endif
+
+#ifndef SYSLOG_CONSOLE_ITM_PORT
+#define SYSLOG_CONSOLE_ITM_PORT 0
+#endif
+
+/* Bytes moved to the ITM per console_drain() call, bounds the time spent
+ * with interrupts masked */
+#ifndef SYSLOG_CONSOLE_DRAIN_MAX
+#define SYSLOG_CONSOLE_DRAIN_MAX 64
+#endif
+
+/* Sink levels at boot (log_sink.h), log_sink_set_level() at run time;
+ * the backup SRAM sink starts at SYSLOG_BKP_LOG_LEVEL. 0 turns one off. */
+#ifndef SYSLOG_SINK_SYSLOG_LEVEL
+#define SYSLOG_SINK_SYSLOG_LEVEL 5
+#endif
+
+#ifndef SYSLOG_SINK_FLASH_LEVEL
+#define SYSLOG_SINK_FLASH_LEVEL 5
+#endif
+
+#ifndef SYSLOG_SINK_CONSOLE_LEVEL
+#define SYSLOG_SINK_CONSOLE_LEVEL 0
+#endif
+
+/* LZ4 blocks (compress/lz4_block.h) on the sinks that have them, switched
+ * per sink at run time (log_sink_set_lz4(), log_ctl "sink <name> lz4
+ * on|off"); 0 leaves the code out:
+ *  - syslog over TCP: each staged batch of framed records that shrinks
+ *    goes as "Z", u16 raw length, u16 block length (network byte order)
+ *    and the block, in place of the records. A plain receiver does not
+ *    read that, tools/lz4_relay.py of the compress component does.
+ *  - flash: the records of a sender pass are archived as one compressed
+ *    record, a single line alone hardly shrinks. Replay sends them as
+ *    they were. */
+#ifndef SYSLOG_LZ4
+#define SYSLOG_LZ4 1
+#endif
+
+/* Sink switches at boot */
+#ifndef SYSLOG_SINK_SYSLOG_LZ4
+#define SYSLOG_SINK_SYSLOG_LZ4 0
+#endif
+
+#ifndef SYSLOG_SINK_FLASH_LZ4
+#define SYSLOG_SINK_FLASH_LZ4 1
+#endif
+
+/* Framed text records gathered for one compressed archive record */
+#ifndef SYSLOG_ARCHIVE_LZ4_BATCH
+#define SYSLOG_ARCHIVE_LZ4_BATCH 2048
+#endif
+
+/* Records the syslog sink holds in the ring for an unreachable or slow
+ * server; beyond them its oldest are dropped, the rest of the ring stays
+ * free for the records the other sinks have not seen yet. */
+#ifndef SYSLOG_SINK_BACKLOG
+#define SYSLOG_SINK_BACKLOG (SYSLOG_RING_SLOTS - SYSLOG_RING_SLOTS / 8)
+#endif
+
+/* Remote configuration (log_ctl.c): text commands on a UDP port change the
+ * levels, the rate limit and the sinks at run time. */
+#ifndef SYSLOG_CTL
+#define SYSLOG_CTL 1
+#endif
+
+#ifndef SYSLOG_CTL_PORT
+#define SYSLOG_CTL_PORT 5514
+#endif
+
+/* Address commands are taken from, "" for any; the port is not
+ * authenticated otherwise */
+#ifndef SYSLOG_CTL_PEER
+#define SYSLOG_CTL_PEER ""
+#endif
+
+#ifndef SYSLOG_CTL_PRIORITY
+#define SYSLOG_CTL_PRIORITY 8 /* osPriorityBelowNormal, see configOS2_TO_RTOS_PRIO() */
+#endif
+
+#ifndef SYSLOG_CTL_STACK_WORDS
+#define SYSLOG_CTL_STACK_WORDS 384
+#endif
+
+/* Records wait in the ring while the ETH driver's logging class queue has
+ * fewer free slots than this (ethernetif_tx_class_room()): a burst over the
+ * shaped rate (ETHIF_TX_SHAPE) is sent later instead of being refused.
+ * 0: no check, for builds without the driver. */
+#ifndef SYSLOG_TX_ROOM
+#define SYSLOG_TX_ROOM 2
+#endif
+
+/* IP TOS of syslog datagrams: DSCP CS2, the logging class of the ETH TX
+ * scheduler (ETHIF_TX_SCHED) */
+#ifndef SYSLOG_TOS
+#define SYSLOG_TOS 0x40U
+#endif
+
+/* Record format. 1: RFC 5424, "<PRI>1 TIMESTAMP HOST APP - TAG [meta
+ * sequenceId sysUpTime] MSG" with a microsecond UTC timestamp once SNTP
+ * has synced (the RTC's millisecond time before). 0: RFC 3164 as before. */
+#ifndef SYSLOG_RFC5424
+#define SYSLOG_RFC5424 1
+#endif
+
+/* TCP transport (RFC 6587 octet counting, "LEN SP MSG") on one persistent
+ * connection to the server; records go over UDP while it is down. Needs
+ * SYSLOG_ASYNC. */
+#ifndef SYSLOG_TCP
+#define SYSLOG_TCP 1
+#endif
+
+/* Server TCP port, 0: the UDP port of init_logger() */
+#ifndef SYSLOG_TCP_PORT
+#define SYSLOG_TCP_PORT 0
+#endif
+
+/* Reconnect delay after a failed or lost connection, doubled per failure
+ * up to the maximum */
+#ifndef SYSLOG_TCP_BACKOFF_MIN_MS
+#define SYSLOG_TCP_BACKOFF_MIN_MS 500U
+#endif
+
+#ifndef SYSLOG_TCP_BACKOFF_MAX_MS
+#define SYSLOG_TCP_BACKOFF_MAX_MS 60000U
+#endif
+
+/* Framed records are gathered here and handed to tcp_write() in one copy;
+ * one MSS fills a segment. */
+#ifndef SYSLOG_TCP_STAGE_SIZE
+#define SYSLOG_TCP_STAGE_SIZE 1460
+#endif
+
+#endif /* LOGGER_SYSLOG_OPTS_H */
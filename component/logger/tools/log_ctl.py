@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+"""Logger configuration client for the board's log_ctl port.
+
+Sends the commands given on the command line (or on stdin) as one datagram
+to SYSLOG_CTL_PORT (component/logger/log_ctl.h) and prints the reply: one
+"ok" or "error: ..." line per command, then the configuration in command
+syntax, which can be sent back as is.
+
+    log_ctl.py 192.168.7.2 show
+    log_ctl.py 192.168.7.2 "tag ETH debug" "limit 100 200"
+    log_ctl.py 192.168.7.2 - < saved.cfg      (commands from stdin)
+
+Commands: show | level <level> | tag <tag> <level|default> |
+limit <rate> <burst> | sink <syslog|flash|bkp|console> <on|off|level> |
+sink <syslog|flash> lz4 <on|off>
+"""
+
+import argparse
+import socket
+import sys
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("host")
+    ap.add_argument("commands", nargs="+", help='commands, "-" reads them from stdin')
+    ap.add_argument("--port", type=int, default=5514)
+    ap.add_argument("--timeout", type=float, default=1.0)
+    args = ap.parse_args()
+
+    lines = []
+    for c in args.commands:
+        lines.extend(sys.stdin.read().splitlines() if c == "-" else [c])
+    # A saved reply: its result lines are not commands
+    lines = [line for line in lines if line.strip() and line.strip() != "ok" and not line.startswith("error:")]
+    msg = "\n".join(lines).encode()
+    if len(msg) > 256:
+        sys.exit("commands too long for one datagram (256 bytes)")
+
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.settimeout(args.timeout)
+    s.sendto(msg, (args.host, args.port))
+    try:
+        reply, _ = s.recvfrom(2048)
+    except socket.timeout:
+        sys.exit("no reply from %s:%d" % (args.host, args.port))
+    text = reply.decode(errors="replace")
+    sys.stdout.write(text)
+    sys.exit(1 if "error:" in text else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""Host-side decoder for deferred (SYSLOG_BIN_REMOTE) log records.
+
+The firmware sends UDP datagrams to SYSLOG_BIN_PORT laid out as
+
+    LogBinHeader_t  'L' 'B' version:u8 count:u8
+    count x LogBinRecord_t (little endian, only nargs arguments sent)
+        tick:u32 fmt:u32 level:u8 nargs:u8 tag:u16 args:u32[nargs]
+
+and, ahead of records with tags it has not announced yet and every
+SYSLOG_BIN_TAGS_MS, the interned tag table:
+
+    LogBinHeader_t  'L' 'T' version:u8 count:u8
+    count x id:u16 len:u8 name:len bytes
+
+args are 32-bit words: one per int, char or pointer argument, two (low
+word first) per long long or double. The firmware checks each format
+against its arguments at compile time, so the conversions say how many
+words each argument took (ARM: long and size_t are 32 bits).
+
+fmt is an address in the image; it (and %s arguments) is resolved against
+the loadable sections of the ELF that is running on the target. tag is an
+interned id (0: none); ids not announced yet print as tag#<id>. Ids are
+stable across boots for the same names.
+
+    log_decode.py Debug/STM32_eth.elf [--port 5140] [--bind 0.0.0.0]
+
+Requires pyelftools.
+"""
+
+import argparse
+import re
+import socket
+import struct
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+LOG_BIN_VERSION = 3
+HEADER = struct.Struct("<2sBB")
+RECORD = struct.Struct("<IIBBH")
+TAG = struct.Struct("<HB")
+LEVELS = {0: "NONE", 1: "ERROR", 2: "WARN", 3: "INFO", 4: "DEBUG", 5: "VERBOSE"}
+
+# printf conversion: flags, width, precision, length, specifier
+CONV = re.compile(r"%([-+ #0]*)(\d+|\*)?(?:\.(\d+|\*))?(hh|h|ll|l|z|t|j)?([diouxXcspfFeEgGaA%])")
+
+
+class Image:
+    """Read-only view of the ELF's allocated sections by address."""
+
+    def __init__(self, path):
+        self.chunks = []
+        with open(path, "rb") as f:
+            elf = ELFFile(f)
+            for sec in elf.iter_sections():
+                if sec["sh_flags"] & 0x2 and sec["sh_type"] == "SHT_PROGBITS":
+                    self.chunks.append((sec["sh_addr"], sec.data()))
+
+    def string(self, addr):
+        for base, data in self.chunks:
+            if base <= addr < base + len(data):
+                off = addr - base
+                end = data.find(b"\0", off)
+                return data[off:end if end >= 0 else len(data)].decode("utf-8", "replace")
+        return "<0x%08x>" % addr
+
+
+def expand(image, fmt, args):
+    """Applies a C format string to the raw argument words."""
+    args = list(args)
+
+    def take(words=1):
+        v = 0
+        for i in range(words):
+            v |= (args.pop(0) if args else 0) << (32 * i)
+        return v
+
+    def sub(m):
+        flags, width, prec, length, spec = m.groups()
+        if spec == "%":
+            return "%"
+        if width == "*":
+            width = str(take())
+        if prec == "*":
+            prec = str(take())
+        pyfmt = "%" + flags + (width or "") + ("." + prec if prec else "")
+        if spec in "fFeEgGaA":
+            d = struct.unpack("<d", struct.pack("<Q", take(2)))[0]
+            return (pyfmt + ("f" if spec in "aA" else spec)) % d
+        bits = 64 if length in ("ll", "j") else 32
+        v = take(bits // 32)
+        if spec in "di":
+            return (pyfmt + "d") % (v - (1 << bits) if v >> (bits - 1) else v)
+        if spec == "u":
+            return (pyfmt + "d") % v
+        if spec in "oxX":
+            return (pyfmt + spec) % v
+        if spec == "c":
+            return (pyfmt + "c") % chr(v & 0xFF)
+        if spec == "s":
+            return (pyfmt + "s") % image.string(v)
+        return (pyfmt + "s") % ("0x%08x" % v)
+
+    return CONV.sub(sub, fmt)
+
+
+def tag_table(tags, datagram, count):
+    """Adds the entries of an "LT" datagram to tags (id -> name)."""
+    off = HEADER.size
+    for _ in range(count):
+        if off + TAG.size > len(datagram):
+            break
+        tag_id, length = TAG.unpack_from(datagram, off)
+        off += TAG.size
+        tags[tag_id] = datagram[off:off + length].decode("utf-8", "replace")
+        off += length
+
+
+def decode(image, tags, datagram):
+    if len(datagram) < HEADER.size:
+        return
+    magic, version, count = HEADER.unpack_from(datagram)
+    if magic not in (b"LB", b"LT") or version != LOG_BIN_VERSION:
+        print("unknown datagram (%d bytes)" % len(datagram), file=sys.stderr)
+        return
+    if magic == b"LT":
+        tag_table(tags, datagram, count)
+        return
+    off = HEADER.size
+    for _ in range(count):
+        if off + RECORD.size > len(datagram):
+            break
+        tick, fmt, level, nargs, tag = RECORD.unpack_from(datagram, off)
+        off += RECORD.size
+        args = struct.unpack_from("<%dI" % nargs, datagram, off)
+        off += 4 * nargs
+        msg = expand(image, image.string(fmt), args)
+        yield "%10.3f %-7s [%s] %s" % (tick / 1000.0, LEVELS.get(level, level),
+                                              tags.get(tag, "-" if tag == 0 else "tag#%04x" % tag), msg)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("elf")
+    ap.add_argument("--port", type=int, default=5140)
+    ap.add_argument("--bind", default="0.0.0.0")
+    opts = ap.parse_args()
+
+    image = Image(opts.elf)
+    tags = {}
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((opts.bind, opts.port))
+    while True:
+        datagram, peer = sock.recvfrom(2048)
+        for line in decode(image, tags, datagram):
+            print("%s %s" % (peer[0], line), flush=True)
+
+
+if __name__ == "__main__":
+    main()
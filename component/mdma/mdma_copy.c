@@ -0,0 +1,295 @@
+/**
+ * @file mdma_copy.c
+ * @brief Queued memory-to-memory copies on one MDMA channel.
+ */
+
+#include "mdma_copy.h"
+
+#include "stm32h7xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "memops/memops.h"
+
+#include <string.h>
+
+#define MDMA_COPY_LINE      32U     /* Cortex-M7 D-cache line */
+#define MDMA_COPY_CHUNK     65536U  /* CBNDTR.BNDT limit per transfer */
+#define MDMA_COPY_SRC_MASK  (MDMA_CTCR_SINC | MDMA_CTCR_SINCOS | MDMA_CTCR_SSIZE)
+
+#if MDMA_COPY_THRESHOLD < 2 * MDMA_COPY_LINE
+#error "MDMA_COPY_THRESHOLD must cover at least one whole destination cache line"
+#endif
+
+typedef struct {
+    uint8_t* dst;           /* cache-line aligned */
+    const uint8_t* src;
+    uint32_t len;           /* multiple of MDMA_COPY_LINE */
+    uint32_t pos;           /* bytes transferred so far */
+    MdmaCopyDone_t done;
+    void* arg;
+} MdmaCopyReq_t;
+
+typedef struct {
+    MDMA_HandleTypeDef hmdma;
+    MdmaCopyReq_t queue[MDMA_COPY_QUEUE_LEN];
+    uint32_t head;          /* free-running, empty when equal */
+    uint32_t tail;          /* queue[tail] is on the channel while busy */
+    bool busy;
+    bool ready;
+    SemaphoreHandle_t sync_mutex;   /* one blocking copy on the MDMA at a time */
+    SemaphoreHandle_t sync_done;
+    volatile bool sync_ok;
+    MDMA_HandleTypeDef* shared[MDMA_COPY_SHARED];
+    uint32_t shared_count;
+    MdmaCopyStats_t stats;
+} MdmaCopy_t;
+
+static MdmaCopy_t mdma;
+
+/* Source access width from the source alignment. The destination side is
+ * always aligned doublewords, the MDMA packs narrower source beats. */
+static uint32_t mdma_copy_src_cfg(uintptr_t src)
+{
+    if ((src & 7U) == 0U) {
+        return MDMA_SRC_INC_DOUBLEWORD | MDMA_SRC_DATASIZE_DOUBLEWORD;
+    }
+    if ((src & 3U) == 0U) {
+        return MDMA_SRC_INC_WORD | MDMA_SRC_DATASIZE_WORD;
+    }
+    if ((src & 1U) == 0U) {
+        return MDMA_SRC_INC_HALFWORD | MDMA_SRC_DATASIZE_HALFWORD;
+    }
+    return MDMA_SRC_INC_BYTE | MDMA_SRC_DATASIZE_BYTE;
+}
+
+static uint32_t mdma_copy_chunk(const MdmaCopyReq_t* r)
+{
+    uint32_t n = r->len - r->pos;
+    return (n > MDMA_COPY_CHUNK) ? MDMA_COPY_CHUNK : n;
+}
+
+static void mdma_copy_finish(bool ok);
+
+/* Starts the next chunk of queue[tail]. Called with interrupts masked. */
+static void mdma_copy_start(void)
+{
+    MdmaCopyReq_t* r = &mdma.queue[mdma.tail % MDMA_COPY_QUEUE_LEN];
+
+    if (r->pos == 0U) {
+        MODIFY_REG(mdma.hmdma.Instance->CTCR, MDMA_COPY_SRC_MASK, mdma_copy_src_cfg((uintptr_t)r->src));
+    }
+    if (HAL_MDMA_Start_IT(&mdma.hmdma, (uint32_t)(r->src + r->pos), (uint32_t)(r->dst + r->pos),
+                          mdma_copy_chunk(r), 1U) != HAL_OK) {
+        mdma.stats.errors++;
+        mdma_copy_finish(false);
+    }
+}
+
+/* Retires queue[tail] and starts the next request. The callback runs last
+ * and may queue a new copy. Called with interrupts masked. */
+static void mdma_copy_finish(bool ok)
+{
+    MdmaCopyReq_t* r = &mdma.queue[mdma.tail % MDMA_COPY_QUEUE_LEN];
+    MdmaCopyDone_t done = r->done;
+    void* arg = r->arg;
+
+    if (ok) {
+        /* Lines the core fetched speculatively during the transfer */
+        SCB_InvalidateDCache_by_Addr((uint32_t*)r->dst, (int32_t)r->len);
+        mdma.stats.copies++;
+        mdma.stats.bytes += r->len;
+    }
+    mdma.tail++;
+    if (mdma.tail != mdma.head) {
+        mdma_copy_start();
+    } else {
+        mdma.busy = false;
+    }
+    if (done != NULL) {
+        done(arg, ok);
+    }
+}
+
+static void mdma_copy_cplt_cb(MDMA_HandleTypeDef* hmdma)
+{
+    (void)hmdma;
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    MdmaCopyReq_t* r = &mdma.queue[mdma.tail % MDMA_COPY_QUEUE_LEN];
+
+    r->pos += mdma_copy_chunk(r);
+    if (r->pos < r->len) {
+        mdma_copy_start();
+    } else {
+        mdma_copy_finish(true);
+    }
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+static void mdma_copy_error_cb(MDMA_HandleTypeDef* hmdma)
+{
+    (void)hmdma;
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    mdma.stats.errors++;
+    mdma_copy_finish(false);
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+void MDMA_IRQHandler(void)
+{
+    HAL_MDMA_IRQHandler(&mdma.hmdma);
+    for (uint32_t i = 0U; i < mdma.shared_count; i++) {
+        HAL_MDMA_IRQHandler(mdma.shared[i]);
+    }
+}
+
+bool mdma_copy_init(void)
+{
+    if (mdma.ready) {
+        return true;
+    }
+
+    __HAL_RCC_MDMA_CLK_ENABLE();
+
+    mdma.hmdma.Instance = MDMA_COPY_CHANNEL;
+    mdma.hmdma.Init.Request = MDMA_REQUEST_SW;
+    mdma.hmdma.Init.TransferTriggerMode = MDMA_FULL_TRANSFER;
+    mdma.hmdma.Init.Priority = MDMA_COPY_PRIORITY;
+    mdma.hmdma.Init.Endianness = MDMA_LITTLE_ENDIANNESS_PRESERVE;
+    mdma.hmdma.Init.SourceInc = MDMA_SRC_INC_DOUBLEWORD;
+    mdma.hmdma.Init.DestinationInc = MDMA_DEST_INC_DOUBLEWORD;
+    mdma.hmdma.Init.SourceDataSize = MDMA_SRC_DATASIZE_DOUBLEWORD;
+    mdma.hmdma.Init.DestDataSize = MDMA_DEST_DATASIZE_DOUBLEWORD;
+    mdma.hmdma.Init.DataAlignment = MDMA_DATAALIGN_PACKENABLE;
+    mdma.hmdma.Init.BufferTransferLength = 128;
+    /* Destination bursts are one cache line and never cross a 1 KB AXI
+     * boundary; the source may be unaligned, so it is read in single beats. */
+    mdma.hmdma.Init.SourceBurst = MDMA_SOURCE_BURST_SINGLE;
+    mdma.hmdma.Init.DestBurst = MDMA_DEST_BURST_4BEATS;
+    mdma.hmdma.Init.SourceBlockAddressOffset = 0;
+    mdma.hmdma.Init.DestBlockAddressOffset = 0;
+    if (HAL_MDMA_Init(&mdma.hmdma) != HAL_OK) {
+        return false;
+    }
+    HAL_MDMA_RegisterCallback(&mdma.hmdma, HAL_MDMA_XFER_CPLT_CB_ID, mdma_copy_cplt_cb);
+    HAL_MDMA_RegisterCallback(&mdma.hmdma, HAL_MDMA_XFER_ERROR_CB_ID, mdma_copy_error_cb);
+
+    mdma.sync_mutex = xSemaphoreCreateMutex();
+    mdma.sync_done = xSemaphoreCreateBinary();
+    if (mdma.sync_mutex == NULL || mdma.sync_done == NULL) {
+        return false;
+    }
+
+    HAL_NVIC_SetPriority(MDMA_IRQn, MDMA_COPY_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(MDMA_IRQn);
+    mdma.ready = true;
+    return true;
+}
+
+bool mdma_copy_async(void* dst, const void* src, size_t len, MdmaCopyDone_t done, void* arg)
+{
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+
+    if (!mdma.ready) {
+        return false;
+    }
+    if (len < MDMA_COPY_THRESHOLD) {
+        memops_copy(d, s, len);
+        if (done != NULL) {
+            done(arg, true);
+        }
+        return true;
+    }
+
+    uintptr_t lo = ((uintptr_t)d + MDMA_COPY_LINE - 1U) & ~(uintptr_t)(MDMA_COPY_LINE - 1U);
+    uintptr_t hi = ((uintptr_t)d + len) & ~(uintptr_t)(MDMA_COPY_LINE - 1U);
+    size_t head = lo - (uintptr_t)d;
+    size_t mid = hi - lo;
+
+    /* Partial lines on the CPU, then nothing of the middle may be dirty in
+     * the cache: source cleaned to memory, destination lines dropped so no
+     * eviction lands on top of the transfer. */
+    memops_copy(d, s, head);
+    memops_copy((uint8_t*)hi, s + head + mid, len - head - mid);
+    SCB_CleanDCache_by_Addr((uint32_t*)((uintptr_t)(s + head) & ~(uintptr_t)(MDMA_COPY_LINE - 1U)),
+                            (int32_t)(mid + MDMA_COPY_LINE));
+    SCB_InvalidateDCache_by_Addr((uint32_t*)lo, (int32_t)mid);
+
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    if (mdma.head - mdma.tail >= MDMA_COPY_QUEUE_LEN) {
+        mdma.stats.queue_full++;
+        taskEXIT_CRITICAL_FROM_ISR(mask);
+        return false;
+    }
+    MdmaCopyReq_t* r = &mdma.queue[mdma.head % MDMA_COPY_QUEUE_LEN];
+    r->dst = (uint8_t*)lo;
+    r->src = s + head;
+    r->len = (uint32_t)mid;
+    r->pos = 0U;
+    r->done = done;
+    r->arg = arg;
+    mdma.head++;
+    if (!mdma.busy) {
+        mdma.busy = true;
+        mdma_copy_start();
+    }
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+    return true;
+}
+
+static void mdma_copy_sync_done(void* arg, bool ok)
+{
+    BaseType_t woken = pdFALSE;
+
+    (void)arg;
+    mdma.sync_ok = ok;
+    xSemaphoreGiveFromISR(mdma.sync_done, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void* mdma_copy(void* dst, const void* src, size_t len)
+{
+    if (len < MDMA_COPY_THRESHOLD) {
+        return memops_copy(dst, src, len);
+    }
+    /* Sleeping needs a task context with interrupts enabled */
+    if (!mdma.ready || __get_IPSR() != 0U || __get_PRIMASK() != 0U || __get_BASEPRI() != 0U ||
+        xTaskGetSchedulerState() != taskSCHEDULER_RUNNING ||
+        xSemaphoreTake(mdma.sync_mutex, 0) != pdTRUE) {
+        mdma.stats.cpu_copies++;
+        return memops_copy(dst, src, len);
+    }
+
+    mdma.sync_ok = false;
+    if (mdma_copy_async(dst, src, len, mdma_copy_sync_done, NULL)) {
+        xSemaphoreTake(mdma.sync_done, portMAX_DELAY);
+    }
+    if (!mdma.sync_ok) {
+        mdma.stats.cpu_copies++;
+        memops_copy(dst, src, len);
+    }
+    xSemaphoreGive(mdma.sync_mutex);
+    return dst;
+}
+
+void mdma_copy_get_stats(MdmaCopyStats_t* stats)
+{
+    if (stats != NULL) {
+        UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+        *stats = mdma.stats;
+        taskEXIT_CRITICAL_FROM_ISR(mask);
+    }
+}
+
+bool mdma_copy_share_irq(MDMA_HandleTypeDef* hmdma)
+{
+    if (!mdma.ready || mdma.shared_count >= MDMA_COPY_SHARED) {
+        return false;
+    }
+    mdma.shared[mdma.shared_count] = hmdma;
+    /* The handler may run for this service's channel meanwhile */
+    __DMB();
+    mdma.shared_count++;
+    return true;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file mdma_copy.h
+ * @brief Memory-to-memory copies on the MDMA controller.
+ *
+ * Copies of MDMA_COPY_THRESHOLD bytes or more are split: the CPU copies
+ * the bytes before the first and after the last 32-byte cache line of the
+ * destination, the MDMA moves the cache-line aligned middle. Data cache
+ * maintenance is done here (clean of the source, invalidate of the
+ * destination before and after the transfer), so buffers may live in any
+ * RAM the MDMA reaches, cacheable or not. Since only whole destination
+ * lines are invalidated, data next to the destination is never lost.
+ *
+ * mdma_copy_async() queues a copy and returns at once; its completion
+ * callback runs in the MDMA interrupt. mdma_copy() is a drop-in memcpy():
+ * the calling task sleeps while the MDMA works, and it falls back to the
+ * CPU when sleeping is not possible (interrupt, critical section, before
+ * the scheduler runs) or another blocking copy is in progress.
+ *
+ * The source and destination must stay untouched until completion.
+ */
+
+#pragma once
+
+#ifndef MDMA_COPY_H
+#define MDMA_COPY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "mdma_copy_opts.h"
+
+/* ok is false if the MDMA reported a transfer error; the destination is
+ * then undefined. Runs in interrupt context. */
+typedef void (*MdmaCopyDone_t)(void* arg, bool ok);
+
+typedef struct {
+    uint32_t copies;        /* transfers completed by the MDMA */
+    uint32_t bytes;         /* bytes moved by the MDMA */
+    uint32_t cpu_copies;    /* mdma_copy() calls done by the CPU */
+    uint32_t queue_full;    /* mdma_copy_async() refused */
+    uint32_t errors;        /* MDMA transfer errors */
+} MdmaCopyStats_t;
+
+/* Sets up the channel and its interrupt. Call once, before the first copy
+ * (the scheduler need not be running yet). */
+bool mdma_copy_init(void);
+
+/* Queues a copy. Returns false (done not called) if the service is not
+ * initialised or the queue is full; the partial lines at either end of dst
+ * may already be written then. Short copies complete
+ * on the CPU before this returns, with done called from here. Usable from
+ * tasks and interrupts. */
+bool mdma_copy_async(void* dst, const void* src, size_t len, MdmaCopyDone_t done, void* arg);
+
+/* memcpy() replacement, returns dst. */
+void* mdma_copy(void* dst, const void* src, size_t len);
+
+void mdma_copy_get_stats(MdmaCopyStats_t* stats);
+
+/* The MDMA has one interrupt for all channels: MDMA_IRQHandler() here also
+ * runs HAL_MDMA_IRQHandler() for up to MDMA_COPY_SHARED handles of other
+ * drivers' channels. Call after mdma_copy_init(), before the channel is
+ * started. */
+struct __MDMA_HandleTypeDef;
+bool mdma_copy_share_irq(struct __MDMA_HandleTypeDef* hmdma);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MDMA_COPY_H */
@@ -0,0 +1,51 @@
+/**
+ * @file mdma_copy_opts.h
+ * @brief Build-time options for the MDMA copy service.
+ *
+ * Every option can be overridden from the compiler command line or by
+ * defining it before this header is included.
+ */
+
+#pragma once
+
+#ifndef MDMA_COPY_OPTS_H
+#define MDMA_COPY_OPTS_H
+
+/* Copies shorter than this are done by the CPU: below about 1 KB the cache
+ * maintenance and completion interrupt cost more than memcpy() itself. */
+#ifndef MDMA_COPY_THRESHOLD
+#define MDMA_COPY_THRESHOLD 1024
+#endif
+
+/* Pending asynchronous requests, including the one in progress. */
+#ifndef MDMA_COPY_QUEUE_LEN
+#define MDMA_COPY_QUEUE_LEN 8
+#endif
+
+/* MDMA channel reserved for the service, its software priority and the
+ * NVIC priority of the MDMA interrupt (numerically not below
+ * configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, completions use FreeRTOS). */
+#ifndef MDMA_COPY_CHANNEL
+#define MDMA_COPY_CHANNEL MDMA_Channel0
+#endif
+
+#ifndef MDMA_COPY_PRIORITY
+#define MDMA_COPY_PRIORITY MDMA_PRIORITY_LOW
+#endif
+
+#ifndef MDMA_COPY_IRQ_PRIORITY
+#define MDMA_COPY_IRQ_PRIORITY 6
+#endif
+
+/* Handles of other MDMA users serviced by the shared interrupt. */
+#ifndef MDMA_COPY_SHARED
+#define MDMA_COPY_SHARED 2
+#endif
+
+/* Route lwIP's MEMCPY() (pbuf_take(), pbuf_copy_partial(), netconn and
+ * socket receive copies) through mdma_copy(), see lwipopts.h. */
+#ifndef MDMA_COPY_LWIP
+#define MDMA_COPY_LWIP 1
+#endif
+
+#endif /* MDMA_COPY_OPTS_H */
@@ -0,0 +1,208 @@
+/**
+ * @file memmon.c
+ * @brief Memory monitor task and its metrics collector.
+ */
+
+#include "memmon.h"
+
+#if MEMMON
+
+#include "main.h"
+#include "task.h"
+#include "lwip/opt.h"
+#include "lwip/stats.h"
+#include "lwip/memp.h"
+#include "metrics/metrics.h"
+#if LWIP_MEM_TLSF
+#include "tlsf/tlsf.h"
+#endif
+
+#include <stdio.h>
+
+#define MEMMON_TAG "MEM"
+
+typedef struct {
+    TaskStatus_t status[MEMMON_MAX_TASKS];
+    MemMonSnapshot_t work;
+    /* Task numbers already reported low on stack */
+    UBaseType_t warned[MEMMON_MAX_TASKS];
+    uint32_t warned_count;
+    bool heap_warned;
+    bool lwip_warned;
+} MemMon_t;
+
+static MemMon_t memmon;
+/* Written by the monitor task, read by memmon_get(), in a critical section */
+static MemMonSnapshot_t memmon_last;
+
+static StaticTask_t memmon_tcb;
+static StackType_t memmon_stack[MEMMON_STACK_WORDS];
+
+static void memmon_copy_name(char* dst, const char* src)
+{
+    size_t i;
+
+    for (i = 0; i < configMAX_TASK_NAME_LEN - 1U && src[i] != '\0'; i++) {
+        char c = src[i];
+        bool alnum = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+        dst[i] = alnum ? c : '_';
+    }
+    dst[i] = '\0';
+}
+
+/* True the first time for a task: the high water mark only goes down */
+static bool memmon_warn_once(UBaseType_t number)
+{
+    for (uint32_t i = 0; i < memmon.warned_count; i++) {
+        if (memmon.warned[i] == number) {
+            return false;
+        }
+    }
+    if (memmon.warned_count < MEMMON_MAX_TASKS) {
+        memmon.warned[memmon.warned_count++] = number;
+    }
+    return true;
+}
+
+static void memmon_sample(void)
+{
+    MemMonSnapshot_t* s = &memmon.work;
+    HeapStats_t heap;
+    /* Computes the high water mark of every task, scheduler suspended */
+    UBaseType_t count = uxTaskGetSystemState(memmon.status, MEMMON_MAX_TASKS, NULL);
+
+    s->task_count = (uint32_t)count;
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t* t = &memmon.status[i];
+
+        memmon_copy_name(s->task[i].name, t->pcTaskName);
+        s->task[i].stack_free = (uint32_t)t->usStackHighWaterMark;
+        if (t->usStackHighWaterMark < MEMMON_STACK_WARN_WORDS && memmon_warn_once(t->xTaskNumber)) {
+            LOG_ERROR(MEMMON_TAG, "task %s: stack down to %lu free words", t->pcTaskName,
+                      (uint32_t)t->usStackHighWaterMark);
+        }
+    }
+
+    vPortGetHeapStats(&heap);
+    s->heap_free = (uint32_t)heap.xAvailableHeapSpaceInBytes;
+    s->heap_min_free = (uint32_t)heap.xMinimumEverFreeBytesRemaining;
+    s->heap_largest = (uint32_t)heap.xSizeOfLargestFreeBlockInBytes;
+    s->heap_blocks = (uint32_t)heap.xNumberOfFreeBlocks;
+    s->heap_dtcm_free = (uint32_t)xPortGetFreeHeapSizeRegion(heapREGION_DTCM);
+    s->heap_axi_free = (uint32_t)xPortGetFreeHeapSizeRegion(heapREGION_AXI);
+    s->heap_frag_pct = (s->heap_free == 0U) ? 0U : 100U - (uint32_t)((uint64_t)s->heap_largest * 100U / s->heap_free);
+    if (s->heap_largest < MEMMON_HEAP_WARN_BYTES) {
+        if (!memmon.heap_warned) {
+            LOG_ERROR(MEMMON_TAG, "heap: largest free block %lu of %lu free in %lu blocks",
+                      s->heap_largest, s->heap_free, s->heap_blocks);
+        }
+        memmon.heap_warned = true;
+    } else {
+        memmon.heap_warned = false;
+    }
+
+#if MEM_USE_POOLS
+    /* Size classes: bytes summed over the malloc pools, and each class
+     * warned about on its own since a full class is what fails */
+    s->lwip_size = 0U;
+    s->lwip_used = 0U;
+    s->lwip_max = 0U;
+    for (memp_t i = MEMP_POOL_FIRST; i <= MEMP_POOL_LAST; i++) {
+        const struct memp_desc* d = memp_pools[i];
+        s->lwip_size += (uint32_t)d->num * d->size;
+#if MEMP_STATS
+        s->lwip_used += (uint32_t)d->stats->used * d->size;
+        s->lwip_max += (uint32_t)d->stats->max * d->size;
+        if (!memmon.lwip_warned && d->stats->max > ((uint32_t)d->num * MEMMON_LWIP_WARN_PCT) / 100U) {
+            LOG_ERROR(MEMMON_TAG, "lwIP %lu-byte pool: peak %lu of %lu", (uint32_t)d->size,
+                      (uint32_t)d->stats->max, (uint32_t)d->num);
+            memmon.lwip_warned = true;
+        }
+#endif
+    }
+#else
+    s->lwip_size = MEM_SIZE;
+#endif
+#if LWIP_MEM_TLSF
+    {
+        TlsfStats_t t;
+
+        tlsf_lwip_stats(&t);
+        s->lwip_largest = (uint32_t)t.largest;
+        s->lwip_blocks = t.free_blocks;
+        s->lwip_frag_pct = t.frag_pct;
+    }
+#endif
+#if MEM_STATS
+    /* Single words, written under the lwIP heap's own protection */
+    s->lwip_used = (uint32_t)lwip_stats.mem.used;
+    s->lwip_max = (uint32_t)lwip_stats.mem.max;
+    if (!memmon.lwip_warned && s->lwip_max > (MEM_SIZE / 100U) * MEMMON_LWIP_WARN_PCT) {
+        LOG_ERROR(MEMMON_TAG, "lwIP heap: peak %lu of %lu bytes", s->lwip_max, s->lwip_size);
+        memmon.lwip_warned = true;
+    }
+#endif
+    s->samples++;
+
+    taskENTER_CRITICAL();
+    memmon_last = *s;
+    taskEXIT_CRITICAL();
+}
+
+void memmon_get(MemMonSnapshot_t* snap)
+{
+    taskENTER_CRITICAL();
+    *snap = memmon_last;
+    taskEXIT_CRITICAL();
+}
+
+#if METRICS
+/* Runs on the tcpip thread; only copies the last sample */
+static void memmon_metrics(MetricsWriter_t* w)
+{
+    static MemMonSnapshot_t snap;
+    char name[METRICS_NAME_MAX];
+
+    memmon_get(&snap);
+    if (snap.samples == 0U) {
+        return;
+    }
+    metrics_emit(w, "rtos.heap.largest_block", METRIC_GAUGE, snap.heap_largest);
+    metrics_emit(w, "rtos.heap.free_blocks", METRIC_GAUGE, snap.heap_blocks);
+    metrics_emit(w, "rtos.heap.dtcm_free", METRIC_GAUGE, snap.heap_dtcm_free);
+    metrics_emit(w, "rtos.heap.axi_free", METRIC_GAUGE, snap.heap_axi_free);
+    metrics_emit(w, "rtos.heap.frag_pct", METRIC_GAUGE, snap.heap_frag_pct);
+#if LWIP_MEM_TLSF
+    metrics_emit(w, "lwip.heap.largest_block", METRIC_GAUGE, snap.lwip_largest);
+    metrics_emit(w, "lwip.heap.free_blocks", METRIC_GAUGE, snap.lwip_blocks);
+    metrics_emit(w, "lwip.heap.frag_pct", METRIC_GAUGE, snap.lwip_frag_pct);
+#endif
+    for (uint32_t i = 0; i < snap.task_count; i++) {
+        snprintf(name, sizeof(name), "rtos.stack.%s.free", snap.task[i].name);
+        metrics_emit(w, name, METRIC_GAUGE, snap.task[i].stack_free);
+    }
+}
+#endif
+
+static void memmon_task(void* arg)
+{
+    TickType_t wake = xTaskGetTickCount();
+
+    (void)arg;
+    for (;;) {
+        memmon_sample();
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(MEMMON_PERIOD_MS));
+    }
+}
+
+bool memmon_start(void)
+{
+#if METRICS
+    /* Last in the collector list: the task list changes the series count */
+    (void)metrics_register_collector(memmon_metrics);
+#endif
+    return xTaskCreateStatic(memmon_task, "MemMon", MEMMON_STACK_WORDS, NULL, MEMMON_PRIORITY,
+                             memmon_stack, &memmon_tcb) != NULL;
+}
+
+#endif /* MEMMON */
@@ -0,0 +1,108 @@
+/**
+ * @file memmon.h
+ * @brief Stack high water marks and heap fragmentation, sampled by a task.
+ *
+ * A low priority task samples every MEMMON_PERIOD_MS: the stack high water
+ * mark of every task, FreeRTOS heap free / minimum ever free / largest free
+ * block / free block count (plus the free bytes of the DTCM and AXI
+ * regions) and the lwIP heap (its malloc pools with MEM_USE_POOLS, its
+ * free blocks with LWIP_MEM_TLSF). Walking stacks and the free list is left to this
+ * task so that neither the tcpip thread nor a metrics scrape pays for it.
+ *
+ * The last sample is exported through the metrics collector as
+ * "rtos.stack.<task>.free" (words) and "rtos.heap.*" gauges; the lwIP heap
+ * is already exported as "lwip.mem.*" (per pool as "lwip.memp.POOL_*" with
+ * MEM_USE_POOLS), its fragmentation as "lwip.heap.*" with LWIP_MEM_TLSF. Crossing MEMMON_STACK_WARN_WORDS, MEMMON_HEAP_WARN_BYTES
+ * or MEMMON_LWIP_WARN_PCT is logged once, tag "MEM".
+ */
+
+#pragma once
+
+#ifndef MEMMON_H
+#define MEMMON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+
+/* 0 leaves the monitor task out of the startup code */
+#ifndef MEMMON
+#define MEMMON 1
+#endif
+
+#ifndef MEMMON_PERIOD_MS
+#define MEMMON_PERIOD_MS 5000U
+#endif
+
+/* Tasks covered by one sample; further tasks are left out. */
+#ifndef MEMMON_MAX_TASKS
+#define MEMMON_MAX_TASKS 16U
+#endif
+
+/* Only above the idle task */
+#ifndef MEMMON_PRIORITY
+#define MEMMON_PRIORITY (tskIDLE_PRIORITY + 1)
+#endif
+
+/* uxTaskGetSystemState() and the log calls, MEMMON_MAX_TASKS entries are static */
+#ifndef MEMMON_STACK_WORDS
+#define MEMMON_STACK_WORDS 384U
+#endif
+
+/* A task whose stack never had more than this many words free is logged */
+#ifndef MEMMON_STACK_WARN_WORDS
+#define MEMMON_STACK_WARN_WORDS 64U
+#endif
+
+/* Largest FreeRTOS heap free block below this is logged */
+#ifndef MEMMON_HEAP_WARN_BYTES
+#define MEMMON_HEAP_WARN_BYTES 4096U
+#endif
+
+/* lwIP heap peak above this share of MEM_SIZE (of a malloc pool's count
+ * with MEM_USE_POOLS) is logged */
+#ifndef MEMMON_LWIP_WARN_PCT
+#define MEMMON_LWIP_WARN_PCT 90U
+#endif
+
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];    /* not alphanumeric replaced by '_' */
+    uint32_t stack_free;                    /* high water mark, words */
+} MemMonTask_t;
+
+typedef struct {
+    uint32_t samples;           /* 0: no sample yet */
+    uint32_t heap_free;
+    uint32_t heap_min_free;
+    uint32_t heap_largest;      /* largest free block; what the next allocation can get */
+    uint32_t heap_blocks;       /* free blocks; grows with fragmentation */
+    uint32_t heap_dtcm_free;
+    uint32_t heap_axi_free;
+    uint32_t heap_frag_pct;     /* 100 - largest / free in percent */
+    uint32_t lwip_size;         /* MEM_SIZE, or the malloc pools' bytes */
+    uint32_t lwip_used;
+    uint32_t lwip_max;
+    uint32_t lwip_largest;      /* LWIP_MEM_TLSF only */
+    uint32_t lwip_blocks;
+    uint32_t lwip_frag_pct;
+    uint32_t task_count;
+    MemMonTask_t task[MEMMON_MAX_TASKS];
+} MemMonSnapshot_t;
+
+/* Creates the monitor task and registers its metrics collector. Call once
+ * from a task, after metrics_init(). */
+bool memmon_start(void);
+
+/* Copy of the last sample, from any task or the tcpip thread */
+void memmon_get(MemMonSnapshot_t* snap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEMMON_H */
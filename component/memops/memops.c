@@ -0,0 +1,180 @@
+/**
+ * @file memops.c
+ * @brief Word and burst copy / fill loops.
+ */
+
+#include "memops.h"
+
+#include "main.h"
+
+/* Bytes per burst, one cache line */
+#define MEMOPS_BLOCK    32U
+
+#if defined(__thumb2__) && defined(__ARM_ARCH_7EM__)
+#define MEMOPS_ASM      1
+#else
+#define MEMOPS_ASM      0
+#endif
+
+typedef uint32_t memops_u32_t __attribute__((may_alias));
+/* Any alignment: LDR/STR on the M7, byte loads elsewhere */
+typedef uint32_t memops_u32u_t __attribute__((may_alias, aligned(1)));
+
+static inline uint32_t memops_load(const uint8_t* p)
+{
+    return *(const memops_u32u_t*)p;
+}
+
+static inline void memops_store(uint8_t* p, uint32_t v)
+{
+    *(memops_u32u_t*)p = v;
+}
+
+#if MEMOPS_ASM
+/* blocks 32-byte bursts, both pointers word aligned */
+static inline void memops_copy_blocks(uint8_t** dst, const uint8_t** src, uint32_t blocks)
+{
+    uint8_t* q = *dst;
+    const uint8_t* p = *src;
+    uint32_t a, b, c, d;
+
+    __asm volatile(
+        "1:                             \n"
+        "ldrd   %[a], %[b], [%[p]], #8  \n"
+        "ldrd   %[c], %[d], [%[p]], #8  \n"
+        "strd   %[a], %[b], [%[q]], #8  \n"
+        "strd   %[c], %[d], [%[q]], #8  \n"
+        "ldrd   %[a], %[b], [%[p]], #8  \n"
+        "ldrd   %[c], %[d], [%[p]], #8  \n"
+        "strd   %[a], %[b], [%[q]], #8  \n"
+        "strd   %[c], %[d], [%[q]], #8  \n"
+        "subs   %[n], %[n], #1          \n"
+        "bne    1b                      \n"
+        : [p] "+r"(p), [q] "+r"(q), [n] "+r"(blocks),
+          [a] "=&r"(a), [b] "=&r"(b), [c] "=&r"(c), [d] "=&r"(d)
+        :
+        : "cc", "memory");
+    *dst = q;
+    *src = p;
+}
+
+static inline void memops_set_blocks(uint8_t** dst, uint32_t v, uint32_t blocks)
+{
+    uint8_t* q = *dst;
+    uint32_t w = v;
+
+    __asm volatile(
+        "1:                             \n"
+        "strd   %[v], %[w], [%[q]], #8  \n"
+        "strd   %[v], %[w], [%[q]], #8  \n"
+        "strd   %[v], %[w], [%[q]], #8  \n"
+        "strd   %[v], %[w], [%[q]], #8  \n"
+        "subs   %[n], %[n], #1          \n"
+        "bne    1b                      \n"
+        : [q] "+r"(q), [n] "+r"(blocks)
+        : [v] "r"(v), [w] "r"(w)
+        : "cc", "memory");
+    *dst = q;
+}
+#endif
+
+ITCM_FUNC void* memops_copy(void* dst, const void* src, size_t len)
+{
+    uint8_t* d = (uint8_t*)dst;
+    const uint8_t* s = (const uint8_t*)src;
+
+    /* Short: first and last word (or two) may overlap, nothing loops */
+    if (len <= 16U) {
+        if (len >= 8U) {
+            uint32_t a = memops_load(s);
+            uint32_t b = memops_load(s + 4);
+            uint32_t c = memops_load(s + len - 8U);
+            uint32_t e = memops_load(s + len - 4U);
+            memops_store(d, a);
+            memops_store(d + 4, b);
+            memops_store(d + len - 8U, c);
+            memops_store(d + len - 4U, e);
+        } else if (len >= 4U) {
+            uint32_t a = memops_load(s);
+            uint32_t b = memops_load(s + len - 4U);
+            memops_store(d, a);
+            memops_store(d + len - 4U, b);
+        } else if (len != 0U) {
+            uint8_t a = s[0];
+            uint8_t b = s[len >> 1];
+            uint8_t c = s[len - 1U];
+            d[0] = a;
+            d[len >> 1] = b;
+            d[len - 1U] = c;
+        }
+        return dst;
+    }
+
+    if ((((uintptr_t)d ^ (uintptr_t)s) & 3U) == 0U) {
+        while (((uintptr_t)d & 3U) != 0U) {
+            *d++ = *s++;
+            len--;
+        }
+#if MEMOPS_ASM
+        if (len >= MEMOPS_BLOCK) {
+            uint32_t blocks = (uint32_t)(len / MEMOPS_BLOCK);
+            memops_copy_blocks(&d, &s, blocks);
+            len -= blocks * MEMOPS_BLOCK;
+        }
+#endif
+        while (len >= 4U) {
+            *(memops_u32_t*)d = *(const memops_u32_t*)s;
+            d += 4;
+            s += 4;
+            len -= 4U;
+        }
+    } else {
+        while (((uintptr_t)d & 3U) != 0U) {
+            *d++ = *s++;
+            len--;
+        }
+        while (len >= 4U) {
+            *(memops_u32_t*)d = memops_load(s);
+            d += 4;
+            s += 4;
+            len -= 4U;
+        }
+    }
+    while (len != 0U) {
+        *d++ = *s++;
+        len--;
+    }
+    return dst;
+}
+
+ITCM_FUNC void* memops_set(void* dst, int c, size_t len)
+{
+    uint8_t* d = (uint8_t*)dst;
+    uint32_t v = (uint8_t)c * 0x01010101U;
+
+    if (len >= 8U) {
+        memops_store(d, v);
+        memops_store(d + len - 4U, v);
+        while (((uintptr_t)d & 3U) != 0U) {
+            d++;
+            len--;
+        }
+#if MEMOPS_ASM
+        if (len >= MEMOPS_BLOCK) {
+            uint32_t blocks = (uint32_t)(len / MEMOPS_BLOCK);
+            memops_set_blocks(&d, v, blocks);
+            len -= blocks * MEMOPS_BLOCK;
+        }
+#endif
+        while (len >= 4U) {
+            *(memops_u32_t*)d = v;
+            d += 4;
+            len -= 4U;
+        }
+    }
+    while (len != 0U) {
+        *d++ = (uint8_t)v;
+        len--;
+    }
+    return dst;
+}
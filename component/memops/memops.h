@@ -0,0 +1,55 @@
+/**
+ * @file memops.h
+ * @brief memcpy() / memset() for the Cortex-M7, for lwIP and the logger.
+ *
+ * newlib nano's memcpy() and memset() move one byte per iteration. Here:
+ *  - up to 16 bytes (MAC addresses, Ethernet and IP headers copied at a
+ *    runtime length): two possibly overlapping word or double word moves,
+ *    no loop;
+ *  - same alignment in a word: bytes up to a word boundary, then 32-byte
+ *    LDRD/STRD bursts, then words;
+ *  - different alignment: unaligned word loads, aligned word stores.
+ *
+ * MEMOPS_COPY() inlines copies of a small constant length instead.
+ * Unaligned accesses need Normal memory (any RAM here), not Device memory.
+ * Other targets (host) run the same code with plain word loops.
+ */
+
+#pragma once
+
+#ifndef MEMOPS_H
+#define MEMOPS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* 1: lwipopts.h routes SMEMCPY (and MEMCPY without the MDMA) here */
+#ifndef MEMOPS_LWIP
+#define MEMOPS_LWIP 1
+#endif
+
+/* Constant lengths up to this are left to the compiler to inline */
+#ifndef MEMOPS_INLINE_MAX
+#define MEMOPS_INLINE_MAX 32U
+#endif
+
+/* memcpy(), returns dst; the areas must not overlap */
+void* memops_copy(void* dst, const void* src, size_t len);
+
+/* memset(), returns dst */
+void* memops_set(void* dst, int c, size_t len);
+
+#define MEMOPS_COPY(dst, src, len)                                              \
+    ((__builtin_constant_p(len) && (size_t)(len) <= MEMOPS_INLINE_MAX)          \
+         ? __builtin_memcpy((dst), (src), (len))                                \
+         : memops_copy((dst), (src), (len)))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MEMOPS_H */
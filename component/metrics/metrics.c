@@ -0,0 +1,423 @@
+/**
+ * @file metrics.c
+ * @brief Metric registry, StatsD batches, the Prometheus text page and JSON.
+ */
+
+#include "metrics.h"
+
+#include "main.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+#include "lwip/udp.h"
+#include "lwip/tcp.h"
+#include "lwip/pbuf.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define METRICS_TAG             "METRICS"
+/* One Ethernet frame without fragmentation */
+#define METRICS_DATAGRAM_MAX    (1500U - 20U - 8U)
+/* tcp_poll() runs every 500 ms */
+#define METRICS_HTTP_POLLS      10U
+
+typedef enum {
+    METRICS_OUT_STATSD = 0,
+    METRICS_OUT_TEXT,
+    METRICS_OUT_JSON,
+} MetricsOut_t;
+
+struct MetricsWriter_s {
+    MetricsOut_t out;
+    char* buf;
+    size_t size;
+    size_t len;
+    uint32_t series;
+    bool full;
+    JsonOut_t* json;            /* METRICS_OUT_JSON */
+};
+
+typedef struct {
+    const char* name;
+    const LatHist_t* hist;
+} MetricsHist_t;
+
+/* All of it is used on the tcpip thread or under the core lock */
+static Metric_t* metrics_table[METRICS_MAX];
+static uint32_t metrics_count;
+static MetricsHist_t metrics_hist[METRICS_MAX];
+static uint32_t metrics_hist_count;
+static MetricsCollector_t metrics_collectors[METRICS_MAX_COLLECTORS];
+static uint32_t metrics_collector_count;
+
+/* StatsD counters are sent as the change since the previous batch */
+static uint32_t metrics_prev[METRICS_MAX_SERIES];
+static bool metrics_prev_valid;
+
+static char metrics_text[METRICS_TEXT_SIZE];
+
+#if METRICS_STATSD_MS
+static struct udp_pcb* metrics_udp;
+static ip_addr_t metrics_statsd_addr;
+static char metrics_datagram[METRICS_DATAGRAM_MAX];
+#endif
+
+#if METRICS_HTTP_PORT
+typedef struct {
+    struct tcp_pcb* pcb;
+    size_t len;
+    size_t off;
+    uint8_t polls;
+    bool answered;
+} MetricsHttp_t;
+
+static MetricsHttp_t metrics_http;
+#endif
+
+bool metrics_register(Metric_t* m)
+{
+    bool ok = false;
+
+    LOCK_TCPIP_CORE();
+    if (metrics_count < METRICS_MAX) {
+        metrics_table[metrics_count++] = m;
+        metrics_prev_valid = false;
+        ok = true;
+    }
+    UNLOCK_TCPIP_CORE();
+    return ok;
+}
+
+bool metrics_register_hist(const char* name, const LatHist_t* h)
+{
+    bool ok = false;
+
+    LOCK_TCPIP_CORE();
+    if (metrics_hist_count < METRICS_MAX) {
+        metrics_hist[metrics_hist_count].name = name;
+        metrics_hist[metrics_hist_count].hist = h;
+        metrics_hist_count++;
+        metrics_prev_valid = false;
+        ok = true;
+    }
+    UNLOCK_TCPIP_CORE();
+    return ok;
+}
+
+bool metrics_register_collector(MetricsCollector_t fn)
+{
+    bool ok = false;
+
+    LOCK_TCPIP_CORE();
+    if (metrics_collector_count < METRICS_MAX_COLLECTORS) {
+        metrics_collectors[metrics_collector_count++] = fn;
+        metrics_prev_valid = false;
+        ok = true;
+    }
+    UNLOCK_TCPIP_CORE();
+    return ok;
+}
+
+#if METRICS_STATSD_MS
+static void metrics_statsd_send(MetricsWriter_t* w)
+{
+    struct pbuf* p;
+
+    if (w->len == 0U) {
+        return;
+    }
+    p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)w->len, PBUF_RAM);
+    if (p != NULL) {
+        pbuf_take(p, w->buf, (u16_t)w->len);
+        udp_sendto(metrics_udp, p, &metrics_statsd_addr, METRICS_STATSD_PORT);
+        pbuf_free(p);
+    }
+    w->len = 0U;
+}
+#endif
+
+static void metrics_append(MetricsWriter_t* w, const char* line, size_t n)
+{
+#if METRICS_STATSD_MS
+    if (w->out == METRICS_OUT_STATSD && w->len + n > w->size) {
+        metrics_statsd_send(w);
+    }
+#endif
+    if (w->full || w->len + n > w->size) {
+        w->full = true;
+        return;
+    }
+    memcpy(&w->buf[w->len], line, n);
+    w->len += n;
+}
+
+void metrics_emit(MetricsWriter_t* w, const char* name, MetricType_t type, uint32_t value)
+{
+    char line[METRICS_NAME_MAX * 2U + 32U];
+    uint32_t idx = w->series++;
+    int n;
+
+    if (w->out == METRICS_OUT_STATSD) {
+        uint32_t v = value;
+
+        if (type == METRIC_COUNTER) {
+            if (idx >= METRICS_MAX_SERIES) {
+                /* No baseline, a total would read as an increment */
+                return;
+            }
+            v = value - metrics_prev[idx];
+            metrics_prev[idx] = value;
+            if (!metrics_prev_valid) {
+                /* First batch after a change of the table: baseline only */
+                return;
+            }
+        }
+        n = snprintf(line, sizeof(line), METRICS_PREFIX ".%s:%lu|%s\n", name, (unsigned long)v,
+                     (type == METRIC_COUNTER) ? "c" : "g");
+    } else if (w->out == METRICS_OUT_JSON) {
+        LWIP_UNUSED_ARG(idx);
+        json_out_u32(w->json, name, value);
+        return;
+    } else {
+        char prom[METRICS_NAME_MAX];
+        size_t i;
+
+        for (i = 0; i < sizeof(prom) - 1U && name[i] != '\0'; i++) {
+            prom[i] = (name[i] == '.' || name[i] == '-') ? '_' : name[i];
+        }
+        prom[i] = '\0';
+        n = snprintf(line, sizeof(line), "# TYPE " METRICS_PREFIX "_%s %s\n" METRICS_PREFIX "_%s %lu\n", prom,
+                     (type == METRIC_COUNTER) ? "counter" : "gauge", prom, (unsigned long)value);
+    }
+    if (n > 0 && (size_t)n < sizeof(line)) {
+        metrics_append(w, line, (size_t)n);
+    }
+}
+
+static void metrics_emit_hist(MetricsWriter_t* w, const MetricsHist_t* mh)
+{
+    static LatHist_t snap;
+    static const struct {
+        const char* suffix;
+        uint32_t per10k;
+    } q[] = { { "p50", 5000U }, { "p99", 9900U }, { "p999", 9990U } };
+    char name[METRICS_NAME_MAX];
+
+    lat_hist_snapshot(mh->hist, &snap);
+    snprintf(name, sizeof(name), "%s.count", mh->name);
+    metrics_emit(w, name, METRIC_COUNTER, snap.count);
+    for (uint32_t i = 0; i < sizeof(q) / sizeof(q[0]); i++) {
+        snprintf(name, sizeof(name), "%s.%s", mh->name, q[i].suffix);
+        metrics_emit(w, name, METRIC_GAUGE, lat_hist_percentile(&snap, q[i].per10k));
+    }
+    snprintf(name, sizeof(name), "%s.max", mh->name);
+    metrics_emit(w, name, METRIC_GAUGE, snap.max);
+}
+
+static void metrics_export(MetricsWriter_t* w)
+{
+    for (uint32_t i = 0; i < metrics_count; i++) {
+        metrics_emit(w, metrics_table[i]->name, metrics_table[i]->type, metrics_table[i]->value);
+    }
+    for (uint32_t i = 0; i < metrics_hist_count; i++) {
+        metrics_emit_hist(w, &metrics_hist[i]);
+    }
+    for (uint32_t i = 0; i < metrics_collector_count; i++) {
+        metrics_collectors[i](w);
+    }
+}
+
+size_t metrics_render_text(char* buf, size_t size)
+{
+    MetricsWriter_t w = { METRICS_OUT_TEXT, buf, size, 0U, 0U, false };
+
+    if (size == 0U) {
+        return 0U;
+    }
+    metrics_export(&w);
+    return w.len;
+}
+
+void metrics_json(JsonOut_t* j, void* arg)
+{
+    MetricsWriter_t w = { METRICS_OUT_JSON, NULL, 0U, 0U, 0U, false, j };
+
+    LWIP_UNUSED_ARG(arg);
+    json_out_obj(j, NULL);
+    metrics_export(&w);
+    json_out_end(j);
+}
+
+#if METRICS_STATSD_MS
+static void metrics_statsd_timer(void* arg)
+{
+    MetricsWriter_t w = { METRICS_OUT_STATSD, metrics_datagram, sizeof(metrics_datagram), 0U, 0U, false };
+
+    metrics_export(&w);
+    metrics_statsd_send(&w);
+    metrics_prev_valid = true;
+    sys_timeout(METRICS_STATSD_MS, metrics_statsd_timer, arg);
+}
+#endif
+
+#if METRICS_HTTP_PORT
+static const char metrics_http_header[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: text/plain; version=0.0.4\r\n"
+    "Connection: close\r\n\r\n";
+
+static void metrics_http_close(MetricsHttp_t* c)
+{
+    struct tcp_pcb* pcb = c->pcb;
+
+    c->pcb = NULL;
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+    tcp_err(pcb, NULL);
+    if (tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+    }
+}
+
+static void metrics_http_send(MetricsHttp_t* c)
+{
+    while (c->off < c->len) {
+        size_t n = c->len - c->off;
+        u16_t room = tcp_sndbuf(c->pcb);
+
+        if (n > room) {
+            n = room;
+        }
+        if (n == 0U || tcp_write(c->pcb, &metrics_text[c->off], (u16_t)n, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+            break;
+        }
+        c->off += n;
+    }
+    tcp_output(c->pcb);
+    if (c->off == c->len) {
+        /* The FIN follows the queued data */
+        metrics_http_close(c);
+    }
+}
+
+static err_t metrics_http_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    MetricsHttp_t* c = arg;
+
+    if (p == NULL || err != ERR_OK) {
+        if (p != NULL) {
+            pbuf_free(p);
+        }
+        metrics_http_close(c);
+        return ERR_OK;
+    }
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+    if (!c->answered) {
+        /* Any request gets the page */
+        size_t hlen = sizeof(metrics_http_header) - 1U;
+        memcpy(metrics_text, metrics_http_header, hlen);
+        c->len = hlen + metrics_render_text(&metrics_text[hlen], sizeof(metrics_text) - hlen);
+        c->off = 0U;
+        c->answered = true;
+        metrics_http_send(c);
+    }
+    return ERR_OK;
+}
+
+static err_t metrics_http_sent(void* arg, struct tcp_pcb* pcb, u16_t len)
+{
+    MetricsHttp_t* c = arg;
+
+    LWIP_UNUSED_ARG(pcb);
+    LWIP_UNUSED_ARG(len);
+    c->polls = 0U;
+    metrics_http_send(c);
+    return ERR_OK;
+}
+
+static err_t metrics_http_poll(void* arg, struct tcp_pcb* pcb)
+{
+    MetricsHttp_t* c = arg;
+
+    if (++c->polls >= METRICS_HTTP_POLLS) {
+        c->pcb = NULL;
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    return ERR_OK;
+}
+
+static void metrics_http_err(void* arg, err_t err)
+{
+    MetricsHttp_t* c = arg;
+
+    LWIP_UNUSED_ARG(err);
+    c->pcb = NULL;
+}
+
+static err_t metrics_http_accept(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+    MetricsHttp_t* c = &metrics_http;
+
+    LWIP_UNUSED_ARG(arg);
+    if (err != ERR_OK || pcb == NULL || c->pcb != NULL) {
+        /* One scrape at a time, the page buffer is shared */
+        return ERR_MEM;
+    }
+    memset(c, 0, sizeof(*c));
+    c->pcb = pcb;
+    pcb->tos = METRICS_TOS;
+    tcp_arg(pcb, c);
+    tcp_recv(pcb, metrics_http_recv);
+    tcp_sent(pcb, metrics_http_sent);
+    tcp_poll(pcb, metrics_http_poll, 1U);
+    tcp_err(pcb, metrics_http_err);
+    return ERR_OK;
+}
+
+static bool metrics_http_listen(void)
+{
+    struct tcp_pcb* pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    struct tcp_pcb* lpcb;
+
+    if (pcb == NULL) {
+        return false;
+    }
+    if (tcp_bind(pcb, IP_ANY_TYPE, METRICS_HTTP_PORT) != ERR_OK) {
+        tcp_close(pcb);
+        return false;
+    }
+    lpcb = tcp_listen_with_backlog(pcb, 1);
+    if (lpcb == NULL) {
+        tcp_close(pcb);
+        return false;
+    }
+    tcp_accept(lpcb, metrics_http_accept);
+    return true;
+}
+#endif
+
+void metrics_init(void)
+{
+    metrics_sources_register();
+
+    LOCK_TCPIP_CORE();
+#if METRICS_STATSD_MS
+    metrics_udp = udp_new();
+    if (metrics_udp != NULL && ipaddr_aton(METRICS_STATSD_IP, &metrics_statsd_addr)) {
+        metrics_udp->tos = METRICS_TOS;
+        sys_timeout(METRICS_STATSD_MS, metrics_statsd_timer, NULL);
+    } else {
+        LOG_ERROR(METRICS_TAG, "statsd disabled");
+    }
+#endif
+#if METRICS_HTTP_PORT
+    if (!metrics_http_listen()) {
+        LOG_ERROR(METRICS_TAG, "no listener on port %u", (unsigned)METRICS_HTTP_PORT);
+    }
+#endif
+    UNLOCK_TCPIP_CORE();
+}
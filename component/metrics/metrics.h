@@ -0,0 +1,157 @@
+/**
+ * @file metrics.h
+ * @brief Counters, gauges and histograms exported as StatsD or Prometheus text.
+ *
+ * A metric is either a Metric_t the owner updates in place (one relaxed
+ * atomic add, safe from any context), a LatHist_t exported as count and
+ * percentiles, or the output of a collector: a function that reads the
+ * snapshot of an existing subsystem (driver, logger, heap) and emits it
+ * through metrics_emit() when an export runs. Nothing is allocated, all
+ * tables are fixed size.
+ *
+ * Exports run on the tcpip thread: a StatsD batch every METRICS_STATSD_MS
+ * ("prefix.name:value|c" lines, as many per datagram as fit, counters as
+ * deltas) and a Prometheus text page on TCP port METRICS_HTTP_PORT
+ * ("curl http://<board>:9100/metrics", dots in names become underscores).
+ * metrics_json() gives the diagnostics page (component/httpd) the same
+ * values, streamed.
+ */
+
+#pragma once
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "lathist/lat_hist.h"
+#include "json/json_out.h"
+
+/* 0 leaves the exporter out of the startup code */
+#ifndef METRICS
+#define METRICS 1
+#endif
+
+/* Registered Metric_t and histograms */
+#ifndef METRICS_MAX
+#define METRICS_MAX 48U
+#endif
+
+#ifndef METRICS_MAX_COLLECTORS
+#define METRICS_MAX_COLLECTORS 32U
+#endif
+
+/* Exported values per export, histograms count five. StatsD counter
+ * deltas need one word each. */
+#ifndef METRICS_MAX_SERIES
+#define METRICS_MAX_SERIES 256U
+#endif
+
+/* StatsD period; 0: no StatsD */
+#ifndef METRICS_STATSD_MS
+#define METRICS_STATSD_MS 10000U
+#endif
+
+#ifndef METRICS_STATSD_IP
+#define METRICS_STATSD_IP SYSLOG_SERVER_IP
+#endif
+
+#ifndef METRICS_STATSD_PORT
+#define METRICS_STATSD_PORT 8125U
+#endif
+
+/* Prometheus text over HTTP; 0: no listener */
+#ifndef METRICS_HTTP_PORT
+#define METRICS_HTTP_PORT 9100U
+#endif
+
+/* Rendered page, one scrape at a time */
+#ifndef METRICS_TEXT_SIZE
+#define METRICS_TEXT_SIZE 16384U
+#endif
+
+/* Longest name including the terminator; longer ones are cut */
+#ifndef METRICS_NAME_MAX
+#define METRICS_NAME_MAX 64U
+#endif
+
+/* IP TOS of statsd datagrams and scrape replies: DSCP AF31, the telemetry
+ * class of the ETH TX scheduler (ETHIF_TX_SCHED) */
+#ifndef METRICS_TOS
+#define METRICS_TOS 0x68U
+#endif
+
+#ifndef METRICS_PREFIX
+#define METRICS_PREFIX "h743"
+#endif
+
+typedef enum {
+    METRIC_COUNTER = 0,     /* running total, wraps at 32 bits */
+    METRIC_GAUGE,
+} MetricType_t;
+
+typedef struct {
+    const char* name;       /* "eth.rx.frames"; must outlive the registry */
+    MetricType_t type;
+    volatile uint32_t value;
+} Metric_t;
+
+#define METRIC_COUNTER_INIT(n) { (n), METRIC_COUNTER, 0U }
+#define METRIC_GAUGE_INIT(n)   { (n), METRIC_GAUGE, 0U }
+
+typedef struct MetricsWriter_s MetricsWriter_t;
+
+/* Runs on the tcpip thread during an export */
+typedef void (*MetricsCollector_t)(MetricsWriter_t* w);
+
+static inline void metric_add(Metric_t* m, uint32_t n)
+{
+    __atomic_fetch_add(&m->value, n, __ATOMIC_RELAXED);
+}
+
+static inline void metric_inc(Metric_t* m)
+{
+    metric_add(m, 1U);
+}
+
+static inline void metric_set(Metric_t* m, uint32_t v)
+{
+    __atomic_store_n(&m->value, v, __ATOMIC_RELAXED);
+}
+
+/* Registration takes the core lock: call from a task, not holding it.
+ * False when the table is full. */
+bool metrics_register(Metric_t* m);
+bool metrics_register_hist(const char* name, const LatHist_t* h);
+bool metrics_register_collector(MetricsCollector_t fn);
+
+/* For collectors; name is copied, a stack buffer will do. */
+void metrics_emit(MetricsWriter_t* w, const char* name, MetricType_t type, uint32_t value);
+
+/* Registers the built-in collectors (metrics_sources.c), starts the StatsD
+ * timer and the HTTP listener. Call once from a task after init_logger(). */
+void metrics_init(void);
+
+/* Prometheus text into buf, returns its length. Call with the core lock
+ * held or on the tcpip thread. */
+size_t metrics_render_text(char* buf, size_t size);
+
+/* JsonOutFn_t: one JSON object, {"eth.rx.frames":123,...}, same rules;
+ * arg unused. Rendered again per chunk, so a chunk may show newer values
+ * than the one before. */
+void metrics_json(JsonOut_t* j, void* arg);
+
+/* Built-in collectors, registered by metrics_init() */
+void metrics_sources_register(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* METRICS_H */
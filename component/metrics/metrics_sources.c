@@ -0,0 +1,514 @@
+/**
+ * @file metrics_sources.c
+ * @brief Built-in collectors: Ethernet driver, lwIP, DHCP, logger, QSPI flash and FreeRTOS heap.
+ */
+
+#include "metrics.h"
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "ethernetif.h"
+#include "ethernetif_opts.h"
+#include "lwip/stats.h"
+#include "lwip/memp.h"
+#include "lwip/tcp.h"
+#include "lwip/api.h"
+#include "twheel/twheel.h"
+#include "timesync/timesync.h"
+#include "timesync/sntp_client.h"
+#include "resolv/resolv.h"
+#include "dhcpc/dhcp_client.h"
+#include "logger/log_store.h"
+#include "logger/console.h"
+#include "logger/log_ctl.h"
+#include "logger/log_sink.h"
+#include "qspi/qspi_flash.h"
+
+#include <stdio.h>
+
+static void metrics_eth(MetricsWriter_t* w)
+{
+    EthIfStatsTypeDef s;
+
+    ethernetif_get_stats(&s);
+    metrics_emit(w, "eth.rx.frames", METRIC_COUNTER, s.rx.frames);
+    metrics_emit(w, "eth.rx.bytes", METRIC_COUNTER, s.rx.bytes);
+    metrics_emit(w, "eth.rx.rbu", METRIC_COUNTER, s.rx.rbu);
+    metrics_emit(w, "eth.rx.alloc_fail", METRIC_COUNTER, s.rx.alloc_fail);
+    metrics_emit(w, "eth.rx.refill_retry", METRIC_COUNTER, s.rx.refill_retry);
+    metrics_emit(w, "eth.rx.irq", METRIC_COUNTER, s.rx.irq);
+    metrics_emit(w, "eth.rx.budget_hits", METRIC_COUNTER, s.rx.budget_hits);
+    metrics_emit(w, "eth.rx.batches", METRIC_COUNTER, s.rx.batches);
+    metrics_emit(w, "eth.rx.queue_drops", METRIC_COUNTER, s.rx.queue_drops);
+    metrics_emit(w, "eth.rx.mbox_full", METRIC_COUNTER, s.rx.mbox_full);
+    metrics_emit(w, "eth.rx.csum_drops", METRIC_COUNTER, s.rx.csum_drops);
+    metrics_emit(w, "eth.rx.arp_offloaded", METRIC_COUNTER, s.rx.arp_offloaded);
+    metrics_emit(w, "eth.rx.prio", METRIC_COUNTER, s.rx.prio);
+    metrics_emit(w, "eth.rx.udp_fast", METRIC_COUNTER, s.rx.udp_fast);
+    metrics_emit(w, "eth.rx.udp_fast_drops", METRIC_COUNTER, s.rx.udp_fast_drops);
+    metrics_emit(w, "eth.rx.steered", METRIC_COUNTER, s.rx.steered);
+    metrics_emit(w, "eth.rx.steer_drops", METRIC_COUNTER, s.rx.steer_drops);
+    metrics_emit(w, "eth.rx.copied", METRIC_COUNTER, s.rx.copied);
+    metrics_emit(w, "eth.rx.copy_fail", METRIC_COUNTER, s.rx.copy_fail);
+    metrics_emit(w, "eth.rx.admit_level", METRIC_GAUGE, s.rx.admit_level);
+    metrics_emit(w, "eth.rx.overloads", METRIC_COUNTER, s.rx.overloads);
+    metrics_emit(w, "eth.rx.admit_bcast", METRIC_COUNTER, s.rx.admit_bcast);
+    metrics_emit(w, "eth.rx.admit_port", METRIC_COUNTER, s.rx.admit_port);
+    metrics_emit(w, "eth.rx.admit_bulk", METRIC_COUNTER, s.rx.admit_bulk);
+    metrics_emit(w, "eth.tx.frames", METRIC_COUNTER, s.tx.frames);
+    metrics_emit(w, "eth.tx.bytes", METRIC_COUNTER, s.tx.bytes);
+    metrics_emit(w, "eth.tx.busy", METRIC_COUNTER, s.tx.busy);
+    metrics_emit(w, "eth.tx.errors", METRIC_COUNTER, s.tx.errors);
+    metrics_emit(w, "eth.tx.queued", METRIC_COUNTER, s.tx.queued);
+    metrics_emit(w, "eth.tx.queue_drops", METRIC_COUNTER, s.tx.queue_drops);
+    metrics_emit(w, "eth.tx.coalesced", METRIC_COUNTER, s.tx.coalesced);
+    metrics_emit(w, "eth.tx.batches", METRIC_COUNTER, s.tx.batches);
+    metrics_emit(w, "eth.tx.batched", METRIC_COUNTER, s.tx.batched);
+    metrics_emit(w, "eth.tx.csum_sw", METRIC_COUNTER, s.tx.csum_sw);
+#if ETHIF_TX_TT
+    EthIfTxTtStatsTypeDef tt;
+
+    ethernetif_get_tx_tt_stats(&tt);
+    metrics_emit(w, "eth.tx.tt.windows", METRIC_COUNTER, tt.windows);
+    metrics_emit(w, "eth.tx.tt.frames", METRIC_COUNTER, tt.frames);
+    metrics_emit(w, "eth.tx.tt.drops", METRIC_COUNTER, tt.drops);
+    metrics_emit(w, "eth.tx.tt.late", METRIC_COUNTER, tt.late);
+    metrics_emit(w, "eth.tx.tt.held", METRIC_COUNTER, tt.held);
+    metrics_emit(w, "eth.tx.tt.err_max_ns", METRIC_GAUGE, tt.err_max_ns);
+#endif
+#if ETHIF_TX_SCHED
+    static const char* const cls[ETHIF_TX_CLASS_CNT] = { "control", "telemetry", "logging", "bulk" };
+    EthIfTxClassStatsTypeDef tc[ETHIF_TX_CLASS_CNT];
+    char cname[METRICS_NAME_MAX];
+
+    ethernetif_get_tx_class_stats(tc);
+    for (uint32_t i = 0; i < ETHIF_TX_CLASS_CNT; i++) {
+        snprintf(cname, sizeof(cname), "eth.tx.%s.frames", cls[i]);
+        metrics_emit(w, cname, METRIC_COUNTER, tc[i].frames);
+        snprintf(cname, sizeof(cname), "eth.tx.%s.bytes", cls[i]);
+        metrics_emit(w, cname, METRIC_COUNTER, tc[i].bytes);
+        snprintf(cname, sizeof(cname), "eth.tx.%s.queued", cls[i]);
+        metrics_emit(w, cname, METRIC_COUNTER, tc[i].queued);
+        snprintf(cname, sizeof(cname), "eth.tx.%s.shaped", cls[i]);
+        metrics_emit(w, cname, METRIC_COUNTER, tc[i].shaped);
+        snprintf(cname, sizeof(cname), "eth.tx.%s.queue_drops", cls[i]);
+        metrics_emit(w, cname, METRIC_COUNTER, tc[i].queue_drops);
+        snprintf(cname, sizeof(cname), "eth.tx.%s.delay_max_us", cls[i]);
+        metrics_emit(w, cname, METRIC_GAUGE, tc[i].delay_max_us);
+    }
+#endif
+    metrics_emit(w, "eth.dma_errors", METRIC_COUNTER, s.dma_errors);
+    metrics_emit(w, "eth.mac_errors", METRIC_COUNTER, s.mac_errors);
+    metrics_emit(w, "lwip.core_lock.violations", METRIC_COUNTER, ethernetif_core_lock_violations());
+#if ETHIF_RX_LATENCY
+    static const char* const stage[ETHIF_RXLAT_CNT] = { "wake", "post", "input", "done", "app" };
+    char name[METRICS_NAME_MAX];
+
+    for (uint32_t i = 0; i < ETHIF_RXLAT_CNT; i++) {
+        EthIfRxLatTypeDef lat;
+        ethernetif_rx_latency_get((EthIfRxLatStageTypeDef)i, &lat);
+        snprintf(name, sizeof(name), "eth.rxlat.%s.p50_ns", stage[i]);
+        metrics_emit(w, name, METRIC_GAUGE, lat.p50_ns);
+        snprintf(name, sizeof(name), "eth.rxlat.%s.p99_ns", stage[i]);
+        metrics_emit(w, name, METRIC_GAUGE, lat.p99_ns);
+        snprintf(name, sizeof(name), "eth.rxlat.%s.max_ns", stage[i]);
+        metrics_emit(w, name, METRIC_GAUGE, lat.max_ns);
+    }
+#endif
+}
+
+#if LWIP_STATS
+static void metrics_lwip_proto(MetricsWriter_t* w, const char* proto, const struct stats_proto* p)
+{
+    char name[METRICS_NAME_MAX];
+
+#define METRICS_LWIP_FIELD(f) \
+    snprintf(name, sizeof(name), "lwip.%s." #f, proto); \
+    metrics_emit(w, name, METRIC_COUNTER, p->f)
+    METRICS_LWIP_FIELD(xmit);
+    METRICS_LWIP_FIELD(recv);
+    METRICS_LWIP_FIELD(drop);
+    METRICS_LWIP_FIELD(chkerr);
+    METRICS_LWIP_FIELD(lenerr);
+    METRICS_LWIP_FIELD(memerr);
+    METRICS_LWIP_FIELD(rterr);
+    METRICS_LWIP_FIELD(proterr);
+    METRICS_LWIP_FIELD(err);
+#undef METRICS_LWIP_FIELD
+}
+
+static void metrics_lwip_mem(MetricsWriter_t* w, const char* pool, const struct stats_mem* m)
+{
+    char name[METRICS_NAME_MAX];
+
+    snprintf(name, sizeof(name), "lwip.%s.avail", pool);
+    metrics_emit(w, name, METRIC_GAUGE, (uint32_t)m->avail);
+    snprintf(name, sizeof(name), "lwip.%s.used", pool);
+    metrics_emit(w, name, METRIC_GAUGE, (uint32_t)m->used);
+    snprintf(name, sizeof(name), "lwip.%s.max", pool);
+    metrics_emit(w, name, METRIC_GAUGE, (uint32_t)m->max);
+    snprintf(name, sizeof(name), "lwip.%s.err", pool);
+    metrics_emit(w, name, METRIC_COUNTER, m->err);
+}
+
+/* Pool names without LWIP_DEBUG (memp_desc has no desc string then) */
+static const char* const metrics_memp_names[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name, num, size, desc) "memp." #name,
+#include "lwip/priv/memp_std.h"
+};
+
+/* Runs on the tcpip thread, so the core counters are not moving while
+ * they are copied; pool stats change from other tasks and interrupts
+ * (atomically with MEMP_LOCKFREE) and are read one word at a time. */
+static void metrics_lwip(MetricsWriter_t* w)
+{
+    static struct stats_ snap;
+
+    snap = lwip_stats;
+#if ETHARP_STATS
+    metrics_lwip_proto(w, "etharp", &snap.etharp);
+#endif
+#if IP_STATS
+    metrics_lwip_proto(w, "ip", &snap.ip);
+#endif
+#if ICMP_STATS
+    metrics_lwip_proto(w, "icmp", &snap.icmp);
+#endif
+#if UDP_STATS
+    metrics_lwip_proto(w, "udp", &snap.udp);
+#endif
+#if TCP_STATS
+    metrics_lwip_proto(w, "tcp", &snap.tcp);
+#endif
+#if MEM_STATS
+    metrics_lwip_mem(w, "mem", &snap.mem);
+#endif
+#if MEMP_STATS
+    for (uint32_t i = 0; i < MEMP_MAX; i++) {
+        struct stats_mem m = *snap.memp[i];
+        metrics_lwip_mem(w, metrics_memp_names[i], &m);
+    }
+#endif
+}
+#endif
+
+#if LWIP_TCP && TCP_OOSEQ_GOVERN
+static void metrics_tcp_ooseq(MetricsWriter_t* w)
+{
+    struct tcp_ooseq_stats s;
+
+    tcp_ooseq_get_stats(&s);
+    metrics_emit(w, "lwip.tcp.ooseq.pbufs", METRIC_GAUGE, s.pbufs);
+    metrics_emit(w, "lwip.tcp.ooseq.bytes", METRIC_GAUGE, s.bytes);
+    metrics_emit(w, "lwip.tcp.ooseq.pbufs_max", METRIC_GAUGE, s.pbufs_max);
+    metrics_emit(w, "lwip.tcp.ooseq.trimmed", METRIC_COUNTER, s.trimmed);
+    metrics_emit(w, "lwip.tcp.ooseq.pool_low", METRIC_COUNTER, s.pool_low);
+    metrics_emit(w, "lwip.tcp.ooseq.evicted", METRIC_COUNTER, s.evicted);
+    metrics_emit(w, "lwip.tcp.ooseq.evicted_pbufs", METRIC_COUNTER, s.evicted_pbufs);
+}
+#endif
+
+#if LWIP_TCP && TCP_SND_AUTOTUNE
+static void metrics_tcp_snd_tune(MetricsWriter_t* w)
+{
+    struct tcp_snd_tune_stats s;
+
+    tcp_snd_tune_get_stats(&s);
+    metrics_emit(w, "lwip.tcp.snd_tune.granted", METRIC_GAUGE, s.granted);
+    metrics_emit(w, "lwip.tcp.snd_tune.granted_max", METRIC_GAUGE, s.granted_max);
+    metrics_emit(w, "lwip.tcp.snd_tune.grown", METRIC_COUNTER, s.grown);
+    metrics_emit(w, "lwip.tcp.snd_tune.shrunk", METRIC_COUNTER, s.shrunk);
+    metrics_emit(w, "lwip.tcp.snd_tune.denied", METRIC_COUNTER, s.denied);
+}
+#endif
+
+#if TCP_CONN_STATS
+/* Over the open connections, all gauges: the sums drop when a connection
+ * closes, and the series stay the same whatever is open. Per connection
+ * on the diagnostics page (/tcp.json). */
+static void metrics_tcp_conns(MetricsWriter_t* w)
+{
+    static struct tcp_conn_info conns[MEMP_NUM_TCP_PCB];
+    uint32_t srtt_max = 0U;
+    uint32_t rto_max = 0U;
+    uint32_t in_flight = 0U;
+    uint32_t rexmit_rto = 0U;
+    uint32_t rexmit_fast = 0U;
+    uint32_t snd_wnd_stalls = 0U;
+    uint32_t snd_buf_stalls = 0U;
+    uint32_t rcv_wnd_stalls = 0U;
+    uint16_t n = tcp_conn_snapshot(conns, MEMP_NUM_TCP_PCB);
+
+    for (uint16_t i = 0U; i < n; i++) {
+        const struct tcp_conn_info* c = &conns[i];
+
+        srtt_max = LWIP_MAX(srtt_max, c->srtt_ms);
+        rto_max = LWIP_MAX(rto_max, c->rto_ms);
+        in_flight += c->in_flight;
+        rexmit_rto += c->rexmit_rto;
+        rexmit_fast += c->rexmit_fast;
+        snd_wnd_stalls += c->snd_wnd_stalls;
+        snd_buf_stalls += c->snd_buf_stalls;
+        rcv_wnd_stalls += c->rcv_wnd_stalls;
+    }
+    metrics_emit(w, "lwip.tcp.conn.active", METRIC_GAUGE, n);
+    metrics_emit(w, "lwip.tcp.conn.srtt_max_ms", METRIC_GAUGE, srtt_max);
+    metrics_emit(w, "lwip.tcp.conn.rto_max_ms", METRIC_GAUGE, rto_max);
+    metrics_emit(w, "lwip.tcp.conn.in_flight", METRIC_GAUGE, in_flight);
+    metrics_emit(w, "lwip.tcp.conn.rexmit_rto", METRIC_GAUGE, rexmit_rto);
+    metrics_emit(w, "lwip.tcp.conn.rexmit_fast", METRIC_GAUGE, rexmit_fast);
+    metrics_emit(w, "lwip.tcp.conn.snd_wnd_stalls", METRIC_GAUGE, snd_wnd_stalls);
+    metrics_emit(w, "lwip.tcp.conn.snd_buf_stalls", METRIC_GAUGE, snd_buf_stalls);
+    metrics_emit(w, "lwip.tcp.conn.rcv_wnd_stalls", METRIC_GAUGE, rcv_wnd_stalls);
+}
+#endif
+
+#if LWIP_NETCONN && NETCONN_RX_COPY
+static void metrics_netconn_rx_copy(MetricsWriter_t* w)
+{
+    struct netconn_rx_copy_stats s;
+
+    netconn_rx_copy_get_stats(&s);
+    metrics_emit(w, "lwip.netconn.rx_copy.copied", METRIC_COUNTER, s.copied);
+    metrics_emit(w, "lwip.netconn.rx_copy.bytes", METRIC_COUNTER, s.bytes);
+    metrics_emit(w, "lwip.netconn.rx_copy.failed", METRIC_COUNTER, s.failed);
+    metrics_emit(w, "lwip.netconn.rx_copy.forced", METRIC_COUNTER, s.forced);
+    metrics_emit(w, "lwip.netconn.rx_copy.dropped", METRIC_COUNTER, s.dropped);
+}
+#endif
+
+#if LWIP_NETCONN && LWIP_SO_RCVBUF
+static void metrics_netconn_recvbuf(MetricsWriter_t* w)
+{
+    struct netconn_recvbuf_stats s;
+
+    netconn_recvbuf_get_stats(&s);
+    metrics_emit(w, "lwip.netconn.recvbuf.dropped", METRIC_COUNTER, s.dropped);
+    metrics_emit(w, "lwip.netconn.recvbuf.grown", METRIC_COUNTER, s.grown);
+    metrics_emit(w, "lwip.netconn.recvbuf.shrunk", METRIC_COUNTER, s.shrunk);
+}
+#endif
+
+#if ETHIF_CORE_LOCK_PROF
+static void metrics_core_lock(MetricsWriter_t* w)
+{
+    static EthIfCoreLockStatsTypeDef lock[ETHIF_CORE_LOCK_PROF_THREADS];
+    uint32_t n = ethernetif_core_lock_get(lock, ETHIF_CORE_LOCK_PROF_THREADS, NULL);
+    uint32_t mhz = SystemCoreClock / 1000000U;
+    char name[METRICS_NAME_MAX];
+
+    for (uint32_t i = 0; i < n; i++) {
+        const EthIfCoreLockStatsTypeDef* l = &lock[i];
+        snprintf(name, sizeof(name), "lock.%s.acquired", l->name);
+        metrics_emit(w, name, METRIC_COUNTER, l->acquired);
+        snprintf(name, sizeof(name), "lock.%s.contended", l->name);
+        metrics_emit(w, name, METRIC_COUNTER, l->contended);
+        snprintf(name, sizeof(name), "lock.%s.wait_us", l->name);
+        metrics_emit(w, name, METRIC_COUNTER, (uint32_t)(l->wait_cycles / mhz));
+        snprintf(name, sizeof(name), "lock.%s.wait_max_us", l->name);
+        metrics_emit(w, name, METRIC_GAUGE, l->wait_max_cycles / mhz);
+        snprintf(name, sizeof(name), "lock.%s.hold_us", l->name);
+        metrics_emit(w, name, METRIC_COUNTER, (uint32_t)(l->hold_cycles / mhz));
+        snprintf(name, sizeof(name), "lock.%s.hold_max_us", l->name);
+        metrics_emit(w, name, METRIC_GAUGE, l->hold_max_cycles / mhz);
+    }
+}
+#endif
+
+#if LWIP_TIMERS_CUSTOM && TWHEEL_LWIP
+static void metrics_timers(MetricsWriter_t* w)
+{
+    TWheelStats_t s;
+
+    twheel_get_stats(&s);
+    metrics_emit(w, "lwip.timers.used", METRIC_GAUGE, s.used);
+    metrics_emit(w, "lwip.timers.max", METRIC_GAUGE, s.max);
+    metrics_emit(w, "lwip.timers.fired", METRIC_COUNTER, s.fired);
+    metrics_emit(w, "lwip.timers.runs", METRIC_COUNTER, s.runs);
+    metrics_emit(w, "lwip.timers.cascades", METRIC_COUNTER, s.cascades);
+    metrics_emit(w, "lwip.timers.alloc_fail", METRIC_COUNTER, s.alloc_fail);
+}
+#endif
+
+static void metrics_logger(MetricsWriter_t* w)
+{
+    uint32_t sent = 0U;
+    uint32_t failed = 0U;
+
+    logger_get_stats(&sent, &failed);
+    metrics_emit(w, "log.sent", METRIC_COUNTER, sent);
+    metrics_emit(w, "log.failed", METRIC_COUNTER, failed);
+    metrics_emit(w, "log.dropped", METRIC_COUNTER, logger_get_dropped_count());
+    metrics_emit(w, "log.suppressed", METRIC_COUNTER, logger_get_suppressed_count());
+    for (const LogSink_t* k = log_sink_first(); k != NULL; k = k->next) {
+        char name[METRICS_NAME_MAX];
+
+        snprintf(name, sizeof(name), "log.sink.%s.level", k->name);
+        metrics_emit(w, name, METRIC_GAUGE, (uint32_t)k->level);
+        snprintf(name, sizeof(name), "log.sink.%s.written", k->name);
+        metrics_emit(w, name, METRIC_COUNTER, k->written);
+        snprintf(name, sizeof(name), "log.sink.%s.dropped", k->name);
+        metrics_emit(w, name, METRIC_COUNTER, k->dropped);
+        if (log_sink_has_lz4(k)) {
+            snprintf(name, sizeof(name), "log.sink.%s.lz4", k->name);
+            metrics_emit(w, name, METRIC_GAUGE, k->lz4 ? 1U : 0U);
+            snprintf(name, sizeof(name), "log.sink.%s.lz4_in", k->name);
+            metrics_emit(w, name, METRIC_COUNTER, k->lz4_in);
+            snprintf(name, sizeof(name), "log.sink.%s.lz4_out", k->name);
+            metrics_emit(w, name, METRIC_COUNTER, k->lz4_out);
+        }
+    }
+#if SYSLOG_TCP
+    LoggerTcpStats_t t;
+
+    logger_get_tcp_stats(&t);
+    metrics_emit(w, "log.tcp.up", METRIC_GAUGE, t.up ? 1U : 0U);
+    metrics_emit(w, "log.tcp.connects", METRIC_COUNTER, t.connects);
+    metrics_emit(w, "log.tcp.failures", METRIC_COUNTER, t.failures);
+    metrics_emit(w, "log.tcp.udp_fallback", METRIC_COUNTER, t.udp_fallback);
+#endif
+#if SYSLOG_ARCHIVE
+    LogStoreStats_t a;
+
+    log_store_get_stats(&a);
+    metrics_emit(w, "log.archive.appended", METRIC_COUNTER, a.appended);
+    metrics_emit(w, "log.archive.dropped", METRIC_COUNTER, a.dropped);
+    metrics_emit(w, "log.archive.replayed", METRIC_COUNTER, a.replayed);
+    metrics_emit(w, "log.archive.overwritten", METRIC_COUNTER, a.overwritten);
+    metrics_emit(w, "log.archive.errors", METRIC_COUNTER, a.errors);
+#endif
+#if SYSLOG_CONSOLE
+    ConsoleStats_t c;
+
+    console_get_stats(&c);
+    metrics_emit(w, "log.console.written", METRIC_COUNTER, c.written);
+    metrics_emit(w, "log.console.dropped", METRIC_COUNTER, c.dropped);
+    metrics_emit(w, "log.console.discarded", METRIC_COUNTER, c.discarded);
+#endif
+#if SYSLOG_CTL
+    LogCtlStats_t k;
+
+    log_ctl_get_stats(&k);
+    metrics_emit(w, "log.ctl.datagrams", METRIC_COUNTER, k.datagrams);
+    metrics_emit(w, "log.ctl.errors", METRIC_COUNTER, k.errors);
+    metrics_emit(w, "log.ctl.busy", METRIC_COUNTER, k.busy);
+    metrics_emit(w, "log.ctl.refused", METRIC_COUNTER, k.refused);
+#endif
+}
+
+#if QSPI_FLASH
+static void metrics_qspi(MetricsWriter_t* w)
+{
+    QspiFlashStats_t q;
+
+    qspi_flash_get_stats(&q);
+    metrics_emit(w, "qspi.size", METRIC_GAUGE, qspi_flash_size());
+    metrics_emit(w, "qspi.erases", METRIC_COUNTER, q.erases);
+    metrics_emit(w, "qspi.programs", METRIC_COUNTER, q.programs);
+    metrics_emit(w, "qspi.bytes", METRIC_COUNTER, q.bytes);
+    metrics_emit(w, "qspi.errors", METRIC_COUNTER, q.errors);
+    metrics_emit(w, "qspi.map_refused", METRIC_COUNTER, q.map_refused);
+}
+#endif
+
+#if TIMESYNC
+/* Signed values as two's complement gauges */
+static void metrics_time(MetricsWriter_t* w)
+{
+    TimesyncStats_t t;
+    SntpClientStats_t s;
+
+    timesync_get_stats(&t);
+    sntp_client_get_stats(&s);
+    metrics_emit(w, "time.synced", METRIC_GAUGE, t.synced ? 1U : 0U);
+    metrics_emit(w, "time.offset_us", METRIC_GAUGE, (uint32_t)t.offset_us);
+    metrics_emit(w, "time.delay_us", METRIC_GAUGE, t.delay_us);
+    metrics_emit(w, "time.freq_ppb", METRIC_GAUGE, (uint32_t)t.freq_ppb);
+    metrics_emit(w, "time.steps", METRIC_COUNTER, t.steps);
+    metrics_emit(w, "time.rejected", METRIC_COUNTER, t.rejected);
+    metrics_emit(w, "time.rtc.err_us", METRIC_GAUGE, (uint32_t)t.rtc_err_us);
+    metrics_emit(w, "time.rtc.cal_ppm", METRIC_GAUGE, (uint32_t)t.rtc_cal_ppm);
+    metrics_emit(w, "time.sntp.requests", METRIC_COUNTER, s.requests);
+    metrics_emit(w, "time.sntp.replies", METRIC_COUNTER, s.replies);
+    metrics_emit(w, "time.sntp.timeouts", METRIC_COUNTER, s.timeouts);
+    metrics_emit(w, "time.sntp.bad", METRIC_COUNTER, s.bad + s.kod + s.dns_fail);
+}
+#endif
+
+static void metrics_dns(MetricsWriter_t* w)
+{
+    ResolvStats_t r;
+
+    resolv_get_stats(&r);
+    metrics_emit(w, "dns.queries", METRIC_COUNTER, r.queries);
+    metrics_emit(w, "dns.answers", METRIC_COUNTER, r.answers);
+    metrics_emit(w, "dns.fails", METRIC_COUNTER, r.fails);
+    metrics_emit(w, "dns.changes", METRIC_COUNTER, r.changes);
+}
+
+#if DHCP_CLIENT
+static void metrics_dhcp(MetricsWriter_t* w)
+{
+    DhcpClientStats_t d;
+
+    dhcp_client_get_stats(&d);
+    metrics_emit(w, "dhcp.bound", METRIC_GAUGE, d.bound ? 1U : 0U);
+    metrics_emit(w, "dhcp.binds", METRIC_COUNTER, d.binds);
+    metrics_emit(w, "dhcp.naks", METRIC_COUNTER, d.naks);
+    metrics_emit(w, "dhcp.reused", METRIC_COUNTER, d.reused);
+    metrics_emit(w, "dhcp.reboots", METRIC_COUNTER, d.reboots);
+    if (d.addressed) {
+        metrics_emit(w, "dhcp.addr_ms", METRIC_GAUGE, d.addr_ms);
+    }
+    if (d.binds != 0U) {
+        metrics_emit(w, "dhcp.bind_ms", METRIC_GAUGE, d.bind_ms);
+    }
+}
+#endif
+
+static void metrics_rtos(MetricsWriter_t* w)
+{
+    metrics_emit(w, "rtos.heap.free", METRIC_GAUGE, (uint32_t)xPortGetFreeHeapSize());
+    metrics_emit(w, "rtos.heap.min_free", METRIC_GAUGE, (uint32_t)xPortGetMinimumEverFreeHeapSize());
+}
+
+void metrics_sources_register(void)
+{
+    (void)metrics_register_collector(metrics_eth);
+#if LWIP_STATS
+    (void)metrics_register_collector(metrics_lwip);
+#endif
+#if LWIP_TCP && TCP_OOSEQ_GOVERN
+    (void)metrics_register_collector(metrics_tcp_ooseq);
+#endif
+#if LWIP_TCP && TCP_SND_AUTOTUNE
+    (void)metrics_register_collector(metrics_tcp_snd_tune);
+#endif
+#if TCP_CONN_STATS
+    (void)metrics_register_collector(metrics_tcp_conns);
+#endif
+#if LWIP_NETCONN && NETCONN_RX_COPY
+    (void)metrics_register_collector(metrics_netconn_rx_copy);
+#endif
+#if LWIP_NETCONN && LWIP_SO_RCVBUF
+    (void)metrics_register_collector(metrics_netconn_recvbuf);
+#endif
+#if ETHIF_CORE_LOCK_PROF
+    (void)metrics_register_collector(metrics_core_lock);
+#endif
+#if LWIP_TIMERS_CUSTOM && TWHEEL_LWIP
+    (void)metrics_register_collector(metrics_timers);
+#endif
+#if TIMESYNC
+    (void)metrics_register_collector(metrics_time);
+#endif
+    (void)metrics_register_collector(metrics_dns);
+#if DHCP_CLIENT
+    (void)metrics_register_collector(metrics_dhcp);
+#endif
+    (void)metrics_register_collector(metrics_logger);
+#if QSPI_FLASH
+    (void)metrics_register_collector(metrics_qspi);
+#endif
+    (void)metrics_register_collector(metrics_rtos);
+}
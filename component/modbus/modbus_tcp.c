@@ -0,0 +1,704 @@
+/**
+ * @file modbus_tcp.c
+ * @brief Modbus/TCP server on the raw TCP API, see modbus_tcp.h.
+ */
+
+#include "modbus_tcp.h"
+
+#if MODBUS_TCP
+
+#include "metrics/metrics.h"
+#include "workpool/work_pool.h"
+
+#include "main.h"
+#include "lwip/tcpip.h"
+#include "lwip/tcp.h"
+#include "lwip/pbuf.h"
+
+#include <string.h>
+
+#if !LWIP_TCP_TXREF
+#error "modbus_tcp needs LWIP_TCP_TXREF"
+#endif
+
+#define MODBUS_TAG              "MODBUS"
+#define MODBUS_MBAP_LEN         7U
+#define MODBUS_PDU_MAX          253U
+#define MODBUS_ADU_MAX          (MODBUS_MBAP_LEN + MODBUS_PDU_MAX)
+/* tcp_poll() every second */
+#define MODBUS_POLL_INTERVAL    2U
+
+#define MODBUS_EXC_FUNCTION     0x01U
+#define MODBUS_EXC_ADDRESS      0x02U
+#define MODBUS_EXC_VALUE        0x03U
+
+#define MODBUS_WRITE_ASYNC      (MODBUS_TCP_WRITE_WORKER && WORK_POOL)
+
+typedef struct ModbusConn_s ModbusConn_t;
+
+typedef struct ModbusSlot_s {
+    struct tcp_txref ref;       /* first: the done callback gets it */
+    struct ModbusSlot_s* next;  /* free list */
+    ModbusConn_t* conn;
+    uint32_t gen;               /* of conn when taken */
+    uint16_t len;
+    uint8_t buf[MODBUS_ADU_MAX];
+} ModbusSlot_t;
+
+struct ModbusConn_s {
+    struct tcp_pcb* pcb;
+    struct pbuf* rx;            /* unanswered data, starts at an ADU */
+    ModbusSlot_t* unsent;       /* answered, not yet taken by tcp_write_ref() */
+    uint32_t gen;               /* +1 per connection using this entry */
+    uint8_t inflight;           /* slots taken */
+    uint8_t idle;               /* polls without a request */
+    uint8_t adu[MODBUS_ADU_MAX];  /* an ADU split across pbufs */
+};
+
+/* tcpip thread, or core lock held */
+static const ModbusMap_t* modbus_map;
+static ModbusConn_t modbus_conns[MODBUS_TCP_CONNS];
+static ModbusSlot_t modbus_slots[MODBUS_TCP_TX_SLOTS];
+static ModbusSlot_t* modbus_free;
+static struct tcpip_callback_msg* modbus_resume_msg;
+static bool modbus_resume_pending;
+
+static ModbusMap_t modbus_scratch_map;
+static uint16_t modbus_scratch_regs[MODBUS_TCP_SCRATCH];
+static uint8_t modbus_scratch_bits[(MODBUS_TCP_SCRATCH + 7U) / 8U];
+
+static Metric_t modbus_requests = METRIC_COUNTER_INIT("modbus.requests");
+static Metric_t modbus_exceptions = METRIC_COUNTER_INIT("modbus.exceptions");
+static Metric_t modbus_errors = METRIC_COUNTER_INIT("modbus.errors");
+static Metric_t modbus_waits = METRIC_COUNTER_INIT("modbus.waits");
+static Metric_t modbus_refused = METRIC_COUNTER_INIT("modbus.refused");
+static Metric_t modbus_conns_open = METRIC_GAUGE_INIT("modbus.conns");
+static Metric_t modbus_snap_retries = METRIC_COUNTER_INIT("modbus.snap_retries");
+static Metric_t modbus_write_inline = METRIC_COUNTER_INIT("modbus.write_inline");
+
+#if MODBUS_WRITE_ASYNC
+/* Written ranges of the coils and the holding registers, [lo, hi) */
+typedef struct {
+    uint32_t lo;
+    uint32_t hi;
+} ModbusRange_t;
+
+static void modbus_write_run(WorkJob_t* job);
+static void modbus_write_done(WorkJob_t* job);
+
+/* tcpip thread: written since the job was submitted; the job's own
+ * ranges are the worker's until it is done */
+static ModbusRange_t modbus_dirty[2];
+static ModbusRange_t modbus_writing[2];
+static WorkJob_t modbus_write_job = WORK_JOB_INIT(modbus_write_run, modbus_write_done, NULL);
+#endif
+
+sys_prot_t modbus_map_lock(void)
+{
+    return sys_arch_protect();
+}
+
+void modbus_map_unlock(sys_prot_t lev)
+{
+    sys_arch_unprotect(lev);
+}
+
+static uint16_t modbus_get16(const uint8_t* p)
+{
+    return (uint16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+static void modbus_put16(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+/* n bits of src from bit pos on, to dst from bit 0; a byte at a time */
+static void modbus_bits_get(uint8_t* dst, const uint8_t* src, uint32_t pos, uint32_t n)
+{
+    const uint8_t* s = &src[pos >> 3];
+    uint32_t sh = pos & 7U;
+    uint32_t bytes = (n + 7U) >> 3;
+
+    for (uint32_t i = 0U; i < bytes; i++) {
+        uint32_t v = (uint32_t)s[i] >> sh;
+        /* The next source byte only if bits of it are asked for */
+        if (sh != 0U && (i * 8U + 8U - sh) < n) {
+            v |= (uint32_t)s[i + 1U] << (8U - sh);
+        }
+        dst[i] = (uint8_t)v;
+    }
+    if ((n & 7U) != 0U) {
+        dst[bytes - 1U] &= (uint8_t)((1U << (n & 7U)) - 1U);
+    }
+}
+
+/* n bits of src from bit 0 on, to dst from bit pos on */
+static void modbus_bits_set(uint8_t* dst, uint32_t pos, const uint8_t* src, uint32_t n)
+{
+    uint32_t i = 0U;
+
+    while (i < n) {
+        uint32_t bit = pos + i;
+        uint32_t sh = bit & 7U;
+        uint32_t take = 8U - sh;
+        uint32_t v = (uint32_t)src[i >> 3] >> (i & 7U);
+        uint32_t mask;
+
+        if (take > n - i) {
+            take = n - i;
+        }
+        if ((i & 7U) != 0U && (8U - (i & 7U)) < take) {
+            v |= (uint32_t)src[(i >> 3) + 1U] << (8U - (i & 7U));
+        }
+        mask = (1U << take) - 1U;
+        dst[bit >> 3] = (uint8_t)((dst[bit >> 3] & ~(mask << sh)) | ((v & mask) << sh));
+        i += take;
+    }
+}
+
+#if MODBUS_WRITE_ASYNC
+static void modbus_write_run(WorkJob_t* job)
+{
+    const ModbusMap_t* m = modbus_map;
+
+    LWIP_UNUSED_ARG(job);
+    for (uint32_t i = 0U; i < 2U; i++) {
+        if (modbus_writing[i].hi != 0U) {
+            m->on_write((i == 0U) ? MODBUS_AREA_COILS : MODBUS_AREA_HOLDING, (uint16_t)modbus_writing[i].lo,
+                        (uint16_t)(modbus_writing[i].hi - modbus_writing[i].lo), m->arg);
+        }
+    }
+}
+
+/* The ranges written so far to the worker */
+static void modbus_write_start(void)
+{
+    memcpy(modbus_writing, modbus_dirty, sizeof(modbus_writing));
+    memset(modbus_dirty, 0, sizeof(modbus_dirty));
+    if (!work_submit(&modbus_write_job, WORK_PRIO_HIGH)) {
+        metric_inc(&modbus_write_inline);
+        modbus_write_run(&modbus_write_job);
+    }
+}
+
+/* tcpip thread: writes that came in meanwhile go next */
+static void modbus_write_done(WorkJob_t* job)
+{
+    LWIP_UNUSED_ARG(job);
+    if (modbus_dirty[0].hi != 0U || modbus_dirty[1].hi != 0U) {
+        modbus_write_start();
+    }
+}
+#endif
+
+static void modbus_notify(ModbusArea_t area, uint16_t addr, uint16_t count)
+{
+    const ModbusMap_t* m = modbus_map;
+
+    if (m->on_write == NULL) {
+        return;
+    }
+#if MODBUS_WRITE_ASYNC
+    ModbusRange_t* d = &modbus_dirty[(area == MODBUS_AREA_HOLDING) ? 1U : 0U];
+
+    if (d->hi == 0U) {
+        d->lo = addr;
+        d->hi = (uint32_t)addr + count;
+    } else {
+        d->lo = (addr < d->lo) ? addr : d->lo;
+        d->hi = ((uint32_t)addr + count > d->hi) ? (uint32_t)addr + count : d->hi;
+    }
+    if (!modbus_write_job.busy) {
+        modbus_write_start();
+    }
+#else
+    metric_inc(&modbus_write_inline);
+    m->on_write(area, addr, count, m->arg);
+#endif
+}
+
+static uint16_t modbus_exception(uint8_t* rsp, uint8_t fc, uint8_t code)
+{
+    metric_inc(&modbus_exceptions);
+    rsp[0] = (uint8_t)(fc | 0x80U);
+    rsp[1] = code;
+    return 2U;
+}
+
+/* Answers the request PDU req (len bytes) into rsp, returns the response
+ * PDU length */
+static uint16_t modbus_pdu(const uint8_t* req, uint16_t len, uint8_t* rsp)
+{
+    const ModbusMap_t* m = modbus_map;
+    uint8_t fc = req[0];
+    uint16_t addr = (len >= 3U) ? modbus_get16(&req[1]) : 0U;
+    uint16_t qty = (len >= 5U) ? modbus_get16(&req[3]) : 0U;
+    uint16_t changed = 0U;
+    ModbusArea_t area = MODBUS_AREA_COILS;
+    uint16_t rlen;
+    sys_prot_t lev;
+
+    switch (fc) {
+    case 0x01U:     /* read coils */
+    case 0x02U: {   /* read discrete inputs */
+        const uint8_t* bits = (fc == 0x01U) ? m->coils : m->discrete;
+        uint16_t count = (fc == 0x01U) ? m->coil_count : m->discrete_count;
+
+        if (len != 5U || qty == 0U || qty > 2000U) {
+            return modbus_exception(rsp, fc, MODBUS_EXC_VALUE);
+        }
+        if ((uint32_t)addr + qty > count) {
+            return modbus_exception(rsp, fc, MODBUS_EXC_ADDRESS);
+        }
+        rsp[0] = fc;
+        rsp[1] = (uint8_t)((qty + 7U) / 8U);
+        if (fc == 0x02U && m->inputs != NULL) {
+            uint32_t v;
+
+            for (;;) {
+                v = seqsnap_read_begin(m->inputs);
+                modbus_bits_get(&rsp[2], seqsnap_at(m->inputs, v, bits), addr, qty);
+                if (!seqsnap_read_retry(m->inputs, v)) {
+                    break;
+                }
+                metric_inc(&modbus_snap_retries);
+            }
+            return (uint16_t)(2U + rsp[1]);
+        }
+        lev = sys_arch_protect();
+        modbus_bits_get(&rsp[2], bits, addr, qty);
+        sys_arch_unprotect(lev);
+        return (uint16_t)(2U + rsp[1]);
+    }
+    case 0x03U:     /* read holding registers */
+    case 0x04U: {   /* read input registers */
+        const uint16_t* regs = (fc == 0x03U) ? m->holding : m->input;
+        uint16_t count = (fc == 0x03U) ? m->holding_count : m->input_count;
+
+        if (len != 5U || qty == 0U || qty > 125U) {
+            return modbus_exception(rsp, fc, MODBUS_EXC_VALUE);
+        }
+        if ((uint32_t)addr + qty > count) {
+            return modbus_exception(rsp, fc, MODBUS_EXC_ADDRESS);
+        }
+        rsp[0] = fc;
+        rsp[1] = (uint8_t)(qty * 2U);
+        if (fc == 0x04U && m->inputs != NULL) {
+            uint32_t v;
+
+            for (;;) {
+                v = seqsnap_read_begin(m->inputs);
+                regs = seqsnap_at(m->inputs, v, m->input);
+                for (uint32_t i = 0U; i < qty; i++) {
+                    modbus_put16(&rsp[2U + 2U * i], regs[addr + i]);
+                }
+                if (!seqsnap_read_retry(m->inputs, v)) {
+                    break;
+                }
+                metric_inc(&modbus_snap_retries);
+            }
+            return (uint16_t)(2U + rsp[1]);
+        }
+        lev = sys_arch_protect();
+        for (uint32_t i = 0U; i < qty; i++) {
+            modbus_put16(&rsp[2U + 2U * i], regs[addr + i]);
+        }
+        sys_arch_unprotect(lev);
+        return (uint16_t)(2U + rsp[1]);
+    }
+    case 0x05U:     /* write single coil */
+        if (len != 5U || (qty != 0xFF00U && qty != 0x0000U)) {
+            return modbus_exception(rsp, fc, MODBUS_EXC_VALUE);
+        }
+        if (addr >= m->coil_count) {
+            return modbus_exception(rsp, fc, MODBUS_EXC_ADDRESS);
+        }
+        lev = sys_arch_protect();
+        if (qty != 0U) {
+            m->coils[addr >> 3] |= (uint8_t)(1U << (addr & 7U));
+        } else {
+            m->coils[addr >> 3] &= (uint8_t)~(1U << (addr & 7U));
+        }
+        sys_arch_unprotect(lev);
+        memcpy(rsp, req, 5U);
+        rlen = 5U;
+        changed = 1U;
+        break;
+    case 0x06U:     /* write single register */
+        if (len != 5U) {
+            return modbus_exception(rsp, fc, MODBUS_EXC_VALUE);
+        }
+        if (addr >= m->holding_count) {
+            return modbus_exception(rsp, fc, MODBUS_EXC_ADDRESS);
+        }
+        m->holding[addr] = qty;
+        memcpy(rsp, req, 5U);
+        rlen = 5U;
+        changed = 1U;
+        area = MODBUS_AREA_HOLDING;
+        break;
+    case 0x0FU:     /* write multiple coils */
+        if (len < 6U || qty == 0U || qty > 1968U || req[5] != (qty + 7U) / 8U || len != 6U + req[5]) {
+            return modbus_exception(rsp, fc, MODBUS_EXC_VALUE);
+        }
+        if ((uint32_t)addr + qty > m->coil_count) {
+            return modbus_exception(rsp, fc, MODBUS_EXC_ADDRESS);
+        }
+        lev = sys_arch_protect();
+        modbus_bits_set(m->coils, addr, &req[6], qty);
+        sys_arch_unprotect(lev);
+        memcpy(rsp, req, 5U);
+        rlen = 5U;
+        changed = qty;
+        break;
+    case 0x10U:     /* write multiple registers */
+        if (len < 6U || qty == 0U || qty > 123U || req[5] != qty * 2U || len != 6U + req[5]) {
+            return modbus_exception(rsp, fc, MODBUS_EXC_VALUE);
+        }
+        if ((uint32_t)addr + qty > m->holding_count) {
+            return modbus_exception(rsp, fc, MODBUS_EXC_ADDRESS);
+        }
+        lev = sys_arch_protect();
+        for (uint32_t i = 0U; i < qty; i++) {
+            m->holding[addr + i] = modbus_get16(&req[6U + 2U * i]);
+        }
+        sys_arch_unprotect(lev);
+        memcpy(rsp, req, 5U);
+        rlen = 5U;
+        changed = qty;
+        area = MODBUS_AREA_HOLDING;
+        break;
+    default:
+        return modbus_exception(rsp, fc, MODBUS_EXC_FUNCTION);
+    }
+    modbus_notify(area, addr, changed);
+    return rlen;
+}
+
+static void modbus_schedule_resume(void)
+{
+    if (!modbus_resume_pending && modbus_resume_msg != NULL) {
+        modbus_resume_pending = true;
+        if (tcpip_callbackmsg_trycallback(modbus_resume_msg) != ERR_OK) {
+            modbus_resume_pending = false;
+        }
+    }
+}
+
+/* tcp_txref_fn: the response is acknowledged and out of the driver, or
+ * dropped with its pcb */
+static void modbus_slot_done(struct tcp_txref* ref)
+{
+    ModbusSlot_t* s = (ModbusSlot_t*)ref;
+
+    if (s->conn->gen == s->gen) {
+        s->conn->inflight--;
+    }
+    s->next = modbus_free;
+    modbus_free = s;
+    /* Connections may be waiting for it */
+    modbus_schedule_resume();
+}
+
+static ModbusSlot_t* modbus_slot_take(ModbusConn_t* c)
+{
+    ModbusSlot_t* s = modbus_free;
+
+    if (s == NULL || c->inflight >= MODBUS_TCP_CONN_SLOTS) {
+        return NULL;
+    }
+    modbus_free = s->next;
+    s->conn = c;
+    s->gen = c->gen;
+    c->inflight++;
+    tcp_txref_init(&s->ref, modbus_slot_done, NULL);
+    return s;
+}
+
+/* Queues a built response by reference; false while the send buffer is
+ * full, the sent callback retries */
+static bool modbus_send(ModbusConn_t* c, ModbusSlot_t* s)
+{
+    if (tcp_write_ref(c->pcb, s->buf, s->len, 0U, &s->ref) != ERR_OK) {
+        return false;
+    }
+    /* The pbufs hold the slot from here */
+    tcp_txref_release(&s->ref);
+    return true;
+}
+
+static void modbus_release(ModbusConn_t* c)
+{
+    if (c->rx != NULL) {
+        pbuf_free(c->rx);
+        c->rx = NULL;
+    }
+    if (c->unsent != NULL) {
+        ModbusSlot_t* s = c->unsent;
+        c->unsent = NULL;
+        tcp_txref_release(&s->ref);
+    }
+    if (c->pcb != NULL) {
+        c->pcb = NULL;
+        metric_add(&modbus_conns_open, (uint32_t)-1);
+    }
+}
+
+/* ERR_ABRT when the pcb had to be aborted, for the callback to return */
+static err_t modbus_close(ModbusConn_t* c)
+{
+    struct tcp_pcb* pcb = c->pcb;
+
+    modbus_release(c);
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_sent(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+    tcp_err(pcb, NULL);
+    if (tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    return ERR_OK;
+}
+
+/* Answers the complete requests received, up to MODBUS_TCP_BURST, as far
+ * as response slots and the send buffer allow */
+static err_t modbus_process(ModbusConn_t* c)
+{
+    uint32_t n = 0U;
+
+    if (c->unsent != NULL) {
+        if (!modbus_send(c, c->unsent)) {
+            return ERR_OK;
+        }
+        c->unsent = NULL;
+    }
+    while (c->rx != NULL && n < MODBUS_TCP_BURST) {
+        uint8_t mbap[MODBUS_MBAP_LEN];
+        const uint8_t* h;
+        const uint8_t* adu;
+        ModbusSlot_t* s;
+        uint16_t len;
+        uint16_t rlen;
+
+        if (c->rx->tot_len < MODBUS_MBAP_LEN) {
+            break;
+        }
+        h = pbuf_get_contiguous(c->rx, mbap, sizeof(mbap), MODBUS_MBAP_LEN, 0U);
+        len = modbus_get16(&h[4]);
+        if (modbus_get16(&h[2]) != 0U || len < 2U || len > MODBUS_PDU_MAX + 1U) {
+            /* Not Modbus, or out of step: nothing to resynchronise on */
+            metric_inc(&modbus_errors);
+            return modbus_close(c);
+        }
+        if (c->rx->tot_len < 6U + len) {
+            break;
+        }
+        s = modbus_slot_take(c);
+        if (s == NULL) {
+            metric_inc(&modbus_waits);
+            break;
+        }
+        adu = pbuf_get_contiguous(c->rx, c->adu, sizeof(c->adu), (u16_t)(6U + len), 0U);
+        metric_inc(&modbus_requests);
+        rlen = modbus_pdu(&adu[MODBUS_MBAP_LEN], (uint16_t)(len - 1U), &s->buf[MODBUS_MBAP_LEN]);
+        /* Transaction and unit identifiers echoed */
+        memcpy(s->buf, adu, 4U);
+        modbus_put16(&s->buf[4], (uint16_t)(rlen + 1U));
+        s->buf[6] = adu[6];
+        s->len = (uint16_t)(MODBUS_MBAP_LEN + rlen);
+
+        c->rx = pbuf_free_header(c->rx, (u16_t)(6U + len));
+        tcp_recved(c->pcb, (u16_t)(6U + len));
+        c->idle = 0U;
+        n++;
+        if (!modbus_send(c, s)) {
+            c->unsent = s;
+            break;
+        }
+    }
+    tcp_output(c->pcb);
+    if (n == MODBUS_TCP_BURST && c->rx != NULL) {
+        /* The rest after the other connections */
+        modbus_schedule_resume();
+    }
+    return ERR_OK;
+}
+
+/* tcpip callback: picks up connections that waited for a slot or their
+ * turn */
+static void modbus_resume(void* arg)
+{
+    LWIP_UNUSED_ARG(arg);
+    modbus_resume_pending = false;
+    for (uint32_t i = 0U; i < MODBUS_TCP_CONNS; i++) {
+        ModbusConn_t* c = &modbus_conns[i];
+        if (c->pcb != NULL && (c->rx != NULL || c->unsent != NULL)) {
+            (void)modbus_process(c);
+        }
+    }
+}
+
+static err_t modbus_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    ModbusConn_t* c = arg;
+
+    LWIP_UNUSED_ARG(pcb);
+    if (p == NULL || err != ERR_OK) {
+        if (p != NULL) {
+            pbuf_free(p);
+        }
+        return modbus_close(c);
+    }
+    if (c->rx == NULL) {
+        c->rx = p;
+    } else {
+        pbuf_cat(c->rx, p);
+    }
+    return modbus_process(c);
+}
+
+static err_t modbus_sent(void* arg, struct tcp_pcb* pcb, u16_t len)
+{
+    ModbusConn_t* c = arg;
+
+    LWIP_UNUSED_ARG(pcb);
+    LWIP_UNUSED_ARG(len);
+    if (c->rx != NULL || c->unsent != NULL) {
+        return modbus_process(c);
+    }
+    return ERR_OK;
+}
+
+static err_t modbus_poll(void* arg, struct tcp_pcb* pcb)
+{
+    ModbusConn_t* c = arg;
+
+    if (++c->idle >= MODBUS_TCP_IDLE_S) {
+        modbus_release(c);
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    if (c->rx != NULL || c->unsent != NULL) {
+        return modbus_process(c);
+    }
+    return ERR_OK;
+}
+
+static void modbus_err(void* arg, err_t err)
+{
+    ModbusConn_t* c = arg;
+
+    LWIP_UNUSED_ARG(err);
+    /* The pcb is gone; its queued responses were released with it */
+    modbus_release(c);
+}
+
+static err_t modbus_accept(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+    ModbusConn_t* c = NULL;
+
+    LWIP_UNUSED_ARG(arg);
+    if (err != ERR_OK || pcb == NULL) {
+        return ERR_VAL;
+    }
+    for (uint32_t i = 0U; i < MODBUS_TCP_CONNS; i++) {
+        if (modbus_conns[i].pcb == NULL) {
+            c = &modbus_conns[i];
+            break;
+        }
+    }
+    if (c == NULL) {
+        metric_inc(&modbus_refused);
+        return ERR_MEM;
+    }
+    c->pcb = pcb;
+    c->rx = NULL;
+    c->unsent = NULL;
+    c->gen++;
+    c->inflight = 0U;
+    c->idle = 0U;
+    metric_inc(&modbus_conns_open);
+    pcb->tos = MODBUS_TCP_TOS;
+    tcp_nagle_disable(pcb);
+    tcp_arg(pcb, c);
+    tcp_recv(pcb, modbus_recv);
+    tcp_sent(pcb, modbus_sent);
+    tcp_poll(pcb, modbus_poll, MODBUS_POLL_INTERVAL);
+    tcp_err(pcb, modbus_err);
+    return ERR_OK;
+}
+
+/* Whether len bytes at p lie in copy 0 of the snapshot */
+static bool modbus_in_snap(const SeqSnap_t* snap, const void* p, uint32_t len)
+{
+    uintptr_t a = (uintptr_t)p;
+    uintptr_t base = (uintptr_t)snap->copy[0];
+
+    return len == 0U || (a >= base && a - base + len <= snap->size);
+}
+
+bool modbus_tcp_start(const ModbusMap_t* map)
+{
+    struct tcp_pcb* pcb;
+    struct tcp_pcb* lpcb = NULL;
+
+    if (map == NULL) {
+        modbus_scratch_map.coils = modbus_scratch_bits;
+        modbus_scratch_map.coil_count = MODBUS_TCP_SCRATCH;
+        modbus_scratch_map.discrete = modbus_scratch_bits;
+        modbus_scratch_map.discrete_count = MODBUS_TCP_SCRATCH;
+        modbus_scratch_map.holding = modbus_scratch_regs;
+        modbus_scratch_map.holding_count = MODBUS_TCP_SCRATCH;
+        modbus_scratch_map.input = modbus_scratch_regs;
+        modbus_scratch_map.input_count = MODBUS_TCP_SCRATCH;
+        map = &modbus_scratch_map;
+    }
+    if (map->inputs != NULL &&
+        (!modbus_in_snap(map->inputs, map->input, map->input_count * 2U) ||
+         !modbus_in_snap(map->inputs, map->discrete, (map->discrete_count + 7U) / 8U))) {
+        LOG_ERROR(MODBUS_TAG, "input areas outside the snapshot");
+        return false;
+    }
+    modbus_map = map;
+
+    (void)metrics_register(&modbus_requests);
+    (void)metrics_register(&modbus_exceptions);
+    (void)metrics_register(&modbus_errors);
+    (void)metrics_register(&modbus_waits);
+    (void)metrics_register(&modbus_refused);
+    (void)metrics_register(&modbus_conns_open);
+    (void)metrics_register(&modbus_snap_retries);
+    (void)metrics_register(&modbus_write_inline);
+
+    LOCK_TCPIP_CORE();
+    for (uint32_t i = 0U; i < MODBUS_TCP_TX_SLOTS; i++) {
+        modbus_slots[i].next = modbus_free;
+        modbus_free = &modbus_slots[i];
+    }
+    modbus_resume_msg = tcpip_callbackmsg_new(modbus_resume, NULL);
+    pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (pcb != NULL && modbus_resume_msg != NULL) {
+        if (tcp_bind(pcb, IP_ANY_TYPE, MODBUS_TCP_PORT) == ERR_OK) {
+            lpcb = tcp_listen_with_backlog(pcb, MODBUS_TCP_CONNS);
+        }
+        if (lpcb == NULL) {
+            tcp_close(pcb);
+        } else {
+            tcp_accept(lpcb, modbus_accept);
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+    if (lpcb == NULL) {
+        LOG_ERROR(MODBUS_TAG, "no listener on port %u", (unsigned)MODBUS_TCP_PORT);
+        return false;
+    }
+    LOG_INFO(MODBUS_TAG, "listening on port %u, %u connections", (unsigned)MODBUS_TCP_PORT,
+             (unsigned)MODBUS_TCP_CONNS);
+    return true;
+}
+
+#endif /* MODBUS_TCP */
@@ -0,0 +1,150 @@
+/**
+ * @file modbus_tcp.h
+ * @brief Modbus/TCP server on the raw TCP API, answering from a register
+ *        table in memory.
+ *
+ * Up to MODBUS_TCP_CONNS masters at once, each may pipeline requests.
+ * Requests are parsed where they lie in the received pbufs; only an ADU
+ * split across two pbufs is gathered into a per-connection buffer first
+ * (pbuf_get_contiguous()). The data stays in lwIP until it is answered,
+ * and tcp_recved() follows the answers, so a master sending faster than it
+ * reads its responses closes its own receive window.
+ *
+ * Responses are built into MODBUS_TCP_TX_SLOTS preallocated buffers and
+ * sent by reference (tcp_write_ref()); a buffer returns to the pool once
+ * the master has acknowledged it and the driver is done with it. A master
+ * holds at most MODBUS_TCP_CONN_SLOTS of them, so a slow one cannot starve
+ * the others. Per request the work is one pass over at most 250 bytes of
+ * register data, and one call handles at most MODBUS_TCP_BURST requests
+ * of a connection before the others get their turn.
+ *
+ * The table (ModbusMap_t) is the application's memory, registers in host
+ * byte order, coils and discrete inputs packed eight to a byte, LSB first.
+ * A request reads or writes it with interrupts masked (SYS_ARCH_PROTECT),
+ * so the values of one response are a snapshot, and a multiple write is
+ * seen whole or not at all. Application updates that must be seen
+ * together go between modbus_map_lock() and modbus_map_unlock(); single
+ * aligned registers need no lock. The read-only areas may instead live in
+ * a snapshot the application publishes (ModbusMap_t.inputs, a SeqSnap_t
+ * of seqlock/seqlock.h): the control task then updates them without
+ * masking anything or waiting, and a read request copies from the current
+ * copy and builds its response again if a publication overtook it.
+ *
+ * Function codes 1 to 6, 15 and 16. Any unit identifier is answered.
+ * Exported through metrics as "modbus.*". tools/modbus_load.py drives it.
+ */
+
+#pragma once
+
+#ifndef MODBUS_TCP_H
+#define MODBUS_TCP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lwip/sys.h"
+#include "seqlock/seqlock.h"
+
+/* 0 leaves the server out of the startup code */
+#ifndef MODBUS_TCP
+#define MODBUS_TCP 1
+#endif
+
+#ifndef MODBUS_TCP_PORT
+#define MODBUS_TCP_PORT 502U
+#endif
+
+/* Masters served at once; more are refused */
+#ifndef MODBUS_TCP_CONNS
+#define MODBUS_TCP_CONNS 8U
+#endif
+
+/* Response buffers shared by all connections */
+#ifndef MODBUS_TCP_TX_SLOTS
+#define MODBUS_TCP_TX_SLOTS 32U
+#endif
+
+/* Of those, the most one connection holds: its pipelining depth */
+#ifndef MODBUS_TCP_CONN_SLOTS
+#define MODBUS_TCP_CONN_SLOTS 8U
+#endif
+
+/* Requests of one connection handled per call */
+#ifndef MODBUS_TCP_BURST
+#define MODBUS_TCP_BURST 8U
+#endif
+
+/* A connection without a request for this long is closed */
+#ifndef MODBUS_TCP_IDLE_S
+#define MODBUS_TCP_IDLE_S 60U
+#endif
+
+/* Registers of each kind in the table served without an application map */
+#ifndef MODBUS_TCP_SCRATCH
+#define MODBUS_TCP_SCRATCH 256U
+#endif
+
+/* The application's write callback (ModbusMap_t.on_write) off the tcpip
+ * thread, through the work pool (workpool/work_pool.h); 0, or the pool
+ * refusing, calls it inline */
+#ifndef MODBUS_TCP_WRITE_WORKER
+#define MODBUS_TCP_WRITE_WORKER 1
+#endif
+
+/* DSCP AF31: the telemetry class of the ETH TX scheduler (ETHIF_TX_SCHED) */
+#ifndef MODBUS_TCP_TOS
+#define MODBUS_TCP_TOS 0x68U
+#endif
+
+typedef enum {
+    MODBUS_AREA_COILS = 0,      /* read/write bits */
+    MODBUS_AREA_DISCRETE,       /* read-only bits */
+    MODBUS_AREA_HOLDING,        /* read/write registers */
+    MODBUS_AREA_INPUT,          /* read-only registers */
+} ModbusArea_t;
+
+/* After a write request changed count values of area from addr on;
+ * outside the map lock. With MODBUS_TCP_WRITE_WORKER on a worker of the
+ * pool, one call at a time, writes meanwhile merged into the range that
+ * covers them; otherwise on the tcpip thread. */
+typedef void (*ModbusWriteFn)(ModbusArea_t area, uint16_t addr, uint16_t count, void* arg);
+
+/* Register table; an area with a count of 0 answers every address with
+ * an illegal data address exception */
+typedef struct {
+    uint8_t* coils;             /* (coil_count + 7) / 8 bytes */
+    uint16_t coil_count;
+    const uint8_t* discrete;
+    uint16_t discrete_count;
+    uint16_t* holding;
+    uint16_t holding_count;
+    const uint16_t* input;
+    uint16_t input_count;
+    /* NULL, or the snapshot holding discrete and input: both then point
+     * into its copy 0 and are read from the current copy */
+    const SeqSnap_t* inputs;
+    ModbusWriteFn on_write;     /* may be NULL */
+    void* arg;
+} ModbusMap_t;
+
+/* Opens the listener and registers the metrics. map must outlive the
+ * server; NULL serves MODBUS_TCP_SCRATCH read/write registers of each kind
+ * (input registers and discrete inputs mirror the holding registers and
+ * coils), for tests. Call once from a task after metrics_init(), not
+ * holding the core lock. */
+bool modbus_tcp_start(const ModbusMap_t* map);
+
+/* Keeps requests off the table while the application updates several
+ * values; interrupts are masked in between, keep it to a few copies */
+sys_prot_t modbus_map_lock(void);
+void modbus_map_unlock(sys_prot_t lev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MODBUS_TCP_H */
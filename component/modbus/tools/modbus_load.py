@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Modbus/TCP load: pipelined requests on several connections, checked.
+
+Opens --conns connections to the board's Modbus/TCP server
+(component/modbus/modbus_tcp.h) and keeps --depth requests outstanding on
+each. Requests alternate between writing --qty holding registers
+(function 16) and reading them back (function 3); every connection uses
+its own block of addresses, so each read must return what the same
+connection wrote before it. Responses are matched by transaction id.
+
+    modbus_load.py 192.168.7.2 [--port 502] [--conns 4] [--depth 4]
+                   [--qty 16] [--seconds 5]
+
+The server's scratch map (modbus_tcp_start(NULL)) has 256 registers, so
+conns * qty must stay within that.
+"""
+
+import argparse
+import random
+import selectors
+import socket
+import struct
+import sys
+import time
+
+MBAP = struct.Struct("!HHHB")
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+class Conn:
+    def __init__(self, host, port, base, qty):
+        self.sock = socket.create_connection((host, port))
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.sock.setblocking(False)
+        self.base = base
+        self.qty = qty
+        self.tid = 0
+        self.rx = b""
+        self.tx = b""
+        # tid -> (send time, function, expected registers or None)
+        self.pending = {}
+        self.values = [0] * qty
+        self.write_next = True
+
+    def request(self):
+        self.tid = (self.tid + 1) & 0xFFFF
+        if self.write_next:
+            self.values = [random.getrandbits(16) for _ in range(self.qty)]
+            pdu = struct.pack("!BHHB", 16, self.base, self.qty, 2 * self.qty) + \
+                struct.pack("!%dH" % self.qty, *self.values)
+            expect = None
+            fc = 16
+        else:
+            pdu = struct.pack("!BHH", 3, self.base, self.qty)
+            expect = list(self.values)
+            fc = 3
+        self.write_next = not self.write_next
+        self.tx += MBAP.pack(self.tid, 0, len(pdu) + 1, 1) + pdu
+        self.pending[self.tid] = (time.monotonic_ns(), fc, expect)
+
+    def flush(self):
+        if self.tx:
+            try:
+                n = self.sock.send(self.tx)
+            except BlockingIOError:
+                return
+            self.tx = self.tx[n:]
+
+    def responses(self):
+        """Yields (rtt_ns, ok) for each complete response received."""
+        try:
+            data = self.sock.recv(65536)
+        except BlockingIOError:
+            return
+        if not data:
+            raise ConnectionError("closed by the server")
+        self.rx += data
+        now = time.monotonic_ns()
+        while len(self.rx) >= MBAP.size:
+            tid, proto, length, _unit = MBAP.unpack_from(self.rx)
+            if len(self.rx) < 6 + length:
+                break
+            pdu = self.rx[MBAP.size:6 + length]
+            self.rx = self.rx[6 + length:]
+            sent = self.pending.pop(tid, None)
+            if sent is None or proto != 0:
+                yield 0, False
+                continue
+            t, fc, expect = sent
+            if fc == 16:
+                ok = pdu == struct.pack("!BHH", 16, self.base, self.qty)
+            else:
+                ok = len(pdu) == 2 + 2 * self.qty and pdu[0] == 3 and \
+                    list(struct.unpack_from("!%dH" % self.qty, pdu, 2)) == expect
+            yield now - t, ok
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("host")
+    ap.add_argument("--port", type=int, default=502)
+    ap.add_argument("--conns", type=int, default=4)
+    ap.add_argument("--depth", type=int, default=4, help="requests outstanding per connection")
+    ap.add_argument("--qty", type=int, default=16, help="registers per request, 1..123")
+    ap.add_argument("--seconds", type=float, default=5.0)
+    args = ap.parse_args()
+
+    sel = selectors.DefaultSelector()
+    conns = []
+    for i in range(args.conns):
+        c = Conn(args.host, args.port, i * args.qty, args.qty)
+        conns.append(c)
+        sel.register(c.sock, selectors.EVENT_READ, c)
+        for _ in range(args.depth):
+            c.request()
+        c.flush()
+
+    rtt = []
+    bad = 0
+    start = time.monotonic()
+    end = start + args.seconds
+    while time.monotonic() < end:
+        for key, _ in sel.select(timeout=0.1):
+            c = key.data
+            for r, ok in c.responses():
+                if ok:
+                    rtt.append(r)
+                else:
+                    bad += 1
+                c.request()
+            c.flush()
+        for c in conns:
+            c.flush()
+    elapsed = time.monotonic() - start
+    for c in conns:
+        c.sock.close()
+
+    print("%d connections x %d deep, %d registers: %d transactions in %.1f s, %.0f/s, %d bad" %
+          (args.conns, args.depth, args.qty, len(rtt), elapsed, len(rtt) / elapsed, bad))
+    print("rtt p50 %.1f  p99 %.1f  max %.1f us" %
+          (percentile(rtt, 50) / 1e3, percentile(rtt, 99) / 1e3, (max(rtt) if rtt else 0) / 1e3))
+    return 0 if bad == 0 and rtt else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
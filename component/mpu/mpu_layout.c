@@ -0,0 +1,152 @@
+/**
+ * @file mpu_layout.c
+ * @brief MPU memory map, see mpu_layout.h.
+ */
+
+#include "mpu_layout.h"
+
+#include "main.h"
+#include "lwip/opt.h"
+#include "ethernetif_opts.h"
+
+#define MPU_TAG "MPU"
+
+typedef struct {
+    uint8_t tex;
+    uint8_t cacheable;
+    uint8_t bufferable;
+    uint8_t shareable;
+} MpuAttr_t;
+
+/* Indexed by MPU_POLICY_*. Cached memory is not shareable: the M7 would
+ * treat shareable normal memory as non-cacheable. */
+static const MpuAttr_t mpu_attr[MPU_POLICY_COUNT] = {
+    [MPU_POLICY_WB] = { MPU_TEX_LEVEL1, MPU_ACCESS_CACHEABLE, MPU_ACCESS_BUFFERABLE, MPU_ACCESS_NOT_SHAREABLE },
+    [MPU_POLICY_WT] = { MPU_TEX_LEVEL0, MPU_ACCESS_CACHEABLE, MPU_ACCESS_NOT_BUFFERABLE, MPU_ACCESS_NOT_SHAREABLE },
+    [MPU_POLICY_NC] = { MPU_TEX_LEVEL1, MPU_ACCESS_NOT_CACHEABLE, MPU_ACCESS_NOT_BUFFERABLE, MPU_ACCESS_NOT_SHAREABLE },
+    [MPU_POLICY_DEVICE] = { MPU_TEX_LEVEL0, MPU_ACCESS_NOT_CACHEABLE, MPU_ACCESS_BUFFERABLE, MPU_ACCESS_SHAREABLE },
+    [MPU_POLICY_SO] = { MPU_TEX_LEVEL0, MPU_ACCESS_NOT_CACHEABLE, MPU_ACCESS_NOT_BUFFERABLE, MPU_ACCESS_SHAREABLE },
+};
+
+static const char* const mpu_policy_names[MPU_POLICY_COUNT] = {
+    "wb", "wt", "nc", "device", "so"
+};
+
+_Static_assert(LWIP_RAM_HEAP_POINTER == MPU_LAYOUT_HEAP_BASE, "lwIP heap moved, update MPU_LAYOUT_HEAP_BASE");
+_Static_assert((ETHIF_DESC_BASE & (MPU_LAYOUT_DMA_SIZE - 1U)) == 0U, "ETHIF_DESC_BASE not aligned to the DMA region");
+_Static_assert((MPU_LAYOUT_HEAP_BASE & (MPU_LAYOUT_HEAP_SIZE - 1U)) == 0U &&
+               (MPU_LAYOUT_AXI_BASE & (MPU_LAYOUT_AXI_SIZE - 1U)) == 0U,
+               "the heap and AXI regions must be powers of two aligned to their size");
+/* Region 3 is above region 1: an overlap would give the heap the AXI policy */
+_Static_assert(MPU_LAYOUT_HEAP_IN_D2 || MPU_LAYOUT_HEAP_BASE >= MPU_LAYOUT_AXI_BASE + MPU_LAYOUT_AXI_SIZE,
+               "the lwIP heap overlaps the AXI region");
+
+/* MPU_LAYOUT_MAP as the absolute symbol __mpu_layout_map, which the linker
+ * script asserts its own MPU_LAYOUT_MAP against: a mismatch fails the link */
+#if MPU_LAYOUT_MAP == MPU_MAP_H743
+__asm__(".global __mpu_layout_map\n\t.equ __mpu_layout_map, 0");
+#elif MPU_LAYOUT_MAP == MPU_MAP_H72X
+__asm__(".global __mpu_layout_map\n\t.equ __mpu_layout_map, 1");
+#endif
+
+/* The same map as the linker script has it */
+extern const uint8_t LWIP_POOL_BASE[];
+extern const uint8_t ETH_DESC_BASE[];
+
+const char* mpu_policy_name(uint32_t policy)
+{
+    return (policy < MPU_POLICY_COUNT) ? mpu_policy_names[policy] : "?";
+}
+
+static void mpu_layout_init(MPU_Region_InitTypeDef* r, uint32_t number, uint32_t base, uint32_t size,
+                            uint32_t policy)
+{
+    const MpuAttr_t* a = &mpu_attr[policy];
+
+    r->Enable = MPU_REGION_ENABLE;
+    r->Number = (uint8_t)number;
+    r->BaseAddress = base;
+    r->Size = (uint8_t)(__builtin_ctz(size) - 1);
+    r->SubRegionDisable = 0x0;
+    r->TypeExtField = a->tex;
+    r->AccessPermission = MPU_REGION_FULL_ACCESS;
+    r->DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+    r->IsShareable = a->shareable;
+    r->IsCacheable = a->cacheable;
+    r->IsBufferable = a->bufferable;
+}
+
+#if MPU_LAYOUT
+void mpu_layout_config(void)
+{
+    MPU_Region_InitTypeDef r = { 0 };
+
+    HAL_MPU_Disable();
+
+    /* As generated: no access outside the code and SRAM subregions */
+    r.Enable = MPU_REGION_ENABLE;
+    r.Number = MPU_LAYOUT_REGION_BACKGROUND;
+    r.BaseAddress = 0x0;
+    r.Size = MPU_REGION_SIZE_4GB;
+    r.SubRegionDisable = 0x87;
+    r.TypeExtField = MPU_TEX_LEVEL0;
+    r.AccessPermission = MPU_REGION_NO_ACCESS;
+    r.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+    r.IsShareable = MPU_ACCESS_SHAREABLE;
+    r.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+    r.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+    HAL_MPU_ConfigRegion(&r);
+
+    mpu_layout_init(&r, MPU_LAYOUT_REGION_HEAP, MPU_LAYOUT_HEAP_BASE, MPU_LAYOUT_HEAP_SIZE, MPU_HEAP_POLICY);
+    HAL_MPU_ConfigRegion(&r);
+    mpu_layout_init(&r, MPU_LAYOUT_REGION_DMA, ETHIF_DESC_BASE, MPU_LAYOUT_DMA_SIZE, MPU_DMA_POLICY);
+    HAL_MPU_ConfigRegion(&r);
+    mpu_layout_init(&r, MPU_LAYOUT_REGION_AXI, MPU_LAYOUT_AXI_BASE, MPU_LAYOUT_AXI_SIZE, MPU_AXI_POLICY);
+    r.DisableExec = MPU_INSTRUCTION_ACCESS_ENABLE;
+    HAL_MPU_ConfigRegion(&r);
+    mpu_layout_init(&r, MPU_LAYOUT_REGION_DESC, ETHIF_DESC_BASE, ETHIF_DESC_REGION_SIZE, MPU_DESC_POLICY);
+    HAL_MPU_ConfigRegion(&r);
+
+    HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+}
+#endif /* MPU_LAYOUT */
+
+void mpu_layout_region(uint32_t number, uint32_t base, uint32_t size, uint32_t policy)
+{
+    MPU_Region_InitTypeDef r = { 0 };
+    uint32_t primask = __get_PRIMASK();
+
+    mpu_layout_init(&r, number, base, size, policy);
+    __disable_irq();
+    HAL_MPU_Disable();
+    HAL_MPU_ConfigRegion(&r);
+    HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+    if (primask == 0U) {
+        __enable_irq();
+    }
+}
+
+void mpu_layout_region_off(uint32_t number)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    HAL_MPU_Disable();
+    HAL_MPU_DisableRegion(number);
+    HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+    if (primask == 0U) {
+        __enable_irq();
+    }
+}
+
+void mpu_layout_report(void)
+{
+    if ((uint32_t)LWIP_POOL_BASE != MPU_LAYOUT_HEAP_BASE || (uint32_t)ETH_DESC_BASE != ETHIF_DESC_BASE) {
+        LOG_ERROR(MPU_TAG, "%s map, but linked with the heap at 0x%08lx and the descriptors at 0x%08lx: "
+                  "MPU_LAYOUT_MAP of the linker script differs", MPU_LAYOUT_MAP_NAME,
+                  (unsigned long)(uint32_t)LWIP_POOL_BASE, (unsigned long)(uint32_t)ETH_DESC_BASE);
+    }
+    LOG_INFO(MPU_TAG, "%s, %s map: axi %s, lwip heap %s, rx pool %s, descriptors %s",
+             MPU_LAYOUT ? "layout" : "CubeMX regions", MPU_LAYOUT_MAP_NAME, mpu_policy_name(MPU_AXI_POLICY),
+             mpu_policy_name(MPU_HEAP_POLICY), mpu_policy_name(MPU_DMA_POLICY), mpu_policy_name(MPU_DESC_POLICY));
+}
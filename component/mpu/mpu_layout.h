@@ -0,0 +1,191 @@
+/**
+ * @file mpu_layout.h
+ * @brief MPU memory map: one cache policy per memory the ETH DMA and the CPU share.
+ *
+ * MPU_Config() hands over to mpu_layout_config(), which programs the
+ * regions below from the policies chosen here, so a layout is picked with
+ * -D options rather than by editing the generated code:
+ *
+ *   region  memory                                    policy
+ *   0       background, 4 GB minus code and SRAM      no access
+ *   1       lwIP heap and pools (MPU_LAYOUT_HEAP_*)   MPU_HEAP_POLICY
+ *   2       RX_POOL, 32 KB D2 SRAM at ETHIF_DESC_BASE MPU_DMA_POLICY
+ *   3       AXI SRAM (data, stacks, bss)              MPU_AXI_POLICY
+ *   4, 5    QSPI flash, backup SRAM (their components)
+ *   6       bench_suite.c scratch
+ *   7       ETH DMA descriptors, over region 2        MPU_DESC_POLICY
+ *
+ * Where regions 1 to 3 sit depends on the device (MPU_LAYOUT_MAP, from the
+ * CMSIS device macro):
+ *
+ *   MPU_MAP_H743  H743/H753/H750, 512 KB AXI and 288 KB D2 SRAM: region 3
+ *                 is all of AXI SRAM; the heap (128 KB at 0x30020000) and
+ *                 the DMA area (0x30040000) are in D2 SRAM.
+ *   MPU_MAP_H72X  H723/H725/H730/H733/H735, 320 KB AXI (ITCM at its 64 KB
+ *                 default) and 32 KB D2 SRAM: the DMA area is D2 SRAM, the
+ *                 heap (64 KB at 0x24040000) the top of AXI SRAM and
+ *                 region 3 the 256 KB below it, so that the two do not
+ *                 overlap. The malloc pools of the default LWIP_PROFILE do
+ *                 not fit 64 KB; lwipopts_profile.h defaults to LOW_MEMORY.
+ *
+ * The linker script has the same map (MPU_LAYOUT_MAP at its top, set by
+ * hand to match; the link fails when it differs, mpu_layout.c exports this
+ * one as __mpu_layout_map) and places the pools, descriptors and RX_POOL
+ * in regions of these bounds; ethernetif.c checks the lwIP side at compile
+ * time and mpu_layout_report() logs an error when the linked addresses
+ * differ.
+ *
+ * The defaults are the CubeMX map: write-through AXI, non-cacheable heap,
+ * write-back RX_POOL (invalidated per frame) and device descriptors. One
+ * difference: the generated AXI region inherits the shareable bit of the
+ * descriptor region, and the M7 does not cache shareable memory, so it was
+ * in effect non-cacheable; here cached policies are never shareable.
+ *
+ * ethernetif.c derives its cache maintenance from the same macros: TX
+ * frames in write-back memory are cleaned, RX buffers are invalidated
+ * unless MPU_DMA_POLICY is non-cacheable. Descriptors must not be cacheable.
+ *
+ * Comparing layouts: the Bench configuration (bench_suite.h) reports the
+ * CPU side for every policy in AXI and D2 SRAM ("bench=mpu" lines) and the
+ * layout it was built with; the network side is iperf against builds that
+ * differ in one policy. Write-back memory is the fastest for the CPU and
+ * costs a clean per transmitted frame; non-cacheable memory needs no
+ * maintenance but every protocol header read goes to the bus.
+ */
+
+#pragma once
+
+#ifndef MPU_LAYOUT_H
+#define MPU_LAYOUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Memory types, as plain numbers for #if */
+#define MPU_POLICY_WB           0U  /* normal, write-back read/write-allocate */
+#define MPU_POLICY_WT           1U  /* normal, write-through no write-allocate */
+#define MPU_POLICY_NC           2U  /* normal, non-cacheable */
+#define MPU_POLICY_DEVICE       3U  /* shareable device */
+#define MPU_POLICY_SO           4U  /* strongly ordered */
+#define MPU_POLICY_COUNT        5U
+
+#define MPU_POLICY_CACHED(p)    ((p) <= MPU_POLICY_WT)
+#define MPU_POLICY_WRITEBACK(p) ((p) == MPU_POLICY_WB)
+
+/* 0 leaves the regions of the generated MPU_Config(), which are the
+ * defaults below */
+#ifndef MPU_LAYOUT
+#define MPU_LAYOUT 1
+#endif
+
+#ifndef MPU_AXI_POLICY
+#define MPU_AXI_POLICY MPU_POLICY_WT
+#endif
+
+#ifndef MPU_HEAP_POLICY
+#define MPU_HEAP_POLICY MPU_POLICY_NC
+#endif
+
+#ifndef MPU_DMA_POLICY
+#define MPU_DMA_POLICY MPU_POLICY_WB
+#endif
+
+#ifndef MPU_DESC_POLICY
+#define MPU_DESC_POLICY MPU_POLICY_DEVICE
+#endif
+
+#define MPU_LAYOUT_REGION_BACKGROUND 0U
+#define MPU_LAYOUT_REGION_HEAP       1U
+#define MPU_LAYOUT_REGION_DMA        2U
+#define MPU_LAYOUT_REGION_AXI        3U
+#define MPU_LAYOUT_REGION_BENCH      6U
+#define MPU_LAYOUT_REGION_DESC       7U
+
+#define MPU_MAP_H743            0U
+#define MPU_MAP_H72X            1U
+
+#ifndef MPU_LAYOUT_MAP
+#if defined(STM32H723xx) || defined(STM32H725xx) || defined(STM32H730xx) || defined(STM32H730xxQ) || \
+    defined(STM32H733xx) || defined(STM32H735xx)
+#define MPU_LAYOUT_MAP MPU_MAP_H72X
+#else
+#define MPU_LAYOUT_MAP MPU_MAP_H743
+#endif
+#endif
+
+#define MPU_LAYOUT_AXI_BASE          0x24000000U
+#define MPU_LAYOUT_D2_BASE           0x30000000U
+#define MPU_LAYOUT_D3_BASE           0x38000000U
+/* From ETHIF_DESC_BASE: descriptors (region 7 on top) and RX_POOL */
+#define MPU_LAYOUT_DMA_SIZE          0x8000U
+
+#if MPU_LAYOUT_MAP == MPU_MAP_H743
+#define MPU_LAYOUT_MAP_NAME          "h743"
+#define MPU_LAYOUT_AXI_SIZE          0x80000U
+#define MPU_LAYOUT_HEAP_BASE         0x30020000U
+#define MPU_LAYOUT_HEAP_SIZE         0x20000U
+#define MPU_LAYOUT_DMA_BASE          0x30040000U
+#define MPU_LAYOUT_D2_END            0x30048000U
+#define MPU_LAYOUT_D3_END            0x38010000U
+/* D2 SRAM below the heap, used by nothing but the bench MPU sweep */
+#define MPU_LAYOUT_D2_FREE_SIZE      0x20000U
+#elif MPU_LAYOUT_MAP == MPU_MAP_H72X
+#define MPU_LAYOUT_MAP_NAME          "h72x"
+#define MPU_LAYOUT_AXI_SIZE          0x40000U
+#define MPU_LAYOUT_HEAP_BASE         0x24040000U
+#define MPU_LAYOUT_HEAP_SIZE         0x10000U
+#define MPU_LAYOUT_DMA_BASE          0x30000000U
+#define MPU_LAYOUT_D2_END            0x30008000U
+#define MPU_LAYOUT_D3_END            0x38004000U
+#define MPU_LAYOUT_D2_FREE_SIZE      0U
+#else
+#error "MPU_LAYOUT_MAP: unknown memory map"
+#endif
+
+/* The lwIP heap lies in D2 SRAM (else at the top of AXI SRAM) */
+#define MPU_LAYOUT_HEAP_IN_D2        (MPU_LAYOUT_HEAP_BASE >= MPU_LAYOUT_D2_BASE)
+
+#if MPU_POLICY_CACHED(MPU_DESC_POLICY)
+#error "MPU_DESC_POLICY: the ETH DMA descriptors cannot be cacheable"
+#endif
+
+#if MPU_AXI_POLICY > MPU_POLICY_NC || MPU_HEAP_POLICY > MPU_POLICY_NC || MPU_DMA_POLICY > MPU_POLICY_NC
+#error "Data and buffers need normal memory: lwIP and the C library access it unaligned"
+#endif
+
+#if !MPU_LAYOUT && MPU_LAYOUT_MAP != MPU_MAP_H743
+#error "The CubeMX regions of MPU_Config() are the H743 map: this device needs MPU_LAYOUT"
+#endif
+
+#if !MPU_LAYOUT && (MPU_AXI_POLICY != MPU_POLICY_WT || MPU_HEAP_POLICY != MPU_POLICY_NC || \
+                    MPU_DMA_POLICY != MPU_POLICY_WB || MPU_DESC_POLICY != MPU_POLICY_DEVICE)
+#error "MPU policies other than the CubeMX ones need MPU_LAYOUT"
+#endif
+
+#if MPU_LAYOUT
+/* Programs all regions and enables the MPU; from MPU_Config(), before the
+ * caches are enabled */
+void mpu_layout_config(void);
+#endif
+
+/* Maps [base, base + size) with a policy; size a power of two from 32 B,
+ * base aligned to it. Safe with the MPU running as long as nothing else
+ * uses the memory; the caller cleans or invalidates it around a change. */
+void mpu_layout_region(uint32_t number, uint32_t base, uint32_t size, uint32_t policy);
+
+/* Turns a region off */
+void mpu_layout_region_off(uint32_t number);
+
+const char* mpu_policy_name(uint32_t policy);
+
+/* Logs the layout (tag "MPU"), once the logger runs */
+void mpu_layout_report(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MPU_LAYOUT_H */
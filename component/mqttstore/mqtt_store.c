@@ -0,0 +1,344 @@
+/**
+ * @file mqtt_store.c
+ * @brief MQTT store and forward over a QSPI flash log, see mqtt_store.h.
+ */
+
+#include "mqtt_store.h"
+
+#if MQTT_STORE
+
+#include "qspi/qspi_flash.h"
+#include "qspi/qspi_log.h"
+#include "metrics/metrics.h"
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "lwip/tcpip.h"
+
+#include <string.h>
+
+#if !QSPI_FLASH
+#error "MQTT_STORE needs QSPI_FLASH"
+#endif
+
+#if (MQTT_STORE_OFFSET % QSPI_FLASH_SECTOR_SIZE) != 0 || (MQTT_STORE_SIZE % QSPI_FLASH_SECTOR_SIZE) != 0
+#error "the MQTT store must be made of whole QSPI sectors"
+#endif
+
+#if MQTT_STORE_SIZE / QSPI_FLASH_SECTOR_SIZE < 2
+#error "the MQTT store needs at least two sectors"
+#endif
+
+#if (MQTT_STORE_RAM_SIZE & (MQTT_STORE_RAM_SIZE - 1U)) != 0U || MQTT_STORE_RAM_SIZE < 64U
+#error "MQTT_STORE_RAM_SIZE must be a power of two"
+#endif
+
+/* A flash record is a 12-byte header and the message */
+#if MQTT_STORE_MSG_MAX + 12U > MQTT_STORE_STAGE_SIZE || MQTT_STORE_MSG_MAX + 12U > QSPI_FLASH_SECTOR_SIZE
+#error "MQTT_STORE_MSG_MAX does not fit a flash record"
+#endif
+
+#define MQTT_STORE_TAG          "MQTTS"
+#define MQTT_STORE_QOS          0x03U
+#define MQTT_STORE_RETAIN       0x04U
+#define MQTT_STORE_WRAP         0x80U   /* RAM only: the rest of the ring is unused */
+#define MQTT_STORE_ALIGN(n)     (((n) + 7U) & ~7U)
+
+/* A message in the RAM ring: the header, the topic with its terminator,
+ * the payload, padded to 8 bytes. The flash record of a message is the
+ * part behind the header, flags as its kind. */
+typedef struct {
+    uint16_t len;           /* the whole record */
+    uint16_t payload_len;
+    uint8_t flags;          /* qos, MQTT_STORE_RETAIN, MQTT_STORE_WRAP */
+    uint8_t topic_len;
+    volatile uint8_t ready; /* set last by the producer */
+    uint8_t reserved;
+} MqttStoreRec_t;
+
+typedef struct {
+    mqtt_client_t* client;
+    uint32_t bytes;         /* payload replayed this period */
+} MqttStoreBurst_t;
+
+/* Free running; head moved by producers in a critical section, tail by
+ * the task */
+static uint8_t mqtt_store_ram[MQTT_STORE_RAM_SIZE] __attribute__((aligned(8)));
+static volatile uint32_t mqtt_store_head;
+static volatile uint32_t mqtt_store_tail;
+static mqtt_client_t* volatile mqtt_store_client;
+static MqttStoreStats_t mqtt_store_stats;
+
+static TaskHandle_t mqtt_store_task_handle;
+static StaticTask_t mqtt_store_tcb;
+static StackType_t mqtt_store_stack[MQTT_STORE_STACK_WORDS];
+
+/* Store task only, but for the statistics */
+QSPI_LOG_DEFINE(mqtt_store_log, MQTT_STORE_OFFSET, MQTT_STORE_SIZE, MQTT_STORE_STAGE_SIZE, MQTT_STORE_REPLAY_BURST,
+                MQTT_STORE_BUS_WAIT_MS);
+
+/*---------------------------------------------------------------------------*/
+/* Producers */
+
+/* Space for a record of rec bytes, after a wrap record when it does not
+ * fit before the end of the ring. Sets *first when the ring was empty. */
+static MqttStoreRec_t* mqtt_store_reserve(uint32_t rec, bool* first)
+{
+    MqttStoreRec_t* r = NULL;
+
+    taskENTER_CRITICAL();
+    uint32_t head = mqtt_store_head;
+    uint32_t pos = head % MQTT_STORE_RAM_SIZE;
+    uint32_t skip = (pos + rec > MQTT_STORE_RAM_SIZE) ? MQTT_STORE_RAM_SIZE - pos : 0U;
+
+    if (head - mqtt_store_tail + skip + rec <= MQTT_STORE_RAM_SIZE) {
+        *first = (head == mqtt_store_tail);
+        if (skip != 0U) {
+            MqttStoreRec_t* w = (MqttStoreRec_t*)&mqtt_store_ram[pos];
+            w->len = (uint16_t)skip;
+            w->flags = MQTT_STORE_WRAP;
+            __atomic_store_n(&w->ready, 1U, __ATOMIC_RELEASE);
+        }
+        r = (MqttStoreRec_t*)&mqtt_store_ram[(head + skip) % MQTT_STORE_RAM_SIZE];
+        r->ready = 0U;
+        __atomic_store_n(&mqtt_store_head, head + skip + rec, __ATOMIC_RELEASE);
+        mqtt_store_stats.queued++;
+    } else {
+        mqtt_store_stats.full++;
+    }
+    taskEXIT_CRITICAL();
+    return r;
+}
+
+bool mqtt_store_publish(const char* topic, const void* payload, uint16_t len, uint8_t qos, bool retain)
+{
+    size_t topic_len = strnlen(topic, 256U);
+    MqttStoreRec_t* r;
+    bool first = false;
+
+    if (topic_len == 0U || topic_len > 255U || topic_len + 1U + len > MQTT_STORE_MSG_MAX || qos > 2U) {
+        taskENTER_CRITICAL();
+        mqtt_store_stats.full++;
+        taskEXIT_CRITICAL();
+        return false;
+    }
+    r = mqtt_store_reserve(MQTT_STORE_ALIGN(sizeof(*r) + topic_len + 1U + len), &first);
+    if (r == NULL) {
+        return false;
+    }
+    r->len = (uint16_t)MQTT_STORE_ALIGN(sizeof(*r) + topic_len + 1U + len);
+    r->payload_len = len;
+    r->flags = (uint8_t)(qos | (retain ? MQTT_STORE_RETAIN : 0U));
+    r->topic_len = (uint8_t)topic_len;
+    memcpy(r + 1, topic, topic_len + 1U);
+    if (len != 0U) {
+        memcpy((uint8_t*)(r + 1) + topic_len + 1U, payload, len);
+    }
+    __atomic_store_n(&r->ready, 1U, __ATOMIC_RELEASE);
+
+    /* Later messages find the task busy with this one */
+    if (first && mqtt_store_task_handle != NULL) {
+        xTaskNotifyGive(mqtt_store_task_handle);
+    }
+    return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Store task */
+
+static uint32_t mqtt_store_used(void)
+{
+    return __atomic_load_n(&mqtt_store_head, __ATOMIC_ACQUIRE) - mqtt_store_tail;
+}
+
+static void mqtt_store_release(const MqttStoreRec_t* r)
+{
+    __atomic_store_n(&mqtt_store_tail, mqtt_store_tail + r->len, __ATOMIC_RELEASE);
+}
+
+/* The oldest complete message, NULL if none */
+static const MqttStoreRec_t* mqtt_store_peek(void)
+{
+    while (mqtt_store_used() != 0U) {
+        const MqttStoreRec_t* r = (const MqttStoreRec_t*)&mqtt_store_ram[mqtt_store_tail % MQTT_STORE_RAM_SIZE];
+
+        if (!__atomic_load_n(&r->ready, __ATOMIC_ACQUIRE)) {
+            return NULL;
+        }
+        if ((r->flags & MQTT_STORE_WRAP) == 0U) {
+            return r;
+        }
+        mqtt_store_release(r);
+    }
+    return NULL;
+}
+
+/* ERR_CONN when client is not connected */
+static err_t mqtt_store_send(mqtt_client_t* client, const char* topic, uint16_t topic_len, uint16_t payload_len,
+                             uint8_t flags)
+{
+    return mqtt_publish(client, topic, topic + topic_len + 1U, payload_len, flags & MQTT_STORE_QOS,
+                        (flags & MQTT_STORE_RETAIN) != 0U, NULL, NULL);
+}
+
+/* Sends or stores what the ring holds; stops at the first message that
+ * can go nowhere now */
+static void mqtt_store_drain(mqtt_client_t* client)
+{
+    const MqttStoreRec_t* r;
+
+    while ((r = mqtt_store_peek()) != NULL) {
+        const char* topic = (const char*)(r + 1);
+        uint16_t n = (uint16_t)(r->topic_len + 1U + r->payload_len);
+
+        if (client != NULL) {
+            err_t err = ERR_CONN;
+
+            LOCK_TCPIP_CORE();
+            if (mqtt_client_is_connected(client)) {
+                err = mqtt_store_send(client, topic, r->topic_len, r->payload_len, r->flags);
+            }
+            UNLOCK_TCPIP_CORE();
+            if (err == ERR_OK) {
+                mqtt_store_stats.sent++;
+                mqtt_store_release(r);
+                continue;
+            }
+            if (err == ERR_MEM && mqtt_store_used() <= MQTT_STORE_RAM_SIZE / 2U) {
+                mqtt_store_stats.deferred++;
+                break;
+            }
+            if (err != ERR_MEM && err != ERR_CONN) {
+                /* The client will never take it */
+                mqtt_store_stats.lost++;
+                mqtt_store_release(r);
+                continue;
+            }
+        }
+        if (!qspi_log_fits(&mqtt_store_log, n)) {
+            qspi_log_flush(&mqtt_store_log);
+            if (!qspi_log_fits(&mqtt_store_log, n)) {
+                /* No flash, or it is busy: waits in RAM */
+                break;
+            }
+        }
+        if (qspi_log_append(&mqtt_store_log, r->flags, topic, n)) {
+            mqtt_store_stats.stored++;
+        } else {
+            mqtt_store_stats.lost++;
+        }
+        mqtt_store_release(r);
+    }
+}
+
+static bool mqtt_store_replay_one(void* arg, uint8_t kind, const void* data, uint16_t len)
+{
+    MqttStoreBurst_t* b = (MqttStoreBurst_t*)arg;
+    const char* topic = (const char*)data;
+    size_t topic_len = strnlen(topic, len);
+    err_t err;
+
+    if (b->bytes >= MQTT_STORE_REPLAY_BYTES) {
+        return false;
+    }
+    if (topic_len == 0U || topic_len == len) {
+        mqtt_store_stats.lost++;
+        return true;
+    }
+    err = mqtt_store_send(b->client, topic, (uint16_t)topic_len, (uint16_t)(len - topic_len - 1U), kind);
+    if (err == ERR_MEM || err == ERR_CONN) {
+        return false;
+    }
+    if (err == ERR_OK) {
+        mqtt_store_stats.replayed++;
+        b->bytes += len;
+    } else {
+        mqtt_store_stats.lost++;
+    }
+    return true;
+}
+
+static void mqtt_store_task(void* arg)
+{
+    LWIP_UNUSED_ARG(arg);
+
+    for (;;) {
+        mqtt_client_t* client;
+
+        (void)ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_STORE_PERIOD_MS));
+        client = mqtt_store_client;
+        mqtt_store_drain(client);
+
+        /* Live messages first, then a burst of the backlog */
+        if (client != NULL && qspi_log_pending(&mqtt_store_log)) {
+            MqttStoreBurst_t burst = { client, 0U };
+
+            LOCK_TCPIP_CORE();
+            if (mqtt_client_is_connected(client)) {
+                (void)qspi_log_replay(&mqtt_store_log, mqtt_store_replay_one, &burst, MQTT_STORE_REPLAY_BURST);
+            }
+            UNLOCK_TCPIP_CORE();
+        }
+        qspi_log_flush(&mqtt_store_log);
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void mqtt_store_metrics(MetricsWriter_t* w)
+{
+    MqttStoreStats_t s;
+    QspiLogStats_t f;
+
+    mqtt_store_get_stats(&s);
+    qspi_log_get_stats(&mqtt_store_log, &f);
+    metrics_emit(w, "mqtt_store.queued", METRIC_COUNTER, s.queued);
+    metrics_emit(w, "mqtt_store.full", METRIC_COUNTER, s.full);
+    metrics_emit(w, "mqtt_store.sent", METRIC_COUNTER, s.sent);
+    metrics_emit(w, "mqtt_store.deferred", METRIC_COUNTER, s.deferred);
+    metrics_emit(w, "mqtt_store.stored", METRIC_COUNTER, s.stored);
+    metrics_emit(w, "mqtt_store.replayed", METRIC_COUNTER, s.replayed);
+    metrics_emit(w, "mqtt_store.lost", METRIC_COUNTER, s.lost);
+    metrics_emit(w, "mqtt_store.ram_used", METRIC_GAUGE, s.ram_used);
+    metrics_emit(w, "mqtt_store.flash.dropped", METRIC_COUNTER, f.dropped);
+    metrics_emit(w, "mqtt_store.flash.erases", METRIC_COUNTER, f.erases);
+    metrics_emit(w, "mqtt_store.flash.overwritten", METRIC_COUNTER, f.overwritten);
+    metrics_emit(w, "mqtt_store.flash.errors", METRIC_COUNTER, f.errors);
+}
+
+bool mqtt_store_start(void)
+{
+    if (mqtt_store_task_handle != NULL) {
+        return false;
+    }
+    if (!qspi_log_init(&mqtt_store_log)) {
+        LOG_WARNING(MQTT_STORE_TAG, "no store in the QSPI flash, RAM only");
+    }
+    (void)metrics_register_collector(mqtt_store_metrics);
+
+    mqtt_store_task_handle = xTaskCreateStatic(mqtt_store_task, "MQTTStore", MQTT_STORE_STACK_WORDS, NULL,
+                                               MQTT_STORE_PRIORITY, mqtt_store_stack, &mqtt_store_tcb);
+    if (mqtt_store_task_handle == NULL) {
+        LOG_ERROR(MQTT_STORE_TAG, "no task");
+        return false;
+    }
+    return true;
+}
+
+void mqtt_store_set_client(mqtt_client_t* client)
+{
+    mqtt_store_client = client;
+    if (mqtt_store_task_handle != NULL) {
+        xTaskNotifyGive(mqtt_store_task_handle);
+    }
+}
+
+void mqtt_store_get_stats(MqttStoreStats_t* stats)
+{
+    taskENTER_CRITICAL();
+    *stats = mqtt_store_stats;
+    taskEXIT_CRITICAL();
+    stats->ram_used = mqtt_store_used();
+}
+
+#endif /* MQTT_STORE */
@@ -0,0 +1,131 @@
+/**
+ * @file mqtt_store.h
+ * @brief MQTT store and forward: publishes queued without blocking, sent
+ *        live while the broker is reachable, kept in the QSPI flash while
+ *        it is not and replayed in paced bursts once it is back.
+ *
+ * mqtt_store_publish() copies topic and payload into a RAM ring
+ * (MQTT_STORE_RAM_SIZE) and returns; it never waits for the network, the
+ * flash or the core lock, and fails only when the ring is full. Every
+ * MQTT_STORE_PERIOD_MS, and at once when a message lands in an empty
+ * ring, the store task drains it:
+ *   - connected (mqtt_store_set_client(), mqtt_client_is_connected()):
+ *     each message goes out through mqtt_publish() under the core lock.
+ *     When the client has no room (ERR_MEM), the rest waits in RAM for the
+ *     next period, unless the ring is half full: then it goes to flash.
+ *   - not connected: the messages are appended to a qspi_log.h log in
+ *     MQTT_STORE_OFFSET/_SIZE, oldest lost first when it is full.
+ * While connected, each period then replays at most MQTT_STORE_REPLAY_BURST
+ * stored messages and MQTT_STORE_REPLAY_BYTES of payload, oldest first,
+ * after the live ones: a backlog drains at a bounded rate and live traffic
+ * keeps going meanwhile. A replayed message counts as sent once
+ * mqtt_publish() accepted it, at most once across a restart.
+ *
+ * Order is kept among live messages and among stored ones; a message
+ * stored during an outage arrives after the live ones that followed it.
+ *
+ * Exported through metrics as "mqtt_store.*".
+ */
+
+#pragma once
+
+#ifndef MQTT_STORE_H
+#define MQTT_STORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lwip/apps/mqtt.h"
+
+/* 0 leaves the store out of the startup code */
+#ifndef MQTT_STORE
+#define MQTT_STORE 1
+#endif
+
+/* Device range of the store, whole sectors; below the syslog archive, see
+ * the QSPI region of the linker script */
+#ifndef MQTT_STORE_OFFSET
+#define MQTT_STORE_OFFSET 0x00E00000U
+#endif
+
+#ifndef MQTT_STORE_SIZE
+#define MQTT_STORE_SIZE 0x00100000U
+#endif
+
+/* RAM ring between the producers and the store task */
+#ifndef MQTT_STORE_RAM_SIZE
+#define MQTT_STORE_RAM_SIZE 8192U
+#endif
+
+/* Topic, its terminator and payload of one message at most */
+#ifndef MQTT_STORE_MSG_MAX
+#define MQTT_STORE_MSG_MAX 512U
+#endif
+
+/* Flash writes staged per period */
+#ifndef MQTT_STORE_STAGE_SIZE
+#define MQTT_STORE_STAGE_SIZE 4096U
+#endif
+
+#ifndef MQTT_STORE_PERIOD_MS
+#define MQTT_STORE_PERIOD_MS 100U
+#endif
+
+/* Stored messages and payload bytes replayed per period at most */
+#ifndef MQTT_STORE_REPLAY_BURST
+#define MQTT_STORE_REPLAY_BURST 32U
+#endif
+
+#ifndef MQTT_STORE_REPLAY_BYTES
+#define MQTT_STORE_REPLAY_BYTES 8192U
+#endif
+
+/* Longest wait for readers of the mapped flash before a write */
+#ifndef MQTT_STORE_BUS_WAIT_MS
+#define MQTT_STORE_BUS_WAIT_MS 50U
+#endif
+
+/* osPriorityBelowNormal, see configOS2_TO_RTOS_PRIO(): below the tcpip
+ * thread, which sends what the task publishes */
+#ifndef MQTT_STORE_PRIORITY
+#define MQTT_STORE_PRIORITY 8
+#endif
+
+#ifndef MQTT_STORE_STACK_WORDS
+#define MQTT_STORE_STACK_WORDS 384U
+#endif
+
+typedef struct {
+    uint32_t queued;        /* taken by mqtt_store_publish() */
+    uint32_t full;          /* refused: RAM ring full or message too long */
+    uint32_t sent;          /* live, accepted by mqtt_publish() */
+    uint32_t deferred;      /* publish refused, kept in RAM for later */
+    uint32_t stored;        /* appended to the flash */
+    uint32_t replayed;      /* from the flash, accepted by mqtt_publish() */
+    uint32_t lost;          /* neither sent nor stored */
+    uint32_t ram_used;      /* bytes in the RAM ring now */
+} MqttStoreStats_t;
+
+/* Opens the flash log and starts the task; from a task, after
+ * qspi_flash_init(). Without the flash, messages wait in RAM only. */
+bool mqtt_store_start(void);
+
+/* The client messages go out through, NULL to store everything. Its
+ * connection is the application's; any task. */
+void mqtt_store_set_client(mqtt_client_t* client);
+
+/* Queues a message; false when it does not fit. Any task, not from an
+ * ISR; never blocks. */
+bool mqtt_store_publish(const char* topic, const void* payload, uint16_t len, uint8_t qos, bool retain);
+
+void mqtt_store_get_stats(MqttStoreStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MQTT_STORE_H */
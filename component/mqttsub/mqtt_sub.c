@@ -0,0 +1,255 @@
+/**
+ * @file mqtt_sub.c
+ * @brief MQTT subscriptions: a trie of topic filter levels, see mqtt_sub.h.
+ */
+
+#include "mqtt_sub.h"
+
+#include <string.h>
+
+#if MQTT_SUB_NODES >= MQTT_SUB_NONE || MQTT_SUB_HANDLERS >= MQTT_SUB_NONE || MQTT_SUB_CHARS > 0xFFFFU
+#error "MQTT_SUB_NODES, MQTT_SUB_HANDLERS and MQTT_SUB_CHARS must fit 16 bits"
+#endif
+#if MQTT_SUB_TOPIC_MAX > 256U
+#error "MQTT_SUB_TOPIC_MAX is limited to 256: a level length is 8 bits"
+#endif
+
+#define MQTT_SUB_ROOT 0U
+
+/* FNV-1a of a level, folded to 16 bits */
+static uint16_t mqtt_sub_hash(const char* seg, uint32_t len)
+{
+    uint32_t h = 2166136261U;
+    for (uint32_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)seg[i]) * 16777619U;
+    }
+    return (uint16_t)(h ^ (h >> 16));
+}
+
+/* End of the level starting at seg: the next '/' or the terminator */
+static const char* mqtt_sub_level_end(const char* seg)
+{
+    while (*seg != '\0' && *seg != '/') seg++;
+    return seg;
+}
+
+static uint16_t mqtt_sub_node_new(MqttSub_t* s)
+{
+    if (s->node_count >= MQTT_SUB_NODES) return MQTT_SUB_NONE;
+    uint16_t i = s->node_count++;
+    MqttSubNode_t* n = &s->nodes[i];
+    n->child = MQTT_SUB_NONE;
+    n->next = MQTT_SUB_NONE;
+    n->plus = MQTT_SUB_NONE;
+    n->multi = MQTT_SUB_NONE;
+    n->handler = MQTT_SUB_NONE;
+    n->seg = 0U;
+    n->seg_hash = 0U;
+    n->len = 0U;
+    return i;
+}
+
+/* The literal child of parent for seg, MQTT_SUB_NONE if none */
+static uint16_t mqtt_sub_child(const MqttSub_t* s, uint16_t parent, const char* seg, uint32_t len, uint16_t hash)
+{
+    for (uint16_t c = s->nodes[parent].child; c != MQTT_SUB_NONE; c = s->nodes[c].next) {
+        const MqttSubNode_t* n = &s->nodes[c];
+        if (n->seg_hash == hash && n->len == len && memcmp(&s->chars[n->seg], seg, len) == 0) return c;
+    }
+    return MQTT_SUB_NONE;
+}
+
+void mqtt_sub_init(MqttSub_t* s)
+{
+    memset(s, 0, sizeof(*s));
+    (void)mqtt_sub_node_new(s);
+}
+
+/* The filter's level count, 0 if it is not a valid filter */
+static uint32_t mqtt_sub_filter_levels(const char* filter)
+{
+    uint32_t levels = 0U;
+    const char* seg = filter;
+
+    if (filter[0] == '\0' || strlen(filter) >= MQTT_SUB_TOPIC_MAX) return 0U;
+    for (;;) {
+        const char* end = mqtt_sub_level_end(seg);
+        uint32_t len = (uint32_t)(end - seg);
+        for (uint32_t i = 0; i < len; i++) {
+            if ((seg[i] == '+' || seg[i] == '#') && len != 1U) return 0U;
+        }
+        levels++;
+        if (*end == '\0') break;
+        if (seg[0] == '#') return 0U;
+        seg = end + 1;
+    }
+    return (levels <= MQTT_SUB_DEPTH) ? levels : 0U;
+}
+
+bool mqtt_sub_add(MqttSub_t* s, const char* filter, MqttSubFn_t fn, void* arg)
+{
+    if (!s || !filter || !fn || mqtt_sub_filter_levels(filter) == 0U) return false;
+    if (s->handler_count >= MQTT_SUB_HANDLERS) return false;
+
+    uint16_t node = MQTT_SUB_ROOT;
+    const char* seg = filter;
+    for (;;) {
+        const char* end = mqtt_sub_level_end(seg);
+        uint32_t len = (uint32_t)(end - seg);
+        uint16_t* link = NULL;
+        uint16_t next;
+
+        if (len == 1U && seg[0] == '+') {
+            link = &s->nodes[node].plus;
+        } else if (len == 1U && seg[0] == '#') {
+            link = &s->nodes[node].multi;
+        }
+        if (link) {
+            next = *link;
+            if (next == MQTT_SUB_NONE) {
+                next = mqtt_sub_node_new(s);
+                if (next == MQTT_SUB_NONE) return false;
+                *link = next;
+            }
+        } else {
+            uint16_t hash = mqtt_sub_hash(seg, len);
+            next = mqtt_sub_child(s, node, seg, len, hash);
+            if (next == MQTT_SUB_NONE) {
+                if (s->char_count + len > MQTT_SUB_CHARS) return false;
+                next = mqtt_sub_node_new(s);
+                if (next == MQTT_SUB_NONE) return false;
+                MqttSubNode_t* n = &s->nodes[next];
+                memcpy(&s->chars[s->char_count], seg, len);
+                n->seg = s->char_count;
+                n->len = (uint8_t)len;
+                n->seg_hash = hash;
+                s->char_count += (uint16_t)len;
+                n->next = s->nodes[node].child;
+                s->nodes[node].child = next;
+            }
+        }
+        node = next;
+        if (*end == '\0') break;
+        seg = end + 1;
+    }
+
+    /* in the order added */
+    uint16_t h = s->handler_count++;
+    s->handlers[h].fn = fn;
+    s->handlers[h].arg = arg;
+    s->handlers[h].filter = filter;
+    s->handlers[h].next = MQTT_SUB_NONE;
+    uint16_t* tail = &s->nodes[node].handler;
+    while (*tail != MQTT_SUB_NONE) tail = &s->handlers[*tail].next;
+    *tail = h;
+    return true;
+}
+
+static void mqtt_sub_collect(MqttSub_t* s, uint16_t node)
+{
+    if (node == MQTT_SUB_NONE) return;
+    for (uint16_t h = s->nodes[node].handler; h != MQTT_SUB_NONE; h = s->handlers[h].next) {
+        if (s->match_count < MQTT_SUB_MATCH_MAX) {
+            s->match[s->match_count++] = h;
+        } else {
+            s->stats.overflow++;
+        }
+    }
+}
+
+/* node has matched the levels before seg; seg is NULL past the last one.
+ * Recurses once per level, so at most MQTT_SUB_DEPTH deep. */
+static void mqtt_sub_match(MqttSub_t* s, uint16_t node, const char* seg, bool wild)
+{
+    const MqttSubNode_t* n = &s->nodes[node];
+
+    if (!seg) {
+        mqtt_sub_collect(s, node);
+        /* "a/#" matches "a" too */
+        mqtt_sub_collect(s, n->multi);
+        return;
+    }
+    if (wild) mqtt_sub_collect(s, n->multi);
+
+    const char* end = mqtt_sub_level_end(seg);
+    uint32_t len = (uint32_t)(end - seg);
+    const char* next = (*end == '/') ? end + 1 : NULL;
+
+    if (n->child != MQTT_SUB_NONE) {
+        uint16_t c = mqtt_sub_child(s, node, seg, len, mqtt_sub_hash(seg, len));
+        if (c != MQTT_SUB_NONE) mqtt_sub_match(s, c, next, true);
+    }
+    if (wild && n->plus != MQTT_SUB_NONE) mqtt_sub_match(s, n->plus, next, true);
+}
+
+/* Matches topic into s->match; false if it is too long to copy */
+static bool mqtt_sub_begin(MqttSub_t* s, const char* topic)
+{
+    size_t len = strnlen(topic, MQTT_SUB_TOPIC_MAX);
+
+    s->match_count = 0U;
+    if (len == MQTT_SUB_TOPIC_MAX) {
+        s->stats.long_topics++;
+        return false;
+    }
+    memcpy(s->topic, topic, len + 1U);
+    /* wildcards of the first level skip "$..." topics */
+    mqtt_sub_match(s, MQTT_SUB_ROOT, s->topic, s->topic[0] != '$');
+    if (s->match_count == 0U) {
+        s->stats.unmatched++;
+        return false;
+    }
+    s->stats.dispatched++;
+    return true;
+}
+
+static void mqtt_sub_deliver(MqttSub_t* s, const uint8_t* data, uint16_t len, uint8_t flags)
+{
+    for (uint16_t i = 0; i < s->match_count; i++) {
+        const MqttSubHandler_t* h = &s->handlers[s->match[i]];
+        h->fn(h->arg, s->topic, data, len, flags);
+    }
+    if (flags & MQTT_DATA_FLAG_LAST) s->match_count = 0U;
+}
+
+static void mqtt_sub_publish_cb(void* arg, const char* topic, u32_t tot_len)
+{
+    LWIP_UNUSED_ARG(tot_len);
+    (void)mqtt_sub_begin((MqttSub_t*)arg, topic);
+}
+
+static void mqtt_sub_data_cb(void* arg, const u8_t* data, u16_t len, u8_t flags)
+{
+    mqtt_sub_deliver((MqttSub_t*)arg, data, len, flags);
+}
+
+void mqtt_sub_attach(MqttSub_t* s, mqtt_client_t* client)
+{
+    mqtt_set_inpub_callback(client, mqtt_sub_publish_cb, mqtt_sub_data_cb, s);
+}
+
+err_t mqtt_sub_subscribe(MqttSub_t* s, mqtt_client_t* client, u8_t qos, mqtt_request_cb_t cb, void* arg)
+{
+    for (uint16_t i = 0; i < s->handler_count; i++) {
+        const char* filter = s->handlers[i].filter;
+        bool sent = false;
+        /* once per filter text */
+        for (uint16_t j = 0; j < i && !sent; j++) sent = (strcmp(s->handlers[j].filter, filter) == 0);
+        if (sent) continue;
+        err_t err = mqtt_subscribe(client, filter, qos, cb, arg);
+        if (err != ERR_OK) return err;
+    }
+    return ERR_OK;
+}
+
+bool mqtt_sub_dispatch(MqttSub_t* s, const char* topic, const uint8_t* data, uint16_t len)
+{
+    if (!mqtt_sub_begin(s, topic)) return false;
+    mqtt_sub_deliver(s, data, len, MQTT_DATA_FLAG_LAST);
+    return true;
+}
+
+void mqtt_sub_get_stats(const MqttSub_t* s, MqttSubStats_t* stats)
+{
+    *stats = s->stats;
+}
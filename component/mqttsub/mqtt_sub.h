@@ -0,0 +1,148 @@
+/**
+ * @file mqtt_sub.h
+ * @brief MQTT subscriptions: incoming publishes dispatched to handlers by
+ *        topic filter, through a trie of topic levels.
+ *
+ * The lwIP client hands every PUBLISH to one callback pair
+ * (mqtt_set_inpub_callback()). mqtt_sub_attach() installs this module's
+ * pair instead: it walks the topic level by level through a trie of the
+ * filters registered with mqtt_sub_add() and calls every handler whose
+ * filter matches, with the topic, for each part of the payload the client
+ * passes on. A level is found among its siblings by a 16-bit hash before
+ * its text is compared, so a publish costs about its topic length however
+ * many filters there are; "+" and "#" are children of their own that the
+ * walk also follows (MQTT 3.1.1, 4.7):
+ *   "cfg/+/set"   one level: "cfg/eth/set", not "cfg/eth/x/set"
+ *   "cmd/#"       "cmd" and everything below it
+ * A filter starting with a wildcard does not match topics starting with
+ * '$' ("$SYS/..."). A handler is called once per matching filter.
+ *
+ * Everything is static: a MqttSub_t holds its nodes, handlers and level
+ * text, sized by the macros below; mqtt_sub_add() fails when one is full.
+ * Filters and handlers are added at startup, before the client connects
+ * or under the core lock; dispatch runs on the tcpip thread. Not
+ * reentrant per MqttSub_t.
+ *
+ * mqtt_sub_subscribe() asks the broker for every filter added, e.g. from
+ * the connection callback.
+ */
+
+#pragma once
+
+#ifndef MQTT_SUB_H
+#define MQTT_SUB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lwip/apps/mqtt.h"
+
+/* Trie nodes, one per distinct filter level plus the root */
+#ifndef MQTT_SUB_NODES
+#define MQTT_SUB_NODES 64U
+#endif
+
+/* Handlers, one per mqtt_sub_add() */
+#ifndef MQTT_SUB_HANDLERS
+#define MQTT_SUB_HANDLERS 32U
+#endif
+
+/* Level text of all nodes, not terminated */
+#ifndef MQTT_SUB_CHARS
+#define MQTT_SUB_CHARS 512U
+#endif
+
+/* Levels of a filter */
+#ifndef MQTT_SUB_DEPTH
+#define MQTT_SUB_DEPTH 8U
+#endif
+
+/* Handlers one publish is dispatched to; further matches are counted */
+#ifndef MQTT_SUB_MATCH_MAX
+#define MQTT_SUB_MATCH_MAX 8U
+#endif
+
+/* Longest topic, terminator included: what the client's receive buffer
+ * holds */
+#ifndef MQTT_SUB_TOPIC_MAX
+#define MQTT_SUB_TOPIC_MAX MQTT_VAR_HEADER_BUFFER_LEN
+#endif
+
+#define MQTT_SUB_NONE 0xFFFFU
+
+/* A part of a publish on topic; flags MQTT_DATA_FLAG_LAST on its last
+ * part. topic and data are valid during the call only. */
+typedef void (*MqttSubFn_t)(void* arg, const char* topic, const uint8_t* data, uint16_t len, uint8_t flags);
+
+typedef struct {
+    uint16_t child;     /* first literal child */
+    uint16_t next;      /* next literal sibling */
+    uint16_t plus;      /* "+" child */
+    uint16_t multi;     /* "#" child */
+    uint16_t handler;   /* first handler of the filter ending here */
+    uint16_t seg;       /* level text in chars[] */
+    uint16_t seg_hash;  /* of the level text */
+    uint8_t len;
+} MqttSubNode_t;
+
+typedef struct {
+    MqttSubFn_t fn;
+    void* arg;
+    const char* filter;
+    uint16_t next;      /* next handler of the same filter */
+} MqttSubHandler_t;
+
+typedef struct {
+    uint32_t dispatched;    /* publishes with at least one handler */
+    uint32_t unmatched;     /* publishes no filter matched */
+    uint32_t overflow;      /* handlers past MQTT_SUB_MATCH_MAX, not called */
+    uint32_t long_topics;   /* topics of MQTT_SUB_TOPIC_MAX or more, dropped */
+} MqttSubStats_t;
+
+typedef struct {
+    MqttSubNode_t nodes[MQTT_SUB_NODES];
+    MqttSubHandler_t handlers[MQTT_SUB_HANDLERS];
+    char chars[MQTT_SUB_CHARS];
+    uint16_t node_count;
+    uint16_t handler_count;
+    uint16_t char_count;
+    /* the publish being received */
+    uint16_t match[MQTT_SUB_MATCH_MAX];
+    uint16_t match_count;
+    char topic[MQTT_SUB_TOPIC_MAX];
+    MqttSubStats_t stats;
+} MqttSub_t;
+
+/* Empties s */
+void mqtt_sub_init(MqttSub_t* s);
+
+/* Calls fn(arg, ...) for publishes matching filter, which must outlive s
+ * (mqtt_sub_subscribe() sends it). False for an invalid filter ("#" or
+ * "+" sharing a level, "#" not last), one deeper than MQTT_SUB_DEPTH or
+ * longer than MQTT_SUB_TOPIC_MAX, or s full. */
+bool mqtt_sub_add(MqttSub_t* s, const char* filter, MqttSubFn_t fn, void* arg);
+
+/* Routes the publishes client receives through s. Core lock held, like
+ * mqtt_set_inpub_callback(). */
+void mqtt_sub_attach(MqttSub_t* s, mqtt_client_t* client);
+
+/* Subscribes client to every filter of s with qos, cb called per filter.
+ * Core lock held. The first error of mqtt_subscribe(), e.g. ERR_MEM with
+ * more filters than MQTT_REQ_MAX_IN_FLIGHT requests at once. */
+err_t mqtt_sub_subscribe(MqttSub_t* s, mqtt_client_t* client, u8_t qos, mqtt_request_cb_t cb, void* arg);
+
+/* Dispatches a whole message as if client had received it; false when no
+ * filter matches. Same thread rules as the client's callbacks. */
+bool mqtt_sub_dispatch(MqttSub_t* s, const char* topic, const uint8_t* data, uint16_t len);
+
+void mqtt_sub_get_stats(const MqttSub_t* s, MqttSubStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MQTT_SUB_H */
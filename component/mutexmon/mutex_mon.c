@@ -0,0 +1,248 @@
+/**
+ * @file mutex_mon.c
+ * @brief Contended mutex takes and priority inversions, see mutex_mon.h.
+ */
+
+#include "mutex_mon.h"
+
+#if MUTEX_MON
+
+#include "main.h"
+#include "task.h"
+#include "lathist/lat_hist.h"
+#include "metrics/metrics.h"
+#include "timesync/time_ns.h"
+#include "workpool/work_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define MUTEX_MON_TAG       "MUTEX"
+#define MUTEX_MON_HIST_NAME 40U
+
+typedef struct {
+    SemaphoreHandle_t mutex;
+    const char* name;
+    /* Written by the holder, under the mutex */
+    uint32_t takes;
+    uint32_t contended;
+    uint32_t inversions;
+    uint32_t inversion_max_ns;
+    LatHist_t wait;
+    LatHist_t inversion;
+    /* Written without the mutex, atomic */
+    uint32_t timeouts;
+#if METRICS
+    char hist_name[2][MUTEX_MON_HIST_NAME];
+#endif
+} MutexMonEntry_t;
+
+/* Worst inversion over MUTEX_MON_LOG_US since the last report, in a
+ * critical section */
+typedef struct {
+    const char* mutex;
+    char holder[configMAX_TASK_NAME_LEN];
+    char waiter[configMAX_TASK_NAME_LEN];
+    UBaseType_t holder_prio;
+    UBaseType_t waiter_prio;
+    uint32_t wait_ns;
+    uint32_t count;
+} MutexMonReport_t;
+
+static MutexMonEntry_t mutex_entries[MUTEX_MON_MAX];
+static uint32_t mutex_entry_count;
+static bool mutex_mon_exported;
+
+#if MUTEX_MON_LOG_US
+static MutexMonReport_t mutex_report;
+#if WORK_POOL
+static void mutex_mon_report_run(WorkJob_t* job);
+static WorkJob_t mutex_report_job = WORK_JOB_INIT(mutex_mon_report_run, NULL, NULL);
+#endif
+#endif
+
+static MutexMonEntry_t* mutex_mon_find(SemaphoreHandle_t m)
+{
+    uint32_t n = __atomic_load_n(&mutex_entry_count, __ATOMIC_ACQUIRE);
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (mutex_entries[i].mutex == m) {
+            return &mutex_entries[i];
+        }
+    }
+    return NULL;
+}
+
+static inline uint32_t mutex_mon_ns(uint64_t ns)
+{
+    return (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)ns;
+}
+
+#if MUTEX_MON_LOG_US
+static void mutex_mon_report(const MutexMonEntry_t* e, const char* holder, UBaseType_t holder_prio,
+                             UBaseType_t waiter_prio, uint32_t wait_ns)
+{
+    MutexMonReport_t* r = &mutex_report;
+
+    taskENTER_CRITICAL();
+    r->count++;
+    if (wait_ns > r->wait_ns) {
+        r->mutex = e->name;
+        strncpy(r->holder, holder, sizeof(r->holder) - 1U);
+        strncpy(r->waiter, pcTaskGetName(NULL), sizeof(r->waiter) - 1U);
+        r->holder_prio = holder_prio;
+        r->waiter_prio = waiter_prio;
+        r->wait_ns = wait_ns;
+    }
+    taskEXIT_CRITICAL();
+#if WORK_POOL
+    (void)work_submit(&mutex_report_job, WORK_PRIO_LOW);
+#endif
+}
+
+#if WORK_POOL
+/* On a worker, which holds none of the monitored mutexes */
+static void mutex_mon_report_run(WorkJob_t* job)
+{
+    MutexMonReport_t r;
+
+    (void)job;
+    taskENTER_CRITICAL();
+    r = mutex_report;
+    mutex_report.count = 0U;
+    mutex_report.wait_ns = 0U;
+    taskEXIT_CRITICAL();
+    if (r.count == 0U) {
+        return;
+    }
+    LOG_WARNING(MUTEX_MON_TAG, "%s: %s (prio %lu) waited %lu us on %s (prio %lu); %lu inversion(s) over %u us",
+                r.mutex, r.waiter, (unsigned long)r.waiter_prio, (unsigned long)(r.wait_ns / 1000U), r.holder,
+                (unsigned long)r.holder_prio, (unsigned long)r.count, (unsigned)MUTEX_MON_LOG_US);
+}
+#endif
+#endif /* MUTEX_MON_LOG_US */
+
+BaseType_t mutex_mon_take(SemaphoreHandle_t m, TickType_t timeout)
+{
+    MutexMonEntry_t* e = mutex_mon_find(m);
+    char holder_name[configMAX_TASK_NAME_LEN] = "";
+    TaskHandle_t holder;
+    UBaseType_t prio;
+    UBaseType_t holder_prio;
+    uint64_t start;
+    uint32_t wait_ns;
+
+    if (e == NULL) {
+        return xSemaphoreTake(m, timeout);
+    }
+    if (xSemaphoreTake(m, 0U) == pdTRUE) {
+        e->takes++;
+        return pdTRUE;
+    }
+    if (timeout == 0U) {
+        return pdFALSE;
+    }
+
+    /* Released since the try: no holder, no inversion */
+    holder = xSemaphoreGetMutexHolder(m);
+    prio = uxTaskPriorityGet(NULL);
+    holder_prio = (holder != NULL) ? uxTaskPriorityGet(holder) : prio;
+    if (holder_prio < prio) {
+        strncpy(holder_name, pcTaskGetName(holder), sizeof(holder_name) - 1U);
+    }
+    start = time_now_ns();
+    if (xSemaphoreTake(m, timeout) != pdTRUE) {
+        __atomic_fetch_add(&e->timeouts, 1U, __ATOMIC_RELAXED);
+        return pdFALSE;
+    }
+    wait_ns = mutex_mon_ns(time_now_ns() - start);
+
+    e->takes++;
+    e->contended++;
+    lat_hist_add(&e->wait, wait_ns);
+    if (holder_prio < prio) {
+        e->inversions++;
+        lat_hist_add(&e->inversion, wait_ns);
+        if (wait_ns > e->inversion_max_ns) {
+            e->inversion_max_ns = wait_ns;
+        }
+#if MUTEX_MON_LOG_US
+        if (wait_ns >= MUTEX_MON_LOG_US * 1000U) {
+            mutex_mon_report(e, holder_name, holder_prio, prio, wait_ns);
+        }
+#endif
+    }
+    return pdTRUE;
+}
+
+#if METRICS
+/* Runs on the tcpip thread; the histograms are registered on their own */
+static void mutex_mon_metrics(MetricsWriter_t* w)
+{
+    char name[METRICS_NAME_MAX];
+    uint32_t n = __atomic_load_n(&mutex_entry_count, __ATOMIC_ACQUIRE);
+
+    for (uint32_t i = 0; i < n; i++) {
+        const MutexMonEntry_t* e = &mutex_entries[i];
+
+        snprintf(name, sizeof(name), "mutex.%s.takes", e->name);
+        metrics_emit(w, name, METRIC_COUNTER, e->takes);
+        snprintf(name, sizeof(name), "mutex.%s.contended", e->name);
+        metrics_emit(w, name, METRIC_COUNTER, e->contended);
+        snprintf(name, sizeof(name), "mutex.%s.inversions", e->name);
+        metrics_emit(w, name, METRIC_COUNTER, e->inversions);
+        snprintf(name, sizeof(name), "mutex.%s.timeouts", e->name);
+        metrics_emit(w, name, METRIC_COUNTER, e->timeouts);
+        snprintf(name, sizeof(name), "mutex.%s.inversion_max_ns", e->name);
+        metrics_emit(w, name, METRIC_GAUGE, e->inversion_max_ns);
+    }
+}
+
+static void mutex_mon_export(MutexMonEntry_t* e)
+{
+    snprintf(e->hist_name[0], MUTEX_MON_HIST_NAME, "mutex.%s.wait_ns", e->name);
+    snprintf(e->hist_name[1], MUTEX_MON_HIST_NAME, "mutex.%s.inversion_ns", e->name);
+    (void)metrics_register_hist(e->hist_name[0], &e->wait);
+    (void)metrics_register_hist(e->hist_name[1], &e->inversion);
+}
+#endif
+
+bool mutex_mon_register(SemaphoreHandle_t m, const char* name)
+{
+    MutexMonEntry_t* e;
+
+    if (m == NULL || mutex_entry_count >= MUTEX_MON_MAX) {
+        return false;
+    }
+    if (mutex_mon_find(m) != NULL) {
+        return true;
+    }
+    e = &mutex_entries[mutex_entry_count];
+    e->name = name;
+    e->mutex = m;
+    /* Measured by the takes from here on */
+    __atomic_store_n(&mutex_entry_count, mutex_entry_count + 1U, __ATOMIC_RELEASE);
+#if METRICS
+    if (__atomic_load_n(&mutex_mon_exported, __ATOMIC_ACQUIRE)) {
+        mutex_mon_export(e);
+    }
+#endif
+    return true;
+}
+
+void mutex_mon_init(void)
+{
+#if METRICS
+    uint32_t n = __atomic_load_n(&mutex_entry_count, __ATOMIC_ACQUIRE);
+
+    if (!metrics_register_collector(mutex_mon_metrics)) {
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        mutex_mon_export(&mutex_entries[i]);
+    }
+#endif
+    __atomic_store_n(&mutex_mon_exported, true, __ATOMIC_RELEASE);
+}
+
+#endif /* MUTEX_MON */
@@ -0,0 +1,83 @@
+/**
+ * @file mutex_mon.h
+ * @brief Mutex blocking time and priority inversion detector.
+ *
+ * Takes of a registered mutex go through mutex_mon_take(), which tries the
+ * mutex without blocking first: an uncontended take costs that try and a
+ * table lookup. A contended one notes the holder
+ * (xSemaphoreGetMutexHolder()) and both priorities before it blocks, and
+ * the time it blocked once it has the mutex. A wait is an inversion when
+ * the holder's priority was below the waiter's: a higher priority task
+ * stood still while a lower one ran its critical section, plus whatever
+ * ran above the holder before priority inheritance raised it. Per mutex:
+ *  - wait_ns:       every contended take
+ *  - inversion_ns:  the inversions among them
+ * as latency histograms (lathist/lat_hist.h), and the counts of takes,
+ * contended takes, inversions and timeouts. Exported through metrics as
+ * "mutex.<name>.wait_ns" and ".inversion_ns" (histograms), ".takes",
+ * ".contended", ".inversions", ".timeouts" and ".inversion_max_ns".
+ *
+ * An inversion of MUTEX_MON_LOG_US or more is logged with the holder and
+ * waiter tasks and priorities, tag "MUTEX": the worst one since the last
+ * report, by a work pool job, since the waiter may hold the logger's own
+ * mutexes. Reports while the job runs wait for the next inversion.
+ *
+ * Registered by their owners: the core lock and lwIP's protection mutex
+ * in sys_arch.c, the syslog and line mutexes in syslog.c. Takes that do
+ * not go through mutex_mon_take() are not seen.
+ */
+
+#pragma once
+
+#ifndef MUTEX_MON_H
+#define MUTEX_MON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+#ifndef MUTEX_MON
+#define MUTEX_MON 1
+#endif
+
+/* Mutexes mutex_mon_register() accepts */
+#ifndef MUTEX_MON_MAX
+#define MUTEX_MON_MAX 8U
+#endif
+
+/* Inversions this long or longer are logged, 0: none */
+#ifndef MUTEX_MON_LOG_US
+#define MUTEX_MON_LOG_US 1000U
+#endif
+
+#if MUTEX_MON
+
+/* Starts monitoring m, a non-recursive mutex, under name, which must
+ * outlive the registry. Any task, or before the scheduler; the core lock
+ * not held once mutex_mon_init() has run. False when the table is full. */
+bool mutex_mon_register(SemaphoreHandle_t m, const char* name);
+
+/* Exports the mutexes registered so far and those to come. Call once from
+ * a task after metrics_init(). */
+void mutex_mon_init(void);
+
+/* xSemaphoreTake() of a mutex, measured if it is registered */
+BaseType_t mutex_mon_take(SemaphoreHandle_t m, TickType_t timeout);
+
+#else
+
+#define mutex_mon_take(m, timeout) xSemaphoreTake((m), (timeout))
+
+#endif /* MUTEX_MON */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MUTEX_MON_H */
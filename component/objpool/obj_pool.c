@@ -0,0 +1,129 @@
+/**
+ * @file obj_pool.c
+ * @brief Lock-free typed object pools, see obj_pool.h.
+ */
+
+#include "obj_pool.h"
+
+#include "metrics/metrics.h"
+
+#include <stdio.h>
+
+#define OBJ_POOL_INDEX(h)   ((h) & 0xFFFFU)
+#define OBJ_POOL_TAG(h)     ((h) & 0xFFFF0000U)
+#define OBJ_POOL_TAG_STEP   0x10000U
+
+static ObjPool_t* obj_pools[OBJ_POOL_MAX_REGISTERED];
+static uint32_t obj_pool_count;
+
+static void obj_pool_count_used(ObjPool_t* pool)
+{
+    uint32_t used = __atomic_add_fetch(&pool->used, 1U, __ATOMIC_RELAXED);
+    uint32_t max = __atomic_load_n(&pool->max, __ATOMIC_RELAXED);
+
+    while (used > max && !__atomic_compare_exchange_n(&pool->max, &max, used, true, __ATOMIC_RELAXED,
+                                                      __ATOMIC_RELAXED)) {
+    }
+}
+
+void* obj_pool_alloc(ObjPool_t* pool)
+{
+    uint32_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    uint32_t i;
+
+    for (;;) {
+        uint32_t top = OBJ_POOL_INDEX(head);
+        uint32_t next;
+
+        if (top == 0U) {
+            break;
+        }
+        /* Stale when top was taken meanwhile; the tag then fails the swap */
+        next = __atomic_load_n(&pool->next[top - 1U], __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&pool->head, &head, OBJ_POOL_TAG(head) | next, true,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            i = top - 1U;
+            goto taken;
+        }
+    }
+
+    /* Free list empty: an object never handed out, if any is left */
+    i = __atomic_load_n(&pool->bump, __ATOMIC_RELAXED);
+    do {
+        if (i >= pool->count) {
+            __atomic_add_fetch(&pool->fails, 1U, __ATOMIC_RELAXED);
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n(&pool->bump, &i, i + 1U, true, __ATOMIC_RELAXED,
+                                          __ATOMIC_RELAXED));
+
+taken:
+    __atomic_store_n(&pool->state[i], 1U, __ATOMIC_RELAXED);
+    obj_pool_count_used(pool);
+    return pool->base + i * pool->stride;
+}
+
+bool obj_pool_free(ObjPool_t* pool, void* obj)
+{
+    uintptr_t off = (uintptr_t)obj - (uintptr_t)pool->base;
+    uint32_t i = (uint32_t)(off / pool->stride);
+    uint32_t head;
+
+    if (obj == NULL) {
+        return true;
+    }
+    /* Outside the pool (off wraps below base), not at an object start, or
+     * not allocated: nothing to give back */
+    if (off % pool->stride != 0U || i >= pool->count ||
+        __atomic_exchange_n(&pool->state[i], 0U, __ATOMIC_RELAXED) == 0U) {
+        __atomic_add_fetch(&pool->bad_frees, 1U, __ATOMIC_RELAXED);
+        return false;
+    }
+    __atomic_sub_fetch(&pool->used, 1U, __ATOMIC_RELAXED);
+
+    head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(&pool->next[i], (uint16_t)OBJ_POOL_INDEX(head), __ATOMIC_RELAXED);
+        /* The object and its next index are written before it is published */
+    } while (!__atomic_compare_exchange_n(&pool->head, &head,
+                                          (OBJ_POOL_TAG(head) + OBJ_POOL_TAG_STEP) | (i + 1U), true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return true;
+}
+
+#if METRICS
+/* Runs on the tcpip thread; counters only */
+static void obj_pool_metrics(MetricsWriter_t* w)
+{
+    char name[METRICS_NAME_MAX];
+    uint32_t count = __atomic_load_n(&obj_pool_count, __ATOMIC_ACQUIRE);
+
+    for (uint32_t i = 0U; i < count; i++) {
+        const ObjPool_t* p = obj_pools[i];
+
+        snprintf(name, sizeof(name), "pool.%s.used", p->name);
+        metrics_emit(w, name, METRIC_GAUGE, p->used);
+        snprintf(name, sizeof(name), "pool.%s.max", p->name);
+        metrics_emit(w, name, METRIC_GAUGE, p->max);
+        snprintf(name, sizeof(name), "pool.%s.fails", p->name);
+        metrics_emit(w, name, METRIC_COUNTER, p->fails);
+        snprintf(name, sizeof(name), "pool.%s.bad_frees", p->name);
+        metrics_emit(w, name, METRIC_COUNTER, p->bad_frees);
+    }
+}
+#endif
+
+bool obj_pool_register(ObjPool_t* pool)
+{
+    if (obj_pool_count >= OBJ_POOL_MAX_REGISTERED) {
+        return false;
+    }
+#if METRICS
+    if (obj_pool_count == 0U && !metrics_register_collector(obj_pool_metrics)) {
+        return false;
+    }
+#endif
+    obj_pools[obj_pool_count] = pool;
+    __atomic_store_n(&obj_pool_count, obj_pool_count + 1U, __ATOMIC_RELEASE);
+    return true;
+}
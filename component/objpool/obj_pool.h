@@ -0,0 +1,118 @@
+/**
+ * @file obj_pool.h
+ * @brief Typed static object pools: messages and buffers without the heap.
+ *
+ * OBJ_POOL_DEFINE(var, type, n) reserves n objects of type and defines
+ * var_alloc() and var_free() typed for them, in the manner of lwIP's
+ * LWIP_MEMPOOL_DECLARE() but for application objects that would otherwise
+ * come from pvPortMalloc(). Every object starts on an OBJ_POOL_ALIGN
+ * boundary, the 32-byte D-cache line of the M7: cleaning or invalidating
+ * one for DMA never touches a neighbour, and two tasks filling neighbouring
+ * objects do not share a line. OBJ_POOL_DEFINE_IN() adds an attribute for
+ * the storage, e.g. DTCM_BSS for objects only the CPU touches; the default
+ * is .bss in AXI SRAM, which DMA reaches.
+ *
+ * Allocation and free are O(1), lock-free and usable from interrupts. The
+ * free objects are a stack of indices whose head word holds the top index
+ * and a tag, changed by compare-and-swap (LDREX/STREX on the M7). Every
+ * push changes the tag, so a pop that read its next index before the top
+ * was taken and given back fails and starts over (ABA) instead of linking
+ * in a stale index. Objects never handed out yet come from a bump index:
+ * a pool needs no init call.
+ *
+ * Ownership is single and moves with the pointer: whoever allocates fills
+ * the object and passes the pointer on (a queue of pointers, a task
+ * notification value, a custom pbuf) without touching it again, and the
+ * last holder frees it. C has no move-only handles, so the pool checks
+ * what it can: a free of a pointer that is not an allocated object of
+ * the pool (a double free, a pointer into the middle, another pool's) is
+ * refused and counted instead of corrupting the free list.
+ *
+ * obj_pool_register() exports a pool through metrics as
+ * "pool.<name>.used", ".max", ".fails" and ".bad_frees".
+ */
+
+#pragma once
+
+#ifndef OBJ_POOL_H
+#define OBJ_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Object alignment and size granule, the M7 D-cache line */
+#ifndef OBJ_POOL_ALIGN
+#define OBJ_POOL_ALIGN 32U
+#endif
+
+/* Pools obj_pool_register() can export */
+#ifndef OBJ_POOL_MAX_REGISTERED
+#define OBJ_POOL_MAX_REGISTERED 8U
+#endif
+
+typedef struct {
+    const char* name;
+    uint8_t* base;
+    uint16_t* next;             /* per object: index + 1 of the next free one */
+    volatile uint8_t* state;    /* per object: 1 while allocated */
+    uint32_t stride;
+    uint32_t count;
+    volatile uint32_t head;     /* tag << 16 | index + 1 of the top, 0: empty */
+    volatile uint32_t bump;     /* objects from here on never allocated */
+    volatile uint32_t used;
+    volatile uint32_t max;
+    volatile uint32_t fails;    /* allocations refused, pool empty */
+    volatile uint32_t bad_frees;
+} ObjPool_t;
+
+/* n objects of type in .bss, attr (may be empty) on their storage */
+#define OBJ_POOL_DEFINE_IN(var, type, n, attr)                                        \
+    _Static_assert((n) > 0 && (n) < 0xFFFF, "OBJ_POOL " #var ": 1 to 65534 objects"); \
+    typedef union {                                                                   \
+        type obj;                                                                     \
+        uint8_t raw[sizeof(type)];                                                    \
+    } __attribute__((aligned(OBJ_POOL_ALIGN))) var##_slot_t;                          \
+    static var##_slot_t var##_mem[(n)] attr;                                          \
+    static uint16_t var##_next[(n)];                                                  \
+    static uint8_t var##_state[(n)];                                                  \
+    static ObjPool_t var = { .name = #var, .base = (uint8_t*)var##_mem,               \
+                             .next = var##_next, .state = var##_state,                \
+                             .stride = sizeof(var##_slot_t), .count = (n) };          \
+    static inline type* var##_alloc(void)                                             \
+    {                                                                                 \
+        return (type*)obj_pool_alloc(&var);                                           \
+    }                                                                                 \
+    static inline bool var##_free(type* obj)                                          \
+    {                                                                                 \
+        return obj_pool_free(&var, obj);                                              \
+    }
+
+#define OBJ_POOL_DEFINE(var, type, n) OBJ_POOL_DEFINE_IN(var, type, n, )
+
+/* An object, OBJ_POOL_ALIGN aligned and not zeroed; NULL when all are in
+ * use. Any context. */
+void* obj_pool_alloc(ObjPool_t* pool);
+
+/* Gives obj back; false (and bad_frees counted) when it is not an
+ * allocated object of pool. NULL is accepted and ignored. Any context. */
+bool obj_pool_free(ObjPool_t* pool, void* obj);
+
+/* Objects allocated now */
+static inline uint32_t obj_pool_used(const ObjPool_t* pool)
+{
+    return pool->used;
+}
+
+/* Exports the pool's counters through metrics; from a task, after
+ * metrics_init() */
+bool obj_pool_register(ObjPool_t* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OBJ_POOL_H */
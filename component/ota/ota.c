@@ -0,0 +1,525 @@
+/**
+ * @file ota.c
+ * @brief Firmware update streamed over TCP into the inactive flash bank,
+ *        see ota.h.
+ */
+
+#include "ota.h"
+
+#if OTA
+
+#include "chksum/crc32.h"
+#include "metrics/metrics.h"
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "lwip/tcpip.h"
+#include "lwip/tcp.h"
+#include "lwip/pbuf.h"
+#include "lwip/def.h"
+
+#include <string.h>
+#include <stdio.h>
+
+#if (OTA_RING_SIZE & (OTA_RING_SIZE - 1U)) != 0U
+#error "OTA_RING_SIZE must be a power of two"
+#endif
+
+#define OTA_TAG                 "OTA"
+/* tcp_poll() every second */
+#define OTA_POLL_INTERVAL       2U
+/* For the status line to reach the client before the reset */
+#define OTA_SWAP_DELAY_MS       500U
+#define OTA_WORDS               (OTA_FLASH_WORD / 4U)
+
+typedef struct {
+    /* tcpip thread */
+    struct tcp_pcb* pcb;
+    struct pbuf* held;          /* received, not yet in the ring */
+    uint8_t hdr[sizeof(OtaHdr_t)];
+    uint32_t hdr_len;           /* bytes of hdr received */
+    uint32_t received;          /* image bytes into the ring */
+    uint8_t idle;               /* polls without data */
+    bool active;                /* header taken, until the status line */
+    /* Shared, ring indices free running */
+    volatile uint32_t head;     /* written by the tcpip thread */
+    volatile uint32_t tail;     /* taken by the task */
+    volatile bool stalled;      /* held waits for room in the ring */
+    volatile uint32_t sessions; /* headers taken */
+    volatile bool abort;        /* connection gone */
+    uint32_t length;            /* of the header, set before sessions */
+    uint32_t crc;
+    uint32_t flags;
+    uint32_t start_ms;
+    /* OTA task */
+    uint32_t ms;                /* duration of the session */
+    uint32_t dirty;             /* sectors not known to be blank */
+    const char* result;         /* NULL: image written and checked */
+} Ota_t;
+
+static Ota_t ota;
+static uint8_t ota_ring[OTA_RING_SIZE];
+static uint32_t ota_word[2][OTA_WORDS];
+static TaskHandle_t ota_task_handle;
+static StaticTask_t ota_tcb;
+static StackType_t ota_stack[OTA_STACK_WORDS];
+static struct tcpip_callback_msg* ota_resume_msg;
+static struct tcpip_callback_msg* ota_done_msg;
+
+static Metric_t ota_updates = METRIC_COUNTER_INIT("ota.updates");
+static Metric_t ota_failed = METRIC_COUNTER_INIT("ota.failed");
+static Metric_t ota_refused = METRIC_COUNTER_INIT("ota.refused");
+static Metric_t ota_bytes = METRIC_COUNTER_INIT("ota.bytes");
+static Metric_t ota_erases = METRIC_COUNTER_INIT("ota.erases");
+static Metric_t ota_erase_waits = METRIC_COUNTER_INIT("ota.erase_waits");
+static Metric_t ota_ring_full = METRIC_COUNTER_INIT("ota.ring_full");
+static Metric_t ota_last_ms = METRIC_GAUGE_INIT("ota.last_ms");
+static Metric_t ota_last_kbps = METRIC_GAUGE_INIT("ota.last_kbps");
+
+/*---------------------------------------------------------------------------*/
+/* tcpip thread */
+
+static void ota_reply(struct tcp_pcb* pcb, const char* line)
+{
+    (void)tcp_write(pcb, line, (u16_t)strlen(line), TCP_WRITE_FLAG_COPY);
+    (void)tcp_output(pcb);
+}
+
+/* Drops the connection, its unconsumed data with it; a session still
+ * running is told to stop. ERR_ABRT when the pcb had to be aborted. */
+static err_t ota_close(void)
+{
+    struct tcp_pcb* pcb = ota.pcb;
+
+    if (ota.held != NULL) {
+        pbuf_free(ota.held);
+        ota.held = NULL;
+    }
+    if (ota.active) {
+        ota.abort = true;
+        xTaskNotifyGive(ota_task_handle);
+    }
+    if (pcb == NULL) {
+        return ERR_OK;
+    }
+    ota.pcb = NULL;
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, NULL);
+    tcp_poll(pcb, NULL, 0);
+    tcp_err(pcb, NULL);
+    if (tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+        return ERR_ABRT;
+    }
+    return ERR_OK;
+}
+
+/* Takes the header off the held data; false after refusing it */
+static bool ota_header(void)
+{
+    OtaHdr_t h;
+    u16_t n = (u16_t)LWIP_MIN(ota.held->tot_len, sizeof(ota.hdr) - ota.hdr_len);
+
+    (void)pbuf_copy_partial(ota.held, &ota.hdr[ota.hdr_len], n, 0U);
+    ota.hdr_len += n;
+    ota.held = pbuf_free_header(ota.held, n);
+    tcp_recved(ota.pcb, n);
+    if (ota.hdr_len < sizeof(ota.hdr)) {
+        return true;
+    }
+
+    memcpy(&h, ota.hdr, sizeof(h));
+    if (lwip_ntohl(h.magic) != OTA_MAGIC) {
+        ota_reply(ota.pcb, "error magic\n");
+        return false;
+    }
+    ota.length = lwip_ntohl(h.length);
+    if (ota.length == 0U || ota.length > OTA_FLASH_SIZE) {
+        ota_reply(ota.pcb, "error length\n");
+        return false;
+    }
+    ota.crc = lwip_ntohl(h.crc);
+    ota.flags = lwip_ntohl(h.flags);
+    ota.received = 0U;
+    ota.head = 0U;
+    ota.tail = 0U;
+    ota.abort = false;
+    ota.start_ms = sys_now();
+    ota.active = true;
+    __atomic_store_n(&ota.sessions, ota.sessions + 1U, __ATOMIC_RELEASE);
+    xTaskNotifyGive(ota_task_handle);
+    LOG_INFO(OTA_TAG, "receiving %lu bytes", (unsigned long)ota.length);
+    return true;
+}
+
+/* Moves held data into the ring as far as it has room, giving the window
+ * back for every byte taken */
+static err_t ota_pump(void)
+{
+    while (ota.held != NULL && ota.pcb != NULL) {
+        uint32_t head = ota.head;
+        uint32_t room;
+        uint32_t off;
+        uint32_t n;
+
+        if (!ota.active) {
+            if (ota.hdr_len == sizeof(ota.hdr)) {
+                /* Finished: anything more is not part of the image */
+                tcp_recved(ota.pcb, ota.held->tot_len);
+                pbuf_free(ota.held);
+                ota.held = NULL;
+                break;
+            }
+            if (!ota_header()) {
+                return ota_close();
+            }
+            continue;
+        }
+        if (ota.received == ota.length) {
+            tcp_recved(ota.pcb, ota.held->tot_len);
+            pbuf_free(ota.held);
+            ota.held = NULL;
+            break;
+        }
+
+        room = OTA_RING_SIZE - (head - __atomic_load_n(&ota.tail, __ATOMIC_ACQUIRE));
+        if (room == 0U) {
+            if (!ota.stalled) {
+                metric_inc(&ota_ring_full);
+                ota.stalled = true;
+            }
+            break;
+        }
+        n = LWIP_MIN(LWIP_MIN(room, ota.held->tot_len), ota.length - ota.received);
+        off = head & (OTA_RING_SIZE - 1U);
+        if (n > OTA_RING_SIZE - off) {
+            n = OTA_RING_SIZE - off;
+        }
+        (void)pbuf_copy_partial(ota.held, &ota_ring[off], (u16_t)n, 0U);
+        __atomic_store_n(&ota.head, head + n, __ATOMIC_RELEASE);
+        ota.received += n;
+        ota.held = pbuf_free_header(ota.held, (u16_t)n);
+        tcp_recved(ota.pcb, (u16_t)n);
+        xTaskNotifyGive(ota_task_handle);
+    }
+    return ERR_OK;
+}
+
+/* tcpip callback: the task made room in the ring */
+static void ota_resume(void* arg)
+{
+    LWIP_UNUSED_ARG(arg);
+    if (ota.held != NULL) {
+        (void)ota_pump();
+    }
+}
+
+/* tcpip callback: the task finished the session */
+static void ota_done(void* arg)
+{
+    char line[48];
+
+    LWIP_UNUSED_ARG(arg);
+    if (ota.pcb != NULL) {
+        if (ota.result == NULL) {
+            (void)snprintf(line, sizeof(line), "ok %lu %lu\n", (unsigned long)ota.length,
+                           (unsigned long)ota.ms);
+        } else {
+            (void)snprintf(line, sizeof(line), "error %s\n", ota.result);
+        }
+        ota_reply(ota.pcb, line);
+        (void)ota_close();
+    }
+    ota.active = false;
+}
+
+static err_t ota_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    LWIP_UNUSED_ARG(arg);
+    LWIP_UNUSED_ARG(pcb);
+    if (p == NULL || err != ERR_OK) {
+        if (p != NULL) {
+            pbuf_free(p);
+        }
+        return ota_close();
+    }
+    ota.idle = 0U;
+    if (ota.held == NULL) {
+        ota.held = p;
+    } else {
+        pbuf_cat(ota.held, p);
+    }
+    return ota_pump();
+}
+
+static err_t ota_poll(void* arg, struct tcp_pcb* pcb)
+{
+    LWIP_UNUSED_ARG(arg);
+    LWIP_UNUSED_ARG(pcb);
+    /* Waiting on the ring is not the client's silence */
+    if (ota.held != NULL) {
+        ota.idle = 0U;
+        return ERR_OK;
+    }
+    if (++ota.idle >= OTA_IDLE_S) {
+        LOG_WARNING(OTA_TAG, "client silent, dropped");
+        return ota_close();
+    }
+    return ERR_OK;
+}
+
+static void ota_err(void* arg, err_t err)
+{
+    LWIP_UNUSED_ARG(arg);
+    LWIP_UNUSED_ARG(err);
+    /* The pcb is gone */
+    ota.pcb = NULL;
+    (void)ota_close();
+}
+
+static err_t ota_accept(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+    LWIP_UNUSED_ARG(arg);
+    if (err != ERR_OK || pcb == NULL) {
+        return ERR_VAL;
+    }
+    if (ota.pcb != NULL || ota.active) {
+        metric_inc(&ota_refused);
+        return ERR_MEM;
+    }
+    ota.pcb = pcb;
+    ota.held = NULL;
+    ota.hdr_len = 0U;
+    ota.idle = 0U;
+    ota.stalled = false;
+    tcp_arg(pcb, NULL);
+    tcp_recv(pcb, ota_recv);
+    tcp_poll(pcb, ota_poll, OTA_POLL_INTERVAL);
+    tcp_err(pcb, ota_err);
+    return ERR_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/* OTA task */
+
+static bool ota_blank(uint32_t sector)
+{
+    const uint32_t* p = (const uint32_t*)(const void*)ota_flash_map(sector * OTA_FLASH_SECTOR_SIZE,
+                                                                      OTA_FLASH_SECTOR_SIZE);
+
+    for (uint32_t i = 0U; i < OTA_FLASH_SECTOR_SIZE / 4U; i++) {
+        if (p[i] != 0xFFFFFFFFUL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Erases a sector unless it is blank already, the task sleeping meanwhile */
+static bool ota_erase(uint32_t sector)
+{
+    if ((ota.dirty & (1UL << sector)) == 0U) {
+        return true;
+    }
+    if (!ota_blank(sector)) {
+        ota_flash_erase(sector);
+        while (ota_flash_busy()) {
+            vTaskDelay(1);
+        }
+        metric_inc(&ota_erases);
+        if (ota_flash_errors() != 0U) {
+            return false;
+        }
+    }
+    ota.dirty &= ~(1UL << sector);
+    return true;
+}
+
+/* Waits for n bytes in the ring; false when the session was aborted */
+static bool ota_wait_data(uint32_t n)
+{
+    while (__atomic_load_n(&ota.head, __ATOMIC_ACQUIRE) - ota.tail < n) {
+        if (ota.abort) {
+            return false;
+        }
+        (void)ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000U));
+    }
+    return !ota.abort;
+}
+
+/* n bytes of the ring into a staging word, the rest erased value */
+static void ota_gather(uint32_t* word, uint32_t n)
+{
+    uint8_t* dst = (uint8_t*)word;
+    uint32_t off = ota.tail & (OTA_RING_SIZE - 1U);
+    uint32_t first = LWIP_MIN(n, OTA_RING_SIZE - off);
+
+    memcpy(dst, &ota_ring[off], first);
+    memcpy(&dst[first], ota_ring, n - first);
+    memset(&dst[n], 0xFF, OTA_FLASH_WORD - n);
+    __atomic_store_n(&ota.tail, ota.tail + n, __ATOMIC_RELEASE);
+    if (__atomic_exchange_n(&ota.stalled, false, __ATOMIC_ACQ_REL)) {
+        if (tcpip_callbackmsg_trycallback(ota_resume_msg) != ERR_OK) {
+            ota.stalled = true;
+        }
+    }
+}
+
+static const char* ota_session(void)
+{
+    uint32_t off = 0U;
+    uint32_t buf = 0U;
+
+    while (off < ota.length) {
+        uint32_t n = LWIP_MIN(OTA_FLASH_WORD, ota.length - off);
+
+        if ((off % OTA_FLASH_SECTOR_SIZE) == 0U) {
+            uint32_t sector = off / OTA_FLASH_SECTOR_SIZE;
+
+            while (ota_flash_busy()) {
+            }
+            if ((ota.dirty & (1UL << sector)) != 0U) {
+                metric_inc(&ota_erase_waits);
+            }
+            if (!ota_erase(sector)) {
+                return "erase";
+            }
+            ota.dirty |= 1UL << sector;
+        }
+        if (!ota_wait_data(n)) {
+            return "aborted";
+        }
+        /* Gathered while the previous word programs */
+        ota_gather(ota_word[buf], n);
+        ota_flash_program(off, ota_word[buf]);
+        buf ^= 1U;
+        off += OTA_FLASH_WORD;
+    }
+    while (ota_flash_busy()) {
+    }
+    metric_add(&ota_bytes, ota.length);
+    if (ota_flash_errors() != 0U) {
+        return "program";
+    }
+    if (crc32_ieee(0U, ota_flash_map(0U, off), ota.length) != ota.crc) {
+        return "crc";
+    }
+    ota.ms = sys_now() - ota.start_ms;
+    metric_set(&ota_last_ms, ota.ms);
+    metric_set(&ota_last_kbps, (ota.ms != 0U) ? ota.length / ota.ms : ota.length);
+    return NULL;
+}
+
+static void ota_task(void* arg)
+{
+    TickType_t pre_erase = xTaskGetTickCount() + pdMS_TO_TICKS(OTA_PRE_ERASE_DELAY_S * 1000U);
+    uint32_t done = 0U;
+
+    (void)arg;
+    for (;;) {
+        if (__atomic_load_n(&ota.sessions, __ATOMIC_ACQUIRE) != done) {
+            done++;
+            ota.result = ota_session();
+            if (ota.result == NULL) {
+                metric_inc(&ota_updates);
+                LOG_INFO(OTA_TAG, "%lu bytes written in %lu ms", (unsigned long)ota.length,
+                         (unsigned long)ota.ms);
+            } else {
+                metric_inc(&ota_failed);
+                LOG_WARNING(OTA_TAG, "update failed: %s", ota.result);
+            }
+            /* Whatever the stream left unconsumed goes with the connection;
+             * the next one is accepted once the status line is out */
+            while (tcpip_callbackmsg_trycallback(ota_done_msg) != ERR_OK) {
+                vTaskDelay(1);
+            }
+            if (ota.result == NULL && (ota.flags & OTA_HDR_SWAP) != 0U) {
+                LOG_INFO(OTA_TAG, "swapping banks");
+                vTaskDelay(pdMS_TO_TICKS(OTA_SWAP_DELAY_MS));
+                ota_flash_swap();
+            }
+            continue;
+        }
+#if OTA_PRE_ERASE
+        if (ota.dirty != 0U) {
+            TickType_t now = xTaskGetTickCount();
+
+            if ((int32_t)(pre_erase - now) > 0) {
+                (void)ulTaskNotifyTake(pdTRUE, pre_erase - now);
+            } else {
+                uint32_t sector = (uint32_t)__builtin_ctz(ota.dirty);
+
+                /* One sector at a time, an update may start in between */
+                if (!ota_erase(sector)) {
+                    LOG_WARNING(OTA_TAG, "pre-erase of sector %lu failed", (unsigned long)sector);
+                    pre_erase = portMAX_DELAY;
+                }
+            }
+            continue;
+        }
+#else
+        (void)pre_erase;
+#endif
+        (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+
+bool ota_start(void)
+{
+    struct tcp_pcb* pcb;
+    struct tcp_pcb* lpcb = NULL;
+
+    if (ota_task_handle != NULL) {
+        return false;
+    }
+    if (!ota_flash_init()) {
+        LOG_ERROR(OTA_TAG, "flash locked");
+        return false;
+    }
+    ota.dirty = (1UL << OTA_FLASH_SECTORS) - 1U;
+
+    (void)metrics_register(&ota_updates);
+    (void)metrics_register(&ota_failed);
+    (void)metrics_register(&ota_refused);
+    (void)metrics_register(&ota_bytes);
+    (void)metrics_register(&ota_erases);
+    (void)metrics_register(&ota_erase_waits);
+    (void)metrics_register(&ota_ring_full);
+    (void)metrics_register(&ota_last_ms);
+    (void)metrics_register(&ota_last_kbps);
+
+    /* Before a connection can notify it */
+    ota_task_handle = xTaskCreateStatic(ota_task, "OTA", OTA_STACK_WORDS, NULL, OTA_PRIORITY, ota_stack,
+                                        &ota_tcb);
+    if (ota_task_handle == NULL) {
+        LOG_ERROR(OTA_TAG, "no task");
+        return false;
+    }
+
+    LOCK_TCPIP_CORE();
+    ota_resume_msg = tcpip_callbackmsg_new(ota_resume, NULL);
+    ota_done_msg = tcpip_callbackmsg_new(ota_done, NULL);
+    pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+    if (pcb != NULL && ota_resume_msg != NULL && ota_done_msg != NULL) {
+        if (tcp_bind(pcb, IP_ANY_TYPE, OTA_PORT) == ERR_OK) {
+            lpcb = tcp_listen_with_backlog(pcb, 1U);
+        }
+        if (lpcb == NULL) {
+            tcp_close(pcb);
+        } else {
+            tcp_accept(lpcb, ota_accept);
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+    if (lpcb == NULL) {
+        LOG_ERROR(OTA_TAG, "no listener on port %u", (unsigned)OTA_PORT);
+        return false;
+    }
+    LOG_INFO(OTA_TAG, "listening on port %u, %lu KB bank", (unsigned)OTA_PORT,
+             (unsigned long)(OTA_FLASH_SIZE / 1024U));
+    return true;
+}
+
+#endif /* OTA */
@@ -0,0 +1,127 @@
+/**
+ * @file ota.h
+ * @brief Firmware update streamed over TCP into the inactive flash bank.
+ *
+ * A client connects to OTA_PORT and sends an OtaHdr_t, then the image. The
+ * receive callback, on the tcpip thread, copies the segments into a ring of
+ * OTA_RING_SIZE bytes and gives the window back (tcp_recved()) for every
+ * byte copied, so the window stays open as long as the ring has room;
+ * segments that do not fit stay queued in lwIP until the ring drains, which
+ * is the only backpressure the client sees.
+ *
+ * The OTA task, below the tcpip thread, empties the ring into flash one
+ * 32-byte flash word at a time: while one word is being programmed it
+ * gathers the next from the ring into the second of two staging buffers,
+ * and only then waits for the first to leave the write queue. Erase and
+ * program cannot overlap within a bank, so erasing is kept off the stream
+ * instead: with OTA_PRE_ERASE the task erases the inactive bank while no
+ * update runs, and a sector that is not blank yet is erased ahead of the
+ * data, the ring filling meanwhile. A pre-erased bank is programmed at the
+ * flash word rate, the link no longer waiting on erase.
+ *
+ * At the end the image is read back from flash and its CRC-32 checked
+ * against the header; one status line answers the client
+ * ("ok <bytes> <ms>\n" or "error <reason>\n") and the connection closes.
+ * OTA_HDR_SWAP then swaps the banks (option byte SWAP_BANK) and resets into
+ * the new image. One update at a time; further connections are refused.
+ * Exported through metrics as "ota.*". tools/ota_send.py is a client.
+ *
+ * The flash itself is behind the ota_flash_*() functions: ota_flash_h7.c
+ * for bank 2 of the STM32H743, host/port/ota_flash_mem.c in memory.
+ */
+
+#pragma once
+
+#ifndef OTA_H
+#define OTA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 0 leaves the update receiver out of the startup code */
+#ifndef OTA
+#define OTA 1
+#endif
+
+#ifndef OTA_PORT
+#define OTA_PORT 5800U
+#endif
+
+/* Received image not yet in flash, a power of two; at least TCP_WND keeps
+ * the window fully open while the task keeps up */
+#ifndef OTA_RING_SIZE
+#define OTA_RING_SIZE 32768U
+#endif
+
+/* Erase the inactive bank while no update runs. This gives up the image
+ * that bank held, the previous firmware after a swap. */
+#ifndef OTA_PRE_ERASE
+#define OTA_PRE_ERASE 1
+#endif
+
+/* Seconds after startup before the pre-erase begins */
+#ifndef OTA_PRE_ERASE_DELAY_S
+#define OTA_PRE_ERASE_DELAY_S 10U
+#endif
+
+/* A client silent this long is dropped, in seconds */
+#ifndef OTA_IDLE_S
+#define OTA_IDLE_S 10U
+#endif
+
+/* osPriorityBelowNormal, see configOS2_TO_RTOS_PRIO(): below the tcpip
+ * thread, which must keep filling the ring while the task programs */
+#ifndef OTA_PRIORITY
+#define OTA_PRIORITY 8
+#endif
+
+#ifndef OTA_STACK_WORDS
+#define OTA_STACK_WORDS 256U
+#endif
+
+/* Inactive bank geometry */
+#define OTA_FLASH_WORD          32U
+#define OTA_FLASH_SECTOR_SIZE   (128U * 1024U)
+#define OTA_FLASH_SECTORS       8U
+#define OTA_FLASH_SIZE          (OTA_FLASH_SECTORS * OTA_FLASH_SECTOR_SIZE)
+
+#define OTA_MAGIC               0x4F544131UL    /* "OTA1" */
+#define OTA_HDR_SWAP            0x00000001UL    /* swap banks and reset */
+
+/* First bytes of a connection, network byte order, the image follows */
+typedef struct __attribute__((packed)) {
+    uint32_t magic;         /* OTA_MAGIC */
+    uint32_t length;        /* image bytes, at most OTA_FLASH_SIZE */
+    uint32_t crc;           /* CRC-32 (IEEE 802.3) of the image */
+    uint32_t flags;         /* OTA_HDR_* */
+} OtaHdr_t;
+
+/* Binds OTA_PORT and starts the task; from a task, core lock not held */
+bool ota_start(void);
+
+/* The inactive bank, one implementation per platform; all but
+ * ota_flash_init() on the OTA task */
+bool ota_flash_init(void);
+/* Read access to len bytes of the bank from offset, both multiples of
+ * OTA_FLASH_WORD, as programmed: for the blank check and the CRC */
+const uint8_t* ota_flash_map(uint32_t offset, uint32_t len);
+/* Starts erasing a sector and returns; ota_flash_busy() until done */
+void ota_flash_erase(uint32_t sector);
+/* Queues one flash word at offset, a multiple of OTA_FLASH_WORD, once the
+ * previous one has left the write queue */
+void ota_flash_program(uint32_t offset, const uint32_t* word);
+bool ota_flash_busy(void);
+/* Error flags of the last operations, cleared */
+uint32_t ota_flash_errors(void);
+/* Boots from the inactive bank next: does not return */
+void ota_flash_swap(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OTA_H */
@@ -0,0 +1,98 @@
+/**
+ * @file ota_flash_h7.c
+ * @brief The inactive bank of the STM32H743 for ota.c: the bank at
+ *        FLASH_BANK2_BASE, see ota.h.
+ *
+ * With SWAP_BANK set the two banks trade addresses, and the FLASH_xxx2
+ * registers follow the address, so the bank not running is always the one
+ * at 0x08100000 driven through CR2/SR2. Only bank 2 is unlocked: a stray
+ * write to the running image faults instead of programming it.
+ *
+ * Erase and program are started here and left running (FLASH_Erase_Sector()
+ * returns once the erase is started); only a flash word queued while the
+ * previous one still occupies the write queue waits, for at most one word
+ * programming time.
+ */
+
+#include "ota.h"
+
+#if OTA
+
+#include "main.h"
+
+#define OTA_FLASH_ERRORS (FLASH_FLAG_ALL_ERRORS_BANK2 & 0x7FFFFFFFU)
+
+bool ota_flash_init(void)
+{
+    if (HAL_FLASHEx_Unlock_Bank2() != HAL_OK) {
+        return false;
+    }
+    WRITE_REG(FLASH->CCR2, OTA_FLASH_ERRORS);
+    return true;
+}
+
+const uint8_t* ota_flash_map(uint32_t offset, uint32_t len)
+{
+    /* The D-cache may hold what was read before the erase or the program */
+    SCB_InvalidateDCache_by_Addr((void*)(FLASH_BANK2_BASE + offset), (int32_t)len);
+    return (const uint8_t*)(FLASH_BANK2_BASE + offset);
+}
+
+void ota_flash_erase(uint32_t sector)
+{
+    while ((FLASH->SR2 & FLASH_SR_QW) != 0U) {
+    }
+    CLEAR_BIT(FLASH->CR2, FLASH_CR_PG);
+    FLASH_Erase_Sector(sector, FLASH_BANK_2, FLASH_VOLTAGE_RANGE_3);
+}
+
+void ota_flash_program(uint32_t offset, const uint32_t* word)
+{
+    volatile uint32_t* dst = (volatile uint32_t*)(FLASH_BANK2_BASE + offset);
+
+    /* The previous word still being programmed, 16 us typical */
+    while ((FLASH->SR2 & FLASH_SR_QW) != 0U) {
+    }
+    SET_BIT(FLASH->CR2, FLASH_CR_PG);
+    __ISB();
+    __DSB();
+    for (uint32_t i = 0U; i < OTA_FLASH_WORD / 4U; i++) {
+        dst[i] = word[i];
+    }
+    __ISB();
+    __DSB();
+}
+
+bool ota_flash_busy(void)
+{
+    if ((FLASH->SR2 & FLASH_SR_QW) != 0U) {
+        return true;
+    }
+    CLEAR_BIT(FLASH->CR2, FLASH_CR_PG | FLASH_CR_SER | FLASH_CR_SNB);
+    return false;
+}
+
+uint32_t ota_flash_errors(void)
+{
+    uint32_t err = FLASH->SR2 & OTA_FLASH_ERRORS;
+
+    WRITE_REG(FLASH->CCR2, err);
+    return err;
+}
+
+void ota_flash_swap(void)
+{
+    FLASH_OBProgramInitTypeDef ob = { 0 };
+
+    HAL_FLASHEx_OBGetConfig(&ob);
+    ob.OptionType = OPTIONBYTE_USER;
+    ob.USERType = OB_USER_SWAP_BANK;
+    ob.USERConfig = ((ob.USERConfig & OB_SWAP_BANK_ENABLE) != 0U) ? OB_SWAP_BANK_DISABLE : OB_SWAP_BANK_ENABLE;
+    (void)HAL_FLASH_OB_Unlock();
+    if (HAL_FLASHEx_OBProgram(&ob) == HAL_OK) {
+        (void)HAL_FLASH_OB_Launch();
+    }
+    NVIC_SystemReset();
+}
+
+#endif /* OTA */
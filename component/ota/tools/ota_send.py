@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Firmware update client: streams an image to the board's OTA receiver.
+
+Sends the header of component/ota/ota.h (magic, length, CRC-32, flags) and
+the image on one connection, then prints the status line the board answers
+with once the image is in flash and checked, and the rate seen from here.
+
+    ota_send.py 192.168.7.2 firmware.bin [--port 5800] [--swap]
+    ota_send.py 192.168.7.2 --random 1048576
+
+--swap has the board boot the new image; --random sends that many random
+bytes instead of a file, for measuring.
+"""
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import time
+import zlib
+
+OTA_MAGIC = 0x4F544131
+OTA_HDR_SWAP = 0x00000001
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("host")
+    ap.add_argument("image", nargs="?")
+    ap.add_argument("--port", type=int, default=5800)
+    ap.add_argument("--swap", action="store_true")
+    ap.add_argument("--random", type=int, default=0)
+    args = ap.parse_args()
+
+    if args.random:
+        data = os.urandom(args.random)
+    elif args.image:
+        with open(args.image, "rb") as f:
+            data = f.read()
+    else:
+        ap.error("an image or --random")
+    flags = OTA_HDR_SWAP if args.swap else 0
+    hdr = struct.pack("!IIII", OTA_MAGIC, len(data), zlib.crc32(data) & 0xFFFFFFFF, flags)
+
+    t0 = time.monotonic()
+    sock = socket.create_connection((args.host, args.port))
+    sock.sendall(hdr + data)
+    t_sent = time.monotonic()
+    reply = b""
+    while not reply.endswith(b"\n"):
+        chunk = sock.recv(256)
+        if not chunk:
+            break
+        reply += chunk
+    t_done = time.monotonic()
+    sock.close()
+
+    line = reply.decode(errors="replace").strip()
+    print("%s" % (line or "no reply"))
+    print("bytes=%d sent_s=%.3f done_s=%.3f kB/s=%.0f" % (
+        len(data), t_sent - t0, t_done - t0, len(data) / 1000.0 / max(t_done - t0, 1e-6)))
+    return 0 if line.startswith("ok") else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,414 @@
+/**
+ * @file pcap_ring.c
+ * @brief Frame capture ring and its read-only TFTP server.
+ */
+
+#include "pcap_ring.h"
+
+#if PCAP_RING
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+#include "lwip/udp.h"
+#include "lwip/pbuf.h"
+#include "lwip/def.h"
+#include "timesync/time_ns.h"
+
+#include <string.h>
+#include <strings.h>
+
+#define PCAP_TAG                "PCAP"
+#define PCAP_NS_PER_S           1000000000ULL
+
+#define PCAP_LINKTYPE_ETHERNET  1U
+#define PCAP_HDR_LEN            24U
+#define PCAP_REC_HDR_LEN        16U
+
+/* RFC 1350 */
+#define TFTP_RRQ                1U
+#define TFTP_WRQ                2U
+#define TFTP_DATA               3U
+#define TFTP_ACK                4U
+#define TFTP_ERROR              5U
+#define TFTP_ERR_UNDEF          0U
+#define TFTP_ERR_NOT_FOUND      1U
+#define TFTP_ERR_ACCESS         2U
+#define TFTP_BLOCK              512U
+#define TFTP_TIMEOUT_MS         1000U
+#define TFTP_RETRIES            5U
+
+typedef struct {
+    uint64_t ns;            /* time_utc_ns() */
+    uint16_t len;           /* on the wire */
+    uint16_t caplen;
+    uint32_t reserved;
+    uint8_t data[PCAP_RING_SNAPLEN];
+} PcapSlot_t;
+
+/* Changed in a critical section only: the taps run in the EthIf task and
+ * in whichever task transmits */
+typedef struct {
+    uint32_t head;          /* frames captured since pcap_ring_start() */
+    uint32_t post;          /* frames left after pcap_ring_trigger(), 0: none */
+    bool dumping;
+    bool resume;            /* capture again when the transfer ends */
+} PcapRing_t;
+
+/* TFTP transfer, on the tcpip thread */
+typedef struct {
+    struct udp_pcb* pcb;    /* NULL: idle */
+    uint16_t block;
+    uint8_t retries;
+    bool last;              /* the block in pkt is short, nothing follows */
+    bool header_done;
+    uint32_t next;          /* next slot, as a capture count */
+    uint32_t end;
+    uint16_t item_len;
+    uint16_t item_pos;
+    uint16_t pkt_len;
+    uint8_t item[PCAP_REC_HDR_LEN + PCAP_RING_SNAPLEN];
+    uint8_t pkt[4U + TFTP_BLOCK];
+} PcapTftp_t;
+
+volatile uint8_t pcap_ring_on;
+
+static PcapSlot_t pcap_slots[PCAP_RING_SLOTS] PCAP_RING_SECTION;
+static PcapRing_t pcap_ring;
+static PcapTftp_t pcap_tftp;
+static struct udp_pcb* pcap_listen;
+
+void pcap_ring_capture(const struct pbuf* p)
+{
+    taskENTER_CRITICAL();
+    /* Checked again: a stop may have come between the tap and here */
+    if (pcap_ring_on != 0U) {
+        PcapSlot_t* s = &pcap_slots[pcap_ring.head % PCAP_RING_SLOTS];
+
+        s->ns = time_utc_ns();
+        s->len = p->tot_len;
+        s->caplen = pbuf_copy_partial(p, s->data, PCAP_RING_SNAPLEN, 0);
+        pcap_ring.head++;
+        if (pcap_ring.post != 0U && --pcap_ring.post == 0U) {
+            pcap_ring_on = 0U;
+        }
+    }
+    taskEXIT_CRITICAL();
+}
+
+void pcap_ring_start(void)
+{
+    taskENTER_CRITICAL();
+    pcap_ring.head = 0U;
+    pcap_ring.post = 0U;
+    if (pcap_ring.dumping) {
+        pcap_ring.resume = true;
+    } else {
+        pcap_ring_on = 1U;
+    }
+    taskEXIT_CRITICAL();
+}
+
+void pcap_ring_stop(void)
+{
+    taskENTER_CRITICAL();
+    pcap_ring_on = 0U;
+    pcap_ring.resume = false;
+    pcap_ring.post = 0U;
+    taskEXIT_CRITICAL();
+}
+
+void pcap_ring_trigger(uint32_t frames)
+{
+    if (frames == 0U) {
+        pcap_ring_stop();
+        return;
+    }
+    taskENTER_CRITICAL();
+    if (pcap_ring.post == 0U) {
+        pcap_ring.post = frames;
+    }
+    taskEXIT_CRITICAL();
+}
+
+uint32_t pcap_ring_count(void)
+{
+    uint32_t head = pcap_ring.head;
+
+    return (head < PCAP_RING_SLOTS) ? head : PCAP_RING_SLOTS;
+}
+
+static void pcap_put32(uint8_t* dst, uint32_t v)
+{
+    /* Native order: readers tell it from the magic number */
+    memcpy(dst, &v, sizeof(v));
+}
+
+static void pcap_put16(uint8_t* dst, uint16_t v)
+{
+    memcpy(dst, &v, sizeof(v));
+}
+
+/* Next piece of the file into item; false at the end */
+static bool pcap_tftp_next_item(void)
+{
+    PcapTftp_t* t = &pcap_tftp;
+    uint8_t* b = t->item;
+
+    t->item_pos = 0U;
+    if (!t->header_done) {
+        pcap_put32(&b[0], 0xA1B2C3D4UL);
+        pcap_put16(&b[4], 2U);
+        pcap_put16(&b[6], 4U);
+        pcap_put32(&b[8], 0U);
+        pcap_put32(&b[12], 0U);
+        pcap_put32(&b[16], PCAP_RING_SNAPLEN);
+        pcap_put32(&b[20], PCAP_LINKTYPE_ETHERNET);
+        t->item_len = PCAP_HDR_LEN;
+        t->header_done = true;
+        return true;
+    }
+    if (t->next == t->end) {
+        t->item_len = 0U;
+        return false;
+    }
+
+    const PcapSlot_t* s = &pcap_slots[t->next % PCAP_RING_SLOTS];
+
+    pcap_put32(&b[0], (uint32_t)(s->ns / PCAP_NS_PER_S));
+    pcap_put32(&b[4], (uint32_t)((s->ns % PCAP_NS_PER_S) / 1000U));
+    pcap_put32(&b[8], s->caplen);
+    pcap_put32(&b[12], s->len);
+    memcpy(&b[PCAP_REC_HDR_LEN], s->data, s->caplen);
+    t->item_len = (uint16_t)(PCAP_REC_HDR_LEN + s->caplen);
+    t->next++;
+    return true;
+}
+
+/* Builds DATA block t->block; a short one is the last */
+static void pcap_tftp_fill(void)
+{
+    PcapTftp_t* t = &pcap_tftp;
+    uint16_t n = 0U;
+
+    while (n < TFTP_BLOCK) {
+        if (t->item_pos == t->item_len && !pcap_tftp_next_item()) {
+            break;
+        }
+        uint16_t k = (uint16_t)LWIP_MIN(TFTP_BLOCK - n, (uint32_t)(t->item_len - t->item_pos));
+        memcpy(&t->pkt[4U + n], &t->item[t->item_pos], k);
+        t->item_pos += k;
+        n += k;
+    }
+    t->pkt[0] = 0U;
+    t->pkt[1] = TFTP_DATA;
+    t->pkt[2] = (uint8_t)(t->block >> 8);
+    t->pkt[3] = (uint8_t)t->block;
+    t->pkt_len = (uint16_t)(4U + n);
+    t->last = (n < TFTP_BLOCK);
+}
+
+static void pcap_tftp_send(struct udp_pcb* pcb, const ip_addr_t* addr, u16_t port, const void* data, u16_t len)
+{
+    struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+
+    if (p == NULL) {
+        /* The peer times out and retransmits its request or ACK */
+        return;
+    }
+    (void)pbuf_take(p, data, len);
+    if (addr != NULL) {
+        (void)udp_sendto(pcb, p, addr, port);
+    } else {
+        (void)udp_send(pcb, p);
+    }
+    pbuf_free(p);
+}
+
+static void pcap_tftp_error(const ip_addr_t* addr, u16_t port, uint8_t code, const char* msg)
+{
+    uint8_t pkt[64];
+    size_t len = strlen(msg);
+
+    if (len > sizeof(pkt) - 5U) {
+        len = sizeof(pkt) - 5U;
+    }
+    pkt[0] = 0U;
+    pkt[1] = TFTP_ERROR;
+    pkt[2] = 0U;
+    pkt[3] = code;
+    memcpy(&pkt[4], msg, len);
+    pkt[4U + len] = '\0';
+    pcap_tftp_send(pcap_listen, addr, port, pkt, (u16_t)(len + 5U));
+}
+
+static void pcap_tftp_timer(void* arg);
+
+static void pcap_tftp_end(bool complete)
+{
+    PcapTftp_t* t = &pcap_tftp;
+
+    sys_untimeout(pcap_tftp_timer, NULL);
+    udp_remove(t->pcb);
+    t->pcb = NULL;
+    taskENTER_CRITICAL();
+    pcap_ring.dumping = false;
+    if (pcap_ring.resume) {
+        pcap_ring_on = 1U;
+    }
+    pcap_ring.resume = false;
+    taskEXIT_CRITICAL();
+    if (complete) {
+        LOG_INFO(PCAP_TAG, "dump done, %u blocks", (unsigned)t->block);
+    } else {
+        LOG_ERROR(PCAP_TAG, "dump aborted at block %u", (unsigned)t->block);
+    }
+}
+
+static void pcap_tftp_timer(void* arg)
+{
+    PcapTftp_t* t = &pcap_tftp;
+
+    (void)arg;
+    if (++t->retries > TFTP_RETRIES) {
+        pcap_tftp_end(false);
+        return;
+    }
+    pcap_tftp_send(t->pcb, NULL, 0U, t->pkt, t->pkt_len);
+    sys_timeout(TFTP_TIMEOUT_MS, pcap_tftp_timer, NULL);
+}
+
+/* Transfer socket, connected to the client: ACKs and errors */
+static void pcap_tftp_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    PcapTftp_t* t = &pcap_tftp;
+    uint8_t hdr[4];
+
+    (void)arg;
+    (void)pcb;
+    (void)addr;
+    (void)port;
+    if (pbuf_copy_partial(p, hdr, sizeof(hdr), 0) == sizeof(hdr)) {
+        uint16_t op = (uint16_t)((hdr[0] << 8) | hdr[1]);
+        uint16_t block = (uint16_t)((hdr[2] << 8) | hdr[3]);
+
+        if (op == TFTP_ERROR) {
+            pcap_tftp_end(false);
+        } else if (op == TFTP_ACK && block == t->block) {
+            /* ACKs of earlier blocks are ignored, no duplicate DATA */
+            if (t->last) {
+                pcap_tftp_end(true);
+            } else {
+                t->block++;
+                t->retries = 0U;
+                pcap_tftp_fill();
+                pcap_tftp_send(t->pcb, NULL, 0U, t->pkt, t->pkt_len);
+                sys_untimeout(pcap_tftp_timer, NULL);
+                sys_timeout(TFTP_TIMEOUT_MS, pcap_tftp_timer, NULL);
+            }
+        }
+    }
+    pbuf_free(p);
+}
+
+static void pcap_tftp_start(const ip_addr_t* addr, u16_t port)
+{
+    PcapTftp_t* t = &pcap_tftp;
+    uint32_t head;
+
+    t->pcb = udp_new_ip_type(IP_GET_TYPE(addr));
+    if (t->pcb == NULL) {
+        pcap_tftp_error(addr, port, TFTP_ERR_UNDEF, "out of memory");
+        return;
+    }
+    if (udp_bind(t->pcb, IP_ANY_TYPE, 0U) != ERR_OK || udp_connect(t->pcb, addr, port) != ERR_OK) {
+        udp_remove(t->pcb);
+        t->pcb = NULL;
+        pcap_tftp_error(addr, port, TFTP_ERR_UNDEF, "no port");
+        return;
+    }
+    udp_recv(t->pcb, pcap_tftp_recv, NULL);
+
+    /* Frozen for the transfer: the slots read below stay as they are */
+    taskENTER_CRITICAL();
+    pcap_ring.dumping = true;
+    pcap_ring.resume = (pcap_ring_on != 0U);
+    pcap_ring_on = 0U;
+    head = pcap_ring.head;
+    taskEXIT_CRITICAL();
+
+    t->end = head;
+    t->next = (head > PCAP_RING_SLOTS) ? head - PCAP_RING_SLOTS : 0U;
+    t->header_done = false;
+    t->item_len = 0U;
+    t->item_pos = 0U;
+    t->block = 1U;
+    t->retries = 0U;
+    LOG_INFO(PCAP_TAG, "dump to %s:%u, %lu frames", ipaddr_ntoa(addr), (unsigned)port,
+             (unsigned long)(t->end - t->next));
+    pcap_tftp_fill();
+    pcap_tftp_send(t->pcb, NULL, 0U, t->pkt, t->pkt_len);
+    sys_timeout(TFTP_TIMEOUT_MS, pcap_tftp_timer, NULL);
+}
+
+/* Well-known port: requests only */
+static void pcap_listen_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    char req[80];
+    u16_t len = pbuf_copy_partial(p, req, sizeof(req) - 1U, 0);
+    uint16_t op;
+
+    (void)arg;
+    (void)pcb;
+    pbuf_free(p);
+    if (len < 4U) {
+        return;
+    }
+    req[len] = '\0';
+    op = (uint16_t)(((uint8_t)req[0] << 8) | (uint8_t)req[1]);
+    if (op == TFTP_WRQ) {
+        pcap_tftp_error(addr, port, TFTP_ERR_ACCESS, "read only");
+        return;
+    }
+    if (op != TFTP_RRQ) {
+        return;
+    }
+
+    /* "<file>\0<mode>\0", options after it are ignored (no OACK) */
+    const char* file = &req[2];
+    size_t file_len = strlen(file);
+    const char* mode = file + file_len + 1;
+
+    if (mode >= &req[len] || strcmp(file, PCAP_RING_FILE) != 0) {
+        pcap_tftp_error(addr, port, TFTP_ERR_NOT_FOUND, "only " PCAP_RING_FILE);
+    } else if (strcasecmp(mode, "octet") != 0) {
+        pcap_tftp_error(addr, port, TFTP_ERR_UNDEF, "octet mode only");
+    } else if (pcap_tftp.pcb != NULL) {
+        pcap_tftp_error(addr, port, TFTP_ERR_UNDEF, "busy");
+    } else {
+        pcap_tftp_start(addr, port);
+    }
+}
+
+void pcap_ring_init(void)
+{
+    LOCK_TCPIP_CORE();
+    pcap_listen = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if (pcap_listen != NULL && udp_bind(pcap_listen, IP_ANY_TYPE, PCAP_RING_TFTP_PORT) == ERR_OK) {
+        udp_recv(pcap_listen, pcap_listen_recv, NULL);
+    } else {
+        if (pcap_listen != NULL) {
+            udp_remove(pcap_listen);
+            pcap_listen = NULL;
+        }
+        LOG_ERROR(PCAP_TAG, "no TFTP listener on port %u", (unsigned)PCAP_RING_TFTP_PORT);
+    }
+    UNLOCK_TCPIP_CORE();
+#if PCAP_RING_AUTOSTART
+    pcap_ring_start();
+#endif
+}
+
+#endif /* PCAP_RING */
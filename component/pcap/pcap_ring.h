@@ -0,0 +1,104 @@
+/**
+ * @file pcap_ring.h
+ * @brief Capture of the last frames in RAM, read back as a pcap file by TFTP.
+ *
+ * The driver taps every frame it delivers to lwIP and every frame it hands
+ * to the DMA. While capturing, the first PCAP_RING_SNAPLEN bytes and a
+ * nanosecond timestamp (time_utc_ns()) go into a ring of PCAP_RING_SLOTS fixed slots,
+ * oldest overwritten first. Stopped (the default), a tap is one load and
+ * one branch.
+ *
+ * The ring is served read-only on UDP port PCAP_RING_TFTP_PORT:
+ *
+ *   curl -o capture.pcap tftp://<board>/capture.pcap
+ *
+ * Capture pauses for the transfer and resumes after it. Timestamps are UTC
+ * once SNTP has synced, time since boot before. pcap_ring_trigger() keeps a few more frames after an anomaly
+ * is noticed and then freezes the ring until the next pcap_ring_start().
+ */
+
+#pragma once
+
+#ifndef PCAP_RING_H
+#define PCAP_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 0 leaves the taps and the TFTP server out */
+#ifndef PCAP_RING
+#define PCAP_RING 1
+#endif
+
+/* Bytes kept per frame: Ethernet, IPv4 and TCP headers with options */
+#ifndef PCAP_RING_SNAPLEN
+#define PCAP_RING_SNAPLEN 128U
+#endif
+
+/* 16 + PCAP_RING_SNAPLEN bytes each */
+#ifndef PCAP_RING_SLOTS
+#define PCAP_RING_SLOTS 256U
+#endif
+
+/* Placement of the ring, e.g. a section in D2 SRAM; default NOINIT (AXI,
+ * main.h), only slots captured since pcap_ring_start() are read */
+#ifndef PCAP_RING_SECTION
+#define PCAP_RING_SECTION NOINIT
+#endif
+
+/* 1: capture from pcap_ring_init() on */
+#ifndef PCAP_RING_AUTOSTART
+#define PCAP_RING_AUTOSTART 0
+#endif
+
+#ifndef PCAP_RING_TFTP_PORT
+#define PCAP_RING_TFTP_PORT 69U
+#endif
+
+#ifndef PCAP_RING_FILE
+#define PCAP_RING_FILE "capture.pcap"
+#endif
+
+#if PCAP_RING
+
+struct pbuf;
+
+/* Nonzero while capturing; only the taps read it */
+extern volatile uint8_t pcap_ring_on;
+
+/* Copies one frame into the ring, from any task */
+void pcap_ring_capture(const struct pbuf* p);
+
+static inline void pcap_ring_tap(const struct pbuf* p)
+{
+    if (pcap_ring_on != 0U) {
+        pcap_ring_capture(p);
+    }
+}
+
+/* Opens the TFTP listener. Call once from a task after MX_LWIP_Init(). */
+void pcap_ring_init(void);
+
+/* Empties the ring and captures */
+void pcap_ring_start(void);
+
+/* Stops capturing, the ring keeps its frames */
+void pcap_ring_stop(void);
+
+/* Captures frames more frames, then stops; 0 stops now */
+void pcap_ring_trigger(uint32_t frames);
+
+/* Frames in the ring */
+uint32_t pcap_ring_count(void);
+
+#endif /* PCAP_RING */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PCAP_RING_H */
@@ -0,0 +1,205 @@
+/**
+ * @file dwt_events.c
+ * @brief TIM5 windows over the DWT event counters, see dwt_events.h.
+ */
+
+#include "dwt_events.h"
+
+#if DWT_EVENTS
+
+#include "main.h"
+#include "FreeRTOS.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#if DWT_EVENTS_IRQ_PRIORITY >= configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
+#error "DWT_EVENTS_IRQ_PRIORITY must be above the syscall priority"
+#endif
+
+/* Longest exact window: the event counters are read a few cycles outside
+ * the CYCCNT reads */
+#define DWT_EVENTS_MAX_CYCLES   (256U - 16U)
+
+#define DWT_EVENTS_CTRL (DWT_CTRL_CYCCNTENA_Msk | DWT_CTRL_CPIEVTENA_Msk | DWT_CTRL_LSUEVTENA_Msk | \
+                         DWT_CTRL_EXCEVTENA_Msk | DWT_CTRL_SLEEPEVTENA_Msk | DWT_CTRL_FOLDEVTENA_Msk)
+
+typedef struct {
+    uint32_t cycles;
+    uint8_t cpi;
+    uint8_t lsu;
+    uint8_t exc;
+    uint8_t sleep;
+    uint8_t fold;
+} DwtRaw_t;
+
+typedef struct {
+    DwtRaw_t open_at;
+    bool open;
+    uint32_t period;        /* timer counts from window to window */
+    uint32_t window;        /* timer counts of a window */
+} DwtSampler_t;
+
+static DwtSampler_t dwt_sampler;
+/* Written by the TIM5 handler only, windows last */
+static volatile DwtEvents_t dwt_totals;
+
+static inline void dwt_events_read(DwtRaw_t* r)
+{
+    r->cpi = (uint8_t)DWT->CPICNT;
+    r->lsu = (uint8_t)DWT->LSUCNT;
+    r->exc = (uint8_t)DWT->EXCCNT;
+    r->sleep = (uint8_t)DWT->SLEEPCNT;
+    r->fold = (uint8_t)DWT->FOLDCNT;
+}
+
+ITCM_FUNC void TIM5_IRQHandler(void)
+{
+    DwtSampler_t* s = &dwt_sampler;
+    DwtRaw_t now;
+
+    if (!s->open) {
+        /* Opens at the end of the handler, CYCCNT last */
+        TIM5->SR = ~(uint32_t)TIM_SR_UIF;
+        TIM5->ARR = s->window - 1U;
+        /* Entered late, past the window already: close it at once */
+        if (TIM5->CNT >= s->window - 1U) {
+            TIM5->EGR = TIM_EGR_UG;
+        }
+        s->open = true;
+        dwt_events_read(&s->open_at);
+        s->open_at.cycles = DWT->CYCCNT;
+        return;
+    }
+
+    /* Closes at the start, CYCCNT first */
+    now.cycles = DWT->CYCCNT;
+    dwt_events_read(&now);
+    now.cycles -= s->open_at.cycles;
+    if (now.cycles < DWT_EVENTS_MAX_CYCLES) {
+        dwt_totals.cycles += now.cycles;
+        dwt_totals.cpi += (uint8_t)(now.cpi - s->open_at.cpi);
+        dwt_totals.lsu += (uint8_t)(now.lsu - s->open_at.lsu);
+        dwt_totals.exc += (uint8_t)(now.exc - s->open_at.exc);
+        dwt_totals.sleep += (uint8_t)(now.sleep - s->open_at.sleep);
+        dwt_totals.fold += (uint8_t)(now.fold - s->open_at.fold);
+        dwt_totals.windows++;
+    } else {
+        dwt_totals.skipped++;
+    }
+    TIM5->SR = ~(uint32_t)TIM_SR_UIF;
+    TIM5->ARR = s->period - s->window - 1U;
+    s->open = false;
+    __DSB();
+}
+
+void dwt_events_snapshot(DwtEvents_t* out)
+{
+    uint32_t windows;
+
+    /* The handler preempts but is never preempted by a reader: a copy
+     * with the same window count before and after is whole */
+    do {
+        windows = dwt_totals.windows;
+        out->skipped = dwt_totals.skipped;
+        out->cycles = dwt_totals.cycles;
+        out->cpi = dwt_totals.cpi;
+        out->lsu = dwt_totals.lsu;
+        out->exc = dwt_totals.exc;
+        out->sleep = dwt_totals.sleep;
+        out->fold = dwt_totals.fold;
+    } while (dwt_totals.windows != windows);
+    out->windows = windows;
+}
+
+void dwt_events_delta(DwtEvents_t* out, const DwtEvents_t* now, const DwtEvents_t* then)
+{
+    out->windows = now->windows - then->windows;
+    out->skipped = now->skipped - then->skipped;
+    out->cycles = now->cycles - then->cycles;
+    out->cpi = now->cpi - then->cpi;
+    out->lsu = now->lsu - then->lsu;
+    out->exc = now->exc - then->exc;
+    out->sleep = now->sleep - then->sleep;
+    out->fold = now->fold - then->fold;
+}
+
+void dwt_events_add(DwtEvents_t* out, const DwtEvents_t* d)
+{
+    out->windows += d->windows;
+    out->skipped += d->skipped;
+    out->cycles += d->cycles;
+    out->cpi += d->cpi;
+    out->lsu += d->lsu;
+    out->exc += d->exc;
+    out->sleep += d->sleep;
+    out->fold += d->fold;
+}
+
+/* Per mille of the window cycles */
+static uint32_t dwt_events_permille(uint32_t n, uint32_t cycles)
+{
+    return (uint32_t)(((uint64_t)n * 1000U + cycles / 2U) / cycles);
+}
+
+void dwt_events_format(char* out, size_t size, const DwtEvents_t* e)
+{
+    int64_t instr;
+    uint32_t ipc;
+
+    if (e->windows == 0U || e->cycles == 0U) {
+        snprintf(out, size, "w 0");
+        return;
+    }
+    instr = (int64_t)e->cycles - e->cpi - e->lsu - e->exc - e->sleep + e->fold;
+    ipc = (instr > 0) ? (uint32_t)((instr * 100) / e->cycles) : 0U;
+    snprintf(out, size, "w %lu ipc %lu.%02lu cpi %lu.%lu%% lsu %lu.%lu%% exc %lu.%lu%% sleep %lu.%lu%% fold %lu.%lu%%",
+             (unsigned long)e->windows, (unsigned long)(ipc / 100U), (unsigned long)(ipc % 100U),
+             (unsigned long)(dwt_events_permille(e->cpi, e->cycles) / 10U),
+             (unsigned long)(dwt_events_permille(e->cpi, e->cycles) % 10U),
+             (unsigned long)(dwt_events_permille(e->lsu, e->cycles) / 10U),
+             (unsigned long)(dwt_events_permille(e->lsu, e->cycles) % 10U),
+             (unsigned long)(dwt_events_permille(e->exc, e->cycles) / 10U),
+             (unsigned long)(dwt_events_permille(e->exc, e->cycles) % 10U),
+             (unsigned long)(dwt_events_permille(e->sleep, e->cycles) / 10U),
+             (unsigned long)(dwt_events_permille(e->sleep, e->cycles) % 10U),
+             (unsigned long)(dwt_events_permille(e->fold, e->cycles) / 10U),
+             (unsigned long)(dwt_events_permille(e->fold, e->cycles) % 10U));
+}
+
+void dwt_events_init(void)
+{
+    DwtSampler_t* s = &dwt_sampler;
+    uint32_t clk = HAL_RCC_GetPCLK1Freq();
+
+    /* TIM5 runs at twice PCLK1 unless APB1 is undivided */
+    if ((RCC->D2CFGR & RCC_D2CFGR_D2PPRE1) != RCC_APB1_DIV1) {
+        clk *= 2U;
+    }
+    s->period = clk / DWT_EVENTS_HZ;
+    s->window = (uint32_t)(((uint64_t)DWT_EVENTS_WINDOW_CYCLES * clk) / SystemCoreClock);
+    if (s->window == 0U) {
+        s->window = 1U;
+    }
+    s->open = false;
+
+    /* Setting an EVTENA bit also clears its counter */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55U;
+    DWT->CTRL |= DWT_EVENTS_CTRL;
+
+    /* 32-bit TIM5, counting timer clocks; ARR is written in the handler
+     * right after each update, without preload */
+    __HAL_RCC_TIM5_CLK_ENABLE();
+    TIM5->CR1 = 0U;
+    TIM5->PSC = 0U;
+    TIM5->ARR = s->period - 1U;
+    TIM5->EGR = TIM_EGR_UG;
+    TIM5->SR = 0U;
+    TIM5->DIER = TIM_DIER_UIE;
+    HAL_NVIC_SetPriority(TIM5_IRQn, DWT_EVENTS_IRQ_PRIORITY, 0U);
+    HAL_NVIC_EnableIRQ(TIM5_IRQn);
+    TIM5->CR1 = TIM_CR1_CEN;
+}
+
+#endif /* DWT_EVENTS */
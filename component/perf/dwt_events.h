@@ -0,0 +1,106 @@
+/**
+ * @file dwt_events.h
+ * @brief Sampled DWT event counters: where the cycles go, system-wide and per section.
+ *
+ * Besides CYCCNT the M7 DWT counts, per cycle, the extra cycles of
+ * multi-cycle instructions and instruction fetch stalls (CPICNT), of loads
+ * and stores beyond their first cycle (LSUCNT), of exception entry and
+ * return (EXCCNT), of sleep (SLEEPCNT), and the instructions that took no
+ * cycle of their own (FOLDCNT, dual issue on the M7). With them
+ *
+ *     instructions = cycles - CPI - LSU - EXC - SLEEP + FOLD
+ *
+ * A high LSU share marks code waiting on data (D-cache misses into D2
+ * SRAM, uncached DMA buffers, peripheral registers), a high CPI share code
+ * waiting on instruction fetch from flash or on divides; code that is
+ * neither runs close to one or two instructions per cycle and only gets
+ * faster with fewer instructions.
+ *
+ * These counters are 8 bits wide and their overflow is only reported to a
+ * trace probe, so they are read over short windows: TIM5 interrupts
+ * DWT_EVENTS_HZ times a second, the handler snapshots the counters and
+ * closes the window with a second interrupt DWT_EVENTS_WINDOW_CYCLES later.
+ * A window longer than 256 - 16 cycles (held off by a debugger halt or the
+ * clocks stopped) could have wrapped and is skipped. Closed windows add to
+ * running totals, which are system-wide figures over a statistical sample
+ * of the time. The handler's own few dozen cycles and its exception entry
+ * and return are part of every window: EXC is mostly the sampler's.
+ *
+ * perf_stats.h snapshots the totals at PERF_START and adds the windows
+ * that closed before PERF_STOP to the section, so the named sections get
+ * their event shares too; like their cycles, these include what preempted
+ * them. Short, rare sections see few windows: compare shares over enough
+ * of them.
+ */
+
+#pragma once
+
+#ifndef DWT_EVENTS_H
+#define DWT_EVENTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef DWT_EVENTS
+#define DWT_EVENTS 1
+#endif
+
+/* Windows per second; off the multiples of the 1 kHz tick */
+#ifndef DWT_EVENTS_HZ
+#define DWT_EVENTS_HZ 4999U
+#endif
+
+/* Target window length in CPU cycles, timer rounding and the handler
+ * entry make the measured one shorter */
+#ifndef DWT_EVENTS_WINDOW_CYCLES
+#define DWT_EVENTS_WINDOW_CYCLES 200U
+#endif
+
+/* Above configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY (5) and the PC
+ * profiler, so that windows close on time */
+#ifndef DWT_EVENTS_IRQ_PRIORITY
+#define DWT_EVENTS_IRQ_PRIORITY 1U
+#endif
+
+/* Running totals over the closed windows; take differences of snapshots */
+typedef struct {
+    uint32_t windows;
+    uint32_t skipped;       /* windows too long to be exact */
+    uint32_t cycles;
+    uint32_t cpi;
+    uint32_t lsu;
+    uint32_t exc;
+    uint32_t sleep;
+    uint32_t fold;
+} DwtEvents_t;
+
+#if DWT_EVENTS
+
+/* Enables the counters and starts the TIM5 windows. Call once. */
+void dwt_events_init(void);
+
+/* Consistent copy of the totals. From tasks and interrupts below
+ * DWT_EVENTS_IRQ_PRIORITY. */
+void dwt_events_snapshot(DwtEvents_t* out);
+
+/* out = now - then, field by field */
+void dwt_events_delta(DwtEvents_t* out, const DwtEvents_t* now, const DwtEvents_t* then);
+
+/* out += d */
+void dwt_events_add(DwtEvents_t* out, const DwtEvents_t* d);
+
+/* "w 812 ipc 0.74 cpi 21.3% lsu 30.2% exc 9.8% sleep 0.0% fold 4.1%",
+ * shares of the window cycles; "w 0" without windows */
+void dwt_events_format(char* out, size_t size, const DwtEvents_t* e);
+
+#endif /* DWT_EVENTS */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DWT_EVENTS_H */
@@ -0,0 +1,173 @@
+/**
+ * @file perf_stats.c
+ * @brief Section cycle statistics table and its syslog dump.
+ */
+
+#include "perf_stats.h"
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+
+#include <string.h>
+
+#define PERF_STATS_SLOT_FULL 0xFFU  /* table was full, never recorded */
+
+typedef struct {
+    PerfStatsSection_t section[PERF_STATS_MAX_SECTIONS];
+    uint32_t used;
+    uint32_t dropped;       /* calls from sections without an entry */
+} PerfStats_t;
+
+static PerfStats_t perf;
+
+#if PERF_STATS_MAX_SECTIONS >= PERF_STATS_SLOT_FULL
+#error "PERF_STATS_MAX_SECTIONS must fit a call site slot"
+#endif
+
+/* First call from a site: finds or adds the entry. Interrupts masked. */
+static uint8_t perf_stats_assign(const char* name)
+{
+    for (uint32_t i = 0; i < perf.used; i++) {
+        if (perf.section[i].name == name || strcmp(perf.section[i].name, name) == 0) {
+            return (uint8_t)(i + 1U);
+        }
+    }
+    if (perf.used >= PERF_STATS_MAX_SECTIONS) {
+        return PERF_STATS_SLOT_FULL;
+    }
+    PerfStatsSection_t* s = &perf.section[perf.used++];
+    s->name = name;
+    s->min = UINT32_MAX;
+    return (uint8_t)perf.used;
+}
+
+void perf_stats_record(uint8_t* slot, const char* name, const PerfStatsStart_t* start)
+{
+    uint32_t cycles = PERF_STATS_CYCCNT - start->cycles;
+#if DWT_EVENTS
+    DwtEvents_t events;
+
+    dwt_events_snapshot(&events);
+    dwt_events_delta(&events, &events, &start->events);
+#endif
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    if (*slot == 0U) {
+        *slot = perf_stats_assign(name);
+    }
+    if (*slot == PERF_STATS_SLOT_FULL) {
+        perf.dropped++;
+    } else {
+        PerfStatsSection_t* s = &perf.section[*slot - 1U];
+        s->count++;
+        s->total += cycles;
+        if (cycles < s->min) {
+            s->min = cycles;
+        }
+        if (cycles > s->max) {
+            s->max = cycles;
+        }
+#if DWT_EVENTS
+        dwt_events_add(&s->events, &events);
+#endif
+    }
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+uint32_t perf_stats_get(PerfStatsSection_t* sections, uint32_t max)
+{
+    uint32_t n;
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    n = (perf.used < max) ? perf.used : max;
+    memcpy(sections, perf.section, n * sizeof(sections[0]));
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+    return n;
+}
+
+void perf_stats_reset(void)
+{
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    for (uint32_t i = 0; i < perf.used; i++) {
+        perf.section[i].count = 0U;
+        perf.section[i].min = UINT32_MAX;
+        perf.section[i].max = 0U;
+        perf.section[i].total = 0U;
+#if DWT_EVENTS
+        memset(&perf.section[i].events, 0, sizeof(perf.section[i].events));
+#endif
+    }
+    perf.dropped = 0U;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+void perf_stats_log(bool reset)
+{
+    /* Copied first: logging records the logger's own section */
+    static PerfStatsSection_t copy[PERF_STATS_MAX_SECTIONS];
+    uint32_t dropped = perf.dropped;
+    uint32_t n = perf_stats_get(copy, PERF_STATS_MAX_SECTIONS);
+#if DWT_EVENTS
+    /* System-wide figures since the previous dump */
+    static DwtEvents_t last;
+    static char events[96];
+    DwtEvents_t now;
+    DwtEvents_t d;
+
+    dwt_events_snapshot(&now);
+    dwt_events_delta(&d, &now, &last);
+    last = now;
+#endif
+
+    if (reset) {
+        perf_stats_reset();
+    }
+    LOG_INFO("PERF", "%lu sections, cycles at %lu MHz, %lu calls not recorded",
+             n, SystemCoreClock / 1000000U, dropped);
+#if DWT_EVENTS
+    dwt_events_format(events, sizeof(events), &d);
+    LOG_INFO("PERF", "%-16s %s, %lu skipped", "system", events, d.skipped);
+#endif
+    for (uint32_t i = 0; i < n; i++) {
+        const PerfStatsSection_t* s = &copy[i];
+        if (s->count == 0U) {
+            continue;
+        }
+        LOG_INFO("PERF", "%-16s n %lu min %lu avg %lu max %lu", s->name, s->count, s->min,
+                 (uint32_t)(s->total / s->count), s->max);
+#if DWT_EVENTS
+        if (s->events.windows != 0U) {
+            dwt_events_format(events, sizeof(events), &s->events);
+            LOG_INFO("PERF", "%-16s %s", s->name, events);
+        }
+#endif
+    }
+}
+
+#if PERF_STATS_LOG_MS
+/* Runs on the tcpip thread; each dump covers one period */
+static void perf_stats_timer(void* arg)
+{
+    perf_stats_log(true);
+    sys_timeout(PERF_STATS_LOG_MS, perf_stats_timer, arg);
+}
+#endif
+
+void perf_stats_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55U;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#if DWT_EVENTS
+    dwt_events_init();
+#endif
+#if PERF_STATS_LOG_MS
+    LOCK_TCPIP_CORE();
+    sys_timeout(PERF_STATS_LOG_MS, perf_stats_timer, NULL);
+    UNLOCK_TCPIP_CORE();
+#endif
+}
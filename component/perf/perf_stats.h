@@ -0,0 +1,104 @@
+/**
+ * @file perf_stats.h
+ * @brief Cycle counts of named code sections, behind lwIP PERF_START/PERF_STOP.
+ *
+ * With LWIP_PERF set, arch/perf.h makes PERF_START read the DWT cycle
+ * counter into a local and PERF_STOP(name) add the elapsed cycles to the
+ * table entry of that name: count, min, average and max. All call sites
+ * with the same name share an entry. lwIP itself times udp_input,
+ * tcp_input, pbuf_free and ip4_forward; ethernetif.c and the logger add
+ * their own sections.
+ *
+ * A section is timed from start to stop in wall-clock cycles, so time spent
+ * in interrupts or other tasks in between is included: the minimum is the
+ * cost of the code, the maximum shows the worst preemption.
+ *
+ * With DWT_EVENTS (dwt_events.h) each section also collects the sampled
+ * DWT event windows that closed while it ran, and the dump adds their
+ * shares per section and system-wide: memory stalls (LSU) against fetch
+ * and multi-cycle stalls (CPI) against instructions per cycle.
+ */
+
+#pragma once
+
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "dwt_events.h"
+
+/* Named sections in the table; sections beyond that are not recorded. */
+#ifndef PERF_STATS_MAX_SECTIONS
+#define PERF_STATS_MAX_SECTIONS 24U
+#endif
+
+/* Period of the syslog dump (tag "PERF"). 0: only on request through
+ * perf_stats_log(). */
+#ifndef PERF_STATS_LOG_MS
+#define PERF_STATS_LOG_MS 10000U
+#endif
+
+/* DWT->CYCCNT, without pulling the device header into every lwIP file */
+#define PERF_STATS_CYCCNT (*(volatile uint32_t*)0xE0001004UL)
+
+typedef struct {
+    const char* name;
+    uint32_t count;
+    uint32_t min;           /* cycles */
+    uint32_t max;           /* cycles */
+    uint64_t total;         /* cycles */
+#if DWT_EVENTS
+    DwtEvents_t events;     /* sampled windows inside the section */
+#endif
+} PerfStatsSection_t;
+
+/* PERF_START state of a call site */
+typedef struct {
+#if DWT_EVENTS
+    DwtEvents_t events;
+#endif
+    uint32_t cycles;
+} PerfStatsStart_t;
+
+/* Enables the cycle counter, starts the DWT event windows with DWT_EVENTS
+ * and arms the periodic dump when
+ * PERF_STATS_LOG_MS is set. Call once from a task after the TCP/IP stack
+ * and the logger are up. */
+void perf_stats_init(void);
+
+/* PERF_START() backend, the cycle counter read last */
+static inline PerfStatsStart_t perf_stats_start(void)
+{
+    PerfStatsStart_t start;
+
+#if DWT_EVENTS
+    dwt_events_snapshot(&start.events);
+#endif
+    start.cycles = PERF_STATS_CYCCNT;
+    return start;
+}
+
+/* PERF_STOP() backend. slot caches the table index of the call site, name
+ * must be a string constant. Usable from tasks and interrupts. */
+void perf_stats_record(uint8_t* slot, const char* name, const PerfStatsStart_t* start);
+
+/* Copies up to max entries, returns their number. */
+uint32_t perf_stats_get(PerfStatsSection_t* sections, uint32_t max);
+
+/* Clears the figures; names and call site slots are kept. */
+void perf_stats_reset(void);
+
+/* Logs one line per section; reset afterwards if reset is true. */
+void perf_stats_log(bool reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PERF_STATS_H */
@@ -0,0 +1,269 @@
+/**
+ * @file periodic_exec.c
+ * @brief TIM2 compare releases of periodic tasks, see periodic_exec.h.
+ */
+
+#include "periodic_exec.h"
+
+#if PERIODIC_EXEC
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "lathist/lat_hist.h"
+#include "metrics/metrics.h"
+#include "supervisor/supervisor.h"
+
+#include <stdio.h>
+
+#define PERIODIC_TAG        "PERIODIC"
+#define PERIODIC_COUNTS_US  (PERIODIC_EXEC_TIM_HZ / 1000000U)
+#define PERIODIC_HIST_NAME  40U
+#define PERIODIC_CC_FLAGS   (TIM_SR_CC1IF | TIM_SR_CC2IF | TIM_SR_CC3IF | TIM_SR_CC4IF)
+
+#if PERIODIC_EXEC_IRQ_PRIORITY < configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
+#error "PERIODIC_EXEC_IRQ_PRIORITY must not be above the syscall priority"
+#endif
+
+#if PERIODIC_EXEC_TIM_HZ % 1000000U != 0U
+#error "PERIODIC_EXEC_TIM_HZ must be a multiple of 1 MHz"
+#endif
+
+/* Job states, for the overrun count */
+#define PERIODIC_IDLE       0U
+#define PERIODIC_RELEASED   1U
+#define PERIODIC_RUNNING    2U
+
+typedef struct {
+    PeriodicExecTask_t cfg;
+    uint32_t period;                /* counts */
+    uint32_t deadline;              /* counts */
+    TaskHandle_t task;
+    /* Interrupt to the task */
+    volatile uint32_t release;      /* compare value of the latest release */
+    volatile uint32_t releases;
+    volatile uint32_t overruns;
+    volatile uint8_t state;
+    /* Task only */
+    uint32_t misses;
+    LatHist_t jitter;
+    LatHist_t exec;
+#if METRICS
+    char hist_name[2][PERIODIC_HIST_NAME];
+#endif
+#if SUPERVISOR
+    SupervisorCheck_t sup;          /* the deadline as latency budget */
+#endif
+    StaticTask_t tcb;
+    StackType_t stack[PERIODIC_EXEC_STACK_WORDS];
+} PeriodicSlot_t;
+
+typedef struct {
+    PeriodicSlot_t slot[PERIODIC_EXEC_MAX_TASKS];
+    uint32_t used;
+    /* Changed by each prescaler switch: counts either side do not compare */
+    volatile uint32_t epoch;
+} PeriodicExec_t;
+
+static PeriodicExec_t pexec;
+
+static inline volatile uint32_t* periodic_ccr(uint32_t ch)
+{
+    return &(&TIM2->CCR1)[ch];
+}
+
+static inline uint32_t periodic_ns(uint32_t counts)
+{
+    return (uint32_t)(((uint64_t)counts * 1000000000U) / PERIODIC_EXEC_TIM_HZ);
+}
+
+/* Timer clock of TIM2: twice PCLK1 unless APB1 is undivided */
+static uint32_t periodic_tim_clk(void)
+{
+    uint32_t clk = HAL_RCC_GetPCLK1Freq();
+
+    if ((RCC->D2CFGR & RCC_D2CFGR_D2PPRE1) != RCC_APB1_DIV1) {
+        clk *= 2U;
+    }
+    return clk;
+}
+
+void TIM2_IRQHandler(void)
+{
+    uint32_t sr = TIM2->SR & PERIODIC_CC_FLAGS & TIM2->DIER;
+    BaseType_t woken = pdFALSE;
+
+    TIM2->SR = ~sr;
+    for (uint32_t ch = 0U; ch < PERIODIC_EXEC_MAX_TASKS; ch++) {
+        PeriodicSlot_t* s = &pexec.slot[ch];
+        volatile uint32_t* ccr = periodic_ccr(ch);
+        uint32_t release;
+        uint32_t next;
+
+        if ((sr & (TIM_SR_CC1IF << ch)) == 0U) {
+            continue;
+        }
+        release = *ccr;
+        next = release + s->period;
+        /* Held off past the next release: it is due already, not in 2^32 counts */
+        while ((int32_t)(next - TIM2->CNT) <= 0) {
+            next += s->period;
+            s->overruns++;
+        }
+        *ccr = next;
+        s->release = release;
+        s->releases++;
+        if (s->state != PERIODIC_IDLE) {
+            s->overruns++;
+        } else {
+            s->state = PERIODIC_RELEASED;
+        }
+        vTaskNotifyGiveFromISR(s->task, &woken);
+    }
+    portYIELD_FROM_ISR(woken);
+}
+
+static void periodic_task(void* arg)
+{
+    PeriodicSlot_t* s = arg;
+
+    for (;;) {
+        uint32_t epoch;
+        uint32_t release;
+        uint32_t start;
+        uint32_t end;
+
+        (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        epoch = pexec.epoch;
+        start = TIM2->CNT;
+        release = s->release;
+        s->state = PERIODIC_RUNNING;
+        s->cfg.job(s->cfg.arg);
+        end = TIM2->CNT;
+        s->state = PERIODIC_IDLE;
+        if (epoch != pexec.epoch) {
+#if SUPERVISOR
+            supervisor_beat(&s->sup);
+#endif
+            continue;
+        }
+        lat_hist_add(&s->jitter, periodic_ns(start - release));
+        lat_hist_add(&s->exec, periodic_ns(end - start));
+        if (end - release > s->deadline) {
+            s->misses++;
+        }
+#if SUPERVISOR
+        supervisor_latency(&s->sup, periodic_ns(end - release) / 1000U);
+#endif
+    }
+}
+
+#if METRICS
+/* Runs on the tcpip thread; the histograms are registered on their own */
+static void periodic_metrics(MetricsWriter_t* w)
+{
+    char name[METRICS_NAME_MAX];
+    uint32_t n = __atomic_load_n(&pexec.used, __ATOMIC_ACQUIRE);
+
+    for (uint32_t i = 0U; i < n; i++) {
+        const PeriodicSlot_t* s = &pexec.slot[i];
+
+        snprintf(name, sizeof(name), "periodic.%s.releases", s->cfg.name);
+        metrics_emit(w, name, METRIC_COUNTER, s->releases);
+        snprintf(name, sizeof(name), "periodic.%s.overruns", s->cfg.name);
+        metrics_emit(w, name, METRIC_COUNTER, s->overruns);
+        snprintf(name, sizeof(name), "periodic.%s.misses", s->cfg.name);
+        metrics_emit(w, name, METRIC_COUNTER, s->misses);
+    }
+}
+#endif
+
+bool periodic_exec_add(const PeriodicExecTask_t* t)
+{
+    PeriodicSlot_t* s;
+    uint32_t ch;
+    uint32_t first;
+
+    if (t->job == NULL || t->period_us < 10U || t->period_us > 200000000U ||
+        pexec.used >= PERIODIC_EXEC_MAX_TASKS) {
+        return false;
+    }
+    ch = pexec.used;
+    s = &pexec.slot[ch];
+    s->cfg = *t;
+    s->period = t->period_us * PERIODIC_COUNTS_US;
+    s->deadline = ((t->deadline_us != 0U) ? t->deadline_us : t->period_us) * PERIODIC_COUNTS_US;
+    s->state = PERIODIC_IDLE;
+    s->task = xTaskCreateStatic(periodic_task, t->name, PERIODIC_EXEC_STACK_WORDS, s, t->priority, s->stack,
+                                &s->tcb);
+    if (s->task == NULL) {
+        return false;
+    }
+#if METRICS
+    snprintf(s->hist_name[0], PERIODIC_HIST_NAME, "periodic.%s.jitter_ns", t->name);
+    snprintf(s->hist_name[1], PERIODIC_HIST_NAME, "periodic.%s.exec_ns", t->name);
+    (void)metrics_register_hist(s->hist_name[0], &s->jitter);
+    (void)metrics_register_hist(s->hist_name[1], &s->exec);
+#endif
+#if SUPERVISOR
+    /* Silent for two periods: not released, or not getting the CPU */
+    s->sup.name = t->name;
+    s->sup.budget_us = s->deadline / PERIODIC_COUNTS_US;
+    s->sup.timeout_ms = (2U * t->period_us) / 1000U + SUPERVISOR_PERIOD_MS;
+    (void)supervisor_add(&s->sup);
+#endif
+    __atomic_store_n(&pexec.used, ch + 1U, __ATOMIC_RELEASE);
+
+    taskENTER_CRITICAL();
+    first = TIM2->CNT + ((t->offset_us != 0U) ? t->offset_us : 1U) * PERIODIC_COUNTS_US;
+    *periodic_ccr(ch) = first;
+    TIM2->SR = ~(uint32_t)(TIM_SR_CC1IF << ch);
+    TIM2->DIER |= TIM_DIER_CC1IE << ch;
+    taskEXIT_CRITICAL();
+    LOG_INFO(PERIODIC_TAG, "%s every %lu us, deadline %lu us, priority %lu", t->name,
+             (unsigned long)t->period_us, (unsigned long)(s->deadline / PERIODIC_COUNTS_US),
+             (unsigned long)t->priority);
+    return true;
+}
+
+void periodic_exec_clock_changed(void)
+{
+    uint32_t cnt;
+
+    if ((RCC->APB1LENR & RCC_APB1LENR_TIM2EN) == 0U) {
+        return;
+    }
+    /* The prescaler only loads on an update, which also clears the count:
+     * the compares move back by the count they lose */
+    cnt = TIM2->CNT;
+    TIM2->PSC = periodic_tim_clk() / PERIODIC_EXEC_TIM_HZ - 1U;
+    TIM2->EGR = TIM_EGR_UG;
+    for (uint32_t ch = 0U; ch < PERIODIC_EXEC_MAX_TASKS; ch++) {
+        *periodic_ccr(ch) -= cnt;
+        pexec.slot[ch].release -= cnt;
+    }
+    pexec.epoch++;
+}
+
+void periodic_exec_init(void)
+{
+    __HAL_RCC_TIM2_CLK_ENABLE();
+    TIM2->CR1 = 0U;
+    TIM2->PSC = periodic_tim_clk() / PERIODIC_EXEC_TIM_HZ - 1U;
+    TIM2->ARR = UINT32_MAX;
+    /* Output compare, frozen: the channels only raise their flags */
+    TIM2->CCMR1 = 0U;
+    TIM2->CCMR2 = 0U;
+    TIM2->CCER = 0U;
+    TIM2->DIER = 0U;
+    TIM2->EGR = TIM_EGR_UG;
+    TIM2->SR = 0U;
+    HAL_NVIC_SetPriority(TIM2_IRQn, PERIODIC_EXEC_IRQ_PRIORITY, 0U);
+    HAL_NVIC_EnableIRQ(TIM2_IRQn);
+    TIM2->CR1 = TIM_CR1_CEN;
+#if METRICS
+    (void)metrics_register_collector(periodic_metrics);
+#endif
+}
+
+#endif /* PERIODIC_EXEC */
@@ -0,0 +1,101 @@
+/**
+ * @file periodic_exec.h
+ * @brief Periodic executive: timer-released tasks with jitter and deadline statistics.
+ *
+ * Every periodic task gets a TIM2 compare channel, so up to four run at
+ * once. TIM2 counts freely at PERIODIC_EXEC_TIM_HZ over its 32 bits; each
+ * compare interrupt moves its channel on by the period and releases the
+ * task with a task notification. Releases are spaced by the timer, not by
+ * when the previous job ran, so they never drift the way a task pacing
+ * itself with osDelay() does, and the compare value is the ideal release
+ * time the statistics are measured against:
+ *  - jitter_ns:  release to the start of the job, i.e. interrupt latency
+ *                plus the time higher-priority tasks (and interrupts, the
+ *                ETH handler among them) kept it from running
+ *  - exec_ns:    start to end of the job, preemption included
+ *  - misses:     jobs that ended later than deadline_us after the release
+ *  - overruns:   releases that found the previous job not started or not
+ *                finished; the job runs once for all of them
+ * Compare the jitter under network load (iperf) with the idle figures to
+ * see whether the stack disturbs a loop; the cure is usually a task
+ * priority above the tcpip thread and EthIf, or less work in the ETH
+ * handler.
+ *
+ * The timer clock follows PCLK1: clock_profile_switch() calls
+ * periodic_exec_clock_changed(), which keeps the count rate and the
+ * schedule, and the jobs running across a switch are not measured.
+ *
+ * With SUPERVISOR each task is a check of the supervisor, its deadline the
+ * latency budget (supervisor/supervisor.h).
+ *
+ * Exported through metrics as "periodic.<name>.jitter_ns" and ".exec_ns"
+ * (histograms), ".releases", ".overruns" and ".misses".
+ */
+
+#pragma once
+
+#ifndef PERIODIC_EXEC_H
+#define PERIODIC_EXEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef PERIODIC_EXEC
+#define PERIODIC_EXEC 1
+#endif
+
+/* Count rate; an integer divisor of the TIM2 clock at every profile */
+#ifndef PERIODIC_EXEC_TIM_HZ
+#define PERIODIC_EXEC_TIM_HZ 10000000U
+#endif
+
+/* Numerically not below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY; the
+ * highest level allowed, releases are on time */
+#ifndef PERIODIC_EXEC_IRQ_PRIORITY
+#define PERIODIC_EXEC_IRQ_PRIORITY 5
+#endif
+
+#ifndef PERIODIC_EXEC_STACK_WORDS
+#define PERIODIC_EXEC_STACK_WORDS 512U
+#endif
+
+/* One per TIM2 compare channel */
+#define PERIODIC_EXEC_MAX_TASKS 4U
+
+typedef void (*PeriodicExecJob_t)(void* arg);
+
+typedef struct {
+    const char* name;       /* task and metrics name; must outlive the task */
+    PeriodicExecJob_t job;  /* one run per release */
+    void* arg;
+    uint32_t period_us;
+    uint32_t offset_us;     /* first release after periodic_exec_add() */
+    uint32_t deadline_us;   /* job end after its release, 0: the period */
+    uint32_t priority;      /* FreeRTOS level: tcpip thread 12, EthIf 24 */
+} PeriodicExecTask_t;
+
+#if PERIODIC_EXEC
+
+/* Starts TIM2 and registers the statistics. Call once from a task after
+ * metrics_init(). */
+void periodic_exec_init(void);
+
+/* Creates the task and schedules its first release. False when all
+ * channels are taken or the period is out of range (10 us to 200 s). */
+bool periodic_exec_add(const PeriodicExecTask_t* t);
+
+/* Re-derives the prescaler after a PCLK1 change; interrupts masked up to
+ * the syscall priority */
+void periodic_exec_clock_changed(void);
+
+#endif /* PERIODIC_EXEC */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PERIODIC_EXEC_H */
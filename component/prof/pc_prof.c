@@ -0,0 +1,274 @@
+/**
+ * @file pc_prof.c
+ * @brief TIM17 PC sampling into a ring and its UDP stream.
+ */
+
+#include "pc_prof.h"
+
+#if PC_PROF
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+#include "lwip/udp.h"
+#include "lwip/pbuf.h"
+#include "lwip/sys.h"
+
+#include <string.h>
+
+#if (PC_PROF_SAMPLES & (PC_PROF_SAMPLES - 1U)) != 0U
+#error "PC_PROF_SAMPLES must be a power of two"
+#endif
+
+#define PROF_TAG                "PROF"
+#define PROF_MAGIC_INFO         0x49465250UL    /* "PRFI" */
+#define PROF_MAGIC_SAMPLES      0x53465250UL    /* "PRFS" */
+#define PROF_HDR_LEN            16U
+/* 1216-byte datagrams, 4 per tick: 20k samples/s at 20 ms */
+#define PROF_DGRAM_SAMPLES      100U
+#define PROF_DGRAM_BURST        4U
+#define PROF_NAME_LEN           16U
+#define PROF_INFO_ENTRY_LEN     (2U + PROF_NAME_LEN)
+#define PROF_INFO_TASKS         24U
+/* Timer clock: 16-bit ARR from 153 Hz, rates within 0.1 % up to 10 kHz */
+#define PROF_TIM_HZ             10000000U
+
+#if PC_PROF_HZ < 153U || PC_PROF_HZ > 20000U
+#error "PC_PROF_HZ out of range"
+#endif
+
+typedef struct {
+    struct udp_pcb* pcb;
+    bool on;
+    ip_addr_t peer;
+    u16_t port;
+    uint32_t tail;          /* next sample to send, as a sample count */
+    uint32_t seq;
+    uint32_t lost;
+    uint32_t last_rx_ms;
+    uint32_t hz;            /* actual rate, after the ARR rounding */
+} ProfStream_t;
+
+static PcProfSample_t prof_ring[PC_PROF_SAMPLES] NOINIT;
+/* Samples taken; the ring holds the last PC_PROF_SAMPLES. Only the TIM17
+ * handler writes, it does not nest. */
+static volatile uint32_t prof_head;
+
+static ProfStream_t prof_stream;
+
+void pc_prof_sample(const uint32_t* frame);
+
+/* The frame is on the stack that was in use: PSP for a task, MSP for an
+ * interrupt handler or before the scheduler (EXC_RETURN bit 2). Nothing
+ * is pushed before it is read; the tail call keeps EXC_RETURN in LR. In
+ * ITCM with pc_prof_sample(), the branch would not reach it from flash. */
+ITCM_FUNC __attribute__((naked)) void TIM17_IRQHandler(void)
+{
+    __asm volatile(
+        "tst    lr, #4          \n"
+        "ite    eq              \n"
+        "mrseq  r0, msp         \n"
+        "mrsne  r0, psp         \n"
+        "b      pc_prof_sample  \n");
+}
+
+/* frame: r0 r1 r2 r3 r12 lr pc xpsr, then the FPU part if any */
+ITCM_FUNC __attribute__((used)) void pc_prof_sample(const uint32_t* frame)
+{
+    uint32_t i = prof_head;
+    PcProfSample_t* s = &prof_ring[i & (PC_PROF_SAMPLES - 1U)];
+    TaskHandle_t t = xTaskGetCurrentTaskHandle();
+
+    TIM17->SR = ~(uint32_t)TIM_SR_UIF;
+    s->pc = frame[6];
+    s->lr = frame[5];
+    s->exc = (uint16_t)(frame[7] & 0x1FFU);
+    s->reserved = 0U;
+    /* Reads the TCB only, safe above the syscall priority */
+    s->task = (t != NULL) ? (uint8_t)uxTaskGetTaskNumber(t) : 0U;
+    prof_head = i + 1U;
+    __DSB();
+}
+
+/* 10 MHz count, update every PROF_TIM_HZ / PC_PROF_HZ counts */
+static void prof_timer_start(void)
+{
+    uint32_t clk = HAL_RCC_GetPCLK2Freq();
+    uint32_t arr = (PROF_TIM_HZ + PC_PROF_HZ / 2U) / PC_PROF_HZ;
+
+    /* TIM17 runs at twice PCLK2 unless APB2 is undivided */
+    if ((RCC->D2CFGR & RCC_D2CFGR_D2PPRE2) != RCC_APB2_DIV1) {
+        clk *= 2U;
+    }
+    __HAL_RCC_TIM17_CLK_ENABLE();
+    TIM17->CR1 = 0U;
+    TIM17->PSC = clk / PROF_TIM_HZ - 1U;
+    TIM17->ARR = arr - 1U;
+    TIM17->EGR = TIM_EGR_UG;
+    TIM17->SR = 0U;
+    TIM17->DIER = TIM_DIER_UIE;
+    prof_stream.hz = PROF_TIM_HZ / arr;
+    HAL_NVIC_SetPriority(TIM17_IRQn, PC_PROF_IRQ_PRIORITY, 0U);
+    HAL_NVIC_EnableIRQ(TIM17_IRQn);
+    TIM17->CR1 = TIM_CR1_CEN;
+}
+
+static void prof_timer_stop(void)
+{
+    TIM17->CR1 = 0U;
+    TIM17->DIER = 0U;
+    HAL_NVIC_DisableIRQ(TIM17_IRQn);
+    __HAL_RCC_TIM17_CLK_DISABLE();
+}
+
+static void prof_put32(uint8_t* dst, uint32_t v)
+{
+    memcpy(dst, &v, sizeof(v));
+}
+
+/* Task names, so the samples can be labelled */
+static void prof_send_info(void)
+{
+    static TaskStatus_t tasks[PROF_INFO_TASKS];
+    ProfStream_t* s = &prof_stream;
+    UBaseType_t n = uxTaskGetSystemState(tasks, PROF_INFO_TASKS, NULL);
+    struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)(8U + n * PROF_INFO_ENTRY_LEN), PBUF_RAM);
+    uint8_t* b;
+
+    if (p == NULL) {
+        return;
+    }
+    b = p->payload;
+    prof_put32(&b[0], PROF_MAGIC_INFO);
+    prof_put32(&b[4], s->hz);
+    b += 8;
+    for (UBaseType_t i = 0; i < n; i++) {
+        b[0] = (uint8_t)'T';
+        b[1] = (uint8_t)tasks[i].xTaskNumber;
+        memset(&b[2], 0, PROF_NAME_LEN);
+        strncpy((char*)&b[2], tasks[i].pcTaskName, PROF_NAME_LEN);
+        b += PROF_INFO_ENTRY_LEN;
+    }
+    (void)udp_sendto(s->pcb, p, &s->peer, s->port);
+    pbuf_free(p);
+}
+
+/* One datagram from tail; false when there is nothing more to send */
+static bool prof_send_samples(void)
+{
+    ProfStream_t* s = &prof_stream;
+    uint32_t head = prof_head;
+    uint32_t n;
+    struct pbuf* p;
+    uint8_t* b;
+
+    if (head - s->tail > PC_PROF_SAMPLES) {
+        s->lost += head - s->tail - PC_PROF_SAMPLES;
+        s->tail = head - PC_PROF_SAMPLES;
+    }
+    n = LWIP_MIN(head - s->tail, PROF_DGRAM_SAMPLES);
+    if (n == 0U) {
+        return false;
+    }
+    p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)(PROF_HDR_LEN + n * sizeof(PcProfSample_t)), PBUF_RAM);
+    if (p == NULL) {
+        return false;
+    }
+    b = p->payload;
+    for (uint32_t i = 0; i < n; i++) {
+        memcpy(&b[PROF_HDR_LEN + i * sizeof(PcProfSample_t)],
+               &prof_ring[(s->tail + i) & (PC_PROF_SAMPLES - 1U)], sizeof(PcProfSample_t));
+    }
+    /* Overwritten while being copied: the handler lapped the first ones */
+    if (prof_head - s->tail > PC_PROF_SAMPLES) {
+        pbuf_free(p);
+        s->lost += n;
+        s->tail += n;
+        return true;
+    }
+    prof_put32(&b[0], PROF_MAGIC_SAMPLES);
+    prof_put32(&b[4], s->seq++);
+    prof_put32(&b[8], s->lost);
+    prof_put32(&b[12], s->tail);
+    (void)udp_sendto(s->pcb, p, &s->peer, s->port);
+    pbuf_free(p);
+    s->tail += n;
+    return n == PROF_DGRAM_SAMPLES;
+}
+
+static void prof_stop(const char* why)
+{
+    ProfStream_t* s = &prof_stream;
+
+    prof_timer_stop();
+    s->on = false;
+    LOG_INFO(PROF_TAG, "stream to %s %s, %lu samples, %lu lost", ipaddr_ntoa(&s->peer), why, prof_head, s->lost);
+}
+
+/* Runs on the tcpip thread */
+static void prof_stream_timer(void* arg)
+{
+    ProfStream_t* s = &prof_stream;
+
+    (void)arg;
+    if (sys_now() - s->last_rx_ms > PC_PROF_STREAM_IDLE_MS) {
+        prof_stop("idle");
+        return;
+    }
+    for (uint32_t i = 0; i < PROF_DGRAM_BURST && prof_send_samples(); i++) {
+    }
+    sys_timeout(PC_PROF_STREAM_MS, prof_stream_timer, NULL);
+}
+
+static void prof_stream_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    ProfStream_t* s = &prof_stream;
+    char cmd[8] = { 0 };
+
+    (void)arg;
+    (void)pcb;
+    (void)pbuf_copy_partial(p, cmd, sizeof(cmd) - 1U, 0);
+    pbuf_free(p);
+    if (strncmp(cmd, "start", 5) == 0) {
+        s->last_rx_ms = sys_now();
+        if (s->on && ip_addr_cmp(&s->peer, addr) && s->port == port) {
+            /* Keepalive */
+            return;
+        }
+        ip_addr_copy(s->peer, *addr);
+        s->port = port;
+        s->seq = 0U;
+        s->lost = 0U;
+        s->tail = prof_head;
+        if (!s->on) {
+            s->on = true;
+            prof_timer_start();
+            sys_timeout(PC_PROF_STREAM_MS, prof_stream_timer, NULL);
+        }
+        prof_send_info();
+        LOG_INFO(PROF_TAG, "stream to %s:%u at %lu Hz", ipaddr_ntoa(addr), (unsigned)port, s->hz);
+    } else if (strncmp(cmd, "stop", 4) == 0 && s->on) {
+        sys_untimeout(prof_stream_timer, NULL);
+        prof_stop("stopped");
+    }
+}
+
+void pc_prof_init(void)
+{
+    LOCK_TCPIP_CORE();
+    prof_stream.pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if (prof_stream.pcb != NULL && udp_bind(prof_stream.pcb, IP_ANY_TYPE, PC_PROF_UDP_PORT) == ERR_OK) {
+        udp_recv(prof_stream.pcb, prof_stream_recv, NULL);
+    } else {
+        if (prof_stream.pcb != NULL) {
+            udp_remove(prof_stream.pcb);
+            prof_stream.pcb = NULL;
+        }
+        LOG_ERROR(PROF_TAG, "no stream port %u", (unsigned)PC_PROF_UDP_PORT);
+    }
+    UNLOCK_TCPIP_CORE();
+}
+
+#endif /* PC_PROF */
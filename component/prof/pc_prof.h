@@ -0,0 +1,94 @@
+/**
+ * @file pc_prof.h
+ * @brief Statistical profiler: interrupted PC samples streamed over UDP.
+ *
+ * While a client streams, TIM17 interrupts PC_PROF_HZ times a second at
+ * PC_PROF_IRQ_PRIORITY, above configMAX_SYSCALL_INTERRUPT_PRIORITY, so
+ * that critical sections, the lwIP core lock holders and the ETH handler
+ * are sampled like any other code. The handler takes the PC and LR from
+ * the exception frame the hardware stacked, with the running task and the
+ * interrupted exception number, and stores them in a RAM ring; that is
+ * all it does. There is no unwinding: the LR is the caller of a leaf
+ * function and a stale return address in any other, so the host treats
+ * it as a hint (one frame of context), not as a call stack.
+ *
+ * Without a client the timer is off and the profiler costs nothing but
+ * the ring. The stream is that of trace_rec.h on its own port:
+ *  - a datagram "start" to PC_PROF_UDP_PORT starts sampling and streaming
+ *    to the sender every PC_PROF_STREAM_MS; "stop" ends both, as does
+ *    PC_PROF_STREAM_IDLE_MS without a datagram (send "start" again to
+ *    keep it)
+ *  - first an info datagram:   "PRFI" u32 sample_hz, then 18-byte entries
+ *                              { u8 'T', u8 task number, char name[16] }
+ *  - then sample datagrams:    "PRFS" u32 seq, u32 lost, u32 index of the
+ *                              first sample, PcProfSample_t samples[]
+ * Fields are little endian. tools/pc_flame.py symbolises the samples
+ * against the ELF and writes folded stacks for flamegraph.pl or
+ * speedscope.
+ */
+
+#pragma once
+
+#ifndef PC_PROF_H
+#define PC_PROF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef PC_PROF
+#define PC_PROF 1
+#endif
+
+/* Sample rate; off the multiples of the 1 kHz tick, so that sampling does
+ * not run in lock-step with the tick work */
+#ifndef PC_PROF_HZ
+#define PC_PROF_HZ 3989U
+#endif
+
+/* Ring length, a power of two; 12 bytes each */
+#ifndef PC_PROF_SAMPLES
+#define PC_PROF_SAMPLES 1024U
+#endif
+
+/* Above configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY (5): the handler
+ * calls no RTOS function and is not held off by critical sections */
+#ifndef PC_PROF_IRQ_PRIORITY
+#define PC_PROF_IRQ_PRIORITY 2U
+#endif
+
+#ifndef PC_PROF_UDP_PORT
+#define PC_PROF_UDP_PORT 5004U
+#endif
+
+#ifndef PC_PROF_STREAM_MS
+#define PC_PROF_STREAM_MS 20U
+#endif
+
+#ifndef PC_PROF_STREAM_IDLE_MS
+#define PC_PROF_STREAM_IDLE_MS 60000U
+#endif
+
+typedef struct {
+    uint32_t pc;                /* interrupted instruction */
+    uint32_t lr;                /* its LR: the caller, for a leaf function */
+    uint8_t task;               /* task number of the running task, 0: before the scheduler */
+    uint8_t reserved;
+    uint16_t exc;               /* interrupted exception number, 0: thread mode */
+} PcProfSample_t;
+
+#if PC_PROF
+
+/* Opens the UDP port. Call once from a task after MX_LWIP_Init(). */
+void pc_prof_init(void);
+
+#endif /* PC_PROF */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PC_PROF_H */
@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""PC-sampling profile of the board as folded stacks for a flame graph.
+
+Asks the profiler (component/prof/pc_prof.h) on PC_PROF_UDP_PORT for its
+sample stream, collects for a while, symbolises every sample against the
+ELF that is running on the target and writes one folded stack per line,
+
+    task;caller;function count
+
+the input of flamegraph.pl and speedscope. The stream is
+
+    "PRFI" hz:u32, then { 'T' task:u8 name:char[16] } per task
+    "PRFS" seq:u32 lost:u32 index:u32, then samples of
+        pc:u32 lr:u32 task:u8 reserved:u8 exc:u16
+
+all little endian. Samples taken in an exception handler get the handler
+(its vector name, or irqN) as root instead of the interrupted task. The
+caller frame comes from the sampled LR, which is only exact in a leaf
+function; it is left out where it does not resolve or names the function
+itself, and with --no-lr altogether.
+
+    pc_flame.py Debug/STM32_eth.elf 192.168.7.2 [--port 5004] [--seconds 10]
+                [--out prof.folded] [--no-lr] [--top 20]
+    flamegraph.pl prof.folded > prof.svg
+
+Requires pyelftools.
+"""
+
+import argparse
+import bisect
+import collections
+import socket
+import struct
+import sys
+import time
+
+from elftools.elf.elffile import ELFFile
+
+INFO_MAGIC = b"PRFI"
+SAMPLES_MAGIC = b"PRFS"
+SAMPLES_HEADER = struct.Struct("<4sIII")
+SAMPLE = struct.Struct("<IIBBH")
+TASK_ENTRY = struct.Struct("<cB16s")
+KEEPALIVE_S = 10.0
+EXCEPTIONS = {2: "NMI", 3: "HardFault", 4: "MemManage", 5: "BusFault", 6: "UsageFault",
+              11: "SVCall", 12: "DebugMon", 14: "PendSV", 15: "SysTick"}
+
+
+class Symbols:
+    """Function symbols of the ELF, looked up by address."""
+
+    def __init__(self, path):
+        funcs = []
+        with open(path, "rb") as f:
+            elf = ELFFile(f)
+            symtab = elf.get_section_by_name(".symtab")
+            if symtab is None:
+                sys.exit("%s: no symbol table" % path)
+            for sym in symtab.iter_symbols():
+                if sym["st_info"]["type"] == "STT_FUNC" and sym["st_value"] != 0:
+                    # Thumb functions have bit 0 set
+                    funcs.append((sym["st_value"] & ~1, sym["st_size"], sym.name))
+        funcs.sort()
+        self.starts = [f[0] for f in funcs]
+        self.funcs = funcs
+
+    def name(self, addr):
+        i = bisect.bisect_right(self.starts, addr) - 1
+        if i < 0:
+            return None
+        start, size, name = self.funcs[i]
+        if addr >= start + max(size, 2):
+            return None
+        return name
+
+
+def isr_name(exc):
+    if exc >= 16:
+        return "irq%d" % (exc - 16)
+    return EXCEPTIONS.get(exc, "exc%d" % exc)
+
+
+class Profile:
+    def __init__(self, symbols, use_lr):
+        self.symbols = symbols
+        self.use_lr = use_lr
+        self.tasks = {0: "startup"}
+        self.hz = 0
+        self.stacks = collections.Counter()
+        self.self_counts = collections.Counter()
+        self.samples = 0
+        self.lost = 0
+        self.seq = None
+        self.gaps = 0
+
+    def info(self, datagram):
+        (self.hz,) = struct.unpack_from("<I", datagram, 4)
+        for off in range(8, len(datagram) - TASK_ENTRY.size + 1, TASK_ENTRY.size):
+            kind, number, name = TASK_ENTRY.unpack_from(datagram, off)
+            if kind == b"T":
+                self.tasks[number] = name.split(b"\0", 1)[0].decode("ascii", "replace")
+
+    def frames(self, pc, lr, task, exc):
+        func = self.symbols.name(pc) or "0x%08x" % pc
+        stack = [isr_name(exc) if exc else self.tasks.get(task, "task%d" % task)]
+        # An EXC_RETURN value is no caller
+        if self.use_lr and lr < 0xF0000000:
+            caller = self.symbols.name((lr & ~1) - 2)
+            if caller is not None and caller != func:
+                stack.append(caller)
+        stack.append(func)
+        return func, stack
+
+    def samples_datagram(self, datagram):
+        _, seq, lost, _ = SAMPLES_HEADER.unpack_from(datagram)
+        if self.seq is not None and seq > self.seq + 1:
+            self.gaps += seq - self.seq - 1
+        self.seq = seq
+        self.lost = lost
+        for off in range(SAMPLES_HEADER.size, len(datagram) - SAMPLE.size + 1, SAMPLE.size):
+            pc, lr, task, _, exc = SAMPLE.unpack_from(datagram, off)
+            func, stack = self.frames(pc, lr, task, exc)
+            self.stacks[";".join(stack)] += 1
+            self.self_counts[func] += 1
+            self.samples += 1
+
+    def feed(self, datagram):
+        if datagram[:4] == INFO_MAGIC:
+            self.info(datagram)
+        elif datagram[:4] == SAMPLES_MAGIC and len(datagram) >= SAMPLES_HEADER.size:
+            self.samples_datagram(datagram)
+        else:
+            print("unknown datagram (%d bytes)" % len(datagram), file=sys.stderr)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("elf")
+    ap.add_argument("host")
+    ap.add_argument("--port", type=int, default=5004)
+    ap.add_argument("--seconds", type=float, default=10.0)
+    ap.add_argument("--out", help="folded stacks file, default stdout")
+    ap.add_argument("--no-lr", action="store_true", help="no caller frame")
+    ap.add_argument("--top", type=int, default=20, help="functions in the summary")
+    opts = ap.parse_args()
+
+    profile = Profile(Symbols(opts.elf), not opts.no_lr)
+    target = (opts.host, opts.port)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(0.5)
+    sock.sendto(b"start", target)
+    start = keepalive = time.monotonic()
+    try:
+        while time.monotonic() - start < opts.seconds:
+            if time.monotonic() - keepalive >= KEEPALIVE_S:
+                sock.sendto(b"start", target)
+                keepalive = time.monotonic()
+            try:
+                datagram, _ = sock.recvfrom(2048)
+            except socket.timeout:
+                continue
+            profile.feed(datagram)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        sock.sendto(b"stop", target)
+
+    out = open(opts.out, "w") if opts.out else sys.stdout
+    for stack, count in sorted(profile.stacks.items()):
+        out.write("%s %d\n" % (stack, count))
+    if opts.out:
+        out.close()
+
+    print("%d samples at %d Hz, %d lost on the target, %d datagrams missing"
+          % (profile.samples, profile.hz, profile.lost, profile.gaps), file=sys.stderr)
+    for func, count in profile.self_counts.most_common(opts.top):
+        print("%6.2f%% %7d  %s" % (100.0 * count / max(profile.samples, 1), count, func), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
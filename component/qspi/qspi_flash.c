@@ -0,0 +1,490 @@
+/**
+ * @file qspi_flash.c
+ * @brief QSPI NOR flash driver, see qspi_flash.h.
+ */
+
+#include "qspi_flash.h"
+
+#if QSPI_FLASH
+
+#include "main.h"
+#include "stm32h7xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "mdma/mdma_copy.h"
+
+#include <string.h>
+
+#define QSPI_CMD_RESET_ENABLE   0x66U
+#define QSPI_CMD_RESET          0x99U
+#define QSPI_CMD_JEDEC_ID       0x9FU
+#define QSPI_CMD_WRITE_ENABLE   0x06U
+#define QSPI_CMD_READ_SR1       0x05U
+#define QSPI_CMD_READ_SR2       0x35U
+#define QSPI_CMD_WRITE_SR       0x01U
+#define QSPI_CMD_WRITE_SR2      0x31U
+#define QSPI_CMD_SECTOR_ERASE   0x20U
+#define QSPI_CMD_QUAD_PROGRAM   0x32U
+#define QSPI_CMD_QUAD_IO_READ   0xEBU
+
+#define QSPI_SR1_BUSY           0x01U
+#define QSPI_SR1_WEL            0x02U
+#define QSPI_SR2_QE             0x02U
+
+/* 3-byte addresses */
+#define QSPI_ADDR_LIMIT         (16U * 1024U * 1024U)
+/* EBh: mode byte 0xFF (no continuous read), then 4 dummy clocks */
+#define QSPI_READ_MODE_BYTE     0xFFU
+#define QSPI_READ_DUMMY         4U
+#define QSPI_LINE               32U     /* D-cache line */
+
+extern QSPI_HandleTypeDef hqspi;
+
+typedef struct {
+    MDMA_HandleTypeDef hmdma;
+    SemaphoreHandle_t bus;          /* writer */
+    SemaphoreHandle_t done;         /* from the interrupt callbacks */
+    volatile bool done_ok;
+    volatile bool mapped;           /* readers admitted */
+    volatile uint32_t readers;
+    uint32_t size;
+    uint32_t dirty_lo;              /* written since qspi_flash_begin() */
+    uint32_t dirty_hi;
+    QspiFlashStats_t stats;
+} QspiFlash_t;
+
+static QspiFlash_t qspi;
+
+static void qspi_cmd(QSPI_CommandTypeDef* c, uint32_t instruction)
+{
+    memset(c, 0, sizeof(*c));
+    c->Instruction = instruction;
+    c->InstructionMode = QSPI_INSTRUCTION_1_LINE;
+    c->AddressMode = QSPI_ADDRESS_NONE;
+    c->AddressSize = QSPI_ADDRESS_24_BITS;
+    c->AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+    c->DataMode = QSPI_DATA_NONE;
+    c->DdrMode = QSPI_DDR_MODE_DISABLE;
+    c->DdrHoldHalfCycle = QSPI_DDR_HHC_ANALOG_DELAY;
+    c->SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
+}
+
+static bool qspi_send(uint32_t instruction)
+{
+    QSPI_CommandTypeDef c;
+
+    qspi_cmd(&c, instruction);
+    return HAL_QSPI_Command(&hqspi, &c, HAL_QSPI_TIMEOUT_DEFAULT_VALUE) == HAL_OK;
+}
+
+static bool qspi_read_reg(uint32_t instruction, uint8_t* data, uint32_t len)
+{
+    QSPI_CommandTypeDef c;
+
+    qspi_cmd(&c, instruction);
+    c.DataMode = QSPI_DATA_1_LINE;
+    c.NbData = len;
+    return HAL_QSPI_Command(&hqspi, &c, HAL_QSPI_TIMEOUT_DEFAULT_VALUE) == HAL_OK &&
+           HAL_QSPI_Receive(&hqspi, data, HAL_QSPI_TIMEOUT_DEFAULT_VALUE) == HAL_OK;
+}
+
+static bool qspi_write_reg(uint32_t instruction, uint8_t* data, uint32_t len)
+{
+    QSPI_CommandTypeDef c;
+
+    qspi_cmd(&c, instruction);
+    c.DataMode = QSPI_DATA_1_LINE;
+    c.NbData = len;
+    return HAL_QSPI_Command(&hqspi, &c, HAL_QSPI_TIMEOUT_DEFAULT_VALUE) == HAL_OK &&
+           HAL_QSPI_Transmit(&hqspi, data, HAL_QSPI_TIMEOUT_DEFAULT_VALUE) == HAL_OK;
+}
+
+/* Status register 1 polled by the controller until (SR1 & mask) == match */
+static void qspi_poll_cfg(QSPI_CommandTypeDef* c, QSPI_AutoPollingTypeDef* cfg, uint8_t mask, uint8_t match)
+{
+    qspi_cmd(c, QSPI_CMD_READ_SR1);
+    c->DataMode = QSPI_DATA_1_LINE;
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->Match = match;
+    cfg->Mask = mask;
+    cfg->MatchMode = QSPI_MATCH_MODE_AND;
+    cfg->StatusBytesSize = 1U;
+    cfg->Interval = 0x10U;
+    cfg->AutomaticStop = QSPI_AUTOMATIC_STOP_ENABLE;
+}
+
+static bool qspi_poll(uint8_t mask, uint8_t match)
+{
+    QSPI_CommandTypeDef c;
+    QSPI_AutoPollingTypeDef cfg;
+
+    qspi_poll_cfg(&c, &cfg, mask, match);
+    return HAL_QSPI_AutoPolling(&hqspi, &c, &cfg, HAL_QSPI_TIMEOUT_DEFAULT_VALUE) == HAL_OK;
+}
+
+static bool qspi_write_enable(void)
+{
+    return qspi_send(QSPI_CMD_WRITE_ENABLE) && qspi_poll(QSPI_SR1_WEL, QSPI_SR1_WEL);
+}
+
+/* Sleeps until an interrupt callback reports the operation started last */
+static bool qspi_wait(void)
+{
+    if (xSemaphoreTake(qspi.done, pdMS_TO_TICKS(QSPI_FLASH_TIMEOUT_MS)) != pdTRUE) {
+        (void)HAL_QSPI_Abort(&hqspi);
+        /* A completion racing the abort */
+        (void)xSemaphoreTake(qspi.done, 0);
+        qspi.stats.errors++;
+        return false;
+    }
+    if (!qspi.done_ok) {
+        qspi.stats.errors++;
+    }
+    return qspi.done_ok;
+}
+
+/* Busy bit cleared, polled by the controller; the task sleeps */
+static bool qspi_wait_ready(void)
+{
+    QSPI_CommandTypeDef c;
+    QSPI_AutoPollingTypeDef cfg;
+
+    qspi_poll_cfg(&c, &cfg, QSPI_SR1_BUSY, 0U);
+    if (HAL_QSPI_AutoPolling_IT(&hqspi, &c, &cfg) != HAL_OK) {
+        qspi.stats.errors++;
+        return false;
+    }
+    return qspi_wait();
+}
+
+static void qspi_signal(bool ok)
+{
+    BaseType_t woken = pdFALSE;
+
+    qspi.done_ok = ok;
+    xSemaphoreGiveFromISR(qspi.done, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void HAL_QSPI_TxCpltCallback(QSPI_HandleTypeDef* h)
+{
+    (void)h;
+    qspi_signal(true);
+}
+
+void HAL_QSPI_StatusMatchCallback(QSPI_HandleTypeDef* h)
+{
+    (void)h;
+    qspi_signal(true);
+}
+
+void HAL_QSPI_ErrorCallback(QSPI_HandleTypeDef* h)
+{
+    (void)h;
+    qspi_signal(false);
+}
+
+void QUADSPI_IRQHandler(void)
+{
+    HAL_QSPI_IRQHandler(&hqspi);
+}
+
+static bool qspi_map(void)
+{
+    QSPI_CommandTypeDef c;
+    QSPI_MemoryMappedTypeDef m = { 0 };
+
+    qspi_cmd(&c, QSPI_CMD_QUAD_IO_READ);
+    c.AddressMode = QSPI_ADDRESS_4_LINES;
+    c.AlternateByteMode = QSPI_ALTERNATE_BYTES_4_LINES;
+    c.AlternateBytesSize = QSPI_ALTERNATE_BYTES_8_BITS;
+    c.AlternateBytes = QSPI_READ_MODE_BYTE;
+    c.DummyCycles = QSPI_READ_DUMMY;
+    c.DataMode = QSPI_DATA_4_LINES;
+    m.TimeOutActivation = QSPI_TIMEOUT_COUNTER_DISABLE;
+    return HAL_QSPI_MemoryMapped(&hqspi, &c, &m) == HAL_OK;
+}
+
+/* Region 0 of MPU_Config() forbids 0x60000000-0xDFFFFFFF; the device gets
+ * its own region on top, read-only normal memory, write-through. */
+static void qspi_mpu(uint32_t size)
+{
+    MPU_Region_InitTypeDef r = { 0 };
+    uint32_t primask = __get_PRIMASK();
+
+    r.Enable = MPU_REGION_ENABLE;
+    r.Number = QSPI_FLASH_MPU_REGION;
+    r.BaseAddress = QSPI_FLASH_BASE;
+    r.Size = (uint8_t)(__builtin_ctz(size) - 1);
+    r.SubRegionDisable = 0x0;
+    r.TypeExtField = MPU_TEX_LEVEL0;
+    r.AccessPermission = MPU_REGION_PRIV_RO_URO;
+    r.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+    r.IsShareable = MPU_ACCESS_NOT_SHAREABLE;
+    r.IsCacheable = MPU_ACCESS_CACHEABLE;
+    r.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+
+    __disable_irq();
+    HAL_MPU_Disable();
+    HAL_MPU_ConfigRegion(&r);
+    HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+    if (primask == 0U) {
+        __enable_irq();
+    }
+}
+
+static bool qspi_quad_enable(void)
+{
+    uint8_t sr[2];
+
+    if (!qspi_read_reg(QSPI_CMD_READ_SR2, &sr[1], 1U)) {
+        return false;
+    }
+    if ((sr[1] & QSPI_SR2_QE) != 0U) {
+        return true;
+    }
+    sr[1] |= QSPI_SR2_QE;
+    if (!qspi_write_enable() || !qspi_write_reg(QSPI_CMD_WRITE_SR2, &sr[1], 1U) || !qspi_poll(QSPI_SR1_BUSY, 0U) ||
+        !qspi_read_reg(QSPI_CMD_READ_SR2, &sr[1], 1U)) {
+        return false;
+    }
+    if ((sr[1] & QSPI_SR2_QE) != 0U) {
+        return true;
+    }
+    /* Older parts only take both registers through 01h */
+    sr[1] |= QSPI_SR2_QE;
+    if (!qspi_read_reg(QSPI_CMD_READ_SR1, &sr[0], 1U) || !qspi_write_enable() ||
+        !qspi_write_reg(QSPI_CMD_WRITE_SR, sr, 2U) || !qspi_poll(QSPI_SR1_BUSY, 0U) ||
+        !qspi_read_reg(QSPI_CMD_READ_SR2, &sr[1], 1U)) {
+        return false;
+    }
+    return (sr[1] & QSPI_SR2_QE) != 0U;
+}
+
+static bool qspi_mdma_init(void)
+{
+    MDMA_HandleTypeDef* h = &qspi.hmdma;
+
+    h->Instance = QSPI_FLASH_MDMA_CHANNEL;
+    h->Init.Request = MDMA_REQUEST_QUADSPI_FIFO_TH;
+    h->Init.TransferTriggerMode = MDMA_BUFFER_TRANSFER;
+    h->Init.Priority = MDMA_PRIORITY_HIGH;
+    h->Init.Endianness = MDMA_LITTLE_ENDIANNESS_PRESERVE;
+    h->Init.SourceInc = MDMA_SRC_INC_BYTE;
+    h->Init.DestinationInc = MDMA_DEST_INC_DISABLE;
+    h->Init.SourceDataSize = MDMA_SRC_DATASIZE_BYTE;
+    h->Init.DestDataSize = MDMA_DEST_DATASIZE_BYTE;
+    h->Init.DataAlignment = MDMA_DATAALIGN_PACKENABLE;
+    /* One FIFO threshold (MX_QUADSPI_Init()) per request */
+    h->Init.BufferTransferLength = hqspi.Init.FifoThreshold;
+    h->Init.SourceBurst = MDMA_SOURCE_BURST_SINGLE;
+    h->Init.DestBurst = MDMA_DEST_BURST_SINGLE;
+    h->Init.SourceBlockAddressOffset = 0;
+    h->Init.DestBlockAddressOffset = 0;
+    if (HAL_MDMA_Init(h) != HAL_OK || !mdma_copy_share_irq(h)) {
+        return false;
+    }
+    __HAL_LINKDMA(&hqspi, hmdma, *h);
+    return true;
+}
+
+bool qspi_flash_init(void)
+{
+    uint8_t id[3];
+    uint32_t size;
+
+    if (qspi.size != 0U) {
+        return true;
+    }
+    qspi.bus = xSemaphoreCreateMutex();
+    qspi.done = xSemaphoreCreateBinary();
+    if (qspi.bus == NULL || qspi.done == NULL || !qspi_mdma_init()) {
+        return false;
+    }
+
+    /* Leaves a continuous read of a previous run */
+    if (!qspi_send(QSPI_CMD_RESET_ENABLE) || !qspi_send(QSPI_CMD_RESET)) {
+        return false;
+    }
+    HAL_Delay(1);
+    if (!qspi_read_reg(QSPI_CMD_JEDEC_ID, id, sizeof(id)) || id[2] < 16U || id[2] > 31U) {
+        return false;
+    }
+    size = 1UL << id[2];
+    if (size > QSPI_ADDR_LIMIT) {
+        size = QSPI_ADDR_LIMIT;
+    }
+    if (size > (2UL << hqspi.Init.FlashSize)) {
+        size = 2UL << hqspi.Init.FlashSize;
+    }
+    if (!qspi_quad_enable()) {
+        return false;
+    }
+
+    HAL_NVIC_SetPriority(QUADSPI_IRQn, QSPI_FLASH_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(QUADSPI_IRQn);
+    qspi_mpu(size);
+    if (!qspi_map()) {
+        return false;
+    }
+    qspi.size = size;
+    qspi.mapped = true;
+    return true;
+}
+
+uint32_t qspi_flash_size(void)
+{
+    return qspi.size;
+}
+
+bool qspi_flash_map_get(void)
+{
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    bool ok = qspi.mapped;
+
+    if (ok) {
+        qspi.readers++;
+    } else {
+        qspi.stats.map_refused++;
+    }
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+    return ok;
+}
+
+void qspi_flash_map_put(void)
+{
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+
+    qspi.readers--;
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+bool qspi_flash_begin(uint32_t timeout_ms)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    if (qspi.size == 0U || xSemaphoreTake(qspi.bus, pdMS_TO_TICKS(timeout_ms)) != pdTRUE) {
+        return false;
+    }
+    taskENTER_CRITICAL();
+    qspi.mapped = false;
+    taskEXIT_CRITICAL();
+    while (qspi.readers != 0U) {
+        if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(timeout_ms)) {
+            taskENTER_CRITICAL();
+            qspi.mapped = true;
+            taskEXIT_CRITICAL();
+            xSemaphoreGive(qspi.bus);
+            return false;
+        }
+        vTaskDelay(1);
+    }
+    (void)HAL_QSPI_Abort(&hqspi);
+    qspi.dirty_lo = UINT32_MAX;
+    qspi.dirty_hi = 0U;
+    return true;
+}
+
+void qspi_flash_end(void)
+{
+    bool mapped = qspi_map();
+
+    if (!mapped) {
+        qspi.stats.errors++;
+    }
+    if (qspi.dirty_lo < qspi.dirty_hi) {
+        uint32_t lo = qspi.dirty_lo & ~(QSPI_LINE - 1U);
+        uint32_t hi = (qspi.dirty_hi + QSPI_LINE - 1U) & ~(QSPI_LINE - 1U);
+        SCB_InvalidateDCache_by_Addr((void*)(uintptr_t)(QSPI_FLASH_BASE + lo), (int32_t)(hi - lo));
+    }
+    taskENTER_CRITICAL();
+    qspi.mapped = mapped;
+    taskEXIT_CRITICAL();
+    xSemaphoreGive(qspi.bus);
+}
+
+static void qspi_dirty(uint32_t addr, uint32_t len)
+{
+    if (addr < qspi.dirty_lo) {
+        qspi.dirty_lo = addr;
+    }
+    if (addr + len > qspi.dirty_hi) {
+        qspi.dirty_hi = addr + len;
+    }
+}
+
+bool qspi_flash_erase_sector(uint32_t addr)
+{
+    QSPI_CommandTypeDef c;
+
+    addr &= ~(QSPI_FLASH_SECTOR_SIZE - 1U);
+    if (addr >= qspi.size) {
+        return false;
+    }
+    qspi_cmd(&c, QSPI_CMD_SECTOR_ERASE);
+    c.AddressMode = QSPI_ADDRESS_1_LINE;
+    c.Address = addr;
+    if (!qspi_write_enable() || HAL_QSPI_Command(&hqspi, &c, HAL_QSPI_TIMEOUT_DEFAULT_VALUE) != HAL_OK) {
+        qspi.stats.errors++;
+        return false;
+    }
+    qspi_dirty(addr, QSPI_FLASH_SECTOR_SIZE);
+    qspi.stats.erases++;
+    return qspi_wait_ready();
+}
+
+/* One page or less: the MDMA feeds the FIFO, then the busy bit is polled */
+static bool qspi_program_page(uint32_t addr, const uint8_t* data, uint32_t len)
+{
+    QSPI_CommandTypeDef c;
+    uintptr_t lo = (uintptr_t)data & ~(uintptr_t)(QSPI_LINE - 1U);
+
+    SCB_CleanDCache_by_Addr((uint32_t*)lo, (int32_t)((uintptr_t)data + len - lo));
+    qspi_cmd(&c, QSPI_CMD_QUAD_PROGRAM);
+    c.AddressMode = QSPI_ADDRESS_1_LINE;
+    c.Address = addr;
+    c.DataMode = QSPI_DATA_4_LINES;
+    c.NbData = len;
+    if (!qspi_write_enable() || HAL_QSPI_Command(&hqspi, &c, HAL_QSPI_TIMEOUT_DEFAULT_VALUE) != HAL_OK ||
+        HAL_QSPI_Transmit_DMA(&hqspi, (uint8_t*)data) != HAL_OK) {
+        qspi.stats.errors++;
+        return false;
+    }
+    if (!qspi_wait()) {
+        return false;
+    }
+    qspi_dirty(addr, len);
+    qspi.stats.programs++;
+    qspi.stats.bytes += len;
+    return qspi_wait_ready();
+}
+
+bool qspi_flash_program(uint32_t addr, const void* data, uint32_t len)
+{
+    const uint8_t* p = (const uint8_t*)data;
+
+    if (addr >= qspi.size || len > qspi.size - addr) {
+        return false;
+    }
+    while (len > 0U) {
+        uint32_t n = QSPI_FLASH_PAGE_SIZE - (addr & (QSPI_FLASH_PAGE_SIZE - 1U));
+        if (n > len) {
+            n = len;
+        }
+        if (!qspi_program_page(addr, p, n)) {
+            return false;
+        }
+        addr += n;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+void qspi_flash_get_stats(QspiFlashStats_t* stats)
+{
+    *stats = qspi.stats;
+}
+
+#endif /* QSPI_FLASH */
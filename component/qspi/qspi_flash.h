@@ -0,0 +1,121 @@
+/**
+ * @file qspi_flash.h
+ * @brief QSPI NOR flash: memory-mapped reads, MDMA-driven writes.
+ *
+ * The device on QUADSPI bank 1 (MX_QUADSPI_Init()) is a W25Q-style SPI
+ * NOR flash: JEDEC ID 9Fh, quad enable in status register 2, 4 KB sector
+ * erase 20h, quad page program 32h and quad I/O fast read EBh with 3-byte
+ * addresses, so at most the first 16 MB are used whatever FlashSize says.
+ *
+ * The resting state is memory-mapped mode: the device appears read-only at
+ * QSPI_FLASH_BASE (MPU region QSPI_FLASH_MPU_REGION, cacheable
+ * write-through), for const data placed with QSPI_FLASH_RODATA and for
+ * reading back what was written. Erase and program need indirect mode,
+ * which unmaps the device. Readers therefore bracket every access, also
+ * a DMA that reads the window, with qspi_flash_map_get()/_put(); a writer
+ * takes the device with qspi_flash_begin(), which refuses new readers and
+ * waits for the current ones, and maps it again in qspi_flash_end().
+ * While a sector erase runs (typically 45 ms, up to 400 ms) readers are
+ * refused.
+ *
+ * Page data goes to the QUADSPI FIFO through MDMA channel
+ * QSPI_FLASH_MDMA_CHANNEL and the busy bit is polled by the QUADSPI
+ * auto-polling engine, both with interrupts: the writing task sleeps
+ * while the device works.
+ */
+
+#pragma once
+
+#ifndef QSPI_FLASH_H
+#define QSPI_FLASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 0 leaves the driver out of the startup code */
+#ifndef QSPI_FLASH
+#define QSPI_FLASH 1
+#endif
+
+#define QSPI_FLASH_BASE         0x90000000U
+#define QSPI_FLASH_SECTOR_SIZE  4096U
+#define QSPI_FLASH_PAGE_SIZE    256U
+
+/* Const data in the memory-mapped device, see the .qspi_rodata section in
+ * the linker script; readable between qspi_flash_map_get() and _put() */
+#define QSPI_FLASH_RODATA __attribute__((section(".qspi_rodata")))
+
+/* MDMA_Channel0 is mdma_copy.c's */
+#ifndef QSPI_FLASH_MDMA_CHANNEL
+#define QSPI_FLASH_MDMA_CHANNEL MDMA_Channel1
+#endif
+
+/* Above region 3 (AXI SRAM) of MPU_Config() */
+#ifndef QSPI_FLASH_MPU_REGION
+#define QSPI_FLASH_MPU_REGION MPU_REGION_NUMBER4
+#endif
+
+/* Numerically not below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY */
+#ifndef QSPI_FLASH_IRQ_PRIORITY
+#define QSPI_FLASH_IRQ_PRIORITY 6
+#endif
+
+/* Longest wait for one page program or sector erase */
+#ifndef QSPI_FLASH_TIMEOUT_MS
+#define QSPI_FLASH_TIMEOUT_MS 1000U
+#endif
+
+typedef struct {
+    uint32_t erases;
+    uint32_t programs;      /* page program operations */
+    uint32_t bytes;
+    uint32_t errors;        /* QUADSPI or MDMA errors, timeouts */
+    uint32_t map_refused;   /* qspi_flash_map_get() during a write */
+} QspiFlashStats_t;
+
+/* Resets and identifies the device, sets its quad enable bit, and maps it.
+ * Call once after mdma_copy_init(), before the scheduler or from a task. */
+bool qspi_flash_init(void);
+
+/* Usable bytes from QSPI_FLASH_BASE, 0 before a successful init */
+uint32_t qspi_flash_size(void);
+
+/* Reader reference on the mapped window; false (no reference taken) while
+ * the device is not mapped or a writer waits. Never blocks, usable from
+ * tasks and interrupts. */
+bool qspi_flash_map_get(void);
+void qspi_flash_map_put(void);
+
+static inline const void* qspi_flash_ptr(uint32_t addr)
+{
+    return (const void*)(uintptr_t)(QSPI_FLASH_BASE + addr);
+}
+
+static inline bool qspi_flash_contains(const void* p)
+{
+    return (uintptr_t)p - QSPI_FLASH_BASE < qspi_flash_size();
+}
+
+/* Exclusive access for erase and program, task context. Waits up to
+ * timeout_ms for the readers to put their references back. */
+bool qspi_flash_begin(uint32_t timeout_ms);
+/* Maps the device again; the cached copy of everything written since
+ * qspi_flash_begin() is invalidated. */
+void qspi_flash_end(void);
+
+/* Between qspi_flash_begin() and _end(). addr is a device offset. A
+ * program may span pages; it only clears bits. */
+bool qspi_flash_erase_sector(uint32_t addr);
+bool qspi_flash_program(uint32_t addr, const void* data, uint32_t len);
+
+void qspi_flash_get_stats(QspiFlashStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QSPI_FLASH_H */
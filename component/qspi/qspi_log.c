@@ -0,0 +1,342 @@
+/**
+ * @file qspi_log.c
+ * @brief Sector ring of records in the QSPI flash, see qspi_log.h.
+ */
+
+#include "qspi_log.h"
+#include "qspi_flash.h"
+
+#if QSPI_FLASH
+
+#include <stddef.h>
+#include <string.h>
+
+#define QSPI_LOG_SECTOR         QSPI_FLASH_SECTOR_SIZE
+#define QSPI_LOG_MAGIC          0x5AU
+#define QSPI_LOG_PENDING        0x01U
+
+typedef struct {
+    uint8_t magic;
+    uint8_t flags;          /* QSPI_LOG_PENDING, programmed to 0 once replayed */
+    uint8_t kind;
+    uint8_t reserved;
+    uint16_t len;
+    uint16_t check;         /* Fletcher-16 of kind, len, seq and the payload */
+    uint32_t seq;
+} QspiLogHdr_t;
+
+#define QSPI_LOG_REC_LEN(len)   ((sizeof(QspiLogHdr_t) + (len) + 3U) & ~3U)
+
+static const uint8_t qspi_log_cleared = 0U;
+
+/* Offsets are relative to l->offset */
+static uint32_t qspi_log_next_sector(const QspiLog_t* l, uint32_t off)
+{
+    off = (off / QSPI_LOG_SECTOR + 1U) * QSPI_LOG_SECTOR;
+    return (off >= l->size) ? 0U : off;
+}
+
+static const QspiLogHdr_t* qspi_log_hdr(const QspiLog_t* l, uint32_t off)
+{
+    return (const QspiLogHdr_t*)qspi_flash_ptr(l->offset + off);
+}
+
+static uint16_t qspi_log_check(uint8_t kind, uint16_t len, uint32_t seq, const uint8_t* data)
+{
+    uint8_t head[7] = { kind, (uint8_t)len, (uint8_t)(len >> 8), (uint8_t)seq, (uint8_t)(seq >> 8),
+                        (uint8_t)(seq >> 16), (uint8_t)(seq >> 24) };
+    uint32_t a = 0U;
+    uint32_t b = 0U;
+
+    for (uint32_t i = 0U; i < sizeof(head); i++) {
+        a = (a + head[i]) % 255U;
+        b = (b + a) % 255U;
+    }
+    for (uint32_t i = 0U; i < len; i++) {
+        a = (a + data[i]) % 255U;
+        b = (b + a) % 255U;
+    }
+    return (uint16_t)((b << 8) | a);
+}
+
+/* Whether a complete record starts at off; the flash is mapped */
+static bool qspi_log_valid(const QspiLog_t* l, uint32_t off)
+{
+    const QspiLogHdr_t* h = qspi_log_hdr(l, off);
+    uint32_t room = QSPI_LOG_SECTOR - off % QSPI_LOG_SECTOR;
+
+    return room >= sizeof(QspiLogHdr_t) && h->magic == QSPI_LOG_MAGIC && QSPI_LOG_REC_LEN(h->len) <= room &&
+           h->check == qspi_log_check(h->kind, h->len, h->seq, (const uint8_t*)(h + 1));
+}
+
+/* Offset after the last valid record of the sector at off */
+static uint32_t qspi_log_sector_end(const QspiLog_t* l, uint32_t off, uint32_t* last_seq)
+{
+    uint32_t end = off + QSPI_LOG_SECTOR;
+
+    while (off < end && qspi_log_valid(l, off)) {
+        *last_seq = qspi_log_hdr(l, off)->seq;
+        off += QSPI_LOG_REC_LEN(qspi_log_hdr(l, off)->len);
+    }
+    return off;
+}
+
+/* The sector holding the newest flushed record */
+static uint32_t qspi_log_writer_sector(const QspiLog_t* l)
+{
+    uint32_t last = (l->flushed + l->size - 1U) % l->size;
+
+    return last - last % QSPI_LOG_SECTOR;
+}
+
+/* First pending record of the sector at off, or UINT32_MAX */
+static uint32_t qspi_log_sector_pending(const QspiLog_t* l, uint32_t off)
+{
+    uint32_t end = off + QSPI_LOG_SECTOR;
+
+    while (off < end && qspi_log_valid(l, off)) {
+        if ((qspi_log_hdr(l, off)->flags & QSPI_LOG_PENDING) != 0U) {
+            return off;
+        }
+        off += QSPI_LOG_REC_LEN(qspi_log_hdr(l, off)->len);
+    }
+    return UINT32_MAX;
+}
+
+bool qspi_log_init(QspiLog_t* l)
+{
+    uint32_t newest = UINT32_MAX;
+    uint32_t seq = 0U;
+    uint32_t head;
+
+    if (l->ready) {
+        return true;
+    }
+    if ((l->offset % QSPI_LOG_SECTOR) != 0U || (l->size % QSPI_LOG_SECTOR) != 0U || l->size < 2U * QSPI_LOG_SECTOR ||
+        qspi_flash_size() < l->offset + l->size || !qspi_flash_map_get()) {
+        return false;
+    }
+    for (uint32_t off = 0U; off < l->size; off += QSPI_LOG_SECTOR) {
+        if (qspi_log_valid(l, off) && (newest == UINT32_MAX || (int32_t)(qspi_log_hdr(l, off)->seq - seq) > 0)) {
+            newest = off;
+            seq = qspi_log_hdr(l, off)->seq;
+        }
+    }
+    if (newest == UINT32_MAX) {
+        head = 0U;
+        l->rd = head;
+    } else {
+        (void)qspi_log_sector_end(l, newest, &seq);
+        head = qspi_log_next_sector(l, newest);
+        /* Oldest first; the head sector is erased by the first write */
+        l->rd = head;
+        for (uint32_t off = qspi_log_next_sector(l, head); off != head; off = qspi_log_next_sector(l, off)) {
+            uint32_t rd = qspi_log_sector_pending(l, off);
+            if (rd != UINT32_MAX) {
+                l->rd = rd;
+                l->pending = true;
+                break;
+            }
+        }
+    }
+    qspi_flash_map_put();
+
+    l->wr = head;
+    l->flushed = head;
+    l->seq = seq + 1U;
+    l->ready = true;
+    return true;
+}
+
+bool qspi_log_ready(const QspiLog_t* l)
+{
+    return l->ready;
+}
+
+static uint16_t qspi_log_clip(uint16_t len)
+{
+    return (QSPI_LOG_REC_LEN(len) > QSPI_LOG_SECTOR) ? (uint16_t)(QSPI_LOG_SECTOR - sizeof(QspiLogHdr_t)) : len;
+}
+
+bool qspi_log_fits(const QspiLog_t* l, uint16_t len)
+{
+    return l->ready && l->stage_count < l->stage_records &&
+           l->stage_used + QSPI_LOG_REC_LEN(qspi_log_clip(len)) <= l->stage_size;
+}
+
+bool qspi_log_append(QspiLog_t* l, uint8_t kind, const void* data, uint16_t len)
+{
+    QspiLogHdr_t* h;
+    uint32_t rec;
+
+    if (!l->ready) {
+        return false;
+    }
+    len = qspi_log_clip(len);
+    rec = QSPI_LOG_REC_LEN(len);
+    if (!qspi_log_fits(l, len)) {
+        l->stats.dropped++;
+        return false;
+    }
+    if (l->wr % QSPI_LOG_SECTOR + rec > QSPI_LOG_SECTOR) {
+        l->wr = qspi_log_next_sector(l, l->wr);
+    }
+
+    h = (QspiLogHdr_t*)&l->stage[l->stage_used];
+    h->magic = QSPI_LOG_MAGIC;
+    h->flags = 0xFFU;
+    h->kind = kind;
+    h->reserved = 0xFFU;
+    h->len = len;
+    h->seq = l->seq++;
+    memcpy(h + 1, data, len);
+    memset((uint8_t*)(h + 1) + len, 0xFF, rec - sizeof(*h) - len);
+    h->check = qspi_log_check(kind, len, h->seq, (const uint8_t*)(h + 1));
+
+    l->stage_off[l->stage_count] = l->wr;
+    l->stage_len[l->stage_count] = (uint16_t)rec;
+    l->stage_count++;
+    l->stage_used += rec;
+    l->wr += rec;
+    if (l->wr == l->size) {
+        l->wr = 0U;
+    }
+    l->stats.appended++;
+    return true;
+}
+
+bool qspi_log_pending(const QspiLog_t* l)
+{
+    return l->ready && l->pending;
+}
+
+static void qspi_log_advance(QspiLog_t* l, uint32_t rd)
+{
+    l->rd = (rd == l->size) ? 0U : rd;
+    if (l->rd == l->flushed) {
+        l->pending = false;
+    }
+}
+
+uint32_t qspi_log_replay(QspiLog_t* l, QspiLogReplay_t fn, void* arg, uint32_t max)
+{
+    uint32_t sectors = l->size / QSPI_LOG_SECTOR;
+    uint32_t n = 0U;
+
+    if (max > l->marks_max - l->mark_count) {
+        max = l->marks_max - l->mark_count;
+    }
+    if (!qspi_log_pending(l) || max == 0U || !qspi_flash_map_get()) {
+        return 0U;
+    }
+    /* Every step advances rd towards flushed; the bound only guards
+     * against a damaged ring */
+    for (uint32_t guard = 0U; n < max && l->pending && guard < sectors + max; ) {
+        const QspiLogHdr_t* h = qspi_log_hdr(l, l->rd);
+
+        if (!qspi_log_valid(l, l->rd)) {
+            /* End of a sector's data; in the writer's sector, there is no more */
+            guard++;
+            if (l->rd - l->rd % QSPI_LOG_SECTOR == qspi_log_writer_sector(l)) {
+                l->rd = l->flushed;
+                l->pending = false;
+            } else {
+                qspi_log_advance(l, qspi_log_next_sector(l, l->rd));
+            }
+            continue;
+        }
+        if ((h->flags & QSPI_LOG_PENDING) != 0U) {
+            if (!fn(arg, h->kind, h + 1, h->len)) {
+                break;
+            }
+            l->marks[l->mark_count++] = l->rd;
+            l->stats.replayed++;
+            n++;
+        }
+        qspi_log_advance(l, l->rd + QSPI_LOG_REC_LEN(h->len));
+    }
+    qspi_flash_map_put();
+    return n;
+}
+
+/* Staged records [first, last) lie back to back in one sector */
+static bool qspi_log_write_run(QspiLog_t* l, uint32_t first, uint32_t last, uint32_t pos)
+{
+    uint32_t off = l->stage_off[first];
+    uint32_t len = 0U;
+
+    for (uint32_t i = first; i < last; i++) {
+        len += l->stage_len[i];
+    }
+    if (off % QSPI_LOG_SECTOR == 0U) {
+        /* The writer laps the reader: the rest of this sector is lost */
+        if (l->pending && l->rd / QSPI_LOG_SECTOR == off / QSPI_LOG_SECTOR) {
+            l->rd = qspi_log_next_sector(l, off);
+            l->stats.overwritten++;
+        }
+        l->stats.erases++;
+        if (!qspi_flash_erase_sector(l->offset + off)) {
+            return false;
+        }
+    }
+    if (!qspi_flash_program(l->offset + off, &l->stage[pos], len)) {
+        return false;
+    }
+    if (!l->pending) {
+        l->rd = off;
+        l->pending = true;
+    }
+    l->flushed = off + len;
+    if (l->flushed == l->size) {
+        l->flushed = 0U;
+    }
+    return true;
+}
+
+void qspi_log_flush(QspiLog_t* l)
+{
+    uint32_t pos = 0U;
+    uint32_t first = 0U;
+
+    if (!l->ready || (l->stage_count == 0U && l->mark_count == 0U) || !qspi_flash_begin(l->bus_wait_ms)) {
+        return;
+    }
+    for (uint32_t i = 0U; i < l->mark_count; i++) {
+        if (!qspi_flash_program(l->offset + l->marks[i] + offsetof(QspiLogHdr_t, flags), &qspi_log_cleared, 1U)) {
+            /* Replayed again after a restart */
+            l->stats.errors++;
+        }
+    }
+    l->mark_count = 0U;
+
+    while (first < l->stage_count) {
+        uint32_t last = first + 1U;
+        uint32_t run = l->stage_len[first];
+
+        while (last < l->stage_count && l->stage_off[last] == l->stage_off[last - 1U] + l->stage_len[last - 1U] &&
+               l->stage_off[last] % QSPI_LOG_SECTOR != 0U) {
+            run += l->stage_len[last];
+            last++;
+        }
+        if (!qspi_log_write_run(l, first, last, pos)) {
+            /* Nothing more goes into a sector with a failed write */
+            l->stats.errors++;
+            l->stats.dropped += l->stage_count - first;
+            l->wr = qspi_log_next_sector(l, l->stage_off[first]);
+            l->flushed = l->wr;
+            break;
+        }
+        pos += run;
+        first = last;
+    }
+    l->stage_count = 0U;
+    l->stage_used = 0U;
+    qspi_flash_end();
+}
+
+void qspi_log_get_stats(const QspiLog_t* l, QspiLogStats_t* stats)
+{
+    *stats = l->stats;
+}
+
+#endif /* QSPI_FLASH */
@@ -0,0 +1,119 @@
+/**
+ * @file qspi_log.h
+ * @brief Append-only record log in a range of the QSPI flash, replayed in
+ *        order.
+ *
+ * A QspiLog_t owns a range of 4 KB sectors and uses it as a ring written
+ * strictly in order: a sector is erased when the writer enters it, so
+ * every sector sees the same number of erases, and the oldest sector is
+ * the one lost when the ring is full. A record (header, payload, padded to
+ * 4 bytes) never spans sectors. The header carries a sequence number and
+ * a checksum; a torn record ends the valid data of its sector. Every boot
+ * continues in a fresh sector, so nothing is ever programmed next to a
+ * record a power loss may have cut.
+ *
+ * Records are pending until qspi_log_replay() has handed them out; that
+ * clears a flag byte in the header in place (NOR programming only clears
+ * bits), so a restart resumes with the oldest record not yet replayed.
+ *
+ * Flash writes are done by qspi_log_flush() alone: qspi_log_append() only
+ * stages in RAM and qspi_log_replay() only reads the mapped flash, so both
+ * are fine under the core lock. All calls on one log come from one task.
+ *
+ * The syslog archive (logger/log_store.h) and the MQTT store
+ * (mqttstore/mqtt_store.h) are such logs, each in its own range.
+ */
+
+#pragma once
+
+#ifndef QSPI_LOG_H
+#define QSPI_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Records the stage of a log holds at most: its smallest record is a
+ * header and up to 4 bytes */
+#define QSPI_LOG_STAGE_RECORDS(stage_size) ((stage_size) / 16U)
+
+/* Returns false to stop the replay; the record stays pending. */
+typedef bool (*QspiLogReplay_t)(void* arg, uint8_t kind, const void* data, uint16_t len);
+
+typedef struct {
+    uint32_t appended;
+    uint32_t dropped;       /* stage full, or lost to a failed write */
+    uint32_t replayed;
+    uint32_t erases;
+    uint32_t overwritten;   /* sectors erased before they were replayed */
+    uint32_t errors;        /* failed erases and programs */
+} QspiLogStats_t;
+
+/* Set up by QSPI_LOG_DEFINE(); the rest is the log's, see qspi_log.c */
+typedef struct {
+    uint32_t offset;        /* device range, whole sectors, two at least */
+    uint32_t size;
+    uint8_t* stage;         /* MDMA source of the flash writes */
+    uint32_t stage_size;
+    uint32_t* stage_off;
+    uint16_t* stage_len;
+    uint32_t stage_records;
+    uint32_t* marks;        /* replayed, flag not yet cleared */
+    uint32_t marks_max;
+    uint32_t bus_wait_ms;   /* longest wait for readers of the mapped flash */
+
+    bool ready;
+    uint32_t wr;            /* next record, staged or not */
+    uint32_t flushed;       /* end of the records in flash */
+    uint32_t rd;            /* next record to replay */
+    bool pending;           /* records from rd to flushed; rd == flushed with
+                               pending set is a full ring */
+    uint32_t seq;
+    uint32_t stage_used;
+    uint32_t stage_count;
+    uint32_t mark_count;
+    QspiLogStats_t stats;
+} QspiLog_t;
+
+/* Defines the log var in the device range offset/size, staging up to
+ * stage_size bytes between flushes and replaying up to replay_max records
+ * between them */
+#define QSPI_LOG_DEFINE(var, offset_, size_, stage_size_, replay_max_, bus_wait_ms_)             \
+    static uint8_t var##_stage[(stage_size_)] __attribute__((aligned(32)));                     \
+    static uint32_t var##_stage_off[QSPI_LOG_STAGE_RECORDS(stage_size_)];                       \
+    static uint16_t var##_stage_len[QSPI_LOG_STAGE_RECORDS(stage_size_)];                       \
+    static uint32_t var##_marks[(replay_max_)];                                                 \
+    static QspiLog_t var = { .offset = (offset_), .size = (size_), .stage = var##_stage,        \
+                             .stage_size = (stage_size_), .stage_off = var##_stage_off,         \
+                             .stage_len = var##_stage_len,                                      \
+                             .stage_records = QSPI_LOG_STAGE_RECORDS(stage_size_),              \
+                             .marks = var##_marks, .marks_max = (replay_max_),                  \
+                             .bus_wait_ms = (bus_wait_ms_) }
+
+/* Finds the newest record and the oldest pending one. Needs
+ * qspi_flash_init(); false leaves the log unusable. */
+bool qspi_log_init(QspiLog_t* l);
+bool qspi_log_ready(const QspiLog_t* l);
+
+bool qspi_log_append(QspiLog_t* l, uint8_t kind, const void* data, uint16_t len);
+/* Whether a record of len bytes fits the stage now */
+bool qspi_log_fits(const QspiLog_t* l, uint16_t len);
+/* Records not yet replayed */
+bool qspi_log_pending(const QspiLog_t* l);
+/* Hands up to max pending records, oldest first, to fn. Returns the number
+ * fn accepted. */
+uint32_t qspi_log_replay(QspiLog_t* l, QspiLogReplay_t fn, void* arg, uint32_t max);
+/* Writes the staged records and the replay marks. Task context, no lock
+ * held: it may wait for a sector erase. */
+void qspi_log_flush(QspiLog_t* l);
+
+void qspi_log_get_stats(const QspiLog_t* l, QspiLogStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* QSPI_LOG_H */
@@ -0,0 +1,145 @@
+/**
+ * @file resolv.c
+ * @brief Service names kept resolved, see resolv.h.
+ */
+
+#include "resolv.h"
+
+#include "lwip/opt.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+#include "lwip/dns.h"
+#include "lwip/sys.h"
+
+#include <string.h>
+
+typedef struct {
+    char name[RESOLV_NAME_MAX];
+    ip_addr_t addr;         /* under SYS_ARCH_PROTECT */
+    bool valid;
+    bool literal;
+    bool pending;           /* lookup in flight, its callback clears it */
+} ResolvName_t;
+
+/* tcpip thread, but for resolv_get() */
+typedef struct {
+    ResolvName_t names[RESOLV_NAMES];
+    uint32_t count;
+    bool polling;
+    ResolvStats_t stats;
+} Resolv_t;
+
+static Resolv_t resolv;
+
+static void resolv_store(ResolvName_t* n, const ip_addr_t* addr)
+{
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    if (n->valid && ip_addr_cmp(&n->addr, addr)) {
+        return;
+    }
+    if (n->valid) {
+        resolv.stats.changes++;
+    }
+    SYS_ARCH_PROTECT(lev);
+    ip_addr_copy(n->addr, *addr);
+    n->valid = true;
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+static void resolv_found(const char* name, const ip_addr_t* addr, void* arg)
+{
+    ResolvName_t* n = (ResolvName_t*)arg;
+
+    (void)name;
+    n->pending = false;
+    if (addr == NULL) {
+        resolv.stats.fails++;
+        return;
+    }
+    resolv.stats.answers++;
+    resolv_store(n, addr);
+}
+
+static void resolv_lookup(ResolvName_t* n)
+{
+    ip_addr_t addr;
+
+    if (n->literal || n->pending) {
+        return;
+    }
+    switch (dns_gethostbyname(n->name, &addr, resolv_found, n)) {
+    case ERR_OK:
+        resolv_store(n, &addr);
+        break;
+    case ERR_INPROGRESS:
+        n->pending = true;
+        resolv.stats.queries++;
+        break;
+    default:
+        resolv.stats.fails++;
+        break;
+    }
+}
+
+static void resolv_poll(void* arg)
+{
+    (void)arg;
+    for (uint32_t i = 0U; i < resolv.count; i++) {
+        resolv_lookup(&resolv.names[i]);
+    }
+    sys_timeout(RESOLV_POLL_MS, resolv_poll, NULL);
+}
+
+int resolv_add(const char* name)
+{
+    int id = -1;
+
+    if (name == NULL || name[0] == '\0' || strlen(name) >= RESOLV_NAME_MAX) {
+        return -1;
+    }
+    LOCK_TCPIP_CORE();
+    for (uint32_t i = 0U; i < resolv.count; i++) {
+        if (strcmp(resolv.names[i].name, name) == 0) {
+            id = (int)i;
+            break;
+        }
+    }
+    if (id < 0 && resolv.count < RESOLV_NAMES) {
+        ResolvName_t* n = &resolv.names[resolv.count];
+
+        memcpy(n->name, name, strlen(name) + 1U);
+        n->literal = ipaddr_aton(name, &n->addr) != 0;
+        n->valid = n->literal;
+        id = (int)resolv.count++;
+        resolv_lookup(n);
+        if (!resolv.polling) {
+            resolv.polling = true;
+            sys_timeout(RESOLV_POLL_MS, resolv_poll, NULL);
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+    return id;
+}
+
+bool resolv_get(int id, ip_addr_t* addr)
+{
+    SYS_ARCH_DECL_PROTECT(lev);
+    bool valid;
+
+    if (id < 0 || (uint32_t)id >= RESOLV_NAMES) {
+        return false;
+    }
+    SYS_ARCH_PROTECT(lev);
+    valid = resolv.names[id].valid;
+    if (valid) {
+        ip_addr_copy(*addr, resolv.names[id].addr);
+    }
+    SYS_ARCH_UNPROTECT(lev);
+    return valid;
+}
+
+void resolv_get_stats(ResolvStats_t* stats)
+{
+    *stats = resolv.stats;
+}
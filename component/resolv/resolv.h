@@ -0,0 +1,66 @@
+/**
+ * @file resolv.h
+ * @brief Service names (NTP, syslog, MQTT brokers) kept resolved.
+ *
+ * resolv_add() registers a name, or a literal address, once. A poll on
+ * the tcpip thread looks every name up in the lwIP DNS table each
+ * RESOLV_POLL_MS; a table hit counts as a use, so with DNS_PREFETCH_S
+ * (lwipopts.h) the table asks again before the TTL runs out and the name
+ * never drops out of it. resolv_get() returns the last answer from any
+ * task without the core lock and without waiting on DNS: false only
+ * until the first answer.
+ *
+ * An answer that goes away (NXDOMAIN, no server) leaves the last address
+ * in place; a changed answer replaces it.
+ */
+
+#pragma once
+
+#ifndef RESOLV_H
+#define RESOLV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lwip/ip_addr.h"
+
+/* Names registered at most; DNS_TABLE_SIZE leaves room for them */
+#ifndef RESOLV_NAMES
+#define RESOLV_NAMES 4U
+#endif
+
+/* Longest name, terminator included */
+#ifndef RESOLV_NAME_MAX
+#define RESOLV_NAME_MAX 64U
+#endif
+
+#ifndef RESOLV_POLL_MS
+#define RESOLV_POLL_MS 1000U
+#endif
+
+typedef struct {
+    uint32_t queries;       /* lookups that went to the server */
+    uint32_t answers;
+    uint32_t fails;         /* timeouts and errors */
+    uint32_t changes;       /* answers that moved a name */
+} ResolvStats_t;
+
+/* Index for resolv_get(), -1 when the table is full or the name too long.
+ * The name is copied, it may come from the memory-mapped configuration
+ * (config/config_store.h); the same name again returns the same index.
+ * Takes the core lock. */
+int resolv_add(const char* name);
+
+bool resolv_get(int id, ip_addr_t* addr);
+
+void resolv_get_stats(ResolvStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RESOLV_H */
@@ -0,0 +1,110 @@
+/**
+ * @file rtstats.c
+ * @brief Windowed per-task CPU load and its syslog export.
+ */
+
+#include "rtstats.h"
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+
+typedef struct {
+    UBaseType_t number;
+    uint32_t counter;
+} RtStatsPrev_t;
+
+typedef struct {
+    TaskStatus_t status[RTSTATS_MAX_TASKS];
+    RtStatsPrev_t prev[RTSTATS_MAX_TASKS];
+    UBaseType_t prev_count;
+    uint32_t prev_total;
+    TickType_t prev_tick;
+} RtStats_t;
+
+static RtStats_t rtstats;
+
+/* Run time of task number at the previous sample, 0 for a new task */
+static uint32_t rtstats_prev_counter(UBaseType_t number)
+{
+    for (UBaseType_t i = 0; i < rtstats.prev_count; i++) {
+        if (rtstats.prev[i].number == number) {
+            return rtstats.prev[i].counter;
+        }
+    }
+    return 0U;
+}
+
+uint32_t rtstats_sample(RtStatsTask_t* tasks, uint32_t max, uint32_t* window_ms)
+{
+    uint32_t total = 0U;
+    UBaseType_t count = uxTaskGetSystemState(rtstats.status, RTSTATS_MAX_TASKS, &total);
+    TickType_t tick = xTaskGetTickCount();
+    /* Counters wrap; unsigned differences stay right within one wrap */
+    uint32_t window = total - rtstats.prev_total;
+    uint32_t n = 0U;
+
+    if (count == 0U) {
+        /* More than RTSTATS_MAX_TASKS tasks: FreeRTOS fills nothing then */
+        return 0U;
+    }
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t* s = &rtstats.status[i];
+        uint32_t delta = s->ulRunTimeCounter - rtstats_prev_counter(s->xTaskNumber);
+
+        if (n < max && tasks != NULL) {
+            uint32_t load = (window != 0U) ? (uint32_t)(((uint64_t)delta * 1000U) / window) : 0U;
+            tasks[n].name = s->pcTaskName;
+            tasks[n].number = (uint32_t)s->xTaskNumber;
+            tasks[n].priority = (uint32_t)s->uxCurrentPriority;
+            tasks[n].load = (load > 1000U) ? 1000U : load;
+            tasks[n].stack_free = (uint32_t)s->usStackHighWaterMark;
+            n++;
+        }
+        rtstats.prev[i].number = s->xTaskNumber;
+        rtstats.prev[i].counter = s->ulRunTimeCounter;
+    }
+    rtstats.prev_count = count;
+    rtstats.prev_total = total;
+    if (window_ms != NULL) {
+        *window_ms = (uint32_t)(tick - rtstats.prev_tick) * portTICK_PERIOD_MS;
+    }
+    rtstats.prev_tick = tick;
+    return n;
+}
+
+void rtstats_log(void)
+{
+    static RtStatsTask_t tasks[RTSTATS_MAX_TASKS];
+    uint32_t window_ms = 0U;
+    uint32_t n = rtstats_sample(tasks, RTSTATS_MAX_TASKS, &window_ms);
+
+    LOG_INFO("CPU", "load over %lu ms, %lu tasks", window_ms, n);
+    for (uint32_t i = 0; i < n; i++) {
+        LOG_INFO("CPU", "%-16s %3lu.%lu%% prio %2lu stack free %lu",
+                 tasks[i].name, tasks[i].load / 10U, tasks[i].load % 10U,
+                 tasks[i].priority, tasks[i].stack_free);
+    }
+}
+
+#if RTSTATS_LOG_MS
+/* Runs on the tcpip thread */
+static void rtstats_timer(void* arg)
+{
+    rtstats_log();
+    sys_timeout(RTSTATS_LOG_MS, rtstats_timer, arg);
+}
+#endif
+
+void rtstats_init(void)
+{
+    /* Starts the first window here rather than at boot */
+    LOCK_TCPIP_CORE();
+    (void)rtstats_sample(NULL, 0U, NULL);
+#if RTSTATS_LOG_MS
+    sys_timeout(RTSTATS_LOG_MS, rtstats_timer, NULL);
+#endif
+    UNLOCK_TCPIP_CORE();
+}
@@ -0,0 +1,59 @@
+/**
+ * @file rtstats.h
+ * @brief Per-task CPU load from the FreeRTOS run-time counters.
+ *
+ * configGENERATE_RUN_TIME_STATS is driven by the DWT cycle counter (see
+ * getRunTimeCounterValue() in freertos.c), so the figures resolve single
+ * interrupt-to-task handovers rather than whole ticks. rtstats_sample()
+ * returns the load of every task over the window since the previous
+ * sample; rtstats_log() sends that to syslog (tag "CPU"), periodically when
+ * RTSTATS_LOG_MS is set.
+ */
+
+#pragma once
+
+#ifndef RTSTATS_H
+#define RTSTATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Period of the syslog export. 0: only on request through rtstats_log(). */
+#ifndef RTSTATS_LOG_MS
+#define RTSTATS_LOG_MS 10000U
+#endif
+
+/* Tasks covered by one sample; further tasks are left out. */
+#ifndef RTSTATS_MAX_TASKS
+#define RTSTATS_MAX_TASKS 16U
+#endif
+
+typedef struct {
+    const char* name;       /* valid while the task exists */
+    uint32_t number;        /* FreeRTOS task number, unique per task */
+    uint32_t priority;      /* current FreeRTOS priority */
+    uint32_t load;          /* share of the window in 0.1 % */
+    uint32_t stack_free;    /* stack high water mark, words */
+} RtStatsTask_t;
+
+/* Arms the periodic export when RTSTATS_LOG_MS is set. Call once from a
+ * task after the TCP/IP stack and the logger are up. */
+void rtstats_init(void);
+
+/* Fills up to max entries and returns their number; window_ms receives the
+ * length of the window (may be NULL). Not reentrant: the periodic export
+ * calls it from the tcpip thread, other callers must hold the core lock. */
+uint32_t rtstats_sample(RtStatsTask_t* tasks, uint32_t max, uint32_t* window_ms);
+
+/* Samples and logs one line per task. */
+void rtstats_log(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RTSTATS_H */
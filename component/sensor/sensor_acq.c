@@ -0,0 +1,457 @@
+/**
+ * @file sensor_acq.c
+ * @brief I2C sensor acquisition by DMA on a timer schedule, see sensor_acq.h.
+ */
+
+#include "sensor_acq.h"
+
+#if SENSOR_ACQ
+
+#include "main.h"
+#include "stm32h7xx_hal.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "metrics/metrics.h"
+#include "mpu/mpu_layout.h"
+#include "timesync/time_ns.h"
+
+#include <string.h>
+
+#define SENSOR_TAG          "SENSOR"
+#define SENSOR_LINE         32U     /* D-cache line */
+#define SENSOR_BLOCK_LEN    ((SENSOR_ACQ_BLOCK_SIZE + SENSOR_LINE - 1U) & ~(SENSOR_LINE - 1U))
+#define SENSOR_TIM_HZ       100000U
+#define SENSOR_I2C_STEP_HZ  25000000U   /* fastest TIMINGR time base */
+
+/* Task notification bits */
+#define SENSOR_NOTIFY_BLOCK 0x1U
+#define SENSOR_NOTIFY_RESET 0x2U
+
+#if SENSOR_ACQ_PERIOD_US < 10U || SENSOR_ACQ_PERIOD_US / 10U > 65536U
+#error "SENSOR_ACQ_PERIOD_US out of the TIM7 range"
+#endif
+
+typedef struct {
+    I2C_HandleTypeDef hi2c;
+    DMA_HandleTypeDef hdma;
+    const SensorAcqStep_t* steps;
+    uint32_t n;
+    uint16_t offset[SENSOR_ACQ_MAX_STEPS];  /* of each read in a block */
+    TaskHandle_t task;
+    /* Interrupts; the task only after a reset request */
+    volatile bool running;          /* a chain is under way */
+    volatile bool resetting;        /* the task recovers the bus */
+    uint32_t step;
+    uint32_t fill;                  /* block being filled */
+    uint32_t start_ms;
+    uint64_t start_ns;
+    uint32_t t_us[2];               /* per block, the period's start */
+    /* Interrupts to the task */
+    volatile bool pending;
+    volatile uint32_t ready;
+} SensorAcq_t;
+
+static SensorAcq_t acq;
+/* Written by the DMA alone; line aligned so the invalidation touches
+ * nothing else */
+static uint8_t acq_block[2][SENSOR_BLOCK_LEN] __attribute__((aligned(SENSOR_LINE)));
+static StaticTask_t acq_tcb;
+static StackType_t acq_stack[SENSOR_ACQ_STACK_WORDS];
+
+static Metric_t acq_blocks = METRIC_COUNTER_INIT("sensor.blocks");
+static Metric_t acq_errors = METRIC_COUNTER_INIT("sensor.errors");
+static Metric_t acq_late = METRIC_COUNTER_INIT("sensor.late");
+static Metric_t acq_overruns = METRIC_COUNTER_INIT("sensor.overruns");
+static Metric_t acq_chain_us = METRIC_GAUGE_INIT("sensor.chain_us");
+
+static uint32_t sensor_size(uint8_t kind)
+{
+    switch (kind) {
+    case SENSOR_ACQ_S8:
+    case SENSOR_ACQ_U8:
+        return 1U;
+    case SENSOR_ACQ_S16BE:
+    case SENSOR_ACQ_U16BE:
+    case SENSOR_ACQ_S16LE:
+    case SENSOR_ACQ_U16LE:
+        return 2U;
+    case SENSOR_ACQ_S24BE:
+    case SENSOR_ACQ_U24BE:
+        return 3U;
+    case SENSOR_ACQ_S32BE:
+    case SENSOR_ACQ_S32LE:
+        return 4U;
+    default:
+        return 0U;
+    }
+}
+
+static int32_t sensor_value(const uint8_t* p, uint8_t kind)
+{
+    switch (kind) {
+    case SENSOR_ACQ_S8:
+        return (int8_t)p[0];
+    case SENSOR_ACQ_U8:
+        return p[0];
+    case SENSOR_ACQ_S16BE:
+        return (int16_t)(((uint16_t)p[0] << 8) | p[1]);
+    case SENSOR_ACQ_U16BE:
+        return (int32_t)(((uint32_t)p[0] << 8) | p[1]);
+    case SENSOR_ACQ_S16LE:
+        return (int16_t)(((uint16_t)p[1] << 8) | p[0]);
+    case SENSOR_ACQ_U16LE:
+        return (int32_t)(((uint32_t)p[1] << 8) | p[0]);
+    case SENSOR_ACQ_S24BE:
+        return (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8)) >> 8;
+    case SENSOR_ACQ_U24BE:
+        return (int32_t)(((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2]);
+    case SENSOR_ACQ_S32BE:
+        return (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]);
+    case SENSOR_ACQ_S32LE:
+        return (int32_t)(((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0]);
+    default:
+        return 0;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Interrupts: TIM7, then one I2C transfer after the other */
+
+static void sensor_notify_from_isr(uint32_t bits)
+{
+    BaseType_t woken = pdFALSE;
+
+    xTaskNotifyFromISR(acq.task, bits, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void sensor_fail(void)
+{
+    metric_inc(&acq_errors);
+    acq.running = false;
+}
+
+/* The last step is in: the block goes to the task, the next period fills
+ * the other one */
+static void sensor_done(void)
+{
+#if MPU_POLICY_CACHED(MPU_AXI_POLICY)
+    SCB_InvalidateDCache_by_Addr((uint32_t*)(void*)acq_block[acq.fill], (int32_t)SENSOR_BLOCK_LEN);
+#endif
+    if (acq.pending) {
+        metric_inc(&acq_overruns);
+    }
+    acq.ready = acq.fill;
+    acq.pending = true;
+    acq.fill ^= 1U;
+    metric_set(&acq_chain_us, (uint32_t)((time_now_ns() - acq.start_ns) / 1000U));
+    metric_inc(&acq_blocks);
+    acq.running = false;
+    sensor_notify_from_isr(SENSOR_NOTIFY_BLOCK);
+}
+
+static void sensor_next(void)
+{
+    const SensorAcqStep_t* s;
+    HAL_StatusTypeDef st;
+
+    if (acq.step == acq.n) {
+        sensor_done();
+        return;
+    }
+    s = &acq.steps[acq.step];
+    if (s->kind == SENSOR_ACQ_WRITE) {
+        /* HAL_I2C_Mem_Write_IT() only reads the data */
+        st = HAL_I2C_Mem_Write_IT(&acq.hi2c, (uint16_t)(s->addr << 1), s->reg, I2C_MEMADD_SIZE_8BIT,
+                                  (uint8_t*)(uintptr_t)s->data, s->len);
+    } else {
+        st = HAL_I2C_Mem_Read_DMA(&acq.hi2c, (uint16_t)(s->addr << 1), s->reg, I2C_MEMADD_SIZE_8BIT,
+                                  &acq_block[acq.fill][acq.offset[acq.step]], s->len);
+    }
+    if (st != HAL_OK) {
+        sensor_fail();
+    }
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef* h)
+{
+    if (h == &acq.hi2c && acq.running) {
+        acq.step++;
+        sensor_next();
+    }
+}
+
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef* h)
+{
+    HAL_I2C_MemTxCpltCallback(h);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef* h)
+{
+    if (h == &acq.hi2c && acq.running) {
+        sensor_fail();
+    }
+}
+
+void TIM7_IRQHandler(void)
+{
+    TIM7->SR = ~(uint32_t)TIM_SR_UIF;
+    if (acq.running) {
+        metric_inc(&acq_late);
+        /* A transfer that never ends: the task resets the peripheral */
+        if (!acq.resetting && HAL_GetTick() - acq.start_ms >= SENSOR_ACQ_TIMEOUT_MS) {
+            acq.resetting = true;
+            sensor_notify_from_isr(SENSOR_NOTIFY_RESET);
+        }
+        return;
+    }
+    acq.running = true;
+    acq.step = 0U;
+    acq.start_ms = HAL_GetTick();
+    acq.start_ns = time_now_ns();
+    acq.t_us[acq.fill] = (uint32_t)(acq.start_ns / 1000U);
+    /* A clock change during the last chain: the bus is idle now */
+    if (acq.hi2c.Instance->TIMINGR != acq.hi2c.Init.Timing) {
+        __HAL_I2C_DISABLE(&acq.hi2c);
+        acq.hi2c.Instance->TIMINGR = acq.hi2c.Init.Timing;
+        __HAL_I2C_ENABLE(&acq.hi2c);
+    }
+    sensor_next();
+}
+
+void I2C1_EV_IRQHandler(void)
+{
+    HAL_I2C_EV_IRQHandler(&acq.hi2c);
+}
+
+void I2C1_ER_IRQHandler(void)
+{
+    HAL_I2C_ER_IRQHandler(&acq.hi2c);
+}
+
+void SENSOR_ACQ_DMA_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&acq.hdma);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Task */
+
+static void sensor_put(const uint8_t* block, uint32_t t_us)
+{
+    for (uint32_t i = 0U; i < acq.n; i++) {
+        const SensorAcqStep_t* s = &acq.steps[i];
+        uint32_t size = sensor_size(s->kind);
+
+        for (uint32_t v = 0U; size != 0U && v < s->len / size; v++) {
+            if (s->chan[v] != NULL) {
+                telemetry_agg_put_at(s->chan[v], sensor_value(&block[acq.offset[i] + v * size], s->kind), t_us);
+            }
+        }
+    }
+}
+
+/* A stuck transfer: the peripheral and the stream start over */
+static void sensor_reset(void)
+{
+    HAL_NVIC_DisableIRQ(TIM7_IRQn);
+    (void)HAL_DMA_Abort(&acq.hdma);
+    (void)HAL_I2C_DeInit(&acq.hi2c);
+    if (HAL_I2C_Init(&acq.hi2c) != HAL_OK) {
+        LOG_ERROR(SENSOR_TAG, "I2C1 does not come back");
+    }
+    metric_inc(&acq_errors);
+    acq.running = false;
+    acq.resetting = false;
+    HAL_NVIC_EnableIRQ(TIM7_IRQn);
+}
+
+static void sensor_task(void* arg)
+{
+    (void)arg;
+
+    for (;;) {
+        uint32_t bits = 0U;
+
+        (void)xTaskNotifyWait(0U, UINT32_MAX, &bits, portMAX_DELAY);
+        if ((bits & SENSOR_NOTIFY_RESET) != 0U) {
+            sensor_reset();
+        }
+        if ((bits & SENSOR_NOTIFY_BLOCK) != 0U) {
+            uint32_t b;
+            uint32_t t_us;
+
+            taskENTER_CRITICAL();
+            b = acq.ready;
+            t_us = acq.t_us[b];
+            acq.pending = false;
+            taskEXIT_CRITICAL();
+            sensor_put(acq_block[b], t_us);
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+
+/* TIM7 runs at twice PCLK1 unless APB1 is undivided (TIMPRE clear) */
+static uint32_t sensor_tim_clk(void)
+{
+    uint32_t clk = HAL_RCC_GetPCLK1Freq();
+
+    if ((RCC->D2CFGR & RCC_D2CFGR_D2PPRE1) != RCC_APB1_DIV1) {
+        clk *= 2U;
+    }
+    return clk;
+}
+
+/* ns in steps of an hz time base, rounded */
+static uint32_t sensor_i2c_steps(uint32_t hz, uint32_t ns)
+{
+    return (uint32_t)(((uint64_t)ns * hz + 500000000U) / 1000000000U);
+}
+
+/* TIMINGR for 400 kHz: SCLL 1320 ns, SCLH 1000 ns, SCLDEL 400 ns and
+ * SDADEL 120 ns on a time base of at most SENSOR_I2C_STEP_HZ, as
+ * 0x30931820 at 100 MHz */
+static uint32_t sensor_i2c_timing(void)
+{
+    uint32_t clk = HAL_RCC_GetPCLK1Freq();
+    uint32_t presc;
+    uint32_t hz;
+
+    if (SENSOR_ACQ_TIMING != 0U) {
+        return SENSOR_ACQ_TIMING;
+    }
+    presc = (clk + SENSOR_I2C_STEP_HZ - 1U) / SENSOR_I2C_STEP_HZ - 1U;
+    hz = clk / (presc + 1U);
+    return (presc << I2C_TIMINGR_PRESC_Pos) |
+           ((sensor_i2c_steps(hz, 400U) - 1U) << I2C_TIMINGR_SCLDEL_Pos) |
+           (sensor_i2c_steps(hz, 120U) << I2C_TIMINGR_SDADEL_Pos) |
+           ((sensor_i2c_steps(hz, 1000U) - 1U) << I2C_TIMINGR_SCLH_Pos) |
+           ((sensor_i2c_steps(hz, 1320U) - 1U) << I2C_TIMINGR_SCLL_Pos);
+}
+
+static bool sensor_hw_init(void)
+{
+    GPIO_InitTypeDef g = { 0 };
+
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    __HAL_RCC_I2C123_CONFIG(RCC_I2C123CLKSOURCE_D2PCLK1);
+    __HAL_RCC_I2C1_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    __HAL_RCC_TIM7_CLK_ENABLE();
+
+    g.Pin = GPIO_PIN_8 | GPIO_PIN_9;
+    g.Mode = GPIO_MODE_AF_OD;
+    g.Pull = GPIO_NOPULL;
+    g.Speed = GPIO_SPEED_FREQ_LOW;
+    g.Alternate = GPIO_AF4_I2C1;
+    HAL_GPIO_Init(GPIOB, &g);
+
+    acq.hdma.Instance = SENSOR_ACQ_DMA_STREAM;
+    acq.hdma.Init.Request = DMA_REQUEST_I2C1_RX;
+    acq.hdma.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    acq.hdma.Init.PeriphInc = DMA_PINC_DISABLE;
+    acq.hdma.Init.MemInc = DMA_MINC_ENABLE;
+    acq.hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    acq.hdma.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    acq.hdma.Init.Mode = DMA_NORMAL;
+    acq.hdma.Init.Priority = DMA_PRIORITY_LOW;
+    acq.hdma.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if (HAL_DMA_Init(&acq.hdma) != HAL_OK) {
+        return false;
+    }
+    __HAL_LINKDMA(&acq.hi2c, hdmarx, acq.hdma);
+
+    acq.hi2c.Instance = I2C1;
+    acq.hi2c.Init.Timing = sensor_i2c_timing();
+    acq.hi2c.Init.OwnAddress1 = 0U;
+    acq.hi2c.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
+    acq.hi2c.Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
+    acq.hi2c.Init.OwnAddress2 = 0U;
+    acq.hi2c.Init.OwnAddress2Masks = I2C_OA2_NOMASK;
+    acq.hi2c.Init.GeneralCallMode = I2C_GENERALCALL_DISABLE;
+    acq.hi2c.Init.NoStretchMode = I2C_NOSTRETCH_DISABLE;
+    if (HAL_I2C_Init(&acq.hi2c) != HAL_OK ||
+        HAL_I2CEx_ConfigAnalogFilter(&acq.hi2c, I2C_ANALOGFILTER_ENABLE) != HAL_OK) {
+        return false;
+    }
+
+    HAL_NVIC_SetPriority(I2C1_EV_IRQn, SENSOR_ACQ_IRQ_PRIORITY, 0U);
+    HAL_NVIC_SetPriority(I2C1_ER_IRQn, SENSOR_ACQ_IRQ_PRIORITY, 0U);
+    HAL_NVIC_SetPriority(SENSOR_ACQ_DMA_IRQn, SENSOR_ACQ_IRQ_PRIORITY, 0U);
+    HAL_NVIC_SetPriority(TIM7_IRQn, SENSOR_ACQ_IRQ_PRIORITY, 0U);
+    HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
+    HAL_NVIC_EnableIRQ(I2C1_ER_IRQn);
+    HAL_NVIC_EnableIRQ(SENSOR_ACQ_DMA_IRQn);
+
+    TIM7->CR1 = 0U;
+    TIM7->PSC = sensor_tim_clk() / SENSOR_TIM_HZ - 1U;
+    TIM7->ARR = SENSOR_ACQ_PERIOD_US / 10U - 1U;
+    TIM7->EGR = TIM_EGR_UG;
+    TIM7->SR = 0U;
+    TIM7->DIER = TIM_DIER_UIE;
+    return true;
+}
+
+bool sensor_acq_start(const SensorAcqStep_t* steps, uint32_t n)
+{
+    uint32_t used = 0U;
+
+    if (acq.task != NULL || n == 0U || n > SENSOR_ACQ_MAX_STEPS) {
+        return false;
+    }
+    for (uint32_t i = 0U; i < n; i++) {
+        const SensorAcqStep_t* s = &steps[i];
+        uint32_t size = sensor_size(s->kind);
+
+        if (s->addr > 0x7FU || s->len == 0U) {
+            return false;
+        }
+        if (s->kind == SENSOR_ACQ_WRITE) {
+            if (s->len > sizeof(s->data)) {
+                return false;
+            }
+            continue;
+        }
+        if (size == 0U || s->len % size != 0U || s->len / size > SENSOR_ACQ_VALUES_MAX ||
+            used + s->len > SENSOR_ACQ_BLOCK_SIZE) {
+            return false;
+        }
+        acq.offset[i] = (uint16_t)used;
+        used += s->len;
+    }
+    acq.steps = steps;
+    acq.n = n;
+
+    (void)metrics_register(&acq_blocks);
+    (void)metrics_register(&acq_errors);
+    (void)metrics_register(&acq_late);
+    (void)metrics_register(&acq_overruns);
+    (void)metrics_register(&acq_chain_us);
+
+    acq.task = xTaskCreateStatic(sensor_task, "Sensor", SENSOR_ACQ_STACK_WORDS, NULL, SENSOR_ACQ_PRIORITY,
+                                 acq_stack, &acq_tcb);
+    if (acq.task == NULL || !sensor_hw_init()) {
+        LOG_ERROR(SENSOR_TAG, "no I2C1");
+        return false;
+    }
+    HAL_NVIC_EnableIRQ(TIM7_IRQn);
+    TIM7->CR1 = TIM_CR1_CEN;
+    LOG_INFO(SENSOR_TAG, "%lu steps, %lu bytes every %lu us", n, used, (uint32_t)SENSOR_ACQ_PERIOD_US);
+    return true;
+}
+
+void sensor_acq_clock_changed(void)
+{
+    if ((RCC->APB1LENR & RCC_APB1LENR_TIM7EN) == 0U) {
+        return;
+    }
+    /* Preloaded: the period under way ends at the old rate. The timing
+     * goes to I2C1 at the start of the next chain (TIM7_IRQHandler()), and
+     * to HAL_I2C_Init() after a reset. */
+    TIM7->PSC = sensor_tim_clk() / SENSOR_TIM_HZ - 1U;
+    acq.hi2c.Init.Timing = sensor_i2c_timing();
+}
+
+#endif /* SENSOR_ACQ */
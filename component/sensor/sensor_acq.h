@@ -0,0 +1,141 @@
+/**
+ * @file sensor_acq.h
+ * @brief I2C sensors read on a timer schedule by DMA, samples to telemetry.
+ *
+ * The application describes one acquisition as a list of steps: register
+ * writes (a conversion start, a few bytes) and register reads. Every
+ * SENSOR_ACQ_PERIOD_US the TIM7 update interrupt stamps the block with
+ * time_now_ns() and starts the first step on I2C1; each completion
+ * callback starts the next one, so the chain runs without a task. Reads
+ * go by DMA (DMA1 stream SENSOR_ACQ_DMA_STREAM) into the block, writes by
+ * interrupt, the register address phase of both by interrupt too.
+ *
+ * The blocks are double-buffered: the last completion hands the filled
+ * block to the acquisition task with a task notification and the next
+ * period fills the other one. The task decodes each read step (big or
+ * little endian, 8 to 32 bits, signed or not) and puts the values to the
+ * step's telemetry channels (telemetry_agg.h) stamped with the block's
+ * time, so the windows follow the schedule rather than the task's
+ * latency. A period that finds the chain still running is skipped, a block
+ * the task has not taken yet is overwritten; a failed transfer (NACK, bus
+ * error, timeout) drops its block. All are counted.
+ *
+ * Pins and peripherals, not in the CubeMX project: I2C1 on PB8 (SCL) and
+ * PB9 (SDA), AF4, external pull-ups; kernel clock PCLK1 (see
+ * SENSOR_ACQ_TIMING), TIM7, DMA1 through the DMAMUX. clock_profile_switch()
+ * calls sensor_acq_clock_changed(), which keeps the schedule and the SCL
+ * rate; a chain under way finishes on the old timing. Blocks are in AXI
+ * SRAM, line aligned, invalidated after the DMA when the AXI policy is
+ * cached (mpu_layout.h); the steps may be anywhere but DTCM.
+ *
+ * Exported through metrics as "sensor.*".
+ */
+
+#pragma once
+
+#ifndef SENSOR_ACQ_H
+#define SENSOR_ACQ_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "telemetry/telemetry_agg.h"
+
+/* 0 leaves the pipeline out of the build */
+#ifndef SENSOR_ACQ
+#define SENSOR_ACQ 1
+#endif
+
+/* Schedule period, a multiple of 10 us up to 655 ms (TIM7 at 100 kHz) */
+#ifndef SENSOR_ACQ_PERIOD_US
+#define SENSOR_ACQ_PERIOD_US 10000U
+#endif
+
+/* I2C1 TIMINGR; 0 derives 400 kHz fast mode with 300 ns rise time from
+ * PCLK1, whatever the clock profile. A fixed value holds for one PCLK1
+ * only, e.g. 0x30931820U at 100 MHz (PRESC 3, SCLDEL 9, SDADEL 3,
+ * SCLH 24, SCLL 32). */
+#ifndef SENSOR_ACQ_TIMING
+#define SENSOR_ACQ_TIMING 0U
+#endif
+
+#ifndef SENSOR_ACQ_DMA_STREAM
+#define SENSOR_ACQ_DMA_STREAM DMA1_Stream0
+#define SENSOR_ACQ_DMA_IRQn DMA1_Stream0_IRQn
+#define SENSOR_ACQ_DMA_IRQHandler DMA1_Stream0_IRQHandler
+#endif
+
+/* Numerically not below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY */
+#ifndef SENSOR_ACQ_IRQ_PRIORITY
+#define SENSOR_ACQ_IRQ_PRIORITY 6
+#endif
+
+/* Steps per schedule and bytes read per block */
+#ifndef SENSOR_ACQ_MAX_STEPS
+#define SENSOR_ACQ_MAX_STEPS 16U
+#endif
+
+#ifndef SENSOR_ACQ_BLOCK_SIZE
+#define SENSOR_ACQ_BLOCK_SIZE 128U
+#endif
+
+/* A transfer that has not completed after this is abandoned */
+#ifndef SENSOR_ACQ_TIMEOUT_MS
+#define SENSOR_ACQ_TIMEOUT_MS 5U
+#endif
+
+/* osPriorityAboveNormal, see configOS2_TO_RTOS_PRIO(): the task decoding
+ * blocks, a few microseconds each, above the tcpip thread and the
+ * application */
+#ifndef SENSOR_ACQ_PRIORITY
+#define SENSOR_ACQ_PRIORITY 16
+#endif
+
+#ifndef SENSOR_ACQ_STACK_WORDS
+#define SENSOR_ACQ_STACK_WORDS 256U
+#endif
+
+/* Values per read step, each to its own channel */
+#define SENSOR_ACQ_VALUES_MAX 4U
+
+/* Step kinds: a register write, or a read of values in one format */
+#define SENSOR_ACQ_WRITE   0U
+#define SENSOR_ACQ_S8      1U
+#define SENSOR_ACQ_U8      2U
+#define SENSOR_ACQ_S16BE   3U
+#define SENSOR_ACQ_U16BE   4U
+#define SENSOR_ACQ_S16LE   5U
+#define SENSOR_ACQ_U16LE   6U
+#define SENSOR_ACQ_S24BE   7U
+#define SENSOR_ACQ_U24BE   8U
+#define SENSOR_ACQ_S32BE   9U
+#define SENSOR_ACQ_S32LE   10U
+
+typedef struct {
+    uint8_t addr;           /* 7-bit device address */
+    uint8_t reg;            /* first register, 8-bit addresses */
+    uint8_t kind;           /* SENSOR_ACQ_WRITE or a read format */
+    uint8_t len;            /* bytes written from data[], or read */
+    uint8_t data[4];
+    /* Reads: len / format size values, value i to chan[i] (NULL: none) */
+    TelemetryChan_t* chan[SENSOR_ACQ_VALUES_MAX];
+} SensorAcqStep_t;
+
+/* Configures I2C1, DMA and TIM7, creates the task and starts the schedule
+ * of n steps; the steps stay in place, the channels added to the engine.
+ * Once, from a task. */
+bool sensor_acq_start(const SensorAcqStep_t* steps, uint32_t n);
+
+/* Re-derives the TIM7 prescaler and the I2C1 timing after a PCLK1 change;
+ * interrupts masked up to the syscall priority */
+void sensor_acq_clock_changed(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SENSOR_ACQ_H */
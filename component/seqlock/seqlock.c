@@ -0,0 +1,45 @@
+/**
+ * @file seqlock.c
+ * @brief Double-buffered snapshots, see seqlock.h.
+ */
+
+#include "seqlock.h"
+
+#include <string.h>
+
+void* seqsnap_write_begin(SeqSnap_t* s)
+{
+    uint32_t v = s->seq;
+    uint8_t* next = s->copy[(v + 1U) & 1U];
+
+    /* Readers still in this copy saw v - 1 and retry on the count */
+    memcpy(next, s->copy[v & 1U], s->size);
+    return next;
+}
+
+void seqsnap_write_end(SeqSnap_t* s)
+{
+    __DMB();
+    s->seq = s->seq + 1U;
+}
+
+void seqsnap_publish(SeqSnap_t* s, const void* src)
+{
+    memcpy(s->copy[(s->seq + 1U) & 1U], src, s->size);
+    seqsnap_write_end(s);
+}
+
+uint32_t seqsnap_read(const SeqSnap_t* s, void* dst)
+{
+    uint32_t retries = 0U;
+    uint32_t v;
+
+    for (;;) {
+        v = seqsnap_read_begin(s);
+        memcpy(dst, seqsnap_data(s, v), s->size);
+        if (!seqsnap_read_retry(s, v)) {
+            return retries;
+        }
+        retries++;
+    }
+}
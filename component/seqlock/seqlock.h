@@ -0,0 +1,146 @@
+/**
+ * @file seqlock.h
+ * @brief Sequence locks: one writer publishes without blocking, readers
+ *        copy and retry instead of locking.
+ *
+ * Seqlock_t is the plain sequence count: the writer makes it odd, updates
+ * the data in place and makes it even again; a reader notes the count,
+ * copies what it needs and starts over when the count was odd or has
+ * moved. Nothing is masked and nobody waits on anybody, but on one core a
+ * reader must never preempt the writer: it would find the count odd until
+ * the writer runs again, which it cannot. Use it for readers of lower
+ * priority than the writer (a monitor task behind the control loop).
+ *
+ * SeqSnap_t is the double-buffered variant for the other readers: tasks
+ * above the writer, the tcpip thread, ISRs. The state exists twice, the
+ * count's low bit names the current copy. The writer prepares the other
+ * copy, seqsnap_write_begin() having seeded it with the current one, and
+ * publishes it by bumping the count; a reader takes the copy the count
+ * names and only retries when the writer published during its copy, so a
+ * reader that preempted the writer never retries at all. The cost is the
+ * second copy and a copy of the state per update.
+ *
+ * One writer at a time per lock; writers that share one serialize among
+ * themselves, the readers are unaffected. The count changes with plain
+ * stores between __DMB() barriers, ordered against the data for any
+ * observer; no read-modify-write is needed, so neither exclusive accesses
+ * nor FreeRTOS's atomic.h, whose helpers are critical sections on this
+ * port, are involved.
+ *
+ * Writer:
+ *   State_t* s = seqsnap_write_begin(&snap);
+ *   s->speed = speed;
+ *   seqsnap_write_end(&snap);
+ * Reader:
+ *   do {
+ *       v = seqsnap_read_begin(&snap);
+ *       speed = ((const State_t*)seqsnap_data(&snap, v))->speed;
+ *   } while (seqsnap_read_retry(&snap, v));
+ */
+
+#pragma once
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "stm32h7xx_hal.h"
+
+typedef struct {
+    volatile uint32_t seq;      /* odd while the writer is inside */
+} Seqlock_t;
+
+#define SEQLOCK_INIT { .seq = 0U }
+
+static inline void seqlock_write_begin(Seqlock_t* l)
+{
+    l->seq = l->seq + 1U;
+    __DMB();
+}
+
+static inline void seqlock_write_end(Seqlock_t* l)
+{
+    __DMB();
+    l->seq = l->seq + 1U;
+}
+
+static inline uint32_t seqlock_read_begin(const Seqlock_t* l)
+{
+    uint32_t v = l->seq;
+
+    __DMB();
+    return v;
+}
+
+/* True when what was read since seqlock_read_begin() returned v is torn */
+static inline bool seqlock_read_retry(const Seqlock_t* l, uint32_t v)
+{
+    __DMB();
+    return (v & 1U) != 0U || l->seq != v;
+}
+
+typedef struct {
+    volatile uint32_t seq;      /* publications; the low bit the current copy */
+    uint8_t* copy[2];
+    uint32_t size;
+} SeqSnap_t;
+
+/* A snapshot of type, both copies zeroed, copy 0 current */
+#define SEQSNAP_DEFINE(var, type)                                               \
+    static type var##_copy[2];                                                  \
+    static SeqSnap_t var = { .seq = 0U,                                         \
+                             .copy = { (uint8_t*)&var##_copy[0], (uint8_t*)&var##_copy[1] }, \
+                             .size = sizeof(type) }
+
+/* The copy to update, holding the current state; the writer's until
+ * seqsnap_write_end() */
+void* seqsnap_write_begin(SeqSnap_t* s);
+/* Makes the updated copy current */
+void seqsnap_write_end(SeqSnap_t* s);
+/* Publishes size bytes of src as a whole */
+void seqsnap_publish(SeqSnap_t* s, const void* src);
+
+static inline uint32_t seqsnap_read_begin(const SeqSnap_t* s)
+{
+    uint32_t v = s->seq;
+
+    __DMB();
+    return v;
+}
+
+/* The copy current at v */
+static inline const void* seqsnap_data(const SeqSnap_t* s, uint32_t v)
+{
+    return s->copy[v & 1U];
+}
+
+/* p, pointing into copy 0, moved to the same place in the copy current
+ * at v */
+static inline const void* seqsnap_at(const SeqSnap_t* s, uint32_t v, const void* p)
+{
+    return &s->copy[v & 1U][(const uint8_t*)p - s->copy[0]];
+}
+
+/* True when the copy read since seqsnap_read_begin() returned v may have
+ * been overwritten */
+static inline bool seqsnap_read_retry(const SeqSnap_t* s, uint32_t v)
+{
+    __DMB();
+    /* The writer only writes the copy of v once it has published v + 1 */
+    return s->seq != v;
+}
+
+/* The whole state into dst, size bytes; returns the retries it took */
+uint32_t seqsnap_read(const SeqSnap_t* s, void* dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SEQLOCK_H */
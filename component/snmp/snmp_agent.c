@@ -0,0 +1,863 @@
+/**
+ * @file snmp_agent.c
+ * @brief SNMPv1/v2c agent of the system group and IF-MIB, see
+ *        snmp_agent.h.
+ */
+
+#include "snmp_agent.h"
+
+#if SNMP_AGENT
+
+#include "metrics/metrics.h"
+#include "logger/syslog.h"
+#include "timesync/time_ns.h"
+
+#include "main.h"
+#include "cmsis_os.h"
+#include "lwip/init.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "ethernetif.h"
+
+#include <string.h>
+
+#if SNMP_AGENT_MSG_MAX < 484U || SNMP_AGENT_MSG_MAX > 0xFFFFU
+#error "SNMP_AGENT_MSG_MAX must be 484 to 65535"
+#endif
+
+#define SNMP_TAG                "SNMP"
+
+/* BER tags */
+#define SNMP_INTEGER            0x02U
+#define SNMP_OCTETS             0x04U
+#define SNMP_NULL               0x05U
+#define SNMP_OID                0x06U
+#define SNMP_SEQUENCE           0x30U
+#define SNMP_COUNTER32          0x41U
+#define SNMP_GAUGE32            0x42U
+#define SNMP_TIMETICKS          0x43U
+#define SNMP_NO_SUCH_OBJECT     0x80U
+#define SNMP_NO_SUCH_INSTANCE   0x81U
+#define SNMP_END_OF_MIB_VIEW    0x82U
+
+#define SNMP_PDU_GET            0xA0U
+#define SNMP_PDU_GETNEXT        0xA1U
+#define SNMP_PDU_RESPONSE       0xA2U
+#define SNMP_PDU_SET            0xA3U
+#define SNMP_PDU_GETBULK        0xA5U
+
+#define SNMP_VERSION_1          0
+#define SNMP_VERSION_2C         1
+
+#define SNMP_ERR_TOO_BIG        1
+#define SNMP_ERR_NO_SUCH_NAME   2
+#define SNMP_ERR_NOT_WRITABLE   17
+
+/* Sub-identifiers of a request OID */
+#define SNMP_OID_MAX            32U
+/* Variable bindings of a request */
+#define SNMP_VARS_MAX           32U
+/* In front of the variable bindings: message, version, community, PDU,
+ * request id, error status and index, binding list headers */
+#define SNMP_HEADROOM           (40U + SNMP_AGENT_COMMUNITY_MAX)
+
+#define SNMP_IF_DESCR           "STM32H7 ETH MAC"
+/* ethernetCsmacd */
+#define SNMP_IF_TYPE            6U
+
+typedef struct {
+    const uint8_t* p;
+    const uint8_t* end;
+} SnmpIn_t;
+
+typedef struct {
+    uint8_t* buf;
+    uint32_t len;
+    uint32_t size;
+    bool full;
+} SnmpOut_t;
+
+typedef struct {
+    uint32_t id[SNMP_OID_MAX];
+    uint8_t len;
+} SnmpOid_t;
+
+typedef enum {
+    SNMP_SYS_DESCR,
+    SNMP_SYS_OBJECT_ID,
+    SNMP_SYS_UP_TIME,
+    SNMP_SYS_CONTACT,
+    SNMP_SYS_NAME,
+    SNMP_SYS_LOCATION,
+    SNMP_SYS_SERVICES,
+    SNMP_IF_NUMBER,
+    SNMP_IF_INDEX,
+    SNMP_IF_DESCR_OBJ,
+    SNMP_IF_TYPE_OBJ,
+    SNMP_IF_MTU,
+    SNMP_IF_SPEED,
+    SNMP_IF_PHYS_ADDRESS,
+    SNMP_IF_ADMIN_STATUS,
+    SNMP_IF_OPER_STATUS,
+    SNMP_IF_IN_OCTETS,
+    SNMP_IF_IN_DISCARDS,
+    SNMP_IF_IN_ERRORS,
+    SNMP_IF_OUT_OCTETS,
+    SNMP_IF_OUT_DISCARDS,
+    SNMP_IF_OUT_ERRORS,
+    SNMP_IF_NAME,
+} SnmpObj_t;
+
+/* An instance of the MIB; every sub-identifier of these fits a byte */
+typedef struct {
+    uint8_t len;
+    uint8_t obj;            /* SnmpObj_t */
+    uint8_t oid[12];
+} SnmpMibEntry_t;
+
+/* What a request reads, taken once per request */
+typedef struct {
+    EthIfStatsTypeDef eth;
+    uint32_t uptime_cs;
+    uint32_t speed;
+    uint16_t mtu;
+    uint8_t hwaddr[NETIF_MAX_HWADDR_LEN];
+    uint8_t hwaddr_len;
+    bool up;
+    bool link;
+    char name[8];           /* "st0" */
+} SnmpMibSnap_t;
+
+#define SNMP_SYS(n, o)  { 9U, (o), { 1U, 3U, 6U, 1U, 2U, 1U, 1U, (n), 0U } }
+#define SNMP_IF(c, o)   { 11U, (o), { 1U, 3U, 6U, 1U, 2U, 1U, 2U, 2U, 1U, (c), 1U } }
+
+/* In OID order, for GETNEXT */
+static const SnmpMibEntry_t snmp_mib[] = {
+    SNMP_SYS(1U, SNMP_SYS_DESCR),
+    SNMP_SYS(2U, SNMP_SYS_OBJECT_ID),
+    SNMP_SYS(3U, SNMP_SYS_UP_TIME),
+    SNMP_SYS(4U, SNMP_SYS_CONTACT),
+    SNMP_SYS(5U, SNMP_SYS_NAME),
+    SNMP_SYS(6U, SNMP_SYS_LOCATION),
+    SNMP_SYS(7U, SNMP_SYS_SERVICES),
+    { 9U, SNMP_IF_NUMBER, { 1U, 3U, 6U, 1U, 2U, 1U, 2U, 1U, 0U } },
+    SNMP_IF(1U, SNMP_IF_INDEX),
+    SNMP_IF(2U, SNMP_IF_DESCR_OBJ),
+    SNMP_IF(3U, SNMP_IF_TYPE_OBJ),
+    SNMP_IF(4U, SNMP_IF_MTU),
+    SNMP_IF(5U, SNMP_IF_SPEED),
+    SNMP_IF(6U, SNMP_IF_PHYS_ADDRESS),
+    SNMP_IF(7U, SNMP_IF_ADMIN_STATUS),
+    SNMP_IF(8U, SNMP_IF_OPER_STATUS),
+    SNMP_IF(10U, SNMP_IF_IN_OCTETS),
+    SNMP_IF(13U, SNMP_IF_IN_DISCARDS),
+    SNMP_IF(14U, SNMP_IF_IN_ERRORS),
+    SNMP_IF(16U, SNMP_IF_OUT_OCTETS),
+    SNMP_IF(19U, SNMP_IF_OUT_DISCARDS),
+    SNMP_IF(20U, SNMP_IF_OUT_ERRORS),
+    /* ifXTable ifName */
+    { 12U, SNMP_IF_NAME, { 1U, 3U, 6U, 1U, 2U, 1U, 31U, 1U, 1U, 1U, 1U, 1U } },
+};
+
+#define SNMP_MIB_COUNT          (sizeof(snmp_mib) / sizeof(snmp_mib[0]))
+
+static const uint32_t snmp_sys_oid[] = { SNMP_AGENT_SYS_OID };
+
+static struct udp_pcb* snmp_pcb;
+static TaskHandle_t snmp_task_handle;
+static StaticTask_t snmp_tcb;
+static StackType_t snmp_stack[SNMP_AGENT_STACK_WORDS];
+
+/* Request and its sender: written on the tcpip thread while busy is
+ * false, then the agent task's until it clears busy */
+static uint8_t snmp_req[SNMP_AGENT_MSG_MAX];
+static uint32_t snmp_req_len;
+static ip_addr_t snmp_peer;
+static uint16_t snmp_peer_port;
+static volatile bool snmp_busy;
+/* Agent task */
+static uint8_t snmp_resp[SNMP_AGENT_MSG_MAX];
+static SnmpMibSnap_t snmp_snap;
+
+static Metric_t snmp_requests = METRIC_COUNTER_INIT("snmp.requests");
+static Metric_t snmp_responses = METRIC_COUNTER_INIT("snmp.responses");
+static Metric_t snmp_busy_drops = METRIC_COUNTER_INIT("snmp.busy");
+static Metric_t snmp_bad_community = METRIC_COUNTER_INIT("snmp.bad_community");
+static Metric_t snmp_parse_errors = METRIC_COUNTER_INIT("snmp.parse_errors");
+static Metric_t snmp_too_big = METRIC_COUNTER_INIT("snmp.too_big");
+
+/*---------------------------------------------------------------------------*/
+/* BER */
+
+/* Tag and definite length, short or long form; the byte count */
+static uint32_t snmp_hdr(uint8_t* h, uint8_t tag, uint32_t len)
+{
+    h[0] = tag;
+    if (len < 0x80U) {
+        h[1] = (uint8_t)len;
+        return 2U;
+    }
+    if (len < 0x100U) {
+        h[1] = 0x81U;
+        h[2] = (uint8_t)len;
+        return 3U;
+    }
+    h[1] = 0x82U;
+    h[2] = (uint8_t)(len >> 8);
+    h[3] = (uint8_t)len;
+    return 4U;
+}
+
+/* Content of an INTEGER or an unsigned application type: the fewest bytes
+ * that keep the value and its sign */
+static uint32_t snmp_int_content(uint8_t* d, uint32_t v, bool sign)
+{
+    uint32_t n = 4U;
+    uint32_t k = 0U;
+
+    while (n > 1U) {
+        uint32_t top = (v >> (8U * n - 9U)) & 0x1FFU;
+        if (top != 0U && !(sign && top == 0x1FFU)) {
+            break;
+        }
+        n--;
+    }
+    if (!sign && ((v >> (8U * n - 1U)) & 1U) != 0U) {
+        d[k++] = 0U;
+    }
+    while (n > 0U) {
+        n--;
+        d[k++] = (uint8_t)(v >> (8U * n));
+    }
+    return k;
+}
+
+static void snmp_put(SnmpOut_t* o, const void* data, uint32_t n)
+{
+    if (n == 0U) {
+        return;
+    }
+    if (o->full || o->len + n > o->size) {
+        o->full = true;
+        return;
+    }
+    memcpy(&o->buf[o->len], data, n);
+    o->len += n;
+}
+
+static void snmp_put_tlv(SnmpOut_t* o, uint8_t tag, const void* data, uint32_t n)
+{
+    uint8_t h[4];
+
+    snmp_put(o, h, snmp_hdr(h, tag, n));
+    snmp_put(o, data, n);
+}
+
+static void snmp_put_int(SnmpOut_t* o, uint8_t tag, uint32_t v, bool sign)
+{
+    uint8_t d[5];
+
+    snmp_put_tlv(o, tag, d, snmp_int_content(d, v, sign));
+}
+
+static void snmp_put_oid(SnmpOut_t* o, const uint32_t* id, uint32_t len)
+{
+    uint8_t d[2U + SNMP_OID_MAX * 5U];
+    uint32_t n = 0U;
+
+    d[n++] = (uint8_t)(id[0] * 40U + id[1]);
+    for (uint32_t i = 2U; i < len; i++) {
+        uint32_t v = id[i];
+        int32_t shift = 28;
+
+        /* Base 128, high groups first, all but the last with bit 7 */
+        while (shift > 0 && (v >> shift) == 0U) {
+            shift -= 7;
+        }
+        for (; shift > 0; shift -= 7) {
+            d[n++] = (uint8_t)(0x80U | ((v >> shift) & 0x7FU));
+        }
+        d[n++] = (uint8_t)(v & 0x7FU);
+    }
+    snmp_put_tlv(o, SNMP_OID, d, n);
+}
+
+/* One TLV of in into val, definite lengths up to 0xFFFF */
+static bool snmp_tlv(SnmpIn_t* in, uint8_t* tag, SnmpIn_t* val)
+{
+    uint32_t len;
+
+    if (in->end - in->p < 2) {
+        return false;
+    }
+    *tag = *in->p++;
+    len = *in->p++;
+    if (len == 0x81U && in->p < in->end) {
+        len = *in->p++;
+    } else if (len == 0x82U && in->end - in->p >= 2) {
+        len = ((uint32_t)in->p[0] << 8) | in->p[1];
+        in->p += 2;
+    } else if (len >= 0x80U) {
+        return false;
+    }
+    if ((uint32_t)(in->end - in->p) < len) {
+        return false;
+    }
+    val->p = in->p;
+    val->end = in->p + len;
+    in->p += len;
+    return true;
+}
+
+/* An INTEGER as a signed 32-bit value */
+static bool snmp_get_int(SnmpIn_t* in, int32_t* v)
+{
+    SnmpIn_t val;
+    uint8_t tag;
+    uint32_t u;
+
+    if (!snmp_tlv(in, &tag, &val) || tag != SNMP_INTEGER || val.p == val.end || val.end - val.p > 4) {
+        return false;
+    }
+    u = ((*val.p & 0x80U) != 0U) ? 0xFFFFFFFFU : 0U;
+    while (val.p < val.end) {
+        u = (u << 8) | *val.p++;
+    }
+    *v = (int32_t)u;
+    return true;
+}
+
+static bool snmp_get_oid(SnmpIn_t* in, SnmpOid_t* oid)
+{
+    SnmpIn_t val;
+    uint8_t tag;
+
+    if (!snmp_tlv(in, &tag, &val) || tag != SNMP_OID || val.p == val.end || *val.p >= 120U) {
+        return false;
+    }
+    oid->id[0] = *val.p / 40U;
+    oid->id[1] = *val.p % 40U;
+    oid->len = 2U;
+    val.p++;
+    while (val.p < val.end) {
+        uint32_t v = 0U;
+        uint32_t n = 0U;
+        uint8_t b;
+
+        if (oid->len == SNMP_OID_MAX) {
+            return false;
+        }
+        do {
+            if (val.p == val.end || n == 5U || (v >> 25) != 0U) {
+                return false;
+            }
+            b = *val.p++;
+            v = (v << 7) | (b & 0x7FU);
+            n++;
+        } while ((b & 0x80U) != 0U);
+        oid->id[oid->len++] = v;
+    }
+    return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/* MIB */
+
+static void snmp_mib_oid(const SnmpMibEntry_t* e, SnmpOid_t* oid)
+{
+    for (uint32_t i = 0U; i < e->len; i++) {
+        oid->id[i] = e->oid[i];
+    }
+    oid->len = e->len;
+}
+
+/* <0, 0, >0 as oid sorts before, at or after the entry */
+static int32_t snmp_mib_cmp(const SnmpOid_t* oid, const SnmpMibEntry_t* e)
+{
+    uint32_t n = (oid->len < e->len) ? oid->len : e->len;
+
+    for (uint32_t i = 0U; i < n; i++) {
+        if (oid->id[i] != e->oid[i]) {
+            return (oid->id[i] < e->oid[i]) ? -1 : 1;
+        }
+    }
+    return (int32_t)oid->len - (int32_t)e->len;
+}
+
+/* The entry at oid, or SNMP_MIB_COUNT; *exc the exception for none */
+static uint32_t snmp_mib_find(const SnmpOid_t* oid, uint8_t* exc)
+{
+    *exc = SNMP_NO_SUCH_OBJECT;
+    for (uint32_t i = 0U; i < SNMP_MIB_COUNT; i++) {
+        const SnmpMibEntry_t* e = &snmp_mib[i];
+
+        if (snmp_mib_cmp(oid, e) == 0) {
+            return i;
+        }
+        /* The object is there, the instance not */
+        if (oid->len >= e->len - 1U) {
+            uint32_t k = 0U;
+
+            while (k < e->len - 1U && oid->id[k] == e->oid[k]) {
+                k++;
+            }
+            if (k == e->len - 1U) {
+                *exc = SNMP_NO_SUCH_INSTANCE;
+            }
+        }
+    }
+    return SNMP_MIB_COUNT;
+}
+
+/* The first entry after oid, or SNMP_MIB_COUNT */
+static uint32_t snmp_mib_next(const SnmpOid_t* oid)
+{
+    uint32_t i = 0U;
+
+    while (i < SNMP_MIB_COUNT && snmp_mib_cmp(oid, &snmp_mib[i]) >= 0) {
+        i++;
+    }
+    return i;
+}
+
+static void snmp_put_str(SnmpOut_t* o, const char* s)
+{
+    snmp_put_tlv(o, SNMP_OCTETS, s, (uint32_t)strlen(s));
+}
+
+static void snmp_put_value(SnmpOut_t* o, const SnmpMibSnap_t* s, uint8_t obj)
+{
+    const EthIfStatsTypeDef* eth = &s->eth;
+
+    switch ((SnmpObj_t)obj) {
+    case SNMP_SYS_DESCR:
+        snmp_put_str(o, SNMP_AGENT_SYS_DESCR);
+        break;
+    case SNMP_SYS_OBJECT_ID:
+        snmp_put_oid(o, snmp_sys_oid, sizeof(snmp_sys_oid) / sizeof(snmp_sys_oid[0]));
+        break;
+    case SNMP_SYS_UP_TIME:
+        snmp_put_int(o, SNMP_TIMETICKS, s->uptime_cs, false);
+        break;
+    case SNMP_SYS_CONTACT:
+        snmp_put_str(o, SNMP_AGENT_SYS_CONTACT);
+        break;
+    case SNMP_SYS_NAME:
+        snmp_put_str(o, SNMP_AGENT_SYS_NAME);
+        break;
+    case SNMP_SYS_LOCATION:
+        snmp_put_str(o, SNMP_AGENT_SYS_LOCATION);
+        break;
+    case SNMP_SYS_SERVICES:
+        /* Transport and application layers */
+        snmp_put_int(o, SNMP_INTEGER, 72U, true);
+        break;
+    case SNMP_IF_NUMBER:
+    case SNMP_IF_INDEX:
+        snmp_put_int(o, SNMP_INTEGER, 1U, true);
+        break;
+    case SNMP_IF_DESCR_OBJ:
+        snmp_put_str(o, SNMP_IF_DESCR);
+        break;
+    case SNMP_IF_TYPE_OBJ:
+        snmp_put_int(o, SNMP_INTEGER, SNMP_IF_TYPE, true);
+        break;
+    case SNMP_IF_MTU:
+        snmp_put_int(o, SNMP_INTEGER, s->mtu, true);
+        break;
+    case SNMP_IF_SPEED:
+        snmp_put_int(o, SNMP_GAUGE32, s->speed, false);
+        break;
+    case SNMP_IF_PHYS_ADDRESS:
+        snmp_put_tlv(o, SNMP_OCTETS, s->hwaddr, s->hwaddr_len);
+        break;
+    case SNMP_IF_ADMIN_STATUS:
+        /* up(1), down(2) */
+        snmp_put_int(o, SNMP_INTEGER, s->up ? 1U : 2U, true);
+        break;
+    case SNMP_IF_OPER_STATUS:
+        snmp_put_int(o, SNMP_INTEGER, (s->up && s->link) ? 1U : 2U, true);
+        break;
+    case SNMP_IF_IN_OCTETS:
+        snmp_put_int(o, SNMP_COUNTER32, eth->rx.bytes, false);
+        break;
+    case SNMP_IF_IN_DISCARDS:
+        snmp_put_int(o, SNMP_COUNTER32,
+                     eth->rx.queue_drops + eth->rx.udp_fast_drops + eth->rx.steer_drops + eth->rx.admit_bcast +
+                         eth->rx.admit_port + eth->rx.admit_bulk,
+                     false);
+        break;
+    case SNMP_IF_IN_ERRORS:
+        snmp_put_int(o, SNMP_COUNTER32, eth->rx.csum_drops, false);
+        break;
+    case SNMP_IF_OUT_OCTETS:
+        snmp_put_int(o, SNMP_COUNTER32, eth->tx.bytes, false);
+        break;
+    case SNMP_IF_OUT_DISCARDS:
+        snmp_put_int(o, SNMP_COUNTER32, eth->tx.queue_drops, false);
+        break;
+    case SNMP_IF_OUT_ERRORS:
+        snmp_put_int(o, SNMP_COUNTER32, eth->tx.errors, false);
+        break;
+    case SNMP_IF_NAME:
+        snmp_put_str(o, s->name);
+        break;
+    default:
+        snmp_put_tlv(o, SNMP_NULL, NULL, 0U);
+        break;
+    }
+}
+
+/* A variable binding: entry i, or oid with the exception tag exc. A
+ * binding that does not fit leaves o as it was, full set. */
+static void snmp_put_varbind(SnmpOut_t* o, const SnmpOid_t* oid, uint32_t i, uint8_t exc)
+{
+    uint8_t vb[320];
+    SnmpOut_t v = { vb, 0U, sizeof(vb), false };
+    uint32_t len = o->len;
+
+    if (i < SNMP_MIB_COUNT) {
+        SnmpOid_t e;
+
+        snmp_mib_oid(&snmp_mib[i], &e);
+        snmp_put_oid(&v, e.id, e.len);
+        snmp_put_value(&v, &snmp_snap, snmp_mib[i].obj);
+    } else {
+        snmp_put_oid(&v, oid->id, oid->len);
+        snmp_put_tlv(&v, exc, NULL, 0U);
+    }
+    /* A value too long for vb: a configuration string */
+    if (v.full) {
+        v.len = 0U;
+        snmp_put_oid(&v, oid->id, oid->len);
+        snmp_put_tlv(&v, SNMP_NULL, NULL, 0U);
+    }
+    snmp_put_tlv(o, SNMP_SEQUENCE, vb, v.len);
+    if (o->full) {
+        o->len = len;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/* Requests */
+
+typedef struct {
+    int32_t version;
+    int32_t request_id;
+    uint8_t pdu;
+    int32_t error;
+    int32_t index;
+    SnmpIn_t vbl;           /* the request's binding list */
+} SnmpMsg_t;
+
+/* Header of a request, false for anything to drop */
+static bool snmp_parse(const uint8_t* req, uint32_t len, SnmpMsg_t* m)
+{
+    static const char community[] = SNMP_AGENT_COMMUNITY;
+    SnmpIn_t in = { req, req + len };
+    SnmpIn_t msg;
+    SnmpIn_t comm;
+    SnmpIn_t pdu;
+    uint8_t tag;
+
+    if (!snmp_tlv(&in, &tag, &msg) || tag != SNMP_SEQUENCE || !snmp_get_int(&msg, &m->version) ||
+        (m->version != SNMP_VERSION_1 && m->version != SNMP_VERSION_2C) || !snmp_tlv(&msg, &tag, &comm) ||
+        tag != SNMP_OCTETS) {
+        metric_inc(&snmp_parse_errors);
+        return false;
+    }
+    if ((uint32_t)(comm.end - comm.p) != sizeof(community) - 1U || memcmp(comm.p, community, sizeof(community) - 1U) != 0) {
+        metric_inc(&snmp_bad_community);
+        return false;
+    }
+    if (!snmp_tlv(&msg, &m->pdu, &pdu) ||
+        (m->pdu != SNMP_PDU_GET && m->pdu != SNMP_PDU_GETNEXT && m->pdu != SNMP_PDU_SET &&
+         !(m->pdu == SNMP_PDU_GETBULK && m->version == SNMP_VERSION_2C)) ||
+        !snmp_get_int(&pdu, &m->request_id) || !snmp_get_int(&pdu, &m->error) || !snmp_get_int(&pdu, &m->index) ||
+        !snmp_tlv(&pdu, &tag, &m->vbl) || tag != SNMP_SEQUENCE) {
+        metric_inc(&snmp_parse_errors);
+        return false;
+    }
+    return true;
+}
+
+/* The bindings of a GET, GETNEXT or GETBULK into o; false for a malformed
+ * list. m->error and m->index set for an error response. */
+static bool snmp_bindings(SnmpMsg_t* m, SnmpOut_t* o)
+{
+    uint8_t next[SNMP_VARS_MAX];
+    uint32_t nonrep = 0U;
+    uint32_t reps = 1U;
+    uint32_t r = 0U;
+    SnmpIn_t vbl = m->vbl;
+
+    if (m->pdu == SNMP_PDU_GETBULK) {
+        nonrep = (m->error > 0) ? (uint32_t)m->error : 0U;
+        reps = (m->index > 0) ? (uint32_t)m->index : 0U;
+        if (reps > SNMP_AGENT_BULK_MAX) {
+            reps = SNMP_AGENT_BULK_MAX;
+        }
+    }
+    m->error = 0;
+    m->index = 0;
+    for (uint32_t k = 0U; vbl.p < vbl.end; k++) {
+        SnmpIn_t vb;
+        SnmpOid_t oid;
+        uint8_t tag;
+        uint8_t exc = SNMP_END_OF_MIB_VIEW;
+        uint32_t i;
+
+        if (!snmp_tlv(&vbl, &tag, &vb) || tag != SNMP_SEQUENCE || !snmp_get_oid(&vb, &oid)) {
+            return false;
+        }
+        if (k == SNMP_VARS_MAX) {
+            m->error = SNMP_ERR_TOO_BIG;
+            return true;
+        }
+        if (m->pdu == SNMP_PDU_SET) {
+            m->error = (m->version == SNMP_VERSION_1) ? SNMP_ERR_NO_SUCH_NAME : SNMP_ERR_NOT_WRITABLE;
+            m->index = (int32_t)k + 1;
+            return true;
+        }
+        if (m->pdu == SNMP_PDU_GET) {
+            i = snmp_mib_find(&oid, &exc);
+        } else {
+            i = snmp_mib_next(&oid);
+            if (m->pdu == SNMP_PDU_GETBULK && k >= nonrep) {
+                /* Repeaters: the first repetition now, in request order */
+                next[r++] = (uint8_t)i;
+                if (reps == 0U) {
+                    continue;
+                }
+            }
+        }
+        if (i == SNMP_MIB_COUNT && m->version == SNMP_VERSION_1) {
+            m->error = SNMP_ERR_NO_SUCH_NAME;
+            m->index = (int32_t)k + 1;
+            return true;
+        }
+        snmp_put_varbind(o, &oid, i, exc);
+        if (o->full) {
+            /* A bulk answer is cut at the last whole binding */
+            if (m->pdu != SNMP_PDU_GETBULK) {
+                m->error = SNMP_ERR_TOO_BIG;
+            }
+            return true;
+        }
+    }
+
+    /* The other repetitions, until every repeater is at the end */
+    for (uint32_t rep = 1U; rep < reps; rep++) {
+        bool more = false;
+
+        for (uint32_t k = 0U; k < r; k++) {
+            if (next[k] < SNMP_MIB_COUNT) {
+                next[k]++;
+            }
+            more |= next[k] < SNMP_MIB_COUNT;
+        }
+        if (!more) {
+            break;
+        }
+        for (uint32_t k = 0U; k < r; k++) {
+            SnmpOid_t last;
+
+            snmp_mib_oid(&snmp_mib[SNMP_MIB_COUNT - 1U], &last);
+            snmp_put_varbind(o, &last, next[k], SNMP_END_OF_MIB_VIEW);
+            if (o->full) {
+                return true;
+            }
+        }
+    }
+    return true;
+}
+
+/* Prepends an INTEGER at pos */
+static uint32_t snmp_prepend_int(uint8_t* buf, uint32_t pos, int32_t v)
+{
+    uint8_t d[8];
+    SnmpOut_t o = { d, 0U, sizeof(d), false };
+
+    snmp_put_int(&o, SNMP_INTEGER, (uint32_t)v, true);
+    pos -= o.len;
+    memcpy(&buf[pos], d, o.len);
+    return pos;
+}
+
+static uint32_t snmp_prepend_hdr(uint8_t* buf, uint32_t pos, uint8_t tag, uint32_t len)
+{
+    uint8_t h[4];
+    uint32_t n = snmp_hdr(h, tag, len);
+
+    pos -= n;
+    memcpy(&buf[pos], h, n);
+    return pos;
+}
+
+/* The response to req into resp, from *start; 0 for none */
+static uint32_t snmp_handle(const uint8_t* req, uint32_t len, uint8_t* resp, uint32_t* start)
+{
+    static const char community[] = SNMP_AGENT_COMMUNITY;
+    SnmpOut_t o = { resp, SNMP_HEADROOM, SNMP_AGENT_MSG_MAX, false };
+    SnmpMsg_t m;
+    uint32_t pos;
+
+    if (!snmp_parse(req, len, &m)) {
+        return 0U;
+    }
+    metric_inc(&snmp_requests);
+    if (!snmp_bindings(&m, &o)) {
+        metric_inc(&snmp_parse_errors);
+        return 0U;
+    }
+    if (m.error != 0) {
+        /* The request's bindings as they came; none for tooBig */
+        o.len = SNMP_HEADROOM;
+        o.full = false;
+        if (m.error == SNMP_ERR_TOO_BIG) {
+            metric_inc(&snmp_too_big);
+            m.index = 0;
+        } else {
+            snmp_put(&o, m.vbl.p, (uint32_t)(m.vbl.end - m.vbl.p));
+            if (o.full) {
+                return 0U;
+            }
+        }
+    }
+
+    pos = snmp_prepend_hdr(resp, SNMP_HEADROOM, SNMP_SEQUENCE, o.len - SNMP_HEADROOM);
+    pos = snmp_prepend_int(resp, pos, m.index);
+    pos = snmp_prepend_int(resp, pos, m.error);
+    pos = snmp_prepend_int(resp, pos, m.request_id);
+    pos = snmp_prepend_hdr(resp, pos, SNMP_PDU_RESPONSE, o.len - pos);
+    pos -= sizeof(community) - 1U;
+    memcpy(&resp[pos], community, sizeof(community) - 1U);
+    pos = snmp_prepend_hdr(resp, pos, SNMP_OCTETS, sizeof(community) - 1U);
+    pos = snmp_prepend_int(resp, pos, m.version);
+    pos = snmp_prepend_hdr(resp, pos, SNMP_SEQUENCE, o.len - pos);
+    *start = pos;
+    return o.len - pos;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Threads */
+
+/* The netif fields under the core lock, the driver counters without */
+static void snmp_snapshot(SnmpMibSnap_t* s)
+{
+    struct netif* nif;
+
+    memset(s, 0, sizeof(*s));
+    ethernetif_get_stats(&s->eth);
+    s->speed = ethernetif_link_speed();
+    /* TimeTicks, hundredths of a second */
+    s->uptime_cs = (uint32_t)(time_now_ns() / 10000000ULL);
+
+    LOCK_TCPIP_CORE();
+    nif = netif_default;
+    if (nif != NULL) {
+        s->mtu = nif->mtu;
+        s->hwaddr_len = nif->hwaddr_len;
+        memcpy(s->hwaddr, nif->hwaddr, sizeof(s->hwaddr));
+        s->up = netif_is_up(nif);
+        s->link = netif_is_link_up(nif);
+        s->name[0] = nif->name[0];
+        s->name[1] = nif->name[1];
+        s->name[2] = (char)('0' + nif->num % 10U);
+    }
+    UNLOCK_TCPIP_CORE();
+}
+
+static void snmp_task(void* arg)
+{
+    LWIP_UNUSED_ARG(arg);
+
+    for (;;) {
+        uint32_t start = 0U;
+        uint32_t len;
+
+        (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!snmp_busy) {
+            continue;
+        }
+        snmp_snapshot(&snmp_snap);
+        len = snmp_handle(snmp_req, snmp_req_len, snmp_resp, &start);
+        if (len != 0U) {
+            struct pbuf* p;
+
+            LOCK_TCPIP_CORE();
+            p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)len, PBUF_RAM);
+            if (p != NULL) {
+                (void)pbuf_take(p, &snmp_resp[start], (u16_t)len);
+                if (udp_sendto(snmp_pcb, p, &snmp_peer, snmp_peer_port) == ERR_OK) {
+                    metric_inc(&snmp_responses);
+                }
+                pbuf_free(p);
+            }
+            UNLOCK_TCPIP_CORE();
+        }
+        snmp_busy = false;
+    }
+}
+
+/* tcpip thread: the request is copied for the task, nothing else */
+static void snmp_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    LWIP_UNUSED_ARG(arg);
+    LWIP_UNUSED_ARG(pcb);
+
+    if (snmp_busy) {
+        metric_inc(&snmp_busy_drops);
+    } else if (p->tot_len > sizeof(snmp_req)) {
+        metric_inc(&snmp_too_big);
+    } else {
+        snmp_req_len = pbuf_copy_partial(p, snmp_req, p->tot_len, 0U);
+        ip_addr_copy(snmp_peer, *addr);
+        snmp_peer_port = port;
+        snmp_busy = true;
+        xTaskNotifyGive(snmp_task_handle);
+    }
+    pbuf_free(p);
+}
+
+bool snmp_agent_start(void)
+{
+    if (snmp_task_handle != NULL) {
+        return false;
+    }
+    (void)metrics_register(&snmp_requests);
+    (void)metrics_register(&snmp_responses);
+    (void)metrics_register(&snmp_busy_drops);
+    (void)metrics_register(&snmp_bad_community);
+    (void)metrics_register(&snmp_parse_errors);
+    (void)metrics_register(&snmp_too_big);
+
+    snmp_task_handle = xTaskCreateStatic(snmp_task, "SNMP", SNMP_AGENT_STACK_WORDS, NULL, SNMP_AGENT_PRIORITY,
+                                         snmp_stack, &snmp_tcb);
+    if (snmp_task_handle == NULL) {
+        LOG_ERROR(SNMP_TAG, "no task");
+        return false;
+    }
+
+    LOCK_TCPIP_CORE();
+    snmp_pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if (snmp_pcb != NULL && udp_bind(snmp_pcb, IP_ANY_TYPE, SNMP_AGENT_PORT) != ERR_OK) {
+        udp_remove(snmp_pcb);
+        snmp_pcb = NULL;
+    }
+    if (snmp_pcb != NULL) {
+        udp_recv(snmp_pcb, snmp_recv, NULL);
+    }
+    UNLOCK_TCPIP_CORE();
+
+    if (snmp_pcb == NULL) {
+        LOG_ERROR(SNMP_TAG, "port %u not bound", (unsigned)SNMP_AGENT_PORT);
+        return false;
+    }
+    LOG_INFO(SNMP_TAG, "agent on UDP port %u", (unsigned)SNMP_AGENT_PORT);
+    return true;
+}
+
+#endif /* SNMP_AGENT */
@@ -0,0 +1,124 @@
+/**
+ * @file snmp_agent.h
+ * @brief SNMP agent: SNMPv1 and SNMPv2c GET, GETNEXT and GETBULK of the
+ *        system group and of the interface's IF-MIB entries.
+ *
+ * lwIP ships the headers of its SNMP agent (lwip/apps/snmp*.h) but not its
+ * sources, and its MIB2 counters (MIB2_STATS) would count every packet a
+ * second time in the core. This agent serves a read-only MIB from what the
+ * board already keeps:
+ *
+ *   1.3.6.1.2.1.1        system: sysDescr, sysObjectID, sysUpTime,
+ *                        sysContact, sysName, sysLocation, sysServices
+ *   1.3.6.1.2.1.2.1.0    ifNumber, 1
+ *   1.3.6.1.2.1.2.2.1.x.1  ifTable of the ETH interface: ifIndex, ifDescr,
+ *                        ifType, ifMtu, ifSpeed, ifPhysAddress,
+ *                        ifAdminStatus, ifOperStatus, ifInOctets,
+ *                        ifInDiscards, ifInErrors, ifOutOctets,
+ *                        ifOutDiscards, ifOutErrors
+ *   1.3.6.1.2.1.31.1.1.1.1.1  ifName
+ *
+ * The counters are the driver's (ethernetif_get_stats()), read without a
+ * lock as they have a single writer each; Counter32, wrapping as they do:
+ *   ifInOctets     rx.bytes
+ *   ifInDiscards   rx.queue_drops + rx.udp_fast_drops + rx.steer_drops
+ *                  + rx.admit_bcast + rx.admit_port + rx.admit_bulk:
+ *                  received, dropped for want of queue room or shed
+ *                  under overload
+ *   ifInErrors     rx.csum_drops
+ *   ifOutOctets    tx.bytes
+ *   ifOutDiscards  tx.queue_drops
+ *   ifOutErrors    tx.errors
+ *
+ * Requests are handled the way lwIP's snmp_threadsync.h would have them:
+ * the udp_recv() callback on the tcpip thread only copies the request and
+ * wakes the agent task, which decodes it, reads the MIB and encodes the
+ * answer, then takes the core lock for the udp_sendto() alone. The netif
+ * fields (MTU, address, up and link flags) are copied once per request
+ * under that lock. One request is handled at a time; one arriving
+ * meanwhile is dropped (snmp.busy) and retried by the manager.
+ *
+ * A request with another community than SNMP_AGENT_COMMUNITY is dropped
+ * (snmp.bad_community), SET is answered notWritable (noSuchName in v1).
+ * Exported through metrics as "snmp.*".
+ */
+
+#pragma once
+
+#ifndef SNMP_AGENT_H
+#define SNMP_AGENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 0 leaves the agent out of the startup code */
+#ifndef SNMP_AGENT
+#define SNMP_AGENT 1
+#endif
+
+#ifndef SNMP_AGENT_PORT
+#define SNMP_AGENT_PORT 161U
+#endif
+
+/* Read community, up to SNMP_AGENT_COMMUNITY_MAX characters */
+#ifndef SNMP_AGENT_COMMUNITY
+#define SNMP_AGENT_COMMUNITY "public"
+#endif
+
+#define SNMP_AGENT_COMMUNITY_MAX 32U
+
+/* Longest request taken and response sent; at least the 484 bytes
+ * RFC 3417 requires */
+#ifndef SNMP_AGENT_MSG_MAX
+#define SNMP_AGENT_MSG_MAX 1400U
+#endif
+
+/* GETBULK repetitions answered at most, whatever max-repetitions says */
+#ifndef SNMP_AGENT_BULK_MAX
+#define SNMP_AGENT_BULK_MAX 32U
+#endif
+
+#ifndef SNMP_AGENT_SYS_DESCR
+#define SNMP_AGENT_SYS_DESCR "STM32H743 lwIP " LWIP_VERSION_STRING
+#endif
+
+#ifndef SNMP_AGENT_SYS_CONTACT
+#define SNMP_AGENT_SYS_CONTACT ""
+#endif
+
+#ifndef SNMP_AGENT_SYS_NAME
+#define SNMP_AGENT_SYS_NAME "stm32h743"
+#endif
+
+#ifndef SNMP_AGENT_SYS_LOCATION
+#define SNMP_AGENT_SYS_LOCATION ""
+#endif
+
+/* sysObjectID: lwIP's enterprise number, as its own agent reports */
+#ifndef SNMP_AGENT_SYS_OID
+#define SNMP_AGENT_SYS_OID 1U, 3U, 6U, 1U, 4U, 1U, 26381U
+#endif
+
+/* osPriorityBelowNormal, see configOS2_TO_RTOS_PRIO(): below the tcpip
+ * thread */
+#ifndef SNMP_AGENT_PRIORITY
+#define SNMP_AGENT_PRIORITY 8
+#endif
+
+#ifndef SNMP_AGENT_STACK_WORDS
+#define SNMP_AGENT_STACK_WORDS 512U
+#endif
+
+/* Binds SNMP_AGENT_PORT and starts the agent task; from a task, core lock
+ * not held, once the netif is added */
+bool snmp_agent_start(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SNMP_AGENT_H */
@@ -0,0 +1,247 @@
+/**
+ * @file supervisor.c
+ * @brief Latency budgets and the IWDG, see supervisor.h.
+ */
+
+#include "supervisor.h"
+
+#if SUPERVISOR
+
+#include "main.h"
+#include "task.h"
+#include "metrics/metrics.h"
+#include "timesync/time_ns.h"
+#include "logger/bkp_log.h"
+#include "lwip/tcpip.h"
+
+#include <stdio.h>
+
+#define SUPERVISOR_TAG          "SUPV"
+/* LSI / 256: 125 Hz */
+#define SUPERVISOR_IWDG_PR      6U
+#define SUPERVISOR_IWDG_STEP_MS (256U * 1000U / LSI_VALUE)
+#define SUPERVISOR_IWDG_RELOAD  (SUPERVISOR_IWDG_MS / SUPERVISOR_IWDG_STEP_MS)
+
+#if SUPERVISOR_IWDG_MS && (SUPERVISOR_IWDG_RELOAD < 2U || SUPERVISOR_IWDG_RELOAD > 0xFFFU)
+#error "SUPERVISOR_IWDG_MS out of the IWDG range"
+#endif
+
+#if SUPERVISOR_IWDG_MS && SUPERVISOR_IWDG_MS <= 2U * SUPERVISOR_PERIOD_MS
+#error "SUPERVISOR_IWDG_MS must leave room for a late period"
+#endif
+
+static SupervisorCheck_t* supervisor_checks;
+static struct tcpip_callback_msg* supervisor_tcpip_msg;
+
+static StaticTask_t supervisor_tcb;
+static StackType_t supervisor_stack[SUPERVISOR_STACK_WORDS];
+
+static Metric_t supervisor_alarm = METRIC_GAUGE_INIT("supervisor.alarm");
+static Metric_t supervisor_kicks = METRIC_COUNTER_INIT("supervisor.kicks");
+static Metric_t supervisor_withheld = METRIC_COUNTER_INIT("supervisor.withheld");
+
+static bool supervisor_tcpip_probe(SupervisorCheck_t* c);
+
+static SupervisorCheck_t supervisor_tcpip = {
+    .name = "tcpip",
+    .budget_us = SUPERVISOR_TCPIP_BUDGET_US,
+    .timeout_ms = SUPERVISOR_PROBE_TIMEOUT_MS,
+    .probe = supervisor_tcpip_probe,
+};
+
+static uint32_t supervisor_now_us(void)
+{
+    return (uint32_t)(time_now_ns() / 1000U);
+}
+
+/*---------------------------------------------------------------------------*/
+/* Reporting */
+
+void supervisor_latency(SupervisorCheck_t* c, uint32_t us)
+{
+    /* The supervisor swaps in 0: a larger value lands in this period or
+     * the next, never lost */
+    if (us > c->worst_us) {
+        c->worst_us = us;
+    }
+    c->beat_ms = HAL_GetTick();
+}
+
+void supervisor_beat(SupervisorCheck_t* c)
+{
+    if (__atomic_load_n(&c->probing, __ATOMIC_ACQUIRE) != 0U) {
+        supervisor_latency(c, supervisor_now_us() - c->probe_us);
+        __atomic_store_n(&c->probing, 0U, __ATOMIC_RELEASE);
+    } else {
+        c->beat_ms = HAL_GetTick();
+    }
+}
+
+/* tcpip thread */
+static void supervisor_tcpip_beat(void* arg)
+{
+    supervisor_beat((SupervisorCheck_t*)arg);
+}
+
+static bool supervisor_tcpip_probe(SupervisorCheck_t* c)
+{
+    LWIP_UNUSED_ARG(c);
+    return tcpip_callbackmsg_trycallback(supervisor_tcpip_msg) == ERR_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Supervisor task */
+
+static void supervisor_iwdg_start(void)
+{
+#if SUPERVISOR_IWDG_MS
+#ifdef DEBUG
+    DBGMCU->APB4FZ1 |= DBGMCU_APB4FZ1_DBG_IWDG1;
+#endif
+    IWDG1->KR = 0xCCCCU;                /* starts it, and the LSI */
+    IWDG1->KR = 0x5555U;                /* PR and RLR writable */
+    IWDG1->PR = SUPERVISOR_IWDG_PR;
+    IWDG1->RLR = SUPERVISOR_IWDG_RELOAD;
+    while (IWDG1->SR != 0U) {
+    }
+    IWDG1->KR = 0xAAAAU;
+#endif
+}
+
+static void supervisor_kick(void)
+{
+#if SUPERVISOR_IWDG_MS
+    IWDG1->KR = 0xAAAAU;
+#endif
+    metric_inc(&supervisor_kicks);
+}
+
+/* True with the budget and timeout met over the last period */
+static bool supervisor_check(SupervisorCheck_t* c, uint32_t now_us, uint32_t now_ms)
+{
+    uint32_t worst = __atomic_exchange_n(&c->worst_us, 0U, __ATOMIC_ACQ_REL);
+    bool stalled = (c->timeout_ms != 0U) && ((now_ms - c->beat_ms) > c->timeout_ms);
+    bool ok;
+
+    if (__atomic_load_n(&c->probing, __ATOMIC_ACQUIRE) != 0U) {
+        uint32_t waited = now_us - c->probe_us;
+        if (waited > worst) {
+            worst = waited;
+        }
+    }
+    c->last_us = worst;
+    ok = !stalled && (worst <= c->budget_us);
+    if (!ok) {
+        c->blown++;
+        if (!c->failed) {
+            LOG_ERROR(SUPERVISOR_TAG, "%s: %s, %lu us, budget %lu us", c->name,
+                      stalled ? "no beat" : "over budget", (unsigned long)worst, (unsigned long)c->budget_us);
+#if SYSLOG_BKP_LOG
+            bkp_log_crash(BKP_LOG_CRASH_DEADLINE, 0U, c->name);
+#endif
+        }
+    } else if (c->failed) {
+        LOG_INFO(SUPERVISOR_TAG, "%s: within budget again", c->name);
+    }
+    c->failed = !ok;
+
+    /* The next probe; one unanswered keeps its start time */
+    if (c->probe != NULL) {
+        if (__atomic_load_n(&c->probing, __ATOMIC_ACQUIRE) == 0U) {
+            c->probe_us = supervisor_now_us();
+            __atomic_store_n(&c->probing, 1U, __ATOMIC_RELEASE);
+            c->posted = false;
+        }
+        if (!c->posted) {
+            c->posted = c->probe(c);
+        }
+    }
+    return ok;
+}
+
+static void supervisor_task(void* arg)
+{
+    TickType_t wake = xTaskGetTickCount();
+
+    (void)arg;
+    supervisor_iwdg_start();
+    for (;;) {
+        uint32_t now_us = supervisor_now_us();
+        uint32_t now_ms = HAL_GetTick();
+        bool ok = true;
+
+        for (SupervisorCheck_t* c = __atomic_load_n(&supervisor_checks, __ATOMIC_ACQUIRE); c != NULL;
+             c = c->next) {
+            /* Every check, even after one failed: each gets its counters */
+            if (!supervisor_check(c, now_us, now_ms)) {
+                ok = false;
+            }
+        }
+        metric_set(&supervisor_alarm, ok ? 0U : 1U);
+        if (ok) {
+            supervisor_kick();
+        } else {
+            metric_inc(&supervisor_withheld);
+        }
+        vTaskDelayUntil(&wake, pdMS_TO_TICKS(SUPERVISOR_PERIOD_MS));
+    }
+}
+
+#if METRICS
+/* Runs on the tcpip thread */
+static void supervisor_metrics(MetricsWriter_t* w)
+{
+    char name[METRICS_NAME_MAX];
+
+    for (const SupervisorCheck_t* c = __atomic_load_n(&supervisor_checks, __ATOMIC_ACQUIRE); c != NULL;
+         c = c->next) {
+        snprintf(name, sizeof(name), "supervisor.%s.worst_us", c->name);
+        metrics_emit(w, name, METRIC_GAUGE, c->last_us);
+        snprintf(name, sizeof(name), "supervisor.%s.blown", c->name);
+        metrics_emit(w, name, METRIC_COUNTER, c->blown);
+    }
+}
+#endif
+
+/*---------------------------------------------------------------------------*/
+
+bool supervisor_add(SupervisorCheck_t* c)
+{
+    if (c->name == NULL || c->budget_us == 0U) {
+        return false;
+    }
+    c->beat_ms = HAL_GetTick();
+    c->worst_us = 0U;
+    c->probing = 0U;
+    c->failed = false;
+    taskENTER_CRITICAL();
+    c->next = supervisor_checks;
+    __atomic_store_n(&supervisor_checks, c, __ATOMIC_RELEASE);
+    taskEXIT_CRITICAL();
+    return true;
+}
+
+bool supervisor_start(void)
+{
+    (void)metrics_register(&supervisor_alarm);
+    (void)metrics_register(&supervisor_kicks);
+    (void)metrics_register(&supervisor_withheld);
+#if METRICS
+    (void)metrics_register_collector(supervisor_metrics);
+#endif
+
+    supervisor_tcpip_msg = tcpip_callbackmsg_new(supervisor_tcpip_beat, &supervisor_tcpip);
+    if (supervisor_tcpip_msg == NULL || !supervisor_add(&supervisor_tcpip)) {
+        LOG_ERROR(SUPERVISOR_TAG, "no tcpip probe");
+        return false;
+    }
+    if (xTaskCreateStatic(supervisor_task, "Supervisor", SUPERVISOR_STACK_WORDS, NULL, SUPERVISOR_PRIORITY,
+                          supervisor_stack, &supervisor_tcb) == NULL) {
+        return false;
+    }
+    LOG_INFO(SUPERVISOR_TAG, "period %lu ms, IWDG %lu ms", (unsigned long)SUPERVISOR_PERIOD_MS,
+             (unsigned long)SUPERVISOR_IWDG_MS);
+    return true;
+}
+
+#endif /* SUPERVISOR */
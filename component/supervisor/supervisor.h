@@ -0,0 +1,139 @@
+/**
+ * @file supervisor.h
+ * @brief Latency budgets of the critical tasks, and the IWDG kicked only
+ *        while they are all met.
+ *
+ * A check is one task (or thread) with a latency budget. It reports in one
+ * of two ways:
+ *  - measured deadlines: the task itself hands over the latency of each
+ *    job (supervisor_latency()), e.g. release to end of a control loop
+ *    cycle; every periodic_exec.h task is checked this way, its deadline
+ *    the budget
+ *  - probes: a task that blocks until there is work, and so has no
+ *    deadline of its own, is asked for a beat every SUPERVISOR_PERIOD_MS
+ *    (the check's probe function) and the time to the beat
+ *    (supervisor_beat()) is its latency: the tcpip thread gets a callback
+ *    message through its mailbox, the EthIf task a wakeup
+ * A check with timeout_ms set also fails when no beat comes for that long.
+ *
+ * Every SUPERVISOR_PERIOD_MS the supervisor task takes each check's worst
+ * latency of the period (a probe still unanswered counts with its wait so
+ * far) and compares it with the budget. A blown budget raises the alarm:
+ * the metrics gauge "supervisor.alarm", a log line at the start of each
+ * episode, and once per boot the crash record of the backup SRAM
+ * (BKP_LOG_CRASH_DEADLINE, the check's name as the task), replayed after
+ * the next reset. The independent watchdog (IWDG1, SUPERVISOR_IWDG_MS) is
+ * kicked only at the end of a period with every budget met: a degradation
+ * shows up in the metrics first, and one lasting SUPERVISOR_IWDG_MS resets
+ * the MCU, as does a supervisor task kept from running. The IWDG stops
+ * while a debugger halts the core.
+ *
+ * Exported through metrics as "supervisor.alarm", ".kicks", ".withheld",
+ * and per check "supervisor.<name>.worst_us" (the last period) and
+ * ".blown" (periods over budget).
+ */
+
+#pragma once
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "FreeRTOS.h"
+
+/* 0 leaves the supervisor, its checks and the IWDG out */
+#ifndef SUPERVISOR
+#define SUPERVISOR 1
+#endif
+
+#ifndef SUPERVISOR_PERIOD_MS
+#define SUPERVISOR_PERIOD_MS 100U
+#endif
+
+/* IWDG1 timeout, 8 ms steps up to 32760; 0 leaves it stopped. Once
+ * started it cannot be stopped but by a reset. */
+#ifndef SUPERVISOR_IWDG_MS
+#define SUPERVISOR_IWDG_MS 4000U
+#endif
+
+/* Above the EthIf task: only a fault or a runaway interrupt keeps it off */
+#ifndef SUPERVISOR_PRIORITY
+#define SUPERVISOR_PRIORITY (configMAX_PRIORITIES - 2)
+#endif
+
+#ifndef SUPERVISOR_STACK_WORDS
+#define SUPERVISOR_STACK_WORDS 256U
+#endif
+
+/* Probe to callback on the tcpip thread: the wait in its mailbox plus
+ * the message ahead of it */
+#ifndef SUPERVISOR_TCPIP_BUDGET_US
+#define SUPERVISOR_TCPIP_BUDGET_US 20000U
+#endif
+
+/* Probe to wakeup of the EthIf task */
+#ifndef SUPERVISOR_ETHIF_BUDGET_US
+#define SUPERVISOR_ETHIF_BUDGET_US 5000U
+#endif
+
+/* Unanswered probes fail a check after this long, whatever the budget */
+#ifndef SUPERVISOR_PROBE_TIMEOUT_MS
+#define SUPERVISOR_PROBE_TIMEOUT_MS 1000U
+#endif
+
+struct SupervisorCheck_s;
+
+/* Asks the task for a supervisor_beat(); false if the request could not
+ * be posted, tried again the next period. Supervisor task. */
+typedef bool (*SupervisorProbe_t)(struct SupervisorCheck_s* c);
+
+typedef struct SupervisorCheck_s {
+    const char* name;           /* metrics name; must outlive the check */
+    uint32_t budget_us;
+    uint32_t timeout_ms;        /* longest time without a beat, 0: none */
+    SupervisorProbe_t probe;    /* NULL: the task reports on its own */
+    void* arg;                  /* for the probe */
+    /* The task */
+    volatile uint32_t beat_ms;  /* tick of the last beat */
+    volatile uint32_t worst_us; /* since the supervisor's last look */
+    /* Supervisor to the task */
+    volatile uint32_t probe_us; /* time_now_ns() / 1000 of the probe */
+    volatile uint8_t probing;   /* a probe waits for its beat */
+    /* Supervisor */
+    bool posted;
+    bool failed;                /* the last period was over budget */
+    uint32_t last_us;           /* worst latency of the last period */
+    uint32_t blown;
+    struct SupervisorCheck_s* next;
+} SupervisorCheck_t;
+
+#if SUPERVISOR
+
+/* Registers the metrics, adds the tcpip thread check and starts the
+ * supervisor task, which starts the IWDG. Call once from a task, after
+ * metrics_init() and MX_LWIP_Init(). */
+bool supervisor_start(void);
+
+/* Adds a check; any time, from a task */
+bool supervisor_add(SupervisorCheck_t* c);
+
+/* The task made progress; answers a pending probe. The check's task only. */
+void supervisor_beat(SupervisorCheck_t* c);
+
+/* One measured latency, e.g. release to end of a job; also a beat. The
+ * check's task only. */
+void supervisor_latency(SupervisorCheck_t* c, uint32_t us);
+
+#endif /* SUPERVISOR */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SUPERVISOR_H */
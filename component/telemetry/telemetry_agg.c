@@ -0,0 +1,432 @@
+/**
+ * @file telemetry_agg.c
+ * @brief Sensor samples aggregated per channel, sent as compressed blocks,
+ *        see telemetry_agg.h.
+ */
+
+#include "telemetry_agg.h"
+
+#if TELEMETRY_AGG
+
+#include "metrics/metrics.h"
+#include "compress/lz4_block.h"
+#include "timesync/time_ns.h"
+
+#include "main.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#include "lwip/pbuf.h"
+#include "lwip/timeouts.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define TELEMETRY_TAG           "TELEM"
+#define TELEMETRY_HDR_LEN       8U
+#define TELEMETRY_CHAN_HDR_LEN  3U
+#define TELEMETRY_COLUMNS       6U
+/* Worst case of a column of n windows: two varints, the width byte and
+ * n - 2 values of 32 bits */
+#define TELEMETRY_COLUMN_MAX(n) (5U + 5U + 1U + 4U * ((n) - 2U))
+
+/* Bits packed LSB first */
+typedef struct {
+    uint8_t* p;
+    uint32_t acc;
+    uint32_t bits;
+} TelemetryBits_t;
+
+/* tcpip thread; a producer touches its own channel only */
+static TelemetryChan_t* telemetry_chans;
+static TelemetrySnap_t* telemetry_snaps;
+static struct udp_pcb* telemetry_udp;
+static ip_addr_t telemetry_addr;
+static uint32_t telemetry_seq;
+static volatile bool telemetry_lz4 = TELEMETRY_AGG_LZ4;
+static TelemetrySink_t telemetry_sink;
+static TelemetryOutput_t telemetry_output;
+/* The block before compression, and the compressor */
+static uint8_t telemetry_raw[TELEMETRY_AGG_MTU];
+static Lz4Block_t telemetry_lz4_state;
+
+static Metric_t telemetry_datagrams = METRIC_COUNTER_INIT("telemetry.datagrams");
+static Metric_t telemetry_bytes = METRIC_COUNTER_INIT("telemetry.bytes");
+static Metric_t telemetry_windows = METRIC_COUNTER_INIT("telemetry.windows");
+static Metric_t telemetry_samples = METRIC_COUNTER_INIT("telemetry.samples");
+static Metric_t telemetry_dropped = METRIC_COUNTER_INIT("telemetry.dropped");
+static Metric_t telemetry_lz4_in = METRIC_COUNTER_INIT("telemetry.lz4_in");
+static Metric_t telemetry_lz4_out = METRIC_COUNTER_INIT("telemetry.lz4_out");
+static Metric_t telemetry_snap_retries = METRIC_COUNTER_INIT("telemetry.snap_retries");
+
+/*---------------------------------------------------------------------------*/
+/* Producer */
+
+static void telemetry_close(TelemetryChan_t* ch)
+{
+    uint32_t head = ch->head;
+    TelemetryAgg_t* a;
+
+    if (head - __atomic_load_n(&ch->tail, __ATOMIC_ACQUIRE) >= ch->slots) {
+        metric_inc(&telemetry_dropped);
+        return;
+    }
+    a = &ch->ring[head & (ch->slots - 1U)];
+    a->t_us = ch->win;
+    a->count = ch->count;
+    a->min = ch->min;
+    a->max = ch->max;
+    a->mean = (int32_t)(ch->sum / (int64_t)ch->count);
+    a->last = ch->last;
+    __atomic_store_n(&ch->head, head + 1U, __ATOMIC_RELEASE);
+}
+
+void telemetry_agg_put_at(TelemetryChan_t* ch, int32_t v, uint32_t t_us)
+{
+    uint32_t win = t_us - (t_us % ch->window_us);
+
+    if (ch->open && win != ch->win) {
+        telemetry_close(ch);
+        ch->open = false;
+    }
+    if (!ch->open) {
+        ch->open = true;
+        ch->win = win;
+        ch->count = 0U;
+        ch->sum = 0;
+        ch->min = v;
+        ch->max = v;
+    }
+    ch->count++;
+    ch->sum += v;
+    if (v < ch->min) {
+        ch->min = v;
+    }
+    if (v > ch->max) {
+        ch->max = v;
+    }
+    ch->last = v;
+}
+
+void telemetry_agg_put(TelemetryChan_t* ch, int32_t v)
+{
+    telemetry_agg_put_at(ch, v, (uint32_t)(time_now_ns() / 1000U));
+}
+
+/*---------------------------------------------------------------------------*/
+/* Encoder, tcpip thread */
+
+static uint32_t telemetry_zz(uint32_t x)
+{
+    return (x << 1) ^ (uint32_t)((int32_t)x >> 31);
+}
+
+static uint8_t* telemetry_varint(uint8_t* p, uint32_t v)
+{
+    while (v >= 0x80U) {
+        *p++ = (uint8_t)(v | 0x80U);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static void telemetry_bits_put(TelemetryBits_t* b, uint32_t v, uint32_t w)
+{
+    /* Up to 32 bits in two halves, the accumulator holds at most 7 more */
+    for (uint32_t part = 0U; part < w; part += 16U) {
+        uint32_t n = LWIP_MIN(16U, w - part);
+
+        b->acc |= ((v >> part) & ((1UL << n) - 1U)) << b->bits;
+        b->bits += n;
+        while (b->bits >= 8U) {
+            *b->p++ = (uint8_t)b->acc;
+            b->acc >>= 8;
+            b->bits -= 8U;
+        }
+    }
+}
+
+/* Column col (offset of a uint32_t/int32_t field in TelemetryAgg_t) of n
+ * windows from tail on */
+static uint8_t* telemetry_column(uint8_t* p, const TelemetryChan_t* ch, uint32_t tail, uint32_t n, size_t col)
+{
+    uint32_t v[2];
+    uint32_t maxzz = 0U;
+    uint32_t w = 0U;
+    TelemetryBits_t b;
+
+#define TELEMETRY_AT(i) (*(const uint32_t*)(const void*)((const uint8_t*)&ch->ring[(tail + (i)) & (ch->slots - 1U)] + col))
+
+    v[0] = TELEMETRY_AT(0U);
+    p = telemetry_varint(p, telemetry_zz(v[0]));
+    if (n < 2U) {
+        return p;
+    }
+    v[1] = TELEMETRY_AT(1U);
+    p = telemetry_varint(p, telemetry_zz(v[1] - v[0]));
+    if (n < 3U) {
+        return p;
+    }
+    /* Two passes: the width first */
+    for (uint32_t i = 2U; i < n; i++) {
+        uint32_t zz = telemetry_zz(TELEMETRY_AT(i) - 2U * TELEMETRY_AT(i - 1U) + TELEMETRY_AT(i - 2U));
+        maxzz |= zz;
+    }
+    while (w < 32U && (maxzz >> w) != 0U) {
+        w++;
+    }
+    *p++ = (uint8_t)w;
+    if (w == 0U) {
+        return p;
+    }
+    b.p = p;
+    b.acc = 0U;
+    b.bits = 0U;
+    for (uint32_t i = 2U; i < n; i++) {
+        telemetry_bits_put(&b, telemetry_zz(TELEMETRY_AT(i) - 2U * TELEMETRY_AT(i - 1U) + TELEMETRY_AT(i - 2U)), w);
+    }
+    if (b.bits != 0U) {
+        *b.p++ = (uint8_t)b.acc;
+    }
+#undef TELEMETRY_AT
+    return b.p;
+}
+
+uint32_t telemetry_agg_encode(uint8_t* buf, uint32_t size)
+{
+    static const size_t cols[TELEMETRY_COLUMNS] = {
+        offsetof(TelemetryAgg_t, t_us), offsetof(TelemetryAgg_t, count), offsetof(TelemetryAgg_t, min),
+        offsetof(TelemetryAgg_t, max),  offsetof(TelemetryAgg_t, mean),  offsetof(TelemetryAgg_t, last),
+    };
+    uint8_t* p = &buf[TELEMETRY_HDR_LEN];
+    uint8_t* end = &buf[size];
+    uint32_t chans = 0U;
+
+    if (size < TELEMETRY_HDR_LEN + TELEMETRY_CHAN_HDR_LEN + TELEMETRY_COLUMNS * 5U) {
+        return 0U;
+    }
+    for (TelemetryChan_t* ch = telemetry_chans; ch != NULL && chans < 255U; ch = ch->next) {
+        uint32_t tail = ch->tail;
+        uint32_t n = __atomic_load_n(&ch->head, __ATOMIC_ACQUIRE) - tail;
+        uint32_t room = (uint32_t)(end - p);
+        uint32_t samples = 0U;
+
+        if (n == 0U) {
+            continue;
+        }
+        /* As many windows as fit in the worst case */
+        n = LWIP_MIN(n, 255U);
+        while (n > 2U && TELEMETRY_CHAN_HDR_LEN + TELEMETRY_COLUMNS * TELEMETRY_COLUMN_MAX(n) > room) {
+            n--;
+        }
+        if (TELEMETRY_CHAN_HDR_LEN + TELEMETRY_COLUMNS * 10U > room) {
+            break;
+        }
+        *p++ = (uint8_t)(ch->id >> 8);
+        *p++ = (uint8_t)ch->id;
+        *p++ = (uint8_t)n;
+        for (uint32_t c = 0U; c < TELEMETRY_COLUMNS; c++) {
+            p = telemetry_column(p, ch, tail, n, cols[c]);
+        }
+        for (uint32_t i = 0U; i < n; i++) {
+            samples += ch->ring[(tail + i) & (ch->slots - 1U)].count;
+        }
+        __atomic_store_n(&ch->tail, tail + n, __ATOMIC_RELEASE);
+        metric_add(&telemetry_windows, n);
+        metric_add(&telemetry_samples, samples);
+        chans++;
+    }
+    if (chans == 0U) {
+        return 0U;
+    }
+    buf[0] = (uint8_t)(TELEMETRY_AGG_MAGIC >> 8);
+    buf[1] = (uint8_t)TELEMETRY_AGG_MAGIC;
+    buf[2] = TELEMETRY_AGG_VERSION;
+    buf[3] = (uint8_t)chans;
+    buf[4] = (uint8_t)(telemetry_seq >> 24);
+    buf[5] = (uint8_t)(telemetry_seq >> 16);
+    buf[6] = (uint8_t)(telemetry_seq >> 8);
+    buf[7] = (uint8_t)telemetry_seq;
+    telemetry_seq++;
+    return (uint32_t)(p - buf);
+}
+
+/* The encoded block of len bytes in raw to out, its body as an LZ4 block
+ * when that is shorter; returns the datagram length */
+static uint32_t telemetry_pack(uint8_t* out, const uint8_t* raw, uint32_t len)
+{
+    uint32_t body = len - TELEMETRY_HDR_LEN;
+    uint32_t n = (body > 1U) ? lz4_block_compress(&telemetry_lz4_state, &raw[TELEMETRY_HDR_LEN], body,
+                                                  &out[TELEMETRY_HDR_LEN], body - 1U) : 0U;
+
+    memcpy(out, raw, TELEMETRY_HDR_LEN);
+    if (n != 0U) {
+        out[2] |= TELEMETRY_AGG_FLAG_LZ4;
+    } else {
+        memcpy(&out[TELEMETRY_HDR_LEN], &raw[TELEMETRY_HDR_LEN], body);
+        n = body;
+    }
+    metric_add(&telemetry_lz4_in, len);
+    metric_add(&telemetry_lz4_out, TELEMETRY_HDR_LEN + n);
+    return TELEMETRY_HDR_LEN + n;
+}
+
+static void telemetry_flush(void* arg)
+{
+    LWIP_UNUSED_ARG(arg);
+    for (uint32_t i = 0U; i < TELEMETRY_AGG_BURST; i++) {
+        struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, TELEMETRY_AGG_MTU, PBUF_RAM);
+        bool lz4 = telemetry_lz4;
+        uint32_t len;
+
+        if (p == NULL) {
+            break;
+        }
+        /* Encoded in place, one PBUF_RAM is contiguous; for LZ4 aside */
+        len = telemetry_agg_encode(lz4 ? telemetry_raw : p->payload, TELEMETRY_AGG_MTU);
+        if (len == 0U) {
+            pbuf_free(p);
+            break;
+        }
+        if (lz4) {
+            len = telemetry_pack(p->payload, telemetry_raw, len);
+        }
+        pbuf_realloc(p, (u16_t)len);
+        if (telemetry_sink != NULL) {
+            telemetry_sink(p->payload, len);
+        }
+        if (((telemetry_output != NULL) ? telemetry_output(p)
+                                        : udp_sendto(telemetry_udp, p, &telemetry_addr, TELEMETRY_AGG_PORT)) == ERR_OK) {
+            metric_inc(&telemetry_datagrams);
+            metric_add(&telemetry_bytes, len);
+        }
+        pbuf_free(p);
+    }
+    if (telemetry_sink != NULL) {
+        telemetry_sink(NULL, 0U);
+    }
+    sys_timeout(TELEMETRY_AGG_FLUSH_MS, telemetry_flush, NULL);
+}
+
+/* The snapshots' fields to their channels, stamped alike */
+static void telemetry_sample(void* arg)
+{
+    uint32_t t_us = (uint32_t)(time_now_ns() / 1000U);
+
+    LWIP_UNUSED_ARG(arg);
+    for (TelemetrySnap_t* s = telemetry_snaps; s != NULL; s = s->next) {
+        int32_t v[TELEMETRY_AGG_SNAP_FIELDS];
+        uint32_t seq;
+
+        for (;;) {
+            seq = seqsnap_read_begin(s->snap);
+            const uint8_t* p = seqsnap_data(s->snap, seq);
+            for (uint32_t i = 0U; i < s->n; i++) {
+                memcpy(&v[i], &p[s->fields[i].offset], sizeof(v[i]));
+            }
+            if (!seqsnap_read_retry(s->snap, seq)) {
+                break;
+            }
+            metric_inc(&telemetry_snap_retries);
+        }
+        for (uint32_t i = 0U; i < s->n; i++) {
+            telemetry_agg_put_at(s->fields[i].chan, v[i], t_us);
+        }
+    }
+    sys_timeout(TELEMETRY_AGG_SNAP_MS, telemetry_sample, NULL);
+}
+
+/*---------------------------------------------------------------------------*/
+
+void telemetry_agg_set_sink(TelemetrySink_t fn)
+{
+    LOCK_TCPIP_CORE();
+    telemetry_sink = fn;
+    UNLOCK_TCPIP_CORE();
+}
+
+void telemetry_agg_set_output(TelemetryOutput_t fn)
+{
+    LOCK_TCPIP_CORE();
+    telemetry_output = fn;
+    UNLOCK_TCPIP_CORE();
+}
+
+void telemetry_agg_set_lz4(bool on)
+{
+    telemetry_lz4 = on;
+}
+
+bool telemetry_agg_add(TelemetryChan_t* ch)
+{
+    bool ok = true;
+
+    if (ch->slots == 0U || (ch->slots & (ch->slots - 1U)) != 0U || ch->window_us == 0U) {
+        return false;
+    }
+    LOCK_TCPIP_CORE();
+    for (TelemetryChan_t* c = telemetry_chans; c != NULL; c = c->next) {
+        if (c == ch || c->id == ch->id) {
+            ok = false;
+        }
+    }
+    if (ok) {
+        ch->open = false;
+        ch->head = 0U;
+        ch->tail = 0U;
+        ch->next = telemetry_chans;
+        telemetry_chans = ch;
+    }
+    UNLOCK_TCPIP_CORE();
+    return ok;
+}
+
+bool telemetry_agg_add_snap(TelemetrySnap_t* s)
+{
+    if (s->snap == NULL || s->n == 0U || s->n > TELEMETRY_AGG_SNAP_FIELDS) {
+        return false;
+    }
+    for (uint32_t i = 0U; i < s->n; i++) {
+        if (s->fields[i].chan == NULL || s->fields[i].offset + sizeof(int32_t) > s->snap->size) {
+            return false;
+        }
+    }
+    LOCK_TCPIP_CORE();
+    /* The first one starts the sampling */
+    if (telemetry_snaps == NULL) {
+        sys_timeout(TELEMETRY_AGG_SNAP_MS, telemetry_sample, NULL);
+    }
+    s->next = telemetry_snaps;
+    telemetry_snaps = s;
+    UNLOCK_TCPIP_CORE();
+    return true;
+}
+
+bool telemetry_agg_start(void)
+{
+    bool ok = false;
+
+    (void)metrics_register(&telemetry_datagrams);
+    (void)metrics_register(&telemetry_bytes);
+    (void)metrics_register(&telemetry_windows);
+    (void)metrics_register(&telemetry_samples);
+    (void)metrics_register(&telemetry_dropped);
+    (void)metrics_register(&telemetry_lz4_in);
+    (void)metrics_register(&telemetry_lz4_out);
+    (void)metrics_register(&telemetry_snap_retries);
+
+    LOCK_TCPIP_CORE();
+    telemetry_udp = udp_new();
+    if (telemetry_udp != NULL && ipaddr_aton(TELEMETRY_AGG_IP, &telemetry_addr)) {
+        telemetry_udp->tos = TELEMETRY_AGG_TOS;
+        sys_timeout(TELEMETRY_AGG_FLUSH_MS, telemetry_flush, NULL);
+        ok = true;
+    }
+    UNLOCK_TCPIP_CORE();
+    if (!ok) {
+        LOG_ERROR(TELEMETRY_TAG, "no socket");
+    }
+    return ok;
+}
+
+#endif /* TELEMETRY_AGG */
@@ -0,0 +1,211 @@
+/**
+ * @file telemetry_agg.h
+ * @brief Sensor samples aggregated per channel on the device, sent as
+ *        compressed blocks.
+ *
+ * A channel takes int32 samples (fixed point, the application's scale)
+ * through telemetry_agg_put() and reduces them to one TelemetryAgg_t per
+ * window of window_us: min, max, mean, last value and sample count.
+ * Windows are aligned to multiples of window_us on time_now_ns(), and a
+ * window is closed by the first sample after it, so a channel that stops
+ * sampling keeps its last window until it resumes. Closed windows go to
+ * the channel's ring, a fixed number of slots (TELEMETRY_CHAN_DEFINE,
+ * static, in AXI SRAM with the rest of .bss); with the ring full a window
+ * is dropped and counted. A put costs a few compares and adds, no lock: one
+ * producer per channel, any context, ISRs included.
+ *
+ * State that a control task keeps rather than samples (speeds, loads,
+ * limits) is published as a snapshot (SeqSnap_t, seqlock/seqlock.h) and
+ * added with telemetry_agg_add_snap(): every TELEMETRY_AGG_SNAP_MS the
+ * tcpip thread copies the listed int32 fields of one consistent copy,
+ * retrying when the task published meanwhile, and puts them to their
+ * channels, of which it is then the producer. The control task never
+ * waits for the telemetry.
+ *
+ * Every TELEMETRY_AGG_FLUSH_MS the tcpip thread drains the rings into
+ * UDP datagrams of at most TELEMETRY_AGG_MTU bytes to
+ * TELEMETRY_AGG_IP:TELEMETRY_AGG_PORT, the windows of several channels per
+ * datagram. Each of the six columns of a channel's windows is encoded as
+ * delta-of-delta: the first value and the first delta as zigzag varints,
+ * the remaining second differences zigzagged and bit-packed at the width
+ * of the largest. Regular windows make the timestamp column a run of
+ * zeros, a byte for the lot, and slowly moving values take a few bits
+ * each. With LZ4 on (TELEMETRY_AGG_LZ4, telemetry_agg_set_lz4()) the part
+ * behind the header goes as an LZ4 block (compress/lz4_block.h) when that
+ * is shorter, flagged in the version byte; noisy channels rarely gain,
+ * runs of equal columns do. tools/telemetry_decode.py decodes the
+ * datagrams. A sink (telemetry_agg_set_sink()) gets every datagram as
+ * well, e.g. the WebSocket clients of the diagnostics server. An output
+ * (telemetry_agg_set_output()) replaces the UDP send, e.g. the multicast
+ * publisher of telemetry_mcast.h.
+ *
+ * Datagram, multi-byte header fields in network byte order:
+ *   u16 TELEMETRY_AGG_MAGIC, u8 version, u8 channels, u32 sequence
+ *   version | TELEMETRY_AGG_FLAG_LZ4: what follows is one LZ4 block
+ *   per channel: u16 id, u8 windows n, then the columns
+ *     t_us (window start), count, min, max, mean, last, each:
+ *       varint zz(v0); n > 1: varint zz(v1 - v0); n > 2: u8 width w,
+ *       then zz(dd_i) for i = 2..n-1, w bits each, LSB first
+ *   zz(x) = (x << 1) ^ (x >> 31), differences modulo 2^32.
+ *
+ * Exported through metrics as "telemetry.*".
+ */
+
+#pragma once
+
+#ifndef TELEMETRY_AGG_H
+#define TELEMETRY_AGG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "seqlock/seqlock.h"
+#include "lwip/err.h"
+
+/* 0 leaves the engine out of the startup code */
+#ifndef TELEMETRY_AGG
+#define TELEMETRY_AGG 1
+#endif
+
+#ifndef TELEMETRY_AGG_IP
+#define TELEMETRY_AGG_IP SYSLOG_SERVER_IP
+#endif
+
+#ifndef TELEMETRY_AGG_PORT
+#define TELEMETRY_AGG_PORT 8126U
+#endif
+
+#ifndef TELEMETRY_AGG_FLUSH_MS
+#define TELEMETRY_AGG_FLUSH_MS 1000U
+#endif
+
+/* UDP payload per datagram */
+#ifndef TELEMETRY_AGG_MTU
+#define TELEMETRY_AGG_MTU 1400U
+#endif
+
+/* Datagrams per flush at most; the rest waits for the next one */
+#ifndef TELEMETRY_AGG_BURST
+#define TELEMETRY_AGG_BURST 8U
+#endif
+
+/* IP TOS: DSCP AF31, the telemetry class of the ETH TX scheduler */
+#ifndef TELEMETRY_AGG_TOS
+#define TELEMETRY_AGG_TOS 0x68U
+#endif
+
+/* LZ4 at boot, telemetry_agg_set_lz4() at run time */
+#ifndef TELEMETRY_AGG_LZ4
+#define TELEMETRY_AGG_LZ4 0
+#endif
+
+/* Snapshot sampling period, and the fields of one snapshot at most */
+#ifndef TELEMETRY_AGG_SNAP_MS
+#define TELEMETRY_AGG_SNAP_MS 100U
+#endif
+
+#ifndef TELEMETRY_AGG_SNAP_FIELDS
+#define TELEMETRY_AGG_SNAP_FIELDS 16U
+#endif
+
+#define TELEMETRY_AGG_MAGIC     0x5441U     /* "TA" */
+#define TELEMETRY_AGG_VERSION   1U
+#define TELEMETRY_AGG_FLAG_LZ4  0x80U
+
+/* One closed window */
+typedef struct {
+    uint32_t t_us;          /* window start, time_now_ns() / 1000 */
+    uint32_t count;         /* samples in it, at least 1 */
+    int32_t min;
+    int32_t max;
+    int32_t mean;           /* rounded toward zero */
+    int32_t last;
+} TelemetryAgg_t;
+
+typedef struct TelemetryChan_s {
+    uint16_t id;            /* in the datagrams */
+    uint32_t window_us;
+    TelemetryAgg_t* ring;
+    uint32_t slots;         /* of ring, a power of two */
+    /* Producer */
+    bool open;              /* a window is being filled */
+    uint32_t win;           /* its start */
+    uint32_t count;
+    int64_t sum;
+    int32_t min;
+    int32_t max;
+    int32_t last;
+    /* Shared, free running */
+    volatile uint32_t head; /* windows closed, producer */
+    volatile uint32_t tail; /* windows sent, tcpip thread */
+    struct TelemetryChan_s* next;
+} TelemetryChan_t;
+
+/* Gets each datagram of a flush as it is sent, then (NULL, 0) at the end
+ * of the flush. tcpip thread; data is valid during the call only. */
+typedef void (*TelemetrySink_t)(const uint8_t* data, uint32_t len);
+
+struct pbuf;
+/* Sends a datagram instead of the UDP PCB, ERR_OK when it went out.
+ * p is one PBUF_RAM allocated at PBUF_TRANSPORT, room for the UDP, IP and
+ * link headers in front of the payload; the caller frees it. tcpip
+ * thread. */
+typedef err_t (*TelemetryOutput_t)(struct pbuf* p);
+
+/* A field of a snapshot and the channel it is sampled to */
+typedef struct {
+    TelemetryChan_t* chan;
+    uint16_t offset;        /* of an int32_t in the snapshot */
+} TelemetryField_t;
+
+typedef struct TelemetrySnap_s {
+    const SeqSnap_t* snap;
+    const TelemetryField_t* fields;
+    uint32_t n;             /* up to TELEMETRY_AGG_SNAP_FIELDS */
+    struct TelemetrySnap_s* next;
+} TelemetrySnap_t;
+
+/* A channel with its ring; slots a power of two */
+#define TELEMETRY_CHAN_DEFINE(var, chan_id, win_us, n_slots)                    \
+    static TelemetryAgg_t var##_ring[(n_slots)];                                \
+    static TelemetryChan_t var = { .id = (chan_id), .window_us = (win_us),      \
+                                   .ring = var##_ring, .slots = (n_slots) }
+
+/* Binds the UDP PCB and starts the flush timer; from a task, core lock
+ * not held */
+bool telemetry_agg_start(void);
+
+/* Adds a channel, ids unique; before its first sample, from a task */
+bool telemetry_agg_add(TelemetryChan_t* ch);
+
+/* Samples the fields of a snapshot from now on; their channels added
+ * before and fed by nothing else. From a task. */
+bool telemetry_agg_add_snap(TelemetrySnap_t* s);
+
+/* One sample, stamped now; one producer per channel */
+void telemetry_agg_put(TelemetryChan_t* ch, int32_t v);
+/* The same with the caller's time_now_ns() / 1000 */
+void telemetry_agg_put_at(TelemetryChan_t* ch, int32_t v, uint32_t t_us);
+
+/* The sink of the datagrams, NULL for none; from a task */
+void telemetry_agg_set_sink(TelemetrySink_t fn);
+
+/* The output of the datagrams, NULL for TELEMETRY_AGG_IP; from a task */
+void telemetry_agg_set_output(TelemetryOutput_t fn);
+
+/* Whether the flush sends LZ4 blocks; any context */
+void telemetry_agg_set_lz4(bool on);
+
+/* Encodes pending windows of the channels into buf, as one datagram;
+ * returns the length, 0 when none are pending. tcpip thread. */
+uint32_t telemetry_agg_encode(uint8_t* buf, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_AGG_H */
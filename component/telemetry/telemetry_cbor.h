@@ -0,0 +1,159 @@
+/**
+ * @file telemetry_cbor.h
+ * @brief Fixed telemetry structs encoded as CBOR straight into MQTT publishes.
+ *
+ * A schema is an X-macro list of (type, name) fields:
+ *
+ *   #define PLANT_TELEMETRY(F) \
+ *       F(u32, uptime_s)       \
+ *       F(i32, temp_mc)        \
+ *       F(f32, flow_lpm)       \
+ *       F(bool, pump_on)
+ *   TELEMETRY_CBOR_SCHEMA(PlantTelemetry, PLANT_TELEMETRY)
+ *
+ * generates the struct PlantTelemetry_t, its encoded length
+ * PlantTelemetry_CBOR_LEN and its encoder PlantTelemetry_cbor(), an
+ * mqtt_payload_gen_t. TELEMETRY_CBOR_PUBLISH() publishes a struct with
+ * mqtt_publish_gen(): the values are encoded straight into the client's
+ * output ring, no text and no staging buffer.
+ *
+ * The payload is a CBOR array of the values in schema order, without keys:
+ * the schema is the contract with the consumer, append fields only. Each
+ * value takes the full width of its type (u32 is always 0x1a + 4 bytes).
+ * That is valid CBOR, though not the shortest form, and makes the length
+ * a compile-time constant. Types: u8 u16 u32 u64 i32 f32 bool.
+ *
+ * Call from the tcpip thread or with the core lock held, like mqtt_publish().
+ */
+
+#pragma once
+
+#ifndef TELEMETRY_CBOR_H
+#define TELEMETRY_CBOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lwip/apps/mqtt.h"
+
+/* C type and encoded length per schema type */
+#define TELEMETRY_CBOR_CTYPE_u8     uint8_t
+#define TELEMETRY_CBOR_CTYPE_u16    uint16_t
+#define TELEMETRY_CBOR_CTYPE_u32    uint32_t
+#define TELEMETRY_CBOR_CTYPE_u64    uint64_t
+#define TELEMETRY_CBOR_CTYPE_i32    int32_t
+#define TELEMETRY_CBOR_CTYPE_f32    float
+#define TELEMETRY_CBOR_CTYPE_bool   bool
+
+#define TELEMETRY_CBOR_LEN_u8       2U
+#define TELEMETRY_CBOR_LEN_u16      3U
+#define TELEMETRY_CBOR_LEN_u32      5U
+#define TELEMETRY_CBOR_LEN_u64      9U
+#define TELEMETRY_CBOR_LEN_i32      5U
+#define TELEMETRY_CBOR_LEN_f32      5U
+#define TELEMETRY_CBOR_LEN_bool     1U
+
+#define TELEMETRY_CBOR_ARRAY_LEN(n) ((n) < 24U ? 1U : ((n) < 256U ? 2U : 3U))
+
+#define TELEMETRY_CBOR_FIELD_(type, name)   TELEMETRY_CBOR_CTYPE_##type name;
+#define TELEMETRY_CBOR_COUNT_(type, name)   + 1U
+#define TELEMETRY_CBOR_SIZE_(type, name)    + TELEMETRY_CBOR_LEN_##type
+#define TELEMETRY_CBOR_PUT_(type, name)     telemetry_cbor_put_##type(out, t->name);
+
+#define TELEMETRY_CBOR_SCHEMA(Name, FIELDS)                                                 \
+    typedef struct {                                                                        \
+        FIELDS(TELEMETRY_CBOR_FIELD_)                                                       \
+    } Name##_t;                                                                             \
+    enum {                                                                                  \
+        Name##_CBOR_FIELDS = 0U FIELDS(TELEMETRY_CBOR_COUNT_),                              \
+        Name##_CBOR_LEN = TELEMETRY_CBOR_ARRAY_LEN(0U FIELDS(TELEMETRY_CBOR_COUNT_))        \
+                          FIELDS(TELEMETRY_CBOR_SIZE_)                                      \
+    };                                                                                      \
+    _Static_assert(Name##_CBOR_LEN <= 0xFFFF, #Name " does not fit an MQTT publish");        \
+    static inline void Name##_cbor(void* arg, struct mqtt_payload_out* out)                 \
+    {                                                                                       \
+        const Name##_t* t = (const Name##_t*)arg;                                           \
+        telemetry_cbor_put_array(out, Name##_CBOR_FIELDS);                                  \
+        FIELDS(TELEMETRY_CBOR_PUT_)                                                         \
+    }
+
+/* Publishes *value (a Name##_t, read before this returns) to topic */
+#define TELEMETRY_CBOR_PUBLISH(client, topic, Name, value, qos, cb, arg)                    \
+    mqtt_publish_gen((client), (topic), (u16_t)Name##_CBOR_LEN, Name##_cbor, (void*)(value), \
+                     (qos), 0, (cb), (arg))
+
+/* Major type, 0x18..0x1b additional info, big-endian argument of n bytes */
+static inline void telemetry_cbor_put_head(struct mqtt_payload_out* out, uint8_t head, uint64_t v, uint32_t n)
+{
+    uint8_t b[9];
+
+    b[0] = head;
+    for (uint32_t i = 0; i < n; i++) {
+        b[n - i] = (uint8_t)(v >> (8U * i));
+    }
+    mqtt_payload_write(out, b, (u16_t)(n + 1U));
+}
+
+static inline void telemetry_cbor_put_array(struct mqtt_payload_out* out, uint32_t n)
+{
+    if (n < 24U) {
+        telemetry_cbor_put_head(out, (uint8_t)(0x80U | n), 0U, 0U);
+    } else if (n < 256U) {
+        telemetry_cbor_put_head(out, 0x98U, n, 1U);
+    } else {
+        telemetry_cbor_put_head(out, 0x99U, n, 2U);
+    }
+}
+
+static inline void telemetry_cbor_put_u8(struct mqtt_payload_out* out, uint8_t v)
+{
+    telemetry_cbor_put_head(out, 0x18U, v, 1U);
+}
+
+static inline void telemetry_cbor_put_u16(struct mqtt_payload_out* out, uint16_t v)
+{
+    telemetry_cbor_put_head(out, 0x19U, v, 2U);
+}
+
+static inline void telemetry_cbor_put_u32(struct mqtt_payload_out* out, uint32_t v)
+{
+    telemetry_cbor_put_head(out, 0x1aU, v, 4U);
+}
+
+static inline void telemetry_cbor_put_u64(struct mqtt_payload_out* out, uint64_t v)
+{
+    telemetry_cbor_put_head(out, 0x1bU, v, 8U);
+}
+
+/* Negative values are major type 1 with argument -1 - v */
+static inline void telemetry_cbor_put_i32(struct mqtt_payload_out* out, int32_t v)
+{
+    if (v < 0) {
+        telemetry_cbor_put_head(out, 0x3aU, ~(uint32_t)v, 4U);
+    } else {
+        telemetry_cbor_put_head(out, 0x1aU, (uint32_t)v, 4U);
+    }
+}
+
+static inline void telemetry_cbor_put_f32(struct mqtt_payload_out* out, float v)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &v, sizeof(bits));
+    telemetry_cbor_put_head(out, 0xfaU, bits, 4U);
+}
+
+static inline void telemetry_cbor_put_bool(struct mqtt_payload_out* out, bool v)
+{
+    telemetry_cbor_put_head(out, v ? 0xf5U : 0xf4U, 0U, 0U);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_CBOR_H */
@@ -0,0 +1,225 @@
+/**
+ * @file telemetry_mcast.c
+ * @brief The telemetry datagrams to an IP multicast group, see
+ *        telemetry_mcast.h.
+ */
+
+#include "telemetry_mcast.h"
+
+#if TELEMETRY_MCAST
+
+#include "metrics/metrics.h"
+
+#include "main.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#include "lwip/igmp.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/netif.h"
+#include "lwip/pbuf.h"
+#include "lwip/prot/ethernet.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/udp.h"
+
+#include <string.h>
+
+#define MCAST_TAG               "TELEM"
+/* The template: Ethernet (ETH_PAD_SIZE included), IPv4, UDP */
+#define MCAST_IP_OFS            SIZEOF_ETH_HDR
+#define MCAST_UDP_OFS           (SIZEOF_ETH_HDR + IP_HLEN)
+#define MCAST_HDR_LEN           (SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN)
+
+/* tcpip thread */
+static uint8_t mcast_tmpl[MCAST_HDR_LEN];
+static struct netif* mcast_netif;       /* the template's; NULL: to build */
+static ip4_addr_t mcast_src;            /* and its source address */
+static ip4_addr_t mcast_group;
+static u16_t mcast_id;
+static struct netif* mcast_joined;      /* joined on */
+static struct udp_pcb* mcast_pcb;       /* another publisher's datagrams */
+static bool mcast_started;
+static bool mcast_foreign_logged;
+
+static Metric_t mcast_frames = METRIC_COUNTER_INIT("telemetry.mcast.frames");
+static Metric_t mcast_bytes = METRIC_COUNTER_INIT("telemetry.mcast.bytes");
+static Metric_t mcast_errors = METRIC_COUNTER_INIT("telemetry.mcast.errors");
+static Metric_t mcast_rebuilds = METRIC_COUNTER_INIT("telemetry.mcast.rebuilds");
+static Metric_t mcast_foreign = METRIC_COUNTER_INIT("telemetry.mcast.foreign");
+
+/*---------------------------------------------------------------------------*/
+
+static void mcast_template(struct netif* netif)
+{
+    struct eth_hdr* eth = (struct eth_hdr*)mcast_tmpl;
+    struct ip_hdr* iph = (struct ip_hdr*)&mcast_tmpl[MCAST_IP_OFS];
+    struct udp_hdr* udph = (struct udp_hdr*)&mcast_tmpl[MCAST_UDP_OFS];
+    u32_t group = lwip_ntohl(ip4_addr_get_u32(&mcast_group));
+
+    memset(mcast_tmpl, 0, sizeof(mcast_tmpl));
+    /* RFC 1112: 01:00:5e and the low 23 bits of the group */
+    eth->dest.addr[0] = LL_IP4_MULTICAST_ADDR_0;
+    eth->dest.addr[1] = LL_IP4_MULTICAST_ADDR_1;
+    eth->dest.addr[2] = LL_IP4_MULTICAST_ADDR_2;
+    eth->dest.addr[3] = (u8_t)((group >> 16) & 0x7FU);
+    eth->dest.addr[4] = (u8_t)(group >> 8);
+    eth->dest.addr[5] = (u8_t)group;
+    SMEMCPY(eth->src.addr, netif->hwaddr, ETH_HWADDR_LEN);
+    eth->type = PP_HTONS(ETHTYPE_IP);
+
+    IPH_VHL_SET(iph, 4, IP_HLEN / 4);
+    IPH_TOS_SET(iph, TELEMETRY_AGG_TOS);
+    IPH_OFFSET_SET(iph, PP_HTONS(IP_DF));
+    IPH_TTL_SET(iph, TELEMETRY_MCAST_TTL);
+    IPH_PROTO_SET(iph, IP_PROTO_UDP);
+    ip4_addr_copy(iph->src, *netif_ip4_addr(netif));
+    ip4_addr_copy(iph->dest, mcast_group);
+
+    udph->src = PP_HTONS(TELEMETRY_MCAST_PORT);
+    udph->dest = PP_HTONS(TELEMETRY_MCAST_PORT);
+
+    mcast_netif = netif;
+    ip4_addr_copy(mcast_src, *netif_ip4_addr(netif));
+    metric_inc(&mcast_rebuilds);
+}
+
+/* TelemetryOutput_t: the template in front, lengths and id patched */
+static err_t mcast_output(struct pbuf* p)
+{
+    struct netif* netif = netif_default;
+    u16_t len = p->tot_len;
+    struct ip_hdr* iph;
+    struct udp_hdr* udph;
+    err_t err;
+
+    if (netif == NULL || !netif_is_up(netif) || !netif_is_link_up(netif) ||
+        ip4_addr_isany_val(*netif_ip4_addr(netif))) {
+        metric_inc(&mcast_errors);
+        return ERR_IF;
+    }
+    if (netif != mcast_netif || !ip4_addr_cmp(netif_ip4_addr(netif), &mcast_src)) {
+        mcast_template(netif);
+    }
+    /* Allocated at PBUF_TRANSPORT: the headroom is there */
+    if (pbuf_add_header(p, MCAST_HDR_LEN) != 0U) {
+        metric_inc(&mcast_errors);
+        return ERR_BUF;
+    }
+    memcpy(p->payload, mcast_tmpl, MCAST_HDR_LEN);
+    iph = (struct ip_hdr*)((u8_t*)p->payload + MCAST_IP_OFS);
+    udph = (struct udp_hdr*)((u8_t*)p->payload + MCAST_UDP_OFS);
+    IPH_LEN_SET(iph, lwip_htons((u16_t)(IP_HLEN + UDP_HLEN + len)));
+    IPH_ID_SET(iph, lwip_htons(mcast_id));
+    mcast_id++;
+    udph->len = lwip_htons((u16_t)(UDP_HLEN + len));
+#if CHECKSUM_GEN_UDP
+    IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_UDP) {
+        u16_t sum;
+
+        (void)pbuf_remove_header(p, MCAST_UDP_OFS);
+        sum = inet_chksum_pseudo(p, IP_PROTO_UDP, p->tot_len, &mcast_src, &mcast_group);
+        udph->chksum = (sum == 0x0000U) ? 0xFFFFU : sum;
+        (void)pbuf_add_header(p, MCAST_UDP_OFS);
+    }
+#endif
+#if CHECKSUM_GEN_IP
+    IF__NETIF_CHECKSUM_ENABLED(netif, NETIF_CHECKSUM_GEN_IP) {
+        IPH_CHKSUM_SET(iph, inet_chksum(iph, IP_HLEN));
+    }
+#endif
+
+    err = netif->linkoutput(netif, p);
+    if (err == ERR_OK) {
+        metric_inc(&mcast_frames);
+        metric_add(&mcast_bytes, p->tot_len);
+    } else {
+        metric_inc(&mcast_errors);
+    }
+    return err;
+}
+
+/* Our own frames do not come back: this is someone else on the group */
+static void mcast_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    LWIP_UNUSED_ARG(arg);
+    LWIP_UNUSED_ARG(pcb);
+    metric_inc(&mcast_foreign);
+    if (!mcast_foreign_logged) {
+        mcast_foreign_logged = true;
+        LOG_ERROR(MCAST_TAG, "another publisher on %s: %s:%u", TELEMETRY_MCAST_GROUP, ipaddr_ntoa(addr),
+                  (unsigned)port);
+    }
+    pbuf_free(p);
+}
+
+/*---------------------------------------------------------------------------*/
+
+bool telemetry_mcast_start(void)
+{
+    ip_addr_t group;
+    bool ok = false;
+
+    if (!ip4addr_aton(TELEMETRY_MCAST_GROUP, &mcast_group) || !ip4_addr_ismulticast(&mcast_group)) {
+        LOG_ERROR(MCAST_TAG, "not a multicast group: %s", TELEMETRY_MCAST_GROUP);
+        return false;
+    }
+    ip_addr_copy_from_ip4(group, mcast_group);
+
+    (void)metrics_register(&mcast_frames);
+    (void)metrics_register(&mcast_bytes);
+    (void)metrics_register(&mcast_errors);
+    (void)metrics_register(&mcast_rebuilds);
+    (void)metrics_register(&mcast_foreign);
+
+    LOCK_TCPIP_CORE();
+    if (!mcast_started && netif_default != NULL) {
+        mcast_started = true;
+        mcast_netif = NULL;
+        /* Kept by lwIP across link changes; the ETH driver follows it in
+         * the MAC hash filter */
+        if (igmp_joingroup_netif(netif_default, &mcast_group) == ERR_OK) {
+            mcast_joined = netif_default;
+        }
+        mcast_pcb = udp_new();
+        if (mcast_pcb != NULL) {
+            if (udp_bind(mcast_pcb, &group, TELEMETRY_MCAST_PORT) == ERR_OK) {
+                udp_recv(mcast_pcb, mcast_recv, NULL);
+            } else {
+                udp_remove(mcast_pcb);
+                mcast_pcb = NULL;
+            }
+        }
+        ok = true;
+    }
+    UNLOCK_TCPIP_CORE();
+    if (!ok) {
+        LOG_ERROR(MCAST_TAG, "no netif");
+        return false;
+    }
+    if (mcast_joined == NULL) {
+        LOG_ERROR(MCAST_TAG, "group %s not joined", TELEMETRY_MCAST_GROUP);
+    }
+
+    telemetry_agg_set_output(mcast_output);
+    LOG_INFO(MCAST_TAG, "multicast to %s:%u, TTL %u", TELEMETRY_MCAST_GROUP, (unsigned)TELEMETRY_MCAST_PORT,
+             (unsigned)TELEMETRY_MCAST_TTL);
+    return true;
+}
+
+void telemetry_mcast_stop(void)
+{
+    telemetry_agg_set_output(NULL);
+
+    LOCK_TCPIP_CORE();
+    if (mcast_pcb != NULL) {
+        udp_remove(mcast_pcb);
+        mcast_pcb = NULL;
+    }
+    if (mcast_joined != NULL) {
+        (void)igmp_leavegroup_netif(mcast_joined, &mcast_group);
+        mcast_joined = NULL;
+    }
+    mcast_started = false;
+    UNLOCK_TCPIP_CORE();
+}
+
+#endif /* TELEMETRY_MCAST */
@@ -0,0 +1,85 @@
+/**
+ * @file telemetry_mcast.h
+ * @brief The telemetry datagrams to an IP multicast group, once for all
+ *        receivers.
+ *
+ * With several consumers of the telemetry_agg.h stream (a historian, a
+ * dashboard, a test rig) unicast would mean a copy per consumer. Started,
+ * the publisher takes over the output of the aggregation engine
+ * (telemetry_agg_set_output()): every datagram goes once to
+ * TELEMETRY_MCAST_GROUP:TELEMETRY_MCAST_PORT, instead of
+ * TELEMETRY_AGG_IP, and the switch fans it out.
+ *
+ * The group's destination is fixed, so the frame headers are too: the
+ * Ethernet, IPv4 and UDP headers are built once into a 42-byte template
+ * (the MAC 01:00:5e plus the low 23 bits of the group, the netif's MAC and
+ * address, TELEMETRY_AGG_TOS, TELEMETRY_MCAST_TTL, DF) and put in front of
+ * each datagram with one copy, in the headroom of the pbuf the engine
+ * encoded into. Only the lengths and the IP identification are patched;
+ * the checksums are left to the MAC where lwIP leaves them to it
+ * (CHECKSUM_GEN_IP / CHECKSUM_GEN_UDP 0), and computed otherwise. The
+ * frame goes straight to netif->linkoutput: no routing, no ARP, no UDP
+ * PCB. The template is rebuilt when the netif's address changes (DHCP).
+ * The ETH TX scheduler files the frames under the telemetry class by
+ * their TOS, as it does the unicast ones.
+ *
+ * The board joins the group too (IGMP, which also sets the MAC multicast
+ * hash filter): a snooping switch then keeps the group alive on the
+ * port, and datagrams of another publisher on the group are counted and
+ * their first source logged, a configuration mistake that would otherwise
+ * show up as garbage at the receivers.
+ *
+ * Receivers detect loss by the sequence number of the datagram header,
+ * one per datagram sent; a datagram the board fails to send leaves its
+ * gap as well. tools/telemetry_decode.py --group joins and reports loss
+ * per publisher.
+ *
+ * Exported through metrics as "telemetry.mcast.*".
+ */
+
+#pragma once
+
+#ifndef TELEMETRY_MCAST_H
+#define TELEMETRY_MCAST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+
+#include "telemetry_agg.h"
+
+/* 1 starts the publisher with the aggregation engine; off by default, as
+ * it replaces the unicast destination */
+#ifndef TELEMETRY_MCAST
+#define TELEMETRY_MCAST 0
+#endif
+
+/* Organization-local scope (RFC 2365) */
+#ifndef TELEMETRY_MCAST_GROUP
+#define TELEMETRY_MCAST_GROUP "239.192.84.65"
+#endif
+
+#ifndef TELEMETRY_MCAST_PORT
+#define TELEMETRY_MCAST_PORT TELEMETRY_AGG_PORT
+#endif
+
+/* 1 keeps the datagrams on the subnet */
+#ifndef TELEMETRY_MCAST_TTL
+#define TELEMETRY_MCAST_TTL 1U
+#endif
+
+/* Joins the group on the default netif and takes over the output of the
+ * aggregation engine; after telemetry_agg_start(), from a task, core lock
+ * not held */
+bool telemetry_mcast_start(void);
+
+/* Back to unicast, leaving the group; from a task */
+void telemetry_mcast_stop(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TELEMETRY_MCAST_H */
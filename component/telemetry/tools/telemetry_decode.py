@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Telemetry block decoder: the datagrams of component/telemetry/telemetry_agg.h.
+
+Listens on UDP --port (8126, TELEMETRY_AGG_PORT) and prints one line per
+window: channel id, window start in microseconds, sample count, min, max,
+mean and last value, plus a summary of sizes and gaps in the sequence.
+
+    telemetry_decode.py [--bind 0.0.0.0] [--port 8126] [--quiet]
+    telemetry_decode.py --group 239.192.84.65 [--iface 192.168.1.5]
+
+--group joins the multicast group of component/telemetry/telemetry_mcast.h,
+on the interface with address --iface, or the one the routing table
+picks. Sequence gaps are kept per publisher; on exit (Ctrl-C) each one's
+datagrams received, lost and out of order are printed.
+
+decode(datagram) can be imported for other consumers; it returns
+(sequence, {channel id: [(t_us, count, min, max, mean, last), ...]}).
+Datagrams with LZ4 blocks (TELEMETRY_AGG_FLAG_LZ4) are expanded with the
+decoder of component/compress/tools/lz4_relay.py.
+"""
+
+import argparse
+import os
+import socket
+import struct
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "compress", "tools"))
+from lz4_relay import decompress  # noqa: E402
+
+MAGIC = 0x5441
+VERSION = 1
+FLAG_LZ4 = 0x80
+COLUMNS = 6
+M32 = 0xFFFFFFFF
+
+
+def unzz(z):
+    return (z >> 1) ^ (-(z & 1) & M32)
+
+
+def signed(v):
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+class Reader:
+    def __init__(self, data, pos):
+        self.data = data
+        self.pos = pos
+
+    def byte(self):
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def varint(self):
+        v = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            v |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return v
+
+    def bits(self, n, w):
+        out = []
+        acc = 0
+        have = 0
+        for _ in range(n):
+            while have < w:
+                acc |= self.byte() << have
+                have += 8
+            out.append(acc & ((1 << w) - 1))
+            acc >>= w
+            have -= w
+        return out
+
+
+def column(r, n):
+    v = [unzz(r.varint())]
+    if n > 1:
+        v.append((v[0] + unzz(r.varint())) & M32)
+    if n > 2:
+        w = r.byte()
+        dds = r.bits(n - 2, w) if w else [0] * (n - 2)
+        for dd in dds:
+            v.append((2 * v[-1] - v[-2] + unzz(dd)) & M32)
+    return v
+
+
+def decode(data):
+    magic, version, chans, seq = struct.unpack_from("!HBBI", data, 0)
+    if magic != MAGIC or version & ~FLAG_LZ4 != VERSION:
+        raise ValueError("not a telemetry block")
+    if version & FLAG_LZ4:
+        data = data[:8] + decompress(data[8:])
+    r = Reader(data, 8)
+    out = {}
+    for _ in range(chans):
+        cid = (r.byte() << 8) | r.byte()
+        n = r.byte()
+        cols = [column(r, n) for _ in range(COLUMNS)]
+        rows = []
+        for i in range(n):
+            t, count, mn, mx, mean, last = (c[i] for c in cols)
+            rows.append((t, count, signed(mn), signed(mx), signed(mean), signed(last)))
+        out.setdefault(cid, []).extend(rows)
+    if r.pos != len(data):
+        raise ValueError("%d trailing bytes" % (len(data) - r.pos))
+    return seq, out
+
+
+def report(pubs, pub, seq):
+    """Counts the datagram against its publisher's sequence."""
+    last, rx, lost, late = pubs.get(pub, (None, 0, 0, 0))
+    rx += 1
+    if last is not None:
+        gap = (seq - last - 1) & M32
+        if gap & 0x80000000:
+            # Behind the last one: late, after it was counted lost
+            late += 1
+            lost = max(lost - 1, 0)
+            seq = last
+        elif gap:
+            print("%s: %d datagrams lost" % (pub, gap))
+            lost += gap
+    pubs[pub] = (seq, rx, lost, late)
+
+
+def summary(chans, seq, data, quiet):
+    windows = sum(len(w) for w in chans.values())
+    samples = sum(row[1] for w in chans.values() for row in w)
+    print("seq=%d bytes=%d windows=%d samples=%d raw_bytes=%d" % (
+        seq, len(data), windows, samples, samples * 8))
+    if not quiet:
+        for cid, rows in sorted(chans.items()):
+            for row in rows:
+                print("  ch=%d t_us=%d count=%d min=%d max=%d mean=%d last=%d" % ((cid,) + row))
+    sys.stdout.flush()
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--bind", default="0.0.0.0")
+    ap.add_argument("--port", type=int, default=8126)
+    ap.add_argument("--quiet", action="store_true")
+    ap.add_argument("--group", help="multicast group to join")
+    ap.add_argument("--iface", default="0.0.0.0", help="address of the interface to join on")
+    args = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind((args.group if args.group and args.bind == "0.0.0.0" else args.bind, args.port))
+    if args.group:
+        mreq = socket.inet_aton(args.group) + socket.inet_aton(args.iface)
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+    # Per publisher: last sequence, received, lost, out of order
+    pubs = {}
+    try:
+        while True:
+            data, peer = sock.recvfrom(2048)
+            try:
+                seq, chans = decode(data)
+            except (ValueError, IndexError, struct.error) as e:
+                print("%s: bad datagram: %s" % (peer[0], e), file=sys.stderr)
+                continue
+            report(pubs, peer[0], seq)
+            summary(chans, seq, data, args.quiet)
+    except KeyboardInterrupt:
+        pass
+    for pub, (_, rx, lost, late) in sorted(pubs.items()):
+        total = rx + lost
+        print("%s: received %d lost %d (%.3f%%) out of order %d" % (
+            pub, rx, lost, 100.0 * lost / total if total else 0.0, late))
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,299 @@
+/**
+ * @file tickless.c
+ * @brief Tickless idle on LPTIM1, see tickless.h.
+ */
+
+#include "tickless.h"
+
+#if TICKLESS_IDLE
+
+#include "metrics/metrics.h"
+#include "lathist/lat_hist.h"
+#include "logger/console.h"
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include <stdbool.h>
+
+#define TICKLESS_TAG "IDLE"
+
+/* LPTIM1 kernel clock PCLK1 / 2^7 */
+#define TICKLESS_PRESC_LOG2 7U
+#define TICKLESS_COUNT_MASK 0xFFFFU
+#define TICKLESS_MAX_COUNTS (TICKLESS_COUNT_MASK - TICKLESS_LPTIM_MARGIN)
+
+typedef struct {
+    volatile uint32_t ready;
+    volatile uint32_t rx_pending;   /* an RX wake not yet seen by EthIf */
+    uint32_t rx_wake_cyc;
+    TicklessStats_t stats;
+    LatHist_t rx_lat;
+} Tickless_t;
+
+static Tickless_t tl;
+
+/* CPU cycles per LPTIM1 count, as a shift: HPRE and D2PPRE1 are the only
+ * dividers between the core and PCLK1, and both are powers of two */
+static uint32_t tickless_shift(void)
+{
+    return D1CorePrescTable[(RCC->D1CFGR & RCC_D1CFGR_HPRE) >> RCC_D1CFGR_HPRE_Pos] +
+           D1CorePrescTable[(RCC->D2CFGR & RCC_D2CFGR_D2PPRE1) >> RCC_D2CFGR_D2PPRE1_Pos] + TICKLESS_PRESC_LOG2;
+}
+
+/* CNT is read twice until both agree, as the reference manual asks */
+static uint32_t tickless_count(void)
+{
+    uint32_t a;
+    uint32_t b = LPTIM1->CNT;
+
+    do {
+        a = b;
+        b = LPTIM1->CNT;
+    } while (a != b);
+    return a;
+}
+
+/* Waits for the next count and returns it with the cycle counter at that
+ * edge, so that a count and a cycle stamp describe the same instant */
+static uint32_t tickless_edge(uint32_t* cyc)
+{
+    uint32_t c = tickless_count();
+    uint32_t n;
+
+    while ((n = tickless_count()) == c) {}
+    *cyc = DWT->CYCCNT;
+    return n;
+}
+
+static void tickless_metrics(MetricsWriter_t* w)
+{
+    TicklessStats_t s;
+
+    tickless_get_stats(&s);
+    metrics_emit(w, "idle.sleeps", METRIC_COUNTER, s.sleeps);
+    metrics_emit(w, "idle.aborted", METRIC_COUNTER, s.aborted);
+    metrics_emit(w, "idle.timer_wakes", METRIC_COUNTER, s.timer_wakes);
+    metrics_emit(w, "idle.rx_wakes", METRIC_COUNTER, s.rx_wakes);
+    metrics_emit(w, "idle.other_wakes", METRIC_COUNTER, s.other_wakes);
+    metrics_emit(w, "idle.slept_ms", METRIC_COUNTER, (uint32_t)(s.slept_us / 1000U));
+    metrics_emit(w, "idle.rxlat.p50_ns", METRIC_GAUGE, s.rx_lat_p50_ns);
+    metrics_emit(w, "idle.rxlat.p99_ns", METRIC_GAUGE, s.rx_lat_p99_ns);
+    metrics_emit(w, "idle.rxlat.max_ns", METRIC_GAUGE, s.rx_lat_max_ns);
+}
+
+void tickless_start(void)
+{
+    __HAL_RCC_LPTIM1_CONFIG(RCC_LPTIM1CLKSOURCE_D2PCLK1);
+    __HAL_RCC_LPTIM1_CLK_ENABLE();
+
+    /* CFGR and IER only while disabled, ARR and CMP only while enabled */
+    LPTIM1->CR = 0U;
+    LPTIM1->CFGR = TICKLESS_PRESC_LOG2 << LPTIM_CFGR_PRESC_Pos;
+    LPTIM1->IER = LPTIM_IER_CMPMIE;
+    LPTIM1->CR = LPTIM_CR_ENABLE;
+    LPTIM1->ARR = TICKLESS_COUNT_MASK;
+    while ((LPTIM1->ISR & LPTIM_ISR_ARROK) == 0U) {}
+    LPTIM1->ICR = LPTIM_ICR_ARROKCF;
+    LPTIM1->CR = LPTIM_CR_ENABLE | LPTIM_CR_CNTSTRT;
+
+    /* Compare matches come every wrap; the NVIC only passes them on
+     * while the core sleeps */
+    HAL_NVIC_SetPriority(LPTIM1_IRQn, TICKLESS_IRQ_PRIO, 0U);
+    NVIC_DisableIRQ(LPTIM1_IRQn);
+
+    lat_hist_reset(&tl.rx_lat);
+    (void)metrics_register_collector(tickless_metrics);
+    tl.ready = 1U;
+    LOG_INFO(TICKLESS_TAG, "tickless idle on LPTIM1, %lu cycles per count, up to %lu ms",
+             (unsigned long)(1UL << tickless_shift()),
+             (unsigned long)(((uint64_t)TICKLESS_MAX_COUNTS << tickless_shift()) / (SystemCoreClock / 1000U)));
+}
+
+void tickless_sleep(uint32_t expected_ticks)
+{
+    uint32_t per_tick = SystemCoreClock / configTICK_RATE_HZ;
+    uint32_t shift;
+    uint32_t max_ticks;
+    uint32_t val;
+    uint32_t cyc_stop;
+    uint32_t tim0;
+    uint32_t cyc_tim0;
+    uint32_t lp0;
+    uint32_t cyc0;
+    uint32_t lp1;
+    uint32_t cyc1;
+    uint32_t counts;
+    uint32_t cyc_wake;
+    uint32_t slept;
+    uint32_t skip = 0U;
+    uint32_t total;
+    uint32_t ticks;
+    uint32_t left;
+    uint32_t tim1;
+    uint32_t period;
+    int32_t us;
+    uint32_t events;
+    bool rx;
+    bool timer;
+
+    if (tl.ready == 0U) {
+        return;
+    }
+    shift = tickless_shift();
+    max_ticks = (TICKLESS_MAX_COUNTS << shift) / per_tick;
+    if (expected_ticks > max_ticks) {
+        expected_ticks = max_ticks;
+    }
+    if ((((expected_ticks - 1U) * per_tick) >> shift) < TICKLESS_MIN_COUNTS) {
+        return;
+    }
+#if SYSLOG_CONSOLE
+    /* The HAL tick drains the console, stay up until it is through */
+    if (console_pending()) {
+        return;
+    }
+#endif
+
+    __disable_irq();
+    __DSB();
+    __ISB();
+    if (eTaskConfirmSleepModeStatus() == eAbortSleep) {
+        tl.stats.aborted++;
+        __enable_irq();
+        return;
+    }
+
+    /* RTOS tick: VAL cycles to the next one */
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+    cyc_stop = DWT->CYCCNT;
+    val = SysTick->VAL;
+    /* HAL tick: TIM6 runs on, its update interrupt is off */
+    HAL_SuspendTick();
+    tim0 = TIM6->CNT;
+    cyc_tim0 = DWT->CYCCNT;
+    if (((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0U) || ((TIM6->SR & TIM_SR_UIF) != 0U)) {
+        /* A tick is due already; a few cycles of SysTick are lost */
+        HAL_ResumeTick();
+        SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+        tl.stats.aborted++;
+        __enable_irq();
+        return;
+    }
+
+    /* Wake at the tick the kernel expects a task to unblock */
+    counts = (val + (expected_ticks - 1U) * per_tick) >> shift;
+    if (counts > TICKLESS_MAX_COUNTS) {
+        counts = TICKLESS_MAX_COUNTS;
+    }
+    lp0 = tickless_edge(&cyc0);
+    LPTIM1->ICR = LPTIM_ICR_CMPMCF | LPTIM_ICR_CMPOKCF;
+    LPTIM1->CMP = (lp0 + counts) & TICKLESS_COUNT_MASK;
+    while ((LPTIM1->ISR & LPTIM_ISR_CMPOK) == 0U) {}
+    LPTIM1->ICR = LPTIM_ICR_CMPOKCF | LPTIM_ICR_CMPMCF;
+    NVIC_ClearPendingIRQ(LPTIM1_IRQn);
+    NVIC_EnableIRQ(LPTIM1_IRQn);
+
+    /* CSleep: SLEEPDEEP stays clear, the ETH DMA keeps its clocks */
+    __DSB();
+    __WFI();
+    __ISB();
+    cyc_wake = DWT->CYCCNT;
+
+    /* Interrupts are still masked: whatever woke the core is pending */
+    rx = NVIC_GetPendingIRQ(ETH_IRQn) != 0U;
+    timer = (LPTIM1->ISR & LPTIM_ISR_CMPM) != 0U;
+    lp1 = tickless_edge(&cyc1);
+    NVIC_DisableIRQ(LPTIM1_IRQn);
+    LPTIM1->ICR = LPTIM_ICR_CMPMCF;
+    NVIC_ClearPendingIRQ(LPTIM1_IRQn);
+
+    /* The cycle counter stood still while the CPU clock was off */
+    slept = ((lp1 - lp0) & TICKLESS_COUNT_MASK) << shift;
+    if (slept > cyc1 - cyc0) {
+        skip = slept - (cyc1 - cyc0);
+        DWT->CYCCNT += skip;
+    }
+
+    /* RTOS tick: step the whole ticks, the SysTick finishes the one under way */
+    total = (per_tick - val) + (DWT->CYCCNT - cyc_stop);
+    ticks = total / per_tick;
+    left = per_tick - (total % per_tick);
+    if (ticks >= expected_ticks) {
+        /* Woke late: the expected tick is due now */
+        ticks = expected_ticks - 1U;
+        left = 2U;
+    }
+    if (left < 2U) {
+        left = 2U;
+    }
+    SysTick->LOAD = left - 1U;
+    SysTick->VAL = 0U;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    SysTick->LOAD = per_tick - 1U;
+    vTaskStepTick(ticks);
+
+    /* HAL tick: the TIM6 periods that ended during the sleep */
+    tim1 = TIM6->CNT;
+    period = TIM6->ARR + 1U;
+    us = (int32_t)((DWT->CYCCNT - cyc_tim0) / (SystemCoreClock / 1000000U) + tim0) - (int32_t)tim1;
+    events = (us > 0) ? ((uint32_t)us + period / 2U) / period : 0U;
+    TIM6->SR = ~(uint32_t)TIM_SR_UIF;
+    if ((TIM6->CNT < tim1) && ((TIM6->SR & TIM_SR_UIF) == 0U)) {
+        /* Wrapped between the read and the clear */
+        events++;
+    }
+    uwTick += events * (uint32_t)uwTickFreq;
+    HAL_ResumeTick();
+
+    tl.stats.sleeps++;
+    tl.stats.slept_us += slept / (SystemCoreClock / 1000000U);
+    if (timer) {
+        tl.stats.timer_wakes++;
+    } else if (rx) {
+        tl.stats.rx_wakes++;
+        tl.rx_wake_cyc = cyc_wake + skip;
+        tl.rx_pending = 1U;
+    } else {
+        tl.stats.other_wakes++;
+    }
+    __enable_irq();
+}
+
+void tickless_rx_mark(void)
+{
+    uint32_t cyc;
+
+    if (tl.rx_pending == 0U) {
+        return;
+    }
+    cyc = DWT->CYCCNT - tl.rx_wake_cyc;
+    tl.rx_pending = 0U;
+    lat_hist_add(&tl.rx_lat, (uint32_t)(((uint64_t)cyc * 1000U) / (SystemCoreClock / 1000000U)));
+}
+
+void tickless_get_stats(TicklessStats_t* stats)
+{
+    static LatHist_t snap;
+
+    *stats = tl.stats;
+    lat_hist_snapshot(&tl.rx_lat, &snap);
+    stats->rx_lat_p50_ns = lat_hist_percentile(&snap, 5000U);
+    stats->rx_lat_p99_ns = lat_hist_percentile(&snap, 9900U);
+    stats->rx_lat_max_ns = snap.max;
+}
+
+void tickless_reset_latency(void)
+{
+    lat_hist_reset(&tl.rx_lat);
+}
+
+/* Only reached if a compare match slips past tickless_sleep() */
+void LPTIM1_IRQHandler(void)
+{
+    LPTIM1->ICR = LPTIM_ICR_CMPMCF;
+    NVIC_DisableIRQ(LPTIM1_IRQn);
+}
+
+#endif /* TICKLESS_IDLE */
@@ -0,0 +1,95 @@
+/**
+ * @file tickless.h
+ * @brief Tickless idle on LPTIM1: the core sleeps until the next RTOS timeout or a frame.
+ *
+ * FreeRTOSConfig.h maps portSUPPRESS_TICKS_AND_SLEEP() to tickless_sleep().
+ * When the idle task finds nothing due for configEXPECTED_IDLE_TIME_BEFORE_SLEEP
+ * ticks or more, the SysTick and the HAL tick (TIM6 update interrupt) are
+ * stopped, LPTIM1 is set to interrupt when the next task unblocks, and the
+ * core waits in WFI. That is CSleep: only the CPU clock stops, the buses,
+ * the MAC and its DMA keep running, so frames land in the RX descriptors
+ * and the RX interrupt wakes the core as it would any idle loop. Stop mode
+ * would halt the ETH DMA and is not used.
+ *
+ * The lwIP timers bound the sleep without any hook here: the tcpip thread
+ * blocks on its mailbox for sys_timeouts_sleeptime() ticks, and that is
+ * the timeout the kernel hands to tickless_sleep() when nothing else is
+ * due sooner.
+ *
+ * LPTIM1 counts PCLK1 / 128. PCLK1 is SYSCLK / 4 in every clock profile, so
+ * one count is exactly 512 CPU cycles and the sleep is measured without
+ * drift; the 16-bit counter caps one sleep at about 70 ms at 480 MHz
+ * (longer idles sleep again). On waking the cycle counter (DWT CYCCNT),
+ * which stops with the CPU clock, is moved on by the cycles slept: time_ns,
+ * the run-time stats (the idle task is charged the sleep) and the loads
+ * clock_dvfs.h works from stay continuous. The RTOS tick count and the HAL
+ * tick are stepped by the whole ticks that passed.
+ *
+ * Wake-to-packet latency: when the ETH interrupt is what ended a sleep, the
+ * time from the wake to the EthIf task reading the frames goes into a
+ * histogram. Exported through metrics as "idle.*".
+ */
+
+#pragma once
+
+#ifndef TICKLESS_H
+#define TICKLESS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Also read by FreeRTOSConfig.h, keep the defaults in step */
+#ifndef TICKLESS_IDLE
+#define TICKLESS_IDLE 1
+#endif
+
+/* LPTIM1 counts left between the last one slept and the counter wrap */
+#ifndef TICKLESS_LPTIM_MARGIN
+#define TICKLESS_LPTIM_MARGIN 256U
+#endif
+
+/* Below this many LPTIM1 counts (about 0.5 ms) the idle task just loops */
+#ifndef TICKLESS_MIN_COUNTS
+#define TICKLESS_MIN_COUNTS 500U
+#endif
+
+/* LPTIM1 interrupt priority; any level wakes WFI */
+#ifndef TICKLESS_IRQ_PRIO
+#define TICKLESS_IRQ_PRIO 15U
+#endif
+
+typedef struct {
+    uint32_t sleeps;
+    uint32_t aborted;       /* something became ready, or a tick was pending */
+    uint32_t timer_wakes;   /* LPTIM1 compare: slept the whole timeout */
+    uint32_t rx_wakes;      /* ETH interrupt */
+    uint32_t other_wakes;
+    uint64_t slept_us;
+    uint32_t rx_lat_p50_ns; /* wake to EthIf, since the last reset */
+    uint32_t rx_lat_p99_ns;
+    uint32_t rx_lat_max_ns;
+} TicklessStats_t;
+
+#if TICKLESS_IDLE
+/* Sets up LPTIM1 and registers the metrics; the idle task sleeps from
+ * then on. Once from a task, after metrics_init(). */
+void tickless_start(void);
+
+/* portSUPPRESS_TICKS_AND_SLEEP(), idle task with the scheduler suspended */
+void tickless_sleep(uint32_t expected_ticks);
+
+/* EthIf task, after an RX wakeup: closes a pending wake-to-packet sample */
+void tickless_rx_mark(void);
+
+void tickless_get_stats(TicklessStats_t* stats);
+void tickless_reset_latency(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TICKLESS_H */
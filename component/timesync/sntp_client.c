@@ -0,0 +1,214 @@
+/**
+ * @file sntp_client.c
+ * @brief Unicast SNTP client over the raw UDP API.
+ */
+
+#include "sntp_client.h"
+#include "timesync.h"
+#include "time_ns.h"
+
+#include "lwip/opt.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+#include "lwip/udp.h"
+#include "lwip/pbuf.h"
+#include "lwip/prot/iana.h"
+#include "logger/syslog.h"
+#include "resolv/resolv.h"
+
+#include <string.h>
+
+#define SNTP_TAG "SNTP"
+
+#define SNTP_MSG_LEN            48U
+#define SNTP_OFS_FLAGS          0U
+#define SNTP_OFS_STRATUM        1U
+#define SNTP_OFS_ORIGINATE      24U
+#define SNTP_OFS_RECEIVE        32U
+#define SNTP_OFS_TRANSMIT       40U
+
+#define SNTP_LI_MASK            0xC0U
+#define SNTP_LI_ALARM           0xC0U
+#define SNTP_MODE_MASK          0x07U
+#define SNTP_MODE_CLIENT        0x03U
+#define SNTP_MODE_SERVER        0x04U
+#define SNTP_VERSION            (4U << 3)
+
+/* 1900-01-01 to 1970-01-01 */
+#define SNTP_UNIX_OFFSET        2208988800ULL
+#define SNTP_ERA_S              (1ULL << 32)
+#define SNTP_NS_PER_S           1000000000ULL
+
+typedef enum {
+    SNTP_IDLE,
+    SNTP_WAITING,
+} SntpState_t;
+
+typedef struct {
+    int servers[SNTP_CLIENT_SERVERS];   /* resolv.h ids */
+    struct udp_pcb* pcb;
+    ip_addr_t addr;
+    SntpState_t state;
+    uint8_t sent_ts[8];         /* transmit timestamp of the request */
+    uint64_t t1;
+    SntpClientStats_t stats;
+} SntpClient_t;
+
+/* tcpip thread */
+static SntpClient_t sntp;
+
+static void sntp_client_poll(void* arg);
+
+/* Nanoseconds since 1970 to NTP: seconds of the era, 32-bit fraction */
+static void sntp_put_ts(uint8_t* p, uint64_t ns)
+{
+    uint32_t sec = (uint32_t)(ns / SNTP_NS_PER_S + SNTP_UNIX_OFFSET);
+    uint32_t frac = (uint32_t)(((ns % SNTP_NS_PER_S) << 32) / SNTP_NS_PER_S);
+
+    p[0] = (uint8_t)(sec >> 24);
+    p[1] = (uint8_t)(sec >> 16);
+    p[2] = (uint8_t)(sec >> 8);
+    p[3] = (uint8_t)sec;
+    p[4] = (uint8_t)(frac >> 24);
+    p[5] = (uint8_t)(frac >> 16);
+    p[6] = (uint8_t)(frac >> 8);
+    p[7] = (uint8_t)frac;
+}
+
+/* Era 0 ends in 2036: seconds below 1968 (bit 31 clear) are era 1, as in
+ * RFC 4330 section 3. Fraction rounded to the nearest nanosecond. */
+static uint64_t sntp_get_ts(const uint8_t* p)
+{
+    uint64_t sec = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    uint64_t frac = ((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 8) | p[7];
+
+    if ((sec & 0x80000000ULL) == 0U) {
+        sec += SNTP_ERA_S;
+    }
+    return (sec - SNTP_UNIX_OFFSET) * SNTP_NS_PER_S + ((frac * SNTP_NS_PER_S + (1ULL << 31)) >> 32);
+}
+
+static void sntp_client_schedule(uint32_t s)
+{
+    sntp.state = SNTP_IDLE;
+    sys_untimeout(sntp_client_poll, NULL);
+    sys_timeout(s * 1000U, sntp_client_poll, NULL);
+}
+
+/* Give up on the current server, the other one is tried after the retry
+ * period */
+static void sntp_client_next(void)
+{
+    if (sntp.servers[1] >= 0) {
+        sntp.stats.server ^= 1U;
+    }
+    sntp_client_schedule(SNTP_CLIENT_RETRY_S);
+}
+
+static void sntp_client_timeout(void* arg)
+{
+    (void)arg;
+    sntp.stats.timeouts++;
+    sntp_client_next();
+}
+
+static void sntp_client_send(void)
+{
+    struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, SNTP_MSG_LEN, PBUF_RAM);
+    uint8_t* msg;
+
+    if (p == NULL) {
+        sntp_client_schedule(SNTP_CLIENT_RETRY_S);
+        return;
+    }
+    msg = (uint8_t*)p->payload;
+    memset(msg, 0, SNTP_MSG_LEN);
+    msg[SNTP_OFS_FLAGS] = SNTP_VERSION | SNTP_MODE_CLIENT;
+    sntp.t1 = time_utc_ns();
+    sntp_put_ts(&msg[SNTP_OFS_TRANSMIT], sntp.t1);
+    memcpy(sntp.sent_ts, &msg[SNTP_OFS_TRANSMIT], sizeof(sntp.sent_ts));
+
+    if (udp_sendto(sntp.pcb, p, &sntp.addr, LWIP_IANA_PORT_SNTP) != ERR_OK) {
+        pbuf_free(p);
+        sntp_client_schedule(SNTP_CLIENT_RETRY_S);
+        return;
+    }
+    pbuf_free(p);
+    sntp.stats.requests++;
+    sntp.state = SNTP_WAITING;
+    sys_timeout(SNTP_CLIENT_TIMEOUT_MS, sntp_client_timeout, NULL);
+}
+
+static void sntp_client_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    uint64_t t4 = time_utc_ns();
+    uint8_t msg[SNTP_MSG_LEN];
+
+    (void)arg;
+    (void)pcb;
+    if (sntp.state != SNTP_WAITING || port != LWIP_IANA_PORT_SNTP || !ip_addr_cmp(addr, &sntp.addr) ||
+        pbuf_copy_partial(p, msg, SNTP_MSG_LEN, 0) != SNTP_MSG_LEN ||
+        (msg[SNTP_OFS_FLAGS] & SNTP_MODE_MASK) != SNTP_MODE_SERVER ||
+        memcmp(&msg[SNTP_OFS_ORIGINATE], sntp.sent_ts, sizeof(sntp.sent_ts)) != 0) {
+        sntp.stats.bad++;
+        pbuf_free(p);
+        return;
+    }
+    pbuf_free(p);
+    sys_untimeout(sntp_client_timeout, NULL);
+
+    /* Stratum 0 is a kiss-o'-death, LI 3 a server that is not synced */
+    if (msg[SNTP_OFS_STRATUM] == 0U || msg[SNTP_OFS_STRATUM] > 15U ||
+        (msg[SNTP_OFS_FLAGS] & SNTP_LI_MASK) == SNTP_LI_ALARM) {
+        sntp.stats.kod++;
+        sntp_client_next();
+        return;
+    }
+
+    timesync_sample(sntp.t1, sntp_get_ts(&msg[SNTP_OFS_RECEIVE]), sntp_get_ts(&msg[SNTP_OFS_TRANSMIT]), t4);
+    sntp.stats.replies++;
+    sntp_client_schedule(timesync_synced() ? SNTP_CLIENT_POLL_S : SNTP_CLIENT_RETRY_S);
+}
+
+static void sntp_client_poll(void* arg)
+{
+    (void)arg;
+    sys_untimeout(sntp_client_timeout, NULL);
+    if (resolv_get(sntp.servers[sntp.stats.server], &sntp.addr)) {
+        sntp_client_send();
+        return;
+    }
+    sntp.stats.dns_fail++;
+    sntp_client_next();
+}
+
+bool sntp_client_start(const char* server1, const char* server2)
+{
+    int id1 = resolv_add(server1);
+    int id2 = resolv_add(server2);
+    bool ok = false;
+
+    LOCK_TCPIP_CORE();
+    if (sntp.pcb == NULL && id1 >= 0) {
+        sntp.servers[0] = id1;
+        sntp.servers[1] = id2;
+        sntp.pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+        if (sntp.pcb != NULL) {
+            udp_recv(sntp.pcb, sntp_client_recv, NULL);
+            timesync_init();
+            /* One resolv poll to answer the names */
+            sys_timeout(RESOLV_POLL_MS, sntp_client_poll, NULL);
+            ok = true;
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+    if (!ok) {
+        LOG_ERROR(SNTP_TAG, "not started");
+    }
+    return ok;
+}
+
+void sntp_client_get_stats(SntpClientStats_t* stats)
+{
+    *stats = sntp.stats;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file sntp_client.h
+ * @brief Unicast SNTP (RFC 4330) client feeding timesync_sample().
+ *
+ * One request per poll to the current server, by name (resolv.h keeps it
+ * resolved, a poll never waits on DNS) or as a literal address. A
+ * timeout, a name not resolved yet, a kiss-o'-death or an unsynchronised
+ * reply moves on to the other server. The transmit timestamp of the
+ * request is checked against the originate timestamp of the reply, the
+ * four timestamps keep their fraction to the nanosecond.
+ *
+ * Everything runs on the tcpip thread; one UDP PCB, one sys_timeout.
+ */
+
+#pragma once
+
+#ifndef SNTP_CLIENT_H
+#define SNTP_CLIENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Poll period once synced */
+#ifndef SNTP_CLIENT_POLL_S
+#define SNTP_CLIENT_POLL_S 64U
+#endif
+
+/* Poll period until synced, and after a failure */
+#ifndef SNTP_CLIENT_RETRY_S
+#define SNTP_CLIENT_RETRY_S 8U
+#endif
+
+/* Reply wait */
+#ifndef SNTP_CLIENT_TIMEOUT_MS
+#define SNTP_CLIENT_TIMEOUT_MS 3000U
+#endif
+
+#define SNTP_CLIENT_SERVERS 2U
+
+typedef struct {
+    uint32_t requests;
+    uint32_t replies;       /* accepted, passed to timesync_sample() */
+    uint32_t timeouts;
+    uint32_t dns_fail;      /* polls before the name resolved */
+    uint32_t bad;           /* wrong mode, originate, source or size */
+    uint32_t kod;           /* kiss-o'-death or unsynchronised server */
+    uint8_t server;         /* index in use */
+} SntpClientStats_t;
+
+/* Names or literal addresses; server2 may be NULL. The strings must stay
+ * valid. Starts timesync too. Takes the core lock. */
+bool sntp_client_start(const char* server1, const char* server2);
+
+void sntp_client_get_stats(SntpClientStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SNTP_CLIENT_H */
@@ -0,0 +1,160 @@
+/**
+ * @file time_ns.c
+ * @brief Lock-free nanosecond clocks, see time_ns.h.
+ *
+ * Both clocks are a pair of slots and a generation count with one writer:
+ * the writer fills the slot the count does not point at, then advances
+ * the count. A reader copies the slot the count points at and checks that
+ * the count has not moved; a writer running in between can only have
+ * filled the other slot, but the copy is taken again to keep the check
+ * simple. The monotonic slot carries the sub-nanosecond remainder, so
+ * anchors never accumulate rounding and a read between two ticks lies on
+ * the same line as the next anchor.
+ */
+
+#include "time_ns.h"
+
+#include "main.h"
+
+/* ns per cycle in 2^-24 units: 400 MHz is exactly 2.5 << 24 */
+#define TIME_NS_FRAC_BITS 24U
+#define TIME_NS_FRAC_MASK ((1UL << TIME_NS_FRAC_BITS) - 1U)
+
+typedef struct {
+    uint32_t cyc;
+    uint32_t frac;          /* ns below the unit, 2^-24 */
+    uint64_t ns;
+    uint64_t mult;          /* ns per cycle, 2^-24, from here on */
+} TimeNsAnchor_t;
+
+typedef struct {
+    uint32_t ready;         /* time_ns_init() done */
+    uint32_t gen;
+    TimeNsAnchor_t anchor[2];
+    uint32_t seg_gen;
+    TimeNsSegment_t seg[2];
+} TimeNs_t;
+
+static TimeNs_t tn;
+
+void time_ns_init(void)
+{
+    TimeNsAnchor_t* a = &tn.anchor[0];
+
+    a->cyc = TIME_NS_CYCLES();
+    a->frac = 0U;
+    a->ns = (uint64_t)HAL_GetTick() * 1000000U;
+    a->mult = ((uint64_t)1000000000U << TIME_NS_FRAC_BITS) / TIME_NS_CYCLES_HZ;
+    tn.gen = 0U;
+    __atomic_store_n(&tn.ready, 1U, __ATOMIC_RELEASE);
+}
+
+/* Publishes an anchor at the current cycle count, the cycles since the
+ * previous one counted at its rate, the ones after at hz */
+static void time_ns_anchor(uint32_t hz)
+{
+    uint32_t g = tn.gen;
+    const TimeNsAnchor_t* cur = &tn.anchor[g & 1U];
+    TimeNsAnchor_t* next = &tn.anchor[(g + 1U) & 1U];
+    uint32_t cyc = TIME_NS_CYCLES();
+    uint64_t acc = (uint64_t)(cyc - cur->cyc) * cur->mult + cur->frac;
+
+    next->cyc = cyc;
+    next->frac = (uint32_t)(acc & TIME_NS_FRAC_MASK);
+    next->ns = cur->ns + (acc >> TIME_NS_FRAC_BITS);
+    next->mult = (hz != 0U) ? ((uint64_t)1000000000U << TIME_NS_FRAC_BITS) / hz : cur->mult;
+    __atomic_store_n(&tn.gen, g + 1U, __ATOMIC_RELEASE);
+}
+
+void time_ns_tick(void)
+{
+    if (__atomic_load_n(&tn.ready, __ATOMIC_ACQUIRE) == 0U) {
+        return;
+    }
+    time_ns_anchor(0U);
+}
+
+void time_ns_set_hz(uint32_t hz)
+{
+    if (__atomic_load_n(&tn.ready, __ATOMIC_ACQUIRE) == 0U) {
+        return;
+    }
+    time_ns_anchor(hz);
+}
+
+uint64_t time_now_ns(void)
+{
+    TimeNsAnchor_t a;
+    uint32_t cyc;
+    uint32_t g;
+
+    if (__atomic_load_n(&tn.ready, __ATOMIC_ACQUIRE) == 0U) {
+        return (uint64_t)HAL_GetTick() * 1000000U;
+    }
+    do {
+        g = __atomic_load_n(&tn.gen, __ATOMIC_ACQUIRE);
+        a = tn.anchor[g & 1U];
+        cyc = TIME_NS_CYCLES();
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&tn.gen, __ATOMIC_RELAXED) != g);
+
+    return a.ns + (((uint64_t)(cyc - a.cyc) * a.mult + a.frac) >> TIME_NS_FRAC_BITS);
+}
+
+uint64_t time_ns_at_cycles(uint32_t cyc)
+{
+    TimeNsAnchor_t a;
+    uint32_t g;
+    int64_t acc;
+
+    if (__atomic_load_n(&tn.ready, __ATOMIC_ACQUIRE) == 0U) {
+        return (uint64_t)HAL_GetTick() * 1000000U;
+    }
+    do {
+        g = __atomic_load_n(&tn.gen, __ATOMIC_ACQUIRE);
+        a = tn.anchor[g & 1U];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&tn.gen, __ATOMIC_RELAXED) != g);
+
+    /* Usually before the anchor: the tick moved it on since the stamp */
+    acc = (int64_t)(int32_t)(cyc - a.cyc) * (int64_t)a.mult + a.frac;
+    return a.ns + (uint64_t)(acc >> TIME_NS_FRAC_BITS);
+}
+
+uint64_t time_ns_segment_at(const TimeNsSegment_t* seg, uint64_t mono)
+{
+    int64_t dt = (int64_t)(mono - seg->mono_ns);
+    int64_t s = (dt * seg->slew) >> 32;
+
+    if ((seg->slew_ns >= 0 && s > seg->slew_ns) || (seg->slew_ns < 0 && s < seg->slew_ns)) {
+        s = seg->slew_ns;
+    }
+    return seg->utc_ns + (uint64_t)(dt + ((dt * seg->freq) >> 32) + s);
+}
+
+uint64_t time_utc_ns_at(uint64_t mono)
+{
+    TimeNsSegment_t seg;
+    uint32_t g;
+
+    do {
+        g = __atomic_load_n(&tn.seg_gen, __ATOMIC_ACQUIRE);
+        seg = tn.seg[g & 1U];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&tn.seg_gen, __ATOMIC_RELAXED) != g);
+
+    return time_ns_segment_at(&seg, mono);
+}
+
+uint64_t time_utc_ns(void)
+{
+    return time_utc_ns_at(time_now_ns());
+}
+
+void time_ns_set_segment(const TimeNsSegment_t* seg)
+{
+    uint32_t g = tn.seg_gen;
+
+    tn.seg[(g + 1U) & 1U] = *seg;
+    __atomic_store_n(&tn.seg_gen, g + 1U, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,85 @@
+/**
+ * @file time_ns.h
+ * @brief Lock-free nanosecond clocks: monotonic since boot and UTC.
+ *
+ * time_now_ns() is DWT CYCCNT anchored at every 1 ms HAL tick: the TIM6
+ * interrupt calls time_ns_tick(), which extends the counter to a 64-bit
+ * nanosecond value and publishes (cycles, ns) in one of two slots. A read
+ * takes the current slot and the cycles since, so the CYCCNT wrap (10.7 s
+ * at 400 MHz) never shows. No critical section: a generation count tells
+ * a reader that was preempted across a tick to read again, and a reader
+ * that preempts the tick (a higher priority interrupt) finds the previous
+ * slot intact. Readable from any context.
+ *
+ * time_utc_ns() maps the monotonic clock to UTC with the segment timesync
+ * publishes (timesync.h): a base, a frequency correction and a capped
+ * slew, double buffered the same way. Before the first SNTP sample it is
+ * the monotonic clock, see timesync_synced().
+ *
+ * Resolution is one CPU cycle (2.5 ns at 400 MHz); a read costs two
+ * 64-bit multiplies and no division.
+ */
+
+#pragma once
+
+#ifndef TIME_NS_H
+#define TIME_NS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Cycle counter and its rate */
+#ifndef TIME_NS_CYCLES
+#define TIME_NS_CYCLES() (DWT->CYCCNT)
+#define TIME_NS_CYCLES_HZ SystemCoreClock
+#endif
+
+/* Monotonic to UTC: utc = utc_ns + dt + dt * freq + min(dt * slew, slew_ns)
+ * with dt = mono - mono_ns, rates in units of 2^-32, slew_ns signed like
+ * slew. */
+typedef struct {
+    uint64_t mono_ns;
+    uint64_t utc_ns;
+    int32_t freq;
+    int32_t slew;
+    int64_t slew_ns;
+} TimeNsSegment_t;
+
+/* From the task that starts after the scheduler (which resets CYCCNT).
+ * Until then time_now_ns() counts HAL ticks. */
+void time_ns_init(void);
+
+/* From the 1 ms tick interrupt, the only writer of the monotonic slots */
+void time_ns_tick(void);
+
+/* The cycle counter runs at hz from now on: right after a core clock
+ * switch, with the tick interrupt masked so that it stays the only writer
+ * (clock/clock_dvfs.h) */
+void time_ns_set_hz(uint32_t hz);
+
+uint64_t time_now_ns(void);
+
+/* time_now_ns() at an earlier TIME_NS_CYCLES() reading, at most 2^31
+ * cycles ago (5.3 s at 400 MHz): stamps taken in an interrupt or driver
+ * and converted later. Before time_ns_init() the current time. */
+uint64_t time_ns_at_cycles(uint32_t cyc);
+
+uint64_t time_utc_ns(void);
+
+/* UTC of an earlier time_now_ns() reading, under the current segment */
+uint64_t time_utc_ns_at(uint64_t mono);
+
+/* Writer of the UTC segment (timesync, one thread) */
+void time_ns_set_segment(const TimeNsSegment_t* seg);
+
+/* UTC of mono under seg */
+uint64_t time_ns_segment_at(const TimeNsSegment_t* seg, uint64_t mono);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIME_NS_H */
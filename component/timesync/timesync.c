@@ -0,0 +1,405 @@
+/**
+ * @file timesync.c
+ * @brief Slewed UTC and RTC discipline.
+ *
+ * UTC is piecewise linear in the monotonic clock of time_ns.h. Each
+ * segment starts at (mono_ns, utc_ns) and runs at 1 + freq + slew, rates
+ * in units of 2^-32. The slew part is capped at the offset still to be
+ * removed, so it stops by itself between ticks. Every tick starts a new
+ * segment at the current value and publishes it to the readers: UTC is
+ * continuous across segments and its rate stays above 1 - 1000 ppm, so it
+ * cannot go backwards unless an offset beyond TIMESYNC_STEP_US steps it.
+ */
+
+#include "timesync.h"
+#include "time_ns.h"
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "lwip/timeouts.h"
+#include "logger/syslog.h"
+
+#include <stdlib.h>
+
+#define TIMESYNC_TAG "TIME"
+
+#define TIMESYNC_US_PER_S 1000000LL
+#define TIMESYNC_NS_PER_US 1000LL
+#define TIMESYNC_PPM_TO_RATE(ppm) ((int32_t)(((int64_t)(ppm) << 32) / 1000000))
+#define TIMESYNC_PPB_TO_RATE(ppb) ((int32_t)(((int64_t)(ppb) << 32) / 1000000000))
+
+/* Shorter sample intervals do not resolve the frequency */
+#define TIMESYNC_FREQ_MIN_INTERVAL_NS (16LL * TIMESYNC_US_PER_S * TIMESYNC_NS_PER_US)
+
+typedef struct {
+    TimeNsSegment_t seg;        /* as published */
+    uint64_t last_sample;       /* monotonic time of the last accepted sample */
+    TimesyncStats_t stats;
+} TimesyncState_t;
+
+/* tcpip thread */
+static TimesyncState_t ts;
+
+#if TIMESYNC_RTC
+extern RTC_HandleTypeDef hrtc;
+
+typedef struct {
+    bool valid;                 /* set by us, in this boot or before the reset */
+    bool ref_valid;             /* trim reference taken */
+    int64_t ref_err_us;
+    uint64_t ref_mono;
+    int64_t i_ppb;              /* integral of the calibration loop */
+    uint32_t countdown;         /* ticks to the next check */
+} TimesyncRtc_t;
+
+static TimesyncRtc_t rtc;
+#endif
+
+int32_t timesync_days_from_civil(int32_t y, uint32_t m, uint32_t d)
+{
+    y -= (m <= 2U) ? 1 : 0;
+    int32_t era = (y >= 0 ? y : y - 399) / 400;
+    uint32_t yoe = (uint32_t)(y - era * 400);
+    uint32_t doy = (153U * (m > 2U ? m - 3U : m + 9U) + 2U) / 5U + d - 1U;
+    uint32_t doe = yoe * 365U + yoe / 4U - yoe / 100U + doy;
+
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+void timesync_civil_from_days(int32_t days, int32_t* y, uint32_t* m, uint32_t* d)
+{
+    days += 719468;
+    int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+    uint32_t doe = (uint32_t)(days - era * 146097);
+    uint32_t yoe = (doe - doe / 1460U + doe / 36524U - doe / 146096U) / 365U;
+    uint32_t doy = doe - (365U * yoe + yoe / 4U - yoe / 100U);
+    uint32_t mp = (5U * doy + 2U) / 153U;
+
+    *d = doy - (153U * mp + 2U) / 5U + 1U;
+    *m = mp < 10U ? mp + 3U : mp - 9U;
+    *y = (int32_t)yoe + era * 400 + (*m <= 2U ? 1 : 0);
+}
+
+/* New segment at mono with the same UTC value, and the slew it has
+ * removed so far taken off the remainder */
+static void timesync_rebase(uint64_t mono)
+{
+    int64_t dt = (int64_t)(mono - ts.seg.mono_ns);
+    uint64_t utc = time_ns_segment_at(&ts.seg, mono);
+
+    ts.seg.slew_ns -= (int64_t)(utc - ts.seg.utc_ns) - dt - ((dt * ts.seg.freq) >> 32);
+    ts.seg.mono_ns = mono;
+    ts.seg.utc_ns = utc;
+    if (ts.seg.slew_ns == 0) {
+        ts.seg.slew = 0;
+    }
+}
+
+bool timesync_synced(void)
+{
+    return ts.stats.synced;
+}
+
+#if TIMESYNC_RTC
+/* RTC time in microseconds since 1970, fraction from SSR, which counts
+ * down from PREDIV_S (and is briefly above it after a shift) */
+static bool timesync_rtc_read(int64_t* rtc_us, int64_t* utc_us)
+{
+    RTC_TimeTypeDef t = {0};
+    RTC_DateTypeDef d = {0};
+    bool ok;
+
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    ok = HAL_RTC_GetTime(&hrtc, &t, RTC_FORMAT_BIN) == HAL_OK && HAL_RTC_GetDate(&hrtc, &d, RTC_FORMAT_BIN) == HAL_OK;
+    *utc_us = (int64_t)(time_utc_ns() / TIMESYNC_NS_PER_US);
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+    if (!ok) {
+        return false;
+    }
+
+    int64_t sec = (int64_t)timesync_days_from_civil(2000 + (int32_t)d.Year, d.Month, d.Date) * 86400 +
+                  (int64_t)t.Hours * 3600 + (int64_t)t.Minutes * 60 + t.Seconds;
+    int64_t frac = ((int64_t)t.SecondFraction - (int64_t)t.SubSeconds) * TIMESYNC_US_PER_S /
+                   ((int64_t)t.SecondFraction + 1);
+
+    *rtc_us = sec * TIMESYNC_US_PER_S + frac;
+    return true;
+}
+
+/* Sets the RTC to the current UTC: date and time of the current second,
+ * which restarts the prescaler, then a shift by the part of the second
+ * that had passed (ADD1S, minus the rest in SSR units). Setting across a
+ * second boundary leaves the RTC a second behind, the next check steps it
+ * again. */
+static bool timesync_rtc_set(void)
+{
+    RTC_TimeTypeDef t = {0};
+    RTC_DateTypeDef d = {0};
+    uint64_t sec = time_utc_ns() / (uint64_t)(TIMESYNC_US_PER_S * TIMESYNC_NS_PER_US);
+    int32_t days = (int32_t)(sec / 86400U);
+    uint32_t sod = (uint32_t)(sec % 86400U);
+    int32_t y;
+    uint32_t m;
+    uint32_t day;
+
+    timesync_civil_from_days(days, &y, &m, &day);
+    if (y < 2000 || y > 2099) {
+        return false;
+    }
+    d.Year = (uint8_t)(y - 2000);
+    d.Month = (uint8_t)m;
+    d.Date = (uint8_t)day;
+    d.WeekDay = (uint8_t)(((days + 3) % 7) + 1); /* 1970-01-01 was a Thursday, RTC Monday is 1 */
+    t.Hours = (uint8_t)(sod / 3600U);
+    t.Minutes = (uint8_t)((sod / 60U) % 60U);
+    t.Seconds = (uint8_t)(sod % 60U);
+    t.DayLightSaving = RTC_DAYLIGHTSAVING_NONE;
+    t.StoreOperation = RTC_STOREOPERATION_RESET;
+    if (HAL_RTC_SetDate(&hrtc, &d, RTC_FORMAT_BIN) != HAL_OK || HAL_RTC_SetTime(&hrtc, &t, RTC_FORMAT_BIN) != HAL_OK) {
+        return false;
+    }
+
+    int64_t late = (int64_t)(time_utc_ns() / TIMESYNC_NS_PER_US) - (int64_t)sec * TIMESYNC_US_PER_S;
+    uint32_t prediv_s = hrtc.Init.SynchPrediv + 1U;
+
+    if (late > 0 && late < TIMESYNC_US_PER_S) {
+        uint32_t subfs = (uint32_t)(((TIMESYNC_US_PER_S - late) * prediv_s) / TIMESYNC_US_PER_S);
+        if (subfs < prediv_s && HAL_RTCEx_SetSynchroShift(&hrtc, RTC_SHIFTADD1S_SET, subfs) != HAL_OK) {
+            return false;
+        }
+    }
+    HAL_RTCEx_BKUPWrite(&hrtc, TIMESYNC_RTC_BKUP_REG_MAGIC, TIMESYNC_RTC_BKUP_MAGIC);
+    rtc.valid = true;
+    rtc.ref_valid = false;
+    ts.stats.rtc_steps++;
+    return true;
+}
+
+/* Smooth calibration for a rate change in ppb (positive: faster). One
+ * CALM pulse masked per 2^20 RTCCLK cycles is -0.954 ppm, CALP adds 512. */
+static void timesync_rtc_calibrate(int64_t ppb)
+{
+    int32_t pulses = (int32_t)((ppb * (1 << 20)) / 1000000000);
+    uint32_t plus = RTC_SMOOTHCALIB_PLUSPULSES_RESET;
+    uint32_t minus;
+
+    if (pulses > 512) {
+        pulses = 512;
+    } else if (pulses < -511) {
+        pulses = -511;
+    }
+    if (pulses > 0) {
+        plus = RTC_SMOOTHCALIB_PLUSPULSES_SET;
+        minus = (uint32_t)(512 - pulses);
+    } else {
+        minus = (uint32_t)-pulses;
+    }
+    if (HAL_RTCEx_SetSmoothCalib(&hrtc, RTC_SMOOTHCALIB_PERIOD_32SEC, plus, minus) == HAL_OK) {
+        ts.stats.rtc_cal_ppm = (int32_t)(((int64_t)pulses * 1000000) >> 20);
+    }
+}
+
+/* The LSI is 32 kHz nominal, not the 32.768 kHz the CubeMX prescaler
+ * (128 x 256) assumes, and varies by part. PREDIV_A = 4 leaves the
+ * synchronous prescaler a 125 ppm step (and SSR 31 us resolution), which
+ * smooth calibration covers. */
+static void timesync_rtc_trim(int64_t rate_ppb)
+{
+    uint64_t f = (uint64_t)(hrtc.Init.AsynchPrediv + 1U) * (hrtc.Init.SynchPrediv + 1U);
+
+    f = (uint64_t)((int64_t)f + ((int64_t)f * rate_ppb) / 1000000000);
+    hrtc.Init.AsynchPrediv = 3U;
+    hrtc.Init.SynchPrediv = (uint32_t)((f + 2U) / 4U) - 1U;
+    if (HAL_RTC_Init(&hrtc) != HAL_OK) {
+        LOG_ERROR(TIMESYNC_TAG, "RTC prescaler trim failed");
+        return;
+    }
+    HAL_RTCEx_BKUPWrite(&hrtc, TIMESYNC_RTC_BKUP_REG_PREDIV,
+                        (hrtc.Init.AsynchPrediv << 16) | hrtc.Init.SynchPrediv);
+    ts.stats.rtc_trimmed = true;
+    LOG_INFO(TIMESYNC_TAG, "RTC clock %lu Hz, prescaler 4 x %lu", (unsigned long)f,
+             (unsigned long)(hrtc.Init.SynchPrediv + 1U));
+}
+
+/* Every TIMESYNC_RTC_CHECK_S once synced */
+static void timesync_rtc_check(void)
+{
+    int64_t rtc_us;
+    int64_t utc_us;
+
+    if (!timesync_rtc_read(&rtc_us, &utc_us)) {
+        return;
+    }
+    int64_t err = rtc_us - utc_us;
+    ts.stats.rtc_err_us = (int32_t)err;
+
+    if (!rtc.valid || llabs(err) > TIMESYNC_RTC_STEP_US) {
+        if (!ts.stats.rtc_trimmed) {
+            timesync_rtc_calibrate(0);
+        }
+        if (!timesync_rtc_set()) {
+            LOG_ERROR(TIMESYNC_TAG, "RTC set failed");
+        }
+        return;
+    }
+    if (!ts.stats.rtc_trimmed) {
+        uint64_t mono = time_now_ns() / TIMESYNC_NS_PER_US;
+        if (!rtc.ref_valid) {
+            rtc.ref_valid = true;
+            rtc.ref_err_us = err;
+            rtc.ref_mono = mono;
+            return;
+        }
+        if (mono - rtc.ref_mono < (uint64_t)TIMESYNC_RTC_TRIM_S * (uint64_t)TIMESYNC_US_PER_S) {
+            return;
+        }
+        int64_t rate_ppb = (err - rtc.ref_err_us) * 1000000000 / (int64_t)(mono - rtc.ref_mono);
+        if (llabs(rate_ppb) > 200000) {
+            timesync_rtc_trim(rate_ppb);
+            (void)timesync_rtc_set();
+        } else {
+            ts.stats.rtc_trimmed = true;
+            HAL_RTCEx_BKUPWrite(&hrtc, TIMESYNC_RTC_BKUP_REG_PREDIV,
+                                (hrtc.Init.AsynchPrediv << 16) | hrtc.Init.SynchPrediv);
+        }
+        return;
+    }
+
+    /* PI loop on the error: the proportional part removes it over about
+     * TIMESYNC_RTC_SLEW_S, the integral learns the LSI offset. Errors
+     * within one SSR step are noise. */
+    int64_t p_ppb = 0;
+    if (llabs(err) > TIMESYNC_US_PER_S / ((int64_t)hrtc.Init.SynchPrediv + 1)) {
+        p_ppb = -err * 1000 / TIMESYNC_RTC_SLEW_S;
+    }
+    rtc.i_ppb += p_ppb / 8;
+    if (rtc.i_ppb > 480000) {
+        rtc.i_ppb = 480000;
+    } else if (rtc.i_ppb < -480000) {
+        rtc.i_ppb = -480000;
+    }
+    timesync_rtc_calibrate(rtc.i_ppb + p_ppb);
+}
+
+bool timesync_rtc_restore(RTC_HandleTypeDef* h)
+{
+    uint32_t prediv;
+
+    if (HAL_RTCEx_BKUPRead(h, TIMESYNC_RTC_BKUP_REG_MAGIC) != TIMESYNC_RTC_BKUP_MAGIC) {
+        return false;
+    }
+    prediv = HAL_RTCEx_BKUPRead(h, TIMESYNC_RTC_BKUP_REG_PREDIV);
+    if (prediv != 0U && prediv != ((h->Init.AsynchPrediv << 16) | h->Init.SynchPrediv)) {
+        h->Init.AsynchPrediv = prediv >> 16;
+        h->Init.SynchPrediv = prediv & 0xFFFFU;
+        if (HAL_RTC_Init(h) != HAL_OK) {
+            return false;
+        }
+    }
+    /* The smooth calibration survives in CALR */
+    rtc.valid = true;
+    ts.stats.rtc_trimmed = prediv != 0U;
+    return true;
+}
+
+bool timesync_rtc_seconds(uint32_t* sec)
+{
+    int64_t rtc_us, utc_us;
+
+    if (!rtc.valid || !timesync_rtc_read(&rtc_us, &utc_us)) {
+        return false;
+    }
+    *sec = (uint32_t)(rtc_us / TIMESYNC_US_PER_S);
+    return true;
+}
+#endif
+
+void timesync_sample(uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4)
+{
+    int64_t offset = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2;
+    int64_t delay = (int64_t)(t4 - t1) - (int64_t)(t3 - t2);
+    int64_t offset_us = offset / TIMESYNC_NS_PER_US;
+    bool step = false;
+
+    if (ts.stats.synced && (delay < 0 || delay > TIMESYNC_DELAY_MAX_US * TIMESYNC_NS_PER_US)) {
+        ts.stats.rejected++;
+        return;
+    }
+
+    uint64_t mono = time_now_ns();
+    timesync_rebase(mono);
+    if (!ts.stats.synced || llabs(offset_us) > TIMESYNC_STEP_US) {
+        ts.seg.utc_ns += (uint64_t)offset;
+        ts.seg.slew_ns = 0;
+        ts.seg.slew = 0;
+        ts.stats.synced = true;
+        step = true;
+    } else {
+        /* What the last slew did not remove was still pending; the rest
+         * of the offset built up at the frequency error. A drift no
+         * oscillator has is a jump of the server's time, a phase error. */
+        int64_t interval = (int64_t)(mono - ts.last_sample);
+        int64_t drift_ppb = 0;
+        if (ts.last_sample != 0U && interval >= TIMESYNC_FREQ_MIN_INTERVAL_NS) {
+            drift_ppb = (offset - ts.seg.slew_ns) * 1000 / (interval / 1000000);
+        }
+        if (drift_ppb != 0 && llabs(drift_ppb) <= TIMESYNC_FREQ_MAX_PPM * 1000) {
+            int64_t freq = ts.stats.freq_ppb + drift_ppb / 2;
+            if (freq > TIMESYNC_FREQ_MAX_PPM * 1000) {
+                freq = TIMESYNC_FREQ_MAX_PPM * 1000;
+            } else if (freq < -TIMESYNC_FREQ_MAX_PPM * 1000) {
+                freq = -TIMESYNC_FREQ_MAX_PPM * 1000;
+            }
+            ts.stats.freq_ppb = (int32_t)freq;
+            ts.seg.freq = TIMESYNC_PPB_TO_RATE(freq);
+        }
+        ts.seg.slew_ns = offset;
+        ts.seg.slew = offset >= 0 ? TIMESYNC_PPM_TO_RATE(TIMESYNC_SLEW_PPM) : -TIMESYNC_PPM_TO_RATE(TIMESYNC_SLEW_PPM);
+    }
+    ts.last_sample = mono;
+    time_ns_set_segment(&ts.seg);
+
+    ts.stats.offset_us = (int32_t)(offset_us > INT32_MAX ? INT32_MAX : (offset_us < INT32_MIN ? INT32_MIN : offset_us));
+    ts.stats.delay_us = (uint32_t)(delay / TIMESYNC_NS_PER_US);
+    ts.stats.samples++;
+    if (step) {
+        ts.stats.steps++;
+        LOG_INFO(TIMESYNC_TAG, "clock stepped by %ld ms, delay %lu us", (long)(offset_us / 1000),
+                 (unsigned long)ts.stats.delay_us);
+#if TIMESYNC_RTC
+        rtc.countdown = 0U;
+#endif
+    }
+}
+
+static void timesync_tick(void* arg)
+{
+    (void)arg;
+    timesync_rebase(time_now_ns());
+    time_ns_set_segment(&ts.seg);
+    ts.stats.slew_us = (int32_t)(ts.seg.slew_ns / TIMESYNC_NS_PER_US);
+
+#if TIMESYNC_RTC
+    if (ts.stats.synced) {
+        if (rtc.countdown == 0U) {
+            rtc.countdown = TIMESYNC_RTC_CHECK_S * 1000U / TIMESYNC_TICK_MS;
+            timesync_rtc_check();
+        }
+        rtc.countdown--;
+    }
+#endif
+    sys_timeout(TIMESYNC_TICK_MS, timesync_tick, NULL);
+}
+
+/* The zero segment maps the monotonic clock to itself, which is UTC until
+ * the first sample */
+void timesync_init(void)
+{
+    sys_timeout(TIMESYNC_TICK_MS, timesync_tick, NULL);
+}
+
+void timesync_get_stats(TimesyncStats_t* stats)
+{
+    *stats = ts.stats;
+}
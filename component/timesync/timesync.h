@@ -0,0 +1,147 @@
+/**
+ * @file timesync.h
+ * @brief Disciplined UTC for time_ns.h, RTC kept in step.
+ *
+ * Two clocks:
+ *  - time_utc_ns() (time_ns.h): the monotonic clock time_now_ns() plus an
+ *    offset that follows the SNTP samples (sntp_client.h). Offsets below
+ *    TIMESYNC_STEP_US are slewed out at TIMESYNC_SLEW_PPM, so this clock
+ *    never goes backwards and never jumps; only the first sample and
+ *    errors beyond TIMESYNC_STEP_US step it. A frequency term learnt from
+ *    successive samples keeps the residual offset small between polls.
+ *  - the RTC: set once from the first sample (seconds, then a shift of
+ *    the sub-second counter), then disciplined towards UTC with the smooth
+ *    calibration register, i.e. slewed too. The RTC runs on the LSI, which
+ *    can be a few percent off, more than smooth calibration covers: the
+ *    prescaler is retrimmed once from the measured rate. The magic and the
+ *    prescaler sit in backup registers, so a reset keeps the time
+ *    (timesync_rtc_restore() from MX_RTC_Init()).
+ *
+ * The UTC segment is rebased and republished every TIMESYNC_TICK_MS on
+ * the tcpip thread.
+ */
+
+#pragma once
+
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 0 leaves SNTP and the RTC discipline out of the startup code */
+#ifndef TIMESYNC
+#define TIMESYNC 1
+#endif
+
+/* Discipline the RTC; 0 on boards (or the host build) without one */
+#ifndef TIMESYNC_RTC
+#define TIMESYNC_RTC 1
+#endif
+
+/* UTC segment rebase period */
+#ifndef TIMESYNC_TICK_MS
+#define TIMESYNC_TICK_MS 1000U
+#endif
+
+/* Larger offsets step the UTC clock instead of slewing it */
+#ifndef TIMESYNC_STEP_US
+#define TIMESYNC_STEP_US 128000
+#endif
+
+/* Slew rate: a 128 ms offset takes 256 s to remove at 500 ppm */
+#ifndef TIMESYNC_SLEW_PPM
+#define TIMESYNC_SLEW_PPM 500
+#endif
+
+/* Limit of the learnt frequency correction */
+#ifndef TIMESYNC_FREQ_MAX_PPM
+#define TIMESYNC_FREQ_MAX_PPM 500
+#endif
+
+/* Samples with a longer round trip are ignored; their offset error can be
+ * up to half of it */
+#ifndef TIMESYNC_DELAY_MAX_US
+#define TIMESYNC_DELAY_MAX_US 100000
+#endif
+
+/* RTC: compare with UTC every TIMESYNC_RTC_CHECK_S, remove an error over
+ * about TIMESYNC_RTC_SLEW_S, step it beyond TIMESYNC_RTC_STEP_US */
+#ifndef TIMESYNC_RTC_CHECK_S
+#define TIMESYNC_RTC_CHECK_S 64U
+#endif
+
+#ifndef TIMESYNC_RTC_SLEW_S
+#define TIMESYNC_RTC_SLEW_S 1024
+#endif
+
+#ifndef TIMESYNC_RTC_STEP_US
+#define TIMESYNC_RTC_STEP_US 500000
+#endif
+
+/* Rate measurement before the prescaler trim; the RTC reads in 1/256 s
+ * steps until then, 256 s resolve 15 ppm */
+#ifndef TIMESYNC_RTC_TRIM_S
+#define TIMESYNC_RTC_TRIM_S 256U
+#endif
+
+/* Backup registers: magic, then (PREDIV_A << 16) | PREDIV_S */
+#define TIMESYNC_RTC_BKUP_MAGIC 0x5453594EUL /* "TSYN" */
+#define TIMESYNC_RTC_BKUP_REG_MAGIC 0U
+#define TIMESYNC_RTC_BKUP_REG_PREDIV 1U
+
+typedef struct {
+    bool synced;            /* UTC set from at least one sample */
+    int32_t offset_us;      /* last sample: server minus local */
+    uint32_t delay_us;      /* last sample: round trip */
+    int32_t slew_us;        /* still to be slewed out, as of the last tick */
+    int32_t freq_ppb;       /* learnt correction of the local clock */
+    uint32_t samples;       /* accepted samples */
+    uint32_t rejected;      /* samples over TIMESYNC_DELAY_MAX_US */
+    uint32_t steps;         /* UTC steps, the first sync included */
+    int32_t rtc_err_us;     /* last RTC check: RTC minus UTC */
+    int32_t rtc_cal_ppm;    /* smooth calibration in effect */
+    uint32_t rtc_steps;     /* RTC sets, the first one included */
+    bool rtc_trimmed;       /* prescaler retrimmed to the LSI */
+} TimesyncStats_t;
+
+/* Starts the tick; core lock held. sntp_client_start() calls it. */
+void timesync_init(void);
+
+/* time_utc_ns() is time since boot until the first sample */
+bool timesync_synced(void);
+
+/* One SNTP exchange (RFC 4330 T1..T4): t1 and t4 are time_utc_ns() at
+ * transmit and receive, t2 and t3 the server's receive and transmit times
+ * in nanoseconds since 1970. tcpip thread. */
+void timesync_sample(uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4);
+
+void timesync_get_stats(TimesyncStats_t* stats);
+
+/* Days since 1970-01-01 to and from the civil date (proleptic Gregorian) */
+int32_t timesync_days_from_civil(int32_t y, uint32_t m, uint32_t d);
+void timesync_civil_from_days(int32_t days, int32_t* y, uint32_t* m, uint32_t* d);
+
+#if TIMESYNC_RTC
+#include "main.h"
+
+/* From MX_RTC_Init() after HAL_RTC_Init(): true when the backup domain
+ * still holds a set RTC, whose trimmed prescaler is then put back. The
+ * caller must not set the time and date in that case. */
+bool timesync_rtc_restore(RTC_HandleTypeDef* hrtc);
+
+/* RTC seconds since 1970; false until the RTC was set, in this boot or
+ * before the reset. Survives resets, so it dates things across them.
+ * Task context. */
+bool timesync_rtc_seconds(uint32_t* sec);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMESYNC_H */
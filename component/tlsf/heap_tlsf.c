@@ -0,0 +1,219 @@
+/**
+ * @file heap_tlsf.c
+ * @brief FreeRTOS heap on TLSF, in place of heap_4.c (HEAP_TLSF).
+ *
+ * The regions of heap_4.c, configTOTAL_HEAP_SIZE bytes in DTCM and
+ * configHEAP_AXI_SIZE in AXI SRAM, each an allocator of its own so that
+ * pvPortMallocRegion() can still prefer one: heapREGION_ANY tries DTCM
+ * first, as the address ordered first fit did, and a preferred region
+ * that is full falls back to the other. Each try is O(1), so an
+ * allocation costs at most one per region. The scheduler is suspended
+ * around it as in heap_4.c, now for a bounded time.
+ *
+ * vPortGetHeapStats() walks two free lists per region instead of the
+ * whole free list (see tlsf_stats()).
+ */
+
+/* The API functions themselves, not the MPU wrappers */
+#define MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#if HEAP_TLSF
+
+#include "tlsf.h"
+#include "heaptrace/heap_trace.h"
+
+#if configSUPPORT_DYNAMIC_ALLOCATION == 0
+#error "HEAP_TLSF without configSUPPORT_DYNAMIC_ALLOCATION"
+#endif
+
+_Static_assert(TLSF_ALIGN % portBYTE_ALIGNMENT == 0U, "TLSF_ALIGN below portBYTE_ALIGNMENT");
+
+#define HEAP_REGIONS 2U
+
+#if configAPPLICATION_ALLOCATED_HEAP == 1
+extern uint8_t ucHeap[configTOTAL_HEAP_SIZE];
+#else
+/* .dtcm_bss, see STM32H743VITX_FLASH.ld */
+static uint8_t ucHeap[configTOTAL_HEAP_SIZE] __attribute__((section(".dtcm_bss"), aligned(8)));
+#endif
+static uint8_t ucHeapAxi[configHEAP_AXI_SIZE] __attribute__((aligned(8)));
+
+/* Indexed by heapREGION_DTCM - 1 and heapREGION_AXI - 1 */
+static uint8_t* const heap_start[HEAP_REGIONS] = { ucHeap, ucHeapAxi };
+static const size_t heap_size[HEAP_REGIONS] = { configTOTAL_HEAP_SIZE, configHEAP_AXI_SIZE };
+
+static Tlsf_t heap_tlsf[HEAP_REGIONS];
+static bool heap_ready;
+static size_t heap_free;
+static size_t heap_min_free;
+
+/* First allocation, scheduler suspended */
+static void heap_init(void)
+{
+    for (uint32_t i = 0U; i < HEAP_REGIONS; i++) {
+        bool ok;
+
+        tlsf_init(&heap_tlsf[i]);
+        ok = tlsf_add_pool(&heap_tlsf[i], heap_start[i], heap_size[i]);
+        configASSERT(ok);
+        (void)ok;
+        heap_free += heap_tlsf[i].free_bytes;
+    }
+    heap_min_free = heap_free;
+    heap_ready = true;
+}
+
+/* HEAP_REGIONS when pv is in none */
+static uint32_t heap_region_of(const void* pv)
+{
+    uint32_t i;
+
+    for (i = 0U; i < HEAP_REGIONS; i++) {
+        if ((const uint8_t*)pv >= heap_start[i] && (const uint8_t*)pv < heap_start[i] + heap_size[i]) {
+            break;
+        }
+    }
+    return i;
+}
+
+static void heap_update_free(void)
+{
+    heap_free = 0U;
+    for (uint32_t i = 0U; i < HEAP_REGIONS; i++) {
+        heap_free += heap_tlsf[i].free_bytes;
+    }
+    if (heap_free < heap_min_free) {
+        heap_min_free = heap_free;
+    }
+}
+
+static void* heap_malloc(size_t xWantedSize, uint32_t ulRegion, const void* site);
+
+void* pvPortMalloc(size_t xWantedSize)
+{
+    return heap_malloc(xWantedSize, heapREGION_ANY, HEAP_TRACE_CALLER());
+}
+
+void* pvPortMallocRegion(size_t xWantedSize, uint32_t ulRegion)
+{
+    return heap_malloc(xWantedSize, ulRegion, HEAP_TRACE_CALLER());
+}
+
+/* site: the caller of the API function, for HEAP_TRACE */
+static void* heap_malloc(size_t xWantedSize, uint32_t ulRegion, const void* site)
+{
+    void* pv = NULL;
+    uint32_t first = (ulRegion == heapREGION_ANY || ulRegion > HEAP_REGIONS) ? 0U : ulRegion - 1U;
+
+    vTaskSuspendAll();
+    if (!heap_ready) {
+        heap_init();
+    }
+    if (xWantedSize > 0U) {
+        for (uint32_t i = 0U; i < HEAP_REGIONS && pv == NULL; i++) {
+            pv = tlsf_malloc(&heap_tlsf[(first + i) % HEAP_REGIONS], xWantedSize);
+        }
+        heap_update_free();
+    }
+    traceMALLOC(pv, xWantedSize);
+    (void)xTaskResumeAll();
+#if HEAP_TRACE
+    heap_trace_alloc(HEAP_TRACE_RTOS, pv, xWantedSize, site);
+#else
+    (void)site;
+#endif
+
+#if configUSE_MALLOC_FAILED_HOOK == 1
+    if (pv == NULL) {
+        extern void vApplicationMallocFailedHook(void);
+        vApplicationMallocFailedHook();
+    }
+#endif
+    configASSERT(((size_t)pv & (size_t)portBYTE_ALIGNMENT_MASK) == 0U);
+    return pv;
+}
+
+void vPortFree(void* pv)
+{
+    uint32_t region;
+
+    if (pv == NULL) {
+        return;
+    }
+    region = heap_region_of(pv);
+    configASSERT(region < HEAP_REGIONS);
+    if (region >= HEAP_REGIONS) {
+        return;
+    }
+#if HEAP_TRACE
+    heap_trace_free(HEAP_TRACE_RTOS, pv);
+#endif
+    vTaskSuspendAll();
+    traceFREE(pv, tlsf_block_size(pv));
+    tlsf_free(&heap_tlsf[region], pv);
+    heap_update_free();
+    (void)xTaskResumeAll();
+}
+
+size_t xPortGetFreeHeapSize(void)
+{
+    return heap_free;
+}
+
+size_t xPortGetFreeHeapSizeRegion(uint32_t ulRegion)
+{
+    if (ulRegion == heapREGION_ANY || ulRegion > HEAP_REGIONS) {
+        return heap_free;
+    }
+    return heap_tlsf[ulRegion - 1U].free_bytes;
+}
+
+size_t xPortGetMinimumEverFreeHeapSize(void)
+{
+    return heap_min_free;
+}
+
+void vPortInitialiseBlocks(void)
+{
+    /* Initialised on the first allocation */
+}
+
+void vPortGetHeapStats(HeapStats_t* pxHeapStats)
+{
+    TlsfStats_t s;
+    size_t largest = 0U;
+    size_t smallest = portMAX_DELAY;
+    size_t blocks = 0U;
+    size_t allocs = 0U;
+    size_t frees = 0U;
+
+    vTaskSuspendAll();
+    for (uint32_t i = 0U; i < HEAP_REGIONS && heap_ready; i++) {
+        tlsf_stats(&heap_tlsf[i], &s);
+        if (s.largest > largest) {
+            largest = s.largest;
+        }
+        if (s.free_blocks != 0U && s.smallest < smallest) {
+            smallest = s.smallest;
+        }
+        blocks += s.free_blocks;
+        allocs += s.allocs;
+        frees += s.frees;
+    }
+    pxHeapStats->xAvailableHeapSpaceInBytes = heap_free;
+    pxHeapStats->xMinimumEverFreeBytesRemaining = heap_min_free;
+    (void)xTaskResumeAll();
+
+    pxHeapStats->xSizeOfLargestFreeBlockInBytes = largest;
+    pxHeapStats->xSizeOfSmallestFreeBlockInBytes = smallest;
+    pxHeapStats->xNumberOfFreeBlocks = blocks;
+    pxHeapStats->xNumberOfSuccessfulAllocations = allocs;
+    pxHeapStats->xNumberOfSuccessfulFrees = frees;
+}
+
+#endif /* HEAP_TLSF */
@@ -0,0 +1,278 @@
+/**
+ * @file tlsf.c
+ * @brief Two-level segregated fit allocator, see tlsf.h.
+ */
+
+#include "tlsf.h"
+
+#include <string.h>
+
+#define TLSF_BLOCK_FREE     ((size_t)1U)
+#define TLSF_HDR            offsetof(TlsfBlock_t, next_free)
+/* The free list links have to fit in the payload */
+#define TLSF_MIN_PAYLOAD    (sizeof(TlsfBlock_t) - TLSF_HDR)
+#define TLSF_MAX_SIZE       (((size_t)1U << TLSF_FL_MAX_LOG2) - TLSF_ALIGN)
+
+_Static_assert(TLSF_HDR == TLSF_ALIGN, "TLSF header breaks the payload alignment");
+_Static_assert(TLSF_FL_COUNT < 32U, "TLSF first level bitmap is 32 bits");
+_Static_assert(TLSF_MIN_PAYLOAD <= TLSF_ALIGN, "TLSF free list links exceed the alignment");
+
+static inline uint32_t tlsf_fls(size_t x)
+{
+    return 31U - (uint32_t)__builtin_clz((uint32_t)x);
+}
+
+static inline size_t tlsf_size(const TlsfBlock_t* b)
+{
+    return b->size & ~TLSF_BLOCK_FREE;
+}
+
+static inline bool tlsf_is_free(const TlsfBlock_t* b)
+{
+    return (b->size & TLSF_BLOCK_FREE) != 0U;
+}
+
+static inline TlsfBlock_t* tlsf_next(const TlsfBlock_t* b)
+{
+    return (TlsfBlock_t*)(void*)((uint8_t*)b + TLSF_HDR + tlsf_size(b));
+}
+
+static inline TlsfBlock_t* tlsf_from_ptr(const void* p)
+{
+    return (TlsfBlock_t*)(void*)((uint8_t*)p - TLSF_HDR);
+}
+
+static inline void* tlsf_to_ptr(TlsfBlock_t* b)
+{
+    return (uint8_t*)b + TLSF_HDR;
+}
+
+/* The list a block of this size belongs to */
+static void tlsf_mapping(size_t size, uint32_t* fl, uint32_t* sl)
+{
+    if (size < ((size_t)1U << TLSF_FL_SHIFT)) {
+        *fl = 0U;
+        *sl = (uint32_t)(size >> (TLSF_FL_SHIFT - TLSF_SL_LOG2));
+    } else {
+        uint32_t f = tlsf_fls(size);
+
+        *sl = (uint32_t)(size >> (f - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+        *fl = f - (TLSF_FL_SHIFT - 1U);
+    }
+}
+
+/* The first list whose every block holds size: the size rounded up to
+ * the next class boundary, then the next non-empty list at or above it */
+static TlsfBlock_t* tlsf_search(const Tlsf_t* t, size_t size, uint32_t* fl, uint32_t* sl)
+{
+    uint32_t map;
+
+    if (size >= ((size_t)1U << TLSF_FL_SHIFT)) {
+        size += ((size_t)1U << (tlsf_fls(size) - TLSF_SL_LOG2)) - 1U;
+    }
+    tlsf_mapping(size, fl, sl);
+    if (*fl >= TLSF_FL_COUNT) {
+        return NULL;
+    }
+    map = t->sl_bitmap[*fl] & (~0U << *sl);
+    if (map == 0U) {
+        map = t->fl_bitmap & (~0U << (*fl + 1U));
+        if (map == 0U) {
+            return NULL;
+        }
+        *fl = (uint32_t)__builtin_ctz(map);
+        map = t->sl_bitmap[*fl];
+    }
+    *sl = (uint32_t)__builtin_ctz(map);
+    return t->lists[*fl][*sl];
+}
+
+static void tlsf_unlink(Tlsf_t* t, TlsfBlock_t* b, uint32_t fl, uint32_t sl)
+{
+    TlsfBlock_t* prev = b->prev_free;
+    TlsfBlock_t* next = b->next_free;
+
+    if (next != NULL) {
+        next->prev_free = prev;
+    }
+    if (prev != NULL) {
+        prev->next_free = next;
+    } else {
+        t->lists[fl][sl] = next;
+        if (next == NULL) {
+            t->sl_bitmap[fl] &= ~(1U << sl);
+            if (t->sl_bitmap[fl] == 0U) {
+                t->fl_bitmap &= ~(1U << fl);
+            }
+        }
+    }
+    t->free_blocks--;
+    t->free_bytes -= tlsf_size(b);
+}
+
+static void tlsf_remove(Tlsf_t* t, TlsfBlock_t* b)
+{
+    uint32_t fl;
+    uint32_t sl;
+
+    tlsf_mapping(tlsf_size(b), &fl, &sl);
+    tlsf_unlink(t, b, fl, sl);
+}
+
+static void tlsf_insert(Tlsf_t* t, TlsfBlock_t* b)
+{
+    uint32_t fl;
+    uint32_t sl;
+
+    tlsf_mapping(tlsf_size(b), &fl, &sl);
+    b->size |= TLSF_BLOCK_FREE;
+    b->prev_free = NULL;
+    b->next_free = t->lists[fl][sl];
+    if (b->next_free != NULL) {
+        b->next_free->prev_free = b;
+    }
+    t->lists[fl][sl] = b;
+    t->sl_bitmap[fl] |= 1U << sl;
+    t->fl_bitmap |= 1U << fl;
+    t->free_blocks++;
+    t->free_bytes += tlsf_size(b);
+}
+
+void tlsf_init(Tlsf_t* t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+bool tlsf_add_pool(Tlsf_t* t, void* mem, size_t size)
+{
+    uintptr_t start = ((uintptr_t)mem + TLSF_ALIGN - 1U) & ~(uintptr_t)(TLSF_ALIGN - 1U);
+    size_t usable;
+    TlsfBlock_t* b;
+    TlsfBlock_t* end;
+
+    if (size < (size_t)(start - (uintptr_t)mem) + 2U * TLSF_HDR + TLSF_ALIGN) {
+        return false;
+    }
+    /* One free block, then the sentinel: a used header of size 0 */
+    usable = (size - (size_t)(start - (uintptr_t)mem) - 2U * TLSF_HDR) & ~(size_t)(TLSF_ALIGN - 1U);
+    if (usable > TLSF_MAX_SIZE) {
+        return false;
+    }
+    b = (TlsfBlock_t*)(void*)start;
+    b->prev_phys = NULL;
+    b->size = usable;
+    end = tlsf_next(b);
+    end->prev_phys = b;
+    end->size = 0U;
+    tlsf_insert(t, b);
+    t->total += size;
+    t->min_free = t->free_bytes;
+    return true;
+}
+
+void* tlsf_malloc(Tlsf_t* t, size_t size)
+{
+    TlsfBlock_t* b;
+    uint32_t fl;
+    uint32_t sl;
+    size_t rest;
+
+    if (size > TLSF_MAX_SIZE) {
+        t->fails++;
+        return NULL;
+    }
+    size = (size < TLSF_MIN_PAYLOAD) ? TLSF_MIN_PAYLOAD : size;
+    size = (size + TLSF_ALIGN - 1U) & ~(size_t)(TLSF_ALIGN - 1U);
+    b = tlsf_search(t, size, &fl, &sl);
+    if (b == NULL) {
+        t->fails++;
+        return NULL;
+    }
+    tlsf_unlink(t, b, fl, sl);
+    b->size &= ~TLSF_BLOCK_FREE;
+
+    /* The tail goes back as a block of its own when it can hold one */
+    rest = tlsf_size(b) - size;
+    if (rest >= TLSF_HDR + TLSF_ALIGN) {
+        TlsfBlock_t* r;
+
+        b->size = size;
+        r = tlsf_next(b);
+        r->prev_phys = b;
+        r->size = rest - TLSF_HDR;
+        tlsf_next(r)->prev_phys = r;
+        tlsf_insert(t, r);
+    }
+    t->used_blocks++;
+    t->allocs++;
+    if (t->free_bytes < t->min_free) {
+        t->min_free = t->free_bytes;
+    }
+    return tlsf_to_ptr(b);
+}
+
+void tlsf_free(Tlsf_t* t, void* p)
+{
+    TlsfBlock_t* b;
+    TlsfBlock_t* n;
+
+    if (p == NULL) {
+        return;
+    }
+    b = tlsf_from_ptr(p);
+    if (b->prev_phys != NULL && tlsf_is_free(b->prev_phys)) {
+        TlsfBlock_t* prev = b->prev_phys;
+
+        tlsf_remove(t, prev);
+        prev->size = tlsf_size(prev) + TLSF_HDR + tlsf_size(b);
+        b = prev;
+    }
+    n = tlsf_next(b);
+    if (tlsf_is_free(n)) {
+        tlsf_remove(t, n);
+        b->size = tlsf_size(b) + TLSF_HDR + tlsf_size(n);
+    }
+    tlsf_next(b)->prev_phys = b;
+    tlsf_insert(t, b);
+    t->used_blocks--;
+    t->frees++;
+}
+
+size_t tlsf_block_size(const void* p)
+{
+    return tlsf_size(tlsf_from_ptr(p));
+}
+
+void tlsf_stats(const Tlsf_t* t, TlsfStats_t* s)
+{
+    s->total = t->total;
+    s->free_bytes = t->free_bytes;
+    s->min_free = t->min_free;
+    s->free_blocks = t->free_blocks;
+    s->used_blocks = t->used_blocks;
+    s->allocs = t->allocs;
+    s->frees = t->frees;
+    s->fails = t->fails;
+    s->largest = 0U;
+    s->smallest = 0U;
+    if (t->fl_bitmap != 0U) {
+        /* Extremes of the highest and the lowest non-empty list */
+        uint32_t fl = tlsf_fls(t->fl_bitmap);
+        uint32_t sl = tlsf_fls(t->sl_bitmap[fl]);
+
+        for (const TlsfBlock_t* b = t->lists[fl][sl]; b != NULL; b = b->next_free) {
+            if (tlsf_size(b) > s->largest) {
+                s->largest = tlsf_size(b);
+            }
+        }
+        fl = (uint32_t)__builtin_ctz(t->fl_bitmap);
+        sl = (uint32_t)__builtin_ctz(t->sl_bitmap[fl]);
+        s->smallest = tlsf_size(t->lists[fl][sl]);
+        for (const TlsfBlock_t* b = t->lists[fl][sl]; b != NULL; b = b->next_free) {
+            if (tlsf_size(b) < s->smallest) {
+                s->smallest = tlsf_size(b);
+            }
+        }
+    }
+    s->frag_pct = (s->free_bytes == 0U) ? 0U : (uint32_t)(100U - (uint64_t)s->largest * 100U / s->free_bytes);
+}
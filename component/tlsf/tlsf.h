@@ -0,0 +1,127 @@
+/**
+ * @file tlsf.h
+ * @brief Two-level segregated fit allocator: malloc and free in O(1).
+ *
+ * A first-fit heap (heap_4.c, lwIP's mem.c) walks its free list, so the
+ * time an allocation takes grows with the fragmentation left behind by
+ * every earlier one, and whoever holds the heap lock meanwhile holds up
+ * the rest. TLSF (Masmano et al.) keeps a free list per size class
+ * instead: the first level splits sizes by power of two, the second
+ * splits each power into TLSF_SL_COUNT linear steps, and a bitmap per
+ * level says which lists are not empty. An allocation rounds its size up
+ * to the next class, so that any block of that list fits, and finds the
+ * first non-empty list at or above it with two count-trailing-zeros; a
+ * free merges with its physical neighbours through the boundary tags.
+ * Neither depends on how many blocks there are, and the worst case waste
+ * of the rounding is 1 / TLSF_SL_COUNT of the request.
+ *
+ * A Tlsf_t manages one or more pools of caller memory, each ending in a
+ * sentinel block so that blocks never merge across pools. There is no
+ * locking here: heap_tlsf.c (FreeRTOS heap, HEAP_TLSF in FreeRTOSConfig.h)
+ * and tlsf_lwip.c (lwIP heap, LWIP_MEM_TLSF in lwipopts.h) wrap it in
+ * their own protection.
+ */
+
+#pragma once
+
+#ifndef TLSF_H
+#define TLSF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* log2 of the second level lists per power of two */
+#ifndef TLSF_SL_LOG2
+#define TLSF_SL_LOG2 4U
+#endif
+
+/* Blocks and pools below 2^TLSF_FL_MAX_LOG2 bytes: 1 MB covers AXI SRAM */
+#ifndef TLSF_FL_MAX_LOG2
+#define TLSF_FL_MAX_LOG2 20U
+#endif
+
+/* Block and pointer alignment, the larger of 8 and a pointer pair */
+#define TLSF_ALIGN          ((sizeof(void*) > 4U) ? 16U : 8U)
+
+#define TLSF_SL_COUNT       (1U << TLSF_SL_LOG2)
+/* Sizes below 2^TLSF_FL_SHIFT share first level 0, in steps of 8 bytes */
+#define TLSF_FL_SHIFT       (TLSF_SL_LOG2 + 3U)
+#define TLSF_FL_COUNT       (TLSF_FL_MAX_LOG2 - TLSF_FL_SHIFT + 1U)
+
+#if TLSF_SL_LOG2 > 5U
+#error "TLSF_SL_LOG2: the second level bitmap is 32 bits"
+#endif
+
+/* Block header: the previous physical block and the payload size with
+ * the free flag in bit 0. Two free list links follow it while the block
+ * is free; they are the first bytes of the payload while it is not. */
+typedef struct TlsfBlock_s {
+    struct TlsfBlock_s* prev_phys;
+    size_t size;
+    struct TlsfBlock_s* next_free;
+    struct TlsfBlock_s* prev_free;
+} TlsfBlock_t;
+
+typedef struct {
+    uint32_t fl_bitmap;
+    uint32_t sl_bitmap[TLSF_FL_COUNT];
+    TlsfBlock_t* lists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+    size_t total;               /* pool bytes, headers and sentinels included */
+    size_t free_bytes;          /* payload of the free blocks */
+    size_t min_free;            /* low water mark of free_bytes */
+    uint32_t free_blocks;
+    uint32_t used_blocks;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t fails;             /* allocations refused */
+} Tlsf_t;
+
+typedef struct {
+    size_t total;
+    size_t free_bytes;
+    size_t min_free;
+    size_t largest;             /* largest free block: what an allocation can get */
+    size_t smallest;            /* smallest free block, 0 when none */
+    uint32_t free_blocks;
+    uint32_t used_blocks;
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t fails;
+    uint32_t frag_pct;          /* 100 - largest / free_bytes in percent */
+} TlsfStats_t;
+
+/* Empty allocator, no pool yet */
+void tlsf_init(Tlsf_t* t);
+
+/* Hands size bytes at mem over as a pool; false when it is too small or
+ * too large (2^TLSF_FL_MAX_LOG2) for one block */
+bool tlsf_add_pool(Tlsf_t* t, void* mem, size_t size);
+
+/* TLSF_ALIGN aligned, NULL when no free block fits */
+void* tlsf_malloc(Tlsf_t* t, size_t size);
+
+/* p from tlsf_malloc() on t, or NULL */
+void tlsf_free(Tlsf_t* t, void* p);
+
+/* Usable bytes of an allocated block, at least what was asked for */
+size_t tlsf_block_size(const void* p);
+
+/* Counters in O(1); largest and smallest walk one free list each */
+void tlsf_stats(const Tlsf_t* t, TlsfStats_t* s);
+
+/* lwIP heap on TLSF, see tlsf_lwip.c: mem_clib_malloc() and friends */
+void* tlsf_lwip_malloc(size_t size);
+void* tlsf_lwip_calloc(size_t count, size_t size);
+void tlsf_lwip_free(void* p);
+void tlsf_lwip_stats(TlsfStats_t* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TLSF_H */
@@ -0,0 +1,91 @@
+/**
+ * @file tlsf_lwip.c
+ * @brief lwIP heap on TLSF (LWIP_MEM_TLSF in lwipopts.h).
+ *
+ * With MEM_LIBC_MALLOC, mem.c hands mem_malloc() and mem_free() to
+ * mem_clib_malloc() and mem_clib_free(), which lwipopts.h maps to the
+ * functions here: one Tlsf_t over the MEM_SIZE bytes at
+ * LWIP_RAM_HEAP_POINTER, the D2 window of MPU region 1 that the malloc
+ * pools occupy otherwise (a static array on the host). mem.c keeps its
+ * MEM_STATS. Calls come from every thread and from the ETH interrupt, so
+ * each runs under SYS_ARCH_PROTECT, short since it is O(1).
+ */
+
+#include "tlsf.h"
+
+#include "lwip/opt.h"
+
+#if LWIP_MEM_TLSF
+
+#include "lwip/sys.h"
+
+#include <string.h>
+
+#ifdef LWIP_RAM_HEAP_POINTER
+#define TLSF_LWIP_HEAP ((void*)(uintptr_t)LWIP_RAM_HEAP_POINTER)
+#else
+LWIP_DECLARE_MEMORY_ALIGNED(tlsf_lwip_ram, MEM_SIZE);
+#define TLSF_LWIP_HEAP ((void*)tlsf_lwip_ram)
+#endif
+
+static Tlsf_t tlsf_lwip;
+static bool tlsf_lwip_ready;
+
+/* Under SYS_ARCH_PROTECT: on the first call, lwIP has no init hook for a
+ * libc heap */
+static void tlsf_lwip_init(void)
+{
+    tlsf_init(&tlsf_lwip);
+    if (!tlsf_add_pool(&tlsf_lwip, TLSF_LWIP_HEAP, MEM_SIZE)) {
+        LWIP_ASSERT("tlsf_lwip: MEM_SIZE does not make a pool", 0);
+    }
+    tlsf_lwip_ready = true;
+}
+
+void* tlsf_lwip_malloc(size_t size)
+{
+    void* p;
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    SYS_ARCH_PROTECT(lev);
+    if (!tlsf_lwip_ready) {
+        tlsf_lwip_init();
+    }
+    p = tlsf_malloc(&tlsf_lwip, size);
+    SYS_ARCH_UNPROTECT(lev);
+    return p;
+}
+
+void* tlsf_lwip_calloc(size_t count, size_t size)
+{
+    void* p;
+
+    if (size != 0U && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    p = tlsf_lwip_malloc(count * size);
+    if (p != NULL) {
+        memset(p, 0, count * size);
+    }
+    return p;
+}
+
+void tlsf_lwip_free(void* p)
+{
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    SYS_ARCH_PROTECT(lev);
+    tlsf_free(&tlsf_lwip, p);
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+void tlsf_lwip_stats(TlsfStats_t* s)
+{
+    SYS_ARCH_DECL_PROTECT(lev);
+
+    SYS_ARCH_PROTECT(lev);
+    tlsf_stats(&tlsf_lwip, s);
+    SYS_ARCH_UNPROTECT(lev);
+}
+
+#endif /* LWIP_MEM_TLSF */
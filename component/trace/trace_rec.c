@@ -0,0 +1,254 @@
+/**
+ * @file trace_rec.c
+ * @brief Kernel event ring and its UDP stream.
+ */
+
+#include "trace_rec.h"
+
+#include "FreeRTOS.h"
+
+#if TRACE_REC
+
+#include "main.h"
+#include "task.h"
+#include "queue.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+#include "lwip/udp.h"
+#include "lwip/pbuf.h"
+#include "lwip/sys.h"
+
+#include <string.h>
+
+#if (TRACE_REC_EVENTS & (TRACE_REC_EVENTS - 1U)) != 0U
+#error "TRACE_REC_EVENTS must be a power of two"
+#endif
+
+#define TRACE_TAG               "TRACE"
+#define TRACE_MAGIC_INFO        0x49435254UL    /* "TRCI" */
+#define TRACE_MAGIC_EVENTS      0x45435254UL    /* "TRCE" */
+#define TRACE_HDR_LEN           16U
+/* 1296-byte datagrams, 8 per tick: about 64k events/s at 20 ms */
+#define TRACE_DGRAM_EVENTS      160U
+#define TRACE_DGRAM_BURST       8U
+#define TRACE_NAME_LEN          16U
+#define TRACE_INFO_ENTRY_LEN    (2U + TRACE_NAME_LEN)
+#define TRACE_INFO_TASKS        24U
+
+typedef struct {
+    struct udp_pcb* pcb;
+    bool on;
+    ip_addr_t peer;
+    u16_t port;
+    uint32_t tail;          /* next event to send, as an event count */
+    uint32_t seq;
+    uint32_t lost;
+    uint32_t last_rx_ms;
+} TraceStream_t;
+
+volatile uint8_t trace_rec_task;
+
+static TraceEvent_t trace_ring[TRACE_REC_EVENTS] TRACE_REC_SECTION;
+/* Events recorded; the ring holds the last TRACE_REC_EVENTS */
+static volatile uint32_t trace_head;
+
+static const char* trace_queue_names[TRACE_REC_MAX_QUEUES];
+static uint32_t trace_queue_count;
+
+static TraceStream_t trace_stream;
+
+ITCM_FUNC void trace_rec_event(uint8_t type, uint16_t arg)
+{
+    UBaseType_t mask = taskENTER_CRITICAL_FROM_ISR();
+    uint32_t i = trace_head;
+    TraceEvent_t* e = &trace_ring[i & (TRACE_REC_EVENTS - 1U)];
+
+    e->cycles = DWT->CYCCNT;
+    e->type = type;
+    e->task = trace_rec_task;
+    e->arg = arg;
+    trace_head = i + 1U;
+#if TRACE_REC_ITM
+    if ((ITM->TCR & ITM_TCR_ITMENA_Msk) != 0U && (ITM->TER & (1UL << TRACE_REC_ITM_PORT)) != 0U) {
+        while (ITM->PORT[TRACE_REC_ITM_PORT].u32 == 0U) {
+        }
+        ITM->PORT[TRACE_REC_ITM_PORT].u32 = e->cycles;
+        while (ITM->PORT[TRACE_REC_ITM_PORT].u32 == 0U) {
+        }
+        ITM->PORT[TRACE_REC_ITM_PORT].u32 = (uint32_t)type | ((uint32_t)e->task << 8) | ((uint32_t)arg << 16);
+    }
+#endif
+    taskEXIT_CRITICAL_FROM_ISR(mask);
+}
+
+bool trace_rec_name_queue(void* handle, const char* name)
+{
+    uint32_t id = 0U;
+
+    taskENTER_CRITICAL();
+    if (trace_queue_count < TRACE_REC_MAX_QUEUES) {
+        trace_queue_names[trace_queue_count++] = name;
+        id = trace_queue_count;
+    }
+    taskEXIT_CRITICAL();
+    if (id == 0U) {
+        return false;
+    }
+    vQueueSetQueueNumber((QueueHandle_t)handle, (UBaseType_t)id);
+    return true;
+}
+
+static void trace_put32(uint8_t* dst, uint32_t v)
+{
+    memcpy(dst, &v, sizeof(v));
+}
+
+static void trace_put_entry(uint8_t* dst, char kind, uint8_t id, const char* name)
+{
+    dst[0] = (uint8_t)kind;
+    dst[1] = id;
+    memset(&dst[2], 0, TRACE_NAME_LEN);
+    strncpy((char*)&dst[2], name, TRACE_NAME_LEN);
+}
+
+/* Task and queue names, so the events can be labelled */
+static void trace_send_info(void)
+{
+    static TaskStatus_t tasks[TRACE_INFO_TASKS];
+    TraceStream_t* s = &trace_stream;
+    UBaseType_t n = uxTaskGetSystemState(tasks, TRACE_INFO_TASKS, NULL);
+    u16_t len = (u16_t)(8U + (n + trace_queue_count) * TRACE_INFO_ENTRY_LEN);
+    struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+    uint8_t* b;
+
+    if (p == NULL) {
+        return;
+    }
+    b = p->payload;
+    trace_put32(&b[0], TRACE_MAGIC_INFO);
+    trace_put32(&b[4], SystemCoreClock);
+    b += 8;
+    for (UBaseType_t i = 0; i < n; i++) {
+        trace_put_entry(b, 'T', (uint8_t)tasks[i].xTaskNumber, tasks[i].pcTaskName);
+        b += TRACE_INFO_ENTRY_LEN;
+    }
+    for (uint32_t i = 0; i < trace_queue_count; i++) {
+        trace_put_entry(b, 'Q', (uint8_t)(i + 1U), trace_queue_names[i]);
+        b += TRACE_INFO_ENTRY_LEN;
+    }
+    (void)udp_sendto(s->pcb, p, &s->peer, s->port);
+    pbuf_free(p);
+}
+
+/* One datagram from tail; false when there is nothing more to send */
+static bool trace_send_events(void)
+{
+    TraceStream_t* s = &trace_stream;
+    uint32_t head = trace_head;
+    uint32_t n;
+    struct pbuf* p;
+    uint8_t* b;
+
+    if (head - s->tail > TRACE_REC_EVENTS) {
+        s->lost += head - s->tail - TRACE_REC_EVENTS;
+        s->tail = head - TRACE_REC_EVENTS;
+    }
+    n = LWIP_MIN(head - s->tail, TRACE_DGRAM_EVENTS);
+    if (n == 0U) {
+        return false;
+    }
+    p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)(TRACE_HDR_LEN + n * sizeof(TraceEvent_t)), PBUF_RAM);
+    if (p == NULL) {
+        return false;
+    }
+    b = p->payload;
+    for (uint32_t i = 0; i < n; i++) {
+        memcpy(&b[TRACE_HDR_LEN + i * sizeof(TraceEvent_t)],
+               &trace_ring[(s->tail + i) & (TRACE_REC_EVENTS - 1U)], sizeof(TraceEvent_t));
+    }
+    /* Overwritten while being copied: the writer lapped the first ones */
+    if (trace_head - s->tail > TRACE_REC_EVENTS) {
+        pbuf_free(p);
+        s->lost += n;
+        s->tail += n;
+        return true;
+    }
+    trace_put32(&b[0], TRACE_MAGIC_EVENTS);
+    trace_put32(&b[4], s->seq++);
+    trace_put32(&b[8], s->lost);
+    trace_put32(&b[12], s->tail);
+    (void)udp_sendto(s->pcb, p, &s->peer, s->port);
+    pbuf_free(p);
+    s->tail += n;
+    return n == TRACE_DGRAM_EVENTS;
+}
+
+/* Runs on the tcpip thread */
+static void trace_stream_timer(void* arg)
+{
+    TraceStream_t* s = &trace_stream;
+
+    (void)arg;
+    if (sys_now() - s->last_rx_ms > TRACE_REC_STREAM_IDLE_MS) {
+        s->on = false;
+        LOG_INFO(TRACE_TAG, "stream to %s idle, stopped", ipaddr_ntoa(&s->peer));
+        return;
+    }
+    for (uint32_t i = 0; i < TRACE_DGRAM_BURST && trace_send_events(); i++) {
+    }
+    sys_timeout(TRACE_REC_STREAM_MS, trace_stream_timer, NULL);
+}
+
+static void trace_stream_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    TraceStream_t* s = &trace_stream;
+    char cmd[8] = { 0 };
+
+    (void)arg;
+    (void)pcb;
+    (void)pbuf_copy_partial(p, cmd, sizeof(cmd) - 1U, 0);
+    pbuf_free(p);
+    if (strncmp(cmd, "start", 5) == 0) {
+        s->last_rx_ms = sys_now();
+        if (s->on && ip_addr_cmp(&s->peer, addr) && s->port == port) {
+            /* Keepalive */
+            return;
+        }
+        ip_addr_copy(s->peer, *addr);
+        s->port = port;
+        s->seq = 0U;
+        s->lost = 0U;
+        s->tail = (trace_head > TRACE_REC_EVENTS) ? trace_head - TRACE_REC_EVENTS : 0U;
+        trace_send_info();
+        if (!s->on) {
+            s->on = true;
+            sys_timeout(TRACE_REC_STREAM_MS, trace_stream_timer, NULL);
+        }
+        LOG_INFO(TRACE_TAG, "stream to %s:%u", ipaddr_ntoa(addr), (unsigned)port);
+    } else if (strncmp(cmd, "stop", 4) == 0 && s->on) {
+        s->on = false;
+        sys_untimeout(trace_stream_timer, NULL);
+        LOG_INFO(TRACE_TAG, "stream stopped, %lu events lost", s->lost);
+    }
+}
+
+void trace_rec_init(void)
+{
+#if LWIP_TCPIP_CORE_LOCKING
+    (void)trace_rec_name_queue(lock_tcpip_core, "tcpip_core");
+#endif
+    LOCK_TCPIP_CORE();
+    trace_stream.pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if (trace_stream.pcb != NULL && udp_bind(trace_stream.pcb, IP_ANY_TYPE, TRACE_REC_UDP_PORT) == ERR_OK) {
+        udp_recv(trace_stream.pcb, trace_stream_recv, NULL);
+    } else {
+        if (trace_stream.pcb != NULL) {
+            udp_remove(trace_stream.pcb);
+            trace_stream.pcb = NULL;
+        }
+        LOG_ERROR(TRACE_TAG, "no stream port %u", (unsigned)TRACE_REC_UDP_PORT);
+    }
+    UNLOCK_TCPIP_CORE();
+}
+
+#endif /* TRACE_REC */
@@ -0,0 +1,159 @@
+/**
+ * @file trace_rec.h
+ * @brief FreeRTOS trace hooks recording a task / ISR timeline into RAM.
+ *
+ * With TRACE_REC set (FreeRTOSConfig.h), the kernel trace macros record
+ * 8-byte events: DWT cycle count, event type, the running task and one
+ * argument. Task switches, ready transitions, task notifications,
+ * priority inheritance and interrupts (trace_rec_isr_enter/exit) are
+ * always recorded. Queue, semaphore and mutex operations only for objects
+ * named with trace_rec_name_queue(), e.g. the lwIP core lock and the
+ * logger mutex, so the ring holds the contended objects rather than every
+ * mbox post.
+ *
+ * Readout:
+ *  - UDP: a datagram "start" to TRACE_REC_UDP_PORT makes the tcpip thread
+ *    stream the ring to the sender, from the oldest event on, every
+ *    TRACE_REC_STREAM_MS; "stop" ends it, as does TRACE_REC_STREAM_IDLE_MS
+ *    without a datagram from the client (send "start" again to keep it).
+ *    First an info datagram:   "TRCI" u32 cpu_hz, then 18-byte entries
+ *                              { u8 kind 'T'/'Q', u8 id, char name[16] }
+ *    then event datagrams:     "TRCE" u32 seq, u32 lost, u32 index of the
+ *                              first event, TraceEvent_t events[]
+ *    Fields are little endian. The cycle counter wraps every 2^32 cycles;
+ *    the stream is dense enough to unwrap it.
+ *  - SWO: with TRACE_REC_ITM, each event is also written to ITM stimulus
+ *    port TRACE_REC_ITM_PORT as two words, when the debugger enabled it.
+ */
+
+#pragma once
+
+#ifndef TRACE_REC_H
+#define TRACE_REC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Set in FreeRTOSConfig.h, where the trace macros are defined */
+#ifndef TRACE_REC
+#define TRACE_REC 0
+#endif
+
+/* Ring length, a power of two */
+#ifndef TRACE_REC_EVENTS
+#define TRACE_REC_EVENTS 2048U
+#endif
+
+/* Placement of the ring; default NOINIT (AXI, main.h), only events recorded
+ * since the boot are read */
+#ifndef TRACE_REC_SECTION
+#define TRACE_REC_SECTION NOINIT
+#endif
+
+#ifndef TRACE_REC_UDP_PORT
+#define TRACE_REC_UDP_PORT 5003U
+#endif
+
+#ifndef TRACE_REC_STREAM_MS
+#define TRACE_REC_STREAM_MS 20U
+#endif
+
+#ifndef TRACE_REC_STREAM_IDLE_MS
+#define TRACE_REC_STREAM_IDLE_MS 60000U
+#endif
+
+/* Objects named by trace_rec_name_queue(), id 1..n */
+#ifndef TRACE_REC_MAX_QUEUES
+#define TRACE_REC_MAX_QUEUES 8U
+#endif
+
+/* Blocks while the SWO FIFO is full: slows everything down to the SWO rate */
+#ifndef TRACE_REC_ITM
+#define TRACE_REC_ITM 0
+#endif
+
+#ifndef TRACE_REC_ITM_PORT
+#define TRACE_REC_ITM_PORT 1U
+#endif
+
+typedef enum {
+    TRACE_EV_TASK_IN = 1,       /* arg: task number */
+    TRACE_EV_TASK_READY,        /* arg: task number */
+    TRACE_EV_ISR_ENTER,         /* arg: IRQ number */
+    TRACE_EV_ISR_EXIT,          /* arg: IRQ number */
+    TRACE_EV_Q_SEND,            /* arg: queue id; mutex give */
+    TRACE_EV_Q_RECV,            /* arg: queue id; mutex take */
+    TRACE_EV_Q_BLOCK_SEND,      /* arg: queue id */
+    TRACE_EV_Q_BLOCK_RECV,      /* arg: queue id; waiting for a mutex */
+    TRACE_EV_Q_SEND_ISR,        /* arg: queue id */
+    TRACE_EV_PRIO_INHERIT,      /* arg: holder task << 8 | new priority */
+    TRACE_EV_PRIO_DISINHERIT,   /* arg: holder task << 8 | restored priority */
+    TRACE_EV_NOTIFY,            /* arg: notified task number */
+    TRACE_EV_NOTIFY_BLOCK,      /* ulTaskNotifyTake() blocks */
+    TRACE_EV_NOTIFY_TAKE,       /* ulTaskNotifyTake() returns */
+    TRACE_EV_USER,              /* arg: trace_rec_mark() value */
+} TraceEventType_t;
+
+typedef struct {
+    uint32_t cycles;            /* DWT CYCCNT */
+    uint8_t type;               /* TraceEventType_t */
+    uint8_t task;               /* task number of the running task, 0: before the scheduler */
+    uint16_t arg;
+} TraceEvent_t;
+
+#if TRACE_REC
+
+/* Task currently running, set on every switch */
+extern volatile uint8_t trace_rec_task;
+
+/* From any context up to configMAX_SYSCALL_INTERRUPT_PRIORITY */
+void trace_rec_event(uint8_t type, uint16_t arg);
+
+static inline void trace_rec_task_in(uint8_t number)
+{
+    trace_rec_task = number;
+    trace_rec_event(TRACE_EV_TASK_IN, number);
+}
+
+static inline void trace_rec_queue(uint8_t type, uint32_t id)
+{
+    if (id != 0U) {
+        trace_rec_event(type, (uint16_t)id);
+    }
+}
+
+static inline void trace_rec_isr_enter(uint16_t irqn)
+{
+    trace_rec_event(TRACE_EV_ISR_ENTER, irqn);
+}
+
+static inline void trace_rec_isr_exit(uint16_t irqn)
+{
+    trace_rec_event(TRACE_EV_ISR_EXIT, irqn);
+}
+
+/* Application marker, e.g. around a control loop iteration */
+static inline void trace_rec_mark(uint16_t value)
+{
+    trace_rec_event(TRACE_EV_USER, value);
+}
+
+/* Records operations on a queue, semaphore or mutex handle from now on
+ * under name (kept, not copied). False when TRACE_REC_MAX_QUEUES are used. */
+bool trace_rec_name_queue(void* handle, const char* name);
+
+/* Names the lwIP core lock and opens the UDP port. Call once from a task
+ * after MX_LWIP_Init(). */
+void trace_rec_init(void);
+
+#endif /* TRACE_REC */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_REC_H */
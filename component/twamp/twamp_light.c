@@ -0,0 +1,498 @@
+/**
+ * @file twamp_light.c
+ * @brief TWAMP-light reflector and sender on the tcpip thread, see
+ *        twamp_light.h.
+ */
+
+#include "twamp_light.h"
+
+#include "lwip/opt.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#include "lwip/ip.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/pbuf.h"
+#include "lwip/def.h"
+#include "lwip/timeouts.h"
+#include "logger/syslog.h"
+#include "lathist/lat_hist.h"
+#include "metrics/metrics.h"
+#include "timesync/time_ns.h"
+#include "timesync/timesync.h"
+#if TWAMP_LIGHT_FAST
+#include "ethernetif.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#define TWAMP_TAG "TWAMP"
+
+#define TWAMP_TEST_LEN          ((uint16_t)sizeof(TwampTest_t))
+#define TWAMP_REFLECT_LEN       ((uint16_t)sizeof(TwampReflect_t))
+/* 1900 to 1970 */
+#define TWAMP_NTP_UNIX_S        2208988800UL
+#define TWAMP_NS_PER_S          1000000000ULL
+#define TWAMP_HIST_NAME         40U
+
+_Static_assert((TWAMP_LIGHT_RX_SLOTS & (TWAMP_LIGHT_RX_SLOTS - 1U)) == 0U,
+               "TWAMP_LIGHT_RX_SLOTS not a power of two");
+_Static_assert(TWAMP_LIGHT_PROBE_LEN >= sizeof(TwampTest_t), "TWAMP_LIGHT_PROBE_LEN below a test packet");
+_Static_assert(TWAMP_LIGHT_MSG_MAX >= sizeof(TwampReflect_t), "TWAMP_LIGHT_MSG_MAX below a reflected packet");
+
+typedef enum {
+    TWAMP_HIST_RTT = 0,
+    TWAMP_HIST_FWD,
+    TWAMP_HIST_BACK,
+    TWAMP_HIST_JITTER,
+    TWAMP_HIST_CNT
+} TwampHist_t;
+
+static const char* const twamp_hist_suffix[TWAMP_HIST_CNT] = { "rtt_ns", "fwd_ns", "back_ns", "jitter_ns" };
+
+typedef struct {
+    const char* name;
+    ip_addr_t addr;
+    uint16_t port;
+    /* tcpip thread */
+    uint32_t seq;           /* of the next probe */
+    bool waiting;           /* the last probe has no answer yet */
+    bool have_rtt;
+    uint32_t last_rtt;
+    TwampLightPeerStats_t stats;
+    LatHist_t hist[TWAMP_HIST_CNT];
+#if METRICS
+    char hist_name[TWAMP_HIST_CNT][TWAMP_HIST_NAME];
+#endif
+} TwampPeer_t;
+
+#if TWAMP_LIGHT_FAST
+typedef struct {
+    struct pbuf* p;
+    ip4_addr_t src;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint64_t t_rx;          /* time_now_ns() at the hand-over */
+} TwampRx_t;
+#endif
+
+typedef struct {
+    struct udp_pcb* reflector;
+    struct udp_pcb* sender;
+    uint32_t seq;           /* reflector's */
+    TwampPeer_t peers[TWAMP_LIGHT_PEERS];
+    uint32_t peer_count;
+    TwampLightStats_t stats;
+    LatHist_t reflect;
+    LatHist_t rx;
+    LatHist_t tx;
+#if TWAMP_LIGHT_FAST
+    /* EthIf task to tcpip thread, single producer, single consumer */
+    TwampRx_t ring[TWAMP_LIGHT_RX_SLOTS];
+    volatile uint32_t rx_head;
+    volatile uint32_t rx_tail;
+    struct tcpip_callback_msg* rx_msg;
+    bool rx_pending;
+#endif
+} TwampLight_t;
+
+static TwampLight_t twamp;
+
+static inline uint32_t twamp_clamp(uint64_t ns)
+{
+    return (ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)ns;
+}
+
+/* NTP timestamp, network byte order */
+typedef struct {
+    uint32_t sec;
+    uint32_t frac;
+} TwampNtp_t;
+
+/* UTC of a time_now_ns() value, in NTP format (era 0) */
+static TwampNtp_t twamp_ntp(uint64_t mono)
+{
+    uint64_t utc = time_utc_ns() - (time_now_ns() - mono);
+    uint64_t ns = utc % TWAMP_NS_PER_S;
+    TwampNtp_t ts;
+
+    ts.sec = lwip_htonl((uint32_t)(utc / TWAMP_NS_PER_S + TWAMP_NTP_UNIX_S));
+    ts.frac = lwip_htonl((uint32_t)((ns << 32) / TWAMP_NS_PER_S));
+    return ts;
+}
+
+/* NTP timestamp in network byte order to ns, for differences */
+static int64_t twamp_ns(uint32_t sec, uint32_t frac)
+{
+    return (int64_t)lwip_ntohl(sec) * (int64_t)TWAMP_NS_PER_S +
+           (int64_t)(((uint64_t)lwip_ntohl(frac) * TWAMP_NS_PER_S) >> 32);
+}
+
+static uint16_t twamp_err(void)
+{
+    uint16_t err = (uint16_t)((TWAMP_LIGHT_ERR_SCALE << 8) | TWAMP_LIGHT_ERR_MULT);
+
+#if TIMESYNC
+    if (timesync_synced()) {
+        err |= TWAMP_ERR_S;
+    }
+#endif
+    return lwip_htons(err);
+}
+
+/* A test packet to TWAMP_LIGHT_PORT, received at t_rx: answered with a
+ * reflected packet as long as it */
+static void twamp_reflect(struct pbuf* in, const ip_addr_t* src, uint16_t src_port, uint8_t ttl, uint64_t t_rx)
+{
+    uint16_t len = (in->tot_len > TWAMP_REFLECT_LEN) ? in->tot_len : TWAMP_REFLECT_LEN;
+    TwampTest_t test;
+    TwampReflect_t* r;
+    struct pbuf* p;
+    TwampNtp_t ts;
+    uint64_t t_tx;
+    err_t err;
+
+    if ((in->tot_len < TWAMP_TEST_LEN) || (in->tot_len > TWAMP_LIGHT_MSG_MAX) ||
+        (pbuf_copy_partial(in, &test, TWAMP_TEST_LEN, 0) != TWAMP_TEST_LEN)) {
+        twamp.stats.bad++;
+        return;
+    }
+    p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+    if (p == NULL) {
+        twamp.stats.tx_errors++;
+        return;
+    }
+    memset(p->payload, 0, len);
+    r = (TwampReflect_t*)p->payload;
+    r->seq = lwip_htonl(twamp.seq);
+    r->err = twamp_err();
+    ts = twamp_ntp(t_rx);
+    r->rx_sec = ts.sec;
+    r->rx_frac = ts.frac;
+    r->sender_seq = test.seq;
+    r->sender_sec = test.ts_sec;
+    r->sender_frac = test.ts_frac;
+    r->sender_err = test.err;
+    r->sender_ttl = ttl;
+    /* T3 as late as it can be written */
+    t_tx = time_now_ns();
+    ts = twamp_ntp(t_tx);
+    r->ts_sec = ts.sec;
+    r->ts_frac = ts.frac;
+    err = udp_sendto(twamp.reflector, p, src, src_port);
+    pbuf_free(p);
+    if (err != ERR_OK) {
+        twamp.stats.tx_errors++;
+        return;
+    }
+    twamp.seq++;
+    twamp.stats.reflected++;
+    lat_hist_add(&twamp.reflect, twamp_clamp(t_tx - t_rx));
+}
+
+static TwampPeer_t* twamp_find(const ip_addr_t* addr, uint16_t port)
+{
+    for (uint32_t i = 0U; i < twamp.peer_count; i++) {
+        if ((twamp.peers[i].port == port) && ip_addr_cmp(&twamp.peers[i].addr, addr)) {
+            return &twamp.peers[i];
+        }
+    }
+    return NULL;
+}
+
+/* A reflected packet to TWAMP_LIGHT_SENDER_PORT, received at t_rx */
+static void twamp_answer(struct pbuf* in, const ip_addr_t* src, uint16_t src_port, uint64_t t_rx)
+{
+    TwampPeer_t* peer = twamp_find(src, src_port);
+    TwampNtp_t ts;
+    TwampReflect_t r;
+    int64_t t1, t2, t3, t4;
+    int64_t rtt;
+    uint32_t v;
+
+    lat_hist_add(&twamp.rx, twamp_clamp(time_now_ns() - t_rx));
+    if ((peer == NULL) || (in->tot_len < TWAMP_REFLECT_LEN) ||
+        (pbuf_copy_partial(in, &r, TWAMP_REFLECT_LEN, 0) != TWAMP_REFLECT_LEN)) {
+        twamp.stats.bad++;
+        return;
+    }
+    if (!peer->waiting || (lwip_ntohl(r.sender_seq) != peer->seq - 1U)) {
+        peer->stats.late++;
+        return;
+    }
+    peer->waiting = false;
+    peer->stats.answered++;
+
+    ts = twamp_ntp(t_rx);
+    t1 = twamp_ns(r.sender_sec, r.sender_frac);
+    t2 = twamp_ns(r.rx_sec, r.rx_frac);
+    t3 = twamp_ns(r.ts_sec, r.ts_frac);
+    t4 = twamp_ns(ts.sec, ts.frac);
+    rtt = (t4 - t1) - (t3 - t2);
+    if (rtt < 0) {
+        /* A reflector residence longer than the round trip: its clock
+         * runs off */
+        peer->stats.skew++;
+        return;
+    }
+    v = twamp_clamp((uint64_t)rtt);
+    lat_hist_add(&peer->hist[TWAMP_HIST_RTT], v);
+    if (peer->have_rtt) {
+        lat_hist_add(&peer->hist[TWAMP_HIST_JITTER], (peer->last_rtt > v) ? peer->last_rtt - v : v - peer->last_rtt);
+    }
+    peer->have_rtt = true;
+    peer->last_rtt = v;
+
+    /* One-way only between synchronized clocks */
+    if (((lwip_ntohs(r.err) & TWAMP_ERR_S) == 0U) || ((lwip_ntohs(r.sender_err) & TWAMP_ERR_S) == 0U)) {
+        return;
+    }
+    if ((t2 < t1) || (t4 < t3)) {
+        peer->stats.skew++;
+        return;
+    }
+    lat_hist_add(&peer->hist[TWAMP_HIST_FWD], twamp_clamp((uint64_t)(t2 - t1)));
+    lat_hist_add(&peer->hist[TWAMP_HIST_BACK], twamp_clamp((uint64_t)(t4 - t3)));
+}
+
+/* tcpip thread */
+static void twamp_input(struct pbuf* p, const ip_addr_t* src, uint16_t src_port, uint16_t dst_port, uint8_t ttl,
+                        uint64_t t_rx)
+{
+    if (dst_port == TWAMP_LIGHT_PORT) {
+        twamp_reflect(p, src, src_port, ttl, t_rx);
+    } else {
+        twamp_answer(p, src, src_port, t_rx);
+    }
+    pbuf_free(p);
+}
+
+static void twamp_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    uint64_t t_rx = time_now_ns();
+    const struct ip_hdr* iph = ip4_current_header();
+
+    (void)arg;
+    twamp_input(p, addr, port, pcb->local_port, (iph != NULL) ? IPH_TTL(iph) : 0U, t_rx);
+}
+
+#if TWAMP_LIGHT_FAST
+/* tcpip thread: everything the fast path queued */
+static void twamp_drain(void* arg)
+{
+    uint32_t head;
+
+    (void)arg;
+    /* Cleared first: a packet queued after the drain schedules another run */
+    __atomic_store_n(&twamp.rx_pending, false, __ATOMIC_SEQ_CST);
+    head = __atomic_load_n(&twamp.rx_head, __ATOMIC_ACQUIRE);
+    while (twamp.rx_tail != head) {
+        TwampRx_t r = twamp.ring[twamp.rx_tail % TWAMP_LIGHT_RX_SLOTS];
+        ip_addr_t src;
+
+        __atomic_store_n(&twamp.rx_tail, twamp.rx_tail + 1U, __ATOMIC_RELEASE);
+        ip_addr_copy_from_ip4(src, r.src);
+        twamp_input(r.p, &src, r.src_port, r.dst_port, 0U, r.t_rx);
+    }
+}
+
+/* EthIf task: stamped at the hand-over from the driver, processed on the
+ * tcpip thread */
+static void twamp_fast_rx(struct pbuf* p, const ip4_addr_t* src, uint16_t src_port, void* arg)
+{
+    uint64_t t_rx = time_now_ns();
+    uint32_t head = twamp.rx_head;
+    TwampRx_t* r;
+
+    if ((head - __atomic_load_n(&twamp.rx_tail, __ATOMIC_ACQUIRE)) >= TWAMP_LIGHT_RX_SLOTS) {
+        twamp.stats.overruns++;
+        pbuf_free(p);
+        return;
+    }
+    r = &twamp.ring[head % TWAMP_LIGHT_RX_SLOTS];
+    r->p = p;
+    ip4_addr_copy(r->src, *src);
+    r->src_port = src_port;
+    r->dst_port = (uint16_t)(uintptr_t)arg;
+    r->t_rx = t_rx;
+    __atomic_store_n(&twamp.rx_head, head + 1U, __ATOMIC_RELEASE);
+    if (!__atomic_exchange_n(&twamp.rx_pending, true, __ATOMIC_SEQ_CST) &&
+        (tcpip_callbackmsg_trycallback(twamp.rx_msg) != ERR_OK)) {
+        /* Mailbox full: the next packet tries again */
+        __atomic_store_n(&twamp.rx_pending, false, __ATOMIC_SEQ_CST);
+    }
+}
+#endif /* TWAMP_LIGHT_FAST */
+
+/* tcpip thread, every TWAMP_LIGHT_PERIOD_MS while there are peers */
+static void twamp_probe(void* arg)
+{
+    (void)arg;
+    for (uint32_t i = 0U; i < twamp.peer_count; i++) {
+        TwampPeer_t* peer = &twamp.peers[i];
+        struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, TWAMP_LIGHT_PROBE_LEN, PBUF_RAM);
+        TwampTest_t* t;
+        TwampNtp_t ts;
+        uint64_t t1;
+        err_t err;
+
+        if (peer->waiting) {
+            peer->stats.lost++;
+            peer->waiting = false;
+        }
+        if (p == NULL) {
+            twamp.stats.tx_errors++;
+            continue;
+        }
+        memset(p->payload, 0, TWAMP_LIGHT_PROBE_LEN);
+        t = (TwampTest_t*)p->payload;
+        t->seq = lwip_htonl(peer->seq);
+        t->err = twamp_err();
+        t1 = time_now_ns();
+        ts = twamp_ntp(t1);
+        t->ts_sec = ts.sec;
+        t->ts_frac = ts.frac;
+        err = udp_sendto(twamp.sender, p, &peer->addr, peer->port);
+        lat_hist_add(&twamp.tx, twamp_clamp(time_now_ns() - t1));
+        pbuf_free(p);
+        if (err != ERR_OK) {
+            twamp.stats.tx_errors++;
+            continue;
+        }
+        peer->seq++;
+        peer->waiting = true;
+        peer->stats.sent++;
+    }
+    sys_timeout(TWAMP_LIGHT_PERIOD_MS, twamp_probe, NULL);
+}
+
+#if METRICS
+/* Runs on the tcpip thread; the histograms are registered on their own */
+static void twamp_metrics(MetricsWriter_t* w)
+{
+    char name[METRICS_NAME_MAX];
+
+    metrics_emit(w, "twamp.reflected", METRIC_COUNTER, twamp.stats.reflected);
+    metrics_emit(w, "twamp.bad", METRIC_COUNTER, twamp.stats.bad);
+    metrics_emit(w, "twamp.overruns", METRIC_COUNTER, twamp.stats.overruns);
+    metrics_emit(w, "twamp.tx_errors", METRIC_COUNTER, twamp.stats.tx_errors);
+    for (uint32_t i = 0U; i < twamp.peer_count; i++) {
+        const TwampPeer_t* peer = &twamp.peers[i];
+
+        snprintf(name, sizeof(name), "twamp.%s.sent", peer->name);
+        metrics_emit(w, name, METRIC_COUNTER, peer->stats.sent);
+        snprintf(name, sizeof(name), "twamp.%s.answered", peer->name);
+        metrics_emit(w, name, METRIC_COUNTER, peer->stats.answered);
+        snprintf(name, sizeof(name), "twamp.%s.lost", peer->name);
+        metrics_emit(w, name, METRIC_COUNTER, peer->stats.lost);
+        snprintf(name, sizeof(name), "twamp.%s.late", peer->name);
+        metrics_emit(w, name, METRIC_COUNTER, peer->stats.late);
+        snprintf(name, sizeof(name), "twamp.%s.skew", peer->name);
+        metrics_emit(w, name, METRIC_COUNTER, peer->stats.skew);
+    }
+}
+#endif
+
+static struct udp_pcb* twamp_bind(uint16_t port)
+{
+    struct udp_pcb* pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+
+    if ((pcb != NULL) && (udp_bind(pcb, IP_ANY_TYPE, port) != ERR_OK)) {
+        udp_remove(pcb);
+        pcb = NULL;
+    }
+    if (pcb != NULL) {
+        udp_recv(pcb, twamp_recv, NULL);
+#if TWAMP_LIGHT_FAST
+        (void)ethernetif_udp_fast_register(port, twamp_fast_rx, (void*)(uintptr_t)port);
+#endif
+    }
+    return pcb;
+}
+
+bool twamp_light_start(void)
+{
+    bool ok;
+
+    if (twamp.reflector != NULL) {
+        return false;
+    }
+#if TWAMP_LIGHT_FAST
+    /* Before the fast path can post it */
+    twamp.rx_msg = tcpip_callbackmsg_new(twamp_drain, NULL);
+    if (twamp.rx_msg == NULL) {
+        LOG_ERROR(TWAMP_TAG, "no callback message");
+        return false;
+    }
+#endif
+#if METRICS
+    (void)metrics_register_collector(twamp_metrics);
+    (void)metrics_register_hist("twamp.reflect_ns", &twamp.reflect);
+    (void)metrics_register_hist("twamp.rx_ns", &twamp.rx);
+    (void)metrics_register_hist("twamp.tx_ns", &twamp.tx);
+#endif
+
+    LOCK_TCPIP_CORE();
+    twamp.reflector = twamp_bind(TWAMP_LIGHT_PORT);
+    twamp.sender = twamp_bind(TWAMP_LIGHT_SENDER_PORT);
+    ok = (twamp.reflector != NULL) && (twamp.sender != NULL);
+    UNLOCK_TCPIP_CORE();
+
+    if (!ok) {
+        LOG_ERROR(TWAMP_TAG, "ports %u/%u not bound", (unsigned)TWAMP_LIGHT_PORT, (unsigned)TWAMP_LIGHT_SENDER_PORT);
+        return false;
+    }
+    LOG_INFO(TWAMP_TAG, "reflector on port %u, probes from %u every %u ms, %s receive", (unsigned)TWAMP_LIGHT_PORT,
+             (unsigned)TWAMP_LIGHT_SENDER_PORT, (unsigned)TWAMP_LIGHT_PERIOD_MS,
+             TWAMP_LIGHT_FAST ? "fast path" : "udp");
+    return true;
+}
+
+bool twamp_light_add_peer(const char* name, const ip_addr_t* addr, uint16_t port)
+{
+    char ip[IPADDR_STRLEN_MAX];
+    TwampPeer_t* peer;
+    bool first;
+
+    if ((twamp.sender == NULL) || (twamp.peer_count >= TWAMP_LIGHT_PEERS)) {
+        return false;
+    }
+    peer = &twamp.peers[twamp.peer_count];
+    peer->name = name;
+    ip_addr_copy(peer->addr, *addr);
+    peer->port = port;
+#if METRICS
+    for (uint32_t i = 0U; i < TWAMP_HIST_CNT; i++) {
+        snprintf(peer->hist_name[i], TWAMP_HIST_NAME, "twamp.%s.%s", name, twamp_hist_suffix[i]);
+        (void)metrics_register_hist(peer->hist_name[i], &peer->hist[i]);
+    }
+#else
+    (void)twamp_hist_suffix;
+#endif
+
+    LOCK_TCPIP_CORE();
+    first = (twamp.peer_count == 0U);
+    /* Probed from the next period on */
+    twamp.peer_count++;
+    if (first) {
+        sys_timeout(TWAMP_LIGHT_PERIOD_MS, twamp_probe, NULL);
+    }
+    UNLOCK_TCPIP_CORE();
+
+    LOG_INFO(TWAMP_TAG, "peer %s: %s:%u", name, ipaddr_ntoa_r(addr, ip, sizeof(ip)), (unsigned)port);
+    return true;
+}
+
+void twamp_light_get_stats(TwampLightStats_t* stats)
+{
+    *stats = twamp.stats;
+}
+
+bool twamp_light_get_peer(uint32_t index, TwampLightPeerStats_t* stats)
+{
+    if (index >= __atomic_load_n(&twamp.peer_count, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    *stats = twamp.peers[index].stats;
+    return true;
+}
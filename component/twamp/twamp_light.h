@@ -0,0 +1,179 @@
+/**
+ * @file twamp_light.h
+ * @brief TWAMP-light reflector and sender: network round trip, one-way
+ *        delay and jitter to configured peers.
+ *
+ * The reflector answers every test packet (RFC 5357, unauthenticated
+ * mode, the stateless "light" variant of RFC 5357 appendix I) arriving on
+ * TWAMP_LIGHT_PORT with a reflected packet carrying the time it was
+ * received (T2), the time the answer was sent (T3), and the sender's
+ * sequence number, timestamp and error estimate. Any TWAMP-light sender
+ * measures against it.
+ *
+ * The sender sends one test packet every TWAMP_LIGHT_PERIOD_MS to each
+ * peer added with twamp_light_add_peer(), from TWAMP_LIGHT_SENDER_PORT,
+ * stamped T1, and takes the reflected packet at T4. Per peer, in
+ * nanoseconds, as LatHist_t:
+ *   rtt       (T4 - T1) - (T3 - T2): the network round trip alone, the
+ *             reflector's residence taken out
+ *   fwd, back T2 - T1 and T4 - T3, only while both ends report a
+ *             synchronized clock (the S bit of the error estimate,
+ *             timesync_synced() here); negative ones count as skew
+ *   jitter    |rtt - previous rtt| of consecutive answers (IPDV)
+ * and the counts of probes sent, answered, lost (no answer by the next
+ * probe), answered late and skewed. Exported through metrics as
+ * "twamp.<name>.rtt_ns" etc.
+ *
+ * The stack's own share is measured on this side and kept out of the
+ * network figures:
+ *   twamp.reflect_ns  T2 to T3 as reflector, receive hand-over to the
+ *                     answer given to the driver
+ *   twamp.rx_ns       reflected packet from the receive hand-over to its
+ *                     processing on the tcpip thread
+ *   twamp.tx_ns       udp_sendto() of a probe, T1 to the frame queued
+ *
+ * Receive times are taken at the driver boundary: both ports are UDP fast
+ * path ports (ETHIF_UDP_FAST, ethernetif.h), stamped with the DWT-based
+ * time_now_ns() on the EthIf task as the driver hands them over, then
+ * processed on the tcpip thread; without it (TWAMP_LIGHT_FAST 0, the
+ * host build) the udp_recv() callback stamps them. The driver's IEEE 1588
+ * timestamps are not used: it timestamps PTP event messages only, and
+ * timestamping every frame would keep all small frames in their RX_POOL
+ * buffers. Timestamps go out in NTP format from time_utc_ns().
+ */
+
+#pragma once
+
+#ifndef TWAMP_LIGHT_H
+#define TWAMP_LIGHT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lwip/ip_addr.h"
+
+/* 0 leaves the reflector out of the startup code */
+#ifndef TWAMP_LIGHT
+#define TWAMP_LIGHT 1
+#endif
+
+/* Receive on the EthIf task through ethernetif_udp_fast_register();
+ * 0: udp_recv() on the tcpip thread */
+#ifndef TWAMP_LIGHT_FAST
+#define TWAMP_LIGHT_FAST 1
+#endif
+
+/* Reflector port, the TWAMP well-known port */
+#ifndef TWAMP_LIGHT_PORT
+#define TWAMP_LIGHT_PORT 862U
+#endif
+
+/* Local port of the probes, where the answers come back */
+#ifndef TWAMP_LIGHT_SENDER_PORT
+#define TWAMP_LIGHT_SENDER_PORT 8620U
+#endif
+
+/* Probe interval, one sys_timeout() for all peers */
+#ifndef TWAMP_LIGHT_PERIOD_MS
+#define TWAMP_LIGHT_PERIOD_MS 1000U
+#endif
+
+/* Peers twamp_light_add_peer() accepts; four histograms each */
+#ifndef TWAMP_LIGHT_PEERS
+#define TWAMP_LIGHT_PEERS 2U
+#endif
+
+/* Probe length: the reflected packet's 41 bytes, so both directions
+ * carry the same size (RFC 6038) */
+#ifndef TWAMP_LIGHT_PROBE_LEN
+#define TWAMP_LIGHT_PROBE_LEN 41U
+#endif
+
+/* Longest test packet reflected; the answer is as long as the test */
+#ifndef TWAMP_LIGHT_MSG_MAX
+#define TWAMP_LIGHT_MSG_MAX 1024U
+#endif
+
+/* Received packets waiting for the tcpip thread (fast path), a power of
+ * two */
+#ifndef TWAMP_LIGHT_RX_SLOTS
+#define TWAMP_LIGHT_RX_SLOTS 8U
+#endif
+
+/* Error estimate sent, scale and multiplier: 2^-32 * 2^22 s, about 1 ms,
+ * the SNTP discipline's order of accuracy */
+#ifndef TWAMP_LIGHT_ERR_SCALE
+#define TWAMP_LIGHT_ERR_SCALE 22U
+#endif
+#ifndef TWAMP_LIGHT_ERR_MULT
+#define TWAMP_LIGHT_ERR_MULT 1U
+#endif
+
+/* Error estimate: S (synchronized), Z (0: NTP format), scale, multiplier */
+#define TWAMP_ERR_S             0x8000U
+#define TWAMP_ERR_Z             0x4000U
+
+/* Unauthenticated test packet of the sender, network byte order,
+ * padding follows */
+typedef struct __attribute__((packed)) {
+    uint32_t seq;
+    uint32_t ts_sec;        /* NTP: seconds since 1900 */
+    uint32_t ts_frac;       /* 2^-32 s */
+    uint16_t err;
+} TwampTest_t;
+
+/* Unauthenticated reflected packet, network byte order, padding follows */
+typedef struct __attribute__((packed)) {
+    uint32_t seq;           /* reflector's */
+    uint32_t ts_sec;        /* T3 */
+    uint32_t ts_frac;
+    uint16_t err;
+    uint16_t mbz1;
+    uint32_t rx_sec;        /* T2 */
+    uint32_t rx_frac;
+    uint32_t sender_seq;    /* echoed from the test packet */
+    uint32_t sender_sec;    /* T1 */
+    uint32_t sender_frac;
+    uint16_t sender_err;
+    uint16_t mbz2;
+    uint8_t sender_ttl;     /* 0 when the fast path does not see it */
+} TwampReflect_t;
+
+typedef struct {
+    uint32_t reflected;     /* test packets answered */
+    uint32_t bad;           /* shorter than a test packet, or not for a peer */
+    uint32_t overruns;      /* dropped on a full receive ring */
+    uint32_t tx_errors;     /* pbuf_alloc() or udp_sendto() failed */
+} TwampLightStats_t;
+
+typedef struct {
+    uint32_t sent;
+    uint32_t answered;
+    uint32_t lost;          /* no answer before the next probe */
+    uint32_t late;          /* answer to an earlier probe */
+    uint32_t skew;          /* a negative one-way delay: clocks apart */
+} TwampLightPeerStats_t;
+
+/* Binds both ports. Call once from a task, not holding the core lock,
+ * after time_ns_init() and metrics_init(). */
+bool twamp_light_start(void);
+
+/* Probes addr:port (a reflector, usually TWAMP_LIGHT_PORT) from now on;
+ * name, for the metrics, must outlive the sender. Any task, not holding
+ * the core lock. False when the table is full or not started. */
+bool twamp_light_add_peer(const char* name, const ip_addr_t* addr, uint16_t port);
+
+void twamp_light_get_stats(TwampLightStats_t* stats);
+
+/* False for an index without a peer */
+bool twamp_light_get_peer(uint32_t index, TwampLightPeerStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TWAMP_LIGHT_H */
@@ -0,0 +1,427 @@
+/**
+ * @file twheel.c
+ * @brief lwIP timeouts on a hierarchical timer wheel.
+ *
+ * A timeout due at time t is kept at the lowest level l whose granules
+ * (64^l ms each) number less than 64 from the wheel time Now to t, in slot
+ * (t >> 6l) & 63. For l > 0 its granule then starts after Now, and when
+ * Now reaches that start the slot is cascaded: each timeout in it is
+ * placed again and lands on a lower level. Level 0 slots hold timeouts
+ * due exactly at one millisecond. Now only advances to the next cascade
+ * or expiry, or to sys_now() when none is due by then, so no granule
+ * boundary with work in it is ever skipped.
+ */
+
+#include "twheel.h"
+
+#include "lwip/opt.h"
+
+#if LWIP_TIMERS && LWIP_TIMERS_CUSTOM && TWHEEL_LWIP
+
+#include "lwip/timeouts.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/sys.h"
+#include "netif/ppp/ppp_opts.h"
+#include "main.h"
+
+#include <string.h>
+
+#define TW_BITS         6U
+#define TW_SLOTS        (1U << TW_BITS)
+#define TW_MASK         (TW_SLOTS - 1U)
+#define TW_LEVELS       5U
+
+#define TW_HASH_BITS    5U
+#define TW_HASH         (1U << TW_HASH_BITS)
+
+/* Same wraparound rule as timeouts.c: t is before compare_to */
+#define TW_MAX_TIMEOUT  0x7FFFFFFFU
+#define TW_BEFORE(t, compare_to) ((uint32_t)((t) - (compare_to)) > TW_MAX_TIMEOUT)
+
+typedef struct TWheelNode {
+    struct TWheelNode* next; /* slot list, free list */
+    struct TWheelNode* prev;
+    struct TWheelNode* hnext; /* hash chain, sys_timeout() nodes only */
+    uint32_t time;           /* due, sys_now() milliseconds */
+    sys_timeout_handler handler;
+    void* arg;
+    const struct lwip_cyclic_timer* cyclic; /* NULL for sys_timeout() */
+    uint8_t level;
+    uint8_t slot;
+} TWheelNode_t;
+
+static TWheelNode_t Nodes[MEMP_NUM_SYS_TIMEOUT];
+static TWheelNode_t* FreeNodes;
+static TWheelNode_t* Slots[TW_LEVELS][TW_SLOTS];
+static uint64_t Busy[TW_LEVELS];
+static TWheelNode_t* Hash[TW_HASH];
+static uint32_t Now;
+static TWheelStats_t Stats;
+
+#if LWIP_TCP
+/* lwip_cyclic_timers[0], armed by tcp_timer_needed() while PCBs exist */
+static TWheelNode_t* TcpNode;
+static uint8_t TcpActive;
+#endif
+
+/* Granules of 2^shift ms from b to a, modulo the granules in 32 bits */
+static inline uint32_t tw_gdiff(uint32_t a, uint32_t b, uint32_t shift)
+{
+    return ((a >> shift) - (b >> shift)) & (0xFFFFFFFFU >> shift);
+}
+
+static inline uint32_t tw_hash(sys_timeout_handler handler, const void* arg)
+{
+    return ((uint32_t)((uintptr_t)handler ^ (uintptr_t)arg) * 2654435761U) >> (32U - TW_HASH_BITS);
+}
+
+static void tw_link(TWheelNode_t* n)
+{
+    uint32_t level = 0U;
+    uint32_t slot;
+
+    while ((level < (TW_LEVELS - 1U)) && (tw_gdiff(n->time, Now, TW_BITS * level) >= TW_SLOTS)) {
+        level++;
+    }
+    if (tw_gdiff(n->time, Now, TW_BITS * level) < TW_SLOTS) {
+        slot = (n->time >> (TW_BITS * level)) & TW_MASK;
+    } else {
+        /* Beyond the top level: its last granule, placed again from there */
+        slot = ((Now >> (TW_BITS * level)) + TW_MASK) & TW_MASK;
+    }
+
+    n->level = (uint8_t)level;
+    n->slot = (uint8_t)slot;
+    n->prev = NULL;
+    n->next = Slots[level][slot];
+    if (n->next != NULL) {
+        n->next->prev = n;
+    }
+    Slots[level][slot] = n;
+    Busy[level] |= 1ULL << slot;
+}
+
+static void tw_unlink(TWheelNode_t* n)
+{
+    if (n->prev != NULL) {
+        n->prev->next = n->next;
+    } else {
+        Slots[n->level][n->slot] = n->next;
+        if (n->next == NULL) {
+            Busy[n->level] &= ~(1ULL << n->slot);
+        }
+    }
+    if (n->next != NULL) {
+        n->next->prev = n->prev;
+    }
+}
+
+static void tw_hash_remove(TWheelNode_t* n)
+{
+    TWheelNode_t** pp = &Hash[tw_hash(n->handler, n->arg)];
+
+    while (*pp != n) {
+        pp = &(*pp)->hnext;
+    }
+    *pp = n->hnext;
+}
+
+static TWheelNode_t* tw_alloc(void)
+{
+    TWheelNode_t* n = FreeNodes;
+
+    if (n != NULL) {
+        FreeNodes = n->next;
+        Stats.used++;
+        if (Stats.used > Stats.max) {
+            Stats.max = Stats.used;
+        }
+    }
+    return n;
+}
+
+static void tw_free(TWheelNode_t* n)
+{
+    n->next = FreeNodes;
+    FreeNodes = n;
+    Stats.used--;
+}
+
+/* First multiple of interval after t: cyclic timers share their grid */
+static inline uint32_t tw_grid(uint32_t t, uint32_t interval)
+{
+    return (t / interval + 1U) * interval;
+}
+
+static void tw_arm_cyclic(TWheelNode_t* n, uint32_t after)
+{
+    n->time = tw_grid(after, n->cyclic->interval_ms);
+    tw_link(n);
+}
+
+/* Milliseconds from Now to the next cascade or expiry */
+static ITCM_FUNC uint32_t tw_next(void)
+{
+    uint32_t best = SYS_TIMEOUTS_SLEEPTIME_INFINITE;
+
+    for (uint32_t level = 0U; level < TW_LEVELS; level++) {
+        uint64_t busy = Busy[level];
+        uint32_t shift = TW_BITS * level;
+        uint32_t idx;
+        uint32_t d;
+        uint32_t off;
+
+        if (busy == 0U) {
+            continue;
+        }
+        idx = (Now >> shift) & TW_MASK;
+        busy = (busy >> idx) | (busy << ((TW_SLOTS - idx) & TW_MASK));
+        d = (uint32_t)__builtin_ctzll(busy);
+        if (level == 0U) {
+            off = d;
+        } else if (d == 0U) {
+            off = 0U;
+        } else {
+            off = ((((Now >> shift) + d) << shift) - Now);
+        }
+        if (off < best) {
+            best = off;
+        }
+    }
+    return best;
+}
+
+/* Slots whose granule starts at Now, highest level first */
+static void tw_cascade(void)
+{
+    for (uint32_t level = TW_LEVELS - 1U; level > 0U; level--) {
+        uint32_t shift = TW_BITS * level;
+        uint32_t slot;
+        TWheelNode_t* n;
+
+        if ((Now & ((1U << shift) - 1U)) != 0U) {
+            continue;
+        }
+        slot = (Now >> shift) & TW_MASK;
+        n = Slots[level][slot];
+        Slots[level][slot] = NULL;
+        Busy[level] &= ~(1ULL << slot);
+        while (n != NULL) {
+            TWheelNode_t* next = n->next;
+            tw_link(n);
+            Stats.cascades++;
+            n = next;
+        }
+    }
+}
+
+/* Handlers due at Now; whatever they arm for Now runs in the same pass */
+static uint32_t tw_expire(void)
+{
+    uint32_t slot = Now & TW_MASK;
+    uint32_t fired = 0U;
+    TWheelNode_t* n;
+
+    while ((n = Slots[0][slot]) != NULL) {
+        tw_unlink(n);
+        fired++;
+        if (n->cyclic == NULL) {
+            sys_timeout_handler handler = n->handler;
+            void* arg = n->arg;
+
+            tw_hash_remove(n);
+            tw_free(n);
+            handler(arg);
+            continue;
+        }
+        n->cyclic->handler();
+#if LWIP_TCP
+        if (n == TcpNode) {
+            if ((tcp_active_pcbs == NULL) && (tcp_tw_pcbs == NULL)) {
+                TcpActive = 0U;
+                continue;
+            }
+        }
+#endif
+        /* Late (a long handler before this one): resume on the grid */
+        uint32_t now = sys_now();
+        tw_arm_cyclic(n, TW_BEFORE(Now + n->cyclic->interval_ms, now) ? now : Now);
+    }
+    Stats.fired += fired;
+    return fired;
+}
+
+void sys_timeouts_init(void)
+{
+    memset(Slots, 0, sizeof(Slots));
+    memset(Busy, 0, sizeof(Busy));
+    memset(Hash, 0, sizeof(Hash));
+    memset(&Stats, 0, sizeof(Stats));
+    FreeNodes = NULL;
+    for (uint32_t i = 0U; i < LWIP_ARRAYSIZE(Nodes); i++) {
+        Nodes[i].next = FreeNodes;
+        FreeNodes = &Nodes[i];
+    }
+    Now = sys_now();
+
+    for (int i = 0; i < lwip_num_cyclic_timers; i++) {
+        TWheelNode_t* n = tw_alloc();
+
+        LWIP_ASSERT("sys_timeouts_init: MEMP_NUM_SYS_TIMEOUT too small", n != NULL);
+        n->cyclic = &lwip_cyclic_timers[i];
+        n->handler = NULL;
+        n->arg = NULL;
+#if LWIP_TCP
+        /* The TCP timer is the first entry and only runs while needed */
+        if (i == 0) {
+            TcpNode = n;
+            TcpActive = 0U;
+            continue;
+        }
+#endif
+        tw_arm_cyclic(n, Now);
+    }
+}
+
+#if LWIP_TCP
+void tcp_timer_needed(void)
+{
+    LWIP_ASSERT_CORE_LOCKED();
+    if ((TcpActive == 0U) && ((tcp_active_pcbs != NULL) || (tcp_tw_pcbs != NULL))) {
+        TcpActive = 1U;
+        tw_arm_cyclic(TcpNode, sys_now());
+    }
+}
+#endif
+
+#if LWIP_DEBUG_TIMERNAMES
+void sys_timeout_debug(u32_t msecs, sys_timeout_handler handler, void* arg, const char* handler_name)
+#else
+void sys_timeout(u32_t msecs, sys_timeout_handler handler, void* arg)
+#endif
+{
+    TWheelNode_t* n;
+    uint32_t time;
+
+    LWIP_ASSERT_CORE_LOCKED();
+    LWIP_ASSERT("Timeout time too long, max is LWIP_UINT32_MAX/4 msecs", msecs <= (LWIP_UINT32_MAX / 4));
+#if LWIP_DEBUG_TIMERNAMES
+    LWIP_UNUSED_ARG(handler_name);
+#endif
+
+    n = tw_alloc();
+    if (n == NULL) {
+        Stats.alloc_fail++;
+        LWIP_ASSERT("sys_timeout: timeout != NULL, pool MEMP_SYS_TIMEOUT is empty", n != NULL);
+        return;
+    }
+    time = sys_now() + msecs;
+#if TWHEEL_SLACK_MS
+    if (msecs >= TWHEEL_SLACK_MIN_MS) {
+        time = ((time + TWHEEL_SLACK_MS - 1U) / TWHEEL_SLACK_MS) * TWHEEL_SLACK_MS;
+    }
+#endif
+    n->time = time;
+    n->handler = handler;
+    n->arg = arg;
+    n->cyclic = NULL;
+    tw_link(n);
+
+    uint32_t h = tw_hash(handler, arg);
+    n->hnext = Hash[h];
+    Hash[h] = n;
+}
+
+void sys_untimeout(sys_timeout_handler handler, void* arg)
+{
+    TWheelNode_t** pp = &Hash[tw_hash(handler, arg)];
+
+    LWIP_ASSERT_CORE_LOCKED();
+    for (TWheelNode_t* n = *pp; n != NULL; pp = &n->hnext, n = n->hnext) {
+        if ((n->handler == handler) && (n->arg == arg)) {
+            *pp = n->hnext;
+            tw_unlink(n);
+            tw_free(n);
+            return;
+        }
+    }
+}
+
+ITCM_FUNC void sys_check_timeouts(void)
+{
+    uint32_t now = sys_now();
+    uint32_t fired = 0U;
+
+    LWIP_ASSERT_CORE_LOCKED();
+    for (;;) {
+        uint32_t off = tw_next();
+
+        /* Handlers may have taken time: sys_now() again for the next one */
+        if ((off == SYS_TIMEOUTS_SLEEPTIME_INFINITE) || (off > (uint32_t)(now - Now))) {
+            break;
+        }
+        Now += off;
+        tw_cascade();
+        fired += tw_expire();
+        now = sys_now();
+    }
+    Now = now;
+    if (fired != 0U) {
+        Stats.runs++;
+    }
+}
+
+ITCM_FUNC u32_t sys_timeouts_sleeptime(void)
+{
+    uint32_t off = tw_next();
+    uint32_t late;
+
+    LWIP_ASSERT_CORE_LOCKED();
+    if (off == SYS_TIMEOUTS_SLEEPTIME_INFINITE) {
+        return SYS_TIMEOUTS_SLEEPTIME_INFINITE;
+    }
+    late = sys_now() - Now;
+    return (late >= off) ? 0U : (off - late);
+}
+
+void sys_restart_timeouts(void)
+{
+    TWheelNode_t* all = NULL;
+    uint32_t first = SYS_TIMEOUTS_SLEEPTIME_INFINITE;
+    uint32_t now = sys_now();
+
+    /* Off the wheel, chained through prev */
+    for (uint32_t level = 0U; level < TW_LEVELS; level++) {
+        for (uint32_t slot = 0U; slot < TW_SLOTS; slot++) {
+            for (TWheelNode_t* n = Slots[level][slot]; n != NULL; n = n->next) {
+                uint32_t off = n->time - Now;
+
+                if (off < first) {
+                    first = off;
+                }
+                n->prev = all;
+                all = n;
+            }
+            Slots[level][slot] = NULL;
+        }
+        Busy[level] = 0U;
+    }
+
+    /* Everything moves by the same amount, the earliest is due now */
+    uint32_t then = Now;
+    Now = now;
+    while (all != NULL) {
+        TWheelNode_t* next = all->prev;
+
+        all->time = now + (all->time - then - first);
+        tw_link(all);
+        all = next;
+    }
+}
+
+void twheel_get_stats(TWheelStats_t* stats)
+{
+    *stats = Stats;
+}
+
+#endif /* LWIP_TIMERS && LWIP_TIMERS_CUSTOM && TWHEEL_LWIP */
@@ -0,0 +1,69 @@
+/**
+ * @file twheel.h
+ * @brief Hierarchical timer wheel behind lwIP's sys_timeout() API.
+ *
+ * With LWIP_TIMERS_CUSTOM, lwIP leaves sys_timeout(), sys_untimeout(),
+ * sys_check_timeouts() and sys_timeouts_sleeptime() to the port. Here a
+ * timeout sits in one of five levels of 64 slots (1 ms, 64 ms, 4.1 s,
+ * 262 s and 4.7 h per slot) instead of a sorted list:
+ *  - insert: a few shifts and a list push, whatever is already armed;
+ *  - cancel: sys_untimeout() finds the timeout through a hash of handler
+ *    and argument and unlinks it from its doubly linked slot;
+ *  - a timeout moves down at most four times before it fires, and the
+ *    occupancy bitmaps of the levels give the next expiry (the tcpip
+ *    thread's sleep time) without walking any list.
+ *
+ * Fewer wakeups: the stack's cyclic timers (lwip_cyclic_timers[]: TCP,
+ * IP reassembly, ARP, IGMP, DHCP, DNS, ND6, MLD) fire on multiples of
+ * their interval instead of counting from when each was started, so the
+ * TCP timer (started on demand), IGMP and the 1 s timers share a tcpip
+ * thread wakeup wherever their grids meet. Timeouts of TWHEEL_SLACK_MIN_MS
+ * or more are rounded up to a multiple of TWHEEL_SLACK_MS to join them.
+ *
+ * The nodes are a static pool of MEMP_NUM_SYS_TIMEOUT (the memp pool
+ * SYS_TIMEOUT is gone). Everything runs under the lwIP core lock.
+ */
+
+#pragma once
+
+#ifndef TWHEEL_H
+#define TWHEEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* 1: lwipopts.h sets LWIP_TIMERS_CUSTOM and the wheel replaces timeouts.c */
+#ifndef TWHEEL_LWIP
+#define TWHEEL_LWIP 1
+#endif
+
+/* Grid (ms) long timeouts are rounded up to; 0 keeps every timeout exact */
+#ifndef TWHEEL_SLACK_MS
+#define TWHEEL_SLACK_MS 100U
+#endif
+
+/* Shortest timeout that is rounded, at most TWHEEL_SLACK_MS / this late */
+#ifndef TWHEEL_SLACK_MIN_MS
+#define TWHEEL_SLACK_MIN_MS 1000U
+#endif
+
+typedef struct {
+    uint32_t used;       /* timeouts armed, cyclic timers included */
+    uint32_t max;        /* high water mark of used */
+    uint32_t fired;      /* handlers called */
+    uint32_t runs;       /* sys_check_timeouts() calls that called one */
+    uint32_t cascades;   /* timeouts moved down a level */
+    uint32_t alloc_fail; /* sys_timeout() with every node in use */
+} TWheelStats_t;
+
+/* Snapshot of the counters; call with the lwIP core lock held */
+void twheel_get_stats(TWheelStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TWHEEL_H */
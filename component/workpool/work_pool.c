@@ -0,0 +1,252 @@
+/**
+ * @file work_pool.c
+ * @brief Worker tasks fed by lock-free rings, see work_pool.h.
+ */
+
+#include "work_pool.h"
+
+#if WORK_POOL
+
+#include "metrics/metrics.h"
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "lwip/tcpip.h"
+
+#define WORK_TAG        "WORK"
+/* Completed jobs waiting for the tcpip thread */
+#define WORK_DONE_DEPTH (4U * WORK_POOL_DEPTH)
+
+#if (WORK_POOL_DEPTH & (WORK_POOL_DEPTH - 1U)) != 0U
+#error "WORK_POOL_DEPTH must be a power of two"
+#endif
+
+#if WORK_POOL_WORKERS == 0U || WORK_POOL_WORKERS > 32U
+#error "WORK_POOL_WORKERS out of range"
+#endif
+
+/* A cell's sequence is its position when free, position + 1 when full */
+typedef struct {
+    volatile uint32_t seq;
+    WorkJob_t* job;
+} WorkCell_t;
+
+typedef struct {
+    volatile uint32_t head;     /* next push */
+    volatile uint32_t tail;     /* next pop */
+    uint32_t mask;
+    WorkCell_t* cell;
+} WorkRing_t;
+
+static WorkCell_t work_cells[WORK_PRIO_COUNT][WORK_POOL_DEPTH];
+static WorkCell_t work_done_cells[WORK_DONE_DEPTH];
+static WorkRing_t work_queue[WORK_PRIO_COUNT];
+static WorkRing_t work_done_ring;
+
+static TaskHandle_t work_tasks[WORK_POOL_WORKERS];
+static StaticTask_t work_tcb[WORK_POOL_WORKERS];
+static StackType_t work_stack[WORK_POOL_WORKERS][WORK_POOL_STACK_WORDS];
+/* Bit per worker asleep and not yet woken */
+static volatile uint32_t work_idle;
+static struct tcpip_callback_msg* work_done_msg;
+static volatile bool work_done_pending;
+static volatile bool work_running;
+
+static Metric_t work_submitted = METRIC_COUNTER_INIT("work.submitted");
+static Metric_t work_rejected = METRIC_COUNTER_INIT("work.rejected");
+static Metric_t work_completed = METRIC_COUNTER_INIT("work.completed");
+static Metric_t work_waits = METRIC_COUNTER_INIT("work.waits");
+
+static void work_ring_init(WorkRing_t* r, WorkCell_t* cell, uint32_t n)
+{
+    for (uint32_t i = 0U; i < n; i++) {
+        cell[i].seq = i;
+        cell[i].job = NULL;
+    }
+    r->head = 0U;
+    r->tail = 0U;
+    r->mask = n - 1U;
+    r->cell = cell;
+}
+
+static bool work_ring_push(WorkRing_t* r, WorkJob_t* job)
+{
+    uint32_t pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    WorkCell_t* c;
+
+    for (;;) {
+        c = &r->cell[pos & r->mask];
+        int32_t diff = (int32_t)(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) - pos);
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&r->head, &pos, pos + 1U, true, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;       /* full */
+        } else {
+            pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        }
+    }
+    c->job = job;
+    __atomic_store_n(&c->seq, pos + 1U, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* NULL when empty, or while the oldest push is still being written */
+static WorkJob_t* work_ring_pop(WorkRing_t* r)
+{
+    uint32_t pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+    WorkCell_t* c;
+    WorkJob_t* job;
+
+    for (;;) {
+        c = &r->cell[pos & r->mask];
+        int32_t diff = (int32_t)(__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) - (pos + 1U));
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&r->tail, &pos, pos + 1U, true, __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+        }
+    }
+    job = c->job;
+    __atomic_store_n(&c->seq, pos + r->mask + 1U, __ATOMIC_RELEASE);
+    return job;
+}
+
+static WorkJob_t* work_take(void)
+{
+    for (uint32_t p = 0U; p < WORK_PRIO_COUNT; p++) {
+        WorkJob_t* job = work_ring_pop(&work_queue[p]);
+        if (job != NULL) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+/* tcpip thread: the done functions of completed jobs */
+static void work_deliver(void* arg)
+{
+    WorkJob_t* job;
+
+    LWIP_UNUSED_ARG(arg);
+    /* Cleared first: a completion after the drain schedules another run */
+    __atomic_store_n(&work_done_pending, false, __ATOMIC_SEQ_CST);
+    while ((job = work_ring_pop(&work_done_ring)) != NULL) {
+        __atomic_store_n(&job->busy, false, __ATOMIC_RELEASE);
+        job->done(job);
+    }
+}
+
+/* Worker: the job back to the tcpip thread */
+static void work_complete(WorkJob_t* job)
+{
+    while (!work_ring_push(&work_done_ring, job)) {
+        metric_inc(&work_waits);
+        vTaskDelay(1);
+    }
+    while (!__atomic_exchange_n(&work_done_pending, true, __ATOMIC_SEQ_CST) &&
+           tcpip_callbackmsg_trycallback(work_done_msg) != ERR_OK) {
+        /* The tcpip mailbox is full; the message is not queued */
+        __atomic_store_n(&work_done_pending, false, __ATOMIC_SEQ_CST);
+        metric_inc(&work_waits);
+        vTaskDelay(1);
+    }
+}
+
+static void work_task(void* arg)
+{
+    uint32_t bit = 1UL << (uint32_t)(uintptr_t)arg;
+
+    for (;;) {
+        WorkJob_t* job = work_take();
+
+        if (job == NULL) {
+            /* Idle before the second look, so a submit in between wakes us */
+            __atomic_fetch_or(&work_idle, bit, __ATOMIC_SEQ_CST);
+            job = work_take();
+            if (job == NULL) {
+                (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+                continue;
+            }
+            /* A submit may have claimed us already: one spurious wake */
+            __atomic_fetch_and(&work_idle, ~bit, __ATOMIC_SEQ_CST);
+        }
+        job->run(job);
+        metric_inc(&work_completed);
+        if (job->done != NULL) {
+            work_complete(job);
+        } else {
+            __atomic_store_n(&job->busy, false, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+bool work_submit(WorkJob_t* job, WorkPrio_t prio)
+{
+    uint32_t idle;
+
+    if (!work_running || (uint32_t)prio >= WORK_PRIO_COUNT || job->run == NULL ||
+        __atomic_exchange_n(&job->busy, true, __ATOMIC_ACQ_REL)) {
+        metric_inc(&work_rejected);
+        return false;
+    }
+    if (!work_ring_push(&work_queue[prio], job)) {
+        __atomic_store_n(&job->busy, false, __ATOMIC_RELEASE);
+        metric_inc(&work_rejected);
+        return false;
+    }
+    metric_inc(&work_submitted);
+    /* Wakes one idle worker, if any; busy ones look again when done */
+    idle = __atomic_load_n(&work_idle, __ATOMIC_SEQ_CST);
+    while (idle != 0U) {
+        uint32_t bit = idle & (~idle + 1U);
+
+        if (__atomic_compare_exchange_n(&work_idle, &idle, idle & ~bit, false, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_SEQ_CST)) {
+            (void)xTaskNotifyGive(work_tasks[__builtin_ctz(bit)]);
+            break;
+        }
+    }
+    return true;
+}
+
+bool work_pool_start(void)
+{
+    (void)metrics_register(&work_submitted);
+    (void)metrics_register(&work_rejected);
+    (void)metrics_register(&work_completed);
+    (void)metrics_register(&work_waits);
+
+    for (uint32_t p = 0U; p < WORK_PRIO_COUNT; p++) {
+        work_ring_init(&work_queue[p], work_cells[p], WORK_POOL_DEPTH);
+    }
+    work_ring_init(&work_done_ring, work_done_cells, WORK_DONE_DEPTH);
+    work_done_msg = tcpip_callbackmsg_new(work_deliver, NULL);
+    if (work_done_msg == NULL) {
+        LOG_ERROR(WORK_TAG, "no tcpip message");
+        return false;
+    }
+    for (uint32_t i = 0U; i < WORK_POOL_WORKERS; i++) {
+        work_tasks[i] = xTaskCreateStatic(work_task, "Work", WORK_POOL_STACK_WORDS, (void*)(uintptr_t)i,
+                                          WORK_POOL_PRIORITY, work_stack[i],
+                                          &work_tcb[i]);
+        if (work_tasks[i] == NULL) {
+            LOG_ERROR(WORK_TAG, "no worker %lu", i);
+            return false;
+        }
+    }
+    work_running = true;
+    return true;
+}
+
+#endif /* WORK_POOL */
@@ -0,0 +1,96 @@
+/**
+ * @file work_pool.h
+ * @brief Fixed pool of worker tasks taking jobs off the tcpip thread.
+ *
+ * Raw API callbacks run on the tcpip thread, and whatever they compute
+ * holds up every packet behind them. A callback that has more to do than
+ * parse and answer hands the rest to the pool as a WorkJob_t: the run
+ * function executes on one of WORK_POOL_WORKERS tasks below the tcpip
+ * thread, then the done function, if any, back on the tcpip thread, where
+ * the result may touch pcbs again.
+ *
+ * Submission never blocks. There is one queue per WorkPrio_t, each a
+ * bounded ring of WORK_POOL_DEPTH job pointers (Vyukov's multi-producer,
+ * multi-consumer sequence ring on compare-and-swap, LDREX/STREX on the
+ * M7): a full queue refuses the job and the caller decides, answering
+ * "busy" or doing the work itself. Workers take the highest priority
+ * first. An idle worker sleeps on its task notification and is woken by
+ * the submit that finds it idle; a busy one takes the next job when it is
+ * done. Done jobs go back through one ring and one preallocated tcpip
+ * callback message, so nothing is allocated per job.
+ *
+ * A job is the caller's memory and is queued once at a time: from
+ * work_submit() to its done function (or to the end of run without one)
+ * it is busy and a second submit is refused. Jobs may run concurrently
+ * and complete out of order. Exported through metrics as "work.*".
+ */
+
+#pragma once
+
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 0 leaves the pool out of the startup code; its users then do their
+ * work inline */
+#ifndef WORK_POOL
+#define WORK_POOL 1
+#endif
+
+#ifndef WORK_POOL_WORKERS
+#define WORK_POOL_WORKERS 2U
+#endif
+
+/* Jobs queued per priority, a power of two */
+#ifndef WORK_POOL_DEPTH
+#define WORK_POOL_DEPTH 16U
+#endif
+
+/* osPriorityBelowNormal, see configOS2_TO_RTOS_PRIO(): below the tcpip
+ * thread, which keeps dispatching while the workers run */
+#ifndef WORK_POOL_PRIORITY
+#define WORK_POOL_PRIORITY 8
+#endif
+
+#ifndef WORK_POOL_STACK_WORDS
+#define WORK_POOL_STACK_WORDS 512U
+#endif
+
+typedef enum {
+    WORK_PRIO_HIGH = 0,
+    WORK_PRIO_NORMAL,
+    WORK_PRIO_LOW,
+    WORK_PRIO_COUNT,
+} WorkPrio_t;
+
+typedef struct WorkJob_s WorkJob_t;
+typedef void (*WorkFn)(WorkJob_t* job);
+
+struct WorkJob_s {
+    WorkFn run;             /* on a worker */
+    WorkFn done;            /* then on the tcpip thread; may be NULL */
+    void* arg;
+    volatile bool busy;     /* submitted, done not run yet */
+};
+
+#define WORK_JOB_INIT(run_, done_, arg_) { .run = (run_), .done = (done_), .arg = (arg_), .busy = false }
+
+/* Creates the workers and the completion message; from a task, core lock
+ * not held */
+bool work_pool_start(void);
+
+/* Queues the job; false when the pool is not running, the job is still
+ * busy or the queue of prio is full. Tasks and the tcpip thread. */
+bool work_submit(WorkJob_t* job, WorkPrio_t prio);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WORK_POOL_H */
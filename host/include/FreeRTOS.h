@@ -0,0 +1,43 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host build: the part of the FreeRTOS API the shared code uses,
+ *        on POSIX threads (port/freertos_host.c).
+ *
+ * One tick is one millisecond. There are no interrupts, so the _FROM_ISR
+ * calls are the task calls and critical sections are one recursive mutex.
+ */
+
+#pragma once
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uintptr_t StackType_t;
+
+#define pdFALSE                 ((BaseType_t)0)
+#define pdTRUE                  ((BaseType_t)1)
+#define pdFAIL                  pdFALSE
+#define pdPASS                  pdTRUE
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFFUL)
+
+#define configTICK_RATE_HZ      1000U
+#define portTICK_PERIOD_MS      1U
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+
+#define configMAX_PRIORITIES    32
+#define configMINIMAL_STACK_SIZE 128U
+#define configMAX_TASK_NAME_LEN 16
+#define configNUM_THREAD_LOCAL_STORAGE_POINTERS 4
+
+#define configASSERT(x)         assert(x)
+
+#define portYIELD_FROM_ISR(x)   ((void)(x))
+
+#endif /* HOST_FREERTOS_H */
@@ -0,0 +1,28 @@
+/**
+ * @file cc.h
+ * @brief Host build: lwIP compiler and platform definitions (Linux, gcc).
+ */
+
+#ifndef HOST_ARCH_CC_H
+#define HOST_ARCH_CC_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+typedef int sys_prot_t;
+
+#define LWIP_TIMEVAL_PRIVATE 0
+
+#define PACK_STRUCT_BEGIN
+#define PACK_STRUCT_STRUCT __attribute__ ((__packed__))
+#define PACK_STRUCT_END
+#define PACK_STRUCT_FIELD(x) x
+
+/* Fatal on the host: a failed assertion should stop a benchmark or fuzz run */
+#define LWIP_PLATFORM_ASSERT(x) do { printf("Assertion \"%s\" failed at line %d in %s\n", \
+                                     x, __LINE__, __FILE__); fflush(NULL); abort(); } while (0)
+
+#define LWIP_RAND() ((u32_t)rand())
+
+#endif /* HOST_ARCH_CC_H */
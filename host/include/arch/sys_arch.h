@@ -0,0 +1,43 @@
+/**
+ * @file sys_arch.h
+ * @brief Host build: lwIP OS abstraction types on POSIX threads.
+ */
+
+#ifndef HOST_ARCH_SYS_ARCH_H
+#define HOST_ARCH_SYS_ARCH_H
+
+#include <pthread.h>
+
+#include "lwip/err.h"
+
+#define SYS_MBOX_NULL NULL
+#define SYS_SEM_NULL  NULL
+
+typedef struct sys_sem_host* sys_sem_t;
+typedef struct sys_mutex_host* sys_mutex_t;
+typedef struct sys_mbox_host* sys_mbox_t;
+typedef pthread_t sys_thread_t;
+
+/* Post ahead of the queued messages, see the target sys_arch.h */
+err_t sys_mbox_trypost_front(sys_mbox_t* mbox, void* msg);
+
+/* Per-thread netconn semaphore, see the target sys_arch.h */
+#if LWIP_NETCONN_SEM_PER_THREAD
+sys_sem_t* sys_arch_netconn_sem_get(void);
+void sys_arch_netconn_sem_alloc(void);
+void sys_arch_netconn_sem_free(void);
+#define LWIP_NETCONN_THREAD_SEM_GET()   sys_arch_netconn_sem_get()
+#define LWIP_NETCONN_THREAD_SEM_ALLOC() sys_arch_netconn_sem_alloc()
+#define LWIP_NETCONN_THREAD_SEM_FREE()  sys_arch_netconn_sem_free()
+#endif
+
+/* Test clock: while held, sys_now() returns ms instead of the monotonic
+ * clock (main.c -w) */
+void sys_now_set(int held, u32_t ms);
+
+/* Socket event queue wake-ups, see the target sys_arch.h */
+sys_thread_t sys_notify_self(void);
+void sys_notify(sys_thread_t thread);
+u32_t sys_notify_wait(u32_t timeout);
+
+#endif /* HOST_ARCH_SYS_ARCH_H */
@@ -0,0 +1,18 @@
+/**
+ * @file cmsis_os.h
+ * @brief Host build: stands in for the CMSIS-RTOS v2 header, which the
+ *        shared code only includes for the FreeRTOS types.
+ */
+
+#pragma once
+
+#ifndef HOST_CMSIS_OS_H
+#define HOST_CMSIS_OS_H
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Queue handle of the ethernetif.h declarations */
+typedef void* osMessageQueueId_t;
+
+#endif /* HOST_CMSIS_OS_H */
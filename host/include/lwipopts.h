@@ -0,0 +1,67 @@
+/**
+ * @file lwipopts.h
+ * @brief Host build: the target lwIP configuration, less what only the
+ *        STM32H743 has.
+ *
+ * Everything else (pools, windows, core locking, IGMP) stays as on the
+ * target, so host figures follow the firmware configuration.
+ */
+
+#pragma once
+
+#ifndef HOST_LWIPOPTS_H
+#define HOST_LWIPOPTS_H
+
+#include <stdint.h>
+
+#include "../../LWIP/Target/lwipopts.h"
+
+/* The heap is a static array instead of the D2 SRAM address */
+#undef LWIP_RAM_HEAP_POINTER
+
+/* Pointers are 8 bytes on a 64-bit host; pbufs and pools need that too */
+#if UINTPTR_MAX > 0xFFFFFFFFU
+#undef MEM_ALIGNMENT
+#define MEM_ALIGNMENT 8
+#endif
+
+/* No MDMA: plain memcpy() */
+#undef MEMCPY
+
+/* PERF_START/PERF_STOP read the DWT cycle counter */
+#undef LWIP_PERF
+#define LWIP_PERF 0
+
+/* The lock-free pools use the Cortex-M exclusive monitor (LDREX/STREX) */
+#undef MEMP_LOCKFREE
+#define MEMP_LOCKFREE 0
+
+/* No checksum offload on a TAP device: generate in software. The checks
+ * stay off like on the target, the host kernel sends valid frames. */
+#undef CHECKSUM_GEN_IP
+#define CHECKSUM_GEN_IP 1
+#undef CHECKSUM_GEN_UDP
+#define CHECKSUM_GEN_UDP 1
+#undef CHECKSUM_GEN_TCP
+#define CHECKSUM_GEN_TCP 1
+#undef CHECKSUM_GEN_ICMP
+#define CHECKSUM_GEN_ICMP 1
+
+/* The TAP netif receives into PBUF_POOL, there is no RX_POOL to watch;
+ * PBUF_POOL stands in for it where netconns copy held data */
+#undef TCP_OOSEQ_POOL_LOW
+#define TCP_OOSEQ_POOL_LOW() 0
+#undef NETCONN_RX_PINNED
+#define NETCONN_RX_PINNED(q) ((q)->type_internal == (u8_t)PBUF_POOL)
+#undef NETCONN_RX_PINNED_SIZE
+#define NETCONN_RX_PINNED_SIZE(q) PBUF_POOL_BUFSIZE
+#undef NETCONN_RX_PINNED_MAX
+#define NETCONN_RX_PINNED_MAX (4 * PBUF_POOL_BUFSIZE)
+#undef IP_REASS_COPY_NEEDED
+#define IP_REASS_COPY_NEEDED(p) NETCONN_RX_PINNED(p)
+/* The TAP netif stamps what it receives (tapif.c) */
+#undef LWIP_PBUF_RX_TIME
+#define LWIP_PBUF_RX_TIME(p, mono_ns, utc_ns) tapif_rx_time(p, mono_ns, utc_ns)
+int tapif_rx_time(const struct pbuf *p, uint64_t *mono_ns, uint64_t *utc_ns);
+
+#endif /* HOST_LWIPOPTS_H */
@@ -0,0 +1,47 @@
+/**
+ * @file stm32h7xx_hal.h
+ * @brief Host build: the few HAL names main.h and the logger refer to.
+ */
+
+#pragma once
+
+#ifndef HOST_STM32H7XX_HAL_H
+#define HOST_STM32H7XX_HAL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef __ALIGNED
+#define __ALIGNED(x) __attribute__((aligned(x)))
+#endif
+
+/* The barrier of seqlock.h */
+#ifndef __DMB
+#define __DMB() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+#define GPIO_PIN_0  0x0001U
+#define GPIO_PIN_9  0x0200U
+
+typedef struct {
+    int unused;
+} ETH_HandleTypeDef;
+
+/* Ring lengths of stm32h7xx_hal_conf.h, ethernetif_opts.h sizes from them */
+#define ETH_TX_DESC_CNT 8U
+#define ETH_RX_DESC_CNT 8U
+
+/* Milliseconds since start, CLOCK_MONOTONIC */
+uint32_t HAL_GetTick(void);
+
+/* Microseconds since start, the stand-in for DWT->CYCCNT */
+uint32_t host_cycles(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_STM32H7XX_HAL_H */
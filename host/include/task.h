@@ -0,0 +1,69 @@
+/**
+ * @file task.h
+ * @brief Host build: FreeRTOS tasks, notifications and critical sections.
+ */
+
+#pragma once
+
+#ifndef HOST_TASK_H
+#define HOST_TASK_H
+
+#include "FreeRTOS.h"
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*TaskFunction_t)(void*);
+
+/* The whole task lives here, xTaskCreateStatic() allocates nothing */
+typedef struct HostTask_s {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+    TaskFunction_t fn;
+    void* arg;
+    void* tls[configNUM_THREAD_LOCAL_STORAGE_POINTERS];
+    char name[configMAX_TASK_NAME_LEN];
+} StaticTask_t;
+
+typedef StaticTask_t* TaskHandle_t;
+
+#define taskSCHEDULER_SUSPENDED   ((BaseType_t)0)
+#define taskSCHEDULER_NOT_STARTED ((BaseType_t)1)
+#define taskSCHEDULER_RUNNING     ((BaseType_t)2)
+
+UBaseType_t host_critical_enter(void);
+void host_critical_exit(UBaseType_t mask);
+
+#define taskENTER_CRITICAL()            ((void)host_critical_enter())
+#define taskEXIT_CRITICAL()             host_critical_exit(0U)
+#define taskENTER_CRITICAL_FROM_ISR()   host_critical_enter()
+#define taskEXIT_CRITICAL_FROM_ISR(m)   host_critical_exit(m)
+#define taskYIELD()                     sched_yield()
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char* name, uint32_t depth, void* arg,
+                               UBaseType_t prio, StackType_t* stack, StaticTask_t* tcb);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskGetSchedulerState(void);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken);
+
+void* pvTaskGetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index);
+void vTaskSetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index, void* value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#include <sched.h>
+
+#endif /* HOST_TASK_H */
@@ -0,0 +1,1537 @@
+/**
+ * @file main.c
+ * @brief Host simulation of the firmware network stack.
+ *
+ * lwIP with the target lwipopts.h, component/logger and lwiperf run on
+ * POSIX threads, with a TAP device (or nothing) in place of the ETH MAC:
+ *
+ *   stm32_eth_host [-t tap0] [-a ip] [-m mask] [-g gw] [-s syslog_ip] [-p]
+ *                  [-N ntp_ip] [-d lease_file]
+ *       TAP mode: iperf server on port 5001, syslog to syslog_ip, frame
+ *       capture served as tftp://<ip>/capture.pcap (-p: capturing from start),
+ *       SNTP against ntp_ip with the clock state printed every 10 s, control
+ *       channel echo on UDP port 5300 (component/ctrlchan), Modbus/TCP on
+ *       port 502 with a scratch register map (component/modbus), firmware
+ *       update into a bank in memory on port 5800 (component/ota), logger
+ *       configuration on UDP port 5514 (component/logger/log_ctl.h); syslog_ip
+ *       and ntp_ip may be names, resolved through the gateway; -d takes
+ *       the address from DHCP instead of -a/-m/-g, the lease kept in
+ *       lease_file for the next start (component/dhcpc)
+ *   stm32_eth_host -r frames.pcap [-n loops]
+ *       feeds the frames of a pcap file to ethernet_input() (no device),
+ *       reports the rate; frame contents are not checked, so it doubles
+ *       as a fuzz harness
+ *   stm32_eth_host -b
+ *       microbenchmarks, "bench=<name> key=value" lines as in the Bench
+ *       firmware configuration, but in nanoseconds
+ *   stm32_eth_host -w
+ *       the lwIP timer wheel (component/twheel) against a model, on a
+ *       simulated sys_now() that starts just below the 32-bit wrap:
+ *       random sys_timeout() / sys_untimeout() / advances, every expiry
+ *       checked for early, late or stale, exit status 1 on any
+ *   stm32_eth_host -C
+ *       telemetry CBOR schemas (component/telemetry/telemetry_cbor.h)
+ *       encoded into an MQTT output ring and decoded back: every type,
+ *       random and edge values, golden bytes; exit status 1 on a mismatch
+ *   stm32_eth_host [-t tap0] [-a ip] ... -q broker_ip [-c count] [-l len]
+ *       MQTT publish rate to a broker on the TAP side, payloads copied and
+ *       sent by reference (component/bench/mqtt_bench.h)
+ */
+
+#include "main.h"
+#include "lwip/init.h"
+#include "lwip/tcpip.h"
+#include "lwip/netif.h"
+#include "lwip/dns.h"
+#include "lwip/pbuf.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/ip.h"
+#include "lwip/tcp.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/udp.h"
+#include "lwip/api.h"
+#include "lwip/sockets.h"
+#include "lwip/apps/lwiperf.h"
+#include "lwip/apps/mqtt.h"
+#include "lwip/apps/mqtt_priv.h"
+#include "lwip/timeouts.h"
+#include "netif/ppp/ppp_opts.h"
+#include "netif/ethernet.h"
+#include "port/tapif.h"
+#include "port/dhcp_lease_file.h"
+#include "pcap/pcap_ring.h"
+#include "chksum/chksum_m7.h"
+#include "bench/mqtt_bench.h"
+#include "bench/log_bench.h"
+#include "compress/lz4_block.h"
+#include "mqttsub/mqtt_sub.h"
+#include "timesync/timesync.h"
+#include "metrics/metrics.h"
+#include "httpd/diag_httpd.h"
+#include "timesync/time_ns.h"
+#include "timesync/sntp_client.h"
+#include "ctrlchan/ctrl_chan.h"
+#include "twamp/twamp_light.h"
+#include "workpool/work_pool.h"
+#include "modbus/modbus_tcp.h"
+#include "ota/ota.h"
+#include "telemetry/telemetry_agg.h"
+#include "telemetry/telemetry_mcast.h"
+#include "telemetry/telemetry_cbor.h"
+#include "logger/log_ctl.h"
+#include "dhcpc/dhcp_client.h"
+#include "twheel/twheel.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HOST_TAG            "HOST"
+#define HOST_BENCH_ITER     100000U
+#define HOST_PCAP_SNAP      65535U
+#define HOST_MQTT_COUNT     10000U
+#define HOST_MQTT_LEN       64U
+#define HOST_LOSS_EVERY     20U         /* -L: every Nth data segment dropped */
+#define HOST_LOSS_WARMUP    32U         /* lossless, for the RTT estimate */
+#define HOST_LOSS_EXCHANGES 200U
+#define HOST_LOSS_REQ_LEN   12U         /* Modbus/TCP read request */
+#define HOST_LOSS_RSP_LEN   64U
+#define HOST_LOSS_PORT      5502U
+#define HOST_UDP_BATCH      DEFAULT_UDP_RECVMBOX_SIZE   /* a round fits the receive mailbox */
+#define HOST_UDP_LEN        64U
+#define HOST_UDP_PORT       5503U
+#define HOST_TW_TIMERS      32U
+#define HOST_TW_STEPS       4000000U
+#define HOST_TW_START       0xFFFFF000U /* sys_now() wraps 4 s in */
+#define HOST_TW_DRAIN_MS    (1U << 20)
+#define HOST_TEST_REPORT    10U         /* -w, -C: errors printed */
+#define HOST_CBOR_ROUNDS    100000U
+#define HOST_TW_HANG_S      30U         /* a stuck slot spins the wheel */
+
+typedef struct {
+    const char* tap;
+    const char* ip;
+    const char* mask;
+    const char* gw;
+    const char* syslog_ip;
+    const char* replay;
+    const char* broker;
+    const char* ntp;
+    const char* lease;
+    unsigned long loops;
+    unsigned long count;
+    unsigned long len;
+    unsigned long loss;
+    int bench;
+    int twheel;
+    int cbor;
+    int capture;
+} HostArgs_t;
+
+static struct netif host_netif;
+static sys_sem_t host_ready;
+static uint32_t host_seed = 0x2545F491U;
+
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* xorshift32, the same sequence every run */
+static uint32_t host_rand(void)
+{
+    host_seed ^= host_seed << 13;
+    host_seed ^= host_seed >> 17;
+    host_seed ^= host_seed << 5;
+    return host_seed;
+}
+
+static void host_tcpip_ready(void* arg)
+{
+    (void)arg;
+    sys_sem_signal(&host_ready);
+}
+
+static void host_iperf_report(void* arg, enum lwiperf_report_type report_type, const ip_addr_t* local_addr,
+                              u16_t local_port, const ip_addr_t* remote_addr, u16_t remote_port,
+                              u32_t bytes_transferred, u32_t ms_duration, u32_t bandwidth_kbitpsec)
+{
+    (void)arg;
+    (void)local_addr;
+    (void)local_port;
+    printf("iperf type=%d remote=%s:%u bytes=%lu ms=%lu kbps=%lu\n", (int)report_type, ipaddr_ntoa(remote_addr),
+           remote_port, (unsigned long)bytes_transferred, (unsigned long)ms_duration,
+           (unsigned long)bandwidth_kbitpsec);
+    fflush(stdout);
+}
+
+/* metrics_sources.c reads the ETH driver and the RTOS; the host has the
+ * tap counters, the TCP out-of-order totals and the DHCP client */
+static void host_metrics_tap(MetricsWriter_t* w)
+{
+    TapIfStats_t s;
+
+    tapif_get_stats(&s);
+    metrics_emit(w, "tap.rx_frames", METRIC_COUNTER, s.rx_frames);
+    metrics_emit(w, "tap.rx_bytes", METRIC_COUNTER, s.rx_bytes);
+    metrics_emit(w, "tap.rx_drops", METRIC_COUNTER, s.rx_drops);
+    metrics_emit(w, "tap.tx_frames", METRIC_COUNTER, s.tx_frames);
+    metrics_emit(w, "tap.tx_bytes", METRIC_COUNTER, s.tx_bytes);
+    metrics_emit(w, "tap.tx_errors", METRIC_COUNTER, s.tx_errors);
+}
+
+#if TCP_OOSEQ_GOVERN
+static void host_metrics_ooseq(MetricsWriter_t* w)
+{
+    struct tcp_ooseq_stats s;
+
+    tcp_ooseq_get_stats(&s);
+    metrics_emit(w, "lwip.tcp.ooseq.pbufs", METRIC_GAUGE, s.pbufs);
+    metrics_emit(w, "lwip.tcp.ooseq.pbufs_max", METRIC_GAUGE, s.pbufs_max);
+    metrics_emit(w, "lwip.tcp.ooseq.trimmed", METRIC_COUNTER, s.trimmed);
+    metrics_emit(w, "lwip.tcp.ooseq.evicted", METRIC_COUNTER, s.evicted);
+}
+#endif
+
+#if DHCP_CLIENT
+static void host_metrics_dhcp(MetricsWriter_t* w)
+{
+    DhcpClientStats_t d;
+
+    dhcp_client_get_stats(&d);
+    metrics_emit(w, "dhcp.bound", METRIC_GAUGE, d.bound ? 1U : 0U);
+    metrics_emit(w, "dhcp.binds", METRIC_COUNTER, d.binds);
+    metrics_emit(w, "dhcp.naks", METRIC_COUNTER, d.naks);
+    metrics_emit(w, "dhcp.reused", METRIC_COUNTER, d.reused);
+    if (d.addressed) {
+        metrics_emit(w, "dhcp.addr_ms", METRIC_GAUGE, d.addr_ms);
+    }
+    if (d.binds != 0U) {
+        metrics_emit(w, "dhcp.bind_ms", METRIC_GAUGE, d.bind_ms);
+    }
+}
+#endif
+
+void metrics_sources_register(void)
+{
+    (void)metrics_register_collector(host_metrics_tap);
+#if TCP_OOSEQ_GOVERN
+    (void)metrics_register_collector(host_metrics_ooseq);
+#endif
+#if DHCP_CLIENT
+    (void)metrics_register_collector(host_metrics_dhcp);
+#endif
+}
+
+static bool host_netif_up(const HostArgs_t* a, netif_init_fn init)
+{
+    ip4_addr_t ip, mask, gw;
+    ip_addr_t dns;
+
+    if (!ip4addr_aton(a->ip, &ip) || !ip4addr_aton(a->mask, &mask) || !ip4addr_aton(a->gw, &gw)) {
+        fprintf(stderr, "invalid address\n");
+        return false;
+    }
+    LOCK_TCPIP_CORE();
+    if (netif_add(&host_netif, &ip, &mask, &gw, (void*)a->tap, init, tcpip_input) == NULL) {
+        UNLOCK_TCPIP_CORE();
+        return false;
+    }
+    netif_set_default(&host_netif);
+    netif_set_up(&host_netif);
+    /* The gateway answers DNS, for -N and -s names */
+    ip_addr_copy_from_ip4(dns, gw);
+    dns_setserver(0, &dns);
+#if DHCP_CLIENT
+    if (a->lease != NULL) {
+        dhcp_lease_file_set(a->lease);
+        if (dhcp_client_start(&host_netif) != ERR_OK) {
+            UNLOCK_TCPIP_CORE();
+            return false;
+        }
+    }
+#endif
+    UNLOCK_TCPIP_CORE();
+    return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Microbenchmarks */
+
+static void host_bench_report(const char* name, const char* extra, uint64_t ns, uint32_t n)
+{
+    printf("bench=%s %sns=%lu per_s=%lu\n", name, extra, (unsigned long)(ns / n),
+           (unsigned long)((ns != 0U) ? (uint64_t)n * 1000000000ULL / ns : 0U));
+}
+
+static volatile uint16_t host_bench_sink;
+
+static void host_bench_chksum(void)
+{
+    static uint8_t buf[1514];
+    uint64_t t0;
+
+    memset(buf, 0xA5, sizeof(buf));
+    t0 = host_ns();
+    for (uint32_t i = 0; i < HOST_BENCH_ITER; i++) {
+        host_bench_sink = inet_chksum(buf, sizeof(buf));
+    }
+    host_bench_report("chksum", "bytes=1514 ", host_ns() - t0, HOST_BENCH_ITER);
+
+    t0 = host_ns();
+    for (uint32_t i = 0; i < HOST_BENCH_ITER; i++) {
+        host_bench_sink = chksum_m7_ref(buf, sizeof(buf));
+    }
+    host_bench_report("chksum_ref", "bytes=1514 ", host_ns() - t0, HOST_BENCH_ITER);
+}
+
+/* MQTT topic dispatch: command and config filters of a device, publishes
+ * on the deepest of them */
+static void host_bench_mqtt_sub_fn(void* arg, const char* topic, const uint8_t* data, uint16_t len, uint8_t flags)
+{
+    (void)topic;
+    (void)data;
+    (void)flags;
+    *(uint32_t*)arg += len;
+}
+
+static void host_bench_mqtt_sub(void)
+{
+    static const char* const filters[] = {
+        "dev/eth0/cmd/reboot", "dev/eth0/cmd/log", "dev/eth0/cmd/ota/+", "dev/eth0/cfg/#",
+        "dev/+/cmd/ping", "dev/+/cfg/net/ip", "dev/+/cfg/net/mask", "dev/+/cfg/net/gw",
+        "dev/all/cmd/+", "dev/all/time", "site/+/alarm/#", "$SYS/broker/uptime", "#",
+    };
+    static const char* const topics[] = {
+        "dev/eth0/cfg/net/ip", "dev/eth1/cmd/ping", "dev/all/cmd/sync", "site/a/alarm/hi/t",
+    };
+    static MqttSub_t sub;
+    static const uint8_t payload[16];
+    uint32_t bytes = 0U;
+    MqttSubStats_t st;
+    char extra[48];
+    uint64_t t0;
+
+    mqtt_sub_init(&sub);
+    for (uint32_t i = 0; i < sizeof(filters) / sizeof(filters[0]); i++) {
+        (void)mqtt_sub_add(&sub, filters[i], host_bench_mqtt_sub_fn, &bytes);
+    }
+    t0 = host_ns();
+    for (uint32_t i = 0; i < HOST_BENCH_ITER; i++) {
+        (void)mqtt_sub_dispatch(&sub, topics[i & 3U], payload, sizeof(payload));
+    }
+    t0 = host_ns() - t0;
+    mqtt_sub_get_stats(&sub, &st);
+    snprintf(extra, sizeof(extra), "filters=%u handlers=%lu ", (unsigned)(sizeof(filters) / sizeof(filters[0])),
+             (unsigned long)(bytes / sizeof(payload) / HOST_BENCH_ITER));
+    host_bench_report("mqtt_sub", extra, t0, HOST_BENCH_ITER);
+}
+
+/* LZ4 on a TCP stage of framed syslog lines, as bench_suite.c */
+static void host_bench_lz4(void)
+{
+    static Lz4Block_t st;
+    static uint8_t text[1460];
+    static uint8_t packed[LZ4_BLOCK_BOUND(sizeof(text))];
+    static uint8_t plain[sizeof(text)];
+    char extra[48];
+    uint32_t len = 0U;
+    uint32_t out = 0U;
+    uint64_t t0;
+
+    for (uint32_t i = 0U;; i++) {
+        char line[160];
+        char hdr[8];
+        int n = snprintf(line, sizeof(line), "<14>1 2026-01-01T00:%02u:%02u.%06uZ stm32-eth STM32_eth - BENCH "
+                         "[meta sequenceId=\"%u\"] bench=lz4_probe seq=%u", i / 60U % 60U, i % 60U,
+                         (i * 7919U) % 1000000U, i + 1U, i);
+        int h = snprintf(hdr, sizeof(hdr), "%d ", n);
+        if (len + (uint32_t)(h + n) > sizeof(text)) {
+            break;
+        }
+        memcpy(&text[len], hdr, (size_t)h);
+        memcpy(&text[len + (uint32_t)h], line, (size_t)n);
+        len += (uint32_t)(h + n);
+    }
+    t0 = host_ns();
+    for (uint32_t i = 0; i < HOST_BENCH_ITER; i++) {
+        out = lz4_block_compress(&st, text, len, packed, sizeof(packed));
+    }
+    t0 = host_ns() - t0;
+    snprintf(extra, sizeof(extra), "bytes=%u out=%u ", len, out);
+    host_bench_report("lz4_compress", extra, t0, HOST_BENCH_ITER);
+
+    t0 = host_ns();
+    for (uint32_t i = 0; i < HOST_BENCH_ITER; i++) {
+        host_bench_sink = (uint16_t)lz4_block_decompress(packed, out, plain, sizeof(plain));
+    }
+    t0 = host_ns() - t0;
+    snprintf(extra, sizeof(extra), "bytes=%u ok=%d ", len, memcmp(plain, text, len) == 0);
+    host_bench_report("lz4_decompress", extra, t0, HOST_BENCH_ITER);
+}
+
+static void host_bench_pbuf(const char* name, pbuf_type type, u16_t len)
+{
+    char extra[32];
+    uint64_t t0;
+
+    LOCK_TCPIP_CORE();
+    t0 = host_ns();
+    for (uint32_t i = 0; i < HOST_BENCH_ITER; i++) {
+        struct pbuf* p = pbuf_alloc(PBUF_RAW, len, type);
+        if (p != NULL) {
+            pbuf_free(p);
+        }
+    }
+    t0 = host_ns() - t0;
+    UNLOCK_TCPIP_CORE();
+    snprintf(extra, sizeof(extra), "type=%s bytes=%u ", name, len);
+    host_bench_report("pbuf", extra, t0, HOST_BENCH_ITER);
+}
+
+static void host_bench_done(void* arg)
+{
+    sys_sem_signal((sys_sem_t*)arg);
+}
+
+/* One message to the tcpip thread and back */
+static void host_bench_tcpip(void)
+{
+    const uint32_t n = HOST_BENCH_ITER / 10U;
+    sys_sem_t done;
+    uint64_t t0;
+
+    sys_sem_new(&done, 0);
+    t0 = host_ns();
+    for (uint32_t i = 0; i < n; i++) {
+        tcpip_callback(host_bench_done, &done);
+        sys_arch_sem_wait(&done, 0);
+    }
+    host_bench_report("tcpip_roundtrip", "", host_ns() - t0, n);
+    sys_sem_free(&done);
+}
+
+static void host_bench_logger(void)
+{
+    const uint32_t n = 32U;     /* below SYSLOG_RING_SLOTS, nothing dropped */
+    uint64_t t0 = host_ns();
+
+    for (uint32_t i = 0; i < n; i++) {
+        logger_printf(LOG_LEVEL_INFO, HOST_TAG, "bench=logger_probe seq=%lu", (unsigned long)i);
+    }
+    host_bench_report("logger_printf", "", host_ns() - t0, n);
+}
+
+/* Producers of bench_suite.c at a tenth of the rate: threads, no priorities */
+static void host_bench_log_stress(void)
+{
+    static const LogBenchProducer_t p[] = {
+        { .priority = 4U, .rate_hz = 2U, .len = 32U, .level = LOG_LEVEL_WARNING },
+        { .priority = 3U, .rate_hz = 50U, .len = 64U, .level = LOG_LEVEL_INFO },
+        { .priority = 2U, .rate_hz = 200U, .len = 128U, .level = LOG_LEVEL_DEBUG },
+        { .priority = 1U, .rate_hz = 500U, .len = 200U, .level = LOG_LEVEL_VERBOSE },
+    };
+    static LogBenchResult_t r;
+    const uint32_t n = sizeof(p) / sizeof(p[0]);
+
+    if (!log_bench_run(p, n, 2000U, 500U, &r)) {
+        printf("bench=log_stress failed\n");
+        return;
+    }
+    printf("bench=log_stress async=%u producers=%u ms=%u calls=%u per_s=%u sent=%u failed=%u dropped=%u "
+           "suppressed=%u\n", (unsigned)SYSLOG_ASYNC, n, r.ms, r.calls, r.per_s, r.sent, r.failed, r.dropped,
+           r.suppressed);
+    for (uint32_t i = 0U; i < n; i++) {
+        printf("bench=log_producer id=%u level=%d rate=%u len=%u calls=%u refused=%u p50_us=%u p99_us=%u "
+               "p999_us=%u max_us=%u\n", i, p[i].level, p[i].rate_hz, p[i].len, r.producer[i].calls,
+               r.producer[i].refused, r.producer[i].p50, r.producer[i].p99, r.producer[i].p999, r.producer[i].max);
+    }
+}
+
+/* Whole frames through ethernet_input(): ARP requests for our address */
+static void host_bench_rx(void)
+{
+    static const uint8_t arp[42] = {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x06,
+        0x00, 0x01, 0x08, 0x00, 0x06, 0x04, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+        0, 0, 0, 0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0, 0, 0, 0,
+    };
+    uint8_t frame[sizeof(arp)];
+    const ip4_addr_t* self = netif_ip4_addr(&host_netif);
+    uint32_t peer = lwip_htonl(lwip_ntohl(ip4_addr_get_u32(self)) ^ 1U);
+    uint64_t t0;
+
+    memcpy(frame, arp, sizeof(frame));
+    memcpy(&frame[28], &peer, 4);
+    memcpy(&frame[38], &ip4_addr_get_u32(self), 4);
+    t0 = host_ns();
+    for (uint32_t i = 0; i < HOST_BENCH_ITER; i++) {
+        LOCK_TCPIP_CORE();
+        struct pbuf* p = pbuf_alloc(PBUF_RAW, sizeof(frame), PBUF_POOL);
+        if (p != NULL) {
+            pbuf_take(p, frame, sizeof(frame));
+            ethernet_input(p, &host_netif);
+        }
+        UNLOCK_TCPIP_CORE();
+    }
+    host_bench_report("arp_rx_reply", "", host_ns() - t0, HOST_BENCH_ITER);
+}
+
+#if UDP_TPL
+static err_t host_null_linkoutput(struct netif* netif, struct pbuf* p)
+{
+    (void)netif;
+    (void)p;
+    return ERR_OK;
+}
+
+/* Datagrams to the peer whose ARP entry host_bench_rx() left, frames
+   discarded at the link: udp_send() against udp_tpl_send() */
+static void host_bench_udp_tx(int tpl)
+{
+    const ip4_addr_t* self = netif_ip4_addr(&host_netif);
+    netif_linkoutput_fn linkoutput;
+    struct udp_tpl t;
+    struct udp_pcb* pcb;
+    ip_addr_t peer;
+    uint64_t t0;
+
+    ip_addr_set_ip4_u32(&peer, lwip_htonl(lwip_ntohl(ip4_addr_get_u32(self)) ^ 1U));
+    LOCK_TCPIP_CORE();
+    pcb = udp_new();
+    udp_connect(pcb, &peer, HOST_UDP_PORT);
+    udp_tpl_init(&t, pcb);
+    linkoutput = host_netif.linkoutput;
+    host_netif.linkoutput = host_null_linkoutput;
+    UNLOCK_TCPIP_CORE();
+    t0 = host_ns();
+    for (uint32_t i = 0; i < HOST_BENCH_ITER; i++) {
+        LOCK_TCPIP_CORE();
+        struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, HOST_UDP_LEN, PBUF_RAM);
+        if (p != NULL) {
+            (void)(tpl ? udp_tpl_send(&t, p) : udp_send(pcb, p));
+            pbuf_free(p);
+        }
+        UNLOCK_TCPIP_CORE();
+    }
+    host_bench_report("udp_tx", tpl ? "path=tpl " : "path=udp_send ", host_ns() - t0, HOST_BENCH_ITER);
+    LOCK_TCPIP_CORE();
+    host_netif.linkoutput = linkoutput;
+    udp_remove(pcb);
+    UNLOCK_TCPIP_CORE();
+}
+#endif
+
+/*
+ * TCP loss recovery: request/response exchanges over a connection between
+ * two netifs joined back to back, every Nth data segment (either way)
+ * dropped after a lossless warm-up. With one request outstanding there
+ * are no duplicate ACKs, so each drop costs one retransmission timeout;
+ * ns per exchange shows what the RTO granularity costs (TCP_RTO_MS).
+ */
+typedef struct {
+    struct netif netif[2];      /* client side, server side */
+    struct tcp_pcb* listener;
+    struct tcp_pcb* client;
+    struct tcp_pcb* server;
+    sys_sem_t done;
+    uint32_t every;
+    uint32_t segs;
+    uint32_t drops;
+    uint32_t exchanges;
+    uint32_t req_rx;
+    uint32_t rsp_rx;
+    uint64_t t0;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+} HostLoss_t;
+
+static HostLoss_t host_loss;
+
+static void host_loss_deliver(void* arg)
+{
+    struct pbuf* p = (struct pbuf*)arg;
+    struct netif* netif = netif_get_by_index(p->if_idx);
+
+    if (netif != NULL) {
+        ip_input(p, netif);
+    } else {
+        pbuf_free(p);           /* queued before the netifs were removed */
+    }
+}
+
+/* netif output: to the other netif, through the tcpip mailbox so that
+   tcp_output() is not reentered */
+static err_t host_loss_output(struct netif* netif, struct pbuf* p, const ip4_addr_t* ipaddr)
+{
+    const struct ip_hdr* iph = (const struct ip_hdr*)p->payload;
+    struct netif* peer = (netif == &host_loss.netif[0]) ? &host_loss.netif[1] : &host_loss.netif[0];
+    struct pbuf* q;
+
+    (void)ipaddr;
+    if ((IPH_PROTO(iph) == IP_PROTO_TCP) && (host_loss.every != 0U) &&
+        (host_loss.exchanges >= HOST_LOSS_WARMUP)) {
+        const struct tcp_hdr* tcph = (const struct tcp_hdr*)((const uint8_t*)iph + IPH_HL_BYTES(iph));
+        if ((lwip_ntohs(IPH_LEN(iph)) > IPH_HL_BYTES(iph) + TCPH_HDRLEN_BYTES(tcph)) &&
+            ((++host_loss.segs % host_loss.every) == 0U)) {
+            host_loss.drops++;
+            return ERR_OK;
+        }
+    }
+    /* received into PBUF_POOL, as the TAP netif and the driver do */
+    q = pbuf_clone(PBUF_RAW, PBUF_POOL, p);
+    if (q == NULL) {
+        return ERR_MEM;
+    }
+    q->if_idx = netif_get_index(peer);
+    if (tcpip_try_callback(host_loss_deliver, q) != ERR_OK) {
+        pbuf_free(q);
+        return ERR_MEM;
+    }
+    return ERR_OK;
+}
+
+static err_t host_loss_netif_init(struct netif* netif)
+{
+    netif->name[0] = 'l';
+    netif->name[1] = 's';
+    netif->output = host_loss_output;
+    netif->mtu = 1500U;
+    netif->flags = NETIF_FLAG_LINK_UP;
+    return ERR_OK;
+}
+
+/* The netif pair, 10.99.0.1 and .2; call with the core locked */
+static void host_link_up(uint32_t every)
+{
+    ip4_addr_t ip;
+    ip4_addr_t mask;
+
+    memset(&host_loss, 0, sizeof(host_loss));
+    host_loss.every = every;
+    IP4_ADDR(&mask, 255, 255, 255, 0);
+    for (int i = 0; i < 2; i++) {
+        IP4_ADDR(&ip, 10, 99, 0, i + 1);
+        netif_add(&host_loss.netif[i], &ip, &mask, IP4_ADDR_ANY4, NULL, host_loss_netif_init, ip_input);
+        netif_set_up(&host_loss.netif[i]);
+    }
+}
+
+static void host_link_down(void)
+{
+    netif_remove(&host_loss.netif[0]);
+    netif_remove(&host_loss.netif[1]);
+}
+
+static void host_loss_request(struct tcp_pcb* pcb)
+{
+    static const uint8_t req[HOST_LOSS_REQ_LEN] = { 0, 1, 0, 0, 0, 6, 1, 3, 0, 0, 0, 1 };
+
+    host_loss.t0 = host_ns();
+    tcp_write(pcb, req, sizeof(req), TCP_WRITE_FLAG_COPY);
+    tcp_output(pcb);
+}
+
+static err_t host_loss_server_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    static const uint8_t rsp[HOST_LOSS_RSP_LEN];
+
+    (void)arg;
+    (void)err;
+    if (p == NULL) {
+        return ERR_OK;
+    }
+    tcp_recved(pcb, p->tot_len);
+    host_loss.req_rx += p->tot_len;
+    pbuf_free(p);
+    while (host_loss.req_rx >= HOST_LOSS_REQ_LEN) {
+        host_loss.req_rx -= HOST_LOSS_REQ_LEN;
+        tcp_write(pcb, rsp, sizeof(rsp), 0);
+    }
+    tcp_output(pcb);
+    return ERR_OK;
+}
+
+static err_t host_loss_accept(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+    (void)arg;
+    if ((err != ERR_OK) || (pcb == NULL)) {
+        return ERR_VAL;
+    }
+    tcp_bind_netif(pcb, &host_loss.netif[1]);
+    tcp_nagle_disable(pcb);
+    tcp_recv(pcb, host_loss_server_recv);
+    host_loss.server = pcb;
+    return ERR_OK;
+}
+
+static err_t host_loss_client_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    (void)arg;
+    (void)err;
+    if (p == NULL) {
+        return ERR_OK;
+    }
+    tcp_recved(pcb, p->tot_len);
+    host_loss.rsp_rx += p->tot_len;
+    pbuf_free(p);
+    while (host_loss.rsp_rx >= HOST_LOSS_RSP_LEN) {
+        uint64_t ns = host_ns() - host_loss.t0;
+        host_loss.rsp_rx -= HOST_LOSS_RSP_LEN;
+        if (host_loss.exchanges >= HOST_LOSS_WARMUP) {
+            host_loss.sum_ns += ns;
+            host_loss.max_ns = LWIP_MAX(host_loss.max_ns, ns);
+        }
+        if (++host_loss.exchanges == HOST_LOSS_WARMUP + HOST_LOSS_EXCHANGES) {
+            sys_sem_signal(&host_loss.done);
+            return ERR_OK;
+        }
+        host_loss_request(pcb);
+    }
+    return ERR_OK;
+}
+
+static err_t host_loss_connected(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+    (void)arg;
+    (void)err;
+    host_loss_request(pcb);
+    return ERR_OK;
+}
+
+static void host_bench_loss(uint32_t every)
+{
+    char extra[96];
+    struct tcp_pcb* pcb;
+
+    LOCK_TCPIP_CORE();
+    host_link_up(every);
+    sys_sem_new(&host_loss.done, 0);
+    pcb = tcp_new();
+    tcp_bind(pcb, netif_ip_addr4(&host_loss.netif[1]), HOST_LOSS_PORT);
+    host_loss.listener = tcp_listen(pcb);
+    tcp_accept(host_loss.listener, host_loss_accept);
+    host_loss.client = tcp_new();
+    tcp_bind(host_loss.client, netif_ip_addr4(&host_loss.netif[0]), 0);
+    tcp_bind_netif(host_loss.client, &host_loss.netif[0]);
+    tcp_nagle_disable(host_loss.client);
+    tcp_recv(host_loss.client, host_loss_client_recv);
+    tcp_connect(host_loss.client, netif_ip_addr4(&host_loss.netif[1]), HOST_LOSS_PORT, host_loss_connected);
+    UNLOCK_TCPIP_CORE();
+
+    if (sys_arch_sem_wait(&host_loss.done, 120000U) == SYS_ARCH_TIMEOUT) {
+        printf("bench=tcp_loss timeout exchanges=%lu\n", (unsigned long)host_loss.exchanges);
+    } else {
+        snprintf(extra, sizeof(extra), "rto=%s drop_every=%lu drops=%lu max_us=%lu ",
+                 TCP_RTO_MS ? "ms" : "tick", (unsigned long)every, (unsigned long)host_loss.drops,
+                 (unsigned long)(host_loss.max_ns / 1000U));
+        host_bench_report("tcp_loss", extra, host_loss.sum_ns, HOST_LOSS_EXCHANGES);
+    }
+
+    LOCK_TCPIP_CORE();
+    tcp_abort(host_loss.client);
+    if (host_loss.server != NULL) {
+        tcp_abort(host_loss.server);
+    }
+    tcp_close(host_loss.listener);
+    host_link_down();
+    UNLOCK_TCPIP_CORE();
+    sys_sem_free(&host_loss.done);
+}
+
+/*
+ * Datagram sockets over the netif pair: rounds of HOST_UDP_BATCH datagrams
+ * sent and received, with a call per datagram (sendto/recvfrom) or per
+ * round (sendmmsg/recvmmsg, LWIP_NETCONN_BATCH).
+ */
+static void host_bench_udp(int batch)
+{
+    static uint8_t data[HOST_UDP_BATCH][HOST_UDP_LEN];
+    const uint32_t rounds = HOST_BENCH_ITER / 10U / HOST_UDP_BATCH;
+    struct sockaddr_in to;
+    char extra[48];
+    uint64_t t0;
+    int tx;
+    int rx;
+#if LWIP_NETCONN_BATCH
+    struct iovec iov[HOST_UDP_BATCH];
+    struct mmsghdr smsg[HOST_UDP_BATCH];
+    struct mmsghdr rmsg[HOST_UDP_BATCH];
+#endif
+#if NETCONN_RX_COPY
+    struct netconn_rx_copy_stats c0;
+    struct netconn_rx_copy_stats c1;
+#endif
+
+    LOCK_TCPIP_CORE();
+    host_link_up(0U);
+    UNLOCK_TCPIP_CORE();
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_port = lwip_htons(HOST_UDP_PORT);
+    inet_addr_from_ip4addr(&to.sin_addr, netif_ip4_addr(&host_loss.netif[1]));
+    rx = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+    tx = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+    lwip_bind(rx, (struct sockaddr*)&to, sizeof(to));
+#if LWIP_NETCONN_BATCH
+    memset(smsg, 0, sizeof(smsg));
+    memset(rmsg, 0, sizeof(rmsg));
+    for (uint32_t i = 0; i < HOST_UDP_BATCH; i++) {
+        iov[i].iov_base = data[i];
+        iov[i].iov_len = HOST_UDP_LEN;
+        smsg[i].msg_hdr.msg_name = &to;
+        smsg[i].msg_hdr.msg_namelen = sizeof(to);
+        smsg[i].msg_hdr.msg_iov = &iov[i];
+        smsg[i].msg_hdr.msg_iovlen = 1;
+        rmsg[i].msg_hdr.msg_iov = &iov[i];
+        rmsg[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+
+#if NETCONN_RX_COPY
+    netconn_rx_copy_get_stats(&c0);
+#endif
+    t0 = host_ns();
+    for (uint32_t r = 0; r < rounds; r++) {
+#if LWIP_NETCONN_BATCH
+        if (batch) {
+            int got = 0;
+            lwip_sendmmsg(tx, smsg, HOST_UDP_BATCH, 0);
+            while (got < (int)HOST_UDP_BATCH) {
+                int n = lwip_recvmmsg(rx, &rmsg[got], HOST_UDP_BATCH - (unsigned int)got, 0);
+                if (n <= 0) {
+                    break;
+                }
+                got += n;
+            }
+            continue;
+        }
+#endif
+        for (uint32_t i = 0; i < HOST_UDP_BATCH; i++) {
+            lwip_sendto(tx, data[i], HOST_UDP_LEN, 0, (struct sockaddr*)&to, sizeof(to));
+        }
+        for (uint32_t i = 0; i < HOST_UDP_BATCH; i++) {
+            lwip_recvfrom(rx, data[i], HOST_UDP_LEN, 0, NULL, NULL);
+        }
+    }
+    t0 = host_ns() - t0;
+    snprintf(extra, sizeof(extra), "calls=%s batch=%u ", batch ? "mmsg" : "single", (unsigned)HOST_UDP_BATCH);
+#if NETCONN_RX_COPY
+    /* datagrams queued behind NETCONN_RX_COPY_DEPTH others are copied */
+    netconn_rx_copy_get_stats(&c1);
+    snprintf(extra + strlen(extra), sizeof(extra) - strlen(extra), "copied=%lu ",
+             (unsigned long)(c1.copied - c0.copied));
+#endif
+    host_bench_report("udp_socket", extra, t0, rounds * HOST_UDP_BATCH);
+
+    lwip_close(tx);
+    lwip_close(rx);
+    LOCK_TCPIP_CORE();
+    host_link_down();
+    UNLOCK_TCPIP_CORE();
+}
+
+static int host_bench(const HostArgs_t* a)
+{
+    printf("bench=info iterations=%lu\n", (unsigned long)HOST_BENCH_ITER);
+    host_bench_chksum();
+    host_bench_lz4();
+    host_bench_mqtt_sub();
+    host_bench_pbuf("ram", PBUF_RAM, 1514U);
+    host_bench_pbuf("pool", PBUF_POOL, 1514U);
+    host_bench_pbuf("ref", PBUF_REF, 0U);
+    host_bench_tcpip();
+    host_bench_rx();
+#if UDP_TPL
+    host_bench_udp_tx(0);
+    host_bench_udp_tx(1);
+#endif
+    host_bench_logger();
+    host_bench_log_stress();
+    host_bench_udp(0);
+#if LWIP_NETCONN_BATCH
+    host_bench_udp(1);
+#endif
+    host_bench_loss((uint32_t)a->loss);
+    printf("bench=done\n");
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Timer wheel against a model */
+
+#if LWIP_TIMERS_CUSTOM && TWHEEL_LWIP
+typedef struct {
+    uint32_t armed_at;
+    uint32_t msecs;
+    uint32_t due;       /* as sys_timeout() rounds it */
+    uint8_t armed;
+    uint8_t rearm;      /* armed again from its handler */
+} HostTwTimer_t;
+
+static HostTwTimer_t host_tw[HOST_TW_TIMERS];
+static uint32_t host_tw_count;
+static uint32_t host_tw_now;
+static uint32_t host_tw_fired;
+static uint32_t host_tw_errors;
+static int host_tw_draining;
+
+static void host_tw_error(const char* what, const HostTwTimer_t* t)
+{
+    if (host_tw_errors++ < HOST_TEST_REPORT) {
+        printf("twheel %s timer=%u now=0x%08lx armed_at=0x%08lx msecs=%lu due=0x%08lx\n", what,
+               (unsigned)(t - host_tw), (unsigned long)host_tw_now, (unsigned long)t->armed_at,
+               (unsigned long)t->msecs, (unsigned long)t->due);
+    }
+}
+
+/* Mostly level 0 and 1, now and then up to the longest sys_timeout() */
+static uint32_t host_tw_msecs(void)
+{
+    uint32_t r = host_rand();
+
+    switch (r & 7U) {
+    case 0: return 0U;
+    case 1: case 2: case 3: return (r >> 8) % 64U;
+    case 4: case 5: return (r >> 8) % 4096U;
+    case 6: return (r >> 8) % 300000U;
+    default: return host_rand() % (LWIP_UINT32_MAX / 4U + 1U);
+    }
+}
+
+static uint32_t host_tw_advance(void)
+{
+    uint32_t r = host_rand();
+
+    switch (r & 15U) {
+    case 0: return (r >> 8) % 70000U;
+    case 1: return (r >> 8) % 5000000U;
+    default: return (r >> 8) % 20U;
+    }
+}
+
+static void host_tw_fire(void* arg);
+
+static void host_tw_arm(HostTwTimer_t* t)
+{
+    uint32_t due = host_tw_now + (t->msecs = host_tw_msecs());
+
+#if TWHEEL_SLACK_MS
+    if (t->msecs >= TWHEEL_SLACK_MIN_MS) {
+        due = ((due + TWHEEL_SLACK_MS - 1U) / TWHEEL_SLACK_MS) * TWHEEL_SLACK_MS;
+    }
+#endif
+    t->armed_at = host_tw_now;
+    t->due = due;
+    t->armed = 1U;
+    t->rearm = !host_tw_draining && ((host_rand() & 3U) == 0U);
+    if ((uint32_t)(due - (host_tw_now + t->msecs)) >= TWHEEL_SLACK_MS + 1U) {
+        host_tw_error("slack", t);
+    }
+    sys_timeout(t->msecs, host_tw_fire, t);
+}
+
+static void host_tw_fire(void* arg)
+{
+    HostTwTimer_t* t = arg;
+
+    host_tw_fired++;
+    if (!t->armed) {
+        host_tw_error("stale", t);
+        return;
+    }
+    if ((int32_t)(host_tw_now - t->due) < 0) {
+        host_tw_error("early", t);
+    }
+    t->armed = 0U;
+    if (t->rearm) {
+        host_tw_arm(t);
+    }
+}
+
+/* sys_check_timeouts() at the model's time: every timer due fired, the
+ * sleep time no longer than to the next one */
+static void host_tw_check(void)
+{
+    uint32_t next = SYS_TIMEOUTS_SLEEPTIME_INFINITE;
+    uint32_t sleep;
+
+    sys_now_set(1, host_tw_now);
+    sys_check_timeouts();
+    for (uint32_t i = 0U; i < host_tw_count; i++) {
+        const HostTwTimer_t* t = &host_tw[i];
+
+        if (!t->armed) {
+            continue;
+        }
+        if ((int32_t)(host_tw_now - t->due) >= 0) {
+            host_tw_error("late", t);
+        } else if ((uint32_t)(t->due - host_tw_now) < next) {
+            next = t->due - host_tw_now;
+        }
+    }
+    sleep = sys_timeouts_sleeptime();
+    if (sleep > next) {
+        if (host_tw_errors++ < HOST_TEST_REPORT) {
+            printf("twheel oversleep now=0x%08lx sleep=%lu next=%lu\n", (unsigned long)host_tw_now,
+                   (unsigned long)sleep, (unsigned long)next);
+        }
+    }
+}
+
+/* write() is lwip_write() here; the wheel spins, not in stdio */
+static void host_tw_hang(int sig)
+{
+    (void)sig;
+    fputs("twheel hang\n", stdout);
+    fflush(stdout);
+    _exit(1);
+}
+
+static int host_twheel(void)
+{
+    TWheelStats_t base;
+    TWheelStats_t s;
+    uint32_t armed = 1U;
+    uint32_t rounds = 0U;
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    signal(SIGALRM, host_tw_hang);
+    alarm(HOST_TW_HANG_S);
+
+    LOCK_TCPIP_CORE();
+    /* The stack's own timers start over on the simulated clock */
+    host_tw_now = HOST_TW_START;
+    sys_now_set(1, host_tw_now);
+    sys_timeouts_init();
+    twheel_get_stats(&base);
+    host_tw_count = LWIP_MIN(HOST_TW_TIMERS, MEMP_NUM_SYS_TIMEOUT - base.used);
+
+    for (uint32_t step = 0U; step < HOST_TW_STEPS; step++) {
+        uint32_t r = host_rand();
+        HostTwTimer_t* t = &host_tw[(r >> 8) % host_tw_count];
+
+        switch (r & 3U) {
+        case 0:
+            if (t->armed) {
+                sys_untimeout(host_tw_fire, t);
+                t->armed = 0U;
+                break;
+            }
+            /* fall through */
+        case 1:
+            if (!t->armed) {
+                host_tw_arm(t);
+            }
+            break;
+        default:
+            host_tw_now += host_tw_advance();
+            host_tw_check();
+            break;
+        }
+    }
+
+    /* Everything still armed runs out, none armed again; one that never
+     * fires stays "late" */
+    host_tw_draining = 1;
+    for (uint32_t i = 0U; i < host_tw_count; i++) {
+        host_tw[i].rearm = 0U;
+    }
+    while ((armed != 0U) && (rounds++ <= (LWIP_UINT32_MAX / 4U) / HOST_TW_DRAIN_MS + 1U)) {
+        host_tw_now += HOST_TW_DRAIN_MS;
+        host_tw_check();
+        armed = 0U;
+        for (uint32_t i = 0U; i < host_tw_count; i++) {
+            armed += host_tw[i].armed;
+        }
+    }
+    twheel_get_stats(&s);
+    if (s.used != base.used) {
+        printf("twheel leak used=%lu base=%lu\n", (unsigned long)s.used, (unsigned long)base.used);
+        host_tw_errors++;
+    }
+
+    /* Back on the clock */
+    alarm(0);
+    sys_now_set(0, 0U);
+    sys_timeouts_init();
+    UNLOCK_TCPIP_CORE();
+
+    printf("twheel timers=%lu steps=%lu fired=%lu cascades=%lu alloc_fail=%lu end=0x%08lx errors=%lu\n",
+           (unsigned long)host_tw_count, (unsigned long)HOST_TW_STEPS, (unsigned long)host_tw_fired,
+           (unsigned long)s.cascades, (unsigned long)s.alloc_fail, (unsigned long)host_tw_now,
+           (unsigned long)host_tw_errors);
+    return (host_tw_errors != 0U || s.alloc_fail != 0U) ? 1 : 0;
+}
+#endif /* LWIP_TIMERS_CUSTOM && TWHEEL_LWIP */
+
+/*---------------------------------------------------------------------------*/
+/* Telemetry CBOR round trip */
+
+/* Every type; > 23 fields, so the array head takes a length byte */
+#define HOST_CBOR_ALL(F) \
+    F(u8, u8)            \
+    F(u16, u16)          \
+    F(u32, u32)          \
+    F(u64, u64)          \
+    F(i32, i32)          \
+    F(f32, f32)          \
+    F(bool, b)
+#define HOST_CBOR_WIDE(F) \
+    HOST_CBOR_ALL(F)      \
+    F(i32, n0) F(i32, n1) F(i32, n2) F(i32, n3) F(u8, s0) F(u8, s1) F(u16, s2) F(u16, s3) \
+    F(u32, s4) F(u64, s5) F(f32, f0) F(f32, f1) F(f32, f2) F(bool, t0) F(bool, t1) F(bool, t2) \
+    F(u32, last)
+TELEMETRY_CBOR_SCHEMA(HostCborAll, HOST_CBOR_ALL)
+TELEMETRY_CBOR_SCHEMA(HostCborWide, HOST_CBOR_WIDE)
+
+typedef struct {
+    const uint8_t* p;
+    uint32_t left;
+} HostCborIn_t;
+
+/* Written from RFC 8949, not from the encoder: one item with initial byte
+ * ib and an n-byte big-endian argument */
+static bool host_cbor_item(HostCborIn_t* in, uint8_t ib, uint32_t n, uint64_t* arg)
+{
+    if (in->left < 1U + n || in->p[0] != ib) {
+        return false;
+    }
+    *arg = 0U;
+    for (uint32_t i = 1U; i <= n; i++) {
+        *arg = (*arg << 8) | in->p[i];
+    }
+    in->p += 1U + n;
+    in->left -= 1U + n;
+    return true;
+}
+
+static bool host_cbor_get_u8(HostCborIn_t* in, uint8_t* v)
+{
+    uint64_t a;
+
+    return host_cbor_item(in, 0x18U, 1U, &a) && ((*v = (uint8_t)a), true);
+}
+
+static bool host_cbor_get_u16(HostCborIn_t* in, uint16_t* v)
+{
+    uint64_t a;
+
+    return host_cbor_item(in, 0x19U, 2U, &a) && ((*v = (uint16_t)a), true);
+}
+
+static bool host_cbor_get_u32(HostCborIn_t* in, uint32_t* v)
+{
+    uint64_t a;
+
+    return host_cbor_item(in, 0x1aU, 4U, &a) && ((*v = (uint32_t)a), true);
+}
+
+static bool host_cbor_get_u64(HostCborIn_t* in, uint64_t* v)
+{
+    return host_cbor_item(in, 0x1bU, 8U, v);
+}
+
+/* Major type 0 for >= 0, 1 (-1 - argument) below */
+static bool host_cbor_get_i32(HostCborIn_t* in, int32_t* v)
+{
+    uint64_t a;
+
+    if (host_cbor_item(in, 0x1aU, 4U, &a) && a <= (uint64_t)INT32_MAX) {
+        *v = (int32_t)a;
+        return true;
+    }
+    if (host_cbor_item(in, 0x3aU, 4U, &a) && a <= (uint64_t)INT32_MAX) {
+        *v = (int32_t)(-1 - (int64_t)a);
+        return true;
+    }
+    return false;
+}
+
+static bool host_cbor_get_f32(HostCborIn_t* in, float* v)
+{
+    uint64_t a;
+    uint32_t bits;
+
+    if (!host_cbor_item(in, 0xfaU, 4U, &a)) {
+        return false;
+    }
+    bits = (uint32_t)a;
+    memcpy(v, &bits, sizeof(bits));
+    return true;
+}
+
+static bool host_cbor_get_bool(HostCborIn_t* in, bool* v)
+{
+    uint64_t a;
+
+    if (host_cbor_item(in, 0xf5U, 0U, &a)) {
+        *v = true;
+        return true;
+    }
+    return host_cbor_item(in, 0xf4U, 0U, &a) && ((*v = false), true);
+}
+
+static bool host_cbor_get_array(HostCborIn_t* in, uint32_t n)
+{
+    uint64_t a;
+
+    if (n < 24U) {
+        return host_cbor_item(in, (uint8_t)(0x80U | n), 0U, &a);
+    }
+    if (n < 256U) {
+        return host_cbor_item(in, 0x98U, 1U, &a) && a == n;
+    }
+    return host_cbor_item(in, 0x99U, 2U, &a) && a == n;
+}
+
+/* Random bits, edge values now and then; floats by bit pattern, NaNs
+ * included */
+static void host_cbor_fill(void* v, size_t len)
+{
+    uint8_t* b = v;
+    uint32_t r = host_rand();
+
+    if ((r & 7U) == 0U) {
+        memset(b, (r & 8U) ? 0xFF : 0x00, len);
+        if ((r & 16U) && len > 1U) {
+            b[len - 1U] ^= 0x80U;   /* INT_MIN / INT_MAX, -0.0f */
+        }
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        b[i] = (uint8_t)host_rand();
+    }
+}
+
+/* Fields of *rv; a bool (the only 1-byte encoding) is 0 or 1 */
+#define HOST_CBOR_RAND_(type, name)                                              \
+    if (TELEMETRY_CBOR_LEN_##type == 1U) {                                       \
+        memset(&rv->name, (int)(host_rand() & 1U), sizeof(rv->name));            \
+    } else {                                                                     \
+        host_cbor_fill(&rv->name, sizeof(rv->name));                             \
+    }
+#define HOST_CBOR_GET_(type, name)                                               \
+    ok = ok && host_cbor_get_##type(&in, &got.name) &&                           \
+         memcmp(&got.name, &want->name, sizeof(want->name)) == 0;
+
+/* Encodes v through the MQTT output ring, starting at ring offset start,
+ * and decodes it back; false on any difference */
+#define HOST_CBOR_ROUND(Name, FIELDS, v, start)                                   \
+    ({                                                                            \
+        static struct mqtt_ringbuf_t rb;                                          \
+        struct mqtt_payload_out out;                                              \
+        uint8_t enc[Name##_CBOR_LEN];                                             \
+        HostCborIn_t in = { enc, Name##_CBOR_LEN };                               \
+        const Name##_t* want = &(v);                                              \
+        Name##_t got;                                                             \
+        bool ok;                                                                  \
+                                                                                  \
+        memset(&rb, 0, sizeof(rb));                                               \
+        rb.put = rb.get = (u16_t)((start) % MQTT_OUTPUT_RINGBUF_SIZE);            \
+        out.rb = &rb;                                                             \
+        out.left = Name##_CBOR_LEN;                                               \
+        Name##_cbor((void*)want, &out);                                           \
+        for (uint32_t i = 0U; i < Name##_CBOR_LEN; i++) {                         \
+            enc[i] = rb.buf[(rb.get + i) % MQTT_OUTPUT_RINGBUF_SIZE];             \
+        }                                                                         \
+        memset(&got, 0, sizeof(got));                                             \
+        ok = (out.left == 0U) &&                                                  \
+             (uint16_t)(rb.put - rb.get + MQTT_OUTPUT_RINGBUF_SIZE) % MQTT_OUTPUT_RINGBUF_SIZE == \
+                 Name##_CBOR_LEN &&                                               \
+             host_cbor_get_array(&in, Name##_CBOR_FIELDS);                        \
+        FIELDS(HOST_CBOR_GET_)                                                    \
+        ok && in.left == 0U;                                                      \
+    })
+
+static int host_cbor(void)
+{
+    /* 255, 65535, 1000000, 2^64 - 1, -1000, 1.5, true (RFC 8949 appendix A
+     * values, full width) */
+    static const uint8_t golden[] = {
+        0x87, 0x18, 0xff, 0x19, 0xff, 0xff, 0x1a, 0x00, 0x0f, 0x42, 0x40,
+        0x1b, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x3a, 0x00, 0x00, 0x03, 0xe7, 0xfa, 0x3f, 0xc0, 0x00, 0x00, 0xf5,
+    };
+    HostCborAll_t g = { 255U, 65535U, 1000000U, UINT64_MAX, -1000, 1.5f, true };
+    struct mqtt_ringbuf_t rb;
+    struct mqtt_payload_out out = { &rb, HostCborAll_CBOR_LEN };
+    uint32_t errors = 0U;
+
+    _Static_assert(sizeof(golden) == HostCborAll_CBOR_LEN, "golden length");
+    memset(&rb, 0, sizeof(rb));
+    HostCborAll_cbor(&g, &out);
+    if (memcmp(rb.buf, golden, sizeof(golden)) != 0) {
+        printf("cbor golden mismatch\n");
+        errors++;
+    }
+
+    for (uint32_t round = 0U; round < HOST_CBOR_ROUNDS; round++) {
+        HostCborAll_t v;
+        HostCborWide_t w;
+
+        memset(&v, 0, sizeof(v));
+        memset(&w, 0, sizeof(w));
+        {
+            HostCborAll_t* rv = &v;
+            HOST_CBOR_ALL(HOST_CBOR_RAND_)
+        }
+        if (!HOST_CBOR_ROUND(HostCborAll, HOST_CBOR_ALL, v, round)) {
+            if (errors++ < HOST_TEST_REPORT) {
+                printf("cbor mismatch schema=all round=%lu\n", (unsigned long)round);
+            }
+        }
+        {
+            HostCborWide_t* rv = &w;
+            HOST_CBOR_WIDE(HOST_CBOR_RAND_)
+        }
+        if (!HOST_CBOR_ROUND(HostCborWide, HOST_CBOR_WIDE, w, round * 7U)) {
+            if (errors++ < HOST_TEST_REPORT) {
+                printf("cbor mismatch schema=wide round=%lu\n", (unsigned long)round);
+            }
+        }
+    }
+    printf("cbor rounds=%lu len_all=%u len_wide=%u errors=%lu\n", (unsigned long)HOST_CBOR_ROUNDS,
+           (unsigned)HostCborAll_CBOR_LEN, (unsigned)HostCborWide_CBOR_LEN, (unsigned long)errors);
+    return (errors != 0U) ? 1 : 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* pcap replay */
+
+static int host_replay(const HostArgs_t* a)
+{
+    static uint8_t frame[HOST_PCAP_SNAP];
+    uint32_t frames = 0U;
+    uint64_t t0;
+    uint64_t ns;
+    FILE* f = fopen(a->replay, "rb");
+    uint32_t gh[6];
+
+    if (f == NULL) {
+        perror(a->replay);
+        return 1;
+    }
+    /* Little endian, microsecond or nanosecond magic, Ethernet link type */
+    if (fread(gh, sizeof(gh), 1, f) != 1 || (gh[0] != 0xA1B2C3D4U && gh[0] != 0xA1B23C4DU) || gh[5] != 1U) {
+        fprintf(stderr, "%s: not an Ethernet pcap file\n", a->replay);
+        fclose(f);
+        return 1;
+    }
+    t0 = host_ns();
+    for (unsigned long loop = 0; loop < a->loops; loop++) {
+        uint32_t rh[4];
+        fseek(f, (long)sizeof(gh), SEEK_SET);
+        while (fread(rh, sizeof(rh), 1, f) == 1) {
+            uint32_t len = rh[2];
+            if (len > sizeof(frame) || fread(frame, 1, len, f) != len) {
+                break;
+            }
+            if (len > 0xFFFFU) {
+                continue;
+            }
+            LOCK_TCPIP_CORE();
+            struct pbuf* p = pbuf_alloc(PBUF_RAW, (u16_t)len, PBUF_POOL);
+            if (p != NULL) {
+                pbuf_take(p, frame, (u16_t)len);
+                ethernet_input(p, &host_netif);
+            }
+            UNLOCK_TCPIP_CORE();
+            frames++;
+        }
+    }
+    ns = host_ns() - t0;
+    fclose(f);
+    printf("replay frames=%lu ns_per_frame=%lu\n", (unsigned long)frames,
+           (unsigned long)((frames != 0U) ? ns / frames : 0U));
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* MQTT publish rate */
+
+static int host_mqtt(const HostArgs_t* a)
+{
+    static const bool by_ref[] = { false, true };
+    ip_addr_t broker;
+    int rc = 0;
+
+    if (!ipaddr_aton(a->broker, &broker)) {
+        fprintf(stderr, "invalid broker address\n");
+        return 1;
+    }
+    for (size_t i = 0; i < LWIP_ARRAYSIZE(by_ref); i++) {
+        MqttBenchResult_t r;
+        const char* name = by_ref[i] ? "mqtt_ref" : "mqtt_copy";
+
+        if (!mqtt_bench_run(&broker, MQTT_PORT, (uint32_t)a->count, (uint16_t)a->len, by_ref[i], &r)) {
+            printf("bench=%s failed\n", name);
+            rc = 1;
+            continue;
+        }
+        printf("bench=%s msgs=%lu len=%lu ms=%lu per_s=%lu kbps=%lu retries=%lu\n", name, (unsigned long)r.msgs,
+               a->len, (unsigned long)r.ms, (unsigned long)r.per_s, (unsigned long)r.kbps,
+               (unsigned long)r.retries);
+    }
+    return rc;
+}
+
+/*---------------------------------------------------------------------------*/
+/* SNTP and the disciplined clock */
+
+/* TIM6 in place: anchors time_now_ns() every millisecond */
+static void* host_tick(void* arg)
+{
+    (void)arg;
+    for (;;) {
+        usleep(1000);
+        time_ns_tick();
+    }
+    return NULL;
+}
+
+static void host_time_report(void)
+{
+    TimesyncStats_t t;
+    SntpClientStats_t s;
+    struct timespec now;
+    uint64_t utc;
+
+    LOCK_TCPIP_CORE();
+    timesync_get_stats(&t);
+    sntp_client_get_stats(&s);
+    UNLOCK_TCPIP_CORE();
+    utc = time_utc_ns() / 1000U;
+    clock_gettime(CLOCK_REALTIME, &now);
+    printf("time synced=%d offset_us=%ld delay_us=%lu slew_us=%ld freq_ppb=%ld steps=%lu samples=%lu "
+           "requests=%lu timeouts=%lu bad=%lu vs_host_us=%lld\n",
+           (int)t.synced, (long)t.offset_us, (unsigned long)t.delay_us, (long)t.slew_us, (long)t.freq_ppb,
+           (unsigned long)t.steps, (unsigned long)t.samples, (unsigned long)s.requests,
+           (unsigned long)s.timeouts, (unsigned long)(s.bad + s.kod + s.dns_fail),
+           (long long)((int64_t)utc - ((int64_t)now.tv_sec * 1000000LL + now.tv_nsec / 1000)));
+    fflush(stdout);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void host_usage(const char* prog)
+{
+    fprintf(stderr,
+            "usage: %s [-t tap] [-a ip] [-m mask] [-g gw] [-s syslog_ip] [-p] [-N ntp_ip] [-d lease_file]\n"
+            "       %s -r frames.pcap [-n loops]\n"
+            "       %s -b [-L drop_every]\n"
+            "       %s -w\n"
+            "       %s -C\n"
+            "       %s [-t tap] [-a ip] ... -q broker_ip [-c count] [-l len]\n", prog, prog, prog, prog, prog, prog);
+}
+
+int main(int argc, char** argv)
+{
+    HostArgs_t a = { "tap0", "192.168.7.2", "255.255.255.0", "192.168.7.1", NULL, NULL, NULL, NULL, NULL, 1U, HOST_MQTT_COUNT, HOST_MQTT_LEN, HOST_LOSS_EVERY, 0, 0, 0, 0 };
+    pthread_t tick;
+    int opt;
+
+    time_ns_init();
+    pthread_create(&tick, NULL, host_tick, NULL);
+    pthread_detach(tick);
+
+    while ((opt = getopt(argc, argv, "t:a:m:g:s:r:n:q:c:l:N:L:d:bwCph")) != -1) {
+        switch (opt) {
+        case 't': a.tap = optarg; break;
+        case 'a': a.ip = optarg; break;
+        case 'm': a.mask = optarg; break;
+        case 'g': a.gw = optarg; break;
+        case 's': a.syslog_ip = optarg; break;
+        case 'r': a.replay = optarg; break;
+        case 'n': a.loops = strtoul(optarg, NULL, 0); break;
+        case 'q': a.broker = optarg; break;
+        case 'c': a.count = strtoul(optarg, NULL, 0); break;
+        case 'l': a.len = strtoul(optarg, NULL, 0); break;
+        case 'N': a.ntp = optarg; break;
+        case 'd': a.lease = optarg; break;
+        case 'L': a.loss = strtoul(optarg, NULL, 0); break;
+        case 'b': a.bench = 1; break;
+        case 'w': a.twheel = 1; break;
+        case 'C': a.cbor = 1; break;
+        case 'p': a.capture = 1; break;
+        default: host_usage(argv[0]); return 2;
+        }
+    }
+
+    sys_sem_new(&host_ready, 0);
+    tcpip_init(host_tcpip_ready, NULL);
+    sys_arch_sem_wait(&host_ready, 0);
+
+#if LWIP_TIMERS_CUSTOM && TWHEEL_LWIP
+    if (a.twheel) {
+        return host_twheel();
+    }
+#endif
+    if (a.cbor) {
+        return host_cbor();
+    }
+    if (a.bench || a.replay != NULL) {
+        /* No device: transmitted frames are counted and dropped */
+        a.lease = NULL;
+        if (!host_netif_up(&a, tapif_init_null)) {
+            return 1;
+        }
+        init_logger((a.syslog_ip != NULL) ? a.syslog_ip : a.gw, SYSLOG_SERVER_PORT);
+        return a.bench ? host_bench(&a) : host_replay(&a);
+    }
+
+    if (!host_netif_up(&a, tapif_init)) {
+        return 1;
+    }
+    init_logger((a.syslog_ip != NULL) ? a.syslog_ip : a.gw, SYSLOG_SERVER_PORT);
+    if (a.broker != NULL) {
+        return host_mqtt(&a);
+    }
+    LOCK_TCPIP_CORE();
+    lwiperf_start_tcp_server_default(host_iperf_report, NULL);
+    UNLOCK_TCPIP_CORE();
+    pcap_ring_init();
+    metrics_init();
+    diag_httpd_init();
+    ctrl_chan_start(CTRL_CHAN_PORT, NULL, NULL);
+    twamp_light_start();
+    work_pool_start();
+    modbus_tcp_start(NULL);
+    ota_start();
+    telemetry_agg_start();
+#if TELEMETRY_MCAST
+    telemetry_mcast_start();
+#endif
+    log_ctl_start();
+    if (a.capture) {
+        pcap_ring_start();
+    }
+    if (a.ntp != NULL) {
+        sntp_client_start(a.ntp, NULL);
+    }
+    if (a.lease != NULL) {
+        printf("up on %s, address from DHCP\n", a.tap);
+    } else {
+        printf("up on %s as %s, iperf -c %s\n", a.tap, a.ip, a.ip);
+    }
+    fflush(stdout);
+
+    for (;;) {
+        TapIfStats_t s;
+        sleep(10);
+        tapif_get_stats(&s);
+        LOG_INFO(HOST_TAG, "rx %lu frames %lu bytes %lu drops, tx %lu frames %lu bytes %lu errors",
+                 (unsigned long)s.rx_frames, (unsigned long)s.rx_bytes, (unsigned long)s.rx_drops,
+                 (unsigned long)s.tx_frames, (unsigned long)s.tx_bytes, (unsigned long)s.tx_errors);
+        if (a.ntp != NULL) {
+            host_time_report();
+        }
+    }
+}
@@ -0,0 +1,57 @@
+/**
+ * @file board_host.c
+ * @brief Host build: board.h timestamps from the host clock.
+ */
+
+#include "main.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Same "YYYY-MM-DD HH:MM:SS[.mmm]" text as the RTC version */
+static char* board_format(const struct timespec* ts, char* buffer, size_t buffer_size)
+{
+    struct tm tm;
+
+    if (buffer_size < 20) {
+        if (buffer_size > 0) buffer[0] = '\0';
+        return buffer;
+    }
+    localtime_r(&ts->tv_sec, &tm);
+    strftime(buffer, buffer_size, "%Y-%m-%d %H:%M:%S", &tm);
+#if BOARD_TIMESTAMP_MS
+    if (buffer_size >= BOARD_TIMESTAMP_LEN) {
+        snprintf(buffer + 19, buffer_size - 19, ".%03ld", ts->tv_nsec / 1000000L);
+    }
+#endif
+    return buffer;
+}
+
+char* board_get_timestamp(char* buffer, size_t buffer_size)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return board_format(&ts, buffer, buffer_size);
+}
+
+char* board_get_timestamp_at(uint32_t tick, char* buffer, size_t buffer_size)
+{
+    struct timespec ts;
+    int32_t age = (int32_t)(HAL_GetTick() - tick);
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    if (age > 0) {
+        int64_t ns = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec - (int64_t)age * 1000000LL;
+        ts.tv_sec = (time_t)(ns / 1000000000LL);
+        ts.tv_nsec = (long)(ns % 1000000000LL);
+    }
+    return board_format(&ts, buffer, buffer_size);
+}
+
+void Error_Handler(void)
+{
+    fprintf(stderr, "Error_Handler\n");
+    abort();
+}
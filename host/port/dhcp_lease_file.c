@@ -0,0 +1,68 @@
+/**
+ * @file dhcp_lease_file.c
+ * @brief Host build: DHCP lease store in a file, dated by the host clock.
+ */
+
+#include "port/dhcp_lease_file.h"
+#include "dhcpc/dhcp_client.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#define DHCP_LEASE_FILE_MAGIC 0x44484C45UL /* "DHLE" */
+
+typedef struct {
+    uint32_t magic;
+    DhcpLease_t lease;
+} DhcpLeaseFile_t;
+
+static const char* dhcp_lease_path;
+
+void dhcp_lease_file_set(const char* path)
+{
+    dhcp_lease_path = path;
+}
+
+bool dhcp_lease_load(DhcpLease_t* lease)
+{
+    DhcpLeaseFile_t f;
+    FILE* fp;
+    bool ok;
+
+    if (dhcp_lease_path == NULL || (fp = fopen(dhcp_lease_path, "rb")) == NULL) {
+        return false;
+    }
+    ok = fread(&f, sizeof(f), 1, fp) == 1 && f.magic == DHCP_LEASE_FILE_MAGIC;
+    fclose(fp);
+    if (ok) {
+        *lease = f.lease;
+    }
+    return ok && !ip4_addr_isany_val(lease->addr);
+}
+
+void dhcp_lease_save(const DhcpLease_t* lease)
+{
+    DhcpLeaseFile_t f = { 0 };
+    FILE* fp;
+
+    if (dhcp_lease_path == NULL) {
+        return;
+    }
+    if (lease == NULL) {
+        (void)remove(dhcp_lease_path);
+        return;
+    }
+    if ((fp = fopen(dhcp_lease_path, "wb")) == NULL) {
+        return;
+    }
+    f.magic = DHCP_LEASE_FILE_MAGIC;
+    f.lease = *lease;
+    (void)fwrite(&f, sizeof(f), 1, fp);
+    fclose(fp);
+}
+
+bool dhcp_lease_clock(uint32_t* sec)
+{
+    *sec = (uint32_t)time(NULL);
+    return true;
+}
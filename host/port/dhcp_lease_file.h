@@ -0,0 +1,24 @@
+/**
+ * @file dhcp_lease_file.h
+ * @brief Host build: the DHCP lease store of component/dhcpc in a file, in
+ *        place of the RTC backup registers.
+ */
+
+#pragma once
+
+#ifndef HOST_DHCP_LEASE_FILE_H
+#define HOST_DHCP_LEASE_FILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* File for dhcp_lease_load() and dhcp_lease_save(); the string must stay
+ * valid. Without one nothing is kept. */
+void dhcp_lease_file_set(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_DHCP_LEASE_FILE_H */
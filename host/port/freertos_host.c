@@ -0,0 +1,228 @@
+/**
+ * @file freertos_host.c
+ * @brief Host build: FreeRTOS tasks, notifications and mutexes on POSIX
+ *        threads, enough to run component/logger unchanged.
+ */
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include "stm32h7xx_hal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct HostMutex_s {
+    pthread_mutex_t lock;
+};
+
+static pthread_mutex_t host_critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static __thread TaskHandle_t host_self;
+
+static void host_abstime(struct timespec* ts, TickType_t ticks)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ticks / 1000U;
+    ts->tv_nsec += (long)(ticks % 1000U) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void host_task_init(StaticTask_t* t, const char* name)
+{
+    memset(t, 0, sizeof(*t));
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    strncpy(t->name, name, sizeof(t->name) - 1U);
+}
+
+uint32_t HAL_GetTick(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000U + ts.tv_nsec / 1000000L);
+}
+
+uint32_t host_cycles(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000U + ts.tv_nsec / 1000L);
+}
+
+UBaseType_t host_critical_enter(void)
+{
+    pthread_mutex_lock(&host_critical);
+    return 0U;
+}
+
+void host_critical_exit(UBaseType_t mask)
+{
+    (void)mask;
+    pthread_mutex_unlock(&host_critical);
+}
+
+static void* host_task_entry(void* p)
+{
+    StaticTask_t* t = p;
+
+    host_self = t;
+    t->fn(t->arg);
+    return NULL;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char* name, uint32_t depth, void* arg,
+                               UBaseType_t prio, StackType_t* stack, StaticTask_t* tcb)
+{
+    (void)depth;
+    (void)prio;
+    (void)stack;
+
+    host_task_init(tcb, name);
+    tcb->fn = fn;
+    tcb->arg = arg;
+    if (pthread_create(&tcb->thread, NULL, host_task_entry, tcb) != 0) {
+        return NULL;
+    }
+    pthread_detach(tcb->thread);
+    pthread_setname_np(tcb->thread, tcb->name);
+    return tcb;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    /* Only self-deletion is used */
+    if (task == NULL || task == host_self) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep((useconds_t)ticks * 1000U);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return HAL_GetTick();
+}
+
+/* Threads not created by xTaskCreateStatic() (main, lwIP) get their task
+ * on first use, for the notification and TLS slots. */
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (host_self == NULL) {
+        StaticTask_t* t = malloc(sizeof(*t));
+        configASSERT(t != NULL);
+        host_task_init(t, "host");
+        t->thread = pthread_self();
+        host_self = t;
+    }
+    return host_self;
+}
+
+BaseType_t xTaskGetSchedulerState(void)
+{
+    return taskSCHEDULER_RUNNING;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    TaskHandle_t t = xTaskGetCurrentTaskHandle();
+    uint32_t value;
+
+    pthread_mutex_lock(&t->lock);
+    if (t->notify == 0U && ticks != 0U) {
+        if (ticks == portMAX_DELAY) {
+            while (t->notify == 0U) {
+                pthread_cond_wait(&t->cond, &t->lock);
+            }
+        } else {
+            struct timespec ts;
+            host_abstime(&ts, ticks);
+            while (t->notify == 0U) {
+                if (pthread_cond_timedwait(&t->cond, &t->lock, &ts) == ETIMEDOUT) {
+                    break;
+                }
+            }
+        }
+    }
+    value = t->notify;
+    if (value != 0U) {
+        t->notify = (clear != pdFALSE) ? 0U : value - 1U;
+    }
+    pthread_mutex_unlock(&t->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken)
+{
+    (void)xTaskNotifyGive(task);
+    if (woken != NULL) {
+        *woken = pdFALSE;
+    }
+}
+
+void* pvTaskGetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index)
+{
+    if (task == NULL) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    return (index < configNUM_THREAD_LOCAL_STORAGE_POINTERS) ? task->tls[index] : NULL;
+}
+
+void vTaskSetThreadLocalStoragePointer(TaskHandle_t task, BaseType_t index, void* value)
+{
+    if (task == NULL) {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    if (index < configNUM_THREAD_LOCAL_STORAGE_POINTERS) {
+        task->tls[index] = value;
+    }
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t m = malloc(sizeof(*m));
+
+    if (m != NULL) {
+        pthread_mutex_init(&m->lock, NULL);
+    }
+    return m;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    struct timespec ts;
+
+    if (ticks == portMAX_DELAY) {
+        return (pthread_mutex_lock(&sem->lock) == 0) ? pdTRUE : pdFALSE;
+    }
+    if (ticks == 0U) {
+        return (pthread_mutex_trylock(&sem->lock) == 0) ? pdTRUE : pdFALSE;
+    }
+    host_abstime(&ts, ticks);
+    return (pthread_mutex_timedlock(&sem->lock, &ts) == 0) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return (pthread_mutex_unlock(&sem->lock) == 0) ? pdTRUE : pdFALSE;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file ota_flash_mem.c
+ * @brief Host build: the inactive bank of component/ota in memory, erased
+ *        and programmed at once.
+ */
+
+#include "ota/ota.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Not blank, as the bank of a board holding an older image */
+static uint8_t ota_flash_mem[OTA_FLASH_SIZE];
+
+bool ota_flash_init(void)
+{
+    memset(ota_flash_mem, 0, sizeof(ota_flash_mem));
+    return true;
+}
+
+const uint8_t* ota_flash_map(uint32_t offset, uint32_t len)
+{
+    (void)len;
+    return &ota_flash_mem[offset];
+}
+
+void ota_flash_erase(uint32_t sector)
+{
+    memset(&ota_flash_mem[sector * OTA_FLASH_SECTOR_SIZE], 0xFF, OTA_FLASH_SECTOR_SIZE);
+}
+
+void ota_flash_program(uint32_t offset, const uint32_t* word)
+{
+    memcpy(&ota_flash_mem[offset], word, OTA_FLASH_WORD);
+}
+
+bool ota_flash_busy(void)
+{
+    return false;
+}
+
+uint32_t ota_flash_errors(void)
+{
+    return 0U;
+}
+
+void ota_flash_swap(void)
+{
+    printf("ota: would boot the new image\n");
+    exit(0);
+}
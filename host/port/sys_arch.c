@@ -0,0 +1,548 @@
+/**
+ * @file sys_arch.c
+ * @brief Host build: lwIP semaphores, mutexes, mailboxes and threads on
+ *        POSIX threads, plus the core locking checks of lwipopts.h.
+ */
+
+#include "lwip/opt.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct sys_sem_host {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned int count;
+};
+
+struct sys_mutex_host {
+    pthread_mutex_t lock;
+};
+
+struct sys_mbox_host {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    unsigned int size;
+    unsigned int head;
+    unsigned int count;
+    void* msgs[];
+};
+
+static pthread_mutex_t sys_protect_lock;
+static pthread_t sys_core_lock_holder;
+static int sys_core_lock_held;
+static pthread_t sys_tcpip_thread;
+static int sys_tcpip_thread_marked;
+
+/* Thread flag of the target sys_notify(): one pending wake-up per thread */
+#define SYS_NOTIFY_THREADS 16
+
+static struct {
+    pthread_t thread;
+    int used;
+    int pending;
+} sys_notify_slots[SYS_NOTIFY_THREADS];
+static pthread_mutex_t sys_notify_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sys_notify_cond;
+
+/* sys_now_set() */
+static volatile int sys_now_held;
+static volatile u32_t sys_now_held_ms;
+
+static void sys_abstime(struct timespec* ts, u32_t timeout_ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += timeout_ms / 1000U;
+    ts->tv_nsec += (long)(timeout_ms % 1000U) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static void sys_cond_init(pthread_cond_t* cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* Waits on cond, timeout_ms 0 for ever. Returns the time waited or
+ * SYS_ARCH_TIMEOUT. */
+static u32_t sys_cond_wait(pthread_cond_t* cond, pthread_mutex_t* lock, u32_t timeout_ms, u32_t start)
+{
+    if (timeout_ms == 0U) {
+        pthread_cond_wait(cond, lock);
+    } else {
+        struct timespec ts;
+        u32_t elapsed = sys_now() - start;
+        if (elapsed >= timeout_ms) {
+            return SYS_ARCH_TIMEOUT;
+        }
+        sys_abstime(&ts, timeout_ms - elapsed);
+        if (pthread_cond_timedwait(cond, lock, &ts) == ETIMEDOUT) {
+            return SYS_ARCH_TIMEOUT;
+        }
+    }
+    return sys_now() - start;
+}
+
+void sys_init(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&sys_protect_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    sys_cond_init(&sys_notify_cond);
+}
+
+void sys_now_set(int held, u32_t ms)
+{
+    sys_now_held_ms = ms;
+    sys_now_held = held;
+}
+
+u32_t sys_now(void)
+{
+    struct timespec ts;
+
+    if (sys_now_held) {
+        return sys_now_held_ms;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u32_t)(ts.tv_sec * 1000U + ts.tv_nsec / 1000000L);
+}
+
+u32_t sys_jiffies(void)
+{
+    return sys_now();
+}
+
+/*-----------------------------------------------------------------------------------*/
+err_t sys_sem_new(sys_sem_t* sem, u8_t count)
+{
+    struct sys_sem_host* s = calloc(1, sizeof(*s));
+
+    if (s == NULL) {
+        *sem = NULL;
+        return ERR_MEM;
+    }
+    pthread_mutex_init(&s->lock, NULL);
+    sys_cond_init(&s->cond);
+    s->count = count;
+    *sem = s;
+    return ERR_OK;
+}
+
+void sys_sem_free(sys_sem_t* sem)
+{
+    struct sys_sem_host* s = *sem;
+
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+    *sem = NULL;
+}
+
+void sys_sem_signal(sys_sem_t* sem)
+{
+    struct sys_sem_host* s = *sem;
+
+    pthread_mutex_lock(&s->lock);
+    s->count++;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+u32_t sys_arch_sem_wait(sys_sem_t* sem, u32_t timeout)
+{
+    struct sys_sem_host* s = *sem;
+    u32_t start = sys_now();
+    u32_t waited = 0U;
+
+    pthread_mutex_lock(&s->lock);
+    while (s->count == 0U) {
+        waited = sys_cond_wait(&s->cond, &s->lock, timeout, start);
+        if (waited == SYS_ARCH_TIMEOUT) {
+            pthread_mutex_unlock(&s->lock);
+            return SYS_ARCH_TIMEOUT;
+        }
+    }
+    s->count--;
+    pthread_mutex_unlock(&s->lock);
+    return waited;
+}
+
+int sys_sem_valid(sys_sem_t* sem)
+{
+    return (sem != NULL) && (*sem != NULL);
+}
+
+void sys_sem_set_invalid(sys_sem_t* sem)
+{
+    *sem = NULL;
+}
+
+#if LWIP_NETCONN_SEM_PER_THREAD
+/* The calling thread's netconn semaphore in C thread-local storage; the
+ * target keeps it in a FreeRTOS TLS slot */
+static __thread sys_sem_t sys_netconn_sem;
+
+sys_sem_t* sys_arch_netconn_sem_get(void)
+{
+    if (sys_netconn_sem == NULL) {
+        sys_arch_netconn_sem_alloc();
+    }
+    return &sys_netconn_sem;
+}
+
+void sys_arch_netconn_sem_alloc(void)
+{
+    err_t err = sys_sem_new(&sys_netconn_sem, 0);
+
+    LWIP_ASSERT("sys_arch_netconn_sem_alloc: out of memory", err == ERR_OK);
+    LWIP_UNUSED_ARG(err);
+}
+
+void sys_arch_netconn_sem_free(void)
+{
+    if (sys_netconn_sem != NULL) {
+        sys_sem_free(&sys_netconn_sem);
+    }
+}
+#endif
+
+/*-----------------------------------------------------------------------------------*/
+err_t sys_mutex_new(sys_mutex_t* mutex)
+{
+    struct sys_mutex_host* m = calloc(1, sizeof(*m));
+
+    if (m == NULL) {
+        *mutex = NULL;
+        return ERR_MEM;
+    }
+    pthread_mutex_init(&m->lock, NULL);
+    *mutex = m;
+    return ERR_OK;
+}
+
+void sys_mutex_free(sys_mutex_t* mutex)
+{
+    pthread_mutex_destroy(&(*mutex)->lock);
+    free(*mutex);
+    *mutex = NULL;
+}
+
+void sys_mutex_lock(sys_mutex_t* mutex)
+{
+    pthread_mutex_lock(&(*mutex)->lock);
+}
+
+void sys_mutex_unlock(sys_mutex_t* mutex)
+{
+    pthread_mutex_unlock(&(*mutex)->lock);
+}
+
+int sys_mutex_valid(sys_mutex_t* mutex)
+{
+    return (mutex != NULL) && (*mutex != NULL);
+}
+
+void sys_mutex_set_invalid(sys_mutex_t* mutex)
+{
+    *mutex = NULL;
+}
+
+/*-----------------------------------------------------------------------------------*/
+err_t sys_mbox_new(sys_mbox_t* mbox, int size)
+{
+    struct sys_mbox_host* m;
+
+    if (size <= 0) {
+        size = 16;
+    }
+    m = calloc(1, sizeof(*m) + (size_t)size * sizeof(void*));
+    if (m == NULL) {
+        *mbox = NULL;
+        return ERR_MEM;
+    }
+    pthread_mutex_init(&m->lock, NULL);
+    sys_cond_init(&m->not_empty);
+    sys_cond_init(&m->not_full);
+    m->size = (unsigned int)size;
+    *mbox = m;
+    return ERR_OK;
+}
+
+void sys_mbox_free(sys_mbox_t* mbox)
+{
+    struct sys_mbox_host* m = *mbox;
+
+    pthread_cond_destroy(&m->not_full);
+    pthread_cond_destroy(&m->not_empty);
+    pthread_mutex_destroy(&m->lock);
+    free(m);
+    *mbox = NULL;
+}
+
+static void sys_mbox_put_locked(struct sys_mbox_host* m, void* msg)
+{
+    m->msgs[(m->head + m->count) % m->size] = msg;
+    m->count++;
+    pthread_cond_signal(&m->not_empty);
+}
+
+void sys_mbox_post(sys_mbox_t* mbox, void* msg)
+{
+    struct sys_mbox_host* m = *mbox;
+
+    pthread_mutex_lock(&m->lock);
+    while (m->count == m->size) {
+        pthread_cond_wait(&m->not_full, &m->lock);
+    }
+    sys_mbox_put_locked(m, msg);
+    pthread_mutex_unlock(&m->lock);
+}
+
+err_t sys_mbox_trypost(sys_mbox_t* mbox, void* msg)
+{
+    struct sys_mbox_host* m = *mbox;
+    err_t err = ERR_MEM;
+
+    pthread_mutex_lock(&m->lock);
+    if (m->count < m->size) {
+        sys_mbox_put_locked(m, msg);
+        err = ERR_OK;
+    }
+    pthread_mutex_unlock(&m->lock);
+    return err;
+}
+
+err_t sys_mbox_trypost_front(sys_mbox_t* mbox, void* msg)
+{
+    struct sys_mbox_host* m = *mbox;
+    err_t err = ERR_MEM;
+
+    pthread_mutex_lock(&m->lock);
+    if (m->count < m->size) {
+        m->head = (m->head + m->size - 1U) % m->size;
+        m->msgs[m->head] = msg;
+        m->count++;
+        pthread_cond_signal(&m->not_empty);
+        err = ERR_OK;
+    }
+    pthread_mutex_unlock(&m->lock);
+    return err;
+}
+
+err_t sys_mbox_trypost_fromisr(sys_mbox_t* mbox, void* msg)
+{
+    return sys_mbox_trypost(mbox, msg);
+}
+
+static void* sys_mbox_get_locked(struct sys_mbox_host* m)
+{
+    void* msg = m->msgs[m->head];
+
+    m->head = (m->head + 1U) % m->size;
+    m->count--;
+    pthread_cond_signal(&m->not_full);
+    return msg;
+}
+
+u32_t sys_arch_mbox_fetch(sys_mbox_t* mbox, void** msg, u32_t timeout)
+{
+    struct sys_mbox_host* m = *mbox;
+    u32_t start = sys_now();
+    u32_t waited = 0U;
+    void* got;
+
+    pthread_mutex_lock(&m->lock);
+    while (m->count == 0U) {
+        waited = sys_cond_wait(&m->not_empty, &m->lock, timeout, start);
+        if (waited == SYS_ARCH_TIMEOUT) {
+            pthread_mutex_unlock(&m->lock);
+            if (msg != NULL) {
+                *msg = NULL;
+            }
+            return SYS_ARCH_TIMEOUT;
+        }
+    }
+    got = sys_mbox_get_locked(m);
+    pthread_mutex_unlock(&m->lock);
+    if (msg != NULL) {
+        *msg = got;
+    }
+    return waited;
+}
+
+u32_t sys_arch_mbox_tryfetch(sys_mbox_t* mbox, void** msg)
+{
+    struct sys_mbox_host* m = *mbox;
+    void* got;
+
+    pthread_mutex_lock(&m->lock);
+    if (m->count == 0U) {
+        pthread_mutex_unlock(&m->lock);
+        return SYS_MBOX_EMPTY;
+    }
+    got = sys_mbox_get_locked(m);
+    pthread_mutex_unlock(&m->lock);
+    if (msg != NULL) {
+        *msg = got;
+    }
+    return 0U;
+}
+
+int sys_mbox_valid(sys_mbox_t* mbox)
+{
+    return (mbox != NULL) && (*mbox != NULL);
+}
+
+void sys_mbox_set_invalid(sys_mbox_t* mbox)
+{
+    *mbox = NULL;
+}
+
+/*-----------------------------------------------------------------------------------*/
+typedef struct {
+    lwip_thread_fn fn;
+    void* arg;
+} SysThreadStart_t;
+
+static void* sys_thread_entry(void* p)
+{
+    SysThreadStart_t start = *(SysThreadStart_t*)p;
+
+    free(p);
+    start.fn(start.arg);
+    return NULL;
+}
+
+/* Stack size and priority are the target's, the host scheduler decides */
+sys_thread_t sys_thread_new(const char* name, lwip_thread_fn thread, void* arg, int stacksize, int prio)
+{
+    SysThreadStart_t* start = malloc(sizeof(*start));
+    pthread_t tid;
+
+    LWIP_UNUSED_ARG(stacksize);
+    LWIP_UNUSED_ARG(prio);
+    LWIP_ASSERT("sys_thread_new: out of memory", start != NULL);
+    start->fn = thread;
+    start->arg = arg;
+    if (pthread_create(&tid, NULL, sys_thread_entry, start) != 0) {
+        LWIP_ASSERT("sys_thread_new: pthread_create failed", 0);
+    }
+    pthread_detach(tid);
+    pthread_setname_np(tid, name);
+    return tid;
+}
+
+/*-----------------------------------------------------------------------------------*/
+/* Thread flag of the target sys_notify(); call with sys_notify_lock held */
+static int* sys_notify_pending(pthread_t thread)
+{
+    int i;
+    int free_slot = -1;
+
+    for (i = 0; i < SYS_NOTIFY_THREADS; i++) {
+        if (sys_notify_slots[i].used && pthread_equal(sys_notify_slots[i].thread, thread)) {
+            return &sys_notify_slots[i].pending;
+        }
+        if (!sys_notify_slots[i].used && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+    LWIP_ASSERT("sys_notify: too many threads", free_slot >= 0);
+    sys_notify_slots[free_slot].thread = thread;
+    sys_notify_slots[free_slot].used = 1;
+    return &sys_notify_slots[free_slot].pending;
+}
+
+sys_thread_t sys_notify_self(void)
+{
+    return pthread_self();
+}
+
+void sys_notify(sys_thread_t thread)
+{
+    pthread_mutex_lock(&sys_notify_lock);
+    *sys_notify_pending(thread) = 1;
+    pthread_cond_broadcast(&sys_notify_cond);
+    pthread_mutex_unlock(&sys_notify_lock);
+}
+
+u32_t sys_notify_wait(u32_t timeout)
+{
+    u32_t start = sys_now();
+    u32_t res = 0;
+    int* pending;
+
+    pthread_mutex_lock(&sys_notify_lock);
+    pending = sys_notify_pending(pthread_self());
+    while (!*pending) {
+        if (sys_cond_wait(&sys_notify_cond, &sys_notify_lock, timeout, start) == SYS_ARCH_TIMEOUT) {
+            res = SYS_ARCH_TIMEOUT;
+            break;
+        }
+    }
+    *pending = 0;
+    pthread_mutex_unlock(&sys_notify_lock);
+    return res;
+}
+
+sys_prot_t sys_arch_protect(void)
+{
+    pthread_mutex_lock(&sys_protect_lock);
+    return 1;
+}
+
+void sys_arch_unprotect(sys_prot_t pval)
+{
+    LWIP_UNUSED_ARG(pval);
+    pthread_mutex_unlock(&sys_protect_lock);
+}
+
+/*-----------------------------------------------------------------------------------*/
+/* Same contract as the target functions in ethernetif.c */
+void sys_lock_tcpip_core(void)
+{
+    sys_mutex_lock(&lock_tcpip_core);
+    sys_core_lock_holder = pthread_self();
+    sys_core_lock_held = 1;
+}
+
+void sys_unlock_tcpip_core(void)
+{
+    sys_core_lock_held = 0;
+    sys_mutex_unlock(&lock_tcpip_core);
+}
+
+void sys_check_core_locking(void)
+{
+    if (sys_tcpip_thread_marked) {
+#if LWIP_TCPIP_CORE_LOCKING
+        LWIP_ASSERT("Function called without core lock",
+                    sys_core_lock_held && pthread_equal(sys_core_lock_holder, pthread_self()));
+#else
+        LWIP_ASSERT("Function called from wrong thread", pthread_equal(sys_tcpip_thread, pthread_self()));
+#endif
+    }
+}
+
+void sys_mark_tcpip_thread(void)
+{
+    sys_tcpip_thread = pthread_self();
+    sys_tcpip_thread_marked = 1;
+}
@@ -0,0 +1,183 @@
+/**
+ * @file tapif.c
+ * @brief Host build: Linux TAP netif.
+ */
+
+#include "tapif.h"
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/etharp.h"
+#include "lwip/igmp.h"
+#include "netif/ethernet.h"
+#include "lwip/sys.h"
+#include "pcap/pcap_ring.h"
+#include "timesync/time_ns.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+
+#define TAPIF_MTU       1500U
+#define TAPIF_FRAME_MAX 1536U
+/* meta_flags: meta_stamp is the host cycle count at the receive, the
+ * ETHIF_META_STAMP of the target driver */
+#define TAPIF_META_STAMP 0x01U
+
+static TapIfStats_t tapif_stats;
+static int tapif_fd = -1;
+
+static void tapif_count(uint32_t* counter, uint32_t n)
+{
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+static err_t tapif_output(struct netif* netif, struct pbuf* p)
+{
+    uint8_t frame[TAPIF_FRAME_MAX];
+    u16_t len;
+
+    LWIP_UNUSED_ARG(netif);
+    if (p->tot_len > sizeof(frame)) {
+        tapif_count(&tapif_stats.tx_errors, 1U);
+        return ERR_IF;
+    }
+    len = pbuf_copy_partial(p, frame, p->tot_len, 0);
+    if (tapif_fd >= 0 && write(tapif_fd, frame, len) != (ssize_t)len) {
+        tapif_count(&tapif_stats.tx_errors, 1U);
+        return ERR_IF;
+    }
+    pcap_ring_tap(p);
+    tapif_count(&tapif_stats.tx_frames, 1U);
+    tapif_count(&tapif_stats.tx_bytes, len);
+    return ERR_OK;
+}
+
+#if LWIP_IGMP
+/* A TAP device takes every frame, there is no filter to program */
+static err_t tapif_igmp_mac_filter(struct netif* netif, const ip4_addr_t* group,
+                                   enum netif_mac_filter_action action)
+{
+    LWIP_UNUSED_ARG(netif);
+    LWIP_UNUSED_ARG(group);
+    LWIP_UNUSED_ARG(action);
+    return ERR_OK;
+}
+#endif
+
+int tapif_rx_time(const struct pbuf* p, uint64_t* mono_ns, uint64_t* utc_ns)
+{
+    uint64_t mono;
+
+    if ((p->meta_flags & TAPIF_META_STAMP) == 0U) {
+        return 0;
+    }
+    mono = time_ns_at_cycles(p->meta_stamp);
+    if (mono_ns != NULL) {
+        *mono_ns = mono;
+    }
+    if (utc_ns != NULL) {
+        *utc_ns = time_utc_ns_at(mono);
+    }
+    return 1;
+}
+
+err_t tapif_inject(struct netif* netif, const void* frame, uint16_t len)
+{
+    struct pbuf* p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+
+    if (p == NULL) {
+        tapif_count(&tapif_stats.rx_drops, 1U);
+        return ERR_MEM;
+    }
+    pbuf_take(p, frame, len);
+    p->meta_stamp = TIME_NS_CYCLES();
+    p->meta_flags = TAPIF_META_STAMP;
+    pcap_ring_tap(p);
+    if (netif->input(p, netif) != ERR_OK) {
+        pbuf_free(p);
+        tapif_count(&tapif_stats.rx_drops, 1U);
+        return ERR_MEM;
+    }
+    tapif_count(&tapif_stats.rx_frames, 1U);
+    tapif_count(&tapif_stats.rx_bytes, len);
+    return ERR_OK;
+}
+
+static void tapif_thread(void* arg)
+{
+    struct netif* netif = arg;
+    uint8_t frame[TAPIF_FRAME_MAX];
+
+    for (;;) {
+        ssize_t len = read(tapif_fd, frame, sizeof(frame));
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("tapif: read");
+            return;
+        }
+        if (len > 0) {
+            (void)tapif_inject(netif, frame, (uint16_t)len);
+        }
+    }
+}
+
+err_t tapif_init_null(struct netif* netif)
+{
+    static const uint8_t mac[6] = { 0x02, 0x00, 0x5E, 0x48, 0x37, 0x01 };
+
+    netif->name[0] = 't';
+    netif->name[1] = 'p';
+    netif->output = etharp_output;
+    netif->linkoutput = tapif_output;
+    netif->mtu = TAPIF_MTU;
+    netif->hwaddr_len = ETH_HWADDR_LEN;
+    memcpy(netif->hwaddr, mac, sizeof(mac));
+    netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_ETHERNET | NETIF_FLAG_IGMP |
+                   NETIF_FLAG_LINK_UP;
+#if LWIP_IGMP
+    netif_set_igmp_mac_filter(netif, tapif_igmp_mac_filter);
+#endif
+    return ERR_OK;
+}
+
+err_t tapif_init(struct netif* netif)
+{
+    const char* name = (netif->state != NULL) ? (const char*)netif->state : "tap0";
+    struct ifreq ifr;
+
+    tapif_fd = open("/dev/net/tun", O_RDWR);
+    if (tapif_fd < 0) {
+        perror("tapif: /dev/net/tun");
+        return ERR_IF;
+    }
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    strncpy(ifr.ifr_name, name, sizeof(ifr.ifr_name) - 1U);
+    if (ioctl(tapif_fd, TUNSETIFF, &ifr) < 0) {
+        perror("tapif: TUNSETIFF");
+        close(tapif_fd);
+        tapif_fd = -1;
+        return ERR_IF;
+    }
+    tapif_init_null(netif);
+    sys_thread_new("TapIf", tapif_thread, netif, 0, 0);
+    return ERR_OK;
+}
+
+void tapif_get_stats(TapIfStats_t* stats)
+{
+    stats->rx_frames = __atomic_load_n(&tapif_stats.rx_frames, __ATOMIC_RELAXED);
+    stats->rx_bytes = __atomic_load_n(&tapif_stats.rx_bytes, __ATOMIC_RELAXED);
+    stats->rx_drops = __atomic_load_n(&tapif_stats.rx_drops, __ATOMIC_RELAXED);
+    stats->tx_frames = __atomic_load_n(&tapif_stats.tx_frames, __ATOMIC_RELAXED);
+    stats->tx_bytes = __atomic_load_n(&tapif_stats.tx_bytes, __ATOMIC_RELAXED);
+    stats->tx_errors = __atomic_load_n(&tapif_stats.tx_errors, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,45 @@
+/**
+ * @file tapif.h
+ * @brief Host build: Linux TAP device as the lwIP netif, in place of
+ *        LWIP/Target/ethernetif.c.
+ */
+
+#pragma once
+
+#ifndef HOST_TAPIF_H
+#define HOST_TAPIF_H
+
+#include "lwip/netif.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t rx_frames;
+    uint32_t rx_bytes;
+    uint32_t rx_drops;      /* no pbuf, or the tcpip mailbox was full */
+    uint32_t tx_frames;
+    uint32_t tx_bytes;
+    uint32_t tx_errors;
+} TapIfStats_t;
+
+/* netif_add() init function; netif->state is the device name ("tap0"),
+ * which must exist and be up (ip tuntap add tap0 mode tap user $USER).
+ * Starts the receive thread, which hands frames to netif->input. */
+err_t tapif_init(struct netif* netif);
+
+/* Same as tapif_init() without a device: frames (tx) are counted and
+ * dropped, frames come in through tapif_inject() only. */
+err_t tapif_init_null(struct netif* netif);
+
+/* Hands one frame to netif->input as the receive thread would. */
+err_t tapif_inject(struct netif* netif, const void* frame, uint16_t len);
+
+void tapif_get_stats(TapIfStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_TAPIF_H */